@@ -8,6 +8,7 @@
 #include <eosio/chain/asset.hpp>
 #include <eosio/chain/exceptions.hpp>
 #include <fc/io/raw.hpp>
+#include <fc/io/json.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <fc/io/varint.hpp>
 
@@ -49,6 +50,31 @@ namespace eosio { namespace chain {
       );
    }
 
+   static_assert( sizeof(name) == sizeof(uint64_t), "name arrays are read as packed" );
+
+   /// name arrays are decoded straight into the variants, by names_to_strings()
+   auto pack_unpack_name() {
+      auto generic = pack_unpack<name>();
+      return std::make_pair<abi_serializer::unpack_function, abi_serializer::pack_function>(
+         [unpack = std::move( generic.first )]( fc::datastream<const char*>& stream, bool is_array, bool is_optional) -> fc::variant  {
+            if( !is_array )
+               return unpack( stream, is_array, is_optional );
+            fc::unsigned_int size;
+            fc::raw::unpack( stream, size );
+            EOS_ASSERT( size.value * sizeof(uint64_t) <= stream.remaining(), unpack_exception, "name array exceeds the data" );
+            vector<name> names( size.value );
+            stream.read( reinterpret_cast<char*>( names.data() ), size.value * sizeof(uint64_t) );
+            auto strings = names_to_strings( names.data(), names.size() );
+            fc::variants result;
+            result.reserve( strings.size() );
+            for( auto& s : strings )
+               result.emplace_back( std::move( s ) );
+            return fc::variant( std::move( result ) );
+         },
+         std::move( generic.second )
+      );
+   }
+
    abi_serializer::abi_serializer( const abi_def& abi, const fc::microseconds& max_serialization_time ) {
       configure_built_in_types();
       set_abi(abi, max_serialization_time);
@@ -84,7 +110,7 @@ namespace eosio { namespace chain {
       built_in_types.emplace("time_point_sec",            pack_unpack<fc::time_point_sec>());
       built_in_types.emplace("block_timestamp_type",      pack_unpack<block_timestamp_type>());
 
-      built_in_types.emplace("name",                      pack_unpack<name>());
+      built_in_types.emplace("name",                      pack_unpack_name());
 
       built_in_types.emplace("bytes",                     pack_unpack<bytes>());
       built_in_types.emplace("string",                    pack_unpack<string>());
@@ -397,6 +423,127 @@ namespace eosio { namespace chain {
       return _binary_to_variant(type, binary, ctx);
    }
 
+   size_t abi_serializer::_binary_to_json( const std::string_view& type, fc::datastream<const char *>& stream,
+                                           string& out, bool first, impl::binary_to_variant_context& ctx )const
+   {
+      auto h = ctx.enter_scope();
+      auto s_itr = structs.find(type);
+      EOS_ASSERT( s_itr != structs.end(), invalid_type_inside_abi, "Unknown type ${type}", ("type",ctx.maybe_shorten(type)) );
+      ctx.hint_struct_type_if_in_array( s_itr );
+      const auto& st = s_itr->second;
+      size_t fields = 0;
+      if( st.base != type_name() ) {
+         fields = _binary_to_json(resolve_type(st.base), stream, out, first, ctx);
+      }
+      bool encountered_extension = false;
+      for( uint32_t i = 0; i < st.fields.size(); ++i ) {
+         const auto& field = st.fields[i];
+         bool extension = ends_with(field.type, "$");
+         encountered_extension |= extension;
+         if( !stream.remaining() ) {
+            if( extension ) {
+               continue;
+            }
+            if( encountered_extension ) {
+               EOS_THROW( abi_exception, "Encountered field '${f}' without binary extension designation while processing struct '${p}'",
+                          ("f", ctx.maybe_shorten(field.name))("p", ctx.get_path_string()) );
+            }
+            EOS_THROW( unpack_exception, "Stream unexpectedly ended; unable to unpack field '${f}' of struct '${p}'",
+                       ("f", ctx.maybe_shorten(field.name))("p", ctx.get_path_string()) );
+
+         }
+         auto h1 = ctx.push_to_path( impl::field_path_item{ .parent_struct_itr = s_itr, .field_ordinal = i } );
+         if( fields > 0 || !first ) out += ',';
+         out += fc::json::to_string( fc::variant(field.name), fc::time_point::maximum() );
+         out += ':';
+         _binary_to_json(resolve_type( extension ? _remove_bin_extension(field.type) : field.type ), stream, out, ctx);
+         ++fields;
+      }
+      return fields;
+   }
+
+   bool abi_serializer::_binary_to_json( const std::string_view& type, fc::datastream<const char *>& stream,
+                                         string& out, impl::binary_to_variant_context& ctx )const
+   {
+      auto h = ctx.enter_scope();
+      auto rtype = resolve_type(type);
+      auto ftype = fundamental_type(rtype);
+      auto btype = built_in_types.find(ftype );
+      if( btype != built_in_types.end() ) {
+         fc::variant v;
+         try {
+            v = btype->second.first(stream, is_array(rtype), is_optional(rtype));
+         } EOS_RETHROW_EXCEPTIONS( unpack_exception, "Unable to unpack ${class} type '${type}' while processing '${p}'",
+                                   ("class", is_array(rtype) ? "array of built-in" : is_optional(rtype) ? "optional of built-in" : "built-in")
+                                   ("type", impl::limit_size(ftype))("p", ctx.get_path_string()) )
+         out += fc::json::to_string( v, fc::time_point::maximum() );
+         return !v.is_null();
+      }
+      if ( is_array(rtype) ) {
+         ctx.hint_array_type_if_in_array();
+         fc::unsigned_int size;
+         try {
+            fc::raw::unpack(stream, size);
+         } EOS_RETHROW_EXCEPTIONS( unpack_exception, "Unable to unpack size of array '${p}'", ("p", ctx.get_path_string()) )
+         out += '[';
+         auto h1 = ctx.push_to_path( impl::array_index_path_item{} );
+         for( decltype(size.value) i = 0; i < size; ++i ) {
+            ctx.set_array_index_of_path_back(i);
+            if( i > 0 ) out += ',';
+            EOS_ASSERT( _binary_to_json(ftype, stream, out, ctx), unpack_exception, "Invalid packed array '${p}'", ("p", ctx.get_path_string()) );
+         }
+         out += ']';
+         return true;
+      } else if ( is_optional(rtype) ) {
+         char flag;
+         try {
+            fc::raw::unpack(stream, flag);
+         } EOS_RETHROW_EXCEPTIONS( unpack_exception, "Unable to unpack presence flag of optional '${p}'", ("p", ctx.get_path_string()) )
+         if( !flag ) {
+            out += "null";
+            return false;
+         }
+         return _binary_to_json(ftype, stream, out, ctx);
+      } else {
+         auto v_itr = variants.find(rtype);
+         if( v_itr != variants.end() ) {
+            ctx.hint_variant_type_if_in_array( v_itr );
+            fc::unsigned_int select;
+            try {
+               fc::raw::unpack(stream, select);
+            } EOS_RETHROW_EXCEPTIONS( unpack_exception, "Unable to unpack tag of variant '${p}'", ("p", ctx.get_path_string()) )
+            EOS_ASSERT( (size_t)select < v_itr->second.types.size(), unpack_exception,
+                        "Unpacked invalid tag (${select}) for variant '${p}'", ("select", select.value)("p",ctx.get_path_string()) );
+            auto h1 = ctx.push_to_path( impl::variant_path_item{ .variant_itr = v_itr, .variant_ordinal = static_cast<uint32_t>(select) } );
+            out += '[';
+            out += fc::json::to_string( fc::variant(v_itr->second.types[select]), fc::time_point::maximum() );
+            out += ',';
+            _binary_to_json(v_itr->second.types[select], stream, out, ctx);
+            out += ']';
+            return true;
+         }
+      }
+
+      out += '{';
+      EOS_ASSERT( _binary_to_json(rtype, stream, out, true, ctx) > 0, unpack_exception, "Unable to unpack '${p}' from stream", ("p", ctx.get_path_string()) );
+      out += '}';
+      return true;
+   }
+
+   void abi_serializer::binary_to_json( const std::string_view& type, fc::datastream<const char*>& binary, string& out,
+                                        const fc::microseconds& max_serialization_time, bool short_path )const {
+      impl::binary_to_variant_context ctx(*this, max_serialization_time, type);
+      ctx.short_path = short_path;
+      _binary_to_json(type, binary, out, ctx);
+   }
+
+   string abi_serializer::binary_to_json( const std::string_view& type, const bytes& binary, const fc::microseconds& max_serialization_time, bool short_path )const {
+      string out;
+      fc::datastream<const char*> ds( binary.data(), binary.size() );
+      binary_to_json( type, ds, out, max_serialization_time, short_path );
+      return out;
+   }
+
    void abi_serializer::_variant_to_binary( const std::string_view& type, const fc::variant& var, fc::datastream<char *>& ds, impl::variant_to_binary_context& ctx )const
    { try {
       auto h = ctx.enter_scope();
@@ -42,6 +42,7 @@ apply_context::apply_context(controller& con, transaction_context& trx_ctx, uint
 ,idx256(*this)
 ,idx_double(*this)
 ,idx_long_double(*this)
+,keyval_cache(trx_ctx.arena)
 {
    action_trace& trace = trx_ctx.get_action_trace(action_ordinal);
    act = &trace.act;
@@ -52,10 +53,14 @@ apply_context::apply_context(controller& con, transaction_context& trx_ctx, uint
 void apply_context::exec_one()
 {
    auto start = fc::time_point::now();
+   db_intrinsic_calls = 0;
+   const auto arena_allocations = trx_context.arena.allocations();
 
    action_receipt r;
    r.receiver         = receiver;
-   r.act_digest       = digest_type::hash(*act);
+   // the notifications of an action are copies of it, it is packed and hashed once for all its receivers
+   if( !act_digest ) act_digest = digest_type::hash(*act);
+   r.act_digest       = *act_digest;
 
    const auto& cfg = control.get_global_properties().configuration;
    const account_metadata_object* receiver_account = nullptr;
@@ -65,6 +70,8 @@ void apply_context::exec_one()
          privileged = receiver_account->is_privileged();
          auto native = control.find_apply_handler( receiver, act->account, act->name );
          if( native ) {
+            // the native actions all write the state
+            require_writable();
             if( trx_context.enforce_whiteblacklist && control.is_producing_block() ) {
                control.check_contract_list( receiver );
                control.check_action_list( act->account, act->name );
@@ -162,6 +169,8 @@ void apply_context::finalize_trace( action_trace& trace, const fc::time_point& s
    _pending_console_output.clear();
 
    trace.elapsed = fc::time_point::now() - start;
+
+   trx_context.record_action_counters( action_ordinal, db_intrinsic_calls, trx_context.arena.allocations() - arena_allocations );
 }
 
 void apply_context::exec()
@@ -252,7 +261,13 @@ void apply_context::require_recipient( account_name recipient ) {
  *   ask the user for permission to take certain actions rather than making it implicit. This way users
  *   can better understand the security risk.
  */
+void apply_context::require_writable()const {
+   EOS_ASSERT( !trx_context.read_only, read_only_write_exception,
+               "${receiver} cannot write its tables nor send actions in a read-only transaction", ("receiver", receiver) );
+}
+
 void apply_context::execute_inline( action&& a ) {
+   require_writable();
    auto* code = control.db().find<account_object, by_name>(a.account);
    EOS_ASSERT( code != nullptr, action_validate_exception,
                "inline action's code account ${account} does not exist", ("account", a.account) );
@@ -292,7 +307,7 @@ void apply_context::execute_inline( action&& a ) {
    if( !control.skip_auth_check() && !privileged ) {
       try {
          control.get_authorization_manager()
-                .check_authorization( {a},
+                .check_authorization( a,
                                       {},
                                       {{receiver, config::eosio_code_name}},
                                       control.pending_block_time() - trx_context.published,
@@ -330,6 +345,7 @@ void apply_context::execute_inline( action&& a ) {
 }
 
 void apply_context::execute_context_free_inline( action&& a ) {
+   require_writable();
    auto* code = control.db().find<account_object, by_name>(a.account);
    EOS_ASSERT( code != nullptr, action_validate_exception,
                "inline action's code account ${account} does not exist", ("account", a.account) );
@@ -346,6 +362,7 @@ void apply_context::execute_context_free_inline( action&& a ) {
 
 
 void apply_context::schedule_deferred_transaction( const uint128_t& sender_id, account_name payer, transaction&& trx, bool replace_existing ) {
+   require_writable();
    EOS_ASSERT( trx.context_free_actions.size() == 0, cfa_inside_generated_tx, "context free actions are not currently allowed in generated transactions" );
 
    bool enforce_actor_whitelist_blacklist = trx_context.enforce_whiteblacklist && control.is_producing_block()
@@ -524,6 +541,7 @@ void apply_context::schedule_deferred_transaction( const uint128_t& sender_id, a
 }
 
 bool apply_context::cancel_deferred_transaction( const uint128_t& sender_id, account_name sender ) {
+   require_writable();
    auto& generated_transaction_idx = db.get_mutable_index<generated_transaction_multi_index>();
    const auto* gto = db.find<generated_transaction_object,by_sender_id>(boost::make_tuple(sender, sender_id));
    if ( gto ) {
@@ -654,6 +672,7 @@ int apply_context::db_store_i64( uint64_t scope, uint64_t table, const account_n
 
 int apply_context::db_store_i64( uint64_t code, uint64_t scope, uint64_t table, const account_name& payer, uint64_t id, const char* buffer, size_t buffer_size ) {
 //   require_write_lock( scope );
+   require_writable();
    const auto& tab = find_or_create_table( code, scope, table, payer );
    auto tableid = tab.id;
 
@@ -678,6 +697,7 @@ int apply_context::db_store_i64( uint64_t code, uint64_t scope, uint64_t table,
 }
 
 void apply_context::db_update_i64( int iterator, account_name payer, const char* buffer, size_t buffer_size ) {
+   require_writable();
    const key_value_object& obj = keyval_cache.get( iterator );
 
    const auto& table_obj = keyval_cache.get_table( obj.t_id );
@@ -708,6 +728,7 @@ void apply_context::db_update_i64( int iterator, account_name payer, const char*
 }
 
 void apply_context::db_remove_i64( int iterator ) {
+   require_writable();
    const key_value_object& obj = keyval_cache.get( iterator );
 
    const auto& table_obj = keyval_cache.get_table( obj.t_id );
@@ -752,6 +773,7 @@ int apply_context::db_next_i64( int iterator, uint64_t& primary ) {
 
    if( itr == idx.end() || itr->t_id != obj.t_id ) return keyval_cache.get_end_iterator_by_table_id(obj.t_id);
 
+   prefetch_row( *itr ); // a scan reads the value of the row next
    primary = itr->primary_key;
    return keyval_cache.add( *itr );
 }
@@ -784,6 +806,7 @@ int apply_context::db_previous_i64( int iterator, uint64_t& primary ) {
 
    if( itr->t_id != obj.t_id ) return -1; // cannot decrement past beginning iterator of table
 
+   prefetch_row( *itr );
    primary = itr->primary_key;
    return keyval_cache.add(*itr);
 }
@@ -0,0 +1,168 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/chain/async_log.hpp>
+#include <eosio/chain/thread_utils.hpp>
+#include <fc/log/logger_config.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace eosio { namespace chain {
+
+   /// bounded queue of many producers and the background thread, each slot has the sequence of its next use
+   struct async_log::queue {
+      struct slot {
+         std::atomic<uint64_t>          sequence{0};
+         fc::logger                     logger;
+         fc::optional<fc::log_message>  msg;
+      };
+
+      explicit queue( uint32_t capacity )
+      : slots( capacity ), mask( capacity - 1 ) {
+         for( uint64_t i = 0; i < capacity; ++i )
+            slots[i].sequence.store( i, std::memory_order_relaxed );
+      }
+
+      bool push( const fc::logger& logger, fc::log_message&& msg ) {
+         auto pos = enqueue_pos.load( std::memory_order_relaxed );
+         slot* s;
+         for( ;; ) {
+            s = &slots[pos & mask];
+            const auto seq = s->sequence.load( std::memory_order_acquire );
+            const auto diff = int64_t( seq - pos );
+            if( diff == 0 ) {
+               if( enqueue_pos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) break;
+            } else if( diff < 0 ) {
+               return false; // full
+            } else {
+               pos = enqueue_pos.load( std::memory_order_relaxed );
+            }
+         }
+         s->logger = logger;
+         s->msg.emplace( std::move( msg ) );
+         s->sequence.store( pos + 1, std::memory_order_release );
+         return true;
+      }
+
+      /// background thread only
+      bool pop( fc::logger& logger, fc::optional<fc::log_message>& msg ) {
+         auto& s = slots[dequeue_pos & mask];
+         if( s.sequence.load( std::memory_order_acquire ) != dequeue_pos + 1 ) return false;
+         logger = std::move( s.logger );
+         msg = std::move( s.msg );
+         s.msg.reset();
+         s.sequence.store( dequeue_pos + mask + 1, std::memory_order_release );
+         ++dequeue_pos;
+         return true;
+      }
+
+      std::vector<slot>       slots;
+      const uint64_t          mask;
+      std::atomic<uint64_t>   enqueue_pos{0};
+      uint64_t                dequeue_pos = 0;
+
+      std::atomic<uint32_t>   pushing{0};    ///< threads between their check of running and their push
+      std::atomic<bool>       sleeping{false};
+      std::atomic<bool>       stopping{false};
+      std::mutex              mtx;
+      std::condition_variable wake;
+      std::thread             writer;
+   };
+
+   async_log::async_log() = default;
+
+   async_log::~async_log() {
+      stop();
+   }
+
+   async_log& async_log::global() {
+      static async_log log;
+      return log;
+   }
+
+   void async_log::start( uint32_t capacity ) {
+      if( running() ) return;
+      uint32_t size = 2;
+      while( size < capacity ) size *= 2;
+      _queue.reset( new queue( size ) );
+      auto& q = *_queue;
+      q.writer = std::thread( [this, &q]() {
+         fc::set_os_thread_name( "asynclog" );
+         thread_cpu_registration cpu( "asynclog" );
+         fc::logger logger;
+         fc::optional<fc::log_message> msg;
+         for( ;; ) {
+            while( q.pop( logger, msg ) ) {
+               try {
+                  logger.log( std::move( *msg ) );
+               } catch( ... ) {
+                  // an appender failing to write loses its message, as it does for synchronous logs
+               }
+               msg.reset();
+               _stats.written.fetch_add( 1, std::memory_order_release );
+            }
+            std::unique_lock<std::mutex> g( q.mtx );
+            q.sleeping.store( true );
+            if( backlog() == 0 ) {
+               if( q.stopping.load() ) break;
+               q.wake.wait_for( g, std::chrono::milliseconds( 100 ) );
+            }
+            q.sleeping.store( false );
+         }
+      } );
+      _running.store( true, std::memory_order_release );
+   }
+
+   void async_log::stop() {
+      if( !running() ) return;
+      _running.store( false );
+      auto& q = *_queue;
+      while( q.pushing.load() > 0 )
+         std::this_thread::yield();
+      {
+         std::lock_guard<std::mutex> g( q.mtx );
+         q.stopping.store( true );
+      }
+      q.wake.notify_one();
+      q.writer.join();
+      // the queue is kept until the next start, a thread may have seen the log running just before the stop
+   }
+
+   void async_log::log( const fc::logger& logger, fc::log_message&& msg ) {
+      if( running() ) {
+         auto& q = *_queue;
+         q.pushing.fetch_add( 1 );
+         if( running() ) {
+            if( q.push( logger, std::move( msg ) ) ) {
+               _stats.queued.fetch_add( 1 );
+               const auto backlog = this->backlog();
+               auto max = _stats.max_backlog.load( std::memory_order_relaxed );
+               while( backlog > max && !_stats.max_backlog.compare_exchange_weak( max, backlog, std::memory_order_relaxed ) );
+               if( q.sleeping.load() ) {
+                  std::lock_guard<std::mutex> g( q.mtx );
+                  q.wake.notify_one();
+               }
+            } else {
+               _stats.dropped.fetch_add( 1, std::memory_order_relaxed );
+            }
+            q.pushing.fetch_sub( 1 );
+            return;
+         }
+         q.pushing.fetch_sub( 1 );
+      }
+      fc::logger( logger ).log( std::move( msg ) );
+   }
+
+   void async_log::flush() {
+      if( !running() ) return;
+      const auto target = _stats.queued.load();
+      while( _stats.written.load( std::memory_order_acquire ) < target && running() )
+         std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+   }
+
+} } // namespace eosio::chain
@@ -431,6 +431,34 @@ namespace eosio { namespace chain {
 
    void
    authorization_manager::check_authorization( const vector<action>&                actions,
+                                               const flat_set<public_key_type>&     provided_keys,
+                                               const flat_set<permission_level>&    provided_permissions,
+                                               fc::microseconds                     provided_delay,
+                                               const std::function<void()>&         checktime,
+                                               bool                                 allow_unused_keys,
+                                               const flat_set<permission_level>&    satisfied_authorizations
+                                             )const
+   {
+      check_authorization( actions.data(), actions.data() + actions.size(), provided_keys, provided_permissions,
+                           provided_delay, checktime, allow_unused_keys, satisfied_authorizations );
+   }
+
+   void
+   authorization_manager::check_authorization( const action&                        act,
+                                               const flat_set<public_key_type>&     provided_keys,
+                                               const flat_set<permission_level>&    provided_permissions,
+                                               fc::microseconds                     provided_delay,
+                                               const std::function<void()>&         checktime,
+                                               bool                                 allow_unused_keys,
+                                               const flat_set<permission_level>&    satisfied_authorizations
+                                             )const
+   {
+      check_authorization( &act, &act + 1, provided_keys, provided_permissions,
+                           provided_delay, checktime, allow_unused_keys, satisfied_authorizations );
+   }
+
+   void
+   authorization_manager::check_authorization( const action* first, const action* last,
                                                const flat_set<public_key_type>&     provided_keys,
                                                const flat_set<permission_level>&    provided_permissions,
                                                fc::microseconds                     provided_delay,
@@ -445,7 +473,7 @@ namespace eosio { namespace chain {
 
       auto effective_provided_delay =  (provided_delay >= delay_max_limit) ? fc::microseconds::maximum() : provided_delay;
 
-      auto checker = make_auth_checker( [&](const permission_level& p){ return get_permission(p).auth; },
+      auto checker = make_auth_checker( [&](const permission_level& p) -> const shared_authority& { return get_permission(p).auth; },
                                         _control.get_global_properties().configuration.max_authority_depth,
                                         provided_keys,
                                         provided_permissions,
@@ -455,7 +483,8 @@ namespace eosio { namespace chain {
 
       map<permission_level, fc::microseconds> permissions_to_satisfy;
 
-      for( const auto& act : actions ) {
+      for( const action* itr = first; itr != last; ++itr ) {
+         const auto& act = *itr;
          bool special_case = false;
          fc::microseconds delay = effective_provided_delay;
 
@@ -546,7 +575,7 @@ namespace eosio { namespace chain {
 
       auto delay_max_limit = fc::seconds( _control.get_global_properties().configuration.max_transaction_delay );
 
-      auto checker = make_auth_checker( [&](const permission_level& p){ return get_permission(p).auth; },
+      auto checker = make_auth_checker( [&](const permission_level& p) -> const shared_authority& { return get_permission(p).auth; },
                                         _control.get_global_properties().configuration.max_authority_depth,
                                         provided_keys,
                                         provided_permissions,
@@ -577,7 +606,7 @@ namespace eosio { namespace chain {
                                                                        fc::microseconds provided_delay
                                                                      )const
    {
-      auto checker = make_auth_checker( [&](const permission_level& p){ return get_permission(p).auth; },
+      auto checker = make_auth_checker( [&](const permission_level& p) -> const shared_authority& { return get_permission(p).auth; },
                                         _control.get_global_properties().configuration.max_authority_depth,
                                         candidate_keys,
                                         {},
@@ -585,8 +614,11 @@ namespace eosio { namespace chain {
                                         _noop_checktime
                                       );
 
+      // actions of a transaction often declare the same authorization, its keys are the same every time
+      flat_set<permission_level> checked;
       for (const auto& act : trx.actions ) {
          for (const auto& declared_auth : act.authorization) {
+            if( !checked.insert( declared_auth ).second ) continue;
             EOS_ASSERT( checker.satisfied(declared_auth), unsatisfied_authorization,
                         "transaction declares authority '${auth}', but does not have signatures for it.",
                         ("auth", declared_auth) );
@@ -1,5 +1,7 @@
 #include <eosio/chain/block_header_state.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/signature_recovery_cache.hpp>
+#include <array>
 #include <limits>
 
 namespace eosio { namespace chain {
@@ -10,22 +12,33 @@ namespace eosio { namespace chain {
    }
 
    producer_key block_header_state::get_scheduled_producer( block_timestamp_type t )const {
-      auto index = t.slot % (active_schedule.producers.size() * config::producer_repetitions);
+      const auto& producers = active_schedule->producers;
+      auto index = t.slot % (producers.size() * config::producer_repetitions);
       index /= config::producer_repetitions;
-      return active_schedule.producers[index];
+      return producers[index];
    }
 
    uint32_t block_header_state::calc_dpos_last_irreversible( account_name producer_of_next_block )const {
-      vector<uint32_t> blocknums; blocknums.reserve( producer_to_last_implied_irb.size() );
+      const auto size = producer_to_last_implied_irb.size();
+      if( size == 0 ) return 0;
+
+      // called for every block: the producers of a schedule fit on the stack, a vector is only a fallback
+      std::array<uint32_t, config::max_producers> stack_blocknums;
+      vector<uint32_t> heap_blocknums;
+      uint32_t* blocknums = stack_blocknums.data();
+      if( size > stack_blocknums.size() ) {
+         heap_blocknums.resize( size );
+         blocknums = heap_blocknums.data();
+      }
+
+      std::size_t n = 0;
       for( auto& i : producer_to_last_implied_irb ) {
-         blocknums.push_back( (i.first == producer_of_next_block) ? dpos_proposed_irreversible_blocknum : i.second);
+         blocknums[n++] = (i.first == producer_of_next_block) ? dpos_proposed_irreversible_blocknum : i.second;
       }
       /// 2/3 must be greater, so if I go 1/3 into the list sorted from low to high, then 2/3 are greater
 
-      if( blocknums.size() == 0 ) return 0;
-
-      std::size_t index = (blocknums.size()-1) / 3;
-      std::nth_element( blocknums.begin(),  blocknums.begin() + index, blocknums.end() );
+      std::size_t index = (size-1) / 3;
+      std::nth_element( blocknums,  blocknums + index, blocknums + size );
       return blocknums[ index ];
    }
 
@@ -54,7 +67,7 @@ namespace eosio { namespace chain {
       result.previous                                        = id;
       result.timestamp                                       = when;
       result.confirmed                                       = num_prev_blocks_to_confirm;
-      result.active_schedule_version                         = active_schedule.version;
+      result.active_schedule_version                         = active_schedule->version;
       result.prev_activated_protocol_features                = activated_protocol_features;
 
       result.block_signing_key                               = prokey.block_signing_key;
@@ -68,7 +81,7 @@ namespace eosio { namespace chain {
       static_assert(std::numeric_limits<uint8_t>::max() >= (config::max_producers * 2 / 3) + 1, "8bit confirmations may not be able to hold all of the needed confirmations");
 
       // This uses the previous block active_schedule because thats the "schedule" that signs and therefore confirms _this_ block
-      auto num_active_producers = active_schedule.producers.size();
+      auto num_active_producers = active_schedule->producers.size();
       uint32_t required_confs = (uint32_t)(num_active_producers * 2 / 3) + 1;
 
       if( confirm_count.size() < config::maximum_tracked_dpos_confirmations ) {
@@ -116,11 +129,11 @@ namespace eosio { namespace chain {
       if( pending_schedule.schedule.producers.size() &&
           result.dpos_irreversible_blocknum >= pending_schedule.schedule_lib_num )
       {
-         result.active_schedule = pending_schedule.schedule;
+         result.active_schedule = std::make_shared<producer_schedule_type>( pending_schedule.schedule );
 
          flat_map<account_name,uint32_t> new_producer_to_last_produced;
 
-         for( const auto& pro : result.active_schedule.producers ) {
+         for( const auto& pro : result.active_schedule->producers ) {
             if( pro.producer_name == prokey.producer_name ) {
                new_producer_to_last_produced[pro.producer_name] = result.block_num;
             } else {
@@ -138,7 +151,7 @@ namespace eosio { namespace chain {
 
          flat_map<account_name,uint32_t> new_producer_to_last_implied_irb;
 
-         for( const auto& pro : result.active_schedule.producers ) {
+         for( const auto& pro : result.active_schedule->producers ) {
             if( pro.producer_name == prokey.producer_name ) {
                new_producer_to_last_implied_irb[pro.producer_name] = dpos_proposed_irreversible_blocknum;
             } else {
@@ -208,7 +221,7 @@ namespace eosio { namespace chain {
 
       if( h.new_producers ) {
          EOS_ASSERT( !was_pending_promoted, producer_schedule_exception, "cannot set pending producer schedule in the same block in which pending was promoted to active" );
-         EOS_ASSERT( h.new_producers->version == active_schedule.version + 1, producer_schedule_exception, "wrong producer schedule version specified" );
+         EOS_ASSERT( h.new_producers->version == active_schedule->version + 1, producer_schedule_exception, "wrong producer schedule version specified" );
          EOS_ASSERT( prev_pending_schedule.schedule.producers.size() == 0, producer_schedule_exception,
                     "cannot set new pending producers until last pending is confirmed" );
       }
@@ -321,7 +334,7 @@ namespace eosio { namespace chain {
    }
 
    public_key_type block_header_state::signee()const {
-      return fc::crypto::public_key( header.producer_signature, sig_digest(), true );
+      return signature_recovery_cache::global().recover( header.producer_signature, sig_digest() );
    }
 
    void block_header_state::verify_signee( const public_key_type& signee )const {
@@ -4,8 +4,27 @@
  */
 #include <eosio/chain/block_log.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <fc/io/raw.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
 
 #define LOG_READ  (std::ios::in | std::ios::binary)
 #define LOG_WRITE (std::ios::out | std::ios::binary | std::ios::app)
@@ -24,6 +43,622 @@ namespace eosio { namespace chain {
    const uint32_t block_log::max_supported_version = 2;
 
    namespace detail {
+      namespace bip = boost::interprocess;
+      namespace bio = boost::iostreams;
+      namespace bfs = boost::filesystem;
+
+      /// read-only mapping of both files, covering blocks up to `last_block_num`
+      struct mapped_block_log {
+         bip::file_mapping   block_file;
+         bip::file_mapping   index_file;
+         bip::mapped_region  blocks;
+         bip::mapped_region  index;
+         uint32_t            first_block_num = 0;
+         uint32_t            last_block_num = 0;
+
+         mapped_block_log( const boost::filesystem::path& block_path, const boost::filesystem::path& index_path, uint32_t first, uint32_t last )
+         :block_file( block_path.generic_string().c_str(), bip::read_only )
+         ,index_file( index_path.generic_string().c_str(), bip::read_only )
+         ,blocks( block_file, bip::read_only )
+         ,index( index_file, bip::read_only )
+         ,first_block_num( first )
+         ,last_block_num( last )
+         {
+            EOS_ASSERT( index.get_size() >= sizeof(uint64_t) * (last - first + 1), block_log_exception,
+                        "Block log index is shorter than the log" );
+         }
+
+         uint64_t position( uint32_t block_num )const {
+            uint64_t pos;
+            memcpy( &pos, static_cast<const char*>(index.get_address()) + sizeof(uint64_t) * (block_num - first_block_num), sizeof(pos) );
+            return pos;
+         }
+
+         /// every block is followed by its position; the head block by the end of the file
+         std::pair<const char*, size_t> packed_block( uint32_t block_num )const {
+            const uint64_t pos = position( block_num );
+            const uint64_t end = block_num < last_block_num ? position( block_num + 1 ) : blocks.get_size();
+            EOS_ASSERT( pos + sizeof(uint64_t) <= end && end <= blocks.get_size(), block_log_exception,
+                        "Block log index points outside of the log", ("block_num", block_num) );
+            return { static_cast<const char*>(blocks.get_address()) + pos, end - pos - sizeof(uint64_t) };
+         }
+      };
+
+      /**
+       * Rebuilds the index of a mapped log on several threads. The log is split into chunks; a thread finds
+       * the last block ending in its chunk (validated by unpacking it and checking its link to the previous
+       * block) and follows the trailing positions backwards to the first block starting before the chunk.
+       */
+      class index_builder {
+         public:
+            index_builder( const char* log, uint64_t blocks_begin, uint64_t log_size, uint32_t first, uint32_t last, char* index )
+            :log( log ), blocks_begin( blocks_begin ), log_size( log_size ), first_block_num( first ), last_block_num( last ), index( index ) {}
+
+            void build( size_t threads, std::atomic<uint32_t>& indexed ) {
+               const uint64_t chunk_size = std::max<uint64_t>( min_chunk_size, (log_size - blocks_begin) / threads + 1 );
+               std::vector<std::future<void>> chunks;
+               for( uint64_t begin = blocks_begin; begin < log_size; begin += chunk_size ) {
+                  const uint64_t end = std::min( log_size, begin + chunk_size );
+                  chunks.emplace_back( std::async( std::launch::async, [this, begin, end, &indexed]() {
+                     index_chunk( begin, end, indexed );
+                  } ) );
+               }
+               for( auto& c : chunks )
+                  c.get();
+               verify();
+            }
+
+         private:
+            static constexpr uint64_t min_chunk_size = 64 * 1024 * 1024;
+
+            uint64_t position_at( uint64_t pos )const {
+               uint64_t result;
+               memcpy( &result, log + pos, sizeof(result) );
+               return result;
+            }
+
+            void set_index( uint32_t block_num, uint64_t pos ) {
+               memcpy( index + sizeof(uint64_t) * (block_num - first_block_num), &pos, sizeof(pos) );
+            }
+
+            /// block number of the block ending with the position at `marker`, 0 if `marker` is not a block boundary
+            uint32_t anchor_block_num( uint64_t marker )const {
+               const uint64_t pos = position_at( marker );
+               if( pos < blocks_begin || pos >= marker )
+                  return 0;
+               const uint64_t prev_marker = pos - sizeof(uint64_t);
+               if( pos != blocks_begin && (pos < blocks_begin + sizeof(uint64_t) || position_at( prev_marker ) < blocks_begin ||
+                                           position_at( prev_marker ) >= prev_marker) )
+                  return 0;
+               try {
+                  signed_block b;
+                  fc::datastream<const char*> ds( log + pos, marker - pos );
+                  fc::raw::unpack( ds, b );
+                  const auto block_num = b.block_num();
+                  if( ds.remaining() || block_num < first_block_num || block_num > last_block_num )
+                     return 0;
+                  if( pos == blocks_begin )
+                     return block_num == first_block_num ? block_num : 0;
+                  const uint64_t prev_pos = position_at( prev_marker );
+                  block_header prev;
+                  fc::datastream<const char*> prev_ds( log + prev_pos, prev_marker - prev_pos );
+                  fc::raw::unpack( prev_ds, prev );
+                  return prev.id() == b.previous ? block_num : 0;
+               } catch( ... ) {
+                  return 0;
+               }
+            }
+
+            void index_chunk( uint64_t begin, uint64_t end, std::atomic<uint32_t>& indexed ) {
+               uint64_t marker = end - sizeof(uint64_t);
+               uint32_t block_num = 0;
+               if( end == log_size ) {
+                  block_num = last_block_num;
+               } else {
+                  for( ; marker >= begin && !block_num; --marker )
+                     block_num = anchor_block_num( marker );
+                  if( !block_num )
+                     return; // no block ends in this chunk, the next chunk covers the blocks crossing it
+                  ++marker;
+               }
+
+               uint32_t count = 0;
+               while( true ) {
+                  const uint64_t pos = position_at( marker );
+                  EOS_ASSERT( blocks_begin <= pos && pos < marker && block_num >= first_block_num, block_log_exception,
+                              "Block log is malformed at position ${p}", ("p", marker) );
+                  set_index( block_num, pos );
+                  if( ++count % 10000 == 0 )
+                     indexed += 10000;
+                  if( pos < begin || block_num == first_block_num ) {
+                     EOS_ASSERT( block_num != first_block_num || pos == blocks_begin, block_log_exception,
+                                 "Block log is malformed, first block found at position ${p}", ("p", pos) );
+                     break;
+                  }
+                  marker = pos - sizeof(uint64_t);
+                  --block_num;
+               }
+               indexed += count % 10000;
+            }
+
+            void verify()const {
+               uint64_t prev = 0;
+               for( uint64_t block_num = first_block_num; block_num <= last_block_num; ++block_num ) {
+                  uint64_t pos;
+                  memcpy( &pos, index + sizeof(uint64_t) * (block_num - first_block_num), sizeof(pos) );
+                  EOS_ASSERT( (block_num == first_block_num ? pos == blocks_begin : pos > prev) && pos < log_size, block_log_exception,
+                              "Reconstructed block log index is inconsistent at block ${n}", ("n", block_num) );
+                  prev = pos;
+               }
+            }
+
+            const char*    log;
+            const uint64_t blocks_begin;
+            const uint64_t log_size;
+            const uint32_t first_block_num;
+            const uint32_t last_block_num;
+            char*          index;
+      };
+
+      struct compressed_segment_header {
+         uint32_t magic = 0;
+         uint32_t version = 0;
+         uint32_t first_block_num = 0;
+         uint32_t last_block_num = 0;
+         uint32_t blocks_per_frame = 0;
+      };
+
+      constexpr uint32_t compressed_segment_magic = 0x474f4c5a; // "ZLOG"
+      constexpr uint32_t compressed_segment_version = 1;
+
+      /// blocks of one frame of a compressed segment
+      struct decompressed_frame {
+         std::vector<char>                     data;
+         std::vector<std::pair<size_t,size_t>> blocks; ///< (offset, size) of packed blocks in `data`
+      };
+
+      /// read-only mapping of a compressed segment
+      struct compressed_segment {
+         bip::file_mapping          file;
+         bip::mapped_region         region;
+         compressed_segment_header  header;
+         uint32_t                   frames = 0;
+         uint64_t                   frame_index_pos = 0;
+
+         explicit compressed_segment( const bfs::path& path )
+         :file( path.generic_string().c_str(), bip::read_only )
+         ,region( file, bip::read_only )
+         {
+            const auto size = region.get_size();
+            EOS_ASSERT( size >= sizeof(header) + sizeof(frames), block_log_exception,
+                        "Compressed block log segment ${f} is truncated", ("f", path.generic_string()) );
+            memcpy( &header, base(), sizeof(header) );
+            EOS_ASSERT( header.magic == compressed_segment_magic && header.version == compressed_segment_version,
+                        block_log_unsupported_version, "Unsupported compressed block log segment ${f}", ("f", path.generic_string()) );
+            memcpy( &frames, base() + size - sizeof(frames), sizeof(frames) );
+            frame_index_pos = size - sizeof(frames) - sizeof(uint64_t) * uint64_t(frames);
+            EOS_ASSERT( header.blocks_per_frame > 0 && header.first_block_num <= header.last_block_num &&
+                        frames == (header.last_block_num - header.first_block_num) / header.blocks_per_frame + 1 &&
+                        size >= sizeof(header) + sizeof(frames) + sizeof(uint64_t) * uint64_t(frames),
+                        block_log_exception, "Compressed block log segment ${f} is malformed", ("f", path.generic_string()) );
+         }
+
+         const char* base()const { return static_cast<const char*>(region.get_address()); }
+
+         uint64_t frame_pos( uint32_t frame )const {
+            uint64_t pos;
+            memcpy( &pos, base() + frame_index_pos + sizeof(uint64_t) * frame, sizeof(pos) );
+            return pos;
+         }
+
+         std::shared_ptr<const decompressed_frame> decompress( uint32_t frame )const {
+            const uint64_t begin = frame_pos( frame );
+            const uint64_t end = frame + 1 < frames ? frame_pos( frame + 1 ) : frame_index_pos;
+            EOS_ASSERT( sizeof(header) <= begin && begin <= end && end <= frame_index_pos, block_log_exception,
+                        "Compressed block log segment frame index points outside of the segment", ("frame", frame) );
+
+            auto result = std::make_shared<decompressed_frame>();
+            bio::filtering_ostream decomp;
+            decomp.push( bio::zlib_decompressor() );
+            decomp.push( bio::back_inserter( result->data ) );
+            bio::write( decomp, base() + begin, end - begin );
+            bio::close( decomp );
+
+            size_t pos = 0;
+            while( pos + sizeof(uint32_t) <= result->data.size() ) {
+               uint32_t size;
+               memcpy( &size, result->data.data() + pos, sizeof(size) );
+               pos += sizeof(size);
+               result->blocks.emplace_back( pos, size );
+               pos += size;
+            }
+            const uint32_t first = header.first_block_num + frame * header.blocks_per_frame;
+            EOS_ASSERT( pos == result->data.size() &&
+                        result->blocks.size() == std::min<uint64_t>( header.blocks_per_frame, uint64_t(header.last_block_num) - first + 1 ),
+                        block_log_exception, "Compressed block log segment frame is malformed", ("frame", frame) );
+            return result;
+         }
+
+         /// writes blocks of `warm` as a compressed segment, gives up and returns false once `stopping` is set
+         static bool write( const mapped_block_log& warm, uint32_t blocks_per_frame, const bfs::path& path,
+                            const std::atomic<bool>& stopping ) {
+            std::ofstream out( path.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+            out.exceptions( std::ofstream::failbit | std::ofstream::badbit );
+
+            compressed_segment_header header;
+            header.magic = compressed_segment_magic;
+            header.version = compressed_segment_version;
+            header.first_block_num = warm.first_block_num;
+            header.last_block_num = warm.last_block_num;
+            header.blocks_per_frame = blocks_per_frame;
+            out.write( (const char*)&header, sizeof(header) );
+
+            std::vector<uint64_t> frame_positions;
+            for( uint64_t first = warm.first_block_num; first <= warm.last_block_num; first += blocks_per_frame ) {
+               if( stopping ) return false;
+               frame_positions.push_back( out.tellp() );
+
+               std::vector<char> compressed;
+               bio::filtering_ostream comp;
+               comp.push( bio::zlib_compressor( bio::zlib::default_compression ) );
+               comp.push( bio::back_inserter( compressed ) );
+               const uint64_t last = std::min<uint64_t>( warm.last_block_num, first + blocks_per_frame - 1 );
+               for( uint64_t block_num = first; block_num <= last; ++block_num ) {
+                  const auto block = warm.packed_block( block_num );
+                  const uint32_t size = block.second;
+                  bio::write( comp, (const char*)&size, sizeof(size) );
+                  bio::write( comp, block.first, block.second );
+               }
+               bio::close( comp );
+               out.write( compressed.data(), compressed.size() );
+            }
+
+            out.write( (const char*)frame_positions.data(), sizeof(uint64_t) * frame_positions.size() );
+            const uint32_t frames = frame_positions.size();
+            out.write( (const char*)&frames, sizeof(frames) );
+            out.close();
+            return true;
+         }
+      };
+
+      /**
+       * Blocks moved out of blocks.log, see block_log_segment_config. Renamed segments are read through
+       * their mapping until a background thread compresses them. All members are thread safe.
+       */
+      class block_log_segments {
+         public:
+            block_log_segments( const fc::path& blocks_dir, const block_log_segment_config& cfg );
+            ~block_log_segments();
+
+            /// moves closed blocks.log files holding blocks [first, last] into a new segment
+            void add( const fc::path& block_file, const fc::path& index_file, uint32_t first, uint32_t last );
+
+            /// empty view if the block is not in segments
+            block_log::packed_block_view read_packed_block( uint32_t block_num );
+
+            /// 0 if there are no segments
+            uint32_t first_block_num();
+            uint32_t last_block_num();
+
+            /// deletes all segments, e.g. when the log is reset
+            void remove_all();
+
+         private:
+            struct segment {
+               uint32_t                                  first_block_num = 0;
+               uint32_t                                  last_block_num = 0;
+               bfs::path                                 block_file; ///< files of the not yet compressed segment
+               bfs::path                                 index_file;
+               std::shared_ptr<const mapped_block_log>   warm;
+               std::shared_ptr<const compressed_segment> cold;
+            };
+
+            struct cached_frame {
+               uint32_t                                  segment_last_block_num;
+               uint32_t                                  frame;
+               std::shared_ptr<const decompressed_frame> blocks;
+            };
+
+            bfs::path segment_path( const bfs::path& dir, uint32_t first, uint32_t last, const char* extension )const {
+               return dir / ("blocks-" + std::to_string(first) + "-" + std::to_string(last) + extension);
+            }
+
+            void scan();
+            void remove_files( const segment& s );
+            std::shared_ptr<const decompressed_frame> get_frame( const segment& s, uint32_t frame );
+            void compress_segments();
+
+            const bfs::path                  blocks_dir;
+            const bfs::path                  archive_dir;
+            const block_log_segment_config   cfg;
+
+            std::mutex                       mtx;
+            std::map<uint32_t, segment>      segments; ///< by last block num
+            std::list<cached_frame>          cache;    ///< most recently used first
+            std::deque<uint32_t>             pending;  ///< last block nums of segments to compress
+            std::condition_variable          pending_cv;
+            std::atomic<bool>                stopping{false};
+            std::thread                      compress_thread;
+      };
+
+      block_log_segments::block_log_segments( const fc::path& dir, const block_log_segment_config& c )
+      :blocks_dir( dir.generic_string() )
+      ,archive_dir( c.archive_dir.generic_string().empty() ? dir.generic_string() : c.archive_dir.generic_string() )
+      ,cfg( c )
+      {
+         EOS_ASSERT( cfg.blocks_per_frame > 0, block_log_exception, "Blocks per compressed frame should be positive" );
+         if( !bfs::is_directory( archive_dir ) )
+            bfs::create_directories( archive_dir );
+         scan();
+         compress_thread = std::thread( [this]() { compress_segments(); } );
+      }
+
+      block_log_segments::~block_log_segments() {
+         {
+            std::lock_guard<std::mutex> lock( mtx );
+            stopping = true;
+         }
+         pending_cv.notify_all();
+         compress_thread.join();
+      }
+
+      void block_log_segments::scan() {
+         // name of a segment file without extension -> (first, last); blocks.log does not match
+         const auto parse = []( const bfs::path& p, uint32_t& first, uint32_t& last ) {
+            char tail;
+            return sscanf( p.stem().generic_string().c_str(), "blocks-%u-%u%c", &first, &last, &tail ) == 2 && first <= last;
+         };
+
+         std::map<uint32_t, segment> found;
+         for( bfs::directory_iterator it( archive_dir ), end; it != end; ++it ) {
+            uint32_t first, last;
+            if( it->path().extension() == ".tmp" ) {
+               bfs::remove( it->path() ); // compression interrupted by shutdown, restarted below
+            } else if( it->path().extension() == ".zlog" && parse( it->path(), first, last ) ) {
+               auto& s = found[last];
+               s.first_block_num = first;
+               s.last_block_num = last;
+               s.cold = std::make_shared<compressed_segment>( it->path() );
+            }
+         }
+         for( bfs::directory_iterator it( blocks_dir ), end; it != end; ++it ) {
+            uint32_t first, last;
+            if( it->path().extension() != ".log" || !parse( it->path(), first, last ) )
+               continue;
+            auto& s = found[last];
+            s.block_file = it->path();
+            s.index_file = segment_path( blocks_dir, first, last, ".index" );
+            if( s.cold ) { // compressed, but not removed before shutdown
+               remove_files( s );
+               continue;
+            }
+            s.first_block_num = first;
+            s.last_block_num = last;
+            s.warm = std::make_shared<mapped_block_log>( s.block_file, s.index_file, first, last );
+            pending.push_back( last );
+         }
+
+         for( auto it = found.begin(); it != found.end(); ++it ) {
+            auto next = std::next( it );
+            EOS_ASSERT( next == found.end() || it->second.last_block_num + 1 == next->second.first_block_num, block_log_exception,
+                        "Block log segments are not contiguous: ${l} is followed by ${f}",
+                        ("l", it->second.last_block_num)("f", next->second.first_block_num) );
+         }
+         segments = std::move( found );
+         if( !segments.empty() )
+            ilog( "Block log segments hold blocks ${f} to ${l}, ${p} to compress",
+                  ("f", segments.begin()->second.first_block_num)("l", segments.rbegin()->first)("p", pending.size()) );
+      }
+
+      void block_log_segments::remove_files( const segment& s ) {
+         bfs::remove( s.block_file );
+         bfs::remove( s.index_file );
+      }
+
+      void block_log_segments::add( const fc::path& block_file, const fc::path& index_file, uint32_t first, uint32_t last ) {
+         segment s;
+         s.first_block_num = first;
+         s.last_block_num = last;
+         s.block_file = segment_path( blocks_dir, first, last, ".log" );
+         s.index_file = segment_path( blocks_dir, first, last, ".index" );
+         bfs::rename( block_file.generic_string(), s.block_file );
+         bfs::rename( index_file.generic_string(), s.index_file );
+         s.warm = std::make_shared<mapped_block_log>( s.block_file, s.index_file, first, last );
+         ilog( "Moved blocks ${f} to ${l} to block log segment ${s}", ("f", first)("l", last)("s", s.block_file.generic_string()) );
+         {
+            std::lock_guard<std::mutex> lock( mtx );
+            segments[last] = std::move( s );
+            pending.push_back( last );
+         }
+         pending_cv.notify_all();
+      }
+
+      block_log::packed_block_view block_log_segments::read_packed_block( uint32_t block_num ) {
+         block_log::packed_block_view view;
+         std::lock_guard<std::mutex> lock( mtx );
+         const auto it = segments.lower_bound( block_num );
+         if( it == segments.end() || block_num < it->second.first_block_num )
+            return view;
+
+         const auto& s = it->second;
+         if( s.warm ) {
+            std::tie( view.data, view.size ) = s.warm->packed_block( block_num );
+            view.mapping = s.warm;
+         } else {
+            const auto index = block_num - s.first_block_num;
+            const auto frame = get_frame( s, index / s.cold->header.blocks_per_frame );
+            const auto& block = frame->blocks[index % s.cold->header.blocks_per_frame];
+            view.data = frame->data.data() + block.first;
+            view.size = block.second;
+            view.mapping = frame;
+         }
+         return view;
+      }
+
+      std::shared_ptr<const decompressed_frame> block_log_segments::get_frame( const segment& s, uint32_t frame ) {
+         for( auto it = cache.begin(); it != cache.end(); ++it ) {
+            if( it->segment_last_block_num == s.last_block_num && it->frame == frame ) {
+               cache.splice( cache.begin(), cache, it );
+               return it->blocks;
+            }
+         }
+         auto blocks = s.cold->decompress( frame );
+         if( cfg.cache_frames ) {
+            cache.push_front( cached_frame{ s.last_block_num, frame, blocks } );
+            if( cache.size() > cfg.cache_frames )
+               cache.pop_back();
+         }
+         return blocks;
+      }
+
+      uint32_t block_log_segments::first_block_num() {
+         std::lock_guard<std::mutex> lock( mtx );
+         return segments.empty() ? 0 : segments.begin()->second.first_block_num;
+      }
+
+      uint32_t block_log_segments::last_block_num() {
+         std::lock_guard<std::mutex> lock( mtx );
+         return segments.empty() ? 0 : segments.rbegin()->first;
+      }
+
+      void block_log_segments::remove_all() {
+         std::lock_guard<std::mutex> lock( mtx );
+         for( const auto& item : segments ) {
+            const auto& s = item.second;
+            if( s.warm )
+               remove_files( s );
+            else
+               bfs::remove( segment_path( archive_dir, s.first_block_num, s.last_block_num, ".zlog" ) );
+         }
+         segments.clear();
+         cache.clear();
+         pending.clear();
+      }
+
+      void block_log_segments::compress_segments() {
+         std::unique_lock<std::mutex> lock( mtx );
+         while( true ) {
+            pending_cv.wait( lock, [this]() { return stopping || !pending.empty(); } );
+            if( stopping )
+               return;
+            const auto last = pending.front();
+            pending.pop_front();
+            auto it = segments.find( last );
+            if( it == segments.end() || !it->second.warm )
+               continue;
+            const auto warm = it->second.warm;
+            const auto path = segment_path( archive_dir, warm->first_block_num, warm->last_block_num, ".zlog" );
+            bfs::path tmp_path = path;
+            tmp_path += ".tmp";
+            lock.unlock();
+
+            bool written = false;
+            try {
+               written = compressed_segment::write( *warm, cfg.blocks_per_frame, tmp_path, stopping );
+            } catch( const fc::exception& e ) {
+               elog( "Cannot compress block log segment ${f}: ${e}", ("f", tmp_path.generic_string())("e", e.to_detail_string()) );
+            } catch( const std::exception& e ) {
+               elog( "Cannot compress block log segment ${f}: ${e}", ("f", tmp_path.generic_string())("e", e.what()) );
+            }
+
+            lock.lock();
+            it = segments.find( last );
+            if( !written || it == segments.end() ) { // failed, interrupted, or removed meanwhile
+               boost::system::error_code ec;
+               bfs::remove( tmp_path, ec );
+               continue;
+            }
+            try {
+               bfs::rename( tmp_path, path );
+               it->second.cold = std::make_shared<compressed_segment>( path );
+            } catch( const fc::exception& e ) {
+               elog( "Cannot open compressed block log segment ${f}: ${e}", ("f", path.generic_string())("e", e.to_detail_string()) );
+               continue;
+            } catch( const std::exception& e ) {
+               elog( "Cannot open compressed block log segment ${f}: ${e}", ("f", path.generic_string())("e", e.what()) );
+               continue;
+            }
+            remove_files( it->second );
+            it->second.warm.reset();
+            ilog( "Compressed block log segment ${f}", ("f", path.generic_string()) );
+         }
+      }
+
+      /// fsyncs blocks.log and blocks.index on a thread of its own, so that appends do not wait for the disk
+      class block_log_syncer {
+         public:
+            block_log_syncer( const fc::path& block_file, const fc::path& index_file )
+            :block_file( block_file.generic_string() )
+            ,index_file( index_file.generic_string() )
+            {
+               sync_thread = std::thread( [this]() { run(); } );
+            }
+
+            /// serves the requested syncs first
+            ~block_log_syncer() {
+               {
+                  std::lock_guard<std::mutex> lock( mtx );
+                  stopping = true;
+               }
+               cv.notify_all();
+               sync_thread.join();
+            }
+
+            /// syncs what was written to the files before the call
+            void request() {
+               {
+                  std::lock_guard<std::mutex> lock( mtx );
+                  ++requested;
+               }
+               cv.notify_all();
+            }
+
+            /// waits for the requested syncs, the files can be closed or renamed after it
+            void wait() {
+               std::unique_lock<std::mutex> lock( mtx );
+               cv.wait( lock, [this]() { return synced == requested; } );
+            }
+
+         private:
+            void run() {
+               std::unique_lock<std::mutex> lock( mtx );
+               while( true ) {
+                  cv.wait( lock, [this]() { return stopping || synced != requested; } );
+                  if( synced == requested )
+                     return;
+                  // requests made while syncing are served by the next sync
+                  const auto target = requested;
+                  lock.unlock();
+                  sync_file( block_file );
+                  sync_file( index_file );
+                  lock.lock();
+                  synced = target;
+                  cv.notify_all();
+               }
+            }
+
+            static void sync_file( const std::string& path ) {
+               // fsync syncs the file whichever descriptor it is called on
+               const int fd = ::open( path.c_str(), O_RDONLY );
+               if( fd < 0 ) {
+                  wlog( "cannot open ${f} to sync it: ${e}", ("f", path)("e", strerror( errno )) );
+                  return;
+               }
+               if( ::fsync( fd ) != 0 )
+                  wlog( "cannot sync ${f}: ${e}", ("f", path)("e", strerror( errno )) );
+               ::close( fd );
+            }
+
+            const std::string        block_file;
+            const std::string        index_file;
+            std::mutex               mtx;
+            std::condition_variable  cv;
+            uint64_t                 requested = 0;
+            uint64_t                 synced = 0;
+            bool                     stopping = false;
+            std::thread              sync_thread;
+      };
+
       class block_log_impl {
          public:
             signed_block_ptr         head;
@@ -36,6 +671,18 @@ namespace eosio { namespace chain {
             bool                     genesis_written_to_block_log = false;
             uint32_t                 version = 0;
             uint32_t                 first_block_num = 0;
+            std::shared_ptr<const mapped_block_log> mapped;
+            block_log_segment_config                segment_config;
+            std::shared_ptr<block_log_segments>     segments;
+
+            block_log_write_config                  write_config;
+            std::vector<char>                       pending_blocks;  ///< appended after the end of blocks.log
+            std::vector<uint64_t>                   pending_index;   ///< positions of the blocks not in blocks.index
+            uint64_t                                log_end = 0;     ///< size of blocks.log
+            uint32_t                                unsynced_blocks = 0;
+            std::unique_ptr<block_log_syncer>       syncer;
+
+            static constexpr uint64_t write_alignment = 4096;
 
             inline void check_open_files() {
                if( !open_files ) {
@@ -44,7 +691,42 @@ namespace eosio { namespace chain {
             }
             void reopen();
 
+            /// mapping covering `block_num`, remapped if the log was appended since the last call
+            const std::shared_ptr<const mapped_block_log>& get_mapped( uint32_t block_num ) {
+               write_all_pending();
+               if( !mapped || mapped->last_block_num < block_num ) {
+                  mapped = std::make_shared<mapped_block_log>( block_file.generic_string(), index_file.generic_string(), first_block_num,
+                                                               block_header::num_from_id( head_id ) );
+               }
+               return mapped;
+            }
+
+            /// writes the blocks buffered by append, all of them or the chunk ending at the last page boundary
+            void write_pending( bool all );
+
+            /// before the files are read through their streams or mappings
+            void write_all_pending() {
+               if( !pending_index.empty() )
+                  write_pending( true );
+            }
+
+            void request_sync() {
+               write_all_pending();
+               unsynced_blocks = 0;
+               if( !syncer )
+                  syncer = std::make_unique<block_log_syncer>( block_file, index_file );
+               syncer->request();
+            }
+
             void close() {
+               if( open_files )
+                  write_all_pending();
+               if( syncer ) {
+                  if( unsynced_blocks )
+                     request_sync();
+                  syncer.reset();
+               }
+               mapped.reset();
                if( block_stream.is_open() )
                   block_stream.close();
                if( index_stream.is_open() )
@@ -66,12 +748,49 @@ namespace eosio { namespace chain {
          block_stream.open(block_file.generic_string().c_str(), LOG_RW);
          index_stream.open(index_file.generic_string().c_str(), LOG_RW);
 
+         block_stream.seekp(0, std::ios::end);
+         log_end = block_stream.tellp();
          open_files = true;
       }
+
+      void block_log_impl::write_pending( bool all ) {
+         uint64_t count = pending_blocks.size();
+         if( !all ) {
+            // whole pages only, the tail goes with the next chunk
+            const uint64_t end = (log_end + pending_blocks.size()) / write_alignment * write_alignment;
+            count = end > log_end ? end - log_end : 0;
+         }
+         if( count ) {
+            block_stream.seekp(0, std::ios::end);
+            block_stream.write(pending_blocks.data(), count);
+            block_stream.flush();
+            log_end += count;
+            pending_blocks.erase(pending_blocks.begin(), pending_blocks.begin() + count);
+         }
+
+         // index entries of the blocks now complete in blocks.log, ending with their positions
+         size_t entries = 0;
+         while( entries < pending_index.size() ) {
+            const uint64_t block_end = entries + 1 < pending_index.size() ? pending_index[entries + 1] : log_end + pending_blocks.size();
+            if( block_end > log_end )
+               break;
+            ++entries;
+         }
+         if( entries ) {
+            index_stream.seekp(0, std::ios::end);
+            index_stream.write((const char*)pending_index.data(), sizeof(uint64_t) * entries);
+            index_stream.flush();
+            pending_index.erase(pending_index.begin(), pending_index.begin() + entries);
+         }
+      }
    }
 
-   block_log::block_log(const fc::path& data_dir)
+   block_log::block_log(const fc::path& data_dir, const block_log_segment_config& segment_config,
+                        const block_log_write_config& write_config)
    :my(new detail::block_log_impl()) {
+      my->segment_config = segment_config;
+      my->write_config = write_config;
+      my->pending_blocks.reserve(write_config.buffer_size);
       my->block_stream.exceptions(std::fstream::failbit | std::fstream::badbit);
       my->index_stream.exceptions(std::fstream::failbit | std::fstream::badbit);
       open(data_dir);
@@ -98,6 +817,9 @@ namespace eosio { namespace chain {
       my->block_file = data_dir / "blocks.log";
       my->index_file = data_dir / "blocks.index";
 
+      my->segments.reset();
+      my->segments = std::make_shared<detail::block_log_segments>( data_dir, my->segment_config );
+
       my->reopen();
 
       /* On startup of the block log, there are several states the log file and the index file can be
@@ -175,30 +897,48 @@ namespace eosio { namespace chain {
          fc::remove_all(my->index_file);
          my->reopen();
       }
+
+      const auto segments_last = my->segments->last_block_num();
+      EOS_ASSERT( !segments_last || !log_size || segments_last + 1 == my->first_block_num, block_log_exception,
+                  "Block log segments end at ${l} but blocks.log starts at ${f}", ("l", segments_last)("f", my->first_block_num) );
    }
 
    uint64_t block_log::append(const signed_block_ptr& b) {
       try {
          EOS_ASSERT( my->genesis_written_to_block_log, block_log_append_fail, "Cannot append to block log until the genesis is first written" );
 
+         if( my->segment_config.stride && my->head && b->block_num() - my->first_block_num >= my->segment_config.stride ) {
+            start_segment( b );
+            return get_block_pos( b->block_num() );
+         }
+
          my->check_open_files();
 
-         my->block_stream.seekp(0, std::ios::end);
          my->index_stream.seekp(0, std::ios::end);
-         uint64_t pos = my->block_stream.tellp();
-         EOS_ASSERT(my->index_stream.tellp() == sizeof(uint64_t) * (b->block_num() - my->first_block_num),
+         const uint64_t index_end = uint64_t(my->index_stream.tellp()) + sizeof(uint64_t) * my->pending_index.size();
+         uint64_t pos = my->log_end + my->pending_blocks.size();
+         EOS_ASSERT(index_end == sizeof(uint64_t) * (b->block_num() - my->first_block_num),
                    block_log_append_fail,
                    "Append to index file occuring at wrong position.",
-                   ("position", (uint64_t) my->index_stream.tellp())
+                   ("position", index_end)
                    ("expected", (b->block_num() - my->first_block_num) * sizeof(uint64_t)));
          auto data = fc::raw::pack(*b);
-         my->block_stream.write(data.data(), data.size());
-         my->block_stream.write((char*)&pos, sizeof(pos));
-         my->index_stream.write((char*)&pos, sizeof(pos));
+         auto& pending = my->pending_blocks;
+         pending.insert(pending.end(), data.begin(), data.end());
+         pending.insert(pending.end(), (const char*)&pos, (const char*)&pos + sizeof(pos));
+         my->pending_index.push_back(pos);
          my->head = b;
          my->head_id = b->id();
 
-         flush();
+         if( !my->write_config.buffer_size )
+            my->write_pending( true );
+         else if( pending.size() >= my->write_config.buffer_size )
+            my->write_pending( false );
+
+         if( my->write_config.fsync_blocks || my->write_config.fsync_on_commit )
+            ++my->unsynced_blocks;
+         if( my->write_config.fsync_blocks && my->unsynced_blocks >= my->write_config.fsync_blocks )
+            my->request_sync();
 
          return pos;
       }
@@ -206,11 +946,33 @@ namespace eosio { namespace chain {
    }
 
    void block_log::flush() {
+      if( my->open_files )
+         my->write_all_pending();
       my->block_stream.flush();
       my->index_stream.flush();
    }
 
+   void block_log::commit() {
+      if( my->write_config.fsync_on_commit && my->unsynced_blocks )
+         my->request_sync();
+   }
+
    void block_log::reset( const genesis_state& gs, const signed_block_ptr& first_block, uint32_t first_block_num ) {
+      my->segments->remove_all();
+      reset_log( gs, first_block, first_block_num );
+   }
+
+   void block_log::start_segment( const signed_block_ptr& b ) {
+      const auto gs = extract_genesis_state( my->block_file.parent_path() );
+      const uint32_t first = my->first_block_num;
+      const uint32_t last = block_header::num_from_id( my->head_id );
+      flush();
+      my->close();
+      my->segments->add( my->block_file, my->index_file, first, last );
+      reset_log( gs, b, b->block_num() );
+   }
+
+   void block_log::reset_log( const genesis_state& gs, const signed_block_ptr& first_block, uint32_t first_block_num ) {
       my->close();
 
       fc::remove_all(my->block_file);
@@ -230,6 +992,8 @@ namespace eosio { namespace chain {
       // append a totem to indicate the division between blocks and header
       auto totem = npos;
       my->block_stream.write((char*)&totem, sizeof(totem));
+      my->block_stream.flush();
+      my->log_end = my->block_stream.tellp();
 
       if (first_block) {
          append(first_block);
@@ -238,6 +1002,7 @@ namespace eosio { namespace chain {
          my->head_id = {};
       }
 
+      my->write_all_pending();
       auto pos = my->block_stream.tellp();
 
       static_assert( block_log::max_supported_version > 0, "a version number of zero is not supported" );
@@ -250,6 +1015,7 @@ namespace eosio { namespace chain {
 
    std::pair<signed_block_ptr, uint64_t> block_log::read_block(uint64_t pos)const {
       my->check_open_files();
+      my->write_all_pending();
 
       my->block_stream.seekg(pos);
       std::pair<signed_block_ptr,uint64_t> result;
@@ -262,9 +1028,10 @@ namespace eosio { namespace chain {
    signed_block_ptr block_log::read_block_by_num(uint32_t block_num)const {
       try {
          signed_block_ptr b;
-         uint64_t pos = get_block_pos(block_num);
-         if (pos != npos) {
-            b = read_block(pos).first;
+         if (const auto packed = read_packed_block_by_num(block_num)) {
+            b = std::make_shared<signed_block>();
+            fc::datastream<const char*> ds(packed.data, packed.size);
+            fc::raw::unpack(ds, *b);
             EOS_ASSERT(b->block_num() == block_num, reversible_blocks_exception,
                       "Wrong block was read from block log.", ("returned", b->block_num())("expected", block_num));
          }
@@ -272,8 +1039,63 @@ namespace eosio { namespace chain {
       } FC_LOG_AND_RETHROW()
    }
 
+   block_log::packed_block_view block_log::read_packed_block_by_num(uint32_t block_num)const {
+      packed_block_view view;
+      if (block_num < my->first_block_num)
+         return my->segments->read_packed_block(block_num);
+      if (!(my->head && block_num <= block_header::num_from_id(my->head_id) && block_num >= my->first_block_num))
+         return view;
+      const auto& mapped = my->get_mapped(block_num);
+      std::tie(view.data, view.size) = mapped->packed_block(block_num);
+      view.mapping = mapped;
+      return view;
+   }
+
+   block_log::sequential_reader::sequential_reader( const block_log& log, uint32_t first_block_num )
+   :next_block_num( first_block_num )
+   ,last_block_num( log.head() ? log.head()->block_num() : 0 )
+   ,log_first_block_num( log.my->first_block_num )
+   {
+      if( first_block_num < log_first_block_num ) {
+         segments = log.my->segments;
+         const auto segments_first = segments->first_block_num();
+         if( !segments_first || first_block_num < segments_first ) {
+            last_block_num = 0;
+            return;
+         }
+      }
+      const auto pos = log.get_block_pos( std::max( first_block_num, log_first_block_num ) );
+      if( pos == npos ) {
+         last_block_num = 0;
+         return;
+      }
+      block_stream.open( log.my->block_file.generic_string().c_str(), LOG_READ );
+      EOS_ASSERT( block_stream, block_log_exception, "cannot open block log ${f}", ("f", log.my->block_file.generic_string()) );
+      block_stream.seekg( pos );
+   }
+
+   signed_block_ptr block_log::sequential_reader::next() {
+      if( next_block_num > last_block_num ) return {};
+
+      auto b = std::make_shared<signed_block>();
+      if( next_block_num < log_first_block_num ) {
+         const auto packed = segments->read_packed_block( next_block_num );
+         EOS_ASSERT( packed, block_log_exception, "Block ${n} is missing in block log segments", ("n", next_block_num) );
+         fc::datastream<const char*> ds( packed.data, packed.size );
+         fc::raw::unpack( ds, *b );
+      } else {
+         fc::raw::unpack( block_stream, *b );
+         block_stream.seekg( sizeof(uint64_t), std::ios::cur ); // skip position of the block
+      }
+      EOS_ASSERT( b->block_num() == next_block_num, block_log_exception,
+                  "Wrong block was read from block log.", ("returned", b->block_num())("expected", next_block_num) );
+      ++next_block_num;
+      return b;
+   }
+
    uint64_t block_log::get_block_pos(uint32_t block_num) const {
       my->check_open_files();
+      my->write_all_pending();
       if (!(my->head && block_num <= block_header::num_from_id(my->head_id) && block_num >= my->first_block_num))
          return npos;
       my->index_stream.seekg(sizeof(uint64_t) * (block_num - my->first_block_num));
@@ -284,6 +1106,7 @@ namespace eosio { namespace chain {
 
    signed_block_ptr block_log::read_head()const {
       my->check_open_files();
+      my->write_all_pending();
 
       uint64_t pos;
 
@@ -305,8 +1128,14 @@ namespace eosio { namespace chain {
       return my->head;
    }
 
+   block_log::index_progress& block_log::index_reconstruction_progress() {
+      static index_progress progress;
+      return progress;
+   }
+
    uint32_t block_log::first_block_num() const {
-      return my->first_block_num;
+      const auto segments_first = my->segments->first_block_num();
+      return segments_first ? segments_first : my->first_block_num;
    }
 
    void block_log::construct_index() {
@@ -327,8 +1156,6 @@ namespace eosio { namespace chain {
          return;
       }
 
-      signed_block tmp;
-
       uint64_t pos = 0;
       if (my->version == 1) {
          pos = 4; // Skip version which should have already been checked.
@@ -346,14 +1173,40 @@ namespace eosio { namespace chain {
          my->block_stream.read((char*) &totem, sizeof(totem));
       }
 
-      my->index_stream.seekp(0, std::ios::end);
-      while( pos < end_pos ) {
-         fc::raw::unpack(my->block_stream, tmp);
-         my->block_stream.read((char*)&pos, sizeof(pos));
-         if(tmp.block_num() % 1000 == 0)
-            ilog( "Block log index reconstructed for block ${n}", ("n", tmp.block_num()));
-         my->index_stream.write((char*)&pos, sizeof(pos));
+      const uint64_t blocks_begin = my->block_stream.tellg();
+      my->block_stream.seekg(0, std::ios::end);
+      const uint64_t log_size = my->block_stream.tellg();
+      const uint32_t last_block_num = block_header::num_from_id(my->head_id);
+      my->close();
+
+      auto& progress = index_reconstruction_progress();
+      progress.blocks_indexed = 0;
+      progress.blocks_total = last_block_num - my->first_block_num + 1;
+      const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+      ilog( "Indexing blocks ${f} to ${l} on ${t} threads", ("f", my->first_block_num)("l", last_block_num)("t", threads) );
+
+      boost::filesystem::resize_file(my->index_file.generic_string(), sizeof(uint64_t) * uint64_t(progress.blocks_total));
+      {
+         namespace bip = boost::interprocess;
+         bip::file_mapping block_mapping(my->block_file.generic_string().c_str(), bip::read_only);
+         bip::file_mapping index_mapping(my->index_file.generic_string().c_str(), bip::read_write);
+         bip::mapped_region blocks(block_mapping, bip::read_only);
+         bip::mapped_region index(index_mapping, bip::read_write);
+
+         auto build = std::async(std::launch::async, [&]() {
+            detail::index_builder(static_cast<const char*>(blocks.get_address()), blocks_begin, log_size,
+                                  my->first_block_num, last_block_num, static_cast<char*>(index.get_address()))
+               .build(threads, progress.blocks_indexed);
+         });
+         while (build.wait_for(std::chrono::seconds(5)) != std::future_status::ready) {
+            ilog( "Block log index reconstructed for ${n} of ${t} blocks", ("n", progress.blocks_indexed.load())("t", progress.blocks_total.load()) );
+         }
+         build.get();
+         index.flush();
       }
+      ilog( "Block log index reconstructed for ${t} blocks", ("t", progress.blocks_total.load()) );
+
+      my->reopen();
    } // construct_index
 
    fc::path block_log::repair_log( const fc::path& data_dir, uint32_t truncate_at_block ) {
@@ -543,4 +1396,127 @@ namespace eosio { namespace chain {
       return gs;
    }
 
+   namespace detail {
+      /// mapping of blocks.log and blocks.index for the offline edits
+      struct block_log_files {
+         bip::file_mapping   block_file;
+         bip::file_mapping   index_file;
+         bip::mapped_region  blocks;
+         bip::mapped_region  index;
+         uint32_t            first_block_num = 1;
+         uint32_t            last_block_num = 0;
+         uint64_t            genesis_begin = 0;
+         uint64_t            genesis_end = 0;
+
+         explicit block_log_files( const fc::path& data_dir )
+         :block_file( (data_dir / "blocks.log").generic_string().c_str(), bip::read_only )
+         ,index_file( (data_dir / "blocks.index").generic_string().c_str(), bip::read_only )
+         ,blocks( block_file, bip::read_only )
+         ,index( index_file, bip::read_only )
+         {
+            fc::datastream<const char*> ds( data(), blocks.get_size() );
+            uint32_t version = 0;
+            fc::raw::unpack( ds, version );
+            EOS_ASSERT( version >= block_log::min_supported_version && version <= block_log::max_supported_version, block_log_unsupported_version,
+                        "Unsupported version of block log. Block log version is ${version} while code supports version(s) [${min},${max}]",
+                        ("version", version)("min", block_log::min_supported_version)("max", block_log::max_supported_version) );
+            if( version != 1 )
+               fc::raw::unpack( ds, first_block_num );
+            genesis_begin = ds.tellp();
+            genesis_state gs;
+            fc::raw::unpack( ds, gs );
+            genesis_end = ds.tellp();
+            EOS_ASSERT( index.get_size() % sizeof(uint64_t) == 0 && index.get_size() > 0, block_log_exception,
+                        "Block log index of ${d} is empty or malformed", ("d", data_dir) );
+            last_block_num = first_block_num + index.get_size() / sizeof(uint64_t) - 1;
+            uint64_t head_pos = 0;
+            memcpy( &head_pos, data() + blocks.get_size() - sizeof(head_pos), sizeof(head_pos) );
+            EOS_ASSERT( head_pos == pos( last_block_num ), block_log_exception,
+                        "Block log index of ${d} does not match the log, reconstruct it first", ("d", data_dir) );
+         }
+
+         const char* data()const { return static_cast<const char*>( blocks.get_address() ); }
+
+         uint64_t pos( uint32_t block_num )const {
+            uint64_t result = 0;
+            memcpy( &result, static_cast<const char*>( index.get_address() ) + sizeof(result) * (block_num - first_block_num), sizeof(result) );
+            return result;
+         }
+
+         /// end of the block and of its position
+         uint64_t end( uint32_t block_num )const {
+            return block_num == last_block_num ? blocks.get_size() : pos( block_num + 1 );
+         }
+      };
+   }
+
+   void block_log::extract_blocks( const fc::path& data_dir, const fc::path& output_dir, uint32_t first, uint32_t last ) {
+      EOS_ASSERT( !fc::exists( output_dir / "blocks.log" ) ||
+                  !boost::filesystem::equivalent( (data_dir / "blocks.log").generic_string(), (output_dir / "blocks.log").generic_string() ),
+                  block_log_exception, "Cannot extract blocks of ${d} to itself", ("d", data_dir) );
+      detail::block_log_files in( data_dir );
+      EOS_ASSERT( first >= in.first_block_num && first <= last && last <= in.last_block_num, block_log_exception,
+                  "Blocks ${f} through ${l} are not in the block log of ${d}, which has blocks ${lf} through ${ll}",
+                  ("f", first)("l", last)("d", data_dir)("lf", in.first_block_num)("ll", in.last_block_num) );
+
+      fc::create_directories( output_dir );
+      std::ofstream block_stream( (output_dir / "blocks.log").generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+      std::ofstream index_stream( (output_dir / "blocks.index").generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+
+      const uint32_t version = max_supported_version;
+      block_stream.write( (const char*)&version, sizeof(version) );
+      block_stream.write( (const char*)&first, sizeof(first) );
+      block_stream.write( in.data() + in.genesis_begin, in.genesis_end - in.genesis_begin );
+      const auto totem = npos;
+      block_stream.write( (const char*)&totem, sizeof(totem) );
+
+      const uint64_t blocks_begin = sizeof(version) + sizeof(first) + (in.genesis_end - in.genesis_begin) + sizeof(totem);
+      const uint64_t old_begin = in.pos( first );
+      for( uint32_t block_num = first; block_num <= last; ++block_num ) {
+         const uint64_t old_pos = in.pos( block_num );
+         const uint64_t new_pos = old_pos - old_begin + blocks_begin;
+         block_stream.write( in.data() + old_pos, in.end( block_num ) - old_pos - sizeof(new_pos) );
+         block_stream.write( (const char*)&new_pos, sizeof(new_pos) );
+         index_stream.write( (const char*)&new_pos, sizeof(new_pos) );
+         if( block_num % 1000000 == 0 )
+            ilog( "Extracted block ${n}", ("n", block_num) );
+      }
+      block_stream.close();
+      index_stream.close();
+      EOS_ASSERT( !block_stream.fail() && !index_stream.fail(), block_log_exception,
+                  "Unable to write the block log in ${d}", ("d", output_dir) );
+   }
+
+   void block_log::trim_front( const fc::path& data_dir, uint32_t first ) {
+      uint32_t last = 0;
+      {
+         detail::block_log_files in( data_dir );
+         if( first <= in.first_block_num )
+            return;
+         last = in.last_block_num;
+      }
+      const auto temp_dir = data_dir / "trim-front";
+      fc::remove_all( temp_dir );
+      extract_blocks( data_dir, temp_dir, first, last );
+      fc::rename( temp_dir / "blocks.log", data_dir / "blocks.log" );
+      fc::rename( temp_dir / "blocks.index", data_dir / "blocks.index" );
+      fc::remove_all( temp_dir );
+   }
+
+   void block_log::trim_end( const fc::path& data_dir, uint32_t last ) {
+      uint64_t log_size = 0, index_size = 0;
+      {
+         detail::block_log_files in( data_dir );
+         EOS_ASSERT( last >= in.first_block_num, block_log_exception,
+                     "Cannot trim all the blocks of the block log of ${d}, its first block is ${f}",
+                     ("d", data_dir)("f", in.first_block_num) );
+         if( last >= in.last_block_num )
+            return;
+         log_size = in.end( last );
+         index_size = sizeof(uint64_t) * (last - in.first_block_num + 1);
+      }
+      boost::filesystem::resize_file( (data_dir / "blocks.log").generic_string(), log_size );
+      boost::filesystem::resize_file( (data_dir / "blocks.index").generic_string(), index_size );
+   }
+
 } } /// eosio::chain
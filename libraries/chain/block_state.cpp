@@ -41,4 +41,24 @@ namespace eosio { namespace chain {
    ,trxs( std::move(trx_metas) )
    {}
 
+   void block_state::compact() {
+      if( !block ) return; // sparsely loaded from a snapshot, nothing to rebuild them from
+      vector<transaction_metadata_ptr>().swap( trxs );
+      compacted = true;
+   }
+
+   const vector<transaction_metadata_ptr>& block_state::get_trxs() {
+      if( compacted ) {
+         compacted = false;
+         trxs.reserve( block->transactions.size() );
+         for( const auto& receipt : block->transactions ) {
+            if( receipt.trx.contains<packed_transaction>() ) {
+               const auto& pt = receipt.trx.get<packed_transaction>();
+               trxs.push_back( std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( pt ) ) );
+            }
+         }
+      }
+      return trxs;
+   }
+
 } } /// eosio::chain
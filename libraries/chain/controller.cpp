@@ -14,6 +14,9 @@
 #include <eosio/chain/contract_table_objects.hpp>
 #include <eosio/chain/generated_transaction_object.hpp>
 #include <eosio/chain/transaction_object.hpp>
+#include <eosio/chain/permission_object.hpp>
+#include <eosio/chain/permission_link_object.hpp>
+#include <eosio/chain/resource_limits_private.hpp>
 #include <eosio/chain/reversible_block_object.hpp>
 #include <eosio/chain/genesis_intrinsics.hpp>
 #include <eosio/chain/whitelisted_intrinsics.hpp>
@@ -23,6 +26,7 @@
 #include <eosio/chain/resource_limits.hpp>
 #include <eosio/chain/chain_snapshot.hpp>
 #include <eosio/chain/thread_utils.hpp>
+#include <eosio/chain/list_filter.hpp>
 
 #include <chainbase/chainbase.hpp>
 #include <fc/io/json.hpp>
@@ -30,6 +34,13 @@
 #include <fc/scoped_exit.hpp>
 #include <fc/variant_object.hpp>
 
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
 namespace eosio { namespace chain {
 
 using resource_limits::resource_limits_manager;
@@ -57,6 +68,117 @@ using contract_database_index_set = index_set<
    index_long_double_index
 >;
 
+/// indices of the chain whose changes by a block are redone when switching back to it, see block_redo
+using redo_index_set = index_set<
+   account_index,
+   account_metadata_index,
+   account_ram_correction_index,
+   global_property_multi_index,
+   protocol_state_multi_index,
+   dynamic_global_property_multi_index,
+   block_summary_multi_index,
+   transaction_multi_index,
+   generated_transaction_multi_index,
+   table_id_multi_index,
+   code_index,
+   key_value_index,
+   index64_index,
+   index128_index,
+   index256_index,
+   index_double_index,
+   index_long_double_index,
+   permission_index,
+   permission_usage_index,
+   permission_link_index,
+   resource_limits::resource_limits_index,
+   resource_limits::resource_usage_index,
+   resource_limits::resource_limits_state_index,
+   resource_limits::resource_limits_config_index
+>;
+
+/// changes of a block to one index, see index_redo_changes
+struct redo_changes {
+   virtual ~redo_changes() = default;
+   virtual void redo( database& db )const = 0;
+};
+
+/**
+ * Changes of a block to Index, read from the undo session of the block before it is undone: the ids of the rows it
+ * removed, the rows it modified or created as they were at the end of the block, and the next id of Index then. The
+ * copies keep their strings in the state database.
+ */
+template<typename Index>
+struct index_redo_changes : redo_changes {
+   using value_type = typename Index::value_type;
+   using id_type    = typename value_type::id_type;
+
+   vector<id_type>    removed;
+   vector<value_type> modified;
+   vector<value_type> created; ///< by id
+   id_type            next_id; ///< also advanced by the rows the block created then removed
+
+   /**
+    * changes of the block's undo session, below the session at the top of the stack of Index which was started at the
+    * end of the block to read the next id; null if there are none
+    */
+   static std::unique_ptr<redo_changes> record( const database& db ) {
+      const auto& index = db.get_index<Index>();
+      if( index.stack().size() < 2 ) return {};
+      const auto& undo = index.stack()[index.stack().size() - 2];
+      const auto next_id = index.stack().back().old_next_id;
+      if( undo.old_values.empty() && undo.removed_values.empty() && undo.new_ids.empty() && next_id == undo.old_next_id )
+         return {};
+
+      auto changes = std::make_unique<index_redo_changes>();
+      changes->next_id = next_id;
+      changes->removed.reserve( undo.removed_values.size() );
+      for( const auto& r : undo.removed_values )
+         changes->removed.push_back( r.first );
+      changes->modified.reserve( undo.old_values.size() );
+      for( const auto& m : undo.old_values )
+         changes->modified.push_back( index.get( m.first ) );
+      changes->created.reserve( undo.new_ids.size() );
+      for( const auto& id : undo.new_ids )
+         changes->created.push_back( index.get( id ) );
+      std::sort( changes->created.begin(), changes->created.end(),
+                 []( const value_type& a, const value_type& b ) { return a.id < b.id; } );
+      return changes;
+   }
+
+   /**
+    * throws if a row cannot be recreated with its id, or the next id differs from the one after the block, e.g. the
+    * block created and removed a row after the last one it kept; chainbase has no way to set it.
+    * @pre the session redoing the block is at the top of the stack of Index
+    */
+   void redo( database& db )const override {
+      for( const auto& id : removed )
+         db.remove( db.get<value_type>( id ) );
+      for( const auto& v : modified )
+         db.modify( db.get<value_type>( v.id ), [&]( value_type& o ) { o = v; } );
+      for( const auto& v : created ) {
+         db.create<value_type>( [&]( value_type& o ) {
+            EOS_ASSERT( o.id == v.id, fork_database_exception, "row ${v} of a redone block created as ${o}",
+                        ("v", v.id._id)("o", o.id._id) );
+            o = v;
+         } );
+      }
+      const auto& index = db.get_index<Index>();
+      const id_type redone_next_id = created.empty() ? index.stack().back().old_next_id : id_type( created.back().id._id + 1 );
+      EOS_ASSERT( redone_next_id == next_id, fork_database_exception, "next id ${r} of a redone block instead of ${n}",
+                  ("r", redone_next_id._id)("n", next_id._id) );
+   }
+};
+
+/// applied_transaction of a block, in order; the transactions are shared with their packed_transaction when they have one
+using applied_traces_type = vector<std::pair<transaction_trace_ptr, std::shared_ptr<const signed_transaction>>>;
+
+/// an applied reversible block, to switch back to it after a fork switch popped it without executing it again
+struct block_redo {
+   applied_traces_type                                             traces;
+   vector<std::unique_ptr<redo_changes>>                           changes; ///< recorded when the block is popped
+   bool                                                            popped = false;
+};
+
 class maybe_session {
    public:
       maybe_session() = default;
@@ -102,6 +224,10 @@ class maybe_session {
       optional<database::session>     _session;
 };
 
+struct transaction_id_hash {
+   size_t operator()( const transaction_id_type& id )const { return id._hash[0]; }
+};
+
 struct building_block {
    building_block( const block_header_state& prev,
                    block_timestamp_type when,
@@ -118,7 +244,27 @@ struct building_block {
    vector<transaction_metadata_ptr>   _pending_trx_metas;
    vector<transaction_receipt>        _pending_trx_receipts;
    vector<action_receipt>             _actions;
+   vector<pair<transaction_id_type, time_point_sec>>             _recorded_trxs; ///< written to the deduplication table by finalize_block, in order
+   std::unordered_set<transaction_id_type, transaction_id_hash>  _recorded_trx_ids;
    optional<checksum256_type>         _transaction_mroot;
+   merkle_accumulator                 _trx_merkle;    ///< digests of the committed _pending_trx_receipts
+   merkle_accumulator                 _action_merkle; ///< digests of the committed _actions
+
+   /// folds receipts and actions appended since the previous call into the merkle accumulators
+   void fold_merkle_leaves( bool with_trxs ) {
+      if( with_trxs )
+         fold( _trx_merkle, _pending_trx_receipts );
+      fold( _action_merkle, _actions );
+   }
+
+private:
+   template<typename Leaves>
+   static void fold( merkle_accumulator& acc, const Leaves& leaves ) {
+      if( leaves.size() < acc.size() )
+         acc.reset(); // folded leaves were rolled back, cannot happen once a transaction is committed
+      for( auto i = acc.size(); i < leaves.size(); ++i )
+         acc.append( leaves[i].digest() );
+   }
 };
 
 struct assembled_block {
@@ -147,6 +293,7 @@ struct pending_state {
    block_stage_type                   _block_stage;
    controller::block_status           _block_status = controller::block_status::incomplete;
    optional<block_id_type>            _producer_block_id;
+   applied_traces_type                _applied_traces; ///< kept for block_redo
 
    /** @pre _block_stage cannot hold completed_block alternative */
    const pending_block_header_state& get_pending_block_header_state()const {
@@ -207,10 +354,104 @@ struct pending_state {
    }
 };
 
+/**
+ *  Irreversible replay pipeline. A reader thread streams blocks from the block log; for every block
+ *  the thread pool unpacks its transactions, computes ids and, when auth is checked, recovers keys,
+ *  while the main thread is applying previous blocks taken from a bounded queue.
+ */
+class replay_prefetcher {
+   public:
+      struct prefetched_block {
+         signed_block_ptr                                           block;
+         std::shared_future<std::vector<transaction_metadata_ptr>>  trxs;
+      };
+
+      static constexpr size_t max_prefetched_blocks = 64;
+
+      replay_prefetcher( const block_log& blog, uint32_t first_block_num, const task_executor& thread_pool,
+                         const chain_id_type& chain_id, bool recover_keys )
+      :reader( blog, first_block_num ), thread_pool( thread_pool ), chain_id( chain_id ), recover_keys( recover_keys )
+      {
+         thread = std::thread( [this]() { run(); } );
+      }
+
+      ~replay_prefetcher() {
+         {
+            std::lock_guard<std::mutex> g( mtx );
+            stopping = true;
+         }
+         cv.notify_all();
+         thread.join();
+      }
+
+      /// @return blocks in order, empty after the last one; rethrows errors of reading the log
+      optional<prefetched_block> next() {
+         std::unique_lock<std::mutex> lock( mtx );
+         cv.wait( lock, [this]() { return !queue.empty() || done; } );
+         if( queue.empty() ) {
+            if( except ) std::rethrow_exception( except );
+            return {};
+         }
+         auto result = std::move( queue.front() );
+         queue.pop_front();
+         cv.notify_all();
+         return result;
+      }
+
+   private:
+      void run() {
+         std::exception_ptr e;
+         try {
+            while( auto b = reader.next() ) {
+               auto trxs = async_thread_pool( thread_pool, [b, chain_id = chain_id, recover_keys = recover_keys]() {
+                  std::vector<transaction_metadata_ptr> result;
+                  result.reserve( b->transactions.size() );
+                  for( const auto& receipt : b->transactions ) {
+                     if( receipt.trx.contains<packed_transaction>() ) {
+                        auto mtrx = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( receipt.trx.get<packed_transaction>() ) );
+                        if( recover_keys ) {
+                           mtrx->recover_keys( chain_id ); // not shared with other threads yet
+                        }
+                        result.emplace_back( std::move( mtrx ) );
+                     }
+                  }
+                  return result;
+               } ).share();
+
+               std::unique_lock<std::mutex> lock( mtx );
+               cv.wait( lock, [this]() { return queue.size() < max_prefetched_blocks || stopping; } );
+               if( stopping ) break;
+               queue.push_back( { std::move( b ), std::move( trxs ) } );
+               cv.notify_all();
+            }
+         } catch( ... ) {
+            e = std::current_exception();
+         }
+         std::lock_guard<std::mutex> g( mtx );
+         except = e;
+         done = true;
+         cv.notify_all();
+      }
+
+      block_log::sequential_reader   reader;
+      const task_executor            thread_pool;
+      const chain_id_type            chain_id;
+      const bool                     recover_keys;
+
+      std::thread                    thread;
+      std::mutex                     mtx;
+      std::condition_variable        cv;
+      std::deque<prefetched_block>   queue;
+      bool                           stopping = false;
+      bool                           done = false;
+      std::exception_ptr             except;
+};
+
 struct controller_impl {
    controller&                    self;
    chainbase::database            db;
    chainbase::database            reversible_blocks; ///< a special database to persist blocks that have successfully been applied but are still reversible
+   reversible_block_cache         reversible_cache;  ///< decoded blocks of reversible_blocks
    block_log                      blog;
    optional<pending_state>        pending;
    block_state_ptr                head;
@@ -220,14 +461,49 @@ struct controller_impl {
    authorization_manager          authorization;
    protocol_feature_manager       protocol_features;
    controller::config             conf;
+   list_filter                    actor_blacklist_filter;    ///< built from conf.actor_blacklist
+   list_filter                    contract_blacklist_filter; ///< built from conf.contract_blacklist
+   list_filter                    action_blacklist_filter;   ///< built from conf.action_blacklist
+   list_filter                    key_blacklist_filter;      ///< built from conf.key_blacklist
    chain_id_type                  chain_id;
    optional<fc::time_point>       replay_head_time;
+   vector<controller::startup_phase> startup_phases;
    db_read_mode                   read_mode = db_read_mode::SPECULATIVE;
    bool                           in_trx_requiring_checks = false; ///< if true, checks that are normally skipped on replay (e.g. auth checks) cannot be skipped
    optional<fc::microseconds>     subjective_cpu_leeway;
    bool                           trusted_producer_light_validation = false;
    uint32_t                       snapshot_head_block = 0;
-   named_thread_pool              thread_pool;
+   /**
+    * Mirror of the block_summary_object table, indexed by block number & 0xffff, for the TaPoS checks of transactions.
+    * Written with the table by create_block_summary but not reverted when the block is undone: an entry for a block
+    * after head is stale and the table is read instead.
+    */
+   vector<block_id_type>          tapos_ring;
+   task_scheduler                 scheduler;
+   task_executor                  thread_pool;       ///< on scheduler, block validation and key recovery of transactions
+
+   struct prefetched_block {
+      std::shared_future<block_state_ptr>  header; ///< header validated, producer signature not verified yet
+      std::shared_future<block_state_ptr>  state;  ///< fully validated, taken by create_block_state_future
+      vector<transaction_metadata_ptr>     trxs;   ///< keys being recovered, taken by apply_block
+   };
+   static constexpr size_t                       max_prefetched_blocks = 1024;
+   map<block_id_type, prefetched_block>          prefetched_blocks; ///< block ids start with the block number, so ordered by it
+
+   /**
+    * header tasks of prefetch_blocks, run one after the other: each needs the state of the previous block, and a task
+    * waiting for another one still queued could hold the last free worker, the scheduler does not run tasks in order
+    */
+   struct prefetch_header_queue {
+      std::mutex                         mtx;
+      std::deque<std::function<void()>>  tasks;
+      bool                               running = false; ///< a task of the thread pool is taking them
+   };
+   std::shared_ptr<prefetch_header_queue>        prefetch_headers = std::make_shared<prefetch_header_queue>();
+   map<uint32_t, block_id_type>                  finality_checkpoints; ///< add_finality_checkpoint, by block number
+   uint64_t                                      checkpointed_blocks = 0; ///< prefetched in a chain ending at a finality checkpoint
+   uint32_t                                      reversible_prune_through = 0; ///< reversible blocks up to this one are in the block log
+   map<block_id_type, block_redo>                redo_blocks;       ///< at most conf.fork_switch_redo_blocks, ordered by block number
 
    typedef pair<scope_name,action_name>                   handler_key;
    map< account_name, map<handler_key, apply_handler> >   apply_handlers;
@@ -252,19 +528,64 @@ struct controller_impl {
       {
          reversible_blocks.remove( *b );
       }
+      reversible_cache.remove( head->block_num );
 
       if ( read_mode == db_read_mode::SPECULATIVE ) {
          EOS_ASSERT( head->block, block_validate_exception, "attempting to pop a block that was sparsely loaded from a snapshot");
-         for( const auto& t : head->trxs )
-            unapplied_transactions[t->signed_id] = t;
+         for( const auto& t : head->get_trxs() )
+            unapplied_transactions.add( t );
       }
 
+      record_redo_changes();
+
       head = prev;
       db.undo();
 
       protocol_features.popped_blocks_to( prev->block_num );
    }
 
+   /// keeps the changes of head, about to be undone, if it is one of redo_blocks
+   void record_redo_changes() {
+      auto itr = redo_blocks.find( head->id );
+      if( itr == redo_blocks.end() ) return;
+      auto& r = itr->second;
+      r.changes.clear();
+      // an empty session records the next id of every index at the end of the block as its old_next_id
+      auto next_ids = db.start_undo_session( true );
+      redo_index_set::walk_indices( [&]( auto utils ) {
+         using index_t = typename decltype( utils )::index_t;
+         if( auto c = index_redo_changes<index_t>::record( db ) )
+            r.changes.emplace_back( std::move( c ) );
+      } );
+      next_ids.undo();
+      r.popped = true;
+   }
+
+   /// `bsp`, just committed, can be redone once popped; blocks activating protocol features are always applied
+   void add_redo_block( const block_state_ptr& bsp, applied_traces_type&& traces ) {
+      if( !bsp->get_new_protocol_feature_activations().empty() ) return;
+      auto& r = redo_blocks[bsp->id];
+      r.traces = std::move( traces );
+      r.changes.clear();
+      r.popped = false;
+      while( redo_blocks.size() > conf.fork_switch_redo_blocks )
+         redo_blocks.erase( redo_blocks.begin() );
+   }
+
+   /**
+    * emits applied_transaction and keeps it for block_redo. `packed` holds `trx` when it is an input transaction, the
+    * trace refers to it then, instead of a copy of the transaction and its context-free data kept as long as the block
+    * can be redone.
+    */
+   void emit_applied_transaction( const transaction_trace_ptr& trace, const signed_transaction& trx,
+                                  const packed_transaction_ptr& packed = packed_transaction_ptr() ) {
+      if( conf.fork_switch_redo_blocks > 0 && pending ) {
+         pending->_applied_traces.emplace_back( trace, packed ? std::shared_ptr<const signed_transaction>( packed, &trx )
+                                                              : std::make_shared<const signed_transaction>( trx ) );
+      }
+      emit( self.applied_transaction, std::tie( trace, trx ) );
+   }
+
    template<builtin_protocol_feature_t F>
    void on_activation();
 
@@ -292,31 +613,43 @@ struct controller_impl {
     reversible_blocks( cfg.blocks_dir/config::reversible_blocks_dir_name,
         cfg.read_only ? database::read_only : database::read_write,
         cfg.reversible_cache_size, false, cfg.db_map_mode, cfg.db_hugepage_paths ),
-    blog( cfg.blocks_dir ),
+    reversible_cache( cfg.reversible_block_cache_size ),
+    blog( cfg.blocks_dir, cfg.blocks_log_segments, cfg.blocks_log_writes ),
     fork_db( cfg.state_dir ),
-    wasmif( cfg.wasm_runtime, db ),
+    wasmif( cfg.wasm_runtime, db, cfg.wasm_cache_dir, cfg.wasm_cache_size ),
     resource_limits( db ),
     authorization( s, db ),
     protocol_features( std::move(pfs) ),
     conf( cfg ),
     chain_id( cfg.genesis.compute_chain_id() ),
     read_mode( cfg.read_mode ),
-    thread_pool( "chain", cfg.thread_pool_size )
+    scheduler( "chain", cfg.thread_pool_size ),
+    thread_pool( scheduler, task_priority::block_apply )
    {
+      reset_blacklist_filters();
 
+      auto fork_db_start = fc::time_point::now();
       fork_db.open( [this]( block_timestamp_type timestamp,
                             const flat_set<digest_type>& cur_features,
                             const vector<digest_type>& new_features )
                            { check_protocol_features( timestamp, cur_features, new_features ); }
       );
+      add_startup_phase( "fork_db_open", fork_db_start );
 
       set_activation_handler<builtin_protocol_feature_t::preactivate_feature>();
       set_activation_handler<builtin_protocol_feature_t::replace_deferred>();
       set_activation_handler<builtin_protocol_feature_t::get_sender>();
+      set_activation_handler<builtin_protocol_feature_t::rsa_verify_batch>();
+      set_activation_handler<builtin_protocol_feature_t::secondary_index_batch>();
 
       self.irreversible_block.connect([this](const block_state_ptr& bsp) {
          wasmif.current_lib(bsp->block_num);
       });
+      wasmif.on_cache_access([this](const wasm_interface::cache_access& a) {
+         if( !self.wasm_cache_accessed.empty() ) {
+            emit( self.wasm_cache_accessed, a );
+         }
+      });
 
 
 #define SET_APP_HANDLER( receiver, contract, action) \
@@ -369,6 +702,37 @@ struct controller_impl {
       }
    }
 
+   void emit_stage_timing( controller::pipeline_stage stage, const fc::time_point& start ) {
+      if( !self.pipeline_stage_timed.empty() ) {
+         emit( self.pipeline_stage_timed, controller::pipeline_stage_timing{ stage, fc::time_point::now() - start } );
+      }
+   }
+
+   void emit_action_profiles( const transaction_context& trx_context ) {
+      if( self.action_profiled.empty() ) return;
+
+      const auto& traces = trx_context.trace->action_traces;
+      int64_t total_elapsed = 0;
+      for( const auto& at : traces ) {
+         total_elapsed += at.elapsed.count();
+      }
+      for( size_t i = 0; i < traces.size(); ++i ) {
+         const auto& at = traces[i];
+         controller::action_profile profile{ at.receiver, at.act.name, at.elapsed };
+         profile.billed_cpu_us = total_elapsed > 0
+                               ? trx_context.billed_cpu_time_us * at.elapsed.count() / total_elapsed
+                               : trx_context.billed_cpu_time_us / static_cast<int64_t>(traces.size());
+         for( const auto& delta : at.account_ram_deltas ) {
+            profile.ram_delta += delta.delta;
+         }
+         if( i < trx_context.action_db_intrinsic_calls.size() ) {
+            profile.db_intrinsic_calls = trx_context.action_db_intrinsic_calls[i];
+            profile.arena_allocations = trx_context.action_arena_allocations[i];
+         }
+         emit( self.action_profiled, profile );
+      }
+   }
+
    void log_irreversible() {
       EOS_ASSERT( fork_db.root(), fork_database_exception, "fork database not properly initialized" );
 
@@ -396,9 +760,8 @@ struct controller_impl {
 
       const auto branch = fork_db.fetch_branch( fork_head->id, new_lib_num );
       ///@}
+      const auto start = fc::time_point::now();
       try {
-         const auto& rbi = reversible_blocks.get_index<reversible_block_index,by_num>();
-
          for( auto bitr = branch.rbegin(); bitr != branch.rend(); ++bitr ) {
             if( read_mode == db_read_mode::IRREVERSIBLE ) {
                apply_block( *bitr, controller::block_status::complete );
@@ -413,15 +776,15 @@ struct controller_impl {
 
             blog.append( (*bitr)->block );
 
-            auto rbitr = rbi.begin();
-            while( rbitr != rbi.end() && rbitr->blocknum <= (*bitr)->block_num ) {
-               reversible_blocks.remove( *rbitr );
-               rbitr = rbi.begin();
-            }
+            // the reversible blocks now in the block log are removed by prune_irreversible, a few per block
+            reversible_prune_through = (*bitr)->block_num;
+            reversible_cache.remove_through( (*bitr)->block_num );
+            while( !redo_blocks.empty() && block_header::num_from_id( redo_blocks.begin()->first ) <= (*bitr)->block_num )
+               redo_blocks.erase( redo_blocks.begin() );
          }
       } catch( fc::exception& ) {
          if( root_id != fork_db.root()->id ) {
-            fork_db.advance_root( root_id );
+            advance_fork_db_root( root_id );
          }
          throw;
       }
@@ -429,8 +792,56 @@ struct controller_impl {
       //db.commit( fork_head->dpos_irreversible_blocknum ); // redundant
 
       if( root_id != fork_db.root()->id ) {
-         fork_db.advance_root( root_id );
+         advance_fork_db_root( root_id );
+      }
+      blog.commit();
+      prune_irreversible( conf.lib_prune_blocks );
+      emit_stage_timing( controller::pipeline_stage::block_irreversible, start );
+   }
+
+   /// the block states released by the fork database are destroyed on the thread pool: after a long finality
+   /// stall they are thousands of blocks with their transactions
+   void advance_fork_db_root( const block_id_type& root_id ) {
+      vector<block_state_ptr> removed;
+      fork_db.advance_root( root_id, &removed );
+      if( !removed.empty() ) {
+         thread_pool.post( [removed{std::move( removed )}]() {} );
+      }
+   }
+
+   /// removes at most `max_blocks` reversible blocks already in the block log, all of them if 0;
+   /// true if some are left
+   bool prune_irreversible( uint32_t max_blocks ) {
+      const auto& rbi = reversible_blocks.get_index<reversible_block_index,by_num>();
+      for( uint32_t removed = 0; max_blocks == 0 || removed < max_blocks; ++removed ) {
+         auto itr = rbi.begin();
+         if( itr == rbi.end() || itr->blocknum > reversible_prune_through )
+            return false;
+         reversible_blocks.remove( *itr );
       }
+      const auto itr = rbi.begin();
+      return itr != rbi.end() && itr->blocknum <= reversible_prune_through;
+   }
+
+   /// the decoded block of `obj`, shared with its block state when the fork database has it
+   signed_block_ptr reversible_block( const reversible_block_object& obj )const {
+      if( const auto* cached = reversible_cache.find( obj.blocknum ) )
+         return cached->block;
+      if( auto bsp = fork_db.get_block( obj.get_block_id() ) ) {
+         if( bsp->block ) return bsp->block;
+      }
+      return obj.get_block();
+   }
+
+   /// id of a reversible block, without reading its header when it is cached
+   block_id_type reversible_block_id( const reversible_block_object& obj )const {
+      if( const auto* cached = reversible_cache.find( obj.blocknum ) )
+         return cached->id;
+      return obj.get_block_id();
+   }
+
+   void add_startup_phase( const char* name, fc::time_point start ) {
+      startup_phases.push_back( { name, start, fc::time_point::now() - start } );
    }
 
    /**
@@ -441,7 +852,7 @@ struct controller_impl {
       producer_schedule_type initial_schedule{ 0, {{config::system_account_name, conf.genesis.initial_key}} };
 
       block_header_state genheader;
-      genheader.active_schedule                = initial_schedule;
+      genheader.active_schedule                = std::make_shared<producer_schedule_type>( initial_schedule );
       genheader.pending_schedule.schedule      = initial_schedule;
       genheader.pending_schedule.schedule_hash = fc::sha256::hash(initial_schedule);
       genheader.header.timestamp               = conf.genesis.initial_timestamp;
@@ -466,12 +877,57 @@ struct controller_impl {
 
       std::exception_ptr except_ptr;
 
+      // replay timing: a line per block, RAM deltas summed from the traces of its transactions
+      std::ofstream timing;
+      boost::signals2::scoped_connection ram_delta_connection;
+      int64_t ram_delta = 0;
+      if( !conf.replay_timing_file.empty() ) {
+         timing.open( conf.replay_timing_file.generic_string(), std::ios::out | std::ios::trunc );
+         EOS_ASSERT( timing.is_open(), misc_exception, "unable to open replay timing file ${f}", ("f", conf.replay_timing_file.generic_string()) );
+         timing << "block_num,transactions,apply_us,billed_cpu_us,net_bytes,ram_delta\n";
+         ram_delta_connection = self.applied_transaction.connect(
+            [&ram_delta]( std::tuple<const transaction_trace_ptr&, const signed_transaction&> t ) {
+               for( const auto& at : std::get<0>( t )->action_traces ) {
+                  for( const auto& d : at.account_ram_deltas )
+                     ram_delta += d.delta;
+               }
+            } );
+      }
+      auto push_block = [&]( const signed_block_ptr& b, controller::block_status s,
+                             const std::vector<transaction_metadata_ptr>& prepared_trxs ) {
+         if( !timing.is_open() ) {
+            replay_push_block( b, s, prepared_trxs );
+            return;
+         }
+         ram_delta = 0;
+         const auto apply_start = fc::time_point::now();
+         replay_push_block( b, s, prepared_trxs );
+         const auto apply_time = fc::time_point::now() - apply_start;
+         uint64_t cpu_us = 0;
+         uint64_t net_bytes = 0;
+         for( const auto& r : b->transactions ) {
+            cpu_us += r.cpu_usage_us;
+            net_bytes += uint64_t( r.net_usage_words ) * 8;
+         }
+         timing << b->block_num() << ',' << b->transactions.size() << ',' << apply_time.count() << ','
+                << cpu_us << ',' << net_bytes << ',' << ram_delta << '\n';
+      };
+      bool stopped = false;
+
       if( start_block_num <= blog_head->block_num() ) {
          ilog( "existing block log, attempting to replay from ${s} to ${n} blocks",
                ("s", start_block_num)("n", blog_head->block_num()) );
          try {
-            while( auto next = blog.read_block_by_num( head->block_num + 1 ) ) {
-               replay_push_block( next, controller::block_status::irreversible );
+            // keys are only needed if auth is checked, see skip_auth_check
+            replay_prefetcher prefetcher( blog, start_block_num, thread_pool, chain_id, conf.force_all_checks );
+            while( auto prefetched = prefetcher.next() ) {
+               const auto& next = prefetched->block;
+               push_block( next, controller::block_status::irreversible, prefetched->trxs.get() );
+               if( conf.replay_max_blocks && next->block_num() + 1 - start_block_num >= conf.replay_max_blocks ) {
+                  ilog( "stopping replay after ${n} blocks, see replay-max-blocks", ("n", conf.replay_max_blocks) );
+                  stopped = true;
+                  break;
+               }
                if( next->block_num() % 500 == 0 ) {
                   ilog( "${n} of ${head}", ("n", next->block_num())("head", blog_head->block_num()) );
                   if( shutdown() ) break;
@@ -500,16 +956,21 @@ struct controller_impl {
          // revision ordinal to the appropriate expected value here.
          if( self.skip_db_sessions( controller::block_status::irreversible ) )
             db.set_revision( head->block_num );
+         add_startup_phase( "irreversible_replay", start );
       } else {
          ilog( "no irreversible blocks need to be replayed" );
       }
 
-      if( !except_ptr && !shutdown() ) {
+      if( !except_ptr && !shutdown() && !stopped ) {
+         auto reversible_start = fc::time_point::now();
          int rev = 0;
          while( auto obj = reversible_blocks.find<reversible_block_object,by_num>(head->block_num+1) ) {
             ++rev;
-            replay_push_block( obj->get_block(), controller::block_status::validated );
+            auto b = reversible_block( *obj );
+            push_block( b, controller::block_status::validated, {} );
+            reversible_cache.add( b->id(), b, obj->packedblock.size() );
          }
+         add_startup_phase( "reversible_replay", reversible_start );
          ilog( "${n} reversible blocks replayed", ("n",rev) );
       }
 
@@ -528,15 +989,20 @@ struct controller_impl {
       // Setup state if necessary (or in the default case stay with already loaded state):
       uint32_t lib_num = 1u;
       if( snapshot ) {
+         auto snapshot_start = fc::time_point::now();
          snapshot->validate();
          if( blog.head() ) {
             lib_num = blog.head()->block_num();
             read_from_snapshot( snapshot, blog.first_block_num(), lib_num );
+            EOS_ASSERT( conf.partial_state_contracts.empty() || lib_num == head->block_num, block_log_exception,
+                        "Blocks after the snapshot cannot be replayed into a partial state, start with a block log ending at block ${n}",
+                        ("n", head->block_num) );
          } else {
             read_from_snapshot( snapshot, 0, std::numeric_limits<uint32_t>::max() );
             lib_num = head->block_num;
             blog.reset( conf.genesis, signed_block_ptr(), lib_num + 1 );
          }
+         add_startup_phase( "snapshot_load", snapshot_start );
       } else {
          if( db.revision() < 1 || !fork_db.head() ) {
             if( fork_db.head() ) {
@@ -549,7 +1015,9 @@ struct controller_impl {
                            "No existing fork database despite existing chain state. Replay required." );
                wlog( "No existing chain state or fork database. Initializing fresh blockchain state and resetting fork database.");
             }
+            auto genesis_start = fc::time_point::now();
             initialize_blockchain_state(); // sets head to genesis state
+            add_startup_phase( "genesis_initialize", genesis_start );
 
             if( !fork_db.head() ) {
                fork_db.reset( *head );
@@ -604,6 +1072,7 @@ struct controller_impl {
       while( db.revision() > head->block_num ) {
          db.undo();
       }
+      reset_tapos_ring();
 
       protocol_features.init( db );
 
@@ -692,13 +1161,15 @@ struct controller_impl {
       }
 
       if( report_integrity_hash ) {
+         auto hash_start = fc::time_point::now();
          const auto hash = calculate_integrity_hash();
+         add_startup_phase( "integrity_hash", hash_start );
          ilog( "database initialized with hash: ${hash}", ("hash", hash) );
       }
    }
 
    ~controller_impl() {
-      thread_pool.stop();
+      scheduler.stop();
       pending.reset();
    }
 
@@ -722,57 +1193,88 @@ struct controller_impl {
                   */
    }
 
-   void add_contract_tables_to_snapshot( const snapshot_writer_ptr& snapshot ) const {
-      snapshot->write_section("contract_tables", [this]( auto& section ) {
-         index_utils<table_id_multi_index>::walk(db, [this, &section]( const table_id_object& table_row ){
-            // add a row for the table
-            section.add_row(table_row, db);
+   /// the contract tables with ids in [begin, end)
+   void add_contract_tables_to_snapshot( snapshot_writer::section_writer& section, table_id begin, table_id end ) const {
+      index_utils<table_id_multi_index>::walk_range<by_id>(db, begin, end, [this, &section]( const table_id_object& table_row ){
+         // add a row for the table
+         section.add_row(table_row, db);
 
-            // followed by a size row and then N data rows for each type of table
-            contract_database_index_set::walk_indices([this, &section, &table_row]( auto utils ) {
-               using utils_t = decltype(utils);
-               using value_t = typename decltype(utils)::index_t::value_type;
-               using by_table_id = object_to_table_id_tag_t<value_t>;
+         // followed by a size row and then N data rows for each type of table
+         contract_database_index_set::walk_indices([this, &section, &table_row]( auto utils ) {
+            using utils_t = decltype(utils);
+            using value_t = typename decltype(utils)::index_t::value_type;
+            using by_table_id = object_to_table_id_tag_t<value_t>;
 
-               auto tid_key = boost::make_tuple(table_row.id);
-               auto next_tid_key = boost::make_tuple(table_id_object::id_type(table_row.id._id + 1));
+            auto tid_key = boost::make_tuple(table_row.id);
+            auto next_tid_key = boost::make_tuple(table_id_object::id_type(table_row.id._id + 1));
 
-               unsigned_int size = utils_t::template size_range<by_table_id>(db, tid_key, next_tid_key);
-               section.add_row(size, db);
+            unsigned_int size = utils_t::template size_range<by_table_id>(db, tid_key, next_tid_key);
+            section.add_row(size, db);
 
-               utils_t::template walk_range<by_table_id>(db, tid_key, next_tid_key, [this, &section]( const auto &row ) {
-                  section.add_row(row, db);
-               });
+            utils_t::template walk_range<by_table_id>(db, tid_key, next_tid_key, [this, &section]( const auto &row ) {
+               section.add_row(row, db);
             });
          });
       });
    }
 
+   /// the contract_tables section in parts of about contract_tables_part_rows rows, which chunked writers encode concurrently
+   snapshot_writer::section_parts contract_tables_snapshot_parts() const {
+      static constexpr uint64_t contract_tables_part_rows = 100000;
+
+      snapshot_writer::section_parts section{ "contract_tables", {} };
+      const auto& tables = db.get_index<table_id_multi_index, by_id>();
+      table_id begin = tables.empty() ? table_id() : tables.begin()->id;
+      uint64_t rows = 0;
+      for( const auto& t : tables ) {
+         if( rows >= contract_tables_part_rows ) {
+            section.parts.emplace_back( [this, begin, end = t.id]( auto& section ) {
+               add_contract_tables_to_snapshot( section, begin, end );
+            });
+            begin = t.id;
+            rows = 0;
+         }
+         rows += t.count + 1;
+      }
+      section.parts.emplace_back( [this, begin]( auto& section ) {
+         add_contract_tables_to_snapshot( section, begin, table_id( std::numeric_limits<int64_t>::max() ) );
+      });
+      return section;
+   }
+
    void read_contract_tables_from_snapshot( const snapshot_reader_ptr& snapshot ) {
-      snapshot->read_section("contract_tables", [this]( auto& section ) {
+      const auto& contracts = conf.partial_state_contracts;
+      snapshot->read_section("contract_tables", [this, &contracts]( auto& section ) {
          bool more = !section.empty();
          while (more) {
             // read the row for the table
             table_id_object::id_type t_id;
-            index_utils<table_id_multi_index>::create(db, [this, &section, &t_id](auto& row) {
+            bool keep = true;
+            index_utils<table_id_multi_index>::create(db, [this, &section, &t_id, &keep, &contracts](auto& row) {
                section.read_row(row, db);
                t_id = row.id;
+               keep = contracts.empty() || contracts.count( row.code );
             });
 
             // read the size and data rows for each type of table
-            contract_database_index_set::walk_indices([this, &section, &t_id, &more](auto utils) {
+            contract_database_index_set::walk_indices([this, &section, &t_id, &more, keep](auto utils) {
                using utils_t = decltype(utils);
 
                unsigned_int size;
                more = section.read_row(size, db);
 
                for (size_t idx = 0; idx < size.value; idx++) {
-                  utils_t::create(db, [this, &section, &more, &t_id](auto& row) {
+                  // rows have no size of their own in the snapshot, those of other contracts are read into the
+                  // state and removed at once, so that they take no memory
+                  const auto& row = db.create<typename utils_t::index_t::value_type>([this, &section, &more, &t_id](auto& row) {
                      row.t_id = t_id;
                      more = section.read_row(row, db);
                   });
+                  if( !keep ) db.remove( row );
                }
             });
+
+            if( !keep ) db.remove( db.get<table_id_object>( t_id ) );
          }
       });
    }
@@ -790,7 +1292,9 @@ struct controller_impl {
          section.template add_row<block_header_state>(*fork_db.head(), db);
       });
 
-      controller_index_set::walk_indices([this, &snapshot]( auto utils ){
+      // sections only read the state, a chunked writer encodes them concurrently
+      std::vector<snapshot_writer::section_parts> sections;
+      controller_index_set::walk_indices([this, &sections]( auto utils ){
          using value_t = typename decltype(utils)::index_t::value_type;
 
          // skip the table_id_object as its inlined with contract tables section
@@ -798,14 +1302,15 @@ struct controller_impl {
             return;
          }
 
-         snapshot->write_section<value_t>([this]( auto& section ){
+         sections.push_back( { detail::snapshot_section_traits<value_t>::section_name(), { [this]( auto& section ){
             decltype(utils)::walk(db, [this, &section]( const auto &row ) {
                section.add_row(row, db);
             });
-         });
+         } } } );
       });
 
-      add_contract_tables_to_snapshot(snapshot);
+      sections.emplace_back( contract_tables_snapshot_parts() );
+      snapshot->write_sections( sections );
 
       authorization.add_to_snapshot(snapshot);
       resource_limits.add_to_snapshot(snapshot);
@@ -860,6 +1365,15 @@ struct controller_impl {
       authorization.read_from_snapshot(snapshot);
       resource_limits.read_from_snapshot(snapshot);
 
+      if( !conf.partial_state_contracts.empty() ) {
+         ilog( "Loaded the tables of ${n} contracts from the snapshot, the state is partial", ("n", conf.partial_state_contracts.size()) );
+      } else if( auto expected = snapshot->expected_integrity_hash() ) {
+         const auto actual = calculate_integrity_hash();
+         EOS_ASSERT( actual == *expected, snapshot_exception,
+                     "State loaded from snapshot has integrity hash ${actual}, expected ${expected}",
+                     ("actual", actual)("expected", *expected) );
+      }
+
       db.set_revision( head->block_num );
    }
 
@@ -975,8 +1489,8 @@ struct controller_impl {
          for( auto ritr = branches.first.rbegin(); ritr != branches.first.rend(); ++ritr ) {
             optional<fc::exception> except;
             try {
-               apply_block( (*ritr), (*ritr)->validated ? controller::block_status::validated 
-                                                               : controller::block_status::complete );
+               apply_or_redo_block( (*ritr), (*ritr)->validated ? controller::block_status::validated
+                                                                       : controller::block_status::complete );
                fork_db.mark_valid( *ritr );
                head = *ritr;
             }
@@ -997,7 +1511,7 @@ struct controller_impl {
 
                // re-apply good blocks
                for( auto ritr = branches.second.rbegin(); ritr != branches.second.rend(); ++ritr ) {
-                  apply_block( (*ritr), controller::block_status::validated /* we previously validated these blocks*/ );
+                  apply_or_redo_block( (*ritr), controller::block_status::validated /* we previously validated these blocks*/ );
                   head = *ritr;
                }
                throw *except;
@@ -1071,6 +1585,7 @@ struct controller_impl {
 
          trx_context.squash();
          restore.cancel();
+         fold_block_merkles();
          return trace;
       } catch( const disallowed_transaction_extensions_bad_block_exception& ) {
          throw;
@@ -1157,7 +1672,7 @@ struct controller_impl {
 
       transaction_trace_ptr trace;
       if( gtrx.expiration < self.pending_block_time() ) {
-         trace = std::make_shared<transaction_trace>();
+         trace = make_transaction_trace();
          trace->id = gtrx.trx_id;
          trace->block_num = self.head_block_num() + 1;
          trace->block_time = self.pending_block_time();
@@ -1166,8 +1681,9 @@ struct controller_impl {
          trace->receipt = push_receipt( gtrx.trx_id, transaction_receipt::expired, billed_cpu_time_us, 0 ); // expire the transaction
          trace->account_ram_delta = account_delta( gtrx.payer, trx_removal_ram_delta );
          emit( self.accepted_transaction, trx );
-         emit( self.applied_transaction, std::tie(trace, dtrx) );
+         emit_applied_transaction( trace, dtrx );
          undo_session.squash();
+         fold_block_merkles();
          return trace;
       }
 
@@ -1200,6 +1716,7 @@ struct controller_impl {
 
          trx_context.exec();
          trx_context.finalize(); // Automatically rounds up network and CPU usage in trace and bills payers if successful
+         emit_action_profiles( trx_context );
 
          auto restore = make_block_restore_point();
 
@@ -1213,12 +1730,13 @@ struct controller_impl {
          trace->account_ram_delta = account_delta( gtrx.payer, trx_removal_ram_delta );
 
          emit( self.accepted_transaction, trx );
-         emit( self.applied_transaction, std::tie(trace, dtrx) );
+         emit_applied_transaction( trace, dtrx );
 
          trx_context.squash();
          undo_session.squash();
 
          restore.cancel();
+         fold_block_merkles();
 
          return trace;
       } catch( const disallowed_transaction_extensions_bad_block_exception& ) {
@@ -1247,7 +1765,7 @@ struct controller_impl {
          if( !trace->except_ptr ) {
             trace->account_ram_delta = account_delta( gtrx.payer, trx_removal_ram_delta );
             emit( self.accepted_transaction, trx );
-            emit( self.applied_transaction, std::tie(trace, dtrx) );
+            emit_applied_transaction( trace, dtrx );
             undo_session.squash();
             return trace;
          }
@@ -1288,12 +1806,13 @@ struct controller_impl {
          trace->account_ram_delta = account_delta( gtrx.payer, trx_removal_ram_delta );
 
          emit( self.accepted_transaction, trx );
-         emit( self.applied_transaction, std::tie(trace, dtrx) );
+         emit_applied_transaction( trace, dtrx );
 
          undo_session.squash();
+         fold_block_merkles();
       } else {
          emit( self.accepted_transaction, trx );
-         emit( self.applied_transaction, std::tie(trace, dtrx) );
+         emit_applied_transaction( trace, dtrx );
       }
 
       return trace;
@@ -1336,6 +1855,9 @@ struct controller_impl {
          // call recover keys so that trx->sig_cpu_usage is set correctly
          const fc::microseconds sig_cpu_usage = check_auth ? std::get<0>( trx->recover_keys( chain_id ) ) : fc::microseconds();
          const flat_set<public_key_type>& recovered_keys = check_auth ? std::get<1>( trx->recover_keys( chain_id ) ) : flat_set<public_key_type>();
+         if( check_auth && !self.pipeline_stage_timed.empty() ) {
+            emit( self.pipeline_stage_timed, controller::pipeline_stage_timing{ controller::pipeline_stage::trx_signature_recovery, sig_cpu_usage } );
+         }
          if( !explicit_billed_cpu_time ) {
             fc::microseconds already_consumed_time( EOS_PERCENT(sig_cpu_usage.count(), conf.sig_cpu_bill_pct) );
 
@@ -1399,8 +1921,11 @@ struct controller_impl {
 #endif
 ///@}
             }
+            const auto exec_start = fc::time_point::now();
             trx_context.exec();
+            emit_stage_timing( controller::pipeline_stage::trx_execution, exec_start );
             trx_context.finalize(); // Automatically rounds up network and CPU usage in trace and bills payers if successful
+            emit_action_profiles( trx_context );
 
             auto restore = make_block_restore_point();
 
@@ -1427,7 +1952,7 @@ struct controller_impl {
                emit( self.accepted_transaction, trx);
             }
 
-            emit(self.applied_transaction, std::tie(trace, trn));
+            emit_applied_transaction( trace, trn, trx->packed_trx );
 
 
             if ( read_mode != db_read_mode::SPECULATIVE && pending->_block_status == controller::block_status::incomplete ) {
@@ -1436,6 +1961,7 @@ struct controller_impl {
             } else {
                restore.cancel();
                trx_context.squash();
+               fold_block_merkles();
             }
 
             if (!trx->implicit) {
@@ -1457,12 +1983,35 @@ struct controller_impl {
          }
 
          emit( self.accepted_transaction, trx );
-         emit( self.applied_transaction, std::tie(trace, trn) );
+         emit_applied_transaction( trace, trn, trx->packed_trx );
 
          return trace;
       } FC_CAPTURE_AND_RETHROW((trace))
    } /// push_transaction
 
+   transaction_trace_ptr push_read_only_transaction( const transaction_metadata_ptr& trx, fc::time_point deadline ) {
+      EOS_ASSERT( pending, block_validate_exception, "read-only transactions are executed in a pending block" );
+
+      transaction_trace_ptr trace;
+      try {
+         const signed_transaction& trn = trx->packed_trx->get_signed_transaction();
+         transaction_context trx_context(self, trn, trx->id);
+         trx_context.deadline = deadline;
+         trace = trx_context.trace;
+         try {
+            trx_context.init_for_read_only_trx();
+            trx_context.exec();
+         } catch( const fc::exception& e ) {
+            trace->error_code = controller::convert_exception_to_error_code( e );
+            trace->except = e;
+            trace->except_ptr = std::current_exception();
+         }
+         trace->elapsed = fc::time_point::now() - trx_context.start;
+         trx_context.undo();
+         return trace;
+      } FC_CAPTURE_AND_RETHROW((trace))
+   }
+
    void start_block( block_timestamp_type when,
                      uint16_t confirm_block_count,
                      const vector<digest_type>& new_protocol_feature_activations,
@@ -1470,6 +2019,7 @@ struct controller_impl {
                      const optional<block_id_type>& producer_block_id )
    {
       EOS_ASSERT( !pending, block_validate_exception, "pending block already exists" );
+      EOS_ASSERT( conf.partial_state_contracts.empty(), unsupported_feature, "blocks cannot be applied to a partial state" );
 
       auto guard_pending = fc::make_scoped_exit([this, head_block_num=head->block_num](){
          protocol_features.popped_blocks_to( head_block_num );
@@ -1634,10 +2184,19 @@ struct controller_impl {
 
       auto& bb = pending->_block_stage.get<building_block>();
 
+      // Record the input transactions of the block for the detection of duplicates
+      for( const auto& t : bb._recorded_trxs ) {
+         db.create<transaction_object>([&]( transaction_object& transaction ) {
+            transaction.trx_id = t.first;
+            transaction.expiration = t.second;
+         });
+      }
+      bb.fold_merkle_leaves( !bb._transaction_mroot );
+
       // Create (unsigned) block:
       auto block_ptr = std::make_shared<signed_block>( pbhs.make_block_header(
-         bb._transaction_mroot ? *bb._transaction_mroot : calculate_trx_merkle( bb._pending_trx_receipts ),
-         calculate_action_merkle(),
+         bb._transaction_mroot ? *bb._transaction_mroot : bb._trx_merkle.get_root(),
+         bb._action_merkle.get_root(),
          std::move( bb._new_pending_producer_schedule ),
          std::move( bb._new_protocol_feature_activations )
       ) );
@@ -1679,6 +2238,7 @@ struct controller_impl {
          pending.reset();
       });
 
+      const auto start = fc::time_point::now();
       try {
          EOS_ASSERT( pending->_block_stage.contains<completed_block>(), block_validate_exception,
                      "cannot call commit_block until pending block is completed" );
@@ -1694,17 +2254,25 @@ struct controller_impl {
          }
 
          if( !replay_head_time && read_mode != db_read_mode::IRREVERSIBLE ) {
-            reversible_blocks.create<reversible_block_object>( [&]( auto& ubo ) {
+            const auto& ubo = reversible_blocks.create<reversible_block_object>( [&]( auto& ubo ) {
                ubo.blocknum = bsp->block_num;
                ubo.set_block( bsp->block );
             });
+            reversible_cache.add( bsp->id, bsp->block, ubo.packedblock.size() );
+            if( conf.fork_switch_redo_blocks > 0 )
+               add_redo_block( bsp, std::move( pending->_applied_traces ) );
          }
 
+         emit_stage_timing( controller::pipeline_stage::block_commit, start );
+         // a produced block is relayed before the blocks it makes irreversible are written to the block log
+         emit( self.accepted_block, bsp );
+
          if( add_to_fork_db ) {
+            // far enough behind the head that the plugins handling accepted_block are done with them
+            if( conf.fork_db_compact_depth > 0 )
+               fork_db.compact( bsp->id, conf.fork_db_compact_depth );
             log_irreversible();
          }
-
-         emit( self.accepted_block, bsp );
       } catch (...) {
          // dont bother resetting pending, instead abort the block
          reset_pending_on_exit.cancel();
@@ -1777,8 +2345,11 @@ struct controller_impl {
       }
    }
 
-   void apply_block( const block_state_ptr& bsp, controller::block_status s )
+   /// @param prepared_trxs  metadata of the packed transactions of the block, created at replay in advance
+   void apply_block( const block_state_ptr& bsp, controller::block_status s,
+                     const std::vector<transaction_metadata_ptr>& prepared_trxs = {} )
    { try {
+      const auto start = fc::time_point::now();
       try {
          const signed_block_ptr& b = bsp->block;
          const auto& new_protocol_feature_activations = bsp->get_new_protocol_feature_activations();
@@ -1787,17 +2358,17 @@ struct controller_impl {
          auto producer_block_id = b->id();
          start_block( b->timestamp, b->confirmed, new_protocol_feature_activations, s, producer_block_id);
 
-         std::vector<transaction_metadata_ptr> packed_transactions;
-         packed_transactions.reserve( b->transactions.size() );
-         for( const auto& receipt : b->transactions ) {
-            if( receipt.trx.contains<packed_transaction>()) {
-               auto& pt = receipt.trx.get<packed_transaction>();
-               auto mtrx = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( pt ) );
-               if( !self.skip_auth_check() ) {
-                  transaction_metadata::start_recover_keys( mtrx, thread_pool.get_executor(), chain_id, microseconds::maximum() );
-               }
-               packed_transactions.emplace_back( std::move( mtrx ) );
-            }
+         std::vector<transaction_metadata_ptr> packed_transactions = prepared_trxs;
+         if( packed_transactions.empty() ) {
+            packed_transactions = take_prefetched_trxs( producer_block_id );
+         }
+         if( packed_transactions.empty() ) {
+            // prepared with the block state by create_block_state_future
+            packed_transactions = std::move( bsp->trxs );
+            bsp->trxs.clear();
+         }
+         if( packed_transactions.empty() ) {
+            packed_transactions = prepare_block_trxs( *b, !self.skip_auth_check() );
          }
 
          transaction_trace_ptr trace;
@@ -1858,6 +2429,7 @@ struct controller_impl {
                     );
 
          pending->_block_stage = completed_block{ bsp };
+         emit_stage_timing( controller::pipeline_stage::block_apply, start );
 
          commit_block(false);
          return;
@@ -1868,6 +2440,46 @@ struct controller_impl {
       }
    } FC_CAPTURE_AND_RETHROW() } /// apply_block
 
+   /**
+    * Metadata of the packed transactions of `b`: the transactions are unpacked and their ids computed by the calling
+    * thread, their keys are recovered on the thread pool if `recover_keys`.
+    */
+   vector<transaction_metadata_ptr> prepare_block_trxs( const signed_block& b, bool recover_keys ) {
+      vector<transaction_metadata_ptr> trxs;
+      trxs.reserve( b.transactions.size() );
+      for( const auto& receipt : b.transactions ) {
+         if( receipt.trx.contains<packed_transaction>() ) {
+            auto mtrx = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( receipt.trx.get<packed_transaction>() ) );
+            if( recover_keys ) {
+               transaction_metadata::start_recover_keys( mtrx, thread_pool, chain_id, microseconds::maximum() );
+            }
+            trxs.emplace_back( std::move( mtrx ) );
+         }
+      }
+      return trxs;
+   }
+
+   /// header validation of `b` following `prev`, the producer signature is verified unless `skip_validate_signee`
+   block_state_ptr make_block_state( const signed_block_ptr& b, const block_header_state& prev, bool skip_validate_signee ) {
+      const auto start = fc::time_point::now();
+
+      auto trx_mroot = calculate_trx_merkle( b->transactions );
+      EOS_ASSERT( b->transaction_mroot == trx_mroot, block_validate_exception,
+                  "invalid block transaction merkle root ${b} != ${c}", ("b", b->transaction_mroot)("c", trx_mroot) );
+
+      auto bsp = std::make_shared<block_state>(
+                     prev,
+                     b,
+                     [control=this]( block_timestamp_type timestamp,
+                                     const flat_set<digest_type>& cur_features,
+                                     const vector<digest_type>& new_features )
+                     { control->check_protocol_features( timestamp, cur_features, new_features ); },
+                     skip_validate_signee
+      );
+      emit_stage_timing( controller::pipeline_stage::block_signature_check, start );
+      return bsp;
+   }
+
    std::future<block_state_ptr> create_block_state_future( const signed_block_ptr& b ) {
       EOS_ASSERT( b, block_validate_exception, "null block" );
 
@@ -1881,28 +2493,156 @@ struct controller_impl {
       EOS_ASSERT( prev, unlinkable_block_exception,
                   "unlinkable block ${id}", ("id", id)("previous", b->previous) );
 
-      return async_thread_pool( thread_pool.get_executor(), [b, prev, control=this]() {
-         const bool skip_validate_signee = false;
+      auto prefetched = prefetched_blocks.find( id );
+      if( prefetched != prefetched_blocks.end() && prefetched->second.state.valid() ) {
+         auto state = std::move( prefetched->second.state );
+         // the prefetched state may come from a different (invalid) copy of an earlier block, validate again if it failed
+         return std::async( std::launch::deferred, [b, prev, state, control=this]() {
+            try {
+               return state.get();
+            } catch( const fc::exception& ) {
+               return control->make_block_state( b, *prev, false );
+            }
+         } );
+      }
 
-         auto trx_mroot = calculate_trx_merkle( b->transactions );
-         EOS_ASSERT( b->transaction_mroot == trx_mroot, block_validate_exception,
-                     "invalid block transaction merkle root ${b} != ${c}", ("b", b->transaction_mroot)("c", trx_mroot) );
+      // the transactions are prepared off the main thread too, apply_block takes them from the block state
+      return async_thread_pool( thread_pool, [b, prev, control=this, recover_keys=!self.skip_auth_check()]() {
+         auto bsp = control->make_block_state( b, *prev, false );
+         bsp->trxs = control->prepare_block_trxs( *b, recover_keys );
+         return bsp;
+      } );
+   }
 
-         return std::make_shared<block_state>(
-                        *prev,
-                        move( b ),
-                        [control]( block_timestamp_type timestamp,
-                                   const flat_set<digest_type>& cur_features,
-                                   const vector<digest_type>& new_features )
-                        { control->check_protocol_features( timestamp, cur_features, new_features ); },
-                        skip_validate_signee
-         );
+   /**
+    * Starts validation of `blocks` ahead of create_block_state_future(). Header validation of a block needs the
+    * state of the previous one, so the header tasks run one after the other, see prefetch_header_queue; producer and
+    * transaction signatures of all the blocks are recovered concurrently on the thread pool.
+    */
+   void prefetch_blocks( const vector<signed_block_ptr>& blocks ) {
+      const auto lib = fork_db.root()->block_num;
+      while( !prefetched_blocks.empty() && block_header::num_from_id( prefetched_blocks.begin()->first ) <= lib ) {
+         prefetched_blocks.erase( prefetched_blocks.begin() );
+      }
+      while( !finality_checkpoints.empty() && finality_checkpoints.begin()->first <= lib ) {
+         finality_checkpoints.erase( finality_checkpoints.begin() );
+      }
+
+      vector<block_id_type> ids;
+      ids.reserve( blocks.size() );
+      for( const auto& b : blocks ) {
+         ids.emplace_back( b->id() );
+      }
+
+      // a block whose id is a checkpoint, or the previous block of such a block, is final. Its producer signature is
+      // still verified: the block id does not cover it, a forged one would be stored and relayed to peers
+      vector<bool> checkpointed( blocks.size(), false );
+      if( !finality_checkpoints.empty() ) {
+         optional<block_id_type> expected;
+         for( size_t i = blocks.size(); i-- > 0; ) {
+            if( !expected || ids[i] != *expected ) {
+               const auto cp = finality_checkpoints.find( block_header::num_from_id( ids[i] ) );
+               expected.reset();
+               if( cp == finality_checkpoints.end() || cp->second != ids[i] )
+                  continue;
+            }
+            checkpointed[i] = true;
+            expected = blocks[i]->previous;
+         }
+      }
+
+      for( size_t i = 0; i < blocks.size(); ++i ) {
+         if( prefetched_blocks.size() >= max_prefetched_blocks )
+            break;
+         const auto& b = blocks[i];
+         const auto& id = ids[i];
+         if( prefetched_blocks.count( id ) || fork_db.get_block( id ) )
+            continue;
+
+         auto prev = fork_db.get_block_header( b->previous );
+         std::shared_future<block_state_ptr> prev_future;
+         if( !prev ) {
+            const auto prev_itr = prefetched_blocks.find( b->previous );
+            if( prev_itr == prefetched_blocks.end() )
+               break; // does not link, the following blocks would not either
+            // queued before this one, so done by the time this one runs
+            prev_future = prev_itr->second.header;
+         }
+
+         auto header = std::make_shared<std::promise<block_state_ptr>>();
+         auto state = std::make_shared<std::promise<block_state_ptr>>();
+         auto& entry = prefetched_blocks[id];
+         entry.header = header->get_future().share();
+         entry.state = state->get_future().share();
+         if( checkpointed[i] )
+            ++checkpointed_blocks;
+
+         post_prefetch_header( [control=this, b, prev, prev_future, header, state]() {
+            block_state_ptr bsp;
+            try {
+               const block_header_state& p = prev ? *prev : static_cast<const block_header_state&>( *prev_future.get() );
+               bsp = control->make_block_state( b, p, true );
+               header->set_value( bsp );
+            } catch( ... ) {
+               header->set_exception( std::current_exception() );
+               state->set_exception( std::current_exception() );
+               return;
+            }
+            // the producer signature of the blocks is verified concurrently
+            control->thread_pool.post( [bsp, state]() {
+               try {
+                  bsp->verify_signee( bsp->signee() );
+                  state->set_value( bsp );
+               } catch( ... ) {
+                  state->set_exception( std::current_exception() );
+               }
+            } );
+         } );
+
+         entry.trxs = prepare_block_trxs( *b, !self.skip_auth_check() );
+      }
+   }
+
+   void post_prefetch_header( std::function<void()> task ) {
+      auto q = prefetch_headers;
+      {
+         std::lock_guard<std::mutex> g( q->mtx );
+         q->tasks.push_back( std::move( task ) );
+         if( q->running ) return;
+         q->running = true;
+      }
+      thread_pool.post( [q]() {
+         while( true ) {
+            std::function<void()> t;
+            {
+               std::lock_guard<std::mutex> g( q->mtx );
+               if( q->tasks.empty() ) {
+                  q->running = false;
+                  return;
+               }
+               t = std::move( q->tasks.front() );
+               q->tasks.pop_front();
+            }
+            t();
+         }
       } );
    }
 
+   /// transactions of a block prepared by prefetch_blocks, empty if it was not prefetched
+   vector<transaction_metadata_ptr> take_prefetched_trxs( const block_id_type& id ) {
+      vector<transaction_metadata_ptr> trxs;
+      auto itr = prefetched_blocks.find( id );
+      if( itr != prefetched_blocks.end() ) {
+         trxs = std::move( itr->second.trxs );
+         prefetched_blocks.erase( itr );
+      }
+      return trxs;
+   }
+
    void push_block( std::future<block_state_ptr>& block_state_future ) {
       controller::block_status s = controller::block_status::complete;
       EOS_ASSERT(!pending, block_validate_exception, "it is not valid to push a block when there is a pending block");
+      EOS_ASSERT(conf.partial_state_contracts.empty(), unsupported_feature, "blocks cannot be applied to a partial state");
 
       auto reset_prod_light_validation = fc::make_scoped_exit([old_value=trusted_producer_light_validation, this]() {
          trusted_producer_light_validation = old_value;
@@ -1930,7 +2670,8 @@ struct controller_impl {
       } FC_LOG_AND_RETHROW( )
    }
 
-   void replay_push_block( const signed_block_ptr& b, controller::block_status s ) {
+   void replay_push_block( const signed_block_ptr& b, controller::block_status s,
+                           const std::vector<transaction_metadata_ptr>& prepared_trxs = {} ) {
       self.validate_db_available_size();
       self.validate_reversible_available_size();
 
@@ -1960,7 +2701,7 @@ struct controller_impl {
          emit( self.accepted_block_header, bsp );
 
          if( s == controller::block_status::irreversible ) {
-            apply_block( bsp, s );
+            apply_block( bsp, s, prepared_trxs );
             head = bsp;
 
             // On replay, log_irreversible is not called and so no irreversible_block signal is emittted.
@@ -1980,6 +2721,52 @@ struct controller_impl {
       } FC_LOG_AND_RETHROW( )
    }
 
+   /**
+    * Applies `bsp`, a child of head popped by a fork switch, with the changes it made to the chain state then rather
+    * than by executing it again. The signals of its application are emitted again, for the plugins to redo their own
+    * changes. Returns false, with the state untouched, if its changes were not kept or cannot be redone.
+    */
+   bool redo_block( const block_state_ptr& bsp ) {
+      auto itr = redo_blocks.find( bsp->id );
+      if( itr == redo_blocks.end() || !itr->second.popped ) return false;
+      const auto& r = itr->second;
+
+      const auto start = fc::time_point::now();
+      auto session = db.start_undo_session( true );
+      try {
+         for( const auto& c : r.changes )
+            c->redo( db );
+      } catch( const fc::exception& e ) {
+         wlog( "cannot redo block ${id}, applying it: ${e}", ("id", bsp->id)("e", e.to_detail_string()) );
+         return false;
+      } catch( const std::exception& e ) {
+         wlog( "cannot redo block ${id}, applying it: ${e}", ("id", bsp->id)("e", e.what()) );
+         return false;
+      }
+      tapos_ring[bsp->block_num & 0xffff] = bsp->id;
+
+      for( const auto& t : bsp->get_trxs() )
+         unapplied_transactions.erase( t->signed_id );
+      for( const auto& t : r.traces )
+         emit( self.applied_transaction, std::tie( t.first, *t.second ) );
+
+      const auto& ubo = reversible_blocks.create<reversible_block_object>( [&]( auto& ubo ) {
+         ubo.blocknum = bsp->block_num;
+         ubo.set_block( bsp->block );
+      });
+      reversible_cache.add( bsp->id, bsp->block, ubo.packedblock.size() );
+
+      emit( self.accepted_block, bsp );
+      session.push();
+      emit_stage_timing( controller::pipeline_stage::block_redo, start );
+      return true;
+   }
+
+   void apply_or_redo_block( const block_state_ptr& bsp, controller::block_status s ) {
+      if( !redo_block( bsp ) )
+         apply_block( bsp, s );
+   }
+
    void maybe_switch_forks( const block_state_ptr& new_head, controller::block_status s ) {
       bool head_changed = true;
       if( new_head->header.previous == head->id ) {
@@ -1992,6 +2779,7 @@ struct controller_impl {
             throw;
          }
       } else if( new_head->id != head->id ) {
+         const auto start = fc::time_point::now();
          auto old_head = head;
          ilog("switching forks from ${current_head_id} (block number ${current_head_num}) to ${new_head_id} (block number ${new_head_num})",
               ("current_head_id", head->id)("current_head_num", head->block_num)("new_head_id", new_head->id)("new_head_num", new_head->block_num) );
@@ -2008,8 +2796,8 @@ struct controller_impl {
          for( auto ritr = branches.first.rbegin(); ritr != branches.first.rend(); ++ritr ) {
             optional<fc::exception> except;
             try {
-               apply_block( *ritr, (*ritr)->is_valid() ? controller::block_status::validated
-                                                       : controller::block_status::complete );
+               apply_or_redo_block( *ritr, (*ritr)->is_valid() ? controller::block_status::validated
+                                                               : controller::block_status::complete );
                fork_db.mark_valid( *ritr );
                head = *ritr;
             } catch (const fc::exception& e) {
@@ -2033,7 +2821,7 @@ struct controller_impl {
 
                // re-apply good blocks
                for( auto ritr = branches.second.rbegin(); ritr != branches.second.rend(); ++ritr ) {
-                  apply_block( *ritr, controller::block_status::validated /* we previously validated these blocks*/ );
+                  apply_or_redo_block( *ritr, controller::block_status::validated /* we previously validated these blocks*/ );
                   head = *ritr;
                }
                throw *except;
@@ -2041,6 +2829,7 @@ struct controller_impl {
          } /// end for each block in branch
 
          ilog("successfully switched fork to new head ${new_head_id}", ("new_head_id", new_head->id));
+         emit_stage_timing( controller::pipeline_stage::fork_switch, start );
       } else {
          head_changed = false;
       }
@@ -2053,7 +2842,7 @@ struct controller_impl {
       if( pending ) {
          if ( read_mode == db_read_mode::SPECULATIVE ) {
             for( const auto& t : pending->get_trx_metas() )
-               unapplied_transactions[t->signed_id] = t;
+               unapplied_transactions.add( t );
          }
          pending.reset();
          protocol_features.popped_blocks_to( head->block_num );
@@ -2065,14 +2854,9 @@ struct controller_impl {
       return false;
    }
 
-   checksum256_type calculate_action_merkle() {
-      vector<digest_type> action_digests;
-      const auto& actions = pending->_block_stage.get<building_block>()._actions;
-      action_digests.reserve( actions.size() );
-      for( const auto& a : actions )
-         action_digests.emplace_back( a.digest() );
-
-      return merkle( move(action_digests) );
+   /// the transaction merkle of a block being validated comes from the block itself, only produced blocks need it
+   void fold_block_merkles() {
+      pending->_block_stage.get<building_block>().fold_merkle_leaves( pending->_block_status == controller::block_status::incomplete );
    }
 
    static checksum256_type calculate_trx_merkle( const vector<transaction_receipt>& trxs ) {
@@ -2085,7 +2869,7 @@ struct controller_impl {
    }
 
    void update_producers_authority() {
-      const auto& producers = pending->get_pending_block_header_state().active_schedule.producers;
+      const auto& producers = pending->get_pending_block_header_state().active_schedule->producers;
 
       auto update_permission = [&]( auto& permission, auto threshold ) {
          auto auth = authority( threshold, {}, {});
@@ -2126,6 +2910,22 @@ struct controller_impl {
       db.modify( db.get<block_summary_object,by_id>(sid), [&](block_summary_object& bso ) {
           bso.block_id = id;
       });
+      tapos_ring[sid] = id;
+   }
+
+   void reset_tapos_ring() {
+      tapos_ring.assign( 0x10000, block_id_type() );
+      for( const auto& bso : db.get_index<block_summary_multi_index, by_id>() ) {
+         tapos_ring[bso.id._id & 0xffff] = bso.block_id;
+      }
+   }
+
+   /// id of the block the table has for `ref_block_num`, without a database lookup unless the entry is stale
+   const block_id_type& tapos_block_id( uint16_t ref_block_num )const {
+      const auto& id = tapos_ring[ref_block_num];
+      if( BOOST_LIKELY( block_header::num_from_id( id ) <= head->block_num ) )
+         return id;
+      return db.get<block_summary_object>( ref_block_num ).block_id;
    }
 
 
@@ -2195,9 +2995,16 @@ struct controller_impl {
          // throw if actors intersects blacklist
          const auto& blacklist = conf.actor_blacklist;
          bool intersects = false;
+         bool may_intersect = false;
+         for( const auto& actor : actors ) {
+            if( actor_blacklist_filter.may_contain( actor ) ) {
+               may_intersect = true;
+               break;
+            }
+         }
 
          // quick extents check then brute force check actors
-         if( *actors.cbegin() <= *blacklist.crbegin() && *actors.crbegin() >= *blacklist.cbegin() ) {
+         if( may_intersect && *actors.cbegin() <= *blacklist.crbegin() && *actors.crbegin() >= *blacklist.cbegin() ) {
             auto lower_bound = blacklist.cbegin();
             for (const auto& actor: actors) {
                lower_bound = std::lower_bound(lower_bound, blacklist.cend(), actor);
@@ -2234,13 +3041,20 @@ struct controller_impl {
       }
    }
 
+   void reset_blacklist_filters() {
+      actor_blacklist_filter.reset( conf.actor_blacklist );
+      contract_blacklist_filter.reset( conf.contract_blacklist );
+      action_blacklist_filter.reset( conf.action_blacklist );
+      key_blacklist_filter.reset( conf.key_blacklist );
+   }
+
    void check_contract_list( account_name code )const {
       if( conf.contract_whitelist.size() > 0 ) {
          EOS_ASSERT( conf.contract_whitelist.find( code ) != conf.contract_whitelist.end(),
                      contract_whitelist_exception,
                      "account '${code}' is not on the contract whitelist", ("code", code)
                    );
-      } else if( conf.contract_blacklist.size() > 0 ) {
+      } else if( contract_blacklist_filter.may_contain( code ) ) {
          EOS_ASSERT( conf.contract_blacklist.find( code ) == conf.contract_blacklist.end(),
                      contract_blacklist_exception,
                      "account '${code}' is on the contract blacklist", ("code", code)
@@ -2249,8 +3063,9 @@ struct controller_impl {
    }
 
    void check_action_list( account_name code, action_name action )const {
-      if( conf.action_blacklist.size() > 0 ) {
-         EOS_ASSERT( conf.action_blacklist.find( std::make_pair(code, action) ) == conf.action_blacklist.end(),
+      const auto act = std::make_pair( code, action );
+      if( action_blacklist_filter.may_contain( act ) ) {
+         EOS_ASSERT( conf.action_blacklist.find( act ) == conf.action_blacklist.end(),
                      action_blacklist_exception,
                      "action '${code}::${action}' is on the action blacklist",
                      ("code", code)("action", action)
@@ -2259,7 +3074,7 @@ struct controller_impl {
    }
 
    void check_key_list( const public_key_type& key )const {
-      if( conf.key_blacklist.size() > 0 ) {
+      if( key_blacklist_filter.may_contain( key ) ) {
          EOS_ASSERT( conf.key_blacklist.find( key ) == conf.key_blacklist.end(),
                      key_blacklist_exception,
                      "public key '${key}' is on the key blacklist",
@@ -2362,6 +3177,7 @@ void controller::startup( std::function<bool()> shutdown, const snapshot_reader_
    if( snapshot ) {
       ilog( "Starting initialization from snapshot, this may take a significant amount of time" );
    }
+   auto start = fc::time_point::now();
    try {
       my->init(shutdown, snapshot);
    } catch (boost::interprocess::bad_alloc& e) {
@@ -2369,11 +3185,16 @@ void controller::startup( std::function<bool()> shutdown, const snapshot_reader_
          elog( "db storage not configured to have enough storage for the provided snapshot, please increase and retry snapshot" );
       throw e;
    }
+   my->add_startup_phase( "controller_startup", start );
    if( snapshot ) {
       ilog( "Finished initialization from snapshot" );
    }
 }
 
+const vector<controller::startup_phase>& controller::startup_timeline()const {
+   return my->startup_phases;
+}
+
 const chainbase::database& controller::db()const { return my->db; }
 
 chainbase::database& controller::mutable_db()const { return my->db; }
@@ -2572,14 +3393,36 @@ void controller::abort_block() {
    my->abort_block();
 }
 
-boost::asio::io_context& controller::get_thread_pool() {
-   return my->thread_pool.get_executor();
+const task_executor& controller::get_thread_pool() {
+   return my->thread_pool;
+}
+
+task_scheduler& controller::get_task_scheduler() {
+   return my->scheduler;
 }
 
 std::future<block_state_ptr> controller::create_block_state_future( const signed_block_ptr& b ) {
    return my->create_block_state_future( b );
 }
 
+void controller::prefetch_blocks( const vector<signed_block_ptr>& blocks ) {
+   my->prefetch_blocks( blocks );
+}
+
+bool controller::prune_irreversible( uint32_t max_blocks ) {
+   return my->prune_irreversible( max_blocks );
+}
+
+void controller::add_finality_checkpoint( const block_id_type& id ) {
+   if( block_header::num_from_id( id ) > my->fork_db.root()->block_num ) {
+      my->finality_checkpoints[block_header::num_from_id( id )] = id;
+   }
+}
+
+uint64_t controller::get_checkpointed_blocks()const {
+   return my->checkpointed_blocks;
+}
+
 void controller::push_block( std::future<block_state_ptr>& block_state_future ) {
    validate_db_available_size();
    validate_reversible_available_size();
@@ -2594,6 +3437,12 @@ transaction_trace_ptr controller::push_transaction( const transaction_metadata_p
    return my->push_transaction(trx, deadline, billed_cpu_time_us, explicit_billed_cpu_time );
 }
 
+transaction_trace_ptr controller::push_read_only_transaction( const transaction_metadata_ptr& trx, fc::time_point deadline ) {
+   EOS_ASSERT( get_read_mode() != db_read_mode::IRREVERSIBLE, transaction_type_exception, "push transaction not allowed in irreversible mode" );
+   EOS_ASSERT( trx && !trx->implicit && !trx->scheduled, transaction_type_exception, "Implicit/Scheduled transaction not allowed" );
+   return my->push_read_only_transaction( trx, deadline );
+}
+
 transaction_trace_ptr controller::push_scheduled_transaction( const transaction_id_type& trxid, fc::time_point deadline,
                                                               uint32_t billed_cpu_time_us, bool explicit_billed_cpu_time )
 {
@@ -2602,6 +3451,18 @@ transaction_trace_ptr controller::push_scheduled_transaction( const transaction_
    return my->push_scheduled_transaction( trxid, deadline, billed_cpu_time_us, explicit_billed_cpu_time );
 }
 
+vector<transaction_id_type> controller::get_due_scheduled_transactions( size_t max )const {
+   EOS_ASSERT( my->pending, block_validate_exception, "no pending block" );
+   const auto pending_block_time = this->pending_block_time();
+   const auto& idx = db().get_index<generated_transaction_multi_index,by_delay>();
+   vector<transaction_id_type> result;
+   for( auto itr = idx.begin(); itr != idx.end() && itr->delay_until <= pending_block_time && result.size() < max; ++itr ) {
+      if( itr->published < pending_block_time ) // not scheduled and executed in the same block
+         result.push_back( itr->trx_id );
+   }
+   return result;
+}
+
 ///@{
 /// HAYA: TODO[doc]
 void controller::bft_finalize(const block_id_type& block_id) {
@@ -2633,12 +3494,14 @@ void controller::set_actor_whitelist( const flat_set<account_name>& new_actor_wh
 }
 void controller::set_actor_blacklist( const flat_set<account_name>& new_actor_blacklist ) {
    my->conf.actor_blacklist = new_actor_blacklist;
+   my->actor_blacklist_filter.reset( my->conf.actor_blacklist );
 }
 void controller::set_contract_whitelist( const flat_set<account_name>& new_contract_whitelist ) {
    my->conf.contract_whitelist = new_contract_whitelist;
 }
 void controller::set_contract_blacklist( const flat_set<account_name>& new_contract_blacklist ) {
    my->conf.contract_blacklist = new_contract_blacklist;
+   my->contract_blacklist_filter.reset( my->conf.contract_blacklist );
 }
 void controller::set_action_blacklist( const flat_set< pair<account_name, action_name> >& new_action_blacklist ) {
    for (auto& act: new_action_blacklist) {
@@ -2646,9 +3509,11 @@ void controller::set_action_blacklist( const flat_set< pair<account_name, action
       EOS_ASSERT(act.second != action_name(), action_type_exception, "Action blacklist - action name should not be empty");
    }
    my->conf.action_blacklist = new_action_blacklist;
+   my->action_blacklist_filter.reset( my->conf.action_blacklist );
 }
 void controller::set_key_blacklist( const flat_set<public_key_type>& new_key_blacklist ) {
    my->conf.key_blacklist = new_key_blacklist;
+   my->key_blacklist_filter.reset( my->conf.key_blacklist );
 }
 
 uint32_t controller::head_block_num()const {
@@ -2782,6 +3647,10 @@ signed_block_ptr controller::fetch_block_by_number( uint32_t block_num )const  {
    return my->blog.read_block_by_num(block_num);
 } FC_CAPTURE_AND_RETHROW( (block_num) ) }
 
+block_log::packed_block_view controller::fetch_packed_block_by_number( uint32_t block_num )const  { try {
+   return my->blog.read_packed_block_by_num(block_num);
+} FC_CAPTURE_AND_RETHROW( (block_num) ) }
+
 block_state_ptr controller::fetch_block_state_by_id( block_id_type id )const {
    auto state = my->fork_db.get_block(id);
    return state;
@@ -2799,7 +3668,7 @@ block_state_ptr controller::fetch_block_state_by_number( uint32_t block_num )con
       }
    }
 
-   return my->fork_db.get_block( objitr->get_block_id() );
+   return my->fork_db.get_block( my->reversible_block_id( *objitr ) );
 } FC_CAPTURE_AND_RETHROW( (block_num) ) }
 
 block_id_type controller::get_block_id_for_num( uint32_t block_num )const { try {
@@ -2812,7 +3681,7 @@ block_id_type controller::get_block_id_for_num( uint32_t block_num )const { try
          const auto& rev_blocks = my->reversible_blocks.get_index<reversible_block_index,by_num>();
          auto objitr = rev_blocks.find(block_num);
          if( objitr != rev_blocks.end() ) {
-            return objitr->get_block_id();
+            return my->reversible_block_id( *objitr );
          }
       } else {
          auto bsp = my->fork_db.search_on_branch( my->fork_db.pending_head()->id, block_num );
@@ -2833,6 +3702,12 @@ sha256 controller::calculate_integrity_hash()const { try {
    return my->calculate_integrity_hash();
 } FC_LOG_AND_RETHROW() }
 
+sha256 controller::calculate_tree_integrity_hash( uint32_t threads )const { try {
+   auto hash_writer = std::make_shared<tree_integrity_hash_snapshot_writer>(threads);
+   my->add_to_snapshot(hash_writer);
+   return hash_writer->finalize();
+} FC_LOG_AND_RETHROW() }
+
 void controller::write_snapshot( const snapshot_writer_ptr& snapshot ) const {
    EOS_ASSERT( !my->pending, block_validate_exception, "cannot take a consistent snapshot with a pending block" );
    return my->add_to_snapshot(snapshot);
@@ -2895,12 +3770,12 @@ int64_t controller::set_proposed_producers( vector<producer_key> producers ) {
 
 const producer_schedule_type&    controller::active_producers()const {
    if( !(my->pending) )
-      return  my->head->active_schedule;
+      return *my->head->active_schedule;
 
    if( my->pending->_block_stage.contains<completed_block>() )
-      return my->pending->_block_stage.get<completed_block>()._block_state->active_schedule;
+      return *my->pending->_block_stage.get<completed_block>()._block_state->active_schedule;
 
-   return my->pending->get_pending_block_header_state().active_schedule;
+   return *my->pending->get_pending_block_header_state().active_schedule;
 }
 
 const producer_schedule_type&    controller::pending_producers()const {
@@ -2993,6 +3868,10 @@ validation_mode controller::get_validation_mode()const {
    return my->conf.block_validation_mode;
 }
 
+const flat_set<account_name>& controller::get_partial_state_contracts()const {
+   return my->conf.partial_state_contracts;
+}
+
 const apply_handler* controller::find_apply_handler( account_name receiver, account_name scope, action_name act ) const
 {
    auto native_handler_scope = my->apply_handlers.find( receiver );
@@ -3071,10 +3950,12 @@ void controller::validate_expiration( const transaction& trx )const { try {
 } FC_CAPTURE_AND_RETHROW((trx)) }
 
 void controller::validate_tapos( const transaction& trx )const { try {
-   const auto& tapos_block_summary = db().get<block_summary_object>((uint16_t)trx.ref_block_num);
-
    //Verify TaPoS block summary has correct ID prefix, and that this block's time is not past the expiration
-   EOS_ASSERT(trx.verify_reference_block(tapos_block_summary.block_id), invalid_ref_block_exception,
+   if( BOOST_LIKELY( trx.verify_reference_block( my->tapos_block_id( trx.ref_block_num ) ) ) )
+      return;
+
+   const auto& tapos_block_summary = db().get<block_summary_object>((uint16_t)trx.ref_block_num);
+   EOS_THROW( invalid_ref_block_exception,
               "Transaction's reference block did not match. Is this transaction from a different fork?",
               ("tapos_summary", tapos_block_summary));
 } FC_CAPTURE_AND_RETHROW() }
@@ -3100,19 +3981,26 @@ bool controller::is_protocol_feature_activated( const digest_type& feature_diges
 }
 
 bool controller::is_builtin_activated( builtin_protocol_feature_t f )const {
-   uint32_t current_block_num = head_block_num();
-
-   if( my->pending ) {
-      ++current_block_num;
-   }
-
-   return my->protocol_features.is_builtin_activated( f, current_block_num );
+   // features are only activated by the pending block and abort_block pops its activations,
+   // so the activated ones are those with an activation block num <= head (+1 if pending)
+   return my->protocol_features.is_builtin_activated( f );
 }
 
 bool controller::is_known_unexpired_transaction( const transaction_id_type& id) const {
+   if( my->pending && my->pending->_block_stage.contains<building_block>() ) {
+      const auto& recorded = my->pending->_block_stage.get<building_block>()._recorded_trx_ids;
+      if( recorded.count( id ) ) return true;
+   }
    return db().find<transaction_object, by_trx_id>(id);
 }
 
+void controller::record_transaction( const transaction_id_type& id, fc::time_point_sec expire ) {
+   EOS_ASSERT( my->pending, block_validate_exception, "no pending block" );
+   auto& bb = my->pending->_block_stage.get<building_block>();
+   if( bb._recorded_trx_ids.insert( id ).second )
+      bb._recorded_trxs.emplace_back( id, expire );
+}
+
 void controller::set_subjective_cpu_leeway(fc::microseconds leeway) {
    my->subjective_cpu_leeway = leeway;
 }
@@ -3169,6 +4057,24 @@ bool controller::all_subjective_mitigations_disabled()const {
    return my->conf.disable_all_subjective_mitigations;
 }
 
+const char* controller::pipeline_stage_name( pipeline_stage stage ) {
+   switch( stage ) {
+      case pipeline_stage::block_receive:          return "block_receive";
+      case pipeline_stage::block_signature_check:  return "block_signature_check";
+      case pipeline_stage::block_apply:            return "block_apply";
+      case pipeline_stage::block_commit:           return "block_commit";
+      case pipeline_stage::fork_switch:            return "fork_switch";
+      case pipeline_stage::block_irreversible:     return "block_irreversible";
+      case pipeline_stage::trx_signature_recovery: return "trx_signature_recovery";
+      case pipeline_stage::trx_queue_wait:         return "trx_queue_wait";
+      case pipeline_stage::trx_execution:          return "trx_execution";
+      case pipeline_stage::trx_relay:              return "trx_relay";
+      case pipeline_stage::block_redo:             return "block_redo";
+      case pipeline_stage::stages_count:           break;
+   }
+   return "unknown";
+}
+
 fc::optional<uint64_t> controller::convert_exception_to_error_code( const fc::exception& e ) {
    const chain_exception* e_ptr = dynamic_cast<const chain_exception*>( &e );
 
@@ -3196,6 +4102,24 @@ void controller_impl::on_activation<builtin_protocol_feature_t::get_sender>() {
    } );
 }
 
+template<>
+void controller_impl::on_activation<builtin_protocol_feature_t::rsa_verify_batch>() {
+   db.modify( db.get<protocol_state_object>(), [&]( auto& ps ) {
+      add_intrinsic_to_whitelist( ps.whitelisted_intrinsics, "rsa_verify_batch" );
+   } );
+}
+
+template<>
+void controller_impl::on_activation<builtin_protocol_feature_t::secondary_index_batch>() {
+   db.modify( db.get<protocol_state_object>(), [&]( auto& ps ) {
+      add_intrinsic_to_whitelist( ps.whitelisted_intrinsics, "db_idx64_next_batch" );
+      add_intrinsic_to_whitelist( ps.whitelisted_intrinsics, "db_idx128_next_batch" );
+      add_intrinsic_to_whitelist( ps.whitelisted_intrinsics, "db_idx256_next_batch" );
+      add_intrinsic_to_whitelist( ps.whitelisted_intrinsics, "db_idx_double_next_batch" );
+      add_intrinsic_to_whitelist( ps.whitelisted_intrinsics, "db_idx_long_double_next_batch" );
+   } );
+}
+
 template<>
 void controller_impl::on_activation<builtin_protocol_feature_t::replace_deferred>() {
    const auto& indx = db.get_index<account_ram_correction_index, by_id>();
@@ -141,7 +141,7 @@ void apply_eosio_setcode(apply_context& context) {
 
    if( code_size > 0 ) {
      code_hash = fc::sha256::hash( act.code.data(), (uint32_t)act.code.size() );
-     wasm_interface::validate(context.control, act.code);
+     wasm_interface::validate(context.control, act.code, code_hash);
    }
 
    const auto& account = db.get<account_metadata_object,by_name>(act.account);
@@ -183,6 +183,8 @@ void apply_eosio_setcode(apply_context& context) {
             o.vm_type = act.vmtype;
             o.vm_version = act.vmversion;
          });
+         context.control.get_wasm_interface().prepare( code_hash, act.vmtype, act.vmversion, act.code,
+                                                       context.control.head_block_num() + 1, context.control.get_thread_pool() );
       }
    }
 
@@ -0,0 +1,48 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/chain/executor_stats.hpp>
+
+#include <limits>
+
+namespace eosio { namespace chain {
+
+   namespace {
+      // values of appbase::priority, which this library does not depend on
+      constexpr int priority_low     = 10;
+      constexpr int priority_medium  = 50;
+      constexpr int priority_high    = 100;
+      constexpr int priority_highest = std::numeric_limits<int>::max();
+   }
+
+   executor_stats& executor_stats::global() {
+      static executor_stats stats;
+      return stats;
+   }
+
+   size_t executor_stats::level_of( int priority ) {
+      if( priority < priority_low ) return 0;
+      if( priority < priority_medium ) return 1;
+      if( priority < priority_high ) return 2;
+      if( priority < priority_highest ) return 3;
+      return 4;
+   }
+
+   const char* executor_stats::level_name( size_t level ) {
+      static const char* names[levels_count] = { "lowest", "low", "medium", "high", "highest" };
+      return level < levels_count ? names[level] : "unknown";
+   }
+
+   const char* executor_stats::category_name( executor_category c ) {
+      switch( c ) {
+         case executor_category::net:      return "net";
+         case executor_category::http:     return "http";
+         case executor_category::producer: return "producer";
+         case executor_category::signals:  return "signals";
+         case executor_category::other:    return "other";
+         default:                          return "unknown";
+      }
+   }
+
+} } // namespace eosio::chain
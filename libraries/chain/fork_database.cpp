@@ -7,7 +7,13 @@
 #include <boost/multi_index/mem_fun.hpp>
 #include <boost/multi_index/composite_key.hpp>
 #include <fc/io/fstream.hpp>
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <mutex>
+#include <thread>
 
 namespace eosio { namespace chain {
    using boost::multi_index_container;
@@ -37,7 +43,7 @@ namespace eosio { namespace chain {
                member<block_state,                        bool,         &block_state::validated>,
                ///@{
                /// HAYA: bft finalize method
-               member<detail::block_header_state_common, uint32_t,      &detail::block_header_state_common::bft_irreversible_blocknum>,
+               member<block_state,                        uint32_t,     &block_state::bft_rank>,
                ///@}
                member<detail::block_header_state_common, uint32_t,      &detail::block_header_state_common::dpos_irreversible_blocknum>,
                member<detail::block_header_state_common, uint32_t,      &detail::block_header_state_common::block_num>,
@@ -57,13 +63,224 @@ namespace eosio { namespace chain {
       >
    > fork_multi_index_type;
 
-   bool first_preferred( const block_header_state& lhs, const block_header_state& rhs ) {
-      ///@{
-      /// HAYA: bft finalize method
-      return std::tie( lhs.bft_irreversible_blocknum, lhs.dpos_irreversible_blocknum, lhs.block_num )
-               > std::tie( rhs.bft_irreversible_blocknum, rhs.dpos_irreversible_blocknum, rhs.block_num );
-      ///@}
+   ///@{
+   /// HAYA: bft finalize method
+   constexpr uint32_t bft_branch_rank = std::numeric_limits<uint32_t>::max();
+
+   bool first_preferred( const block_state& lhs, const block_state& rhs ) {
+      return std::tie( lhs.bft_rank, lhs.dpos_irreversible_blocknum, lhs.block_num )
+               > std::tie( rhs.bft_rank, rhs.dpos_irreversible_blocknum, rhs.block_num );
    }
+   ///@}
+
+   /**
+    *  Append-only log of fork database changes, so a restart (or a crash) replays the latest changes rather
+    *  than the fork database being written out as a whole on shutdown.
+    *
+    *  +-------+---------+------------------------------------------------+-----+
+    *  | Magic | Version | Size | Type | Payload | CRC32 of Type and Payload | ... |
+    *  +-------+---------+------------------------------------------------+-----+
+    *
+    *  Records are written by a dedicated thread. When the log grows much larger than the fork database, it is
+    *  replaced by a log holding just the current state (reset, adds, bft finalization) plus the records following it.
+    */
+   class fork_db_journal {
+      public:
+         enum record_type : uint8_t {
+            reset_record = 1,        ///< root block_header_state
+            add_record,              ///< block_state
+            remove_record,           ///< block id
+            advance_root_record,     ///< block id
+            mark_valid_record,       ///< block id
+            rollback_head_record,    ///< none
+            bft_finalize_record      ///< block id
+         };
+
+         static const uint32_t magic_number = 0x4A510FDB;
+         static const uint32_t version = 1;
+
+         /// record to write; block states are packed by the writer thread from a copy of their header state
+         struct entry {
+            record_type                                type;
+            vector<char>                               packed;
+            std::shared_ptr<const block_header_state>  header;
+            signed_block_ptr                           block;
+            bool                                       validated = false;
+         };
+
+         explicit fork_db_journal( const fc::path& file )
+         :file( file )
+         {
+            writer = std::thread( [this]() { write_entries(); } );
+         }
+
+         ~fork_db_journal() {
+            {
+               std::lock_guard<std::mutex> lock( mtx );
+               stopping = true;
+            }
+            cv.notify_all();
+            writer.join();
+         }
+
+         void append( entry&& e ) {
+            {
+               std::lock_guard<std::mutex> lock( mtx );
+               queue.emplace_back( std::move( e ) );
+            }
+            cv.notify_all();
+            ++records_since_compaction;
+         }
+
+         /// replaces the log with `state` followed by the records appended later
+         void compact( vector<entry>&& state ) {
+            {
+               std::lock_guard<std::mutex> lock( mtx );
+               queue.emplace_back( entry{ compact_marker } );
+               compactions.emplace_back( std::move( state ) );
+            }
+            cv.notify_all();
+            records_since_compaction = 0;
+         }
+
+         uint64_t records_since_compaction = 0; ///< main thread only
+
+         /**
+          * Calls `apply` for every intact record of the log and truncates a partially written tail.
+          * @return false if there is no log
+          */
+         static bool replay( const fc::path& file, const std::function<void( record_type, fc::datastream<const char*>& )>& apply ) {
+            if( !fc::exists( file ) )
+               return false;
+
+            string content;
+            fc::read_file_contents( file, content );
+            fc::datastream<const char*> ds( content.data(), content.size() );
+            uint32_t magic = 0, ver = 0;
+            fc::raw::unpack( ds, magic );
+            fc::raw::unpack( ds, ver );
+            EOS_ASSERT( magic == magic_number && ver == version, fork_database_exception,
+                        "Fork database journal '${filename}' has unexpected magic number or version",
+                        ("filename", file.generic_string()) );
+
+            size_t valid_size = ds.tellp();
+            while( ds.remaining() >= sizeof(uint32_t) ) {
+               uint32_t size = 0;
+               fc::raw::unpack( ds, size );
+               if( size == 0 || ds.remaining() < size + sizeof(uint32_t) )
+                  break;
+               const char* record = content.data() + ds.tellp();
+               boost::crc_32_type crc;
+               crc.process_bytes( record, size );
+               ds.skip( size );
+               uint32_t expected_crc = 0;
+               fc::raw::unpack( ds, expected_crc );
+               if( crc.checksum() != expected_crc )
+                  break;
+
+               fc::datastream<const char*> record_ds( record + 1, size - 1 );
+               apply( static_cast<record_type>( record[0] ), record_ds );
+               valid_size = ds.tellp();
+            }
+
+            if( valid_size < content.size() ) {
+               wlog( "Fork database journal '${filename}' has ${n} bytes of incomplete records at the end, dropping them",
+                     ("filename", file.generic_string())("n", content.size() - valid_size) );
+               boost::filesystem::resize_file( file.generic_string(), valid_size );
+            }
+            return true;
+         }
+
+      private:
+         static const record_type compact_marker = static_cast<record_type>( 0 );
+
+         void write_entry( std::ofstream& out, const entry& e ) {
+            vector<char> payload;
+            if( e.type == add_record ) {
+               // same layout as packed block_state
+               payload = fc::raw::pack( *e.header );
+               const auto rest = fc::raw::pack( std::make_pair( e.block, e.validated ) );
+               payload.insert( payload.end(), rest.begin(), rest.end() );
+            } else if( e.type == reset_record ) {
+               payload = fc::raw::pack( *e.header );
+            }
+            const auto& data = e.packed.empty() ? payload : e.packed;
+
+            const uint32_t size = data.size() + 1;
+            const uint8_t type = e.type;
+            boost::crc_32_type crc;
+            crc.process_bytes( &type, 1 );
+            crc.process_bytes( data.data(), data.size() );
+            const uint32_t checksum = crc.checksum();
+            out.write( (const char*)&size, sizeof(size) );
+            out.write( (const char*)&type, sizeof(type) );
+            out.write( data.data(), data.size() );
+            out.write( (const char*)&checksum, sizeof(checksum) );
+         }
+
+         void open_new( std::ofstream& out, const fc::path& path ) {
+            out.open( path.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+            fc::raw::pack( out, magic_number );
+            fc::raw::pack( out, version );
+         }
+
+         void write_entries() {
+            std::ofstream out;
+            if( fc::exists( file ) )
+               out.open( file.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::app );
+            else
+               open_new( out, file );
+
+            std::unique_lock<std::mutex> lock( mtx );
+            while( true ) {
+               cv.wait( lock, [this]() { return stopping || !queue.empty(); } );
+               if( queue.empty() )
+                  break; // stopping with everything written
+               std::deque<entry> batch;
+               batch.swap( queue );
+               lock.unlock();
+
+               try {
+                  for( const auto& e : batch ) {
+                     if( e.type != compact_marker ) {
+                        write_entry( out, e );
+                        continue;
+                     }
+                     vector<entry> state;
+                     {
+                        std::lock_guard<std::mutex> g( mtx );
+                        state = std::move( compactions.front() );
+                        compactions.pop_front();
+                     }
+                     const auto tmp = file.generic_string() + ".tmp";
+                     std::ofstream compacted;
+                     open_new( compacted, tmp );
+                     for( const auto& s : state )
+                        write_entry( compacted, s );
+                     compacted.close();
+                     out.close();
+                     fc::rename( tmp, file );
+                     out.open( file.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::app );
+                  }
+                  out.flush();
+               } catch( const fc::exception& e ) {
+                  elog( "Cannot write fork database journal '${f}': ${e}", ("f", file.generic_string())("e", e.to_detail_string()) );
+               } catch( const std::exception& e ) {
+                  elog( "Cannot write fork database journal '${f}': ${e}", ("f", file.generic_string())("e", e.what()) );
+               }
+
+               lock.lock();
+            }
+         }
+
+         const fc::path             file;
+         std::mutex                 mtx;
+         std::condition_variable    cv;
+         std::deque<entry>          queue;
+         std::deque<vector<entry>>  compactions;
+         bool                       stopping = false;
+         std::thread                writer;
+   };
 
    struct fork_database_impl {
       fork_database_impl( fork_database& self, const fc::path& data_dir )
@@ -76,6 +293,75 @@ namespace eosio { namespace chain {
       block_state_ptr       root; // Only uses the block_header_state portion
       block_state_ptr       head;
       fc::path              datadir;
+      block_id_type         last_compacted_id; ///< newest block compacted by fork_database::compact
+
+      ///@{
+      /// HAYA: the last bft finalized block. Its descendants (the bft branch) have bft_rank == bft_branch_rank, so
+      /// finalizing a descendant does not modify the whole branch; their bft_irreversible_blocknum is updated lazily
+      /// by refresh_bft() whenever the fork database hands a block state out.
+      block_id_type         bft_branch_id;
+      uint32_t              bft_branch_num = 0;
+
+      void refresh_bft( const block_state_ptr& b )const {
+         if( b && b->bft_rank == bft_branch_rank && b->bft_irreversible_blocknum < bft_branch_num )
+            b->bft_irreversible_blocknum = bft_branch_num;
+      }
+
+      /// moves `b` out of the bft branch, its bft irreversible block stays that of the branch
+      void leave_bft_branch( const block_state_ptr& b ) {
+         refresh_bft( b );
+         auto itr = index.find( b->id );
+         if( itr == index.end() ) {
+            b->bft_rank = b->bft_irreversible_blocknum; // root
+            return;
+         }
+         index.modify( itr, []( block_state_ptr& bsp ) {
+            bsp->bft_rank = bsp->bft_irreversible_blocknum;
+         } );
+      }
+      ///@}
+
+      std::unique_ptr<fork_db_journal> journal; ///< not set while the fork database is loaded
+
+      void journal_id( fork_db_journal::record_type type, const block_id_type& id ) {
+         if( journal )
+            journal->append( fork_db_journal::entry{ type, fc::raw::pack( id ) } );
+      }
+
+      void journal_block( const block_state_ptr& n ) {
+         if( !journal ) return;
+         fork_db_journal::entry e{ fork_db_journal::add_record };
+         e.header = std::make_shared<block_header_state>( *n );
+         e.block = n->block;
+         e.validated = n->validated;
+         journal->append( std::move( e ) );
+         if( journal->records_since_compaction > std::max<uint64_t>( 1024, 4 * index.size() ) )
+            compact_journal();
+      }
+
+      /// the current state as journal records: root, blocks (every block after its previous one) and bft finality
+      void compact_journal() {
+         vector<fork_db_journal::entry> state;
+         fork_db_journal::entry r{ fork_db_journal::reset_record };
+         r.header = std::make_shared<block_header_state>( *root );
+         state.emplace_back( std::move( r ) );
+
+         vector<block_state_ptr> blocks( index.begin(), index.end() );
+         std::sort( blocks.begin(), blocks.end(), []( const block_state_ptr& a, const block_state_ptr& b ) {
+            return a->block_num < b->block_num;
+         } );
+         for( const auto& bsp : blocks ) {
+            refresh_bft( bsp );
+            fork_db_journal::entry e{ fork_db_journal::add_record };
+            e.header = std::make_shared<block_header_state>( *bsp );
+            e.block = bsp->block;
+            e.validated = bsp->validated;
+            state.emplace_back( std::move( e ) );
+         }
+         if( bft_branch_id != block_id_type() && index.find( bft_branch_id ) != index.end() )
+            state.emplace_back( fork_db_journal::entry{ fork_db_journal::bft_finalize_record, fc::raw::pack( bft_branch_id ) } );
+         journal->compact( std::move( state ) );
+      }
 
       void add( const block_state_ptr& n,
                 bool ignore_duplicate, bool validate,
@@ -97,8 +383,62 @@ namespace eosio { namespace chain {
       if (!fc::is_directory(my->datadir))
          fc::create_directories(my->datadir);
 
+      const auto add_loaded = [&]( block_state&& s ) {
+         // the metadata of the transactions is only needed to pop the block, it is rebuilt then
+         s.compact();
+         s.header_exts = s.block->validate_and_extract_header_extensions();
+         my->add( std::make_shared<block_state>( move( s ) ), true, true, validator );
+      };
+
+      my->journal.reset();
+      auto journal_file = my->datadir / config::forkdb_journal_filename;
+      bool journal_loaded = false;
+      try {
+         journal_loaded = fork_db_journal::replay( journal_file, [&]( fork_db_journal::record_type type, fc::datastream<const char*>& ds ) {
+            block_id_type id;
+            switch( type ) {
+               case fork_db_journal::reset_record: {
+                  block_header_state bhs;
+                  fc::raw::unpack( ds, bhs );
+                  reset( bhs );
+                  break;
+               }
+               case fork_db_journal::add_record: {
+                  block_state s;
+                  fc::raw::unpack( ds, s );
+                  add_loaded( std::move( s ) );
+                  break;
+               }
+               case fork_db_journal::remove_record:
+                  fc::raw::unpack( ds, id );
+                  remove( id );
+                  break;
+               case fork_db_journal::advance_root_record:
+                  fc::raw::unpack( ds, id );
+                  advance_root( id );
+                  break;
+               case fork_db_journal::mark_valid_record: {
+                  fc::raw::unpack( ds, id );
+                  auto b = get_block( id );
+                  EOS_ASSERT( b, fork_database_exception, "journal marks unknown block ${id} valid", ("id", id) );
+                  mark_valid( b );
+                  break;
+               }
+               case fork_db_journal::rollback_head_record:
+                  rollback_head_to_root();
+                  break;
+               case fork_db_journal::bft_finalize_record:
+                  fc::raw::unpack( ds, id );
+                  bft_finalize( id );
+                  break;
+               default:
+                  EOS_THROW( fork_database_exception, "unknown fork database journal record ${t}", ("t", (uint32_t)type) );
+            }
+         } );
+      } FC_CAPTURE_AND_RETHROW( (journal_file) )
+
       auto fork_db_dat = my->datadir / config::forkdb_filename;
-      if( fc::exists( fork_db_dat ) ) {
+      if( !journal_loaded && fc::exists( fork_db_dat ) ) {
          try {
             string content;
             fc::read_file_contents( fork_db_dat, content );
@@ -136,14 +476,7 @@ namespace eosio { namespace chain {
             for( uint32_t i = 0, n = size.value; i < n; ++i ) {
                block_state s;
                fc::raw::unpack( ds, s );
-               for( const auto& receipt : s.block->transactions ) {
-                  if( receipt.trx.contains<packed_transaction>() ) {
-                     const auto& pt = receipt.trx.get<packed_transaction>();
-                     s.trxs.push_back( std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>(pt) ) );
-                  }
-               }
-               s.header_exts = s.block->validate_and_extract_header_extensions();
-               my->add( std::make_shared<block_state>( move( s ) ), false, true, validator );
+               add_loaded( std::move( s ) );
             }
             block_id_type head_id;
             fc::raw::unpack( ds, head_id );
@@ -171,68 +504,20 @@ namespace eosio { namespace chain {
 
          fc::remove( fork_db_dat );
       }
-   }
-
-   void fork_database::close() {
-      auto fork_db_dat = my->datadir / config::forkdb_filename;
-
-      if( !my->root ) {
-         if( my->index.size() > 0 ) {
-            elog( "fork_database is in a bad state when closing; not writing out '${filename}'",
-                  ("filename", fork_db_dat.generic_string()) );
-         }
-         return;
-      }
-
-      std::ofstream out( fork_db_dat.generic_string().c_str(), std::ios::out | std::ios::binary | std::ofstream::trunc );
-      fc::raw::pack( out, magic_number );
-      fc::raw::pack( out, max_supported_version ); // write out current version which is always max_supported_version
-      fc::raw::pack( out, *static_cast<block_header_state*>(&*my->root) );
-      uint32_t num_blocks_in_fork_db = my->index.size();
-      fc::raw::pack( out, unsigned_int{num_blocks_in_fork_db} );
-
-      const auto& indx = my->index.get<by_lib_block_num>();
-
-      auto unvalidated_itr = indx.rbegin();
-      auto unvalidated_end = boost::make_reverse_iterator( indx.lower_bound( false ) );
-
-      auto validated_itr = unvalidated_end;
-      auto validated_end = indx.rend();
-
-      for(  bool unvalidated_remaining = (unvalidated_itr != unvalidated_end),
-                 validated_remaining   = (validated_itr != validated_end);
-
-            unvalidated_remaining || validated_remaining;
-
-            unvalidated_remaining = (unvalidated_itr != unvalidated_end),
-            validated_remaining   = (validated_itr != validated_end)
-         )
-      {
-         auto itr = (validated_remaining ? validated_itr : unvalidated_itr);
-
-         if( unvalidated_remaining && validated_remaining ) {
-            if( first_preferred( **validated_itr, **unvalidated_itr ) ) {
-               itr = unvalidated_itr;
-               ++unvalidated_itr;
-            } else {
-               ++validated_itr;
-            }
-         } else if( unvalidated_remaining ) {
-            ++unvalidated_itr;
-         } else {
-            ++validated_itr;
-         }
-
-         fc::raw::pack( out, *(*itr) );
+      if( fc::exists( fork_db_dat ) ) {
+         wlog( "Ignoring '${filename}', the fork database journal is used instead", ("filename", fork_db_dat.generic_string()) );
+         fc::remove( fork_db_dat );
       }
 
-      if( my->head ) {
-         fc::raw::pack( out, my->head->id );
-      } else {
-         elog( "head not set in fork database; '${filename}' will be corrupted",
-               ("filename", fork_db_dat.generic_string()) );
+      my->journal = std::make_unique<fork_db_journal>( journal_file );
+      if( my->root ) {
+         my->compact_journal(); // starts the journal from the loaded state
       }
+   }
 
+   void fork_database::close() {
+      // every change is in the journal already, wait for the journal to be written
+      my->journal.reset();
       my->index.clear();
    }
 
@@ -242,10 +527,14 @@ namespace eosio { namespace chain {
 
    void fork_database::reset( const block_header_state& root_bhs ) {
       my->index.clear();
+      my->bft_branch_id = block_id_type();
+      my->bft_branch_num = 0;
       my->root = std::make_shared<block_state>();
       static_cast<block_header_state&>(*my->root) = root_bhs;
       my->root->validated = true;
       my->head = my->root;
+      if( my->journal )
+         my->compact_journal(); // nothing before the reset is needed
    }
 
    void fork_database::rollback_head_to_root() {
@@ -258,9 +547,11 @@ namespace eosio { namespace chain {
          ++itr;
       }
       my->head = my->root;
+      if( my->journal )
+         my->journal->append( fork_db_journal::entry{ fork_db_journal::rollback_head_record } );
    }
 
-   void fork_database::advance_root( const block_id_type& id ) {
+   void fork_database::advance_root( const block_id_type& id, vector<block_state_ptr>* removed ) {
       EOS_ASSERT( my->root, fork_database_exception, "root not yet set" );
 
       auto new_root = get_block( id );
@@ -277,13 +568,36 @@ namespace eosio { namespace chain {
          EOS_ASSERT( b || blocks_to_remove.back() == my->root->id, fork_database_exception, "invariant violation: orphaned branch was present in forked database" );
       }
 
-      // The new root block should be erased from the fork database index individually rather than with the remove method,
-      // because we do not want the blocks branching off of it to be removed from the fork database.
-      my->index.erase( my->index.find( id ) );
+      // Blocks branching off the removed ancestors are collected at once, rather than traversing the forks with the
+      // remove method for every ancestor. The new root and its descendants are kept.
+      const auto& previdx = my->index.get<by_prev>();
+      const auto head_id = my->head->id;
+      vector<block_id_type> remove_queue;
+      block_id_type kept_child = id;
+      for( const auto& ancestor : blocks_to_remove ) {
+         for( auto previtr = previdx.lower_bound( ancestor ); previtr != previdx.end() && (*previtr)->header.previous == ancestor; ++previtr ) {
+            if( (*previtr)->id != kept_child )
+               remove_queue.push_back( (*previtr)->id );
+         }
+         kept_child = ancestor;
+      }
+      for( uint32_t i = 0; i < remove_queue.size(); ++i ) {
+         EOS_ASSERT( remove_queue[i] != head_id, fork_database_exception,
+                     "removing the block and its descendants would remove the current head block" );
+         for( auto previtr = previdx.lower_bound( remove_queue[i] ); previtr != previdx.end() && (*previtr)->header.previous == remove_queue[i]; ++previtr ) {
+            remove_queue.push_back( (*previtr)->id );
+         }
+      }
+      remove_queue.insert( remove_queue.end(), blocks_to_remove.begin(), blocks_to_remove.end() );
+      remove_queue.push_back( id );
 
-      // The other blocks to be removed are removed using the remove method so that orphaned branches do not remain in the fork database.
-      for( const auto& block_id : blocks_to_remove ) {
-         remove( block_id );
+      if( removed ) removed->reserve( removed->size() + remove_queue.size() );
+      for( const auto& block_id : remove_queue ) {
+         auto itr = my->index.find( block_id );
+         if( itr != my->index.end() ) {
+            if( removed ) removed->push_back( *itr );
+            my->index.erase( itr );
+         }
       }
 
       // Even though fork database no longer needs block or trxs when a block state becomes a root of the tree,
@@ -291,18 +605,22 @@ namespace eosio { namespace chain {
       // parts of the code which run asynchronously (e.g. mongo_db_plugin) may later expect it remain unmodified.
 
       my->root = new_root;
+      my->journal_id( fork_db_journal::advance_root_record, id );
    }
 
    block_header_state_ptr fork_database::get_block_header( const block_id_type& id )const {
       const auto& by_id_idx = my->index.get<by_block_id>();
 
       if( my->root->id == id ) {
+         my->refresh_bft( my->root );
          return my->root;
       }
 
       auto itr = my->index.find( id );
-      if( itr != my->index.end() )
+      if( itr != my->index.end() ) {
+         my->refresh_bft( *itr );
          return *itr;
+      }
 
       return block_header_state_ptr();
    }
@@ -326,6 +644,8 @@ namespace eosio { namespace chain {
       if (prev_bh->bft_irreversible_blocknum > n->bft_irreversible_blocknum) {
          n->bft_irreversible_blocknum = prev_bh->bft_irreversible_blocknum;
       }
+      const auto& prev_state = n->header.previous == root->id ? root : self.get_block( n->header.previous );
+      n->bft_rank = prev_state->bft_rank == bft_branch_rank ? bft_branch_rank : n->bft_irreversible_blocknum;
       ///@}
 
       if( validate ) {
@@ -358,22 +678,31 @@ namespace eosio { namespace chain {
                    const vector<digest_type>& new_features )
                {}
       );
+      my->journal_block( n );
    }
 
-   const block_state_ptr& fork_database::root()const { return my->root; }
+   const block_state_ptr& fork_database::root()const {
+      my->refresh_bft( my->root );
+      return my->root;
+   }
 
-   const block_state_ptr& fork_database::head()const { return my->head; }
+   const block_state_ptr& fork_database::head()const {
+      my->refresh_bft( my->head );
+      return my->head;
+   }
 
    block_state_ptr fork_database::pending_head()const {
       const auto& indx = my->index.get<by_lib_block_num>();
 
       auto itr = indx.lower_bound( false );
       if( itr != indx.end() && !(*itr)->is_valid() ) {
-         if( first_preferred( **itr, *my->head ) )
+         if( first_preferred( **itr, *my->head ) ) {
+            my->refresh_bft( *itr );
             return *itr;
+         }
       }
 
-      return my->head;
+      return head();
    }
 
    branch_type fork_database::fetch_branch( const block_id_type& h, uint32_t trim_after_block_num )const {
@@ -395,6 +724,41 @@ namespace eosio { namespace chain {
       return {};
    }
 
+   void fork_database::compact( const block_id_type& h, uint32_t depth ) {
+      const auto head = get_block( h );
+      // nothing that deep in the fork database, e.g. when the LIB follows the head closely
+      if( !head || !my->root || head->block_num <= my->root->block_num + depth + 1 ) return;
+      const uint32_t last_num = head->block_num - depth - 1;
+
+      // the blocks to compact are usually the children of the last one compacted, a compacted block of another
+      // branch only has its transactions rebuilt if it is popped
+      auto& by_prev = my->index.get<by_prev>();
+      auto last = get_block( my->last_compacted_id );
+      while( last && last->block_num < last_num ) {
+         block_state_ptr next;
+         for( auto r = by_prev.equal_range( last->id ); r.first != r.second; ++r.first ) {
+            (*r.first)->compact();
+            next = *r.first;
+         }
+         last = next;
+      }
+      if( last ) {
+         my->last_compacted_id = last->id;
+         return;
+      }
+
+      // the branch of the last block compacted ended, walk the branch of `h` instead
+      uint32_t behind = 0;
+      my->last_compacted_id = block_id_type();
+      for( auto s = head; s; s = get_block( s->header.previous ), ++behind ) {
+         if( behind <= depth ) continue;
+         if( my->last_compacted_id == block_id_type() )
+            my->last_compacted_id = s->id;
+         if( s->is_compact() ) break;
+         s->compact();
+      }
+   }
+
    /**
     *  Given two head blocks, return two branches of the fork graph that
     *  end with a common ancestor (same prior block)
@@ -480,6 +844,7 @@ namespace eosio { namespace chain {
          if( itr != my->index.end() )
             my->index.erase(itr);
       }
+      my->journal_id( fork_db_journal::remove_record, id );
    }
 
    void fork_database::mark_valid( const block_state_ptr& h ) {
@@ -495,6 +860,7 @@ namespace eosio { namespace chain {
       by_id_idx.modify( itr, []( block_state_ptr& bsp ) {
          bsp->validated = true;
       } );
+      my->journal_id( fork_db_journal::mark_valid_record, h->id );
 
       auto candidate = my->index.get<by_lib_block_num>().begin();
       if( first_preferred( **candidate, *my->head ) ) {
@@ -504,8 +870,10 @@ namespace eosio { namespace chain {
 
    block_state_ptr   fork_database::get_block(const block_id_type& id)const {
       auto itr = my->index.find( id );
-      if( itr != my->index.end() )
+      if( itr != my->index.end() ) {
+         my->refresh_bft( *itr );
          return *itr;
+      }
       return block_state_ptr();
    }
 
@@ -519,6 +887,7 @@ namespace eosio { namespace chain {
       }
 
       set_bft_irreversible( block_id );
+      my->journal_id( fork_db_journal::bft_finalize_record, block_id );
 
       auto candidate = my->index.get<by_lib_block_num>().begin();
 
@@ -532,46 +901,98 @@ namespace eosio { namespace chain {
     *  all blocks which build off of it to have the same bft_irb if their existing
     *  bft irb is less than this block num.
     *
-    *  This will require a search over all forks
+    *  Descendants of the last finalized block form the bft branch and are not modified when a block in the branch
+    *  is finalized: only the blocks leaving the branch are, i.e. the ancestors of the new finalized block up to the
+    *  previous one and the forks off them. So the cost depends on the finality step and the forks, not on the number
+    *  of reversible blocks.
     */
    void fork_database::set_bft_irreversible( block_id_type id ) {
       auto& idx = my->index.get<by_block_id>();
-      auto itr = idx.find(id);
-      uint32_t block_num = (*itr)->block_num;
-      idx.modify( itr, [&]( auto& bsp ) {
-           bsp->bft_irreversible_blocknum = bsp->block_num;
-      });
-
-      /** to prevent stack-overflow, we perform a bredth-first traversal of the
-       * fork database. At each stage we iterate over the leafs from the prior stage
-       * and find all nodes that link their previous. If we update the bft lib then we
-       * add it to a queue for the next layer.  This lambda takes one layer and returns
-       * all block ids that need to be iterated over for next layer.
-       */
-      auto update = [&]( const vector<block_id_type>& in ) {
-         vector<block_id_type> updated;
-
-         for( const auto& i : in ) {
-            auto& pidx = my->index.get<by_prev>();
-            auto pitr  = pidx.lower_bound( i );
-            auto epitr = pidx.upper_bound( i );
-            while( pitr != epitr ) {
-               pidx.modify( pitr, [&]( auto& bsp ) {
-                 if( bsp->bft_irreversible_blocknum < block_num ) {
-                    bsp->bft_irreversible_blocknum = block_num;
-                    updated.push_back( bsp->id );
-                 }
-               });
-               ++pitr;
+      const auto& previdx = my->index.get<by_prev>();
+      const block_state_ptr finalized = *idx.find( id );
+      const uint32_t block_num = finalized->block_num;
+
+      if( finalized->bft_rank == bft_branch_rank ) {
+         if( id == my->bft_branch_id ) return;
+
+         // ancestors up to the previous finalized block and the forks off them leave the branch
+         vector<block_id_type> leaving;
+         block_id_type kept_child = id;
+         for( auto b = finalized->header.previous == my->root->id ? my->root : get_block( finalized->header.previous ); b && b->bft_rank == bft_branch_rank; ) {
+            for( auto pitr = previdx.lower_bound( b->id ); pitr != previdx.end() && (*pitr)->header.previous == b->id; ++pitr ) {
+               if( (*pitr)->id != kept_child )
+                  leaving.push_back( (*pitr)->id );
+            }
+            for( uint32_t i = 0; i < leaving.size(); ++i ) {
+               for( auto pitr = previdx.lower_bound( leaving[i] ); pitr != previdx.end() && (*pitr)->header.previous == leaving[i]; ++pitr ) {
+                  leaving.push_back( (*pitr)->id );
+               }
             }
+            for( const auto& leaving_id : leaving ) {
+               my->leave_bft_branch( *idx.find( leaving_id ) );
+            }
+            leaving.clear();
+
+            my->leave_bft_branch( b );
+            if( b->id == my->bft_branch_id || b == my->root ) break;
+            kept_child = b->id;
+            b = b->header.previous == my->root->id ? my->root : get_block( b->header.previous );
+         }
+      } else {
+         const auto is_ancestor_of_branch = [&]() {
+            if( my->bft_branch_id == block_id_type() ) return false;
+            for( auto b = get_block( my->bft_branch_id ); b; b = get_block( b->header.previous ) ) {
+               if( b->header.previous == id ) return true;
+            }
+            return false;
+         };
+
+         if( is_ancestor_of_branch() ) {
+            // late finalization of an older block: only the blocks between it and the branch and forks off them change
+            idx.modify( idx.find( id ), [&]( auto& bsp ) {
+               bsp->bft_irreversible_blocknum = std::max( bsp->bft_irreversible_blocknum, block_num );
+               bsp->bft_rank = bsp->bft_irreversible_blocknum;
+            });
+            vector<block_id_type> queue{id};
+            for( uint32_t i = 0; i < queue.size(); ++i ) {
+               for( auto pitr = previdx.lower_bound( queue[i] ); pitr != previdx.end() && (*pitr)->header.previous == queue[i]; ++pitr ) {
+                  if( (*pitr)->bft_rank == bft_branch_rank ) continue;
+                  my->index.get<by_prev>().modify( pitr, [&]( auto& bsp ) {
+                     bsp->bft_irreversible_blocknum = std::max( bsp->bft_irreversible_blocknum, block_num );
+                     bsp->bft_rank = bsp->bft_irreversible_blocknum;
+                  });
+                  queue.push_back( (*pitr)->id );
+               }
+            }
+            return;
          }
-         return updated;
-      };
 
-      vector<block_id_type> queue{id};
-      while( queue.size() ) {
-         queue = update( queue );
+         // first finalization or a block off the branch: the whole branch is replaced
+         vector<block_state_ptr> branch;
+         for( const auto& bsp : my->index ) {
+            if( bsp->bft_rank == bft_branch_rank ) branch.push_back( bsp );
+         }
+         for( const auto& bsp : branch ) {
+            my->leave_bft_branch( bsp );
+         }
+         if( my->root->bft_rank == bft_branch_rank )
+            my->leave_bft_branch( my->root );
+
+         vector<block_id_type> queue{id};
+         for( uint32_t i = 0; i < queue.size(); ++i ) {
+            auto itr = idx.find( queue[i] );
+            idx.modify( itr, []( auto& bsp ) {
+               bsp->bft_rank = bft_branch_rank;
+            });
+            for( auto pitr = previdx.lower_bound( queue[i] ); pitr != previdx.end() && (*pitr)->header.previous == queue[i]; ++pitr ) {
+               queue.push_back( (*pitr)->id );
+            }
+         }
       }
+
+      my->bft_branch_id = id;
+      my->bft_branch_num = block_num;
+      my->refresh_bft( finalized );
    }
    ///@}
 
@@ -59,6 +59,11 @@ struct abi_serializer {
    fc::variant binary_to_variant( const std::string_view& type, const bytes& binary, const fc::microseconds& max_serialization_time, bool short_path = false )const;
    fc::variant binary_to_variant( const std::string_view& type, fc::datastream<const char*>& binary, const fc::microseconds& max_serialization_time, bool short_path = false )const;
 
+   /// the JSON of binary_to_variant, written while decoding instead of building the variant first
+   string      binary_to_json( const std::string_view& type, const bytes& binary, const fc::microseconds& max_serialization_time, bool short_path = false )const;
+   /// appends the JSON to `out`
+   void        binary_to_json( const std::string_view& type, fc::datastream<const char*>& binary, string& out, const fc::microseconds& max_serialization_time, bool short_path = false )const;
+
    bytes       variant_to_binary( const std::string_view& type, const fc::variant& var, const fc::microseconds& max_serialization_time, bool short_path = false )const;
    void        variant_to_binary( const std::string_view& type, const fc::variant& var, fc::datastream<char*>& ds, const fc::microseconds& max_serialization_time, bool short_path = false )const;
 
@@ -109,6 +114,11 @@ private:
    void        _binary_to_variant( const std::string_view& type, fc::datastream<const char*>& stream,
                                    fc::mutable_variant_object& obj, impl::binary_to_variant_context& ctx )const;
 
+   /// @return false if null was written
+   bool        _binary_to_json( const std::string_view& type, fc::datastream<const char*>& stream, string& out, impl::binary_to_variant_context& ctx )const;
+   /// writes the fields of a struct, preceded by a comma unless `first`; @return number of fields written
+   size_t      _binary_to_json( const std::string_view& type, fc::datastream<const char*>& stream, string& out, bool first, impl::binary_to_variant_context& ctx )const;
+
    bytes       _variant_to_binary( const std::string_view& type, const fc::variant& var, impl::variant_to_binary_context& ctx )const;
    void        _variant_to_binary( const std::string_view& type, const fc::variant& var,
                                    fc::datastream<char*>& ds, impl::variant_to_binary_context& ctx )const;
@@ -393,7 +403,7 @@ namespace impl {
 
          try {
             auto abi = resolver(act.account);
-            if (abi.valid()) {
+            if (abi) {
                auto type = abi->get_action_type(act.name);
                if (!type.empty()) {
                   try {
@@ -558,7 +568,7 @@ namespace impl {
                valid_empty_data = act.data.empty();
             } else if ( data.is_object() ) {
                auto abi = resolver(act.account);
-               if (abi.valid()) {
+               if (abi) {
                   auto type = abi->get_action_type(act.name);
                   if (!type.empty()) {
                      variant_to_binary_context _ctx(*abi, ctx, type);
@@ -5,7 +5,10 @@
 #pragma once
 #include <eosio/chain/controller.hpp>
 #include <eosio/chain/transaction.hpp>
+#include <eosio/chain/transaction_context.hpp>
+#include <eosio/chain/transaction_arena.hpp>
 #include <eosio/chain/contract_table_objects.hpp>
+#include <eosio/chain/table_scan.hpp>
 #include <fc/utility.hpp>
 #include <sstream>
 #include <algorithm>
@@ -21,9 +24,15 @@ class transaction_context;
 class apply_context {
    private:
       template<typename T>
+      /// storage comes from the arena of the transaction, the caches of all its actions are released together
       class iterator_cache {
          public:
-            iterator_cache(){
+            explicit iterator_cache( transaction_arena& arena )
+            :_table_cache( arena_allocator<table_cache_type::value_type>(arena) )
+            ,_end_iterator_to_table( arena_allocator<const table_id_object*>(arena) )
+            ,_iterator_to_object( arena_allocator<const T*>(arena) )
+            ,_object_to_iterator( arena_allocator<typename object_to_iterator_type::value_type>(arena) )
+            {
                _end_iterator_to_table.reserve(8);
                _iterator_to_object.reserve(32);
             }
@@ -91,10 +100,14 @@ class apply_context {
             }
 
          private:
-            map<table_id_object::id_type, pair<const table_id_object*, int>> _table_cache;
-            vector<const table_id_object*>                  _end_iterator_to_table;
-            vector<const T*>                                _iterator_to_object;
-            map<const T*,int>                               _object_to_iterator;
+            using table_cache_type = map<table_id_object::id_type, pair<const table_id_object*, int>, std::less<table_id_object::id_type>,
+                                         arena_allocator<std::pair<const table_id_object::id_type, pair<const table_id_object*, int>>>>;
+            using object_to_iterator_type = map<const T*, int, std::less<const T*>, arena_allocator<std::pair<const T* const, int>>>;
+
+            table_cache_type                                                     _table_cache;
+            vector<const table_id_object*, arena_allocator<const table_id_object*>> _end_iterator_to_table;
+            vector<const T*, arena_allocator<const T*>>                          _iterator_to_object;
+            object_to_iterator_type                                              _object_to_iterator;
 
             /// Precondition: std::numeric_limits<int>::min() < ei < -1
             /// Iterator of -1 is reserved for invalid iterators (i.e. when the appropriate table has not yet been created).
@@ -175,11 +188,12 @@ class apply_context {
 
             using secondary_key_helper_t = secondary_key_helper<secondary_key_type, secondary_key_proxy_type, secondary_key_proxy_const_type>;
 
-            generic_index( apply_context& c ):context(c){}
+            generic_index( apply_context& c ):context(c),itr_cache(c.trx_context.arena){}
 
             int store( uint64_t scope, uint64_t table, const account_name& payer,
                        uint64_t id, secondary_key_proxy_const_type value )
             {
+               context.require_writable();
                EOS_ASSERT( payer != account_name(), invalid_table_payer, "must specify a valid account to pay for new record" );
 
 //               context.require_write_lock( scope );
@@ -204,6 +218,7 @@ class apply_context {
             }
 
             void remove( int iterator ) {
+               context.require_writable();
                const auto& obj = itr_cache.get( iterator );
                context.update_db_usage( obj.payer, -( config::billable_size_v<ObjectType> ) );
 
@@ -225,6 +240,7 @@ class apply_context {
             }
 
             void update( int iterator, account_name payer, secondary_key_proxy_const_type secondary ) {
+               context.require_writable();
                const auto& obj = itr_cache.get( iterator );
 
                const auto& table_obj = itr_cache.get_table( obj.t_id );
@@ -317,6 +333,37 @@ class apply_context {
                return itr_cache.add(*itr);
             }
 
+            /**
+             * Up to `count` rows following `iterator`, as many calls of next_secondary would return.
+             * `iterator` is left at the last row returned, or at the end iterator of the table once it is reached.
+             * @param secondaries - receives the secondary keys of the rows, unless its size is 0
+             * @return number of rows returned
+             */
+            uint32_t next_secondary_batch( int& iterator, uint64_t* primaries, uint32_t count, char* secondaries, size_t secondaries_size ) {
+               EOS_ASSERT( secondaries_size == 0 || secondaries_size >= count * sizeof(secondary_key_type), db_api_exception,
+                           "secondary keys buffer of ${s} bytes is too small for ${c} rows", ("s", secondaries_size)("c", count) );
+               if( iterator < -1 || count == 0 ) return 0; // cannot increment past end iterator of index
+
+               const auto& obj = itr_cache.get(iterator); // Check for iterator != -1 happens in this call
+               const auto& idx = context.db.get_index<typename chainbase::get_index_type<ObjectType>::type, by_secondary>();
+
+               auto itr = idx.iterator_to(obj);
+               const ObjectType* last = nullptr;
+               uint32_t n = 0;
+               auto ahead = make_scan_prefetcher( std::next(itr), idx.end() );
+               for( ++itr; n < count && itr != idx.end() && itr->t_id == obj.t_id; ++itr, ++n, ahead.advance() ) {
+                  primaries[n] = itr->primary_key;
+                  if( secondaries_size )
+                     memcpy( secondaries + n * sizeof(secondary_key_type), &itr->secondary_key, sizeof(secondary_key_type) );
+                  last = &*itr;
+                  if( n % config::secondary_batch_checktime_rows == config::secondary_batch_checktime_rows - 1 )
+                     context.trx_context.checktime();
+               }
+
+               iterator = n < count ? itr_cache.get_end_iterator_by_table_id(obj.t_id) : itr_cache.add(*last);
+               return n;
+            }
+
             int previous_secondary( int iterator, uint64_t& primary ) {
                const auto& idx = context.db.get_index<typename chainbase::get_index_type<ObjectType>::type, by_secondary>();
 
@@ -502,6 +549,9 @@ class apply_context {
        */
       bool has_recipient(account_name account)const;
 
+      /// throws in a read-only transaction, before a table write or the sending of an action
+      void require_writable()const;
+
    /// Console methods:
    public:
 
@@ -562,6 +612,7 @@ class apply_context {
       controller&                   control;
       chainbase::database&          db;  ///< database where state is stored
       transaction_context&          trx_context; ///< transaction context in which the action is running
+      uint32_t                      db_intrinsic_calls = 0; ///< database intrinsics called by the current receiver
 
    private:
       const action*                 act = nullptr; ///< action being applied
@@ -572,6 +623,7 @@ class apply_context {
       uint32_t                      action_ordinal = 0;
       bool                          privileged   = false;
       bool                          context_free = false;
+      fc::optional<digest_type>     act_digest; ///< of the action, shared by its notifications
 
    public:
       generic_index<index64_object>                                  idx64;
@@ -0,0 +1,84 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <fc/log/logger.hpp>
+
+#include <atomic>
+#include <memory>
+
+namespace eosio { namespace chain {
+
+   /**
+    * Log messages written to their appenders by a background thread of the process.
+    *
+    * The calling thread only captures the message, its arguments as variants and its context, into a bounded
+    * lock-free queue; the format substitution and the appender output, which takes the lock of the console and
+    * writes to it, are done by the background thread. Messages are dropped when the queue is full, so logging
+    * never blocks a hot path. Until start() is called, and after stop(), messages are logged on the calling thread.
+    */
+   class async_log {
+      public:
+         static constexpr uint32_t default_capacity = 8192;
+
+         struct stats_type {
+            std::atomic<uint64_t> queued{0};      ///< messages accepted by the queue
+            std::atomic<uint64_t> written{0};     ///< messages written by the background thread
+            std::atomic<uint64_t> dropped{0};     ///< messages lost because the queue was full
+            std::atomic<uint64_t> max_backlog{0}; ///< most messages waiting in the queue
+         };
+
+         async_log();
+         ~async_log();
+
+         async_log( const async_log& ) = delete;
+         async_log& operator=( const async_log& ) = delete;
+
+         /// the queue of the process
+         static async_log& global();
+
+         /// starts the background thread with room for `capacity` messages, rounded up to a power of 2
+         /// start and stop are called by the main thread
+         void start( uint32_t capacity = default_capacity );
+         /// writes the queued messages and stops the background thread
+         void stop();
+         bool running()const { return _running.load( std::memory_order_acquire ); }
+
+         /// queues `msg`, or logs it in place if the queue is not running
+         void log( const fc::logger& logger, fc::log_message&& msg );
+
+         /// waits until the messages queued before the call are written
+         void flush();
+
+         /// messages waiting in the queue
+         uint64_t backlog()const {
+            const auto written = _stats.written.load();
+            const auto queued = _stats.queued.load();
+            return queued > written ? queued - written : 0; // a message may be written before it is counted as queued
+         }
+         const stats_type& stats()const { return _stats; }
+
+      private:
+         struct queue;
+
+         std::unique_ptr<queue> _queue;
+         std::atomic<bool>      _running{false};
+         stats_type             _stats;
+   };
+
+} } // namespace eosio::chain
+
+/// like fc_dlog and fc_ilog, through the async_log of the process
+#define async_dlog( LOGGER, FORMAT, ... ) \
+  FC_MULTILINE_MACRO_BEGIN \
+   if( (LOGGER).is_enabled( fc::log_level::debug ) ) \
+      ::eosio::chain::async_log::global().log( LOGGER, FC_LOG_MESSAGE( debug, FORMAT, __VA_ARGS__ ) ); \
+  FC_MULTILINE_MACRO_END
+
+#define async_ilog( LOGGER, FORMAT, ... ) \
+  FC_MULTILINE_MACRO_BEGIN \
+   if( (LOGGER).is_enabled( fc::log_level::info ) ) \
+      ::eosio::chain::async_log::global().log( LOGGER, FC_LOG_MESSAGE( info, FORMAT, __VA_ARGS__ ) ); \
+  FC_MULTILINE_MACRO_END
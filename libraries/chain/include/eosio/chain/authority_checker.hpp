@@ -14,6 +14,7 @@
 #include <boost/range/algorithm/find.hpp>
 #include <boost/algorithm/cxx11/all_of.hpp>
 
+#include <algorithm>
 #include <functional>
 
 namespace eosio { namespace chain {
@@ -62,7 +63,7 @@ namespace detail {
       private:
          PermissionToAuthorityFunc            permission_to_authority;
          const std::function<void()>&         checktime;
-         vector<public_key_type>              provided_keys; // Making this a flat_set<public_key_type> causes runtime problems with utilities::filter_data_by_marker for some reason. TODO: Figure out why.
+         vector<public_key_type>              provided_keys; // sorted as the provided flat_set. Making this a flat_set<public_key_type> causes runtime problems with utilities::filter_data_by_marker for some reason. TODO: Figure out why.
          flat_set<permission_level>           provided_permissions;
          vector<bool>                         _used_keys;
          fc::microseconds                     provided_delay;
@@ -178,8 +179,26 @@ namespace detail {
             return &cached_permissions;
          }
 
+         /// index of key in provided_keys, which is sorted, or provided_keys.size() if it is not provided
+         size_t provided_key_index( const public_key_type& key )const {
+            auto itr = std::lower_bound( provided_keys.begin(), provided_keys.end(), key );
+            if( itr == provided_keys.end() || !(*itr == key) )
+               return provided_keys.size();
+            return itr - provided_keys.begin();
+         }
+
          template<typename AuthorityType>
          bool satisfied( const AuthorityType& authority, permission_cache_type& cached_permissions, uint16_t depth ) {
+            // Most permissions are a single key: satisfied if it is provided, no keys to revert nor permissions to sort
+            if( authority.keys.size() == 1 && authority.accounts.empty() && authority.waits.empty() && authority.threshold > 0 ) {
+               const auto& kw = authority.keys.front();
+               if( kw.weight < authority.threshold ) return false;
+               const auto i = provided_key_index( kw.key );
+               if( i == provided_keys.size() ) return false;
+               _used_keys[i] = true;
+               return true;
+            }
+
             // Save the current used keys; if we do not satisfy this authority, the newly used keys aren't actually used
             auto KeyReverter = fc::make_scoped_exit([this, keys = _used_keys] () mutable {
                _used_keys = keys;
@@ -225,9 +244,9 @@ namespace detail {
             }
 
             uint32_t operator()(const key_weight& permission) {
-               auto itr = boost::find( checker.provided_keys, permission.key );
-               if( itr != checker.provided_keys.end() ) {
-                  checker._used_keys[itr - checker.provided_keys.begin()] = true;
+               const auto i = checker.provided_key_index( permission.key );
+               if( i != checker.provided_keys.size() ) {
+                  checker._used_keys[i] = true;
                   total_weight += permission.weight;
                }
                return total_weight;
@@ -88,6 +88,17 @@ namespace eosio { namespace chain {
                               const flat_set<permission_level>&    satisfied_authorizations = flat_set<permission_level>()
                             )const;
 
+         /// as above, for a single action, without copying it into a vector (inline actions)
+         void
+         check_authorization( const action&                        act,
+                              const flat_set<public_key_type>&     provided_keys,
+                              const flat_set<permission_level>&    provided_permissions = flat_set<permission_level>(),
+                              fc::microseconds                     provided_delay = fc::microseconds(0),
+                              const std::function<void()>&         checktime = std::function<void()>(),
+                              bool                                 allow_unused_keys = false,
+                              const flat_set<permission_level>&    satisfied_authorizations = flat_set<permission_level>()
+                            )const;
+
 
          /**
           *  @brief Check authorizations of a permission with provided keys, permission levels, and delay
@@ -128,6 +139,15 @@ namespace eosio { namespace chain {
          void             check_unlinkauth_authorization( const unlinkauth& unlink, const vector<permission_level>& auths )const;
          fc::microseconds check_canceldelay_authorization( const canceldelay& cancel, const vector<permission_level>& auths )const;
 
+         void             check_authorization( const action* first, const action* last,
+                                               const flat_set<public_key_type>&     provided_keys,
+                                               const flat_set<permission_level>&    provided_permissions,
+                                               fc::microseconds                     provided_delay,
+                                               const std::function<void()>&         checktime,
+                                               bool                                 allow_unused_keys,
+                                               const flat_set<permission_level>&    satisfied_authorizations
+                                             )const;
+
          optional<permission_name> lookup_linked_permission( account_name authorizer_account,
                                                              scope_name code_account,
                                                              action_name type
@@ -13,7 +13,7 @@ namespace detail {
       uint32_t                          dpos_proposed_irreversible_blocknum = 0;
       uint32_t                          dpos_irreversible_blocknum = 0;
       uint32_t                          bft_irreversible_blocknum = 0; // HAYA
-      producer_schedule_type            active_schedule;
+      producer_schedule_ptr             active_schedule = std::make_shared<producer_schedule_type>();
       incremental_merkle                blockroot_merkle;
       flat_map<account_name,uint32_t>   producer_to_last_produced;
       flat_map<account_name,uint32_t>   producer_to_last_implied_irb;
@@ -6,10 +6,36 @@
 #include <fc/filesystem.hpp>
 #include <eosio/chain/block.hpp>
 #include <eosio/chain/genesis_state.hpp>
+#include <atomic>
+#include <fstream>
 
 namespace eosio { namespace chain {
 
-   namespace detail { class block_log_impl; }
+   namespace detail { class block_log_impl; class block_log_segments; }
+
+   /**
+    * Splitting of the block log into segments of `stride` blocks. When blocks.log holds `stride` blocks,
+    * it is renamed to blocks-<first>-<last>.log (and .index) and a new blocks.log is started. Renamed
+    * segments are compressed in background to blocks-<first>-<last>.zlog in `archive_dir` and removed.
+    */
+   struct block_log_segment_config {
+      uint32_t stride = 0;             ///< 0 keeps a single ever-growing blocks.log
+      fc::path archive_dir;            ///< where compressed segments go, the blocks directory if empty
+      uint32_t blocks_per_frame = 256; ///< blocks compressed together, the unit of decompression on read
+      uint32_t cache_frames = 8;       ///< decompressed frames kept for reads
+   };
+
+   /**
+    * Group commit of appends. Appended blocks are buffered and written to blocks.log in chunks ending at page
+    * boundaries, with the index entries of the blocks written in one write; a read writes the buffer out first.
+    * Buffered blocks are lost by a crash of the process, which leaves the state database dirty and needing a
+    * replay anyway. fsync is done by a background thread, never by default as before.
+    */
+   struct block_log_write_config {
+      uint32_t buffer_size = 1024 * 1024; ///< bytes of blocks buffered before a write, 0 writes every block
+      uint32_t fsync_blocks = 0;          ///< fsync every this many appended blocks, 0 for none
+      bool     fsync_on_commit = false;   ///< fsync on commit(), once the blocks of a LIB advance are appended
+   };
 
    /* The block log is an external append only log of the blocks with a header. Blocks should only
     * be written to the log after they irreverisble as the log is append only. The log is a doubly
@@ -34,20 +60,51 @@ namespace eosio { namespace chain {
     *
     * The main file is the only file that needs to persist. The index file can be reconstructed during a
     * linear scan of the main file.
+    *
+    * Older blocks may be moved to segments (see block_log_segment_config); reads by block number are
+    * routed to them transparently. A compressed segment is a sequence of zlib frames:
+    *
+    * +--------+---------+-----+-------------+------------------+-----+--------------+
+    * | Header | Frame 0 | ... | Frame N - 1 | Pos of Frame 0   | ... | Frames Count |
+    * +--------+---------+-----+-------------+------------------+-----+--------------+
+    *
+    * Every frame holds blocks_per_frame (size, packed block) records, so a read decompresses one frame only.
     */
 
    class block_log {
       public:
-         block_log(const fc::path& data_dir);
+         block_log(const fc::path& data_dir, const block_log_segment_config& segment_config = block_log_segment_config(),
+                   const block_log_write_config& write_config = block_log_write_config());
          block_log(block_log&& other);
          ~block_log();
 
          uint64_t append(const signed_block_ptr& b);
+         /// writes the buffered blocks to the files
          void flush();
+         /// end of the appends of a LIB advance, see block_log_write_config::fsync_on_commit
+         void commit();
          void reset( const genesis_state& gs, const signed_block_ptr& genesis_block, uint32_t first_block_num = 1 );
 
          std::pair<signed_block_ptr, uint64_t> read_block(uint64_t file_pos)const;
          signed_block_ptr read_block_by_num(uint32_t block_num)const;
+
+         /**
+          * Serialized block inside the read-only memory mapping of the log, shares ownership of the
+          * mapping so it stays valid after the log is remapped or closed.
+          */
+         struct packed_block_view {
+            std::shared_ptr<const void> mapping;
+            const char*                 data = nullptr;
+            size_t                      size = 0;
+
+            explicit operator bool()const { return data != nullptr; }
+         };
+
+         /**
+          * Bytes of the block as stored in the log (fc::raw packed signed_block) without copying,
+          * empty view if the block is not in the log. The log is remapped when it has grown.
+          */
+         packed_block_view read_packed_block_by_num(uint32_t block_num)const;
          signed_block_ptr read_block_by_id(const block_id_type& id)const {
             return read_block_by_num(block_header::num_from_id(id));
          }
@@ -58,6 +115,7 @@ namespace eosio { namespace chain {
          uint64_t get_block_pos(uint32_t block_num) const;
          signed_block_ptr        read_head()const;
          const signed_block_ptr& head()const;
+         /// first block available in the log, including segments
          uint32_t                first_block_num() const;
 
          static const uint64_t npos = std::numeric_limits<uint64_t>::max();
@@ -65,13 +123,55 @@ namespace eosio { namespace chain {
          static const uint32_t min_supported_version;
          static const uint32_t max_supported_version;
 
+         /**
+          * Walks the log forward with its own file stream, so blocks can be read on another thread
+          * while the log is used (but not appended to) elsewhere. Construct on the thread owning the log.
+          * Blocks moved to segments are read through the segments, which are thread safe.
+          */
+         class sequential_reader {
+            public:
+               /// reads blocks from `first_block_num` to the head of the log
+               sequential_reader( const block_log& log, uint32_t first_block_num );
+
+               /// @return block, null after the head block
+               signed_block_ptr next();
+
+            private:
+               std::ifstream block_stream;
+               std::shared_ptr<detail::block_log_segments> segments;
+               uint32_t      next_block_num;
+               uint32_t      last_block_num;
+               uint32_t      log_first_block_num; ///< first block of blocks.log, earlier ones are in segments
+         };
+
+         /// progress of the latest index reconstruction (done on several threads when the index is missing or stale)
+         struct index_progress {
+            std::atomic<uint32_t> blocks_total{0};
+            std::atomic<uint32_t> blocks_indexed{0};
+         };
+         static index_progress& index_reconstruction_progress();
+
          static fc::path repair_log( const fc::path& data_dir, uint32_t truncate_at_block = 0 );
 
          static genesis_state extract_genesis_state( const fc::path& data_dir );
 
+         /**
+          * Offline edits of the blocks.log of `data_dir`, which must not be open. Segments are not changed, the
+          * blocks must be in blocks.log. The serialized blocks are copied as they are, only their positions are
+          * rewritten, and blocks.index is written along.
+          */
+         /// writes blocks `first` through `last` to a new blocks.log and blocks.index in `output_dir`
+         static void extract_blocks( const fc::path& data_dir, const fc::path& output_dir, uint32_t first, uint32_t last );
+         /// removes the blocks before `first`, rewriting the log
+         static void trim_front( const fc::path& data_dir, uint32_t first );
+         /// removes the blocks after `last`, truncating the log in place
+         static void trim_end( const fc::path& data_dir, uint32_t last );
+
       private:
          void open(const fc::path& data_dir);
          void construct_index();
+         void reset_log( const genesis_state& gs, const signed_block_ptr& first_block, uint32_t first_block_num );
+         void start_segment( const signed_block_ptr& b );
 
          std::unique_ptr<detail::block_log_impl> my;
    };
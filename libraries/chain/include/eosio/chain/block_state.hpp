@@ -42,13 +42,26 @@ namespace eosio { namespace chain {
 
       bool is_valid()const { return validated; }
 
+      /// drops the metadata of the transactions, get_trxs() rebuilds it from `block`, without their recovered keys
+      void compact();
+      bool is_compact()const { return compacted; }
+
+      /// `trxs`, rebuilt from `block` first if the block state is compact
+      const vector<transaction_metadata_ptr>& get_trxs();
 
       signed_block_ptr                                    block;
       bool                                                validated = false;
 
+      ///@{
+      /// HAYA: fork database ordering by bft finality, not serialized
+      /// max for descendants of the last bft finalized block, bft_irreversible_blocknum otherwise
+      uint32_t                                            bft_rank = 0;
+      ///@}
+
       /// this data is redundant with the data stored in block, but facilitates
       /// recapturing transactions when we pop a block
       vector<transaction_metadata_ptr>                    trxs;
+      bool                                                compacted = false; ///< not serialized
    };
 
    using block_state_ptr = std::shared_ptr<block_state>;
@@ -16,9 +16,14 @@ const static auto default_blocks_dir_name    = "blocks";
 const static auto reversible_blocks_dir_name = "reversible";
 const static auto default_reversible_cache_size = 340*1024*1024ll;/// 1MB * 340 blocks based on 21 producer BFT delay
 const static auto default_reversible_guard_size = 2*1024*1024ll;/// 1MB * 340 blocks based on 21 producer BFT delay
+const static auto default_reversible_block_cache_size = 64*1024*1024ll;
+const static auto default_fork_switch_redo_blocks = 64;
+const static auto default_lib_prune_blocks = 64;
+const static auto default_fork_db_compact_depth = 360;
 
 const static auto default_state_dir_name     = "state";
 const static auto forkdb_filename            = "fork_db.dat";
+const static auto forkdb_journal_filename    = "fork_db.journal";
 const static auto default_state_size            = 1*1024*1024*1024ll;
 const static auto default_state_guard_size      =    128*1024*1024ll;
 
@@ -97,6 +102,10 @@ const static uint32_t   overhead_per_account_ram_bytes     = 2*1024; ///< overhe
 const static uint32_t   setcode_ram_bytes_multiplier       = 10;     ///< multiplier on contract size to account for multiple copies and cached compilation
 
 const static uint32_t   hashing_checktime_block_size       = 10*1024;  /// call checktime from hashing intrinsic once per this number of bytes
+const static uint32_t   rsa_public_key_cache_size          = 256;      /// parsed public keys kept by the rsa_verify intrinsics
+const static uint32_t   secondary_batch_checktime_rows     = 1024;     /// call checktime from secondary index batch intrinsics once per this number of rows
+const static uint32_t   injected_checktime_interval        = 64;       /// injected checktime calls the host once per this number of loop iterations and calls
+const static uint32_t   transaction_arena_block_size       = 16*1024;  /// size of the first block of the arena of a transaction, later blocks double
 
 const static eosio::chain::wasm_interface::vm_type default_wasm_runtime = eosio::chain::wasm_interface::vm_type::wabt;
 const static uint32_t   default_abi_serializer_max_time_ms = 15*1000; ///< default deadline for abi serialization methods
@@ -1,14 +1,19 @@
 #pragma once
 #include <eosio/chain/block_state.hpp>
+#include <eosio/chain/block_log.hpp>
 #include <eosio/chain/trace.hpp>
 #include <eosio/chain/genesis_state.hpp>
+#include <eosio/chain/thread_utils.hpp>
 #include <chainbase/pinnable_mapped_file.hpp>
 #include <boost/signals2/signal.hpp>
 
+#include <limits>
+
 #include <eosio/chain/abi_serializer.hpp>
 #include <eosio/chain/account_object.hpp>
 #include <eosio/chain/snapshot.hpp>
 #include <eosio/chain/protocol_feature_manager.hpp>
+#include <eosio/chain/unapplied_transaction_queue.hpp>
 
 namespace chainbase {
    class database;
@@ -36,7 +41,7 @@ namespace eosio { namespace chain {
    class account_object;
    using resource_limits::resource_limits_manager;
    using apply_handler = std::function<void(apply_context&)>;
-   using unapplied_transactions_type = map<transaction_id_type, transaction_metadata_ptr, sha256_less>;
+   using unapplied_transactions_type = unapplied_transaction_queue;
 
    class fork_database;
 
@@ -64,22 +69,32 @@ namespace eosio { namespace chain {
             flat_set< pair<account_name, action_name> > action_blacklist;
             flat_set<public_key_type> key_blacklist;
             path                     blocks_dir             =  chain::config::default_blocks_dir_name;
+            block_log_segment_config blocks_log_segments;
+            block_log_write_config   blocks_log_writes;
             path                     state_dir              =  chain::config::default_state_dir_name;
             uint64_t                 state_size             =  chain::config::default_state_size;
             uint64_t                 state_guard_size       =  chain::config::default_state_guard_size;
             uint64_t                 reversible_cache_size  =  chain::config::default_reversible_cache_size;
             uint64_t                 reversible_guard_size  =  chain::config::default_reversible_guard_size;
+            uint64_t                 reversible_block_cache_size = chain::config::default_reversible_block_cache_size; ///< packed bytes of the decoded reversible blocks kept
+            uint32_t                 fork_switch_redo_blocks = chain::config::default_fork_switch_redo_blocks; ///< reversible blocks whose state changes are kept to switch back to them, 0 to disable
+            uint32_t                 lib_prune_blocks = chain::config::default_lib_prune_blocks; ///< reversible blocks removed once irreversible per block applied, 0 for all of them
+            uint32_t                 fork_db_compact_depth = chain::config::default_fork_db_compact_depth; ///< blocks behind the head whose transaction metadata is dropped, 0 to keep it
             uint32_t                 sig_cpu_bill_pct       =  chain::config::default_sig_cpu_bill_pct;
             uint16_t                 thread_pool_size       =  chain::config::default_controller_thread_pool_size;
             bool                     read_only              =  false;
             bool                     force_all_checks       =  false;
             bool                     disable_replay_opts    =  false;
+            path                     replay_timing_file;      ///< CSV of the apply time, CPU, NET and RAM of each replayed block, empty to disable
+            uint32_t                 replay_max_blocks      =  0; ///< irreversible blocks replayed at most, 0 for all
             bool                     contracts_console      =  false;
             bool                     allow_ram_billing_in_notify = false;
             bool                     disable_all_subjective_mitigations = false; //< for testing purposes only
 
             genesis_state            genesis;
             wasm_interface::vm_type  wasm_runtime = chain::config::default_wasm_runtime;
+            path                     wasm_cache_dir; ///< injected code of contracts is kept here across restarts, empty to disable
+            uint64_t                 wasm_cache_size = 0; ///< estimated bytes of instantiated contracts kept in memory, 0 for no limit
 
             db_read_mode             read_mode              = db_read_mode::SPECULATIVE;
             validation_mode          block_validation_mode  = validation_mode::FULL;
@@ -90,6 +105,10 @@ namespace eosio { namespace chain {
             flat_set<account_name>   resource_greylist;
             flat_set<account_name>   trusted_producers;
             uint32_t                 greylist_limit         = chain::config::maximum_elastic_resource_multiplier;
+
+            /// only the tables of these contracts are loaded from a snapshot, all of them if empty; a node with a
+            /// partial state serves reads and does not apply blocks
+            flat_set<account_name>   partial_state_contracts;
          };
 
          enum class block_status {
@@ -99,12 +118,56 @@ namespace eosio { namespace chain {
             incomplete  = 3, ///< this is an incomplete block (either being produced by a producer or speculatively produced by a node)
          };
 
+         /// Stages of block and transaction processing, timed through `pipeline_stage_timed`.
+         enum class pipeline_stage {
+            block_receive,          ///< block message received by net_plugin until it is passed to chain
+            block_signature_check,  ///< block_state creation: merkle root and producer signature check
+            block_apply,            ///< transactions of a block applied and block finalized
+            block_commit,
+            fork_switch,            ///< popping and re-applying blocks when switching to a better fork
+            block_irreversible,     ///< writing new irreversible blocks to the block log
+            trx_signature_recovery,
+            trx_queue_wait,         ///< producer_plugin: received until pushed to chain
+            trx_execution,          ///< transaction_context::exec
+            trx_relay,              ///< net_plugin: serialization and enqueueing to peers
+            block_redo,             ///< fork switch back onto a block through the state changes it made before it was popped
+            stages_count
+         };
+
+         struct pipeline_stage_timing {
+            pipeline_stage   stage;
+            fc::microseconds duration;
+         };
+
+         static const char* pipeline_stage_name( pipeline_stage stage );
+
+         /// A phase of the node startup, see `startup_timeline`. Phases nest: a phase contains those that start
+         /// within it.
+         struct startup_phase {
+            std::string      name;
+            fc::time_point   start;
+            fc::microseconds duration;
+         };
+
+         /// Resources used by one receiver of an action, reported through `action_profiled`.
+         struct action_profile {
+            account_name     receiver;
+            action_name      action;
+            fc::microseconds elapsed;
+            int64_t          billed_cpu_us = 0;     ///< part of the transaction billed CPU, proportional to elapsed
+            int64_t          ram_delta = 0;         ///< sum of RAM deltas of all accounts
+            uint32_t         db_intrinsic_calls = 0;
+            uint64_t         arena_allocations = 0;   ///< allocations from the transaction arena (action caches)
+         };
+
          explicit controller( const config& cfg );
          controller( const config& cfg, protocol_feature_set&& pfs );
          ~controller();
 
          void add_indices();
          void startup( std::function<bool()> shutdown, const snapshot_reader_ptr& snapshot = nullptr );
+         /// phases of the construction and `startup` that ran, in the order they ended
+         const vector<startup_phase>& startup_timeline()const;
 
          void preactivate_feature( const digest_type& feature_digest );
 
@@ -147,6 +210,13 @@ namespace eosio { namespace chain {
          transaction_trace_ptr push_transaction( const transaction_metadata_ptr& trx, fc::time_point deadline,
                                                  uint32_t billed_cpu_time_us, bool explicit_billed_cpu_time );
 
+         /**
+          * Executes `trx` in the pending block without changing it: the contracts cannot write their tables nor send
+          * actions, the transaction is neither billed nor recorded, and its changes are undone. The signatures are not
+          * checked, `deadline` is the only limit of its execution. Errors are reported in the trace.
+          */
+         transaction_trace_ptr push_read_only_transaction( const transaction_metadata_ptr& trx, fc::time_point deadline );
+
          /**
           * Attempt to execute a specific transaction in our deferred trx database
           *
@@ -154,15 +224,45 @@ namespace eosio { namespace chain {
          transaction_trace_ptr push_scheduled_transaction( const transaction_id_type& scheduled, fc::time_point deadline,
                                                            uint32_t billed_cpu_time_us, bool explicit_billed_cpu_time );
 
+         /**
+          * Ids of the scheduled transactions the pending block may execute, in the order of their delay: due by the
+          * pending block time and not published in the pending block. At most `max` of them.
+          */
+         vector<transaction_id_type> get_due_scheduled_transactions( size_t max = std::numeric_limits<size_t>::max() )const;
+
          block_state_ptr finalize_block( const std::function<signature_type( const digest_type& )>& signer_callback );
          void sign_block( const std::function<signature_type( const digest_type& )>& signer_callback );
          void commit_block();
          void pop_block();
 
          std::future<block_state_ptr> create_block_state_future( const signed_block_ptr& b );
+         /**
+          * Sync: starts validation and signature recovery of blocks expected to be pushed next. `blocks` are in order,
+          * the first links to a block known to fork database. create_block_state_future() and push_block() of these
+          * blocks use the prefetched results.
+          */
+         void prefetch_blocks( const vector<signed_block_ptr>& blocks );
+         /**
+          * Sync: `id` is known to be final, from a finality proof checked by the caller. The blocks of a
+          * prefetch_blocks() batch that are `id` or link to it through their previous ids in the batch are counted
+          * as checkpointed. They are validated as any other block: a block id does not cover the producer
+          * signature, so a proof does not authenticate it.
+          */
+         void add_finality_checkpoint( const block_id_type& id );
+         /// blocks prefetched in a chain ending at a finality checkpoint
+         uint64_t get_checkpointed_blocks()const;
+         /**
+          * Removes at most `max_blocks` of the reversible blocks that became irreversible, all of them if 0. Each
+          * block applied removes lib_prune_blocks of them, so that a long LIB jump is not cleaned up at once; the
+          * rest is left for the caller to prune when idle. True if some are left.
+          */
+         bool prune_irreversible( uint32_t max_blocks );
          void push_block( std::future<block_state_ptr>& block_state_future );
 
-         boost::asio::io_context& get_thread_pool();
+         /// executor of the block validation tasks of the controller on its scheduler
+         const task_executor& get_thread_pool();
+         /// workers shared by the subsystems running CPU work off the main thread, see task_scheduler
+         task_scheduler& get_task_scheduler();
 
          const chainbase::database& db()const;
 
@@ -223,6 +323,8 @@ namespace eosio { namespace chain {
          block_id_type last_irreversible_block_id() const;
 
          signed_block_ptr fetch_block_by_number( uint32_t block_num )const;
+         /// serialized irreversible block straight from the block log, empty if the block is not in the log
+         block_log::packed_block_view fetch_packed_block_by_number( uint32_t block_num )const;
          signed_block_ptr fetch_block_by_id( block_id_type id )const;
 
          block_state_ptr fetch_block_state_by_number( uint32_t block_num )const;
@@ -231,6 +333,8 @@ namespace eosio { namespace chain {
          block_id_type get_block_id_for_num( uint32_t block_num )const;
 
          sha256 calculate_integrity_hash()const;
+         /// integrity hash version 2 (tree_integrity_hash_snapshot_writer), computed on `threads` threads
+         sha256 calculate_tree_integrity_hash( uint32_t threads )const;
          void write_snapshot( const snapshot_writer_ptr& snapshot )const;
 
          bool sender_avoids_whitelist_blacklist_enforcement( account_name sender )const;
@@ -273,6 +377,8 @@ namespace eosio { namespace chain {
 
          db_read_mode get_read_mode()const;
          validation_mode get_validation_mode()const;
+         /// contracts with tables in the state when it is partial, empty for a full state
+         const flat_set<account_name>& get_partial_state_contracts()const;
 
          void set_subjective_cpu_leeway(fc::microseconds leeway);
          fc::optional<fc::microseconds> get_subjective_cpu_leeway() const;
@@ -291,6 +397,12 @@ namespace eosio { namespace chain {
          signal<void(const transaction_metadata_ptr&)> accepted_transaction;
          signal<void(std::tuple<const transaction_trace_ptr&, const signed_transaction&>)> applied_transaction;
          signal<void(const int&)>                      bad_alloc;
+         /// may be emitted from any thread
+         signal<void(const pipeline_stage_timing&)>    pipeline_stage_timed;
+         /// for every action trace of an executed transaction, including speculative execution
+         signal<void(const action_profile&)>           action_profiled;
+         /// for every lookup of the instantiated module of a contract
+         signal<void(const wasm_interface::cache_access&)> wasm_cache_accessed;
 
          /*
          signal<void()>                                  pre_apply_block;
@@ -335,8 +447,13 @@ namespace eosio { namespace chain {
 
          chainbase::database& mutable_db()const;
 
+         /// adds an input transaction of the pending block to the deduplication table when the block is finalized
+         void record_transaction( const transaction_id_type& id, fc::time_point_sec expire );
+
          std::unique_ptr<controller_impl> my;
 
    };
 
 } }  /// eosio::chain
+
+FC_REFLECT( eosio::chain::controller::startup_phase, (name)(start)(duration) )
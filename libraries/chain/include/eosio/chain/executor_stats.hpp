@@ -0,0 +1,96 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <fc/scoped_exit.hpp>
+#include <fc/time.hpp>
+
+#include <array>
+#include <atomic>
+#include <utility>
+
+namespace eosio { namespace chain {
+
+   /// who posted work to the application thread
+   enum class executor_category {
+      net,
+      http,
+      producer,
+      signals, ///< posted by handlers of controller signals and channels
+      other,
+      categories_count
+   };
+
+   /**
+    * Depth, wait and run times of the work posted to the application thread, by priority and by category of poster,
+    * shared by every thread of the process.
+    *
+    * The priority queue belongs to appbase: work is accounted when it is wrapped before being posted, see
+    * instrumented_post, and when the wrapper runs. Work dropped from the queue at shutdown stays in the depth.
+    */
+   class executor_stats {
+      public:
+         /// priority bands of appbase: below low, below medium, below high, below highest, highest
+         static constexpr size_t levels_count = 5;
+
+         struct level_stats {
+            std::atomic<int64_t>  depth{0};
+            std::atomic<uint64_t> posted{0};
+            std::atomic<uint64_t> wait_us{0};
+            std::atomic<uint64_t> max_wait_us{0}; ///< since the last take_max_wait
+         };
+
+         struct category_stats {
+            std::atomic<uint64_t> runs{0};
+            std::atomic<uint64_t> wait_us{0};
+            std::atomic<uint64_t> run_us{0};
+         };
+
+         /// the stats of the process
+         static executor_stats& global();
+
+         static size_t      level_of( int priority );
+         static const char* level_name( size_t level );
+         static const char* category_name( executor_category c );
+
+         /// `f` accounted from now until it returns
+         template<typename F>
+         auto wrap( int priority, executor_category c, F&& f ) {
+            auto& level = levels[level_of( priority )];
+            auto& category = categories[static_cast<size_t>( c )];
+            level.depth.fetch_add( 1, std::memory_order_relaxed );
+            level.posted.fetch_add( 1, std::memory_order_relaxed );
+            return [&level, &category, queued = fc::time_point::now(), f = std::forward<F>( f )]() mutable {
+               const auto start = fc::time_point::now();
+               const uint64_t wait = ( start - queued ).count();
+               level.depth.fetch_sub( 1, std::memory_order_relaxed );
+               level.wait_us.fetch_add( wait, std::memory_order_relaxed );
+               uint64_t max_wait = level.max_wait_us.load( std::memory_order_relaxed );
+               while( wait > max_wait && !level.max_wait_us.compare_exchange_weak( max_wait, wait, std::memory_order_relaxed ) );
+               category.wait_us.fetch_add( wait, std::memory_order_relaxed );
+               auto account_run = fc::make_scoped_exit( [&category, start]() {
+                  category.runs.fetch_add( 1, std::memory_order_relaxed );
+                  category.run_us.fetch_add( ( fc::time_point::now() - start ).count(), std::memory_order_relaxed );
+               } );
+               f();
+            };
+         }
+
+         /// longest wait of the level since the previous call
+         uint64_t take_max_wait( size_t level ) {
+            return levels[level].max_wait_us.exchange( 0, std::memory_order_relaxed );
+         }
+
+         std::array<level_stats, levels_count>                                               levels;
+         std::array<category_stats, static_cast<size_t>( executor_category::categories_count )> categories;
+   };
+
+   /// `app.post( priority, f )` with `f` accounted in executor_stats::global()
+   template<typename Application, typename F>
+   void instrumented_post( Application& app, int priority, executor_category c, F&& f ) {
+      app.post( priority, executor_stats::global().wrap( priority, c, std::forward<F>( f ) ) );
+   }
+
+} } // namespace eosio::chain
@@ -46,8 +46,9 @@ namespace eosio { namespace chain {
 
          /**
           *  Advance root block forward to some other block in the tree.
+          *  The removed block states are moved to `removed` if given, for the caller to release them elsewhere.
           */
-         void            advance_root( const block_id_type& id );
+         void            advance_root( const block_id_type& id, vector<block_state_ptr>* removed = nullptr );
 
          /**
           *  Add block state to fork database.
@@ -93,6 +94,13 @@ namespace eosio { namespace chain {
 
          void mark_valid( const block_state_ptr& h );
 
+         /**
+          *  Compacts the block states of the branch of `h` more than `depth` blocks behind it, see block_state::compact.
+          *  Continues from the children of the last block compacted, so each call usually looks up about one block; walks
+          *  the branch of `h` back to the first block already compact when that branch has ended.
+          */
+         void compact( const block_id_type& h, uint32_t depth );
+
          static const uint32_t magic_number;
 
          static const uint32_t min_supported_version;
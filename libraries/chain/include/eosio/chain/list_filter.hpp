@@ -0,0 +1,79 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/chain/types.hpp>
+
+#include <fc/io/raw.hpp>
+
+namespace eosio { namespace chain {
+
+   /**
+    * Bloom filter in front of a configured blacklist: a value it rejects is not in the list, a value it accepts is
+    * looked up in the list. Most values checked are not listed, they cost a hash and three bit tests.
+    * Rebuilt when the list is set, read by the threads applying transactions.
+    */
+   class list_filter {
+      public:
+         static constexpr size_t bits_per_entry = 16; ///< under 0.5% of false positives with 3 probes
+
+         template<typename Set>
+         void reset( const Set& list ) {
+            size_t size = 64;
+            while( size < list.size() * bits_per_entry ) size *= 2;
+            words.assign( size / 64, 0 );
+            mask = size - 1;
+            for( const auto& v : list ) {
+               const uint64_t h = hash( v );
+               for( uint32_t i = 0; i < probes; ++i ) {
+                  const uint64_t bit = probe( h, i );
+                  words[bit / 64] |= uint64_t(1) << (bit % 64);
+               }
+            }
+         }
+
+         /// false if `v` is not in the list the filter was built from
+         template<typename T>
+         bool may_contain( const T& v )const {
+            if( words.empty() ) return false;
+            const uint64_t h = hash( v );
+            for( uint32_t i = 0; i < probes; ++i ) {
+               const uint64_t bit = probe( h, i );
+               if( !(words[bit / 64] & (uint64_t(1) << (bit % 64))) ) return false;
+            }
+            return true;
+         }
+
+         static uint64_t hash( uint64_t v ) {
+            // splitmix64 finalizer, names are not uniformly distributed
+            v += 0x9e3779b97f4a7c15ull;
+            v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ull;
+            v = (v ^ (v >> 27)) * 0x94d049bb133111ebull;
+            return v ^ (v >> 31);
+         }
+         static uint64_t hash( const name& n ) { return hash( n.value ); }
+         static uint64_t hash( const pair<account_name, action_name>& p ) { return hash( hash( p.first.value ) ^ p.second.value ); }
+         static uint64_t hash( const public_key_type& key ) {
+            // FNV-1a of the packed key
+            uint64_t h = 0xcbf29ce484222325ull;
+            for( char c : fc::raw::pack( key ) ) {
+               h = (h ^ uint8_t(c)) * 0x100000001b3ull;
+            }
+            return hash( h );
+         }
+
+      private:
+         static constexpr uint32_t probes = 3;
+
+         uint64_t probe( uint64_t h, uint32_t i )const {
+            // double hashing from the two halves
+            return ( (h & 0xffffffffull) + i * ((h >> 32) | 1) ) & mask;
+         }
+
+         vector<uint64_t>  words;
+         uint64_t          mask = 0;
+   };
+
+} } // namespace eosio::chain
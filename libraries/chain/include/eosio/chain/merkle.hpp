@@ -14,9 +14,43 @@ namespace eosio { namespace chain {
       return make_pair(make_canonical_left(l), make_canonical_right(r));
    };
 
+   /**
+    *  digest_type::hash(make_canonical_pair(l, r)), without packing the pair.
+    */
+   digest_type hash_canonical_pair( const digest_type& l, const digest_type& r );
+
+   /**
+    *  out[i] = hash_canonical_pair(nodes[2*i], nodes[2*i+1]) for i < pairs, several pairs at a time when the CPU
+    *  has AVX2. out may be nodes: a level of a tree is hashed in place.
+    */
+   void hash_canonical_pairs( const digest_type* nodes, size_t pairs, digest_type* out );
+
    /**
     *  Calculates the merkle root of a set of digests, if ids is odd it will duplicate the last id.
     */
    digest_type merkle( vector<digest_type> ids );
 
+   /**
+    *  Calculates merkle() of digests appended one at a time.
+    *
+    *  Complete subtrees are hashed as soon as their last leaf is appended, one hash per leaf amortized,
+    *  so get_root() only combines the roots of at most log2(n) incomplete-tree parts.
+    */
+   class merkle_accumulator {
+      public:
+         void append( const digest_type& digest );
+
+         void reset() {
+            _count = 0;
+            _subtrees.clear();
+         }
+
+         digest_type get_root()const;
+         uint64_t    size()const { return _count; }
+
+      private:
+         uint64_t             _count = 0;
+         vector<digest_type>  _subtrees; ///< roots of complete subtrees, one per set bit of _count, largest first
+   };
+
 } } /// eosio::chain
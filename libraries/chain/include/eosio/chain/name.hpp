@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <vector>
 #include <fc/reflect/reflect.hpp>
 #include <iosfwd>
 
@@ -57,6 +58,12 @@ namespace eosio { namespace chain {
 
       string to_string() const { return string(*this); }
 
+      /// maximum length of a name
+      static constexpr size_t max_length = 13;
+
+      /// writes the characters of the name, without the trailing dots, to `out` and returns their number
+      size_t write_string( char out[max_length] )const;
+
       name& operator=( uint64_t v ) {
          value = v;
          return *this;
@@ -91,6 +98,9 @@ namespace eosio { namespace chain {
       operator unsigned __int128()const       { return value; }
    };
 
+   /// strings of `count` names, decoded by a single loop (e.g. name arrays in abi_serializer and API results)
+   std::vector<string> names_to_strings( const name* names, size_t count );
+
 } } // eosio::chain
 
 namespace std {
@@ -0,0 +1,57 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace eosio { namespace chain {
+
+   /**
+    * NUMA placement of the memory and threads of the process.
+    *
+    * It is applied to the calling thread, and threads created after it inherit it: applied by the main thread
+    * before the database is opened, it places the state and the threads of the chain, and of the plugins started
+    * later, together. Only supported on Linux.
+    */
+   struct numa_placement {
+      enum class policy_type {
+         none,       ///< kernel default, first touch
+         interleave, ///< pages spread over every node, threads not bound
+         bind        ///< pages and threads on `node`
+      };
+
+      policy_type policy = policy_type::none;
+      uint32_t    node = 0;
+
+      /// "default", "interleave" or "bind:<node>"
+      static numa_placement from_string( const std::string& s );
+
+      /// nodes of the host with memory, empty without NUMA support
+      static std::vector<uint32_t> nodes();
+
+      /// applies the policy to the calling thread, throws if the kernel refuses it
+      void apply()const;
+   };
+
+   /// pages allocated on the node of the allocating thread and on other nodes, summed over nodes, since boot
+   struct numa_stats {
+      uint64_t local_pages = 0;
+      uint64_t remote_pages = 0;
+
+      static numa_stats read();
+   };
+
+   /**
+    * Reads `file` by `threads` threads, so that it is in the page cache before it is mapped or copied by a
+    * single thread. Pages are cached on the nodes of the reading threads, following their placement.
+    * @return bytes read
+    */
+   uint64_t prefault_file( const boost::filesystem::path& file, uint16_t threads );
+
+} } // namespace eosio::chain
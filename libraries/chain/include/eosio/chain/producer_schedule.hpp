@@ -34,6 +34,9 @@ namespace eosio { namespace chain {
       }
    };
 
+   /// shared by the block states of a schedule, never modified once shared
+   using producer_schedule_ptr = std::shared_ptr<producer_schedule_type>;
+
    struct shared_producer_schedule_type {
       shared_producer_schedule_type( chainbase::allocator<char> alloc )
       :producers(alloc){}
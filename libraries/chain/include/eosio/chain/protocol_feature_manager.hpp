@@ -24,7 +24,9 @@ enum class builtin_protocol_feature_t : uint32_t {
    only_bill_first_authorizer,
    forward_setcode,
    get_sender,
-   ram_restrictions
+   ram_restrictions,
+   rsa_verify_batch,
+   secondary_index_batch
 };
 
 struct protocol_feature_subjective_restrictions {
@@ -342,6 +344,11 @@ public:
 
    bool is_builtin_activated( builtin_protocol_feature_t feature_codename, uint32_t current_block_num )const;
 
+   /// true if `feature_codename` was activated by the pending block or a block before it
+   bool is_builtin_activated( builtin_protocol_feature_t feature_codename )const {
+      return _activated_builtin_mask & (uint64_t(1) << static_cast<uint32_t>( feature_codename ));
+   }
+
    void activate_feature( const digest_type& feature_digest, uint32_t current_block_num );
    void popped_blocks_to( uint32_t block_num );
 
@@ -365,6 +372,7 @@ protected:
    vector<protocol_feature_entry>         _activated_protocol_features;
    vector<builtin_protocol_feature_entry> _builtin_protocol_features;
    size_t                                 _head_of_builtin_activation_list = builtin_protocol_feature_entry::no_previous;
+   uint64_t                               _activated_builtin_mask = 0; ///< bit i set if builtin feature i is in the activation list
    bool                                   _initialized = false;
 };
 
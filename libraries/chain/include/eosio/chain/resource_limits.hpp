@@ -72,6 +72,8 @@ namespace eosio { namespace chain { namespace resource_limits {
          void add_transaction_usage( const flat_set<account_name>& accounts, uint64_t cpu_usage, uint64_t net_usage, uint32_t ordinal );
 
          void add_pending_ram_usage( const account_name account, int64_t ram_delta );
+         /// checks that add_pending_ram_usage( account, ram_delta ) would succeed after `pending_delta` not applied yet
+         void verify_pending_ram_usage( const account_name account, int64_t pending_delta, int64_t ram_delta )const;
          void verify_account_ram_usage( const account_name accunt )const;
 
          /// set_account_limits returns true if new ram_bytes limit is more restrictive than the previously set one
@@ -8,6 +8,9 @@
 #include <eosio/chain/authority.hpp>
 #include <eosio/chain/block_timestamp.hpp>
 #include <eosio/chain/contract_types.hpp>
+#include <eosio/chain/block.hpp>
+
+#include <map>
 
 #include "multi_index_includes.hpp"
 
@@ -43,6 +46,69 @@ namespace eosio { namespace chain {
       }
    };
 
+   /**
+    * Decoded blocks of the reversible blocks database, by number: the signed_block objects of the block states of the
+    * fork database, so that reading a recent reversible block neither unpacks it nor allocates a copy.
+    *
+    * The packed sizes of the cached blocks are bounded, the lowest numbers, about to become irreversible, go first.
+    * A block missing from the cache is read from its packed bytes.
+    */
+   class reversible_block_cache {
+      public:
+         struct entry {
+            block_id_type    id;
+            signed_block_ptr block;
+            uint64_t         packed_size = 0;
+         };
+
+         explicit reversible_block_cache( uint64_t max_bytes ) : _max_bytes( max_bytes ) {}
+
+         /// replaces the block of that number, a fork switch
+         void add( const block_id_type& id, const signed_block_ptr& b, uint64_t packed_size ) {
+            if( packed_size > _max_bytes ) return;
+            remove( block_header::num_from_id( id ) );
+            _blocks[block_header::num_from_id( id )] = { id, b, packed_size };
+            _bytes += packed_size;
+            while( _bytes > _max_bytes ) {
+               _bytes -= _blocks.begin()->second.packed_size;
+               _blocks.erase( _blocks.begin() );
+            }
+         }
+
+         const entry* find( uint32_t num )const {
+            auto itr = _blocks.find( num );
+            return itr != _blocks.end() ? &itr->second : nullptr;
+         }
+
+         void remove( uint32_t num ) {
+            auto itr = _blocks.find( num );
+            if( itr == _blocks.end() ) return;
+            _bytes -= itr->second.packed_size;
+            _blocks.erase( itr );
+         }
+
+         /// the blocks that became irreversible
+         void remove_through( uint32_t num ) {
+            while( !_blocks.empty() && _blocks.begin()->first <= num ) {
+               _bytes -= _blocks.begin()->second.packed_size;
+               _blocks.erase( _blocks.begin() );
+            }
+         }
+
+         void clear() {
+            _blocks.clear();
+            _bytes = 0;
+         }
+
+         size_t   size()const  { return _blocks.size(); }
+         uint64_t bytes()const { return _bytes; }
+
+      private:
+         uint64_t                  _max_bytes;
+         uint64_t                  _bytes = 0;
+         std::map<uint32_t, entry> _blocks;
+   };
+
    struct by_num;
    using reversible_block_index = chainbase::shared_multi_index_container<
       reversible_block_object,
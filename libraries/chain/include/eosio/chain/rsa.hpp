@@ -16,6 +16,10 @@
 #include <memory>
 #include <fc/io/sstream.hpp>
 
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
 namespace fc {
     typedef std::vector<char> bytes;
     typedef bytes             rsa_signature;
@@ -56,7 +60,47 @@ namespace fc {
                                     (const unsigned char*)sig.data(), 2048/8, rsa);
         }
     private:
-        RSA *rsa;
+        RSA *rsa = nullptr;
+    };
+
+    /**
+     * Parsed public keys by their base64, least recently used keys are dropped first.
+     * Parsing a key costs far more than a verification with it; keys that cannot be parsed are kept as well.
+     */
+    class rsa_public_key_cache {
+    public:
+        using key_ptr = std::shared_ptr<const rsa_public_key>;
+
+        explicit rsa_public_key_cache( size_t capacity ) : capacity(capacity) {}
+
+        key_ptr get( const std::string& b64 ) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto itr = keys.find(b64);
+            if( itr != keys.end() ) {
+                lru.splice(lru.begin(), lru, itr->second.second);
+                return itr->second.first;
+            }
+
+            auto key = std::make_shared<const rsa_public_key>(b64);
+            lru.push_front(b64);
+            keys.emplace(b64, std::make_pair(key, lru.begin()));
+            if( keys.size() > capacity ) {
+                keys.erase(lru.back());
+                lru.pop_back();
+            }
+            return key;
+        }
+
+        size_t size() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return keys.size();
+        }
+
+    private:
+        const size_t capacity;
+        mutable std::mutex mutex;
+        std::list<std::string> lru;
+        std::unordered_map<std::string, std::pair<key_ptr, std::list<std::string>::iterator>> keys;
     };
 } // fc
 
@@ -0,0 +1,134 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/chain/thread_utils.hpp>
+
+#include <fc/scoped_exit.hpp>
+#include <fc/time.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace eosio { namespace chain {
+
+   /// Calls of a subscriber of the controller signals, and the queue of an asynchronous one.
+   struct subscriber_stats {
+      explicit subscriber_stats( std::string n ) : name( std::move( n ) ) {}
+
+      const std::string     name;
+      std::atomic<uint64_t> calls{0};
+      std::atomic<uint64_t> run_us{0};
+      std::atomic<uint64_t> max_run_us{0};  ///< since the last take_max_run
+      std::atomic<uint64_t> backlog{0};     ///< signals queued for an asynchronous subscriber
+      std::atomic<uint64_t> full_waits{0};  ///< signals that waited for room in the queue of an asynchronous subscriber
+
+      void add_run( uint64_t us ) {
+         calls.fetch_add( 1, std::memory_order_relaxed );
+         run_us.fetch_add( us, std::memory_order_relaxed );
+         uint64_t max = max_run_us.load( std::memory_order_relaxed );
+         while( us > max && !max_run_us.compare_exchange_weak( max, us, std::memory_order_relaxed ) );
+      }
+
+      uint64_t take_max_run() { return max_run_us.exchange( 0, std::memory_order_relaxed ); }
+   };
+
+   /**
+    * Stats of the subscribers of the process, by name, for telemetry. Entries live as long as the process, so a
+    * subscriber keeps a reference to its own.
+    */
+   class signal_subscribers {
+      public:
+         static signal_subscribers& global();
+
+         /// the stats named `name`, created on the first call
+         subscriber_stats& get( const std::string& name );
+
+         /// called from any thread
+         template<typename F>
+         void for_each( F&& f ) {
+            std::lock_guard<std::mutex> g( _mtx );
+            for( auto& s : _stats ) f( s );
+         }
+
+      private:
+         std::mutex                   _mtx;
+         std::deque<subscriber_stats> _stats;
+   };
+
+   /**
+    * A thread of its own running the handlers of a subscriber, in the order the signals were emitted.
+    *
+    * The signal is only queued by the emitting thread, so a slow subscriber does not delay the processing of blocks
+    * as long as it keeps up on average. The queue is bounded: when it is full, the emitting thread waits for room
+    * instead of dropping the signal, subscribers like history ones cannot miss a block. Handlers are given a copy of
+    * the payload: only signals whose payloads are shared pointers to immutable objects (block_state_ptr,
+    * transaction_metadata_ptr) are queued, and the handlers must not touch the chain state.
+    */
+   class async_subscriber {
+      public:
+         static constexpr uint32_t default_capacity = 1024;
+
+         async_subscriber( const std::string& name, uint32_t capacity = default_capacity );
+         /// calls stop()
+         ~async_subscriber();
+
+         async_subscriber( const async_subscriber& ) = delete;
+         async_subscriber& operator=( const async_subscriber& ) = delete;
+
+         /// post and stop are called by the emitting thread
+         /// queues `f`, waiting while the queue is full; exceptions thrown by `f` are logged
+         void post( std::function<void()> f );
+
+         /// runs the queued handlers and stops the thread; later posts run on the calling thread
+         void stop();
+
+         subscriber_stats& stats() { return _stats; }
+
+      private:
+         void run( const std::function<void()>& f );
+
+         subscriber_stats&               _stats;
+         const uint32_t                  _capacity;
+         std::mutex                      _mtx;
+         std::condition_variable         _room;
+         uint32_t                        _queued = 0;
+         std::atomic<bool>               _running{true};
+         fc::optional<named_thread_pool> _thread;
+   };
+
+   /// `f` run inline, its calls accounted in the stats named `name`
+   template<typename F>
+   auto timed_slot( const std::string& name, F&& f ) {
+      return [&stats = signal_subscribers::global().get( name ), f = std::forward<F>( f )]( auto&&... args ) {
+         const auto start = fc::time_point::now();
+         auto account = fc::make_scoped_exit( [&stats, start]() {
+            stats.add_run( ( fc::time_point::now() - start ).count() );
+         } );
+         f( std::forward<decltype( args )>( args )... );
+      };
+   }
+
+   /// `f` run by `queue` if there is one, inline otherwise, for a signal whose payload is a shared pointer
+   template<typename F>
+   auto subscriber_slot( const std::string& name, const std::shared_ptr<async_subscriber>& queue, F&& f ) {
+      auto slot = timed_slot( name, std::forward<F>( f ) );
+      auto timed = std::make_shared<decltype( slot )>( std::move( slot ) );
+      return [queue, timed]( const auto& payload ) {
+         if( queue ) {
+            queue->post( [timed, payload]() { (*timed)( payload ); } );
+         } else {
+            (*timed)( payload );
+         }
+      };
+   }
+
+} } // namespace eosio::chain
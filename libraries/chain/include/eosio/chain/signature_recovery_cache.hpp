@@ -0,0 +1,55 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/chain/types.hpp>
+
+#include <array>
+#include <atomic>
+#include <memory>
+
+namespace eosio { namespace chain {
+
+   /**
+    * Keys recovered from signatures, keyed by (digest, signature), shared by every thread of the process.
+    *
+    * A transaction is recovered when received, when it is speculatively executed again after its pending block was
+    * aborted and when it is applied in a block; the same holds for the producer signatures of blocks and for randpa
+    * messages relayed by several peers. The cache is split in shards with their own lock and least recently used
+    * eviction, so that recoveries on different threads rarely contend.
+    */
+   class signature_recovery_cache {
+      public:
+         static constexpr size_t shards_count = 16;
+         static constexpr size_t default_size = 16 * 1024;
+
+         struct stats_type {
+            std::atomic<uint64_t> hits{0};
+            std::atomic<uint64_t> misses{0};
+         };
+
+         explicit signature_recovery_cache( size_t max_size = default_size );
+         ~signature_recovery_cache();
+
+         /// the cache of the process
+         static signature_recovery_cache& global();
+
+         /**
+          * Key signing `digest` with `sig`, throws if it cannot be recovered.
+          * @param cpu_usage if not null, set to the time the recovery took when it was first done
+          */
+         public_key_type recover( const signature_type& sig, const digest_type& digest, fc::microseconds* cpu_usage = nullptr );
+
+         /// hits and misses since the process started
+         const stats_type& stats()const { return _stats; }
+
+      private:
+         struct shard;
+
+         std::array<std::unique_ptr<shard>, shards_count>  shards;
+         stats_type                                         _stats;
+   };
+
+} } // namespace eosio::chain
@@ -6,8 +6,13 @@
 
 #include <eosio/chain/database_utils.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <fc/optional.hpp>
 #include <fc/variant_object.hpp>
 #include <boost/core/demangle.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <functional>
+#include <future>
 #include <ostream>
 
 namespace eosio { namespace chain {
@@ -71,9 +76,28 @@ namespace eosio { namespace chain {
          std::ostream& inner;
       };
 
+      /// appends to a memory buffer, for chunks encoded apart from the snapshot stream
+      struct buffer_wrapper {
+         explicit buffer_wrapper(std::vector<char>& b)
+         :buffer(b) {
+
+         }
+
+         void write( const char* d, size_t s ) {
+            buffer.insert(buffer.end(), d, d + s);
+         }
+
+         void put(char c) {
+            buffer.push_back(c);
+         }
+
+         std::vector<char>& buffer;
+      };
+
 
       struct abstract_snapshot_row_writer {
          virtual void write(ostream_wrapper& out) const = 0;
+         virtual void write(buffer_wrapper& out) const = 0;
          virtual void write(fc::sha256::encoder& out) const = 0;
          virtual variant to_variant() const = 0;
          virtual std::string row_type_name() const = 0;
@@ -93,6 +117,10 @@ namespace eosio { namespace chain {
             write_stream(out);
          }
 
+         void write(buffer_wrapper& out) const override {
+            write_stream(out);
+         }
+
          void write(fc::sha256::encoder& out) const override {
             write_stream(out);
          }
@@ -148,6 +176,20 @@ namespace eosio { namespace chain {
             write_section(detail::snapshot_section_traits<T>::section_name(), f);
          }
 
+         using section_part = std::function<void(section_writer&)>;
+
+         /// a section written by its parts in order
+         struct section_parts {
+            std::string                 name;
+            std::vector<section_part>   parts;
+         };
+
+         /**
+          * Writes the sections in order; writers encoding independent chunks may run the parts concurrently,
+          * so parts must only read the state.
+          */
+         virtual void write_sections( const std::vector<section_parts>& sections );
+
       virtual ~snapshot_writer(){};
 
       protected:
@@ -161,6 +203,7 @@ namespace eosio { namespace chain {
    namespace detail {
       struct abstract_snapshot_row_reader {
          virtual void provide(std::istream& in) const = 0;
+         virtual void provide(fc::datastream<const char*>& in) const = 0;
          virtual void provide(const fc::variant&) const = 0;
          virtual std::string row_type_name() const = 0;
       };
@@ -206,6 +249,12 @@ namespace eosio { namespace chain {
             });
          }
 
+         void provide(fc::datastream<const char*>& in) const override {
+            row_validation_helper::apply(data, [&in,this](){
+               fc::raw::unpack(in, data);
+            });
+         }
+
          void provide(const fc::variant& var) const override {
             row_validation_helper::apply(data, [&var,this]() {
                fc::from_variant(var, data);
@@ -283,12 +332,19 @@ namespace eosio { namespace chain {
 
       virtual void validate() const = 0;
 
+      /// the integrity hash the loaded state must have, if the snapshot records it
+      virtual fc::optional<fc::sha256> expected_integrity_hash() const { return {}; }
+
       virtual ~snapshot_reader(){};
 
       protected:
+         friend class delta_snapshot_reader;
+
          virtual bool has_section( const std::string& section_name ) = 0;
          virtual void set_section( const std::string& section_name ) = 0;
          virtual bool read_row( detail::abstract_snapshot_row_reader& row_reader ) = 0;
+         /// skips the next row of the section, `size` is its packed size
+         virtual bool skip_row( size_t size ) = 0;
          virtual bool empty( ) = 0;
          virtual void clear_section() = 0;
    };
@@ -318,6 +374,7 @@ namespace eosio { namespace chain {
          bool has_section( const string& section_name ) override;
          void set_section( const string& section_name ) override;
          bool read_row( detail::abstract_snapshot_row_reader& row_reader ) override;
+         bool skip_row( size_t size ) override;
          bool empty ( ) override;
          void clear_section() override;
 
@@ -354,6 +411,7 @@ namespace eosio { namespace chain {
          bool has_section( const string& section_name ) override;
          void set_section( const string& section_name ) override;
          bool read_row( detail::abstract_snapshot_row_reader& row_reader ) override;
+         bool skip_row( size_t size ) override;
          bool empty ( ) override;
          void clear_section() override;
 
@@ -366,6 +424,101 @@ namespace eosio { namespace chain {
          uint64_t       cur_row;
    };
 
+   namespace detail {
+      struct snapshot_chunk {
+         std::string section_name;
+         uint64_t    offset = 0;
+         uint64_t    size = 0;
+         uint64_t    row_count = 0;
+         uint32_t    crc = 0;
+      };
+   }
+
+   /**
+    * Binary snapshot of independently encoded chunks, written by several threads.
+    *
+    * Layout: magic, version, chunks of packed rows, the index of chunks and the offset of the index.
+    * A section may span several consecutive chunks; rows are packed as in ostream_snapshot_writer.
+    * At most 2 * threads chunks are kept in memory.
+    *
+    * History:
+    * Version 1: initial version
+    * Version 2: chunks may be zlib compressed, the index is followed by the uncompressed chunk sizes (0 if stored)
+    */
+   class chunked_snapshot_writer : public snapshot_writer {
+      public:
+         chunked_snapshot_writer(std::ostream& snapshot, uint32_t threads, bool compress = false);
+
+         void write_start_section( const std::string& section_name ) override;
+         void write_row( const detail::abstract_snapshot_row_writer& row_writer ) override;
+         void write_end_section( ) override;
+         void write_sections( const std::vector<section_parts>& sections ) override;
+         void finalize();
+
+         static const uint32_t magic_number = 0x30510551;
+         static const uint32_t version = 2;
+         static const uint32_t min_supported_version = 1;
+         static const size_t   max_chunk_size = 64*1024*1024; ///< rows of sequentially written sections are split at this size
+
+      private:
+         void append_chunk( const std::string& section_name, const std::vector<char>& data, uint64_t row_count, uint64_t uncompressed_size );
+         /// compresses `data` in place if compression is on, returns its uncompressed size or 0 if stored as is
+         uint64_t encode_chunk( std::vector<char>& data )const;
+
+         detail::ostream_wrapper              snapshot;
+         uint32_t                             threads;
+         bool                                 compress;
+         std::vector<detail::snapshot_chunk>  chunks;
+         std::vector<uint64_t>                uncompressed_sizes;
+
+         std::string                          section_name;
+         std::vector<char>                    section_data;
+         uint64_t                             row_count = 0;
+         bool                                 section_has_chunk = false;
+   };
+
+   /**
+    * Reads a snapshot written by chunked_snapshot_writer from a read-only mapping of the file.
+    * validate() checks the chunks on several threads.
+    * Compressed chunks are inflated one at a time, the following chunk on a separate thread while the current one is read.
+    */
+   class mapped_snapshot_reader : public snapshot_reader {
+      public:
+         explicit mapped_snapshot_reader(const fc::path& snapshot_path);
+
+         /// true if the file starts as a chunked snapshot
+         static bool is_chunked_snapshot(const fc::path& snapshot_path);
+
+         void validate() const override;
+         bool has_section( const string& section_name ) override;
+         void set_section( const string& section_name ) override;
+         bool read_row( detail::abstract_snapshot_row_reader& row_reader ) override;
+         bool skip_row( size_t size ) override;
+         bool empty ( ) override;
+         void clear_section() override;
+
+      private:
+         void open_chunk();
+         std::vector<char> inflate_chunk( size_t chunk )const;
+         void prefetch_chunk( size_t chunk );
+
+         boost::interprocess::file_mapping    file;
+         boost::interprocess::mapped_region   region;
+         uint32_t                             file_version = 0;
+         std::vector<detail::snapshot_chunk>  chunks;
+         std::vector<uint64_t>                uncompressed_sizes;
+
+         std::vector<char>                    chunk_data;     ///< the current chunk if compressed
+         size_t                               prefetched = 0; ///< chunk inflated by `prefetch`, if valid
+         std::future<std::vector<char>>       prefetch;
+
+         size_t                               cur_chunk = 0;
+         size_t                               end_chunk = 0;
+         uint64_t                             rows_left = 0;   ///< in the current section
+         uint64_t                             chunk_rows_left = 0;
+         fc::datastream<const char*>          chunk_stream{nullptr, 0};
+   };
+
    class integrity_hash_snapshot_writer : public snapshot_writer {
       public:
          explicit integrity_hash_snapshot_writer(fc::sha256::encoder&  enc);
@@ -380,4 +533,28 @@ namespace eosio { namespace chain {
 
    };
 
+   /**
+    * Integrity hash version 2: the merkle root of one hash per section part, the parts hashed on several threads.
+    * Every leaf hashes the section name and the rows of the part; sections written one at a time are a single part.
+    */
+   class tree_integrity_hash_snapshot_writer : public snapshot_writer {
+      public:
+         explicit tree_integrity_hash_snapshot_writer(uint32_t threads);
+
+         void write_start_section( const std::string& section_name ) override;
+         void write_row( const detail::abstract_snapshot_row_writer& row_writer ) override;
+         void write_end_section( ) override;
+         void write_sections( const std::vector<section_parts>& sections ) override;
+         fc::sha256 finalize()const;
+
+         static const uint32_t version = 2;
+
+      private:
+         uint32_t                  threads;
+         std::vector<fc::sha256>   leaves;
+         fc::sha256::encoder       enc;
+   };
+
 }}
+
+FC_REFLECT( eosio::chain::detail::snapshot_chunk, (section_name)(offset)(size)(row_count)(crc) )
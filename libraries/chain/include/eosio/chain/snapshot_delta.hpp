@@ -0,0 +1,155 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/chain/snapshot.hpp>
+#include <unordered_map>
+
+namespace eosio { namespace chain {
+
+   /**
+    * Hash and packed size of every row of every section of a snapshot, in order.
+    * Saved next to a snapshot, it is the base delta snapshots are computed against.
+    */
+   struct snapshot_digest {
+      struct row {
+         uint64_t hash = 0;
+         uint32_t size = 0;
+
+         friend bool operator == ( const row& a, const row& b ) { return a.hash == b.hash && a.size == b.size; }
+      };
+
+      struct section {
+         std::string       name;
+         std::vector<row>  rows;
+      };
+
+      std::vector<section> sections;
+
+      static snapshot_digest from_file( const fc::path& path );
+      void to_file( const fc::path& path )const;
+   };
+
+   namespace detail {
+      /// rebuilds a section from the rows of the base section and the rows stored in the delta
+      struct section_delta {
+         enum op_kind : uint8_t {
+            keep   = 0, ///< the next base rows
+            drop   = 1, ///< skip the next base rows
+            insert = 2  ///< the next delta rows
+         };
+
+         struct op {
+            uint8_t  kind = keep;
+            uint64_t count = 0;
+         };
+
+         std::string            name;
+         uint64_t               row_count = 0;
+         std::vector<op>        ops;
+         std::vector<uint32_t>  dropped_sizes; ///< packed sizes of the dropped base rows, in order
+         std::vector<char>      rows;
+
+         void add_op( op_kind kind, uint64_t count );
+      };
+
+      snapshot_digest::row digest_row( const std::vector<char>& packed_row );
+   }
+
+   /// writes the digest of the state, see snapshot_digest
+   class digest_snapshot_writer : public snapshot_writer {
+      public:
+         void write_start_section( const std::string& section_name ) override;
+         void write_row( const detail::abstract_snapshot_row_writer& row_writer ) override;
+         void write_end_section( ) override;
+
+         const snapshot_digest& digest()const { return result; }
+
+      private:
+         snapshot_digest    result;
+         std::vector<char>  row;
+   };
+
+   /**
+    * Writes the rows added, modified and removed since the base snapshot described by `base`, as an edit script of
+    * every section: runs of base rows kept or dropped and rows stored in the delta.
+    *
+    * Rows carry no keys, sections are matched in order: a row equal to the next base row keeps it, a row found further
+    * in the base section drops the base rows in between, other rows are stored.
+    * The delta records the integrity hash of the state, which the loaded state is checked against.
+    */
+   class delta_snapshot_writer : public snapshot_writer {
+      public:
+         delta_snapshot_writer(std::ostream& delta, const snapshot_digest& base);
+
+         void write_start_section( const std::string& section_name ) override;
+         void write_row( const detail::abstract_snapshot_row_writer& row_writer ) override;
+         void write_end_section( ) override;
+         void finalize();
+
+         /// digest of the written state, the base of the next delta
+         const snapshot_digest& digest()const { return result; }
+
+         static const uint32_t magic_number = 0x30510552;
+         static const uint32_t version = 1;
+         static const uint32_t min_resync_row_size = 8; ///< shorter rows (sizes, flags) repeat too often to be matched ahead
+
+      private:
+         detail::ostream_wrapper                                 delta;
+         const snapshot_digest&                                  base;
+         snapshot_digest                                         result;
+         fc::sha256::encoder                                     enc;
+         std::vector<detail::section_delta>                      sections;
+
+         const snapshot_digest::section*                         base_section = nullptr;
+         std::unordered_map<uint64_t, std::vector<uint32_t>>     base_positions;
+         size_t                                                  base_pos = 0;
+         std::vector<char>                                       row;
+   };
+
+   /**
+    * Reads the state of `base` with a delta written by delta_snapshot_writer applied.
+    * The base may be a delta_snapshot_reader itself, to apply a chain of deltas.
+    */
+   class delta_snapshot_reader : public snapshot_reader {
+      public:
+         delta_snapshot_reader(snapshot_reader_ptr base, const fc::path& delta_path);
+
+         /// true if the file starts as a delta snapshot
+         static bool is_delta_snapshot(const fc::path& delta_path);
+
+         void validate() const override;
+         fc::optional<fc::sha256> expected_integrity_hash() const override { return integrity_hash; }
+         bool has_section( const string& section_name ) override;
+         void set_section( const string& section_name ) override;
+         bool read_row( detail::abstract_snapshot_row_reader& row_reader ) override;
+         bool skip_row( size_t size ) override;
+         bool empty ( ) override;
+         void clear_section() override;
+
+      private:
+         template<typename KeepF, typename InsertF>
+         bool next_row( KeepF&& keep, InsertF&& insert );
+
+         snapshot_reader_ptr                   base;
+         fc::sha256                            integrity_hash;
+         std::vector<detail::section_delta>    sections;
+
+         const detail::section_delta*          cur_section = nullptr;
+         bool                                  base_open = false;
+         size_t                                cur_op = 0;
+         uint64_t                              op_left = 0;
+         size_t                                cur_drop = 0;
+         uint64_t                              rows_left = 0;
+         fc::datastream<const char*>           rows{nullptr, 0};
+   };
+
+}}
+
+FC_REFLECT( eosio::chain::snapshot_digest::row, (hash)(size) )
+FC_REFLECT( eosio::chain::snapshot_digest::section, (name)(rows) )
+FC_REFLECT( eosio::chain::snapshot_digest, (sections) )
+FC_REFLECT( eosio::chain::detail::section_delta::op, (kind)(count) )
+FC_REFLECT( eosio::chain::detail::section_delta, (name)(row_count)(ops)(dropped_sizes)(rows) )
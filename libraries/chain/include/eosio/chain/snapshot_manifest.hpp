@@ -0,0 +1,44 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/chain/types.hpp>
+
+namespace eosio { namespace chain {
+
+   /**
+    * Hashes of the fixed size chunks of a snapshot file, with their merkle root.
+    *
+    * A snapshot is fetched from the peers that agree on a manifest, a chunk at a time from any of them: each chunk
+    * is checked against its hash as it arrives, and the hashes against the root, so a peer sending bad data is
+    * detected at the first chunk it sends rather than when the whole file is loaded.
+    */
+   struct snapshot_manifest {
+      static constexpr uint32_t default_chunk_size = 1024 * 1024;
+      static constexpr uint32_t max_chunk_size = 4 * 1024 * 1024;
+
+      block_id_type        block_id;   ///< head block of the snapshot
+      uint64_t             size = 0;   ///< of the file, 0 if there is no snapshot
+      uint32_t             chunk_size = default_chunk_size;
+      vector<digest_type>  chunk_hashes;
+      digest_type          root;       ///< merkle() of chunk_hashes
+
+      uint32_t block_num()const;
+      uint32_t chunk_count()const;
+      uint32_t chunk_length( uint32_t index )const;
+      uint64_t chunk_offset( uint32_t index )const { return uint64_t(index) * chunk_size; }
+
+      /// the chunk size is bounded, there is a hash per chunk and they match the root
+      bool valid()const;
+      bool verify_chunk( uint32_t index, const char* data, size_t length )const;
+
+      /// reads the snapshot file at `path` whose head block is `block_id`
+      static snapshot_manifest compute( const fc::path& path, const block_id_type& block_id,
+                                        uint32_t chunk_size = default_chunk_size );
+   };
+
+} } // namespace eosio::chain
+
+FC_REFLECT( eosio::chain::snapshot_manifest, (block_id)(size)(chunk_size)(chunk_hashes)(root) )
@@ -0,0 +1,95 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <fc/time.hpp>
+
+#include <boost/filesystem/path.hpp>
+
+#include <atomic>
+#include <memory>
+
+namespace eosio { namespace chain {
+
+   /**
+    * Read windows of the chain state shared with other processes of the host, through a small file next to
+    * the chainbase file.
+    *
+    * chainbase keeps a single version of the state in its mapping, so readers attached to the mapping of another
+    * process may only read while that process writes nothing. The writer opens a window between its own writes,
+    * readers announce themselves while it is open and the writer does not write again before they are done or
+    * the window is overdue. The sequence is odd while a window is open: a reader seeing the same odd value before
+    * and after announcing itself is counted by the writer.
+    */
+   class state_window {
+      public:
+         struct header_type {
+            uint64_t              magic = 0;
+            std::atomic<uint64_t> sequence{0};       ///< odd while a window is open
+            std::atomic<int64_t>  window_end{0};     ///< microseconds since epoch, end of the open window
+            std::atomic<uint32_t> readers{0};        ///< reads running in the open window
+            std::atomic<uint32_t> waiting{0};        ///< readers waiting for a window
+            std::atomic<uint32_t> head_block_num{0}; ///< of the state in the open window
+         };
+
+         static constexpr uint64_t magic = 0x5754534f45ull; ///< "EOSTW"
+
+         /// maps `file`, created by the writer and attached by readers
+         state_window( const boost::filesystem::path& file, bool writer );
+         ~state_window();
+
+         state_window( const state_window& ) = delete;
+         state_window& operator=( const state_window& ) = delete;
+
+         /// @name writer
+         ///@{
+         void open_window( fc::time_point deadline, uint32_t head_block_num );
+         /**
+          * Closes the window once the waiting readers entered it or it ended, then waits for its readers until
+          * `overdue`; returns the readers still running then.
+          */
+         uint32_t close_window( fc::time_point overdue );
+         uint32_t waiting_readers()const;
+         ///@}
+
+         /// @name reader
+         ///@{
+         /**
+          * Runs `read` in the next window of the writer, returns false if none opened before `timeout`.
+          * `read` must return before the window ends: the writer writes again once the window is overdue.
+          */
+         template<typename F>
+         bool read( F&& read, fc::microseconds timeout ) {
+            const auto give_up = fc::time_point::now() + timeout;
+            header->waiting.fetch_add( 1 );
+            bool entered = false;
+            while( !(entered = try_enter()) && fc::time_point::now() < give_up )
+               wait_for_window();
+            header->waiting.fetch_sub( 1 );
+            if( !entered ) return false;
+            struct leave_window {
+               header_type* h;
+               ~leave_window() { h->readers.fetch_sub( 1 ); }
+            } leave{ header };
+            read();
+            return true;
+         }
+
+         /// head block of the last window, as seen by a reader
+         uint32_t head_block_num()const { return header->head_block_num.load(); }
+         ///@}
+
+      private:
+         /// counts this reader in the open window, if any and not over
+         bool try_enter();
+         void wait_for_window();
+
+         struct mapping;
+         std::unique_ptr<mapping> _mapping;
+         header_type*             header = nullptr;
+         const bool               writer;
+   };
+
+} } // namespace eosio::chain
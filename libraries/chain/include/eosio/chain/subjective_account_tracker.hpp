@@ -0,0 +1,102 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/chain/config.hpp>
+#include <eosio/chain/types.hpp>
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace eosio { namespace chain {
+
+   /**
+    * CPU spent by a node on the recently failed transactions of each account, with the greylist membership of the accounts.
+    *
+    * The node decides by itself, before executing a transaction, whether its first authorizer failed too many
+    * transactions lately: a single hash lookup, without reading the resource limits of chainbase. The failed CPU of
+    * an account decays linearly to zero over the decay window, as the usage accumulators of resource_limits do, so
+    * an account is accepted again once it stops failing. Greylisted accounts, whose elastic limits are reduced to
+    * `greylist_limit` of the elastic multiplier, are allowed the same share of the failed CPU.
+    */
+   class subjective_account_tracker {
+      public:
+         struct entry {
+            uint64_t       failed_cpu_us = 0; ///< as of last_update
+            fc::time_point last_update;
+            bool           greylisted = false;
+         };
+
+         /// 0 disables the check, failures are still accounted
+         void set_max_failed_cpu_us( uint64_t max ) { _max_failed_cpu_us = max; }
+         uint64_t get_max_failed_cpu_us()const { return _max_failed_cpu_us; }
+
+         void set_decay_window( fc::microseconds window ) { _window_us = std::max<int64_t>( window.count(), 1 ); }
+
+         /// the greylist limit of the controller, between 1 and config::maximum_elastic_resource_multiplier
+         void set_greylist_limit( uint32_t limit ) { _greylist_limit = std::max<uint32_t>( limit, 1 ); }
+
+         void set_greylisted( account_name account, bool greylisted ) {
+            if( greylisted ) {
+               _accounts[account.value].greylisted = true;
+            } else {
+               auto itr = _accounts.find( account.value );
+               if( itr != _accounts.end() ) itr->second.greylisted = false;
+            }
+         }
+
+         bool is_greylisted( account_name account )const {
+            auto itr = _accounts.find( account.value );
+            return itr != _accounts.end() && itr->second.greylisted;
+         }
+
+         void on_failed( account_name account, uint64_t cpu_us, const fc::time_point& now ) {
+            auto& e = _accounts[account.value];
+            e.failed_cpu_us = decayed( e, now ) + cpu_us;
+            e.last_update = now;
+         }
+
+         uint64_t failed_cpu_us( account_name account, const fc::time_point& now )const {
+            auto itr = _accounts.find( account.value );
+            return itr == _accounts.end() ? 0 : decayed( itr->second, now );
+         }
+
+         /// false when the transactions of `account` are to be rejected without being executed
+         bool may_execute( account_name account, const fc::time_point& now )const {
+            if( _max_failed_cpu_us == 0 ) return true;
+            auto itr = _accounts.find( account.value );
+            if( itr == _accounts.end() ) return true;
+            const auto& e = itr->second;
+            const uint64_t max = e.greylisted ? _max_failed_cpu_us * _greylist_limit / config::maximum_elastic_resource_multiplier
+                                              : _max_failed_cpu_us;
+            return decayed( e, now ) < std::max<uint64_t>( max, 1 );
+         }
+
+         /// removes the accounts whose failures are decayed and which are not greylisted
+         void prune( const fc::time_point& now ) {
+            for( auto itr = _accounts.begin(); itr != _accounts.end(); ) {
+               if( !itr->second.greylisted && decayed( itr->second, now ) == 0 ) itr = _accounts.erase( itr );
+               else ++itr;
+            }
+         }
+
+         size_t size()const { return _accounts.size(); }
+
+      private:
+         uint64_t decayed( const entry& e, const fc::time_point& now )const {
+            const int64_t elapsed = ( now - e.last_update ).count();
+            if( elapsed <= 0 ) return e.failed_cpu_us;
+            if( elapsed >= _window_us ) return 0;
+            return static_cast<uint64_t>( e.failed_cpu_us * ( double( _window_us - elapsed ) / _window_us ) );
+         }
+
+         std::unordered_map<uint64_t, entry> _accounts; ///< by account name value
+         uint64_t                            _max_failed_cpu_us = 0;
+         int64_t                             _window_us = fc::minutes( 1 ).count();
+         uint32_t                            _greylist_limit = config::maximum_elastic_resource_multiplier;
+   };
+
+} } // namespace eosio::chain
@@ -86,8 +86,16 @@ namespace eosio {
             uint64_t value() const { return m_value; }
             bool valid() const
             {
-               const auto& s = name();
-               return decimals() <= max_precision && valid_name(s);
+               return decimals() <= max_precision && valid_code(m_value >> 8);
+            }
+            /// upper case letters from the lowest byte, then zero bytes: what valid_name(name()) checks without the string
+            static constexpr bool valid_code(uint64_t code)
+            {
+               for( ; code & 0xFF; code >>= 8 ) {
+                  const char c = code & 0xFF;
+                  if( c < 'A' || c > 'Z' ) return false;
+               }
+               return code == 0;
             }
             static bool valid_name(const string& name)
             {
@@ -107,15 +115,11 @@ namespace eosio {
             }
             string name() const
             {
-               uint64_t v = m_value;
-               v >>= 8;
-               string result;
-               while (v > 0) {
-                  char c = v & 0xFF;
-                  result += c;
-                  v >>= 8;
-               }
-               return result;
+               char buf[7];
+               size_t len = 0;
+               for( uint64_t v = m_value >> 8; v > 0; v >>= 8 )
+                  buf[len++] = v & 0xFF;
+               return string(buf, len);
             }
 
             symbol_code to_symbol_code()const { return {m_value >> 8}; }
@@ -139,7 +143,7 @@ namespace eosio {
 
             void reflector_init()const {
                EOS_ASSERT( decimals() <= max_precision, symbol_type_exception, "precision ${p} should be <= 18", ("p", decimals()) );
-               EOS_ASSERT( valid_name(name()), symbol_type_exception, "invalid symbol: ${name}", ("name",name()));
+               EOS_ASSERT( valid_code(m_value >> 8), symbol_type_exception, "invalid symbol: ${name}", ("name",name()));
             }
 
          private:
@@ -0,0 +1,61 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/chain/contract_table_objects.hpp>
+
+namespace eosio { namespace chain {
+
+   /// hints the cpu to load `row` before it is read
+   template<typename Object>
+   inline void prefetch_row( const Object& row ) {
+      __builtin_prefetch( &row );
+   }
+
+   /// the value of a key_value row is a separate allocation of the shared memory, read after the row
+   inline void prefetch_row( const key_value_object& row ) {
+      __builtin_prefetch( &row );
+      if( row.value.size() )
+         __builtin_prefetch( row.value.data() );
+   }
+
+   /**
+    * Prefetches the rows of an ordered index scan a few rows ahead of it.
+    *
+    * The contract table indexes are red-black trees of the shared memory, a scan takes cache misses on the row
+    * nodes and on the values of key_value rows. A lead iterator walks `distance` rows ahead of the scan and
+    * prefetches them, so that the misses of the following rows overlap with the processing of the current one.
+    * The scan itself is unchanged: rows are visited in the order of the index.
+    */
+   template<typename Iterator>
+   class scan_prefetcher {
+      public:
+         static constexpr uint32_t default_distance = 4;
+
+         /// `itr` is the first row of the scan
+         scan_prefetcher( Iterator itr, Iterator end, uint32_t distance = default_distance )
+         :lead( itr ), end( end ) {
+            for( uint32_t i = 0; i < distance && lead != end; ++i, ++lead )
+               prefetch_row( *lead );
+         }
+
+         /// to call once per row the scan moves past
+         void advance() {
+            if( lead == end ) return;
+            prefetch_row( *lead );
+            ++lead;
+         }
+
+      private:
+         Iterator lead;
+         Iterator end;
+   };
+
+   template<typename Iterator>
+   scan_prefetcher<Iterator> make_scan_prefetcher( Iterator itr, Iterator end, uint32_t distance = scan_prefetcher<Iterator>::default_distance ) {
+      return scan_prefetcher<Iterator>( itr, end, distance );
+   }
+
+} } // namespace eosio::chain
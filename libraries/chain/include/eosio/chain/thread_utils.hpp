@@ -8,8 +8,17 @@
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/thread_pool.hpp>
 #include <boost/asio/post.hpp>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <future>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace eosio { namespace chain {
 
@@ -40,6 +49,168 @@ namespace eosio { namespace chain {
    };
 
 
+   /// classes of the tasks of task_scheduler, a worker always takes a task of the first class which has one
+   enum class task_priority : uint8_t {
+      consensus,
+      block_apply,
+      net,
+      api,
+      history
+   };
+   constexpr size_t task_priority_count = 5;
+
+   const char* to_string( task_priority p );
+
+   struct task_class_stats {
+      task_priority priority = task_priority::consensus;
+      uint64_t      submitted = 0;
+      uint64_t      executed = 0;
+      uint64_t      stolen = 0;   ///< executed by another worker than the one it was queued on
+      uint64_t      queued = 0;
+      uint64_t      wait_us = 0;  ///< from submission to start, of the executed tasks
+      uint64_t      busy_us = 0;
+   };
+
+   /**
+    * Worker threads shared by the subsystems which run CPU work off the main thread, instead of a pool each.
+    *
+    * Every worker has a queue per task_priority. A task submitted from a worker goes to its queue, one submitted from
+    * another thread to the workers in turn. A free worker takes the first task of the highest class queued on any
+    * worker, its own queue first, so that block validation is not left behind API or history reads whichever worker
+    * they were queued on. Tasks of a class start in the order they were queued on a worker, but tasks queued on
+    * different workers may start in any order: a task must not wait for another one still queued.
+    *
+    * Subsystems bring their threads with add_workers(); pools whose threads own sockets or must run their work in
+    * order keep a named_thread_pool.
+    */
+   class task_scheduler {
+   public:
+      // threads are named name_prefix-##, as those of named_thread_pool
+      task_scheduler( std::string name_prefix, size_t num_threads );
+
+      // calls stop()
+      ~task_scheduler();
+
+      task_scheduler( const task_scheduler& ) = delete;
+      task_scheduler& operator=( const task_scheduler& ) = delete;
+
+      void add_workers( const std::string& name_prefix, size_t num_threads );
+
+      size_t workers()const { return _worker_count.load( std::memory_order_acquire ); }
+
+      void post( task_priority priority, std::function<void()> task );
+
+      /// counters since construction, by class
+      std::vector<task_class_stats> stats()const;
+
+      // drop queued tasks and join workers
+      void stop();
+
+      static constexpr size_t max_workers = 128;
+
+   private:
+      struct queued_task {
+         std::function<void()>  task;
+         int64_t                queued_us = 0;
+      };
+
+      struct worker {
+         std::mutex                                               mtx;
+         std::array<std::deque<queued_task>, task_priority_count> queues;
+      };
+
+      struct class_counters {
+         std::atomic<uint64_t>  submitted{0};
+         std::atomic<uint64_t>  executed{0};
+         std::atomic<uint64_t>  stolen{0};
+         std::atomic<uint64_t>  wait_us{0};
+         std::atomic<uint64_t>  busy_us{0};
+      };
+
+      void run( size_t index );
+      bool take( size_t index, queued_task& t, task_priority& priority );
+
+      std::unique_ptr<worker[]>                                _workers;
+      std::atomic<size_t>                                      _worker_count{0};
+      std::atomic<size_t>                                      _next_worker{0};
+      std::array<class_counters, task_priority_count>          _counters;
+
+      std::mutex                                               _mtx;      ///< guards the fields below
+      std::condition_variable                                  _cv;
+      int64_t                                                  _pending = 0; ///< tasks queued and not taken, below 0 while a task taken is not counted yet
+      bool                                                     _stopping = false;
+      std::vector<std::thread>                                 _threads;
+   };
+
+   /**
+    * Submits the tasks of a subsystem to a task_scheduler with the class of the subsystem.
+    * Copies share cancel(): once called, their queued tasks are dropped when taken.
+    */
+   class task_executor {
+   public:
+      task_executor( task_scheduler& scheduler, task_priority priority );
+
+      template<typename F>
+      void post( F&& f )const {
+         _scheduler->post( _priority, [state = _state, f = std::forward<F>( f )]() mutable {
+            if( !state->enter() ) return;
+            try {
+               f();
+            } catch( ... ) {
+               state->leave();
+               throw;
+            }
+            state->leave();
+         } );
+      }
+
+      task_scheduler& scheduler()const { return *_scheduler; }
+      task_priority priority()const { return _priority; }
+
+      // drop tasks not started yet and wait for the running ones
+      void cancel();
+
+   private:
+      struct state {
+         std::mutex               mtx;
+         std::condition_variable  cv;
+         size_t                   running = 0;
+         bool                     cancelled = false;
+
+         bool enter();
+         void leave();
+      };
+
+      task_scheduler*         _scheduler;
+      task_priority           _priority;
+      std::shared_ptr<state>  _state;
+   };
+
+
+   struct thread_cpu_time {
+      std::string name;
+      uint64_t    cpu_us = 0;
+   };
+
+   /**
+    * Makes the CPU time of the current thread visible in thread_cpu_times() under `name` while it lives.
+    * Threads of named_thread_pool are registered; other threads, like the main one, add themselves.
+    */
+   class thread_cpu_registration {
+   public:
+      explicit thread_cpu_registration( std::string name );
+      ~thread_cpu_registration();
+
+      thread_cpu_registration( const thread_cpu_registration& ) = delete;
+      thread_cpu_registration& operator=( const thread_cpu_registration& ) = delete;
+
+   private:
+      uint64_t _id = 0;
+   };
+
+   /// CPU time of the registered threads, empty where the CPU clocks of other threads cannot be read
+   std::vector<thread_cpu_time> thread_cpu_times();
+
    // async on thread_pool and return future
    template<typename F>
    auto async_thread_pool( boost::asio::io_context& thread_pool, F&& f ) {
@@ -48,6 +219,14 @@ namespace eosio { namespace chain {
       return task->get_future();
    }
 
+   // async on the scheduler of executor and return future, broken if the task is dropped
+   template<typename F>
+   auto async_thread_pool( const task_executor& executor, F&& f ) {
+      auto task = std::make_shared<std::packaged_task<decltype( f() )()>>( std::forward<F>( f ) );
+      executor.post( [task]() { (*task)(); } );
+      return task->get_future();
+   }
+
 } } // eosio::chain
 
 
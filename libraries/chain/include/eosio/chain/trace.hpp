@@ -68,6 +68,12 @@ namespace eosio { namespace chain {
       std::exception_ptr                         except_ptr;
    };
 
+   /**
+    * A default transaction_trace recycled from the traces released before, which keep their action_traces capacity.
+    * The last owner releases it to the pool on whichever thread it runs.
+    */
+   transaction_trace_ptr make_transaction_trace();
+
 } }  /// namespace eosio::chain
 
 FC_REFLECT( eosio::chain::account_delta,
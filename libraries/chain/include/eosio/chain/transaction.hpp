@@ -194,8 +194,9 @@ namespace eosio { namespace chain {
 
       digest_type packed_digest()const;
 
-      transaction_id_type id()const { return unpacked_trx.id(); }
-      bytes               get_raw_transaction()const;
+      transaction_id_type id()const { return trx_id; }
+      /// packed_trx decompressed
+      const bytes&        get_raw_transaction()const;
 
       time_point_sec                expiration()const { return unpacked_trx.expiration; }
       const vector<bytes>&          get_context_free_data()const { return unpacked_trx.context_free_data; }
@@ -225,6 +226,9 @@ namespace eosio { namespace chain {
    private:
       // cache unpacked trx, for thread safety do not modify after construction
       signed_transaction                      unpacked_trx;
+      // computed once with unpacked_trx, ids are asked for by every stage the transaction goes through
+      transaction_id_type                     trx_id;
+      bytes                                   raw_trx; ///< packed_trx decompressed, empty if it is not compressed
    };
 
    using packed_transaction_ptr = std::shared_ptr<packed_transaction>;
@@ -0,0 +1,94 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace eosio { namespace chain {
+
+   /**
+    * Bump allocator for memory that lives no longer than a transaction.
+    * Memory is never freed piecemeal: all of it is released at once by the destructor,
+    * so allocations cost a pointer increment and malloc is called once per block.
+    * Not thread safe, a transaction is executed by one thread.
+    */
+   class transaction_arena {
+      public:
+         explicit transaction_arena( size_t block_size ) : block_size(block_size) {}
+
+         transaction_arena( const transaction_arena& ) = delete;
+         transaction_arena& operator=( const transaction_arena& ) = delete;
+
+         void* allocate( size_t bytes, size_t alignment ) {
+            ++_allocations;
+            auto p = reinterpret_cast<uintptr_t>(cur);
+            auto aligned = (p + alignment - 1) & ~(uintptr_t(alignment) - 1);
+            if( cur == nullptr || aligned + bytes > reinterpret_cast<uintptr_t>(end) ) {
+               add_block( bytes + alignment );
+               p = reinterpret_cast<uintptr_t>(cur);
+               aligned = (p + alignment - 1) & ~(uintptr_t(alignment) - 1);
+            }
+            cur = reinterpret_cast<char*>(aligned + bytes);
+            return reinterpret_cast<void*>(aligned);
+         }
+
+         /// number of allocate() calls since construction
+         uint64_t allocations()const { return _allocations; }
+
+      private:
+         struct block {
+            std::unique_ptr<char[]> data;
+            size_t                  size = 0;
+         };
+
+         void add_block( size_t min_size ) {
+            // blocks grow geometrically so large transactions need few of them
+            size_t size = blocks.empty() ? block_size : blocks.back().size * 2;
+            if( size < min_size ) size = min_size;
+            blocks.push_back( block{ std::unique_ptr<char[]>( new char[size] ), size } );
+            cur = blocks.back().data.get();
+            end = cur + size;
+         }
+
+         const size_t        block_size;
+         std::vector<block>  blocks;
+         char*               cur = nullptr;
+         char*               end = nullptr;
+         uint64_t            _allocations = 0;
+   };
+
+   /// STL allocator of a transaction_arena, deallocate does nothing
+   template<typename T>
+   class arena_allocator {
+      public:
+         using value_type = T;
+
+         explicit arena_allocator( transaction_arena& a ) : arena(&a) {}
+
+         template<typename U>
+         arena_allocator( const arena_allocator<U>& other ) : arena(other.arena) {}
+
+         T* allocate( size_t n ) {
+            return static_cast<T*>( arena->allocate( n * sizeof(T), alignof(T) ) );
+         }
+
+         void deallocate( T*, size_t ) {}
+
+         template<typename U>
+         bool operator == ( const arena_allocator<U>& other )const { return arena == other.arena; }
+         template<typename U>
+         bool operator != ( const arena_allocator<U>& other )const { return arena != other.arena; }
+
+      private:
+         template<typename U> friend class arena_allocator;
+
+         transaction_arena* arena;
+   };
+
+} } // namespace eosio::chain
@@ -1,10 +1,18 @@
 #pragma once
 #include <eosio/chain/controller.hpp>
 #include <eosio/chain/trace.hpp>
+#include <eosio/chain/transaction_arena.hpp>
 #include <signal.h>
 
 namespace eosio { namespace chain {
 
+   /**
+    * Watchdog of the deadline of the transaction executed by the calling thread.
+    *
+    * Each thread executing transactions arms a timer of its own, which raises SIGALRM on that thread only and sets
+    * its `expired` flag: checktime reads the clock only once the flag is set. Where per-thread timers are not
+    * available, or too inaccurate, `expired` is always set and checktime polls the clock.
+    */
    struct deadline_timer {
          deadline_timer();
          ~deadline_timer();
@@ -12,9 +20,9 @@ namespace eosio { namespace chain {
          void start(fc::time_point tp);
          void stop();
 
-         static volatile sig_atomic_t expired;
+         static thread_local volatile sig_atomic_t expired;
       private:
-         static void timer_expired(int);
+         static void timer_expired(int, siginfo_t* info, void*);
          static bool initialized;
    };
 
@@ -37,6 +45,10 @@ namespace eosio { namespace chain {
 
          void init_for_deferred_trx( fc::time_point published );
 
+         /// not billed and limited by `deadline` only; the contracts cannot write tables nor send actions, and the
+         /// caller undoes the session
+         void init_for_read_only_trx();
+
          void exec();
          void finalize();
          void squash();
@@ -71,6 +83,8 @@ namespace eosio { namespace chain {
 
          void add_ram_usage( account_name account, int64_t ram_delta );
 
+         void record_action_counters( uint32_t action_ordinal, uint32_t db_calls, uint64_t arena_allocations );
+
          action_trace& get_action_trace( uint32_t action_ordinal );
          const action_trace& get_action_trace( uint32_t action_ordinal )const;
 
@@ -96,12 +110,16 @@ namespace eosio { namespace chain {
 
          void disallow_transaction_extensions( const char* error_msg )const;
 
+         /// unless the controller skips sessions or one is started already; `force` ignores skip_db_sessions
+         void start_undo_session( bool force = false );
+
       /// Fields:
       public:
 
          controller&                   control;
          const signed_transaction&     trx;
          transaction_id_type           id;
+         /// started by init() before the first write, a transaction rejected before it has nothing to undo
          optional<chainbase::database::session>  undo_session;
          transaction_trace_ptr         trace;
          fc::time_point                start;
@@ -112,6 +130,8 @@ namespace eosio { namespace chain {
          vector<action_receipt>        executed;
          flat_set<account_name>        bill_to_accounts;
          flat_set<account_name>        validate_ram_usage;
+         /// RAM usage changes applied to resource_usage_object at finalize(), one modification per account
+         flat_map<account_name, int64_t> pending_ram_usage;
 
          /// the maximum number of virtual CPU instructions of the transaction that can be safely billed to the billable accounts
          uint64_t                      initial_max_billable_cpu = 0;
@@ -120,14 +140,19 @@ namespace eosio { namespace chain {
          bool                          is_input           = false;
          bool                          apply_context_free = true;
          bool                          enforce_whiteblacklist = true;
+         bool                          read_only          = false;
 
          fc::time_point                deadline = fc::time_point::maximum();
          fc::microseconds              leeway = fc::microseconds( config::default_subjective_cpu_leeway_us );
          int64_t                       billed_cpu_time_us = 0;
          bool                          explicit_billed_cpu_time = false;
 
+         /// memory of the action caches, released when the transaction is done
+         transaction_arena             arena{ config::transaction_arena_block_size };
+
       private:
          bool                          is_initialized = false;
+         optional<fc::time_point_sec>  recorded_expiration; ///< of an input transaction, recorded in the pending block by squash
 
 
          uint64_t                      net_limit = 0;
@@ -147,6 +172,9 @@ namespace eosio { namespace chain {
          fc::microseconds              billed_time;
          fc::microseconds              billing_timer_duration_limit;
 
+         vector<uint32_t>              action_db_intrinsic_calls; ///< indexed by action_ordinal - 1
+         vector<uint64_t>              action_arena_allocations;  ///< indexed by action_ordinal - 1
+
          deadline_timer                _deadline_timer;
    };
 
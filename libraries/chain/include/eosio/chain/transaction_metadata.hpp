@@ -5,7 +5,8 @@
 #pragma once
 #include <eosio/chain/transaction.hpp>
 #include <eosio/chain/types.hpp>
-#include <boost/asio/io_context.hpp>
+#include <eosio/chain/thread_utils.hpp>
+#include <functional>
 #include <future>
 
 namespace boost { namespace asio {
@@ -55,9 +56,16 @@ class transaction_metadata {
 
       // must be called from main application thread
       static signing_keys_future_type
-      start_recover_keys( const transaction_metadata_ptr& mtrx, boost::asio::io_context& thread_pool,
+      start_recover_keys( const transaction_metadata_ptr& mtrx, const task_executor& thread_pool,
                           const chain_id_type& chain_id, fc::microseconds time_limit );
 
+      // must be called from main application thread, recovers the keys of up to batch_size trxs per thread pool task
+      // instead of one task per trx; done is called from a thread pool thread once every signing_keys_future is ready
+      static void
+      start_recover_keys( const std::vector<transaction_metadata_ptr>& mtrxs, const task_executor& thread_pool,
+                          const chain_id_type& chain_id, fc::microseconds time_limit, size_t batch_size,
+                          std::function<void()> done );
+
       // start_recover_keys must be called first
       recovery_keys_type recover_keys( const chain_id_type& chain_id );
 };
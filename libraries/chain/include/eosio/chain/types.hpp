@@ -173,7 +173,7 @@ namespace eosio { namespace chain {
       UNUSED_chain_property_object_type,
       account_control_history_object_type,     ///< Defined by history_plugin
       UNUSED_account_transaction_history_object_type,
-      UNUSED_transaction_history_object_type,
+      transaction_location_object_type,        ///< Defined by history_plugin
       public_key_history_object_type,          ///< Defined by history_plugin
       UNUSED_balance_object_type,
       UNUSED_staked_balance_object_type,
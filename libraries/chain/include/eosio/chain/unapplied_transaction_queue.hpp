@@ -0,0 +1,70 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/chain/transaction_metadata.hpp>
+#include <fc/filesystem.hpp>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+
+namespace eosio { namespace chain {
+
+   struct unapplied_transaction {
+      transaction_id_type        signed_id;
+      fc::time_point             expiry;
+      transaction_metadata_ptr   trx_meta;
+   };
+
+   /**
+    * Transactions of aborted blocks and of blocks popped by a fork switch, to be applied again.
+    * Indexed by signed id and by expiration, so expired transactions are dropped without visiting the others.
+    * The metadata, and so the keys recovered for it, is kept: applying a transaction again does not recover its keys.
+    */
+   class unapplied_transaction_queue {
+      public:
+         struct by_signed_id;
+         struct by_expiry;
+
+         using index_type = boost::multi_index_container< unapplied_transaction,
+            boost::multi_index::indexed_by<
+               boost::multi_index::ordered_unique< boost::multi_index::tag<by_signed_id>,
+                  BOOST_MULTI_INDEX_MEMBER( unapplied_transaction, transaction_id_type, signed_id ), sha256_less >,
+               boost::multi_index::ordered_non_unique< boost::multi_index::tag<by_expiry>,
+                  BOOST_MULTI_INDEX_MEMBER( unapplied_transaction, fc::time_point, expiry ) >
+            >
+         >;
+         using iterator = index_type::index<by_signed_id>::type::iterator;
+
+         bool empty()const { return queue.empty(); }
+         size_t size()const { return queue.size(); }
+         void clear() { queue.clear(); }
+
+         /// in signed id order
+         iterator begin() { return queue.get<by_signed_id>().begin(); }
+         iterator end() { return queue.get<by_signed_id>().end(); }
+
+         /// replaces a queued transaction of the same signed id
+         void add( const transaction_metadata_ptr& trx );
+         void erase( const transaction_id_type& signed_id ) { queue.get<by_signed_id>().erase( signed_id ); }
+         iterator erase( iterator itr ) { return queue.get<by_signed_id>().erase( itr ); }
+
+         /// erases the transactions expiring before `pending_block_time`, returns their number
+         size_t clear_expired( const fc::time_point& pending_block_time );
+
+         /// writes the packed transactions to `path`, metadata is not written
+         void write_to( const fc::path& path )const;
+         /// transactions written by write_to for the caller to add, their keys are not recovered
+         static std::vector<transaction_metadata_ptr> read_from( const fc::path& path );
+
+         static const uint32_t magic_number = 0x30510554;
+         static const uint32_t version = 1;
+
+      private:
+         index_type queue;
+   };
+
+} } // eosio::chain
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <eosio/chain/config.hpp>
 #include <eosio/chain/wasm_eosio_binary_ops.hpp>
 #include <eosio/chain/wasm_eosio_constraints.hpp>
 #include <eosio/chain/webassembly/common.hpp>
@@ -249,6 +250,66 @@ namespace eosio { namespace chain { namespace wasm_injections {
       static int32_t chktm_idx;
    };
 
+   /**
+    * Countdown in front of the injected checktime calls of loops and calls.
+    *
+    * The deadline is watched by the timer of the transaction, checktime only throws once it expired: calling the
+    * host at every loop iteration is a lot of transitions for nothing. A mutable global counts down the calls, and
+    * the host is only called once per config::injected_checktime_interval of them; grow_memory and the start of
+    * functions still call it directly.
+    */
+   struct checktime_gate {
+      static void init() {
+         global_idx = -1;
+      }
+      static void pack( Module& module, wasm_ops::instruction_stream* code, uint32_t checktime_index ) {
+         if ( global_idx == -1 ) {
+            module.globals.defs.push_back({{ValueType::i32, true}, {(I32) eosio::chain::config::injected_checktime_interval}});
+            global_idx = module.globals.size()-1;
+         }
+
+         wasm_ops::op_types<>::get_global_t get_global_inst;
+         wasm_ops::op_types<>::set_global_t set_global_inst;
+         wasm_ops::op_types<>::i32_const_t  const_inst;
+         wasm_ops::op_types<>::i32_add_t    add_inst;
+         wasm_ops::op_types<>::i32_eqz_t    eqz_inst;
+         wasm_ops::op_types<>::if__t        if_inst;
+         wasm_ops::op_types<>::end_t        end_inst;
+         wasm_ops::op_types<>::call_t       call_checktime;
+
+         get_global_inst.field = global_idx;
+         set_global_inst.field = global_idx;
+         call_checktime.field = checktime_index;
+
+         const_inst.field = -1;
+         get_global_inst.pack(code);
+         const_inst.pack(code);
+         add_inst.pack(code);
+         set_global_inst.pack(code);
+         get_global_inst.pack(code);
+         eqz_inst.pack(code);
+         if_inst.pack(code);
+         const_inst.field = eosio::chain::config::injected_checktime_interval;
+         const_inst.pack(code);
+         set_global_inst.pack(code);
+         call_checktime.pack(code);
+         end_inst.pack(code);
+      }
+
+      static int32_t global_idx;
+   };
+
+   /// checktime of a loop iteration, through checktime_gate
+   struct gated_checktime_injection {
+      static constexpr bool kills = false;
+      static constexpr bool post = true;
+      static void init() {}
+      static void accept( wasm_ops::instr* inst, wasm_ops::visitor_arg& arg ) {
+         checktime_gate::pack( *arg.module, arg.new_code,
+                               injector_utils::injected_index_mapping.find(checktime_injection::chktm_idx)->second );
+      }
+   };
+
    struct fix_call_index {
       static constexpr bool kills = false;
       static constexpr bool post = false;
@@ -277,15 +338,13 @@ namespace eosio { namespace chain { namespace wasm_injections {
       static void accept( wasm_ops::instr* inst, wasm_ops::visitor_arg& arg ) {
          if ( global_idx == -1 ) {
             arg.module->globals.defs.push_back({{ValueType::i32, true}, {(I32) eosio::chain::wasm_constraints::maximum_call_depth}});
+            global_idx = arg.module->globals.size()-1;
          }
 
-         global_idx = arg.module->globals.size()-1;
-
          int32_t assert_idx;
          injector_utils::add_import<ResultType::none>(*(arg.module), "call_depth_assert", assert_idx);
 
          wasm_ops::op_types<>::call_t call_assert;
-         wasm_ops::op_types<>::call_t call_checktime;
          wasm_ops::op_types<>::get_global_t get_global_inst; 
          wasm_ops::op_types<>::set_global_t set_global_inst;
 
@@ -297,7 +356,6 @@ namespace eosio { namespace chain { namespace wasm_injections {
          wasm_ops::op_types<>::else__t else_inst; 
 
          call_assert.field = assert_idx;
-         call_checktime.field = checktime_injection::chktm_idx;
          get_global_inst.field = global_idx;
          set_global_inst.field = global_idx;
          const_inst.field = -1;
@@ -331,9 +389,9 @@ namespace eosio { namespace chain { namespace wasm_injections {
          INSERT_INJECTED(const_inst);
          INSERT_INJECTED(add_inst);
          INSERT_INJECTED(set_global_inst);
-         INSERT_INJECTED(call_checktime);
 
 #undef INSERT_INJECTED
+         checktime_gate::pack( *arg.module, arg.new_code, checktime_injection::chktm_idx );
       }
    }; 
 
@@ -754,7 +812,7 @@ namespace eosio { namespace chain { namespace wasm_injections {
 
 
    struct post_op_injectors : wasm_ops::op_types<pass_injector> {
-      using loop_t        = wasm_ops::loop        <checktime_injection>;
+      using loop_t        = wasm_ops::loop        <gated_checktime_injection>;
       using call_t        = wasm_ops::call        <fix_call_index>;
       using grow_memory_t = wasm_ops::grow_memory <checktime_injection>;
    };
@@ -784,6 +842,7 @@ namespace eosio { namespace chain { namespace wasm_injections {
             // initialize static fields of injectors
             injector_utils::init( mod );
             checktime_injection::init();
+            checktime_gate::init();
             call_depth_check_and_insert_checktime::init();
          }
 
@@ -6,9 +6,12 @@
 #include "Runtime/Linker.h"
 #include "Runtime/Runtime.h"
 
+#include <functional>
+
 namespace eosio { namespace chain {
 
    class apply_context;
+   class task_executor;
    class wasm_runtime_interface;
    class controller;
 
@@ -76,14 +79,25 @@ namespace eosio { namespace chain {
             wabt
          };
 
-         wasm_interface(vm_type vm, const chainbase::database& db);
+         /// A lookup of the instantiated module of a contract, see on_cache_access
+         struct cache_access {
+            bool             hit = false;
+            fc::microseconds instantiation_time; ///< of the module on a miss
+            uint64_t         cached_bytes = 0;   ///< estimated size of the instantiated modules after the lookup
+            uint32_t         evicted = 0;        ///< modules evicted to keep within the cache size
+         };
+
+         /// @param cache_dir  keeps the injected code of contracts, shared by the nodes of a host; empty for no cache
+         /// @param cache_size estimated bytes of instantiated modules kept in memory, 0 for no limit
+         wasm_interface(vm_type vm, const chainbase::database& db, const fc::path& cache_dir = fc::path(), uint64_t cache_size = 0);
          ~wasm_interface();
 
          //call before dtor to skip what can be minutes of dtor overhead with some runtimes; can cause leaks
          void indicate_shutting_down();
 
-         //validates code -- does a WASM validation pass and checks the wasm against EOSIO specific constraints
-         static void validate(const controller& control, const bytes& code);
+         //validates code -- does a WASM validation pass and checks the wasm against EOSIO specific constraints;
+         //code that already passed is only checked against the whitelisted intrinsics again
+         static void validate(const controller& control, const bytes& code, const digest_type& code_hash);
 
          //indicate that a particular code probably won't be used after given block_num
          void code_block_num_last_used(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, const uint32_t& block_num);
@@ -91,12 +105,20 @@ namespace eosio { namespace chain {
          //indicate the current LIB. evicts old cache entries
          void current_lib(const uint32_t lib);
 
+         //starts injecting code set at block_num on thread_pool, so its first apply only instantiates it;
+         //its scheduler must be stopped before the wasm_interface is destroyed
+         void prepare(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, const bytes& code,
+                      uint32_t block_num, const task_executor& thread_pool);
+
          //Calls apply or error on a given code
          void apply(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, apply_context& context);
 
          //Immediately exits currently running wasm. UB is called when no wasm running
          void exit();
 
+         //called for every lookup of an instantiated module, on the thread applying the action
+         void on_cache_access(std::function<void(const cache_access&)> cb);
+
       private:
          unique_ptr<struct wasm_interface_impl> my;
          friend class eosio::chain::webassembly::common::intrinsics_accessor;
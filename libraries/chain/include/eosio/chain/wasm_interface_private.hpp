@@ -9,6 +9,16 @@
 #include <eosio/chain/code_object.hpp>
 #include <eosio/chain/exceptions.hpp>
 #include <fc/scoped_exit.hpp>
+#include <fc/io/fstream.hpp>
+#include <fc/io/raw.hpp>
+
+
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unistd.h>
 
 #include "IR/Module.h"
 #include "Runtime/Intrinsics.h"
@@ -32,12 +42,19 @@ namespace eosio { namespace chain {
          std::unique_ptr<wasm_instantiated_module_interface>  module;
          uint8_t                                              vm_type = 0;
          uint8_t                                              vm_version = 0;
+         uint64_t                                             size = 0;             ///< estimated bytes of the module
+         int64_t                                              instantiation_us = 0;
+         double                                               priority = 0;         ///< lowest is evicted first, see cache_priority
       };
       struct by_hash;
       struct by_first_block_num;
       struct by_last_block_num;
+      struct by_priority;
 
-      wasm_interface_impl(wasm_interface::vm_type vm, const chainbase::database& d) : db(d) {
+      wasm_interface_impl(wasm_interface::vm_type vm, const chainbase::database& d, const fc::path& cache_dir, uint64_t cache_size)
+      : cache_dir(cache_dir), cache_size(cache_size), db(d) {
+         if(!cache_dir.empty() && !fc::is_directory(cache_dir))
+            fc::create_directories(cache_dir);
          if(vm == wasm_interface::vm_type::wavm)
             runtime_interface = std::make_unique<webassembly::wavm::wavm_runtime>();
          else if(vm == wasm_interface::vm_type::wabt)
@@ -47,6 +64,9 @@ namespace eosio { namespace chain {
       }
 
       ~wasm_interface_impl() {
+         //the tasks preparing code refer to this
+         for(const auto& p : prepared_codes)
+            p.second.code.wait();
          if(is_shutting_down)
             for(wasm_cache_index::iterator it = wasm_instantiation_cache.begin(); it != wasm_instantiation_cache.end(); ++it)
                wasm_instantiation_cache.modify(it, [](wasm_cache_entry& e) {
@@ -54,7 +74,7 @@ namespace eosio { namespace chain {
                });
       }
 
-      std::vector<uint8_t> parse_initial_memory(const Module& module) {
+      static std::vector<uint8_t> parse_initial_memory(const Module& module) {
          std::vector<uint8_t> mem_image;
 
          for(const DataSegment& data_segment : module.dataSegments) {
@@ -81,8 +101,20 @@ namespace eosio { namespace chain {
       }
 
       void current_lib(uint32_t lib) {
+         //code prepared for a setcode that became irreversible without being used, or was never applied
+         for(auto it = prepared_codes.begin(); it != prepared_codes.end();) {
+            if(it->second.block_num <= lib && it->second.code.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+               it = prepared_codes.erase(it);
+            else
+               ++it;
+         }
+
          //anything last used before or on the LIB can be evicted
-         wasm_instantiation_cache.get<by_last_block_num>().erase(wasm_instantiation_cache.get<by_last_block_num>().begin(), wasm_instantiation_cache.get<by_last_block_num>().upper_bound(lib));
+         auto& idx = wasm_instantiation_cache.get<by_last_block_num>();
+         const auto end = idx.upper_bound(lib);
+         for(auto it = idx.begin(); it != end; ++it)
+            cached_bytes -= it->size;
+         idx.erase(idx.begin(), end);
       }
 
       const std::unique_ptr<wasm_instantiated_module_interface>& get_instantiated_module( const digest_type& code_hash, const uint8_t& vm_type,
@@ -112,40 +144,204 @@ namespace eosio { namespace chain {
                trx_context.resume_billing_timer();
             });
             trx_context.pause_billing_timer();
-            IR::Module module;
-            try {
-               Serialization::MemoryInputStream stream((const U8*)codeobject->code.data(), codeobject->code.size());
-               WASM::serialize(stream, module);
-               module.userSections.clear();
-            } catch(const Serialization::FatalSerializationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-            } catch(const IR::ValidationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+
+            const auto start = fc::time_point::now();
+            prepared_module prepared;
+            if(!take_prepared_code(code_hash, vm_type, vm_version, prepared) && !read_injected_code(code_hash, vm_type, vm_version, prepared.code)) {
+               prepared.code = inject_code((const char*)codeobject->code.data(), codeobject->code.size());
+               write_injected_code(code_hash, vm_type, vm_version, prepared.code.code, prepared.code.initial_memory);
             }
 
+            auto& injected = prepared.code;
+            const uint64_t size = injected.code.size() + injected.initial_memory.size();
+            wasm_instantiation_cache.modify(it, [&](auto& c) {
+               c.module = prepared.module ? std::move(prepared.module)
+                                          : runtime_interface->instantiate_module((const char*)injected.code.data(), injected.code.size(), std::move(injected.initial_memory));
+            });
+            module_instantiated(it, size, start, prepared.instantiation_time);
+         } else {
+            wasm_instantiation_cache.modify(it, [&](wasm_cache_entry& e) {
+               e.priority = cache_priority(e);
+            });
+            if(cache_accessed)
+               cache_accessed(wasm_interface::cache_access{true, fc::microseconds(), cached_bytes, 0});
+         }
+         return it->module;
+      }
+
+      /// what get_instantiated_module derives from the code before handing it to the runtime
+      struct injected_code {
+         std::vector<uint8_t> code;
+         std::vector<uint8_t> initial_memory;
+      };
+
+      /// what prepare leaves for get_instantiated_module
+      struct prepared_module {
+         injected_code                                        code;
+         std::unique_ptr<wasm_instantiated_module_interface>  module;             ///< when the runtime instantiates on any thread
+         fc::microseconds                                     instantiation_time; ///< of `module`
+      };
+
+      /// bump whenever wasm_injections changes the injected code
+      static constexpr uint32_t injected_code_version = 2;
+
+      /// may be called on any thread
+      static injected_code inject_code(const char* code, size_t code_size) {
+         // the injectors keep the module being injected in static members
+         static std::mutex injection_mutex;
+
+         IR::Module module;
+         try {
+            Serialization::MemoryInputStream stream((const U8*)code, code_size);
+            WASM::serialize(stream, module);
+            module.userSections.clear();
+         } catch(const Serialization::FatalSerializationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         } catch(const IR::ValidationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         }
+
+         {
+            std::lock_guard<std::mutex> lock(injection_mutex);
             wasm_injections::wasm_binary_injection injector(module);
             injector.inject();
+         }
+
+         injected_code result;
+         try {
+            Serialization::ArrayOutputStream outstream;
+            WASM::serialize(outstream, module);
+            result.code = outstream.getBytes();
+         } catch(const Serialization::FatalSerializationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         } catch(const IR::ValidationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         }
+         result.initial_memory = parse_initial_memory(module);
+         return result;
+      }
 
-            std::vector<U8> bytes;
+      /**
+       * starts injecting the code on `thread_pool`, unless it is instantiated or being prepared; the runtimes that
+       * allow it also instantiate it there, so the first action of the new code does not wait for the whole module
+       * to be decoded
+       */
+      void prepare(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, const bytes& code,
+                   uint32_t block_num, const task_executor& thread_pool) {
+         const auto key = std::make_tuple(code_hash, vm_type, vm_version);
+         auto it = wasm_instantiation_cache.find(boost::make_tuple(code_hash, vm_type, vm_version));
+         if((it != wasm_instantiation_cache.end() && it->module) || prepared_codes.count(key))
+            return;
+
+         auto promise = std::make_shared<std::promise<prepared_module>>();
+         prepared_codes.emplace(key, prepared_code{block_num, promise->get_future()});
+         thread_pool.post([this, promise, code_hash, vm_type, vm_version, code]() {
             try {
-               Serialization::ArrayOutputStream outstream;
-               WASM::serialize(outstream, module);
-               bytes = outstream.getBytes();
-            } catch(const Serialization::FatalSerializationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-            } catch(const IR::ValidationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+               prepared_module result;
+               if(!read_injected_code(code_hash, vm_type, vm_version, result.code)) {
+                  result.code = inject_code(code.data(), code.size());
+                  write_injected_code(code_hash, vm_type, vm_version, result.code.code, result.code.initial_memory);
+               }
+               if(runtime_interface->instantiates_on_any_thread()) {
+                  const auto start = fc::time_point::now();
+                  result.module = runtime_interface->instantiate_module((const char*)result.code.code.data(), result.code.code.size(),
+                                                                        result.code.initial_memory);
+                  result.instantiation_time = fc::time_point::now() - start;
+               }
+               promise->set_value(std::move(result));
+            } catch(...) {
+               promise->set_exception(std::current_exception());
             }
+         });
+      }
 
-            wasm_instantiation_cache.modify(it, [&](auto& c) {
-               c.module = runtime_interface->instantiate_module((const char*)bytes.data(), bytes.size(), parse_initial_memory(module));
-            });
+      /// waits for the code if it is still being prepared; false if it was not prepared or cannot be
+      bool take_prepared_code(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, prepared_module& result) {
+         auto it = prepared_codes.find(std::make_tuple(code_hash, vm_type, vm_version));
+         if(it == prepared_codes.end())
+            return false;
+         auto code = std::move(it->second.code);
+         prepared_codes.erase(it);
+         try {
+            result = code.get();
+            return true;
+         } catch(...) {
+            // injected again on this thread, which reports the error
+            return false;
+         }
+      }
+
+      fc::path injected_code_path(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version) const {
+         return cache_dir / (code_hash.str() + "-" + std::to_string(vm_type) + "-" + std::to_string(vm_version) + "-" +
+                             std::to_string(injected_code_version) + ".wasm");
+      }
+
+      bool read_injected_code(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, injected_code& result) const {
+         if(cache_dir.empty())
+            return false;
+         const auto path = injected_code_path(code_hash, vm_type, vm_version);
+         try {
+            if(!fc::exists(path))
+               return false;
+            std::string content;
+            fc::read_file_contents(path, content);
+            fc::datastream<const char*> ds(content.data(), content.size());
+            fc::sha256 checksum;
+            fc::raw::unpack(ds, checksum);
+            fc::raw::unpack(ds, result.code);
+            fc::raw::unpack(ds, result.initial_memory);
+            // a node of the host may have written an incomplete or damaged file, applying it would break consensus
+            if(checksum == injected_code_checksum(result))
+               return true;
+            wlog("Ignoring damaged cached code ${p}", ("p", path.generic_string()));
+         } catch(const fc::exception& e) {
+            wlog("Cannot read cached code ${p}: ${e}", ("p", path.generic_string())("e", e.to_string()));
+         }
+         return false;
+      }
+
+      void write_injected_code(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version,
+                               const std::vector<uint8_t>& code, const std::vector<uint8_t>& initial_memory) const {
+         if(cache_dir.empty())
+            return;
+         const auto path = injected_code_path(code_hash, vm_type, vm_version);
+         try {
+            injected_code entry{code, initial_memory};
+            // written aside and renamed, so the nodes sharing the directory never read a partial file
+            const auto temp_path = fc::path(path.generic_string() + "." + std::to_string(::getpid()) + ".tmp");
+            {
+               std::ofstream out(temp_path.generic_string(), std::ios::out | std::ios::binary | std::ios::trunc);
+               for(const auto& packed : {fc::raw::pack(injected_code_checksum(entry)), fc::raw::pack(entry.code), fc::raw::pack(entry.initial_memory)})
+                  out.write(packed.data(), packed.size());
+               out.flush();
+               EOS_ASSERT(out.good(), wasm_exception, "Cannot write ${p}", ("p", temp_path.generic_string()));
+            }
+            fc::rename(temp_path, path);
+         } catch(const fc::exception& e) {
+            wlog("Cannot cache code ${p}: ${e}", ("p", path.generic_string())("e", e.to_string()));
          }
-         return it->module;
+      }
+
+      static fc::sha256 injected_code_checksum(const injected_code& entry) {
+         fc::sha256::encoder enc;
+         fc::raw::pack(enc, entry.code);
+         fc::raw::pack(enc, entry.initial_memory);
+         return enc.result();
       }
 
       bool is_shutting_down = false;
       std::unique_ptr<wasm_runtime_interface> runtime_interface;
+      fc::path cache_dir;
+      const uint64_t cache_size;
+      uint64_t cached_bytes = 0;
+      double cache_inflation = 0; ///< priority of the last evicted module
+      std::function<void(const wasm_interface::cache_access&)> cache_accessed;
+
+      struct prepared_code {
+         uint32_t                           block_num = 0; ///< of the setcode
+         std::future<prepared_module>       code;
+      };
+      std::map<std::tuple<digest_type, uint8_t, uint8_t>, prepared_code> prepared_codes;
 
       typedef boost::multi_index_container<
          wasm_cache_entry,
@@ -158,11 +354,54 @@ namespace eosio { namespace chain {
                >
             >,
             ordered_non_unique<tag<by_first_block_num>, member<wasm_cache_entry, uint32_t, &wasm_cache_entry::first_block_num_used>>,
-            ordered_non_unique<tag<by_last_block_num>, member<wasm_cache_entry, uint32_t, &wasm_cache_entry::last_block_num_used>>
+            ordered_non_unique<tag<by_last_block_num>, member<wasm_cache_entry, uint32_t, &wasm_cache_entry::last_block_num_used>>,
+            ordered_non_unique<tag<by_priority>, member<wasm_cache_entry, double, &wasm_cache_entry::priority>>
          >
       > wasm_cache_index;
       wasm_cache_index wasm_instantiation_cache;
 
+      /**
+       * GreedyDual-Size: a module is worth the time it takes to instantiate it again per byte it holds, plus the worth of
+       * the last evicted module. The latter ages the modules not used since, so a module instantiated once long ago is
+       * evicted before a cheaper one used all the time.
+       */
+      double cache_priority(const wasm_cache_entry& e) const {
+         return cache_inflation + double(e.instantiation_us) / double(std::max<uint64_t>(e.size, 1));
+      }
+
+      /// evicts the modules of the lowest priority until the cache fits in cache_size, except `keep`
+      uint32_t evict_to_cache_size(wasm_cache_index::iterator keep) {
+         uint32_t evicted = 0;
+         if(!cache_size)
+            return evicted;
+         auto& idx = wasm_instantiation_cache.get<by_priority>();
+         for(auto it = idx.begin(); cached_bytes > cache_size && it != idx.end();) {
+            if(wasm_instantiation_cache.project<by_hash>(it) == keep) {
+               ++it;
+               continue;
+            }
+            cache_inflation = it->priority;
+            cached_bytes -= it->size;
+            it = idx.erase(it);
+            ++evicted;
+         }
+         return evicted;
+      }
+
+      /// `prepared_time` is what instantiating the module took on the thread pool, before `start`
+      void module_instantiated(wasm_cache_index::iterator it, uint64_t size, const fc::time_point& start, const fc::microseconds& prepared_time) {
+         const auto elapsed = fc::time_point::now() - start;
+         wasm_instantiation_cache.modify(it, [&](wasm_cache_entry& e) {
+            e.size = size;
+            e.instantiation_us = std::max<int64_t>((elapsed + prepared_time).count(), 1);
+            e.priority = cache_priority(e);
+         });
+         cached_bytes += size;
+         const auto evicted = evict_to_cache_size(it);
+         if(cache_accessed)
+            cache_accessed(wasm_interface::cache_access{false, elapsed, cached_bytes, evicted});
+      }
+
       const chainbase::database& db;
    };
 
@@ -3,6 +3,10 @@
 #include <eosio/chain/wasm_interface.hpp>
 #include <eosio/chain/wasm_eosio_constraints.hpp>
 
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
 #define EOSIO_INJECTED_MODULE_NAME "eosio_injection"
 
 using namespace fc;
@@ -76,6 +80,42 @@ namespace eosio { namespace chain {
       T *value;
    }; 
 
+   /**
+    * Aligned copy of a misaligned array argument, kept on the stack unless it is large
+    * @tparam T - element type, copied with memcpy
+    */
+   template<typename T>
+   class aligned_array_copy {
+      public:
+         using value_type = std::remove_const_t<T>;
+         static constexpr size_t inline_bytes = 512;
+
+         aligned_array_copy( const void* src, size_t length ) : length(length) {
+            if( length * sizeof(value_type) > inline_bytes ) {
+               heap.reset( new value_type[length] );
+               ptr = heap.get();
+            } else {
+               ptr = reinterpret_cast<value_type*>( &inline_storage );
+            }
+            memcpy( (void*)ptr, src, length * sizeof(value_type) );
+         }
+
+         aligned_array_copy( const aligned_array_copy& ) = delete;
+         aligned_array_copy& operator=( const aligned_array_copy& ) = delete;
+
+         T* data() const { return ptr; }
+
+         void copy_back( void* dst ) const {
+            memcpy( dst, (const void*)ptr, length * sizeof(value_type) );
+         }
+
+      private:
+         const size_t                                                  length;
+         value_type*                                                   ptr = nullptr;
+         std::unique_ptr<value_type[]>                                 heap;
+         std::aligned_storage_t<inline_bytes, alignof(value_type)>     inline_storage;
+   };
+
    /**
     * class to represent an in-wasm-memory char array that must be null terminated
     */
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#include <immintrin.h>
+#define EOSIO_NATIVE_FLOAT 1
+#endif
+
+namespace eosio { namespace chain { namespace webassembly { namespace native_float {
+
+   /**
+    * Hardware versions of the float intrinsics computed by softfloat.
+    *
+    * IEEE 754 defines a single result for add, sub, mul, div, sqrt and the f32/f64 conversions in round to nearest
+    * even, except for the payload of NaN results which differs between hardware and softfloat. Each function
+    * computes the operation with SSE and returns false when the result may differ from softfloat: the result is a
+    * NaN, or MXCSR does not round to nearest with subnormals kept (FTZ/DAZ set by a library of the process). The
+    * caller then computes it with softfloat, so results are the same on every node.
+    */
+
+   inline bool is_nan( float f )  { uint32_t v; memcpy( &v, &f, sizeof(v) ); return (v & 0x7fffffff) > 0x7f800000; }
+   inline bool is_nan( double d ) { uint64_t v; memcpy( &v, &d, sizeof(v) ); return (v & 0x7fffffffffffffffull) > 0x7ff0000000000000ull; }
+
+#ifdef EOSIO_NATIVE_FLOAT
+   /// rounding control, flush to zero and denormals are zero bits of MXCSR all clear
+   inline bool ieee_mode() { return (_mm_getcsr() & 0xe040) == 0; }
+
+   template<typename T>
+   inline bool checked( T r, T& out ) {
+      out = r;
+      return !is_nan( r ) && ieee_mode();
+   }
+
+   inline bool add( float a, float b, float& r ) { return checked( _mm_cvtss_f32( _mm_add_ss( _mm_set_ss(a), _mm_set_ss(b) ) ), r ); }
+   inline bool sub( float a, float b, float& r ) { return checked( _mm_cvtss_f32( _mm_sub_ss( _mm_set_ss(a), _mm_set_ss(b) ) ), r ); }
+   inline bool mul( float a, float b, float& r ) { return checked( _mm_cvtss_f32( _mm_mul_ss( _mm_set_ss(a), _mm_set_ss(b) ) ), r ); }
+   inline bool div( float a, float b, float& r ) { return checked( _mm_cvtss_f32( _mm_div_ss( _mm_set_ss(a), _mm_set_ss(b) ) ), r ); }
+   inline bool sqrt( float a, float& r )         { return checked( _mm_cvtss_f32( _mm_sqrt_ss( _mm_set_ss(a) ) ), r ); }
+
+   inline bool add( double a, double b, double& r ) { return checked( _mm_cvtsd_f64( _mm_add_sd( _mm_set_sd(a), _mm_set_sd(b) ) ), r ); }
+   inline bool sub( double a, double b, double& r ) { return checked( _mm_cvtsd_f64( _mm_sub_sd( _mm_set_sd(a), _mm_set_sd(b) ) ), r ); }
+   inline bool mul( double a, double b, double& r ) { return checked( _mm_cvtsd_f64( _mm_mul_sd( _mm_set_sd(a), _mm_set_sd(b) ) ), r ); }
+   inline bool div( double a, double b, double& r ) { return checked( _mm_cvtsd_f64( _mm_div_sd( _mm_set_sd(a), _mm_set_sd(b) ) ), r ); }
+   inline bool sqrt( double a, double& r ) {
+      const auto v = _mm_set_sd(a);
+      return checked( _mm_cvtsd_f64( _mm_sqrt_sd( v, v ) ), r );
+   }
+
+   inline bool promote( float a, double& r ) { return checked( _mm_cvtsd_f64( _mm_cvtss_sd( _mm_setzero_pd(), _mm_set_ss(a) ) ), r ); }
+   inline bool demote( double a, float& r )  { return checked( _mm_cvtss_f32( _mm_cvtsd_ss( _mm_setzero_ps(), _mm_set_sd(a) ) ), r ); }
+#else
+   /// no hardware path, every operation is computed by softfloat
+   template<typename T>
+   inline bool add( T, T, T& ) { return false; }
+   template<typename T>
+   inline bool sub( T, T, T& ) { return false; }
+   template<typename T>
+   inline bool mul( T, T, T& ) { return false; }
+   template<typename T>
+   inline bool div( T, T, T& ) { return false; }
+   template<typename T>
+   inline bool sqrt( T, T& ) { return false; }
+   inline bool promote( float, double& ) { return false; }
+   inline bool demote( double, float& )  { return false; }
+#endif
+
+} } } } // eosio::chain::webassembly::native_float
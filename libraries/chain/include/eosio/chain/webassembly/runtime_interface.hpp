@@ -17,6 +17,9 @@ class wasm_runtime_interface {
    public:
       virtual std::unique_ptr<wasm_instantiated_module_interface> instantiate_module(const char* code_bytes, size_t code_size, std::vector<uint8_t> initial_memory) = 0;
 
+      //true when instantiate_module may run on a thread other than the one applying the modules, while they are applied
+      virtual bool instantiates_on_any_thread() const { return false; }
+
       //immediately exit the currently running wasm_instantiated_module_interface. Yep, this assumes only one can possibly run at a time.
       virtual void immediately_exit_currently_running_module() = 0;
 
@@ -52,6 +52,9 @@ class wabt_runtime : public eosio::chain::wasm_runtime_interface {
       wabt_runtime();
       std::unique_ptr<wasm_instantiated_module_interface> instantiate_module(const char* code_bytes, size_t code_size, std::vector<uint8_t> initial_memory) override;
 
+      //each module decodes into its own environment, the host functions only reach the apply context when called
+      bool instantiates_on_any_thread() const override { return true; }
+
       void immediately_exit_currently_running_module() override;
 
    private:
@@ -78,11 +81,9 @@ inline array_ptr<T> array_ptr_impl (wabt_apply_instance_vars& vars, uint32_t ptr
 inline null_terminated_ptr null_terminated_ptr_impl(wabt_apply_instance_vars& vars, uint32_t ptr)
 {
    char *value = vars.get_validated_pointer(ptr, 1);
-   const char* p = value;
    const char* const top_of_memory = vars.memory->data.data() + vars.memory->data.size();
-   while(p < top_of_memory)
-      if(*p++ == '\0')
-         return null_terminated_ptr(value);
+   if(memchr(value, '\0', top_of_memory - value))
+      return null_terminated_ptr(value);
 
    FC_THROW_EXCEPTION(wasm_execution_error, "unterminated string");
 }
@@ -375,9 +376,8 @@ struct intrinsic_invoker_impl<Ret, std::tuple<array_ptr<T>, size_t, Inputs...>>
       if ( reinterpret_cast<uintptr_t>(base) % alignof(T) != 0 ) {
          if(vars.ctx.control.contracts_console())
             wlog( "misaligned array of const values" );
-         std::vector<std::remove_const_t<T> > copy(length > 0 ? length : 1);
-         T* copy_ptr = &copy[0];
-         memcpy( (void*)copy_ptr, (void*)base, length * sizeof(T) );
+         aligned_array_copy<T> copy( base, length );
+         T* copy_ptr = copy.data();
          return Then(vars, static_cast<array_ptr<T>>(copy_ptr), length, rest..., args, (uint32_t)offset - 2);
       }
       return Then(vars, static_cast<array_ptr<T>>(base), length, rest..., args, (uint32_t)offset - 2);
@@ -392,11 +392,10 @@ struct intrinsic_invoker_impl<Ret, std::tuple<array_ptr<T>, size_t, Inputs...>>
       if ( reinterpret_cast<uintptr_t>(base) % alignof(T) != 0 ) {
          if(vars.ctx.control.contracts_console())
             wlog( "misaligned array of values" );
-         std::vector<std::remove_const_t<T> > copy(length > 0 ? length : 1);
-         T* copy_ptr = &copy[0];
-         memcpy( (void*)copy_ptr, (void*)base, length * sizeof(T) );
-         Ret ret = Then(vars, static_cast<array_ptr<T>>(copy_ptr), length, rest..., args, (uint32_t)offset - 2);  
-         memcpy( (void*)base, (void*)copy_ptr, length * sizeof(T) );
+         aligned_array_copy<T> copy( base, length );
+         T* copy_ptr = copy.data();
+         Ret ret = Then(vars, static_cast<array_ptr<T>>(copy_ptr), length, rest..., args, (uint32_t)offset - 2);
+         copy.copy_back( base );
          return ret;
       }
       return Then(vars, static_cast<array_ptr<T>>(base), length, rest..., args, (uint32_t)offset - 2);
@@ -30,7 +30,8 @@ struct running_instance_context {
    MemoryInstance* memory;
    apply_context*  apply_ctx;
 };
-extern running_instance_context the_running_instance_context;
+/// of the instance running on the calling thread
+extern thread_local running_instance_context the_running_instance_context;
 
 /**
  * class to represent an in-wasm-memory array
@@ -65,11 +66,9 @@ inline null_terminated_ptr null_terminated_ptr_impl(running_instance_context& ct
       Runtime::causeException(Exception::Cause::accessViolation);
 
    char *value                     = (char*)(getMemoryBaseAddress(mem) + ptr);
-   const char* p                   = value;
    const char* const top_of_memory = (char*)(getMemoryBaseAddress(mem) + IR::numBytesPerPage*Runtime::getMemoryNumPages(mem));
-   while(p < top_of_memory)
-      if(*p++ == '\0')
-         return null_terminated_ptr(value);
+   if(value < top_of_memory && memchr(value, '\0', top_of_memory - value))
+      return null_terminated_ptr(value);
 
    Runtime::causeException(Exception::Cause::accessViolation);
 }
@@ -389,9 +388,8 @@ struct intrinsic_invoker_impl<Ret, std::tuple<array_ptr<T>, size_t, Inputs...>,
       if ( reinterpret_cast<uintptr_t>(base) % alignof(T) != 0 ) {
          if(ctx.apply_ctx->control.contracts_console())
             wlog( "misaligned array of const values" );
-         std::vector<std::remove_const_t<T> > copy(length > 0 ? length : 1);
-         T* copy_ptr = &copy[0];
-         memcpy( (void*)copy_ptr, (void*)base, length * sizeof(T) );
+         aligned_array_copy<T> copy( base, length );
+         T* copy_ptr = copy.data();
          return Then(ctx, static_cast<array_ptr<T>>(copy_ptr), length, rest..., translated...);
       }
       return Then(ctx, static_cast<array_ptr<T>>(base), length, rest..., translated...);
@@ -405,11 +403,10 @@ struct intrinsic_invoker_impl<Ret, std::tuple<array_ptr<T>, size_t, Inputs...>,
       if ( reinterpret_cast<uintptr_t>(base) % alignof(T) != 0 ) {
          if(ctx.apply_ctx->control.contracts_console())
             wlog( "misaligned array of values" );
-         std::vector<std::remove_const_t<T> > copy(length > 0 ? length : 1);
-         T* copy_ptr = &copy[0];
-         memcpy( (void*)copy_ptr, (void*)base, length * sizeof(T) );
-         Ret ret = Then(ctx, static_cast<array_ptr<T>>(copy_ptr), length, rest..., translated...);  
-         memcpy( (void*)base, (void*)copy_ptr, length * sizeof(T) );
+         aligned_array_copy<T> copy( base, length );
+         T* copy_ptr = copy.data();
+         Ret ret = Then(ctx, static_cast<array_ptr<T>>(copy_ptr), length, rest..., translated...);
+         copy.copy_back( base );
          return ret;
       }
       return Then(ctx, static_cast<array_ptr<T>>(base), length, rest..., translated...);
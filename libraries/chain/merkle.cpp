@@ -1,6 +1,14 @@
 #include <eosio/chain/merkle.hpp>
 #include <fc/io/raw.hpp>
 
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define EOSIO_MERKLE_AVX2
+#include <immintrin.h>
+#endif
+
 namespace eosio { namespace chain {
 
 /**
@@ -32,6 +40,173 @@ bool is_canonical_right(const digest_type& val) {
 }
 
 
+namespace {
+
+   /**
+    * SHA-256 of canonical pairs, 8 at a time in the lanes of AVX2 registers.
+    *
+    * A pair is a 64 bytes message: its hash is the compression of the message followed by the compression of a
+    * padding block which is the same for every pair, so the schedule of that block is computed once.
+    */
+#ifdef EOSIO_MERKLE_AVX2
+   constexpr size_t lanes = 8;
+
+   constexpr uint32_t round_constants[64] = {
+      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+      0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+      0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+      0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+      0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+      0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+   };
+
+   constexpr uint32_t initial_state[8] = {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+   };
+
+   uint32_t load_be32( const char* p ) {
+      const auto* b = reinterpret_cast<const uint8_t*>( p );
+      return ( uint32_t( b[0] ) << 24 ) | ( uint32_t( b[1] ) << 16 ) | ( uint32_t( b[2] ) << 8 ) | b[3];
+   }
+
+   void store_be32( char* p, uint32_t v ) {
+      auto* b = reinterpret_cast<uint8_t*>( p );
+      b[0] = v >> 24; b[1] = v >> 16; b[2] = v >> 8; b[3] = v;
+   }
+
+   uint32_t rotr( uint32_t x, int n ) { return ( x >> n ) | ( x << ( 32 - n ) ); }
+
+   /// round constants plus the schedule of the padding block of a 64 bytes message
+   const uint32_t* padding_round_words() {
+      static const auto words = [] {
+         std::array<uint32_t, 64> w{};
+         w[0] = 0x80000000;
+         w[15] = 512; // message length in bits
+         for( int t = 16; t < 64; ++t ) {
+            const uint32_t s0 = rotr( w[t - 15], 7 ) ^ rotr( w[t - 15], 18 ) ^ ( w[t - 15] >> 3 );
+            const uint32_t s1 = rotr( w[t - 2], 17 ) ^ rotr( w[t - 2], 19 ) ^ ( w[t - 2] >> 10 );
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+         }
+         for( int t = 0; t < 64; ++t )
+            w[t] += round_constants[t];
+         return w;
+      }();
+      return words.data();
+   }
+
+#define EOSIO_AVX2 __attribute__((target("avx2")))
+
+   EOSIO_AVX2 inline __m256i rotr8( __m256i x, int n ) {
+      return _mm256_or_si256( _mm256_srli_epi32( x, n ), _mm256_slli_epi32( x, 32 - n ) );
+   }
+
+   EOSIO_AVX2 inline __m256i add8( __m256i a, __m256i b ) { return _mm256_add_epi32( a, b ); }
+
+   EOSIO_AVX2 inline __m256i xor8( __m256i a, __m256i b, __m256i c ) {
+      return _mm256_xor_si256( _mm256_xor_si256( a, b ), c );
+   }
+
+   /// 64 rounds over `state`, `round_words[t]` is the round constant plus the schedule word of round `t`
+   EOSIO_AVX2 void compress8( __m256i* state, const __m256i* round_words ) {
+      __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+      __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+      for( int t = 0; t < 64; ++t ) {
+         const __m256i ch  = _mm256_xor_si256( _mm256_and_si256( e, f ), _mm256_andnot_si256( e, g ) );
+         const __m256i maj = _mm256_or_si256( _mm256_and_si256( a, b ), _mm256_and_si256( c, _mm256_or_si256( a, b ) ) );
+         const __m256i t1  = add8( add8( h, xor8( rotr8( e, 6 ), rotr8( e, 11 ), rotr8( e, 25 ) ) ), add8( ch, round_words[t] ) );
+         const __m256i t2  = add8( xor8( rotr8( a, 2 ), rotr8( a, 13 ), rotr8( a, 22 ) ), maj );
+         h = g; g = f; f = e; e = add8( d, t1 );
+         d = c; c = b; b = a; a = add8( t1, t2 );
+      }
+      state[0] = add8( state[0], a ); state[1] = add8( state[1], b );
+      state[2] = add8( state[2], c ); state[3] = add8( state[3], d );
+      state[4] = add8( state[4], e ); state[5] = add8( state[5], f );
+      state[6] = add8( state[6], g ); state[7] = add8( state[7], h );
+   }
+
+   /// hashes the pairs of nodes[0..16) into out[0..8), all nodes are read before out is written
+   EOSIO_AVX2 void hash_8_pairs_avx2( const digest_type* nodes, digest_type* out ) {
+      alignas(32) uint32_t words[16][lanes];
+      for( size_t lane = 0; lane < lanes; ++lane ) {
+         const char* left  = nodes[2 * lane].data();
+         const char* right = nodes[2 * lane + 1].data();
+         for( size_t j = 0; j < 8; ++j ) {
+            words[j][lane]     = load_be32( left + 4 * j );
+            words[8 + j][lane] = load_be32( right + 4 * j );
+         }
+         // see make_canonical_left and make_canonical_right: the first bit of each side
+         words[0][lane] &= 0x7FFFFFFF;
+         words[8][lane] |= 0x80000000;
+      }
+
+      __m256i w[64];
+      for( int t = 0; t < 16; ++t )
+         w[t] = _mm256_load_si256( reinterpret_cast<const __m256i*>( words[t] ) );
+      for( int t = 16; t < 64; ++t ) {
+         const __m256i s0 = xor8( rotr8( w[t - 15], 7 ), rotr8( w[t - 15], 18 ), _mm256_srli_epi32( w[t - 15], 3 ) );
+         const __m256i s1 = xor8( rotr8( w[t - 2], 17 ), rotr8( w[t - 2], 19 ), _mm256_srli_epi32( w[t - 2], 10 ) );
+         w[t] = add8( add8( w[t - 16], s0 ), add8( w[t - 7], s1 ) );
+      }
+      for( int t = 0; t < 64; ++t )
+         w[t] = add8( w[t], _mm256_set1_epi32( round_constants[t] ) );
+
+      __m256i state[8];
+      for( size_t j = 0; j < 8; ++j )
+         state[j] = _mm256_set1_epi32( initial_state[j] );
+      compress8( state, w );
+
+      const uint32_t* padding = padding_round_words();
+      for( int t = 0; t < 64; ++t )
+         w[t] = _mm256_set1_epi32( padding[t] );
+      compress8( state, w );
+
+      alignas(32) uint32_t digests[8][lanes];
+      for( size_t j = 0; j < 8; ++j )
+         _mm256_store_si256( reinterpret_cast<__m256i*>( digests[j] ), state[j] );
+      for( size_t lane = 0; lane < lanes; ++lane ) {
+         char* d = out[lane].data();
+         for( size_t j = 0; j < 8; ++j )
+            store_be32( d + 4 * j, digests[j][lane] );
+      }
+   }
+
+#undef EOSIO_AVX2
+
+   bool use_multi_buffer() {
+      static const bool use = [] {
+         __builtin_cpu_init();
+         return __builtin_cpu_supports( "avx2" ) != 0;
+      }();
+      return use;
+   }
+#endif
+
+}
+
+digest_type hash_canonical_pair( const digest_type& l, const digest_type& r ) {
+   char message[2 * sizeof(digest_type)];
+   memcpy( message, l.data(), sizeof(digest_type) );
+   memcpy( message + sizeof(digest_type), r.data(), sizeof(digest_type) );
+   // see make_canonical_left and make_canonical_right
+   message[0] &= 0x7F;
+   message[sizeof(digest_type)] |= 0x80;
+   return digest_type::hash( message, sizeof(message) );
+}
+
+void hash_canonical_pairs( const digest_type* nodes, size_t pairs, digest_type* out ) {
+   size_t i = 0;
+#ifdef EOSIO_MERKLE_AVX2
+   if( pairs >= lanes && use_multi_buffer() ) {
+      for( ; i + lanes <= pairs; i += lanes )
+         hash_8_pairs_avx2( nodes + 2 * i, out + i );
+   }
+#endif
+   for( ; i < pairs; ++i )
+      out[i] = hash_canonical_pair( nodes[2 * i], nodes[2 * i + 1] );
+}
+
 digest_type merkle(vector<digest_type> ids) {
    if( 0 == ids.size() ) { return digest_type(); }
 
@@ -39,9 +214,7 @@ digest_type merkle(vector<digest_type> ids) {
       if( ids.size() % 2 )
          ids.push_back(ids.back());
 
-      for (size_t i = 0; i < ids.size() / 2; i++) {
-         ids[i] = digest_type::hash(make_canonical_pair(ids[2 * i], ids[(2 * i) + 1]));
-      }
+      hash_canonical_pairs( ids.data(), ids.size() / 2, ids.data() );
 
       ids.resize(ids.size() / 2);
    }
@@ -49,4 +222,34 @@ digest_type merkle(vector<digest_type> ids) {
    return ids.front();
 }
 
+void merkle_accumulator::append( const digest_type& digest ) {
+   auto node = digest;
+   for( auto count = _count; count & 1; count >>= 1 ) {
+      node = hash_canonical_pair( _subtrees.back(), node );
+      _subtrees.pop_back();
+   }
+   _subtrees.emplace_back( std::move(node) );
+   ++_count;
+}
+
+digest_type merkle_accumulator::get_root()const {
+   if( _count == 0 ) { return digest_type(); }
+
+   // walk up as merkle() would: at every level the nodes are the complete subtrees plus
+   // a partial node made of the smaller ones, an odd last node is paired with itself
+   auto subtree = _subtrees.rbegin();
+   digest_type partial;
+   bool has_partial = false;
+   for( uint64_t full = _count; full + has_partial > 1; full >>= 1 ) {
+      if( full & 1 ) {
+         const auto& left = *subtree++;
+         partial = has_partial ? hash_canonical_pair( left, partial ) : hash_canonical_pair( left, left );
+         has_partial = true;
+      } else if( has_partial ) {
+         partial = hash_canonical_pair( partial, partial );
+      }
+   }
+   return has_partial ? partial : _subtrees.front();
+}
+
 } } // eosio::chain
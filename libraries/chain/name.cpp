@@ -1,35 +1,77 @@
 #include <eosio/chain/name.hpp>
 #include <fc/variant.hpp>
-#include <boost/algorithm/string.hpp>
 #include <fc/exception/exception.hpp>
 #include <eosio/chain/exceptions.hpp>
 
-namespace eosio { namespace chain { 
+#include <array>
 
+namespace eosio { namespace chain {
+
+   namespace {
+      constexpr uint8_t invalid_symbol = 0xff;
+
+      /// symbol of every char, invalid_symbol if names cannot contain it
+      constexpr std::array<uint8_t, 256> make_symbol_table() {
+         std::array<uint8_t, 256> table{};
+         for( auto& s : table ) s = invalid_symbol;
+         for( int c = 0; c < 256; ++c ) {
+            if( c == '.' || char_to_symbol( char(c) ) != 0 )
+               table[c] = uint8_t( char_to_symbol( char(c) ) );
+         }
+         return table;
+      }
+
+      constexpr auto symbol_table = make_symbol_table();
+      constexpr char charmap[] = ".12345abcdefghijklmnopqrstuvwxyz";
+   }
+
+   // same value as string_to_name(), normalized if name::to_string() gives str back: known chars, the 13th one
+   // encodable in 4 bits and no trailing dot
    void name::set( const char* str ) {
       const auto len = strnlen(str, 14);
       EOS_ASSERT(len <= 13, name_type_exception, "Name is longer than 13 characters (${name}) ", ("name", string(str)));
-      value = string_to_name(str);
-      EOS_ASSERT(to_string() == string(str), name_type_exception,
+
+      uint64_t v = 0;
+      bool normalized = len == 0 || str[len - 1] != '.';
+      for( size_t i = 0; i < len && i < 12; ++i ) {
+         const auto s = symbol_table[uint8_t(str[i])];
+         normalized &= s != invalid_symbol;
+         v |= uint64_t(s == invalid_symbol ? 0 : s) << (64 - 5 * (i + 1));
+      }
+      if( len == 13 ) {
+         const auto s = symbol_table[uint8_t(str[12])];
+         normalized &= s <= 0x0f;
+         v |= s == invalid_symbol ? 0 : s & 0x0f;
+      }
+      value = v;
+      EOS_ASSERT(normalized, name_type_exception,
                  "Name not properly normalized (name: ${name}, normalized: ${normalized}) ",
                  ("name", string(str))("normalized", to_string()));
    }
 
    // keep in sync with name::to_string() in contract definition for name
-   name::operator string()const {
-     static const char* charmap = ".12345abcdefghijklmnopqrstuvwxyz";
-
-      string str(13,'.');
+   size_t name::write_string( char out[max_length] )const {
+      if( value == 0 ) return 0;
+      // every char is decoded, the length is that of the name up to its last non zero symbol
+      for( uint32_t i = 0; i < 12; ++i )
+         out[i] = charmap[(value >> (64 - 5 * (i + 1))) & 0x1f];
+      out[12] = charmap[value & 0x0f];
+      const uint32_t trailing_zeros = __builtin_ctzll( value );
+      return trailing_zeros < 4 ? 13 : (63 - trailing_zeros) / 5 + 1;
+   }
 
-      uint64_t tmp = value;
-      for( uint32_t i = 0; i <= 12; ++i ) {
-         char c = charmap[tmp & (i == 0 ? 0x0f : 0x1f)];
-         str[12-i] = c;
-         tmp >>= (i == 0 ? 4 : 5);
-      }
+   name::operator string()const {
+      char buf[max_length];
+      return string( buf, write_string( buf ) );
+   }
 
-      boost::algorithm::trim_right_if( str, []( char c ){ return c == '.'; } );
-      return str;
+   std::vector<string> names_to_strings( const name* names, size_t count ) {
+      std::vector<string> result;
+      result.reserve( count );
+      char buf[name::max_length];
+      for( size_t i = 0; i < count; ++i )
+         result.emplace_back( buf, names[i].write_string( buf ) );
+      return result;
    }
 
 } } /// eosio::chain
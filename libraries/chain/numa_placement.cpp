@@ -0,0 +1,158 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/chain/numa_placement.hpp>
+#include <eosio/chain/exceptions.hpp>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+namespace eosio { namespace chain {
+
+   namespace {
+      const boost::filesystem::path sys_nodes_dir = "/sys/devices/system/node";
+
+      /// "0-3,8,10-11"
+      std::vector<uint32_t> parse_list( const std::string& s ) {
+         std::vector<uint32_t> result;
+         std::vector<std::string> ranges;
+         boost::split( ranges, boost::trim_copy( s ), boost::is_any_of( "," ) );
+         for( const auto& r : ranges ) {
+            if( r.empty() ) continue;
+            const auto dash = r.find( '-' );
+            const auto first = boost::lexical_cast<uint32_t>( r.substr( 0, dash ) );
+            const auto last = dash == std::string::npos ? first : boost::lexical_cast<uint32_t>( r.substr( dash + 1 ) );
+            for( auto i = first; i <= last; ++i )
+               result.push_back( i );
+         }
+         return result;
+      }
+
+      std::string read_line( const boost::filesystem::path& file ) {
+         std::ifstream in( file.generic_string() );
+         std::string line;
+         std::getline( in, line );
+         return line;
+      }
+   }
+
+   numa_placement numa_placement::from_string( const std::string& s ) {
+      numa_placement p;
+      if( s == "default" ) return p;
+      if( s == "interleave" ) {
+         p.policy = policy_type::interleave;
+         return p;
+      }
+      EOS_ASSERT( boost::starts_with( s, "bind:" ), plugin_config_exception, "unknown numa policy ${s}", ("s", s) );
+      p.policy = policy_type::bind;
+      try {
+         p.node = boost::lexical_cast<uint32_t>( s.substr( 5 ) );
+      } catch( const boost::bad_lexical_cast& ) {
+         EOS_THROW( plugin_config_exception, "invalid numa node in ${s}", ("s", s) );
+      }
+      return p;
+   }
+
+   std::vector<uint32_t> numa_placement::nodes() {
+      boost::system::error_code ec;
+      if( !boost::filesystem::exists( sys_nodes_dir / "has_memory", ec ) ) return {};
+      return parse_list( read_line( sys_nodes_dir / "has_memory" ) );
+   }
+
+   void numa_placement::apply()const {
+      if( policy == policy_type::none ) return;
+#ifdef __linux__
+      const auto all = nodes();
+      EOS_ASSERT( !all.empty(), plugin_config_exception, "numa policy is set but the host has no NUMA nodes" );
+      std::vector<uint32_t> mem_nodes = all;
+      if( policy == policy_type::bind ) {
+         EOS_ASSERT( std::find( all.begin(), all.end(), node ) != all.end(), plugin_config_exception,
+                     "numa node ${n} has no memory", ("n", node) );
+         mem_nodes = { node };
+      }
+
+      constexpr size_t bits = 8 * sizeof( unsigned long );
+      std::vector<unsigned long> mask( *std::max_element( all.begin(), all.end() ) / bits + 1 );
+      for( auto n : mem_nodes )
+         mask[n / bits] |= 1ul << ( n % bits );
+      const int mode = policy == policy_type::bind ? MPOL_BIND : MPOL_INTERLEAVE;
+      EOS_ASSERT( syscall( SYS_set_mempolicy, mode, mask.data(), mask.size() * bits + 1 ) == 0, plugin_config_exception,
+                  "set_mempolicy failed: ${e}", ("e", strerror( errno )) );
+
+      if( policy == policy_type::bind ) {
+         cpu_set_t cpus;
+         CPU_ZERO( &cpus );
+         for( auto cpu : parse_list( read_line( sys_nodes_dir / ( "node" + std::to_string( node ) ) / "cpulist" ) ) )
+            CPU_SET( cpu, &cpus );
+         EOS_ASSERT( sched_setaffinity( 0, sizeof( cpus ), &cpus ) == 0, plugin_config_exception,
+                     "sched_setaffinity failed: ${e}", ("e", strerror( errno )) );
+      }
+#else
+      EOS_THROW( plugin_config_exception, "numa policy is only supported on Linux" );
+#endif
+   }
+
+   numa_stats numa_stats::read() {
+      numa_stats stats;
+      for( auto n : numa_placement::nodes() ) {
+         std::ifstream in( ( sys_nodes_dir / ( "node" + std::to_string( n ) ) / "numastat" ).generic_string() );
+         std::string name;
+         uint64_t value;
+         while( in >> name >> value ) {
+            if( name == "local_node" ) stats.local_pages += value;
+            else if( name == "other_node" ) stats.remote_pages += value;
+         }
+      }
+      return stats;
+   }
+
+   uint64_t prefault_file( const boost::filesystem::path& file, uint16_t threads ) {
+      const int fd = ::open( file.generic_string().c_str(), O_RDONLY );
+      if( fd < 0 ) return 0;
+      const uint64_t size = boost::filesystem::file_size( file );
+      constexpr uint64_t chunk_size = 64 * 1024 * 1024;
+      constexpr size_t   buffer_size = 1024 * 1024;
+      const uint64_t chunks = ( size + chunk_size - 1 ) / chunk_size;
+
+      std::atomic<uint64_t> next_chunk{ 0 };
+      std::atomic<uint64_t> bytes{ 0 };
+      std::vector<std::thread> readers;
+      for( uint16_t i = 0; i < std::max<uint16_t>( threads, 1 ); ++i ) {
+         readers.emplace_back( [&]() {
+            std::vector<char> buffer( buffer_size );
+            for( uint64_t c; ( c = next_chunk.fetch_add( 1 ) ) < chunks; ) {
+               const uint64_t end = std::min( size, ( c + 1 ) * chunk_size );
+               for( uint64_t pos = c * chunk_size; pos < end; ) {
+                  const auto n = ::pread( fd, buffer.data(), std::min<uint64_t>( buffer_size, end - pos ), pos );
+                  if( n <= 0 ) break;
+                  pos += n;
+                  bytes.fetch_add( n );
+               }
+            }
+         } );
+      }
+      for( auto& r : readers )
+         r.join();
+      ::close( fd );
+      return bytes;
+   }
+
+} } // namespace eosio::chain
@@ -154,6 +154,28 @@ is not allowed to schedule a deferred transaction in which the RAM costs are pai
 unless that account authorized the action;
 but is allowed to execute database operations that increase RAM usage of an account other than the receiver as long as
 either the account authorized the action or the action's net effect on RAM usage for the account is to not increase it.
+*/
+            {}
+         } )
+         (  builtin_protocol_feature_t::rsa_verify_batch, builtin_protocol_feature_spec{
+            "RSA_VERIFY_BATCH",
+            fc::variant("d3d5541cdfc924d4a6b00c955f0dfb0a95eccd02d23c4f722da559bf6deaa443").as<digest_type>(),
+            // SHA256 hash of the raw message below within the comment delimiters (do not modify message below).
+/*
+Builtin protocol feature: RSA_VERIFY_BATCH
+
+Allows contracts to verify several RSA signatures made with one key in a single call.
+*/
+            {}
+         } )
+         (  builtin_protocol_feature_t::secondary_index_batch, builtin_protocol_feature_spec{
+            "SECONDARY_INDEX_BATCH",
+            fc::variant("9a27b53c4310ccab0a2538734196ab302943fef48855f53132f04820c797892e").as<digest_type>(),
+            // SHA256 hash of the raw message below within the comment delimiters (do not modify message below).
+/*
+Builtin protocol feature: SECONDARY_INDEX_BATCH
+
+Allows contracts to read a batch of rows following an iterator of a secondary index in a single call.
 */
             {}
          } )
@@ -466,6 +488,8 @@ either the account authorized the action or the action's net effect on RAM usage
    protocol_feature_manager::protocol_feature_manager( protocol_feature_set&& pfs )
    :_protocol_feature_set( std::move(pfs) )
    {
+      EOS_ASSERT( _protocol_feature_set._recognized_builtin_protocol_features.size() <= 64, protocol_feature_exception,
+                  "builtin protocol features do not fit the activation mask" );
       _builtin_protocol_features.resize( _protocol_feature_set._recognized_builtin_protocol_features.size() );
    }
 
@@ -648,6 +672,7 @@ either the account authorized the action or the action's net effect on RAM usage
       _builtin_protocol_features[indx].previous = _head_of_builtin_activation_list;
       _builtin_protocol_features[indx].activation_block_num = current_block_num;
       _head_of_builtin_activation_list = indx;
+      _activated_builtin_mask |= uint64_t(1) << indx;
    }
 
    void protocol_feature_manager::popped_blocks_to( uint32_t block_num ) {
@@ -657,6 +682,7 @@ either the account authorized the action or the action's net effect on RAM usage
          auto& e = _builtin_protocol_features[_head_of_builtin_activation_list];
          if( e.activation_block_num <= block_num ) break;
 
+         _activated_builtin_mask &= ~(uint64_t(1) << _head_of_builtin_activation_list);
          _head_of_builtin_activation_list = e.previous;
          e.previous = builtin_protocol_feature_entry::no_previous;
          e.activation_block_num = builtin_protocol_feature_entry::not_active;
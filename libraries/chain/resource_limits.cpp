@@ -133,15 +133,16 @@ void resource_limits_manager::add_transaction_usage(const flat_set<account_name>
       int64_t cpu_weight;
       get_account_limits( a, unused, net_weight, cpu_weight );
 
-      _db.modify( usage, [&]( auto& bu ){
-          bu.net_usage.add( net_usage, time_slot, config.account_net_usage_average_window );
-          bu.cpu_usage.add( cpu_usage, time_slot, config.account_cpu_usage_average_window );
-      });
+      // the limits are checked before the usage is written, an exhausted account leaves nothing to undo
+      auto new_net_usage = usage.net_usage;
+      auto new_cpu_usage = usage.cpu_usage;
+      new_net_usage.add( net_usage, time_slot, config.account_net_usage_average_window );
+      new_cpu_usage.add( cpu_usage, time_slot, config.account_cpu_usage_average_window );
 
       if( cpu_weight >= 0 && state.total_cpu_weight > 0 ) {
          uint128_t window_size = config.account_cpu_usage_average_window;
          auto virtual_network_capacity_in_window = (uint128_t)state.virtual_cpu_limit * window_size;
-         auto cpu_used_in_window                 = ((uint128_t)usage.cpu_usage.value_ex * window_size) / (uint128_t)config::rate_limiting_precision;
+         auto cpu_used_in_window                 = ((uint128_t)new_cpu_usage.value_ex * window_size) / (uint128_t)config::rate_limiting_precision;
 
          uint128_t user_weight     = (uint128_t)cpu_weight;
          uint128_t all_user_weight = state.total_cpu_weight;
@@ -160,7 +161,7 @@ void resource_limits_manager::add_transaction_usage(const flat_set<account_name>
 
          uint128_t window_size = config.account_net_usage_average_window;
          auto virtual_network_capacity_in_window = (uint128_t)state.virtual_net_limit * window_size;
-         auto net_used_in_window                 = ((uint128_t)usage.net_usage.value_ex * window_size) / (uint128_t)config::rate_limiting_precision;
+         auto net_used_in_window                 = ((uint128_t)new_net_usage.value_ex * window_size) / (uint128_t)config::rate_limiting_precision;
 
          uint128_t user_weight     = (uint128_t)net_weight;
          uint128_t all_user_weight = state.total_net_weight;
@@ -175,16 +176,23 @@ void resource_limits_manager::add_transaction_usage(const flat_set<account_name>
                      ("max_user_use_in_window",max_user_use_in_window) );
 
       }
+
+      _db.modify( usage, [&]( auto& bu ){
+          bu.net_usage = new_net_usage;
+          bu.cpu_usage = new_cpu_usage;
+      });
    }
 
    // account for this transaction in the block and do not exceed those limits either
+   const uint64_t pending_cpu_usage = state.pending_cpu_usage + cpu_usage;
+   const uint64_t pending_net_usage = state.pending_net_usage + net_usage;
+   EOS_ASSERT( pending_cpu_usage <= config.cpu_limit_parameters.max, block_resource_exhausted, "Block has insufficient cpu resources" );
+   EOS_ASSERT( pending_net_usage <= config.net_limit_parameters.max, block_resource_exhausted, "Block has insufficient net resources" );
+
    _db.modify(state, [&](resource_limits_state_object& rls){
-      rls.pending_cpu_usage += cpu_usage;
-      rls.pending_net_usage += net_usage;
+      rls.pending_cpu_usage = pending_cpu_usage;
+      rls.pending_net_usage = pending_net_usage;
    });
-
-   EOS_ASSERT( state.pending_cpu_usage <= config.cpu_limit_parameters.max, block_resource_exhausted, "Block has insufficient cpu resources" );
-   EOS_ASSERT( state.pending_net_usage <= config.net_limit_parameters.max, block_resource_exhausted, "Block has insufficient net resources" );
 }
 
 void resource_limits_manager::add_pending_ram_usage( const account_name account, int64_t ram_delta ) {
@@ -204,6 +212,20 @@ void resource_limits_manager::add_pending_ram_usage( const account_name account,
    });
 }
 
+void resource_limits_manager::verify_pending_ram_usage( const account_name account, int64_t pending_delta, int64_t ram_delta )const {
+   if (ram_delta == 0) {
+      return;
+   }
+
+   const auto& usage  = _db.get<resource_usage_object,by_owner>( account );
+   const uint64_t ram_usage = usage.ram_usage + pending_delta;
+
+   EOS_ASSERT( ram_delta <= 0 || UINT64_MAX - ram_usage >= (uint64_t)ram_delta, transaction_exception,
+              "Ram usage delta would overflow UINT64_MAX");
+   EOS_ASSERT(ram_delta >= 0 || ram_usage >= (uint64_t)(-ram_delta), transaction_exception,
+              "Ram usage delta would underflow UINT64_MAX");
+}
+
 void resource_limits_manager::verify_account_ram_usage( const account_name account )const {
    int64_t ram_bytes; int64_t net_weight; int64_t cpu_weight;
    get_account_limits( account, ram_bytes, net_weight, cpu_weight );
@@ -307,12 +329,10 @@ void resource_limits_manager::process_account_limit_updates() {
 
    const auto& state = _db.get<resource_limits_state_object>();
    _db.modify(state, [&](resource_limits_state_object& rso){
-      while(!by_owner_index.empty()) {
-         const auto& itr = by_owner_index.lower_bound(boost::make_tuple(true));
-         if (itr == by_owner_index.end() || itr->pending!= true) {
-            break;
-         }
-
+      // pending entries sort after the actual ones, in one pass: removing an entry only invalidates its iterator
+      // and modifying an actual entry does not change its key
+      auto itr = by_owner_index.lower_bound(boost::make_tuple(true));
+      while (itr != by_owner_index.end() && itr->pending) {
          const auto& actual_entry = _db.get<resource_limits_object, by_owner>(boost::make_tuple(false, itr->owner));
          _db.modify(actual_entry, [&](resource_limits_object& rlo){
             update_state_and_value(rso.total_ram_bytes,  rlo.ram_bytes,  itr->ram_bytes, "ram_bytes");
@@ -320,7 +340,9 @@ void resource_limits_manager::process_account_limit_updates() {
             update_state_and_value(rso.total_net_weight, rlo.net_weight, itr->net_weight, "net_weight");
          });
 
-         multi_index.remove(*itr);
+         const auto& pending_entry = *itr;
+         ++itr;
+         multi_index.remove(pending_entry);
       }
    });
 }
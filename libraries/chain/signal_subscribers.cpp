@@ -0,0 +1,93 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/chain/signal_subscribers.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+
+namespace eosio { namespace chain {
+
+//
+// signal_subscribers
+//
+signal_subscribers& signal_subscribers::global() {
+   static signal_subscribers subscribers;
+   return subscribers;
+}
+
+subscriber_stats& signal_subscribers::get( const std::string& name ) {
+   std::lock_guard<std::mutex> g( _mtx );
+   for( auto& s : _stats ) {
+      if( s.name == name ) return s;
+   }
+   _stats.emplace_back( name );
+   return _stats.back();
+}
+
+//
+// async_subscriber
+//
+async_subscriber::async_subscriber( const std::string& name, uint32_t capacity )
+   : _stats( signal_subscribers::global().get( name ) )
+   , _capacity( std::max<uint32_t>( capacity, 1 ) )
+{
+   // short prefix: console_appender shows 9 chars of thread names
+   _thread.emplace( "sig" + name.substr( 0, 3 ), 1 );
+}
+
+async_subscriber::~async_subscriber() {
+   stop();
+}
+
+void async_subscriber::post( std::function<void()> f ) {
+   if( !_running.load( std::memory_order_acquire ) ) {
+      run( f );
+      return;
+   }
+   {
+      std::unique_lock<std::mutex> g( _mtx );
+      if( _queued >= _capacity ) {
+         _stats.full_waits.fetch_add( 1, std::memory_order_relaxed );
+         _room.wait( g, [this]() { return _queued < _capacity; } );
+      }
+      ++_queued;
+      _stats.backlog.store( _queued, std::memory_order_relaxed );
+   }
+   boost::asio::post( _thread->get_executor(), [this, f = std::move( f )]() {
+      run( f );
+      {
+         std::lock_guard<std::mutex> g( _mtx );
+         --_queued;
+         _stats.backlog.store( _queued, std::memory_order_relaxed );
+      }
+      _room.notify_one();
+   } );
+}
+
+void async_subscriber::stop() {
+   if( !_running.exchange( false ) ) return;
+   {
+      std::unique_lock<std::mutex> g( _mtx );
+      _room.wait( g, [this]() { return _queued == 0; } );
+   }
+   _thread->stop();
+}
+
+void async_subscriber::run( const std::function<void()>& f ) {
+   // as controller_impl::emit: a subscriber cannot stop the others
+   try {
+      f();
+   } catch( fc::exception& e ) {
+      wlog( "${n} signal handler: ${details}", ("n", _stats.name)("details", e.to_detail_string()) );
+   } catch( std::exception& e ) {
+      wlog( "${n} signal handler: ${details}", ("n", _stats.name)("details", e.what()) );
+   } catch( ... ) {
+      wlog( "${n} signal handler threw exception", ("n", _stats.name) );
+   }
+}
+
+} } // namespace eosio::chain
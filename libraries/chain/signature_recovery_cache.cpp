@@ -0,0 +1,108 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/chain/signature_recovery_cache.hpp>
+
+#include <boost/functional/hash.hpp>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/member.hpp>
+
+#include <mutex>
+
+namespace eosio { namespace chain {
+
+using namespace boost::multi_index;
+
+namespace {
+   struct recovery_key {
+      digest_type    digest;
+      signature_type sig;
+
+      friend bool operator == ( const recovery_key& a, const recovery_key& b ) {
+         return a.digest == b.digest && a.sig == b.sig;
+      }
+   };
+
+   struct recovery_key_hash {
+      size_t operator()( const recovery_key& k )const {
+         size_t seed = k.digest._hash[0];
+         boost::hash_combine( seed, boost::hash<signature_type>()( k.sig ) );
+         return seed;
+      }
+   };
+
+   struct recovered_key {
+      recovery_key      key;
+      public_key_type   pub_key;
+      fc::microseconds  cpu_usage;
+   };
+
+   struct by_key;
+
+   typedef multi_index_container<
+      recovered_key,
+      indexed_by<
+         sequenced<>,
+         hashed_unique<
+            tag<by_key>,
+            member<recovered_key, recovery_key, &recovered_key::key>,
+            recovery_key_hash
+         >
+      >
+   > recovered_key_index;
+}
+
+struct signature_recovery_cache::shard {
+   std::mutex           mtx;
+   recovered_key_index  keys; ///< least recently used first
+   size_t               max_size = 0;
+};
+
+signature_recovery_cache::signature_recovery_cache( size_t max_size ) {
+   for( auto& s : shards ) {
+      s = std::make_unique<shard>();
+      s->max_size = std::max<size_t>( max_size / shards_count, 1 );
+   }
+}
+
+signature_recovery_cache::~signature_recovery_cache() = default;
+
+signature_recovery_cache& signature_recovery_cache::global() {
+   static signature_recovery_cache cache;
+   return cache;
+}
+
+public_key_type signature_recovery_cache::recover( const signature_type& sig, const digest_type& digest, fc::microseconds* cpu_usage ) {
+   recovery_key key{ digest, sig };
+   // the digest is a hash, its words are uniformly distributed
+   auto& s = *shards[digest._hash[1] % shards_count];
+   {
+      std::lock_guard<std::mutex> g( s.mtx );
+      auto& idx = s.keys.get<by_key>();
+      auto itr = idx.find( key );
+      if( itr != idx.end() ) {
+         s.keys.relocate( s.keys.end(), s.keys.project<0>( itr ) );
+         ++_stats.hits;
+         if( cpu_usage ) *cpu_usage = itr->cpu_usage;
+         return itr->pub_key;
+      }
+   }
+
+   // recover without the lock, a concurrent recovery of the same key inserts it first
+   ++_stats.misses;
+   const auto start = fc::time_point::now();
+   public_key_type pub_key( sig, digest );
+   const auto elapsed = fc::time_point::now() - start;
+   if( cpu_usage ) *cpu_usage = elapsed;
+
+   std::lock_guard<std::mutex> g( s.mtx );
+   s.keys.emplace_back( recovered_key{ std::move( key ), pub_key, elapsed } );
+   while( s.keys.size() > s.max_size )
+      s.keys.pop_front();
+   return pub_key;
+}
+
+} } // namespace eosio::chain
@@ -1,9 +1,29 @@
 #include <eosio/chain/snapshot.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/merkle.hpp>
+#include <eosio/chain/thread_utils.hpp>
 #include <fc/scoped_exit.hpp>
+#include <boost/crc.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <fstream>
 
 namespace eosio { namespace chain {
 
+void snapshot_writer::write_sections( const std::vector<section_parts>& sections ) {
+   for( const auto& s : sections ) {
+      write_section( s.name, [&s]( auto& section ) {
+         for( const auto& part : s.parts ) {
+            part( section );
+         }
+      });
+   }
+}
+
 variant_snapshot_writer::variant_snapshot_writer(fc::mutable_variant_object& snapshot)
 : snapshot(snapshot)
 {
@@ -104,6 +124,12 @@ bool variant_snapshot_reader::read_row( detail::abstract_snapshot_row_reader& ro
    return cur_row < rows.size();
 }
 
+bool variant_snapshot_reader::skip_row( size_t ) {
+   const auto& rows = (*cur_section)["rows"].get_array();
+   EOS_ASSERT(cur_row < rows.size(), snapshot_exception, "Variant snapshot section has no more rows");
+   return ++cur_row < rows.size();
+}
+
 bool variant_snapshot_reader::empty ( ) {
    const auto& rows = (*cur_section)["rows"].get_array();
    return rows.empty();
@@ -327,6 +353,11 @@ bool istream_snapshot_reader::read_row( detail::abstract_snapshot_row_reader& ro
    return ++cur_row < num_rows;
 }
 
+bool istream_snapshot_reader::skip_row( size_t size ) {
+   snapshot.seekg(size, std::ios_base::cur);
+   return ++cur_row < num_rows;
+}
+
 bool istream_snapshot_reader::empty ( ) {
    return num_rows == 0;
 }
@@ -358,4 +389,378 @@ void integrity_hash_snapshot_writer::finalize() {
    // no-op for structural details
 }
 
-}}
\ No newline at end of file
+namespace detail {
+   static fc::sha256 hash_section_part( const std::string& name, const snapshot_writer::section_part& part ) {
+      fc::sha256::encoder enc;
+      enc.write( name.data(), name.size() );
+      integrity_hash_snapshot_writer writer( enc );
+      writer.write_section( name, part );
+      return enc.result();
+   }
+}
+
+tree_integrity_hash_snapshot_writer::tree_integrity_hash_snapshot_writer(uint32_t threads)
+:threads(std::max<uint32_t>(threads, 1))
+{
+}
+
+void tree_integrity_hash_snapshot_writer::write_start_section( const std::string& section_name ) {
+   enc.reset();
+   enc.write( section_name.data(), section_name.size() );
+}
+
+void tree_integrity_hash_snapshot_writer::write_row( const detail::abstract_snapshot_row_writer& row_writer ) {
+   row_writer.write(enc);
+}
+
+void tree_integrity_hash_snapshot_writer::write_end_section( ) {
+   leaves.emplace_back( enc.result() );
+}
+
+void tree_integrity_hash_snapshot_writer::write_sections( const std::vector<section_parts>& sections ) {
+   named_thread_pool pool( "hash", threads );
+
+   std::vector<std::future<fc::sha256>> parts;
+   for( const auto& s : sections ) {
+      for( const auto& part : s.parts ) {
+         parts.emplace_back( async_thread_pool( pool.get_executor(), [&s, &part]() {
+            return detail::hash_section_part( s.name, part );
+         }));
+      }
+   }
+   for( auto& p : parts ) {
+      leaves.emplace_back( p.get() );
+   }
+}
+
+fc::sha256 tree_integrity_hash_snapshot_writer::finalize()const {
+   return merkle( leaves );
+}
+
+
+namespace detail {
+   /// collects the rows of one section part
+   class buffer_snapshot_writer : public snapshot_writer {
+      public:
+         void write_start_section( const std::string& ) override {}
+
+         void write_row( const abstract_snapshot_row_writer& row_writer ) override {
+            buffer_wrapper out(data);
+            row_writer.write(out);
+            row_count++;
+         }
+
+         void write_end_section( ) override {}
+
+         std::vector<char> data;
+         uint64_t          row_count = 0;
+         uint64_t          uncompressed_size = 0;
+   };
+
+   namespace bio = boost::iostreams;
+
+   static uint32_t chunk_crc( const char* data, size_t size ) {
+      boost::crc_32_type crc;
+      crc.process_bytes( data, size );
+      return crc.checksum();
+   }
+}
+
+chunked_snapshot_writer::chunked_snapshot_writer(std::ostream& snapshot, uint32_t threads, bool compress)
+:snapshot(snapshot)
+,threads(std::max<uint32_t>(threads, 1))
+,compress(compress)
+{
+   auto totem = magic_number;
+   snapshot.write((char*)&totem, sizeof(totem));
+
+   auto v = version;
+   snapshot.write((char*)&v, sizeof(v));
+}
+
+void chunked_snapshot_writer::write_start_section( const std::string& name ) {
+   EOS_ASSERT(section_name.empty(), snapshot_exception, "Attempting to write a new section without closing the previous section");
+   EOS_ASSERT(!name.empty(), snapshot_exception, "Snapshot section name cannot be empty");
+   section_name = name;
+   section_data.clear();
+   row_count = 0;
+   section_has_chunk = false;
+}
+
+void chunked_snapshot_writer::write_row( const detail::abstract_snapshot_row_writer& row_writer ) {
+   const auto restore = section_data.size();
+   try {
+      detail::buffer_wrapper out(section_data);
+      row_writer.write(out);
+   } catch (...) {
+      section_data.resize(restore);
+      throw;
+   }
+   row_count++;
+
+   if( section_data.size() >= max_chunk_size ) {
+      append_chunk(section_name, section_data, row_count, encode_chunk(section_data));
+      section_data.clear();
+      row_count = 0;
+      section_has_chunk = true;
+   }
+}
+
+void chunked_snapshot_writer::write_end_section( ) {
+   if( row_count || !section_has_chunk ) {
+      append_chunk(section_name, section_data, row_count, encode_chunk(section_data));
+   }
+   section_name.clear();
+   section_data.clear();
+   row_count = 0;
+}
+
+void chunked_snapshot_writer::write_sections( const std::vector<section_parts>& sections ) {
+   using result_t = std::unique_ptr<detail::buffer_snapshot_writer>;
+   named_thread_pool pool( "snap", threads );
+
+   std::deque<std::pair<const std::string*, std::future<result_t>>> in_flight;
+   const auto append_first = [&]() {
+      const auto* name = in_flight.front().first;
+      auto result = std::move(in_flight.front().second);
+      in_flight.pop_front();
+      auto part = result.get();
+      append_chunk(*name, part->data, part->row_count, part->uncompressed_size);
+   };
+
+   try {
+      for( const auto& s : sections ) {
+         EOS_ASSERT(!s.parts.empty(), snapshot_exception, "Snapshot section ${n} has no parts", ("n", s.name));
+         for( const auto& part : s.parts ) {
+            if( in_flight.size() >= 2 * threads ) {
+               append_first();
+            }
+            in_flight.emplace_back( &s.name, async_thread_pool( pool.get_executor(), [this, &s, &part]() {
+               auto writer = std::make_unique<detail::buffer_snapshot_writer>();
+               writer->write_section(s.name, part);
+               writer->uncompressed_size = encode_chunk(writer->data);
+               return writer;
+            }));
+         }
+      }
+      while( !in_flight.empty() ) {
+         append_first();
+      }
+   } catch( ... ) {
+      // parts refer to the sections, they must be done before unwinding
+      for( auto& f : in_flight ) {
+         f.second.wait();
+      }
+      throw;
+   }
+}
+
+uint64_t chunked_snapshot_writer::encode_chunk( std::vector<char>& data )const {
+   if( !compress || data.empty() ) return 0;
+
+   std::vector<char> compressed;
+   compressed.reserve( data.size() / 4 );
+   detail::bio::filtering_ostream comp;
+   comp.push( detail::bio::zlib_compressor( detail::bio::zlib::default_compression ) );
+   comp.push( detail::bio::back_inserter( compressed ) );
+   detail::bio::write( comp, data.data(), data.size() );
+   detail::bio::close( comp );
+
+   const uint64_t size = data.size();
+   data = std::move( compressed );
+   return size;
+}
+
+void chunked_snapshot_writer::append_chunk( const std::string& name, const std::vector<char>& data, uint64_t rows, uint64_t uncompressed_size ) {
+   detail::snapshot_chunk chunk;
+   chunk.section_name = name;
+   chunk.offset = snapshot.tellp();
+   chunk.size = data.size();
+   chunk.row_count = rows;
+   chunk.crc = detail::chunk_crc(data.data(), data.size());
+   snapshot.write(data.data(), data.size());
+   chunks.emplace_back(std::move(chunk));
+   uncompressed_sizes.push_back(uncompressed_size);
+}
+
+void chunked_snapshot_writer::finalize() {
+   EOS_ASSERT(section_name.empty(), snapshot_exception, "Attempting to finalize a snapshot with an open section");
+   uint64_t index_pos = snapshot.tellp();
+   fc::raw::pack(snapshot, chunks);
+   fc::raw::pack(snapshot, uncompressed_sizes);
+   snapshot.write((char*)&index_pos, sizeof(index_pos));
+}
+
+mapped_snapshot_reader::mapped_snapshot_reader(const fc::path& snapshot_path)
+:file(snapshot_path.generic_string().c_str(), boost::interprocess::read_only)
+,region(file, boost::interprocess::read_only)
+{
+   const auto* data = static_cast<const char*>(region.get_address());
+   const auto size = region.get_size();
+   const size_t header_size = sizeof(chunked_snapshot_writer::magic_number) + sizeof(chunked_snapshot_writer::version);
+   EOS_ASSERT(size >= header_size + sizeof(uint64_t), snapshot_exception, "Chunked snapshot is too small");
+
+   uint64_t index_pos = 0;
+   memcpy(&index_pos, data + size - sizeof(index_pos), sizeof(index_pos));
+   EOS_ASSERT(index_pos >= header_size && index_pos <= size - sizeof(index_pos), snapshot_exception,
+              "Chunked snapshot has an invalid index position ${p}", ("p", index_pos));
+
+   memcpy(&file_version, data + sizeof(chunked_snapshot_writer::magic_number), sizeof(file_version));
+
+   fc::datastream<const char*> ds(data + index_pos, size - sizeof(index_pos) - index_pos);
+   fc::raw::unpack(ds, chunks);
+   if( file_version >= 2 ) {
+      fc::raw::unpack(ds, uncompressed_sizes);
+      EOS_ASSERT(uncompressed_sizes.size() == chunks.size(), snapshot_exception,
+                 "Chunked snapshot index has ${s} sizes for ${c} chunks", ("s", uncompressed_sizes.size())("c", chunks.size()));
+   } else {
+      uncompressed_sizes.resize(chunks.size());
+   }
+   for( const auto& c : chunks ) {
+      EOS_ASSERT(c.offset >= header_size && c.offset <= index_pos && c.size <= index_pos - c.offset, snapshot_exception,
+                 "Chunked snapshot section ${n} is out of the file", ("n", c.section_name));
+   }
+}
+
+bool mapped_snapshot_reader::is_chunked_snapshot(const fc::path& snapshot_path) {
+   std::ifstream in(snapshot_path.generic_string(), std::ios::in | std::ios::binary);
+   uint32_t totem = 0;
+   in.read((char*)&totem, sizeof(totem));
+   return in && totem == chunked_snapshot_writer::magic_number;
+}
+
+void mapped_snapshot_reader::validate() const {
+   const auto* data = static_cast<const char*>(region.get_address());
+
+   uint32_t actual_totem = 0;
+   memcpy(&actual_totem, data, sizeof(actual_totem));
+   EOS_ASSERT(actual_totem == chunked_snapshot_writer::magic_number, snapshot_exception,
+              "Chunked snapshot has unexpected magic number!");
+
+   uint32_t actual_version = 0;
+   memcpy(&actual_version, data + sizeof(actual_totem), sizeof(actual_version));
+   EOS_ASSERT(actual_version >= chunked_snapshot_writer::min_supported_version && actual_version <= chunked_snapshot_writer::version,
+              snapshot_exception,
+              "Chunked snapshot is an unsuppored version.  Expected : [${min},${max}], Got: ${actual}",
+              ("min", chunked_snapshot_writer::min_supported_version)("max", chunked_snapshot_writer::version)("actual", actual_version));
+
+   const auto threads = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), chunks.size()));
+   named_thread_pool pool( "snap", threads );
+   std::vector<std::future<void>> checks;
+   for( size_t t = 0; t < threads; ++t ) {
+      checks.emplace_back( async_thread_pool( pool.get_executor(), [this, data, t, threads]() {
+         for( size_t i = t; i < chunks.size(); i += threads ) {
+            const auto& c = chunks[i];
+            EOS_ASSERT(detail::chunk_crc(data + c.offset, c.size) == c.crc, snapshot_exception,
+                       "Chunked snapshot section ${n} at ${o} is corrupted", ("n", c.section_name)("o", c.offset));
+         }
+      }));
+   }
+   for( auto& c : checks ) {
+      c.get();
+   }
+}
+
+bool mapped_snapshot_reader::has_section( const string& section_name ) {
+   return std::any_of(chunks.begin(), chunks.end(), [&]( const auto& c ) { return c.section_name == section_name; });
+}
+
+void mapped_snapshot_reader::set_section( const string& section_name ) {
+   auto first = std::find_if(chunks.begin(), chunks.end(), [&]( const auto& c ) { return c.section_name == section_name; });
+   EOS_ASSERT(first != chunks.end(), snapshot_exception, "Chunked snapshot has no section named ${n}", ("n", section_name));
+   auto last = std::find_if(first, chunks.end(), [&]( const auto& c ) { return c.section_name != section_name; });
+
+   cur_chunk = first - chunks.begin();
+   end_chunk = last - chunks.begin();
+   rows_left = 0;
+   for( auto i = cur_chunk; i < end_chunk; ++i ) {
+      rows_left += chunks[i].row_count;
+   }
+   open_chunk();
+}
+
+void mapped_snapshot_reader::open_chunk() {
+   while( cur_chunk < end_chunk && chunks[cur_chunk].row_count == 0 ) {
+      ++cur_chunk;
+   }
+   if( cur_chunk == end_chunk ) {
+      chunk_rows_left = 0;
+      chunk_stream = fc::datastream<const char*>(nullptr, 0);
+      return;
+   }
+   const auto& c = chunks[cur_chunk];
+   chunk_rows_left = c.row_count;
+   if( !uncompressed_sizes[cur_chunk] ) {
+      chunk_stream = fc::datastream<const char*>(static_cast<const char*>(region.get_address()) + c.offset, c.size);
+      return;
+   }
+
+   if( prefetch.valid() && prefetched == cur_chunk ) {
+      chunk_data = prefetch.get();
+   } else {
+      chunk_data = inflate_chunk(cur_chunk);
+   }
+   chunk_stream = fc::datastream<const char*>(chunk_data.data(), chunk_data.size());
+   // sections are read in the order they are written, the next chunk is most likely read next
+   prefetch_chunk(cur_chunk + 1);
+}
+
+std::vector<char> mapped_snapshot_reader::inflate_chunk( size_t chunk )const {
+   const auto& c = chunks[chunk];
+   std::vector<char> result;
+   result.reserve(uncompressed_sizes[chunk]);
+   detail::bio::filtering_ostream decomp;
+   decomp.push( detail::bio::zlib_decompressor() );
+   decomp.push( detail::bio::back_inserter( result ) );
+   detail::bio::write( decomp, static_cast<const char*>(region.get_address()) + c.offset, c.size );
+   detail::bio::close( decomp );
+   EOS_ASSERT(result.size() == uncompressed_sizes[chunk], snapshot_exception,
+              "Chunked snapshot section ${n} at ${o} inflates to ${s} bytes instead of ${e}",
+              ("n", c.section_name)("o", c.offset)("s", result.size())("e", uncompressed_sizes[chunk]));
+   return result;
+}
+
+void mapped_snapshot_reader::prefetch_chunk( size_t chunk ) {
+   if( prefetch.valid() ) {
+      prefetch.wait();
+      prefetch = std::future<std::vector<char>>();
+   }
+   if( chunk < chunks.size() && uncompressed_sizes[chunk] ) {
+      prefetched = chunk;
+      prefetch = std::async( std::launch::async, [this, chunk]() { return inflate_chunk(chunk); } );
+   }
+}
+
+bool mapped_snapshot_reader::read_row( detail::abstract_snapshot_row_reader& row_reader ) {
+   EOS_ASSERT(rows_left > 0, snapshot_exception, "Chunked snapshot section has no more rows");
+   row_reader.provide(chunk_stream);
+   --rows_left;
+   if( --chunk_rows_left == 0 ) {
+      ++cur_chunk;
+      open_chunk();
+   }
+   return rows_left > 0;
+}
+
+bool mapped_snapshot_reader::skip_row( size_t size ) {
+   EOS_ASSERT(rows_left > 0, snapshot_exception, "Chunked snapshot section has no more rows");
+   chunk_stream.skip(size);
+   --rows_left;
+   if( --chunk_rows_left == 0 ) {
+      ++cur_chunk;
+      open_chunk();
+   }
+   return rows_left > 0;
+}
+
+bool mapped_snapshot_reader::empty ( ) {
+   return rows_left == 0;
+}
+
+void mapped_snapshot_reader::clear_section() {
+   cur_chunk = end_chunk = 0;
+   rows_left = chunk_rows_left = 0;
+   chunk_stream = fc::datastream<const char*>(nullptr, 0);
+}
+
+}}
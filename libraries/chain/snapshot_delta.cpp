@@ -0,0 +1,272 @@
+#include <eosio/chain/snapshot_delta.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <fc/io/fstream.hpp>
+#include <algorithm>
+#include <fstream>
+
+namespace eosio { namespace chain {
+
+namespace detail {
+   void section_delta::add_op( op_kind kind, uint64_t count ) {
+      if( !count ) return;
+      if( !ops.empty() && ops.back().kind == kind ) {
+         ops.back().count += count;
+      } else {
+         ops.push_back( op{ kind, count } );
+      }
+   }
+
+   snapshot_digest::row digest_row( const std::vector<char>& packed_row ) {
+      return { fc::sha256::hash( packed_row.data(), packed_row.size() )._hash[0], static_cast<uint32_t>(packed_row.size()) };
+   }
+}
+
+snapshot_digest snapshot_digest::from_file( const fc::path& path ) {
+   std::string content;
+   fc::read_file_contents( path, content );
+   snapshot_digest result;
+   fc::datastream<const char*> ds( content.data(), content.size() );
+   fc::raw::unpack( ds, result );
+   return result;
+}
+
+void snapshot_digest::to_file( const fc::path& path )const {
+   std::ofstream out( path.generic_string(), std::ios::out | std::ios::binary | std::ios::trunc );
+   detail::ostream_wrapper wrapper( out );
+   fc::raw::pack( wrapper, *this );
+   out.flush();
+   EOS_ASSERT( out.good(), snapshot_exception, "Cannot write snapshot digest ${p}", ("p", path.generic_string()) );
+}
+
+void digest_snapshot_writer::write_start_section( const std::string& section_name ) {
+   result.sections.push_back( { section_name, {} } );
+}
+
+void digest_snapshot_writer::write_row( const detail::abstract_snapshot_row_writer& row_writer ) {
+   row.clear();
+   detail::buffer_wrapper out( row );
+   row_writer.write( out );
+   result.sections.back().rows.push_back( detail::digest_row( row ) );
+}
+
+void digest_snapshot_writer::write_end_section( ) {
+   // no-op for structural details
+}
+
+delta_snapshot_writer::delta_snapshot_writer(std::ostream& delta, const snapshot_digest& base)
+:delta(delta)
+,base(base)
+{
+   // write magic number
+   auto totem = magic_number;
+   this->delta.write((char*)&totem, sizeof(totem));
+
+   // write version
+   auto ver = version;
+   this->delta.write((char*)&ver, sizeof(ver));
+}
+
+void delta_snapshot_writer::write_start_section( const std::string& section_name ) {
+   result.sections.push_back( { section_name, {} } );
+   sections.emplace_back();
+   sections.back().name = section_name;
+
+   base_section = nullptr;
+   base_positions.clear();
+   base_pos = 0;
+   auto itr = std::find_if( base.sections.begin(), base.sections.end(), [&]( const auto& s ) { return s.name == section_name; } );
+   if( itr == base.sections.end() ) return;
+
+   base_section = &*itr;
+   for( uint32_t i = 0; i < base_section->rows.size(); ++i ) {
+      if( base_section->rows[i].size >= min_resync_row_size ) {
+         base_positions[base_section->rows[i].hash].push_back( i );
+      }
+   }
+}
+
+void delta_snapshot_writer::write_row( const detail::abstract_snapshot_row_writer& row_writer ) {
+   row.clear();
+   detail::buffer_wrapper out( row );
+   row_writer.write( out );
+   enc.write( row.data(), row.size() );
+
+   const auto digest = detail::digest_row( row );
+   result.sections.back().rows.push_back( digest );
+
+   auto& section = sections.back();
+   ++section.row_count;
+
+   if( base_section ) {
+      const auto& base_rows = base_section->rows;
+      if( base_pos < base_rows.size() && base_rows[base_pos] == digest ) {
+         section.add_op( detail::section_delta::keep, 1 );
+         ++base_pos;
+         return;
+      }
+
+      // a row further in the base section, the base rows in between were modified or removed
+      auto itr = base_positions.find( digest.hash );
+      if( digest.size >= min_resync_row_size && itr != base_positions.end() ) {
+         const auto& positions = itr->second;
+         auto pos = std::lower_bound( positions.begin(), positions.end(), base_pos );
+         if( pos != positions.end() && base_rows[*pos] == digest ) {
+            for( auto i = base_pos; i < *pos; ++i ) {
+               section.dropped_sizes.push_back( base_rows[i].size );
+            }
+            section.add_op( detail::section_delta::drop, *pos - base_pos );
+            section.add_op( detail::section_delta::keep, 1 );
+            base_pos = *pos + 1;
+            return;
+         }
+      }
+   }
+
+   section.add_op( detail::section_delta::insert, 1 );
+   section.rows.insert( section.rows.end(), row.begin(), row.end() );
+}
+
+void delta_snapshot_writer::write_end_section( ) {
+   // trailing base rows are not read
+   base_section = nullptr;
+   base_positions.clear();
+}
+
+void delta_snapshot_writer::finalize() {
+   fc::raw::pack( delta, enc.result() );
+   fc::raw::pack( delta, sections );
+}
+
+delta_snapshot_reader::delta_snapshot_reader(snapshot_reader_ptr base, const fc::path& delta_path)
+:base(std::move(base))
+{
+   std::string content;
+   fc::read_file_contents( delta_path, content );
+
+   uint32_t totem = 0;
+   uint32_t ver = 0;
+   EOS_ASSERT( content.size() >= sizeof(totem) + sizeof(ver), snapshot_exception,
+               "Delta snapshot ${p} is truncated", ("p", delta_path.generic_string()) );
+   memcpy( &totem, content.data(), sizeof(totem) );
+   memcpy( &ver, content.data() + sizeof(totem), sizeof(ver) );
+   EOS_ASSERT( totem == delta_snapshot_writer::magic_number, snapshot_exception,
+               "Delta snapshot has unexpected magic number!" );
+   EOS_ASSERT( ver == delta_snapshot_writer::version, snapshot_exception,
+               "Delta snapshot is an unsuppored version.  Expected : ${expected}, Got: ${actual}",
+               ("expected", delta_snapshot_writer::version)("actual", ver) );
+
+   fc::datastream<const char*> ds( content.data() + sizeof(totem) + sizeof(ver), content.size() - sizeof(totem) - sizeof(ver) );
+   fc::raw::unpack( ds, integrity_hash );
+   fc::raw::unpack( ds, sections );
+}
+
+bool delta_snapshot_reader::is_delta_snapshot(const fc::path& delta_path) {
+   std::ifstream in(delta_path.generic_string(), std::ios::in | std::ios::binary);
+   uint32_t totem = 0;
+   in.read((char*)&totem, sizeof(totem));
+   return in && totem == delta_snapshot_writer::magic_number;
+}
+
+void delta_snapshot_reader::validate() const {
+   base->validate();
+
+   for( const auto& s : sections ) {
+      uint64_t produced = 0, dropped = 0, inserted = 0;
+      for( const auto& op : s.ops ) {
+         EOS_ASSERT( op.kind <= detail::section_delta::insert, snapshot_exception,
+                     "Delta snapshot section ${n} has an unknown operation ${k}", ("n", s.name)("k", op.kind) );
+         if( op.kind == detail::section_delta::drop ) {
+            dropped += op.count;
+         } else {
+            produced += op.count;
+            if( op.kind == detail::section_delta::insert ) inserted += op.count;
+         }
+      }
+      EOS_ASSERT( produced == s.row_count, snapshot_exception,
+                  "Delta snapshot section ${n} has ${p} rows instead of ${c}", ("n", s.name)("p", produced)("c", s.row_count) );
+      EOS_ASSERT( dropped == s.dropped_sizes.size(), snapshot_exception,
+                  "Delta snapshot section ${n} drops ${d} rows but has ${s} sizes", ("n", s.name)("d", dropped)("s", s.dropped_sizes.size()) );
+      EOS_ASSERT( inserted == 0 || !s.rows.empty(), snapshot_exception,
+                  "Delta snapshot section ${n} inserts ${i} rows but stores none", ("n", s.name)("i", inserted) );
+   }
+}
+
+bool delta_snapshot_reader::has_section( const string& section_name ) {
+   return std::any_of( sections.begin(), sections.end(), [&]( const auto& s ) { return s.name == section_name; } );
+}
+
+void delta_snapshot_reader::set_section( const string& section_name ) {
+   auto itr = std::find_if( sections.begin(), sections.end(), [&]( const auto& s ) { return s.name == section_name; } );
+   EOS_ASSERT( itr != sections.end(), snapshot_exception, "Delta snapshot has no section named ${n}", ("n", section_name) );
+
+   cur_section = &*itr;
+   const bool reads_base = std::any_of( cur_section->ops.begin(), cur_section->ops.end(), []( const auto& op ) {
+      return op.kind != detail::section_delta::insert;
+   });
+   if( reads_base ) {
+      EOS_ASSERT( base->has_section( section_name ), snapshot_exception,
+                  "Delta snapshot section ${n} is not in its base snapshot", ("n", section_name) );
+      base->set_section( section_name );
+      base_open = true;
+   }
+   cur_op = 0;
+   op_left = cur_section->ops.empty() ? 0 : cur_section->ops.front().count;
+   cur_drop = 0;
+   rows_left = cur_section->row_count;
+   rows = fc::datastream<const char*>( cur_section->rows.data(), cur_section->rows.size() );
+}
+
+template<typename KeepF, typename InsertF>
+bool delta_snapshot_reader::next_row( KeepF&& keep, InsertF&& insert ) {
+   EOS_ASSERT( rows_left > 0, snapshot_exception, "Delta snapshot section has no more rows" );
+   while( true ) {
+      while( op_left == 0 ) {
+         ++cur_op;
+         EOS_ASSERT( cur_op < cur_section->ops.size(), snapshot_exception,
+                     "Delta snapshot section ${n} has no more operations", ("n", cur_section->name) );
+         op_left = cur_section->ops[cur_op].count;
+      }
+      --op_left;
+      switch( cur_section->ops[cur_op].kind ) {
+         case detail::section_delta::drop:
+            base->skip_row( cur_section->dropped_sizes.at( cur_drop++ ) );
+            continue;
+         case detail::section_delta::keep:
+            keep();
+            break;
+         default:
+            insert();
+            break;
+      }
+      return --rows_left > 0;
+   }
+}
+
+bool delta_snapshot_reader::read_row( detail::abstract_snapshot_row_reader& row_reader ) {
+   return next_row( [&]() { base->read_row( row_reader ); },
+                    [&]() { row_reader.provide( rows ); } );
+}
+
+bool delta_snapshot_reader::skip_row( size_t size ) {
+   return next_row( [&]() { base->skip_row( size ); },
+                    [&]() { rows.skip( size ); } );
+}
+
+bool delta_snapshot_reader::empty ( ) {
+   return cur_section->row_count == 0;
+}
+
+void delta_snapshot_reader::clear_section() {
+   if( base_open ) {
+      base->clear_section();
+      base_open = false;
+   }
+   cur_section = nullptr;
+   cur_op = 0;
+   op_left = 0;
+   cur_drop = 0;
+   rows_left = 0;
+   rows = fc::datastream<const char*>( nullptr, 0 );
+}
+
+}}
@@ -0,0 +1,57 @@
+#include <eosio/chain/snapshot_manifest.hpp>
+#include <eosio/chain/block_header.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/merkle.hpp>
+#include <fstream>
+
+namespace eosio { namespace chain {
+
+uint32_t snapshot_manifest::block_num()const {
+   return block_header::num_from_id( block_id );
+}
+
+uint32_t snapshot_manifest::chunk_count()const {
+   if( chunk_size == 0 ) return 0;
+   return static_cast<uint32_t>( ( size + chunk_size - 1 ) / chunk_size );
+}
+
+uint32_t snapshot_manifest::chunk_length( uint32_t index )const {
+   const auto offset = chunk_offset( index );
+   if( offset >= size ) return 0;
+   return static_cast<uint32_t>( std::min<uint64_t>( chunk_size, size - offset ) );
+}
+
+bool snapshot_manifest::valid()const {
+   if( size == 0 || chunk_size == 0 || chunk_size > max_chunk_size ) return false;
+   if( ( size + chunk_size - 1 ) / chunk_size != chunk_hashes.size() ) return false;
+   return merkle( chunk_hashes ) == root;
+}
+
+bool snapshot_manifest::verify_chunk( uint32_t index, const char* data, size_t length )const {
+   if( index >= chunk_hashes.size() || length != chunk_length( index ) ) return false;
+   return digest_type::hash( data, length ) == chunk_hashes[index];
+}
+
+snapshot_manifest snapshot_manifest::compute( const fc::path& path, const block_id_type& block_id, uint32_t chunk_size ) {
+   EOS_ASSERT( chunk_size > 0 && chunk_size <= max_chunk_size, snapshot_exception,
+               "snapshot chunk size ${s} is not between 1 and ${m}", ("s", chunk_size)("m", max_chunk_size) );
+   std::ifstream in( path.generic_string(), std::ios::in | std::ios::binary );
+   EOS_ASSERT( in.good(), snapshot_exception, "cannot open snapshot ${p}", ("p", path.generic_string()) );
+
+   snapshot_manifest result;
+   result.block_id = block_id;
+   result.chunk_size = chunk_size;
+   std::vector<char> chunk( chunk_size );
+   while( in ) {
+      in.read( chunk.data(), chunk.size() );
+      const auto length = static_cast<size_t>( in.gcount() );
+      if( length == 0 ) break;
+      result.chunk_hashes.emplace_back( digest_type::hash( chunk.data(), length ) );
+      result.size += length;
+   }
+   EOS_ASSERT( in.eof(), snapshot_exception, "error reading snapshot ${p}", ("p", path.generic_string()) );
+   result.root = merkle( result.chunk_hashes );
+   return result;
+}
+
+} }
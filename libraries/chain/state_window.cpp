@@ -0,0 +1,94 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/chain/state_window.hpp>
+#include <eosio/chain/exceptions.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+namespace eosio { namespace chain {
+
+   namespace bip = boost::interprocess;
+
+   static_assert( std::atomic<uint64_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free, "window atomics are shared between processes" );
+
+   struct state_window::mapping {
+      bip::file_mapping  file;
+      bip::mapped_region region;
+   };
+
+   state_window::state_window( const boost::filesystem::path& file, bool writer )
+   : writer( writer ) {
+      const bool created = boost::filesystem::exists( file ) && boost::filesystem::file_size( file ) >= sizeof( header_type );
+      if( writer && !created ) {
+         // not truncated when it exists: readers of a previous run may still map it
+         std::ofstream out( file.generic_string(), std::ios::binary | std::ios::trunc );
+         const header_type empty;
+         out.write( reinterpret_cast<const char*>( &empty ), sizeof( empty ) );
+         EOS_ASSERT( out.good(), database_exception, "cannot create state window file ${f}", ("f", file.generic_string()) );
+      } else {
+         EOS_ASSERT( created, database_exception, "state window file ${f} is not created by a writer", ("f", file.generic_string()) );
+      }
+      _mapping.reset( new mapping{ bip::file_mapping( file.generic_string().c_str(), bip::read_write ) } );
+      _mapping->region = bip::mapped_region( _mapping->file, bip::read_write, 0, sizeof( header_type ) );
+      header = static_cast<header_type*>( _mapping->region.get_address() );
+      if( writer ) {
+         header->magic = magic;
+         header->readers.store( 0 );
+         if( header->sequence.load() % 2 == 1 ) // the previous writer did not close its last window
+            header->sequence.fetch_add( 1 );
+      } else {
+         EOS_ASSERT( header->magic == magic, database_exception, "state window file ${f} is corrupted", ("f", file.generic_string()) );
+      }
+   }
+
+   state_window::~state_window() {
+      if( writer && header && header->sequence.load() % 2 == 1 )
+         close_window( fc::time_point::now() );
+   }
+
+   void state_window::open_window( fc::time_point deadline, uint32_t head_block_num ) {
+      header->head_block_num.store( head_block_num );
+      header->window_end.store( deadline.time_since_epoch().count() );
+      header->sequence.fetch_add( 1 );
+   }
+
+   uint32_t state_window::close_window( fc::time_point overdue ) {
+      const auto end = header->window_end.load();
+      while( header->waiting.load() > 0 && fc::time_point::now().time_since_epoch().count() < end )
+         std::this_thread::yield();
+      header->sequence.fetch_add( 1 );
+      uint32_t readers;
+      while( (readers = header->readers.load()) > 0 && fc::time_point::now() < overdue )
+         std::this_thread::yield();
+      return readers;
+   }
+
+   uint32_t state_window::waiting_readers()const {
+      return header->waiting.load();
+   }
+
+   bool state_window::try_enter() {
+      const auto seq = header->sequence.load();
+      if( seq % 2 == 0 || fc::time_point::now().time_since_epoch().count() >= header->window_end.load() )
+         return false;
+      header->readers.fetch_add( 1 );
+      if( header->sequence.load() == seq )
+         return true;
+      header->readers.fetch_sub( 1 );
+      return false;
+   }
+
+   void state_window::wait_for_window() {
+      std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+   }
+
+} } // namespace eosio::chain
@@ -4,10 +4,81 @@
  */
 
 #include <eosio/chain/thread_utils.hpp>
+#include <eosio/chain/exceptions.hpp>
 #include <fc/log/logger_config.hpp>
+#include <fc/time.hpp>
+
+#include <map>
+#include <mutex>
+
+#include <pthread.h>
+#include <time.h>
 
 namespace eosio { namespace chain {
 
+namespace {
+
+   struct registered_thread {
+      std::string name;
+      clockid_t   clock;
+   };
+
+   struct thread_registry {
+      std::mutex                              mtx;
+      uint64_t                                next_id = 1;
+      std::map<uint64_t, registered_thread>   threads;
+   };
+
+   thread_registry& registry() {
+      static thread_registry r;
+      return r;
+   }
+
+   /// scheduler and index of the worker running on this thread
+   thread_local const void* current_scheduler = nullptr;
+   thread_local size_t      current_worker = 0;
+
+   int64_t now_us() {
+      return fc::time_point::now().time_since_epoch().count();
+   }
+
+}
+
+//
+// thread_cpu_registration
+//
+thread_cpu_registration::thread_cpu_registration( std::string name ) {
+#ifdef __linux__
+   clockid_t clock;
+   if( pthread_getcpuclockid( pthread_self(), &clock ) != 0 ) return;
+   auto& r = registry();
+   std::lock_guard<std::mutex> g( r.mtx );
+   _id = r.next_id++;
+   r.threads.emplace( _id, registered_thread{ std::move( name ), clock } );
+#endif
+}
+
+thread_cpu_registration::~thread_cpu_registration() {
+   if( !_id ) return;
+   auto& r = registry();
+   std::lock_guard<std::mutex> g( r.mtx );
+   r.threads.erase( _id );
+}
+
+std::vector<thread_cpu_time> thread_cpu_times() {
+   std::vector<thread_cpu_time> times;
+   auto& r = registry();
+   // under the lock: a clock is valid only while its thread runs, threads unregister before exiting
+   std::lock_guard<std::mutex> g( r.mtx );
+   times.reserve( r.threads.size() );
+   for( const auto& t : r.threads ) {
+      timespec ts;
+      if( clock_gettime( t.second.clock, &ts ) != 0 ) continue;
+      times.push_back( { t.second.name, uint64_t( ts.tv_sec ) * 1000000 + ts.tv_nsec / 1000 } );
+   }
+   return times;
+}
+
 
 //
 // named_thread_pool
@@ -20,6 +91,7 @@ named_thread_pool::named_thread_pool( std::string name_prefix, size_t num_thread
       boost::asio::post( _thread_pool, [&ioc = _ioc, name_prefix, i]() {
          std::string tn = name_prefix + "-" + std::to_string( i );
          fc::set_os_thread_name( tn );
+         thread_cpu_registration cpu( tn );
          ioc.run();
       } );
    }
@@ -37,4 +109,180 @@ void named_thread_pool::stop() {
 }
 
 
-} } // eosio::chain
\ No newline at end of file
+//
+// task_scheduler
+//
+const char* to_string( task_priority p ) {
+   switch( p ) {
+      case task_priority::consensus:   return "consensus";
+      case task_priority::block_apply: return "block_apply";
+      case task_priority::net:         return "net";
+      case task_priority::api:         return "api";
+      case task_priority::history:     return "history";
+   }
+   return "unknown";
+}
+
+task_scheduler::task_scheduler( std::string name_prefix, size_t num_threads )
+: _workers( new worker[max_workers] )
+{
+   add_workers( name_prefix, num_threads );
+}
+
+task_scheduler::~task_scheduler() {
+   stop();
+}
+
+void task_scheduler::add_workers( const std::string& name_prefix, size_t num_threads ) {
+   std::lock_guard<std::mutex> g( _mtx );
+   EOS_ASSERT( !_stopping, misc_exception, "task scheduler is stopped" );
+   const size_t first = _worker_count.load( std::memory_order_relaxed );
+   EOS_ASSERT( first + num_threads <= max_workers, misc_exception,
+               "task scheduler cannot have more than ${max} workers", ("max", max_workers) );
+   for( size_t i = 0; i < num_threads; ++i ) {
+      const size_t index = first + i;
+      _threads.emplace_back( [this, index, tn = name_prefix + "-" + std::to_string( i )]() {
+         fc::set_os_thread_name( tn );
+         thread_cpu_registration cpu( tn );
+         run( index );
+      } );
+   }
+   // queues of the new workers are empty, they may be stolen from once counted
+   _worker_count.store( first + num_threads, std::memory_order_release );
+}
+
+void task_scheduler::post( task_priority priority, std::function<void()> task ) {
+   const size_t count = workers();
+   EOS_ASSERT( count > 0, misc_exception, "task scheduler has no workers" );
+   const size_t index = current_scheduler == this ? current_worker
+                                                  : _next_worker.fetch_add( 1, std::memory_order_relaxed ) % count;
+   const auto p = static_cast<size_t>( priority );
+   {
+      auto& w = _workers[index];
+      std::lock_guard<std::mutex> g( w.mtx );
+      w.queues[p].push_back( { std::move( task ), now_us() } );
+   }
+   _counters[p].submitted.fetch_add( 1, std::memory_order_relaxed );
+   {
+      std::lock_guard<std::mutex> g( _mtx );
+      ++_pending;
+   }
+   _cv.notify_one();
+}
+
+bool task_scheduler::take( size_t index, queued_task& t, task_priority& priority ) {
+   const size_t count = workers();
+   for( size_t p = 0; p < task_priority_count; ++p ) {
+      for( size_t i = 0; i < count; ++i ) {
+         const size_t victim = ( index + i ) % count;
+         auto& w = _workers[victim];
+         {
+            std::lock_guard<std::mutex> g( w.mtx );
+            auto& q = w.queues[p];
+            if( q.empty() ) continue;
+            t = std::move( q.front() );
+            q.pop_front();
+         }
+         priority = static_cast<task_priority>( p );
+         if( victim != index ) _counters[p].stolen.fetch_add( 1, std::memory_order_relaxed );
+         std::lock_guard<std::mutex> g( _mtx );
+         --_pending;
+         return true;
+      }
+   }
+   return false;
+}
+
+void task_scheduler::run( size_t index ) {
+   current_scheduler = this;
+   current_worker = index;
+   while( true ) {
+      {
+         std::unique_lock<std::mutex> lock( _mtx );
+         // asleep while every queue is empty
+         _cv.wait( lock, [this]() { return _stopping || _pending > 0; } );
+         if( _stopping ) return;
+      }
+      queued_task t;
+      task_priority priority;
+      // taken by another worker in the meantime, waits for the next one
+      if( !take( index, t, priority ) ) continue;
+
+      auto& c = _counters[static_cast<size_t>( priority )];
+      const auto start = now_us();
+      c.wait_us.fetch_add( start - t.queued_us, std::memory_order_relaxed );
+      try {
+         t.task();
+      } FC_LOG_AND_DROP()
+      c.busy_us.fetch_add( now_us() - start, std::memory_order_relaxed );
+      c.executed.fetch_add( 1, std::memory_order_relaxed );
+   }
+}
+
+std::vector<task_class_stats> task_scheduler::stats()const {
+   std::vector<task_class_stats> result( task_priority_count );
+   for( size_t p = 0; p < task_priority_count; ++p ) {
+      const auto& c = _counters[p];
+      auto& s = result[p];
+      s.priority = static_cast<task_priority>( p );
+      s.executed = c.executed.load( std::memory_order_relaxed );
+      s.submitted = c.submitted.load( std::memory_order_relaxed );
+      s.stolen = c.stolen.load( std::memory_order_relaxed );
+      s.queued = s.submitted > s.executed ? s.submitted - s.executed : 0;
+      s.wait_us = c.wait_us.load( std::memory_order_relaxed );
+      s.busy_us = c.busy_us.load( std::memory_order_relaxed );
+   }
+   return result;
+}
+
+void task_scheduler::stop() {
+   {
+      std::lock_guard<std::mutex> g( _mtx );
+      if( _stopping ) return;
+      _stopping = true;
+   }
+   _cv.notify_all();
+   for( auto& t : _threads ) {
+      if( t.joinable() ) t.join();
+   }
+   // tasks left hold futures and shared state of their submitters, drop them now as an io_context does on stop
+   const size_t count = _worker_count.load( std::memory_order_acquire );
+   for( size_t i = 0; i < count; ++i ) {
+      for( auto& q : _workers[i].queues ) q.clear();
+   }
+}
+
+
+//
+// task_executor
+//
+task_executor::task_executor( task_scheduler& scheduler, task_priority priority )
+: _scheduler( &scheduler )
+, _priority( priority )
+, _state( std::make_shared<state>() )
+{
+}
+
+void task_executor::cancel() {
+   std::unique_lock<std::mutex> lock( _state->mtx );
+   _state->cancelled = true;
+   _state->cv.wait( lock, [this]() { return _state->running == 0; } );
+}
+
+bool task_executor::state::enter() {
+   std::lock_guard<std::mutex> g( mtx );
+   if( cancelled ) return false;
+   ++running;
+   return true;
+}
+
+void task_executor::state::leave() {
+   {
+      std::lock_guard<std::mutex> g( mtx );
+      --running;
+   }
+   cv.notify_all();
+}
+
+
+} } // eosio::chain
@@ -4,8 +4,62 @@
  */
 #include <eosio/chain/trace.hpp>
 
+#include <mutex>
+
 namespace eosio { namespace chain {
 
+namespace {
+   class transaction_trace_pool {
+      public:
+         static constexpr size_t max_pooled = 256;
+         static constexpr size_t max_pooled_actions = 64; ///< larger action_traces are freed, not kept
+
+         transaction_trace* take() {
+            {
+               std::lock_guard<std::mutex> g( mtx );
+               if( !pooled.empty() ) {
+                  auto t = pooled.back();
+                  pooled.pop_back();
+                  return t;
+               }
+            }
+            return new transaction_trace();
+         }
+
+         void release( transaction_trace* t ) {
+            // reset outside of the lock, it may release a failed_dtrx_trace
+            auto action_traces = std::move( t->action_traces );
+            *t = transaction_trace();
+            if( action_traces.capacity() <= max_pooled_actions ) {
+               action_traces.clear();
+               t->action_traces = std::move( action_traces );
+            }
+            {
+               std::lock_guard<std::mutex> g( mtx );
+               if( pooled.size() < max_pooled ) {
+                  pooled.push_back( t );
+                  return;
+               }
+            }
+            delete t;
+         }
+
+      private:
+         std::mutex                       mtx;
+         std::vector<transaction_trace*>  pooled;
+   };
+
+   // never destroyed, traces may be released by static destructors
+   transaction_trace_pool& trace_pool() {
+      static auto* pool = new transaction_trace_pool();
+      return *pool;
+   }
+}
+
+transaction_trace_ptr make_transaction_trace() {
+   return transaction_trace_ptr( trace_pool().take(), []( transaction_trace* t ) { trace_pool().release( t ); } );
+}
+
 action_trace::action_trace(
    const transaction_trace& trace, const action& act, account_name receiver, bool context_free,
    uint32_t action_ordinal, uint32_t creator_action_ordinal, uint32_t closest_unnotified_ancestor_action_ordinal
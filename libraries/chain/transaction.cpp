@@ -6,50 +6,19 @@
 #include <fc/bitutil.hpp>
 #include <fc/smart_ref_impl.hpp>
 #include <algorithm>
-#include <mutex>
 
 #include <boost/range/adaptor/transformed.hpp>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/sequenced_index.hpp>
-#include <boost/multi_index/hashed_index.hpp>
-#include <boost/multi_index/member.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/device/back_inserter.hpp>
 #include <boost/iostreams/filter/zlib.hpp>
 
 #include <eosio/chain/config.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/signature_recovery_cache.hpp>
 #include <eosio/chain/transaction.hpp>
 
 namespace eosio { namespace chain {
 
-using namespace boost::multi_index;
-
-struct cached_pub_key {
-   transaction_id_type trx_id;
-   public_key_type pub_key;
-   signature_type sig;
-   fc::microseconds cpu_usage;
-   cached_pub_key(const cached_pub_key&) = delete;
-   cached_pub_key() = delete;
-   cached_pub_key& operator=(const cached_pub_key&) = delete;
-   cached_pub_key(cached_pub_key&&) = default;
-};
-struct by_sig{};
-
-typedef multi_index_container<
-   cached_pub_key,
-   indexed_by<
-      sequenced<>,
-      hashed_unique<
-         tag<by_sig>,
-         member<cached_pub_key,
-                signature_type,
-                &cached_pub_key::sig>
-      >
-   >
-> recovery_cache_type;
-
 void deferred_transaction_generation_context::reflector_init() {
       static_assert( fc::raw::has_feature_reflector_init_on_unpacked_reflected_types,
                      "deferred_transaction_generation_context expects FC to support reflector_init" );
@@ -99,37 +68,21 @@ fc::microseconds transaction::get_signature_keys( const vector<signature_type>&
 { try {
    using boost::adaptors::transformed;
 
-   constexpr size_t recovery_cache_size = 10000;
-   static recovery_cache_type recovery_cache;
-   static std::mutex cache_mtx;
-
    auto start = fc::time_point::now();
    recovered_pub_keys.clear();
    const digest_type digest = sig_digest(chain_id, cfd);
 
-   std::unique_lock<std::mutex> lock(cache_mtx, std::defer_lock);
+   auto& recovery_cache = signature_recovery_cache::global();
    fc::microseconds sig_cpu_usage;
    const auto digest_time = fc::time_point::now() - start;
    for(const signature_type& sig : signatures) {
       auto sig_start = fc::time_point::now();
       EOS_ASSERT( sig_start < deadline, tx_cpu_usage_exceeded, "transaction signature verification executed for too long",
                   ("now", sig_start)("deadline", deadline)("start", start) );
-      public_key_type recov;
-      const auto& tid = id();
-      lock.lock();
-      recovery_cache_type::index<by_sig>::type::iterator it = recovery_cache.get<by_sig>().find( sig );
-      if( it == recovery_cache.get<by_sig>().end() || it->trx_id != tid ) {
-         lock.unlock();
-         recov = public_key_type( sig, digest );
-         fc::microseconds cpu_usage = fc::time_point::now() - sig_start;
-         lock.lock();
-         recovery_cache.emplace_back( cached_pub_key{tid, recov, sig, cpu_usage} ); //could fail on dup signatures; not a problem
-         sig_cpu_usage += cpu_usage;
-      } else {
-         recov = it->pub_key;
-         sig_cpu_usage += it->cpu_usage;
-      }
-      lock.unlock();
+      // a cached recovery is billed the time it took when it was done
+      fc::microseconds cpu_usage;
+      const public_key_type recov = recovery_cache.recover( sig, digest, &cpu_usage );
+      sig_cpu_usage += cpu_usage;
       bool successful_insertion = false;
       std::tie(std::ignore, successful_insertion) = recovered_pub_keys.insert(recov);
       EOS_ASSERT( allow_duplicate_keys || successful_insertion, tx_duplicate_sig,
@@ -137,11 +90,6 @@ fc::microseconds transaction::get_signature_keys( const vector<signature_type>&
                   ("key", recov) );
    }
 
-   lock.lock();
-   while ( recovery_cache.size() > recovery_cache_size )
-      recovery_cache.erase( recovery_cache.begin());
-   lock.unlock();
-
    return sig_cpu_usage + digest_time;
 } FC_CAPTURE_AND_RETHROW() }
 
@@ -284,11 +232,6 @@ static vector<bytes> zlib_decompress_context_free_data(const bytes& data) {
    return unpack_context_free_data(out);
 }
 
-static transaction zlib_decompress_transaction(const bytes& data) {
-   bytes out = zlib_decompress(data);
-   return unpack_transaction(out);
-}
-
 static bytes pack_transaction(const transaction& t) {
    return fc::raw::pack(t);
 }
@@ -314,8 +257,7 @@ static bytes zlib_compress_context_free_data(const vector<bytes>& cfd ) {
    return out;
 }
 
-static bytes zlib_compress_transaction(const transaction& t) {
-   bytes in = pack_transaction(t);
+static bytes zlib_compress_transaction(const bytes& in) {
    bytes out;
    bio::filtering_ostream comp;
    comp.push(bio::zlib_compressor(bio::zlib::best_compression));
@@ -325,18 +267,9 @@ static bytes zlib_compress_transaction(const transaction& t) {
    return out;
 }
 
-bytes packed_transaction::get_raw_transaction() const
+const bytes& packed_transaction::get_raw_transaction() const
 {
-   try {
-      switch(compression) {
-         case none:
-            return packed_trx;
-         case zlib:
-            return zlib_decompress(packed_trx);
-         default:
-            EOS_THROW(unknown_transaction_compression, "Unknown transaction compression algorithm");
-      }
-   } FC_CAPTURE_AND_RETHROW((compression)(packed_trx))
+   return compression == none ? packed_trx : raw_trx;
 }
 
 packed_transaction::packed_transaction( bytes&& packed_txn, vector<signature_type>&& sigs, bytes&& packed_cfd, compression_type _compression )
@@ -392,11 +325,13 @@ void packed_transaction::local_unpack_transaction(vector<bytes>&& context_free_d
             unpacked_trx = signed_transaction( unpack_transaction( packed_trx ), signatures, std::move(context_free_data) );
             break;
          case zlib:
-            unpacked_trx = signed_transaction( zlib_decompress_transaction( packed_trx ), signatures, std::move(context_free_data) );
+            raw_trx = zlib_decompress( packed_trx );
+            unpacked_trx = signed_transaction( unpack_transaction( raw_trx ), signatures, std::move(context_free_data) );
             break;
          default:
             EOS_THROW( unknown_transaction_compression, "Unknown transaction compression algorithm" );
       }
+      trx_id = unpacked_trx.id();
    } FC_CAPTURE_AND_RETHROW( (compression) )
 }
 
@@ -425,11 +360,15 @@ void packed_transaction::local_pack_transaction()
             packed_trx = pack_transaction(unpacked_trx);
             break;
          case zlib:
-            packed_trx = zlib_compress_transaction(unpacked_trx);
+            raw_trx = pack_transaction(unpacked_trx);
+            packed_trx = zlib_compress_transaction(raw_trx);
             break;
          default:
             EOS_THROW(unknown_transaction_compression, "Unknown transaction compression algorithm");
       }
+      // the id is the digest of these very bytes, as packed by transaction::id
+      const auto& raw = get_raw_transaction();
+      trx_id = digest_type::hash( raw.data(), raw.size() );
    } FC_CAPTURE_AND_RETHROW((compression))
 }
 
@@ -19,6 +19,12 @@
 
 #include <chrono>
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
 namespace eosio { namespace chain {
 
 namespace bacc = boost::accumulators;
@@ -83,6 +89,33 @@ namespace bacc = boost::accumulators;
    volatile sig_atomic_t deadline_timer_verify::hit;
    static deadline_timer_verify deadline_timer_verification;
 
+#ifdef __linux__
+   /// SIGALRM timer of the calling thread, delivered to that thread with the address of its deadline_timer::expired
+   struct thread_timer {
+      thread_timer() {
+         struct sigevent sev = {};
+         sev.sigev_notify = SIGEV_THREAD_ID;
+         sev.sigev_signo = SIGALRM;
+         sev._sigev_un._tid = static_cast<pid_t>(syscall(SYS_gettid));
+         sev.sigev_value.sival_ptr = const_cast<sig_atomic_t*>(&deadline_timer::expired);
+         created = timer_create(CLOCK_MONOTONIC, &sev, &id) == 0;
+      }
+      ~thread_timer() {
+         if(created)
+            timer_delete(id);
+      }
+
+      /// nullptr if the timer cannot be created
+      static const timer_t* get() {
+         static thread_local thread_timer timer;
+         return timer.created ? &timer.id : nullptr;
+      }
+
+      timer_t id;
+      bool    created = false;
+   };
+#endif
+
    deadline_timer::deadline_timer() {
       if(initialized)
          return;
@@ -94,16 +127,18 @@ namespace bacc = boost::accumulators;
          ("mean", (int)bacc::mean(deadline_timer_verification.samples))("stddev", (int)sqrt(bacc::variance(deadline_timer_verification.samples))) \
          ("t", deadline_timer_verification.timer_overhead)
 
+#ifdef __linux__
       if(deadline_timer_verification.use_deadline_timer) {
          struct sigaction act;
-         act.sa_handler = timer_expired;
+         act.sa_sigaction = timer_expired;
          sigemptyset(&act.sa_mask);
-         act.sa_flags = 0;
+         act.sa_flags = SA_SIGINFO;
          if(sigaction(SIGALRM, &act, NULL) == 0) {
             ilog("Using ${t}us deadline timer for checktime: " TIMER_STATS_FORMAT, TIMER_STATS);
             return;
          }
       }
+#endif
 
       wlog("Using polled checktime; deadline timer too inaccurate: " TIMER_STATS_FORMAT, TIMER_STATS);
       deadline_timer_verification.use_deadline_timer = false; //set in case sigaction() fails above
@@ -119,31 +154,47 @@ namespace bacc = boost::accumulators;
          return;
       }
       microseconds x = tp.time_since_epoch() - fc::time_point::now().time_since_epoch();
-      if(x.count() <= deadline_timer_verification.timer_overhead)
+      if(x.count() <= deadline_timer_verification.timer_overhead) {
          expired = 1;
-      else {
-         struct itimerval enable = {{0, 0}, {0, (int)x.count()-deadline_timer_verification.timer_overhead}};
-         expired = 0;
-         if(setitimer(ITIMER_REAL, &enable, NULL))
-            expired = 1;
+         return;
+      }
+#ifdef __linux__
+      const auto timer = thread_timer::get();
+      if(!timer) {
+         expired = 1;
+         return;
       }
+      const auto us = x.count() - deadline_timer_verification.timer_overhead;
+      struct itimerspec enable = {{0, 0}, {us / 1000000, (us % 1000000) * 1000}};
+      expired = 0;
+      if(timer_settime(*timer, 0, &enable, NULL))
+         expired = 1;
+#else
+      expired = 1;
+#endif
    }
 
    void deadline_timer::stop() {
       if(expired)
          return;
-      struct itimerval disable = {{0, 0}, {0, 0}};
-      setitimer(ITIMER_REAL, &disable, NULL);
+#ifdef __linux__
+      if(const auto timer = thread_timer::get()) {
+         struct itimerspec disable = {{0, 0}, {0, 0}};
+         timer_settime(*timer, 0, &disable, NULL);
+      }
+#endif
    }
 
    deadline_timer::~deadline_timer() {
       stop();
    }
 
-   void deadline_timer::timer_expired(int) {
-      expired = 1;
+   void deadline_timer::timer_expired(int, siginfo_t* info, void*) {
+      // the flag of the thread that armed the timer, without touching thread locals in the handler
+      if(info && info->si_value.sival_ptr)
+         *static_cast<volatile sig_atomic_t*>(info->si_value.sival_ptr) = 1;
    }
-   volatile sig_atomic_t deadline_timer::expired = 0;
+   thread_local volatile sig_atomic_t deadline_timer::expired = 0;
    bool deadline_timer::initialized = false;
 
    transaction_context::transaction_context( controller& c,
@@ -154,14 +205,11 @@ namespace bacc = boost::accumulators;
    ,trx(t)
    ,id(trx_id)
    ,undo_session()
-   ,trace(std::make_shared<transaction_trace>())
+   ,trace(make_transaction_trace())
    ,start(s)
    ,net_usage(trace->net_usage)
    ,pseudo_start(s)
    {
-      if (!c.skip_db_sessions()) {
-         undo_session = c.mutable_db().start_undo_session(true);
-      }
       trace->id = id;
       trace->block_num = c.head_block_num() + 1;
       trace->block_time = c.pending_block_time();
@@ -252,6 +300,9 @@ namespace bacc = boost::accumulators;
 
       validate_ram_usage.reserve( bill_to_accounts.size() );
 
+      // Nothing was written so far, a transaction rejected above did not pay for a session
+      start_undo_session();
+
       // Update usage values of accounts to reflect new time
       rl.update_account_usage( bill_to_accounts, block_timestamp_type(control.pending_block_time()).slot );
 
@@ -366,6 +417,33 @@ namespace bacc = boost::accumulators;
          record_transaction( id, trx.expiration ); /// checks for dupes
    }
 
+   void transaction_context::init_for_read_only_trx()
+   {
+      EOS_ASSERT( !is_initialized, transaction_exception, "cannot initialize twice" );
+      EOS_ASSERT( trx.delay_sec.value == 0, transaction_exception, "read-only transactions cannot be delayed" );
+
+      published = control.pending_block_time();
+      read_only = true;
+      start_undo_session( true );
+      validate_referenced_accounts( trx, false );
+
+      net_limit = std::numeric_limits<uint64_t>::max();
+      eager_net_limit = net_limit;
+      net_limit_due_to_block = false;
+
+      _deadline = deadline;
+      objective_duration_limit = _deadline - start;
+      initial_objective_duration_limit = objective_duration_limit;
+      billing_timer_duration_limit = objective_duration_limit;
+      deadline_exception_code = deadline_exception::code_value;
+      billing_timer_exception_code = deadline_exception::code_value;
+
+      checktime(); // Fail early if deadline has already been exceeded
+      _deadline_timer.start(_deadline);
+
+      is_initialized = true;
+   }
+
    void transaction_context::init_for_deferred_trx( fc::time_point p )
    {
 ///@{
@@ -388,6 +466,8 @@ namespace bacc = boost::accumulators;
    void transaction_context::exec() {
       EOS_ASSERT( is_initialized, transaction_exception, "must first initialize" );
 
+      trace->action_traces.reserve( trace->action_traces.size() + trx.context_free_actions.size() + trx.actions.size() );
+
       if( apply_context_free ) {
          for( const auto& act : trx.context_free_actions ) {
             schedule_action( act, act.account, true, 0, 0 );
@@ -424,6 +504,10 @@ namespace bacc = boost::accumulators;
       }
 
       auto& rl = control.get_mutable_resource_limits_manager();
+      for( const auto& p : pending_ram_usage ) {
+         rl.add_pending_ram_usage( p.first, p.second );
+      }
+      pending_ram_usage.clear();
       for( auto a : validate_ram_usage ) {
          rl.verify_account_ram_usage( a );
       }
@@ -466,8 +550,15 @@ namespace bacc = boost::accumulators;
                                 block_timestamp_type(control.pending_block_time()).slot ); // Should never fail
    }
 
+   void transaction_context::start_undo_session( bool force ) {
+      if( !undo_session && (force || !control.skip_db_sessions()) ) {
+         undo_session = control.mutable_db().start_undo_session(true);
+      }
+   }
+
    void transaction_context::squash() {
       if (undo_session) undo_session->squash();
+      if (recorded_expiration) control.record_transaction( id, *recorded_expiration );
    }
 
    void transaction_context::undo() {
@@ -596,8 +687,11 @@ namespace bacc = boost::accumulators;
    }
 
    void transaction_context::add_ram_usage( account_name account, int64_t ram_delta ) {
-      auto& rl = control.get_mutable_resource_limits_manager();
-      rl.add_pending_ram_usage( account, ram_delta );
+      const auto& rl = control.get_resource_limits_manager();
+      auto& pending = pending_ram_usage[account];
+      // same overflow and underflow checks as if every delta were applied immediately
+      rl.verify_pending_ram_usage( account, pending, ram_delta );
+      pending += ram_delta;
       if( ram_delta > 0 ) {
          validate_ram_usage.insert( account );
       }
@@ -651,6 +745,15 @@ namespace bacc = boost::accumulators;
       return std::make_tuple(account_net_limit, account_cpu_limit, greylisted_net, greylisted_cpu);
    }
 
+   void transaction_context::record_action_counters( uint32_t action_ordinal, uint32_t db_calls, uint64_t arena_allocations ) {
+      if( action_db_intrinsic_calls.size() < action_ordinal ) {
+         action_db_intrinsic_calls.resize( action_ordinal );
+         action_arena_allocations.resize( action_ordinal );
+      }
+      action_db_intrinsic_calls[action_ordinal-1] = db_calls;
+      action_arena_allocations[action_ordinal-1] = arena_allocations;
+   }
+
    action_trace& transaction_context::get_action_trace( uint32_t action_ordinal ) {
       EOS_ASSERT( 0 < action_ordinal && action_ordinal <= trace->action_traces.size() ,
                   transaction_exception,
@@ -701,7 +804,9 @@ namespace bacc = boost::accumulators;
    {
       uint32_t new_action_ordinal = trace->action_traces.size() + 1;
 
-      trace->action_traces.reserve( new_action_ordinal );
+      // grown geometrically, every notification of an action schedules one
+      if( trace->action_traces.capacity() < new_action_ordinal )
+         trace->action_traces.reserve( std::max<size_t>( new_action_ordinal, 2 * trace->action_traces.capacity() ) );
 
       const action& provided_action = get_action_trace( action_ordinal ).act;
 
@@ -749,17 +854,10 @@ namespace bacc = boost::accumulators;
    }
 
    void transaction_context::record_transaction( const transaction_id_type& id, fc::time_point_sec expire ) {
-      try {
-          control.mutable_db().create<transaction_object>([&](transaction_object& transaction) {
-              transaction.trx_id = id;
-              transaction.expiration = expire;
-          });
-      } catch( const boost::interprocess::bad_alloc& ) {
-         throw;
-      } catch ( ... ) {
-          EOS_ASSERT( false, tx_duplicate,
-                     "duplicate transaction ${id}", ("id", id ) );
-      }
+      EOS_ASSERT( !control.is_known_unexpired_transaction( id ), tx_duplicate,
+                  "duplicate transaction ${id}", ("id", id ) );
+      // recorded by squash, so a failed transaction leaves nothing to undo
+      recorded_expiration = expire;
    } /// record_transaction
 
    void transaction_context::validate_referenced_accounts( const transaction& trx, bool enforce_actor_whitelist_blacklist )const {
@@ -1,6 +1,6 @@
 #include <eosio/chain/transaction_metadata.hpp>
 #include <eosio/chain/thread_utils.hpp>
-#include <boost/asio/thread_pool.hpp>
+#include <atomic>
 
 namespace eosio { namespace chain {
 
@@ -26,7 +26,7 @@ recovery_keys_type transaction_metadata::recover_keys( const chain_id_type& chai
 }
 
 signing_keys_future_type transaction_metadata::start_recover_keys( const transaction_metadata_ptr& mtrx,
-                                                                   boost::asio::io_context& thread_pool,
+                                                                   const task_executor& thread_pool,
                                                                    const chain_id_type& chain_id,
                                                                    fc::microseconds time_limit )
 {
@@ -50,5 +50,59 @@ signing_keys_future_type transaction_metadata::start_recover_keys( const transac
    return mtrx->signing_keys_future;
 }
 
+void transaction_metadata::start_recover_keys( const std::vector<transaction_metadata_ptr>& mtrxs,
+                                               const task_executor& thread_pool,
+                                               const chain_id_type& chain_id,
+                                               fc::microseconds time_limit,
+                                               size_t batch_size,
+                                               std::function<void()> done )
+{
+   using promise_type = std::promise<signing_keys_future_value_type>;
+   using batch_type = std::vector<std::pair<std::weak_ptr<transaction_metadata>, promise_type>>;
+
+   std::vector<batch_type> batches;
+   for( const auto& mtrx : mtrxs ) {
+      if( mtrx->signing_keys_future.valid() && std::get<0>( mtrx->signing_keys_future.get() ) == chain_id ) // already created
+         continue;
+      if( batches.empty() || batches.back().size() >= std::max<size_t>( batch_size, 1 ) )
+         batches.emplace_back();
+      promise_type p;
+      mtrx->signing_keys_future = p.get_future().share();
+      batches.back().emplace_back( mtrx, std::move( p ) );
+   }
+
+   if( batches.empty() ) {
+      done();
+      return;
+   }
+
+   auto remaining = std::make_shared<std::atomic<size_t>>( batches.size() );
+   auto on_done = std::make_shared<std::function<void()>>( std::move( done ) );
+   for( auto& batch : batches ) {
+      // promises are move only, share the batch with the task which std::function requires to be copyable
+      auto b = std::make_shared<batch_type>( std::move( batch ) );
+      thread_pool.post( [b, remaining, on_done, time_limit, chain_id]() {
+         for( auto& e : *b ) {
+            try {
+               fc::time_point deadline = time_limit == fc::microseconds::maximum() ?
+                                         fc::time_point::maximum() : fc::time_point::now() + time_limit;
+               auto mtrx = e.first.lock();
+               fc::microseconds cpu_usage;
+               flat_set<public_key_type> recovered_pub_keys;
+               if( mtrx ) {
+                  const signed_transaction& trn = mtrx->packed_trx->get_signed_transaction();
+                  cpu_usage = trn.get_signature_keys( chain_id, deadline, recovered_pub_keys );
+               }
+               e.second.set_value( std::make_tuple( chain_id, cpu_usage, std::move( recovered_pub_keys ) ) );
+            } catch( ... ) {
+               e.second.set_exception( std::current_exception() );
+            }
+         }
+         if( --*remaining == 0 )
+            (*on_done)();
+      } );
+   }
+}
+
 
 } } // eosio::chain
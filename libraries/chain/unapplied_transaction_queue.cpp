@@ -0,0 +1,72 @@
+#include <eosio/chain/unapplied_transaction_queue.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <fc/io/fstream.hpp>
+#include <fc/io/raw.hpp>
+#include <fstream>
+
+namespace eosio { namespace chain {
+
+void unapplied_transaction_queue::add( const transaction_metadata_ptr& trx ) {
+   unapplied_transaction ut{ trx->signed_id, trx->packed_trx->expiration(), trx };
+   auto& idx = queue.get<by_signed_id>();
+   auto itr = idx.find( trx->signed_id );
+   if( itr == idx.end() ) {
+      idx.insert( std::move( ut ) );
+   } else {
+      idx.replace( itr, std::move( ut ) );
+   }
+}
+
+size_t unapplied_transaction_queue::clear_expired( const fc::time_point& pending_block_time ) {
+   auto& idx = queue.get<by_expiry>();
+   auto last = idx.lower_bound( pending_block_time );
+   size_t n = std::distance( idx.begin(), last );
+   idx.erase( idx.begin(), last );
+   return n;
+}
+
+void unapplied_transaction_queue::write_to( const fc::path& path )const {
+   std::vector<packed_transaction> trxs;
+   trxs.reserve( queue.size() );
+   for( const auto& ut : queue.get<by_signed_id>() )
+      trxs.push_back( *ut.trx_meta->packed_trx );
+
+   std::ofstream out( path.generic_string(), std::ios::out | std::ios::binary | std::ios::trunc );
+   auto totem = magic_number;
+   out.write( (char*)&totem, sizeof(totem) );
+   auto ver = version;
+   out.write( (char*)&ver, sizeof(ver) );
+   const auto packed = fc::raw::pack( trxs );
+   out.write( packed.data(), packed.size() );
+   out.flush();
+   EOS_ASSERT( out.good(), chain_exception, "Cannot write unapplied transactions to ${p}", ("p", path.generic_string()) );
+}
+
+std::vector<transaction_metadata_ptr> unapplied_transaction_queue::read_from( const fc::path& path ) {
+   std::string content;
+   fc::read_file_contents( path, content );
+
+   uint32_t totem = 0;
+   uint32_t ver = 0;
+   EOS_ASSERT( content.size() >= sizeof(totem) + sizeof(ver), chain_exception,
+               "Unapplied transactions file ${p} is truncated", ("p", path.generic_string()) );
+   memcpy( &totem, content.data(), sizeof(totem) );
+   memcpy( &ver, content.data() + sizeof(totem), sizeof(ver) );
+   EOS_ASSERT( totem == magic_number, chain_exception,
+               "Unapplied transactions file ${p} has unexpected magic number", ("p", path.generic_string()) );
+   EOS_ASSERT( ver == version, chain_exception,
+               "Unapplied transactions file ${p} is an unsupported version.  Expected : ${expected}, Got: ${actual}",
+               ("p", path.generic_string())("expected", version)("actual", ver) );
+
+   std::vector<packed_transaction> trxs;
+   fc::datastream<const char*> ds( content.data() + sizeof(totem) + sizeof(ver), content.size() - sizeof(totem) - sizeof(ver) );
+   fc::raw::unpack( ds, trxs );
+
+   std::vector<transaction_metadata_ptr> result;
+   result.reserve( trxs.size() );
+   for( auto& trx : trxs )
+      result.push_back( std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( std::move( trx ) ) ) );
+   return result;
+}
+
+} } // eosio::chain
@@ -10,6 +10,7 @@
 #include <eosio/chain/wasm_interface_private.hpp>
 #include <eosio/chain/wasm_eosio_validation.hpp>
 #include <eosio/chain/wasm_eosio_injection.hpp>
+#include <eosio/chain/webassembly/native_float.hpp>
 #include <eosio/chain/global_property_object.hpp>
 #include <eosio/chain/protocol_state_object.hpp>
 #include <eosio/chain/account_object.hpp>
@@ -24,18 +25,51 @@
 #include <compiler_builtins.hpp>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
+#include <algorithm>
+#include <deque>
 #include <fstream>
+#include <map>
+#include <mutex>
 #include <string.h>
 
 namespace eosio { namespace chain {
    using namespace webassembly;
    using namespace webassembly::common;
 
-   wasm_interface::wasm_interface(vm_type vm, const chainbase::database& d) : my( new wasm_interface_impl(vm, d) ) {}
+   namespace {
+      /**
+       * Code that passed validate(), by hash. Setcode is validated again whenever its transaction is applied
+       * (speculatively, when producing and when validating the block), but the result depends on the chain state only
+       * through the whitelisted intrinsics, so only the imports need to be checked again.
+       */
+      struct validated_code {
+         bool                      depth_checked = false; ///< the nesting depth is checked only when producing
+         std::vector<std::string>  imports;
+      };
+
+      constexpr size_t                       max_validated_codes = 64;
+      std::mutex                             validated_codes_mutex;
+      std::map<digest_type, validated_code>  validated_codes;
+      std::deque<digest_type>                validated_codes_order; ///< oldest first
+   }
+
+   wasm_interface::wasm_interface(vm_type vm, const chainbase::database& d, const fc::path& cache_dir, uint64_t cache_size) : my( new wasm_interface_impl(vm, d, cache_dir, cache_size) ) {}
 
    wasm_interface::~wasm_interface() {}
 
-   void wasm_interface::validate(const controller& control, const bytes& code) {
+   void wasm_interface::validate(const controller& control, const bytes& code, const digest_type& code_hash) {
+      const auto& pso = control.db().get<protocol_state_object>();
+      const bool check_depth = control.is_producing_block();
+      {
+         std::lock_guard<std::mutex> lock(validated_codes_mutex);
+         auto itr = validated_codes.find(code_hash);
+         if( itr != validated_codes.end() && (itr->second.depth_checked || !check_depth) &&
+             std::all_of(itr->second.imports.begin(), itr->second.imports.end(), [&](const std::string& name) {
+                return is_intrinsic_whitelisted( pso.whitelisted_intrinsics, name );
+             }) )
+            return;
+      }
+
       Module module;
       try {
          Serialization::MemoryInputStream stream((U8*)code.data(), code.size());
@@ -49,11 +83,23 @@ namespace eosio { namespace chain {
       wasm_validations::wasm_binary_validation validator(control, module);
       validator.validate();
 
-      const auto& pso = control.db().get<protocol_state_object>();
-
       root_resolver resolver( pso.whitelisted_intrinsics );
       LinkResult link_result = linkModule(module, resolver);
 
+      validated_code result{check_depth};
+      for( const auto& import : module.functions.imports )
+         result.imports.push_back( import.exportName );
+      std::lock_guard<std::mutex> lock(validated_codes_mutex);
+      auto inserted = validated_codes.emplace(code_hash, validated_code());
+      inserted.first->second = std::move(result);
+      if( inserted.second ) {
+         validated_codes_order.push_back(code_hash);
+         if( validated_codes_order.size() > max_validated_codes ) {
+            validated_codes.erase(validated_codes_order.front());
+            validated_codes_order.pop_front();
+         }
+      }
+
       //there are a couple opportunties for improvement here--
       //Easy: Cache the Module created here so it can be reused for instantiaion
       //Hard: Kick off instantiation in a separate thread at this location
@@ -71,6 +117,11 @@ namespace eosio { namespace chain {
       my->current_lib(lib);
    }
 
+   void wasm_interface::prepare(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, const bytes& code,
+                                uint32_t block_num, const task_executor& thread_pool) {
+      my->prepare(code_hash, vm_type, vm_version, code, block_num, thread_pool);
+   }
+
    void wasm_interface::apply( const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, apply_context& context ) {
       my->get_instantiated_module(code_hash, vm_type, vm_version, context.trx_context)->apply(context);
    }
@@ -79,6 +130,10 @@ namespace eosio { namespace chain {
       my->runtime_interface->immediately_exit_currently_running_module();
    }
 
+   void wasm_interface::on_cache_access(std::function<void(const cache_access&)> cb) {
+      my->cache_accessed = std::move(cb);
+   }
+
    wasm_instantiated_module_interface::~wasm_instantiated_module_interface() {}
    wasm_runtime_interface::~wasm_runtime_interface() {}
 
@@ -238,6 +293,7 @@ class privileged_api : public context_aware_api {
 
 };
 
+// non NaN results of the hardware are those of softfloat, see native_float
 class softfloat_api : public context_aware_api {
    public:
       // TODO add traps on truncations for special cases (NaN or outside the range which rounds to an integer)
@@ -248,18 +304,26 @@ class softfloat_api : public context_aware_api {
 #pragma GCC diagnostic ignored "-Wstrict-aliasing"
       // float binops
       float _eosio_f32_add( float a, float b ) {
+         float r;
+         if( native_float::add( a, b, r ) ) return r;
          float32_t ret = f32_add( to_softfloat32(a), to_softfloat32(b) );
          return *reinterpret_cast<float*>(&ret);
       }
       float _eosio_f32_sub( float a, float b ) {
+         float r;
+         if( native_float::sub( a, b, r ) ) return r;
          float32_t ret = f32_sub( to_softfloat32(a), to_softfloat32(b) );
          return *reinterpret_cast<float*>(&ret);
       }
       float _eosio_f32_div( float a, float b ) {
+         float r;
+         if( native_float::div( a, b, r ) ) return r;
          float32_t ret = f32_div( to_softfloat32(a), to_softfloat32(b) );
          return *reinterpret_cast<float*>(&ret);
       }
       float _eosio_f32_mul( float a, float b ) {
+         float r;
+         if( native_float::mul( a, b, r ) ) return r;
          float32_t ret = f32_mul( to_softfloat32(a), to_softfloat32(b) );
          return *reinterpret_cast<float*>(&ret);
       }
@@ -315,6 +379,8 @@ class softfloat_api : public context_aware_api {
          return from_softfloat32(a);
       }
       float _eosio_f32_sqrt( float a ) {
+         float r;
+         if( native_float::sqrt( a, r ) ) return r;
          float32_t ret = f32_sqrt( to_softfloat32(a) );
          return from_softfloat32(ret);
       }
@@ -418,18 +484,26 @@ class softfloat_api : public context_aware_api {
 
       // double binops
       double _eosio_f64_add( double a, double b ) {
+         double r;
+         if( native_float::add( a, b, r ) ) return r;
          float64_t ret = f64_add( to_softfloat64(a), to_softfloat64(b) );
          return from_softfloat64(ret);
       }
       double _eosio_f64_sub( double a, double b ) {
+         double r;
+         if( native_float::sub( a, b, r ) ) return r;
          float64_t ret = f64_sub( to_softfloat64(a), to_softfloat64(b) );
          return from_softfloat64(ret);
       }
       double _eosio_f64_div( double a, double b ) {
+         double r;
+         if( native_float::div( a, b, r ) ) return r;
          float64_t ret = f64_div( to_softfloat64(a), to_softfloat64(b) );
          return from_softfloat64(ret);
       }
       double _eosio_f64_mul( double a, double b ) {
+         double r;
+         if( native_float::mul( a, b, r ) ) return r;
          float64_t ret = f64_mul( to_softfloat64(a), to_softfloat64(b) );
          return from_softfloat64(ret);
       }
@@ -479,6 +553,8 @@ class softfloat_api : public context_aware_api {
          return from_softfloat64(a);
       }
       double _eosio_f64_sqrt( double a ) {
+         double r;
+         if( native_float::sqrt( a, r ) ) return r;
          float64_t ret = f64_sqrt( to_softfloat64(a) );
          return from_softfloat64(ret);
       }
@@ -589,9 +665,13 @@ class softfloat_api : public context_aware_api {
 
       // float and double conversions
       double _eosio_f32_promote( float a ) {
+         double r;
+         if( native_float::promote( a, r ) ) return r;
          return from_softfloat64(f32_to_f64( to_softfloat32(a)) );
       }
       float _eosio_f64_demote( double a ) {
+         float r;
+         if( native_float::demote( a, r ) ) return r;
          return from_softfloat32(f64_to_f32( to_softfloat64(a)) );
       }
       int32_t _eosio_f32_trunc_i32s( float af ) {
@@ -806,9 +886,34 @@ class crypto_api : public context_aware_api {
       bool rsa_verify(const fc::sha256& digest,
                   array_ptr<char> sig, size_t siglen,
                   array_ptr<char> pub, size_t publen) {
-         auto raw_sig = base64_decode(std::string((const char*)sig.value, siglen));         
-         fc::rsa_public_key p(std::string((const char*)pub.value, publen));
-         return p &&p.verify(digest, raw_sig);
+         auto raw_sig = base64_decode(std::string((const char*)sig.value, siglen));
+         auto p = cached_rsa_public_key(pub, publen);
+         return *p && p->verify(digest, raw_sig);
+      }
+
+      /**
+       * Verifies the signatures of `sigs`, packed as a vector of base64 strings, of the digests against one key.
+       * @return index of the first pair that does not verify, -1 if all do
+       */
+      int32_t rsa_verify_batch(array_ptr<const fc::sha256> digests, size_t digests_count,
+                               array_ptr<char> sigs, size_t sigs_size,
+                               array_ptr<char> pub, size_t publen) {
+         auto raw_sigs = fc::raw::unpack<vector<string>>( sigs, sigs_size );
+         EOS_ASSERT( raw_sigs.size() == digests_count, crypto_api_exception,
+                     "${s} signatures for ${d} digests", ("s", raw_sigs.size())("d", digests_count) );
+         auto p = cached_rsa_public_key(pub, publen);
+         for( size_t i = 0; i < digests_count; ++i ) {
+            if( !*p || !p->verify(digests.value[i], base64_decode(raw_sigs[i])) )
+               return static_cast<int32_t>(i);
+            context.trx_context.checktime();
+         }
+         return -1;
+      }
+
+   private:
+      static fc::rsa_public_key_cache::key_ptr cached_rsa_public_key(array_ptr<char> pub, size_t publen) {
+         static fc::rsa_public_key_cache keys( config::rsa_public_key_cache_size );
+         return keys.get( std::string((const char*)pub.value, publen) );
       }
 };
 
@@ -1203,6 +1308,9 @@ class console_api : public context_aware_api {
       }\
       int db_##IDX##_previous( int iterator, uint64_t& primary ) {\
          return context.IDX.previous_secondary(iterator, primary);\
+      }\
+      int db_##IDX##_next_batch( int& iterator, array_ptr<uint64_t> primaries, size_t count, array_ptr<char> secondaries, size_t secondaries_size ) {\
+         return context.IDX.next_secondary_batch(iterator, primaries, count, secondaries, secondaries_size);\
       }
 
 #define DB_API_METHOD_WRAPPERS_ARRAY_SECONDARY(IDX, ARR_SIZE, ARR_ELEMENT_TYPE)\
@@ -1259,6 +1367,9 @@ class console_api : public context_aware_api {
       }\
       int db_##IDX##_previous( int iterator, uint64_t& primary ) {\
          return context.IDX.previous_secondary(iterator, primary);\
+      }\
+      int db_##IDX##_next_batch( int& iterator, array_ptr<uint64_t> primaries, size_t count, array_ptr<char> secondaries, size_t secondaries_size ) {\
+         return context.IDX.next_secondary_batch(iterator, primaries, count, secondaries, secondaries_size);\
       }
 
 #define DB_API_METHOD_WRAPPERS_FLOAT_SECONDARY(IDX, TYPE)\
@@ -1296,11 +1407,19 @@ class console_api : public context_aware_api {
       }\
       int db_##IDX##_previous( int iterator, uint64_t& primary ) {\
          return context.IDX.previous_secondary(iterator, primary);\
+      }\
+      int db_##IDX##_next_batch( int& iterator, array_ptr<uint64_t> primaries, size_t count, array_ptr<char> secondaries, size_t secondaries_size ) {\
+         return context.IDX.next_secondary_batch(iterator, primaries, count, secondaries, secondaries_size);\
       }
 
 class database_api : public context_aware_api {
    public:
-      using context_aware_api::context_aware_api;
+      /// constructed for every intrinsic call
+      database_api( apply_context& ctx )
+      :context_aware_api(ctx)
+      {
+         ++context.db_intrinsic_calls;
+      }
 
       int db_store_i64( uint64_t scope, uint64_t table, uint64_t payer, uint64_t id, array_ptr<const char> buffer, size_t buffer_size ) {
          return context.db_store_i64( scope, table, payer, id, buffer, buffer_size );
@@ -1790,7 +1909,8 @@ REGISTER_INTRINSICS(producer_api,
    (db_##IDX##_upperbound,     int(int64_t,int64_t,int64_t,int,int))\
    (db_##IDX##_end,            int(int64_t,int64_t,int64_t))\
    (db_##IDX##_next,           int(int, int))\
-   (db_##IDX##_previous,       int(int, int))
+   (db_##IDX##_previous,       int(int, int))\
+   (db_##IDX##_next_batch,     int(int, int, int, int, int))
 
 #define DB_SECONDARY_INDEX_METHODS_ARRAY(IDX) \
       (db_##IDX##_store,          int(int64_t,int64_t,int64_t,int64_t,int,int))\
@@ -1802,7 +1922,8 @@ REGISTER_INTRINSICS(producer_api,
       (db_##IDX##_upperbound,     int(int64_t,int64_t,int64_t,int,int,int))\
       (db_##IDX##_end,            int(int64_t,int64_t,int64_t))\
       (db_##IDX##_next,           int(int, int))\
-      (db_##IDX##_previous,       int(int, int))
+      (db_##IDX##_previous,       int(int, int))\
+      (db_##IDX##_next_batch,     int(int, int, int, int, int))
 
 REGISTER_INTRINSICS( database_api,
    (db_store_i64,        int(int64_t,int64_t,int64_t,int64_t,int,int))
@@ -1835,6 +1956,7 @@ REGISTER_INTRINSICS(crypto_api,
    (sha512,                 void(int, int, int)           )
    (ripemd160,              void(int, int, int)           )
    (rsa_verify,             int(int, int, int, int, int) )
+   (rsa_verify_batch,       int(int, int, int, int, int, int) )
 );
 
 
@@ -31,6 +31,8 @@ class wabt_instantiated_module : public wasm_instantiated_module_interface {
 
          if(_env->GetMemoryCount())
             _initial_memory_configuration = _env->GetMemory(0)->page_limits;
+
+         _apply_export = _instatiated_module->GetExport("apply");
       }
 
       void apply(apply_context& context) override {
@@ -46,8 +48,9 @@ class wabt_instantiated_module : public wasm_instantiated_module_interface {
             Memory* memory = this_run_vars.memory = _env->GetMemory(0);
             memory->page_limits = _initial_memory_configuration;
             memory->data.resize(_initial_memory_configuration.initial * WABT_PAGE_SIZE);
-            memset(memory->data.data(), 0, memory->data.size());
+            //the initial data is within the initial size, see parse_initial_memory
             memcpy(memory->data.data(), _initial_memory.data(), _initial_memory.size());
+            memset(memory->data.data() + _initial_memory.size(), 0, memory->data.size() - _initial_memory.size());
          }
 
          _params[0].set_i64(uint64_t(context.get_receiver()));
@@ -57,13 +60,16 @@ class wabt_instantiated_module : public wasm_instantiated_module_interface {
          ExecResult res = _executor.RunStartFunction(_instatiated_module);
          EOS_ASSERT( res.result == interp::Result::Ok, wasm_execution_error, "wabt start function failure (${s})", ("s", ResultToString(res.result)) );
 
-         res = _executor.RunExportByName(_instatiated_module, "apply", _params);
+         //a module without apply is reported by RunExportByName
+         res = _apply_export ? _executor.RunExport(_apply_export, _params)
+                             : _executor.RunExportByName(_instatiated_module, "apply", _params);
          EOS_ASSERT( res.result == interp::Result::Ok, wasm_execution_error, "wabt execution failure (${s})", ("s", ResultToString(res.result)) );
       }
 
    private:
       std::unique_ptr<interp::Environment>              _env;
       DefinedModule*                                    _instatiated_module;  //this is owned by the Environment
+      Export*                                           _apply_export = nullptr; //looked up once instead of by name on every action
       std::vector<uint8_t>                              _initial_memory;
       TypedValues                                       _params{3, TypedValue(Type::I64)};
       std::vector<std::pair<Global*, TypedValue>>       _initial_globals;
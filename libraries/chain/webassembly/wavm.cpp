@@ -14,30 +14,44 @@
 
 #include <vector>
 #include <iterator>
+#include <mutex>
+#include <thread>
 
 using namespace IR;
 using namespace Runtime;
 
 namespace eosio { namespace chain { namespace webassembly { namespace wavm {
 
-running_instance_context the_running_instance_context;
+thread_local running_instance_context the_running_instance_context;
 
 namespace detail {
 struct wavm_runtime_initializer {
-   wavm_runtime_initializer() {
+   wavm_runtime_initializer() : main_thread(std::this_thread::get_id()) {
       Runtime::init();
    }
+
+   /// runs the instances with the memory they all share, the other threads get memories of their own
+   const std::thread::id main_thread;
 };
 
+static const wavm_runtime_initializer& the_wavm_runtime_initializer() {
+   static wavm_runtime_initializer initializer;
+   return initializer;
+}
+
 using live_module_ref = std::list<ObjectInstance*>::iterator;
 
+/// WAVM objects are shared by all the threads: instantiation and garbage collection are serialized by `mtx`
 struct wavm_live_modules {
-   live_module_ref add_live_module(ModuleInstance* module_instance) {
-      return live_modules.insert(live_modules.begin(), asObject(module_instance));
+   // mtx must be locked
+   live_module_ref add_live_module(ObjectInstance* object) {
+      return live_modules.insert(live_modules.begin(), object);
    }
 
-   void remove_live_module(live_module_ref it) {
-      live_modules.erase(it);
+   // mtx must be locked
+   void remove_live_modules(const std::vector<live_module_ref>& its) {
+      for(const auto& it : its)
+         live_modules.erase(it);
       run_wavm_garbage_collection();
    }
 
@@ -48,19 +62,96 @@ struct wavm_live_modules {
       Runtime::freeUnreferencedObjects(std::move(root));
    }
 
+   std::mutex                 mtx;
    std::list<ObjectInstance*> live_modules;
 };
 
 static wavm_live_modules the_wavm_live_modules;
 
+// the_wavm_live_modules.mtx must be locked
+static ModuleInstance* instantiate(const Module& module, MemoryInstance* memory) {
+   eosio::chain::webassembly::common::root_resolver resolver;
+   LinkResult link_result = linkModule(module, resolver);
+   ModuleInstance *instance = instantiateModule(module, std::move(link_result.resolvedImports), memory);
+   EOS_ASSERT(instance != nullptr, wasm_exception, "Fail to Instantiate WAVM Module");
+   return instance;
+}
+
+static std::unique_ptr<Module> parse_module(const char* code_bytes, size_t code_size) {
+   std::unique_ptr<Module> module = std::make_unique<Module>();
+   try {
+      Serialization::MemoryInputStream stream((const U8*)code_bytes, code_size);
+      WASM::serialize(stream, *module);
+   } catch(const Serialization::FatalSerializationException& e) {
+      EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+   } catch(const IR::ValidationException& e) {
+      EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+   }
+   return module;
+}
+
+/**
+ * Linear memories of the threads other than the main one. Each reserves the address space and guard pages of a WAVM
+ * memory, so the memory of a thread that exits is kept for the next one, with the instances bound to it.
+ */
+struct wavm_memory_pool {
+   MemoryInstance* checkout() {
+      std::lock_guard<std::mutex> g(the_wavm_live_modules.mtx);
+      if(!free_memories.empty()) {
+         MemoryInstance* memory = free_memories.back();
+         free_memories.pop_back();
+         return memory;
+      }
+      MemoryInstance* memory = createMemory(MemoryType(false, {0, wasm_constraints::maximum_linear_memory/wasm_constraints::wasm_page_size}));
+      EOS_ASSERT(memory != nullptr, wasm_exception, "Fail to reserve a WAVM memory");
+      // retained by the garbage collection while it is not referred to by an instance
+      the_wavm_live_modules.add_live_module(asObject(memory));
+      return memory;
+   }
+
+   void release(MemoryInstance* memory) {
+      std::lock_guard<std::mutex> g(the_wavm_live_modules.mtx);
+      free_memories.push_back(memory);
+   }
+
+   std::vector<MemoryInstance*> free_memories;
+};
+
+static wavm_memory_pool the_wavm_memory_pool;
+
+struct thread_memory {
+   ~thread_memory() {
+      if(memory)
+         the_wavm_memory_pool.release(memory);
+   }
+
+   MemoryInstance* get() {
+      if(!memory)
+         memory = the_wavm_memory_pool.checkout();
+      return memory;
+   }
+
+   MemoryInstance* memory = nullptr;
+};
+
+static thread_local thread_memory the_thread_memory;
+
 }
 
+/**
+ * The instance created with the module runs on the main thread. Another thread gets an instance bound to the memory
+ * it checked out of the pool, instantiated the first time it runs the module and kept with the module: the code
+ * generated by WAVM addresses the memory of its instance directly, so the instances of a module cannot share one
+ * across threads. The module must outlive the calls running it on any thread.
+ */
 class wavm_instantiated_module : public wasm_instantiated_module_interface {
    public:
-      wavm_instantiated_module(ModuleInstance* instance, std::unique_ptr<Module> module, std::vector<uint8_t> initial_mem) :
+      wavm_instantiated_module(ModuleInstance* instance, std::unique_ptr<Module> module, std::vector<uint8_t> code,
+                               std::vector<uint8_t> initial_mem) :
          _initial_memory(initial_mem),
+         _code(std::move(code)),
          _instance(instance),
-         _module_ref(detail::the_wavm_live_modules.add_live_module(instance))
+         _module_ref(detail::the_wavm_live_modules.add_live_module(asObject(instance)))
       {
          //The memory instance is reused across all wavm_instantiated_modules, but for wasm instances
          // that didn't declare "memory", getDefaultMemory() won't see it. It would also be possible
@@ -70,7 +161,11 @@ class wavm_instantiated_module : public wasm_instantiated_module_interface {
       }
 
       ~wavm_instantiated_module() {
-         detail::the_wavm_live_modules.remove_live_module(_module_ref);
+         std::vector<detail::live_module_ref> refs{_module_ref};
+         for(const auto& i : _thread_instances)
+            refs.push_back(i.module_ref);
+         std::lock_guard<std::mutex> g(detail::the_wavm_live_modules.mtx);
+         detail::the_wavm_live_modules.remove_live_modules(refs);
       }
 
       void apply(apply_context& context) override {
@@ -78,35 +173,66 @@ class wavm_instantiated_module : public wasm_instantiated_module_interface {
 	                            Value(uint64_t(context.get_action().account)),
                                Value(uint64_t(context.get_action().name))};
 
-         call("apply", args, context);
+         call(thread_instance(), "apply", args, context);
       }
 
    private:
-      void call(const string &entry_point, const vector <Value> &args, apply_context &context) {
+      struct thread_instance_t {
+         MemoryInstance*         memory;
+         ModuleInstance*         instance;
+         detail::live_module_ref module_ref;
+      };
+
+      ModuleInstance* thread_instance() {
+         if(std::this_thread::get_id() == detail::the_wavm_runtime_initializer().main_thread)
+            return _instance;
+
+         MemoryInstance* memory = detail::the_thread_memory.get();
+         {
+            std::lock_guard<std::mutex> g(_thread_instances_mtx);
+            for(const auto& i : _thread_instances)
+               if(i.memory == memory)
+                  return i.instance;
+         }
+
+         // only this thread instantiates for its memory
+         auto module = detail::parse_module((const char*)_code.data(), _code.size());
+         thread_instance_t i{memory};
+         {
+            std::lock_guard<std::mutex> g(detail::the_wavm_live_modules.mtx);
+            i.instance = detail::instantiate(*module, memory);
+            i.module_ref = detail::the_wavm_live_modules.add_live_module(asObject(i.instance));
+         }
+         std::lock_guard<std::mutex> g(_thread_instances_mtx);
+         _thread_instances.push_back(i);
+         return i.instance;
+      }
+
+      void call(ModuleInstance* instance, const string &entry_point, const vector <Value> &args, apply_context &context) {
          try {
-            FunctionInstance* call = asFunctionNullable(getInstanceExport(_instance,entry_point));
+            FunctionInstance* call = asFunctionNullable(getInstanceExport(instance,entry_point));
             if( !call )
                return;
 
             EOS_ASSERT( getFunctionType(call)->parameters.size() == args.size(), wasm_exception, "" );
 
-            //The memory instance is reused across all wavm_instantiated_modules, but for wasm instances
+            //The memory instance is reused across all wavm_instantiated_modules of a thread, but for wasm instances
             // that didn't declare "memory", getDefaultMemory() won't see it
-            MemoryInstance* default_mem = getDefaultMemory(_instance);
+            MemoryInstance* default_mem = getDefaultMemory(instance);
             if(default_mem) {
                //reset memory resizes the sandbox'ed memory to the module's init memory size and then
                // (effectively) memzeros it all
                resetMemory(default_mem, _initial_memory_config);
 
-               char* memstart = &memoryRef<char>(getDefaultMemory(_instance), 0);
+               char* memstart = &memoryRef<char>(default_mem, 0);
                memcpy(memstart, _initial_memory.data(), _initial_memory.size());
             }
 
             the_running_instance_context.memory = default_mem;
             the_running_instance_context.apply_ctx = &context;
 
-            resetGlobalInstances(_instance);
-            runInstanceStartFunc(_instance);
+            resetGlobalInstances(instance);
+            runInstanceStartFunc(instance);
             Runtime::invokeFunction(call,args);
          } catch( const wasm_exit& e ) {
          } catch( const Runtime::Exception& e ) {
@@ -119,37 +245,31 @@ class wavm_instantiated_module : public wasm_instantiated_module_interface {
 
 
       std::vector<uint8_t>     _initial_memory;
+      std::vector<uint8_t>     _code; ///< injected, parsed again for the instances of other threads
       //naked pointer because ModuleInstance is opaque
       //_instance is deleted via WAVM's object garbage collection when wavm_rutime is deleted
       ModuleInstance*          _instance;
       detail::live_module_ref  _module_ref;
       MemoryType               _initial_memory_config;
+
+      std::mutex                     _thread_instances_mtx;
+      std::vector<thread_instance_t> _thread_instances;
 };
 
 wavm_runtime::wavm_runtime() {
-   static detail::wavm_runtime_initializer the_wavm_runtime_initializer;
+   detail::the_wavm_runtime_initializer();
 }
 
 wavm_runtime::~wavm_runtime() {
 }
 
 std::unique_ptr<wasm_instantiated_module_interface> wavm_runtime::instantiate_module(const char* code_bytes, size_t code_size, std::vector<uint8_t> initial_memory) {
-   std::unique_ptr<Module> module = std::make_unique<Module>();
-   try {
-      Serialization::MemoryInputStream stream((const U8*)code_bytes, code_size);
-      WASM::serialize(stream, *module);
-   } catch(const Serialization::FatalSerializationException& e) {
-      EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-   } catch(const IR::ValidationException& e) {
-      EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-   }
-
-   eosio::chain::webassembly::common::root_resolver resolver;
-   LinkResult link_result = linkModule(*module, resolver);
-   ModuleInstance *instance = instantiateModule(*module, std::move(link_result.resolvedImports));
-   EOS_ASSERT(instance != nullptr, wasm_exception, "Fail to Instantiate WAVM Module");
+   std::unique_ptr<Module> module = detail::parse_module(code_bytes, code_size);
 
-   return std::make_unique<wavm_instantiated_module>(instance, std::move(module), initial_memory);
+   std::lock_guard<std::mutex> g(detail::the_wavm_live_modules.mtx);
+   ModuleInstance *instance = detail::instantiate(*module, nullptr);
+   return std::make_unique<wavm_instantiated_module>(instance, std::move(module), std::vector<uint8_t>(code_bytes, code_bytes + code_size),
+                                                     std::move(initial_memory));
 }
 
 void wavm_runtime::immediately_exit_currently_running_module() {
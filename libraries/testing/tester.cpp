@@ -246,9 +246,9 @@ namespace eosio { namespace testing {
       }
 
       if( !skip_pending_trxs ) {
-         unapplied_transactions_type unapplied_trxs = control->get_unapplied_transactions(); // make copy of map
+         unapplied_transactions_type unapplied_trxs = control->get_unapplied_transactions(); // make copy of queue
          for (const auto& entry : unapplied_trxs ) {
-            auto trace = control->push_transaction(entry.second, fc::time_point::maximum(), DEFAULT_BILLED_CPU_TIME_US, true );
+            auto trace = control->push_transaction(entry.trx_meta, fc::time_point::maximum(), DEFAULT_BILLED_CPU_TIME_US, true );
             if(trace->except) {
                trace->except->dynamic_rethrow_exception();
             }
@@ -369,7 +369,7 @@ namespace eosio { namespace testing {
    void base_tester::produce_min_num_of_blocks_to_spend_time_wo_inactive_prod(const fc::microseconds target_elapsed_time) {
       fc::microseconds elapsed_time;
       while (elapsed_time < target_elapsed_time) {
-         for(uint32_t i = 0; i < control->head_block_state()->active_schedule.producers.size(); i++) {
+         for(uint32_t i = 0; i < control->head_block_state()->active_schedule->producers.size(); i++) {
             const auto time_to_skip = fc::milliseconds(config::producer_repetitions * config::block_interval_ms);
             produce_block(time_to_skip);
             elapsed_time += time_to_skip;
@@ -204,6 +204,9 @@ namespace Runtime
 
 	// Instantiates a module, bindings its imports to the specified objects. May throw InstantiationException.
 	RUNTIME_API ModuleInstance* instantiateModule(const IR::Module& module,ImportBindings&& imports);
+	// Like instantiateModule, the memory defined by the module being defaultMemory instead of the memory shared by the
+	// other instances; the code of the instance only accesses that memory.
+	RUNTIME_API ModuleInstance* instantiateModule(const IR::Module& module,ImportBindings&& imports,MemoryInstance* defaultMemory);
 
 	// Gets the default table/memory for a ModuleInstance.
 	RUNTIME_API MemoryInstance* getDefaultMemory(ModuleInstance* moduleInstance);
@@ -89,12 +89,13 @@ namespace Runtime
 	}
 
 	void resetMemory(MemoryInstance* memory, MemoryType& newMemoryType) {
-		memory->type.size.min = 1;
-		if(shrinkMemory(memory, memory->numPages - 1) == -1)
-			causeException(Exception::Cause::outOfMemory);
-		memset(memory->baseAddress, 0, 1<<IR::numBytesPerPageLog2);
+		// Decommitted pages read as zero once committed again, so the reset costs only the pages that were touched
+		// instead of clearing the whole memory.
+		if(memory->numPages > 0)
+			Platform::decommitVirtualPages(memory->baseAddress, memory->numPages << getPlatformPagesPerWebAssemblyPageLog2());
+		memory->numPages = 0;
 		memory->type = newMemoryType;
-		if(growMemory(memory, memory->type.size.min - 1) == -1)
+		if(growMemory(memory, memory->type.size.min) == -1)
 			causeException(Exception::Cause::outOfMemory);
    }
 
@@ -114,7 +115,7 @@ namespace Runtime
 			{
 				return -1;
 			}
-			memset(memory->baseAddress + (memory->numPages << IR::numBytesPerPageLog2), 0, numNewPages << IR::numBytesPerPageLog2);
+			// The pages past the end of the memory were never committed or were decommitted, so they are already zero.
 			memory->numPages += numNewPages;
 		}
 		return previousNumPages;
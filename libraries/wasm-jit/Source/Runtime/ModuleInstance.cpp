@@ -31,6 +31,11 @@ namespace Runtime
 	MemoryInstance* MemoryInstance::theMemoryInstance = nullptr;
 
 	ModuleInstance* instantiateModule(const IR::Module& module,ImportBindings&& imports)
+	{
+		return instantiateModule(module,std::move(imports),nullptr);
+	}
+
+	ModuleInstance* instantiateModule(const IR::Module& module,ImportBindings&& imports,MemoryInstance* defaultMemory)
 	{
 		ModuleInstance* moduleInstance = new ModuleInstance(
 			std::move(imports.functions),
@@ -74,6 +79,10 @@ namespace Runtime
 		}
 		for(const MemoryDef& memoryDef : module.memories.defs)
 		{
+			if(defaultMemory) {
+				moduleInstance->memories.push_back(defaultMemory);
+				continue;
+			}
 			if(!MemoryInstance::theMemoryInstance) {
 				MemoryInstance::theMemoryInstance = createMemory(memoryDef.type);
 				if(!MemoryInstance::theMemoryInstance) { causeException(Exception::Cause::outOfMemory); }
@@ -3,9 +3,21 @@
  *  @copyright defined in eos/LICENSE
  */
 #include <eosio/chain_api_plugin/chain_api_plugin.hpp>
+#include <eosio/chain_api_plugin/direct_json.hpp>
+#include <eosio/chain/account_object.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/executor_stats.hpp>
 
+#include <fc/crypto/hex.hpp>
 #include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/variant_object.hpp>
+
+#include <boost/signals2/connection.hpp>
+
+#include <atomic>
+#include <map>
+#include <mutex>
 
 namespace eosio {
 
@@ -13,20 +25,113 @@ static appbase::abstract_plugin& _chain_api_plugin = app().register_plugin<chain
 
 using namespace eosio;
 
+/// set by plugin_initialize, before any call is served
+static bool direct_json_params = false;
+
+/// the params of a call, decoded without an fc::variant when direct_json handles the body
+template<typename T>
+static T parse_params( const string& body ) {
+   if( direct_json_params ) {
+      T params;
+      if( direct_json::decode( body, params ) ) return params;
+   }
+   return fc::json::from_string( body ).as<T>();
+}
+
+/**
+ *  Serialized responses of frequent calls, sent again without running the call or rebuilding the JSON.
+ *  An entry is used while its version, a description of the state it was computed from, is unchanged:
+ *  the head block for calls about the head, the ABI or code of the account for calls about an account.
+ *  Thread safe, hits are served on http and read-only threads.
+ */
+class response_cache {
+public:
+   explicit response_cache( size_t max_size ) : max_size( max_size ) {}
+
+   optional<std::string> get( const std::string& key, const std::string& version ) {
+      std::lock_guard<std::mutex> g( mtx );
+      auto itr = entries.find( key );
+      if( itr == entries.end() || itr->second.version != version ) return {};
+      return itr->second.json;
+   }
+
+   /// as get, with the number of the put of the entry: the same key and number always come with the same JSON
+   optional<std::pair<std::string, uint64_t>> get_numbered( const std::string& key, const std::string& version ) {
+      std::lock_guard<std::mutex> g( mtx );
+      auto itr = entries.find( key );
+      if( itr == entries.end() || itr->second.version != version ) return {};
+      return std::make_pair( itr->second.json, itr->second.number );
+   }
+
+   /// returns the number of the entry
+   uint64_t put( const std::string& key, std::string version, std::string json ) {
+      std::lock_guard<std::mutex> g( mtx );
+      // keys come from requests, the cache starts over instead of growing without limit
+      if( entries.size() >= max_size && !entries.count( key ) )
+         entries.clear();
+      entries[key] = entry{ std::move( version ), std::move( json ), ++puts };
+      return puts;
+   }
+
+   /// head, fork database head or last irreversible block changed
+   void start_head( const controller& db ) {
+      auto version = db.head_block_id().str() + db.fork_db_head_block_id().str() + db.last_irreversible_block_id().str();
+      std::lock_guard<std::mutex> g( mtx );
+      head_version = std::move( version );
+   }
+
+   std::string get_head_version() {
+      std::lock_guard<std::mutex> g( mtx );
+      return head_version;
+   }
+
+private:
+   struct entry {
+      std::string version;
+      std::string json;
+      uint64_t    number = 0;
+   };
+
+   const size_t                   max_size;
+   std::mutex                     mtx;
+   std::map<std::string, entry>   entries;
+   std::string                    head_version;
+   uint64_t                       puts = 0;
+};
+
 class chain_api_plugin_impl {
 public:
    chain_api_plugin_impl(controller& db)
       : db(db) {}
 
    controller& db;
+   std::shared_ptr<response_cache> responses;
+   std::vector<boost::signals2::scoped_connection> head_connections;
 };
 
 
 chain_api_plugin::chain_api_plugin(){}
 chain_api_plugin::~chain_api_plugin(){}
 
-void chain_api_plugin::set_program_options(options_description&, options_description&) {}
-void chain_api_plugin::plugin_initialize(const variables_map&) {}
+void chain_api_plugin::set_program_options(options_description&, options_description& cfg) {
+   cfg.add_options()
+         ("chain-api-response-cache-size", bpo::value<uint32_t>()->default_value(0),
+          "Number of serialized get_info, get_producer_schedule, get_abi and get_code_hash responses sent again "
+          "without running the call, 0 disables the cache. Responses about the head are kept until the next head block, "
+          "so fields that change with the pending block, as block_cpu_limit, are those of the first call after it.")
+         ("chain-api-direct-json-params", bpo::bool_switch()->default_value(false),
+          "Decode the flat JSON bodies of the read calls, as get_table_rows, get_account or get_currency_balance, "
+          "straight into their params instead of through a generic variant; other bodies are parsed as before.")
+         ;
+}
+
+void chain_api_plugin::plugin_initialize(const variables_map& options) {
+   my.reset(new chain_api_plugin_impl(app().get_plugin<chain_plugin>().chain()));
+   const auto cache_size = options.at( "chain-api-response-cache-size" ).as<uint32_t>();
+   if( cache_size > 0 )
+      my->responses = std::make_shared<response_cache>( cache_size );
+   direct_json_params = options.at( "chain-api-direct-json-params" ).as<bool>();
+}
 
 struct async_result_visitor : public fc::visitor<fc::variant> {
    template<typename T>
@@ -41,13 +146,97 @@ struct async_result_visitor : public fc::visitor<fc::variant> {
           api_handle.validate(); \
           try { \
              if (body.empty()) body = "{}"; \
-             fc::variant result( api_handle.call_name(fc::json::from_string(body).as<api_namespace::call_name ## _params>()) ); \
+             fc::variant result( api_handle.call_name(parse_params<api_namespace::call_name ## _params>(body)) ); \
              cb(http_response_code, std::move(result)); \
           } catch (...) { \
              http_plugin::handle_exception(#api_name, #call_name, body, cb); \
           } \
        }}
 
+// runs the call on the chain_plugin read-only thread pool when it is enabled
+#define CALL_READ_ONLY(api_name, api_handle, api_namespace, call_name, http_response_code) \
+{std::string("/v1/" #api_name "/" #call_name), \
+   [api_handle, &chain_plug](string, string body, url_response_callback cb) mutable { \
+          api_handle.validate(); \
+          chain_plug.post_read_only([api_handle, body{std::move(body)}, cb{std::move(cb)}]() mutable { \
+             try { \
+                if (body.empty()) body = "{}"; \
+                fc::variant result( api_handle.call_name(parse_params<api_namespace::call_name ## _params>(body)) ); \
+                cb(http_response_code, std::move(result)); \
+             } catch (...) { \
+                http_plugin::handle_exception(#api_name, #call_name, body, cb); \
+             } \
+          }); \
+       }}
+
+// like CALL_READ_ONLY, the call returns the JSON of its result
+#define CALL_READ_ONLY_JSON(api_name, api_handle, api_namespace, call_name, http_response_code) \
+{std::string("/v1/" #api_name "/" #call_name), \
+   [api_handle, &chain_plug](string, string body, url_response_callback cb) mutable { \
+          api_handle.validate(); \
+          chain_plug.post_read_only([api_handle, body{std::move(body)}, cb{std::move(cb)}]() mutable { \
+             try { \
+                if (body.empty()) body = "{}"; \
+                auto json = api_handle.call_name ## _json(parse_params<api_namespace::call_name ## _params>(body)); \
+                cb(http_response_code, json_response_body(json)); \
+             } catch (...) { \
+                http_plugin::handle_exception(#api_name, #call_name, body, cb); \
+             } \
+          }); \
+       }}
+
+// served from the response cache on the http thread, missed calls are run on the main thread
+#define CALL_HEAD_CACHED(api_name, api_handle, api_namespace, call_name, http_response_code) \
+{std::string("/v1/" #api_name "/" #call_name), \
+   [api_handle, responses](string, string body, url_response_callback cb) mutable { \
+          if (auto json = responses->get(#call_name, responses->get_head_version())) { \
+             cb(http_response_code, json_response_body(*json)); \
+             return; \
+          } \
+          chain::instrumented_post(app(), appbase::priority::low, chain::executor_category::http, [api_handle, responses, body{std::move(body)}, cb{std::move(cb)}]() mutable { \
+             try { \
+                if (body.empty()) body = "{}"; \
+                auto version = responses->get_head_version(); \
+                auto json = fc::json::to_string( api_handle.call_name(fc::json::from_string(body).as<api_namespace::call_name ## _params>()), \
+                                                 fc::time_point::maximum() ); \
+                responses->put(#call_name, std::move(version), json); \
+                cb(http_response_code, json_response_body(json)); \
+             } catch (...) { \
+                http_plugin::handle_exception(#api_name, #call_name, body, cb); \
+             } \
+          }); \
+       }}
+
+// like CALL_READ_ONLY, served from the response cache while the account_version of the account is unchanged;
+// cached responses are keyed, so http_plugin also keeps them compressed
+#define CALL_ACCOUNT_CACHED(api_name, api_handle, api_namespace, call_name, account_version, http_response_code) \
+{std::string("/v1/" #api_name "/" #call_name), \
+   [api_handle, responses, &chain_plug](string, string body, url_response_callback cb) mutable { \
+          chain_plug.post_read_only([api_handle, responses, &chain_plug, body{std::move(body)}, cb{std::move(cb)}]() mutable { \
+             try { \
+                if (body.empty()) body = "{}"; \
+                auto params = parse_params<api_namespace::call_name ## _params>(body); \
+                auto version = account_version(chain_plug.chain(), params.account_name); \
+                const auto key = std::string(#call_name) + ":" + params.account_name.to_string(); \
+                if (version) { \
+                   if (auto cached = responses->get_numbered(key, *version)) { \
+                      cb(http_response_code, keyed_response_body(key + ":" + std::to_string(cached->second), cached->first)); \
+                      return; \
+                   } \
+                } \
+                auto json = fc::json::to_string( api_handle.call_name(params), fc::time_point::maximum() ); \
+                if (version) { \
+                   const auto number = responses->put(key, std::move(*version), json); \
+                   cb(http_response_code, keyed_response_body(key + ":" + std::to_string(number), json)); \
+                   return; \
+                } \
+                cb(http_response_code, json_response_body(json)); \
+             } catch (...) { \
+                http_plugin::handle_exception(#api_name, #call_name, body, cb); \
+             } \
+          }); \
+       }}
+
 #define CALL_ASYNC(api_name, api_handle, api_namespace, call_name, call_result, http_response_code) \
 {std::string("/v1/" #api_name "/" #call_name), \
    [api_handle](string, string body, url_response_callback cb) mutable { \
@@ -68,49 +257,309 @@ struct async_result_visitor : public fc::visitor<fc::variant> {
    }\
 }
 
+// like CALL_ASYNC, the body is parsed on the http thread the handler is added to run on
+#define CALL_ASYNC_PARSED(api_name, api_handle, api_namespace, call_name, call_result, http_response_code) \
+{std::string("/v1/" #api_name "/" #call_name), \
+   [api_handle](string, string body, url_response_callback cb) mutable { \
+      try { \
+         if (body.empty()) body = "{}"; \
+         auto params = std::make_shared<api_namespace::call_name ## _params>( \
+               fc::json::from_string(body).as<api_namespace::call_name ## _params>()); \
+         chain::instrumented_post(app(), appbase::priority::low, chain::executor_category::http, [api_handle, params, body{std::move(body)}, cb]() mutable { \
+            try { \
+               api_handle.validate(); \
+               api_handle.call_name(*params, \
+                  [cb, body](const fc::static_variant<fc::exception_ptr, call_result>& result){\
+                     if (result.contains<fc::exception_ptr>()) {\
+                        try {\
+                           result.get<fc::exception_ptr>()->dynamic_rethrow_exception();\
+                        } catch (...) {\
+                           http_plugin::handle_exception(#api_name, #call_name, body, cb);\
+                        }\
+                     } else {\
+                        cb(http_response_code, result.visit(async_result_visitor()));\
+                     }\
+                  });\
+            } catch (...) { \
+               http_plugin::handle_exception(#api_name, #call_name, body, cb); \
+            } \
+         }); \
+      } catch (...) { \
+         http_plugin::handle_exception(#api_name, #call_name, body, cb); \
+      } \
+   }\
+}
+
+// binary API: request bodies and results are fc::raw packed
+template<typename T>
+static std::vector<char> pack_result( const T& result ) {
+   return fc::raw::pack( result );
+}
+
+template<typename T>
+static std::vector<char> pack_result( const std::shared_ptr<T>& result ) {
+   return fc::raw::pack( *result );
+}
+
+// already packed
+static std::vector<char> pack_result( const chain::block_log::packed_block_view& result ) {
+   return std::vector<char>( result.data, result.data + result.size );
+}
+
+template<typename T>
+static T unpack_params( const string& body ) {
+   T params;
+   try {
+      fc::datastream<const char*> ds( body.data(), body.size() );
+      fc::raw::unpack( ds, params );
+   } EOS_RETHROW_EXCEPTIONS( chain::invalid_http_request, "Invalid packed request body" )
+   return params;
+}
+
+#define CALL_BINARY(api_name, api_handle, api_namespace, call_name, http_response_code) \
+{std::string("/v1/" #api_name "/" #call_name), \
+   [api_handle](string, string body, url_response_callback cb) mutable { \
+          api_handle.validate(); \
+          try { \
+             auto result = api_handle.call_name(unpack_params<api_namespace::call_name ## _params>(body)); \
+             cb(http_response_code, binary_response_body(pack_result(result))); \
+          } catch (...) { \
+             http_plugin::handle_exception(#api_name, #call_name, fc::to_hex(body.data(), body.size()), cb); \
+          } \
+       }}
+
+#define CALL_BINARY_READ_ONLY(api_name, api_handle, api_namespace, call_name, http_response_code) \
+{std::string("/v1/" #api_name "/" #call_name), \
+   [api_handle, &chain_plug](string, string body, url_response_callback cb) mutable { \
+          api_handle.validate(); \
+          chain_plug.post_read_only([api_handle, body{std::move(body)}, cb{std::move(cb)}]() mutable { \
+             try { \
+                auto result = api_handle.call_name(unpack_params<api_namespace::call_name ## _params>(body)); \
+                cb(http_response_code, binary_response_body(pack_result(result))); \
+             } catch (...) { \
+                http_plugin::handle_exception(#api_name, #call_name, fc::to_hex(body.data(), body.size()), cb); \
+             } \
+          }); \
+       }}
+
+#define CALL_BINARY_ASYNC(api_name, api_handle, api_namespace, call_name, call_result, http_response_code) \
+{std::string("/v1/" #api_name "/" #call_name), \
+   [api_handle](string, string body, url_response_callback cb) mutable { \
+      try { \
+         api_handle.validate(); \
+         api_handle.call_name(unpack_params<api_namespace::call_name ## _params>(body),\
+            [cb, body](const fc::static_variant<fc::exception_ptr, call_result>& result){\
+               if (result.contains<fc::exception_ptr>()) {\
+                  try {\
+                     result.get<fc::exception_ptr>()->dynamic_rethrow_exception();\
+                  } catch (...) {\
+                     http_plugin::handle_exception(#api_name, #call_name, fc::to_hex(body.data(), body.size()), cb);\
+                  }\
+               } else {\
+                  cb(http_response_code, binary_response_body(pack_result(result.get<call_result>())));\
+               }\
+            });\
+      } catch (...) { \
+         http_plugin::handle_exception(#api_name, #call_name, fc::to_hex(body.data(), body.size()), cb); \
+      } \
+   }\
+}
+
+/// a call of /v1/chain/batch, `params` is the body of /v1/chain/<call>
+struct batch_call_params {
+   std::string  call;
+   fc::variant  params;
+};
+
+}
+
+FC_REFLECT( eosio::batch_call_params, (call)(params) )
+
+namespace eosio {
+
+using batch_handler = std::function<fc::variant(const fc::variant&)>;
+
+#define BATCH_CALL(api_handle, api_namespace, call_name) \
+{std::string(#call_name), \
+   [api_handle](const fc::variant& params) mutable { \
+      if (params.is_null()) return fc::variant( api_handle.call_name(api_namespace::call_name ## _params()) ); \
+      return fc::variant( api_handle.call_name(params.as<api_namespace::call_name ## _params>()) ); \
+   }}
+
+// runs the calls of the body against the same state, results are in the order of the calls
+static url_handler make_batch_handler( chain_plugin& chain_plug, std::map<std::string, batch_handler> handlers ) {
+   return [&chain_plug, handlers{std::move(handlers)}](string, string body, url_response_callback cb) {
+      try {
+         if (body.empty()) body = "[]";
+         auto calls = fc::json::from_string(body).as<std::vector<batch_call_params>>();
+         EOS_ASSERT( calls.size() <= chain_api_plugin::max_batch_calls, chain::invalid_http_request,
+                     "batch has ${n} calls, the limit is ${max}", ("n", calls.size())("max", chain_api_plugin::max_batch_calls) );
+         if( calls.empty() ) {
+            cb(200, fc::variant(fc::variants()));
+            return;
+         }
+
+         struct batch_state {
+            fc::variants           results;
+            std::atomic<size_t>    remaining;
+            url_response_callback  cb;
+         };
+         auto state = std::make_shared<batch_state>();
+         state->results.resize( calls.size() );
+         state->remaining = calls.size();
+
+         std::vector<std::function<void()>> reads;
+         reads.reserve( calls.size() );
+         for( size_t i = 0; i < calls.size(); ++i ) {
+            auto itr = handlers.find( calls[i].call );
+            EOS_ASSERT( itr != handlers.end(), chain::invalid_http_request,
+                        "${call} cannot be called in a batch", ("call", calls[i].call) );
+            reads.emplace_back( [state, i, handler = itr->second, call = std::move( calls[i] )]() mutable {
+               auto done = [&state, i]( int code, fc::variant result ) {
+                  state->results[i] = fc::mutable_variant_object()("code", code)("result", std::move(result));
+                  if( --state->remaining == 0 )
+                     state->cb( 200, fc::variant( std::move( state->results ) ) );
+               };
+               try {
+                  done( 200, handler( call.params ) );
+               } catch (...) {
+                  // results of the other calls are kept, the error is the result of this call
+                  http_plugin::handle_exception( "chain", call.call.c_str(), fc::json::to_string( call.params ), done );
+               }
+            } );
+         }
+         state->cb = std::move( cb );
+         chain_plug.post_read_only( std::move( reads ) );
+      } catch (...) {
+         http_plugin::handle_exception("chain", "batch", body, cb);
+      }
+   };
+}
+
 #define CHAIN_RO_CALL(call_name, http_response_code) CALL(chain, ro_api, chain_apis::read_only, call_name, http_response_code)
+#define CHAIN_RO_STATE_CALL(call_name, http_response_code) CALL_READ_ONLY(chain, ro_api, chain_apis::read_only, call_name, http_response_code)
+#define CHAIN_RO_STATE_JSON_CALL(call_name, http_response_code) CALL_READ_ONLY_JSON(chain, ro_api, chain_apis::read_only, call_name, http_response_code)
+#define CHAIN_RO_HEAD_CACHED_CALL(call_name, http_response_code) CALL_HEAD_CACHED(chain, ro_api, chain_apis::read_only, call_name, http_response_code)
+#define CHAIN_RO_ACCOUNT_CACHED_CALL(call_name, account_version, http_response_code) CALL_ACCOUNT_CACHED(chain, ro_api, chain_apis::read_only, call_name, account_version, http_response_code)
 #define CHAIN_RW_CALL(call_name, http_response_code) CALL(chain, rw_api, chain_apis::read_write, call_name, http_response_code)
 #define CHAIN_RO_CALL_ASYNC(call_name, call_result, http_response_code) CALL_ASYNC(chain, ro_api, chain_apis::read_only, call_name, call_result, http_response_code)
 #define CHAIN_RW_CALL_ASYNC(call_name, call_result, http_response_code) CALL_ASYNC(chain, rw_api, chain_apis::read_write, call_name, call_result, http_response_code)
 
+// versions of the ABI and the code of an existing account, none if there is no such account: errors are not cached
+static optional<std::string> abi_version( const controller& db, const name& account ) {
+   const auto* accnt = db.db().find<chain::account_object, chain::by_name>( account );
+   if( !accnt ) return {};
+   return std::string( accnt->abi.data(), accnt->abi.size() );
+}
+
+static optional<std::string> code_version( const controller& db, const name& account ) {
+   const auto* accnt = db.db().find<chain::account_metadata_object, chain::by_name>( account );
+   if( !accnt ) return {};
+   return accnt->code_hash.str();
+}
+
 void chain_api_plugin::plugin_startup() {
    ilog( "starting chain_api_plugin" );
-   my.reset(new chain_api_plugin_impl(app().get_plugin<chain_plugin>().chain()));
    auto ro_api = app().get_plugin<chain_plugin>().get_read_only_api();
    auto rw_api = app().get_plugin<chain_plugin>().get_read_write_api();
+   auto& chain_plug = app().get_plugin<chain_plugin>();
 
    auto& _http_plugin = app().get_plugin<http_plugin>();
    ro_api.set_shorten_abi_errors( !_http_plugin.verbose_errors() );
 
+   auto responses = my->responses;
+   if( responses ) {
+      auto& db = my->db;
+      auto start_head = [responses, &db]( const chain::block_state_ptr& ) {
+         responses->start_head( db );
+      };
+      start_head( nullptr );
+      my->head_connections.emplace_back( db.accepted_block_header.connect( start_head ) );
+      my->head_connections.emplace_back( db.accepted_block.connect( start_head ) );
+      my->head_connections.emplace_back( db.irreversible_block.connect( start_head ) );
+
+      _http_plugin.add_api({
+         CHAIN_RO_HEAD_CACHED_CALL(get_info, 200l),
+         CHAIN_RO_HEAD_CACHED_CALL(get_producer_schedule, 200)
+      }, handler_thread::http);
+   } else {
+      _http_plugin.add_api({
+         CHAIN_RO_CALL(get_info, 200l),
+         CHAIN_RO_CALL(get_producer_schedule, 200)
+      });
+   }
+
    _http_plugin.add_api({
-      CHAIN_RO_CALL(get_info, 200l),
       CHAIN_RO_CALL(get_activated_protocol_features, 200),
       CHAIN_RO_CALL(get_block, 200),
       CHAIN_RO_CALL(get_block_header_state, 200),
-      CHAIN_RO_CALL(get_account, 200),
-      CHAIN_RO_CALL(get_code, 200),
-      CHAIN_RO_CALL(get_code_hash, 200),
-      CHAIN_RO_CALL(get_abi, 200),
-      CHAIN_RO_CALL(get_raw_code_and_abi, 200),
-      CHAIN_RO_CALL(get_raw_abi, 200),
-      CHAIN_RO_CALL(get_table_rows, 200),
-      CHAIN_RO_CALL(get_table_by_scope, 200),
-      CHAIN_RO_CALL(get_currency_balance, 200),
-      CHAIN_RO_CALL(get_currency_stats, 200),
-      CHAIN_RO_CALL(get_producers, 200),
-      CHAIN_RO_CALL(get_producer_schedule, 200),
-      CHAIN_RO_CALL(get_scheduled_transactions, 200),
-      CHAIN_RO_CALL(abi_json_to_bin, 200),
-      CHAIN_RO_CALL(abi_bin_to_json, 200),
-      CHAIN_RO_CALL(get_required_keys, 200),
       CHAIN_RO_CALL(get_transaction_id, 200),
       CHAIN_RW_CALL_ASYNC(push_block, chain_apis::read_write::push_block_results, 202),
       CHAIN_RW_CALL_ASYNC(push_transaction, chain_apis::read_write::push_transaction_results, 202),
-      CHAIN_RW_CALL_ASYNC(push_transactions, chain_apis::read_write::push_transactions_results, 202),
-      CHAIN_RW_CALL_ASYNC(send_transaction, chain_apis::read_write::send_transaction_results, 202)
+      CHAIN_RW_CALL_ASYNC(send_transaction, chain_apis::read_write::send_transaction_results, 202),
+      CHAIN_RW_CALL_ASYNC(send_read_only_transaction, chain_apis::read_write::send_read_only_transaction_results, 200)
+   });
+
+   // a batch of transactions is parsed off the main thread
+   _http_plugin.add_api({
+      CALL_ASYNC_PARSED(chain, rw_api, chain_apis::read_write, push_transactions, chain_apis::read_write::push_transactions_results, 202)
+   }, handler_thread::http);
+
+   _http_plugin.add_binary_api({
+      CALL_BINARY(chain, ro_api, chain_apis::read_only, get_raw_block, 200),
+      CALL_BINARY_ASYNC(chain, rw_api, chain_apis::read_write, push_raw_transaction, chain_apis::read_write::push_raw_transaction_results, 202)
    });
+
+   // these only post the call to the read-only thread pool, so they skip the main thread when it is enabled
+   const auto state_calls_thread = chain_plug.has_read_only_threads() ? handler_thread::http : handler_thread::app;
+   if( responses ) {
+      _http_plugin.add_api({
+         CHAIN_RO_ACCOUNT_CACHED_CALL(get_code_hash, code_version, 200),
+         CHAIN_RO_ACCOUNT_CACHED_CALL(get_abi, abi_version, 200)
+      }, state_calls_thread);
+   } else {
+      _http_plugin.add_api({
+         CHAIN_RO_STATE_CALL(get_code_hash, 200),
+         CHAIN_RO_STATE_CALL(get_abi, 200)
+      }, state_calls_thread);
+   }
+   _http_plugin.add_api({
+      CHAIN_RO_STATE_CALL(get_account, 200),
+      CHAIN_RO_STATE_CALL(get_code, 200),
+      CHAIN_RO_STATE_CALL(get_raw_code_and_abi, 200),
+      CHAIN_RO_STATE_CALL(get_raw_abi, 200),
+      CHAIN_RO_STATE_JSON_CALL(get_table_rows, 200),
+      CHAIN_RO_STATE_CALL(get_table_by_scope, 200),
+      CHAIN_RO_STATE_CALL(get_currency_balance, 200),
+      CHAIN_RO_STATE_CALL(get_currency_balances, 200),
+      CHAIN_RO_STATE_CALL(get_currency_stats, 200),
+      CHAIN_RO_STATE_CALL(get_producers, 200),
+      CHAIN_RO_STATE_CALL(get_scheduled_transactions, 200),
+      CHAIN_RO_STATE_CALL(abi_json_to_bin, 200),
+      CHAIN_RO_STATE_CALL(abi_bin_to_json, 200),
+      CHAIN_RO_STATE_CALL(get_required_keys, 200),
+      {std::string("/v1/chain/batch"), make_batch_handler( chain_plug, {
+         BATCH_CALL(ro_api, chain_apis::read_only, get_account),
+         BATCH_CALL(ro_api, chain_apis::read_only, get_code_hash),
+         BATCH_CALL(ro_api, chain_apis::read_only, get_abi),
+         BATCH_CALL(ro_api, chain_apis::read_only, get_raw_abi),
+         BATCH_CALL(ro_api, chain_apis::read_only, get_table_rows),
+         BATCH_CALL(ro_api, chain_apis::read_only, get_table_by_scope),
+         BATCH_CALL(ro_api, chain_apis::read_only, get_currency_balance),
+         BATCH_CALL(ro_api, chain_apis::read_only, get_currency_stats),
+         BATCH_CALL(ro_api, chain_apis::read_only, get_producers),
+         BATCH_CALL(ro_api, chain_apis::read_only, abi_json_to_bin),
+         BATCH_CALL(ro_api, chain_apis::read_only, abi_bin_to_json),
+         BATCH_CALL(ro_api, chain_apis::read_only, get_required_keys)
+      } )}
+   }, state_calls_thread);
+   _http_plugin.add_binary_api({
+      CALL_BINARY_READ_ONLY(chain, ro_api, chain_apis::read_only, get_raw_table_rows, 200)
+   }, state_calls_thread);
 }
 
-void chain_api_plugin::plugin_shutdown() {}
+void chain_api_plugin::plugin_shutdown() {
+   my->head_connections.clear();
+}
 
 }
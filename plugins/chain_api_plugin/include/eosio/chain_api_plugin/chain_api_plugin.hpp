@@ -27,6 +27,9 @@ namespace eosio {
         void plugin_startup();
         void plugin_shutdown();
 
+        /// most calls of a /v1/chain/batch request
+        static const size_t max_batch_calls = 1000;
+
       private:
         unique_ptr<class chain_api_plugin_impl> my;
    };
@@ -0,0 +1,214 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/chain/name.hpp>
+
+#include <fc/optional.hpp>
+#include <fc/reflect/reflect.hpp>
+
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+namespace eosio { namespace direct_json {
+
+   /**
+    * Decodes the JSON body of a request straight into its reflected params struct, without building the fc::variant
+    * tree of fc::json::from_string first.
+    *
+    * Only the bodies of the read calls are handled: a flat object whose values are strings without escapes, unsigned
+    * integers, booleans or null, decoded into string, name, unsigned integer, bool and optional members. decode()
+    * returns false for anything else, an escape, a nested value, a value whose type differs from its member, so that
+    * the caller parses the body with fc::json and gets the same params, or the same error, as before. Unknown keys are
+    * ignored and the last of duplicate keys wins, as with fc::json.
+    */
+   class decoder {
+      public:
+         decoder( const char* begin, const char* end ) : pos( begin ), end( end ) {}
+
+         struct token {
+            enum kind_t { string, number, boolean, null } kind = null;
+            const char* begin = nullptr;
+            const char* end = nullptr;
+            bool        value = false; ///< of a boolean
+         };
+
+         template<typename T>
+         bool decode( T& params ) {
+            skip_ws();
+            if( !consume( '{' ) ) return false;
+            skip_ws();
+            if( consume( '}' ) ) return at_end();
+            while( true ) {
+               token key;
+               skip_ws();
+               if( !read_string( key ) ) return false;
+               skip_ws();
+               if( !consume( ':' ) ) return false;
+               skip_ws();
+               token value;
+               if( !read_value( value ) ) return false;
+               if( !assign( params, key, value ) ) return false;
+               skip_ws();
+               if( consume( ',' ) ) continue;
+               if( consume( '}' ) ) return at_end();
+               return false;
+            }
+         }
+
+      private:
+         template<typename T>
+         struct member_visitor {
+            T&           params;
+            const token& key;
+            const token& value;
+            bool&        found;
+            bool&        ok;
+
+            template<typename Member, class Class, Member (Class::*member)>
+            void operator()( const char* name )const {
+               const size_t length = key.end - key.begin;
+               if( found || std::strlen( name ) != length || std::memcmp( name, key.begin, length ) != 0 ) return;
+               found = true;
+               ok = set( params.*member, value );
+            }
+         };
+
+         template<typename T>
+         static bool assign( T& params, const token& key, const token& value ) {
+            bool found = false, ok = true;
+            fc::reflector<T>::visit( member_visitor<T>{ params, key, value, found, ok } );
+            return ok;
+         }
+
+         static bool set( std::string& v, const token& t ) {
+            if( t.kind != token::string ) return false;
+            v.assign( t.begin, t.end );
+            return true;
+         }
+
+         static bool set( chain::name& v, const token& t ) {
+            if( t.kind != token::string ) return false;
+            v = chain::name( std::string( t.begin, t.end ) );
+            return true;
+         }
+
+         static bool set( bool& v, const token& t ) {
+            if( t.kind != token::boolean ) return false;
+            v = t.value;
+            return true;
+         }
+
+         template<typename T>
+         static std::enable_if_t<std::is_integral<T>::value && std::is_unsigned<T>::value, bool> set( T& v, const token& t ) {
+            if( t.kind != token::number ) return false;
+            uint64_t n = 0;
+            for( const char* c = t.begin; c != t.end; ++c ) {
+               const uint64_t digit = *c - '0';
+               if( n > ( std::numeric_limits<T>::max() - digit ) / 10 ) return false;
+               n = n * 10 + digit;
+            }
+            v = static_cast<T>( n );
+            return true;
+         }
+
+         template<typename T>
+         static bool set( fc::optional<T>& v, const token& t ) {
+            if( t.kind == token::null ) {
+               v.reset();
+               return true;
+            }
+            T value;
+            if( !set( value, t ) ) return false;
+            v = std::move( value );
+            return true;
+         }
+
+         /// any other member type is left to fc::json
+         template<typename T>
+         static std::enable_if_t<!(std::is_integral<T>::value && std::is_unsigned<T>::value), bool> set( T&, const token& ) {
+            return false;
+         }
+
+         bool read_string( token& t ) {
+            if( !consume( '"' ) ) return false;
+            // memchr is vectorized by the C library, strings of the read calls are names, keys and bounds
+            const char* close = static_cast<const char*>( std::memchr( pos, '"', end - pos ) );
+            if( close == nullptr ) return false;
+            for( const char* c = pos; c != close; ++c ) {
+               const auto u = static_cast<unsigned char>( *c );
+               if( u == '\\' || u < 0x20 || u >= 0x80 ) return false;
+            }
+            t.kind = token::string;
+            t.begin = pos;
+            t.end = close;
+            pos = close + 1;
+            return true;
+         }
+
+         bool read_value( token& t ) {
+            if( pos == end ) return false;
+            if( *pos == '"' ) return read_string( t );
+            if( *pos >= '0' && *pos <= '9' ) {
+               t.kind = token::number;
+               t.begin = pos;
+               while( pos != end && *pos >= '0' && *pos <= '9' ) ++pos;
+               t.end = pos;
+               // leading zeros, fractions and exponents are left to fc::json
+               if( t.end - t.begin > 1 && *t.begin == '0' ) return false;
+               return pos == end || ( *pos != '.' && *pos != 'e' && *pos != 'E' );
+            }
+            if( literal( "true" ) ) {
+               t.kind = token::boolean;
+               t.value = true;
+               return true;
+            }
+            if( literal( "false" ) ) {
+               t.kind = token::boolean;
+               t.value = false;
+               return true;
+            }
+            if( literal( "null" ) ) {
+               t.kind = token::null;
+               return true;
+            }
+            return false;
+         }
+
+         bool literal( const char* word ) {
+            const size_t length = std::strlen( word );
+            if( size_t( end - pos ) < length || std::memcmp( pos, word, length ) != 0 ) return false;
+            pos += length;
+            return true;
+         }
+
+         void skip_ws() {
+            while( pos != end && ( *pos == ' ' || *pos == '\n' || *pos == '\r' || *pos == '\t' ) ) ++pos;
+         }
+
+         bool consume( char c ) {
+            if( pos == end || *pos != c ) return false;
+            ++pos;
+            return true;
+         }
+
+         bool at_end() {
+            skip_ws();
+            return pos == end;
+         }
+
+         const char* pos;
+         const char* end;
+   };
+
+   /// false if `body` is to be parsed by fc::json
+   template<typename T>
+   bool decode( const std::string& body, T& params ) {
+      return decoder( body.data(), body.data() + body.size() ).decode( params );
+   }
+
+} } // namespace eosio::direct_json
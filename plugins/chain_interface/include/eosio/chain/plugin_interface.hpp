@@ -50,6 +50,8 @@ namespace eosio { namespace chain { namespace plugin_interface {
          // synchronously push a block/trx to a single provider
          using block_sync            = method_decl<chain_plugin_interface, bool(const signed_block_ptr&, const std::optional<block_id_type>&), first_provider_policy>;
          using transaction_async     = method_decl<chain_plugin_interface, void(const transaction_metadata_ptr&, bool, next_function<transaction_trace_ptr>), first_provider_policy>;
+         // several trxs received together, keys are recovered in batches and the trxs are processed in order
+         using transactions_async    = method_decl<chain_plugin_interface, void(const std::vector<std::pair<transaction_metadata_ptr, next_function<transaction_trace_ptr>>>&), first_provider_policy>;
       }
    }
 
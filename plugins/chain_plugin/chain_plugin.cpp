@@ -3,9 +3,11 @@
  *  @copyright defined in eos/LICENSE
  */
 #include <eosio/chain_plugin/chain_plugin.hpp>
+#include <eosio/chain/async_log.hpp>
 #include <eosio/chain/fork_database.hpp>
 #include <eosio/chain/block_log.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/executor_stats.hpp>
 #include <eosio/chain/authorization_manager.hpp>
 #include <eosio/chain/code_object.hpp>
 #include <eosio/chain/config.hpp>
@@ -14,18 +16,30 @@
 #include <eosio/chain/reversible_block_object.hpp>
 #include <eosio/chain/controller.hpp>
 #include <eosio/chain/generated_transaction_object.hpp>
+#include <eosio/chain/numa_placement.hpp>
+#include <eosio/chain/signal_subscribers.hpp>
 #include <eosio/chain/snapshot.hpp>
+#include <eosio/chain/snapshot_delta.hpp>
+#include <eosio/chain/state_window.hpp>
+#include <eosio/chain/thread_utils.hpp>
 
 #include <eosio/chain/eosio_contract.hpp>
 
+#include <boost/asio/steady_timer.hpp>
 #include <boost/signals2/connection.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <fc/crypto/hex.hpp>
 #include <fc/io/json.hpp>
 #include <fc/variant.hpp>
 #include <signal.h>
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <set>
 
 namespace eosio {
 
@@ -137,6 +151,139 @@ using boost::signals2::scoped_connection;
    }
 
 
+/**
+ *  Runs read-only API calls on a thread pool.
+ *
+ *  chainbase keeps a single version of the state, so the calls run in read windows while the main
+ *  thread writes nothing: a window is opened between main thread tasks, the pool drains queued calls
+ *  in parallel until the queue is empty or the window time is over, and the rest waits for the
+ *  next window, which is queued behind the main thread work posted in the meantime.
+ *  The main thread is blocked by the longest call of a window instead of the sum of all calls.
+ *
+ *  With a state window, the windows are published to other processes of the host attached to the state
+ *  mapping, and a window is also opened when only they wait for one.
+ */
+class read_only_queue : public std::enable_shared_from_this<read_only_queue> {
+public:
+   /// the reads of a window run on `threads` api tasks of `scheduler`
+   read_only_queue( const controller& chain, task_scheduler& scheduler, uint16_t threads, fc::microseconds window_time,
+                    std::unique_ptr<state_window> window = {} )
+   : chain( chain ), threads( threads ), window_time( window_time ), pool( scheduler, task_priority::api ), window( std::move( window ) ) {}
+
+   ~read_only_queue() {
+      pool.cancel();
+   }
+
+   void post( std::function<void()> read ) {
+      std::lock_guard<std::mutex> g( mtx );
+      reads.push_back( queued_read{ std::move( read ), 0 } );
+      schedule_window();
+   }
+
+   /// the reads run in the same window, once one of them started the window is not closed before all did
+   void post( std::vector<std::function<void()>> batch ) {
+      std::lock_guard<std::mutex> g( mtx );
+      const uint64_t id = ++last_batch;
+      for( auto& read : batch )
+         reads.push_back( queued_read{ std::move( read ), id } );
+      schedule_window();
+   }
+
+   /// polls the readers of other processes waiting for a window
+   void watch_window_readers() {
+      if( !window ) return;
+      window_timer = std::make_unique<boost::asio::steady_timer>( app().get_io_service() );
+      schedule_watch();
+   }
+
+private:
+   static constexpr auto window_readers_poll_interval = std::chrono::milliseconds( 5 );
+
+   void schedule_watch() {
+      window_timer->expires_from_now( window_readers_poll_interval );
+      window_timer->async_wait( [weak = weak_from_this()]( const boost::system::error_code& ec ) {
+         auto self = weak.lock();
+         if( ec || !self ) return;
+         if( self->window->waiting_readers() > 0 ) {
+            std::lock_guard<std::mutex> g( self->mtx );
+            self->schedule_window();
+         }
+         self->schedule_watch();
+      } );
+   }
+
+   // mtx must be locked
+   void schedule_window() {
+      if( window_scheduled ) return;
+      window_scheduled = true;
+      chain::instrumented_post( app(), appbase::priority::low, chain::executor_category::http, [self = shared_from_this()]() {
+         self->run_window();
+      } );
+   }
+
+   void run_window() {
+      {
+         std::lock_guard<std::mutex> g( mtx );
+         window_scheduled = false;
+         if( reads.empty() && !(window && window->waiting_readers() > 0) ) return;
+      }
+      // settle lazily updated fork database fields before concurrent reads
+      chain.fork_db_head_block_id();
+      chain.last_irreversible_block_id();
+
+      const auto deadline = fc::time_point::now() + window_time;
+      if( window ) window->open_window( deadline, chain.head_block_num() );
+      std::vector<std::future<void>> workers;
+      workers.reserve( threads );
+      for( uint16_t i = 0; i < threads; ++i ) {
+         workers.emplace_back( async_thread_pool( pool, [this, deadline]() {
+            for( bool first = true; ; first = false ) {
+               std::function<void()> read;
+               {
+                  std::lock_guard<std::mutex> g( mtx );
+                  if( reads.empty() ) return;
+                  auto& next = reads.front();
+                  if( !first && fc::time_point::now() >= deadline && (next.batch == 0 || next.batch != started_batch) ) return;
+                  if( next.batch ) started_batch = next.batch;
+                  read = std::move( next.read );
+                  reads.pop_front();
+               }
+               try {
+                  read();
+               } FC_LOG_AND_DROP()
+            }
+         } ) );
+      }
+      for( auto& w : workers )
+         w.get();
+      if( window ) {
+         if( const auto left = window->close_window( deadline + window_time ) )
+            wlog( "${n} reads of other processes still run after their state window is overdue", ("n", left) );
+      }
+
+      std::lock_guard<std::mutex> g( mtx );
+      if( !reads.empty() )
+         schedule_window();
+   }
+
+   struct queued_read {
+      std::function<void()>  read;
+      uint64_t               batch = 0; ///< reads of a batch are queued one after the other
+   };
+
+   const controller&                   chain;
+   const uint16_t                      threads;
+   const fc::microseconds              window_time;
+   task_executor                       pool;
+   std::mutex                          mtx;
+   std::deque<queued_read>             reads;
+   uint64_t                            last_batch = 0;
+   uint64_t                            started_batch = 0;
+   bool                                window_scheduled = false;
+   std::unique_ptr<state_window>       window;
+   std::unique_ptr<boost::asio::steady_timer> window_timer;
+};
+
 class chain_plugin_impl {
 public:
    chain_plugin_impl()
@@ -149,6 +296,7 @@ public:
    ,incoming_block_channel(app().get_channel<incoming::channels::block>())
    ,incoming_block_sync_method(app().get_method<incoming::methods::block_sync>())
    ,incoming_transaction_async_method(app().get_method<incoming::methods::transaction_async>())
+   ,incoming_transactions_async_method(app().get_method<incoming::methods::transactions_async>())
    {}
 
    bfs::path                        blocks_dir;
@@ -166,7 +314,71 @@ public:
    //txn_msg_rate_limits              rate_limits;
    fc::optional<vm_type>            wasm_runtime;
    fc::microseconds                 abi_serializer_max_time_ms;
+   std::unique_ptr<chain_apis::abi_serializer_cache> abi_cache;
+   std::unique_ptr<chain_apis::producer_ranking_cache> producers_cache = std::make_unique<chain_apis::producer_ranking_cache>();
+   std::set<std::string>            async_signal_subscribers; ///< signal-async-subscriber
+   uint32_t                         async_signal_queue_size = chain::async_subscriber::default_capacity;
    fc::optional<bfs::path>          snapshot_path;
+   std::vector<bfs::path>           snapshot_delta_paths;
+
+   /// reader of snapshot_path with the deltas applied; `infile` is read if it is a single stream snapshot
+   snapshot_reader_ptr open_snapshot( std::ifstream& infile ) const {
+      snapshot_reader_ptr reader;
+      if( mapped_snapshot_reader::is_chunked_snapshot(*snapshot_path) ) {
+         reader = std::make_shared<mapped_snapshot_reader>(*snapshot_path);
+      } else {
+         reader = std::make_shared<istream_snapshot_reader>(infile);
+      }
+      for( const auto& delta : snapshot_delta_paths ) {
+         reader = std::make_shared<delta_snapshot_reader>(reader, delta);
+      }
+      return reader;
+   }
+   vector<controller::startup_phase> startup_phases; ///< of the plugin, those of the controller are merged in
+   fc::optional<bfs::path>          startup_timeline_file;
+   numa_stats                       startup_numa_stats; ///< before the database is opened
+
+   void add_startup_phase( const char* name, fc::time_point start ) {
+      startup_phases.push_back( { name, start, fc::time_point::now() - start } );
+   }
+
+   vector<controller::startup_phase> startup_timeline() const {
+      auto timeline = startup_phases;
+      if( chain ) {
+         const auto& c = chain->startup_timeline();
+         timeline.insert( timeline.end(), c.begin(), c.end() );
+      }
+      std::stable_sort( timeline.begin(), timeline.end(), []( const auto& a, const auto& b ) {
+         return a.start < b.start;
+      } );
+      return timeline;
+   }
+
+   /// logs the timeline and writes it to startup_timeline_file
+   void report_startup_timeline() const {
+      const auto timeline = startup_timeline();
+      for( const auto& p : timeline ) {
+         ilog( "startup phase ${p}: ${ms} ms", ("p", p.name)("ms", p.duration.count() / 1000) );
+      }
+      const auto numa = numa_stats::read();
+      const auto local = numa.local_pages - startup_numa_stats.local_pages;
+      const auto remote = numa.remote_pages - startup_numa_stats.remote_pages;
+      if( local + remote > 0 ) {
+         ilog( "startup allocated ${l} pages on the local NUMA node and ${r} on remote ones (${p}% remote, whole host)",
+               ("l", local)("r", remote)("p", remote * 100 / ( local + remote )) );
+      }
+      if( startup_timeline_file ) {
+         if( !fc::json::save_to_file( timeline, *startup_timeline_file, true ) ) {
+            elog( "unable to write startup timeline to ${f}", ("f", startup_timeline_file->generic_string()) );
+         }
+      }
+   }
+
+   uint16_t                         read_only_threads = 0;
+   fc::microseconds                 read_only_window_time;
+   fc::microseconds                 read_only_trx_max_time;
+   std::shared_ptr<read_only_queue> read_only_calls;
+   fc::optional<bfs::path>          state_window_file;
 
 
    // retained references to channels for easy publication
@@ -181,6 +393,7 @@ public:
    // retained references to methods for easy calling
    incoming::methods::block_sync::method_type&        incoming_block_sync_method;
    incoming::methods::transaction_async::method_type& incoming_transaction_async_method;
+   incoming::methods::transactions_async::method_type& incoming_transactions_async_method;
 
    // method provider handles
    methods::get_block_by_number::method_type::handle                 get_block_by_number_provider;
@@ -196,6 +409,19 @@ public:
    fc::optional<scoped_connection>                                   accepted_transaction_connection;
    fc::optional<scoped_connection>                                   applied_transaction_connection;
 
+   bool                                                              prune_scheduled = false;
+
+   /// the reversible blocks that irreversible blocks left behind are removed when the main thread is idle, a
+   /// lib-prune-blocks batch at a time
+   void schedule_prune() {
+      if( prune_scheduled || !chain_config->lib_prune_blocks ) return;
+      prune_scheduled = true;
+      chain::instrumented_post( app(), appbase::priority::lowest, chain::executor_category::other, [this]() {
+         prune_scheduled = false;
+         if( chain && chain->prune_irreversible( chain_config->lib_prune_blocks ) )
+            schedule_prune();
+      } );
+   }
 };
 
 chain_plugin::chain_plugin()
@@ -212,20 +438,62 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
    cfg.add_options()
          ("blocks-dir", bpo::value<bfs::path>()->default_value("blocks"),
           "the location of the blocks directory (absolute path or relative to application data dir)")
+         ("blocks-log-stride", bpo::value<uint32_t>()->default_value(0),
+          "split the block log into segments of this many blocks and compress older segments in background (0 to keep a single block log)")
+         ("blocks-archive-dir", bpo::value<bfs::path>(),
+          "the location of compressed block log segments (absolute path or relative to blocks dir), the blocks directory if not set")
+         ("blocks-archive-frame-size", bpo::value<uint32_t>()->default_value(256),
+          "number of blocks compressed together in a block log segment; a read decompresses the whole frame")
+         ("blocks-archive-cache-frames", bpo::value<uint32_t>()->default_value(8),
+          "number of decompressed frames of block log segments kept in memory")
+         ("blocks-log-buffer-kb", bpo::value<uint32_t>()->default_value(1024),
+          "KiB of irreversible blocks buffered before they are written to the block log in page aligned chunks (0 to write every block)")
+         ("blocks-log-fsync-blocks", bpo::value<uint32_t>()->default_value(0),
+          "fsync the block log in background every this many appended blocks (0 to leave it to the OS)")
+         ("blocks-log-fsync-on-lib", bpo::bool_switch()->default_value(false),
+          "fsync the block log in background once the blocks of each LIB advance are appended")
          ("protocol-features-dir", bpo::value<bfs::path>()->default_value("protocol_features"),
           "the location of the protocol_features directory (absolute path or relative to application config dir)")
          ("checkpoint", bpo::value<vector<string>>()->composing(), "Pairs of [BLOCK_NUM,BLOCK_ID] that should be enforced as checkpoints.")
          ("wasm-runtime", bpo::value<eosio::chain::wasm_interface::vm_type>()->value_name("wavm/wabt"), "Override default WASM runtime")
+         ("wasm-cache-dir", bpo::value<bfs::path>(),
+          "Keep the injected code of contracts in this directory across restarts (absolute path or relative to application data dir); "
+          "may be shared by the nodes of a host")
+         ("wasm-cache-size-mb", bpo::value<uint64_t>()->default_value(0),
+          "Estimated size of the instantiated contracts kept in memory, the least worth instantiating again are evicted first; 0 for no limit")
          ("abi-serializer-max-time-ms", bpo::value<uint32_t>()->default_value(config::default_abi_serializer_max_time_ms),
           "Override default maximum ABI serialization time allowed in ms")
+         ("abi-serializer-cache-size", bpo::value<uint32_t>()->default_value(256),
+          "Number of account ABIs kept unpacked and validated for the API calls; 0 to build them on every call")
+         ("signal-async-subscriber", bpo::value<vector<string>>()->composing()->multitoken(),
+          "Subscriber of the block signals run on a thread of its own instead of the main thread (may specify multiple times): telemetry, randpa")
+         ("signal-async-queue-size", bpo::value<uint32_t>()->default_value(chain::async_subscriber::default_capacity),
+          "Signals queued for an asynchronous subscriber; the main thread waits for the subscriber when its queue is full")
          ("chain-state-db-size-mb", bpo::value<uint64_t>()->default_value(config::default_state_size / (1024  * 1024)), "Maximum size (in MiB) of the chain state database")
          ("chain-state-db-guard-size-mb", bpo::value<uint64_t>()->default_value(config::default_state_guard_size / (1024  * 1024)), "Safely shut down node when free space remaining in the chain state database drops below this size (in MiB).")
          ("reversible-blocks-db-size-mb", bpo::value<uint64_t>()->default_value(config::default_reversible_cache_size / (1024  * 1024)), "Maximum size (in MiB) of the reversible blocks database")
          ("reversible-blocks-db-guard-size-mb", bpo::value<uint64_t>()->default_value(config::default_reversible_guard_size / (1024  * 1024)), "Safely shut down node when free space remaining in the reverseible blocks database drops below this size (in MiB).")
+         ("reversible-block-cache-mb", bpo::value<uint64_t>()->default_value(config::default_reversible_block_cache_size / (1024  * 1024)),
+          "Maximum size (in MiB, packed) of the recent reversible blocks kept decoded and shared with the fork database")
+         ("lib-prune-blocks", bpo::value<uint32_t>()->default_value(config::default_lib_prune_blocks),
+          "Number of reversible blocks removed once irreversible with each block applied; those left after a long LIB jump are removed when the node is idle. 0 to remove them all at once")
+         ("fork-db-compact-depth", bpo::value<uint32_t>()->default_value(config::default_fork_db_compact_depth),
+          "Number of blocks behind the head after which the fork database drops the transaction metadata of a block, "
+          "rebuilding it from the block if the block is popped. Bounds its memory during long finality stalls. 0 to keep it")
+         ("fork-switch-redo-blocks", bpo::value<uint32_t>()->default_value(config::default_fork_switch_redo_blocks),
+          "Number of recent reversible blocks whose state changes are kept when a fork switch pops them, so that switching back to them does not execute their transactions again. 0 to disable")
          ("signature-cpu-billable-pct", bpo::value<uint32_t>()->default_value(config::default_sig_cpu_bill_pct / config::percent_1),
           "Percentage of actual signature recovery cpu to bill. Whole number percentages, e.g. 50 for 50%")
          ("chain-threads", bpo::value<uint16_t>()->default_value(config::default_controller_thread_pool_size),
-          "Number of worker threads in controller thread pool")
+          "Number of worker threads in controller thread pool, shared with the producer, read-only and state history tasks")
+         ("read-only-threads", bpo::value<uint16_t>()->default_value(0),
+          "Number of threads running read-only chain API calls in parallel while the state is not written, 0 to run them on the main thread")
+         ("read-only-window-time-us", bpo::value<uint32_t>()->default_value(60000),
+          "Time in microseconds the main thread waits for parallel read-only chain API calls before continuing with other work")
+         ("read-only-transaction-time-us", bpo::value<uint32_t>()->default_value(10000),
+          "Wall time in microseconds a read-only transaction of send_read_only_transaction may execute for, independent of the block and account CPU limits")
+         ("read-replica-windows", bpo::bool_switch()->default_value(false),
+          "Publish the read windows of the state in state_window.bin of the state directory, for processes of the host reading the state mapping of this node. Requires read-only-threads and database-map-mode = mapped")
          ("contracts-console", bpo::bool_switch()->default_value(false),
           "print contract's output to console")
          ("actor-whitelist", boost::program_options::value<vector<string>>()->composing()->multitoken(),
@@ -257,6 +525,9 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
          ("disable-ram-billing-notify-checks", bpo::bool_switch()->default_value(false),
           "Disable the check which subjectively fails a transaction if a contract bills more RAM to another account within the context of a notification handler (i.e. when the receiver is not the code of the action).")
          ("trusted-producer", bpo::value<vector<string>>()->composing(), "Indicate a producer whose blocks headers signed by it will be fully validated, but transactions in those validated blocks will be trusted.")
+         ("partial-state-contract", bpo::value<vector<string>>()->composing(),
+          "Load only the tables of this contract from --snapshot (may specify multiple times). The node then serves reads, "
+          "it does not apply blocks; state_history_plugin with --state-history-follow-endpoint keeps the tables current.")
          ("database-map-mode", bpo::value<chainbase::pinnable_mapped_file::map_mode>()->default_value(chainbase::pinnable_mapped_file::map_mode::mapped),
           "Database map mode (\"mapped\", \"heap\", or \"locked\").\n"
           "In \"mapped\" mode database is memory mapped as a file.\n"
@@ -269,7 +540,17 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
          )
 #ifdef __linux__
          ("database-hugepage-path", bpo::value<vector<string>>()->composing(), "Optional path for database hugepages when in \"locked\" mode (may specify multiple times)")
+         ("database-numa-policy", bpo::value<string>()->default_value("default"),
+          "NUMA placement of the database and of the threads of the node (\"default\", \"interleave\" or \"bind:<node>\").\n"
+          "In \"interleave\" mode memory pages are spread over every node.\n"
+          "In \"bind:<node>\" mode memory pages are allocated on the node and the threads run on its CPUs.")
 #endif
+         ("database-prefault-threads", bpo::value<uint16_t>()->default_value(0),
+          "Number of threads reading the database file into the page cache before it is opened, 0 to not read it ahead. "
+          "In \"heap\" and \"locked\" mode the copy to memory then reads from the page cache, in \"mapped\" mode the first accesses do")
+         ("log-async-queue-size", bpo::value<uint32_t>()->default_value(0),
+          "Number of debug and info messages of the randpa, net and producer plugins queued for a background thread writing them, "
+          "0 to write them on the logging thread. Messages are dropped while the queue is full")
          ;
 
 // TODO: rate limiting
@@ -299,6 +580,12 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
           "clear chain state database and replay all blocks")
          ("hard-replay-blockchain", bpo::bool_switch()->default_value(false),
           "clear chain state database, recover as many blocks as possible from the block log, and then replay those blocks")
+         ("replay-timing-file", bpo::value<bfs::path>(),
+          "write the apply time, transactions, billed CPU, NET and RAM delta of every replayed block to this CSV file")
+         ("replay-max-blocks", bpo::value<uint32_t>()->default_value(0),
+          "replay at most this many irreversible blocks, then exit (0 for all)")
+         ("startup-timeline-file", bpo::value<bfs::path>(),
+          "write the duration of every startup phase (snapshot load, fork database open, replay, ...) to this JSON file")
          ("delete-all-blocks", bpo::bool_switch()->default_value(false),
           "clear chain state database and block log")
          ("truncate-at-block", bpo::value<uint32_t>()->default_value(0),
@@ -308,6 +595,8 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
          ("export-reversible-blocks", bpo::value<bfs::path>(),
            "export reversible block database in portable format into specified file and then exit")
          ("snapshot", bpo::value<bfs::path>(), "File to read Snapshot State from")
+         ("snapshot-delta", bpo::value<vector<bfs::path>>()->composing(),
+          "Delta snapshot to apply on top of --snapshot; may be repeated to apply a chain of deltas in the order they were written")
          ;
 
 }
@@ -349,6 +638,11 @@ void clear_directory_contents( const fc::path& p ) {
    }
 }
 
+/// written by net_plugin p2p-snapshot-bootstrap
+bfs::path bootstrap_snapshot_file() {
+   return app().data_dir() / "p2p-bootstrap-snapshot.bin";
+}
+
 void clear_chainbase_files( const fc::path& p ) {
    if( !fc::is_directory( p ) )
       return;
@@ -558,6 +852,7 @@ protocol_feature_set initialize_protocol_features( const fc::path& p, bool popul
 
 void chain_plugin::plugin_initialize(const variables_map& options) {
    ilog("initializing chain plugin");
+   const auto initialize_start = fc::time_point::now();
 
    try {
       try {
@@ -570,6 +865,9 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
 
       my->chain_config = controller::config();
 
+      if( const auto log_queue_size = options.at( "log-async-queue-size" ).as<uint32_t>() )
+         async_log::global().start( log_queue_size );
+
       LOAD_VALUE_SET( options, "sender-bypass-whiteblacklist", my->chain_config->sender_bypass_whiteblacklist );
       LOAD_VALUE_SET( options, "actor-whitelist", my->chain_config->actor_whitelist );
       LOAD_VALUE_SET( options, "actor-blacklist", my->chain_config->actor_blacklist );
@@ -577,6 +875,7 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
       LOAD_VALUE_SET( options, "contract-blacklist", my->chain_config->contract_blacklist );
 
       LOAD_VALUE_SET( options, "trusted-producer", my->chain_config->trusted_producers );
+      LOAD_VALUE_SET( options, "partial-state-contract", my->chain_config->partial_state_contracts );
 
       if( options.count( "action-blacklist" )) {
          const std::vector<std::string>& acts = options["action-blacklist"].as<std::vector<std::string>>();
@@ -606,6 +905,28 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
             my->blocks_dir = bld;
       }
 
+      {
+         auto& segments = my->chain_config->blocks_log_segments;
+         segments.stride = options.at( "blocks-log-stride" ).as<uint32_t>();
+         segments.blocks_per_frame = options.at( "blocks-archive-frame-size" ).as<uint32_t>();
+         segments.cache_frames = options.at( "blocks-archive-cache-frames" ).as<uint32_t>();
+         EOS_ASSERT( segments.blocks_per_frame > 0, plugin_config_exception, "blocks-archive-frame-size should be positive" );
+         if( options.count( "blocks-archive-dir" )) {
+            auto ad = options.at( "blocks-archive-dir" ).as<bfs::path>();
+            if( ad.is_relative())
+               segments.archive_dir = my->blocks_dir / ad;
+            else
+               segments.archive_dir = ad;
+         }
+      }
+
+      {
+         auto& writes = my->chain_config->blocks_log_writes;
+         writes.buffer_size = options.at( "blocks-log-buffer-kb" ).as<uint32_t>() * 1024;
+         writes.fsync_blocks = options.at( "blocks-log-fsync-blocks" ).as<uint32_t>();
+         writes.fsync_on_commit = options.at( "blocks-log-fsync-on-lib" ).as<bool>();
+      }
+
       protocol_feature_set pfs;
       {
          fc::path protocol_features_dir;
@@ -642,6 +963,16 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
       if(options.count("abi-serializer-max-time-ms"))
          my->abi_serializer_max_time_ms = fc::microseconds(options.at("abi-serializer-max-time-ms").as<uint32_t>() * 1000);
 
+      if( options.at( "abi-serializer-cache-size" ).as<uint32_t>() > 0 )
+         my->abi_cache = std::make_unique<chain_apis::abi_serializer_cache>( options.at( "abi-serializer-cache-size" ).as<uint32_t>() );
+
+      if( options.count( "signal-async-subscriber" ) ) {
+         const auto& names = options.at( "signal-async-subscriber" ).as<vector<string>>();
+         my->async_signal_subscribers.insert( names.begin(), names.end() );
+      }
+      my->async_signal_queue_size = options.at( "signal-async-queue-size" ).as<uint32_t>();
+      EOS_ASSERT( my->async_signal_queue_size > 0, plugin_config_exception, "signal-async-queue-size must be greater than 0" );
+
       my->chain_config->blocks_dir = my->blocks_dir;
       my->chain_config->state_dir = app().data_dir() / config::default_state_dir_name;
       my->chain_config->read_only = my->readonly;
@@ -656,9 +987,24 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
          my->chain_config->reversible_cache_size =
                options.at( "reversible-blocks-db-size-mb" ).as<uint64_t>() * 1024 * 1024;
 
+      my->chain_config->reversible_block_cache_size = options.at( "reversible-block-cache-mb" ).as<uint64_t>() * 1024 * 1024;
+      my->chain_config->fork_switch_redo_blocks = options.at( "fork-switch-redo-blocks" ).as<uint32_t>();
+      my->chain_config->lib_prune_blocks = options.at( "lib-prune-blocks" ).as<uint32_t>();
+      my->chain_config->fork_db_compact_depth = options.at( "fork-db-compact-depth" ).as<uint32_t>();
+
       if( options.count( "reversible-blocks-db-guard-size-mb" ))
          my->chain_config->reversible_guard_size = options.at( "reversible-blocks-db-guard-size-mb" ).as<uint64_t>() * 1024 * 1024;
 
+      my->read_only_threads = options.at( "read-only-threads" ).as<uint16_t>();
+      my->read_only_window_time = fc::microseconds( options.at( "read-only-window-time-us" ).as<uint32_t>() );
+      my->read_only_trx_max_time = fc::microseconds( options.at( "read-only-transaction-time-us" ).as<uint32_t>() );
+      EOS_ASSERT( my->read_only_threads == 0 || my->read_only_window_time > fc::microseconds(), plugin_config_exception,
+                  "read-only-window-time-us must be greater than 0" );
+      if( options.at( "read-replica-windows" ).as<bool>() ) {
+         EOS_ASSERT( my->read_only_threads > 0, plugin_config_exception, "read-replica-windows requires read-only-threads" );
+         my->state_window_file = my->chain_config->state_dir / "state_window.bin";
+      }
+
       if( options.count( "chain-threads" )) {
          my->chain_config->thread_pool_size = options.at( "chain-threads" ).as<uint16_t>();
          EOS_ASSERT( my->chain_config->thread_pool_size > 0, plugin_config_exception,
@@ -673,8 +1019,23 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
       if( my->wasm_runtime )
          my->chain_config->wasm_runtime = *my->wasm_runtime;
 
+      if( options.count( "wasm-cache-dir" )) {
+         auto dir = options.at( "wasm-cache-dir" ).as<bfs::path>();
+         my->chain_config->wasm_cache_dir = dir.is_relative() ? app().data_dir() / dir : dir;
+      }
+      my->chain_config->wasm_cache_size = options.at( "wasm-cache-size-mb" ).as<uint64_t>() * 1024 * 1024;
+
       my->chain_config->force_all_checks = options.at( "force-all-checks" ).as<bool>();
       my->chain_config->disable_replay_opts = options.at( "disable-replay-opts" ).as<bool>();
+      if( options.count( "replay-timing-file" )) {
+         auto file = options.at( "replay-timing-file" ).as<bfs::path>();
+         my->chain_config->replay_timing_file = file.is_relative() ? app().data_dir() / file : file;
+      }
+      my->chain_config->replay_max_blocks = options.at( "replay-max-blocks" ).as<uint32_t>();
+      if( options.count( "startup-timeline-file" )) {
+         auto file = options.at( "startup-timeline-file" ).as<bfs::path>();
+         my->startup_timeline_file = file.is_relative() ? app().data_dir() / file : file;
+      }
       my->chain_config->contracts_console = options.at( "contracts-console" ).as<bool>();
       my->chain_config->allow_ram_billing_in_notify = options.at( "disable-ram-billing-notify-checks" ).as<bool>();
 
@@ -790,16 +1151,36 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
 
       if (options.count( "snapshot" )) {
          my->snapshot_path = options.at( "snapshot" ).as<bfs::path>();
+      } else if( fc::is_regular_file( bootstrap_snapshot_file() ) ) {
+         // fetched from peers by p2p-snapshot-bootstrap of net_plugin, it replaces the chain started from genesis
+         ilog( "Loading snapshot fetched from peers '${p}': deleting state database and blocks",
+               ("p", bootstrap_snapshot_file().generic_string()) );
+         clear_directory_contents( my->chain_config->state_dir );
+         fc::remove_all( my->blocks_dir );
+         my->snapshot_path = bootstrap_snapshot_file();
+      }
+
+      if (my->snapshot_path) {
          EOS_ASSERT( fc::exists(*my->snapshot_path), plugin_config_exception,
                      "Cannot load snapshot, ${name} does not exist", ("name", my->snapshot_path->generic_string()) );
 
+         if( options.count( "snapshot-delta" )) {
+            my->snapshot_delta_paths = options.at( "snapshot-delta" ).as<vector<bfs::path>>();
+            for( const auto& delta : my->snapshot_delta_paths ) {
+               EOS_ASSERT( fc::exists(delta) && delta_snapshot_reader::is_delta_snapshot(delta), plugin_config_exception,
+                           "Cannot apply delta snapshot, ${name} does not exist or is not a delta snapshot",
+                           ("name", delta.generic_string()) );
+            }
+         }
+
          // recover genesis information from the snapshot
          auto infile = std::ifstream(my->snapshot_path->generic_string(), (std::ios::in | std::ios::binary));
-         auto reader = std::make_shared<istream_snapshot_reader>(infile);
+         snapshot_reader_ptr reader = my->open_snapshot( infile );
          reader->validate();
          reader->read_section<genesis_state>([this]( auto &section ){
             section.read_row(my->chain_config->genesis);
          });
+         reader.reset();
          infile.close();
 
          EOS_ASSERT( options.count( "genesis-timestamp" ) == 0,
@@ -908,12 +1289,26 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
       }
 
       my->chain_config->db_map_mode = options.at("database-map-mode").as<pinnable_mapped_file::map_mode>();
+      EOS_ASSERT( !my->state_window_file || my->chain_config->db_map_mode == pinnable_mapped_file::map_mode::mapped,
+                  plugin_config_exception, "read-replica-windows requires database-map-mode = mapped" );
 #ifdef __linux__
       if( options.count("database-hugepage-path") )
          my->chain_config->db_hugepage_paths = options.at("database-hugepage-path").as<std::vector<std::string>>();
+      // before the database is read and any thread of the chain is created, they inherit the placement
+      numa_placement::from_string( options.at( "database-numa-policy" ).as<string>() ).apply();
 #endif
+      my->startup_numa_stats = numa_stats::read();
+
+      if( const auto prefault_threads = options.at( "database-prefault-threads" ).as<uint16_t>() ) {
+         const auto prefault_start = fc::time_point::now();
+         const auto bytes = prefault_file( my->chain_config->state_dir / "shared_memory.bin", prefault_threads );
+         my->add_startup_phase( "database_prefault", prefault_start );
+         ilog( "read ${mb} MiB of the database ahead by ${n} threads", ("mb", bytes / 1024 / 1024)("n", prefault_threads) );
+      }
 
+      const auto open_start = fc::time_point::now();
       my->chain.emplace( *my->chain_config, std::move(pfs) );
+      my->add_startup_phase( "controller_open", open_start );
       my->chain_id.emplace( my->chain->get_chain_id());
 
       // set up method providers
@@ -961,6 +1356,7 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
 
       my->irreversible_block_connection = my->chain->irreversible_block.connect( [this]( const block_state_ptr& blk ) {
          my->irreversible_block_channel.publish( priority::low, blk );
+         my->schedule_prune();
       } );
 
       my->accepted_transaction_connection = my->chain->accepted_transaction.connect(
@@ -970,10 +1366,12 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
 
       my->applied_transaction_connection = my->chain->applied_transaction.connect(
             [this]( std::tuple<const transaction_trace_ptr&, const signed_transaction&> t ) {
+               my->producers_cache->on_applied_transaction( std::get<0>(t) );
                my->applied_transaction_channel.publish( priority::low, std::get<0>(t) );
             } );
 
       my->chain->add_indices();
+      my->add_startup_phase( "chain_plugin_initialize", initialize_start );
    } FC_LOG_AND_RETHROW()
 
 }
@@ -982,13 +1380,20 @@ void chain_plugin::plugin_startup()
 { try {
    EOS_ASSERT( my->chain_config->read_mode != db_read_mode::IRREVERSIBLE || !accept_transactions(), plugin_config_exception,
                "read-mode = irreversible. transactions should not be enabled by enable_accept_transactions" );
+   const auto startup_start = fc::time_point::now();
    try {
       auto shutdown = [](){ return app().is_quiting(); };
       if (my->snapshot_path) {
+         const auto snapshot_open_start = fc::time_point::now();
          auto infile = std::ifstream(my->snapshot_path->generic_string(), (std::ios::in | std::ios::binary));
-         auto reader = std::make_shared<istream_snapshot_reader>(infile);
+         snapshot_reader_ptr reader = my->open_snapshot( infile );
+         my->add_startup_phase( "snapshot_open", snapshot_open_start );
          my->chain->startup(shutdown, reader);
+         reader.reset();
          infile.close();
+         if( *my->snapshot_path == bootstrap_snapshot_file() ) {
+            fc::remove( *my->snapshot_path );
+         }
       } else {
          my->chain->startup(shutdown);
       }
@@ -1006,9 +1411,32 @@ void chain_plugin::plugin_startup()
    ilog("Blockchain started; head block is #${num}, genesis timestamp is ${ts}",
         ("num", my->chain->head_block_num())("ts", (std::string)my->chain_config->genesis.initial_timestamp));
 
+   if( my->chain_config->replay_max_blocks ) {
+      ilog( "replay-max-blocks is set, exiting" );
+      app().quit();
+   }
+
+   if( my->read_only_threads > 0 ) {
+      std::unique_ptr<state_window> window;
+      if( my->state_window_file )
+         window = std::make_unique<state_window>( *my->state_window_file, true );
+      auto& scheduler = my->chain->get_task_scheduler();
+      scheduler.add_workers( "ro", my->read_only_threads );
+      auto calls = std::make_shared<read_only_queue>( *my->chain, scheduler, my->read_only_threads, my->read_only_window_time,
+                                                      std::move( window ) );
+      calls->watch_window_readers();
+      std::atomic_store( &my->read_only_calls, calls );
+   }
+
    my->chain_config.reset();
+   my->add_startup_phase( "chain_plugin_startup", startup_start );
+   my->report_startup_timeline();
 } FC_CAPTURE_AND_RETHROW() }
 
+vector<controller::startup_phase> chain_plugin::startup_timeline() const {
+   return my->startup_timeline();
+}
+
 void chain_plugin::plugin_shutdown() {
    my->pre_accepted_block_connection.reset();
    my->accepted_block_header_connection.reset();
@@ -1018,13 +1446,42 @@ void chain_plugin::plugin_shutdown() {
    my->applied_transaction_connection.reset();
    if(app().is_quiting())
       my->chain->get_wasm_interface().indicate_shutting_down();
+   std::atomic_store( &my->read_only_calls, std::shared_ptr<read_only_queue>() );
    my->chain.reset();
+   async_log::global().stop();
+}
+
+// http threads may post while the plugin shuts down, calls posted after that are dropped
+void chain_plugin::post_read_only( std::function<void()> read ) {
+   if( my->read_only_threads > 0 ) {
+      if( auto queue = std::atomic_load( &my->read_only_calls ) )
+         queue->post( std::move( read ) );
+   } else {
+      read();
+   }
 }
 
-chain_apis::read_write::read_write(controller& db, const fc::microseconds& abi_serializer_max_time, bool api_accept_transactions)
+bool chain_plugin::has_read_only_threads() const {
+   return my->read_only_threads > 0;
+}
+
+void chain_plugin::post_read_only( std::vector<std::function<void()>> reads ) {
+   if( my->read_only_threads > 0 ) {
+      if( auto queue = std::atomic_load( &my->read_only_calls ) )
+         queue->post( std::move( reads ) );
+   } else {
+      for( auto& read : reads )
+         read();
+   }
+}
+
+chain_apis::read_write::read_write(controller& db, const fc::microseconds& abi_serializer_max_time, bool api_accept_transactions,
+                                   abi_serializer_cache* abi_cache, const fc::microseconds& read_only_trx_max_time)
 : db(db)
 , abi_serializer_max_time(abi_serializer_max_time)
+, abi_cache(abi_cache)
 , api_accept_transactions(api_accept_transactions)
+, read_only_trx_max_time(read_only_trx_max_time)
 {
 }
 
@@ -1045,6 +1502,10 @@ void chain_plugin::accept_transaction(const chain::transaction_metadata_ptr& trx
    my->incoming_transaction_async_method(trx, false, std::forward<decltype(next)>(next));
 }
 
+void chain_plugin::accept_transactions(const std::vector<std::pair<chain::transaction_metadata_ptr, chain::plugin_interface::next_function<chain::transaction_trace_ptr>>>& trxs) {
+   my->incoming_transactions_async_method(trxs);
+}
+
 bool chain_plugin::block_is_on_preferred_chain(const block_id_type& block_id) {
    auto b = chain().fetch_block_by_number( block_header::num_from_id(block_id) );
    return b && b->id() == block_id;
@@ -1253,6 +1714,16 @@ bool chain_plugin::export_reversible_blocks( const fc::path& reversible_dir,
 controller& chain_plugin::chain() { return *my->chain; }
 const controller& chain_plugin::chain() const { return *my->chain; }
 
+fc::path chain_plugin::bootstrap_snapshot_path()const {
+   return bootstrap_snapshot_file();
+}
+
+std::shared_ptr<chain::async_subscriber> chain_plugin::make_async_subscriber( const std::string& name )const {
+   if( !my->async_signal_subscribers.count( name ) ) return {};
+   ilog( "${n} handles the block signals on a thread of its own", ("n", name) );
+   return std::make_shared<chain::async_subscriber>( name, my->async_signal_queue_size );
+}
+
 chain::chain_id_type chain_plugin::get_chain_id()const {
    EOS_ASSERT( my->chain_id.valid(), chain_id_type_exception, "chain ID has not been initialized yet" );
    return *my->chain_id;
@@ -1262,6 +1733,18 @@ fc::microseconds chain_plugin::get_abi_serializer_max_time() const {
    return my->abi_serializer_max_time_ms;
 }
 
+fc::microseconds chain_plugin::get_read_only_transaction_max_time() const {
+   return my->read_only_trx_max_time;
+}
+
+chain_apis::abi_serializer_cache* chain_plugin::get_abi_serializer_cache() const {
+   return my->abi_cache.get();
+}
+
+chain_apis::producer_ranking_cache* chain_plugin::get_producer_ranking_cache() const {
+   return my->producers_cache.get();
+}
+
 bool chain_plugin::api_accept_transactions() const{
    return my->api_accept_transactions;
 }
@@ -1498,15 +1981,6 @@ double convert_to_type(const string& str, const string& desc) {
    return val;
 }
 
-abi_def get_abi( const controller& db, const name& account ) {
-   const auto &d = db.db();
-   const account_object *code_accnt = d.find<account_object, by_name>(account);
-   EOS_ASSERT(code_accnt != nullptr, chain::account_query_exception, "Fail to retrieve account for ${account}", ("account", account) );
-   abi_def abi;
-   abi_serializer::to_abi(code_accnt->abi, abi);
-   return abi;
-}
-
 string get_table_type( const abi_def& abi, const name& table_name ) {
    for( const auto& t : abi.tables ) {
       if( t.name == table_name ){
@@ -1516,8 +1990,83 @@ string get_table_type( const abi_def& abi, const name& table_name ) {
    EOS_ASSERT( false, chain::contract_table_query_exception, "Table ${table} is not specified in the ABI", ("table",table_name) );
 }
 
-read_only::get_table_rows_result read_only::get_table_rows( const read_only::get_table_rows_params& p )const {
-   const abi_def abi = eosio::chain_apis::get_abi( db, p.code );
+abi_serializer_cache::entry_ptr abi_serializer_cache::get( abi_serializer_cache* cache, const controller& db, const name& account,
+                                                           const fc::microseconds& max_serialization_time ) {
+   const auto& d = db.db();
+   const auto* accnt = d.find<account_object, by_name>( account );
+   if( accnt == nullptr ) return nullptr;
+
+   const auto make_entry = [&]() {
+      auto e = std::make_shared<entry>();
+      if( abi_serializer::to_abi( accnt->abi, e->abi ) ) {
+         e->serializer.set_abi( e->abi, max_serialization_time );
+         e->empty = false;
+      }
+      return e;
+   };
+   if( cache == nullptr ) return make_entry();
+
+   const auto abi_sequence = d.get<account_metadata_object, by_name>( account ).abi_sequence;
+   const auto is_current = [&]( const cached& c ) {
+      return c.abi_sequence == abi_sequence && c.raw_abi.size() == accnt->abi.size()
+             && std::equal( c.raw_abi.begin(), c.raw_abi.end(), accnt->abi.data() );
+   };
+   {
+      std::lock_guard<std::mutex> g( cache->mtx );
+      auto itr = cache->entries.find( account );
+      if( itr != cache->entries.end() && is_current( itr->second ) ) {
+         cache->lru.splice( cache->lru.begin(), cache->lru, itr->second.lru_itr );
+         return itr->second.abi;
+      }
+   }
+
+   // validation of a large ABI takes a while, other calls are not blocked meanwhile
+   entry_ptr e = make_entry();
+
+   std::lock_guard<std::mutex> g( cache->mtx );
+   auto res = cache->entries.emplace( account, cached() );
+   auto& c = res.first->second;
+   if( res.second ) {
+      cache->lru.push_front( account );
+      c.lru_itr = cache->lru.begin();
+   } else {
+      cache->lru.splice( cache->lru.begin(), cache->lru, c.lru_itr );
+   }
+   c.abi_sequence = abi_sequence;
+   c.raw_abi.assign( accnt->abi.data(), accnt->abi.size() );
+   c.abi = e;
+   while( cache->entries.size() > cache->max_size ) {
+      cache->entries.erase( cache->lru.back() );
+      cache->lru.pop_back();
+   }
+   return e;
+}
+
+abi_serializer_cache::entry_ptr read_only::get_abi_entry( const name& account )const {
+   auto e = abi_serializer_cache::get( abi_cache, db, account, abi_serializer_max_time );
+   EOS_ASSERT( e, chain::account_query_exception, "Fail to retrieve account for ${account}", ("account", account) );
+   return e;
+}
+
+string read_only::encode_table_cursor( const table_cursor& c ) {
+   const auto packed = fc::raw::pack( c );
+   return fc::to_hex( packed.data(), packed.size() );
+}
+
+read_only::table_cursor read_only::decode_table_cursor( const read_only::get_table_rows_params& p, uint64_t index, size_t secondary_size ) {
+   table_cursor c;
+   try {
+      vector<char> packed( p.cursor.size() / 2 );
+      EOS_ASSERT( fc::from_hex( p.cursor, packed.data(), packed.size() ) == packed.size(), chain::contract_table_query_exception, "Invalid cursor" );
+      c = fc::raw::unpack<table_cursor>( packed );
+   } EOS_RETHROW_EXCEPTIONS( chain::contract_table_query_exception, "Invalid cursor: ${c}", ("c", p.cursor) )
+   EOS_ASSERT( c.index == index && c.reverse == (p.reverse && *p.reverse) && c.secondary.size() == secondary_size,
+               chain::contract_table_query_exception, "Cursor ${c} is for another index or direction", ("c", p.cursor) );
+   return c;
+}
+
+template <typename RowF>
+optional<read_only::table_cursor> read_only::walk_table_rows( const read_only::get_table_rows_params& p, const abi_def& abi, RowF&& add_row )const {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wstrict-aliasing"
    bool primary = false;
@@ -1526,57 +2075,134 @@ read_only::get_table_rows_result read_only::get_table_rows( const read_only::get
       EOS_ASSERT( p.table == table_with_index, chain::contract_table_query_exception, "Invalid table name ${t}", ( "t", p.table ));
       auto table_type = get_table_type( abi, p.table );
       if( table_type == KEYi64 || p.key_type == "i64" || p.key_type == "name" ) {
-         return get_table_rows_ex<key_value_index>(p,abi);
+         return walk_table_rows_ex<key_value_index>(p, add_row);
       }
       EOS_ASSERT( false, chain::contract_table_query_exception,  "Invalid table type ${type}", ("type",table_type)("abi",abi));
    } else {
       EOS_ASSERT( !p.key_type.empty(), chain::contract_table_query_exception, "key type required for non-primary index" );
 
       if (p.key_type == chain_apis::i64 || p.key_type == "name") {
-         return get_table_rows_by_seckey<index64_index, uint64_t>(p, abi, [](uint64_t v)->uint64_t {
+         return walk_table_rows_by_seckey<index64_index, uint64_t>(p, [](uint64_t v)->uint64_t {
             return v;
-         });
+         }, add_row);
       }
       else if (p.key_type == chain_apis::i128) {
-         return get_table_rows_by_seckey<index128_index, uint128_t>(p, abi, [](uint128_t v)->uint128_t {
+         return walk_table_rows_by_seckey<index128_index, uint128_t>(p, [](uint128_t v)->uint128_t {
             return v;
-         });
+         }, add_row);
       }
       else if (p.key_type == chain_apis::i256) {
          if ( p.encode_type == chain_apis::hex) {
             using  conv = keytype_converter<chain_apis::sha256,chain_apis::hex>;
-            return get_table_rows_by_seckey<conv::index_type, conv::input_type>(p, abi, conv::function());
+            return walk_table_rows_by_seckey<conv::index_type, conv::input_type>(p, conv::function(), add_row);
          }
          using  conv = keytype_converter<chain_apis::i256>;
-         return get_table_rows_by_seckey<conv::index_type, conv::input_type>(p, abi, conv::function());
+         return walk_table_rows_by_seckey<conv::index_type, conv::input_type>(p, conv::function(), add_row);
       }
       else if (p.key_type == chain_apis::float64) {
-         return get_table_rows_by_seckey<index_double_index, double>(p, abi, [](double v)->float64_t {
+         return walk_table_rows_by_seckey<index_double_index, double>(p, [](double v)->float64_t {
             float64_t f = *(float64_t *)&v;
             return f;
-         });
+         }, add_row);
       }
       else if (p.key_type == chain_apis::float128) {
-         return get_table_rows_by_seckey<index_long_double_index, double>(p, abi, [](double v)->float128_t{
+         return walk_table_rows_by_seckey<index_long_double_index, double>(p, [](double v)->float128_t{
             float64_t f = *(float64_t *)&v;
             float128_t f128;
             f64_to_f128M(f, &f128);
             return f128;
-         });
+         }, add_row);
       }
       else if (p.key_type == chain_apis::sha256) {
          using  conv = keytype_converter<chain_apis::sha256,chain_apis::hex>;
-         return get_table_rows_by_seckey<conv::index_type, conv::input_type>(p, abi, conv::function());
+         return walk_table_rows_by_seckey<conv::index_type, conv::input_type>(p, conv::function(), add_row);
       }
       else if(p.key_type == chain_apis::ripemd160) {
          using  conv = keytype_converter<chain_apis::ripemd160,chain_apis::hex>;
-         return get_table_rows_by_seckey<conv::index_type, conv::input_type>(p, abi, conv::function());
+         return walk_table_rows_by_seckey<conv::index_type, conv::input_type>(p, conv::function(), add_row);
       }
       EOS_ASSERT(false, chain::contract_table_query_exception,  "Unsupported secondary index type: ${t}", ("t", p.key_type));
    }
 #pragma GCC diagnostic pop
 }
 
+read_only::get_table_rows_result read_only::get_table_rows( const read_only::get_table_rows_params& p )const {
+   const auto abi_entry = get_abi_entry( p.code );
+   const abi_serializer& abis = abi_entry->serializer;
+   const auto table_type = p.json ? abis.get_table_type( p.table ) : string();
+
+   read_only::get_table_rows_result result;
+   const auto next = walk_table_rows( p, abi_entry->abi, [&]( const vector<char>& data, const account_name& payer ) {
+      fc::variant data_var;
+      if( p.json ) {
+         data_var = abis.binary_to_variant( table_type, data, abi_serializer_max_time, shorten_abi_errors );
+      } else {
+         data_var = fc::variant( data );
+      }
+
+      if( p.show_payer && *p.show_payer ) {
+         result.rows.emplace_back( fc::mutable_variant_object("data", std::move(data_var))("payer", payer) );
+      } else {
+         result.rows.emplace_back( std::move(data_var) );
+      }
+   });
+   if( next ) {
+      result.more = true;
+      result.next_cursor = encode_table_cursor( *next );
+   }
+   return result;
+}
+
+read_only::get_raw_table_rows_result read_only::get_raw_table_rows( const read_only::get_raw_table_rows_params& p )const {
+   const auto abi_entry = get_abi_entry( p.code );
+   const bool show_payer = p.show_payer && *p.show_payer;
+
+   read_only::get_raw_table_rows_result result;
+   const auto next = walk_table_rows( p, abi_entry->abi, [&]( const vector<char>& data, const account_name& payer ) {
+      result.rows.emplace_back( data );
+      if( show_payer ) result.payers.emplace_back( payer );
+   });
+   if( next ) {
+      result.more = true;
+      result.next_cursor = encode_table_cursor( *next );
+   }
+   return result;
+}
+
+string read_only::get_table_rows_json( const read_only::get_table_rows_params& p )const {
+   const auto abi_entry = get_abi_entry( p.code );
+   const abi_serializer& abis = abi_entry->serializer;
+   const auto table_type = p.json ? abis.get_table_type( p.table ) : string();
+   const auto no_deadline = fc::time_point::maximum();
+
+   // same layout as get_table_rows_result
+   string out = "{\"rows\":[";
+   bool first = true;
+   const auto next = walk_table_rows( p, abi_entry->abi, [&]( const vector<char>& data, const account_name& payer ) {
+      if( !first ) out += ',';
+      first = false;
+      const bool show_payer = p.show_payer && *p.show_payer;
+      if( show_payer ) out += "{\"data\":";
+      if( p.json ) {
+         fc::datastream<const char*> ds( data.data(), data.size() );
+         abis.binary_to_json( table_type, ds, out, abi_serializer_max_time, shorten_abi_errors );
+      } else {
+         out += fc::json::to_string( fc::variant( data ), no_deadline );
+      }
+      if( show_payer ) {
+         out += ",\"payer\":";
+         out += fc::json::to_string( fc::variant( payer ), no_deadline );
+         out += '}';
+      }
+   });
+   out += "],\"more\":";
+   out += next ? "true" : "false";
+   out += ",\"next_cursor\":\"";
+   if( next ) out += encode_table_cursor( *next );
+   out += "\"}";
+   return out;
+}
+
 read_only::get_table_by_scope_result read_only::get_table_by_scope( const read_only::get_table_by_scope_params& p )const {
    read_only::get_table_by_scope_result result;
    const auto& d = db.db();
@@ -1627,8 +2253,7 @@ read_only::get_table_by_scope_result read_only::get_table_by_scope( const read_o
 
 vector<asset> read_only::get_currency_balance( const read_only::get_currency_balance_params& p )const {
 
-   const abi_def abi = eosio::chain_apis::get_abi( db, p.code );
-   (void)get_table_type( abi, "accounts" );
+   (void)get_table_type( get_abi_entry( p.code )->abi, "accounts" );
 
    vector<asset> results;
    walk_key_value_table(p.code, p.account, N(accounts), [&](const key_value_object& obj){
@@ -1651,11 +2276,42 @@ vector<asset> read_only::get_currency_balance( const read_only::get_currency_bal
    return results;
 }
 
+read_only::get_currency_balances_result read_only::get_currency_balances( const read_only::get_currency_balances_params& p )const {
+   EOS_ASSERT( p.accounts.size() * p.codes.size() <= max_currency_balances_pairs, chain::contract_table_query_exception,
+               "Too many pairs of accounts and contracts, at most ${n}", ("n", max_currency_balances_pairs) );
+
+   get_currency_balances_result results;
+   for( const auto& code : p.codes ) {
+      for( const auto& account : p.accounts ) {
+         get_currency_balances_result_row row{ account, code, {} };
+         // rows of the accounts table start with the asset of the balance, as in get_currency_balance
+         walk_key_value_table(code, account, N(accounts), [&](const key_value_object& obj){
+            EOS_ASSERT( obj.value.size() >= sizeof(asset), chain::asset_type_exception, "Invalid data on table");
+
+            asset cursor;
+            fc::datastream<const char *> ds(obj.value.data(), obj.value.size());
+            fc::raw::unpack(ds, cursor);
+
+            EOS_ASSERT( cursor.get_symbol().valid(), chain::asset_type_exception, "Invalid asset");
+
+            const bool match = !p.symbol || boost::iequals(cursor.symbol_name(), *p.symbol);
+            if( match ) {
+               row.balances.emplace_back(cursor);
+            }
+            return !(p.symbol && match);
+         });
+         if( !row.balances.empty() ) {
+            results.emplace_back( std::move(row) );
+         }
+      }
+   }
+   return results;
+}
+
 fc::variant read_only::get_currency_stats( const read_only::get_currency_stats_params& p )const {
    fc::mutable_variant_object results;
 
-   const abi_def abi = eosio::chain_apis::get_abi( db, p.code );
-   (void)get_table_type( abi, "stat" );
+   (void)get_table_type( get_abi_entry( p.code )->abi, "stat" );
 
    uint64_t scope = ( eosio::chain::string_to_symbol( 0, boost::algorithm::to_upper_copy(p.symbol).c_str() ) >> 8 );
 
@@ -1692,54 +2348,87 @@ fc::variant get_global_row( const database& db, const abi_def& abi, const abi_se
    return abis.binary_to_variant(abis.get_table_type(N(global)), data, abi_serializer_max_time_ms, shorten_abi_errors );
 }
 
-read_only::get_producers_result read_only::get_producers( const read_only::get_producers_params& p ) const try {
-   const abi_def abi = eosio::chain_apis::get_abi(db, config::system_account_name);
-   const auto table_type = get_table_type(abi, N(producers));
-   const abi_serializer abis{ abi, abi_serializer_max_time };
-   EOS_ASSERT(table_type == KEYi64, chain::contract_table_query_exception, "Invalid table type ${type} for table producers", ("type",table_type));
-
-   const auto& d = db.db();
-   const auto lower = name{p.lower_bound};
-
-   static const uint8_t secondary_index_num = 0;
-   const auto* const table_id = d.find<chain::table_id_object, chain::by_code_scope_table>(
-           boost::make_tuple(config::system_account_name, config::system_account_name, N(producers)));
-   const auto* const secondary_table_id = d.find<chain::table_id_object, chain::by_code_scope_table>(
-           boost::make_tuple(config::system_account_name, config::system_account_name, N(producers) | secondary_index_num));
-   EOS_ASSERT(table_id && secondary_table_id, chain::contract_table_query_exception, "Missing producers table");
-
-   const auto& kv_index = d.get_index<key_value_index, by_scope_primary>();
-   const auto& secondary_index = d.get_index<index_double_index>().indices();
-   const auto& secondary_index_by_primary = secondary_index.get<by_primary>();
-   const auto& secondary_index_by_secondary = secondary_index.get<by_secondary>();
+void producer_ranking_cache::on_applied_transaction( const transaction_trace_ptr& trace ) {
+   for( const auto& at : trace->action_traces ) {
+      if( at.receiver == config::system_account_name ) {
+         ++generation;
+         return;
+      }
+   }
+}
 
-   read_only::get_producers_result result;
-   const auto stopTime = fc::time_point::now() + fc::microseconds(1000 * 10); // 10ms
-   vector<char> data;
+producer_ranking_cache::ranking_ptr producer_ranking_cache::get( producer_ranking_cache* cache, const controller& db, bool json,
+                                                                 const std::function<ranking()>& make ) {
+   if( cache == nullptr ) return std::make_shared<ranking>( make() );
+   // a transaction of the system contract undone and another applied leave the revision as it was
+   const auto revision = db.db().revision();
+   const auto generation = cache->generation.load();
+   auto& c = cache->rankings[json];
+   {
+      std::lock_guard<std::mutex> g( cache->mtx );
+      if( c.value && c.revision == revision && c.generation == generation )
+         return c.value;
+   }
+   auto r = std::make_shared<const ranking>( make() );
+   std::lock_guard<std::mutex> g( cache->mtx );
+   c.revision = revision;
+   c.generation = generation;
+   c.value = r;
+   return r;
+}
 
-   auto it = [&]{
-      if(lower.value == 0)
-         return secondary_index_by_secondary.lower_bound(
+read_only::get_producers_result read_only::get_producers( const read_only::get_producers_params& p ) const try {
+   const auto make_ranking = [&]() {
+      const auto abi_entry = get_abi_entry( config::system_account_name );
+      const abi_def& abi = abi_entry->abi;
+      const auto table_type = get_table_type(abi, N(producers));
+      const abi_serializer& abis = abi_entry->serializer;
+      EOS_ASSERT(table_type == KEYi64, chain::contract_table_query_exception, "Invalid table type ${type} for table producers", ("type",table_type));
+
+      const auto& d = db.db();
+      static const uint8_t secondary_index_num = 0;
+      const auto* const table_id = d.find<chain::table_id_object, chain::by_code_scope_table>(
+              boost::make_tuple(config::system_account_name, config::system_account_name, N(producers)));
+      const auto* const secondary_table_id = d.find<chain::table_id_object, chain::by_code_scope_table>(
+              boost::make_tuple(config::system_account_name, config::system_account_name, N(producers) | secondary_index_num));
+      EOS_ASSERT(table_id && secondary_table_id, chain::contract_table_query_exception, "Missing producers table");
+
+      const auto& kv_index = d.get_index<key_value_index, by_scope_primary>();
+      const auto& secondary_index_by_secondary = d.get_index<index_double_index, by_secondary>();
+
+      producer_ranking_cache::ranking r;
+      vector<char> data;
+      auto it = secondary_index_by_secondary.lower_bound(
             boost::make_tuple(secondary_table_id->id, to_softfloat64(std::numeric_limits<double>::lowest()), 0));
-      else
-         return secondary_index.project<by_secondary>(
-            secondary_index_by_primary.lower_bound(
-               boost::make_tuple(secondary_table_id->id, lower.value)));
-   }();
-
-   for( ; it != secondary_index_by_secondary.end() && it->t_id == secondary_table_id->id; ++it ) {
-      if (result.rows.size() >= p.limit || fc::time_point::now() > stopTime) {
-         result.more = name{it->primary_key}.to_string();
-         break;
-      }
-      copy_inline_row(*kv_index.find(boost::make_tuple(table_id->id, it->primary_key)), data);
-      if (p.json)
-         result.rows.emplace_back( abis.binary_to_variant( abis.get_table_type(N(producers)), data, abi_serializer_max_time, shorten_abi_errors ) );
-      else
-         result.rows.emplace_back(fc::variant(data));
+      for( ; it != secondary_index_by_secondary.end() && it->t_id == secondary_table_id->id; ++it ) {
+         copy_inline_row(*kv_index.find(boost::make_tuple(table_id->id, it->primary_key)), data);
+         r.positions.emplace( it->primary_key, r.rows.size() );
+         r.owners.emplace_back( it->primary_key );
+         if (p.json)
+            r.rows.emplace_back( abis.binary_to_variant( abis.get_table_type(N(producers)), data, abi_serializer_max_time, shorten_abi_errors ) );
+         else
+            r.rows.emplace_back(fc::variant(data));
+      }
+      r.total_producer_vote_weight = get_global_row(d, abi, abis, abi_serializer_max_time, shorten_abi_errors)["total_producer_vote_weight"].as_double();
+      return r;
+   };
+   const auto ranking = producer_ranking_cache::get( producers_cache, db, p.json, make_ranking );
+
+   // from the producer of lower_bound, or of the next owner when it has no row
+   const auto lower = name{p.lower_bound};
+   size_t first = 0;
+   if( lower.value != 0 ) {
+      auto pos = ranking->positions.lower_bound( lower.value );
+      first = pos == ranking->positions.end() ? ranking->rows.size() : pos->second;
    }
 
-   result.total_producer_vote_weight = get_global_row(d, abi, abis, abi_serializer_max_time, shorten_abi_errors)["total_producer_vote_weight"].as_double();
+   read_only::get_producers_result result;
+   const auto last = std::min<size_t>( ranking->rows.size(), first + p.limit );
+   if( first < last )
+      result.rows.assign( ranking->rows.begin() + first, ranking->rows.begin() + last );
+   if( last < ranking->rows.size() )
+      result.more = ranking->owners[last].to_string();
+   result.total_producer_vote_weight = ranking->total_producer_vote_weight;
    return result;
 } catch (...) {
    read_only::get_producers_result result;
@@ -1771,16 +2460,10 @@ read_only::get_producer_schedule_result read_only::get_producer_schedule( const
 template<typename Api>
 struct resolver_factory {
    static auto make(const Api* api, const fc::microseconds& max_serialization_time) {
-      return [api, max_serialization_time](const account_name &name) -> optional<abi_serializer> {
-         const auto* accnt = api->db.db().template find<account_object, by_name>(name);
-         if (accnt != nullptr) {
-            abi_def abi;
-            if (abi_serializer::to_abi(accnt->abi, abi)) {
-               return abi_serializer(abi, max_serialization_time);
-            }
-         }
-
-         return optional<abi_serializer>();
+      return [api, max_serialization_time](const account_name &name) -> std::shared_ptr<const abi_serializer> {
+         auto e = abi_serializer_cache::get( api->abi_cache, api->db, name, max_serialization_time );
+         if( !e || e->empty ) return nullptr;
+         return std::shared_ptr<const abi_serializer>( e, &e->serializer );
       };
    }
 };
@@ -1864,28 +2547,56 @@ read_only::get_scheduled_transactions( const read_only::get_scheduled_transactio
    return result;
 }
 
-fc::variant read_only::get_block(const read_only::get_block_params& params) const {
-   signed_block_ptr block;
-   optional<uint64_t> block_num;
-
-   EOS_ASSERT( !params.block_num_or_id.empty() && params.block_num_or_id.size() <= 64,
+// block number and, if `block_num_or_id` is an ID, the ID
+static std::pair<uint32_t, optional<block_id_type>> parse_block_num_or_id( const string& block_num_or_id ) {
+   EOS_ASSERT( !block_num_or_id.empty() && block_num_or_id.size() <= 64,
                chain::block_id_type_exception,
                "Invalid Block number or ID, must be greater than 0 and less than 64 characters"
    );
 
    try {
-      block_num = fc::to_uint64(params.block_num_or_id);
+      return { static_cast<uint32_t>( fc::to_uint64(block_num_or_id) ), optional<block_id_type>() };
    } catch( ... ) {}
 
-   if( block_num.valid() ) {
-      block = db.fetch_block_by_number( *block_num );
-   } else {
-      try {
-         block = db.fetch_block_by_id( fc::variant(params.block_num_or_id).as<block_id_type>() );
-      } EOS_RETHROW_EXCEPTIONS(chain::block_id_type_exception, "Invalid block ID: ${block_num_or_id}", ("block_num_or_id", params.block_num_or_id))
+   try {
+      auto id = fc::variant(block_num_or_id).as<block_id_type>();
+      return { block_header::num_from_id(id), id };
+   } EOS_RETHROW_EXCEPTIONS(chain::block_id_type_exception, "Invalid block ID: ${block_num_or_id}", ("block_num_or_id", block_num_or_id))
+}
+
+signed_block_ptr read_only::fetch_block( const string& block_num_or_id )const {
+   const auto num_or_id = parse_block_num_or_id( block_num_or_id );
+   auto block = num_or_id.second ? db.fetch_block_by_id( *num_or_id.second ) : db.fetch_block_by_number( num_or_id.first );
+   EOS_ASSERT( block, unknown_block_exception, "Could not find block: ${block}", ("block", block_num_or_id));
+   return block;
+}
+
+read_only::get_raw_block_results read_only::get_raw_block(const read_only::get_raw_block_params& params) const {
+   const auto num_or_id = parse_block_num_or_id( params.block_num_or_id );
+
+   // blocks that are in the log but not reversible, as fetch_block_by_number looks them up
+   if( !db.fetch_block_state_by_number( num_or_id.first ) ) {
+      if( auto packed = db.fetch_packed_block_by_number( num_or_id.first ) ) {
+         if( !num_or_id.second )
+            return packed;
+         signed_block_header header;
+         fc::datastream<const char*> ds( packed.data, packed.size );
+         fc::raw::unpack( ds, header );
+         EOS_ASSERT( header.id() == *num_or_id.second, unknown_block_exception, "Could not find block: ${block}", ("block", params.block_num_or_id));
+         return packed;
+      }
    }
 
-   EOS_ASSERT( block, unknown_block_exception, "Could not find block: ${block}", ("block", params.block_num_or_id));
+   auto data = std::make_shared<vector<char>>( fc::raw::pack( *fetch_block( params.block_num_or_id ) ) );
+   get_raw_block_results result;
+   result.data = data->data();
+   result.size = data->size();
+   result.mapping = std::move( data );
+   return result;
+}
+
+fc::variant read_only::get_block(const read_only::get_block_params& params) const {
+   const auto block = fetch_block( params.block_num_or_id );
 
    fc::variant pretty_output;
    abi_serializer::to_variant(*block, pretty_output, make_resolver(this, abi_serializer_max_time), abi_serializer_max_time);
@@ -1932,6 +2643,64 @@ void read_write::push_block(read_write::push_block_params&& params, next_functio
    } CATCH_AND_CALL(next);
 }
 
+/// processed field of push_transaction_results: the trace with the ABIs applied and its action traces as a tree
+static fc::variant push_transaction_output( controller& db, const transaction_trace_ptr& trx_trace_ptr, const fc::microseconds& abi_serializer_max_time ) {
+   fc::variant output;
+   try {
+      output = db.to_variant_with_abi( *trx_trace_ptr, abi_serializer_max_time );
+
+      // Create map of (closest_unnotified_ancestor_action_ordinal, global_sequence) with action trace
+      std::map< std::pair<uint32_t, uint64_t>, fc::mutable_variant_object > act_traces_map;
+      for( const auto& act_trace : output["action_traces"].get_array() ) {
+         if (act_trace["receipt"].is_null() && act_trace["except"].is_null()) continue;
+         auto closest_unnotified_ancestor_action_ordinal =
+               act_trace["closest_unnotified_ancestor_action_ordinal"].as<fc::unsigned_int>().value;
+         auto global_sequence = act_trace["receipt"].is_null() ?
+                                    std::numeric_limits<uint64_t>::max() :
+                                    act_trace["receipt"]["global_sequence"].as<uint64_t>();
+         act_traces_map.emplace( std::make_pair( closest_unnotified_ancestor_action_ordinal,
+                                                 global_sequence ),
+                                 act_trace.get_object() );
+      }
+
+      std::function<vector<fc::variant>(uint32_t)> convert_act_trace_to_tree_struct =
+      [&](uint32_t closest_unnotified_ancestor_action_ordinal) {
+         vector<fc::variant> restructured_act_traces;
+         auto it = act_traces_map.lower_bound(
+                     std::make_pair( closest_unnotified_ancestor_action_ordinal, 0)
+         );
+         for( ;
+            it != act_traces_map.end() && it->first.first == closest_unnotified_ancestor_action_ordinal; ++it )
+         {
+            auto& act_trace_mvo = it->second;
+
+            auto action_ordinal = act_trace_mvo["action_ordinal"].as<fc::unsigned_int>().value;
+            act_trace_mvo["inline_traces"] = convert_act_trace_to_tree_struct(action_ordinal);
+            if (act_trace_mvo["receipt"].is_null()) {
+               act_trace_mvo["receipt"] = fc::mutable_variant_object()
+                  ("abi_sequence", 0)
+                  ("act_digest", digest_type::hash(trx_trace_ptr->action_traces[action_ordinal-1].act))
+                  ("auth_sequence", flat_map<account_name,uint64_t>())
+                  ("code_sequence", 0)
+                  ("global_sequence", 0)
+                  ("receiver", act_trace_mvo["receiver"])
+                  ("recv_sequence", 0);
+            }
+            restructured_act_traces.push_back( std::move(act_trace_mvo) );
+         }
+         return restructured_act_traces;
+      };
+
+      fc::mutable_variant_object output_mvo(output);
+      output_mvo["action_traces"] = convert_act_trace_to_tree_struct(0);
+
+      output = output_mvo;
+   } catch( chain::abi_exception& ) {
+      output = *trx_trace_ptr;
+   }
+   return output;
+}
+
 void read_write::push_transaction(const read_write::push_transaction_params& params, next_function<read_write::push_transaction_results> next) {
    try {
       auto pretty_input = std::make_shared<packed_transaction>();
@@ -1949,59 +2718,7 @@ void read_write::push_transaction(const read_write::push_transaction_params& par
             auto trx_trace_ptr = result.get<transaction_trace_ptr>();
 
             try {
-               fc::variant output;
-               try {
-                  output = db.to_variant_with_abi( *trx_trace_ptr, abi_serializer_max_time );
-
-                  // Create map of (closest_unnotified_ancestor_action_ordinal, global_sequence) with action trace
-                  std::map< std::pair<uint32_t, uint64_t>, fc::mutable_variant_object > act_traces_map;
-                  for( const auto& act_trace : output["action_traces"].get_array() ) {
-                     if (act_trace["receipt"].is_null() && act_trace["except"].is_null()) continue;
-                     auto closest_unnotified_ancestor_action_ordinal =
-                           act_trace["closest_unnotified_ancestor_action_ordinal"].as<fc::unsigned_int>().value;
-                     auto global_sequence = act_trace["receipt"].is_null() ?
-                                                std::numeric_limits<uint64_t>::max() :
-                                                act_trace["receipt"]["global_sequence"].as<uint64_t>();
-                     act_traces_map.emplace( std::make_pair( closest_unnotified_ancestor_action_ordinal,
-                                                             global_sequence ),
-                                             act_trace.get_object() );
-                  }
-
-                  std::function<vector<fc::variant>(uint32_t)> convert_act_trace_to_tree_struct =
-                  [&](uint32_t closest_unnotified_ancestor_action_ordinal) {
-                     vector<fc::variant> restructured_act_traces;
-                     auto it = act_traces_map.lower_bound(
-                                 std::make_pair( closest_unnotified_ancestor_action_ordinal, 0)
-                     );
-                     for( ;
-                        it != act_traces_map.end() && it->first.first == closest_unnotified_ancestor_action_ordinal; ++it )
-                     {
-                        auto& act_trace_mvo = it->second;
-
-                        auto action_ordinal = act_trace_mvo["action_ordinal"].as<fc::unsigned_int>().value;
-                        act_trace_mvo["inline_traces"] = convert_act_trace_to_tree_struct(action_ordinal);
-                        if (act_trace_mvo["receipt"].is_null()) {
-                           act_trace_mvo["receipt"] = fc::mutable_variant_object()
-                              ("abi_sequence", 0)
-                              ("act_digest", digest_type::hash(trx_trace_ptr->action_traces[action_ordinal-1].act))
-                              ("auth_sequence", flat_map<account_name,uint64_t>())
-                              ("code_sequence", 0)
-                              ("global_sequence", 0)
-                              ("receiver", act_trace_mvo["receiver"])
-                              ("recv_sequence", 0);
-                        }
-                        restructured_act_traces.push_back( std::move(act_trace_mvo) );
-                     }
-                     return restructured_act_traces;
-                  };
-
-                  fc::mutable_variant_object output_mvo(output);
-                  output_mvo["action_traces"] = convert_act_trace_to_tree_struct(0);
-
-                  output = output_mvo;
-               } catch( chain::abi_exception& ) {
-                  output = *trx_trace_ptr;
-               }
+               fc::variant output = push_transaction_output( db, trx_trace_ptr, abi_serializer_max_time );
 
                const chain::transaction_id_type& id = trx_trace_ptr->id;
                next(read_write::push_transaction_results{id, output});
@@ -2015,35 +2732,102 @@ void read_write::push_transaction(const read_write::push_transaction_params& par
    } CATCH_AND_CALL(next);
 }
 
-static void push_recurse(read_write* rw, int index, const std::shared_ptr<read_write::push_transactions_params>& params, const std::shared_ptr<read_write::push_transactions_results>& results, const next_function<read_write::push_transactions_results>& next) {
-   auto wrapped_next = [=](const fc::static_variant<fc::exception_ptr, read_write::push_transaction_results>& result) {
-      if (result.contains<fc::exception_ptr>()) {
-         const auto& e = result.get<fc::exception_ptr>();
-         results->emplace_back( read_write::push_transaction_results{ transaction_id_type(), fc::mutable_variant_object( "error", e->to_detail_string() ) } );
-      } else {
-         const auto& r = result.get<read_write::push_transaction_results>();
-         results->emplace_back( r );
-      }
-
-      size_t next_index = index + 1;
-      if (next_index < params->size()) {
-         push_recurse(rw, next_index, params, results, next );
-      } else {
-         next(*results);
-      }
-   };
-
-   rw->push_transaction(params->at(index), wrapped_next);
+void read_write::push_raw_transaction(read_write::push_raw_transaction_params&& params, next_function<read_write::push_raw_transaction_results> next) {
+   try {
+      auto ptrx = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( std::move( params ) ) );
+      app().get_method<incoming::methods::transaction_async>()(ptrx, true, [next](const fc::static_variant<fc::exception_ptr, transaction_trace_ptr>& result) -> void {
+         if (result.contains<fc::exception_ptr>()) {
+            next(result.get<fc::exception_ptr>());
+         } else {
+            next(result.get<transaction_trace_ptr>());
+         }
+      });
+   } catch ( boost::interprocess::bad_alloc& ) {
+      chain_plugin::handle_db_exhaustion();
+   } catch ( const std::bad_alloc& ) {
+      chain_plugin::handle_bad_alloc();
+   } CATCH_AND_CALL(next);
 }
 
 void read_write::push_transactions(const read_write::push_transactions_params& params, next_function<read_write::push_transactions_results> next) {
    try {
       EOS_ASSERT( params.size() <= 1000, too_many_tx_at_once, "Attempt to push too many transactions at once" );
-      auto params_copy = std::make_shared<read_write::push_transactions_params>(params.begin(), params.end());
-      auto result = std::make_shared<read_write::push_transactions_results>();
-      result->reserve(params.size());
+      if( params.empty() ) {
+         next( read_write::push_transactions_results() );
+         return;
+      }
 
-      push_recurse(this, 0, params_copy, result, next);
+      struct batch_state {
+         read_write::push_transactions_params    params;
+         vector<transaction_metadata_ptr>        trxs;      ///< null if the transaction could not be converted
+         read_write::push_transactions_results   results;
+         std::atomic<size_t>                     remaining{0};
+      };
+      auto batch = std::make_shared<batch_state>();
+      batch->params = params;
+      batch->trxs.resize( params.size() );
+      batch->results.resize( params.size() );
+
+      auto error_result = []( const fc::exception_ptr& e ) {
+         return read_write::push_transaction_results{ transaction_id_type(), fc::mutable_variant_object( "error", e->to_detail_string() ) };
+      };
+      auto result_done = [batch, next]() {
+         if( --batch->remaining == 0 )
+            next( batch->results );
+      };
+
+      // the transactions are submitted in order in one main thread task once all are converted
+      auto submit = [this, batch, error_result, result_done]() {
+         try {
+            std::vector<std::pair<transaction_metadata_ptr, next_function<transaction_trace_ptr>>> trxs;
+            trxs.reserve( batch->trxs.size() );
+            batch->remaining = batch->trxs.size();
+            for( size_t i = 0; i < batch->trxs.size(); ++i ) {
+               if( !batch->trxs[i] ) {
+                  result_done();
+                  continue;
+               }
+               trxs.emplace_back( batch->trxs[i], [this, batch, i, error_result, result_done]( const fc::static_variant<fc::exception_ptr, transaction_trace_ptr>& result ) {
+                  if( result.contains<fc::exception_ptr>() ) {
+                     batch->results[i] = error_result( result.get<fc::exception_ptr>() );
+                  } else {
+                     const auto& trace = result.get<transaction_trace_ptr>();
+                     try {
+                        batch->results[i] = read_write::push_transaction_results{ trace->id, push_transaction_output( db, trace, abi_serializer_max_time ) };
+                     } catch( const fc::exception& e ) {
+                        batch->results[i] = error_result( e.dynamic_copy_exception() );
+                     }
+                  }
+                  result_done();
+               } );
+            }
+            batch->trxs.clear();
+            app().get_plugin<chain_plugin>().accept_transactions( trxs );
+         } FC_LOG_AND_DROP()
+      };
+
+      // conversions read the ABIs: they run in parallel on the read-only threads when enabled
+      vector<std::function<void()>> conversions;
+      conversions.reserve( params.size() );
+      batch->remaining = params.size();
+      for( size_t i = 0; i < params.size(); ++i ) {
+         conversions.emplace_back( [this, batch, i, error_result, submit]() {
+            try {
+               try {
+                  auto ptrx = std::make_shared<packed_transaction>();
+                  abi_serializer::from_variant( batch->params[i], *ptrx, make_resolver( this, abi_serializer_max_time ), abi_serializer_max_time );
+                  batch->trxs[i] = std::make_shared<transaction_metadata>( ptrx );
+               } EOS_RETHROW_EXCEPTIONS(chain::packed_transaction_type_exception, "Invalid packed transaction")
+            } catch( const fc::exception& e ) {
+               batch->results[i] = error_result( e.dynamic_copy_exception() );
+            }
+            if( --batch->remaining == 0 ) {
+               batch->params.clear();
+               chain::instrumented_post( app(), appbase::priority::low, chain::executor_category::http, submit );
+            }
+         } );
+      }
+      app().get_plugin<chain_plugin>().post_read_only( std::move( conversions ) );
    } catch ( boost::interprocess::bad_alloc& ) {
       chain_plugin::handle_db_exhaustion();
    } catch ( const std::bad_alloc& ) {
@@ -2088,6 +2872,26 @@ void read_write::send_transaction(const read_write::send_transaction_params& par
    } CATCH_AND_CALL(next);
 }
 
+void read_write::send_read_only_transaction(const read_write::send_read_only_transaction_params& params, next_function<read_write::send_read_only_transaction_results> next) {
+   try {
+      auto pretty_input = std::make_shared<packed_transaction>();
+      auto resolver = make_resolver(this, abi_serializer_max_time);
+      transaction_metadata_ptr ptrx;
+      try {
+         abi_serializer::from_variant(params, *pretty_input, resolver, abi_serializer_max_time);
+         ptrx = std::make_shared<transaction_metadata>( pretty_input );
+      } EOS_RETHROW_EXCEPTIONS(chain::packed_transaction_type_exception, "Invalid packed transaction")
+
+      auto trx_trace_ptr = db.push_read_only_transaction( ptrx, fc::time_point::now() + read_only_trx_max_time );
+      fc::variant output = push_transaction_output( db, trx_trace_ptr, abi_serializer_max_time );
+      next(read_write::send_read_only_transaction_results{trx_trace_ptr->id, output});
+   } catch ( boost::interprocess::bad_alloc& ) {
+      chain_plugin::handle_db_exhaustion();
+   } catch ( const std::bad_alloc& ) {
+      chain_plugin::handle_bad_alloc();
+   } CATCH_AND_CALL(next);
+}
+
 read_only::get_abi_results read_only::get_abi( const get_abi_params& params )const {
    get_abi_results result;
    result.account_name = params.account_name;
@@ -2212,11 +3016,9 @@ read_only::get_account_results read_only::get_account( const get_account_params&
       ++perm;
    }
 
-   const auto& code_account = db.db().get<account_object,by_name>( config::system_account_name );
-
-   abi_def abi;
-   if( abi_serializer::to_abi(code_account.abi, abi) ) {
-      abi_serializer abis( abi, abi_serializer_max_time );
+   const auto abi_entry = get_abi_entry( config::system_account_name );
+   if( !abi_entry->empty ) {
+      const abi_serializer& abis = abi_entry->serializer;
 
       const auto token_code = N(eosio.token);
 
@@ -2297,12 +3099,12 @@ static variant action_abi_to_variant( const abi_def& abi, type_name action_type
 
 read_only::abi_json_to_bin_result read_only::abi_json_to_bin( const read_only::abi_json_to_bin_params& params )const try {
    abi_json_to_bin_result result;
-   const auto code_account = db.db().find<account_object,by_name>( params.code );
-   EOS_ASSERT(code_account != nullptr, contract_query_exception, "Contract can't be found ${contract}", ("contract", params.code));
+   const auto abi_entry = abi_serializer_cache::get( abi_cache, db, params.code, abi_serializer_max_time );
+   EOS_ASSERT(abi_entry, contract_query_exception, "Contract can't be found ${contract}", ("contract", params.code));
 
-   abi_def abi;
-   if( abi_serializer::to_abi(code_account->abi, abi) ) {
-      abi_serializer abis( abi, abi_serializer_max_time );
+   if( !abi_entry->empty ) {
+      const abi_def& abi = abi_entry->abi;
+      const abi_serializer& abis = abi_entry->serializer;
       auto action_type = abis.get_action_type(params.action);
       EOS_ASSERT(!action_type.empty(), action_validate_exception, "Unknown action ${action} in contract ${contract}", ("action", params.action)("contract", params.code));
       try {
@@ -2319,10 +3121,10 @@ read_only::abi_json_to_bin_result read_only::abi_json_to_bin( const read_only::a
 
 read_only::abi_bin_to_json_result read_only::abi_bin_to_json( const read_only::abi_bin_to_json_params& params )const {
    abi_bin_to_json_result result;
-   const auto& code_account = db.db().get<account_object,by_name>( params.code );
-   abi_def abi;
-   if( abi_serializer::to_abi(code_account.abi, abi) ) {
-      abi_serializer abis( abi, abi_serializer_max_time );
+   const auto abi_entry = abi_serializer_cache::get( abi_cache, db, params.code, abi_serializer_max_time );
+   EOS_ASSERT(abi_entry, chain::account_query_exception, "Fail to retrieve account for ${account}", ("account", params.code));
+   if( !abi_entry->empty ) {
+      const abi_serializer& abis = abi_entry->serializer;
       result.args = abis.binary_to_variant( abis.get_action_type( params.action ), params.binargs, abi_serializer_max_time, shorten_abi_errors );
    } else {
       EOS_ASSERT(false, abi_not_found_exception, "No ABI found for ${contract}", ("contract", params.code));
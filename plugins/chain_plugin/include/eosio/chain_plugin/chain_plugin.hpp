@@ -9,7 +9,9 @@
 #include <eosio/chain/account_object.hpp>
 #include <eosio/chain/block.hpp>
 #include <eosio/chain/controller.hpp>
+#include <eosio/chain/signal_subscribers.hpp>
 #include <eosio/chain/contract_table_objects.hpp>
+#include <eosio/chain/table_scan.hpp>
 #include <eosio/chain/resource_limits.hpp>
 #include <eosio/chain/transaction.hpp>
 #include <eosio/chain/abi_serializer.hpp>
@@ -21,6 +23,14 @@
 
 #include <fc/static_variant.hpp>
 
+#include <array>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
 namespace fc { class variant; }
 
 namespace eosio {
@@ -69,16 +79,93 @@ uint64_t convert_to_type(const string& str, const string& desc);
 template<>
 double convert_to_type(const string& str, const string& desc);
 
+/**
+ *  Serializers of account ABIs shared by the API calls, so an ABI is unpacked and validated once
+ *  instead of on every call. Entries are checked against the abi_sequence and the ABI of the account:
+ *  another fork may set a different ABI with the same sequence. Least recently used entries are dropped.
+ *  Thread safe, read-only calls may run on several threads.
+ */
+class abi_serializer_cache {
+public:
+   struct entry {
+      abi_def        abi;
+      abi_serializer serializer;
+      bool           empty = true; ///< account has no ABI
+   };
+   using entry_ptr = std::shared_ptr<const entry>;
+
+   explicit abi_serializer_cache( size_t max_size ) : max_size(max_size) {}
+
+   /// nullptr if there is no such account
+   static entry_ptr get( abi_serializer_cache* cache, const controller& db, const name& account, const fc::microseconds& max_serialization_time );
+
+private:
+   struct cached {
+      uint64_t                                abi_sequence = 0;
+      std::string                             raw_abi;
+      entry_ptr                               abi;
+      std::list<account_name>::iterator       lru_itr;
+   };
+
+   const size_t                               max_size;
+   std::mutex                                 mtx;
+   std::map<account_name, cached>             entries;
+   std::list<account_name>                    lru; ///< most recently used first
+};
+
+/**
+ *  Rows of the producers table of the system contract in get_producers order, decoded once per change of the table
+ *  instead of on every call. The table and the ABI decoding it only change when the system contract runs or the state
+ *  is undone: the applied transactions running it are passed to on_applied_transaction, and a ranking is only used at
+ *  the revision of the state it was built at. Thread safe, read-only calls may run on several threads.
+ */
+class producer_ranking_cache {
+public:
+   struct ranking {
+      vector<fc::variant>       rows;      ///< JSON objects or hex strings, by votes
+      std::map<uint64_t, size_t> positions; ///< of the rows, by owner
+      vector<account_name>      owners;    ///< of the rows
+      double                    total_producer_vote_weight = 0;
+   };
+   using ranking_ptr = std::shared_ptr<const ranking>;
+
+   void on_applied_transaction( const chain::transaction_trace_ptr& trace );
+
+   /// the ranking of the current state, made by `make` when none is cached for this state
+   static ranking_ptr get( producer_ranking_cache* cache, const controller& db, bool json,
+                           const std::function<ranking()>& make );
+
+private:
+   struct cached {
+      int64_t       revision = -1;
+      uint64_t      generation = 0;
+      ranking_ptr   value;
+   };
+
+   std::atomic<uint64_t>      generation{0}; ///< of the transactions running the system contract
+   std::mutex                 mtx;
+   std::array<cached, 2>      rankings;      ///< hex, JSON
+};
+
 class read_only {
    const controller& db;
    const fc::microseconds abi_serializer_max_time;
+   abi_serializer_cache* abi_cache;
+   producer_ranking_cache* producers_cache;
    bool  shorten_abi_errors = true;
 
+   /// ABI of an existing account, throws account_query_exception if there is no such account
+   abi_serializer_cache::entry_ptr get_abi_entry( const name& account )const;
+
+   /// block of get_block_params, throws unknown_block_exception if there is no such block
+   chain::signed_block_ptr fetch_block( const string& block_num_or_id )const;
+
 public:
    static const string KEYi64;
 
-   read_only(const controller& db, const fc::microseconds& abi_serializer_max_time)
-      : db(db), abi_serializer_max_time(abi_serializer_max_time) {}
+   read_only(const controller& db, const fc::microseconds& abi_serializer_max_time, abi_serializer_cache* abi_cache = nullptr,
+             producer_ranking_cache* producers_cache = nullptr)
+      : db(db), abi_serializer_max_time(abi_serializer_max_time), abi_cache(abi_cache), producers_cache(producers_cache) {}
 
    void validate() const {}
 
@@ -271,6 +358,11 @@ public:
 
    fc::variant get_block(const get_block_params& params) const;
 
+   /// get_block for the binary API: the packed signed_block, irreversible blocks are sent from the mapped block log
+   using get_raw_block_params = get_block_params;
+   using get_raw_block_results = chain::block_log::packed_block_view;
+   get_raw_block_results get_raw_block(const get_raw_block_params& params) const;
+
    struct get_block_header_state_params {
       string block_num_or_id;
    };
@@ -291,14 +383,29 @@ public:
       string      encode_type{"dec"}; //dec, hex , default=dec
       optional<bool>  reverse;
       optional<bool>  show_payer; // show RAM pyer
+      string      cursor; // next_cursor of the previous page, continues after its last row; optional
     };
 
    struct get_table_rows_result {
       vector<fc::variant> rows; ///< one row per item, either encoded as hex String or JSON object
       bool                more = false; ///< true if last element in data is not the end and sizeof data() < limit
+      string              next_cursor; ///< cursor of the first row not returned, empty if there are no more rows
    };
 
    get_table_rows_result get_table_rows( const get_table_rows_params& params )const;
+   /// JSON of the get_table_rows result, the rows are written while decoded
+   string get_table_rows_json( const get_table_rows_params& params )const;
+
+   /// get_table_rows for the binary API: rows are not decoded, `json` is ignored
+   using get_raw_table_rows_params = get_table_rows_params;
+   struct get_raw_table_rows_result {
+      vector<vector<char>> rows;
+      vector<name>         payers; ///< payer of every row if show_payer
+      bool                 more = false;
+      string               next_cursor;
+   };
+
+   get_raw_table_rows_result get_raw_table_rows( const get_raw_table_rows_params& params )const;
 
    struct get_table_by_scope_params {
       name        code; // mandatory
@@ -330,6 +437,26 @@ public:
 
    vector<asset> get_currency_balance( const get_currency_balance_params& params )const;
 
+   /// balances of every account in every token contract, read from the rows of the accounts tables without their ABI
+   struct get_currency_balances_params {
+      vector<name>     accounts;
+      vector<name>     codes;
+      optional<string> symbol;
+   };
+
+   struct get_currency_balances_result_row {
+      name             account;
+      name             code;
+      vector<asset>    balances;
+   };
+
+   /// only the pairs of an account and a contract with a balance, by contract then in the order of `accounts`
+   using get_currency_balances_result = vector<get_currency_balances_result_row>;
+
+   static constexpr size_t max_currency_balances_pairs = 100000;
+
+   get_currency_balances_result get_currency_balances( const get_currency_balances_params& params )const;
+
    struct get_currency_stats_params {
       name           code;
       string         symbol;
@@ -398,7 +525,8 @@ public:
          auto lower = idx.lower_bound(boost::make_tuple(t_id->id));
          auto upper = idx.lower_bound(boost::make_tuple(next_tid));
 
-         for (auto itr = lower; itr != upper; ++itr) {
+         auto ahead = chain::make_scan_prefetcher(lower, upper);
+         for (auto itr = lower; itr != upper; ++itr, ahead.advance()) {
             if (!f(*itr)) {
                break;
             }
@@ -408,15 +536,31 @@ public:
 
    static uint64_t get_table_index_name(const read_only::get_table_rows_params& p, bool& primary);
 
-   template <typename IndexType, typename SecKeyType, typename ConvFn>
-   read_only::get_table_rows_result get_table_rows_by_seckey( const read_only::get_table_rows_params& p, const abi_def& abi, ConvFn conv )const {
-      read_only::get_table_rows_result result;
+   /// position of a table walk, a page continues at the row it points to
+   struct table_cursor {
+      uint64_t     index = 0;       ///< table name with index position, see get_table_index_name
+      bool         reverse = false;
+      vector<char> secondary;       ///< secondary key, empty for the primary index
+      uint64_t     primary = 0;
+   };
+
+   /// opaque string of a cursor
+   static string encode_table_cursor( const table_cursor& c );
+   /// cursor of `p`, which must be for the same index and direction
+   static table_cursor decode_table_cursor( const read_only::get_table_rows_params& p, uint64_t index, size_t secondary_size );
+
+   /// calls add_row( data, payer ) for the rows of the table selected by `p`, @return cursor of the next row if there are more rows
+   template <typename RowF>
+   optional<table_cursor> walk_table_rows( const read_only::get_table_rows_params& p, const abi_def& abi, RowF&& add_row )const;
+
+   template <typename IndexType, typename SecKeyType, typename ConvFn, typename RowF>
+   optional<table_cursor> walk_table_rows_by_seckey( const read_only::get_table_rows_params& p, ConvFn conv, RowF&& add_row )const {
+      optional<table_cursor> next;
       const auto& d = db.db();
+      const bool reverse = p.reverse && *p.reverse;
 
       uint64_t scope = convert_to_type<uint64_t>(p.scope, "scope");
 
-      abi_serializer abis;
-      abis.set_abi(abi, abi_serializer_max_time);
       bool primary = false;
       const uint64_t table_with_index = get_table_index_name(p, primary);
       const auto* t_id = d.find<chain::table_id_object, chain::by_code_scope_table>(boost::make_tuple(p.code, scope, p.table));
@@ -455,58 +599,53 @@ public:
             }
          }
 
+         if( !p.cursor.empty() ) {
+            const auto c = decode_table_cursor( p, table_with_index, sizeof(secondary_key_type) );
+            auto& bound = reverse ? upper_bound_lookup_tuple : lower_bound_lookup_tuple;
+            memcpy( &std::get<1>(bound), c.secondary.data(), sizeof(secondary_key_type) );
+            std::get<2>(bound) = c.primary;
+         }
+
          if( upper_bound_lookup_tuple < lower_bound_lookup_tuple )
-            return result;
+            return next;
 
          auto walk_table_row_range = [&]( auto itr, auto end_itr ) {
             auto cur_time = fc::time_point::now();
             auto end_time = cur_time + fc::microseconds(1000 * 10); /// 10ms max time
             vector<char> data;
-            for( unsigned int count = 0; cur_time <= end_time && count < p.limit && itr != end_itr; ++itr, cur_time = fc::time_point::now() ) {
+            auto ahead = chain::make_scan_prefetcher( itr, end_itr );
+            for( unsigned int count = 0; cur_time <= end_time && count < p.limit && itr != end_itr; ++itr, ahead.advance(), cur_time = fc::time_point::now() ) {
                const auto* itr2 = d.find<chain::key_value_object, chain::by_scope_primary>( boost::make_tuple(t_id->id, itr->primary_key) );
                if( itr2 == nullptr ) continue;
                copy_inline_row(*itr2, data);
-
-               fc::variant data_var;
-               if( p.json ) {
-                  data_var = abis.binary_to_variant( abis.get_table_type(p.table), data, abi_serializer_max_time, shorten_abi_errors );
-               } else {
-                  data_var = fc::variant( data );
-               }
-
-               if( p.show_payer && *p.show_payer ) {
-                  result.rows.emplace_back( fc::mutable_variant_object("data", std::move(data_var))("payer", itr->payer) );
-               } else {
-                  result.rows.emplace_back( std::move(data_var) );
-               }
-
+               add_row( data, itr->payer );
                ++count;
             }
             if( itr != end_itr ) {
-               result.more = true;
+               next = table_cursor{ table_with_index, reverse, vector<char>( sizeof(secondary_key_type) ), itr->primary_key };
+               memcpy( next->secondary.data(), &itr->secondary_key, sizeof(secondary_key_type) );
             }
          };
 
          auto lower = secidx.lower_bound( lower_bound_lookup_tuple );
          auto upper = secidx.upper_bound( upper_bound_lookup_tuple );
-         if( p.reverse && *p.reverse ) {
+         if( reverse ) {
             walk_table_row_range( boost::make_reverse_iterator(upper), boost::make_reverse_iterator(lower) );
          } else {
             walk_table_row_range( lower, upper );
          }
       }
-      return result;
+      return next;
    }
 
-   template <typename IndexType>
-   read_only::get_table_rows_result get_table_rows_ex( const read_only::get_table_rows_params& p, const abi_def& abi )const {
-      read_only::get_table_rows_result result;
+   template <typename IndexType, typename RowF>
+   optional<table_cursor> walk_table_rows_ex( const read_only::get_table_rows_params& p, RowF&& add_row )const {
+      optional<table_cursor> next;
       const auto& d = db.db();
+      const bool reverse = p.reverse && *p.reverse;
 
       uint64_t scope = convert_to_type<uint64_t>(p.scope, "scope");
 
-      abi_serializer abis;
-      abis.set_abi(abi, abi_serializer_max_time);
       const auto* t_id = d.find<chain::table_id_object, chain::by_code_scope_table>(boost::make_tuple(p.code, scope, p.table));
       if( t_id != nullptr ) {
          const auto& idx = d.get_index<IndexType, chain::by_scope_primary>();
@@ -533,43 +672,37 @@ public:
             }
          }
 
+         if( !p.cursor.empty() ) {
+            const auto c = decode_table_cursor( p, p.table, 0 );
+            std::get<1>(reverse ? upper_bound_lookup_tuple : lower_bound_lookup_tuple) = c.primary;
+         }
+
          if( upper_bound_lookup_tuple < lower_bound_lookup_tuple  )
-            return result;
+            return next;
 
          auto walk_table_row_range = [&]( auto itr, auto end_itr ) {
             auto cur_time = fc::time_point::now();
             auto end_time = cur_time + fc::microseconds(1000 * 10); /// 10ms max time
             vector<char> data;
-            for( unsigned int count = 0; cur_time <= end_time && count < p.limit && itr != end_itr; ++count, ++itr, cur_time = fc::time_point::now() ) {
+            auto ahead = chain::make_scan_prefetcher( itr, end_itr );
+            for( unsigned int count = 0; cur_time <= end_time && count < p.limit && itr != end_itr; ++count, ++itr, ahead.advance(), cur_time = fc::time_point::now() ) {
                copy_inline_row(*itr, data);
-
-               fc::variant data_var;
-               if( p.json ) {
-                  data_var = abis.binary_to_variant( abis.get_table_type(p.table), data, abi_serializer_max_time, shorten_abi_errors );
-               } else {
-                  data_var = fc::variant( data );
-               }
-
-               if( p.show_payer && *p.show_payer ) {
-                  result.rows.emplace_back( fc::mutable_variant_object("data", std::move(data_var))("payer", itr->payer) );
-               } else {
-                  result.rows.emplace_back( std::move(data_var) );
-               }
+               add_row( data, itr->payer );
             }
             if( itr != end_itr ) {
-               result.more = true;
+               next = table_cursor{ p.table, reverse, vector<char>(), itr->primary_key };
             }
          };
 
          auto lower = idx.lower_bound( lower_bound_lookup_tuple );
          auto upper = idx.upper_bound( upper_bound_lookup_tuple );
-         if( p.reverse && *p.reverse ) {
+         if( reverse ) {
             walk_table_row_range( boost::make_reverse_iterator(upper), boost::make_reverse_iterator(lower) );
          } else {
             walk_table_row_range( lower, upper );
          }
       }
-      return result;
+      return next;
    }
 
    chain::symbol extract_core_symbol()const;
@@ -580,9 +713,12 @@ public:
 class read_write {
    controller& db;
    const fc::microseconds abi_serializer_max_time;
+   abi_serializer_cache* abi_cache;
    const bool api_accept_transactions;
+   const fc::microseconds read_only_trx_max_time;
 public:
-   read_write(controller& db, const fc::microseconds& abi_serializer_max_time, bool api_accept_transactions);
+   read_write(controller& db, const fc::microseconds& abi_serializer_max_time, bool api_accept_transactions, abi_serializer_cache* abi_cache = nullptr,
+              const fc::microseconds& read_only_trx_max_time = fc::microseconds(0));
    void validate() const;
 
    using push_block_params = chain::signed_block;
@@ -596,6 +732,11 @@ public:
    };
    void push_transaction(const push_transaction_params& params, chain::plugin_interface::next_function<push_transaction_results> next);
 
+   /// push_transaction for the binary API, the trace is not converted with the ABIs
+   using push_raw_transaction_params = chain::packed_transaction;
+   using push_raw_transaction_results = chain::transaction_trace_ptr;
+   void push_raw_transaction(push_raw_transaction_params&& params, chain::plugin_interface::next_function<push_raw_transaction_results> next);
+
 
    using push_transactions_params  = vector<push_transaction_params>;
    using push_transactions_results = vector<push_transaction_results>;
@@ -605,6 +746,12 @@ public:
    using send_transaction_results = push_transaction_results;
    void send_transaction(const send_transaction_params& params, chain::plugin_interface::next_function<send_transaction_results> next);
 
+   /// executes the transaction in the pending block with controller::push_read_only_transaction, its changes undone;
+   /// the signatures are not checked and the execution is limited to read-only-transaction-time-us
+   using send_read_only_transaction_params = push_transaction_params;
+   using send_read_only_transaction_results = push_transaction_results;
+   void send_read_only_transaction(const send_read_only_transaction_params& params, chain::plugin_interface::next_function<send_read_only_transaction_results> next);
+
    friend resolver_factory<read_write>;
 };
 
@@ -684,15 +831,31 @@ public:
    void plugin_startup();
    void plugin_shutdown();
 
-   chain_apis::read_only get_read_only_api() const { return chain_apis::read_only(chain(), get_abi_serializer_max_time()); }
-   chain_apis::read_write get_read_write_api() { return chain_apis::read_write(chain(), get_abi_serializer_max_time(), api_accept_transactions()); }
+   chain_apis::read_only get_read_only_api() const { return chain_apis::read_only(chain(), get_abi_serializer_max_time(), get_abi_serializer_cache(),
+                                                                               get_producer_ranking_cache()); }
+   chain_apis::read_write get_read_write_api() { return chain_apis::read_write(chain(), get_abi_serializer_max_time(), api_accept_transactions(), get_abi_serializer_cache(),
+                                                                              get_read_only_transaction_max_time()); }
 
    bool accept_block( const chain::signed_block_ptr& block, const chain::block_id_type& id );
    void accept_transaction(const chain::packed_transaction& trx, chain::plugin_interface::next_function<chain::transaction_trace_ptr> next);
    void accept_transaction(const chain::transaction_metadata_ptr& trx, chain::plugin_interface::next_function<chain::transaction_trace_ptr> next);
+   /// accepts trxs received together, their keys are recovered in batches instead of one thread pool task per trx
+   void accept_transactions(const std::vector<std::pair<chain::transaction_metadata_ptr, chain::plugin_interface::next_function<chain::transaction_trace_ptr>>>& trxs);
 
    bool block_is_on_preferred_chain(const chain::block_id_type& block_id);
 
+   /// runs a read-only call against the state on the read-only thread pool, inline when read-only-threads = 0;
+   /// must be called on the main thread unless has_read_only_threads(), `read` should report its own errors
+   void post_read_only( std::function<void()> read );
+   /// like post_read_only, all `reads` see the same state: they run in parallel in one read window
+   void post_read_only( std::vector<std::function<void()>> reads );
+   /// read-only-threads > 0, post_read_only may be called from any thread once the plugin started
+   bool has_read_only_threads() const;
+
+   /// phases of the plugin initialization and startup, those of the controller included, in the order they started;
+   /// complete once the plugin started
+   vector<chain::controller::startup_phase> startup_timeline() const;
+
    static bool recover_reversible_blocks( const fc::path& db_dir,
                                           uint32_t cache_size,
                                           optional<fc::path> new_db_dir = optional<fc::path>(),
@@ -714,7 +877,17 @@ public:
    const controller& chain() const;
 
    chain::chain_id_type get_chain_id() const;
+   /// snapshot fetched from peers by net_plugin, loaded at the next start instead of the existing state
+   fc::path bootstrap_snapshot_path() const;
+   /// the queue of the subscriber `name` of the block signals if it is listed in signal-async-subscriber, nullptr
+   /// if it runs inline; the subscriber stops the queue on shutdown, see chain::subscriber_slot
+   std::shared_ptr<chain::async_subscriber> make_async_subscriber( const std::string& name ) const;
    fc::microseconds get_abi_serializer_max_time() const;
+   /// wall time limit of a read-only transaction, independent of the CPU limits of blocks and accounts
+   fc::microseconds get_read_only_transaction_max_time() const;
+   /// nullptr if abi-serializer-cache-size is 0
+   chain_apis::abi_serializer_cache* get_abi_serializer_cache() const;
+   chain_apis::producer_ranking_cache* get_producer_ranking_cache() const;
    bool api_accept_transactions() const;
    // set true by other plugins if any plugin allows transactions
    bool accept_transactions() const;
@@ -742,14 +915,18 @@ FC_REFLECT(eosio::chain_apis::read_only::get_block_header_state_params, (block_n
 
 FC_REFLECT( eosio::chain_apis::read_write::push_transaction_results, (transaction_id)(processed) )
 
-FC_REFLECT( eosio::chain_apis::read_only::get_table_rows_params, (json)(code)(scope)(table)(table_key)(lower_bound)(upper_bound)(limit)(key_type)(index_position)(encode_type)(reverse)(show_payer) )
-FC_REFLECT( eosio::chain_apis::read_only::get_table_rows_result, (rows)(more) );
+FC_REFLECT( eosio::chain_apis::read_only::get_table_rows_params, (json)(code)(scope)(table)(table_key)(lower_bound)(upper_bound)(limit)(key_type)(index_position)(encode_type)(reverse)(show_payer)(cursor) )
+FC_REFLECT( eosio::chain_apis::read_only::get_table_rows_result, (rows)(more)(next_cursor) );
+FC_REFLECT( eosio::chain_apis::read_only::get_raw_table_rows_result, (rows)(payers)(more)(next_cursor) );
+FC_REFLECT( eosio::chain_apis::read_only::table_cursor, (index)(reverse)(secondary)(primary) )
 
 FC_REFLECT( eosio::chain_apis::read_only::get_table_by_scope_params, (code)(table)(lower_bound)(upper_bound)(limit)(reverse) )
 FC_REFLECT( eosio::chain_apis::read_only::get_table_by_scope_result_row, (code)(scope)(table)(payer)(count));
 FC_REFLECT( eosio::chain_apis::read_only::get_table_by_scope_result, (rows)(more) );
 
 FC_REFLECT( eosio::chain_apis::read_only::get_currency_balance_params, (code)(account)(symbol));
+FC_REFLECT( eosio::chain_apis::read_only::get_currency_balances_params, (accounts)(codes)(symbol));
+FC_REFLECT( eosio::chain_apis::read_only::get_currency_balances_result_row, (account)(code)(balances));
 FC_REFLECT( eosio::chain_apis::read_only::get_currency_stats_params, (code)(symbol));
 FC_REFLECT( eosio::chain_apis::read_only::get_currency_stats_result, (supply)(max_supply)(issuer));
 
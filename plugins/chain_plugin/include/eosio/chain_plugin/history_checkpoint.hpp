@@ -0,0 +1,95 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/chain/controller.hpp>
+#include <eosio/chain/exceptions.hpp>
+
+#include <fc/filesystem.hpp>
+#include <fc/io/fstream.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <mutex>
+
+namespace eosio {
+
+   /**
+    * Last irreversible block a history consumer fully committed, kept in <dir>/<name>.checkpoint.
+    * The file is replaced through a rename, so a crash leaves the previous checkpoint.
+    *
+    * A restarted consumer skips the blocks up to the checkpoint when the chain is replayed, and reads the
+    * irreversible blocks it missed back from the block log with read_missed_blocks instead of replaying.
+    */
+   class history_checkpoint {
+      public:
+         history_checkpoint( const fc::path& dir, const std::string& name )
+         :path( dir / (name + ".checkpoint") )
+         {
+            fc::create_directories( dir );
+            if( fc::exists( path ) ) {
+               std::string content;
+               fc::read_file_contents( path, content );
+               EOS_ASSERT( content.size() == sizeof(uint32_t), chain::plugin_exception,
+                           "Malformed history checkpoint ${p}", ("p", path.generic_string()) );
+               uint32_t block_num = 0;
+               memcpy( &block_num, content.data(), sizeof(block_num) );
+               committed = block_num;
+            }
+         }
+
+         /// 0 if nothing was committed
+         uint32_t last_committed()const { return committed; }
+
+         /// thread safe, ignores blocks at or before the checkpoint
+         void commit( uint32_t block_num ) {
+            std::lock_guard<std::mutex> g( mtx );
+            if( block_num <= committed ) return;
+            const auto temp_path = path.generic_string() + ".tmp";
+            {
+               std::ofstream out( temp_path, std::ios::out | std::ios::binary | std::ios::trunc );
+               out.write( (const char*)&block_num, sizeof(block_num) );
+               out.close();
+               EOS_ASSERT( !out.fail(), chain::plugin_exception, "Unable to write history checkpoint ${p}", ("p", temp_path) );
+            }
+            fc::rename( temp_path, path );
+            committed = block_num;
+         }
+
+         /// forgets the checkpoint, when the consumer starts over
+         void reset() {
+            std::lock_guard<std::mutex> g( mtx );
+            fc::remove_all( path );
+            committed = 0;
+         }
+
+         /**
+          * Calls f with each block of the block log after max(checkpoint, `after`) through the last irreversible block,
+          * in order. Stops at the first block not in the log.
+          * @return the last block passed to f, 0 if none
+          */
+         template<typename F>
+         uint32_t read_missed_blocks( const chain::controller& chain, uint32_t after, F&& f )const {
+            uint32_t last = 0;
+            const uint32_t lib = chain.last_irreversible_block_num();
+            for( uint32_t block_num = std::max<uint32_t>( committed, after ) + 1; block_num <= lib; ++block_num ) {
+               const auto packed = chain.fetch_packed_block_by_number( block_num );
+               if( !packed ) break;
+               auto block = std::make_shared<chain::signed_block>();
+               fc::datastream<const char*> ds( packed.data, packed.size );
+               fc::raw::unpack( ds, *block );
+               f( block );
+               last = block_num;
+            }
+            return last;
+         }
+
+      private:
+         const fc::path          path;
+         std::mutex              mtx;
+         std::atomic<uint32_t>   committed{0};
+   };
+
+} /// namespace eosio
@@ -6,11 +6,32 @@
 #include <fc/io/json.hpp>
 #include <eosio/db_size_api_plugin/db_size_api_plugin.hpp>
 
+#include <eosio/chain/account_object.hpp>
+#include <eosio/chain/block_summary_object.hpp>
+#include <eosio/chain/code_object.hpp>
+#include <eosio/chain/contract_table_objects.hpp>
+#include <eosio/chain/generated_transaction_object.hpp>
+#include <eosio/chain/global_property_object.hpp>
+#include <eosio/chain/permission_link_object.hpp>
+#include <eosio/chain/permission_object.hpp>
+#include <eosio/chain/protocol_state_object.hpp>
+#include <eosio/chain/resource_limits_private.hpp>
+#include <eosio/chain/transaction_object.hpp>
+
+#include <boost/core/demangle.hpp>
+#include <boost/mpl/size.hpp>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <typeinfo>
+
 namespace eosio {
 
 static appbase::abstract_plugin& _db_size_api_plugin = app().register_plugin<db_size_api_plugin>();
 
 using namespace eosio;
+using namespace eosio::chain;
 
 #define CALL(api_name, api_handle, call_name, INVOKE, http_response_code) \
 {std::string("/v1/" #api_name "/" #call_name), \
@@ -27,11 +48,211 @@ using namespace eosio;
 #define INVOKE_R_V(api_handle, call_name) \
      auto result = api_handle->call_name();
 
+#define INVOKE_R_R(api_handle, call_name, in_param) \
+     auto result = api_handle->call_name(fc::json::from_string(body).as<in_param>());
+
+namespace {
+
+   /// color, parent, left and right of an ordered index node: offset pointers are not compressed with the color
+   constexpr uint64_t ordered_node_bytes = 4 * sizeof(void*);
+   /// size header of a block of the segment allocator, blocks are multiples of its alignment
+   constexpr uint64_t block_header_bytes = 2 * sizeof(size_t);
+   constexpr uint64_t block_alignment    = 16;
+   /// the free block search stops within this many bytes of the largest one
+   constexpr uint64_t probe_granularity  = 4096;
+   constexpr size_t   max_top_contracts  = 1000;
+
+   /// name chainbase registers the index under, as listed by row_count_per_index
+   template<typename Index>
+   string index_name() {
+      return boost::core::demangle( typeid(typename Index::value_type).name() );
+   }
+
+   /// estimated bytes of a row without its blobs
+   template<typename Index>
+   uint64_t row_bytes() {
+      const uint64_t node = sizeof(typename Index::value_type)
+                          + boost::mpl::size<typename Index::index_type_list>::value * ordered_node_bytes;
+      return ( node + block_alignment - 1 ) / block_alignment * block_alignment + block_header_bytes;
+   }
+
+   template<typename... Indices>
+   struct sized_indices {
+      template<typename F>
+      static void walk( F&& f ) {
+         (void)std::initializer_list<int>{ ( f( (Indices*)nullptr ), 0 )... };
+      }
+   };
+
+   /// indices of the chain, the indices of plugins are only counted
+   using chain_indices = sized_indices<
+      account_index,
+      account_metadata_index,
+      account_ram_correction_index,
+      global_property_multi_index,
+      protocol_state_multi_index,
+      dynamic_global_property_multi_index,
+      block_summary_multi_index,
+      transaction_multi_index,
+      generated_transaction_multi_index,
+      table_id_multi_index,
+      code_index,
+      key_value_index,
+      index64_index,
+      index128_index,
+      index256_index,
+      index_double_index,
+      index_long_double_index,
+      permission_index,
+      permission_usage_index,
+      permission_link_index,
+      resource_limits::resource_limits_index,
+      resource_limits::resource_usage_index,
+      resource_limits::resource_limits_state_index,
+      resource_limits::resource_limits_config_index
+   >;
+
+}
+
+/**
+ * Pass over the contract tables, code and accounts in id order, resumed at the next id on every call so that rows
+ * created or removed in between do not invalidate it.
+ */
+struct db_size_api_plugin_impl {
+   enum phase_type : uint32_t {
+      key_value, index64, index128, index256, index_double, index_long_double, code, account, phases
+   };
+
+   // pass in progress
+   uint32_t                                       phase = key_value;
+   int64_t                                        next_id = 0;
+   uint64_t                                       rows_done = 0;
+   std::map<account_name, db_size_contract_bytes> contracts;
+   std::map<string, uint64_t>                     dynamic_bytes;
+
+   // last complete pass
+   vector<db_size_contract_bytes>                 last_contracts;
+   std::map<string, uint64_t>                     last_dynamic_bytes;
+   fc::time_point                                 last_pass_end;
+
+   /// visits at most `budget` rows of Index from next_id, returns whether it reached the end
+   template<typename Index, typename F>
+   bool scan( const chainbase::database& db, uint64_t& budget, F&& visit ) {
+      const auto& idx = db.get_index<Index>().indices();
+      auto itr = idx.lower_bound( typename Index::value_type::id_type( next_id ) );
+      for( ; itr != idx.end() && budget > 0; ++itr, --budget, ++rows_done )
+         visit( *itr );
+      if( itr == idx.end() ) {
+         next_id = 0;
+         return true;
+      }
+      next_id = itr->id._id;
+      return false;
+   }
+
+   db_size_contract_bytes& contract_of( const chainbase::database& db, table_id t_id ) {
+      const auto& code = db.get<table_id_object>( t_id ).code;
+      auto& c = contracts[code];
+      c.code = code;
+      return c;
+   }
+
+   template<typename Index>
+   bool scan_secondary( const chainbase::database& db, uint64_t& budget ) {
+      const auto bytes = row_bytes<Index>();
+      return scan<Index>( db, budget, [&]( const typename Index::value_type& o ) {
+         auto& c = contract_of( db, o.t_id );
+         ++c.secondary_rows;
+         c.secondary_bytes += bytes;
+      } );
+   }
+
+   void step( const chainbase::database& db, uint64_t budget ) {
+      while( budget > 0 ) {
+         bool done = false;
+         switch( phase ) {
+            case key_value: {
+               const auto bytes = row_bytes<key_value_index>();
+               auto& blobs = dynamic_bytes[index_name<key_value_index>()];
+               done = scan<key_value_index>( db, budget, [&]( const key_value_object& o ) {
+                  auto& c = contract_of( db, o.t_id );
+                  ++c.key_value_rows;
+                  c.key_value_bytes += bytes + o.value.size();
+                  blobs += o.value.size();
+               } );
+               break;
+            }
+            case index64:           done = scan_secondary<index64_index>( db, budget ); break;
+            case index128:          done = scan_secondary<index128_index>( db, budget ); break;
+            case index256:          done = scan_secondary<index256_index>( db, budget ); break;
+            case index_double:      done = scan_secondary<index_double_index>( db, budget ); break;
+            case index_long_double: done = scan_secondary<index_long_double_index>( db, budget ); break;
+            case code: {
+               auto& blobs = dynamic_bytes[index_name<code_index>()];
+               done = scan<code_index>( db, budget, [&]( const code_object& o ) { blobs += o.code.size(); } );
+               break;
+            }
+            case account: {
+               auto& blobs = dynamic_bytes[index_name<account_index>()];
+               done = scan<account_index>( db, budget, [&]( const account_object& o ) { blobs += o.abi.size(); } );
+               break;
+            }
+         }
+         if( !done ) break;
+         if( ++phase == phases ) finish_pass();
+      }
+   }
+
+   void finish_pass() {
+      last_contracts.clear();
+      last_contracts.reserve( contracts.size() );
+      for( auto& c : contracts )
+         last_contracts.emplace_back( std::move( c.second ) );
+      const auto total = []( const db_size_contract_bytes& c ) { return c.key_value_bytes + c.secondary_bytes; };
+      const auto top = std::min( max_top_contracts, last_contracts.size() );
+      std::partial_sort( last_contracts.begin(), last_contracts.begin() + top, last_contracts.end(),
+                         [&]( const auto& a, const auto& b ) { return total( a ) > total( b ); } );
+      last_contracts.resize( top );
+      last_dynamic_bytes = std::move( dynamic_bytes );
+      last_pass_end = fc::time_point::now();
+
+      phase = key_value;
+      rows_done = 0;
+      contracts.clear();
+      dynamic_bytes.clear();
+   }
+
+   /// binary search of the largest block the segment can still allocate, the allocator does not expose its free list
+   static db_size_fragmentation probe_free_blocks( chainbase::database& db ) {
+      auto* segment = db.get_segment_manager();
+      const uint64_t free_bytes = segment->get_free_memory();
+      uint64_t lo = 0;
+      uint64_t hi = free_bytes;
+      while( hi - lo > probe_granularity ) {
+         const uint64_t mid = lo + ( hi - lo ) / 2;
+         if( void* p = segment->allocate( mid, std::nothrow ) ) {
+            segment->deallocate( p );
+            lo = mid;
+         } else {
+            hi = mid;
+         }
+      }
+      db_size_fragmentation result;
+      result.largest_free_block = lo;
+      result.fragmentation = free_bytes > 0 ? 1. - double( lo ) / free_bytes : 0.;
+      return result;
+   }
+};
+
+db_size_api_plugin::db_size_api_plugin() : my(new db_size_api_plugin_impl()) {}
+db_size_api_plugin::~db_size_api_plugin() = default;
 
 void db_size_api_plugin::plugin_startup() {
    app().get_plugin<http_plugin>().add_api({
        CALL(db_size, this, get,
             INVOKE_R_V(this, get), 200),
+       CALL(db_size, this, get_breakdown,
+            INVOKE_R_R(this, get_breakdown, db_size_breakdown_params), 200),
    });
 }
 
@@ -50,6 +271,50 @@ db_size_stats db_size_api_plugin::get() {
    return ret;
 }
 
+db_size_breakdown db_size_api_plugin::get_breakdown(const db_size_breakdown_params& params) {
+   chainbase::database& db = app().get_plugin<chain_plugin>().chain().mutable_db();
+   db_size_breakdown ret;
+
+   ret.free_bytes = db.get_segment_manager()->get_free_memory();
+   ret.size = db.get_segment_manager()->get_size();
+   ret.used_bytes = ret.size - ret.free_bytes;
+
+   my->step(db, params.scan_rows);
+   ret.scan_rows_done = my->rows_done;
+
+   std::set<string> sized;
+   chain_indices::walk([&](auto* index) {
+      using index_t = std::remove_pointer_t<decltype(index)>;
+      db_size_index_bytes b;
+      b.index = index_name<index_t>();
+      b.row_count = db.get_index<index_t>().indices().size();
+      b.row_bytes = b.row_count * row_bytes<index_t>();
+      auto blobs = my->last_dynamic_bytes.find(b.index);
+      if (blobs != my->last_dynamic_bytes.end())
+         b.dynamic_bytes = blobs->second;
+      sized.insert(b.index);
+      ret.indices.emplace_back(std::move(b));
+   });
+   for (const auto& i : db.row_count_per_index()) {
+      if (sized.count(i.second)) continue;
+      db_size_index_bytes b;
+      b.index = i.second;
+      b.row_count = i.first;
+      ret.indices.emplace_back(std::move(b));
+   }
+   std::sort(ret.indices.begin(), ret.indices.end(), [](const auto& a, const auto& b) {
+      return a.row_bytes + a.dynamic_bytes > b.row_bytes + b.dynamic_bytes;
+   });
+
+   const auto top = std::min<size_t>(params.top_contracts, my->last_contracts.size());
+   ret.contracts.assign(my->last_contracts.begin(), my->last_contracts.begin() + top);
+   ret.contracts_as_of = my->last_pass_end;
+
+   ret.fragmentation = db_size_api_plugin_impl::probe_free_blocks(db);
+   return ret;
+}
+
+#undef INVOKE_R_R
 #undef INVOKE_R_V
 #undef CALL
 
@@ -25,16 +25,53 @@ struct db_size_stats {
    vector<db_size_index_count> indices;
 };
 
+/// Estimated bytes of an index: its rows with the nodes of every ordered index and the allocator headers
+struct db_size_index_bytes {
+   string   index;
+   uint64_t row_count = 0;
+   uint64_t row_bytes = 0;     ///< 0 for the indices of plugins, only counted
+   uint64_t dynamic_bytes = 0; ///< blobs of the rows (table values, code, abis) as of the last complete scan
+};
+
+struct db_size_contract_bytes {
+   account_name code;
+   uint64_t     key_value_rows = 0;
+   uint64_t     key_value_bytes = 0;
+   uint64_t     secondary_rows = 0;
+   uint64_t     secondary_bytes = 0;
+};
+
+struct db_size_fragmentation {
+   uint64_t largest_free_block = 0;
+   double   fragmentation = 0; ///< 1 - largest_free_block / free_bytes
+};
+
+struct db_size_breakdown_params {
+   uint32_t top_contracts = 20;
+   uint32_t scan_rows = 20000; ///< rows the contract tables scan advances by in this call
+};
+
+struct db_size_breakdown {
+   uint64_t                        free_bytes = 0;
+   uint64_t                        used_bytes = 0;
+   uint64_t                        size = 0;
+   vector<db_size_index_bytes>     indices;
+   vector<db_size_contract_bytes>  contracts;         ///< by bytes of their tables, as of the last complete scan
+   fc::time_point                  contracts_as_of;   ///< end of the last complete scan, zero before the first one
+   uint64_t                        scan_rows_done = 0; ///< rows scanned by the pass in progress
+   db_size_fragmentation           fragmentation;
+};
+
 class db_size_api_plugin : public plugin<db_size_api_plugin> {
 public:
    APPBASE_PLUGIN_REQUIRES((http_plugin) (chain_plugin))
 
-   db_size_api_plugin() = default;
+   db_size_api_plugin();
    db_size_api_plugin(const db_size_api_plugin&) = delete;
    db_size_api_plugin(db_size_api_plugin&&) = delete;
    db_size_api_plugin& operator=(const db_size_api_plugin&) = delete;
    db_size_api_plugin& operator=(db_size_api_plugin&&) = delete;
-   virtual ~db_size_api_plugin() override = default;
+   virtual ~db_size_api_plugin() override;
 
    virtual void set_program_options(options_description& cli, options_description& cfg) override {}
    void plugin_initialize(const variables_map& vm) {}
@@ -43,10 +80,21 @@ public:
 
    db_size_stats get();
 
+   /// Cheap enough to poll: contract tables are scanned `scan_rows` rows per call, the report holds the last
+   /// complete pass over them.
+   db_size_breakdown get_breakdown(const db_size_breakdown_params& params);
+
 private:
+   std::unique_ptr<struct db_size_api_plugin_impl> my;
 };
 
 }
 
 FC_REFLECT( eosio::db_size_index_count, (index)(row_count) )
-FC_REFLECT( eosio::db_size_stats, (free_bytes)(used_bytes)(size)(indices) )
\ No newline at end of file
+FC_REFLECT( eosio::db_size_stats, (free_bytes)(used_bytes)(size)(indices) )
+FC_REFLECT( eosio::db_size_index_bytes, (index)(row_count)(row_bytes)(dynamic_bytes) )
+FC_REFLECT( eosio::db_size_contract_bytes, (code)(key_value_rows)(key_value_bytes)(secondary_rows)(secondary_bytes) )
+FC_REFLECT( eosio::db_size_fragmentation, (largest_free_block)(fragmentation) )
+FC_REFLECT( eosio::db_size_breakdown_params, (top_contracts)(scan_rows) )
+FC_REFLECT( eosio::db_size_breakdown,
+            (free_bytes)(used_bytes)(size)(indices)(contracts)(contracts_as_of)(scan_rows_done)(fragmentation) )
\ No newline at end of file
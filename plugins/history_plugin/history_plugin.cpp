@@ -1,15 +1,22 @@
 #include <eosio/history_plugin/history_plugin.hpp>
 #include <eosio/history_plugin/account_control_history_object.hpp>
+#include <eosio/history_plugin/key_account_store.hpp>
 #include <eosio/history_plugin/public_key_history_object.hpp>
+#include <eosio/history_plugin/transaction_location_object.hpp>
 #include <eosio/chain/controller.hpp>
 #include <eosio/chain/trace.hpp>
 #include <eosio/chain_plugin/chain_plugin.hpp>
+#include <eosio/chain_plugin/history_checkpoint.hpp>
 
+#include <fc/io/fstream.hpp>
 #include <fc/io/json.hpp>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/signals2/connection.hpp>
 
+#include <fstream>
+#include <iterator>
+
 namespace eosio {
    using namespace chain;
    using boost::signals2::scoped_connection;
@@ -142,6 +149,36 @@ namespace eosio {
          std::set<filter_entry> filter_out;
          chain_plugin*          chain_plug = nullptr;
          fc::optional<scoped_connection> applied_transaction_connection;
+         fc::optional<scoped_connection> accepted_block_connection;
+         fc::optional<scoped_connection> irreversible_block_connection;
+
+         /// with --history-separate-db, holds the history of the irreversible blocks outside of the chain state
+         fc::optional<chainbase::database>                      history_db;
+         bfs::path                                              pending_path;
+         std::map<transaction_id_type, transaction_trace_ptr>   cached_traces;
+         transaction_trace_ptr                                  onblock_trace;
+         std::map<block_id_type, vector<action_trace>>          pending_actions; ///< of the reversible blocks
+         bool                                                   index_transactions = false;
+         fc::optional<history_checkpoint>                       checkpoint; ///< last irreversible block in history_db
+         uint32_t                                               last_signaled_irreversible = 0;
+
+         /// with --history-key-accounts-store, the keys of get_key_accounts are not in the history database
+         std::unique_ptr<key_account_store>                     key_store;
+         bfs::path                                              pending_keys_path;
+         std::map<transaction_id_type, vector<authority_keys>>  cached_key_updates;
+         std::map<block_id_type, vector<authority_keys>>        pending_key_updates; ///< of the reversible blocks
+
+         const chainbase::database& db()const {
+            if( history_db )
+               return *history_db;
+            return chain_plug->chain().db();
+         }
+
+         chainbase::database& mutable_db() {
+            if( history_db )
+               return *history_db;
+            return const_cast<chainbase::database&>( chain_plug->chain().db() ); // Override read-only access to state DB (highly unrecommended practice!)
+         }
 
           bool filter(const action_trace& act) {
             bool pass_on = false;
@@ -205,8 +242,7 @@ namespace eosio {
          }
 
          void record_account_action( account_name n, const action_trace& act ) {
-            auto& chain = chain_plug->chain();
-            chainbase::database& db = const_cast<chainbase::database&>( chain.db() ); // Override read-only access to state DB (highly unrecommended practice!)
+            chainbase::database& db = mutable_db();
 
             const auto& idx = db.get_index<account_history_index, by_account_action_seq>();
             auto itr = idx.lower_bound( boost::make_tuple( name(n.value+1), 0 ) );
@@ -224,28 +260,28 @@ namespace eosio {
          }
 
          void on_system_action( const action_trace& at ) {
-            auto& chain = chain_plug->chain();
-            chainbase::database& db = const_cast<chainbase::database&>( chain.db() ); // Override read-only access to state DB (highly unrecommended practice!)
+            chainbase::database& db = mutable_db();
+            const bool keys = !key_store;
             if( at.act.name == N(newaccount) )
             {
                const auto create = at.act.data_as<chain::newaccount>();
-               add(db, create.owner.keys, create.name, N(owner));
+               if( keys ) add(db, create.owner.keys, create.name, N(owner));
                add(db, create.owner.accounts, create.name, N(owner));
-               add(db, create.active.keys, create.name, N(active));
+               if( keys ) add(db, create.active.keys, create.name, N(active));
                add(db, create.active.accounts, create.name, N(active));
             }
             else if( at.act.name == N(updateauth) )
             {
                const auto update = at.act.data_as<chain::updateauth>();
-               remove<public_key_history_multi_index, by_account_permission>(db, update.account, update.permission);
+               if( keys ) remove<public_key_history_multi_index, by_account_permission>(db, update.account, update.permission);
                remove<account_control_history_multi_index, by_controlled_authority>(db, update.account, update.permission);
-               add(db, update.auth.keys, update.account, update.permission);
+               if( keys ) add(db, update.auth.keys, update.account, update.permission);
                add(db, update.auth.accounts, update.account, update.permission);
             }
             else if( at.act.name == N(deleteauth) )
             {
                const auto del = at.act.data_as<chain::deleteauth>();
-               remove<public_key_history_multi_index, by_account_permission>(db, del.account, del.permission);
+               if( keys ) remove<public_key_history_multi_index, by_account_permission>(db, del.account, del.permission);
                remove<account_control_history_multi_index, by_controlled_authority>(db, del.account, del.permission);
             }
          }
@@ -253,8 +289,7 @@ namespace eosio {
          void on_action_trace( const action_trace& at ) {
             if( filter( at ) ) {
                //idump((fc::json::to_pretty_string(at)));
-               auto& chain = chain_plug->chain();
-               chainbase::database& db = const_cast<chainbase::database&>( chain.db() ); // Override read-only access to state DB (highly unrecommended practice!)
+               chainbase::database& db = mutable_db();
 
                db.create<action_history_object>( [&]( auto& aho ) {
                   auto ps = fc::raw::pack_size( at );
@@ -262,8 +297,8 @@ namespace eosio {
                   datastream<char*> ds( aho.packed_action_trace.data(), ps );
                   fc::raw::pack( ds, at );
                   aho.action_sequence_num = at.receipt->global_sequence;
-                  aho.block_num = chain.head_block_num() + 1;
-                  aho.block_time = chain.pending_block_time();
+                  aho.block_num = at.block_num;
+                  aho.block_time = at.block_time;
                   aho.trx_id     = at.trx_id;
                });
 
@@ -276,15 +311,215 @@ namespace eosio {
                on_system_action( at );
          }
 
+         /// keys set by the system actions of `act`, appended to `updates`
+         static void add_key_updates( const action& act, vector<authority_keys>& updates ) {
+            if( act.account != config::system_account_name ) return;
+            if( act.name == N(newaccount) ) {
+               const auto create = act.data_as<chain::newaccount>();
+               updates.push_back( { create.name, N(owner), key_list( create.owner ) } );
+               updates.push_back( { create.name, N(active), key_list( create.active ) } );
+            } else if( act.name == N(updateauth) ) {
+               const auto update = act.data_as<chain::updateauth>();
+               updates.push_back( { update.account, update.permission, key_list( update.auth ) } );
+            } else if( act.name == N(deleteauth) ) {
+               const auto del = act.data_as<chain::deleteauth>();
+               updates.push_back( { del.account, del.permission, {} } );
+            }
+         }
+
+         static vector<public_key_type> key_list( const authority& auth ) {
+            vector<public_key_type> keys;
+            keys.reserve( auth.keys.size() );
+            for( const auto& k : auth.keys )
+               keys.push_back( k.key );
+            return keys;
+         }
+
+         void cache_key_updates( const transaction_trace_ptr& trace ) {
+            vector<authority_keys> updates;
+            for( const auto& atrace : trace->action_traces ) {
+               if( atrace.receipt && atrace.receiver == config::system_account_name )
+                  add_key_updates( atrace.act, updates );
+            }
+            if( updates.empty() ) return;
+            cached_key_updates[trace->failed_dtrx_trace ? trace->failed_dtrx_trace->id : trace->id] = std::move( updates );
+         }
+
          void on_applied_transaction( const transaction_trace_ptr& trace ) {
             if( !trace->receipt || (trace->receipt->status != transaction_receipt_header::executed &&
                   trace->receipt->status != transaction_receipt_header::soft_fail) )
                return;
+            if( key_store )
+               cache_key_updates( trace );
+            if( history_db ) {
+               // kept until the block including it is accepted
+               if( is_onblock( trace ) )
+                  onblock_trace = trace;
+               else if( trace->failed_dtrx_trace )
+                  cached_traces[trace->failed_dtrx_trace->id] = trace;
+               else
+                  cached_traces[trace->id] = trace;
+               return;
+            }
             for( const auto& atrace : trace->action_traces ) {
                if( !atrace.receipt ) continue;
                on_action_trace( atrace );
             }
          }
+
+         static bool is_onblock( const transaction_trace_ptr& trace ) {
+            if( trace->action_traces.size() != 1 ) return false;
+            const auto& act = trace->action_traces[0].act;
+            if( act.account != config::system_account_name || act.name != N(onblock) || act.authorization.size() != 1 )
+               return false;
+            const auto& auth = act.authorization[0];
+            return auth.actor == config::system_account_name && auth.permission == config::active_name;
+         }
+
+         void on_accepted_block( const block_state_ptr& bsp ) {
+            vector<action_trace>* actions = nullptr;
+            if( history_db ) {
+               actions = &pending_actions[bsp->id];
+               actions->clear();
+            }
+            vector<authority_keys>* key_updates = nullptr;
+            if( key_store ) {
+               key_updates = &pending_key_updates[bsp->id];
+               key_updates->clear();
+            }
+            auto add = [&]( const transaction_trace_ptr& trace ) {
+               for( const auto& atrace : trace->action_traces ) {
+                  if( atrace.receipt ) actions->push_back( atrace );
+               }
+            };
+            if( onblock_trace ) add( onblock_trace );
+            for( const auto& r : bsp->block->transactions ) {
+               transaction_id_type id;
+               if( r.trx.contains<transaction_id_type>() )
+                  id = r.trx.get<transaction_id_type>();
+               else
+                  id = r.trx.get<packed_transaction>().id();
+               if( actions ) {
+                  auto itr = cached_traces.find( id );
+                  if( itr != cached_traces.end() ) add( itr->second );
+               }
+               if( key_updates ) {
+                  auto itr = cached_key_updates.find( id );
+                  if( itr != cached_key_updates.end() )
+                     std::move( itr->second.begin(), itr->second.end(), std::back_inserter( *key_updates ) );
+               }
+            }
+            cached_traces.clear();
+            cached_key_updates.clear();
+            onblock_trace.reset();
+         }
+
+         // the history of a block is written once, without undo session, when the block becomes irreversible
+         void on_irreversible_block( const block_state_ptr& bsp ) {
+            last_signaled_irreversible = bsp->block_num;
+            if( key_store ) {
+               // queued for the thread of the store, ignored when replayed
+               auto itr = pending_key_updates.find( bsp->id );
+               key_store->add_block( bsp->block_num, itr != pending_key_updates.end() ? std::move( itr->second ) : vector<authority_keys>() );
+               prune_through( pending_key_updates, bsp->block_num );
+            }
+            if( !history_db ) return;
+            // a replayed block already written by a previous run
+            if( bsp->block_num > checkpoint->last_committed() ) {
+               auto itr = pending_actions.find( bsp->id );
+               if( itr != pending_actions.end() ) {
+                  for( const auto& atrace : itr->second )
+                     on_action_trace( atrace );
+               }
+               if( index_transactions )
+                  index_block_transactions( *bsp->block );
+               checkpoint->commit( bsp->block_num );
+            }
+            prune_through( pending_actions, bsp->block_num );
+         }
+
+         // this block and the blocks of the forks it pruned
+         template<typename Pending>
+         static void prune_through( Pending& pending, uint32_t block_num ) {
+            for( auto i = pending.begin(); i != pending.end(); ) {
+               if( block_header::num_from_id( i->first ) <= block_num )
+                  i = pending.erase( i );
+               else
+                  ++i;
+            }
+         }
+
+         void index_block_transactions( const signed_block& block ) {
+            const auto& receipts = block.transactions;
+            for( uint32_t i = 0; i < receipts.size(); ++i ) {
+               const auto& trx = receipts[i].trx;
+               history_db->create<transaction_location_object>( [&]( auto& loc ) {
+                  loc.id_prefix = transaction_location_object::prefix_of(
+                        trx.contains<transaction_id_type>() ? trx.get<transaction_id_type>() : trx.get<packed_transaction>().id() );
+                  loc.block_num = block.block_num();
+                  loc.index     = i;
+               });
+            }
+         }
+
+         // irreversible blocks applied while the plugin was not running, their action traces are lost
+         void read_missed_blocks() {
+            if( !checkpoint->last_committed() ) return;
+            const auto first = std::max( checkpoint->last_committed(), last_signaled_irreversible ) + 1;
+            const auto last = checkpoint->read_missed_blocks( chain_plug->chain(), last_signaled_irreversible,
+                                                              [&]( const signed_block_ptr& block ) {
+               if( index_transactions )
+                  index_block_transactions( *block );
+            });
+            if( !last ) return;
+            checkpoint->commit( last );
+            wlog( "history of blocks ${f} to ${l} is missing, they were applied while history_plugin was not running${i}",
+                  ("f", first)("l", last)("i", index_transactions ? ", their transactions were indexed from the block log" : "") );
+         }
+
+         // keys of irreversible blocks applied while the plugin was not running, their inline actions are lost
+         void read_missed_key_blocks() {
+            if( !key_store->last_block() ) return;
+            auto& chain = chain_plug->chain();
+            const auto first = key_store->last_block() + 1;
+            uint32_t last = 0;
+            for( uint32_t block_num = first; block_num <= chain.last_irreversible_block_num(); ++block_num ) {
+               const auto block = chain.fetch_block_by_number( block_num );
+               if( !block ) break;
+               vector<authority_keys> updates;
+               for( const auto& r : block->transactions ) {
+                  if( !r.trx.contains<packed_transaction>() ) continue;
+                  for( const auto& act : r.trx.get<packed_transaction>().get_transaction().actions )
+                     add_key_updates( act, updates );
+               }
+               key_store->add_block( block_num, std::move( updates ) );
+               last = block_num;
+            }
+            if( last )
+               wlog( "keys of blocks ${f} to ${l} were read from the block log, the keys set by their inline actions are missing",
+                     ("f", first)("l", last) );
+         }
+
+         // the reversible blocks are not applied again on restart
+         template<typename Pending>
+         static void load_pending( const bfs::path& path, Pending& pending ) {
+            if( !fc::exists( path ) ) return;
+            std::string content;
+            fc::read_file_contents( path, content );
+            fc::datastream<const char*> ds( content.data(), content.size() );
+            fc::raw::unpack( ds, pending );
+            fc::remove( path );
+         }
+
+         template<typename Pending>
+         static void save_pending( const bfs::path& path, const Pending& pending ) {
+            if( pending.empty() ) return;
+            std::ofstream out( path.generic_string(), std::ios::out | std::ios::binary | std::ios::trunc );
+            auto data = fc::raw::pack( pending );
+            out.write( data.data(), data.size() );
+            out.flush();
+            EOS_ASSERT( out.good(), chain::plugin_exception, "Cannot write ${p}", ("p", path.generic_string()) );
+         }
    };
 
    history_plugin::history_plugin()
@@ -305,6 +540,21 @@ namespace eosio {
             ("filter-out,F", bpo::value<vector<string>>()->composing(),
              "Do not track actions which match receiver:action:actor. Action and Actor both blank excludes all from Reciever. Actor blank excludes all from reciever:action. Receiver may not be blank.")
             ;
+      cfg.add_options()
+            ("history-separate-db", bpo::bool_switch()->default_value(false),
+             "Store the history in its own database instead of the chain state database. "
+             "Only the history of irreversible blocks is written to it, once per block, and can be queried.")
+            ("history-dir", bpo::value<bfs::path>()->default_value("history"),
+             "the location of the history database (absolute path or relative to application data dir)")
+            ("history-db-size-mb", bpo::value<uint64_t>()->default_value(1024),
+             "Maximum size (in MiB) of the history database")
+            ("history-index-transactions", bpo::bool_switch()->default_value(false),
+             "Keep the block and position of every irreversible transaction in the history database, "
+             "so that get_transaction finds any transaction without a block hint. Requires --history-separate-db.")
+            ("history-key-accounts-store", bpo::bool_switch()->default_value(false),
+             "Keep the keys of get_key_accounts in key_accounts files of history-dir instead of the history database, "
+             "written on a thread of their own from the irreversible blocks. get_key_accounts only sees irreversible keys.")
+            ;
    }
 
    void history_plugin::plugin_initialize(const variables_map& options) {
@@ -343,25 +593,70 @@ namespace eosio {
          EOS_ASSERT( my->chain_plug, chain::missing_chain_plugin_exception, ""  );
          auto& chain = my->chain_plug->chain();
 
-         chainbase::database& db = const_cast<chainbase::database&>( chain.db() ); // Override read-only access to state DB (highly unrecommended practice!)
-         // TODO: Use separate chainbase database for managing the state of the history_plugin (or remove deprecated history_plugin entirely)
+         auto dir = options.at( "history-dir" ).as<bfs::path>();
+         if( dir.is_relative() )
+            dir = app().data_dir() / dir;
+         if( options.at( "history-separate-db" ).as<bool>() ) {
+            bfs::create_directories( dir );
+            my->history_db.emplace( dir, chainbase::database::read_write,
+                                    options.at( "history-db-size-mb" ).as<uint64_t>() * 1024 * 1024 );
+            my->pending_path = dir / "pending_actions.bin";
+            my->load_pending( my->pending_path, my->pending_actions );
+            my->checkpoint.emplace( dir, "history" );
+         }
+         if( options.at( "history-key-accounts-store" ).as<bool>() ) {
+            my->key_store = std::make_unique<key_account_store>( dir );
+            my->pending_keys_path = dir / "pending_key_updates.bin";
+            my->load_pending( my->pending_keys_path, my->pending_key_updates );
+         }
+         my->index_transactions = options.at( "history-index-transactions" ).as<bool>();
+         EOS_ASSERT( !my->index_transactions || my->history_db, chain::plugin_config_exception,
+                     "--history-index-transactions requires --history-separate-db" );
+
+         chainbase::database& db = my->mutable_db();
          db.add_index<account_history_index>();
          db.add_index<action_history_index>();
          db.add_index<account_control_history_multi_index>();
-         db.add_index<public_key_history_multi_index>();
+         if( !my->key_store )
+            db.add_index<public_key_history_multi_index>();
+         if( my->index_transactions )
+            db.add_index<transaction_location_multi_index>();
 
          my->applied_transaction_connection.emplace(
-               chain.applied_transaction.connect( [&]( std::tuple<const transaction_trace_ptr&, const signed_transaction&> t ) {
+               chain.applied_transaction.connect( chain::timed_slot( "history_applied_transaction",
+                     [&]( std::tuple<const transaction_trace_ptr&, const signed_transaction&> t ) {
                   my->on_applied_transaction( std::get<0>(t) );
-               } ));
+               } ) ));
+         if( my->history_db || my->key_store ) {
+            my->accepted_block_connection.emplace(
+                  chain.accepted_block.connect( chain::timed_slot( "history_accepted_block",
+                        [&]( const block_state_ptr& bsp ) { my->on_accepted_block( bsp ); } ) ) );
+            my->irreversible_block_connection.emplace(
+                  chain.irreversible_block.connect( chain::timed_slot( "history_irreversible_block",
+                        [&]( const block_state_ptr& bsp ) { my->on_irreversible_block( bsp ); } ) ) );
+         }
       } FC_LOG_AND_RETHROW()
    }
 
    void history_plugin::plugin_startup() {
+      try {
+         if( my->history_db )
+            my->read_missed_blocks();
+         if( my->key_store )
+            my->read_missed_key_blocks();
+      } FC_LOG_AND_RETHROW()
    }
 
    void history_plugin::plugin_shutdown() {
       my->applied_transaction_connection.reset();
+      my->accepted_block_connection.reset();
+      my->irreversible_block_connection.reset();
+      if( my->history_db )
+         my->save_pending( my->pending_path, my->pending_actions );
+      if( my->key_store ) {
+         my->save_pending( my->pending_keys_path, my->pending_key_updates );
+         my->key_store->stop();
+      }
    }
 
 
@@ -371,7 +666,7 @@ namespace eosio {
       read_only::get_actions_result read_only::get_actions( const read_only::get_actions_params& params )const {
          edump((params));
         auto& chain = history->chain_plug->chain();
-        const auto& db = chain.db();
+        const auto& db = history->db();
         const auto abi_serializer_max_time = history->chain_plug->get_abi_serializer_max_time();
 
         const auto& idx = db.get_index<account_history_index, by_account_action_seq>();
@@ -461,16 +756,12 @@ namespace eosio {
             return (*(input_id.data() + input_id_size) & 0xF0) == (*(id.data() + input_id_size) & 0xF0);
          };
 
-         const auto& db = chain.db();
+         const auto& db = history->db();
          const auto& idx = db.get_index<action_history_index, by_trx_id>();
          auto itr = idx.lower_bound( boost::make_tuple( input_id ) );
 
          bool in_history = (itr != idx.end() && txn_id_matched(itr->trx_id) );
 
-         if( !in_history && !p.block_num_hint ) {
-            EOS_THROW(tx_not_found, "Transaction ${id} not found in history and no block hint was given", ("id",p.id));
-         }
-
          get_transaction_result result;
 
          if( in_history ) {
@@ -512,33 +803,54 @@ namespace eosio {
                }
             }
          } else {
-            auto blk = chain.fetch_block_by_number(*p.block_num_hint);
+            auto match_receipt = [&]( const signed_block_ptr& blk, const transaction_receipt& receipt ) -> bool {
+               if (receipt.trx.contains<packed_transaction>()) {
+                  auto& pt = receipt.trx.get<packed_transaction>();
+                  const auto& id = pt.id();
+                  if( txn_id_matched(id) ) {
+                     result.id = id;
+                     result.last_irreversible_block = chain.last_irreversible_block_num();
+                     result.block_num = blk->block_num();
+                     result.block_time = blk->timestamp;
+                     fc::mutable_variant_object r("receipt", receipt);
+                     r("trx", chain.to_variant_with_abi(pt.get_signed_transaction(), abi_serializer_max_time));
+                     result.trx = move(r);
+                     return true;
+                  }
+               } else {
+                  auto& id = receipt.trx.get<transaction_id_type>();
+                  if( txn_id_matched(id) ) {
+                     result.id = id;
+                     result.last_irreversible_block = chain.last_irreversible_block_num();
+                     result.block_num = blk->block_num();
+                     result.block_time = blk->timestamp;
+                     fc::mutable_variant_object r("receipt", receipt);
+                     result.trx = move(r);
+                     return true;
+                  }
+               }
+               return false;
+            };
+
             bool found = false;
-            if (blk) {
-               for (const auto& receipt: blk->transactions) {
-                  if (receipt.trx.contains<packed_transaction>()) {
-                     auto& pt = receipt.trx.get<packed_transaction>();
-                     const auto& id = pt.id();
-                     if( txn_id_matched(id) ) {
-                        result.id = id;
-                        result.last_irreversible_block = chain.last_irreversible_block_num();
-                        result.block_num = *p.block_num_hint;
-                        result.block_time = blk->timestamp;
-                        fc::mutable_variant_object r("receipt", receipt);
-                        r("trx", chain.to_variant_with_abi(pt.get_signed_transaction(), abi_serializer_max_time));
-                        result.trx = move(r);
-                        found = true;
-                        break;
-                     }
-                  } else {
-                     auto& id = receipt.trx.get<transaction_id_type>();
-                     if( txn_id_matched(id) ) {
-                        result.id = id;
-                        result.last_irreversible_block = chain.last_irreversible_block_num();
-                        result.block_num = *p.block_num_hint;
-                        result.block_time = blk->timestamp;
-                        fc::mutable_variant_object r("receipt", receipt);
-                        result.trx = move(r);
+            if( history->index_transactions ) {
+               // the ids sharing the known leading bits of input_id, each leads straight to its receipt
+               const size_t known_bits = std::min<size_t>( input_id_length * 4, 64 );
+               const uint64_t unknown = known_bits == 64 ? 0 : ~uint64_t(0) >> known_bits;
+               const uint64_t low = transaction_location_object::prefix_of( input_id ) & ~unknown;
+               const auto& loc_idx = db.get_index<transaction_location_multi_index, by_id_prefix>();
+               auto loc = loc_idx.lower_bound( boost::make_tuple( low ) );
+               auto loc_end = loc_idx.upper_bound( boost::make_tuple( low | unknown ) );
+               for( ; loc != loc_end && !found; ++loc ) {
+                  auto blk = chain.fetch_block_by_number( loc->block_num );
+                  found = blk && loc->index < blk->transactions.size() && match_receipt( blk, blk->transactions[loc->index] );
+               }
+            }
+            if( !found && p.block_num_hint ) {
+               auto blk = chain.fetch_block_by_number(*p.block_num_hint);
+               if (blk) {
+                  for (const auto& receipt: blk->transactions) {
+                     if( match_receipt( blk, receipt ) ) {
                         found = true;
                         break;
                      }
@@ -547,6 +859,8 @@ namespace eosio {
             }
 
             if (!found) {
+               if( !p.block_num_hint )
+                  EOS_THROW(tx_not_found, "Transaction ${id} not found in history and no block hint was given", ("id",p.id));
                EOS_THROW(tx_not_found, "Transaction ${id} not found in history or in block number ${n}", ("id",p.id)("n", *p.block_num_hint));
             }
          }
@@ -555,8 +869,10 @@ namespace eosio {
       }
 
       read_only::get_key_accounts_results read_only::get_key_accounts(const get_key_accounts_params& params) const {
+         if( history->key_store )
+            return { history->key_store->accounts_of( params.public_key ) };
          std::set<account_name> accounts;
-         const auto& db = history->chain_plug->chain().db();
+         const auto& db = history->db();
          const auto& pub_key_idx = db.get_index<public_key_history_multi_index, by_pub_key>();
          auto range = pub_key_idx.equal_range( params.public_key );
          for (auto obj = range.first; obj != range.second; ++obj)
@@ -566,7 +882,7 @@ namespace eosio {
 
       read_only::get_controlled_accounts_results read_only::get_controlled_accounts(const get_controlled_accounts_params& params) const {
          std::set<account_name> accounts;
-         const auto& db = history->chain_plug->chain().db();
+         const auto& db = history->db();
          const auto& account_control_idx = db.get_index<account_control_history_multi_index, by_controlling>();
          auto range = account_control_idx.equal_range( params.controlling_account );
          for (auto obj = range.first; obj != range.second; ++obj)
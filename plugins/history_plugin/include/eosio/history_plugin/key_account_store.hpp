@@ -0,0 +1,92 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/chain/thread_utils.hpp>
+#include <eosio/chain/types.hpp>
+
+#include <fc/filesystem.hpp>
+
+#include <boost/container/flat_set.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+
+namespace eosio {
+
+   /// keys of a permission after an action of a block, none once the permission is deleted
+   struct authority_keys {
+      chain::account_name                 account;
+      chain::permission_name              permission;
+      std::vector<chain::public_key_type> keys;
+   };
+
+   /**
+    * Index of the accounts whose permissions hold a key, outside of the chain state, for get_key_accounts.
+    *
+    * Built from the irreversible blocks only, so it has no undo. The blocks added are written on a thread of the
+    * store, all the blocks queued in the meantime in one record appended to <dir>/key_accounts.log, then applied
+    * to the index in memory. The log is folded into <dir>/key_accounts.bin when it grows large and on startup.
+    * The index is keyed by the packed keys, a byte for their type and their compressed point.
+    */
+   class key_account_store {
+      public:
+         explicit key_account_store( const fc::path& dir );
+
+         // calls stop()
+         ~key_account_store();
+
+         /// the last block added, the blocks up to it are ignored by add_block; 0 for a new store
+         uint32_t last_block()const { return last_queued; }
+
+         /// queues the updates of `block_num`, blocks are added in order
+         void add_block( uint32_t block_num, std::vector<authority_keys> updates );
+
+         /// accounts with a permission holding `key` in the blocks written so far, in order
+         std::vector<chain::account_name> accounts_of( const chain::public_key_type& key )const;
+
+         /// writes the queued blocks
+         void stop();
+
+         static constexpr uint64_t max_log_size = 64 * 1024 * 1024;
+
+      private:
+         using authority = std::pair<chain::account_name, chain::permission_name>;
+
+         struct queued_block {
+            uint32_t                     block_num = 0;
+            std::vector<authority_keys>  updates;
+         };
+
+         void load();
+         void apply( const authority_keys& update );
+         void write_queued();
+         void write_snapshot();
+         void open_log();
+
+         const fc::path                                                    snapshot_path;
+         const fc::path                                                    log_path;
+
+         mutable std::mutex                                                mtx; ///< guards the index
+         std::map<authority, std::vector<std::string>>                     keys_of;
+         std::map<std::string, boost::container::flat_set<authority>>      authorities_of;
+         uint32_t                                                          written_block = 0;
+
+         std::mutex                                                        queue_mtx;
+         std::vector<queued_block>                                         queue;
+         bool                                                              write_scheduled = false;
+         std::atomic<uint32_t>                                             last_queued{0};
+
+         std::ofstream                                                     log;
+         uint64_t                                                          log_size = 0;
+         bool                                                              failed = false;
+         fc::optional<chain::named_thread_pool>                            thread;
+   };
+
+} /// namespace eosio
+
+FC_REFLECT( eosio::authority_keys, (account)(permission)(keys) )
@@ -0,0 +1,55 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <chainbase/chainbase.hpp>
+#include <eosio/chain/types.hpp>
+
+namespace eosio {
+using chain::transaction_id_type;
+using namespace boost::multi_index;
+
+/**
+ * Block and receipt position of a transaction of an irreversible block.
+ * Only the first 8 bytes of the id are kept, lookups check the receipt they lead to.
+ */
+class transaction_location_object : public chainbase::object<chain::transaction_location_object_type, transaction_location_object> {
+   OBJECT_CTOR(transaction_location_object)
+
+   id_type    id;
+   uint64_t   id_prefix = 0; ///< first 8 bytes of the transaction id, big endian so that hex prefixes are ranges
+   uint32_t   block_num = 0;
+   uint32_t   index = 0;     ///< of the receipt in the block
+
+   static uint64_t prefix_of( const transaction_id_type& trx_id ) {
+      uint64_t result = 0;
+      auto data = reinterpret_cast<const uint8_t*>( trx_id.data() );
+      for( int i = 0; i < 8; ++i )
+         result = (result << 8) | data[i];
+      return result;
+   }
+};
+
+struct by_id;
+struct by_id_prefix;
+using transaction_location_multi_index = chainbase::shared_multi_index_container<
+   transaction_location_object,
+   indexed_by<
+      ordered_unique<tag<by_id>, BOOST_MULTI_INDEX_MEMBER(transaction_location_object, transaction_location_object::id_type, id)>,
+      ordered_unique<tag<by_id_prefix>,
+         composite_key< transaction_location_object,
+            member<transaction_location_object, uint64_t, &transaction_location_object::id_prefix>,
+            member<transaction_location_object, uint32_t, &transaction_location_object::block_num>,
+            member<transaction_location_object, uint32_t, &transaction_location_object::index>
+         >
+      >
+   >
+>;
+
+}
+
+CHAINBASE_SET_INDEX_TYPE( eosio::transaction_location_object, eosio::transaction_location_multi_index )
+
+FC_REFLECT( eosio::transaction_location_object, (id_prefix)(block_num)(index) )
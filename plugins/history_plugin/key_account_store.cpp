@@ -0,0 +1,221 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/history_plugin/key_account_store.hpp>
+#include <eosio/chain/exceptions.hpp>
+
+#include <fc/io/fstream.hpp>
+#include <fc/io/raw.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace eosio {
+
+   namespace {
+      constexpr uint32_t snapshot_version = 1;
+
+      std::string pack_key( const chain::public_key_type& key ) {
+         const auto packed = fc::raw::pack( key );
+         return std::string( packed.data(), packed.size() );
+      }
+   }
+
+   key_account_store::key_account_store( const fc::path& dir )
+   :snapshot_path( dir / "key_accounts.bin" )
+   ,log_path( dir / "key_accounts.log" )
+   {
+      fc::create_directories( dir );
+      load();
+      last_queued = written_block;
+      open_log();
+      thread.emplace( "keyidx", 1 );
+   }
+
+   key_account_store::~key_account_store() {
+      stop();
+   }
+
+   void key_account_store::load() {
+      if( fc::exists( snapshot_path ) ) {
+         std::string content;
+         fc::read_file_contents( snapshot_path, content );
+         fc::datastream<const char*> ds( content.data(), content.size() );
+         uint32_t version = 0;
+         fc::raw::unpack( ds, version );
+         EOS_ASSERT( version == snapshot_version, chain::plugin_exception,
+                     "Unsupported version ${v} of ${p}", ("v", version)("p", snapshot_path.generic_string()) );
+         std::vector<authority_keys> authorities;
+         fc::raw::unpack( ds, written_block );
+         fc::raw::unpack( ds, authorities );
+         for( const auto& a : authorities )
+            apply( a );
+      }
+      if( !fc::exists( log_path ) ) return;
+
+      std::string content;
+      fc::read_file_contents( log_path, content );
+      if( content.empty() ) return;
+      size_t pos = 0;
+      while( content.size() - pos >= sizeof(uint32_t) ) {
+         uint32_t size = 0;
+         memcpy( &size, content.data() + pos, sizeof(size) );
+         if( content.size() - pos - sizeof(size) < size ) break;
+         fc::datastream<const char*> ds( content.data() + pos + sizeof(size), size );
+         uint32_t block_num = 0;
+         std::vector<authority_keys> updates;
+         fc::raw::unpack( ds, block_num );
+         fc::raw::unpack( ds, updates );
+         // written again after the log was folded into the snapshot
+         if( block_num > written_block ) {
+            for( const auto& u : updates )
+               apply( u );
+            written_block = block_num;
+         }
+         pos += sizeof(size) + size;
+      }
+      if( pos < content.size() )
+         wlog( "dropping the last ${n} bytes of ${p}, a record not completely written",
+               ("n", content.size() - pos)("p", log_path.generic_string()) );
+      // folded now, so that the log is only appended to from here
+      write_snapshot();
+   }
+
+   void key_account_store::apply( const authority_keys& update ) {
+      const authority auth{ update.account, update.permission };
+      auto itr = keys_of.find( auth );
+      if( itr != keys_of.end() ) {
+         for( const auto& k : itr->second ) {
+            auto a = authorities_of.find( k );
+            a->second.erase( auth );
+            if( a->second.empty() )
+               authorities_of.erase( a );
+         }
+         keys_of.erase( itr );
+      }
+      if( update.keys.empty() ) return;
+      auto& keys = keys_of[auth];
+      for( const auto& key : update.keys ) {
+         auto packed = pack_key( key );
+         if( std::find( keys.begin(), keys.end(), packed ) != keys.end() ) continue;
+         authorities_of[packed].insert( auth );
+         keys.push_back( std::move( packed ) );
+      }
+   }
+
+   void key_account_store::add_block( uint32_t block_num, std::vector<authority_keys> updates ) {
+      if( block_num <= last_queued ) return;
+      last_queued = block_num;
+      std::lock_guard<std::mutex> g( queue_mtx );
+      queue.push_back( { block_num, std::move( updates ) } );
+      if( write_scheduled || !thread ) return;
+      write_scheduled = true;
+      boost::asio::post( thread->get_executor(), [this]() { write_queued(); } );
+   }
+
+   void key_account_store::write_queued() {
+      std::vector<queued_block> blocks;
+      {
+         std::lock_guard<std::mutex> g( queue_mtx );
+         blocks.swap( queue );
+         write_scheduled = false;
+      }
+      if( blocks.empty() || failed ) return;
+      try {
+         // one record for all of them, blocks without updates are recorded too so that they are not read again
+         std::vector<authority_keys> updates;
+         for( auto& b : blocks )
+            std::move( b.updates.begin(), b.updates.end(), std::back_inserter( updates ) );
+         const uint32_t block_num = blocks.back().block_num;
+         const uint32_t size = fc::raw::pack_size( block_num ) + fc::raw::pack_size( updates );
+         std::vector<char> record( sizeof(size) + size );
+         memcpy( record.data(), &size, sizeof(size) );
+         fc::datastream<char*> ds( record.data() + sizeof(size), size );
+         fc::raw::pack( ds, block_num );
+         fc::raw::pack( ds, updates );
+         log.write( record.data(), record.size() );
+         log.flush();
+         EOS_ASSERT( log.good(), chain::plugin_exception, "Unable to write ${p}", ("p", log_path.generic_string()) );
+         log_size += record.size();
+
+         std::lock_guard<std::mutex> g( mtx );
+         for( const auto& u : updates )
+            apply( u );
+         written_block = block_num;
+         if( log_size > max_log_size )
+            write_snapshot();
+      } catch( const fc::exception& e ) {
+         failed = true;
+         elog( "key to account index stopped at block ${b}: ${e}", ("b", written_block)("e", e.to_detail_string()) );
+      }
+   }
+
+   void key_account_store::write_snapshot() {
+      std::vector<authority_keys> authorities;
+      authorities.reserve( keys_of.size() );
+      for( const auto& a : keys_of ) {
+         authority_keys ak{ a.first.first, a.first.second, {} };
+         ak.keys.reserve( a.second.size() );
+         for( const auto& k : a.second ) {
+            fc::datastream<const char*> ds( k.data(), k.size() );
+            chain::public_key_type key;
+            fc::raw::unpack( ds, key );
+            ak.keys.push_back( std::move( key ) );
+         }
+         authorities.push_back( std::move( ak ) );
+      }
+      const auto temp_path = snapshot_path.generic_string() + ".tmp";
+      {
+         std::ofstream out( temp_path, std::ios::out | std::ios::binary | std::ios::trunc );
+         const auto data = fc::raw::pack( snapshot_version );
+         out.write( data.data(), data.size() );
+         const auto block = fc::raw::pack( written_block );
+         out.write( block.data(), block.size() );
+         const auto content = fc::raw::pack( authorities );
+         out.write( content.data(), content.size() );
+         out.close();
+         EOS_ASSERT( !out.fail(), chain::plugin_exception, "Unable to write ${p}", ("p", temp_path) );
+      }
+      fc::rename( temp_path, snapshot_path );
+      // the records of the log are in the snapshot, they are skipped if the log is read before it is emptied
+      if( log.is_open() ) {
+         log.close();
+         fc::remove( log_path );
+         open_log();
+      } else {
+         fc::remove_all( log_path );
+      }
+   }
+
+   void key_account_store::open_log() {
+      log.open( log_path.generic_string(), std::ios::out | std::ios::binary | std::ios::app );
+      EOS_ASSERT( log.good(), chain::plugin_exception, "Unable to open ${p}", ("p", log_path.generic_string()) );
+      log_size = boost::filesystem::file_size( log_path );
+   }
+
+   std::vector<chain::account_name> key_account_store::accounts_of( const chain::public_key_type& key )const {
+      std::vector<chain::account_name> accounts;
+      std::lock_guard<std::mutex> g( mtx );
+      auto itr = authorities_of.find( pack_key( key ) );
+      if( itr == authorities_of.end() ) return accounts;
+      // ordered by account, then permission
+      for( const auto& auth : itr->second ) {
+         if( accounts.empty() || accounts.back() != auth.first )
+            accounts.push_back( auth.first );
+      }
+      return accounts;
+   }
+
+   void key_account_store::stop() {
+      if( !thread ) return;
+      chain::async_thread_pool( thread->get_executor(), [this]() { write_queued(); } ).wait();
+      thread->stop();
+      thread.reset();
+      log.close();
+   }
+
+} /// namespace eosio
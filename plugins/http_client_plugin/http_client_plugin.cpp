@@ -9,7 +9,7 @@
 
 namespace eosio {
 
-http_client_plugin::http_client_plugin():my(new http_client()){}
+http_client_plugin::http_client_plugin():my(new http_client()),pool(new http_client_pool()){}
 http_client_plugin::~http_client_plugin(){}
 
 void http_client_plugin::set_program_options(options_description&, options_description& cfg) {
@@ -18,6 +18,12 @@ void http_client_plugin::set_program_options(options_description&, options_descr
        "PEM encoded trusted root certificate (or path to file containing one) used to validate any TLS connections made.  (may specify multiple times)\n")
       ("https-client-validate-peers", boost::program_options::value<bool>()->default_value(true),
        "true: validate that the peer certificates are valid and trusted, false: ignore cert errors")
+      ("http-client-pool-size", boost::program_options::value<uint32_t>()->default_value(4),
+       "Number of idle keep-alive connections kept per host for the requests of remote signature providers, 0 opens a connection per request")
+      ("http-client-standby", boost::program_options::value<bool>()->default_value(true),
+       "Open a connection in the background whenever the last idle connection to a host is taken, so that requests do not wait for TCP and TLS handshakes")
+      ("http-client-idle-timeout-ms", boost::program_options::value<uint32_t>()->default_value(30000),
+       "Idle keep-alive connections are closed after this many milliseconds")
       ;
 
 }
@@ -44,6 +50,7 @@ void http_client_plugin::plugin_initialize(const variables_map& options) {
 
             try {
                my->add_cert( pem_str );
+               pool->add_cert( pem_str );
             } catch ( const fc::exception& e ) {
                elog( "Failed to read PEM : ${e} \n${pem}\n", ("pem", pem_str)( "e", e.to_detail_string()));
             }
@@ -51,6 +58,14 @@ void http_client_plugin::plugin_initialize(const variables_map& options) {
       }
 
       my->set_verify_peers( options.at( "https-client-validate-peers" ).as<bool>());
+      pool->set_verify_peers( options.at( "https-client-validate-peers" ).as<bool>());
+
+      http_client_pool::options pool_options;
+      pool_options.max_idle = options.at( "http-client-pool-size" ).as<uint32_t>();
+      pool_options.standby = options.at( "http-client-standby" ).as<bool>();
+      pool_options.idle_timeout = fc::milliseconds( options.at( "http-client-idle-timeout-ms" ).as<uint32_t>() );
+      pool->set_options( pool_options );
+      pool_enabled = pool_options.max_idle > 0;
    } FC_LOG_AND_RETHROW()
 }
 
@@ -62,4 +77,15 @@ void http_client_plugin::plugin_shutdown() {
 
 }
 
+fc::variant http_client_plugin::post_sync( const fc::url& dest, const fc::variant& payload, const fc::time_point& deadline ) {
+   if( pool_enabled && http_client_pool::can_post( dest ) )
+      return pool->post_sync( dest, payload, deadline );
+   return my->post_sync( dest, payload, deadline );
+}
+
+void http_client_plugin::warm( const fc::url& dest ) {
+   if( pool_enabled )
+      pool->warm( dest );
+}
+
 }
@@ -0,0 +1,330 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/http_client_plugin/http_client_pool.hpp>
+#include <eosio/chain/exceptions.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/log/logger.hpp>
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+
+namespace eosio {
+
+namespace beast = boost::beast;
+namespace http = boost::beast::http;
+namespace ssl = boost::asio::ssl;
+using tcp = boost::asio::ip::tcp;
+
+namespace {
+
+   /// a connection is used by one thread at a time, its operations run on that thread through its own io_context
+   struct pooled_connection {
+      explicit pooled_connection( ssl::context* ctx ) {
+         if( ctx ) tls.reset( new beast::ssl_stream<beast::tcp_stream>( ioc, *ctx ) );
+         else plain.reset( new beast::tcp_stream( ioc ) );
+      }
+
+      beast::tcp_stream& stream() { return tls ? beast::get_lowest_layer( *tls ) : *plain; }
+
+      void expires_at( const fc::time_point& deadline ) {
+         if( deadline == fc::time_point::maximum() ) {
+            stream().expires_never();
+         } else {
+            const auto left = deadline - fc::time_point::now();
+            EOS_ASSERT( left.count() > 0, chain::http_request_fail, "deadline exceeded" );
+            stream().expires_after( std::chrono::microseconds( left.count() ) );
+         }
+      }
+
+      /// runs the operations started on the connection until they complete
+      void run() {
+         ioc.restart();
+         ioc.run();
+      }
+
+      void open( const std::string& host, uint16_t port, const fc::time_point& deadline, bool verify_peers ) {
+         boost::system::error_code ec;
+         tcp::resolver::results_type endpoints;
+         tcp::resolver resolver( ioc );
+         resolver.async_resolve( host, std::to_string( port ), [&]( const boost::system::error_code& e, tcp::resolver::results_type r ) {
+            ec = e;
+            endpoints = std::move( r );
+         } );
+         ioc.restart();
+         if( deadline == fc::time_point::maximum() ) {
+            ioc.run();
+         } else {
+            ioc.run_for( std::chrono::microseconds( std::max<int64_t>( ( deadline - fc::time_point::now() ).count(), 0 ) ) );
+            if( !ioc.stopped() ) {
+               resolver.cancel();
+               ioc.run();
+            }
+         }
+         EOS_ASSERT( !ec, chain::fail_to_resolve_host, "Unable to resolve ${h}: ${e}", ("h", host)("e", ec.message()) );
+
+         expires_at( deadline );
+         stream().async_connect( endpoints, [&]( const boost::system::error_code& e, const tcp::endpoint& ) { ec = e; } );
+         run();
+         EOS_ASSERT( !ec, chain::http_request_fail, "Unable to connect to ${h}:${p}: ${e}", ("h", host)("p", port)("e", ec.message()) );
+
+         if( tls ) {
+            EOS_ASSERT( SSL_set_tlsext_host_name( tls->native_handle(), host.c_str() ), chain::http_request_fail,
+                        "Unable to set the TLS host name of ${h}", ("h", host) );
+            if( verify_peers ) tls->set_verify_callback( ssl::rfc2818_verification( host ) );
+            tls->async_handshake( ssl::stream_base::client, [&]( const boost::system::error_code& e ) { ec = e; } );
+            run();
+            EOS_ASSERT( !ec, chain::http_request_fail, "TLS handshake with ${h}:${p} failed: ${e}", ("h", host)("p", port)("e", ec.message()) );
+         }
+      }
+
+      /// returns an error when no response was read
+      boost::system::error_code request( const http::request<http::string_body>& req, http::response<http::string_body>& res,
+                                         const fc::time_point& deadline ) {
+         boost::system::error_code ec;
+         expires_at( deadline );
+         auto on_write = [&]( const boost::system::error_code& e, std::size_t ) { ec = e; };
+         if( tls ) http::async_write( *tls, req, on_write );
+         else      http::async_write( *plain, req, on_write );
+         run();
+         if( ec ) return ec;
+
+         beast::flat_buffer buffer;
+         auto on_read = [&]( const boost::system::error_code& e, std::size_t ) { ec = e; };
+         if( tls ) http::async_read( *tls, buffer, res, on_read );
+         else      http::async_read( *plain, buffer, res, on_read );
+         run();
+         // a response is read as a whole, the connection is ready for the next request once it is
+         return ec;
+      }
+
+      boost::asio::io_context                                  ioc;
+      std::unique_ptr<beast::tcp_stream>                       plain;
+      std::unique_ptr<beast::ssl_stream<beast::tcp_stream>>    tls;
+   };
+
+   struct idle_connection {
+      std::unique_ptr<pooled_connection> conn;
+      fc::time_point                     since;
+   };
+
+   uint64_t elapsed_us( const fc::time_point& start ) {
+      return std::max<int64_t>( ( fc::time_point::now() - start ).count(), 0 );
+   }
+
+} // namespace
+
+struct http_client_pool_impl {
+   struct host_key {
+      bool        tls;
+      std::string host;
+      uint16_t    port;
+
+      std::string str()const { return ( tls ? "https://" : "http://" ) + host + ":" + std::to_string( port ); }
+   };
+
+   http_client_pool_impl()
+   : ssl_ctx( ssl::context::sslv23_client ) {
+      ssl_ctx.set_default_verify_paths();
+      ssl_ctx.set_verify_mode( ssl::verify_peer );
+   }
+
+   ~http_client_pool_impl() {
+      standby_pool.stop();
+      standby_pool.join();
+   }
+
+   static host_key key_of( const fc::url& dest ) {
+      EOS_ASSERT( dest.host(), chain::invalid_http_request, "URL ${u} has no host", ("u", std::string( dest )) );
+      const bool tls = dest.proto() == "https";
+      return { tls, *dest.host(), dest.port() ? *dest.port() : uint16_t( tls ? 443 : 80 ) };
+   }
+
+   std::unique_ptr<pooled_connection> open( const host_key& key, const fc::time_point& deadline ) {
+      const auto start = fc::time_point::now();
+      std::unique_ptr<pooled_connection> conn( new pooled_connection( key.tls ? &ssl_ctx : nullptr ) );
+      conn->open( key.host, key.port, deadline, verify_peers );
+      stats.connections_opened.fetch_add( 1, std::memory_order_relaxed );
+      stats.connect_us.fetch_add( elapsed_us( start ), std::memory_order_relaxed );
+      return conn;
+   }
+
+   /// an idle connection to `key`, if there is one which has not been idle too long
+   std::unique_ptr<pooled_connection> take_idle( const host_key& key ) {
+      std::unique_ptr<pooled_connection> conn;
+      bool last = false;
+      {
+         std::lock_guard<std::mutex> g( mtx );
+         auto& idle = idle_by_host[key.str()];
+         const auto oldest = fc::time_point::now() - opts.idle_timeout;
+         while( !idle.empty() && idle.front().since < oldest ) {
+            idle.pop_front();
+            stats.idle.fetch_sub( 1, std::memory_order_relaxed );
+         }
+         if( !idle.empty() ) {
+            conn = std::move( idle.back().conn );
+            idle.pop_back();
+            stats.idle.fetch_sub( 1, std::memory_order_relaxed );
+            last = idle.empty();
+         }
+      }
+      if( last ) open_standby( key );
+      return conn;
+   }
+
+   void give_back( const host_key& key, std::unique_ptr<pooled_connection> conn ) {
+      std::lock_guard<std::mutex> g( mtx );
+      auto& idle = idle_by_host[key.str()];
+      if( idle.size() >= opts.max_idle ) return;
+      idle.push_back( { std::move( conn ), fc::time_point::now() } );
+      stats.idle.fetch_add( 1, std::memory_order_relaxed );
+   }
+
+   /// opens a connection to `key` in the background, unless one is already being opened
+   void open_standby( const host_key& key ) {
+      if( !opts.standby || opts.max_idle == 0 ) return;
+      {
+         std::lock_guard<std::mutex> g( mtx );
+         if( !standby_pending.insert( key.str() ).second ) return;
+      }
+      boost::asio::post( standby_pool, [this, key]() {
+         try {
+            auto conn = open( key, fc::time_point::now() + opts.connect_timeout );
+            stats.standby_opened.fetch_add( 1, std::memory_order_relaxed );
+            give_back( key, std::move( conn ) );
+         } catch( const fc::exception& e ) {
+            dlog( "Standby connection to ${h} failed: ${e}", ("h", key.str())("e", e.to_string()) );
+         } catch( const std::exception& e ) {
+            dlog( "Standby connection to ${h} failed: ${e}", ("h", key.str())("e", e.what()) );
+         }
+         std::lock_guard<std::mutex> g( mtx );
+         standby_pending.erase( key.str() );
+      } );
+   }
+
+   fc::variant post_sync( const fc::url& dest, const fc::variant& payload, const fc::time_point& deadline ) {
+      const auto key = key_of( dest );
+      stats.requests.fetch_add( 1, std::memory_order_relaxed );
+
+      std::string target = dest.path() ? dest.path()->generic_string() : std::string();
+      if( target.empty() || target[0] != '/' ) target.insert( 0, "/" );
+      if( dest.query() ) target += "?" + *dest.query();
+
+      http::request<http::string_body> req{ http::verb::post, target, 11 };
+      req.set( http::field::host, key.port == ( key.tls ? 443 : 80 ) ? key.host : key.host + ":" + std::to_string( key.port ) );
+      req.set( http::field::content_type, "application/json" );
+      req.keep_alive( true );
+      req.body() = fc::json::to_string( payload );
+      req.prepare_payload();
+
+      http::response<http::string_body> res;
+      try {
+         auto conn = take_idle( key );
+         const bool reused = bool( conn );
+         if( !conn ) conn = open( key, deadline );
+
+         auto start = fc::time_point::now();
+         auto ec = conn->request( req, res, deadline );
+         if( ec && reused && ec != beast::error::timeout ) {
+            // the server may have closed the connection while it was idle, the request did not reach it
+            stats.retries.fetch_add( 1, std::memory_order_relaxed );
+            res = {};
+            conn = open( key, deadline );
+            start = fc::time_point::now();
+            ec = conn->request( req, res, deadline );
+         } else if( !ec && reused ) {
+            stats.connections_reused.fetch_add( 1, std::memory_order_relaxed );
+         }
+         stats.request_us.fetch_add( elapsed_us( start ), std::memory_order_relaxed );
+         EOS_ASSERT( !ec, chain::http_request_fail, "Request to ${u} failed: ${e}", ("u", std::string( dest ))("e", ec.message()) );
+
+         if( !res.need_eof() )
+            give_back( key, std::move( conn ) );
+      } catch( ... ) {
+         stats.failures.fetch_add( 1, std::memory_order_relaxed );
+         throw;
+      }
+
+      if( res.result() == http::status::internal_server_error ) {
+         fc::exception_ptr excp;
+         try {
+            auto err_var = fc::json::from_string( res.body() );
+            excp = std::make_shared<fc::exception>( err_var.as<fc::exception>() );
+         } catch( ... ) {
+         }
+         if( excp ) throw *excp;
+         EOS_THROW( chain::invalid_http_response, "Request failed with 500 response, but response was not parseable" );
+      } else if( res.result() == http::status::not_found ) {
+         EOS_THROW( chain::invalid_http_response, "URL not found: ${url}", ("url", std::string( dest )) );
+      }
+      return fc::json::from_string( res.body() );
+   }
+
+   http_client_pool::options              opts;
+   http_client_pool::stats_type           stats;
+   ssl::context                           ssl_ctx;
+   bool                                   verify_peers = true;
+
+   std::mutex                                         mtx;
+   std::map<std::string, std::deque<idle_connection>> idle_by_host;
+   std::set<std::string>                              standby_pending;
+
+   boost::asio::thread_pool               standby_pool{1};
+};
+
+http_client_pool::http_client_pool()
+: my( new http_client_pool_impl() ) {
+}
+
+http_client_pool::~http_client_pool() {
+}
+
+void http_client_pool::set_options( const options& o ) {
+   my->opts = o;
+}
+
+void http_client_pool::add_cert( const std::string& cert_pem_string ) {
+   boost::system::error_code ec;
+   my->ssl_ctx.add_certificate_authority( boost::asio::buffer( cert_pem_string.data(), cert_pem_string.size() ), ec );
+   EOS_ASSERT( !ec, chain::invalid_http_client_root_cert, "Failed to add root certificate: ${e}", ("e", ec.message()) );
+}
+
+void http_client_pool::set_verify_peers( bool enabled ) {
+   my->verify_peers = enabled;
+   my->ssl_ctx.set_verify_mode( enabled ? ssl::verify_peer : ssl::verify_none );
+}
+
+bool http_client_pool::can_post( const fc::url& dest ) {
+   return dest.proto() == "http" || dest.proto() == "https";
+}
+
+fc::variant http_client_pool::post_sync( const fc::url& dest, const fc::variant& payload, const fc::time_point& deadline ) {
+   return my->post_sync( dest, payload, deadline );
+}
+
+void http_client_pool::warm( const fc::url& dest ) {
+   if( !can_post( dest ) ) return;
+   const auto key = http_client_pool_impl::key_of( dest );
+   {
+      std::lock_guard<std::mutex> g( my->mtx );
+      if( !my->idle_by_host[key.str()].empty() ) return;
+   }
+   my->open_standby( key );
+}
+
+const http_client_pool::stats_type& http_client_pool::stats()const {
+   return my->stats;
+}
+
+}
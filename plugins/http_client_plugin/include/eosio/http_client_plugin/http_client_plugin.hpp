@@ -4,6 +4,7 @@
  */
 #pragma once
 #include <appbase/application.hpp>
+#include <eosio/http_client_plugin/http_client_pool.hpp>
 #include <fc/network/http/http_client.hpp>
 
 namespace eosio {
@@ -27,8 +28,19 @@ namespace eosio {
            return *my;
         }
 
+        /// POSTs through a pooled keep-alive connection, or through get_client() for the urls the pool does not cover
+        fc::variant post_sync( const fc::url& dest, const fc::variant& payload, const fc::time_point& deadline = fc::time_point::maximum() );
+        /// opens a connection to `dest` ahead of its first request
+        void warm( const fc::url& dest );
+
+        const http_client_pool::stats_type& pool_stats()const {
+           return pool->stats();
+        }
+
       private:
         std::unique_ptr<http_client> my;
+        std::unique_ptr<http_client_pool> pool;
+        bool pool_enabled = true;
    };
 
 }
@@ -0,0 +1,71 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+#include <fc/network/url.hpp>
+#include <fc/time.hpp>
+#include <fc/variant.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace eosio {
+
+   /**
+    * Keep-alive HTTP and HTTPS connections, for the POSTs of remote signature providers.
+    *
+    * A connection, and its TLS session, is reused by the next request to the same host and port once a response is
+    * read from it, so only the first request to a host pays for the TCP and TLS handshakes. With a warm standby, a
+    * connection is opened in the background whenever the last idle connection to a host is taken, and by warm(),
+    * so that a request arriving while the others are in flight does not pay them either. A request failing on a
+    * reused connection, which the server may have closed while it was idle, is sent again on a new one.
+    *
+    * Requests are not pipelined on a connection: concurrent requests to a host use connections of their own.
+    */
+   class http_client_pool {
+      public:
+         struct options {
+            uint32_t         max_idle = 4;                       ///< idle connections kept per host
+            bool             standby = true;                     ///< keep one idle connection ready per host
+            fc::microseconds idle_timeout = fc::seconds( 30 );   ///< idle connections are closed after this
+            fc::microseconds connect_timeout = fc::seconds( 5 ); ///< of standby connections
+         };
+
+         struct stats_type {
+            std::atomic<uint64_t> requests{0};
+            std::atomic<uint64_t> failures{0};           ///< requests without a response
+            std::atomic<uint64_t> retries{0};            ///< requests sent again after their reused connection failed
+            std::atomic<uint64_t> connections_opened{0};
+            std::atomic<uint64_t> connections_reused{0};
+            std::atomic<uint64_t> standby_opened{0};     ///< connections opened ahead of a request
+            std::atomic<uint64_t> connect_us{0};         ///< time spent opening connections, TLS handshakes included
+            std::atomic<uint64_t> request_us{0};         ///< time from sending requests to reading their responses
+            std::atomic<uint32_t> idle{0};               ///< connections waiting for a request
+         };
+
+         http_client_pool();
+         ~http_client_pool();
+
+         void set_options( const options& o );
+         /// trusted root certificate of TLS connections, PEM encoded
+         void add_cert( const std::string& cert_pem_string );
+         void set_verify_peers( bool enabled );
+
+         /// http and https urls are pooled
+         static bool can_post( const fc::url& dest );
+
+         /// POSTs `payload` as JSON to `dest` and returns the JSON response, throws if it is not a success before `deadline`
+         fc::variant post_sync( const fc::url& dest, const fc::variant& payload, const fc::time_point& deadline = fc::time_point::maximum() );
+
+         /// opens a standby connection to the host of `dest` in the background, if there is none
+         void warm( const fc::url& dest );
+
+         const stats_type& stats()const;
+
+      private:
+         std::unique_ptr<struct http_client_pool_impl> my;
+   };
+
+}
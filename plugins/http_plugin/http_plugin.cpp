@@ -5,6 +5,7 @@
 #include <eosio/http_plugin/http_plugin.hpp>
 #include <eosio/http_plugin/local_endpoint.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/executor_stats.hpp>
 #include <eosio/chain/thread_utils.hpp>
 
 #include <fc/network/ip.hpp>
@@ -16,6 +17,9 @@
 
 #include <boost/asio.hpp>
 #include <boost/optional.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
 
 #include <websocketpp/config/asio_client.hpp>
 #include <websocketpp/config/asio.hpp>
@@ -26,6 +30,7 @@
 
 #include <thread>
 #include <memory>
+#include <mutex>
 #include <regex>
 
 namespace eosio {
@@ -33,6 +38,7 @@ namespace eosio {
    static appbase::abstract_plugin& _http_plugin = app().register_plugin<http_plugin>();
 
    namespace asio = boost::asio;
+   namespace bio = boost::iostreams;
 
    using std::map;
    using std::vector;
@@ -133,15 +139,87 @@ namespace eosio {
 
    static bool verbose_http_errors = false;
 
+   static std::string gzip_compress( const std::string& in ) {
+      std::string out;
+      bio::filtering_ostream comp;
+      comp.push(bio::gzip_compressor(bio::gzip::default_compression));
+      comp.push(bio::back_inserter(out));
+      bio::write(comp, in.data(), in.size());
+      bio::close(comp);
+      return out;
+   }
+
+   /// true if the Accept-Encoding header of a request lists gzip, or *, without a zero quality
+   static bool accepts_gzip( const std::string& accept_encoding ) {
+      size_t begin = 0;
+      while( begin < accept_encoding.size() ) {
+         size_t end = accept_encoding.find( ',', begin );
+         if( end == std::string::npos ) end = accept_encoding.size();
+         const auto coding = accept_encoding.substr( begin, end - begin );
+         begin = end + 1;
+
+         const auto params = coding.find( ';' );
+         auto name = coding.substr( 0, params );
+         name.erase( 0, name.find_first_not_of( " \t" ) );
+         name.erase( name.find_last_not_of( " \t" ) + 1 );
+         if( name != "gzip" && name != "*" ) continue;
+         if( params == std::string::npos ) return true;
+         static const auto zero_quality = regex( R"(q\s*=\s*0(\.0*)?\s*$)" );
+         return !std::regex_search( coding.substr( params + 1 ), zero_quality );
+      }
+      return false;
+   }
+
+   /**
+    * Compressed bodies of keyed_response_body responses, sent again without compressing them.
+    * Bounded by the size of the bodies, the cache starts over when it is full. Thread safe, used on http threads.
+    */
+   class compressed_response_cache {
+      public:
+         void set_max_bytes( size_t max ) { max_bytes = max; }
+
+         std::shared_ptr<const std::string> get( const std::string& key ) {
+            std::lock_guard<std::mutex> g( mtx );
+            auto itr = entries.find( key );
+            return itr == entries.end() ? nullptr : itr->second;
+         }
+
+         void put( const std::string& key, std::shared_ptr<const std::string> body ) {
+            if( body->size() > max_bytes ) return;
+            std::lock_guard<std::mutex> g( mtx );
+            if( bytes + body->size() > max_bytes ) {
+               entries.clear();
+               bytes = 0;
+            }
+            auto res = entries.emplace( key, body );
+            if( res.second ) bytes += body->size();
+         }
+
+      private:
+         std::mutex                                               mtx;
+         std::map<std::string, std::shared_ptr<const std::string>> entries;
+         size_t                                                   bytes = 0;
+         size_t                                                   max_bytes = 0;
+   };
+
    class http_plugin_impl {
       public:
-         map<string,url_handler>  url_handlers;
+         struct url_handler_entry {
+            url_handler     handler;
+            handler_thread  thread = handler_thread::app;
+            bool            binary = false; ///< blob responses are binary_response_body
+         };
+
+         map<string,url_handler_entry>  url_handlers;
+         http_plugin::latency_observer  latency_observer; ///< set before startup, called on http threads
          optional<tcp::endpoint>  listen_endpoint;
          string                   access_control_allow_origin;
          string                   access_control_allow_headers;
          string                   access_control_max_age;
          bool                     access_control_allow_credentials = false;
          size_t                   max_body_size{1024*1024};
+         size_t                   gzip_min_size = 0; ///< smallest compressed response body, 0 disables compression
+         compressed_response_cache compressed_responses;
 
          websocket_server_type    server;
 
@@ -284,8 +362,40 @@ namespace eosio {
             return true;
          }
 
+         /// the body of a JSON response, compressed when the client accepts it and the body is large enough
+         template<typename Con>
+         std::string encode_body( const Con& con, bool gzip, const optional<string>& key, std::string json ) {
+            if( gzip_min_size == 0 ) return json;
+            con->append_header( "Vary", "Accept-Encoding" );
+            if( !gzip || json.size() < gzip_min_size ) return json;
+
+            // the header is set once the body is compressed, an error compressing it is sent uncompressed
+            std::string compressed;
+            if( key ) {
+               auto body = compressed_responses.get( *key );
+               if( !body ) {
+                  body = std::make_shared<const std::string>( gzip_compress( json ) );
+                  compressed_responses.put( *key, body );
+               }
+               compressed = *body;
+            } else {
+               compressed = gzip_compress( json );
+            }
+            con->append_header( "Content-Encoding", "gzip" );
+            return compressed;
+         }
+
+         void report_latency( const string& url, const fc::time_point& start ) const {
+            if( latency_observer ) {
+               try {
+                  latency_observer( url, fc::time_point::now() - start );
+               } FC_LOG_AND_DROP()
+            }
+         }
+
          template<class T>
          void handle_http_request(typename websocketpp::server<T>::connection_ptr con) {
+            const auto start = fc::time_point::now();
             try {
                auto& req = con->get_request();
 
@@ -316,13 +426,13 @@ namespace eosio {
 
                std::string body = con->get_request_body();
                std::string resource = con->get_uri()->get_resource();
+               const bool gzip = gzip_min_size > 0 && accepts_gzip( req.get_header( "Accept-Encoding" ) );
                auto handler_itr = url_handlers.find( resource );
                if( handler_itr != url_handlers.end()) {
                   con->defer_http_response();
                   bytes_in_flight += body.size();
-                  app().post( appbase::priority::low,
-                              [&ioc = thread_pool->get_executor(), &bytes_in_flight = this->bytes_in_flight,
-                               handler_itr, this, resource{std::move( resource )}, body{std::move( body )}, con]() mutable {
+                  auto run = [&ioc = thread_pool->get_executor(), &bytes_in_flight = this->bytes_in_flight,
+                              handler_itr, this, resource{std::move( resource )}, body{std::move( body )}, con, start, gzip]() mutable {
                      const size_t body_size = body.size();
                      if( !verify_max_bytes_in_flight( con ) ) {
                         con->send_http_response();
@@ -330,8 +440,8 @@ namespace eosio {
                         return;
                      }
                      try {
-                        handler_itr->second( std::move( resource ), std::move( body ),
-                                 [&ioc, &bytes_in_flight, con, this]( int code, fc::variant response_body ) {
+                        handler_itr->second.handler( std::move( resource ), std::move( body ),
+                                 [&ioc, &bytes_in_flight, con, this, handler_itr, start, gzip]( int code, fc::variant response_body ) {
                            size_t response_size = 0;
                            try {
                               response_size = fc::raw::pack_size( response_body );
@@ -343,10 +453,26 @@ namespace eosio {
                            } else {
                               boost::asio::post( ioc,
                                  [response_body{std::move( response_body )}, response_size, &bytes_in_flight,
-                                  con, code, max_response_time=max_response_time]() mutable {
+                                  con, code, max_response_time=max_response_time, this, handler_itr, start, gzip]() mutable {
                                  std::string json;
                                  try {
-                                    json = fc::json::to_string( response_body, fc::time_point::now() + max_response_time );
+                                    optional<string> key;
+                                    if( response_body.get_type() == fc::variant::array_type && response_body.size() == 2
+                                        && response_body[0].is_string() && response_body[1].get_type() == fc::variant::blob_type ) {
+                                       // keyed_response_body
+                                       key = response_body[0].get_string();
+                                       const auto& data = response_body[1].get_blob().data;
+                                       json.assign( data.begin(), data.end() );
+                                    } else if( response_body.get_type() == fc::variant::blob_type ) {
+                                       const auto& data = response_body.get_blob().data;
+                                       json.assign( data.begin(), data.end() );
+                                       if( handler_itr->second.binary )
+                                          con->replace_header( "Content-type", "application/octet-stream" );
+                                    } else {
+                                       json = fc::json::to_string( response_body, fc::time_point::now() + max_response_time );
+                                    }
+                                    if( !handler_itr->second.binary )
+                                       json = encode_body( con, gzip, key, std::move( json ) );
                                     con->set_body( std::move( json ) );
                                     con->set_status( websocketpp::http::status_code::value( code ) );
                                  } catch( ... ) {
@@ -357,6 +483,7 @@ namespace eosio {
                                  bytes_in_flight += json_size;
                                  con->send_http_response();
                                  bytes_in_flight -= (json_size + response_size);
+                                 report_latency( handler_itr->first, start );
                               } );
                            }
                         });
@@ -366,7 +493,12 @@ namespace eosio {
                         con->send_http_response();
                      }
                      bytes_in_flight -= body_size;
-                  } );
+                  };
+                  if( handler_itr->second.thread == handler_thread::http ) {
+                     run();
+                  } else {
+                     chain::instrumented_post( app(), appbase::priority::low, chain::executor_category::http, std::move( run ) );
+                  }
 
                } else {
                   dlog( "404 - not found: ${ep}", ("ep", resource));
@@ -485,6 +617,12 @@ namespace eosio {
              "Additionaly acceptable values for the \"Host\" header of incoming HTTP requests, can be specified multiple times.  Includes http/s_server_address by default.")
             ("http-threads", bpo::value<uint16_t>()->default_value( my->thread_pool_size ),
              "Number of worker threads in http thread pool")
+            ("http-gzip-min-size", bpo::value<uint32_t>()->default_value(0),
+             "Smallest JSON response body in bytes compressed with gzip for the clients whose Accept-Encoding allows it, "
+             "on the http threads; 0 disables compression.")
+            ("http-compressed-cache-mb", bpo::value<uint32_t>()->default_value(64),
+             "Maximum size in megabytes of the compressed bodies of versioned responses, e.g. cached ABIs, sent again "
+             "without compressing them.")
             ;
    }
 
@@ -565,6 +703,8 @@ namespace eosio {
 
          my->max_bytes_in_flight = options.at( "http-max-bytes-in-flight-mb" ).as<uint32_t>() * 1024 * 1024;
          my->max_response_time = fc::microseconds( options.at("http-max-response-time-ms").as<uint32_t>() * 1000 );
+         my->gzip_min_size = options.at( "http-gzip-min-size" ).as<uint32_t>();
+         my->compressed_responses.set_max_bytes( size_t( options.at( "http-compressed-cache-mb" ).as<uint32_t>() ) * 1024 * 1024 );
 
          //watch out for the returns above when adding new code here
       } FC_LOG_AND_RETHROW()
@@ -666,9 +806,18 @@ namespace eosio {
       app().post( 0, [me = my](){} ); // keep my pointer alive until queue is drained
    }
 
-   void http_plugin::add_handler(const string& url, const url_handler& handler) {
+   void http_plugin::add_handler(const string& url, const url_handler& handler, handler_thread thread) {
       ilog( "add api url: ${c}", ("c",url) );
-      my->url_handlers.insert(std::make_pair(url,handler));
+      my->url_handlers.insert(std::make_pair(url, http_plugin_impl::url_handler_entry{handler, thread, false}));
+   }
+
+   void http_plugin::add_binary_handler(const string& url, const url_handler& handler, handler_thread thread) {
+      ilog( "add binary api url: ${c}", ("c",url) );
+      my->url_handlers.insert(std::make_pair(url, http_plugin_impl::url_handler_entry{handler, thread, true}));
+   }
+
+   void http_plugin::set_latency_observer(latency_observer observer) {
+      my->latency_observer = std::move(observer);
    }
 
    void http_plugin::handle_exception( const char *api_name, const char *call_name, const string& body, url_response_callback cb ) {
@@ -5,6 +5,7 @@
 #pragma once
 #include <appbase/application.hpp>
 #include <fc/exception/exception.hpp>
+#include <fc/time.hpp>
 
 #include <fc/reflect/reflect.hpp>
 
@@ -19,6 +20,38 @@ namespace eosio {
     */
    using url_response_callback = std::function<void(int,fc::variant)>;
 
+   /**
+    * @brief Response body already serialized to JSON
+    *
+    * For handlers that write JSON while producing the result instead of building
+    * an fc::variant first; the body is sent as is. Carried as a blob, which is not
+    * a top level type of any API result.
+    */
+   inline fc::variant json_response_body( const std::string& json ) {
+      return fc::variant( fc::blob{ std::vector<char>( json.begin(), json.end() ) } );
+   }
+
+   /**
+    * @brief JSON response body identified by `key`: every response with this key has the same body
+    *
+    * When the response is compressed, http_plugin keeps the compressed body under `key` and sends it again without
+    * compressing, so the key must change with the body, e.g. include a version of the state it is computed from.
+    * Carried as an array of the key and a blob, which is not the type of any API result.
+    */
+   inline fc::variant keyed_response_body( const std::string& key, const std::string& json ) {
+      return fc::variant( fc::variants{ fc::variant( key ), json_response_body( json ) } );
+   }
+
+   /**
+    * @brief Response body of a handler added with add_binary_api
+    *
+    * The fc::raw packed result, sent as is with Content-type application/octet-stream.
+    * Errors are still sent as JSON error_results.
+    */
+   inline fc::variant binary_response_body( std::vector<char> data ) {
+      return fc::variant( fc::blob{ std::move( data ) } );
+   }
+
    /**
     * @brief Callback type for a URL handler
     *
@@ -40,6 +73,16 @@ namespace eosio {
     */
    using api_description = std::map<string, url_handler>;
 
+   /**
+    * @brief Thread a URL handler is called on
+    *
+    * Handlers run on the appbase application thread unless they are added to run on
+    * the http thread that read the request, which saves a trip through the application
+    * queue. Only handlers that touch no state owned by the application thread may, e.g.
+    * handlers that parse the request and post the call to a thread safe queue.
+    */
+   enum class handler_thread { app, http };
+
    struct http_plugin_defaults {
       //If empty, unix socket support will be completely disabled. If not empty,
       // unix socket support is enabled with the given default path (treated relative
@@ -57,7 +100,8 @@ namespace eosio {
     *  called with the response code and body.
     *
     *  The handler will be called from the appbase application io_service
-    *  thread.  The callback can be called from any thread and will
+    *  thread, or from an http thread if it was added with handler_thread::http.
+    *  The callback can be called from any thread and will
     *  automatically propagate the call to the http thread.
     *
     *  The HTTP service will run in its own thread with its own io_service to
@@ -80,12 +124,24 @@ namespace eosio {
         void plugin_startup();
         void plugin_shutdown();
 
-        void add_handler(const string& url, const url_handler&);
-        void add_api(const api_description& api) {
+        void add_handler(const string& url, const url_handler&, handler_thread thread = handler_thread::app);
+        void add_api(const api_description& api, handler_thread thread = handler_thread::app) {
            for (const auto& call : api)
-              add_handler(call.first, call.second);
+              add_handler(call.first, call.second, thread);
         }
 
+        /// handlers of a binary API receive fc::raw packed request bodies and respond with binary_response_body
+        void add_binary_handler(const string& url, const url_handler&, handler_thread thread = handler_thread::app);
+        void add_binary_api(const api_description& api, handler_thread thread = handler_thread::app) {
+           for (const auto& call : api)
+              add_binary_handler(call.first, call.second, thread);
+        }
+
+        /// called on an http thread with the URL and the time from receiving a request to sending its response
+        using latency_observer = std::function<void(const string& url, const fc::microseconds& latency)>;
+        /// must be called before startup
+        void set_latency_observer(latency_observer observer);
+
         // standard exception handling for api handlers
         static void handle_exception( const char *api_name, const char *call_name, const string& body, url_response_callback cb );
 
@@ -3,6 +3,7 @@
  *  @copyright defined in eos/LICENSE
  */
 #include <eosio/mongo_db_plugin/mongo_db_plugin.hpp>
+#include <eosio/chain_plugin/history_checkpoint.hpp>
 #include <eosio/chain/eosio_contract.hpp>
 #include <eosio/chain/config.hpp>
 #include <eosio/chain/exceptions.hpp>
@@ -13,19 +14,25 @@
 #include <fc/log/logger_config.hpp>
 #include <fc/utf8.hpp>
 #include <fc/variant.hpp>
+#include <fc/variant_object.hpp>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/chrono.hpp>
 #include <boost/signals2/connection.hpp>
 
+#include <condition_variable>
+#include <functional>
+#include <limits>
 #include <queue>
 #include <thread>
 #include <mutex>
 
 #include <bsoncxx/builder/basic/kvp.hpp>
 #include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/core.hpp>
 #include <bsoncxx/exception/exception.hpp>
 #include <bsoncxx/json.hpp>
+#include <bsoncxx/types.hpp>
 
 #include <mongocxx/client.hpp>
 #include <mongocxx/instance.hpp>
@@ -76,7 +83,43 @@ public:
    fc::optional<boost::signals2::scoped_connection> accepted_transaction_connection;
    fc::optional<boost::signals2::scoped_connection> applied_transaction_connection;
 
-   void consume_blocks();
+   /// consumer thread writing a partition of the collections, its tasks are run in queue order
+   struct consumer {
+      std::string                          name;
+      std::deque<std::function<void()>>    queue;
+      std::mutex                           mtx;
+      std::condition_variable              condition; ///< signaled when a task is queued or on shutdown
+      std::condition_variable              space;     ///< signaled when the queued tasks are taken
+      std::thread                          thread;
+      bool                                 stopped = false; ///< thread exited, queued tasks are dropped
+      mongocxx::collection                 accounts;  ///< abi lookups of this thread
+      std::atomic<uint32_t>                irreversible{0};  ///< last irreversible block written by this thread
+      std::function<void()>                drained;   ///< run by the thread after each batch of queued tasks
+   };
+
+   /// action and transaction traces of the traces thread written together while bulk loading
+   struct traces_batch {
+      traces_batch( mongocxx::bulk_write&& trans_traces, mongocxx::bulk_write&& action_traces )
+         : trans_traces( std::move( trans_traces ) ), action_traces( std::move( action_traces ) ) {}
+
+      mongocxx::bulk_write trans_traces;
+      mongocxx::bulk_write action_traces;
+      uint32_t             trans_traces_count = 0;
+      uint32_t             action_traces_count = 0;
+      uint32_t             irreversible = 0; ///< committed to the checkpoint once the batch is written
+   };
+
+   void start_consumer( consumer& c, const std::string& name, std::function<void(mongocxx::database&)> open );
+   void consume( consumer& c );
+   void queue( consumer& c, std::function<void()> task );
+   void traces_processed_to( uint64_t count );
+   void wait_for_traces( uint64_t count );
+   void irreversible_processed( consumer& c, uint32_t block_num );
+   void read_missed_blocks( const chain::controller& chain );
+   void flush_traces_batch();
+   bool bulk_load_done( const chain::block_state_ptr& bs ) const;
+   void end_bulk_load();
+   std::vector<std::pair<std::string, std::string>> query_indexes() const;
 
    void accepted_block( const chain::block_state_ptr& );
    void applied_irreversible_block(const chain::block_state_ptr&);
@@ -87,12 +130,14 @@ public:
    void process_applied_transaction(const chain::transaction_trace_ptr&);
    void _process_applied_transaction(const chain::transaction_trace_ptr&);
    void process_accepted_block( const chain::block_state_ptr& );
-   void _process_accepted_block( const chain::block_state_ptr& );
-   void process_irreversible_block(const chain::block_state_ptr&);
-   void _process_irreversible_block(const chain::block_state_ptr&);
+   void _process_accepted_block( const chain::block_state_ptr&, bool with_block_state = true );
+   void process_irreversible_block(const chain::block_state_ptr&, bool with_block_state = true);
+   void _process_irreversible_block(const chain::block_state_ptr&, bool with_block_state = true);
+   void process_irreversible_transactions(const chain::block_state_ptr&);
+   void _process_irreversible_transactions(const chain::block_state_ptr&);
 
-   optional<abi_serializer> get_abi_serializer( account_name n );
-   template<typename T> fc::variant to_variant_with_abi( const T& obj );
+   optional<abi_serializer> get_abi_serializer( account_name n, mongocxx::collection& accounts );
+   template<typename T> fc::variant to_variant_with_abi( const T& obj, mongocxx::collection& accounts );
 
    void purge_abi_cache();
 
@@ -120,12 +165,12 @@ public:
    void wipe_database();
    void create_expiration_index(mongocxx::collection& collection, uint32_t expire_after_seconds);
 
-   template<typename Queue, typename Entry> void queue(Queue& queue, const Entry& e);
-
    bool configured{false};
    bool wipe_database_on_startup{false};
    uint32_t start_block_num = 0;
    std::atomic_bool start_block_reached{false};
+   fc::optional<history_checkpoint> checkpoint; ///< last irreversible block written by all consumers
+   uint32_t last_signaled_irreversible = 0;     ///< main thread
 
    bool is_producer = false;
    bool filter_on_star = true;
@@ -137,36 +182,47 @@ public:
    bool store_transactions = true;
    bool store_transaction_traces = true;
    bool store_action_traces = true;
+   bool store_raw_action_data = false;
    uint32_t expire_after_seconds = 0;
 
+   // bulk load: until the node is near head block time or at bulk_load_until, the indexes only read by
+   // queries are not built and the traces are written in large unordered bulk writes
+   bool bulk_load = false;
+   uint32_t bulk_load_until = 0;
+   uint32_t bulk_batch_size = 0;
+   std::atomic_bool bulk_loading{false};
+   fc::optional<traces_batch> pending_traces; ///< traces thread
+   std::thread index_builder;
+   static constexpr int64_t bulk_load_head_lag_sec = 60;
+
    std::string db_name;
    mongocxx::instance mongo_inst;
    fc::optional<mongocxx::pool> mongo_pool;
 
-   // consum thread
+   // traces consumer thread
    mongocxx::collection _accounts;
-   mongocxx::collection _trans;
    mongocxx::collection _trans_traces;
    mongocxx::collection _action_traces;
-   mongocxx::collection _block_states;
-   mongocxx::collection _blocks;
    mongocxx::collection _pub_keys;
    mongocxx::collection _account_controls;
+   // transactions consumer thread
+   mongocxx::collection _trans;
+   // blocks consumer thread
+   mongocxx::collection _block_states;
+   mongocxx::collection _blocks;
 
    size_t max_queue_size = 0;
-   int queue_sleep_time = 0;
    size_t abi_cache_size = 0;
-   std::deque<chain::transaction_metadata_ptr> transaction_metadata_queue;
-   std::deque<chain::transaction_metadata_ptr> transaction_metadata_process_queue;
-   std::deque<chain::transaction_trace_ptr> transaction_trace_queue;
-   std::deque<chain::transaction_trace_ptr> transaction_trace_process_queue;
-   std::deque<chain::block_state_ptr> block_state_queue;
-   std::deque<chain::block_state_ptr> block_state_process_queue;
-   std::deque<chain::block_state_ptr> irreversible_block_state_queue;
-   std::deque<chain::block_state_ptr> irreversible_block_state_process_queue;
-   std::mutex mtx;
-   std::condition_variable condition;
-   std::thread consume_thread;
+   consumer traces;       ///< action_traces, transaction_traces and the accounts, pub_keys, account_controls they update
+   consumer transactions; ///< transactions
+   consumer blocks;       ///< blocks, block_states
+
+   // transactions and blocks are decoded with the abis set by the traces queued before them
+   uint64_t traces_queued = 0; ///< main thread
+   uint64_t traces_processed = 0;
+   std::mutex traces_mtx;
+   std::condition_variable traces_progress;
+
    std::atomic_bool done{false};
    std::atomic_bool startup{true};
    fc::optional<chain::chain_id_type> chain_id;
@@ -189,6 +245,8 @@ public:
    > abi_cache_index_t;
 
    abi_cache_index_t abi_cache_index;
+   uint64_t abi_cache_erased = 0; ///< erase count, a lookup started before an erase is not cached
+   std::mutex abi_cache_mtx;
 
    static const action_name newaccount;
    static const action_name setabi;
@@ -290,31 +348,83 @@ bool mongo_db_plugin_impl::filter_include( const transaction& trx ) const
 }
 
 
-template<typename Queue, typename Entry>
-void mongo_db_plugin_impl::queue( Queue& queue, const Entry& e ) {
-   std::unique_lock<std::mutex> lock( mtx );
-   auto queue_size = queue.size();
-   if( queue_size > max_queue_size ) {
-      lock.unlock();
-      condition.notify_one();
-      queue_sleep_time += 10;
-      if( queue_sleep_time > 1000 )
-         wlog("queue size: ${q}", ("q", queue_size));
-      std::this_thread::sleep_for( std::chrono::milliseconds( queue_sleep_time ));
-      lock.lock();
-   } else {
-      queue_sleep_time -= 10;
-      if( queue_sleep_time < 0 ) queue_sleep_time = 0;
+void mongo_db_plugin_impl::queue( consumer& c, std::function<void()> task ) {
+   std::unique_lock<std::mutex> lock( c.mtx );
+   auto queue_size = c.queue.size();
+   if( queue_size >= max_queue_size ) {
+      // wait for the consumer to take the queued tasks, bounding the queue without polling
+      auto start = fc::time_point::now();
+      c.space.wait( lock, [&]() { return c.queue.size() < max_queue_size || c.queue.empty() || c.stopped; } );
+      auto waited = fc::time_point::now() - start;
+      if( waited > fc::milliseconds( 1000 ) )
+         wlog( "${n} queue size: ${q}, waited: ${t}", ("n", c.name)("q", queue_size)("t", waited) );
    }
-   queue.emplace_back( e );
+   if( c.stopped ) return;
+   c.queue.emplace_back( std::move( task ) );
    lock.unlock();
-   condition.notify_one();
+   c.condition.notify_one();
+}
+
+void mongo_db_plugin_impl::traces_processed_to( uint64_t count ) {
+   {
+      std::lock_guard<std::mutex> g( traces_mtx );
+      traces_processed = count;
+   }
+   traces_progress.notify_all();
+}
+
+void mongo_db_plugin_impl::wait_for_traces( uint64_t count ) {
+   std::unique_lock<std::mutex> lock( traces_mtx );
+   traces_progress.wait( lock, [&]() { return traces_processed >= count; } );
+}
+
+void mongo_db_plugin_impl::irreversible_processed( consumer& c, uint32_t block_num ) {
+   if( !checkpoint ) return;
+   c.irreversible = block_num;
+   uint32_t committed = traces.irreversible;
+   if( store_blocks || store_block_states )
+      committed = std::min<uint32_t>( committed, blocks.irreversible );
+   if( store_transactions )
+      committed = std::min<uint32_t>( committed, transactions.irreversible );
+   checkpoint->commit( committed );
+}
+
+void mongo_db_plugin_impl::read_missed_blocks( const chain::controller& chain ) {
+   if( !checkpoint || !checkpoint->last_committed() ) return;
+   if( !store_blocks ) {
+      if( checkpoint->last_committed() < chain.last_irreversible_block_num() )
+         wlog( "mongo db is missing irreversible blocks ${f} to ${l}, applied while mongo_db_plugin was not running",
+               ("f", checkpoint->last_committed() + 1)("l", chain.last_irreversible_block_num()) );
+      return;
+   }
+   // the blocks signaled by a replay are already queued, the following ones were applied by a previous run
+   const auto last = checkpoint->read_missed_blocks( chain, last_signaled_irreversible, [&]( const chain::signed_block_ptr& block ) {
+      auto bs = std::make_shared<chain::block_state>();
+      bs->header    = *block;
+      bs->block     = block;
+      bs->id        = block->id();
+      bs->block_num = block->block_num();
+      bs->validated = true;
+      start_block_reached = true; // after the checkpoint
+      // there is no header state of a block read from the block log
+      queue( blocks, [this, bs]() {
+         process_irreversible_block( bs, false );
+      } );
+   } );
+   if( last ) {
+      wlog( "mongo db blocks ${f} to ${l} read from the block log, their block_states, transactions and traces are missing",
+            ("f", std::max( checkpoint->last_committed(), last_signaled_irreversible ) + 1)("l", last) );
+   }
 }
 
 void mongo_db_plugin_impl::accepted_transaction( const chain::transaction_metadata_ptr& t ) {
    try {
       if( store_transactions ) {
-         queue( transaction_metadata_queue, t );
+         const auto traces_before = traces_queued;
+         queue( transactions, [this, t, traces_before]() {
+            wait_for_traces( traces_before );
+            process_accepted_transaction( t );
+         } );
       }
    } catch (fc::exception& e) {
       elog("FC Exception while accepted_transaction ${e}", ("e", e.to_string()));
@@ -350,7 +460,11 @@ void mongo_db_plugin_impl::applied_transaction( const chain::transaction_trace_p
       if( !is_producer && !t->producer_block_id.valid() )
          return;
       // always queue since account information always gathered
-      queue( transaction_trace_queue, t );
+      const auto count = ++traces_queued;
+      queue( traces, [this, t, count]() {
+         process_applied_transaction( t );
+         traces_processed_to( count );
+      } );
    } catch (fc::exception& e) {
       elog("FC Exception while applied_transaction ${e}", ("e", e.to_string()));
    } catch (std::exception& e) {
@@ -362,8 +476,30 @@ void mongo_db_plugin_impl::applied_transaction( const chain::transaction_trace_p
 
 void mongo_db_plugin_impl::applied_irreversible_block( const chain::block_state_ptr& bs ) {
    try {
-      if( store_blocks || store_block_states || store_transactions ) {
-         queue( irreversible_block_state_queue, bs );
+      last_signaled_irreversible = bs->block_num;
+      const auto traces_before = traces_queued;
+      if( checkpoint ) {
+         // after the traces of the block
+         queue( traces, [this, block_num = bs->block_num]() {
+            if( !start_block_reached ) return;
+            if( pending_traces ) {
+               pending_traces->irreversible = block_num;
+            } else {
+               irreversible_processed( traces, block_num );
+            }
+         } );
+      }
+      if( store_blocks || store_block_states ) {
+         queue( blocks, [this, bs, traces_before]() {
+            wait_for_traces( traces_before );
+            process_irreversible_block( bs );
+         } );
+      }
+      if( store_transactions ) {
+         // after the accepted transactions of the block, in the same queue
+         queue( transactions, [this, bs]() {
+            process_irreversible_transactions( bs );
+         } );
       }
    } catch (fc::exception& e) {
       elog("FC Exception while applied_irreversible_block ${e}", ("e", e.to_string()));
@@ -381,8 +517,15 @@ void mongo_db_plugin_impl::accepted_block( const chain::block_state_ptr& bs ) {
             start_block_reached = true;
          }
       }
+      if( bulk_loading && bulk_load_done( bs ) ) {
+         end_bulk_load();
+      }
       if( store_blocks || store_block_states ) {
-         queue( block_state_queue, bs );
+         const auto traces_before = traces_queued;
+         queue( blocks, [this, bs, traces_before]() {
+            wait_for_traces( traces_before );
+            process_accepted_block( bs );
+         } );
       }
    } catch (fc::exception& e) {
       elog("FC Exception while accepted_block ${e}", ("e", e.to_string()));
@@ -393,125 +536,73 @@ void mongo_db_plugin_impl::accepted_block( const chain::block_state_ptr& bs ) {
    }
 }
 
-void mongo_db_plugin_impl::consume_blocks() {
-   try {
-      auto mongo_client = mongo_pool->acquire();
-      auto& mongo_conn = *mongo_client;
-
-      _accounts = mongo_conn[db_name][accounts_col];
-      _trans = mongo_conn[db_name][trans_col];
-      _trans_traces = mongo_conn[db_name][trans_traces_col];
-      _action_traces = mongo_conn[db_name][action_traces_col];
-      _blocks = mongo_conn[db_name][blocks_col];
-      _block_states = mongo_conn[db_name][block_states_col];
-      _pub_keys = mongo_conn[db_name][pub_keys_col];
-      _account_controls = mongo_conn[db_name][account_controls_col];
-
-      while (true) {
-         std::unique_lock<std::mutex> lock(mtx);
-         while ( transaction_metadata_queue.empty() &&
-                 transaction_trace_queue.empty() &&
-                 block_state_queue.empty() &&
-                 irreversible_block_state_queue.empty() &&
-                 !done ) {
-            condition.wait(lock);
-         }
+void mongo_db_plugin_impl::start_consumer( consumer& c, const std::string& name,
+                                           std::function<void(mongocxx::database&)> open ) {
+   c.name = name;
+   c.thread = std::thread( [this, &c, open{std::move( open )}] {
+      fc::set_os_thread_name( "mongodb-" + c.name );
+      try {
+         // each consumer has its own connection, a mongocxx client is not thread safe
+         auto mongo_client = mongo_pool->acquire();
+         auto db = (*mongo_client)[db_name];
+         c.accounts = db[accounts_col];
+         open( db );
+         consume( c );
+      } catch (fc::exception& e) {
+         elog("FC Exception while consuming ${n} ${e}", ("n", c.name)("e", e.to_string()));
+      } catch (std::exception& e) {
+         elog("STD Exception while consuming ${n} ${e}", ("n", c.name)("e", e.what()));
+      } catch (...) {
+         elog("Unknown exception while consuming ${n}", ("n", c.name));
+      }
+      {
+         std::lock_guard<std::mutex> g( c.mtx );
+         c.stopped = true;
+         c.queue.clear();
+      }
+      c.space.notify_all();
+      if( &c == &traces ) {
+         // release the consumers waiting for traces that will not be processed
+         traces_processed_to( std::numeric_limits<uint64_t>::max() );
+      }
+   } );
+}
 
-         // capture for processing
-         size_t transaction_metadata_size = transaction_metadata_queue.size();
-         if (transaction_metadata_size > 0) {
-            transaction_metadata_process_queue = move(transaction_metadata_queue);
-            transaction_metadata_queue.clear();
-         }
-         size_t transaction_trace_size = transaction_trace_queue.size();
-         if (transaction_trace_size > 0) {
-            transaction_trace_process_queue = move(transaction_trace_queue);
-            transaction_trace_queue.clear();
-         }
-         size_t block_state_size = block_state_queue.size();
-         if (block_state_size > 0) {
-            block_state_process_queue = move(block_state_queue);
-            block_state_queue.clear();
-         }
-         size_t irreversible_block_size = irreversible_block_state_queue.size();
-         if (irreversible_block_size > 0) {
-            irreversible_block_state_process_queue = move(irreversible_block_state_queue);
-            irreversible_block_state_queue.clear();
-         }
+void mongo_db_plugin_impl::consume( consumer& c ) {
+   std::deque<std::function<void()>> process_queue;
+   while (true) {
+      std::unique_lock<std::mutex> lock( c.mtx );
+      while ( c.queue.empty() && !done ) {
+         c.condition.wait( lock );
+      }
+
+      // capture for processing
+      process_queue = move( c.queue );
+      c.queue.clear();
+      lock.unlock();
+      c.space.notify_all();
 
-         lock.unlock();
+      const auto size = process_queue.size();
+      if (done) {
+         ilog("draining ${n} queue, size: ${q}", ("n", c.name)("q", size));
+      }
 
-         if (done) {
-            ilog("draining queue, size: ${q}", ("q", transaction_metadata_size + transaction_trace_size + block_state_size + irreversible_block_size));
-         }
+      auto start_time = fc::time_point::now();
+      while (!process_queue.empty()) {
+         process_queue.front()();
+         process_queue.pop_front();
+      }
+      if( c.drained ) c.drained();
+      auto time = fc::time_point::now() - start_time;
+      auto per = size > 0 ? time.count()/size : 0;
+      if( time > fc::microseconds(500000) ) // reduce logging, .5 secs
+         ilog( "process ${n}, time per: ${p}, size: ${s}, time: ${t}", ("n", c.name)("s", size)("t", time)("p", per) );
 
-         // process transactions
-         auto start_time = fc::time_point::now();
-         auto size = transaction_trace_process_queue.size();
-         while (!transaction_trace_process_queue.empty()) {
-            const auto& t = transaction_trace_process_queue.front();
-            process_applied_transaction(t);
-            transaction_trace_process_queue.pop_front();
-         }
-         auto time = fc::time_point::now() - start_time;
-         auto per = size > 0 ? time.count()/size : 0;
-         if( time > fc::microseconds(500000) ) // reduce logging, .5 secs
-            ilog( "process_applied_transaction,  time per: ${p}, size: ${s}, time: ${t}", ("s", size)("t", time)("p", per) );
-
-         start_time = fc::time_point::now();
-         size = transaction_metadata_process_queue.size();
-         while (!transaction_metadata_process_queue.empty()) {
-            const auto& t = transaction_metadata_process_queue.front();
-            process_accepted_transaction(t);
-            transaction_metadata_process_queue.pop_front();
-         }
-         time = fc::time_point::now() - start_time;
-         per = size > 0 ? time.count()/size : 0;
-         if( time > fc::microseconds(500000) ) // reduce logging, .5 secs
-            ilog( "process_accepted_transaction, time per: ${p}, size: ${s}, time: ${t}", ("s", size)( "t", time )( "p", per ));
-
-         // process blocks
-         start_time = fc::time_point::now();
-         size = block_state_process_queue.size();
-         while (!block_state_process_queue.empty()) {
-            const auto& bs = block_state_process_queue.front();
-            process_accepted_block( bs );
-            block_state_process_queue.pop_front();
-         }
-         time = fc::time_point::now() - start_time;
-         per = size > 0 ? time.count()/size : 0;
-         if( time > fc::microseconds(500000) ) // reduce logging, .5 secs
-            ilog( "process_accepted_block,       time per: ${p}, size: ${s}, time: ${t}", ("s", size)("t", time)("p", per) );
-
-         // process irreversible blocks
-         start_time = fc::time_point::now();
-         size = irreversible_block_state_process_queue.size();
-         while (!irreversible_block_state_process_queue.empty()) {
-            const auto& bs = irreversible_block_state_process_queue.front();
-            process_irreversible_block(bs);
-            irreversible_block_state_process_queue.pop_front();
-         }
-         time = fc::time_point::now() - start_time;
-         per = size > 0 ? time.count()/size : 0;
-         if( time > fc::microseconds(500000) ) // reduce logging, .5 secs
-            ilog( "process_irreversible_block,   time per: ${p}, size: ${s}, time: ${t}", ("s", size)("t", time)("p", per) );
-
-         if( transaction_metadata_size == 0 &&
-             transaction_trace_size == 0 &&
-             block_state_size == 0 &&
-             irreversible_block_size == 0 &&
-             done ) {
-            break;
-         }
+      if( size == 0 && done ) {
+         break;
       }
-      ilog("mongo_db_plugin consume thread shutdown gracefully");
-   } catch (fc::exception& e) {
-      elog("FC Exception while consuming block ${e}", ("e", e.to_string()));
-   } catch (std::exception& e) {
-      elog("STD Exception while consuming block ${e}", ("e", e.what()));
-   } catch (...) {
-      elog("Unknown exception while consuming block");
    }
+   ilog("mongo_db_plugin ${n} consume thread shutdown gracefully", ("n", c.name));
 }
 
 namespace {
@@ -581,6 +672,96 @@ bsoncxx::oid make_custom_oid() {
    return x;
 }
 
+void append_variant( bsoncxx::builder::core& doc, const fc::variant& v, bool& purged );
+
+void append_string( bsoncxx::builder::core& doc, const std::string& str, bool& purged ) {
+   if( fc::is_utf8( str ) ) {
+      doc.append( bsoncxx::types::b_utf8{str} );
+   } else {
+      purged = true;
+      doc.append( fc::prune_invalid_utf8( str ) );
+   }
+}
+
+void append_key( bsoncxx::builder::core& doc, const std::string& key, bool& purged ) {
+   if( fc::is_utf8( key ) ) {
+      doc.key_view( key );
+   } else {
+      purged = true;
+      doc.key_owned( fc::prune_invalid_utf8( key ) );
+   }
+}
+
+// appends v as bsoncxx::from_json( fc::json::to_string( v ) ) would, without the text in between:
+// large integers and doubles are strings, other integers int32 when they fit
+void append_variant( bsoncxx::builder::core& doc, const fc::variant& v, bool& purged ) {
+   using namespace bsoncxx::types;
+   switch( v.get_type() ) {
+      case fc::variant::null_type:
+         doc.append( b_null{} );
+         break;
+      case fc::variant::int64_type: {
+         const int64_t i = v.as_int64();
+         if( i > 0xffffffff || i < -int64_t(0xffffffff) ) {
+            doc.append( v.as_string() );
+         } else if( i >= std::numeric_limits<int32_t>::min() && i <= std::numeric_limits<int32_t>::max() ) {
+            doc.append( b_int32{static_cast<int32_t>(i)} );
+         } else {
+            doc.append( b_int64{i} );
+         }
+         break;
+      }
+      case fc::variant::uint64_type: {
+         const uint64_t u = v.as_uint64();
+         if( u > 0xffffffff ) {
+            doc.append( v.as_string() );
+         } else if( u <= uint64_t(std::numeric_limits<int32_t>::max()) ) {
+            doc.append( b_int32{static_cast<int32_t>(u)} );
+         } else {
+            doc.append( b_int64{static_cast<int64_t>(u)} );
+         }
+         break;
+      }
+      case fc::variant::double_type:
+         doc.append( v.as_string() );
+         break;
+      case fc::variant::bool_type:
+         doc.append( b_bool{v.as_bool()} );
+         break;
+      case fc::variant::string_type:
+         append_string( doc, v.get_string(), purged );
+         break;
+      case fc::variant::blob_type:
+         doc.append( v.as_string() );
+         break;
+      case fc::variant::array_type:
+         doc.open_array();
+         for( const auto& e : v.get_array() ) {
+            append_variant( doc, e, purged );
+         }
+         doc.close_array();
+         break;
+      case fc::variant::object_type:
+         doc.open_document();
+         for( const auto& e : v.get_object() ) {
+            append_key( doc, e.key(), purged );
+            append_variant( doc, e.value(), purged );
+         }
+         doc.close_document();
+         break;
+   }
+}
+
+/// BSON document of an object variant, `purged` is set when invalid utf8 was removed from its strings
+bsoncxx::document::value to_bson( const fc::variant_object& obj, bool& purged ) {
+   bsoncxx::builder::core doc{false};
+   for( const auto& e : obj ) {
+      append_key( doc, e.key(), purged );
+      append_variant( doc, e.value(), purged );
+   }
+   return doc.extract_document();
+}
+
 } // anonymous namespace
 
 void mongo_db_plugin_impl::purge_abi_cache() {
@@ -594,22 +775,26 @@ void mongo_db_plugin_impl::purge_abi_cache() {
    }
 }
 
-optional<abi_serializer> mongo_db_plugin_impl::get_abi_serializer( account_name n ) {
+optional<abi_serializer> mongo_db_plugin_impl::get_abi_serializer( account_name n, mongocxx::collection& accounts ) {
    using bsoncxx::builder::basic::kvp;
    using bsoncxx::builder::basic::make_document;
    if( n.good()) {
       try {
-
-         auto itr = abi_cache_index.find( n );
-         if( itr != abi_cache_index.end() ) {
-            abi_cache_index.modify( itr, []( auto& entry ) {
-               entry.last_accessed = fc::time_point::now();
-            });
-
-            return itr->serializer;
+         uint64_t erased = 0;
+         {
+            std::lock_guard<std::mutex> g( abi_cache_mtx );
+            auto itr = abi_cache_index.find( n );
+            if( itr != abi_cache_index.end() ) {
+               abi_cache_index.modify( itr, []( auto& entry ) {
+                  entry.last_accessed = fc::time_point::now();
+               });
+
+               return itr->serializer;
+            }
+            erased = abi_cache_erased;
          }
 
-         auto account = _accounts.find_one( make_document( kvp("name", n.to_string())) );
+         auto account = accounts.find_one( make_document( kvp("name", n.to_string())) );
          if(account) {
             auto view = account->view();
             abi_def abi;
@@ -621,7 +806,6 @@ optional<abi_serializer> mongo_db_plugin_impl::get_abi_serializer( account_name
                   return optional<abi_serializer>();
                }
 
-               purge_abi_cache(); // make room if necessary
                abi_cache entry;
                entry.account = n;
                entry.last_accessed = fc::time_point::now();
@@ -668,7 +852,12 @@ optional<abi_serializer> mongo_db_plugin_impl::get_abi_serializer( account_name
                }
                abis.set_abi( abi, abi_serializer_max_time );
                entry.serializer.emplace( std::move( abis ) );
-               abi_cache_index.insert( entry );
+               std::lock_guard<std::mutex> g( abi_cache_mtx );
+               // an abi set by the traces consumer since the lookup may have been read before its update
+               if( erased == abi_cache_erased ) {
+                  purge_abi_cache(); // make room if necessary
+                  abi_cache_index.insert( entry );
+               }
                return entry.serializer;
             }
          }
@@ -678,10 +867,10 @@ optional<abi_serializer> mongo_db_plugin_impl::get_abi_serializer( account_name
 }
 
 template<typename T>
-fc::variant mongo_db_plugin_impl::to_variant_with_abi( const T& obj ) {
+fc::variant mongo_db_plugin_impl::to_variant_with_abi( const T& obj, mongocxx::collection& accounts ) {
    fc::variant pretty_output;
    abi_serializer::to_variant( obj, pretty_output,
-                               [&]( account_name n ) { return get_abi_serializer( n ); },
+                               [&]( account_name n ) { return get_abi_serializer( n, accounts ); },
                                abi_serializer_max_time );
    return pretty_output;
 }
@@ -713,10 +902,11 @@ void mongo_db_plugin_impl::process_applied_transaction( const chain::transaction
    }
 }
 
-void mongo_db_plugin_impl::process_irreversible_block(const chain::block_state_ptr& bs) {
+void mongo_db_plugin_impl::process_irreversible_block(const chain::block_state_ptr& bs, bool with_block_state) {
   try {
      if( start_block_reached ) {
-        _process_irreversible_block( bs );
+        _process_irreversible_block( bs, with_block_state );
+        irreversible_processed( blocks, bs->block_num );
      }
   } catch (fc::exception& e) {
      elog("FC Exception while processing irreversible block: ${e}", ("e", e.to_detail_string()));
@@ -727,6 +917,21 @@ void mongo_db_plugin_impl::process_irreversible_block(const chain::block_state_p
   }
 }
 
+void mongo_db_plugin_impl::process_irreversible_transactions(const chain::block_state_ptr& bs) {
+   try {
+      if( start_block_reached ) {
+         _process_irreversible_transactions( bs );
+         irreversible_processed( transactions, bs->block_num );
+      }
+   } catch (fc::exception& e) {
+      elog("FC Exception while processing irreversible transactions: ${e}", ("e", e.to_detail_string()));
+   } catch (std::exception& e) {
+      elog("STD Exception while processing irreversible transactions: ${e}", ("e", e.what()));
+   } catch (...) {
+      elog("Unknown exception while processing irreversible transactions");
+   }
+}
+
 void mongo_db_plugin_impl::process_accepted_block( const chain::block_state_ptr& bs ) {
    try {
       if( start_block_reached ) {
@@ -762,22 +967,16 @@ void mongo_db_plugin_impl::_process_accepted_transaction( const chain::transacti
 
    trans_doc.append( kvp( "trx_id", trx_id_str ) );
 
-   auto v = to_variant_with_abi( trx );
-   string trx_json = fc::json::to_string( v, fc::time_point::maximum() );
+   auto v = to_variant_with_abi( trx, transactions.accounts );
 
    try {
-      const auto& trx_value = bsoncxx::from_json( trx_json );
+      bool purged = false;
+      const auto& trx_value = to_bson( v.get_object(), purged );
       trans_doc.append( bsoncxx::builder::concatenate_doc{trx_value.view()} );
-   } catch( bsoncxx::exception& ) {
-      try {
-         trx_json = fc::prune_invalid_utf8( trx_json );
-         const auto& trx_value = bsoncxx::from_json( trx_json );
-         trans_doc.append( bsoncxx::builder::concatenate_doc{trx_value.view()} );
-         trans_doc.append( kvp( "non-utf8-purged", b_bool{true} ) );
-      } catch( bsoncxx::exception& e ) {
-         elog( "Unable to convert transaction JSON to MongoDB JSON: ${e}", ("e", e.what()) );
-         elog( "  JSON: ${j}", ("j", trx_json) );
-      }
+      if( purged ) trans_doc.append( kvp( "non-utf8-purged", b_bool{true} ) );
+   } catch( bsoncxx::exception& e ) {
+      elog( "Unable to convert transaction to MongoDB BSON: ${e}", ("e", e.what()) );
+      elog( "  JSON: ${j}", ("j", fc::json::to_string( v, fc::time_point::maximum() )) );
    }
 
    string signing_keys_json;
@@ -843,21 +1042,34 @@ mongo_db_plugin_impl::add_action_trace( mongocxx::bulk_write& bulk_action_traces
       // improve data distributivity when using mongodb sharding
       action_traces_doc.append( kvp( "_id", make_custom_oid() ) );
 
-      auto v = to_variant_with_abi( atrace );
-      string json = fc::json::to_string( v, fc::time_point::maximum() );
+      fc::variant v;
       try {
-         const auto& value = bsoncxx::from_json( json );
-         action_traces_doc.append( bsoncxx::builder::concatenate_doc{value.view()} );
-      } catch( bsoncxx::exception& ) {
-         try {
-            json = fc::prune_invalid_utf8( json );
-            const auto& value = bsoncxx::from_json( json );
+         bool purged = false;
+         if( store_raw_action_data ) {
+            // not decoded, readers decode act.data with the abi of act.account
+            v = fc::variant( atrace );
+            fc::mutable_variant_object trace( v.get_object() );
+            fc::mutable_variant_object act( trace["act"].get_object() );
+            act.erase( "data" );
+            trace.erase( "act" );
+            const auto& value = to_bson( trace, purged );
+            const auto& act_value = to_bson( act, purged );
+            action_traces_doc.append( bsoncxx::builder::concatenate_doc{value.view()} );
+            action_traces_doc.append( kvp( "act", [&]( bsoncxx::builder::basic::sub_document act_doc ) {
+               act_doc.append( bsoncxx::builder::concatenate_doc{act_value.view()} );
+               act_doc.append( kvp( "data", b_binary{bsoncxx::binary_sub_type::k_binary,
+                                                     static_cast<uint32_t>(atrace.act.data.size()),
+                                                     reinterpret_cast<const uint8_t*>(atrace.act.data.data())} ) );
+            } ) );
+         } else {
+            v = to_variant_with_abi( atrace, _accounts );
+            const auto& value = to_bson( v.get_object(), purged );
             action_traces_doc.append( bsoncxx::builder::concatenate_doc{value.view()} );
-            action_traces_doc.append( kvp( "non-utf8-purged", b_bool{true} ) );
-         } catch( bsoncxx::exception& e ) {
-            elog( "Unable to convert action trace JSON to MongoDB JSON: ${e}", ("e", e.what()) );
-            elog( "  JSON: ${j}", ("j", json) );
          }
+         if( purged ) action_traces_doc.append( kvp( "non-utf8-purged", b_bool{true} ) );
+      } catch( bsoncxx::exception& e ) {
+         elog( "Unable to convert action trace to MongoDB BSON: ${e}", ("e", e.what()) );
+         elog( "  JSON: ${j}", ("j", fc::json::to_string( v, fc::time_point::maximum() )) );
       }
       if( t->receipt.valid() ) {
          action_traces_doc.append( kvp( "trx_status", std::string( t->receipt->status ) ) );
@@ -885,13 +1097,21 @@ void mongo_db_plugin_impl::_process_applied_transaction( const chain::transactio
    mongocxx::options::bulk_write bulk_opts;
    bulk_opts.ordered(false);
    mongocxx::bulk_write bulk_action_traces = _action_traces.create_bulk_write(bulk_opts);
+   if( bulk_loading && !pending_traces ) {
+      pending_traces.emplace( _trans_traces.create_bulk_write( bulk_opts ), _action_traces.create_bulk_write( bulk_opts ) );
+   }
+   // the batch is kept once the bulk load is over, until the flush queued by end_bulk_load
+   auto& atraces_bulk = pending_traces ? pending_traces->action_traces : bulk_action_traces;
    bool write_atraces = false;
    bool write_ttrace = false; // filters apply to transaction_traces as well
    bool executed = t->receipt.valid() && t->receipt->status == chain::transaction_receipt_header::executed;
 
    for( const auto& atrace : t->action_traces ) {
       try {
-         write_atraces |= add_action_trace( bulk_action_traces, atrace, t, executed, now, write_ttrace );
+         if( add_action_trace( atraces_bulk, atrace, t, executed, now, write_ttrace ) ) {
+            write_atraces = true;
+            if( pending_traces ) ++pending_traces->action_traces_count;
+         }
       } catch(...) {
          handle_mongo_exception("add action traces", __LINE__);
       }
@@ -903,36 +1123,42 @@ void mongo_db_plugin_impl::_process_applied_transaction( const chain::transactio
 
    if( store_transaction_traces && write_ttrace ) {
       try {
-         auto v = to_variant_with_abi( *t );
-         string json = fc::json::to_string( v, fc::time_point::maximum() );
+         auto v = to_variant_with_abi( *t, _accounts );
          try {
-            const auto& value = bsoncxx::from_json( json );
+            bool purged = false;
+            const auto& value = to_bson( v.get_object(), purged );
             trans_traces_doc.append( bsoncxx::builder::concatenate_doc{value.view()} );
-         } catch( bsoncxx::exception& ) {
-            try {
-               json = fc::prune_invalid_utf8( json );
-               const auto& value = bsoncxx::from_json( json );
-               trans_traces_doc.append( bsoncxx::builder::concatenate_doc{value.view()} );
-               trans_traces_doc.append( kvp( "non-utf8-purged", b_bool{true} ) );
-            } catch( bsoncxx::exception& e ) {
-               elog( "Unable to convert transaction JSON to MongoDB JSON: ${e}", ("e", e.what()) );
-               elog( "  JSON: ${j}", ("j", json) );
-            }
+            if( purged ) trans_traces_doc.append( kvp( "non-utf8-purged", b_bool{true} ) );
+         } catch( bsoncxx::exception& e ) {
+            elog( "Unable to convert transaction trace to MongoDB BSON: ${e}", ("e", e.what()) );
+            elog( "  JSON: ${j}", ("j", fc::json::to_string( v, fc::time_point::maximum() )) );
          }
          trans_traces_doc.append( kvp( "createdAt", b_date{now} ) );
 
-         try {
-            if( !_trans_traces.insert_one( trans_traces_doc.view() ) ) {
-               EOS_ASSERT( false, chain::mongo_db_insert_fail, "Failed to insert trans ${id}", ("id", t->id) );
+         if( pending_traces ) {
+            pending_traces->trans_traces.append( mongocxx::model::insert_one{ trans_traces_doc.view() } );
+            ++pending_traces->trans_traces_count;
+         } else {
+            try {
+               if( !_trans_traces.insert_one( trans_traces_doc.view() ) ) {
+                  EOS_ASSERT( false, chain::mongo_db_insert_fail, "Failed to insert trans ${id}", ("id", t->id) );
+               }
+            } catch( ... ) {
+               handle_mongo_exception( "trans_traces insert: " + t->id.str(), __LINE__ );
             }
-         } catch( ... ) {
-            handle_mongo_exception( "trans_traces insert: " + json, __LINE__ );
          }
       } catch( ... ) {
          handle_mongo_exception( "trans_traces serialization: " + t->id.str(), __LINE__ );
       }
    }
 
+   if( pending_traces ) {
+      if( pending_traces->trans_traces_count + pending_traces->action_traces_count >= bulk_batch_size ) {
+         flush_traces_batch();
+      }
+      return;
+   }
+
    // insert action_traces
    if( write_atraces ) {
       try {
@@ -947,7 +1173,7 @@ void mongo_db_plugin_impl::_process_applied_transaction( const chain::transactio
 
 }
 
-void mongo_db_plugin_impl::_process_accepted_block( const chain::block_state_ptr& bs ) {
+void mongo_db_plugin_impl::_process_accepted_block( const chain::block_state_ptr& bs, bool with_block_state ) {
    using namespace bsoncxx::types;
    using namespace bsoncxx::builder;
    using bsoncxx::builder::basic::kvp;
@@ -965,7 +1191,7 @@ void mongo_db_plugin_impl::_process_accepted_block( const chain::block_state_ptr
    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
          std::chrono::microseconds{fc::time_point::now().time_since_epoch().count()});
 
-   if( store_block_states ) {
+   if( store_block_states && with_block_state ) {
       auto block_state_doc = bsoncxx::builder::basic::document{};
       block_state_doc.append( kvp( "block_num", b_int32{static_cast<int32_t>(block_num)} ),
                               kvp( "block_id", block_id_str ),
@@ -973,20 +1199,15 @@ void mongo_db_plugin_impl::_process_accepted_block( const chain::block_state_ptr
 
       const chain::block_header_state& bhs = *bs;
 
-      auto json = fc::json::to_string( bhs, fc::time_point::maximum() );
+      const fc::variant v( bhs );
       try {
-         const auto& value = bsoncxx::from_json( json );
+         bool purged = false;
+         const auto& value = to_bson( v.get_object(), purged );
          block_state_doc.append( kvp( "block_header_state", value ) );
-      } catch( bsoncxx::exception& ) {
-         try {
-            json = fc::prune_invalid_utf8( json );
-            const auto& value = bsoncxx::from_json( json );
-            block_state_doc.append( kvp( "block_header_state", value ) );
-            block_state_doc.append( kvp( "non-utf8-purged", b_bool{true} ) );
-         } catch( bsoncxx::exception& e ) {
-            elog( "Unable to convert block_header_state JSON to MongoDB JSON: ${e}", ("e", e.what()) );
-            elog( "  JSON: ${j}", ("j", json) );
-         }
+         if( purged ) block_state_doc.append( kvp( "non-utf8-purged", b_bool{true} ) );
+      } catch( bsoncxx::exception& e ) {
+         elog( "Unable to convert block_header_state to MongoDB BSON: ${e}", ("e", e.what()) );
+         elog( "  JSON: ${j}", ("j", fc::json::to_string( v, fc::time_point::maximum() )) );
       }
       block_state_doc.append( kvp( "createdAt", b_date{now} ) );
 
@@ -1003,7 +1224,7 @@ void mongo_db_plugin_impl::_process_accepted_block( const chain::block_state_ptr
             }
          }
       } catch( ... ) {
-         handle_mongo_exception( "block_states insert: " + json, __LINE__ );
+         handle_mongo_exception( "block_states insert: " + block_id_str, __LINE__ );
       }
    }
 
@@ -1012,21 +1233,15 @@ void mongo_db_plugin_impl::_process_accepted_block( const chain::block_state_ptr
       block_doc.append( kvp( "block_num", b_int32{static_cast<int32_t>(block_num)} ),
                         kvp( "block_id", block_id_str ) );
 
-      auto v = to_variant_with_abi( *bs->block );
-      auto json = fc::json::to_string( v, fc::time_point::maximum() );
+      auto v = to_variant_with_abi( *bs->block, blocks.accounts );
       try {
-         const auto& value = bsoncxx::from_json( json );
+         bool purged = false;
+         const auto& value = to_bson( v.get_object(), purged );
          block_doc.append( kvp( "block", value ) );
-      } catch( bsoncxx::exception& ) {
-         try {
-            json = fc::prune_invalid_utf8( json );
-            const auto& value = bsoncxx::from_json( json );
-            block_doc.append( kvp( "block", value ) );
-            block_doc.append( kvp( "non-utf8-purged", b_bool{true} ) );
-         } catch( bsoncxx::exception& e ) {
-            elog( "Unable to convert block JSON to MongoDB JSON: ${e}", ("e", e.what()) );
-            elog( "  JSON: ${j}", ("j", json) );
-         }
+         if( purged ) block_doc.append( kvp( "non-utf8-purged", b_bool{true} ) );
+      } catch( bsoncxx::exception& e ) {
+         elog( "Unable to convert block to MongoDB BSON: ${e}", ("e", e.what()) );
+         elog( "  JSON: ${j}", ("j", fc::json::to_string( v, fc::time_point::maximum() )) );
       }
       block_doc.append( kvp( "createdAt", b_date{now} ) );
 
@@ -1043,12 +1258,12 @@ void mongo_db_plugin_impl::_process_accepted_block( const chain::block_state_ptr
             }
          }
       } catch( ... ) {
-         handle_mongo_exception( "blocks insert: " + json, __LINE__ );
+         handle_mongo_exception( "blocks insert: " + block_id_str, __LINE__ );
       }
    }
 }
 
-void mongo_db_plugin_impl::_process_irreversible_block(const chain::block_state_ptr& bs)
+void mongo_db_plugin_impl::_process_irreversible_block(const chain::block_state_ptr& bs, bool with_block_state)
 {
    using namespace bsoncxx::types;
    using namespace bsoncxx::builder;
@@ -1065,7 +1280,7 @@ void mongo_db_plugin_impl::_process_irreversible_block(const chain::block_state_
    if( store_blocks ) {
       auto ir_block = find_block( _blocks, block_id_str );
       if( !ir_block ) {
-         _process_accepted_block( bs );
+         _process_accepted_block( bs, with_block_state );
          ir_block = find_block( _blocks, block_id_str );
          if( !ir_block ) return; // should never happen
       }
@@ -1077,7 +1292,7 @@ void mongo_db_plugin_impl::_process_irreversible_block(const chain::block_state_
       _blocks.update_one( make_document( kvp( "_id", ir_block->view()["_id"].get_oid() ) ), update_doc.view() );
    }
 
-   if( store_block_states ) {
+   if( store_block_states && with_block_state ) {
       auto ir_block = find_block( _block_states, block_id_str );
       if( !ir_block ) {
          _process_accepted_block( bs );
@@ -1091,45 +1306,56 @@ void mongo_db_plugin_impl::_process_irreversible_block(const chain::block_state_
 
       _block_states.update_one( make_document( kvp( "_id", ir_block->view()["_id"].get_oid() ) ), update_doc.view() );
    }
+}
 
-   if( store_transactions ) {
-      const auto block_num = bs->block->block_num();
-      bool transactions_in_block = false;
-      mongocxx::options::bulk_write bulk_opts;
-      bulk_opts.ordered( false );
-      auto bulk = _trans.create_bulk_write( bulk_opts );
-
-      for( const auto& receipt : bs->block->transactions ) {
-         string trx_id_str;
-         if( receipt.trx.contains<packed_transaction>() ) {
-            const auto& pt = receipt.trx.get<packed_transaction>();
-            if( !filter_include( pt.get_signed_transaction() ) ) continue;
-            const auto& id = pt.id();
-            trx_id_str = id.str();
-         } else {
-            const auto& id = receipt.trx.get<transaction_id_type>();
-            trx_id_str = id.str();
-         }
+void mongo_db_plugin_impl::_process_irreversible_transactions(const chain::block_state_ptr& bs)
+{
+   using namespace bsoncxx::types;
+   using bsoncxx::builder::basic::make_document;
+   using bsoncxx::builder::basic::kvp;
 
-         auto update_doc = make_document( kvp( "$set", make_document( kvp( "irreversible", b_bool{true} ),
-                                                                      kvp( "block_id", block_id_str ),
-                                                                      kvp( "block_num", b_int32{static_cast<int32_t>(block_num)} ),
-                                                                      kvp( "updatedAt", b_date{now} ) ) ) );
+   const auto block_id = bs->block->id();
+   const auto block_id_str = block_id.str();
+
+   auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+         std::chrono::microseconds{fc::time_point::now().time_since_epoch().count()});
 
-         mongocxx::model::update_one update_op{make_document( kvp( "trx_id", trx_id_str ) ), update_doc.view()};
-         update_op.upsert( false );
-         bulk.append( update_op );
-         transactions_in_block = true;
+   const auto block_num = bs->block->block_num();
+   bool transactions_in_block = false;
+   mongocxx::options::bulk_write bulk_opts;
+   bulk_opts.ordered( false );
+   auto bulk = _trans.create_bulk_write( bulk_opts );
+
+   for( const auto& receipt : bs->block->transactions ) {
+      string trx_id_str;
+      if( receipt.trx.contains<packed_transaction>() ) {
+         const auto& pt = receipt.trx.get<packed_transaction>();
+         if( !filter_include( pt.get_signed_transaction() ) ) continue;
+         const auto& id = pt.id();
+         trx_id_str = id.str();
+      } else {
+         const auto& id = receipt.trx.get<transaction_id_type>();
+         trx_id_str = id.str();
       }
 
-      if( transactions_in_block ) {
-         try {
-            if( !bulk.execute() ) {
-               EOS_ASSERT( false, chain::mongo_db_insert_fail, "Bulk transaction insert failed for block: ${bid}", ("bid", block_id) );
-            }
-         } catch( ... ) {
-            handle_mongo_exception( "bulk transaction insert", __LINE__ );
+      auto update_doc = make_document( kvp( "$set", make_document( kvp( "irreversible", b_bool{true} ),
+                                                                   kvp( "block_id", block_id_str ),
+                                                                   kvp( "block_num", b_int32{static_cast<int32_t>(block_num)} ),
+                                                                   kvp( "updatedAt", b_date{now} ) ) ) );
+
+      mongocxx::model::update_one update_op{make_document( kvp( "trx_id", trx_id_str ) ), update_doc.view()};
+      update_op.upsert( false );
+      bulk.append( update_op );
+      transactions_in_block = true;
+   }
+
+   if( transactions_in_block ) {
+      try {
+         if( !bulk.execute() ) {
+            EOS_ASSERT( false, chain::mongo_db_insert_fail, "Bulk transaction insert failed for block: ${bid}", ("bid", block_id) );
          }
+      } catch( ... ) {
+         handle_mongo_exception( "bulk transaction insert", __LINE__ );
       }
    }
 }
@@ -1312,7 +1538,11 @@ void mongo_db_plugin_impl::update_account(const chain::action& act)
                std::chrono::microseconds{fc::time_point::now().time_since_epoch().count()} );
          auto setabi = act.data_as<chain::setabi>();
 
-         abi_cache_index.erase( setabi.account );
+         {
+            std::lock_guard<std::mutex> g( abi_cache_mtx );
+            abi_cache_index.erase( setabi.account );
+            ++abi_cache_erased;
+         }
 
          auto account = find_account( _accounts, setabi.account );
          if( !account ) {
@@ -1356,9 +1586,18 @@ mongo_db_plugin_impl::~mongo_db_plugin_impl() {
       try {
          ilog( "mongo_db_plugin shutdown in process please be patient this can take a few minutes" );
          done = true;
-         condition.notify_one();
-
-         consume_thread.join();
+         for( consumer* c : { &traces, &transactions, &blocks } ) {
+            {
+               std::lock_guard<std::mutex> g( c->mtx ); // done is seen by a consumer about to wait
+            }
+            c->condition.notify_one();
+         }
+         for( consumer* c : { &traces, &transactions, &blocks } ) {
+            if( c->thread.joinable() )
+               c->thread.join();
+         }
+         if( index_builder.joinable() )
+            index_builder.join();
 
          mongo_pool.reset();
       } catch( std::exception& e ) {
@@ -1367,6 +1606,78 @@ mongo_db_plugin_impl::~mongo_db_plugin_impl() {
    }
 }
 
+void mongo_db_plugin_impl::flush_traces_batch() {
+   if( !pending_traces ) return;
+   auto batch = std::move( *pending_traces );
+   pending_traces.reset();
+   if( batch.trans_traces_count > 0 ) {
+      try {
+         if( !batch.trans_traces.execute() ) {
+            EOS_ASSERT( false, chain::mongo_db_insert_fail, "Bulk transaction traces insert failed, ${n} traces",
+                        ("n", batch.trans_traces_count) );
+         }
+      } catch( ... ) {
+         handle_mongo_exception( "bulk trans_traces insert", __LINE__ );
+      }
+   }
+   if( batch.action_traces_count > 0 ) {
+      try {
+         if( !batch.action_traces.execute() ) {
+            EOS_ASSERT( false, chain::mongo_db_insert_fail, "Bulk action traces insert failed, ${n} traces",
+                        ("n", batch.action_traces_count) );
+         }
+      } catch( ... ) {
+         handle_mongo_exception( "bulk action traces insert", __LINE__ );
+      }
+   }
+   if( batch.irreversible ) irreversible_processed( traces, batch.irreversible );
+}
+
+bool mongo_db_plugin_impl::bulk_load_done( const chain::block_state_ptr& bs ) const {
+   if( bulk_load_until ) return bs->block_num >= bulk_load_until;
+   return bs->header.timestamp.to_time_point() >= fc::time_point::now() - fc::seconds( bulk_load_head_lag_sec );
+}
+
+/// main thread, once
+void mongo_db_plugin_impl::end_bulk_load() {
+   bulk_loading = false;
+   ilog( "mongo db bulk load done, building the query indexes in the background" );
+   queue( traces, [this]() {
+      flush_traces_batch();
+   } );
+   // the indexes are built by mongo db while the consumers keep writing, by a thread of its own as
+   // create_index returns once the index is built
+   index_builder = std::thread( [this]() {
+      fc::set_os_thread_name( "mongodb-index" );
+      try {
+         auto client = mongo_pool->acquire();
+         auto db = (*client)[db_name];
+         mongocxx::options::index index_options{};
+         index_options.background( true );
+         for( const auto& index : query_indexes() ) {
+            if( done ) return;
+            ilog( "mongo db create index ${k} for collection ${c}", ("k", index.second)("c", index.first) );
+            db[index.first].create_index( bsoncxx::from_json( index.second ), index_options );
+         }
+         ilog( "mongo db query indexes built" );
+      } catch( ... ) {
+         handle_mongo_exception( "create query indexes", __LINE__ );
+      }
+   } );
+}
+
+/// indexes the writes of the plugin do not use
+std::vector<std::pair<std::string, std::string>> mongo_db_plugin_impl::query_indexes() const {
+   std::vector<std::pair<std::string, std::string>> indexes;
+   if( !update_blocks_via_block_num ) {
+      indexes.emplace_back( blocks_col, R"xxx({ "block_num" : 1, "_id" : 1 })xxx" );
+      indexes.emplace_back( block_states_col, R"xxx({ "block_num" : 1, "_id" : 1 })xxx" );
+   }
+   indexes.emplace_back( trans_traces_col, R"xxx({ "id" : 1, "_id" : 1 })xxx" );
+   indexes.emplace_back( action_traces_col, R"xxx({ "block_num" : 1, "_id" : 1 })xxx" );
+   return indexes;
+}
+
 void mongo_db_plugin_impl::wipe_database() {
    ilog("mongo db wipe_database");
 
@@ -1463,11 +1774,13 @@ void mongo_db_plugin_impl::init() {
 
             // blocks indexes
             auto blocks = mongo_conn[db_name][blocks_col];
-            blocks.create_index( bsoncxx::from_json( R"xxx({ "block_num" : 1, "_id" : 1 })xxx" ));
+            if( update_blocks_via_block_num )
+               blocks.create_index( bsoncxx::from_json( R"xxx({ "block_num" : 1, "_id" : 1 })xxx" ));
             blocks.create_index( bsoncxx::from_json( R"xxx({ "block_id" : 1, "_id" : 1 })xxx" ));
 
             auto block_states = mongo_conn[db_name][block_states_col];
-            block_states.create_index( bsoncxx::from_json( R"xxx({ "block_num" : 1, "_id" : 1 })xxx" ));
+            if( update_blocks_via_block_num )
+               block_states.create_index( bsoncxx::from_json( R"xxx({ "block_num" : 1, "_id" : 1 })xxx" ));
             block_states.create_index( bsoncxx::from_json( R"xxx({ "block_id" : 1, "_id" : 1 })xxx" ));
 
             // accounts indexes
@@ -1477,12 +1790,12 @@ void mongo_db_plugin_impl::init() {
             auto trans = mongo_conn[db_name][trans_col];
             trans.create_index( bsoncxx::from_json( R"xxx({ "trx_id" : 1, "_id" : 1 })xxx" ));
 
-            auto trans_trace = mongo_conn[db_name][trans_traces_col];
-            trans_trace.create_index( bsoncxx::from_json( R"xxx({ "id" : 1, "_id" : 1 })xxx" ));
-
-            // action traces indexes
-            auto action_traces = mongo_conn[db_name][action_traces_col];
-            action_traces.create_index( bsoncxx::from_json( R"xxx({ "block_num" : 1, "_id" : 1 })xxx" ));
+            // transaction traces, action traces and by block_num indexes, after a bulk load
+            if( !bulk_load ) {
+               for( const auto& index : query_indexes() ) {
+                  mongo_conn[db_name][index.first].create_index( bsoncxx::from_json( index.second ));
+               }
+            }
 
             // pub_keys indexes
             auto pub_keys = mongo_conn[db_name][pub_keys_col];
@@ -1520,11 +1833,28 @@ void mongo_db_plugin_impl::init() {
       handle_mongo_exception( "mongo init", __LINE__ );
    }
 
-   ilog("starting db plugin thread");
+   if( bulk_load ) {
+      // also on a database bulk loaded by a previous run, create_index does nothing for an existing index
+      ilog( "mongo db bulk load until ${b}", ("b", bulk_load_until ? std::to_string( bulk_load_until ) : "head") );
+      bulk_loading = true;
+      traces.drained = [this]() { flush_traces_batch(); };
+   }
 
-   consume_thread = std::thread( [this] {
-      fc::set_os_thread_name( "mongodb" );
-      consume_blocks();
+   ilog("starting db plugin threads");
+
+   start_consumer( traces, "traces", [this]( mongocxx::database& db ) {
+      _accounts = db[accounts_col];
+      _trans_traces = db[trans_traces_col];
+      _action_traces = db[action_traces_col];
+      _pub_keys = db[pub_keys_col];
+      _account_controls = db[account_controls_col];
+   } );
+   start_consumer( transactions, "trans", [this]( mongocxx::database& db ) {
+      _trans = db[trans_col];
+   } );
+   start_consumer( blocks, "blocks", [this]( mongocxx::database& db ) {
+      _blocks = db[blocks_col];
+      _block_states = db[block_states_col];
    } );
 
    startup = false;
@@ -1547,7 +1877,7 @@ void mongo_db_plugin::set_program_options(options_description& cli, options_desc
 {
    cfg.add_options()
          ("mongodb-queue-size,q", bpo::value<uint32_t>()->default_value(1024),
-         "The target queue size between nodeos and MongoDB plugin thread.")
+         "The target queue size between nodeos and each MongoDB plugin thread.")
          ("mongodb-abi-cache-size", bpo::value<uint32_t>()->default_value(2048),
           "The maximum size of the abi cache for serializing data.")
          ("mongodb-wipe", bpo::bool_switch()->default_value(false),
@@ -1559,6 +1889,10 @@ void mongo_db_plugin::set_program_options(options_description& cli, options_desc
          "MongoDB URI connection string, see: https://docs.mongodb.com/master/reference/connection-string/."
                " If not specified then plugin is disabled. Default database 'EOS' is used if not specified in URI."
                " Example: mongodb://127.0.0.1:27017/EOS")
+         ("mongodb-checkpoint", bpo::bool_switch()->default_value(false),
+          "Record the last irreversible block written to mongo db in data-dir/mongodb. On restart the blocks up to it are"
+          " not written again, replaying does not require --mongodb-wipe, and the irreversible blocks missed are read from"
+          " the block log.")
          ("mongodb-update-via-block-num", bpo::value<bool>()->default_value(false),
           "Update blocks/block_state with latest via block number so that duplicates are overwritten.")
          ("mongodb-store-blocks", bpo::value<bool>()->default_value(true),
@@ -1571,6 +1905,16 @@ void mongo_db_plugin::set_program_options(options_description& cli, options_desc
           "Enables storing transaction traces in mongodb.")
          ("mongodb-store-action-traces", bpo::value<bool>()->default_value(true),
           "Enables storing action traces in mongodb.")
+         ("mongodb-store-raw-action-data", bpo::value<bool>()->default_value(false),
+          "Store act.data of action traces as binary instead of decoding it with the contract abi.")
+         ("mongodb-bulk-load", bpo::bool_switch()->default_value(false),
+          "Initial sync: until the node is near head block time, or at --mongodb-bulk-load-until, leave out the indexes"
+          " only read by queries (transaction traces, action traces, blocks by number) and write the traces in large"
+          " unordered bulk writes. The indexes are then built in the background.")
+         ("mongodb-bulk-load-until", bpo::value<uint32_t>()->default_value(0),
+          "Block number ending --mongodb-bulk-load, 0 for head block time.")
+         ("mongodb-bulk-batch-size", bpo::value<uint32_t>()->default_value(10000),
+          "Maximum number of traces written by a bulk write of --mongodb-bulk-load.")
          ("mongodb-expire-after-seconds", bpo::value<uint32_t>()->default_value(0),
           "Enables expiring data in mongodb after a specified number of seconds.")
          ("mongodb-filter-on", bpo::value<vector<string>>()->composing(),
@@ -1587,8 +1931,16 @@ void mongo_db_plugin::plugin_initialize(const variables_map& options)
          ilog( "initializing mongo_db_plugin" );
          my->configured = true;
 
+         if( options.at( "mongodb-checkpoint" ).as<bool>() ) {
+            my->checkpoint.emplace( app().data_dir() / "mongodb", "mongodb" );
+            if( options.at( "mongodb-wipe" ).as<bool>() ) my->checkpoint->reset();
+         }
+
+         const bool resumes = my->checkpoint && my->checkpoint->last_committed();
          if( options.at( "replay-blockchain" ).as<bool>() || options.at( "hard-replay-blockchain" ).as<bool>() || options.at( "delete-all-blocks" ).as<bool>() ) {
-            if( options.at( "mongodb-wipe" ).as<bool>()) {
+            if( resumes && !options.at( "delete-all-blocks" ).as<bool>() ) {
+               ilog( "Resuming mongo database after block ${b}", ("b", my->checkpoint->last_committed()) );
+            } else if( options.at( "mongodb-wipe" ).as<bool>()) {
                ilog( "Wiping mongo database on startup" );
                my->wipe_database_on_startup = true;
             } else if( options.count( "mongodb-block-start" ) == 0 ) {
@@ -1630,6 +1982,13 @@ void mongo_db_plugin::plugin_initialize(const variables_map& options)
          if( options.count( "mongodb-store-action-traces" )) {
             my->store_action_traces = options.at( "mongodb-store-action-traces" ).as<bool>();
          }
+         if( options.count( "mongodb-store-raw-action-data" )) {
+            my->store_raw_action_data = options.at( "mongodb-store-raw-action-data" ).as<bool>();
+         }
+         my->bulk_load = options.at( "mongodb-bulk-load" ).as<bool>();
+         my->bulk_load_until = options.at( "mongodb-bulk-load-until" ).as<uint32_t>();
+         my->bulk_batch_size = options.at( "mongodb-bulk-batch-size" ).as<uint32_t>();
+         EOS_ASSERT( my->bulk_batch_size > 0, chain::plugin_config_exception, "mongodb-bulk-batch-size > 0 required" );
          if( options.count( "mongodb-expire-after-seconds" )) {
             my->expire_after_seconds = options.at( "mongodb-expire-after-seconds" ).as<uint32_t>();
          }
@@ -1665,6 +2024,11 @@ void mongo_db_plugin::plugin_initialize(const variables_map& options)
             my->is_producer = true;
          }
 
+         if( resumes ) {
+            const auto committed = my->checkpoint->last_committed();
+            my->start_block_num = std::max( my->start_block_num, committed + 1 );
+            for( auto* c : { &my->traces, &my->transactions, &my->blocks } ) c->irreversible = committed;
+         }
          if( my->start_block_num == 0 ) {
             my->start_block_reached = true;
          }
@@ -1683,21 +2047,22 @@ void mongo_db_plugin::plugin_initialize(const variables_map& options)
          auto& chain = chain_plug->chain();
          my->chain_id.emplace( chain.get_chain_id());
 
-         my->accepted_block_connection.emplace( chain.accepted_block.connect( [&]( const chain::block_state_ptr& bs ) {
+         my->accepted_block_connection.emplace( chain.accepted_block.connect( chain::timed_slot( "mongo_accepted_block", [&]( const chain::block_state_ptr& bs ) {
             my->accepted_block( bs );
-         } ));
+         } ) ));
          my->irreversible_block_connection.emplace(
-               chain.irreversible_block.connect( [&]( const chain::block_state_ptr& bs ) {
+               chain.irreversible_block.connect( chain::timed_slot( "mongo_irreversible_block", [&]( const chain::block_state_ptr& bs ) {
                   my->applied_irreversible_block( bs );
-               } ));
+               } ) ));
          my->accepted_transaction_connection.emplace(
-               chain.accepted_transaction.connect( [&]( const chain::transaction_metadata_ptr& t ) {
+               chain.accepted_transaction.connect( chain::timed_slot( "mongo_accepted_transaction", [&]( const chain::transaction_metadata_ptr& t ) {
                   my->accepted_transaction( t );
-               } ));
+               } ) ));
          my->applied_transaction_connection.emplace(
-               chain.applied_transaction.connect( [&]( std::tuple<const chain::transaction_trace_ptr&, const chain::signed_transaction&> t ) {
+               chain.applied_transaction.connect( chain::timed_slot( "mongo_applied_transaction",
+                     [&]( std::tuple<const chain::transaction_trace_ptr&, const chain::signed_transaction&> t ) {
                   my->applied_transaction( std::get<0>(t) );
-               } ));
+               } ) ));
 
          if( my->wipe_database_on_startup ) {
             my->wipe_database();
@@ -1712,6 +2077,11 @@ void mongo_db_plugin::plugin_initialize(const variables_map& options)
 
 void mongo_db_plugin::plugin_startup()
 {
+   if( my->configured ) {
+      try {
+         my->read_missed_blocks( app().get_plugin<chain_plugin>().chain() );
+      } FC_LOG_AND_RETHROW()
+   }
 }
 
 void mongo_db_plugin::plugin_shutdown()
@@ -10,11 +10,28 @@
 namespace eosio {
    using namespace appbase;
 
+   /// smoothed measurements of a peer, block and transaction fetches go to the peers of the lowest cost first
+   struct peer_score {
+      double            rtt_us = 0;              ///< round trip time from time_message exchanges
+      double            fetch_latency_us = 0;    ///< from a block or transaction request to its arrival
+      double            sync_blocks_per_sec = 0; ///< throughput of the sync ranges served
+      double            failure_rate = 0;        ///< of fetch and sync requests that timed out
+      uint32_t          failures = 0;
+
+      /// expected microseconds to get a block from the peer, 0 for a peer not measured yet
+      double cost()const {
+         const double sync_us = sync_blocks_per_sec > 0 ? 1e6 / sync_blocks_per_sec : 0;
+         return ( rtt_us + fetch_latency_us + sync_us ) * ( 1 + 4 * failure_rate );
+      }
+   };
+
    struct connection_status {
       string            peer;
       bool              connecting = false;
       bool              syncing    = false;
       handshake_message last_handshake;
+      peer_score        score;
+      double            cost = 0;
    };
 
    ///@{
@@ -62,6 +79,8 @@ namespace eosio {
           send(peer_num, custom_message { msg_type, fc::raw::pack(msg) });
         }
         void send(uint32_t peer_num, const custom_message&);
+        /// `data` is a message of type `msg_type` packed once for all `peer_nums`, they share one send buffer
+        void send(const std::vector<uint32_t>& peer_nums, uint32_t msg_type, const std::vector<char>& data);
         ///@}
 
         size_t num_peers() const;
@@ -70,6 +89,8 @@ namespace eosio {
       /// HAYA: [cyb-284] use net_plugin in randpa
       public:
         using new_peer = channel_decl<struct net_new_peer_tag, uint32_t>;
+        /// Published with the connection number when an open connection is closed.
+        using peer_closed = channel_decl<struct net_peer_closed_tag, uint32_t>;
       ///@}
 
       private:
@@ -78,4 +99,5 @@ namespace eosio {
 
 }
 
-FC_REFLECT( eosio::connection_status, (peer)(connecting)(syncing)(last_handshake) )
+FC_REFLECT( eosio::peer_score, (rtt_us)(fetch_latency_us)(sync_blocks_per_sec)(failure_rate)(failures) )
+FC_REFLECT( eosio::connection_status, (peer)(connecting)(syncing)(last_handshake)(score)(cost) )
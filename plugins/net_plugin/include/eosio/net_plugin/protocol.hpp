@@ -4,6 +4,7 @@
  */
 #pragma once
 #include <eosio/chain/block.hpp>
+#include <eosio/chain/snapshot_manifest.hpp>
 #include <eosio/chain/types.hpp>
 #include <chrono>
 
@@ -147,6 +148,52 @@ namespace eosio {
    };
    ///@}
 
+   /// a relayed block whose receipts at `pruned` carry the transaction id instead of the transaction,
+   /// for the receiver to take the transactions it already has from its local transactions
+   struct compact_block_message {
+      signed_block       block;
+      vector<uint32_t>   pruned;
+   };
+
+   /// asks for the transactions of the receipts at `indexes` of a compact block the receiver misses
+   struct get_block_transactions_message {
+      block_id_type      block_id;
+      vector<uint32_t>   indexes;
+   };
+
+   struct block_transactions_message {
+      block_id_type                block_id;
+      vector<packed_transaction>   transactions; ///< in the order requested, empty if the block is unknown
+   };
+
+   /// a bulk net_message compressed with zlib, `data` inflates to the packed net_message of `uncompressed_size` bytes
+   struct compressed_message {
+      uint32_t           uncompressed_size = 0;
+      vector<char>       data;
+   };
+
+   /// asks for the manifest of the snapshot a peer serves
+   struct snapshot_manifest_request_message {
+      uint32_t           min_block_num = 0; ///< oldest snapshot head the requester accepts
+   };
+
+   /// manifest.size is 0 when the peer serves no snapshot at or above the requested block
+   struct snapshot_manifest_message {
+      snapshot_manifest  manifest;
+   };
+
+   struct snapshot_chunk_request_message {
+      block_id_type      block_id; ///< of the manifest
+      uint32_t           index = 0;
+   };
+
+   /// `data` is empty when the peer no longer serves the snapshot
+   struct snapshot_chunk_message {
+      block_id_type      block_id;
+      uint32_t           index = 0;
+      vector<char>       data;
+   };
+
    using net_message = static_variant<handshake_message,
                                       chain_size_message,
                                       go_away_message,
@@ -158,8 +205,16 @@ namespace eosio {
                                       packed_transaction,   // which = 8
                                       ///@{
                                       /// HAYA: [cyb-284] use net_plugin in randpa
-                                      custom_message>;
+                                      custom_message,
                                       ///@}
+                                      compact_block_message,            // which = 10
+                                      get_block_transactions_message,
+                                      block_transactions_message,
+                                      compressed_message,               // which = 13
+                                      snapshot_manifest_request_message,
+                                      snapshot_manifest_message,
+                                      snapshot_chunk_request_message,
+                                      snapshot_chunk_message>;          // which = 17
 
 } // namespace eosio
 
@@ -182,6 +237,14 @@ FC_REFLECT( eosio::sync_request_message, (start_block)(end_block) )
 /// HAYA: [cyb-284] use net_plugin in randpa
 FC_REFLECT( eosio::custom_message, (type)(data) )
 ///@}
+FC_REFLECT( eosio::compact_block_message, (block)(pruned) )
+FC_REFLECT( eosio::get_block_transactions_message, (block_id)(indexes) )
+FC_REFLECT( eosio::block_transactions_message, (block_id)(transactions) )
+FC_REFLECT( eosio::compressed_message, (uncompressed_size)(data) )
+FC_REFLECT( eosio::snapshot_manifest_request_message, (min_block_num) )
+FC_REFLECT( eosio::snapshot_manifest_message, (manifest) )
+FC_REFLECT( eosio::snapshot_chunk_request_message, (block_id)(index) )
+FC_REFLECT( eosio::snapshot_chunk_message, (block_id)(index)(data) )
 
 /**
  *
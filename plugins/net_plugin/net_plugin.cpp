@@ -8,11 +8,16 @@
 #include <eosio/net_plugin/protocol.hpp>
 #include <eosio/chain/controller.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/async_log.hpp>
 #include <eosio/chain/block.hpp>
+#include <eosio/chain/merkle.hpp>
 #include <eosio/chain/plugin_interface.hpp>
+#include <eosio/chain/executor_stats.hpp>
 #include <eosio/chain/thread_utils.hpp>
 #include <eosio/producer_plugin/producer_plugin.hpp>
 #include <eosio/chain/contract_types.hpp>
+#include <eosio/chain/snapshot_delta.hpp>
+#include <eosio/chain/snapshot_manifest.hpp>
 ///@{
 /// HAYA: [cyb-277] add net msg count metrics
 #include <eosio/telemetry_plugin/telemetry_plugin.hpp>
@@ -31,6 +36,12 @@
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/ip/host_name.hpp>
 #include <boost/asio/steady_timer.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <fstream>
 
 using namespace eosio::chain::plugin_interface::compat;
 
@@ -53,13 +64,33 @@ namespace eosio {
 
    class sync_manager;
    class dispatch_manager;
+   class snapshot_fetcher;
 
    using connection_ptr = std::shared_ptr<connection>;
    using connection_wptr = std::weak_ptr<connection>;
 
    using socket_ptr = std::shared_ptr<tcp::socket>;
+
+   /**
+    * The bytes read from a socket of a connection. A read in progress owns it: its completion frames and unpacks it on
+    * the connection strand, the main thread only touches it again to start the next read, once it has the messages.
+    */
+   struct read_buffer {
+      fc::message_buffer<1024*1024>    pending_message_buffer;
+      fc::optional<std::size_t>        outstanding_read_bytes;
+   };
+   using read_buffer_ptr = std::shared_ptr<read_buffer>;
+
    using io_work_t = boost::asio::executor_work_guard<boost::asio::io_context::executor_type>;
 
+   /// write queues of a connection, a queue is sent only when the queues before it are empty
+   enum class write_priority : uint8_t {
+      consensus = 0, ///< custom_message of randpa, small and delaying finality when queued behind blocks
+      sync,          ///< blocks requested by a syncing peer
+      general,
+      count
+   };
+
    struct node_transaction_state {
       transaction_id_type id;
       time_point_sec  expires;  /// time after which this may be purged.
@@ -104,6 +135,12 @@ namespace eosio {
       uint32_t                         max_nodes_per_host = 1;
       uint32_t                         num_clients = 0;
       bool                             p2p_accept_transactions = true;
+      bool                             p2p_compact_blocks = true;
+      bool                             p2p_early_relay = false;
+      bool                             p2p_compression = true;
+      fc::time_point                   compression_window_start;
+      fc::microseconds                 compression_window_time; ///< spent compressing since compression_window_start
+      uint32_t                         sync_prefetch_blocks = 0; ///< sync-prefetch-blocks, 0 disables prefetching
 
       vector<string>                   supplied_peers;
       vector<chain::public_key_type>   allowed_peers; ///< peer keys allowed to connect
@@ -126,13 +163,59 @@ namespace eosio {
       std::unordered_map< uint32_t, connection_wptr > connections_by_num;
       std::unordered_map< uint32_t, std::vector<subs_cb> > custom_handlers;
       ///@}
+      ///@{
+      /// HAYA: [cyb-277] net msg count metrics, indexed by net_message tag
+      std::vector<telemetry::counter_handle> in_msg_counters{ size_t(net_message::count()) };
+      std::vector<telemetry::counter_handle> out_msg_counters{ size_t(net_message::count()) };
+      telemetry::counter_handle in_msg_total_counter;
+      telemetry::counter_handle out_msg_total_counter;
+      ///@}
+      telemetry::counter_handle compressed_msg_counter;
+      telemetry::counter_handle compression_in_bytes_counter;
+      telemetry::counter_handle compression_out_bytes_counter;
+      telemetry::counter_handle compression_skipped_counter;
+      /// time messages wait in the write queue of a connection, by write_priority
+      std::array<telemetry::histogram_handle, size_t(write_priority::count)> write_queue_histograms;
+      /// p2p-peer-metrics: peers exported with a label of their own, at most peer_metrics_max of them
+      struct peer_gauges_type {
+         telemetry::gauge_family_handle bytes_in, bytes_out, msgs_in, msgs_out;
+         telemetry::gauge_family_handle write_queue_bytes, write_wait_us, block_lag_us, rtt_us;
+      };
+      uint32_t                              peer_metrics_max = 0;
+      peer_gauges_type                      peer_gauges;
+      std::vector<string>                   msg_type_names{ size_t(net_message::count()) }; ///< by net_message tag, for labels
+      std::set<string>                      peer_metrics_exported; ///< peer labels of the last export
+      unique_ptr<boost::asio::steady_timer> peer_metrics_timer;
       bool                             done = false;
       unique_ptr< sync_manager >       sync_master;
       unique_ptr< dispatch_manager >   dispatcher;
+      unique_ptr< snapshot_fetcher >   snapshot_fetch; ///< p2p-snapshot-bootstrap, while the snapshot is fetched
+      bool                             snapshot_bootstrap = false;
+      uint32_t                         snapshot_bootstrap_min_peers = 2;
+      optional<digest_type>            snapshot_bootstrap_root;
+
+      /// p2p-snapshot-serve: the newest full snapshot of snapshots_dir, with its manifest
+      struct served_snapshot {
+         boost::filesystem::path  path;
+         snapshot_manifest        manifest;
+      };
+      bool                                    snapshot_serve = false;
+      boost::filesystem::path                 snapshots_dir;
+      std::shared_ptr<const served_snapshot>  snapshot_served;
+      bool                                    snapshot_manifest_pending = false; ///< being computed on the thread pool
+      fc::time_point                          snapshots_dir_scanned;
+      std::atomic<uint32_t>                   snapshot_chunk_reads{0};           ///< chunks being read on the thread pool
+      unique_ptr<boost::asio::steady_timer>   snapshot_timer;
 
       unique_ptr<boost::asio::steady_timer> connector_check;
       unique_ptr<boost::asio::steady_timer> transaction_check;
       unique_ptr<boost::asio::steady_timer> keepalive_timer;
+      unique_ptr<boost::asio::steady_timer> trx_announce_timer;
+      bool                                  trx_announce_scheduled = false;
+      std::set<string>                      trx_announce_peers; ///< p2p-trx-announce-peer
+      bool                                  trx_announce_all = false;
+      /// trxs of the messages of one read, their keys are recovered together by accept_incoming_trxs
+      std::vector<std::pair<transaction_metadata_ptr, chain::plugin_interface::next_function<transaction_trace_ptr>>> incoming_trxs;
       boost::asio::steady_timer::duration   connector_period{0};
       boost::asio::steady_timer::duration   txn_exp_period{0};
       boost::asio::steady_timer::duration   resp_expected_period{0};
@@ -165,15 +248,25 @@ namespace eosio {
       void start_listen_loop();
       void start_read_message(const connection_ptr& c);
 
-      /** \brief Process the next message from the pending message buffer
+      /** \brief Unpack the complete messages of the pending message buffer
+       *
+       * Runs on the connection strand, so peers are deserialized on the net threads.
+       * Appends the messages read after bytes_transferred were received to `messages`.
+       * Returns false if the data is malformed, the messages read before are still valid.
+       */
+      bool read_messages(read_buffer& reads, const socket_ptr& socket, std::size_t bytes_transferred, std::vector<net_message>& messages);
+      /// compressed_message of the framed net_message `buffer`, null if it does not shrink enough or compression is over its time budget
+      std::shared_ptr<vector<char>> compress_send_buffer(const std::shared_ptr<vector<char>>& buffer);
+
+      /** \brief Process a message unpacked by read_messages
        *
-       * Process the next message from the pending_message_buffer.
-       * message_length is the already determined length of the data
-       * part of the message that will handle the message.
        * Returns true is successful. Returns false if an error was
-       * encountered unpacking or processing the message.
+       * encountered processing the message.
        */
-      bool process_next_message(const connection_ptr& conn, uint32_t message_length);
+      bool process_next_message(const connection_ptr& conn, net_message& msg, fc::time_point received);
+
+      /// while syncing, hands blocks received but not processed yet to the controller to validate them in advance
+      void prefetch_sync_blocks(const std::vector<net_message>& messages);
 
       void close(const connection_ptr& c);
       size_t count_open_sockets() const;
@@ -183,6 +276,7 @@ namespace eosio {
 
       void accepted_block(const block_state_ptr&);
       void pre_accepted_block(const signed_block_ptr&);
+      void accepted_block_header(const block_state_ptr&);
       void transaction_ack(const std::pair<fc::exception_ptr, transaction_metadata_ptr>&);
 
       bool is_valid( const handshake_message &msg);
@@ -209,20 +303,45 @@ namespace eosio {
       void handle_message(const connection_ptr& c, const request_message& msg);
       void handle_message(const connection_ptr& c, const sync_request_message& msg);
       void handle_message(const connection_ptr& c, const signed_block& msg) = delete; // signed_block_ptr overload used instead
-      void handle_message(const connection_ptr& c, const signed_block_ptr& msg);
+      /// @param received  time the message was taken from the connection buffer, for block_receive timing
+      void handle_message(const connection_ptr& c, const signed_block_ptr& msg, const fc::time_point& received = fc::time_point::now());
       void handle_message(const connection_ptr& c, const packed_transaction& msg) = delete; // packed_transaction_ptr overload used instead
       void handle_message(const connection_ptr& c, const packed_transaction_ptr& msg);
+      /// hands the trxs collected by handle_message(packed_transaction_ptr) to the chain as one batch
+      void accept_incoming_trxs();
+      void handle_message(const connection_ptr& c, compact_block_message& msg, const fc::time_point& received);
+      void handle_message(const connection_ptr& c, const get_block_transactions_message& msg);
+      void handle_message(const connection_ptr& c, const block_transactions_message& msg);
+      void handle_message(const connection_ptr& c, const compressed_message& msg);
+      void handle_message(const connection_ptr& c, const snapshot_manifest_request_message& msg);
+      void handle_message(const connection_ptr& c, const snapshot_manifest_message& msg);
+      void handle_message(const connection_ptr& c, const snapshot_chunk_request_message& msg);
+      void handle_message(const connection_ptr& c, snapshot_chunk_message& msg);
+
+      /// computes the manifest of the newest snapshot of snapshots_dir on the thread pool, if it is not served yet
+      void refresh_served_snapshot();
+      void start_snapshot_timer();
+
+      void start_peer_metrics_timer();
+      /// exports the metrics of the peers with the most block lag and removes the labels of the others
+      void export_peer_metrics();
+
+      /// handles a block rebuilt from a compact block, or requests the whole block if its transactions do not match
+      void accept_compact_block(const connection_ptr& c, const signed_block_ptr& b, const block_id_type& id, const fc::time_point& received);
       ///@{
       /// HAYA: [cyb-284] use net_plugin in randpa
       void handle_message(const connection_ptr& c, const custom_message& msg);
       ///@}
 
       void start_conn_timer(boost::asio::steady_timer::duration du, std::weak_ptr<connection> from_connection);
-      void start_txn_timer();
+      void start_txn_timer(boost::asio::steady_timer::duration du);
+      /// sends the pending transaction announcements of every connection after def_trx_announce_interval
+      void schedule_trx_announcements();
       void start_monitors();
 
       void expire_txns();
-      void expire_local_txns();
+      /// false if `deadline` passed before every expired transaction was erased
+      bool expire_local_txns(const fc::time_point& deadline = fc::time_point::maximum());
       void connection_monitor(std::weak_ptr<connection> from_connection);
       /** \name Peer Timestamps
        *  Time message handling
@@ -262,6 +381,7 @@ namespace eosio {
       /// HAYA: [cyb-284] use net_plugin in randpa
       void subscribe(uint32_t msg_type, subs_cb&&);
       void send(uint32_t peer_num, const custom_message&);
+      void send(const std::vector<uint32_t>& peer_nums, uint32_t msg_type, const std::vector<char>& data);
       ///@}
    };
 
@@ -269,17 +389,12 @@ namespace eosio {
    fc::logger logger;
    std::string peer_log_format;
 
+// debug and info messages are written by the async_log thread once it is started, warnings and errors in place
 #define peer_dlog( PEER, FORMAT, ... ) \
-  FC_MULTILINE_MACRO_BEGIN \
-   if( logger.is_enabled( fc::log_level::debug ) ) \
-      logger.log( FC_LOG_MESSAGE( debug, peer_log_format + FORMAT, __VA_ARGS__ (PEER->get_logger_variant()) ) ); \
-  FC_MULTILINE_MACRO_END
+  async_dlog( logger, peer_log_format + FORMAT, __VA_ARGS__ (PEER->get_logger_variant()) )
 
 #define peer_ilog( PEER, FORMAT, ... ) \
-  FC_MULTILINE_MACRO_BEGIN \
-   if( logger.is_enabled( fc::log_level::info ) ) \
-      logger.log( FC_LOG_MESSAGE( info, peer_log_format + FORMAT, __VA_ARGS__ (PEER->get_logger_variant()) ) ); \
-  FC_MULTILINE_MACRO_END
+  async_ilog( logger, peer_log_format + FORMAT, __VA_ARGS__ (PEER->get_logger_variant()) )
 
 #define peer_wlog( PEER, FORMAT, ... ) \
   FC_MULTILINE_MACRO_BEGIN \
@@ -309,6 +424,15 @@ namespace eosio {
    constexpr auto     def_send_buffer_size_mb = 4;
    constexpr auto     def_send_buffer_size = 1024*1024*def_send_buffer_size_mb;
    constexpr auto     def_max_write_queue_size = def_send_buffer_size*10;
+   constexpr auto     def_max_write_batch_size = 256*1024; // bulk queues are written in batches of this size, so consensus messages overtake them
+   constexpr auto     def_min_compress_size = 1024;        // smaller messages are not worth compressing
+   constexpr double   def_score_smoothing = 0.125;         // weight of a new sample in the peer_score averages
+   constexpr auto     def_expire_check_interval = 1024;    // erased entries between deadline checks of the expiry sweeps
+   constexpr auto     def_trx_announce_batch = 256;        // ids of a notice_message announcing transactions
+   constexpr auto     def_trx_announce_interval = std::chrono::milliseconds(10);
+   constexpr auto     def_trx_request_timeout = fc::seconds(1); // another announcing peer is asked after it
+   constexpr auto     def_announced_trx_expire = fc::seconds(60); // peer is assumed to know an announced transaction for
+   constexpr auto     def_max_compression_time = fc::milliseconds(200); // of main thread time per second, compression is skipped above it
    constexpr auto     def_max_trx_in_progress_size = 100*1024*1024; // 100 MB
    constexpr auto     def_max_consecutive_rejected_blocks = 13; // num of rejected blocks before disconnect
    constexpr auto     def_max_clients = 25; // 0 for unlimited clients
@@ -317,10 +441,24 @@ namespace eosio {
    constexpr auto     def_txn_expire_wait = std::chrono::seconds(3);
    constexpr auto     def_resp_expected_wait = std::chrono::seconds(5);
    constexpr auto     def_sync_fetch_span = 100;
+   constexpr auto     def_sync_prefetch_blocks = 64;
+   constexpr auto     def_sync_peer_ranges = 2;
+   constexpr auto     def_sync_max_ahead_spans = 20;    // blocks requested ahead of head, in sync-fetch-span
+   constexpr auto     def_sync_range_time = std::chrono::seconds(1); // adapted ranges take about this long to receive
+   constexpr auto     def_snapshot_tick = std::chrono::seconds(2);   // snapshot fetch timeouts and manifest requests are checked at this interval
+   constexpr auto     def_peer_metrics_interval = std::chrono::seconds(10); // of p2p-peer-metrics exports
+   constexpr auto     def_snapshot_manifest_retry = fc::seconds(10); // a peer without a manifest to offer is asked again after it
+   constexpr auto     def_snapshot_chunk_timeout = fc::seconds(30);  // a chunk request is sent to another peer after it
+   constexpr auto     def_snapshot_chunks_per_peer = 4;              // chunk requests in flight to each peer
+   constexpr auto     def_snapshot_max_chunk_reads = 16;             // chunks read at once for peers, more requests are dropped
+   constexpr auto     def_snapshots_dir_scan = fc::seconds(10);      // of p2p-snapshot-serve for a newer snapshot
 
    constexpr auto     message_header_size = 4;
    constexpr uint32_t signed_block_which = 7;        // see protocol net_message
    constexpr uint32_t packed_transaction_which = 8;  // see protocol net_message
+   constexpr uint32_t custom_message_which = 9;      // see protocol net_message
+   constexpr uint32_t compact_block_which = 10;      // see protocol net_message
+   constexpr uint32_t compressed_message_which = 13; // see protocol net_message
 
    /**
     *  For a while, network version was a 16 bit value equal to the second set of 16 bits
@@ -342,8 +480,14 @@ namespace eosio {
     */
    constexpr uint16_t proto_base = 0;
    constexpr uint16_t proto_explicit_sync = 1;
+   constexpr uint16_t proto_compact_blocks = 2;    // compact_block_message and the transactions requests
+   constexpr uint16_t proto_sync_ranges = 3;       // sync_request_message ranges are queued instead of replaced
+   constexpr uint16_t proto_compression = 4;       // compressed_message
+   constexpr uint16_t proto_trx_announce = 5;      // transaction ids of a normal notice_message are requested
+   constexpr uint16_t proto_snapshot_chunks = 6;   // snapshot manifest and chunk messages
+   constexpr uint16_t proto_early_relay = 7;       // blocks may be relayed once their header is validated, before they are applied
 
-   constexpr uint16_t net_version = proto_explicit_sync;
+   constexpr uint16_t net_version = proto_early_relay;
 
    struct transaction_state {
       transaction_id_type id;
@@ -382,6 +526,25 @@ namespace eosio {
       > peer_block_state_index;
 
 
+   /// a block packed as a signed_block net_message, shared by the write queues of all connections
+   struct block_buffer {
+      block_id_type                    id;
+      uint32_t                         block_num{0};
+      std::shared_ptr<vector<char>>    buffer;
+      std::shared_ptr<vector<char>>    compact; ///< compact_block_message, if it prunes any transaction
+      bool                             compact_built{false};
+      std::shared_ptr<vector<char>>    compressed; ///< compressed_message of buffer, if compression pays off
+      bool                             compressed_built{false};
+   };
+
+   typedef multi_index_container<
+      eosio::block_buffer,
+      indexed_by<
+         ordered_unique< tag<by_id>, member<eosio::block_buffer, block_id_type, &eosio::block_buffer::id >, sha256_less >,
+         ordered_non_unique< tag<by_block_num>, member<eosio::block_buffer, uint32_t, &eosio::block_buffer::block_num > >
+         >
+      > block_buffer_index;
+
    struct update_block_num {
       uint32_t new_bnum{0};
       update_block_num(uint32_t bnum) : new_bnum(bnum) {}
@@ -411,11 +574,42 @@ namespace eosio {
       static void populate(handshake_message &hello);
    };
 
+   /// traffic of a connection for p2p-peer-metrics, updated on the main thread
+   struct peer_traffic {
+      uint64_t              bytes_in = 0;
+      uint64_t              bytes_out = 0;
+      std::vector<uint64_t> msgs_in = std::vector<uint64_t>( size_t(net_message::count()) ); ///< by net_message tag
+      std::vector<uint64_t> msgs_out = std::vector<uint64_t>( size_t(net_message::count()) );
+
+      // samples since the previous export
+      uint64_t              writes = 0;
+      uint64_t              write_wait_us = 0; ///< time the written messages spent in the write queue
+      uint64_t              blocks = 0;
+      int64_t               block_lag_us = 0;  ///< from the timestamps of the received blocks to their arrival
+
+      // averages over the samples of the previous export interval
+      double                avg_write_wait_us = 0;
+      double                avg_block_lag_us = 0;
+
+      void add_block_lag( const fc::microseconds& lag ) {
+         ++blocks;
+         block_lag_us += lag.count();
+      }
+
+      void take_interval() {
+         avg_write_wait_us = writes ? double( write_wait_us ) / writes : 0;
+         avg_block_lag_us = blocks ? double( block_lag_us ) / blocks : 0;
+         writes = write_wait_us = blocks = 0;
+         block_lag_us = 0;
+      }
+   };
+
    class queued_buffer : boost::noncopyable {
    public:
       void clear_write_queue() {
-         _write_queue.clear();
-         _sync_write_queue.clear();
+         for( auto& q : _write_queues ) {
+            q.clear();
+         }
          _write_queue_size = 0;
       }
 
@@ -431,31 +625,38 @@ namespace eosio {
 
       bool ready_to_send() const {
          // if out_queue is not empty then async_write is in progress
-         return ((!_sync_write_queue.empty() || !_write_queue.empty()) && _out_queue.empty());
+         return _out_queue.empty() &&
+                std::any_of( _write_queues.begin(), _write_queues.end(), []( const auto& q ) { return !q.empty(); } );
       }
 
       bool add_write_queue( const std::shared_ptr<vector<char>>& buff,
                             std::function<void( boost::system::error_code, std::size_t )> callback,
-                            bool to_sync_queue ) {
-         if( to_sync_queue ) {
-            _sync_write_queue.push_back( {buff, callback} );
-         } else {
-            _write_queue.push_back( {buff, callback} );
-         }
-         _write_queue_size += buff->size();
+                            write_priority priority ) {
+         return add_write_queue( buff, boost::asio::buffer( *buff ), std::move( callback ), priority );
+      }
+
+      /// `data` is written as is, `owner` keeps it alive until it is written
+      bool add_write_queue( std::shared_ptr<const void> owner, boost::asio::const_buffer data,
+                            std::function<void( boost::system::error_code, std::size_t )> callback,
+                            write_priority priority ) {
+         _write_queues[size_t(priority)].push_back( {std::move( owner ), data, callback, fc::time_point::now()} );
+         _write_queue_size += data.size();
          if( _write_queue_size > 2 * def_max_write_queue_size ) {
             return false;
          }
          return true;
       }
 
-      void fill_out_buffer( std::vector<boost::asio::const_buffer>& bufs ) {
-         if( _sync_write_queue.size() > 0 ) { // always send msgs from sync_write_queue first
-            fill_out_buffer( bufs, _sync_write_queue );
-         } else { // postpone real_time write_queue if sync queue is not empty
-            fill_out_buffer( bufs, _write_queue );
-            EOS_ASSERT( _write_queue_size == 0, plugin_exception, "write queue size expected to be zero" );
+      /// returns the time the messages added to `bufs` spent in the write queue, in microseconds
+      uint64_t fill_out_buffer( std::vector<boost::asio::const_buffer>& bufs ) {
+         // only the first non-empty queue is written, consensus messages wait for one batch of bulk data at most
+         for( size_t i = 0; i < _write_queues.size(); ++i ) {
+            if( !_write_queues[i].empty() ) {
+               const bool bulk = i != size_t(write_priority::consensus);
+               return fill_out_buffer( bufs, _write_queues[i], my_impl->write_queue_histograms[i], bulk ? def_max_write_batch_size : 0 );
+            }
          }
+         return 0;
       }
 
       void out_callback( boost::system::error_code ec, std::size_t w ) {
@@ -466,26 +667,37 @@ namespace eosio {
 
    private:
       struct queued_write;
-      void fill_out_buffer( std::vector<boost::asio::const_buffer>& bufs,
-                            deque<queued_write>& w_queue ) {
-         while ( w_queue.size() > 0 ) {
+      uint64_t fill_out_buffer( std::vector<boost::asio::const_buffer>& bufs,
+                                deque<queued_write>& w_queue,
+                                const telemetry::histogram_handle& queue_time,
+                                size_t max_batch_size ) {
+         const auto now = fc::time_point::now();
+         size_t batch_size = 0;
+         uint64_t waited_us = 0;
+         while ( w_queue.size() > 0 && ( max_batch_size == 0 || batch_size < max_batch_size ) ) {
             auto& m = w_queue.front();
-            bufs.push_back( boost::asio::buffer( *m.buff ));
-            _write_queue_size -= m.buff->size();
+            bufs.push_back( m.data );
+            batch_size += m.data.size();
+            _write_queue_size -= m.data.size();
+            const auto waited = ( now - m.queued ).count();
+            queue_time.observe( waited );
+            waited_us += waited;
             _out_queue.emplace_back( m );
             w_queue.pop_front();
          }
+         return waited_us;
       }
 
    private:
       struct queued_write {
-         std::shared_ptr<vector<char>> buff;
+         std::shared_ptr<const void>   owner;
+         boost::asio::const_buffer     data;
          std::function<void( boost::system::error_code, std::size_t )> callback;
+         fc::time_point queued;
       };
 
       uint32_t _write_queue_size = 0;
-      deque<queued_write> _write_queue;
-      deque<queued_write> _sync_write_queue; // sync_write_queue will be sent first
+      std::array<deque<queued_write>, size_t(write_priority::count)> _write_queues; // by write_priority
       deque<queued_write> _out_queue;
 
    }; // queued_buffer
@@ -499,18 +711,35 @@ namespace eosio {
       ~connection();
       void initialize();
 
+      // All the members are used on the main thread, except `reads` while a read is in progress, see read_buffer.
+      // close() and connect() give the next socket a new read_buffer, a completion of the old socket keeps its own.
+
       peer_block_state_index  blk_state;
       transaction_state_index trx_state;
       optional<peer_sync_state>    peer_requested;  // this peer is requesting info from us
+      std::deque<peer_sync_state>  peer_sync_queue; // further ranges this peer requested, served after peer_requested
+
+      std::deque<peer_sync_state>  sync_ranges;     // ranges requested from this peer during sync, in request order
+      bool                         announce_trx = false; // relay transactions to this peer as ids it requests, not pushes
+      vector<transaction_id_type>  trx_announcements;    // ids not yet announced to this peer
+      uint32_t                     sync_span{0};    // size of the next range requested from this peer, adapted to its throughput
+
+      /// a compact block from this peer waiting for the transactions requested from it
+      struct pending_compact_block {
+         signed_block_ptr    block;
+         block_id_type       id;
+         vector<uint32_t>    missing;
+         fc::time_point      received;
+      };
+      optional<pending_compact_block> pending_compact;
       boost::asio::io_context&                  server_ioc;
       boost::asio::io_context::strand           strand;
       socket_ptr                                socket;
-
-      fc::message_buffer<1024*1024>    pending_message_buffer;
-      fc::optional<std::size_t>        outstanding_read_bytes;
+      read_buffer_ptr                           reads = std::make_shared<read_buffer>();
 
 
       queued_buffer           buffer_queue;
+      peer_traffic            traffic;
 
       uint32_t                trx_in_progress_size = 0;
       fc::sha256              node_id;
@@ -527,6 +756,11 @@ namespace eosio {
       block_id_type          fork_head;
       uint32_t               fork_head_num = 0;
       optional<request_message> last_req;
+      fc::time_point         last_req_time;   ///< when last_req was sent, for peer_score::fetch_latency_us
+      peer_score             score;
+
+      /// failure sample of score, a timed out fetch or sync request
+      void score_request( bool failed );
 
       ///@{
       /// HAYA: [cyb-284] use net_plugin in randpa
@@ -539,6 +773,8 @@ namespace eosio {
          stat.connecting = connecting;
          stat.syncing = syncing;
          stat.last_handshake = last_handshake_recv;
+         stat.score = score;
+         stat.cost = score.cost();
          return stat;
       }
 
@@ -608,10 +844,11 @@ namespace eosio {
       void enqueue_block( const signed_block_ptr& sb, bool trigger_send = true, bool to_sync_queue = false);
       void enqueue_buffer( const std::shared_ptr<std::vector<char>>& send_buffer,
                            bool trigger_send, go_away_reason close_after_send,
-                           bool to_sync_queue = false);
+                           write_priority priority = write_priority::general);
       void cancel_sync(go_away_reason);
       void flush_queues();
       void enqueue_sync_block();
+      void announce_transactions();
       void request_sync_blocks(uint32_t start, uint32_t end);
 
       void cancel_wait();
@@ -623,7 +860,12 @@ namespace eosio {
       void queue_write(const std::shared_ptr<vector<char>>& buff,
                        bool trigger_send,
                        std::function<void(boost::system::error_code, std::size_t)> callback,
-                       bool to_sync_queue = false);
+                       write_priority priority = write_priority::general);
+      /// `data` is sent without being copied, `owner` keeps it alive until then
+      void queue_write(std::shared_ptr<const void> owner, boost::asio::const_buffer data,
+                       bool trigger_send,
+                       std::function<void(boost::system::error_code, std::size_t)> callback,
+                       write_priority priority = write_priority::general);
       void do_queue_write();
 
       bool add_peer_block(const peer_block_state& pbs);
@@ -658,7 +900,9 @@ namespace eosio {
    struct msg_handler : public fc::visitor<void> {
       net_plugin_impl &impl;
       connection_ptr c;
-      msg_handler( net_plugin_impl &imp, const connection_ptr& conn) : impl(imp), c(conn) {}
+      fc::time_point received;
+      msg_handler( net_plugin_impl &imp, const connection_ptr& conn, const fc::time_point& received)
+         : impl(imp), c(conn), received(received) {}
 
       void operator()( const signed_block& msg ) const {
          EOS_ASSERT( false, plugin_config_exception, "operator()(signed_block&&) should be called" );
@@ -674,11 +918,14 @@ namespace eosio {
       }
 
       void operator()( signed_block&& msg ) const {
-         impl.handle_message( c, std::make_shared<signed_block>( std::move( msg ) ) );
+         impl.handle_message( c, std::make_shared<signed_block>( std::move( msg ) ), received );
       }
       void operator()( packed_transaction&& msg ) const {
          impl.handle_message( c, std::make_shared<packed_transaction>( std::move( msg ) ) );
       }
+      void operator()( compact_block_message& msg ) const {
+         impl.handle_message( c, msg, received );
+      }
 
       template <typename T>
       void operator()( T&& msg ) const
@@ -699,22 +946,42 @@ namespace eosio {
       uint32_t       sync_last_requested_num{0};
       uint32_t       sync_next_expected_num{0};
       uint32_t       sync_req_span{0};
-      connection_ptr source;
+      uint32_t       sync_peer_ranges{0};
       stages         state{in_sync};
 
+      /// ranges of peers that stopped serving them, requested again before the next ones
+      std::set<std::pair<uint32_t, uint32_t>> sync_unassigned;
+
+      struct buffered_block {
+         connection_ptr    conn;
+         signed_block_ptr  block;
+         fc::time_point    received;
+      };
+      /// blocks received ahead of the next block to apply, by block number
+      std::map<uint32_t, buffered_block> sync_buffer;
+
       chain_plugin* chain_plug = nullptr;
 
       constexpr static auto stage_str(stages s);
 
+      std::pair<uint32_t, uint32_t> next_range(const connection_ptr& c);
+      void release_ranges(const connection_ptr& c);
+      void reset_sync();
+
    public:
-      explicit sync_manager(uint32_t span);
+      sync_manager(uint32_t span, uint32_t peer_ranges);
       void set_state(stages s);
       bool sync_required();
       void send_handshakes();
       bool syncing_with_peer() const { return state == lib_catchup; }
       bool is_active(const connection_ptr& conn);
       void reset_lib_num(const connection_ptr& conn);
-      void request_next_chunk(const connection_ptr& conn = connection_ptr());
+      /// requests ranges from every current peer below its limit of outstanding ranges
+      void request_ranges();
+      /// accounts a block received from `c` against the ranges requested from it
+      void recv_range_block(const connection_ptr& c, uint32_t blk_num);
+      /// keeps a block received ahead of the blocks it links to, true if buffered
+      bool buffer_block(const connection_ptr& c, const signed_block_ptr& b, const fc::time_point& received);
       void start_sync(const connection_ptr& c, uint32_t target);
       void reassign_fetch(const connection_ptr& c, go_away_reason reason);
       bool verify_catchup(const connection_ptr& c, uint32_t num, const block_id_type& id);
@@ -729,10 +996,20 @@ namespace eosio {
    public:
       std::multimap<block_id_type, connection_ptr, sha256_less> received_blocks;
       std::multimap<transaction_id_type, connection_ptr, sha256_less> received_transactions;
+      /// announced transactions requested from a peer, by the time another announcing peer may be asked
+      std::map<transaction_id_type, fc::time_point, sha256_less> requested_transactions;
+      block_buffer_index block_buffers; ///< reversible blocks, packed once for broadcast and sync
+
+      std::shared_ptr<vector<char>> get_block_buffer(const signed_block_ptr& b, const block_id_type& id);
+      /// the block with the transactions in local_txns pruned, null if there are none
+      std::shared_ptr<vector<char>> get_compact_block_buffer(const signed_block_ptr& b, const block_id_type& id);
+      /// the block buffer to send to `c`, compressed if it supports it
+      std::shared_ptr<vector<char>> get_block_buffer(const connection_ptr& c, const signed_block_ptr& b, const block_id_type& id);
 
       void bcast_transaction(const transaction_metadata_ptr& trx);
       void rejected_transaction(const transaction_id_type& msg);
-      void bcast_block(const signed_block_ptr& b, const block_id_type& id);
+      /// `early`: the block is only header validated, it is relayed to the peers that support it
+      void bcast_block(const signed_block_ptr& b, const block_id_type& id, bool early = false);
       void rejected_block(const block_id_type& id);
 
       void recv_block(const connection_ptr& conn, const block_id_type& msg, uint32_t bnum);
@@ -743,6 +1020,69 @@ namespace eosio {
       void retry_fetch(const connection_ptr& conn);
    };
 
+   /**
+    * Fetches a snapshot from peers for chain_plugin to load at the next start, while the chain is at genesis.
+    *
+    * A manifest is chosen once min_peers current peers offer the same one, or one peer offers the trusted root;
+    * the newest such manifest is taken. Its chunks are then requested from every peer offering it, a few at a
+    * time from each, and checked against the manifest as they arrive. A peer sending a chunk that does not match
+    * is disconnected and its chunks are requested from the others.
+    */
+   class snapshot_fetcher {
+   public:
+      snapshot_fetcher(const fc::path& target, uint32_t min_peers, const optional<digest_type>& trusted_root);
+
+      void request_manifest(const connection_ptr& c);
+      void recv_manifest(const connection_ptr& c, const snapshot_manifest& m);
+      void recv_chunk(const connection_ptr& c, snapshot_chunk_message& msg);
+      /// asks the manifests of new peers, chooses a manifest, requests the chunks of expired requests again
+      void tick();
+      bool done() const { return state == finished; }
+
+   private:
+      enum stages {
+         manifests,
+         chunks,
+         finished
+      };
+
+      struct offer {
+         snapshot_manifest          manifest;
+         std::set<connection_ptr>   peers;
+      };
+
+      struct chunk_request {
+         connection_ptr   peer;
+         fc::time_point   sent;
+      };
+
+      void choose_manifest();
+      void start_chunks(offer&& o);
+      void request_chunks();
+      optional<uint32_t> next_missing();
+      void release(const connection_ptr& c);
+      void finish();
+
+      fc::path                                      target;
+      uint32_t                                      min_peers = 2;
+      optional<digest_type>                         trusted_root;
+      stages                                        state{manifests};
+
+      std::map<connection_ptr, fc::time_point>      manifest_requested;
+      std::set<connection_ptr>                      banned; ///< sent a chunk that does not match its manifest
+      /// by root of the offered manifest
+      std::map<digest_type, offer, sha256_less>     offers;
+
+      offer                                         chosen;
+      std::ofstream                                 out;
+      std::vector<bool>                             received;
+      uint32_t                                      received_count = 0;
+      uint32_t                                      missing_from = 0; ///< chunks before it are received
+      std::map<uint32_t, chunk_request>             in_flight;
+      std::map<connection_ptr, uint32_t>            peer_in_flight;
+      fc::time_point                                started;
+   };
+
    //---------------------------------------------------------------------------
 
    connection::connection( string endpoint )
@@ -750,7 +1090,7 @@ namespace eosio {
         trx_state(),
         peer_requested(),
         server_ioc( my_impl->thread_pool->get_executor() ),
-        strand( app().get_io_service() ),
+        strand( my_impl->thread_pool->get_executor() ),
         socket( std::make_shared<tcp::socket>( my_impl->thread_pool->get_executor() ) ),
         node_id(),
         last_handshake_recv(),
@@ -770,7 +1110,7 @@ namespace eosio {
         num(get_new_num())
         ///@}
    {
-      fc_ilog( logger, "created connection to ${n}", ("n", endpoint) );
+      async_ilog( logger, "created connection to ${n}", ("n", endpoint) );
       initialize();
    }
 
@@ -779,7 +1119,7 @@ namespace eosio {
         trx_state(),
         peer_requested(),
         server_ioc( my_impl->thread_pool->get_executor() ),
-        strand( app().get_io_service() ),
+        strand( my_impl->thread_pool->get_executor() ),
         socket( s ),
         node_id(),
         last_handshake_recv(),
@@ -799,7 +1139,7 @@ namespace eosio {
         num(get_new_num())
         ///@}
    {
-      fc_ilog( logger, "accepted network connection" );
+      async_ilog( logger, "accepted network connection" );
       initialize();
    }
 
@@ -819,8 +1159,33 @@ namespace eosio {
       return (connected() && !syncing);
    }
 
+   /// exponential moving average, starting at the first sample
+   static void update_average( double& average, double sample ) {
+      average = average == 0 ? sample : average + def_score_smoothing * ( sample - average );
+   }
+
+   void connection::score_request( bool failed ) {
+      score.failure_rate += def_score_smoothing * ( ( failed ? 1. : 0. ) - score.failure_rate );
+      if( failed ) {
+         ++score.failures;
+      }
+   }
+
+   /// current connections ordered by peer_score::cost, best first
+   static std::vector<connection_ptr> connections_by_score() {
+      std::vector<connection_ptr> result( my_impl->connections.begin(), my_impl->connections.end() );
+      std::stable_sort( result.begin(), result.end(), []( const connection_ptr& a, const connection_ptr& b ) {
+         return a->score.cost() < b->score.cost();
+      });
+      return result;
+   }
+
    void connection::reset() {
       peer_requested.reset();
+      peer_sync_queue.clear();
+      announce_trx = false;
+      trx_announcements.clear();
+      pending_compact.reset();
       blk_state.clear();
       trx_state.clear();
    }
@@ -831,9 +1196,13 @@ namespace eosio {
 
    void connection::close() {
       if(socket) {
+         if( socket->is_open() ) {
+            app().get_channel<net_plugin::peer_closed>().publish(priority::medium, num);
+         }
          boost::system::error_code ec;
          socket->close( ec );
          socket.reset( new tcp::socket( my_impl->thread_pool->get_executor() ) );
+         reads = std::make_shared<read_buffer>();
       }
       else {
          fc_wlog( logger, "no socket to close!" );
@@ -851,8 +1220,8 @@ namespace eosio {
       last_handshake_recv = handshake_message();
       last_handshake_sent = handshake_message();
       my_impl->sync_master->reset_lib_num(shared_from_this());
-      fc_ilog(logger, "closing ${a}, ${p}", ("a",peer_addr)("p",peer_name()));
-      fc_dlog(logger, "canceling wait on ${p}", ("p",peer_name()));
+      async_ilog(logger, "closing ${a}, ${p}", ("a",peer_addr)("p",peer_name()));
+      async_dlog(logger, "canceling wait on ${p}", ("p",peer_name()));
       cancel_wait();
    }
 
@@ -867,6 +1236,19 @@ namespace eosio {
       }
    }
 
+   void connection::announce_transactions() {
+      if( trx_announcements.empty() ) {
+         return;
+      }
+      notice_message note;
+      note.known_trx.mode = normal;
+      note.known_trx.pending = trx_announcements.size();
+      note.known_trx.ids = std::move( trx_announcements );
+      note.known_blocks.mode = none;
+      trx_announcements.clear();
+      enqueue( note );
+   }
+
    void connection::txn_send(const vector<transaction_id_type>& ids) {
       for(const auto& t : ids) {
          auto tx = my_impl->local_txns.get<by_id>().find(t);
@@ -882,13 +1264,13 @@ namespace eosio {
       notice_message note;
       note.known_blocks.mode = normal;
       note.known_blocks.pending = 0;
-      fc_dlog(logger, "head_num = ${h}",("h",head_num));
+      async_dlog(logger, "head_num = ${h}",("h",head_num));
       if(head_num == 0) {
          enqueue(note);
          return;
       }
       if (last_handshake_recv.generation >= 1) {
-         fc_dlog( logger, "maybe truncating branch at = ${h}:${id}",
+         async_dlog( logger, "maybe truncating branch at = ${h}:${id}",
                   ("h", block_header::num_from_id(last_handshake_recv.head_id))("id", last_handshake_recv.head_id) );
       }
 
@@ -914,10 +1296,10 @@ namespace eosio {
       }
 
       if( peer_requested->start_block <= peer_requested->end_block ) {
-         fc_ilog( logger, "enqueue ${s} - ${e} to ${p}", ("s", peer_requested->start_block)("e", peer_requested->end_block)("p", peer_name()) );
+         async_ilog( logger, "enqueue ${s} - ${e} to ${p}", ("s", peer_requested->start_block)("e", peer_requested->end_block)("p", peer_name()) );
          enqueue_sync_block();
       } else {
-         fc_ilog( logger, "nothing to enqueue ${p} to ${p}", ("p", peer_name()) );
+         async_ilog( logger, "nothing to enqueue ${p} to ${p}", ("p", peer_name()) );
          peer_requested.reset();
       }
 
@@ -930,11 +1312,11 @@ namespace eosio {
       try {
          signed_block_ptr b = cc.fetch_block_by_id(blkid);
          if(b) {
-            fc_dlog(logger,"found block for id at num ${n}",("n",b->block_num()));
+            async_dlog(logger,"found block for id at num ${n}",("n",b->block_num()));
             add_peer_block({blkid, block_header::num_from_id(blkid)});
             enqueue_block( b );
          } else {
-            fc_ilog( logger, "fetch block by id returned null, id ${id} for ${p}",
+            async_ilog( logger, "fetch block by id returned null, id ${id} for ${p}",
                      ("id",blkid)("p",peer_name()) );
          }
       }
@@ -957,7 +1339,7 @@ namespace eosio {
       static_assert( std::is_same_v<decltype(sent_handshake_count), int16_t>, "INT16_MAX based on int16_t" );
       if( sent_handshake_count == INT16_MAX ) sent_handshake_count = 1; // do not wrap
       last_handshake_sent.generation = ++sent_handshake_count;
-      fc_ilog( logger, "Sending handshake generation ${g} to ${ep}, lib ${lib}, head ${head}, id ${id}",
+      async_ilog( logger, "Sending handshake generation ${g} to ${ep}, lib ${lib}, head ${head}, id ${id}",
                ("g", last_handshake_sent.generation)("ep", peer_name())
                ("lib", last_handshake_sent.last_irreversible_block_num)
                ("head", last_handshake_sent.head_num)("id", last_handshake_sent.head_id.str().substr(8,16)) );
@@ -984,8 +1366,15 @@ namespace eosio {
    void connection::queue_write(const std::shared_ptr<vector<char>>& buff,
                                 bool trigger_send,
                                 std::function<void(boost::system::error_code, std::size_t)> callback,
-                                bool to_sync_queue) {
-      if( !buffer_queue.add_write_queue( buff, callback, to_sync_queue )) {
+                                write_priority priority) {
+      queue_write( buff, boost::asio::buffer( *buff ), trigger_send, std::move( callback ), priority );
+   }
+
+   void connection::queue_write(std::shared_ptr<const void> owner, boost::asio::const_buffer data,
+                                bool trigger_send,
+                                std::function<void(boost::system::error_code, std::size_t)> callback,
+                                write_priority priority) {
+      if( !buffer_queue.add_write_queue( std::move( owner ), data, callback, priority )) {
          fc_wlog( logger, "write_queue full ${s} bytes, giving up on connection ${p}",
                   ("s", buffer_queue.write_queue_size())("p", peer_name()) );
          my_impl->close( shared_from_this() );
@@ -1006,11 +1395,12 @@ namespace eosio {
          return;
       }
       std::vector<boost::asio::const_buffer> bufs;
-      buffer_queue.fill_out_buffer( bufs );
+      traffic.write_wait_us += buffer_queue.fill_out_buffer( bufs );
+      traffic.writes += bufs.size();
 
       boost::asio::async_write(*socket, bufs,
             boost::asio::bind_executor(strand, [c, socket=socket]( boost::system::error_code ec, std::size_t w ) {
-         app().post(priority::high, [c, ec, w]() {
+         chain::instrumented_post(app(), priority::high, chain::executor_category::net, [c, ec, w]() {
             try {
                auto conn = c.lock();
                if(!conn)
@@ -1029,6 +1419,7 @@ namespace eosio {
                   my_impl->close(conn);
                   return;
                }
+               conn->traffic.bytes_out += w;
                conn->buffer_queue.clear_out_queue();
                conn->enqueue_sync_block();
                conn->do_queue_write();
@@ -1053,7 +1444,7 @@ namespace eosio {
    }
 
    void connection::cancel_sync(go_away_reason reason) {
-      fc_dlog(logger,"cancel sync reason = ${m}, write queue size ${o} bytes peer ${p}",
+      async_dlog(logger,"cancel sync reason = ${m}, write queue size ${o} bytes peer ${p}",
               ("m",reason_str(reason)) ("o", buffer_queue.write_queue_size())("p", peer_name()));
       cancel_wait();
       flush_queues();
@@ -1065,14 +1456,47 @@ namespace eosio {
          break;
       }
       default:
-         fc_ilog(logger, "sending empty request but not calling sync wait on ${p}", ("p",peer_name()));
+         async_ilog(logger, "sending empty request but not calling sync wait on ${p}", ("p",peer_name()));
          enqueue( ( sync_request_message ) {0,0} );
       }
    }
 
+   /// header of the signed_block net_message whose packed block is `packed_size` bytes
+   static std::shared_ptr<std::vector<char>> create_block_header_buffer( size_t packed_size ) {
+      const uint32_t which_size = fc::raw::pack_size( unsigned_int( signed_block_which ) );
+      const uint32_t payload_size = which_size + packed_size;
+
+      const char* const header = reinterpret_cast<const char* const>(&payload_size); // avoid variable size encoding of uint32_t
+      constexpr size_t header_size = sizeof( payload_size );
+
+      auto send_buffer = std::make_shared<vector<char>>( header_size + which_size );
+      fc::datastream<char*> ds( send_buffer->data(), send_buffer->size() );
+      ds.write( header, header_size );
+      fc::raw::pack( ds, unsigned_int( signed_block_which ) );
+      return send_buffer;
+   }
+
+   static std::shared_ptr<std::vector<char>> create_send_buffer( const block_log::packed_block_view& packed ) {
+      // same layout as create_send_buffer( signed_block_which, signed_block ), block is already packed
+      const uint32_t which_size = fc::raw::pack_size( unsigned_int( signed_block_which ) );
+      const uint32_t payload_size = which_size + packed.size;
+
+      const char* const header = reinterpret_cast<const char* const>(&payload_size); // avoid variable size encoding of uint32_t
+      constexpr size_t header_size = sizeof( payload_size );
+      const size_t buffer_size = header_size + payload_size;
+
+      auto send_buffer = std::make_shared<vector<char>>( buffer_size );
+      fc::datastream<char*> ds( send_buffer->data(), buffer_size );
+      ds.write( header, header_size );
+      fc::raw::pack( ds, unsigned_int( signed_block_which ) );
+      ds.write( packed.data, packed.size );
+
+      return send_buffer;
+   }
+
    void connection::enqueue_sync_block() {
       connection_wptr c(shared_from_this());
-      app().post( priority::low, [c]() {
+      chain::instrumented_post( app(), priority::low, chain::executor_category::net, [c]() {
          auto conn = c.lock();
          if(!conn) return;
          if( !conn->peer_requested )
@@ -1080,12 +1504,29 @@ namespace eosio {
          uint32_t num = ++conn->peer_requested->last;
          if( num == conn->peer_requested->end_block ) {
             conn->peer_requested.reset();
-            fc_ilog( logger, "completing enqueue_sync_block ${num} to ${p}", ("num", num)( "p", conn->peer_name() ) );
+            async_ilog( logger, "completing enqueue_sync_block ${num} to ${p}", ("num", num)( "p", conn->peer_name() ) );
+            if( !conn->peer_sync_queue.empty() ) {
+               conn->peer_requested = conn->peer_sync_queue.front();
+               conn->peer_sync_queue.pop_front();
+            }
          }
          try {
             controller& cc = my_impl->chain_plug->chain();
-            signed_block_ptr sb = cc.fetch_block_by_number( num );
-            if( sb ) {
+            if( auto packed = cc.fetch_packed_block_by_number( num ) ) {
+               // irreversible block, send bytes of the block log without unpacking
+               if( conn->protocol_version >= proto_compression && my_impl->p2p_compression ) {
+                  auto buffer = create_send_buffer( packed );
+                  if( auto compressed = my_impl->compress_send_buffer( buffer ) ) {
+                     buffer = std::move( compressed );
+                  }
+                  conn->enqueue_buffer( buffer, true, no_reason, write_priority::sync );
+               } else {
+                  // the header is written before the mapped bytes of the block log, which are not copied
+                  auto noop = []( boost::system::error_code, std::size_t ) {};
+                  conn->queue_write( create_block_header_buffer( packed.size ), false, noop, write_priority::sync );
+                  conn->queue_write( packed.mapping, boost::asio::buffer( packed.data, packed.size ), true, noop, write_priority::sync );
+               }
+            } else if( signed_block_ptr sb = cc.fetch_block_by_number( num ) ) {
                conn->enqueue_block( sb, true, true );
             }
          } catch( ... ) {
@@ -1096,16 +1537,15 @@ namespace eosio {
 
 ///@{
 /// HAYA: [cyb-277] add net msg count metrics
-#define update_metric(type, m, x) { \
-   if (net_message::tag<x>::value == m.which()) { \
-      app().get_plugin<telemetry_plugin>().update_counter("net_" #type "_" #x "_cnt"); \
-      app().get_plugin<telemetry_plugin>().update_counter("net_" #type "_total_cnt"); \
-   } \
+#define update_metric(type, m) { \
+   my_impl->type ## _msg_counters[m.which()].increment(); \
+   my_impl->type ## _msg_total_counter.increment(); \
 }
 
 #define add_metric(x) { \
-   app().get_plugin<telemetry_plugin>().add_counter("net_in_" #x "_cnt"); \
-   app().get_plugin<telemetry_plugin>().add_counter("net_out_" #x "_cnt"); \
+   my->msg_type_names[net_message::tag<x>::value] = #x; \
+   my->in_msg_counters[net_message::tag<x>::value] = app().get_plugin<telemetry_plugin>().register_counter("net_in_" #x "_cnt"); \
+   my->out_msg_counters[net_message::tag<x>::value] = app().get_plugin<telemetry_plugin>().register_counter("net_out_" #x "_cnt"); \
 }
 ///@}
 
@@ -1127,21 +1567,15 @@ namespace eosio {
       ds.write( header, header_size );
       fc::raw::pack( ds, m );
 
-      enqueue_buffer( send_buffer, trigger_send, close_after_send );
+      enqueue_buffer( send_buffer, trigger_send, close_after_send,
+                      m.contains<custom_message>() ? write_priority::consensus
+                      : m.contains<snapshot_chunk_message>() ? write_priority::sync : write_priority::general );
 
       ///@{
       /// HAYA: [cyb-277] add net msg count metrics
-      update_metric(out, m, handshake_message);
-      update_metric(out, m, chain_size_message);
-      update_metric(out, m, go_away_message);
-      update_metric(out, m, time_message);
-      update_metric(out, m, notice_message);
-      update_metric(out, m, request_message);
-      update_metric(out, m, sync_request_message);
-      update_metric(out, m, signed_block);
-      update_metric(out, m, packed_transaction);
-      update_metric(out, m, custom_message);
+      update_metric(out, m);
       ///@}
+      ++traffic.msgs_out[m.which()];
    }
 
    template< typename T>
@@ -1164,6 +1598,26 @@ namespace eosio {
       return send_buffer;
    }
 
+   static std::shared_ptr<std::vector<char>> create_custom_message_buffer( uint32_t type, const std::vector<char>& data ) {
+      // same layout as create_send_buffer( custom_message_which, custom_message ), without copying data to a custom_message
+      const uint32_t which_size = fc::raw::pack_size( unsigned_int( custom_message_which ) );
+      const uint32_t payload_size = which_size + fc::raw::pack_size( type ) + fc::raw::pack_size( data );
+
+      const char* const header = reinterpret_cast<const char* const>(&payload_size); // avoid variable size encoding of uint32_t
+      constexpr size_t header_size = sizeof( payload_size );
+      static_assert( header_size == message_header_size, "invalid message_header_size" );
+      const size_t buffer_size = header_size + payload_size;
+
+      auto send_buffer = std::make_shared<vector<char>>( buffer_size );
+      fc::datastream<char*> ds( send_buffer->data(), buffer_size );
+      ds.write( header, header_size );
+      fc::raw::pack( ds, unsigned_int( custom_message_which ) );
+      fc::raw::pack( ds, type );
+      fc::raw::pack( ds, data );
+
+      return send_buffer;
+   }
+
    static std::shared_ptr<std::vector<char>> create_send_buffer( const signed_block_ptr& sb ) {
       // this implementation is to avoid copy of signed_block to net_message
       // matches which of net_message for signed_block
@@ -1177,12 +1631,13 @@ namespace eosio {
    }
 
    void connection::enqueue_block( const signed_block_ptr& sb, bool trigger_send, bool to_sync_queue) {
-      enqueue_buffer( create_send_buffer( sb ), trigger_send, no_reason, to_sync_queue);
+      enqueue_buffer( my_impl->dispatcher->get_block_buffer( shared_from_this(), sb, sb->id() ), trigger_send, no_reason,
+                      to_sync_queue ? write_priority::sync : write_priority::general );
    }
 
    void connection::enqueue_buffer( const std::shared_ptr<std::vector<char>>& send_buffer,
                                     bool trigger_send, go_away_reason close_after_send,
-                                    bool to_sync_queue)
+                                    write_priority priority)
    {
       connection_wptr weak_this = shared_from_this();
       queue_write(send_buffer,trigger_send,
@@ -1199,7 +1654,7 @@ namespace eosio {
                         fc_wlog(logger, "connection expired before enqueued net_message called callback!");
                      }
                   },
-                  to_sync_queue);
+                  priority);
    }
 
    void connection::cancel_wait() {
@@ -1211,7 +1666,7 @@ namespace eosio {
       response_expected->expires_from_now( my_impl->resp_expected_period);
       connection_wptr c(shared_from_this());
       response_expected->async_wait( [c]( boost::system::error_code ec ) {
-         app().post(priority::low, [c, ec]() {
+         chain::instrumented_post(app(), priority::low, chain::executor_category::net, [c, ec]() {
             connection_ptr conn = c.lock();
             if (!conn) {
                // connection was destroyed before this lambda was delivered
@@ -1227,7 +1682,7 @@ namespace eosio {
       response_expected->expires_from_now( my_impl->resp_expected_period);
       connection_wptr c(shared_from_this());
       response_expected->async_wait( [c]( boost::system::error_code ec ) {
-         app().post(priority::low, [c, ec]() {
+         chain::instrumented_post(app(), priority::low, chain::executor_category::net, [c, ec]() {
             connection_ptr conn = c.lock();
             if (!conn) {
                // connection was destroyed before this lambda was delivered
@@ -1273,7 +1728,7 @@ namespace eosio {
       }
       else if( ec == boost::asio::error::operation_aborted ) {
          if( !connected() ) {
-            fc_dlog(logger, "fetch timeout was cancelled due to dead connection");
+            async_dlog(logger, "fetch timeout was cancelled due to dead connection");
          }
       }
       else {
@@ -1303,12 +1758,12 @@ namespace eosio {
 
    //-----------------------------------------------------------
 
-    sync_manager::sync_manager( uint32_t req_span )
+    sync_manager::sync_manager( uint32_t req_span, uint32_t peer_ranges )
       :sync_known_lib_num( 0 )
       ,sync_last_requested_num( 0 )
       ,sync_next_expected_num( 1 )
       ,sync_req_span( req_span )
-      ,source()
+      ,sync_peer_ranges( peer_ranges )
       ,state(in_sync)
    {
       chain_plug = app().find_plugin<chain_plugin>();
@@ -1328,14 +1783,14 @@ namespace eosio {
       if (state == newstate) {
          return;
       }
-      fc_dlog(logger, "old state ${os} becoming ${ns}",("os",stage_str(state))("ns",stage_str(newstate)));
+      async_dlog(logger, "old state ${os} becoming ${ns}",("os",stage_str(state))("ns",stage_str(newstate)));
       state = newstate;
    }
 
    bool sync_manager::is_active(const connection_ptr& c) {
       if (state == head_catchup && c) {
          bool fhset = c->fork_head != block_id_type();
-         fc_dlog(logger, "fork_head_num = ${fn} fork_head set = ${s}",
+         async_dlog(logger, "fork_head_num = ${fn} fork_head set = ${s}",
                  ("fn", c->fork_head_num)("s", fhset));
             return c->fork_head != block_id_type() && c->fork_head_num < chain_plug->chain().fork_db_pending_head_block_num();
       }
@@ -1343,116 +1798,147 @@ namespace eosio {
    }
 
    void sync_manager::reset_lib_num(const connection_ptr& c) {
-      if(state == in_sync) {
-         source.reset();
-      }
       if( c->current() ) {
          if( c->last_handshake_recv.last_irreversible_block_num > sync_known_lib_num) {
             sync_known_lib_num =c->last_handshake_recv.last_irreversible_block_num;
          }
-      } else if( c == source ) {
-         sync_last_requested_num = 0;
-         request_next_chunk();
+      } else if( !c->sync_ranges.empty() ) {
+         release_ranges( c );
+         request_ranges();
       }
    }
 
    bool sync_manager::sync_required() {
-      fc_dlog(logger, "last req = ${req}, last recv = ${recv} known = ${known} our head = ${head}",
+      async_dlog(logger, "last req = ${req}, last recv = ${recv} known = ${known} our head = ${head}",
               ("req",sync_last_requested_num)("recv",sync_next_expected_num)("known",sync_known_lib_num)("head",chain_plug->chain().fork_db_pending_head_block_num()));
 
       return( sync_last_requested_num < sync_known_lib_num ||
               chain_plug->chain().fork_db_pending_head_block_num() < sync_last_requested_num );
    }
 
-   void sync_manager::request_next_chunk( const connection_ptr& conn ) {
-      uint32_t head_block = chain_plug->chain().fork_db_pending_head_block_num();
-
-      if (head_block < sync_last_requested_num && source && source->current()) {
-         fc_ilog(logger, "ignoring request, head is ${h} last req = ${r} source is ${p}",
-                  ("h",head_block)("r",sync_last_requested_num)("p",source->peer_name()));
-         return;
+   std::pair<uint32_t, uint32_t> sync_manager::next_range( const connection_ptr& c ) {
+      const uint32_t peer_lib = c->last_handshake_recv.last_irreversible_block_num;
+      for( auto itr = sync_unassigned.begin(); itr != sync_unassigned.end(); ++itr ) {
+         if( itr->second <= peer_lib ) {
+            auto range = *itr;
+            sync_unassigned.erase( itr );
+            return range;
+         }
       }
 
-      /* ----------
-       * next chunk provider selection criteria
-       * a provider is supplied and able to be used, use it.
-       * otherwise select the next available from the list, round-robin style.
-       */
-
-      if (conn && conn->current() ) {
-         source = conn;
+      const uint32_t head_block = chain_plug->chain().fork_db_pending_head_block_num();
+      const uint32_t start = std::max( sync_last_requested_num + 1, sync_next_expected_num );
+      if( start > sync_known_lib_num || start > peer_lib || start > head_block + sync_req_span * def_sync_max_ahead_spans ) {
+         return {0, 0};
       }
-      else {
-         if( my_impl->connections.size() == 0 ) {
-            source.reset();
-         } else if( my_impl->connections.size() == 1 ) {
-            if (!source) {
-               source = *my_impl->connections.begin();
-            }
-         } else {
-            // init to a linear array search
-            auto cptr = my_impl->connections.begin();
-            auto cend = my_impl->connections.end();
-            // do we remember the previous source?
-            if( source ) {
-               //try to find it in the list
-               cptr = my_impl->connections.find( source );
-               cend = cptr;
-               if( cptr == my_impl->connections.end() ) {
-                  //not there - must have been closed! cend is now connections.end, so just flatten the ring.
-                  source.reset();
-                  cptr = my_impl->connections.begin();
-               } else {
-                  //was found - advance the start to the next. cend is the old source.
-                  if( ++cptr == my_impl->connections.end() && cend != my_impl->connections.end() ) {
-                     cptr = my_impl->connections.begin();
-                  }
-               }
-            }
+      if( c->sync_span == 0 ) {
+         c->sync_span = sync_req_span;
+      }
+      const uint32_t end = std::min( { start + c->sync_span - 1, sync_known_lib_num, peer_lib } );
+      sync_last_requested_num = end;
+      return {start, end};
+   }
 
-            //scan the list of peers looking for another able to provide sync blocks.
-            if( cptr != my_impl->connections.end() ) {
-               auto cstart_it = cptr;
-               do {
-                  //select the first one which is current and break out.
-                  if( (*cptr)->current() ) {
-                     source = *cptr;
-                     break;
-                  }
-                  if( ++cptr == my_impl->connections.end() )
-                     cptr = my_impl->connections.begin();
-               } while( cptr != cstart_it );
+   void sync_manager::request_ranges() {
+      bool has_source = false;
+      bool outstanding = false;
+      // the best peers take the ranges left by others and the nearest ones
+      for( const auto& c : connections_by_score() ) {
+         if( !c->current() ) {
+            continue;
+         }
+         has_source = true;
+         // older peers replace the range they serve with the last one requested
+         const uint32_t max_ranges = c->protocol_version >= proto_sync_ranges ? sync_peer_ranges : 1;
+         while( c->sync_ranges.size() < max_ranges ) {
+            auto range = next_range( c );
+            if( range.second == 0 ) {
+               break;
             }
-            // no need to check the result, either source advanced or the whole list was checked and the old source is reused.
+            async_ilog( logger, "requesting range ${s} to ${e}, from ${n}", ("n",c->peer_name())("s",range.first)("e",range.second) );
+            c->sync_ranges.emplace_back( range.first, range.second, range.first - 1 );
+            c->request_sync_blocks( range.first, range.second );
          }
+         outstanding = outstanding || !c->sync_ranges.empty();
       }
 
-      // verify there is an available source
-      if (!source || !source->current() ) {
+      if( !has_source ) {
          fc_elog( logger, "Unable to continue syncing at this time");
          sync_known_lib_num = chain_plug->chain().last_irreversible_block_num();
-         sync_last_requested_num = 0;
+         reset_sync();
          set_state(in_sync); // probably not, but we can't do anything else
          return;
       }
+      if( !outstanding && sync_buffer.empty() ) {
+         // nothing left to request until peers report a higher lib
+         send_handshakes();
+      }
+   }
+
+   void sync_manager::recv_range_block( const connection_ptr& c, uint32_t blk_num ) {
+      if( c->sync_ranges.empty() ) {
+         return;
+      }
+      auto& range = c->sync_ranges.front();
+      if( blk_num <= range.last || blk_num > range.end_block ) {
+         return;
+      }
+      range.last = blk_num;
+      if( blk_num == range.end_block ) {
+         // the peer serves its ranges in order, it started the next one now
+         const auto now = fc::time_point::now();
+         const int64_t elapsed_us = std::max<int64_t>( (now - range.start_time).count(), 1 );
+         const uint64_t blocks = range.end_block - range.start_block + 1;
+         const uint64_t span = blocks * std::chrono::duration_cast<std::chrono::microseconds>( def_sync_range_time ).count() / elapsed_us;
+         const uint64_t min_span = std::max( sync_req_span / 4, 1u );
+         const uint64_t max_span = uint64_t( sync_req_span ) * 4;
+         c->sync_span = std::min( std::max( ( c->sync_span + span ) / 2, min_span ), max_span );
+         update_average( c->score.sync_blocks_per_sec, blocks * 1e6 / elapsed_us );
+         c->score_request( false );
+         c->sync_ranges.pop_front();
+         if( !c->sync_ranges.empty() ) {
+            c->sync_ranges.front().start_time = now;
+         }
+      }
+      if( c->sync_ranges.empty() ) {
+         c->cancel_wait();
+      } else {
+         c->sync_wait();
+      }
+      if( blk_num == sync_last_requested_num || c->sync_ranges.size() < sync_peer_ranges ) {
+         request_ranges();
+      }
+   }
 
-      bool request_sent = false;
-      if( sync_last_requested_num != sync_known_lib_num ) {
-         uint32_t start = sync_next_expected_num;
-         uint32_t end = start + sync_req_span - 1;
-         if( end > sync_known_lib_num )
-            end = sync_known_lib_num;
-         if( end > 0 && end >= start ) {
-            fc_ilog(logger, "requesting range ${s} to ${e}, from ${n}",
-                    ("n",source->peer_name())("s",start)("e",end));
-            request_sent = true;
-            source->request_sync_blocks(start, end);
-            sync_last_requested_num = end;
+   void sync_manager::release_ranges( const connection_ptr& c ) {
+      for( const auto& range : c->sync_ranges ) {
+         const uint32_t start = std::max( range.last + 1, sync_next_expected_num );
+         if( start <= range.end_block ) {
+            sync_unassigned.emplace( start, range.end_block );
          }
       }
-      if( !request_sent ) {
-         source->send_handshake();
+      c->sync_ranges.clear();
+      c->sync_span = std::max( c->sync_span / 2, 1u );
+   }
+
+   void sync_manager::reset_sync() {
+      for( const auto& c : my_impl->connections ) {
+         c->sync_ranges.clear();
+      }
+      sync_unassigned.clear();
+      sync_buffer.clear();
+      sync_last_requested_num = 0;
+   }
+
+   bool sync_manager::buffer_block( const connection_ptr& c, const signed_block_ptr& b, const fc::time_point& received ) {
+      const uint32_t blk_num = b->block_num();
+      if( state != lib_catchup || blk_num > sync_last_requested_num ||
+          blk_num <= chain_plug->chain().fork_db_pending_head_block_num() + 1 ) {
+         return false;
       }
+      async_dlog( logger, "buffering block ${n} from ${p}", ("n", blk_num)("p", c->peer_name()) );
+      sync_buffer.emplace( blk_num, buffered_block{ c, b, received } );
+      return true;
    }
 
    void sync_manager::send_handshakes()
@@ -1472,30 +1958,32 @@ namespace eosio {
       uint32_t bnum = chain_plug->chain().last_irreversible_block_num();
       if (!sync_required() || target <= bnum) {
          uint32_t hnum = chain_plug->chain().fork_db_pending_head_block_num();
-         fc_dlog( logger, "We are already caught up, my irr = ${b}, head = ${h}, target = ${t}",
+         async_dlog( logger, "We are already caught up, my irr = ${b}, head = ${h}, target = ${t}",
                   ("b",bnum)("h",hnum)("t",target));
          return;
       }
 
       if (state == in_sync) {
+         reset_sync();
          set_state(lib_catchup);
          sync_next_expected_num = chain_plug->chain().last_irreversible_block_num() + 1;
       }
 
-      fc_ilog(logger, "Catching up with chain, our last req is ${cc}, theirs is ${t} peer ${p}",
+      async_ilog(logger, "Catching up with chain, our last req is ${cc}, theirs is ${t} peer ${p}",
               ( "cc",sync_last_requested_num)("t",target)("p",c->peer_name()));
 
-      request_next_chunk(c);
+      request_ranges();
    }
 
    void sync_manager::reassign_fetch(const connection_ptr& c, go_away_reason reason) {
-      fc_ilog(logger, "reassign_fetch, our last req is ${cc}, next expected is ${ne} peer ${p}",
+      async_ilog(logger, "reassign_fetch, our last req is ${cc}, next expected is ${ne} peer ${p}",
               ( "cc",sync_last_requested_num)("ne",sync_next_expected_num)("p",c->peer_name()));
 
-      if (c == source) {
+      if( !c->sync_ranges.empty() ) {
+         c->score_request( true );
          c->cancel_sync(reason);
-         sync_last_requested_num = 0;
-         request_next_chunk();
+         release_ranges( c );
+         request_ranges();
       }
    }
 
@@ -1523,7 +2011,7 @@ namespace eosio {
       uint32_t head = cc.fork_db_pending_head_block_num();
       block_id_type head_id = cc.fork_db_pending_head_block_id();
       if (head_id == msg.head_id) {
-         fc_ilog( logger, "handshake from ${ep}, lib ${lib}, head ${head}, head id ${id}.. sync 0",
+         async_ilog( logger, "handshake from ${ep}, lib ${lib}, head ${head}, head id ${id}.. sync 0",
                   ("ep", c->peer_name())("lib", msg.last_irreversible_block_num)("head", msg.head_num)
                   ("id", msg.head_id.str().substr(8,16)) );
          // notify peer of our pending transactions
@@ -1535,7 +2023,7 @@ namespace eosio {
          return;
       }
       if (head < peer_lib) {
-         fc_ilog( logger, "handshake from ${ep}, lib ${lib}, head ${head}, head id ${id}.. sync 1",
+         async_ilog( logger, "handshake from ${ep}, lib ${lib}, head ${head}, head id ${id}.. sync 1",
                   ("ep", c->peer_name())("lib", msg.last_irreversible_block_num)("head", msg.head_num)
                   ("id", msg.head_id.str().substr(8,16)) );
          // wait for receipt of a notice message before initiating sync
@@ -1545,7 +2033,7 @@ namespace eosio {
          return;
       }
       if (lib_num > msg.head_num ) {
-         fc_ilog( logger, "handshake from ${ep}, lib ${lib}, head ${head}, head id ${id}.. sync 2",
+         async_ilog( logger, "handshake from ${ep}, lib ${lib}, head ${head}, head id ${id}.. sync 2",
                   ("ep", c->peer_name())("lib", msg.last_irreversible_block_num)("head", msg.head_num)
                   ("id", msg.head_id.str().substr(8,16)) );
          if (msg.generation > 1 || c->protocol_version > proto_base) {
@@ -1561,14 +2049,14 @@ namespace eosio {
       }
 
       if (head < msg.head_num ) {
-         fc_ilog( logger, "handshake from ${ep}, lib ${lib}, head ${head}, head id ${id}.. sync 3",
+         async_ilog( logger, "handshake from ${ep}, lib ${lib}, head ${head}, head id ${id}.. sync 3",
                   ("ep", c->peer_name())("lib", msg.last_irreversible_block_num)("head", msg.head_num)
                   ("id", msg.head_id.str().substr(8,16)) );
          verify_catchup(c, msg.head_num, msg.head_id);
          return;
       }
       else {
-         fc_ilog( logger, "handshake from ${ep}, lib ${lib}, head ${head}, head id ${id}.. sync 4",
+         async_ilog( logger, "handshake from ${ep}, lib ${lib}, head ${head}, head id ${id}.. sync 4",
                   ("ep", c->peer_name())("lib", msg.last_irreversible_block_num)("head", msg.head_num)
                   ("id", msg.head_id.str().substr(8,16)) );
          if (msg.generation > 1 ||  c->protocol_version > proto_base) {
@@ -1607,7 +2095,7 @@ namespace eosio {
       if( req.req_blocks.mode == catch_up ) {
          const controller& cc = chain_plug->chain();
          const auto lib = cc.last_irreversible_block_num();
-         fc_ilog( logger, "catch_up while in ${s}, fork head num = ${fhn} "
+         async_ilog( logger, "catch_up while in ${s}, fork head num = ${fhn} "
                           "target LIB = ${lib} next_expected = ${ne}, id ${id}..., peer ${p}",
                   ("s", stage_str( state ))("fhn", num)("lib", sync_known_lib_num)
                   ("ne", sync_next_expected_num)("id", id.str().substr(8,16))("p", c->peer_name()) );
@@ -1620,7 +2108,7 @@ namespace eosio {
          req.req_blocks.ids.emplace_back( head_id );
       }
       else {
-         fc_ilog( logger, "none notice while in ${s}, fork head num = ${fhn}, id ${id}..., peer ${p}",
+         async_ilog( logger, "none notice while in ${s}, fork head num = ${fhn}, id ${id}..., peer ${p}",
                   ("s", stage_str( state ))("fhn", num)
                   ("id", id.str().substr(8,16))("p", c->peer_name()) );
          c->fork_head_num = 0;
@@ -1631,7 +2119,7 @@ namespace eosio {
    }
 
    void sync_manager::recv_notice(const connection_ptr& c, const notice_message& msg) {
-      fc_ilog(logger, "sync_manager got ${m} block notice",("m",modes_str(msg.known_blocks.mode)));
+      async_ilog(logger, "sync_manager got ${m} block notice",("m",modes_str(msg.known_blocks.mode)));
       if( msg.known_blocks.ids.size() > 1 ) {
          fc_elog( logger, "Invalid notice_message, known_blocks.ids.size ${s}, closing connection: ${p}",
                   ("s", msg.known_blocks.ids.size())("p", c->peer_name()) );
@@ -1643,7 +2131,7 @@ namespace eosio {
             fc_elog( logger,"got a catch up with ids size = 0" );
          } else {
             const block_id_type& id = msg.known_blocks.ids.back();
-            fc_ilog( logger, "notice_message, pending ${p}, blk_num ${n}, id ${id}...",
+            async_ilog( logger, "notice_message, pending ${p}, blk_num ${n}, id ${id}...",
                      ("p", msg.known_blocks.pending)("n", block_header::num_from_id(id))("id",id.str().substr(8,16)) );
             controller& cc = chain_plug->chain();
             if( !cc.fetch_block_by_id( id ) ) {
@@ -1664,8 +2152,7 @@ namespace eosio {
    void sync_manager::rejected_block(const connection_ptr& c, uint32_t blk_num) {
       if( ++c->consecutive_rejected_blocks > def_max_consecutive_rejected_blocks ) {
          fc_wlog( logger, "block ${bn} not accepted from ${p}, closing connection", ("bn",blk_num)("p",c->peer_name()) );
-         sync_last_requested_num = 0;
-         source.reset();
+         reset_sync();
          my_impl->close(c);
          set_state(in_sync);
          send_handshakes();
@@ -1676,10 +2163,10 @@ namespace eosio {
 
    void sync_manager::sync_update_expected(const connection_ptr& c, const block_id_type& blk_id, uint32_t blk_num, bool blk_applied) {
       if( blk_num <= sync_last_requested_num ) {
-         fc_dlog( logger, "sync_last_requested_num: ${r}, sync_next_expected_num: ${e}, sync_known_lib_num: ${k}, sync_req_span: ${s}",
+         async_dlog( logger, "sync_last_requested_num: ${r}, sync_next_expected_num: ${e}, sync_known_lib_num: ${k}, sync_req_span: ${s}",
                   ("r", sync_last_requested_num)("e", sync_next_expected_num)("k", sync_known_lib_num)("s", sync_req_span) );
          if (blk_num != sync_next_expected_num && !blk_applied) {
-            fc_dlog( logger, "expected block ${ne} but got ${bn}, from connection: ${p}",
+            async_dlog( logger, "expected block ${ne} but got ${bn}, from connection: ${p}",
                      ("ne", sync_next_expected_num)( "bn", blk_num )( "p", c->peer_name() ) );
             return;
          }
@@ -1688,13 +2175,12 @@ namespace eosio {
    }
 
    void sync_manager::recv_block(const connection_ptr& c, const block_id_type& blk_id, uint32_t blk_num, bool blk_applied) {
-      fc_dlog(logger, "got block ${bn} from ${p}",("bn",blk_num)("p",c->peer_name()));
+      async_dlog(logger, "got block ${bn} from ${p}",("bn",blk_num)("p",c->peer_name()));
       c->consecutive_rejected_blocks = 0;
       sync_update_expected(c, blk_id, blk_num, blk_applied);
       if (state == head_catchup) {
-         fc_dlog(logger, "sync_manager in head_catchup state");
+         async_dlog(logger, "sync_manager in head_catchup state");
          set_state(in_sync);
-         source.reset();
 
          block_id_type null_id;
          for (const auto& cp : my_impl->connections) {
@@ -1716,52 +2202,136 @@ namespace eosio {
       }
       else if (state == lib_catchup) {
          if( blk_num == sync_known_lib_num ) {
-            fc_dlog( logger, "All caught up with last known last irreversible block resending handshake");
+            async_dlog( logger, "All caught up with last known last irreversible block resending handshake");
+            reset_sync();
             set_state(in_sync);
             send_handshakes();
          }
-         else if (blk_num == sync_last_requested_num) {
-            request_next_chunk();
-         }
-         else {
-            fc_dlog(logger,"calling sync_wait on connection ${p}",("p",c->peer_name()));
-            c->sync_wait();
+         else if( blk_applied ) {
+            // the next block may have arrived from another peer already
+            const uint32_t head = chain_plug->chain().fork_db_pending_head_block_num();
+            while( !sync_buffer.empty() && sync_buffer.begin()->first <= head ) {
+               sync_buffer.erase( sync_buffer.begin() );
+            }
+            if( !sync_buffer.empty() && sync_buffer.begin()->first == head + 1 ) {
+               auto next = std::move( sync_buffer.begin()->second );
+               sync_buffer.erase( sync_buffer.begin() );
+               chain::instrumented_post( app(), priority::medium, chain::executor_category::net, [next{std::move( next )}]() {
+                  my_impl->handle_message( next.conn, next.block, next.received );
+               });
+            }
+            // blocks are requested ahead of head up to a limit
+            request_ranges();
          }
       }
    }
 
    //------------------------------------------------------------------------
 
-   void dispatch_manager::bcast_block(const signed_block_ptr& b, const block_id_type& id) {
+   void dispatch_manager::bcast_block(const signed_block_ptr& b, const block_id_type& id, bool early) {
       std::set<connection_ptr> skips;
       auto range = received_blocks.equal_range(id);
       for (auto org = range.first; org != range.second; ++org) {
          skips.insert(org->second);
       }
-      received_blocks.erase(range.first, range.second);
+      // kept for the relay of the applied block to the other peers
+      if( !early ) {
+         received_blocks.erase(range.first, range.second);
+      }
 
       uint32_t bnum = b->block_num();
       peer_block_state pbstate{id, bnum};
 
-      std::shared_ptr<std::vector<char>> send_buffer;
+      std::shared_ptr<std::vector<char>> compact_buffer;
+      bool compact_built = false;
       for( auto& cp : my_impl->connections ) {
-         if( skips.find( cp ) != skips.end() || !cp->current() ) {
+         if( skips.find( cp ) != skips.end() || !cp->current() || (early && cp->protocol_version < proto_early_relay) ) {
             continue;
          }
          bool has_block = cp->last_handshake_recv.last_irreversible_block_num >= bnum;
          if( !has_block ) {
             if( !cp->add_peer_block( pbstate ) ) {
-               fc_dlog( logger, "not bcast block ${b} to ${p}", ("b", bnum)("p", cp->peer_name()) );
+               async_dlog( logger, "not bcast block ${b} to ${p}", ("b", bnum)("p", cp->peer_name()) );
                continue;
             }
-            if( !send_buffer ) {
-               send_buffer = create_send_buffer( b );
+            if( my_impl->p2p_compact_blocks && cp->protocol_version >= proto_compact_blocks ) {
+               if( !compact_built ) {
+                  compact_buffer = get_compact_block_buffer( b, id );
+                  compact_built = true;
+               }
+               if( compact_buffer ) {
+                  async_dlog(logger, "bcast compact block ${b} to ${p}", ("b", bnum)("p", cp->peer_name()));
+                  cp->enqueue_buffer( compact_buffer, true, no_reason );
+                  continue;
+               }
+            }
+            async_dlog(logger, "bcast block ${b} to ${p}", ("b", bnum)("p", cp->peer_name()));
+            cp->enqueue_buffer( get_block_buffer( cp, b, id ), true, no_reason );
+         }
+      }
+
+   }
+
+   std::shared_ptr<vector<char>> dispatch_manager::get_block_buffer(const signed_block_ptr& b, const block_id_type& id) {
+      auto itr = block_buffers.find( id );
+      if( itr != block_buffers.end() ) {
+         return itr->buffer;
+      }
+      auto buffer = create_send_buffer( b );
+      block_buffers.insert( block_buffer{id, block_header::num_from_id( id ), buffer} );
+      return buffer;
+   }
+
+   std::shared_ptr<vector<char>> dispatch_manager::get_block_buffer(const connection_ptr& c, const signed_block_ptr& b, const block_id_type& id) {
+      auto buffer = get_block_buffer( b, id );
+      if( c->protocol_version < proto_compression ) {
+         return buffer;
+      }
+      auto itr = block_buffers.find( id );
+      if( !itr->compressed_built ) {
+         auto compressed = my_impl->compress_send_buffer( buffer );
+         block_buffers.modify( itr, [&compressed]( block_buffer& e ) {
+            e.compressed = compressed;
+            e.compressed_built = true;
+         });
+      }
+      return itr->compressed ? itr->compressed : buffer;
+   }
+
+   std::shared_ptr<vector<char>> dispatch_manager::get_compact_block_buffer(const signed_block_ptr& b, const block_id_type& id) {
+      get_block_buffer( b, id );
+      auto itr = block_buffers.find( id );
+      if( itr->compact_built ) {
+         return itr->compact;
+      }
+
+      compact_block_message cb;
+      static_cast<signed_block_header&>( cb.block ) = *b;
+      cb.block.block_extensions = b->block_extensions;
+      cb.block.transactions.reserve( b->transactions.size() );
+      const auto& local = my_impl->local_txns.get<by_id>();
+      for( const auto& receipt : b->transactions ) {
+         if( receipt.trx.contains<packed_transaction>() ) {
+            const auto trx_id = receipt.trx.get<packed_transaction>().id();
+            if( local.find( trx_id ) != local.end() ) {
+               cb.pruned.push_back( cb.block.transactions.size() );
+               cb.block.transactions.emplace_back( trx_id );
+               static_cast<transaction_receipt_header&>( cb.block.transactions.back() ) = receipt;
+               continue;
             }
-            fc_dlog(logger, "bcast block ${b} to ${p}", ("b", bnum)("p", cp->peer_name()));
-            cp->enqueue_buffer( send_buffer, true, no_reason );
          }
+         cb.block.transactions.push_back( receipt );
       }
 
+      std::shared_ptr<vector<char>> compact;
+      if( !cb.pruned.empty() ) {
+         compact = create_send_buffer( compact_block_which, cb );
+      }
+      block_buffers.modify( itr, [&compact]( block_buffer& e ) {
+         e.compact = compact;
+         e.compact_built = true;
+      });
+      return compact;
    }
 
    void dispatch_manager::recv_block(const connection_ptr& c, const block_id_type& id, uint32_t bnum) {
@@ -1771,15 +2341,17 @@ namespace eosio {
           c->last_req->req_blocks.mode != none &&
           !c->last_req->req_blocks.ids.empty() &&
           c->last_req->req_blocks.ids.back() == id) {
+         update_average( c->score.fetch_latency_us, ( fc::time_point::now() - c->last_req_time ).count() );
+         c->score_request( false );
          c->last_req.reset();
       }
 
-      fc_dlog(logger, "canceling wait on ${p}", ("p",c->peer_name()));
+      async_dlog(logger, "canceling wait on ${p}", ("p",c->peer_name()));
       c->cancel_wait();
    }
 
    void dispatch_manager::rejected_block(const block_id_type& id) {
-      fc_dlog( logger, "rejected block ${id}", ("id", id) );
+      async_dlog( logger, "rejected block ${id}", ("id", id) );
       auto range = received_blocks.equal_range(id);
       received_blocks.erase(range.first, range.second);
    }
@@ -1794,9 +2366,13 @@ namespace eosio {
             ++i;
          }
       }
+      // irreversible blocks are synced from the block log
+      auto& by_num = block_buffers.get<by_block_num>();
+      by_num.erase( by_num.begin(), by_num.upper_bound( lib_num ) );
    }
 
    void dispatch_manager::bcast_transaction(const transaction_metadata_ptr& ptrx) {
+      const auto start = fc::time_point::now();
       std::set<connection_ptr> skips;
       const auto& id = ptrx->id;
 
@@ -1807,7 +2383,7 @@ namespace eosio {
       received_transactions.erase(range.first, range.second);
 
       if( my_impl->local_txns.get<by_id>().find( id ) != my_impl->local_txns.end() ) { //found
-         fc_dlog(logger, "found trxid in local_trxs" );
+         async_dlog(logger, "found trxid in local_trxs" );
          return;
       }
 
@@ -1819,7 +2395,8 @@ namespace eosio {
       node_transaction_state nts = {id, trx_expiration, 0, buff};
       my_impl->local_txns.insert(std::move(nts));
 
-      my_impl->send_transaction_to_all( buff, [&id, &skips, trx_expiration](const connection_ptr& c) -> bool {
+      bool announced = false;
+      my_impl->send_transaction_to_all( buff, [&id, &skips, &announced, trx_expiration](const connection_ptr& c) -> bool {
          if( skips.find(c) != skips.end() || c->syncing ) {
             return false;
           }
@@ -1827,29 +2404,45 @@ namespace eosio {
           bool unknown = bs == c->trx_state.end();
           if( unknown ) {
              c->trx_state.insert(transaction_state({id,0,trx_expiration}));
-             fc_dlog(logger, "sending trx to ${n}", ("n",c->peer_name() ) );
+             if( c->announce_trx ) {
+                c->trx_announcements.push_back( id );
+                if( c->trx_announcements.size() >= def_trx_announce_batch ) {
+                   c->announce_transactions();
+                }
+                announced = true;
+                return false;
+             }
+             async_dlog(logger, "sending trx to ${n}", ("n",c->peer_name() ) );
           }
           return unknown;
       });
+      if( announced ) {
+         my_impl->schedule_trx_announcements();
+      }
 
+      my_impl->chain_plug->chain().pipeline_stage_timed(
+            { controller::pipeline_stage::trx_relay, fc::time_point::now() - start } );
    }
 
    void dispatch_manager::recv_transaction(const connection_ptr& c, const transaction_id_type& id) {
       received_transactions.insert(std::make_pair(id, c));
+      requested_transactions.erase(id);
       if (c &&
           c->last_req &&
           c->last_req->req_trx.mode != none &&
           !c->last_req->req_trx.ids.empty() &&
           c->last_req->req_trx.ids.back() == id) {
+         update_average( c->score.fetch_latency_us, ( fc::time_point::now() - c->last_req_time ).count() );
+         c->score_request( false );
          c->last_req.reset();
       }
 
-      fc_dlog(logger, "canceling wait on ${p}", ("p",c->peer_name()));
+      async_dlog(logger, "canceling wait on ${p}", ("p",c->peer_name()));
       c->cancel_wait();
    }
 
    void dispatch_manager::rejected_transaction(const transaction_id_type& id) {
-      fc_dlog(logger,"not sending rejected transaction ${tid}",("tid",id));
+      async_dlog(logger,"not sending rejected transaction ${tid}",("tid",id));
       auto range = received_transactions.equal_range(id);
       received_transactions.erase(range.first, range.second);
    }
@@ -1860,9 +2453,32 @@ namespace eosio {
       req.req_blocks.mode = none;
       bool send_req = false;
       if (msg.known_trx.mode == normal) {
-         req.req_trx.mode = normal;
-         req.req_trx.pending = 0;
-         send_req = false;
+         // transactions announced by the peer, request the ones no other peer was asked for
+         request_message trx_req;
+         trx_req.req_trx.mode = normal;
+         trx_req.req_trx.pending = 0;
+         trx_req.req_blocks.mode = none;
+         const auto now = fc::time_point::now();
+         const time_point_sec known_until = now + def_announced_trx_expire;
+         const auto& local = my_impl->local_txns.get<by_id>();
+         for( const auto& id : msg.known_trx.ids ) {
+            if( c->trx_state.find( id ) == c->trx_state.end() ) {
+               c->trx_state.insert( transaction_state({id, 0, known_until}) );
+            }
+            if( local.find( id ) != local.end() ) {
+               continue;
+            }
+            auto itr = requested_transactions.find( id );
+            if( itr != requested_transactions.end() && itr->second > now ) {
+               continue;
+            }
+            requested_transactions[id] = now + def_trx_request_timeout;
+            trx_req.req_trx.ids.push_back( id );
+         }
+         if( !trx_req.req_trx.ids.empty() ) {
+            async_dlog( logger, "requesting ${n} announced transactions from ${p}", ("n", trx_req.req_trx.ids.size())("p", c->peer_name()) );
+            c->enqueue( trx_req );
+         }
       }
       else if (msg.known_trx.mode != none) {
          fc_elog( logger,"passed a notice_message with something other than a normal on none known_trx" );
@@ -1881,7 +2497,7 @@ namespace eosio {
                   c->add_peer_block({blkid, block_header::num_from_id(blkid)});
                }
             } catch (const assert_exception &ex) {
-               fc_ilog( logger, "caught assert on fetch_block_by_id, ${ex}",("ex",ex.what()) );
+               async_ilog( logger, "caught assert on fetch_block_by_id, ${ex}",("ex",ex.what()) );
                // keep going, client can ask another peer
             } catch (...) {
                fc_elog( logger, "failed to retrieve block for id");
@@ -1896,11 +2512,12 @@ namespace eosio {
          fc_elog( logger, "passed a notice_message with something other than a normal on none known_blocks" );
          return;
       }
-      fc_dlog( logger, "send req = ${sr}", ("sr",send_req));
+      async_dlog( logger, "send req = ${sr}", ("sr",send_req));
       if( send_req) {
          c->enqueue(req);
          c->fetch_wait();
          c->last_req = std::move(req);
+         c->last_req_time = fc::time_point::now();
       }
    }
 
@@ -1909,6 +2526,7 @@ namespace eosio {
          return;
       }
       fc_wlog( logger, "failed to fetch from ${p}",("p",c->peer_name()));
+      c->score_request( true );
       transaction_id_type tid;
       block_id_type bid;
       bool is_txn = false;
@@ -1924,7 +2542,7 @@ namespace eosio {
                   ("b",modes_str(c->last_req->req_blocks.mode))("t",modes_str(c->last_req->req_trx.mode)));
          return;
       }
-      for (auto& conn : my_impl->connections) {
+      for (auto& conn : connections_by_score()) {
          if (conn == c || conn->last_req) {
             continue;
          }
@@ -1940,6 +2558,7 @@ namespace eosio {
             conn->enqueue(*c->last_req);
             conn->fetch_wait();
             conn->last_req = c->last_req;
+            conn->last_req_time = fc::time_point::now();
             return;
          }
       }
@@ -1948,60 +2567,290 @@ namespace eosio {
       if( c->connected() ) {
          c->enqueue(*c->last_req);
          c->fetch_wait();
+         c->last_req_time = fc::time_point::now();
       }
    }
 
    //------------------------------------------------------------------------
 
-   void net_plugin_impl::connect(const connection_ptr& c) {
-      if( c->no_retry != go_away_reason::no_reason) {
-         fc_dlog( logger, "Skipping connect due to go_away reason ${r}",("r", reason_str( c->no_retry )));
-         return;
-      }
+   static bool same_snapshot( const snapshot_manifest& a, const snapshot_manifest& b ) {
+      return a.root == b.root && a.block_id == b.block_id && a.size == b.size && a.chunk_size == b.chunk_size;
+   }
 
-      auto colon = c->peer_addr.find(':');
+   snapshot_fetcher::snapshot_fetcher(const fc::path& target, uint32_t min_peers, const optional<digest_type>& trusted_root)
+      : target(target), min_peers(std::max<uint32_t>(min_peers, 1)), trusted_root(trusted_root) {
+   }
 
-      if (colon == std::string::npos || colon == 0) {
-         fc_elog( logger, "Invalid peer address. must be \"host:port\": ${p}", ("p",c->peer_addr) );
-         for ( auto itr : connections ) {
-            if((*itr).peer_addr == c->peer_addr) {
-               (*itr).reset();
-               close(itr);
-               ///@{
-               /// HAYA: [cyb-284] use net_plugin in randpa
-               connections_by_num.erase(itr->num);
-               ///@}
-               connections.erase(itr);
-               break;
-            }
+   void snapshot_fetcher::request_manifest(const connection_ptr& c) {
+      if( state == finished || c->protocol_version < proto_snapshot_chunks || !c->connected() || banned.count( c ) )
+         return;
+      const auto now = fc::time_point::now();
+      auto& requested = manifest_requested[c];
+      if( requested != fc::time_point() && now - requested < def_snapshot_manifest_retry )
+         return;
+      requested = now;
+      snapshot_manifest_request_message req;
+      req.min_block_num = my_impl->chain_plug->chain().head_block_num() + 1;
+      c->enqueue( req );
+   }
+
+   void snapshot_fetcher::recv_manifest(const connection_ptr& c, const snapshot_manifest& m) {
+      if( state == finished || m.size == 0 || banned.count( c ) )
+         return;
+      if( !m.valid() || m.block_num() <= my_impl->chain_plug->chain().head_block_num() ) {
+         fc_wlog( logger, "invalid snapshot manifest from ${p}", ("p", c->peer_name()) );
+         return;
+      }
+      if( trusted_root && m.root != *trusted_root ) {
+         async_dlog( logger, "snapshot manifest of block ${n} from ${p} does not match p2p-snapshot-root",
+                     ("n", m.block_num())("p", c->peer_name()) );
+         return;
+      }
+      if( state == chunks ) {
+         if( same_snapshot( m, chosen.manifest ) && chosen.peers.insert( c ).second ) {
+            async_ilog( logger, "${p} joins the snapshot fetch", ("p", c->peer_name()) );
+            request_chunks();
          }
          return;
       }
 
-      shared_ptr<tcp::resolver> resolver = std::make_shared<tcp::resolver>( my_impl->thread_pool->get_executor() );
-      c->strand.post( [this, c, resolver{std::move(resolver)}](){
-         auto colon = c->peer_addr.find(':');
-         auto host = c->peer_addr.substr( 0, colon );
-         auto port = c->peer_addr.substr( colon + 1);
-         idump((host)(port));
-         // Note: need to add support for IPv6 too
-         tcp::resolver::query query( tcp::v4(), host.c_str(), port.c_str() );
-         connection_wptr weak_conn = c;
-         resolver->async_resolve( query, boost::asio::bind_executor( c->strand,
-                [weak_conn, resolver, this]( const boost::system::error_code& err, tcp::resolver::results_type endpoints ) {
-                   app().post( priority::low, [err, resolver, endpoints, weak_conn, this]() {
-                      auto c = weak_conn.lock();
-                      if( !c ) return;
-                      if( !err ) {
-                         connect( c, resolver, endpoints );
-                      } else {
-                         fc_elog( logger, "Unable to resolve ${peer_addr}: ${error}",
-                                  ("peer_addr", c->peer_name())( "error", err.message()) );
-                         c->connecting = false;
-                      }
-                   } );
-         } ) );
-      } );
+      // the last manifest offered by a peer replaces its previous offer
+      for( auto itr = offers.begin(); itr != offers.end(); ) {
+         itr->second.peers.erase( c );
+         itr = itr->second.peers.empty() ? offers.erase( itr ) : std::next( itr );
+      }
+      auto& o = offers[m.root];
+      if( o.peers.empty() ) {
+         o.manifest = m;
+      } else if( !same_snapshot( m, o.manifest ) ) {
+         fc_wlog( logger, "snapshot manifest from ${p} conflicts with the manifest of the same root", ("p", c->peer_name()) );
+         return;
+      }
+      o.peers.insert( c );
+      async_ilog( logger, "snapshot of block ${n} with root ${r} offered by ${p}, ${c} peer(s)",
+                  ("n", m.block_num())("r", m.root)("p", c->peer_name())("c", o.peers.size()) );
+   }
+
+   void snapshot_fetcher::choose_manifest() {
+      const uint32_t required = trusted_root ? 1 : min_peers;
+      offer* best = nullptr;
+      for( auto& o : offers ) {
+         const uint32_t connected = std::count_if( o.second.peers.begin(), o.second.peers.end(),
+                                                   []( const connection_ptr& c ) { return c->connected(); } );
+         if( connected >= required && ( !best || o.second.manifest.block_num() > best->manifest.block_num() ) ) {
+            best = &o.second;
+         }
+      }
+      if( best ) {
+         start_chunks( std::move( *best ) );
+      }
+   }
+
+   void snapshot_fetcher::start_chunks(offer&& o) {
+      chosen = std::move( o );
+      offers.clear();
+      const auto part = target.generic_string() + ".part";
+      out.open( part, std::ios::out | std::ios::binary | std::ios::trunc );
+      if( !out ) {
+         fc_elog( logger, "cannot create ${f}, p2p-snapshot-bootstrap stopped", ("f", part) );
+         state = finished;
+         return;
+      }
+      received.assign( chosen.manifest.chunk_count(), false );
+      state = chunks;
+      started = fc::time_point::now();
+      async_ilog( logger, "fetching snapshot of block ${n}, ${s} bytes in ${c} chunks, from ${p} peer(s)",
+                  ("n", chosen.manifest.block_num())("s", chosen.manifest.size)("c", received.size())("p", chosen.peers.size()) );
+      request_chunks();
+   }
+
+   optional<uint32_t> snapshot_fetcher::next_missing() {
+      while( missing_from < received.size() && received[missing_from] ) {
+         ++missing_from;
+      }
+      for( uint32_t i = missing_from; i < received.size(); ++i ) {
+         if( !received[i] && !in_flight.count( i ) ) {
+            return i;
+         }
+      }
+      return {};
+   }
+
+   void snapshot_fetcher::request_chunks() {
+      // one request per peer and pass, so the chunks are spread over the peers
+      bool sent = true;
+      while( sent ) {
+         sent = false;
+         for( auto itr = chosen.peers.begin(); itr != chosen.peers.end(); ) {
+            const connection_ptr c = *itr;
+            if( !c->connected() ) {
+               // asked for its manifest again once it reconnects
+               release( c );
+               itr = chosen.peers.erase( itr );
+               continue;
+            }
+            auto& n = peer_in_flight[c];
+            if( n < def_snapshot_chunks_per_peer ) {
+               const auto index = next_missing();
+               if( !index ) {
+                  return;
+               }
+               in_flight[*index] = chunk_request{ c, fc::time_point::now() };
+               ++n;
+               snapshot_chunk_request_message req;
+               req.block_id = chosen.manifest.block_id;
+               req.index = *index;
+               c->enqueue( req );
+               sent = true;
+            }
+            ++itr;
+         }
+      }
+   }
+
+   void snapshot_fetcher::release(const connection_ptr& c) {
+      for( auto itr = in_flight.begin(); itr != in_flight.end(); ) {
+         itr = itr->second.peer == c ? in_flight.erase( itr ) : std::next( itr );
+      }
+      peer_in_flight.erase( c );
+   }
+
+   void snapshot_fetcher::recv_chunk(const connection_ptr& c, snapshot_chunk_message& msg) {
+      if( state != chunks || msg.block_id != chosen.manifest.block_id || msg.index >= received.size() || received[msg.index] )
+         return;
+      auto itr = in_flight.find( msg.index );
+      const bool requested = itr != in_flight.end() && itr->second.peer == c;
+      if( requested ) {
+         in_flight.erase( itr );
+         --peer_in_flight[c];
+      }
+      if( msg.data.empty() ) {
+         if( requested ) {
+            async_ilog( logger, "${p} no longer serves the snapshot", ("p", c->peer_name()) );
+            release( c );
+            chosen.peers.erase( c );
+            request_chunks();
+         }
+         return;
+      }
+      if( !chosen.manifest.verify_chunk( msg.index, msg.data.data(), msg.data.size() ) ) {
+         fc_wlog( logger, "snapshot chunk ${i} from ${p} does not match the manifest, closing connection",
+                  ("i", msg.index)("p", c->peer_name()) );
+         release( c );
+         chosen.peers.erase( c );
+         banned.insert( c );
+         my_impl->close( c );
+         request_chunks();
+         return;
+      }
+
+      out.seekp( chosen.manifest.chunk_offset( msg.index ) );
+      out.write( msg.data.data(), msg.data.size() );
+      if( !out ) {
+         fc_elog( logger, "error writing ${f}, p2p-snapshot-bootstrap stopped", ("f", target.generic_string() + ".part") );
+         state = finished;
+         return;
+      }
+      received[msg.index] = true;
+      if( ++received_count == received.size() ) {
+         finish();
+      } else {
+         request_chunks();
+      }
+   }
+
+   void snapshot_fetcher::tick() {
+      if( state == finished )
+         return;
+      for( const auto& c : my_impl->connections ) {
+         if( state == chunks && chosen.peers.count( c ) )
+            continue;
+         request_manifest( c );
+      }
+      if( state == manifests ) {
+         choose_manifest();
+         return;
+      }
+      const auto expired = fc::time_point::now() - def_snapshot_chunk_timeout;
+      for( auto itr = in_flight.begin(); itr != in_flight.end(); ) {
+         if( itr->second.sent < expired ) {
+            async_dlog( logger, "snapshot chunk ${i} requested from ${p} timed out", ("i", itr->first)("p", itr->second.peer->peer_name()) );
+            --peer_in_flight[itr->second.peer];
+            itr = in_flight.erase( itr );
+         } else {
+            ++itr;
+         }
+      }
+      request_chunks();
+   }
+
+   void snapshot_fetcher::finish() {
+      out.close();
+      state = finished;
+      const auto part = target.generic_string() + ".part";
+      try {
+         fc::rename( part, target );
+      } catch( const fc::exception& e ) {
+         fc_elog( logger, "cannot rename ${f}: ${e}", ("f", part)("e", e.to_string()) );
+         return;
+      }
+      async_ilog( logger, "fetched snapshot of block ${n} in ${t} s, quitting for it to be loaded at the next start",
+                  ("n", chosen.manifest.block_num())("t", (fc::time_point::now() - started).count() / 1000000) );
+      app().quit();
+   }
+
+   //------------------------------------------------------------------------
+
+   void net_plugin_impl::connect(const connection_ptr& c) {
+      if( c->no_retry != go_away_reason::no_reason) {
+         async_dlog( logger, "Skipping connect due to go_away reason ${r}",("r", reason_str( c->no_retry )));
+         return;
+      }
+
+      auto colon = c->peer_addr.find(':');
+
+      if (colon == std::string::npos || colon == 0) {
+         fc_elog( logger, "Invalid peer address. must be \"host:port\": ${p}", ("p",c->peer_addr) );
+         for ( auto itr : connections ) {
+            if((*itr).peer_addr == c->peer_addr) {
+               (*itr).reset();
+               close(itr);
+               ///@{
+               /// HAYA: [cyb-284] use net_plugin in randpa
+               connections_by_num.erase(itr->num);
+               ///@}
+               connections.erase(itr);
+               break;
+            }
+         }
+         return;
+      }
+
+      shared_ptr<tcp::resolver> resolver = std::make_shared<tcp::resolver>( my_impl->thread_pool->get_executor() );
+      // peer_addr belongs to the main thread
+      auto colon = c->peer_addr.find(':');
+      auto host = c->peer_addr.substr( 0, colon );
+      auto port = c->peer_addr.substr( colon + 1);
+      c->strand.post( [this, c, host, port, resolver{std::move(resolver)}](){
+         idump((host)(port));
+         // Note: need to add support for IPv6 too
+         tcp::resolver::query query( tcp::v4(), host.c_str(), port.c_str() );
+         connection_wptr weak_conn = c;
+         resolver->async_resolve( query, boost::asio::bind_executor( c->strand,
+                [weak_conn, resolver, this]( const boost::system::error_code& err, tcp::resolver::results_type endpoints ) {
+                   chain::instrumented_post( app(), priority::low, chain::executor_category::net, [err, resolver, endpoints, weak_conn, this]() {
+                      auto c = weak_conn.lock();
+                      if( !c ) return;
+                      if( !err ) {
+                         connect( c, resolver, endpoints );
+                      } else {
+                         fc_elog( logger, "Unable to resolve ${peer_addr}: ${error}",
+                                  ("peer_addr", c->peer_name())( "error", err.message()) );
+                         c->connecting = false;
+                      }
+                   } );
+         } ) );
+      } );
    }
 
    void net_plugin_impl::connect( const connection_ptr& c, const std::shared_ptr<tcp::resolver>& resolver, tcp::resolver::results_type endpoints ) {
@@ -2010,13 +2859,13 @@ namespace eosio {
          return;
       }
       c->connecting = true;
-      c->pending_message_buffer.reset();
+      c->reads = std::make_shared<read_buffer>();
       c->buffer_queue.clear_out_queue();
       connection_wptr weak_conn = c;
       boost::asio::async_connect( *c->socket, endpoints,
          boost::asio::bind_executor( c->strand,
             [weak_conn, resolver, socket=c->socket, this]( const boost::system::error_code& err, const tcp::endpoint& endpoint ) {
-         app().post( priority::low, [weak_conn, this, err]() {
+         chain::instrumented_post( app(), priority::low, chain::executor_category::net, [weak_conn, this, err]() {
             auto c = weak_conn.lock();
             if( !c ) return;
             if( !err && c->socket->is_open()) {
@@ -2060,7 +2909,7 @@ namespace eosio {
    void net_plugin_impl::start_listen_loop() {
       auto socket = std::make_shared<tcp::socket>( my_impl->thread_pool->get_executor() );
       acceptor->async_accept( *socket, [socket, this]( boost::system::error_code ec ) {
-            app().post( priority::low, [socket, this, ec]() {
+            chain::instrumented_post( app(), priority::low, chain::executor_category::net, [socket, this, ec]() {
             if( !ec ) {
                uint32_t visitors = 0;
                uint32_t from_addr = 0;
@@ -2082,7 +2931,7 @@ namespace eosio {
                      }
                   }
                   if (num_clients != visitors) {
-                     fc_ilog( logger,"checking max client, visitors = ${v} num clients ${n}",("v",visitors)("n",num_clients) );
+                     async_ilog( logger,"checking max client, visitors = ${v} num clients ${n}",("v",visitors)("n",num_clients) );
                      num_clients = visitors;
                   }
                   if( from_addr < max_nodes_per_host && (max_client_count == 0 || num_clients < max_client_count )) {
@@ -2098,11 +2947,11 @@ namespace eosio {
                   }
                   else {
                      if (from_addr >= max_nodes_per_host) {
-                        fc_dlog(logger, "Number of connections (${n}) from ${ra} exceeds limit",
+                        async_dlog(logger, "Number of connections (${n}) from ${ra} exceeds limit",
                                 ("n", from_addr+1)("ra",paddr.to_string()));
                      }
                      else {
-                        fc_dlog(logger, "max_client_count ${m} exceeded", ( "m", max_client_count) );
+                        async_dlog(logger, "max_client_count ${m} exceeded", ( "m", max_client_count) );
                      }
                      boost::system::error_code ec;
                      socket->close( ec );
@@ -2136,7 +2985,8 @@ namespace eosio {
          }
          connection_wptr weak_conn = conn;
 
-         std::size_t minimum_read = conn->outstanding_read_bytes ? *conn->outstanding_read_bytes : message_header_size;
+         auto reads = conn->reads;
+         std::size_t minimum_read = reads->outstanding_read_bytes ? *reads->outstanding_read_bytes : message_header_size;
 
          if (use_socket_read_watermark) {
             const size_t max_socket_read_watermark = 4096;
@@ -2164,70 +3014,52 @@ namespace eosio {
             return;
          }
 
+         // `reads` is only used on the connection strand until the messages are handed to the main thread,
+         // which starts the next read once they are processed
          boost::asio::async_read(*conn->socket,
-            conn->pending_message_buffer.get_buffer_sequence_for_boost_async_read(), completion_handler,
+            reads->pending_message_buffer.get_buffer_sequence_for_boost_async_read(), completion_handler,
             boost::asio::bind_executor( conn->strand,
-              [this,weak_conn,socket=conn->socket]( boost::system::error_code ec, std::size_t bytes_transferred ) {
-            app().post( priority::medium, [this,weak_conn, socket, ec, bytes_transferred]() {
+              [this,weak_conn,reads,socket=conn->socket]( boost::system::error_code ec, std::size_t bytes_transferred ) {
+            auto conn = weak_conn.lock();
+            if (!conn || !socket->is_open()) {
+               return;
+            }
+
+            const auto received = fc::time_point::now();
+            auto messages = std::make_shared<std::vector<net_message>>();
+            bool failed = false;
+            if( !ec ) {
+               failed = !read_messages( *reads, socket, bytes_transferred, *messages );
+            }
+
+            chain::instrumented_post( app(), priority::medium, chain::executor_category::net, [this, weak_conn, socket, ec, failed, messages, received, bytes_transferred]() {
                auto conn = weak_conn.lock();
-               if (!conn || !conn->socket || !conn->socket->is_open() || !socket->is_open()) {
+               if (!conn || !conn->socket || !conn->socket->is_open() || conn->socket != socket) {
                   return;
                }
 
-               conn->outstanding_read_bytes.reset();
-
                try {
                   if( !ec ) {
-                     if (bytes_transferred > conn->pending_message_buffer.bytes_to_write()) {
-                        fc_elog( logger,"async_read_some callback: bytes_transfered = ${bt}, buffer.bytes_to_write = ${btw}",
-                                 ("bt",bytes_transferred)("btw",conn->pending_message_buffer.bytes_to_write()) );
-                     }
-                     EOS_ASSERT(bytes_transferred <= conn->pending_message_buffer.bytes_to_write(), plugin_exception, "");
-                     conn->pending_message_buffer.advance_write_ptr(bytes_transferred);
-                     while (conn->pending_message_buffer.bytes_to_read() > 0) {
-                        uint32_t bytes_in_buffer = conn->pending_message_buffer.bytes_to_read();
-
-                        if (bytes_in_buffer < message_header_size) {
-                           conn->outstanding_read_bytes.emplace(message_header_size - bytes_in_buffer);
-                           break;
-                        } else {
-                           uint32_t message_length;
-                           auto index = conn->pending_message_buffer.read_index();
-                           conn->pending_message_buffer.peek(&message_length, sizeof(message_length), index);
-                           if(message_length > def_send_buffer_size*2 || message_length == 0) {
-                              boost::system::error_code ec;
-                              fc_elog( logger,"incoming message length unexpected (${i}), from ${p}",
-                                       ("i", message_length)("p",boost::lexical_cast<std::string>(conn->socket->remote_endpoint(ec))) );
-                              close(conn);
-                              return;
-                           }
-
-                           auto total_message_bytes = message_length + message_header_size;
-
-                           if (bytes_in_buffer >= total_message_bytes) {
-                              conn->pending_message_buffer.advance_read_ptr(message_header_size);
-                              if (!process_next_message(conn, message_length)) {
-                                 return;
-                              }
-                           } else {
-                              auto outstanding_message_bytes = total_message_bytes - bytes_in_buffer;
-                              auto available_buffer_bytes = conn->pending_message_buffer.bytes_to_write();
-                              if (outstanding_message_bytes > available_buffer_bytes) {
-                                 conn->pending_message_buffer.add_space( outstanding_message_bytes - available_buffer_bytes );
-                              }
-
-                              conn->outstanding_read_bytes.emplace(outstanding_message_bytes);
-                              break;
-                           }
+                     conn->traffic.bytes_in += bytes_transferred;
+                     prefetch_sync_blocks( *messages );
+                     for( auto& msg : *messages ) {
+                        if( !process_next_message( conn, msg, received ) ) {
+                           accept_incoming_trxs();
+                           return;
                         }
                      }
+                     accept_incoming_trxs();
+                     if( failed ) {
+                        close( conn );
+                        return;
+                     }
                      start_read_message(conn);
                   } else {
                      auto pname = conn->peer_name();
                      if (ec.value() != boost::asio::error::eof) {
                         fc_elog( logger, "Error reading message from ${p}: ${m}",("p",pname)( "m", ec.message() ) );
                      } else {
-                        fc_ilog( logger, "Peer ${p} closed connection",("p",pname) );
+                        async_ilog( logger, "Peer ${p} closed connection",("p",pname) );
                      }
                      close( conn );
                   }
@@ -2255,55 +3087,196 @@ namespace eosio {
       }
    }
 
-   bool net_plugin_impl::process_next_message(const connection_ptr& conn, uint32_t message_length) {
+   namespace bio = boost::iostreams;
+
+   /// appends to `out` up to `limit` bytes, so a small compressed_message cannot inflate without bound
+   struct bounded_sink {
+      typedef char           char_type;
+      typedef bio::sink_tag  category;
+
+      vector<char>*  out;
+      size_t         limit;
+
+      std::streamsize write( const char* s, std::streamsize n ) {
+         EOS_ASSERT( out->size() + n <= limit, plugin_exception, "compressed_message inflates beyond ${l} bytes", ("l", limit) );
+         out->insert( out->end(), s, s + n );
+         return n;
+      }
+   };
+
+   static void inflate_message( const compressed_message& compressed, net_message& msg ) {
+      EOS_ASSERT( compressed.uncompressed_size <= def_send_buffer_size*2, plugin_exception,
+                  "compressed_message uncompressed size unexpected (${s})", ("s", compressed.uncompressed_size) );
+      vector<char> packed;
+      packed.reserve( compressed.uncompressed_size );
+      {
+         bio::filtering_ostream decomp;
+         decomp.push( bio::zlib_decompressor() );
+         decomp.push( bounded_sink{ &packed, compressed.uncompressed_size } );
+         decomp.write( compressed.data.data(), compressed.data.size() );
+         decomp.reset();
+      }
+      EOS_ASSERT( packed.size() == compressed.uncompressed_size, plugin_exception,
+                  "compressed_message inflated to ${a} bytes instead of ${e}", ("a", packed.size())("e", compressed.uncompressed_size) );
+      fc::datastream<const char*> ds( packed.data(), packed.size() );
+      fc::raw::unpack( ds, msg );
+      EOS_ASSERT( !msg.contains<compressed_message>(), plugin_exception, "nested compressed_message" );
+   }
+
+   std::shared_ptr<vector<char>> net_plugin_impl::compress_send_buffer(const std::shared_ptr<vector<char>>& buffer) {
+      if( !p2p_compression || buffer->size() < def_min_compress_size ) {
+         return {};
+      }
+      const auto start = fc::time_point::now();
+      if( start - compression_window_start > fc::seconds( 1 ) ) {
+         compression_window_start = start;
+         compression_window_time = fc::microseconds();
+      }
+      if( compression_window_time > def_max_compression_time ) {
+         // main thread is better spent on blocks and transactions, send uncompressed until the next window
+         compression_skipped_counter.increment();
+         return {};
+      }
+
+      compressed_message cm;
+      cm.uncompressed_size = buffer->size() - message_header_size;
+      {
+         bio::filtering_ostream comp;
+         comp.push( bio::zlib_compressor( bio::zlib::best_speed ) );
+         comp.push( bio::back_inserter( cm.data ) );
+         comp.write( buffer->data() + message_header_size, cm.uncompressed_size );
+         comp.reset();
+      }
+      compression_window_time += fc::time_point::now() - start;
+
+      if( cm.data.size() + cm.data.size() / 8 >= cm.uncompressed_size ) {
+         return {};
+      }
+      compressed_msg_counter.increment();
+      compression_in_bytes_counter.increment( buffer->size() );
+      auto compressed = create_send_buffer( compressed_message_which, cm );
+      compression_out_bytes_counter.increment( compressed->size() );
+      return compressed;
+   }
+
+   bool net_plugin_impl::read_messages(read_buffer& reads, const socket_ptr& socket, std::size_t bytes_transferred, std::vector<net_message>& messages) {
+      // conn->socket is replaced on the main thread, use the socket of this read
+      const auto pname = [&socket]() {
+         boost::system::error_code ec;
+         return boost::lexical_cast<std::string>( socket->remote_endpoint( ec ) );
+      };
+
+      reads.outstanding_read_bytes.reset();
+      try {
+         if (bytes_transferred > reads.pending_message_buffer.bytes_to_write()) {
+            fc_elog( logger,"async_read_some callback: bytes_transfered = ${bt}, buffer.bytes_to_write = ${btw}",
+                     ("bt",bytes_transferred)("btw",reads.pending_message_buffer.bytes_to_write()) );
+            return false;
+         }
+         reads.pending_message_buffer.advance_write_ptr(bytes_transferred);
+         while (reads.pending_message_buffer.bytes_to_read() > 0) {
+            uint32_t bytes_in_buffer = reads.pending_message_buffer.bytes_to_read();
+
+            if (bytes_in_buffer < message_header_size) {
+               reads.outstanding_read_bytes.emplace(message_header_size - bytes_in_buffer);
+               break;
+            } else {
+               uint32_t message_length;
+               auto index = reads.pending_message_buffer.read_index();
+               reads.pending_message_buffer.peek(&message_length, sizeof(message_length), index);
+               if(message_length > def_send_buffer_size*2 || message_length == 0) {
+                  fc_elog( logger,"incoming message length unexpected (${i}), from ${p}", ("i", message_length)("p", pname()) );
+                  return false;
+               }
+
+               auto total_message_bytes = message_length + message_header_size;
+
+               if (bytes_in_buffer >= total_message_bytes) {
+                  reads.pending_message_buffer.advance_read_ptr(message_header_size);
+                  auto ds = reads.pending_message_buffer.create_datastream();
+                  messages.emplace_back();
+                  fc::raw::unpack( ds, messages.back() );
+                  if( messages.back().contains<compressed_message>() ) {
+                     auto compressed = std::move( messages.back().get<compressed_message>() );
+                     inflate_message( compressed, messages.back() );
+                  }
+               } else {
+                  auto outstanding_message_bytes = total_message_bytes - bytes_in_buffer;
+                  auto available_buffer_bytes = reads.pending_message_buffer.bytes_to_write();
+                  if (outstanding_message_bytes > available_buffer_bytes) {
+                     reads.pending_message_buffer.add_space( outstanding_message_bytes - available_buffer_bytes );
+                  }
+
+                  reads.outstanding_read_bytes.emplace(outstanding_message_bytes);
+                  break;
+               }
+            }
+         }
+      } catch( const fc::exception& e ) {
+         fc_elog( logger, "Exception in unpacking message from ${p}: ${s}", ("p", pname())("s", e.to_detail_string()) );
+         return false;
+      } catch( const std::exception& e ) {
+         fc_elog( logger, "Exception in unpacking message from ${p}: ${s}", ("p", pname())("s", e.what()) );
+         return false;
+      }
+      return true;
+   }
+
+   void net_plugin_impl::prefetch_sync_blocks(const std::vector<net_message>& messages) {
+      if( !sync_prefetch_blocks || !sync_master->syncing_with_peer() )
+         return;
+      std::vector<signed_block_ptr> blocks;
+      for( const auto& msg : messages ) {
+         if( blocks.size() >= sync_prefetch_blocks )
+            break;
+         if( msg.contains<signed_block>() ) {
+            blocks.emplace_back( std::make_shared<signed_block>( msg.get<signed_block>() ) );
+         }
+      }
+      if( !blocks.empty() ) {
+         chain_plug->chain().prefetch_blocks( blocks );
+      }
+   }
+
+   bool net_plugin_impl::process_next_message(const connection_ptr& conn, net_message& msg, fc::time_point received) {
       try {
          // if next message is a block we already have, exit early
-         auto peek_ds = conn->pending_message_buffer.create_peek_datastream();
-         unsigned_int which{};
-         fc::raw::unpack( peek_ds, which );
-         if( which == signed_block_which ) {
-            block_header bh;
-            fc::raw::unpack( peek_ds, bh );
+         if( msg.contains<signed_block>() ) {
+            const block_header& bh = msg.get<signed_block>();
 
             const controller& cc = chain_plug->chain();
             const block_id_type blk_id = bh.id();
             const uint32_t blk_num = bh.block_num();
+            sync_master->recv_range_block( conn, blk_num );
             if( !sync_master->syncing_with_peer() ) {
                uint32_t lib = cc.last_irreversible_block_num();
                if( blk_num < lib ) {
                   const auto last_sent_lib = conn->last_handshake_sent.last_irreversible_block_num;
                   if( !conn->peer_requested && blk_num < last_sent_lib ) {
-                     fc_ilog( logger, "received block ${n} less than sent lib ${lib}", ("n", blk_num)("lib", last_sent_lib) );
+                     async_ilog( logger, "received block ${n} less than sent lib ${lib}", ("n", blk_num)("lib", last_sent_lib) );
                      close( conn );
                   } else {
-                     fc_ilog( logger, "received block ${n} less than lib ${lib}", ("n", blk_num)("lib", lib) );
+                     async_ilog( logger, "received block ${n} less than lib ${lib}", ("n", blk_num)("lib", lib) );
                      conn->enqueue( (sync_request_message) {0, 0} );
                      conn->send_handshake();
                      conn->cancel_wait();
                   }
-
-                  conn->pending_message_buffer.advance_read_ptr( message_length );
                   return true;
                }
             }
             if( cc.fetch_block_by_id( blk_id ) ) {
                sync_master->recv_block( conn, blk_id, blk_num, false );
                conn->cancel_wait();
-               conn->pending_message_buffer.advance_read_ptr( message_length );
                return true;
             }
          }
 
-         auto ds = conn->pending_message_buffer.create_datastream();
-         net_message msg;
-         fc::raw::unpack( ds, msg );
-         msg_handler m( *this, conn );
+         msg_handler m( *this, conn, received );
          if( msg.contains<signed_block>() ) {
             m( std::move( msg.get<signed_block>() ) );
          } else if( msg.contains<packed_transaction>() ) {
             if( !my_impl->p2p_accept_transactions ) {
-               fc_dlog( logger, "p2p-accept-transaction=false - dropping txn" );
-               conn->pending_message_buffer.advance_read_ptr( message_length );
+               async_dlog( logger, "p2p-accept-transaction=false - dropping txn" );
                return true;
             }
             m( std::move( msg.get<packed_transaction>() ) );
@@ -2312,17 +3285,9 @@ namespace eosio {
          }
          ///@{
          /// HAYA: [cyb-277] add net msg count metrics
-         update_metric(in, msg, handshake_message);
-         update_metric(in, msg, chain_size_message);
-         update_metric(in, msg, go_away_message);
-         update_metric(in, msg, time_message);
-         update_metric(in, msg, notice_message);
-         update_metric(in, msg, request_message);
-         update_metric(in, msg, sync_request_message);
-         update_metric(in, msg, signed_block);
-         update_metric(in, msg, packed_transaction);
-         update_metric(in, msg, custom_message);
+         update_metric(in, msg);
          ///@}
+         ++conn->traffic.msgs_in[msg.which()];
       } catch( const fc::exception& e ) {
          fc_elog( logger, "Exception in handling message from ${p}: ${s}",
                   ("p", conn->peer_name())("s", e.to_detail_string()) );
@@ -2364,6 +3329,25 @@ namespace eosio {
       }
    }
 
+   void net_plugin_impl::send(const std::vector<uint32_t>& peer_nums, uint32_t msg_type, const std::vector<char>& data) {
+      std::shared_ptr<std::vector<char>> send_buffer;
+      for (const auto peer_num : peer_nums) {
+         auto c_wptr_itr = connections_by_num.find(peer_num);
+         if (c_wptr_itr == connections_by_num.end()) {
+            continue;
+         }
+         if (auto c = c_wptr_itr->second.lock()) {
+            if (!send_buffer) {
+               send_buffer = create_custom_message_buffer(msg_type, data);
+            }
+            c->enqueue_buffer(send_buffer, true, no_reason, write_priority::consensus);
+            out_msg_counters[custom_message_which].increment();
+            out_msg_total_counter.increment();
+            ++c->traffic.msgs_out[custom_message_which];
+         }
+      }
+   }
+
    void net_plugin_impl::subscribe(uint32_t msg_type, subs_cb&& cb) {
       if (!custom_handlers.count(msg_type)) {
          custom_handlers.insert({msg_type, { std::move(cb) }});
@@ -2449,7 +3433,7 @@ namespace eosio {
          }
 
          if( c->peer_addr.empty() || c->last_handshake_recv.node_id == fc::sha256()) {
-            fc_dlog(logger, "checking for duplicate" );
+            async_dlog(logger, "checking for duplicate" );
             for(const auto &check : connections) {
                if(check == c)
                   continue;
@@ -2461,7 +3445,7 @@ namespace eosio {
                   if (msg.time + c->last_handshake_sent.time <= check->last_handshake_sent.time + check->last_handshake_recv.time)
                      continue;
 
-                  fc_dlog( logger, "sending go_away duplicate to ${ep}", ("ep",msg.p2p_address) );
+                  async_dlog( logger, "sending go_away duplicate to ${ep}", ("ep",msg.p2p_address) );
                   go_away_message gam(duplicate);
                   gam.node_id = node_id;
                   c->enqueue(gam);
@@ -2471,7 +3455,7 @@ namespace eosio {
             }
          }
          else {
-            fc_dlog(logger, "skipping duplicate check, addr == ${pa}, id = ${ni}",("pa",c->peer_addr)("ni",c->last_handshake_recv.node_id));
+            async_dlog(logger, "skipping duplicate check, addr == ${pa}, id = ${ni}",("pa",c->peer_addr)("ni",c->last_handshake_recv.node_id));
          }
 
          if( msg.chain_id != chain_id) {
@@ -2480,6 +3464,8 @@ namespace eosio {
             return;
          }
          c->protocol_version = to_protocol_version(msg.network_version);
+         c->announce_trx = c->protocol_version >= proto_trx_announce &&
+                           ( trx_announce_all || trx_announce_peers.count( c->peer_addr ) || trx_announce_peers.count( msg.p2p_address ) );
          if(c->protocol_version != net_version) {
             if (network_version_match) {
                fc_elog( logger, "Peer network version does not match expected ${nv} but got ${mnv}",
@@ -2487,7 +3473,7 @@ namespace eosio {
                c->enqueue(go_away_message(wrong_version));
                return;
             } else {
-               fc_ilog( logger, "Local network version: ${nv} Remote version: ${mnv}",
+               async_ilog( logger, "Local network version: ${nv} Remote version: ${mnv}",
                         ("nv", net_version)("mnv", c->protocol_version));
             }
          }
@@ -2503,7 +3489,7 @@ namespace eosio {
          }
 
          bool on_fork = false;
-         fc_dlog(logger, "lib_num = ${ln} peer_lib = ${pl}",("ln",lib_num)("pl",peer_lib));
+         async_dlog(logger, "lib_num = ${ln} peer_lib = ${pl}",("ln",lib_num)("pl",peer_lib));
 
          if( peer_lib <= lib_num && peer_lib > 0) {
             try {
@@ -2547,6 +3533,9 @@ namespace eosio {
       c->last_handshake_recv = msg;
       c->_logger_variant.reset();
       sync_master->recv_handshake(c,msg);
+      if( snapshot_fetch ) {
+         snapshot_fetch->request_manifest(c);
+      }
    }
 
    void net_plugin_impl::handle_message(const connection_ptr& c, const go_away_message& msg) {
@@ -2585,6 +3574,10 @@ namespace eosio {
 
       c->offset = (double(c->rec - c->org) + double(msg.xmt - c->dst)) / 2;
       double NsecPerUsec{1000};
+      const double delay = double(c->dst - c->org) - double(msg.xmt - c->rec);
+      if( delay > 0 ) {
+         update_average( c->score.rtt_us, delay / NsecPerUsec );
+      }
 
       if(logger.is_enabled(fc::log_level::all))
          logger.log(FC_LOG_MESSAGE(all, "Clock offset is ${o}ns (${us}us)", ("o", c->offset)("us", c->offset/NsecPerUsec)));
@@ -2601,7 +3594,7 @@ namespace eosio {
       request_message req;
       bool send_req = false;
       if (msg.known_trx.mode != none) {
-         fc_dlog(logger,"this is a ${m} notice with ${n} transactions", ("m",modes_str(msg.known_trx.mode))("n",msg.known_trx.pending));
+         async_dlog(logger,"this is a ${m} notice with ${n} transactions", ("m",modes_str(msg.known_trx.mode))("n",msg.known_trx.pending));
       }
       switch (msg.known_trx.mode) {
       case none:
@@ -2631,7 +3624,7 @@ namespace eosio {
       }
 
       if (msg.known_blocks.mode != none) {
-         fc_dlog(logger,"this is a ${m} notice with ${n} blocks", ("m",modes_str(msg.known_blocks.mode))("n",msg.known_blocks.pending));
+         async_dlog(logger,"this is a ${m} notice with ${n} blocks", ("m",modes_str(msg.known_blocks.mode))("n",msg.known_blocks.pending));
       }
       switch (msg.known_blocks.mode) {
       case none : {
@@ -2650,7 +3643,7 @@ namespace eosio {
          peer_elog(c, "bad notice_message : invalid known_blocks.mode ${m}",("m",static_cast<uint32_t>(msg.known_blocks.mode)));
       }
       }
-      fc_dlog(logger, "send req = ${sr}", ("sr",send_req));
+      async_dlog(logger, "send req = ${sr}", ("sr",send_req));
       if( send_req) {
          c->enqueue(req);
       }
@@ -2698,7 +3691,10 @@ namespace eosio {
    void net_plugin_impl::handle_message(const connection_ptr& c, const sync_request_message& msg) {
       if( msg.end_block == 0) {
          c->peer_requested.reset();
+         c->peer_sync_queue.clear();
          c->flush_queues();
+      } else if( c->peer_requested && c->protocol_version >= proto_sync_ranges ) {
+         c->peer_sync_queue.emplace_back( msg.start_block, msg.end_block, msg.start_block-1 );
       } else {
          c->peer_requested = peer_sync_state( msg.start_block,msg.end_block,msg.start_block-1);
          c->enqueue_sync_block();
@@ -2716,7 +3712,7 @@ namespace eosio {
       peer_dlog(c, "got a packed transaction, cancel wait");
       controller& cc = my_impl->chain_plug->chain();
       if( sync_master->is_active(c) ) {
-         fc_dlog(logger, "got a txn during sync - dropping");
+         async_dlog(logger, "got a txn during sync - dropping");
          return;
       }
 
@@ -2730,19 +3726,19 @@ namespace eosio {
       }
 
       if(local_txns.get<by_id>().find(tid) != local_txns.end()) {
-         fc_dlog(logger, "got a duplicate transaction - dropping");
+         async_dlog(logger, "got a duplicate transaction - dropping");
          return;
       }
       dispatcher->recv_transaction(c, tid);
       c->trx_in_progress_size += calc_trx_size( ptrx->packed_trx );
-      chain_plug->accept_transaction(ptrx, [c, this, ptrx](const static_variant<fc::exception_ptr, transaction_trace_ptr>& result) {
+      incoming_trxs.emplace_back(ptrx, [c, this, ptrx](const static_variant<fc::exception_ptr, transaction_trace_ptr>& result) {
          c->trx_in_progress_size -= calc_trx_size( ptrx->packed_trx );
          if (result.contains<fc::exception_ptr>()) {
             peer_dlog(c, "bad packed_transaction : ${m}", ("m",result.get<fc::exception_ptr>()->what()));
          } else {
             auto trace = result.get<transaction_trace_ptr>();
             if (!trace->except) {
-               fc_dlog(logger, "chain accepted transaction");
+               async_dlog(logger, "chain accepted transaction");
                this->dispatcher->bcast_transaction(ptrx);
                return;
             }
@@ -2754,11 +3750,335 @@ namespace eosio {
       });
    }
 
-   void net_plugin_impl::handle_message(const connection_ptr& c, const signed_block_ptr& msg) {
+   void net_plugin_impl::accept_incoming_trxs() {
+      if( incoming_trxs.empty() )
+         return;
+      chain_plug->accept_transactions( incoming_trxs );
+      incoming_trxs.clear();
+   }
+
+   void net_plugin_impl::handle_message(const connection_ptr& c, compact_block_message& msg, const fc::time_point& received) {
+      auto b = std::make_shared<signed_block>( std::move( msg.block ) );
+      const block_id_type blk_id = b->id();
+      const auto& cc = chain_plug->chain();
+      if( cc.fetch_block_by_id( blk_id ) ) {
+         sync_master->recv_block( c, blk_id, b->block_num(), false );
+         c->cancel_wait();
+         return;
+      }
+
+      vector<uint32_t> missing;
+      const auto& local = local_txns.get<by_id>();
+      for( auto i : msg.pruned ) {
+         EOS_ASSERT( i < b->transactions.size() && b->transactions[i].trx.contains<transaction_id_type>(), plugin_exception,
+                     "compact block ${id} prunes invalid receipt ${i}", ("id", blk_id)("i", i) );
+         auto& receipt = b->transactions[i];
+         auto tx = local.find( receipt.trx.get<transaction_id_type>() );
+         if( tx == local.end() || !tx->serialized_txn ) {
+            missing.push_back( i );
+            continue;
+         }
+         // serialized_txn is the packed_transaction net_message sent to peers
+         fc::datastream<const char*> ds( tx->serialized_txn->data() + message_header_size, tx->serialized_txn->size() - message_header_size );
+         unsigned_int which{};
+         fc::raw::unpack( ds, which );
+         packed_transaction trx;
+         fc::raw::unpack( ds, trx );
+         receipt.trx = std::move( trx );
+      }
+
+      if( missing.empty() ) {
+         accept_compact_block( c, b, blk_id, received );
+         return;
+      }
+      async_dlog( logger, "compact block ${n} misses ${m} of ${t} transactions, requesting them from ${p}",
+               ("n", b->block_num())("m", missing.size())("t", b->transactions.size())("p", c->peer_name()) );
+      c->enqueue( get_block_transactions_message{ blk_id, missing } );
+      c->pending_compact = connection::pending_compact_block{ b, blk_id, std::move( missing ), received };
+   }
+
+   void net_plugin_impl::handle_message(const connection_ptr& c, const compressed_message& msg) {
+      // inflated by read_messages
+      fc_elog( logger, "unexpected compressed_message from ${p}", ("p", c->peer_name()) );
+   }
+
+   void net_plugin_impl::handle_message(const connection_ptr& c, const get_block_transactions_message& msg) {
+      block_transactions_message reply;
+      reply.block_id = msg.block_id;
+      if( auto b = chain_plug->chain().fetch_block_by_id( msg.block_id ) ) {
+         for( auto i : msg.indexes ) {
+            if( i >= b->transactions.size() || !b->transactions[i].trx.contains<packed_transaction>() ) {
+               reply.transactions.clear();
+               break;
+            }
+            reply.transactions.push_back( b->transactions[i].trx.get<packed_transaction>() );
+         }
+      }
+      c->enqueue( reply );
+   }
+
+   void net_plugin_impl::refresh_served_snapshot() {
+      const auto now = fc::time_point::now();
+      if( snapshot_manifest_pending || now - snapshots_dir_scanned < def_snapshots_dir_scan )
+         return;
+      snapshots_dir_scanned = now;
+
+      // snapshot-<head block id>.bin, as named by producer_plugin
+      boost::filesystem::path newest;
+      block_id_type newest_id;
+      uint32_t newest_num = 0;
+      try {
+         for( boost::filesystem::directory_iterator itr( snapshots_dir ), end; itr != end; ++itr ) {
+            const auto name = itr->path().filename().generic_string();
+            const size_t id_size = sizeof(block_id_type) * 2;
+            if( name.size() != id_size + 13 || name.compare( 0, 9, "snapshot-" ) != 0 || name.compare( 9 + id_size, 4, ".bin" ) != 0 )
+               continue;
+            const block_id_type id( name.substr( 9, id_size ) );
+            const auto num = block_header::num_from_id( id );
+            if( num <= newest_num || delta_snapshot_reader::is_delta_snapshot( itr->path() ) )
+               continue;
+            newest = itr->path();
+            newest_id = id;
+            newest_num = num;
+         }
+      } catch( const fc::exception& e ) {
+         fc_wlog( logger, "cannot list snapshots of ${d}: ${e}", ("d", snapshots_dir.generic_string())("e", e.to_string()) );
+         return;
+      } catch( const std::exception& e ) {
+         fc_wlog( logger, "cannot list snapshots of ${d}: ${e}", ("d", snapshots_dir.generic_string())("e", e.what()) );
+         return;
+      }
+      if( newest_num == 0 || ( snapshot_served && snapshot_served->path == newest ) )
+         return;
+
+      snapshot_manifest_pending = true;
+      boost::asio::post( thread_pool->get_executor(), [this, newest, newest_id]() {
+         std::shared_ptr<served_snapshot> served;
+         try {
+            served = std::make_shared<served_snapshot>();
+            served->path = newest;
+            served->manifest = snapshot_manifest::compute( newest, newest_id );
+         } catch( const fc::exception& e ) {
+            fc_wlog( logger, "cannot serve snapshot ${f}: ${e}", ("f", newest.generic_string())("e", e.to_string()) );
+            served.reset();
+         }
+         chain::instrumented_post( app(), priority::low, chain::executor_category::net, [this, served]() {
+            snapshot_manifest_pending = false;
+            if( served ) {
+               async_ilog( logger, "serving snapshot of block ${n} to peers, root ${r}",
+                           ("n", served->manifest.block_num())("r", served->manifest.root) );
+               snapshot_served = served;
+            }
+         } );
+      } );
+   }
+
+   void net_plugin_impl::handle_message(const connection_ptr& c, const snapshot_manifest_request_message& msg) {
+      snapshot_manifest_message reply;
+      if( snapshot_serve ) {
+         refresh_served_snapshot();
+         if( snapshot_served && snapshot_served->manifest.block_num() >= msg.min_block_num ) {
+            reply.manifest = snapshot_served->manifest;
+         }
+      }
+      c->enqueue( reply );
+   }
+
+   void net_plugin_impl::handle_message(const connection_ptr& c, const snapshot_manifest_message& msg) {
+      if( snapshot_fetch ) {
+         snapshot_fetch->recv_manifest( c, msg.manifest );
+      }
+   }
+
+   void net_plugin_impl::handle_message(const connection_ptr& c, const snapshot_chunk_request_message& msg) {
+      auto served = snapshot_served;
+      if( !served || served->manifest.block_id != msg.block_id || msg.index >= served->manifest.chunk_count() ) {
+         snapshot_chunk_message reply;
+         reply.block_id = msg.block_id;
+         reply.index = msg.index;
+         c->enqueue( reply );
+         return;
+      }
+      if( snapshot_chunk_reads.load() >= def_snapshot_max_chunk_reads ) {
+         // the requester asks another peer once its request times out
+         async_dlog( logger, "dropping snapshot chunk request of ${p}, ${n} chunks being read",
+                     ("p", c->peer_name())("n", snapshot_chunk_reads.load()) );
+         return;
+      }
+      ++snapshot_chunk_reads;
+      boost::asio::post( thread_pool->get_executor(), [this, weak_conn = std::weak_ptr<connection>( c ), served, index = msg.index]() {
+         auto reply = std::make_shared<snapshot_chunk_message>();
+         reply->block_id = served->manifest.block_id;
+         reply->index = index;
+         try {
+            std::ifstream in( served->path.generic_string(), std::ios::in | std::ios::binary );
+            reply->data.resize( served->manifest.chunk_length( index ) );
+            in.seekg( served->manifest.chunk_offset( index ) );
+            in.read( reply->data.data(), reply->data.size() );
+            if( !in ) {
+               reply->data.clear(); // removed or truncated since the manifest was computed
+            }
+         } catch( ... ) {
+            reply->data.clear();
+         }
+         --snapshot_chunk_reads;
+         chain::instrumented_post( app(), priority::low, chain::executor_category::net, [weak_conn, reply]() {
+            auto c = weak_conn.lock();
+            if( c && c->connected() ) {
+               c->enqueue( *reply );
+            }
+         } );
+      } );
+   }
+
+   void net_plugin_impl::handle_message(const connection_ptr& c, snapshot_chunk_message& msg) {
+      if( snapshot_fetch ) {
+         snapshot_fetch->recv_chunk( c, msg );
+      }
+   }
+
+   void net_plugin_impl::start_snapshot_timer() {
+      snapshot_timer->expires_from_now( def_snapshot_tick );
+      snapshot_timer->async_wait( [this]( boost::system::error_code ec ) {
+         if( ec ) {
+            return;
+         }
+         chain::instrumented_post( app(), priority::low, chain::executor_category::net, [this]() {
+            if( !snapshot_fetch || done ) {
+               return;
+            }
+            snapshot_fetch->tick();
+            if( snapshot_fetch->done() ) {
+               snapshot_fetch.reset();
+            } else {
+               start_snapshot_timer();
+            }
+         } );
+      } );
+   }
+
+   void net_plugin_impl::start_peer_metrics_timer() {
+      peer_metrics_timer->expires_from_now( def_peer_metrics_interval );
+      peer_metrics_timer->async_wait( [this]( boost::system::error_code ec ) {
+         if( ec ) {
+            return;
+         }
+         chain::instrumented_post( app(), priority::low, chain::executor_category::net, [this]() {
+            if( done ) {
+               return;
+            }
+            export_peer_metrics();
+            start_peer_metrics_timer();
+         } );
+      } );
+   }
+
+   void net_plugin_impl::export_peer_metrics() {
+      std::vector<connection_ptr> peers;
+      for( const auto& c : connections ) {
+         c->traffic.take_interval();
+         if( c->socket->is_open() ) {
+            peers.push_back( c );
+         }
+      }
+      // bounded label values: the peers delaying blocks the most are the ones worth a label
+      const auto exported = std::min<size_t>( peers.size(), peer_metrics_max );
+      std::partial_sort( peers.begin(), peers.begin() + exported, peers.end(), []( const connection_ptr& a, const connection_ptr& b ) {
+         return a->traffic.avg_block_lag_us > b->traffic.avg_block_lag_us;
+      } );
+
+      using labels_type = telemetry::gauge_family_handle::labels_type;
+      std::set<string> labels;
+      for( size_t i = 0; i < exported; ++i ) {
+         const auto& c = peers[i];
+         const auto peer = c->peer_name();
+         if( !labels.insert( peer ).second ) {
+            continue;
+         }
+         const labels_type l{ {"peer", peer} };
+         peer_gauges.bytes_in.set( l, c->traffic.bytes_in );
+         peer_gauges.bytes_out.set( l, c->traffic.bytes_out );
+         peer_gauges.write_queue_bytes.set( l, c->buffer_queue.write_queue_size() );
+         peer_gauges.write_wait_us.set( l, c->traffic.avg_write_wait_us );
+         peer_gauges.block_lag_us.set( l, c->traffic.avg_block_lag_us );
+         peer_gauges.rtt_us.set( l, c->score.rtt_us );
+         for( size_t t = 0; t < msg_type_names.size(); ++t ) {
+            if( msg_type_names[t].empty() ) {
+               continue;
+            }
+            const labels_type lt{ {"peer", peer}, {"type", msg_type_names[t]} };
+            peer_gauges.msgs_in.set( lt, c->traffic.msgs_in[t] );
+            peer_gauges.msgs_out.set( lt, c->traffic.msgs_out[t] );
+         }
+      }
+
+      for( const auto& peer : peer_metrics_exported ) {
+         if( labels.count( peer ) ) {
+            continue;
+         }
+         const labels_type l{ {"peer", peer} };
+         for( const auto* g : { &peer_gauges.bytes_in, &peer_gauges.bytes_out, &peer_gauges.write_queue_bytes,
+                                &peer_gauges.write_wait_us, &peer_gauges.block_lag_us, &peer_gauges.rtt_us } ) {
+            g->remove( l );
+         }
+         for( const auto& type : msg_type_names ) {
+            if( type.empty() ) {
+               continue;
+            }
+            const labels_type lt{ {"peer", peer}, {"type", type} };
+            peer_gauges.msgs_in.remove( lt );
+            peer_gauges.msgs_out.remove( lt );
+         }
+      }
+      peer_metrics_exported = std::move( labels );
+   }
+
+   void net_plugin_impl::handle_message(const connection_ptr& c, const block_transactions_message& msg) {
+      if( !c->pending_compact || c->pending_compact->id != msg.block_id ) {
+         async_dlog( logger, "unexpected transactions of block ${id} from ${p}", ("id", msg.block_id)("p", c->peer_name()) );
+         return;
+      }
+      auto pending = std::move( *c->pending_compact );
+      c->pending_compact.reset();
+
+      if( msg.transactions.size() != pending.missing.size() ) {
+         // the peer no longer has the block, ask for it whole
+         request_message req;
+         req.req_blocks.mode = normal;
+         req.req_blocks.ids.push_back( pending.id );
+         c->enqueue( req );
+         return;
+      }
+      for( size_t i = 0; i < pending.missing.size(); ++i ) {
+         pending.block->transactions[pending.missing[i]].trx = msg.transactions[i];
+      }
+      accept_compact_block( c, pending.block, pending.id, pending.received );
+   }
+
+   void net_plugin_impl::accept_compact_block(const connection_ptr& c, const signed_block_ptr& b, const block_id_type& id, const fc::time_point& received) {
+      // a local transaction with the id of a block transaction may have other signatures
+      vector<digest_type> trx_digests;
+      trx_digests.reserve( b->transactions.size() );
+      for( const auto& receipt : b->transactions ) {
+         trx_digests.emplace_back( receipt.digest() );
+      }
+      if( merkle( std::move( trx_digests ) ) != b->transaction_mroot ) {
+         fc_wlog( logger, "transactions of compact block ${id} from ${p} do not match, requesting the block",
+                  ("id", id)("p", c->peer_name()) );
+         request_message req;
+         req.req_blocks.mode = normal;
+         req.req_blocks.ids.push_back( id );
+         c->enqueue( req );
+         return;
+      }
+      handle_message( c, b, received );
+   }
+
+   void net_plugin_impl::handle_message(const connection_ptr& c, const signed_block_ptr& msg, const fc::time_point& received) {
       controller &cc = chain_plug->chain();
       block_id_type blk_id = msg->id();
       uint32_t blk_num = msg->block_num();
-      fc_dlog(logger, "canceling wait on ${p}", ("p",c->peer_name()));
+      async_dlog(logger, "canceling wait on ${p}", ("p",c->peer_name()));
       c->cancel_wait();
 
       try {
@@ -2772,11 +4092,18 @@ namespace eosio {
          fc_elog( logger,"Caught an unknown exception trying to recall blockID" );
       }
 
+      if( sync_master->buffer_block( c, msg, received ) ) {
+         return;
+      }
+
       dispatcher->recv_block(c, blk_id, blk_num);
       fc::microseconds age( fc::time_point::now() - msg->timestamp);
+      c->traffic.add_block_lag( age );
       peer_ilog(c, "received signed_block : #${n} block age in secs = ${age}",
               ("n",blk_num)("age",age.to_seconds()));
 
+      cc.pipeline_stage_timed( { controller::pipeline_stage::block_receive, fc::time_point::now() - received } );
+
       go_away_reason reason = fatal_other;
       try {
          bool accepted = chain_plug->accept_block(msg, blk_id);
@@ -2798,7 +4125,7 @@ namespace eosio {
 
       update_block_num ubn(blk_num);
       if( reason == no_reason ) {
-         fc_dlog( logger, "accepted signed_block : #${n} ${id}...", ("n", msg->block_num())("id", blk_id.str().substr(8,16)) );
+         async_dlog( logger, "accepted signed_block : #${n} ${id}...", ("n", msg->block_num())("id", blk_id.str().substr(8,16)) );
          for (const auto &recpt : msg->transactions) {
             auto id = (recpt.trx.which() == 0) ? recpt.trx.get<transaction_id_type>() : recpt.trx.get<packed_transaction>().id();
             auto ltx = local_txns.get<by_id>().find(id);
@@ -2821,7 +4148,7 @@ namespace eosio {
    void net_plugin_impl::start_conn_timer(boost::asio::steady_timer::duration du, std::weak_ptr<connection> from_connection) {
       connector_check->expires_from_now( du);
       connector_check->async_wait( [this, from_connection](boost::system::error_code ec) {
-            app().post( priority::low, [this, from_connection, ec]() {
+            chain::instrumented_post( app(), priority::low, chain::executor_category::net, [this, from_connection, ec]() {
             if( !ec) {
                connection_monitor(from_connection);
             }
@@ -2833,16 +4160,35 @@ namespace eosio {
       });
    }
 
-   void net_plugin_impl::start_txn_timer() {
-      transaction_check->expires_from_now( txn_exp_period);
+   void net_plugin_impl::start_txn_timer(boost::asio::steady_timer::duration du) {
+      transaction_check->expires_from_now( du );
       transaction_check->async_wait( [this]( boost::system::error_code ec ) {
          int lower_than_low = priority::low - 1;
-         app().post( lower_than_low, [this, ec]() {
+         chain::instrumented_post( app(), lower_than_low, chain::executor_category::net, [this, ec]() {
             if( !ec ) {
                expire_txns();
             } else {
                fc_elog( logger, "Error from transaction check monitor: ${m}", ("m", ec.message()));
-               start_txn_timer();
+               start_txn_timer( txn_exp_period );
+            }
+         } );
+      });
+   }
+
+   void net_plugin_impl::schedule_trx_announcements() {
+      if( trx_announce_scheduled ) {
+         return;
+      }
+      trx_announce_scheduled = true;
+      trx_announce_timer->expires_from_now( def_trx_announce_interval );
+      trx_announce_timer->async_wait( [this]( boost::system::error_code ec ) {
+         chain::instrumented_post( app(), priority::medium, chain::executor_category::net, [this, ec]() {
+            trx_announce_scheduled = false;
+            if( ec ) {
+               return;
+            }
+            for( const auto& c : connections ) {
+               c->announce_transactions();
             }
          } );
       });
@@ -2851,7 +4197,7 @@ namespace eosio {
    void net_plugin_impl::ticker() {
       keepalive_timer->expires_from_now(keepalive_interval);
       keepalive_timer->async_wait( [this]( boost::system::error_code ec ) {
-         app().post( priority::low, [this, ec]() {
+         chain::instrumented_post( app(), priority::low, chain::executor_category::net, [this, ec]() {
             ticker();
             if( ec ) {
                fc_wlog( logger, "Peer keepalive ticked sooner than expected: ${m}", ("m", ec.message()) );
@@ -2869,42 +4215,80 @@ namespace eosio {
       connector_check.reset(new boost::asio::steady_timer( my_impl->thread_pool->get_executor() ));
       transaction_check.reset(new boost::asio::steady_timer( my_impl->thread_pool->get_executor() ));
       start_conn_timer(connector_period, std::weak_ptr<connection>());
-      start_txn_timer();
+      start_txn_timer( txn_exp_period );
    }
 
-   void net_plugin_impl::expire_txns() {
-      start_txn_timer();
+   /// erases [first, last) of `idx`, calling `on_erase` with each entry first; false if `deadline` passed before the end
+   template<typename Index, typename Iterator, typename OnErase>
+   static bool erase_until( Index& idx, Iterator first, Iterator last, const fc::time_point& deadline, OnErase&& on_erase ) {
+      for( uint32_t n = 1; first != last; ++n ) {
+         on_erase( *first );
+         first = idx.erase( first );
+         if( n % def_expire_check_interval == 0 && first != last && fc::time_point::now() >= deadline ) {
+            return false;
+         }
+      }
+      return true;
+   }
+
+   template<typename Index, typename Iterator>
+   static bool erase_until( Index& idx, Iterator first, Iterator last, const fc::time_point& deadline ) {
+      return erase_until( idx, first, last, deadline, []( const auto& ) {} );
+   }
 
+   void net_plugin_impl::expire_txns() {
       auto now = time_point::now();
       auto start_size = local_txns.size();
+      const auto max_time = now + fc::milliseconds( max_cleanup_time_ms );
 
-      expire_local_txns();
+      bool done = expire_local_txns( max_time );
 
       controller& cc = chain_plug->chain();
       uint32_t lib = cc.last_irreversible_block_num();
       dispatcher->expire_blocks( lib );
-      for ( auto &c : connections ) {
+      for( auto itr = dispatcher->requested_transactions.begin(); itr != dispatcher->requested_transactions.end(); ) {
+         itr = itr->second <= now ? dispatcher->requested_transactions.erase( itr ) : std::next( itr );
+      }
+      for( auto itr = connections.begin(); done && itr != connections.end(); ++itr ) {
+         const auto& c = *itr;
          auto &stale_txn = c->trx_state.get<by_block_num>();
-         stale_txn.erase( stale_txn.lower_bound(1), stale_txn.upper_bound(lib) );
          auto &stale_txn_e = c->trx_state.get<by_expiry>();
-         stale_txn_e.erase(stale_txn_e.lower_bound(time_point_sec()), stale_txn_e.upper_bound(time_point::now()));
          auto &stale_blk = c->blk_state.get<by_block_num>();
-         stale_blk.erase( stale_blk.lower_bound(1), stale_blk.upper_bound(lib) );
-      }
-      fc_dlog(logger, "expire_txns ${n}us size ${s} removed ${r}",
-            ("n", time_point::now() - now)("s", start_size)("r", start_size - local_txns.size()) );
+         done = erase_until( stale_txn, stale_txn.lower_bound(1), stale_txn.upper_bound(lib), max_time ) &&
+                erase_until( stale_txn_e, stale_txn_e.lower_bound(time_point_sec()), stale_txn_e.upper_bound(time_point::now()), max_time ) &&
+                erase_until( stale_blk, stale_blk.lower_bound(1), stale_blk.upper_bound(lib), max_time );
+      }
+      // a sweep over max-cleanup-time-msec resumes shortly, the swept entries are not visited again
+      start_txn_timer( done ? txn_exp_period : std::chrono::milliseconds(1) );
+      async_dlog(logger, "expire_txns ${n}us size ${s} removed ${r}${p}",
+            ("n", time_point::now() - now)("s", start_size)("r", start_size - local_txns.size())("p", done ? "" : ", continuing") );
    }
 
-   void net_plugin_impl::expire_local_txns() {
+   bool net_plugin_impl::expire_local_txns(const fc::time_point& deadline) {
+      // most buffers are released for good here, free them on a net thread rather than the main thread
+      std::vector<std::shared_ptr<vector<char>>> released;
+      const auto release = [&released]( const node_transaction_state& nts ) {
+         if( nts.serialized_txn ) {
+            released.push_back( nts.serialized_txn );
+         }
+      };
+
       auto& old = local_txns.get<by_expiry>();
       auto ex_lo = old.lower_bound( fc::time_point_sec(0) );
       auto ex_up = old.upper_bound( time_point::now() );
-      old.erase( ex_lo, ex_up );
+      bool done = erase_until( old, ex_lo, ex_up, deadline, release );
 
-      auto& stale = local_txns.get<by_block_num>();
-      controller& cc = chain_plug->chain();
-      uint32_t lib = cc.last_irreversible_block_num();
-      stale.erase( stale.lower_bound(1), stale.upper_bound(lib) );
+      if( done ) {
+         auto& stale = local_txns.get<by_block_num>();
+         controller& cc = chain_plug->chain();
+         uint32_t lib = cc.last_irreversible_block_num();
+         done = erase_until( stale, stale.lower_bound(1), stale.upper_bound(lib), deadline, release );
+      }
+
+      if( !released.empty() ) {
+         boost::asio::post( thread_pool->get_executor(), [released{std::move( released )}]() {} );
+      }
+      return done;
    }
 
    void net_plugin_impl::connection_monitor(std::weak_ptr<connection> from_connection) {
@@ -2938,9 +4322,9 @@ namespace eosio {
       }
       start_conn_timer(connector_period, std::weak_ptr<connection>());
       if( num_clients > 0 || num_peers > 0 )
-         fc_ilog( logger, "p2p client connections: ${num}/${max}, peer connections: ${pnum}/${pmax}",
+         async_ilog( logger, "p2p client connections: ${num}/${max}, peer connections: ${pnum}/${pmax}",
                   ("num", num_clients)("max", max_client_count)("pnum", num_peers)("pmax", supplied_peers.size()) );
-      fc_dlog( logger, "connection monitor, removed ${n} connections", ("n", num_rm) );
+      async_dlog( logger, "connection monitor, removed ${n} connections", ("n", num_rm) );
    }
 
    void net_plugin_impl::close(const connection_ptr& c) {
@@ -2957,7 +4341,7 @@ namespace eosio {
 
    void net_plugin_impl::accepted_block(const block_state_ptr& block) {
       controller& cc = chain_plug->chain();
-      fc_dlog(logger,"signaled accepted_block, id = ${id}",("id", block->id));
+      async_dlog(logger,"signaled accepted_block, id = ${id}",("id", block->id));
       dispatcher->bcast_block(block->block, block->id);
    }
 
@@ -2965,18 +4349,26 @@ namespace eosio {
       controller& cc = chain_plug->chain();
       if( cc.is_trusted_producer(block->producer) ) {
          auto id = block->id();
-         fc_dlog(logger,"signaled accepted_block_header, id = ${id}",("id", id));
+         async_dlog(logger,"signaled accepted_block_header, id = ${id}",("id", id));
          dispatcher->bcast_block(block, id);
       }
    }
 
+   void net_plugin_impl::accepted_block_header(const block_state_ptr& block) {
+      // blocks of trusted producers were relayed by pre_accepted_block; peers that were sent the block here are
+      // skipped by accepted_block, as they have it
+      if( chain_plug->chain().is_trusted_producer(block->block->producer) ) return;
+      async_dlog(logger,"signaled accepted_block_header, early relay of id = ${id}",("id", block->id));
+      dispatcher->bcast_block(block->block, block->id, true);
+   }
+
    void net_plugin_impl::transaction_ack(const std::pair<fc::exception_ptr, transaction_metadata_ptr>& results) {
       const auto& id = results.second->id;
       if (results.first) {
-         fc_ilog(logger,"signaled NACK, trx-id = ${id} : ${why}",("id", id)("why", results.first->to_detail_string()));
+         async_ilog(logger,"signaled NACK, trx-id = ${id} : ${why}",("id", id)("why", results.first->to_detail_string()));
          dispatcher->rejected_transaction(id);
       } else {
-         fc_ilog(logger,"signaled ACK, trx-id = ${id}",("id", id));
+         async_ilog(logger,"signaled ACK, trx-id = ${id}",("id", id));
          dispatcher->bcast_transaction(results.second);
       }
    }
@@ -3030,7 +4422,7 @@ namespace eosio {
          }
       }
       else if(allowed_connections & (Producers | Specified)) {
-         fc_dlog( logger, "Peer sent a handshake with blank signature and token, but this node accepts only authenticated connections." );
+         async_dlog( logger, "Peer sent a handshake with blank signature and token, but this node accepts only authenticated connections." );
          return false;
       }
       return true;
@@ -3119,6 +4511,10 @@ namespace eosio {
       my->send(peer_num, msg);
    }
 
+   void net_plugin::send(const std::vector<uint32_t>& peer_nums, uint32_t msg_type, const std::vector<char>& data) {
+      my->send(peer_nums, msg_type, data);
+   }
+
    void net_plugin::subscribe(uint32_t msg_type, subs_cb&& cb) {
       my->subscribe(msg_type, std::move(cb));
    }
@@ -3132,6 +4528,25 @@ namespace eosio {
          ( "p2p-peer-address", bpo::value< vector<string> >()->composing(), "The public endpoint of a peer node to connect to. Use multiple p2p-peer-address options as needed to compose a network.")
          ( "p2p-max-nodes-per-host", bpo::value<int>()->default_value(def_max_nodes_per_host), "Maximum number of client nodes from any single IP address")
          ( "p2p-accept-transactions", bpo::value<bool>()->default_value(true), "Allow transactions received over p2p network to be evaluated and relayed if valid.")
+         ( "p2p-compact-blocks", bpo::value<bool>()->default_value(true), "Relay blocks to peers that support it with the transactions they were already sent replaced by their ids.")
+         ( "p2p-trx-announce-peer", bpo::value< vector<string> >()->composing(),
+           "host:port of a peer to relay transactions to as batches of ids it requests the missing transactions of, instead of pushing them; '*' for every peer. May be used multiple times. Applies to peers that support it.")
+         ( "p2p-early-relay", bpo::value<bool>()->default_value(false),
+           "Relay blocks to peers that support it as soon as their header and producer signature are validated, before they are applied. The peers still apply them before building on them.")
+         ( "p2p-compression", bpo::value<bool>()->default_value(true),
+           "Compress blocks sent to peers that support it with zlib. Blocks are sent uncompressed when they do not shrink by a ninth, and while compression took more than a fifth of the main thread in the last second.")
+         ( "p2p-peer-metrics", bpo::value<uint32_t>()->default_value(0),
+           "Export bytes and messages in and out, write queue depth and wait, block lag behind the block timestamps and round trip time of up to this many peers to telemetry, labeled by peer; the peers with the most block lag are exported. 0 disables.")
+         ( "p2p-snapshot-serve", bpo::value<bool>()->default_value(false),
+           "Serve the newest full snapshot of p2p-snapshots-dir to peers bootstrapping from it, in chunks checked against its manifest.")
+         ( "p2p-snapshots-dir", bpo::value<boost::filesystem::path>()->default_value("snapshots"),
+           "The directory of the snapshots served by p2p-snapshot-serve, absolute or relative to the data dir; the snapshots-dir of producer_plugin.")
+         ( "p2p-snapshot-bootstrap", bpo::value<bool>()->default_value(false),
+           "While the chain is at genesis, fetch a snapshot from the peers that serve it and quit; the snapshot replaces the state and blocks at the next start.")
+         ( "p2p-snapshot-min-peers", bpo::value<uint32_t>()->default_value(2),
+           "Number of connected peers that must offer the same snapshot manifest for p2p-snapshot-bootstrap to fetch it.")
+         ( "p2p-snapshot-root", bpo::value<string>(),
+           "Merkle root of the chunk hashes of the snapshot for p2p-snapshot-bootstrap to fetch, from a trusted source; a single peer offering it is enough.")
          ( "agent-name", bpo::value<string>()->default_value("\"EOS Test Agent\""), "The name supplied to identify this node amongst the peers.")
          ( "allowed-connection", bpo::value<vector<string>>()->multitoken()->default_value({"any"}, "any"), "Can be 'any' or 'producers' or 'specified' or 'none'. If 'specified', peer-key must be specified at least once. If only 'producers', peer-key is not required. 'producers' and 'specified' may be combined.")
          ( "peer-key", bpo::value<vector<string>>()->composing()->multitoken(), "Optional public key of peer allowed to connect.  May be used multiple times.")
@@ -3143,8 +4558,12 @@ namespace eosio {
          ( "network-version-match", bpo::value<bool>()->default_value(false),
            "DEPRECATED, needless restriction. True to require exact match of peer network version.")
          ( "net-threads", bpo::value<uint16_t>()->default_value(my->thread_pool_size),
-           "Number of worker threads in net_plugin thread pool" )
+           "Number of worker threads in net_plugin thread pool, which also unpack the messages of the connections" )
          ( "sync-fetch-span", bpo::value<uint32_t>()->default_value(def_sync_fetch_span), "number of blocks to retrieve in a chunk from any individual peer during synchronization")
+         ( "sync-peer-ranges", bpo::value<uint32_t>()->default_value(def_sync_peer_ranges),
+           "number of block ranges requested at once from each peer during synchronization; range sizes follow the throughput of the peer, from a quarter to four times sync-fetch-span")
+         ( "sync-prefetch-blocks", bpo::value<uint32_t>()->default_value(def_sync_prefetch_blocks),
+           "number of received blocks validated ahead of application during synchronization; signatures of these blocks are recovered in parallel on the chain thread pool (0 to disable)")
          ( "use-socket-read-watermark", bpo::value<bool>()->default_value(false), "Enable experimental socket read watermark optimization")
          ( "peer-log-format", bpo::value<string>()->default_value( "[\"${_name}\" ${_ip}:${_port}]" ),
            "The string used to format peers when logging messages about them.  Variables are escaped with ${<variable name>}.\n"
@@ -3165,7 +4584,7 @@ namespace eosio {
    }
 
    void net_plugin::plugin_initialize( const variables_map& options ) {
-      fc_ilog( logger, "Initialize net plugin" );
+      async_ilog( logger, "Initialize net plugin" );
       try {
          peer_log_format = options.at( "peer-log-format" ).as<string>();
 
@@ -3173,7 +4592,9 @@ namespace eosio {
          if( my->network_version_match )
             wlog( "network-version-match is DEPRECATED as it is a needless restriction" );
 
-         my->sync_master.reset( new sync_manager( options.at( "sync-fetch-span" ).as<uint32_t>()));
+         my->sync_master.reset( new sync_manager( options.at( "sync-fetch-span" ).as<uint32_t>(),
+                                                  options.at( "sync-peer-ranges" ).as<uint32_t>() ) );
+         my->sync_prefetch_blocks = options.at( "sync-prefetch-blocks" ).as<uint32_t>();
          my->dispatcher.reset( new dispatch_manager );
 
          my->connector_period = std::chrono::seconds( options.at( "connection-cleanup-period" ).as<int>());
@@ -3185,8 +4606,40 @@ namespace eosio {
          my->num_clients = 0;
          my->started_sessions = 0;
          my->p2p_accept_transactions = options.at( "p2p-accept-transactions" ).as<bool>();
+         my->p2p_compact_blocks = options.at( "p2p-compact-blocks" ).as<bool>();
+         my->p2p_early_relay = options.at( "p2p-early-relay" ).as<bool>();
+         my->p2p_compression = options.at( "p2p-compression" ).as<bool>();
+         if( options.count( "p2p-trx-announce-peer" ) ) {
+            for( const auto& peer : options.at( "p2p-trx-announce-peer" ).as<vector<string>>() ) {
+               if( peer == "*" ) {
+                  my->trx_announce_all = true;
+               } else {
+                  my->trx_announce_peers.insert( peer );
+               }
+            }
+         }
 
          my->use_socket_read_watermark = options.at( "use-socket-read-watermark" ).as<bool>();
+         my->peer_metrics_max = options.at( "p2p-peer-metrics" ).as<uint32_t>();
+
+         my->snapshot_serve = options.at( "p2p-snapshot-serve" ).as<bool>();
+         my->snapshots_dir = options.at( "p2p-snapshots-dir" ).as<boost::filesystem::path>();
+         if( my->snapshots_dir.is_relative() ) {
+            my->snapshots_dir = app().data_dir() / my->snapshots_dir;
+         }
+         if( my->snapshot_serve && !fc::is_directory( my->snapshots_dir ) ) {
+            wlog( "p2p-snapshots-dir ${d} does not exist, no snapshot is served until it is created", ("d", my->snapshots_dir.generic_string()) );
+         }
+         if( options.at( "p2p-snapshot-bootstrap" ).as<bool>() ) {
+            optional<digest_type> root;
+            if( options.count( "p2p-snapshot-root" ) ) {
+               root = digest_type( options.at( "p2p-snapshot-root" ).as<string>() );
+            }
+            // created at startup, once the chain is loaded and known to be at genesis
+            my->snapshot_bootstrap_root = root;
+            my->snapshot_bootstrap = true;
+            my->snapshot_bootstrap_min_peers = options.at( "p2p-snapshot-min-peers" ).as<uint32_t>();
+         }
 
          if( options.count( "p2p-listen-endpoint" ) && options.at("p2p-listen-endpoint").as<string>().length()) {
             my->p2p_address = options.at( "p2p-listen-endpoint" ).as<string>();
@@ -3251,7 +4704,7 @@ namespace eosio {
          EOS_ASSERT( my->chain_plug, chain::missing_chain_plugin_exception, ""  );
          my->chain_id = my->chain_plug->get_chain_id();
          fc::rand_pseudo_bytes( my->node_id.data(), my->node_id.data_size());
-         fc_ilog( logger, "my node_id is ${id}", ("id", my->node_id ));
+         async_ilog( logger, "my node_id is ${id}", ("id", my->node_id ));
 
          const controller& cc = my->chain_plug->chain();
          if( cc.get_read_mode() == db_read_mode::IRREVERSIBLE || cc.get_read_mode() == db_read_mode::READ_ONLY ) {
@@ -3271,14 +4724,64 @@ namespace eosio {
    void net_plugin::plugin_startup() {
       handle_sighup();
       try {
+      ///@{
+      /// HAYA: [cyb-277] add net msg count metrics; registered before net threads start
+      add_metric(handshake_message);
+      add_metric(chain_size_message);
+      add_metric(go_away_message);
+      add_metric(time_message);
+      add_metric(notice_message);
+      add_metric(request_message);
+      add_metric(sync_request_message);
+      add_metric(signed_block);
+      add_metric(packed_transaction);
+      add_metric(custom_message);
+      add_metric(compact_block_message);
+      add_metric(get_block_transactions_message);
+      add_metric(block_transactions_message);
+      add_metric(snapshot_manifest_request_message);
+      add_metric(snapshot_manifest_message);
+      add_metric(snapshot_chunk_request_message);
+      add_metric(snapshot_chunk_message);
+      my->in_msg_total_counter = app().get_plugin<telemetry_plugin>().register_counter("net_in_total_cnt");
+      my->out_msg_total_counter = app().get_plugin<telemetry_plugin>().register_counter("net_out_total_cnt");
+      ///@}
+      my->compressed_msg_counter = app().get_plugin<telemetry_plugin>().register_counter("net_compressed_msg_cnt");
+      my->compression_in_bytes_counter = app().get_plugin<telemetry_plugin>().register_counter("net_compression_in_bytes");
+      my->compression_out_bytes_counter = app().get_plugin<telemetry_plugin>().register_counter("net_compression_out_bytes");
+      my->compression_skipped_counter = app().get_plugin<telemetry_plugin>().register_counter("net_compression_skipped_cnt");
+      {
+         const std::vector<double> queue_time_keypoints{ 100, 1000, 10000, 100000, 1000000 };
+         const char* names[] = { "consensus", "sync", "general" };
+         static_assert( sizeof(names) / sizeof(names[0]) == size_t(write_priority::count), "name every write_priority" );
+         for( size_t i = 0; i < size_t(write_priority::count); ++i ) {
+            my->write_queue_histograms[i] = app().get_plugin<telemetry_plugin>().register_histogram(
+                  std::string("net_write_queue_") + names[i] + "_us", queue_time_keypoints );
+         }
+      }
+      if( my->peer_metrics_max > 0 ) {
+         auto& telemetry = app().get_plugin<telemetry_plugin>();
+         auto& g = my->peer_gauges;
+         g.bytes_in = telemetry.register_gauge_family( "net_peer_in_bytes", "Bytes received from the peer" );
+         g.bytes_out = telemetry.register_gauge_family( "net_peer_out_bytes", "Bytes sent to the peer" );
+         g.msgs_in = telemetry.register_gauge_family( "net_peer_in_msg_cnt", "Messages received from the peer, by type" );
+         g.msgs_out = telemetry.register_gauge_family( "net_peer_out_msg_cnt", "Messages queued for the peer, by type" );
+         g.write_queue_bytes = telemetry.register_gauge_family( "net_peer_write_queue_bytes", "Bytes waiting in the write queue of the peer" );
+         g.write_wait_us = telemetry.register_gauge_family( "net_peer_write_wait_us",
+                                                            "Average time messages written to the peer waited in its write queue" );
+         g.block_lag_us = telemetry.register_gauge_family( "net_peer_block_lag_us",
+                                                           "Average time from the timestamp of the blocks received from the peer to their arrival" );
+         g.rtt_us = telemetry.register_gauge_family( "net_peer_rtt_us", "Round trip time to the peer from time_message exchanges" );
+      }
+
       my->producer_plug = app().find_plugin<producer_plugin>();
 
-      // currently thread_pool only used for server_ioc
+      // sockets, timers and the connection strands, which unpack incoming messages
       my->thread_pool.emplace( "net", my->thread_pool_size );
 
       shared_ptr<tcp::resolver> resolver = std::make_shared<tcp::resolver>( my_impl->thread_pool->get_executor() );
       if( !my->p2p_accept_transactions && my->p2p_address.size() ) {
-         fc_ilog( logger, "\n"
+         async_ilog( logger, "\n"
                "***********************************\n"
                "* p2p-accept-transactions = false *\n"
                "*    Transactions not forwarded   *\n"
@@ -3322,17 +4825,36 @@ namespace eosio {
            elog( "net_plugin::plugin_startup failed to bind to port ${port}", ("port", my->listen_endpoint.port()));
            throw e;
          }
-         fc_ilog( logger, "starting listener, max clients is ${mc}",("mc",my->max_client_count) );
+         async_ilog( logger, "starting listener, max clients is ${mc}",("mc",my->max_client_count) );
          my->start_listen_loop();
       }
       chain::controller&cc = my->chain_plug->chain();
       {
-         cc.accepted_block.connect(  boost::bind(&net_plugin_impl::accepted_block, my.get(), _1));
+         cc.accepted_block.connect( chain::timed_slot( "net_accepted_block", boost::bind(&net_plugin_impl::accepted_block, my.get(), _1) ) );
          cc.pre_accepted_block.connect( boost::bind(&net_plugin_impl::pre_accepted_block, my.get(), _1) );
+         if( my->p2p_early_relay ) {
+            cc.accepted_block_header.connect( chain::timed_slot( "net_accepted_block_header", boost::bind(&net_plugin_impl::accepted_block_header, my.get(), _1) ) );
+         }
       }
 
       my->keepalive_timer.reset( new boost::asio::steady_timer( my->thread_pool->get_executor() ) );
+      my->trx_announce_timer.reset( new boost::asio::steady_timer( my->thread_pool->get_executor() ) );
+      my->snapshot_timer.reset( new boost::asio::steady_timer( my->thread_pool->get_executor() ) );
       my->ticker();
+      if( my->peer_metrics_max > 0 ) {
+         my->peer_metrics_timer.reset( new boost::asio::steady_timer( my->thread_pool->get_executor() ) );
+         my->start_peer_metrics_timer();
+      }
+
+      if( my->snapshot_bootstrap ) {
+         if( cc.head_block_num() > 1 ) {
+            async_ilog( logger, "p2p-snapshot-bootstrap ignored, the chain is at block ${n}", ("n", cc.head_block_num()) );
+         } else {
+            my->snapshot_fetch.reset( new snapshot_fetcher( my->chain_plug->bootstrap_snapshot_path(),
+                                                            my->snapshot_bootstrap_min_peers, my->snapshot_bootstrap_root ) );
+            my->start_snapshot_timer();
+         }
+      }
 
       my->incoming_transaction_ack_subscription = app().get_channel<channels::transaction_ack>().subscribe(boost::bind(&net_plugin_impl::transaction_ack, my.get(), _1));
 
@@ -3343,21 +4865,6 @@ namespace eosio {
       }
       handle_sighup();
 
-      ///@{
-      /// HAYA: [cyb-277] add net msg count metrics
-      add_metric(handshake_message);
-      add_metric(chain_size_message);
-      add_metric(go_away_message);
-      add_metric(time_message);
-      add_metric(notice_message);
-      add_metric(request_message);
-      add_metric(sync_request_message);
-      add_metric(signed_block);
-      add_metric(packed_transaction);
-      add_metric(custom_message);
-      add_metric(total);
-      ///@}
-
       } catch (...) {
          // always want plugin_shutdown even on exception
          plugin_shutdown();
@@ -3371,24 +4878,30 @@ namespace eosio {
 
    void net_plugin::plugin_shutdown() {
       try {
-         fc_ilog( logger, "shutdown.." );
+         async_ilog( logger, "shutdown.." );
          if( my->connector_check )
             my->connector_check->cancel();
          if( my->transaction_check )
             my->transaction_check->cancel();
          if( my->keepalive_timer )
             my->keepalive_timer->cancel();
+         if( my->trx_announce_timer )
+            my->trx_announce_timer->cancel();
+         if( my->snapshot_timer )
+            my->snapshot_timer->cancel();
+         if( my->peer_metrics_timer )
+            my->peer_metrics_timer->cancel();
 
          my->done = true;
          if( my->acceptor ) {
-            fc_ilog( logger, "close acceptor" );
+            async_ilog( logger, "close acceptor" );
             boost::system::error_code ec;
             my->acceptor->cancel( ec );
             my->acceptor->close( ec );
 
-            fc_ilog( logger, "close ${s} connections",( "s",my->connections.size()) );
+            async_ilog( logger, "close ${s} connections",( "s",my->connections.size()) );
             for( auto& con : my->connections ) {
-               fc_dlog( logger, "close: ${p}", ("p",con->peer_name()) );
+               async_dlog( logger, "close: ${p}", ("p",con->peer_name()) );
                my->close( con );
             }
             my->connections.clear();
@@ -3400,7 +4913,7 @@ namespace eosio {
 
          app().post( 0, [me = my](){} ); // keep my pointer alive until queue is drained
 
-         fc_ilog( logger, "exit shutdown" );
+         async_ilog( logger, "exit shutdown" );
       }
       FC_CAPTURE_AND_RETHROW()
    }
@@ -3417,13 +4930,13 @@ namespace eosio {
          return "already connected";
 
       connection_ptr c = std::make_shared<connection>(host);
-      fc_dlog(logger,"adding new connection to the list");
+      async_dlog(logger,"adding new connection to the list");
       my->connections.insert( c );
       ///@{
       /// HAYA: [cyb-284] use net_plugin in randpa
       my->connections_by_num[c->num] = c;
       ///@}
-      fc_dlog(logger,"calling active connector");
+      async_dlog(logger,"calling active connector");
       my->connect( c );
       return "added connection";
    }
@@ -3432,7 +4945,7 @@ namespace eosio {
       for( auto itr = my->connections.begin(); itr != my->connections.end(); ++itr ) {
          if( (*itr)->peer_addr == host ) {
             (*itr)->reset();
-            fc_ilog( logger, "disconnecting: ${p}", ("p", (*itr)->peer_name()) );
+            async_ilog( logger, "disconnecting: ${p}", ("p", (*itr)->peer_name()) );
             my->close(*itr);
             ///@{
             /// HAYA: [cyb-284] use net_plugin in randpa
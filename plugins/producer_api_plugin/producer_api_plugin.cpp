@@ -128,6 +128,8 @@ void producer_api_plugin::plugin_startup() {
                                  producer_plugin::get_supported_protocol_features_params), 201),
        CALL(producer, producer, get_account_ram_corrections,
             INVOKE_R_R(producer, get_account_ram_corrections, producer_plugin::get_account_ram_corrections_params), 201),
+       CALL(producer, producer, get_block_time_budgets,
+            INVOKE_R_R(producer, get_block_time_budgets, producer_plugin::get_block_time_budgets_params), 201),
    });
 }
 
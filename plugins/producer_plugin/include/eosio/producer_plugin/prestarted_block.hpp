@@ -0,0 +1,28 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+
+#pragma once
+
+#include <eosio/chain/controller.hpp>
+
+namespace eosio {
+
+/**
+ * Block started while waiting for the production window of a producer of this node. Incoming transactions are
+ * queued until the window opens, so the block holds only what controller::start_block applied.
+ */
+struct prestarted_block {
+   chain::block_id_type   head;
+   fc::time_point         block_time;
+   uint16_t               blocks_to_confirm = 0;
+
+   /// the pending block of `chain` is this block and can be produced at `time` confirming `confirm` blocks
+   bool is_pending( const chain::controller& chain, fc::time_point time, uint16_t confirm ) const {
+      return chain.is_building_block() && chain.head_block_id() == head && chain.pending_block_time() == time
+             && block_time == time && blocks_to_confirm == confirm;
+   }
+};
+
+} // namespace eosio
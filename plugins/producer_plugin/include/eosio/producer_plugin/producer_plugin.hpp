@@ -45,6 +45,7 @@ public:
    struct integrity_hash_information {
       chain::block_id_type head_block_id;
       chain::digest_type   integrity_hash;
+      uint32_t             version = 1; ///< 2 if integrity-hash-threads is set
    };
 
    struct snapshot_information {
@@ -73,6 +74,27 @@ public:
       optional<account_name>   more;
    };
 
+   /// where the time of a block produced by this node went, in microseconds
+   struct block_time_budget {
+      uint32_t             block_num = 0;
+      chain::account_name  producer;
+      int64_t              total_us = 0;      ///< from starting the pending block to committing it
+      int64_t              start_us = 0;      ///< aborting the previous pending block and starting this one
+      int64_t              unapplied_us = 0;  ///< applying transactions of aborted and popped blocks again
+      int64_t              scheduled_us = 0;
+      int64_t              incoming_us = 0;
+      int64_t              exhausted_us = 0;  ///< part of the three above lost to transactions aborted for an exhausted block
+      int64_t              finalize_us = 0;   ///< without signing
+      int64_t              sign_us = 0;
+      int64_t              commit_us = 0;
+      int64_t              expire_us = 0;     ///< expiring the persisted transactions left over from between blocks
+      int64_t              idle_us = 0;       ///< the rest: waiting for transactions and for the block deadline
+   };
+
+   struct get_block_time_budgets_params {
+      uint32_t limit = 12;
+   };
+
    template<typename T>
    using next_function = std::function<void(const fc::static_variant<fc::exception_ptr, T>&)>;
 
@@ -114,6 +136,9 @@ public:
    fc::variants get_supported_protocol_features( const get_supported_protocol_features_params& params ) const;
 
    get_account_ram_corrections_result  get_account_ram_corrections( const get_account_ram_corrections_params& params ) const;
+
+   /// time budgets of the last blocks produced by this node, most recent first
+   std::vector<block_time_budget> get_block_time_budgets( const get_block_time_budgets_params& params ) const;
    
 private:
    std::shared_ptr<class producer_plugin_impl> my;
@@ -124,9 +149,12 @@ private:
 FC_REFLECT(eosio::producer_plugin::runtime_options, (max_transaction_time)(max_irreversible_block_age)(produce_time_offset_us)(last_block_time_offset_us)(max_scheduled_transaction_time_per_block_ms)(subjective_cpu_leeway_us)(incoming_defer_ratio)(greylist_limit));
 FC_REFLECT(eosio::producer_plugin::greylist_params, (accounts));
 FC_REFLECT(eosio::producer_plugin::whitelist_blacklist, (actor_whitelist)(actor_blacklist)(contract_whitelist)(contract_blacklist)(action_blacklist)(key_blacklist) )
-FC_REFLECT(eosio::producer_plugin::integrity_hash_information, (head_block_id)(integrity_hash))
+FC_REFLECT(eosio::producer_plugin::integrity_hash_information, (head_block_id)(integrity_hash)(version))
 FC_REFLECT(eosio::producer_plugin::snapshot_information, (head_block_id)(snapshot_name))
 FC_REFLECT(eosio::producer_plugin::scheduled_protocol_feature_activations, (protocol_features_to_activate))
 FC_REFLECT(eosio::producer_plugin::get_supported_protocol_features_params, (exclude_disabled)(exclude_unactivatable))
 FC_REFLECT(eosio::producer_plugin::get_account_ram_corrections_params, (lower_bound)(upper_bound)(limit)(reverse))
 FC_REFLECT(eosio::producer_plugin::get_account_ram_corrections_result, (rows)(more))
+FC_REFLECT(eosio::producer_plugin::block_time_budget, (block_num)(producer)(total_us)(start_us)(unapplied_us)(scheduled_us)(incoming_us)
+           (exhausted_us)(finalize_us)(sign_us)(commit_us)(expire_us)(idle_us))
+FC_REFLECT(eosio::producer_plugin::get_block_time_budgets_params, (limit))
@@ -3,12 +3,18 @@
  *  @copyright defined in eos/LICENSE
  */
 #include <eosio/producer_plugin/producer_plugin.hpp>
+#include <eosio/producer_plugin/prestarted_block.hpp>
 #include <eosio/chain/plugin_interface.hpp>
+#include <eosio/chain/async_log.hpp>
 #include <eosio/chain/global_property_object.hpp>
 #include <eosio/chain/generated_transaction_object.hpp>
 #include <eosio/chain/transaction_object.hpp>
+#include <eosio/chain/executor_stats.hpp>
 #include <eosio/chain/thread_utils.hpp>
 #include <eosio/chain/snapshot.hpp>
+#include <eosio/chain/snapshot_delta.hpp>
+#include <eosio/chain/subjective_account_tracker.hpp>
+#include <eosio/telemetry_plugin/telemetry_plugin.hpp>
 
 #include <fc/io/json.hpp>
 #include <fc/log/logger_config.hpp>
@@ -29,6 +35,10 @@
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/signals2/connection.hpp>
 
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
 namespace bmi = boost::multi_index;
 using bmi::indexed_by;
 using bmi::ordered_non_unique;
@@ -105,8 +115,152 @@ using transaction_id_with_expiry_index = multi_index_container<
    >
 >;
 
+/**
+ * Ids of the transactions persisted until they expire, in buckets of the second they expire in. Expirations are whole
+ * seconds, so a bucket expires as a whole and expiring is a walk of the few first buckets.
+ */
+class persisted_transaction_index {
+public:
+   /// false if `id` is already persisted
+   bool insert( const transaction_id_type& id, const fc::time_point_sec& expiry ) {
+      if( !_ids.insert( id ).second ) return false;
+      _buckets[expiry.sec_since_epoch()].push_back( id );
+      return true;
+   }
+
+   bool contains( const transaction_id_type& id ) const { return _ids.count( id ) != 0; }
+   bool empty() const { return _ids.empty(); }
+   size_t size() const { return _ids.size(); }
+
+   /// removes the transactions expired at `now`, the buckets in turn until `deadline`; false if stopped at it
+   template<typename F>
+   bool expire( const fc::time_point& now, const fc::time_point& deadline, F&& on_expired ) {
+      while( !_buckets.empty() && fc::time_point( fc::time_point_sec( _buckets.begin()->first ) ) <= now ) {
+         if( deadline <= fc::time_point::now() )
+            return false;
+         for( const auto& id : _buckets.begin()->second ) {
+            _ids.erase( id );
+            on_expired( id );
+         }
+         _buckets.erase( _buckets.begin() );
+      }
+      return true;
+   }
+
+private:
+   struct id_hash {
+      size_t operator()( const transaction_id_type& id )const { return id._hash[0]; }
+   };
+
+   std::unordered_set<transaction_id_type, id_hash>      _ids;
+   std::map<uint32_t, std::vector<transaction_id_type>>  _buckets; ///< by expiration in seconds
+};
+
 struct by_height;
 
+/**
+ * Incoming transactions waiting for a pending block.
+ *
+ * Each transaction is queued in the tier of the contract of its first action (incoming-trx-priority, other contracts
+ * have priority 0) and higher tiers are always served first. With fair queueing, transactions of a tier are further
+ * queued by the first authorizer of their first action and the accounts are served round robin, so a burst from one
+ * account delays only that account. Without priorities and fair queueing this is a FIFO.
+ * push and pop are logarithmic in the number of queued accounts of a tier.
+ */
+class incoming_transaction_queue {
+public:
+   struct entry {
+      transaction_metadata_ptr               trx;
+      bool                                   persist_until_expired = false;
+      next_function<transaction_trace_ptr>   next;
+      fc::time_point                         received;
+      uint32_t                               tier = 0;
+   };
+
+   /// @param priorities  contract -> priority, higher is served first
+   void configure( const std::map<account_name, int32_t>& priorities, bool fair ) {
+      EOS_ASSERT( empty(), producer_exception, "incoming transaction queue reconfigured while not empty" );
+      std::set<int32_t> levels{ 0 };
+      for( const auto& p : priorities )
+         levels.insert( p.second );
+      _priorities.clear();
+      for( auto l = levels.rbegin(); l != levels.rend(); ++l )
+         _priorities.push_back( *l );
+      _contract_tiers.clear();
+      for( const auto& p : priorities )
+         _contract_tiers[p.first] = tier_of( p.second );
+      _default_tier = tier_of( 0 );
+      _tiers.clear();
+      _tiers.resize( _priorities.size() );
+      _fair = fair;
+   }
+
+   /// priority of each tier, tier 0 is the highest
+   const std::vector<int32_t>& priorities()const { return _priorities; }
+
+   bool empty()const { return _size == 0; }
+   size_t size()const { return _size; }
+
+   void push( const transaction_metadata_ptr& trx, bool persist_until_expired, next_function<transaction_trace_ptr> next,
+              const fc::time_point& received ) {
+      const auto& actions = trx->packed_trx->get_transaction().actions;
+      account_name contract, account;
+      if( !actions.empty() ) {
+         contract = actions.front().account;
+         account = actions.front().authorization.empty() ? contract : actions.front().authorization.front().actor;
+      }
+      auto itr = _contract_tiers.find( contract );
+      const uint32_t tier = itr != _contract_tiers.end() ? itr->second : _default_tier;
+      if( !_fair )
+         account = account_name();
+
+      auto& q = _tiers[tier];
+      auto& account_queue = q.accounts[account];
+      if( account_queue.empty() )
+         q.ready.push_back( account );
+      account_queue.push_back( entry{ trx, persist_until_expired, std::move( next ), received, tier } );
+      ++_size;
+   }
+
+   /// must not be empty
+   entry pop() {
+      for( auto& q : _tiers ) {
+         if( q.ready.empty() )
+            continue;
+         const auto account = q.ready.front();
+         q.ready.pop_front();
+         auto itr = q.accounts.find( account );
+         entry e = std::move( itr->second.front() );
+         itr->second.pop_front();
+         if( itr->second.empty() ) {
+            q.accounts.erase( itr );
+         } else {
+            q.ready.push_back( account );
+         }
+         --_size;
+         return e;
+      }
+      EOS_THROW( producer_exception, "pop from an empty incoming transaction queue" );
+   }
+
+private:
+   uint32_t tier_of( int32_t priority )const {
+      return std::find( _priorities.begin(), _priorities.end(), priority ) - _priorities.begin();
+   }
+
+   struct tier_queue {
+      std::map<account_name, std::deque<entry>>  accounts;
+      std::deque<account_name>                   ready; ///< accounts with queued transactions, in the order they are served
+   };
+
+   std::vector<int32_t>             _priorities{ 0 };
+   std::map<account_name, uint32_t> _contract_tiers;
+   uint32_t                         _default_tier = 0;
+   std::vector<tier_queue>          _tiers{ 1 };
+   bool                             _fair = false;
+   size_t                           _size = 0;
+};
+
 class pending_snapshot {
 public:
    using next_t = producer_plugin::next_function<producer_plugin::snapshot_information>;
@@ -204,7 +358,7 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
       void produce_block();
       bool maybe_produce_block();
       bool block_is_exhausted() const;
-      bool remove_expired_persisted_trxs( const fc::time_point& deadline );
+      bool remove_expired_persisted_trxs( const fc::time_point& expiry_time, const fc::time_point& deadline );
       bool remove_expired_blacklisted_trxs( const fc::time_point& deadline );
       bool process_unapplied_trxs( const fc::time_point& deadline );
       void process_scheduled_and_incoming_trxs( const fc::time_point& deadline, size_t& orig_pending_txn_size );
@@ -213,8 +367,12 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
       boost::program_options::variables_map _options;
       bool     _production_enabled                 = false;
       bool     _pause_production                   = false;
+      bool     _prestart_blocks                    = true;
       uint32_t _production_skip_flags              = 0; //eosio::chain::skip_nothing;
 
+      /// block started while waiting for the production window of a producer of this node, see start_block
+      fc::optional<prestarted_block> _prestarted_block;
+
       using signature_provider_type = std::function<chain::signature_type(chain::digest_type)>;
       std::map<chain::public_key_type, signature_provider_type> _signature_providers;
       std::set<chain::account_name>                             _producers;
@@ -223,8 +381,11 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
       using producer_watermark = std::pair<uint32_t, block_timestamp_type>;
       std::map<chain::account_name, producer_watermark>         _producer_watermarks;
       pending_block_mode                                        _pending_block_mode = pending_block_mode::speculating;
-      transaction_id_with_expiry_index                          _persistent_transactions;
-      fc::optional<named_thread_pool>                           _thread_pool;
+      persisted_transaction_index                               _persistent_transactions;
+      bool                                                      _persisted_expiry_posted = false;
+      telemetry::counter_handle                                 _persisted_trx_expired_counter;
+      telemetry::counter_handle                                 _persisted_trx_expiry_time_counter;
+      fc::optional<task_executor>                               _thread_pool;      ///< recovers keys of incoming trxs on the chain scheduler
 
       int32_t                                                   _max_transaction_time_ms = 0;
       fc::microseconds                                          _max_irreversible_block_age_us;
@@ -239,6 +400,32 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
       std::vector<chain::digest_type>                           _protocol_features_to_activate;
       bool                                                      _protocol_features_signaled = false; // to mark whether it has been signaled in start_block
 
+      static constexpr size_t                                   max_block_time_budgets = 120;
+      /// of the block being produced, valid while _pending_block_mode is producing
+      producer_plugin::block_time_budget                        _block_budget;
+      fc::time_point                                            _block_budget_start;
+      std::deque<producer_plugin::block_time_budget>            _block_time_budgets; ///< of produced blocks, most recent first
+      std::vector<telemetry::histogram_handle>                  _block_budget_histograms;
+
+      static const std::vector<std::pair<const char*, int64_t producer_plugin::block_time_budget::*>>& block_budget_fields() {
+         using b = producer_plugin::block_time_budget;
+         static const std::vector<std::pair<const char*, int64_t b::*>> fields{
+            { "start", &b::start_us }, { "unapplied", &b::unapplied_us }, { "scheduled", &b::scheduled_us },
+            { "incoming", &b::incoming_us }, { "exhausted", &b::exhausted_us }, { "finalize", &b::finalize_us },
+            { "sign", &b::sign_us }, { "commit", &b::commit_us }, { "expire", &b::expire_us }, { "idle", &b::idle_us }
+         };
+         return fields;
+      }
+
+      /// adds the time since `start` to `field` of the budget of the block being produced, returns now
+      fc::time_point budget_add( int64_t producer_plugin::block_time_budget::* field, const fc::time_point& start ) {
+         const auto now = fc::time_point::now();
+         if( _pending_block_mode == pending_block_mode::producing )
+            _block_budget.*field += ( now - start ).count();
+         return now;
+      }
+      void finish_block_budget();
+
       producer_plugin* _self = nullptr;
       chain_plugin* chain_plug = nullptr;
 
@@ -249,8 +436,10 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
 
       incoming::methods::block_sync::method_type::handle        _incoming_block_sync_provider;
       incoming::methods::transaction_async::method_type::handle _incoming_transaction_async_provider;
+      incoming::methods::transactions_async::method_type::handle _incoming_transactions_async_provider;
 
       transaction_id_with_expiry_index                         _blacklisted_transactions;
+      subjective_account_tracker                               _subjective_accounts;
       pending_snapshot_index                                   _pending_snapshot_index;
 
       fc::optional<scoped_connection>                          _accepted_block_connection;
@@ -272,8 +461,167 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
       // keep a expected ratio between defer txn and incoming txn
       double _incoming_defer_ratio = 1.0; // 1:1
 
+      /// unapplied transactions are written here on shutdown and applied again after restart, empty to drop them
+      bfs::path _unapplied_trxs_file;
+      void load_unapplied_trxs();
+      void save_unapplied_trxs();
+
       // path to write the snapshots to
       bfs::path _snapshots_dir;
+      uint32_t  _snapshot_threads = 0;
+      bool      _snapshot_compression = false;
+      bool      _background_snapshots = false;
+      bool      _delta_snapshots = false;
+      uint32_t  _integrity_hash_threads = 0;
+      /// digest of the last snapshot written, the base of the next delta snapshot
+      fc::optional<snapshot_digest>  _snapshot_digest;
+
+      using snapshot_next_t = producer_plugin::next_function<producer_plugin::snapshot_information>;
+
+      /// snapshots being written to files by threads, by block id
+      struct background_snapshot {
+         snapshot_next_t   next;
+      };
+      std::map<block_id_type, background_snapshot>  _background_snapshot_writes;
+      std::vector<std::thread>                       _background_snapshot_writers;
+
+      /// serializes the snapshot of `chain` into `out`, a delta against the previous snapshot with delta-snapshots
+      fc::optional<snapshot_digest> serialize_snapshot( const chain::controller& chain, std::ostream& out ) const {
+         fc::optional<snapshot_digest> digest;
+         if( _delta_snapshots && _snapshot_digest ) {
+            auto writer = std::make_shared<delta_snapshot_writer>(out, *_snapshot_digest);
+            chain.write_snapshot(writer);
+            writer->finalize();
+            digest = writer->digest();
+         } else if( _snapshot_threads > 0 ) {
+            auto writer = std::make_shared<chunked_snapshot_writer>(out, _snapshot_threads, _snapshot_compression);
+            chain.write_snapshot(writer);
+            writer->finalize();
+         } else {
+            auto writer = std::make_shared<ostream_snapshot_writer>(out);
+            chain.write_snapshot(writer);
+            writer->finalize();
+         }
+         return digest;
+      }
+
+      void write_snapshot_file( const chain::controller& chain, const bfs::path& p ) {
+         bfs::create_directory( p.parent_path() );
+
+         auto snap_out = std::ofstream(p.generic_string(), (std::ios::out | std::ios::binary));
+         auto digest = serialize_snapshot( chain, snap_out );
+         snap_out.flush();
+         EOS_ASSERT( snap_out.good(), snapshot_exception, "cannot write snapshot ${p}", ("p", p.generic_string()) );
+         snap_out.close();
+
+         if( _delta_snapshots ) {
+            if( !digest ) {
+               auto writer = std::make_shared<digest_snapshot_writer>();
+               chain.write_snapshot(writer);
+               digest = writer->digest();
+            }
+            _snapshot_digest = std::move(digest);
+         }
+      }
+
+      /**
+       * Serializes the snapshot at head into memory at the block boundary, then writes it to `temp_path` from a
+       * thread: the node keeps applying blocks while the file is written. The thread only uses the serialized bytes,
+       * never the database.
+       */
+      void create_background_snapshot( const block_id_type& head_id, const bfs::path& temp_path,
+                                       const bfs::path& snapshot_path, snapshot_next_t next ) {
+         auto existing = _background_snapshot_writes.find( head_id );
+         if( existing != _background_snapshot_writes.end() ) {
+            existing->second.next = [prev = existing->second.next, next](const fc::static_variant<fc::exception_ptr, producer_plugin::snapshot_information>& res){
+               prev(res);
+               next(res);
+            };
+            return;
+         }
+
+         chain::controller& chain = chain_plug->chain();
+         auto reschedule = fc::make_scoped_exit([this](){
+            schedule_production_loop();
+         });
+         if( chain.is_building_block() ) {
+            // abort the pending block
+            chain.abort_block();
+         } else {
+            reschedule.cancel();
+         }
+
+         auto data = std::make_shared<std::stringstream>( std::ios::in | std::ios::out | std::ios::binary );
+         bool serialized = false;
+         try {
+            serialize_snapshot( chain, *data );
+            serialized = true;
+         } CATCH_AND_CALL (next);
+         if( !serialized ) return;
+
+         async_ilog( _log, "writing snapshot of block ${n} in the background", ("n", block_header::num_from_id(head_id)) );
+         _background_snapshot_writes[head_id] = background_snapshot{ std::move(next) };
+         _background_snapshot_writers.emplace_back( [weak_this = weak_from_this(), data, head_id, temp_path, snapshot_path]() {
+            bool ok = false;
+            try {
+               bfs::create_directory( temp_path.parent_path() );
+               std::ofstream snap_out( temp_path.generic_string(), (std::ios::out | std::ios::binary) );
+               snap_out << data->rdbuf();
+               snap_out.flush();
+               ok = snap_out.good();
+               snap_out.close();
+            } catch( ... ) {}
+            data->str( std::string() );
+            chain::instrumented_post( app(), priority::medium, chain::executor_category::producer, [weak_this, head_id, temp_path, snapshot_path, ok]() {
+               if( auto self = weak_this.lock() ) {
+                  self->finish_background_snapshot( head_id, temp_path, snapshot_path, ok );
+               }
+            });
+         });
+      }
+
+      void finish_background_snapshot( const block_id_type& head_id, const bfs::path& temp_path,
+                                       const bfs::path& snapshot_path, bool ok ) {
+         auto itr = _background_snapshot_writes.find( head_id );
+         if( itr == _background_snapshot_writes.end() ) return;
+         auto next = std::move( itr->second.next );
+         _background_snapshot_writes.erase( itr );
+
+         const chain::controller& chain = chain_plug->chain();
+         try {
+            EOS_ASSERT( ok, snapshot_exception, "cannot write snapshot of block ${n}", ("n", block_header::num_from_id(head_id)) );
+
+            boost::system::error_code ec;
+            if( chain.get_read_mode() == db_read_mode::IRREVERSIBLE ) {
+               bfs::rename(temp_path, snapshot_path, ec);
+               EOS_ASSERT(!ec, snapshot_finalization_exception,
+                     "Unable to finalize valid snapshot of block number ${bn}: [code: ${ec}] ${message}",
+                     ("bn", block_header::num_from_id(head_id))
+                     ("ec", ec.value())
+                     ("message", ec.message()));
+               next( producer_plugin::snapshot_information{head_id, snapshot_path.generic_string()} );
+               return;
+            }
+
+            // promoted by on_irreversible_block, possibly at the next irreversible block if lib already passed it
+            const auto& pending_path = pending_snapshot::get_pending_path(head_id, _snapshots_dir);
+            bfs::rename(temp_path, pending_path, ec);
+            EOS_ASSERT(!ec, snapshot_finalization_exception,
+                  "Unable to promote temp snapshot to pending for block number ${bn}: [code: ${ec}] ${message}",
+                  ("bn", block_header::num_from_id(head_id))
+                  ("ec", ec.value())
+                  ("message", ec.message()));
+
+            _pending_snapshot_index.emplace(head_id, next, pending_path.generic_string(), snapshot_path.generic_string());
+         } CATCH_AND_CALL (next);
+      }
+
+      void stop_background_snapshots() {
+         for( auto& t : _background_snapshot_writers ) {
+            t.join();
+         }
+         _background_snapshot_writers.clear();
+      }
 
       void consider_new_watermark( account_name producer, uint32_t block_num, block_timestamp_type timestamp) {
          auto itr = _producer_watermarks.find( producer );
@@ -294,6 +642,21 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
       }
 
       void on_block( const block_state_ptr& bsp ) {
+         post_persisted_trxs_expiry();
+      }
+
+      /// expires the persisted transactions between blocks, so that start_block is left with the ones expiring in
+      /// the block it starts; runs again while some remain
+      void post_persisted_trxs_expiry() {
+         if( _persisted_expiry_posted || _persistent_transactions.empty() ) return;
+         _persisted_expiry_posted = true;
+         chain::instrumented_post( app(), priority::low, chain::executor_category::producer, [self = this]() {
+            self->_persisted_expiry_posted = false;
+            const auto& chain = self->chain_plug->chain();
+            const auto next_block_time = chain.head_block_time() + fc::microseconds( config::block_interval_us );
+            if( !self->remove_expired_persisted_trxs( next_block_time, fc::time_point::now() + fc::milliseconds( 5 ) ) )
+               self->post_persisted_trxs_expiry();
+         } );
       }
 
       void on_block_header( const block_state_ptr& bsp ) {
@@ -370,7 +733,7 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
          const auto& id = block_id ? *block_id : block->id();
          auto blk_num = block->block_num();
 
-         fc_dlog(_log, "received incoming block ${id}", ("id", id));
+         async_dlog(_log, "received incoming block ${id}", ("id", id));
 
          EOS_ASSERT( block->timestamp < (fc::time_point::now() + fc::seconds( 7 )), block_from_the_future,
                      "received a block from the future, ignoring it: ${id}", ("id", id) );
@@ -412,12 +775,12 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
          }
 
          if( fc::time_point::now() - block->timestamp < fc::minutes(5) || (block->block_num() % 1000 == 0) ) {
-            ilog("Received block ${id}... #${n} @ ${t} signed by ${p} [trxs: ${count}, lib: ${lib}, conf: ${confs}, latency: ${latency} ms]",
+            async_ilog( fc::logger::get( DEFAULT_LOGGER ), "Received block ${id}... #${n} @ ${t} signed by ${p} [trxs: ${count}, lib: ${lib}, conf: ${confs}, latency: ${latency} ms]",
                  ("p",block->producer)("id",id.str().substr(8,16))("n",block->block_num())("t",block->timestamp)
                  ("count",block->transactions.size())("lib",chain.last_irreversible_block_num())
                  ("confs", block->confirmed)("latency", (fc::time_point::now() - block->timestamp).count()/1000 ) );
             if( chain.get_read_mode() != db_read_mode::IRREVERSIBLE && hbs->id != id && hbs->block != nullptr ) { // not applied to head
-               ilog("Block not applied to head ${id}... #${n} @ ${t} signed by ${p} [trxs: ${count}, dpos: ${dpos}, conf: ${confs}, latency: ${latency} ms]",
+               async_ilog( fc::logger::get( DEFAULT_LOGGER ), "Block not applied to head ${id}... #${n} @ ${t} signed by ${p} [trxs: ${count}, dpos: ${dpos}, conf: ${confs}, latency: ${latency} ms]",
                     ("p",hbs->block->producer)("id",hbs->id.str().substr(8,16))("n",hbs->block_num)("t",hbs->block->timestamp)
                     ("count",hbs->block->transactions.size())("dpos", hbs->dpos_irreversible_blocknum)
                     ("confs", hbs->block->confirmed)("latency", (fc::time_point::now() - hbs->block->timestamp).count()/1000 ) );
@@ -427,31 +790,105 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
          return true;
       }
 
-      std::deque<std::tuple<transaction_metadata_ptr, bool, next_function<transaction_trace_ptr>>> _pending_incoming_transactions;
+      incoming_transaction_queue                                _pending_incoming_transactions;
+      fc::microseconds                                          _incoming_trx_max_age = fc::microseconds::maximum();
+      std::vector<telemetry::histogram_handle>                  _incoming_trx_wait_histograms; ///< per tier of _pending_incoming_transactions
+      telemetry::counter_handle                                 _incoming_trx_aged_out_counter;
+
+      /// processes the next queued incoming transaction, false if the block is exhausted
+      bool process_next_incoming_transaction() {
+         auto e = _pending_incoming_transactions.pop();
+         const auto now = fc::time_point::now();
+         if( e.tier < _incoming_trx_wait_histograms.size() )
+            _incoming_trx_wait_histograms[e.tier].observe( ( now - e.received ).count() );
+         if( _incoming_trx_max_age != fc::microseconds::maximum() && e.received + _incoming_trx_max_age < now ) {
+            _incoming_trx_aged_out_counter.increment();
+            auto except = std::static_pointer_cast<fc::exception>( std::make_shared<expired_tx_exception>(
+                  FC_LOG_MESSAGE( error, "transaction ${id} waited longer than incoming-trx-max-age-ms", ("id", e.trx->id) ) ) );
+            e.next( except );
+            _transaction_ack_channel.publish( priority::low, std::pair<fc::exception_ptr, transaction_metadata_ptr>( except, e.trx ) );
+            return true;
+         }
+         return process_incoming_transaction_async( e.trx, e.persist_until_expired, e.next, e.received );
+      }
+
+      struct incoming_trx {
+         transaction_metadata_ptr                 trx;
+         bool                                     persist_until_expired = false;
+         next_function<transaction_trace_ptr>     next;
+      };
 
+      static constexpr size_t                     max_incoming_trx_batch = 1000;
+      /// single transactions received since the last flush, so that the keys of many of them are recovered at once
+      std::vector<incoming_trx>                   _incoming_trx_batch;
+
+      // called on the main thread, as the other incoming methods
       void on_incoming_transaction_async(const transaction_metadata_ptr& trx, bool persist_until_expired, next_function<transaction_trace_ptr> next) {
+         // the batch is flushed by a task queued behind the work the main thread has, so waiting adds no latency
+         if( _incoming_trx_batch.empty() ) {
+            chain::instrumented_post(app(), priority::low, chain::executor_category::producer, [self = this]() {
+               self->flush_incoming_trx_batch();
+            });
+         }
+         _incoming_trx_batch.push_back( { trx, persist_until_expired, std::move( next ) } );
+         if( _incoming_trx_batch.size() >= max_incoming_trx_batch )
+            flush_incoming_trx_batch();
+      }
+
+      void flush_incoming_trx_batch() {
+         std::vector<incoming_trx> trxs;
+         trxs.swap( _incoming_trx_batch );
+         recover_and_process_incoming_trxs( std::move( trxs ) );
+      }
+
+      void on_incoming_transactions_async(const std::vector<std::pair<transaction_metadata_ptr, next_function<transaction_trace_ptr>>>& trxs) {
+         std::vector<incoming_trx> batch;
+         batch.reserve( trxs.size() );
+         for( const auto& t : trxs )
+            batch.push_back( { t.first, false, t.second } );
+         recover_and_process_incoming_trxs( std::move( batch ) );
+      }
+
+      void recover_and_process_incoming_trxs( std::vector<incoming_trx>&& batch ) {
+         if( batch.empty() )
+            return;
          chain::controller& chain = chain_plug->chain();
          const auto& cfg = chain.get_global_properties().configuration;
-         signing_keys_future_type future = transaction_metadata::start_recover_keys( trx, _thread_pool->get_executor(),
-               chain.get_chain_id(), fc::microseconds( cfg.max_transaction_cpu_usage ) );
-         boost::asio::post( _thread_pool->get_executor(), [self = this, future, trx, persist_until_expired, next]() {
-            if( future.valid() )
-               future.wait();
-            app().post(priority::low, [self, trx, persist_until_expired, next]() {
-               if( !self->process_incoming_transaction_async( trx, persist_until_expired, next ) ) {
-                  if( self->_pending_block_mode == pending_block_mode::producing ) {
-                     self->schedule_maybe_produce_block( true );
+         const auto received = fc::time_point::now();
+         std::vector<transaction_metadata_ptr> mtrxs;
+         mtrxs.reserve( batch.size() );
+         for( const auto& t : batch )
+            mtrxs.push_back( t.trx );
+         auto trxs = std::make_shared<const std::vector<incoming_trx>>( std::move( batch ) );
+         // spread the batch over the workers, a single main thread task processes it once all keys are recovered
+         // rather than a task waiting for them, which would hold a shared worker
+         const size_t workers = _thread_pool->scheduler().workers();
+         const size_t batch_size = ( mtrxs.size() + workers - 1 ) / workers;
+         transaction_metadata::start_recover_keys( mtrxs, *_thread_pool, chain.get_chain_id(),
+               fc::microseconds( cfg.max_transaction_cpu_usage ), batch_size, [self = this, trxs, received]() {
+            chain::instrumented_post(app(), priority::low, chain::executor_category::producer, [self, trxs, received]() {
+               bool exhausted = false;
+               for( const auto& t : *trxs ) {
+                  if( exhausted ) {
+                     self->_pending_incoming_transactions.push( t.trx, t.persist_until_expired, t.next, received );
+                  } else if( !self->process_incoming_transaction_async( t.trx, t.persist_until_expired, t.next, received ) ) {
+                     exhausted = true;
                   }
                }
+               if( exhausted && self->_pending_block_mode == pending_block_mode::producing ) {
+                  self->schedule_maybe_produce_block( true );
+               }
             });
          });
       }
 
-      bool process_incoming_transaction_async(const transaction_metadata_ptr& trx, bool persist_until_expired, next_function<transaction_trace_ptr> next) {
+      bool process_incoming_transaction_async(const transaction_metadata_ptr& trx, bool persist_until_expired, next_function<transaction_trace_ptr> next,
+                                              const fc::time_point& received) {
          bool exhausted = false;
          chain::controller& chain = chain_plug->chain();
-         if (!chain.is_building_block()) {
-            _pending_incoming_transactions.emplace_back(trx, persist_until_expired, next);
+         // a pre-started block takes transactions once its window opens, with the budget and deadlines of production
+         if (!chain.is_building_block() || _prestarted_block) {
+            _pending_incoming_transactions.push(trx, persist_until_expired, next, received);
             return true;
          }
 
@@ -462,25 +899,25 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
             if (response.contains<fc::exception_ptr>()) {
                _transaction_ack_channel.publish(priority::low, std::pair<fc::exception_ptr, transaction_metadata_ptr>(response.get<fc::exception_ptr>(), trx));
                if (_pending_block_mode == pending_block_mode::producing) {
-                  fc_dlog(_trx_trace_log, "[TRX_TRACE] Block ${block_num} for producer ${prod} is REJECTING tx: ${txid} : ${why} ",
+                  async_dlog(_trx_trace_log, "[TRX_TRACE] Block ${block_num} for producer ${prod} is REJECTING tx: ${txid} : ${why} ",
                         ("block_num", chain.head_block_num() + 1)
                         ("prod", chain.pending_block_producer())
                         ("txid", trx->id)
                         ("why",response.get<fc::exception_ptr>()->what()));
                } else {
-                  fc_dlog(_trx_trace_log, "[TRX_TRACE] Speculative execution is REJECTING tx: ${txid} : ${why} ",
+                  async_dlog(_trx_trace_log, "[TRX_TRACE] Speculative execution is REJECTING tx: ${txid} : ${why} ",
                           ("txid", trx->id)
                           ("why",response.get<fc::exception_ptr>()->what()));
                }
             } else {
                _transaction_ack_channel.publish(priority::low, std::pair<fc::exception_ptr, transaction_metadata_ptr>(nullptr, trx));
                if (_pending_block_mode == pending_block_mode::producing) {
-                  fc_dlog(_trx_trace_log, "[TRX_TRACE] Block ${block_num} for producer ${prod} is ACCEPTING tx: ${txid}",
+                  async_dlog(_trx_trace_log, "[TRX_TRACE] Block ${block_num} for producer ${prod} is ACCEPTING tx: ${txid}",
                           ("block_num", chain.head_block_num() + 1)
                           ("prod", chain.pending_block_producer())
                           ("txid", trx->id));
                } else {
-                  fc_dlog(_trx_trace_log, "[TRX_TRACE] Speculative execution is ACCEPTING tx: ${txid}",
+                  async_dlog(_trx_trace_log, "[TRX_TRACE] Speculative execution is ACCEPTING tx: ${txid}",
                           ("txid", trx->id));
                }
             }
@@ -497,6 +934,14 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
             return true;
          }
 
+         const auto first_auth = trx->packed_trx->get_transaction().first_authorizer();
+         if( !_subjective_accounts.may_execute( first_auth, fc::time_point::now() ) ) {
+            send_response(std::static_pointer_cast<fc::exception>(std::make_shared<tx_subjective_failures_exceeded>(
+                  FC_LOG_MESSAGE(error, "transaction ${id} rejected, ${a} recently failed transactions using ${us} us of CPU",
+                                 ("id", id)("a", first_auth)("us", _subjective_accounts.failed_cpu_us( first_auth, fc::time_point::now() ))) )));
+            return true;
+         }
+
          auto deadline = fc::time_point::now() + fc::milliseconds(_max_transaction_time_ms);
          bool deadline_is_subjective = false;
          const auto block_deadline = calculate_block_deadline(block_time);
@@ -506,22 +951,27 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
          }
 
          try {
+            chain.pipeline_stage_timed( { controller::pipeline_stage::trx_queue_wait, fc::time_point::now() - received } );
+            const auto push_start = fc::time_point::now();
             auto trace = chain.push_transaction( trx, deadline, trx->billed_cpu_time_us, false );
+            budget_add( &producer_plugin::block_time_budget::incoming_us, push_start );
             if (trace->except) {
                if (exception_is_exhausted(*trace->except, deadline_is_subjective)) {
-                  _pending_incoming_transactions.emplace_back(trx, persist_until_expired, next);
+                  budget_add( &producer_plugin::block_time_budget::exhausted_us, push_start );
+                  _pending_incoming_transactions.push(trx, persist_until_expired, next, received);
                   if (_pending_block_mode == pending_block_mode::producing) {
-                     fc_dlog(_trx_trace_log, "[TRX_TRACE] Block ${block_num} for producer ${prod} COULD NOT FIT, tx: ${txid} RETRYING ",
+                     async_dlog(_trx_trace_log, "[TRX_TRACE] Block ${block_num} for producer ${prod} COULD NOT FIT, tx: ${txid} RETRYING ",
                              ("block_num", chain.head_block_num() + 1)
                              ("prod", chain.pending_block_producer())
                              ("txid", trx->id));
                   } else {
-                     fc_dlog(_trx_trace_log, "[TRX_TRACE] Speculative execution COULD NOT FIT tx: ${txid} RETRYING",
+                     async_dlog(_trx_trace_log, "[TRX_TRACE] Speculative execution COULD NOT FIT tx: ${txid} RETRYING",
                              ("txid", trx->id));
                   }
                   if( !exhausted )
                      exhausted = block_is_exhausted();
                } else {
+                  _subjective_accounts.on_failed( first_auth, trace->elapsed.count(), fc::time_point::now() );
                   auto e_ptr = trace->except->dynamic_copy_exception();
                   send_response(e_ptr);
                }
@@ -529,7 +979,7 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
                if (persist_until_expired) {
                   // if this trx didnt fail/soft-fail and the persist flag is set, store its ID so that we can
                   // ensure its applied to all future speculative blocks as well.
-                  _persistent_transactions.insert(transaction_id_with_expiry{trx->id, trx->packed_trx->expiration()});
+                  _persistent_transactions.insert(trx->id, trx->packed_trx->expiration());
                }
                send_response(trace);
             }
@@ -655,12 +1105,39 @@ void producer_plugin::set_program_options(
           "Maximum wall-clock time, in milliseconds, spent retiring scheduled transactions in any block before returning to normal transaction processing.")
          ("subjective-cpu-leeway-us", boost::program_options::value<int32_t>()->default_value( config::default_subjective_cpu_leeway_us ),
           "Time in microseconds allowed for a transaction that starts with insufficient CPU quota to complete and cover its CPU usage.")
+         ("subjective-account-max-failed-cpu-us", boost::program_options::value<uint32_t>()->default_value( 0 ),
+          "Reject the incoming transactions of an account, without executing them, while the CPU of its recently failed transactions exceeds this many microseconds; "
+          "greylisted accounts are allowed greylist-limit/1000 of it (0 to not reject any)")
+         ("subjective-account-decay-time-ms", boost::program_options::value<uint32_t>()->default_value( 60 * 1000 ),
+          "Time in milliseconds over which the failed transaction CPU of an account decays to zero")
          ("incoming-defer-ratio", bpo::value<double>()->default_value(1.0),
           "ratio between incoming transactions and deferred transactions when both are queued for execution")
+         ("incoming-trx-priority", bpo::value<vector<string>>()->composing()->multitoken(),
+          "Priority of incoming transactions whose first action is of a contract, as contract:priority. "
+          "Queued transactions of a higher priority are processed first, other contracts have priority 0. (may specify multiple times)")
+         ("incoming-trx-fair-queueing", bpo::bool_switch()->default_value(false),
+          "Process queued incoming transactions of the same priority round robin by the first authorizer of their first action")
+         ("incoming-trx-max-age-ms", bpo::value<int32_t>()->default_value(-1),
+          "Reject incoming transactions that waited in the queue for longer than this, -1 for no limit")
+         ("prestart-blocks", bpo::value<bool>()->default_value(true),
+          "Start the next block of a producer of this node while waiting for its production window, so that the window "
+          "is not spent on the onblock and scheduled transaction processing of a new block")
          ("producer-threads", bpo::value<uint16_t>()->default_value(config::default_controller_thread_pool_size),
-          "Number of worker threads in producer thread pool")
+          "Number of worker threads the producer adds to the workers shared with the chain")
          ("snapshots-dir", bpo::value<bfs::path>()->default_value("snapshots"),
           "the location of the snapshots directory (absolute path or relative to application data dir)")
+         ("snapshot-threads", bpo::value<uint32_t>()->default_value(0),
+          "Number of threads encoding snapshot sections in parallel into a chunked snapshot, 0 to write the single stream snapshot format")
+         ("snapshot-compression", bpo::bool_switch()->default_value(false),
+          "Compress the chunks of chunked snapshots with zlib; requires snapshot-threads > 0")
+         ("integrity-hash-threads", bpo::value<uint32_t>()->default_value(0),
+          "Number of threads computing get_integrity_hash as a merkle tree of section part hashes (version 2), 0 for the serial version 1 hash")
+         ("delta-snapshots", bpo::bool_switch()->default_value(false),
+          "Write every snapshot but the first one after startup as a delta against the previous snapshot, see --snapshot-delta of chain_plugin")
+         ("persist-unapplied-trxs", bpo::bool_switch()->default_value(false),
+          "Write unapplied transactions to the data directory on shutdown and apply them again after restart")
+         ("background-snapshots", bpo::bool_switch()->default_value(false),
+          "Write the snapshot files from a thread while the node keeps processing blocks; the snapshot is serialized in memory first")
          ;
    config_file_options.add(producer_options);
 }
@@ -714,6 +1191,8 @@ make_keosd_signature_provider(const std::shared_ptr<producer_plugin_impl>& impl,
    else
       keosd_url = fc::url(url_str);
    std::weak_ptr<producer_plugin_impl> weak_impl = impl;
+   // the first signature of a block should not wait for the handshakes with keosd
+   app().get_plugin<http_client_plugin>().warm(keosd_url);
 
    return [weak_impl, keosd_url, pubkey]( const chain::digest_type& digest ) {
       auto impl = weak_impl.lock();
@@ -721,7 +1200,7 @@ make_keosd_signature_provider(const std::shared_ptr<producer_plugin_impl>& impl,
          fc::variant params;
          fc::to_variant(std::make_pair(digest, pubkey), params);
          auto deadline = impl->_keosd_provider_timeout_us.count() >= 0 ? fc::time_point::now() + impl->_keosd_provider_timeout_us : fc::time_point::maximum();
-         return app().get_plugin<http_client_plugin>().get_client().post_sync(keosd_url, params, deadline).as<chain::signature_type>();
+         return app().get_plugin<http_client_plugin>().post_sync(keosd_url, params, deadline).as<chain::signature_type>();
       } else {
          return signature_type();
       }
@@ -787,6 +1266,8 @@ void producer_plugin::plugin_initialize(const boost::program_options::variables_
    EOS_ASSERT( my->_produce_time_offset_us <= 0 && my->_produce_time_offset_us >= -config::block_interval_us, plugin_config_exception,
                "produce-time-offset-us ${o} must be 0 .. -${bi}", ("bi", config::block_interval_us)("o", my->_produce_time_offset_us) );
 
+   my->_prestart_blocks = options.at("prestart-blocks").as<bool>();
+
    my->_last_block_time_offset_us = options.at("last-block-time-offset-us").as<int32_t>();
    EOS_ASSERT( my->_last_block_time_offset_us <= 0 && my->_last_block_time_offset_us >= -config::block_interval_us, plugin_config_exception,
                "last-block-time-offset-us ${o} must be 0 .. -${bi}", ("bi", config::block_interval_us)("o", my->_last_block_time_offset_us) );
@@ -826,10 +1307,64 @@ void producer_plugin::plugin_initialize(const boost::program_options::variables_
 
    my->_incoming_defer_ratio = options.at("incoming-defer-ratio").as<double>();
 
+   if( options.at( "persist-unapplied-trxs" ).as<bool>() ) {
+      my->_unapplied_trxs_file = app().data_dir() / "unapplied-trxs.bin";
+   }
+
+   {
+      std::map<account_name, int32_t> priorities;
+      if( options.count( "incoming-trx-priority" ) ) {
+         for( const auto& p : options.at( "incoming-trx-priority" ).as<vector<string>>() ) {
+            const auto colon = p.find( ':' );
+            EOS_ASSERT( colon != string::npos, plugin_config_exception, "incoming-trx-priority ${p} is not contract:priority", ("p", p) );
+            priorities[account_name( p.substr( 0, colon ) )] = std::stoi( p.substr( colon + 1 ) );
+         }
+      }
+      my->_pending_incoming_transactions.configure( priorities, options.at( "incoming-trx-fair-queueing" ).as<bool>() );
+
+      const auto max_age_ms = options.at( "incoming-trx-max-age-ms" ).as<int32_t>();
+      if( max_age_ms >= 0 )
+         my->_incoming_trx_max_age = fc::milliseconds( max_age_ms );
+
+      auto telemetry = app().find_plugin<telemetry_plugin>();
+      if( telemetry ) {
+         const std::vector<double> wait_keypoints{ 1000, 10000, 100000, 1000000, 10000000 };
+         for( auto priority : my->_pending_incoming_transactions.priorities() ) {
+            my->_incoming_trx_wait_histograms.push_back( telemetry->register_histogram(
+                  "producer_incoming_trx_wait_priority_" + ( priority < 0 ? "m" + std::to_string( -int64_t(priority) ) : std::to_string( priority ) ) + "_us",
+                  wait_keypoints ) );
+         }
+         my->_incoming_trx_aged_out_counter = telemetry->register_counter( "producer_incoming_trx_aged_out_cnt" );
+         my->_persisted_trx_expired_counter = telemetry->register_counter( "producer_persisted_trx_expired_cnt" );
+         my->_persisted_trx_expiry_time_counter = telemetry->register_counter( "producer_persisted_trx_expiry_us" );
+
+         const std::vector<double> budget_keypoints{ 1000, 10000, 50000, 100000, 250000, 500000 };
+         for( const auto& f : producer_plugin_impl::block_budget_fields() ) {
+            my->_block_budget_histograms.push_back( telemetry->register_histogram(
+                  std::string( "producer_block_" ) + f.first + "_us", budget_keypoints ) );
+         }
+      }
+   }
+
    auto thread_pool_size = options.at( "producer-threads" ).as<uint16_t>();
    EOS_ASSERT( thread_pool_size > 0, plugin_config_exception,
                "producer-threads ${num} must be greater than 0", ("num", thread_pool_size));
-   my->_thread_pool.emplace( "prod", thread_pool_size );
+   auto& scheduler = my->chain_plug->chain().get_task_scheduler();
+   scheduler.add_workers( "prod", thread_pool_size );
+   my->_thread_pool.emplace( scheduler, task_priority::net );
+
+   my->_snapshot_threads = options.at( "snapshot-threads" ).as<uint32_t>();
+   my->_snapshot_compression = options.at( "snapshot-compression" ).as<bool>();
+   EOS_ASSERT( !my->_snapshot_compression || my->_snapshot_threads > 0, plugin_config_exception,
+               "snapshot-compression requires the chunked snapshot format, set snapshot-threads > 0" );
+   my->_background_snapshots = options.at( "background-snapshots" ).as<bool>();
+   my->_integrity_hash_threads = options.at( "integrity-hash-threads" ).as<uint32_t>();
+   my->_delta_snapshots = options.at( "delta-snapshots" ).as<bool>();
+   if( my->_delta_snapshots && my->_background_snapshots ) {
+      // each delta is computed against the digest of the previous snapshot, known only once its file is written
+      wlog( "delta-snapshots are written synchronously, background-snapshots is ignored" );
+      my->_background_snapshots = false;
+   }
 
    if( options.count( "snapshots-dir" )) {
       auto sd = options.at( "snapshots-dir" ).as<bfs::path>();
@@ -867,6 +1402,11 @@ void producer_plugin::plugin_initialize(const boost::program_options::variables_
       return my->on_incoming_transaction_async(trx, persist_until_expired, next );
    });
 
+   my->_incoming_transactions_async_provider = app().get_method<incoming::methods::transactions_async>().register_provider(
+         [this](const std::vector<std::pair<transaction_metadata_ptr, next_function<transaction_trace_ptr>>>& trxs) -> void {
+      return my->on_incoming_transactions_async(trxs);
+   });
+
    if (options.count("greylist-account")) {
       std::vector<std::string> greylist = options["greylist-account"].as<std::vector<std::string>>();
       greylist_params param;
@@ -879,8 +1419,12 @@ void producer_plugin::plugin_initialize(const boost::program_options::variables_
    {
       uint32_t greylist_limit = options.at("greylist-limit").as<uint32_t>();
       chain.set_greylist_limit( greylist_limit );
+      my->_subjective_accounts.set_greylist_limit( chain.get_greylist_limit() );
    }
 
+   my->_subjective_accounts.set_max_failed_cpu_us( options.at("subjective-account-max-failed-cpu-us").as<uint32_t>() );
+   my->_subjective_accounts.set_decay_window( fc::milliseconds( options.at("subjective-account-decay-time-ms").as<uint32_t>() ) );
+
 } FC_LOG_AND_RETHROW() }
 
 void producer_plugin::plugin_startup()
@@ -900,9 +1444,9 @@ void producer_plugin::plugin_startup()
    EOS_ASSERT( my->_producers.empty() || my->chain_plug->accept_transactions(), plugin_config_exception,
               "node cannot have any producer-name configured because no block production is possible with no [api|p2p]-accepted-transactions" );
 
-   my->_accepted_block_connection.emplace(chain.accepted_block.connect( [this]( const auto& bsp ){ my->on_block( bsp ); } ));
+   my->_accepted_block_connection.emplace(chain.accepted_block.connect( chain::timed_slot( "producer_accepted_block", [this]( const auto& bsp ){ my->on_block( bsp ); } ) ));
    my->_accepted_block_header_connection.emplace(chain.accepted_block_header.connect( [this]( const auto& bsp ){ my->on_block_header( bsp ); } ));
-   my->_irreversible_block_connection.emplace(chain.irreversible_block.connect( [this]( const auto& bsp ){ my->on_irreversible_block( bsp->block ); } ));
+   my->_irreversible_block_connection.emplace(chain.irreversible_block.connect( chain::timed_slot( "producer_irreversible_block", [this]( const auto& bsp ){ my->on_irreversible_block( bsp->block ); } ) ));
 
    const auto lib_num = chain.last_irreversible_block_num();
    const auto lib = chain.fetch_block_by_number(lib_num);
@@ -923,6 +1467,8 @@ void producer_plugin::plugin_startup()
       }
    }
 
+   my->load_unapplied_trxs();
+
    my->schedule_production_loop();
 
    ilog("producer plugin:  plugin_startup() end");
@@ -940,20 +1486,69 @@ void producer_plugin::plugin_shutdown() {
       edump((e.to_detail_string()));
    }
 
+   try {
+      my->save_unapplied_trxs();
+   } LOG_AND_DROP()
+
    if( my->_thread_pool ) {
-      my->_thread_pool->stop();
+      my->_thread_pool->cancel();
    }
 
+   my->stop_background_snapshots();
+
    app().post( 0, [me = my](){} ); // keep my pointer alive until queue is drained
 }
 
+void producer_plugin_impl::load_unapplied_trxs() {
+   if( _unapplied_trxs_file.empty() || !fc::exists( _unapplied_trxs_file ) )
+      return;
+   chain::controller& chain = chain_plug->chain();
+   try {
+      if( chain.get_read_mode() == db_read_mode::SPECULATIVE ) {
+         auto trxs = unapplied_transaction_queue::read_from( _unapplied_trxs_file );
+         const fc::time_point head_time = chain.head_block_time();
+         trxs.erase( std::remove_if( trxs.begin(), trxs.end(), [&]( const transaction_metadata_ptr& trx ) {
+            return fc::time_point( trx->packed_trx->expiration() ) < head_time;
+         } ), trxs.end() );
+         // recovered in the background, process_unapplied_trxs waits for the keys of the trxs it reaches first
+         const size_t workers = _thread_pool->scheduler().workers();
+         const size_t batch_size = ( trxs.size() + workers - 1 ) / workers;
+         transaction_metadata::start_recover_keys( trxs, *_thread_pool, chain.get_chain_id(),
+                                                   fc::microseconds::maximum(), batch_size, [](){} );
+         auto& unapplied_trxs = chain.get_unapplied_transactions();
+         for( const auto& trx : trxs )
+            unapplied_trxs.add( trx );
+         ilog( "Loaded ${n} unapplied transactions from ${f}", ("n", trxs.size())("f", _unapplied_trxs_file.generic_string()) );
+      }
+   } catch( const fc::exception& e ) {
+      wlog( "Cannot load unapplied transactions from ${f}: ${e}", ("f", _unapplied_trxs_file.generic_string())("e", e.to_detail_string()) );
+   }
+   // never applied twice, a crash before the next shutdown must not bring back trxs from an older run
+   fc::remove( _unapplied_trxs_file );
+}
+
+void producer_plugin_impl::save_unapplied_trxs() {
+   if( _unapplied_trxs_file.empty() )
+      return;
+   chain::controller& chain = chain_plug->chain();
+   if( chain.get_read_mode() != db_read_mode::SPECULATIVE )
+      return;
+   // the trxs of the pending block are unapplied again
+   chain.abort_block();
+   auto& unapplied_trxs = chain.get_unapplied_transactions();
+   if( unapplied_trxs.empty() )
+      return;
+   unapplied_trxs.write_to( _unapplied_trxs_file );
+   ilog( "Saved ${n} unapplied transactions to ${f}", ("n", unapplied_trxs.size())("f", _unapplied_trxs_file.generic_string()) );
+}
+
 void producer_plugin::handle_sighup() {
    fc::logger::update( logger_name, _log );
    fc::logger::update( trx_trace_logger_name, _trx_trace_log );
 }
 
 void producer_plugin::pause() {
-   fc_ilog(_log, "Producer paused.");
+   async_ilog(_log, "Producer paused.");
    my->_pause_production = true;
 }
 
@@ -965,10 +1560,10 @@ void producer_plugin::resume() {
    if (my->_pending_block_mode == pending_block_mode::speculating) {
       chain::controller& chain = my->chain_plug->chain();
       chain.abort_block();
-      fc_ilog(_log, "Producer resumed. Scheduling production.");
+      async_ilog(_log, "Producer resumed. Scheduling production.");
       my->schedule_production_loop();
    } else {
-      fc_ilog(_log, "Producer resumed.");
+      async_ilog(_log, "Producer resumed.");
    }
 }
 
@@ -1016,6 +1611,7 @@ void producer_plugin::update_runtime_options(const runtime_options& options) {
 
    if (options.greylist_limit) {
       chain.set_greylist_limit(*options.greylist_limit);
+      my->_subjective_accounts.set_greylist_limit(chain.get_greylist_limit());
    }
 }
 
@@ -1038,6 +1634,7 @@ void producer_plugin::add_greylist_accounts(const greylist_params& params) {
    chain::controller& chain = my->chain_plug->chain();
    for (auto &acc : params.accounts) {
       chain.add_resource_greylist(acc);
+      my->_subjective_accounts.set_greylisted(acc, true);
    }
 }
 
@@ -1045,6 +1642,7 @@ void producer_plugin::remove_greylist_accounts(const greylist_params& params) {
    chain::controller& chain = my->chain_plug->chain();
    for (auto &acc : params.accounts) {
       chain.remove_resource_greylist(acc);
+      my->_subjective_accounts.set_greylisted(acc, false);
    }
 }
 
@@ -1095,6 +1693,9 @@ producer_plugin::integrity_hash_information producer_plugin::get_integrity_hash(
       reschedule.cancel();
    }
 
+   if( my->_integrity_hash_threads > 0 ) {
+      return {chain.head_block_id(), chain.calculate_tree_integrity_hash(my->_integrity_hash_threads), tree_integrity_hash_snapshot_writer::version};
+   }
    return {chain.head_block_id(), chain.calculate_integrity_hash()};
 }
 
@@ -1112,6 +1713,11 @@ void producer_plugin::create_snapshot(producer_plugin::next_function<producer_pl
       return;
    }
 
+   if( my->_background_snapshots ) {
+      my->create_background_snapshot( head_id, temp_path, snapshot_path, std::move(next) );
+      return;
+   }
+
    auto write_snapshot = [&]( const bfs::path& p ) -> void {
       auto reschedule = fc::make_scoped_exit([this](){
          my->schedule_production_loop();
@@ -1124,15 +1730,7 @@ void producer_plugin::create_snapshot(producer_plugin::next_function<producer_pl
          reschedule.cancel();
       }
 
-      bfs::create_directory( p.parent_path() );
-
-      // create the snapshot
-      auto snap_out = std::ofstream(p.generic_string(), (std::ios::out | std::ios::binary));
-      auto writer = std::make_shared<ostream_snapshot_writer>(snap_out);
-      chain.write_snapshot(writer);
-      writer->finalize();
-      snap_out.flush();
-      snap_out.close();
+      my->write_snapshot_file( chain, p );
    };
 
    // If in irreversible mode, create snapshot and return path to snapshot immediately.
@@ -1290,10 +1888,16 @@ producer_plugin::get_account_ram_corrections( const get_account_ram_corrections_
    return result;
 }
 
+std::vector<producer_plugin::block_time_budget>
+producer_plugin::get_block_time_budgets( const get_block_time_budgets_params& params ) const {
+   const auto n = std::min<size_t>( params.limit, my->_block_time_budgets.size() );
+   return { my->_block_time_budgets.begin(), my->_block_time_budgets.begin() + n };
+}
+
 optional<fc::time_point> producer_plugin_impl::calculate_next_block_time(const account_name& producer_name, const block_timestamp_type& current_block_time) const {
    chain::controller& chain = chain_plug->chain();
    const auto& hbs = chain.head_block_state();
-   const auto& active_schedule = hbs->active_schedule.producers;
+   const auto& active_schedule = hbs->active_schedule->producers;
 
    // determine if this producer is in the active schedule and if so, where
    auto itr = std::find_if(active_schedule.begin(), active_schedule.end(), [&](const auto& asp){ return asp.producer_name == producer_name; });
@@ -1374,6 +1978,10 @@ enum class tx_category {
 producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
    chain::controller& chain = chain_plug->chain();
 
+   // set again below only while waiting for the window of its slot, incoming transactions are queued meanwhile
+   const auto prestart = _prestarted_block;
+   _prestarted_block.reset();
+
    if( !chain_plug->accept_transactions() )
       return start_block_result::waiting_for_block;
 
@@ -1382,6 +1990,8 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
    const fc::time_point now = fc::time_point::now();
    const fc::time_point block_time = calculate_pending_block_time();
 
+   _subjective_accounts.prune( now );
+
    const pending_block_mode previous_pending_mode = _pending_block_mode;
    _pending_block_mode = pending_block_mode::producing;
 
@@ -1433,10 +2043,45 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
          return start_block_result::waiting_for_block;
    }
 
+   uint16_t blocks_to_confirm = 0;
+   if (_pending_block_mode == pending_block_mode::producing) {
+      // determine how many blocks this producer can confirm
+      // 1) if it is not a producer from this node, assume no confirmations (we will discard this block anyway)
+      // 2) if it is a producer on this node that has never produced, the conservative approach is to assume no
+      //    confirmations to make sure we don't double sign after a crash TODO: make these watermarks durable?
+      // 3) if it is a producer on this node where this node knows the last block it produced, safely set it -UNLESS-
+      // 4) the producer on this node's last watermark is higher (meaning on a different fork)
+      if (current_watermark) {
+         auto watermark_bn = current_watermark->first;
+         if (watermark_bn < hbs->block_num) {
+            blocks_to_confirm = (uint16_t)(std::min<uint32_t>(std::numeric_limits<uint16_t>::max(), (uint32_t)(hbs->block_num - watermark_bn)));
+         }
+      }
+
+      // can not confirm irreversible blocks
+      blocks_to_confirm = (uint16_t)(std::min<uint32_t>(blocks_to_confirm, (uint32_t)(hbs->block_num - hbs->dpos_irreversible_blocknum)));
+   }
+
+   // the block pre-started for this slot, if it is still the pending block
+   const bool prestarted = _pending_block_mode == pending_block_mode::producing && prestart
+                           && prestart->is_pending( chain, block_time, blocks_to_confirm )
+                           && _protocol_features_to_activate.empty();
+
    if (_pending_block_mode == pending_block_mode::producing) {
       const auto start_block_time = block_time - fc::microseconds( config::block_interval_us );
       if( now < start_block_time ) {
-         fc_dlog(_log, "Not producing block waiting for production window ${n} ${bt}", ("n", hbs->block_num + 1)("bt", block_time) );
+         async_dlog(_log, "Not producing block waiting for production window ${n} ${bt}", ("n", hbs->block_num + 1)("bt", block_time) );
+         // features to activate are signaled in the block started in the window, they may still change meanwhile
+         if( prestarted ) {
+            _prestarted_block = prestart;
+         } else if( _prestart_blocks && _protocol_features_to_activate.empty() ) {
+            try {
+               chain.abort_block();
+               chain.start_block( block_time, blocks_to_confirm, chain.get_preactivated_protocol_features() );
+               _prestarted_block = prestarted_block{ hbs->id, block_time, blocks_to_confirm };
+               async_dlog(_log, "Pre-started block #${n} ${bt}", ("n", hbs->block_num + 1)("bt", block_time) );
+            } LOG_AND_DROP();
+         }
          // start_block_time instead of block_time because schedule_delayed_production_loop calculates next block time from given time
          schedule_delayed_production_loop(weak_from_this(), calculate_producer_wake_up_time(start_block_time));
          return start_block_result::waiting_for_production;
@@ -1444,35 +2089,23 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
    } else if (previous_pending_mode == pending_block_mode::producing) {
       // just produced our last block of our round
       const auto start_block_time = block_time - fc::microseconds( config::block_interval_us );
-      fc_dlog(_log, "Not starting speculative block until ${bt}", ("bt", start_block_time) );
+      async_dlog(_log, "Not starting speculative block until ${bt}", ("bt", start_block_time) );
       schedule_delayed_production_loop( weak_from_this(), start_block_time);
       return start_block_result::waiting_for_production;
    }
 
-   fc_dlog(_log, "Starting block #${n} ${bt} at ${time}", ("n", hbs->block_num + 1)("bt", block_time)("time", now));
+   async_dlog(_log, "Starting block #${n} ${bt} at ${time}", ("n", hbs->block_num + 1)("bt", block_time)("time", now));
 
    try {
-      uint16_t blocks_to_confirm = 0;
-
       if (_pending_block_mode == pending_block_mode::producing) {
-         // determine how many blocks this producer can confirm
-         // 1) if it is not a producer from this node, assume no confirmations (we will discard this block anyway)
-         // 2) if it is a producer on this node that has never produced, the conservative approach is to assume no
-         //    confirmations to make sure we don't double sign after a crash TODO: make these watermarks durable?
-         // 3) if it is a producer on this node where this node knows the last block it produced, safely set it -UNLESS-
-         // 4) the producer on this node's last watermark is higher (meaning on a different fork)
-         if (current_watermark) {
-            auto watermark_bn = current_watermark->first;
-            if (watermark_bn < hbs->block_num) {
-               blocks_to_confirm = (uint16_t)(std::min<uint32_t>(std::numeric_limits<uint16_t>::max(), (uint32_t)(hbs->block_num - watermark_bn)));
-            }
-         }
-
-         // can not confirm irreversible blocks
-         blocks_to_confirm = (uint16_t)(std::min<uint32_t>(blocks_to_confirm, (uint32_t)(hbs->block_num - hbs->dpos_irreversible_blocknum)));
+         _block_budget = producer_plugin::block_time_budget();
+         _block_budget.block_num = hbs->block_num + 1;
+         _block_budget.producer = scheduled_producer.producer_name;
+         _block_budget_start = fc::time_point::now();
       }
 
-      chain.abort_block();
+      if( !prestarted )
+         chain.abort_block();
 
       auto features_to_activate = chain.get_preactivated_protocol_features();
       if( _pending_block_mode == pending_block_mode::producing && _protocol_features_to_activate.size() > 0 ) {
@@ -1509,7 +2142,13 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
          }
       }
 
-      chain.start_block( block_time, blocks_to_confirm, features_to_activate );
+      if( prestarted ) {
+         // onblock and the scheduled transaction checks of the block are done, the window goes to transactions
+         async_dlog(_log, "Producing pre-started block #${n} ${bt}", ("n", hbs->block_num + 1)("bt", block_time) );
+      } else {
+         chain.start_block( block_time, blocks_to_confirm, features_to_activate );
+      }
+      budget_add( &producer_plugin::block_time_budget::start_us, _block_budget_start );
    } LOG_AND_DROP();
 
    if( chain.is_building_block() ) {
@@ -1522,7 +2161,11 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
       }
 
       try {
-         if( !remove_expired_persisted_trxs( preprocess_deadline ) )
+         // usually done between blocks already, what is left here is lost to the block, see expire_us
+         const auto expire_start = fc::time_point::now();
+         const bool expired = remove_expired_persisted_trxs( chain.pending_block_time(), preprocess_deadline );
+         budget_add( &producer_plugin::block_time_budget::expire_us, expire_start );
+         if( !expired )
             return start_block_result::exhausted;
          if( !remove_expired_blacklisted_trxs( preprocess_deadline ) )
             return start_block_result::exhausted;
@@ -1568,47 +2211,41 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
    return start_block_result::failed;
 }
 
-bool producer_plugin_impl::remove_expired_persisted_trxs( const fc::time_point& deadline )
+bool producer_plugin_impl::remove_expired_persisted_trxs( const fc::time_point& expiry_time, const fc::time_point& deadline )
 {
-   bool exhausted = false;
-   auto& persisted_by_expiry = _persistent_transactions.get<by_expiry>();
-   if (!persisted_by_expiry.empty()) {
-      chain::controller& chain = chain_plug->chain();
-      int num_expired_persistent = 0;
-      int orig_count = _persistent_transactions.size();
-
-      const time_point pending_block_time = chain.pending_block_time();
-      while(!persisted_by_expiry.empty() && persisted_by_expiry.begin()->expiry <= pending_block_time) {
-         if (deadline <= fc::time_point::now()) {
-            exhausted = true;
-            break;
-         }
-         auto const& txid = persisted_by_expiry.begin()->trx_id;
-         if (_pending_block_mode == pending_block_mode::producing) {
-            fc_dlog(_trx_trace_log, "[TRX_TRACE] Block ${block_num} for producer ${prod} is EXPIRING PERSISTED tx: ${txid}",
-                    ("block_num", chain.head_block_num() + 1)
-                    ("prod", chain.pending_block_producer())
-                    ("txid", txid));
-         } else {
-            fc_dlog(_trx_trace_log, "[TRX_TRACE] Speculative execution is EXPIRING PERSISTED tx: ${txid}",
-                    ("txid", txid));
-         }
-
-         persisted_by_expiry.erase(persisted_by_expiry.begin());
-         num_expired_persistent++;
-      }
-
-      if( exhausted ) {
-         fc_wlog( _log, "Unable to process all ${n} persisted transactions before deadline, Expired ${expired}",
-                  ( "n", orig_count )
-                        ( "expired", num_expired_persistent ) );
+   if( _persistent_transactions.empty() )
+      return true;
+   chain::controller& chain = chain_plug->chain();
+   int num_expired_persistent = 0;
+   const auto orig_count = _persistent_transactions.size();
+   const auto start = fc::time_point::now();
+
+   const bool producing = _pending_block_mode == pending_block_mode::producing && chain.is_building_block();
+   const bool done = _persistent_transactions.expire( expiry_time, deadline, [&]( const transaction_id_type& txid ) {
+      if( producing ) {
+         async_dlog(_trx_trace_log, "[TRX_TRACE] Block ${block_num} for producer ${prod} is EXPIRING PERSISTED tx: ${txid}",
+                 ("block_num", chain.head_block_num() + 1)
+                 ("prod", chain.pending_block_producer())
+                 ("txid", txid));
       } else {
-         fc_dlog( _log, "Processed ${n} persisted transactions, Expired ${expired}",
-                  ( "n", orig_count )
-                        ( "expired", num_expired_persistent ) );
+         async_dlog(_trx_trace_log, "[TRX_TRACE] Speculative execution is EXPIRING PERSISTED tx: ${txid}",
+                 ("txid", txid));
       }
-   }
-   return !exhausted;
+      num_expired_persistent++;
+   } );
+
+   _persisted_trx_expired_counter.increment( num_expired_persistent );
+   _persisted_trx_expiry_time_counter.increment( ( fc::time_point::now() - start ).count() );
+   if( !done ) {
+      fc_wlog( _log, "Unable to process all ${n} persisted transactions before deadline, Expired ${expired}",
+               ( "n", orig_count )
+                     ( "expired", num_expired_persistent ) );
+   } else if( num_expired_persistent > 0 ) {
+      async_dlog( _log, "Processed ${n} persisted transactions, Expired ${expired}",
+               ( "n", orig_count )
+                     ( "expired", num_expired_persistent ) );
+   }
+   return done;
 }
 
 bool producer_plugin_impl::remove_expired_blacklisted_trxs( const fc::time_point& deadline )
@@ -1629,21 +2266,23 @@ bool producer_plugin_impl::remove_expired_blacklisted_trxs( const fc::time_point
          num_expired++;
       }
 
-      fc_dlog( _log, "Processed ${n} blacklisted transactions, Expired ${expired}",
+      async_dlog( _log, "Processed ${n} blacklisted transactions, Expired ${expired}",
                ("n", orig_count)("expired", num_expired) );
    }
    return !exhausted;
 }
 
+// Transactions are applied one at a time on the main thread: chainbase keeps a single undo stack and its indices are
+// not thread safe, and the wasm runtime and apply_context share controller state, so there are no isolated sessions
+// to run non-conflicting transactions against. The context free part (key recovery) is already done on the thread pool,
+// see transaction_metadata::start_recover_keys.
 bool producer_plugin_impl::process_unapplied_trxs( const fc::time_point& deadline )
 {
    chain::controller& chain = chain_plug->chain();
-   auto& persisted_by_id = _persistent_transactions.get<by_id>();
-
    bool exhausted = false;
    // Processing unapplied transactions...
    //
-   if (_producers.empty() && persisted_by_id.empty()) {
+   if (_producers.empty() && _persistent_transactions.empty()) {
       // if this node can never produce and has no persisted transactions,
       // there is no need for unapplied transactions they can be dropped
       chain.get_unapplied_transactions().clear();
@@ -1653,13 +2292,18 @@ bool producer_plugin_impl::process_unapplied_trxs( const fc::time_point& deadlin
       if( !unapplied_trxs.empty() ) {
          const time_point pending_block_time = chain.pending_block_time();
          auto unapplied_trxs_size = unapplied_trxs.size();
+         const auto num_expired = unapplied_trxs.clear_expired( pending_block_time );
+         if( num_expired && !_producers.empty() ) {
+            async_dlog(_trx_trace_log, "[TRX_TRACE] Node with producers configured is dropping ${n} EXPIRED transactions that were PREVIOUSLY ACCEPTED",
+                    ("n", num_expired));
+         }
          int num_applied = 0;
          int num_failed = 0;
          int num_processed = 0;
          auto calculate_transaction_category = [&](const transaction_metadata_ptr& trx) {
             if (trx->packed_trx->expiration() < pending_block_time) {
                return tx_category::EXPIRED;
-            } else if (persisted_by_id.find(trx->id) != persisted_by_id.end()) {
+            } else if (_persistent_transactions.contains(trx->id)) {
                return tx_category::PERSISTED;
             } else {
                return tx_category::UNEXPIRED_UNPERSISTED;
@@ -1675,13 +2319,13 @@ bool producer_plugin_impl::process_unapplied_trxs( const fc::time_point& deadlin
                exhausted = true;
                break;
             }
-            const transaction_metadata_ptr trx = itr->second;
+            const transaction_metadata_ptr trx = itr->trx_meta;
             auto category = calculate_transaction_category(trx);
             if (category == tx_category::EXPIRED ||
                 (category == tx_category::UNEXPIRED_UNPERSISTED && _producers.empty()))
             {
                if (!_producers.empty()) {
-                  fc_dlog(_trx_trace_log, "[TRX_TRACE] Node with producers configured is dropping an EXPIRED transaction that was PREVIOUSLY ACCEPTED : ${txid}",
+                  async_dlog(_trx_trace_log, "[TRX_TRACE] Node with producers configured is dropping an EXPIRED transaction that was PREVIOUSLY ACCEPTED : ${txid}",
                           ("txid", trx->id));
                }
                itr = unapplied_trxs.erase( itr ); // unapplied_trxs map has not been modified, so simply erase and continue
@@ -1699,9 +2343,12 @@ bool producer_plugin_impl::process_unapplied_trxs( const fc::time_point& deadlin
                      trx_deadline = deadline;
                   }
 
+                  const auto push_start = fc::time_point::now();
                   auto trace = chain.push_transaction( trx, trx_deadline, trx->billed_cpu_time_us, false );
+                  budget_add( &producer_plugin::block_time_budget::unapplied_us, push_start );
                   if (trace->except) {
                      if (exception_is_exhausted(*trace->except, deadline_is_subjective)) {
+                        budget_add( &producer_plugin::block_time_budget::exhausted_us, push_start );
                         if( block_is_exhausted() ) {
                            exhausted = true;
                            break;
@@ -1722,7 +2369,7 @@ bool producer_plugin_impl::process_unapplied_trxs( const fc::time_point& deadlin
             itr = itr_next;
          }
 
-         fc_dlog( _log, "Processed ${m} of ${n} previously applied transactions, Applied ${applied}, Failed/Dropped ${failed}",
+         async_dlog( _log, "Processed ${m} of ${n} previously applied transactions, Applied ${applied}, Failed/Dropped ${failed}",
                   ("m", num_processed)("n", unapplied_trxs_size)("applied", num_applied)("failed", num_failed) );
       }
    }
@@ -1742,45 +2389,37 @@ void producer_plugin_impl::process_scheduled_and_incoming_trxs( const fc::time_p
    bool exhausted = false;
    double incoming_trx_weight = 0.0;
 
-   const auto& sch_idx = chain.db().get_index<generated_transaction_multi_index,by_delay>();
-   const auto scheduled_trxs_size = sch_idx.size();
-   auto sch_itr = sch_idx.begin();
-   while( sch_itr != sch_idx.end() ) {
-      if( sch_itr->delay_until > pending_block_time) break;    // not scheduled yet
+   const auto scheduled_trxs_size = chain.db().get_index<generated_transaction_multi_index,by_delay>().size();
+   // the due transactions are taken at once, transactions scheduled by them are published in this block
+   const auto due_trxs = chain.get_due_scheduled_transactions();
+   const auto& sch_by_id = chain.db().get_index<generated_transaction_multi_index,by_trx_id>();
+   for( const auto& trx_id : due_trxs ) {
       if( exhausted || deadline <= fc::time_point::now() ) {
          exhausted = true;
          break;
       }
-      if( sch_itr->published >= pending_block_time ) {
-         ++sch_itr;
-         continue; // do not allow schedule and execute in same block
-      }
 
-      const transaction_id_type trx_id = sch_itr->trx_id; // make copy since reference could be invalidated
       if (blacklist_by_id.find(trx_id) != blacklist_by_id.end()) {
-         ++sch_itr;
          continue;
       }
-
-      auto sch_itr_next = sch_itr; // save off next since sch_itr may be invalidated by loop
-      ++sch_itr_next;
-      const auto next_delay_until = sch_itr_next != sch_idx.end() ? sch_itr_next->delay_until : sch_itr->delay_until;
-      const auto next_id = sch_itr_next != sch_idx.end() ? sch_itr_next->id : sch_itr->id;
+      // canceled, or replaced and published in this block, by a transaction executed since
+      const auto sch_itr = sch_by_id.find( trx_id );
+      if( sch_itr == sch_by_id.end() || sch_itr->published >= pending_block_time ) {
+         continue;
+      }
 
       num_processed++;
 
       // configurable ratio of incoming txns vs deferred txns
-      while (incoming_trx_weight >= 1.0 && pending_incoming_process_limit && _pending_incoming_transactions.size()) {
+      while (incoming_trx_weight >= 1.0 && pending_incoming_process_limit && !_pending_incoming_transactions.empty()) {
          if (deadline <= fc::time_point::now()) {
             exhausted = true;
             break;
          }
 
-         auto e = _pending_incoming_transactions.front();
-         _pending_incoming_transactions.pop_front();
          --pending_incoming_process_limit;
          incoming_trx_weight -= 1.0;
-         if( !process_incoming_transaction_async(std::get<0>(e), std::get<1>(e), std::get<2>(e)) ) {
+         if( !process_next_incoming_transaction() ) {
             exhausted = true;
             break;
          }
@@ -1799,9 +2438,12 @@ void producer_plugin_impl::process_scheduled_and_incoming_trxs( const fc::time_p
             trx_deadline = deadline;
          }
 
+         const auto push_start = fc::time_point::now();
          auto trace = chain.push_scheduled_transaction(trx_id, trx_deadline, 0, false);
+         budget_add( &producer_plugin::block_time_budget::scheduled_us, push_start );
          if (trace->except) {
             if (exception_is_exhausted(*trace->except, deadline_is_subjective)) {
+               budget_add( &producer_plugin::block_time_budget::exhausted_us, push_start );
                if( block_is_exhausted() ) {
                   exhausted = true;
                   break;
@@ -1819,13 +2461,10 @@ void producer_plugin_impl::process_scheduled_and_incoming_trxs( const fc::time_p
 
       incoming_trx_weight += _incoming_defer_ratio;
       if (!pending_incoming_process_limit) incoming_trx_weight = 0.0;
-
-      if( sch_itr_next == sch_idx.end() ) break;
-      sch_itr = sch_idx.lower_bound( boost::make_tuple( next_delay_until, next_id ) );
    }
 
    if( scheduled_trxs_size > 0 ) {
-      fc_dlog( _log, "Processed ${m} of ${n} scheduled transactions, Applied ${applied}, Failed/Dropped ${failed}",
+      async_dlog( _log, "Processed ${m} of ${n} scheduled transactions, Applied ${applied}, Failed/Dropped ${failed}",
                ( "m", num_processed )( "n", scheduled_trxs_size )( "applied", num_applied )( "failed", num_failed ) );
    }
 }
@@ -1834,16 +2473,14 @@ bool producer_plugin_impl::process_incoming_trxs( const fc::time_point& deadline
 {
    bool exhausted = false;
    if (!_pending_incoming_transactions.empty()) {
-      fc_dlog(_log, "Processing ${n} pending transactions", ("n", _pending_incoming_transactions.size()));
-      while (pending_incoming_process_limit && _pending_incoming_transactions.size()) {
+      async_dlog(_log, "Processing ${n} pending transactions", ("n", _pending_incoming_transactions.size()));
+      while (pending_incoming_process_limit && !_pending_incoming_transactions.empty()) {
          if( deadline <= fc::time_point::now() ) {
             exhausted = true;
             break;
          }
-         auto e = _pending_incoming_transactions.front();
-         _pending_incoming_transactions.pop_front();
          --pending_incoming_process_limit;
-         if( !process_incoming_transaction_async(std::get<0>(e), std::get<1>(e), std::get<2>(e)) ) {
+         if( !process_next_incoming_transaction() ) {
             exhausted = true;
             break;
          }
@@ -1888,10 +2525,10 @@ void producer_plugin_impl::schedule_production_loop() {
           } ) );
    } else if (result == start_block_result::waiting_for_block){
       if (!_producers.empty() && !production_disabled_by_policy()) {
-         fc_dlog(_log, "Waiting till another block is received and scheduling Speculative/Production Change");
+         async_dlog(_log, "Waiting till another block is received and scheduling Speculative/Production Change");
          schedule_delayed_production_loop(weak_from_this(), calculate_producer_wake_up_time(calculate_pending_block_time()));
       } else {
-         fc_dlog(_log, "Waiting till another block is received");
+         async_dlog(_log, "Waiting till another block is received");
          // nothing to do until more blocks arrive
       }
 
@@ -1903,11 +2540,11 @@ void producer_plugin_impl::schedule_production_loop() {
 
    } else if (_pending_block_mode == pending_block_mode::speculating && !_producers.empty() && !production_disabled_by_policy()){
       chain::controller& chain = chain_plug->chain();
-      fc_dlog(_log, "Speculative Block Created; Scheduling Speculative/Production Change");
+      async_dlog(_log, "Speculative Block Created; Scheduling Speculative/Production Change");
       EOS_ASSERT( chain.is_building_block(), missing_pending_block_state, "speculating without pending_block_state" );
       schedule_delayed_production_loop(weak_from_this(), calculate_producer_wake_up_time(chain.pending_block_time()));
    } else {
-      fc_dlog(_log, "Speculative Block Created");
+      async_dlog(_log, "Speculative Block Created");
    }
 }
 
@@ -1923,12 +2560,12 @@ void producer_plugin_impl::schedule_maybe_produce_block( bool exhausted ) {
       EOS_ASSERT( chain.is_building_block(), missing_pending_block_state,
                   "producing without pending_block_state, start_block succeeded" );
       _timer.expires_at( epoch + boost::posix_time::microseconds( deadline.time_since_epoch().count() ) );
-      fc_dlog( _log, "Scheduling Block Production on Normal Block #${num} for ${time}",
+      async_dlog( _log, "Scheduling Block Production on Normal Block #${num} for ${time}",
                ("num", chain.head_block_num() + 1)( "time", deadline ) );
    } else {
       EOS_ASSERT( chain.is_building_block(), missing_pending_block_state, "producing without pending_block_state" );
       _timer.expires_from_now( boost::posix_time::microseconds( 0 ) );
-      fc_dlog( _log, "Scheduling Block Production on ${desc} Block #${num} immediately",
+      async_dlog( _log, "Scheduling Block Production on ${desc} Block #${num} immediately",
                ("num", chain.head_block_num() + 1)("desc", block_is_exhausted() ? "Exhausted" : "Deadline exceeded") );
    }
 
@@ -1938,9 +2575,9 @@ void producer_plugin_impl::schedule_maybe_produce_block( bool exhausted ) {
             if( self && ec != boost::asio::error::operation_aborted && cid == self->_timer_corelation_id ) {
                // pending_block_state expected, but can't assert inside async_wait
                auto block_num = chain.is_building_block() ? chain.head_block_num() + 1 : 0;
-               fc_dlog( _log, "Produce block timer for ${num} running at ${time}", ("num", block_num)("time", fc::time_point::now()) );
+               async_dlog( _log, "Produce block timer for ${num} running at ${time}", ("num", block_num)("time", fc::time_point::now()) );
                auto res = self->maybe_produce_block();
-               fc_dlog( _log, "Producing Block #${num} returned: ${res}", ("num", block_num)( "res", res ) );
+               async_dlog( _log, "Producing Block #${num} returned: ${res}", ("num", block_num)( "res", res ) );
             }
          } ) );
 }
@@ -1963,7 +2600,7 @@ optional<fc::time_point> producer_plugin_impl::calculate_producer_wake_up_time(
       }
    }
    if( !wake_up_time ) {
-      fc_dlog(_log, "Not Scheduling Speculative/Production, no local producers had valid wake up times");
+      async_dlog(_log, "Not Scheduling Speculative/Production, no local producers had valid wake up times");
    }
 
    return wake_up_time;
@@ -1971,7 +2608,7 @@ optional<fc::time_point> producer_plugin_impl::calculate_producer_wake_up_time(
 
 void producer_plugin_impl::schedule_delayed_production_loop(const std::weak_ptr<producer_plugin_impl>& weak_this, optional<fc::time_point> wake_up_time) {
    if (wake_up_time) {
-      fc_dlog(_log, "Scheduling Speculative/Production Change at ${time}", ("time", wake_up_time));
+      async_dlog(_log, "Scheduling Speculative/Production Change at ${time}", ("time", wake_up_time));
       static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
       _timer.expires_at(epoch + boost::posix_time::microseconds(wake_up_time->time_since_epoch().count()));
       _timer.async_wait( app().get_priority_queue().wrap( priority::high,
@@ -1995,7 +2632,7 @@ bool producer_plugin_impl::maybe_produce_block() {
       return true;
    } LOG_AND_DROP();
 
-   fc_dlog(_log, "Aborting block due to produce_block error");
+   async_dlog(_log, "Aborting block due to produce_block error");
    chain::controller& chain = chain_plug->chain();
    chain.abort_block();
    return false;
@@ -2004,7 +2641,7 @@ bool producer_plugin_impl::maybe_produce_block() {
 static auto make_debug_time_logger() {
    auto start = fc::time_point::now();
    return fc::make_scoped_exit([=](){
-      fc_dlog(_log, "Signing took ${ms}us", ("ms", fc::time_point::now() - start) );
+      async_dlog(_log, "Signing took ${ms}us", ("ms", fc::time_point::now() - start) );
    });
 }
 
@@ -2016,6 +2653,20 @@ static auto maybe_make_debug_time_logger() -> fc::optional<decltype(make_debug_t
    }
 }
 
+void producer_plugin_impl::finish_block_budget() {
+   auto& b = _block_budget;
+   b.total_us = ( fc::time_point::now() - _block_budget_start ).count();
+   b.idle_us = std::max<int64_t>( 0, b.total_us - b.start_us - b.unapplied_us - b.scheduled_us - b.incoming_us
+                                     - b.finalize_us - b.sign_us - b.commit_us - b.expire_us );
+   const auto& fields = block_budget_fields();
+   for( size_t i = 0; i < fields.size() && i < _block_budget_histograms.size(); ++i )
+      _block_budget_histograms[i].observe( b.*fields[i].second );
+
+   _block_time_budgets.push_front( b );
+   if( _block_time_budgets.size() > max_block_time_budgets )
+      _block_time_budgets.pop_back();
+}
+
 void producer_plugin_impl::produce_block() {
    //ilog("produce_block ${t}", ("t", fc::time_point::now())); // for testing _produce_time_offset_us
    EOS_ASSERT(_pending_block_mode == pending_block_mode::producing, producer_exception, "called produce_block while not actually producing");
@@ -2032,16 +2683,24 @@ void producer_plugin_impl::produce_block() {
    }
 
    //idump( (fc::time_point::now() - chain.pending_block_time()) );
+   const auto finalize_start = fc::time_point::now();
    chain.finalize_block( [&]( const digest_type& d ) {
       auto debug_logger = maybe_make_debug_time_logger();
-      return signature_provider_itr->second(d);
+      const auto sign_start = fc::time_point::now();
+      auto sig = signature_provider_itr->second(d);
+      budget_add( &producer_plugin::block_time_budget::sign_us, sign_start );
+      return sig;
    } );
+   const auto commit_start = budget_add( &producer_plugin::block_time_budget::finalize_us, finalize_start );
+   _block_budget.finalize_us -= _block_budget.sign_us;
 
    chain.commit_block();
+   budget_add( &producer_plugin::block_time_budget::commit_us, commit_start );
+   finish_block_budget();
 
    block_state_ptr new_bs = chain.head_block_state();
 
-   ilog("Produced block ${id}... #${n} @ ${t} signed by ${p} [trxs: ${count}, lib: ${lib}, confirmed: ${confs}]",
+   async_ilog( fc::logger::get( DEFAULT_LOGGER ), "Produced block ${id}... #${n} @ ${t} signed by ${p} [trxs: ${count}, lib: ${lib}, confirmed: ${confs}]",
         ("p",new_bs->header.producer)("id",fc::variant(new_bs->id).as_string().substr(0,16))
         ("n",new_bs->block_num)("t",new_bs->header.timestamp)
         ("count",new_bs->block->transactions.size())("lib",chain.last_irreversible_block_num())("confs", new_bs->header.confirmed));
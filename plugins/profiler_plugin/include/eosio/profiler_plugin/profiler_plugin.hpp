@@ -0,0 +1,55 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+#include <eosio/http_plugin/http_plugin.hpp>
+
+#include <appbase/application.hpp>
+
+namespace eosio {
+
+using namespace appbase;
+
+/**
+ *  Samples the stacks of the node threads on a timer of the process CPU time, keeps them aggregated in memory and
+ *  serves them as folded stacks, the input of flamegraph.pl, for a window of the last minutes.
+ */
+class profiler_plugin : public appbase::plugin<profiler_plugin> {
+public:
+   profiler_plugin();
+   virtual ~profiler_plugin();
+
+   APPBASE_PLUGIN_REQUIRES((http_plugin))
+   virtual void set_program_options(options_description&, options_description& cfg) override;
+
+   void plugin_initialize(const variables_map& options);
+   void plugin_startup();
+   void plugin_shutdown();
+
+   struct get_profile_params {
+      uint32_t       seconds = 60; ///< window ending now, rounded up to whole aggregation buckets
+      vector<string> threads;      ///< thread groups to return (main, net, http, ...), all the sampled ones if empty
+   };
+
+   struct get_profile_results {
+      fc::time_point window_start;
+      fc::time_point window_end;
+      uint64_t       samples = 0;
+      uint64_t       dropped = 0;        ///< overwritten in the sample buffer before they were aggregated
+      uint32_t       sample_rate_hz = 0; ///< per second of CPU time, lowered to keep within profiler-max-overhead-pct
+      double         overhead_pct = 0;   ///< time spent in the sampler over the CPU time of the process, last second
+      vector<string> folded;             ///< `<thread>;<outermost frame>;...;<innermost frame> <samples>`
+   };
+
+   get_profile_results get_profile(const get_profile_params& params);
+
+private:
+   std::unique_ptr<class profiler_plugin_impl> my;
+};
+
+}
+
+FC_REFLECT(eosio::profiler_plugin::get_profile_params, (seconds)(threads))
+FC_REFLECT(eosio::profiler_plugin::get_profile_results,
+           (window_start)(window_end)(samples)(dropped)(sample_rate_hz)(overhead_pct)(folded))
@@ -0,0 +1,434 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/profiler_plugin/profiler_plugin.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/thread_utils.hpp>
+
+#include <fc/io/json.hpp>
+
+#include <boost/asio/steady_timer.hpp>
+#include <boost/core/demangle.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace eosio {
+   static appbase::abstract_plugin& _profiler_plugin = app().register_plugin<profiler_plugin>();
+
+namespace {
+
+   constexpr size_t max_frames = 64;
+   constexpr size_t ring_size  = 8192;
+   /// frames of the signal handler and of the signal trampoline at the top of every stack
+   constexpr int    handler_frames = 2;
+
+   /// A stack captured by the signal handler: `seq` is odd while it is written, 2 * (index + 1) once it is complete.
+   struct sample_slot {
+      std::atomic<uint64_t> seq{0};
+      pid_t                 tid = 0;
+      int                   depth = 0;
+      void*                 frames[max_frames];
+   };
+
+   /// Written by the SIGPROF handler of whichever thread is interrupted, read by the aggregation thread alone.
+   struct sample_ring {
+      std::atomic<uint64_t> head{0};
+      std::atomic<uint64_t> handler_ns{0}; ///< time spent in the handler
+      sample_slot           slots[ring_size];
+   };
+
+   std::atomic<sample_ring*> active_ring{nullptr};
+
+   pid_t current_tid() {
+#ifdef __linux__
+      return static_cast<pid_t>( syscall( SYS_gettid ) );
+#else
+      return 0;
+#endif
+   }
+
+   int64_t to_ns( const timespec& ts ) {
+      return int64_t( ts.tv_sec ) * 1000000000 + ts.tv_nsec;
+   }
+
+   /// async-signal-safe: atomics, clock_gettime, gettid and backtrace, initialized before the timer is armed
+   void on_sigprof( int, siginfo_t*, void* ) {
+      auto* ring = active_ring.load( std::memory_order_acquire );
+      if( !ring ) return;
+      const int saved_errno = errno;
+      timespec start, end;
+      clock_gettime( CLOCK_MONOTONIC, &start );
+
+      const uint64_t index = ring->head.fetch_add( 1, std::memory_order_relaxed );
+      auto& slot = ring->slots[index % ring_size];
+      slot.seq.store( 2 * index + 1, std::memory_order_relaxed );
+      std::atomic_thread_fence( std::memory_order_release );
+      slot.tid = current_tid();
+      slot.depth = backtrace( slot.frames, max_frames );
+      slot.seq.store( 2 * index + 2, std::memory_order_release );
+
+      clock_gettime( CLOCK_MONOTONIC, &end );
+      ring->handler_ns.fetch_add( to_ns( end ) - to_ns( start ), std::memory_order_relaxed );
+      errno = saved_errno;
+   }
+
+}
+
+class profiler_plugin_impl {
+   public:
+      struct stack_key {
+         string        thread;
+         vector<void*> frames; ///< outermost first
+
+         bool operator<( const stack_key& other ) const {
+            return std::tie( thread, frames ) < std::tie( other.thread, other.frames );
+         }
+      };
+
+      /// samples aggregated over bucket_length
+      struct bucket {
+         fc::time_point                start;
+         uint64_t                      dropped = 0;
+         std::map<stack_key, uint64_t> stacks;
+      };
+
+      static constexpr int64_t drain_interval_ms = 100;
+      static constexpr int64_t rate_check_drains = 10;
+      static const fc::microseconds bucket_length;
+
+      // configuration
+      uint32_t         max_rate_hz = 99;
+      std::set<string> thread_groups; ///< empty for all
+      fc::microseconds retention;
+      double           max_overhead_pct = 1;
+
+      // aggregation thread only
+      std::unique_ptr<sample_ring>            ring;
+      uint64_t                                tail = 0;
+      uint32_t                                drains = 0;
+      int64_t                                 last_cpu_ns = 0;
+      uint64_t                                last_handler_ns = 0;
+      std::unordered_map<pid_t, string>       thread_names;
+      fc::optional<chain::named_thread_pool>  thread_pool;
+      fc::optional<boost::asio::steady_timer> timer;
+      struct sigaction                        previous_action;
+
+      // shared with the http threads
+      std::mutex                              mtx;
+      std::deque<bucket>                      buckets;
+      uint32_t                                rate_hz = 0;
+      double                                  overhead_pct = 0;
+      std::unordered_map<void*, string>       symbols;
+
+      void start() {
+         ring = std::make_unique<sample_ring>();
+         {
+            // backtrace loads the unwinder on its first call, which is not safe in a signal handler
+            void* frames[1];
+            backtrace( frames, 1 );
+         }
+         timespec cpu;
+         clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &cpu );
+         last_cpu_ns = to_ns( cpu );
+
+         struct sigaction action = {};
+         action.sa_sigaction = on_sigprof;
+         action.sa_flags = SA_SIGINFO | SA_RESTART;
+         sigemptyset( &action.sa_mask );
+         EOS_ASSERT( sigaction( SIGPROF, &action, &previous_action ) == 0, chain::plugin_exception,
+                     "cannot install the SIGPROF handler: ${e}", ("e", strerror( errno )) );
+         active_ring.store( ring.get(), std::memory_order_release );
+         arm( max_rate_hz );
+
+         thread_pool.emplace( "prof", 1 );
+         timer.emplace( thread_pool->get_executor() );
+         schedule_drain();
+      }
+
+      void stop() {
+         if( !thread_pool ) return;
+         thread_pool->stop();
+         timer.reset();
+         thread_pool.reset();
+
+         arm( 0 );
+         active_ring.store( nullptr, std::memory_order_release );
+         sigaction( SIGPROF, &previous_action, nullptr );
+         // left allocated: a handler still running on another thread may be writing to it
+         ring.release();
+      }
+
+      /// the timer counts the CPU time of all the threads, so the busier the node the more samples per second
+      void arm( uint32_t hz ) {
+         itimerval tv = {};
+         if( hz > 0 ) {
+            tv.it_interval.tv_usec = 1000000 / hz;
+            if( tv.it_interval.tv_usec == 1000000 ) {
+               tv.it_interval.tv_sec = 1;
+               tv.it_interval.tv_usec = 0;
+            }
+            tv.it_value = tv.it_interval;
+         }
+         setitimer( ITIMER_PROF, &tv, nullptr );
+         rate_hz = hz;
+      }
+
+      void schedule_drain() {
+         timer->expires_from_now( std::chrono::milliseconds( drain_interval_ms ) );
+         timer->async_wait( [this]( const boost::system::error_code& ec ) {
+            if( ec ) return;
+            try {
+               drain();
+               if( ++drains % rate_check_drains == 0 )
+                  limit_rate();
+            } FC_LOG_AND_DROP();
+            schedule_drain();
+         } );
+      }
+
+      /// thread group of a thread: its name without the index of the pool thread, `main` for the main thread
+      const string& thread_group( pid_t tid ) {
+         auto it = thread_names.find( tid );
+         if( it != thread_names.end() ) return it->second;
+
+         string name;
+         if( tid == getpid() ) {
+            name = "main";
+         } else {
+            std::ifstream comm( "/proc/self/task/" + std::to_string( tid ) + "/comm" );
+            std::getline( comm, name );
+            const auto dash = name.rfind( '-' );
+            if( dash != string::npos && dash + 1 < name.size() &&
+                name.find_first_not_of( "0123456789", dash + 1 ) == string::npos )
+               name.resize( dash );
+            if( name.empty() ) name = "unknown";
+         }
+         // thread ids are reused by new threads, which are named after they started
+         if( thread_names.size() > 1024 ) thread_names.clear();
+         return thread_names.emplace( tid, std::move( name ) ).first->second;
+      }
+
+      void drain() {
+         const auto now = fc::time_point::now();
+         uint64_t dropped = 0;
+         std::map<stack_key, uint64_t> stacks;
+
+         const uint64_t head = ring->head.load( std::memory_order_acquire );
+         if( head - tail > ring_size ) {
+            dropped += head - tail - ring_size;
+            tail = head - ring_size;
+         }
+         for( ; tail < head; ++tail ) {
+            const auto& slot = ring->slots[tail % ring_size];
+            const uint64_t expected = 2 * tail + 2;
+            const uint64_t seq = slot.seq.load( std::memory_order_acquire );
+            if( seq < expected ) break; // still written, next drain takes it
+            if( seq > expected ) {
+               ++dropped;
+               continue;
+            }
+            const pid_t tid = slot.tid;
+            const int depth = std::min<int>( slot.depth, max_frames );
+            vector<void*> frames( slot.frames + std::min( depth, handler_frames ), slot.frames + depth );
+            std::atomic_thread_fence( std::memory_order_acquire );
+            if( slot.seq.load( std::memory_order_relaxed ) != seq ) {
+               ++dropped;
+               continue;
+            }
+
+            const auto& group = thread_group( tid );
+            if( !thread_groups.empty() && !thread_groups.count( group ) ) continue;
+            std::reverse( frames.begin(), frames.end() );
+            ++stacks[stack_key{ group, std::move( frames ) }];
+         }
+
+         std::lock_guard<std::mutex> g( mtx );
+         if( buckets.empty() || now - buckets.back().start >= bucket_length )
+            buckets.push_back( bucket{ now } );
+         auto& b = buckets.back();
+         b.dropped += dropped;
+         for( auto& s : stacks )
+            b.stacks[s.first] += s.second;
+         while( !buckets.empty() && now - buckets.front().start > retention )
+            buckets.pop_front();
+      }
+
+      /// halves the rate when the handler takes more than max_overhead_pct of the CPU time, back up when well below
+      void limit_rate() {
+         timespec cpu;
+         clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &cpu );
+         const int64_t cpu_ns = to_ns( cpu );
+         const uint64_t handler_ns = ring->handler_ns.load( std::memory_order_relaxed );
+         const double overhead = cpu_ns > last_cpu_ns ? 100. * ( handler_ns - last_handler_ns ) / ( cpu_ns - last_cpu_ns ) : 0;
+         last_cpu_ns = cpu_ns;
+         last_handler_ns = handler_ns;
+
+         std::lock_guard<std::mutex> g( mtx );
+         overhead_pct = overhead;
+         if( overhead > max_overhead_pct && rate_hz > 1 ) {
+            arm( rate_hz / 2 );
+            wlog( "profiler sampling took ${o}% of the CPU time, sampling at ${r} Hz", ("o", overhead)("r", rate_hz) );
+         } else if( overhead < max_overhead_pct / 4 && rate_hz < max_rate_hz ) {
+            arm( std::min( rate_hz * 2, max_rate_hz ) );
+         }
+      }
+
+      /// function name if the frame is in the dynamic symbols, `<module>+0x<offset>` for addr2line otherwise
+      const string& symbol( void* pc, bool caller ) {
+         auto it = symbols.find( pc );
+         if( it != symbols.end() ) return it->second;
+
+         // return addresses point after the call, which may be the next function already
+         const void* address = caller ? static_cast<char*>( pc ) - 1 : pc;
+         std::ostringstream name;
+         Dl_info info = {};
+         const bool found = dladdr( address, &info ) != 0;
+         if( found && info.dli_sname ) {
+            name << boost::core::demangle( info.dli_sname );
+         } else if( found && info.dli_fname ) {
+            const char* module = strrchr( info.dli_fname, '/' );
+            name << ( module ? module + 1 : info.dli_fname ) << "+0x" << std::hex
+                 << static_cast<const char*>( address ) - static_cast<const char*>( info.dli_fbase );
+         } else {
+            name << pc;
+         }
+         // `;` separates frames and ` ` the count in the folded format
+         auto folded = name.str();
+         std::replace( folded.begin(), folded.end(), ';', ':' );
+         return symbols.emplace( pc, std::move( folded ) ).first->second;
+      }
+
+      profiler_plugin::get_profile_results get_profile( const profiler_plugin::get_profile_params& params ) {
+         const std::set<string> threads( params.threads.begin(), params.threads.end() );
+         const auto now = fc::time_point::now();
+         const auto window_start = now - fc::seconds( params.seconds );
+
+         profiler_plugin::get_profile_results results;
+         results.window_end = now;
+         results.window_start = now;
+         std::map<stack_key, uint64_t> stacks;
+         std::lock_guard<std::mutex> g( mtx );
+         for( auto it = buckets.rbegin(); it != buckets.rend() && it->start + bucket_length > window_start; ++it ) {
+            results.window_start = it->start;
+            results.dropped += it->dropped;
+            for( const auto& s : it->stacks ) {
+               if( !threads.empty() && !threads.count( s.first.thread ) ) continue;
+               stacks[s.first] += s.second;
+               results.samples += s.second;
+            }
+         }
+         results.sample_rate_hz = rate_hz;
+         results.overhead_pct = overhead_pct;
+
+         // stacks differing by addresses within the same functions are merged once symbolized
+         std::map<string, uint64_t> folded;
+         for( const auto& s : stacks ) {
+            string line = s.first.thread;
+            for( size_t i = 0; i < s.first.frames.size(); ++i ) {
+               line += ';';
+               line += symbol( s.first.frames[i], i + 1 < s.first.frames.size() );
+            }
+            folded[line] += s.second;
+         }
+         results.folded.reserve( folded.size() );
+         for( const auto& f : folded )
+            results.folded.emplace_back( f.first + " " + std::to_string( f.second ) );
+         return results;
+      }
+};
+
+const fc::microseconds profiler_plugin_impl::bucket_length = fc::seconds( 5 );
+
+profiler_plugin::profiler_plugin():my(new profiler_plugin_impl()){}
+profiler_plugin::~profiler_plugin(){}
+
+void profiler_plugin::set_program_options(options_description&, options_description& cfg) {
+   cfg.add_options()
+         ("profiler-sample-rate", bpo::value<uint32_t>()->default_value(99),
+          "stacks sampled per second of CPU time of the node, at most 1000")
+         ("profiler-threads", bpo::value<vector<string>>()->composing()->default_value({"main", "net", "http", "randpa", "chain"}, "main net http randpa chain"),
+          "thread group to aggregate the samples of (main, net, http, randpa, chain, prod, ...), '*' for all. May be specified multiple times")
+         ("profiler-retention-sec", bpo::value<uint32_t>()->default_value(300),
+          "seconds of aggregated stacks kept in memory, the longest window served")
+         ("profiler-max-overhead-pct", bpo::value<double>()->default_value(1.),
+          "percentage of the CPU time the sampler may take, the sample rate is halved while above")
+         ;
+}
+
+void profiler_plugin::plugin_initialize(const variables_map& options) {
+   try {
+#ifndef __linux__
+      EOS_THROW( chain::plugin_config_exception, "profiler_plugin is only supported on Linux" );
+#endif
+      my->max_rate_hz = options.at( "profiler-sample-rate" ).as<uint32_t>();
+      EOS_ASSERT( my->max_rate_hz > 0 && my->max_rate_hz <= 1000, chain::plugin_config_exception,
+                  "profiler-sample-rate should be in [1, 1000]" );
+      for( const auto& t : options.at( "profiler-threads" ).as<vector<string>>() ) {
+         if( t == "*" ) {
+            my->thread_groups.clear();
+            break;
+         }
+         my->thread_groups.insert( t );
+      }
+      const auto retention_sec = options.at( "profiler-retention-sec" ).as<uint32_t>();
+      EOS_ASSERT( retention_sec > 0, chain::plugin_config_exception, "profiler-retention-sec should be positive" );
+      my->retention = fc::seconds( retention_sec );
+      my->max_overhead_pct = options.at( "profiler-max-overhead-pct" ).as<double>();
+      EOS_ASSERT( my->max_overhead_pct > 0, chain::plugin_config_exception, "profiler-max-overhead-pct should be positive" );
+   }
+   FC_LOG_AND_RETHROW()
+}
+
+void profiler_plugin::plugin_startup() {
+   try {
+      my->start();
+      ilog( "profiler sampling at ${r} Hz of CPU time", ("r", my->max_rate_hz) );
+
+      auto api = my.get();
+      // symbolization takes a while for a large profile, do not hold the main thread for it
+      app().get_plugin<http_plugin>().add_api({
+         {std::string("/v1/profiler/get_profile"),
+          [api](string, string body, url_response_callback cb) mutable {
+             try {
+                if (body.empty()) body = "{}";
+                fc::variant result(api->get_profile(fc::json::from_string(body).as<profiler_plugin::get_profile_params>()));
+                cb(200, std::move(result));
+             } catch (...) {
+                http_plugin::handle_exception("profiler", "get_profile", body, cb);
+             }
+          }}
+      }, handler_thread::http);
+   }
+   FC_LOG_AND_RETHROW()
+}
+
+void profiler_plugin::plugin_shutdown() {
+   my->stop();
+}
+
+profiler_plugin::get_profile_results profiler_plugin::get_profile(const get_profile_params& params) {
+   return my->get_profile(params);
+}
+
+}
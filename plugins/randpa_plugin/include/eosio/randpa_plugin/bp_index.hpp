@@ -0,0 +1,57 @@
+#pragma once
+
+#include "prefix_chain_tree.hpp"
+#include "types.hpp"
+
+#include <fc/exception/exception.hpp>
+
+#include <algorithm>
+#include <bitset>
+#include <vector>
+
+namespace randpa_finality {
+
+/// Dense indices of active BP keys.
+///
+/// Producer schedule doesn't change while a round (or a proof) is processed, so voters
+/// are tallied in a fixed-width bitset and supermajority is checked with popcount.
+class bp_index {
+public:
+    /// Upper bound of producers number (eosio::chain::config::max_producers is 125).
+    static constexpr size_t max_producers = 128;
+    static constexpr int npos = -1;
+
+    using voters_type = std::bitset<max_producers>;
+
+    bp_index() = default;
+
+    explicit bp_index(const bp_keys_type& active_bp_keys)
+        : _keys(active_bp_keys.begin(), active_bp_keys.end()) // std::set is already sorted
+    {
+        FC_ASSERT(_keys.size() <= max_producers, "too many active producers: ${n}", ("n", _keys.size()));
+    }
+
+    /// Index of `key`, or npos if it's not an active BP.
+    int find(const public_key_type& key) const {
+        const auto it = std::lower_bound(_keys.begin(), _keys.end(), key);
+        return it != _keys.end() && *it == key ? static_cast<int>(it - _keys.begin()) : npos;
+    }
+
+    const public_key_type& get_key(size_t index) const {
+        return _keys[index];
+    }
+
+    size_t size() const {
+        return _keys.size();
+    }
+
+    /// True if `voters` form supermajority (more than 2/3) of active BPs.
+    bool is_threshold_reached(const voters_type& voters) const {
+        return voters.count() > 2 * size() / 3;
+    }
+
+private:
+    std::vector<public_key_type> _keys;
+};
+
+} //namespace randpa_finality
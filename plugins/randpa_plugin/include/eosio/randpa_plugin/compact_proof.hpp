@@ -0,0 +1,152 @@
+#pragma once
+
+#include "bp_index.hpp"
+#include "network_messages.hpp"
+
+#include <fc/optional.hpp>
+
+namespace randpa_finality {
+
+namespace detail {
+
+inline std::vector<uint8_t> to_bitmap(const bp_index::voters_type& voters, size_t size) {
+    std::vector<uint8_t> bitmap((size + 7) / 8);
+    for (size_t i = 0; i < size; i++) {
+        if (voters.test(i)) {
+            bitmap[i / 8] |= 1 << (i % 8);
+        }
+    }
+    return bitmap;
+}
+
+inline bool test_bit(const std::vector<uint8_t>& bitmap, size_t i) {
+    return bitmap[i / 8] & (1 << (i % 8));
+}
+
+/// Append single-signature messages for every bit set in `bitmap`; keys are recovered
+/// with one digest for the whole payload and checked against the schedule.
+template <typename T>
+bool expand_signers(const T& data,
+                    const std::vector<uint8_t>& bitmap,
+                    const std::vector<signature_type>& signatures,
+                    const bp_index& active_bps,
+                    std::vector<network_msg<T>>& out) {
+    if (bitmap.size() != (active_bps.size() + 7) / 8) {
+        return false;
+    }
+    const auto digest = network_msg<T>(data, std::vector<signature_type>{}).hash();
+    size_t sig_num = 0;
+    for (size_t i = 0; i < active_bps.size(); i++) {
+        if (!test_bit(bitmap, i)) {
+            continue;
+        }
+        if (sig_num == signatures.size()) {
+            return false;
+        }
+        const auto& sig = signatures[sig_num++];
+        auto key = eosio::chain::signature_recovery_cache::global().recover(sig, digest);
+        if (key != active_bps.get_key(i)) {
+            return false;
+        }
+        out.emplace_back(data, std::vector<signature_type>{ sig }, std::vector<public_key_type>{ std::move(key) });
+    }
+    return sig_num == signatures.size();
+}
+
+/// Same as above, but keys are not checked against the schedule (it's done by proof validation).
+template <typename T>
+bool expand_signers(const T& data,
+                    const std::vector<uint8_t>& bitmap,
+                    const std::vector<signature_type>& signatures,
+                    std::vector<network_msg<T>>& out) {
+    size_t signers = 0;
+    for (const auto byte : bitmap) {
+        signers += __builtin_popcount(byte);
+    }
+    if (signers != signatures.size()) {
+        return false;
+    }
+    const auto digest = network_msg<T>(data, std::vector<signature_type>{}).hash();
+    for (const auto& sig : signatures) {
+        out.emplace_back(data, std::vector<signature_type>{ sig }, std::vector<public_key_type>{ eosio::chain::signature_recovery_cache::global().recover(sig, digest) });
+    }
+    return true;
+}
+
+} // namespace detail
+
+/// Make compact form of the proof, if all prevotes (and all precommits) share the same payload.
+/// Keys of the proof messages should be already known (e.g. proof is built by own round).
+inline fc::optional<compact_proof_type> make_compact_proof(const proof_type& proof, const bp_index& active_bps) {
+    if (proof.prevotes.empty() || proof.precommits.empty()) {
+        return {};
+    }
+
+    compact_proof_type compact { proof.round_num, proof.best_block,
+                                 proof.prevotes.front().data, proof.precommits.front().data };
+    std::vector<const signature_type*> prevote_sigs(active_bps.size()), precommit_sigs(active_bps.size());
+    bp_index::voters_type prevoters, precommiters;
+
+    const auto collect = [&](const auto& msg, auto& voters, auto& sigs) {
+        const auto& keys = msg.public_keys();
+        for (size_t i = 0; i < keys.size(); i++) {
+            const auto index = active_bps.find(keys[i]);
+            if (index == bp_index::npos || voters.test(index)) {
+                return false;
+            }
+            voters.set(index);
+            sigs[index] = &msg.signatures[i];
+        }
+        return true;
+    };
+
+    for (const auto& prevote : proof.prevotes) {
+        const auto& data = prevote.data;
+        if (data.round_num != compact.prevote.round_num || data.base_block != compact.prevote.base_block
+            || data.blocks != compact.prevote.blocks || !collect(prevote, prevoters, prevote_sigs)) {
+            return {};
+        }
+    }
+    for (const auto& precommit : proof.precommits) {
+        const auto& data = precommit.data;
+        if (data.round_num != compact.precommit.round_num || data.block_id != compact.precommit.block_id
+            || !collect(precommit, precommiters, precommit_sigs)) {
+            return {};
+        }
+    }
+
+    compact.prevoters = detail::to_bitmap(prevoters, active_bps.size());
+    compact.precommiters = detail::to_bitmap(precommiters, active_bps.size());
+    for (size_t i = 0; i < active_bps.size(); i++) {
+        if (prevoters.test(i)) {
+            compact.prevote_signatures.push_back(*prevote_sigs[i]);
+        }
+        if (precommiters.test(i)) {
+            compact.precommit_signatures.push_back(*precommit_sigs[i]);
+        }
+    }
+    return compact;
+}
+
+/// Restore full proof from the compact one; returns nothing if signers don't match the bitmaps.
+inline fc::optional<proof_type> expand_compact_proof(const compact_proof_type& compact, const bp_index& active_bps) {
+    proof_type proof { compact.round_num, compact.best_block };
+    if (!detail::expand_signers(compact.prevote, compact.prevoters, compact.prevote_signatures, active_bps, proof.prevotes)
+        || !detail::expand_signers(compact.precommit, compact.precommiters, compact.precommit_signatures, active_bps, proof.precommits)) {
+        return {};
+    }
+    return proof;
+}
+
+/// Restore full proof without knowing the schedule; signer keys are recovered, so the result
+/// should be checked with regular proof validation. Used to move key recovery off randpa thread.
+inline fc::optional<proof_type> expand_compact_proof(const compact_proof_type& compact) {
+    proof_type proof { compact.round_num, compact.best_block };
+    if (!detail::expand_signers(compact.prevote, compact.prevoters, compact.prevote_signatures, proof.prevotes)
+        || !detail::expand_signers(compact.precommit, compact.precommiters, compact.precommit_signatures, proof.precommits)) {
+        return {};
+    }
+    return proof;
+}
+
+} //namespace randpa_finality
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "types.hpp"
+#include "network_messages.hpp"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace randpa_finality {
+
+/// Signers of the recent votes this node received, by signature. A proof carries the votes
+/// its round collected, and most of them already reached this node one by one: their keys
+/// are taken from here instead of hashing the vote and recovering its signature again.
+/// Used from the verification pool (received proofs) and from randpa thread (votes, proofs).
+/// Entries live for `ttl_rounds` rounds after the round of the vote.
+class known_votes_cache {
+public:
+    static constexpr uint32_t default_ttl_rounds = 2;
+    static constexpr size_t default_max_size = 16 * 1024;
+
+    explicit known_votes_cache(uint32_t ttl_rounds = default_ttl_rounds, size_t max_size = default_max_size)
+        : _ttl_rounds(ttl_rounds)
+        , _max_size(max_size)
+    {}
+
+    /// Remember the signers of `msg`; they must be already recovered.
+    template <typename T>
+    void add(const network_msg<T>& msg) {
+        if (!msg.has_public_keys()) {
+            return;
+        }
+        const auto keys = msg.public_keys();
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (msg.data.round_num + _ttl_rounds < _current_round) {
+            return;
+        }
+        for (size_t i = 0; i < msg.signatures.size(); i++) {
+            add_vote(entries<T>(), msg.signatures[i], msg.data, keys[i]);
+        }
+    }
+
+    /// Set the signers of `msg` if every its signature signed the same vote before.
+    /// @return true if the keys of `msg` are known
+    template <typename T>
+    bool restore_keys(const network_msg<T>& msg) {
+        if (msg.has_public_keys()) {
+            return true;
+        }
+        std::vector<public_key_type> keys;
+        keys.reserve(msg.signatures.size());
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            const auto& votes = entries<T>();
+            for (const auto& sig : msg.signatures) {
+                const auto it = votes.find(sig);
+                if (it == votes.end() || !same_vote(it->second.data, msg.data)) {
+                    ++_misses;
+                    return false;
+                }
+                keys.push_back(it->second.key);
+            }
+        }
+        ++_hits;
+        msg.set_public_keys(std::move(keys));
+        return true;
+    }
+
+    /// Drop entries of rounds older than `round_num - ttl_rounds`.
+    void set_current_round(uint32_t round_num) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _current_round = std::max(_current_round, round_num);
+        while (!_by_round.empty() && _by_round.begin()->first + _ttl_rounds < _current_round) {
+            erase_oldest_round();
+        }
+    }
+
+    uint64_t hits() const {
+        return _hits;
+    }
+
+    uint64_t misses() const {
+        return _misses;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _prevotes.size() + _precommits.size();
+    }
+
+private:
+    template <typename T>
+    struct entry_type {
+        T data;
+        public_key_type key;
+    };
+
+    template <typename T>
+    using entries_type = std::map<signature_type, entry_type<T>>;
+
+    struct round_entries {
+        std::vector<signature_type> prevotes;
+        std::vector<signature_type> precommits;
+    };
+
+    static bool same_vote(const prevote_type& a, const prevote_type& b) {
+        return a.round_num == b.round_num && a.base_block == b.base_block && a.blocks == b.blocks;
+    }
+
+    static bool same_vote(const precommit_type& a, const precommit_type& b) {
+        return a.round_num == b.round_num && a.block_id == b.block_id;
+    }
+
+    template <typename T>
+    entries_type<T>& entries() {
+        if constexpr (std::is_same_v<T, prevote_type>) {
+            return _prevotes;
+        } else {
+            static_assert(std::is_same_v<T, precommit_type>, "only votes are cached");
+            return _precommits;
+        }
+    }
+
+    template <typename T>
+    void add_vote(entries_type<T>& votes, const signature_type& sig, const T& data, const public_key_type& key) {
+        while (_prevotes.size() + _precommits.size() >= _max_size && !_by_round.empty()) {
+            erase_oldest_round();
+        }
+        if (!votes.emplace(sig, entry_type<T>{data, key}).second) {
+            return;
+        }
+        auto& round = _by_round[data.round_num];
+        if constexpr (std::is_same_v<T, prevote_type>) {
+            round.prevotes.push_back(sig);
+        } else {
+            round.precommits.push_back(sig);
+        }
+    }
+
+    void erase_oldest_round() {
+        const auto& round = _by_round.begin()->second;
+        for (const auto& sig : round.prevotes) {
+            _prevotes.erase(sig);
+        }
+        for (const auto& sig : round.precommits) {
+            _precommits.erase(sig);
+        }
+        _by_round.erase(_by_round.begin());
+    }
+
+    const uint32_t _ttl_rounds;
+    const size_t _max_size;
+    mutable std::mutex _mutex;
+    uint32_t _current_round = 0;
+    entries_type<prevote_type> _prevotes;
+    entries_type<precommit_type> _precommits;
+    std::map<uint32_t, round_entries> _by_round;
+    std::atomic<uint64_t> _hits { 0 };
+    std::atomic<uint64_t> _misses { 0 };
+};
+
+} //namespace randpa_finality
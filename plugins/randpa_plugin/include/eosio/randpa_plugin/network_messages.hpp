@@ -2,6 +2,8 @@
 
 #include "types.hpp"
 
+#include <eosio/chain/signature_recovery_cache.hpp>
+
 #include <fc/reflect/reflect.hpp>
 
 #include <typeinfo>
@@ -26,11 +28,19 @@ public:
     network_msg() = default;
     network_msg(const T& data_, const std::vector<signature_type>& signatures_): data(data_), signatures(signatures_) {}
     network_msg(const T& data_, std::vector<signature_type>&& signatures_): data(data_), signatures(signatures_) {}
+    /// Construct a message whose signers are already known (e.g. a part of already verified message).
+    network_msg(const T& data_, std::vector<signature_type>&& signatures_, std::vector<public_key_type>&& pub_keys)
+        : data(data_)
+        , signatures(std::move(signatures_))
+        , pub_keys_cache(std::move(pub_keys))
+    {}
     network_msg(const T& data_, const std::vector<signature_provider_type>& signature_providers)
         : data{data_}
     {
+        const auto digest = hash();
+        signatures.reserve(signature_providers.size());
         for (const auto& sig_prov : signature_providers) {
-            signatures.push_back(sig_prov(hash()));
+            signatures.push_back(sig_prov(digest));
         }
     }
 
@@ -43,15 +53,26 @@ public:
 
     std::vector<public_key_type> public_keys() const {
         if (pub_keys_cache.empty()) {
+            const auto digest = hash();
             pub_keys_cache.reserve(signatures.size());
 
             for (const auto& sign : signatures) {
-                pub_keys_cache.push_back(public_key_type(sign, hash()));
+                pub_keys_cache.push_back(eosio::chain::signature_recovery_cache::global().recover(sign, digest));
             }
         }
         return pub_keys_cache;
     }
 
+    /// True if signer keys were already recovered, so public_keys() is cheap.
+    bool has_public_keys() const {
+        return !pub_keys_cache.empty() || signatures.empty();
+    }
+
+    /// Set signer keys known from elsewhere (e.g. the same vote received alone), in the order of `signatures`.
+    void set_public_keys(std::vector<public_key_type>&& pub_keys) const {
+        pub_keys_cache = std::move(pub_keys);
+    }
+
     bool validate(const std::vector<public_key_type>& pub_keys) const {
         return pub_keys == public_keys();
     }
@@ -87,6 +108,39 @@ struct finality_req_proof_type {
     uint32_t round_num;
 };
 
+/// Request for all cached proofs finalizing blocks higher than `from_block_num`;
+/// sent by a freshly started node to catch up without waiting for new rounds.
+struct finality_req_proofs_type {
+    uint32_t from_block_num;
+};
+
+/// Optional protocol features, announced in handshake_ext after the regular handshake.
+/// Peers that don't know handshake_ext just ignore it and keep using the basic protocol.
+enum randpa_features : uint32_t {
+    compact_proofs = 1 << 0,
+    proof_ranges = 1 << 1,
+};
+
+struct handshake_ext_type {
+    block_id_type lib;
+    uint32_t features;
+};
+
+/// Proof where all prevotes share one payload and all precommits share another one.
+///
+/// Signers are stored as bitmaps against the active BP schedule of the best block
+/// (in bp_index order), signatures are listed in the same order as the bits set.
+struct compact_proof_type {
+    uint32_t round_num;
+    block_id_type best_block;
+    prevote_type prevote;
+    precommit_type precommit;
+    std::vector<uint8_t> prevoters;
+    std::vector<uint8_t> precommiters;
+    std::vector<signature_type> prevote_signatures;
+    std::vector<signature_type> precommit_signatures;
+};
+
 using handshake_msg = network_msg<handshake_type>;
 using handshake_ans_msg = network_msg<handshake_ans_type>;
 
@@ -101,16 +155,72 @@ struct proof_type {
 };
 
 using proof_msg = network_msg<proof_type>;
+
+/// Request for stored proofs of a light sync: the lowest proof finalizing a block from
+/// `from_block_num + stride`, then from each next `stride` blocks, no more than `limit` of them.
+struct finality_req_proof_range_type {
+    uint32_t from_block_num;
+    uint32_t stride;
+    uint32_t limit;
+};
+
+/// Reply to finality_req_proof_range, oldest proof first.
+struct proof_range_type {
+    std::vector<proof_type> proofs;
+};
+
+using proof_range_msg = network_msg<proof_range_type>;
+
+/// Call `f` for each signed message stored in `msg` (`msg` itself included).
+/// Signers of the visited messages can be recovered independently of each other.
+template <typename T, typename F>
+void for_each_signed_msg(const network_msg<T>& msg, F&& f) {
+    f(msg);
+}
+
+template <typename F>
+void for_each_signed_msg(const proof_msg& msg, F&& f) {
+    f(msg);
+    for (const auto& prevote : msg.data.prevotes) {
+        f(prevote);
+    }
+    for (const auto& precommit : msg.data.precommits) {
+        f(precommit);
+    }
+}
+
+template <typename F>
+void for_each_signed_msg(const proof_range_msg& msg, F&& f) {
+    f(msg);
+    for (const auto& proof : msg.data.proofs) {
+        for (const auto& prevote : proof.prevotes) {
+            f(prevote);
+        }
+        for (const auto& precommit : proof.precommits) {
+            f(precommit);
+        }
+    }
+}
 using finality_notice_msg = network_msg<finality_notice_type>;
 using finality_req_proof_msg = network_msg<finality_req_proof_type>;
+using handshake_ext_msg = network_msg<handshake_ext_type>;
+using compact_proof_msg = network_msg<compact_proof_type>;
+using finality_req_proofs_msg = network_msg<finality_req_proofs_type>;
+using finality_req_proof_range_msg = network_msg<finality_req_proof_range_type>;
 
+// new types must be appended: type tags are a part of the wire protocol
 using randpa_net_msg_data = ::fc::static_variant<handshake_msg,
                                                  handshake_ans_msg,
                                                  prevote_msg,
                                                  precommit_msg,
                                                  proof_msg,
                                                  finality_notice_msg,
-                                                 finality_req_proof_msg>;
+                                                 finality_req_proof_msg,
+                                                 handshake_ext_msg,
+                                                 compact_proof_msg,
+                                                 finality_req_proofs_msg,
+                                                 finality_req_proof_range_msg,
+                                                 proof_range_msg>;
 
 } //namespace randpa_finality
 
@@ -123,5 +233,11 @@ FC_REFLECT(randpa_finality::precommit_type, (round_num)(block_id))
 FC_REFLECT(randpa_finality::proof_type, (round_num)(best_block)(prevotes)(precommits))
 FC_REFLECT(randpa_finality::finality_notice_type, (round_num)(best_block))
 FC_REFLECT(randpa_finality::finality_req_proof_type, (round_num))
+FC_REFLECT(randpa_finality::finality_req_proofs_type, (from_block_num))
+FC_REFLECT(randpa_finality::handshake_ext_type, (lib)(features))
+FC_REFLECT(randpa_finality::finality_req_proof_range_type, (from_block_num)(stride)(limit))
+FC_REFLECT(randpa_finality::proof_range_type, (proofs))
+FC_REFLECT(randpa_finality::compact_proof_type, (round_num)(best_block)(prevote)(precommit)
+                                                (prevoters)(precommiters)(prevote_signatures)(precommit_signatures))
 
 FC_REFLECT_TEMPLATE((typename T), randpa_finality::network_msg<T>, (data)(signatures))
@@ -2,13 +2,28 @@
 
 #include "types.hpp"
 
+#include <boost/pool/pool.hpp>
+#include <boost/pool/pool_alloc.hpp>
+
 #include <map>
 #include <memory>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 namespace randpa_finality {
 
+using bp_keys_type = std::set<public_key_type>;
+/// Active BP set changes only with producer schedule, so consecutive nodes share the same instance.
+using bp_keys_ptr = std::shared_ptr<const bp_keys_type>;
+
+/// Block ids are sha256 with block number in the first word; the last word is already random.
+struct block_id_hash {
+    size_t operator()(const block_id_type& id) const {
+        return id._hash[3];
+    }
+};
+
 template <typename ConfType>
 class prefix_node {
 public:
@@ -23,10 +38,15 @@ public:
     std::vector<node_ptr> adjacent_nodes;
     std::weak_ptr<node_type> parent;
     public_key_type creator_key;
-    std::set<public_key_type> active_bp_keys;
+    bp_keys_ptr active_bp_keys;
 
     //
 
+    const bp_keys_type& get_active_bp_keys() const {
+        static const bp_keys_type empty_keys;
+        return active_bp_keys ? *active_bp_keys : empty_keys;
+    }
+
     size_t confirmation_number() const {
         return confirmation_data.size();
     }
@@ -67,25 +87,30 @@ class prefix_chain_tree {
         size_t height;
     };
 
+    using control_block_allocator = boost::fast_pool_allocator<char>;
+
     std::map<public_key_type, node_weak_ptr> last_inserted_block;
-    std::map<block_id_type, node_weak_ptr> block_index;
+    std::unordered_map<block_id_type, node_weak_ptr, block_id_hash> block_index;
+    /// storage for nodes; control blocks of node pointers come from `control_block_allocator`
+    boost::pool<> node_pool { sizeof(NodeType) };
+    bp_keys_ptr last_bp_keys;
     // lifetime(node) < lifetime(block_index) => destroy the node first
     node_ptr root;
     node_weak_ptr head_block;
 
 public:
     explicit prefix_chain_tree(node_unique_ptr&& root_) {
-        // some dummy code for root to actually be erased from block_index
-        NodeType *raw_ptr = new NodeType(*root_);
-        root = std::shared_ptr<NodeType>(raw_ptr, [this](NodeType *ptr) {
-            this->block_index.erase(ptr->block_id);
-            delete ptr;
-        });
-        block_index[root->block_id] = node_weak_ptr(root);
+        // root is copied into the pool, so it is erased from block_index as any other node
+        root = make_node(std::move(*root_));
     }
     prefix_chain_tree() = delete;
     prefix_chain_tree(const prefix_chain_tree&) = delete;
 
+    ~prefix_chain_tree() {
+        release(root);
+        root.reset();
+    }
+
     node_ptr find(const block_id_type& block_id) const {
         auto itr = block_index.find(block_id);
         return itr != block_index.end() ? itr->second.lock() : nullptr;
@@ -116,7 +141,7 @@ public:
 
     void insert(const chain_type& chain,
                 const public_key_type& creator_key,
-                const std::set<public_key_type>& active_bp_keys) {
+                const bp_keys_type& active_bp_keys) {
         node_ptr node = nullptr;
         block_ids_type blocks;
         std::tie(node, blocks) = get_tree_node(chain);
@@ -125,7 +150,7 @@ public:
             throw NodeNotFoundError();
         }
 
-        insert_blocks(node, blocks, creator_key, active_bp_keys);
+        insert_blocks(node, blocks, creator_key, share_bp_keys(active_bp_keys));
     }
 
     node_ptr get_final_chain_head(size_t confirmation_number) const {
@@ -137,11 +162,28 @@ public:
         return root;
     }
 
+    /// Set new root; nodes that are not descendants of `new_root` are freed at once.
     void set_root(const node_ptr& new_root) {
-        root = new_root;
+        if (new_root == root) {
+            return;
+        }
+        if (!find(new_root->block_id)) {
+            // node constructed outside of the tree (e.g. unknown irreversible block)
+            auto node = make_node(NodeType(*new_root));
+            release(root, node);
+            root = node;
+        } else {
+            auto old_root = root;
+            root = new_root;
+            release(old_root, root);
+        }
         root->parent.reset();
     }
 
+    size_t size() const {
+        return block_index.size();
+    }
+
     node_ptr get_head() const {
         if (!head_block.lock()) {
             return root;
@@ -205,26 +247,58 @@ private:
         return result;
     }
 
+    node_ptr make_node(NodeType&& value) {
+        void* mem = node_pool.malloc();
+        if (!mem) {
+            throw std::bad_alloc();
+        }
+        NodeType* raw_ptr = new (mem) NodeType(std::move(value));
+        auto node = node_ptr(raw_ptr, [this](NodeType* ptr) {
+            this->block_index.erase(ptr->block_id);
+            ptr->~NodeType();
+            this->node_pool.free(ptr);
+        }, control_block_allocator());
+        block_index[node->block_id] = node_weak_ptr(node);
+        return node;
+    }
+
+    bp_keys_ptr share_bp_keys(const bp_keys_type& active_bp_keys) {
+        if (!last_bp_keys || *last_bp_keys != active_bp_keys) {
+            last_bp_keys = std::make_shared<const bp_keys_type>(active_bp_keys);
+        }
+        return last_bp_keys;
+    }
+
+    /// Detach the whole subtree of `node` except `keep` subtree and drop it iteratively,
+    /// so long unfinalized chains don't blow the stack with recursive destructors.
+    static void release(const node_ptr& node, const node_ptr& keep = nullptr) {
+        if (!node) {
+            return;
+        }
+        std::vector<node_ptr> pruned { node };
+        for (size_t i = 0; i < pruned.size(); i++) {
+            for (auto& adjacent_node : pruned[i]->adjacent_nodes) {
+                if (adjacent_node != keep) {
+                    pruned.push_back(std::move(adjacent_node));
+                }
+            }
+            pruned[i]->adjacent_nodes.clear();
+        }
+    }
+
     void insert_blocks(node_ptr node,
                        const block_ids_type& blocks,
                        const public_key_type& creator_key,
-                       const std::set<public_key_type>& active_bp_keys) {
+                       const bp_keys_ptr& active_bp_keys) {
         for (const auto& block_id : blocks) {
             auto next_node = node->get_matching_node(block_id);
             if (!next_node) {
-                next_node = std::shared_ptr<NodeType>(
-                    new NodeType{block_id,
-                                 {},
-                                 {},
-                                 node,
-                                 creator_key,
-                                 active_bp_keys},
-                    [this](NodeType *node) {
-                        this->block_index.erase(node->block_id);
-                        delete node;
-                    }
-                );
-                block_index[block_id] = std::weak_ptr<NodeType>(next_node);
+                next_node = make_node(NodeType{block_id,
+                                               {},
+                                               {},
+                                               node,
+                                               creator_key,
+                                               active_bp_keys});
                 node->adjacent_nodes.push_back(next_node);
             }
             node = next_node;
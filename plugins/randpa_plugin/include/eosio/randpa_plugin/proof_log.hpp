@@ -0,0 +1,75 @@
+#pragma once
+
+#include "network_messages.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace randpa_finality {
+
+/*
+ *   proofs.log:
+ *   +---------+---------+-----+---------+
+ *   | Entry i | Entry j | ... | Entry z |
+ *   +---------+---------+-----+---------+
+ *
+ *   proofs.index:
+ *   +---------------+---------------+-----+---------------+
+ *   | Index entry i | Index entry j | ... | Index entry z |
+ *   +---------------+---------------+-----+---------------+
+ *
+ * each entry:
+ *    uint32_t payload size
+ *    packed proof_type
+ *
+ * Entries are appended in increasing order of best block number (round number grows together with it),
+ * so a finalized block is proved by the first entry with best block number not less than its own.
+ * Index is kept in memory, log is read through a memory mapping.
+ */
+class proof_log {
+public:
+    struct index_entry {
+        uint32_t block_num;
+        uint32_t round_num;
+        uint64_t pos;
+    };
+
+    explicit proof_log(const boost::filesystem::path& dir);
+    proof_log(const proof_log&) = delete;
+
+    /// Append proof; proofs for blocks not higher than the last stored one are ignored.
+    bool append(const proof_type& proof);
+
+    /// Get proof that finalizes `block_num` (i.e. the lowest proof for this or a later block).
+    fc::optional<proof_type> get_by_block(uint32_t block_num) const;
+    fc::optional<proof_type> get_by_round(uint32_t round_num) const;
+    /// Get proofs finalizing blocks in [lower_bound, upper_bound], but no more than `limit`.
+    std::vector<proof_type> get_range(uint32_t lower_bound, uint32_t upper_bound, size_t limit) const;
+
+    uint32_t first_block_num() const;
+    uint32_t last_block_num() const;
+    size_t size() const;
+
+private:
+    void open();
+    void recover_index(uint64_t log_size);
+    proof_type read_entry(const index_entry& entry) const;
+
+    boost::filesystem::path _log_path;
+    boost::filesystem::path _index_path;
+    std::fstream _log;
+    std::fstream _index_file;
+    std::vector<index_entry> _index;
+    uint64_t _log_size = 0;
+
+    mutable boost::interprocess::file_mapping _mapping;
+    mutable boost::interprocess::mapped_region _region;
+    mutable std::mutex _mutex;
+};
+
+} //namespace randpa_finality
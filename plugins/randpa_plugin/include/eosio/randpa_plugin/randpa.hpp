@@ -1,7 +1,11 @@
 #pragma once
 
+#include "compact_proof.hpp"
+#include "known_votes.hpp"
 #include "network_messages.hpp"
 #include "round.hpp"
+#include "round_timeline.hpp"
+#include "seen_messages.hpp"
 #include "randpa_logger.hpp"
 
 #include <fc/exception/exception.hpp>
@@ -11,11 +15,12 @@
 #include <boost/circular_buffer.hpp>
 #include <boost/compute/detail/lru_cache.hpp>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <mutex>
-#include <queue>
 #include <thread>
 
 namespace randpa_finality {
@@ -26,82 +31,246 @@ using mutex_guard = std::lock_guard<std::mutex>;
 
 //---------- types ----------//
 
+/// Bounded lock-free multi-producer/single-consumer queue.
+///
+/// Producers claim cells with a CAS on the enqueue position (D. Vyukov's bounded queue);
+/// the only consumer is randpa thread, which drains all pending messages in one wakeup.
+/// Mutex is touched only to wake up the consumer when it sleeps on an empty queue, or the
+/// producers waiting for space in a full one.
 template <typename message_type>
 class message_queue {
 public:
     using message_ptr = std::shared_ptr<message_type>;
+    using clock_type = std::chrono::steady_clock;
+
+    struct queued_message {
+        message_ptr msg;
+        clock_type::time_point enqueue_time;
+    };
+
+    static constexpr size_t default_capacity = 1 << 14;
 
 public:
-    /// Add message to the queue.
+    explicit message_queue(size_t capacity = default_capacity)
+        : _capacity{round_up_pow2(capacity)}
+        , _mask{_capacity - 1}
+        , _cells{new cell[_capacity]}
+    {
+        for (size_t i = 0; i < _capacity; i++) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    message_queue(const message_queue&) = delete;
+
+    /// Add message to the queue; waits while the queue is full.
     template <typename T>
     void push_message(const T& msg) {
-        mutex_guard lock(_message_queue_mutex);
+        auto item = queued_message { std::make_shared<message_type>(msg), clock_type::now() };
+        while (!try_push(item)) {
+            if (_done) {
+                return;
+            }
+            wait_for_space();
+        }
+        notify_consumer();
+    }
 
-        auto randpa_msg = std::make_shared<message_type>(msg);
-        _message_queue.push(randpa_msg);
+    /// Add message to the queue unless it is full; a dropped message is counted, see dropped().
+    template <typename T>
+    bool try_push_message(const T& msg) {
+        auto item = queued_message { std::make_shared<message_type>(msg), clock_type::now() };
+        if (!try_push(item)) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        notify_consumer();
+        return true;
+    }
+
+    /// Messages dropped by try_push_message() so far.
+    uint64_t dropped() const {
+        return _dropped.load(std::memory_order_relaxed);
+    }
 
-        if (_need_notify) {
+private:
+    void notify_consumer() {
+        // pairs with the fence in wait_for_messages(): either consumer sees the message
+        // or we see it sleeping
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_need_notify.load(std::memory_order_relaxed)) {
+            mutex_guard lock(_wait_mutex);
             _new_msg_cond.notify_one();
         }
     }
 
-    /// Extract next message, or return nullptr (if empty).
-    message_ptr get_next_msg() {
-        mutex_guard lock(_message_queue_mutex);
-
-        if (_message_queue.empty()) {
-            _need_notify = true;
-            return nullptr;
-        } else {
-            _need_notify = false;
+    void wait_for_space() {
+        _waiting_producers.fetch_add(1, std::memory_order_relaxed);
+        // pairs with the fence in try_pop(): either we see the free cell or the consumer sees us waiting
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> lk(_wait_mutex);
+            _space_cond.wait(lk, [this]() { return _done || size() < _capacity; });
         }
+        _waiting_producers.fetch_sub(1, std::memory_order_relaxed);
+    }
 
-        const auto msg = _message_queue.front();
-        _message_queue.pop();
-        return msg;
+public:
+    /// Extract next message, or return nullptr (if empty).
+    message_ptr get_next_msg() {
+        queued_message item;
+        return try_pop(item) ? std::move(item.msg) : nullptr;
     }
 
     /// Extract next message (if there is no one, wait until it appears in the queue).
     message_ptr get_next_msg_wait() {
-        while (true) {
-            if (_need_notify) {
-                std::unique_lock<std::mutex> lk(_message_queue_mutex);
-
-                _new_msg_cond.wait(lk, [this](){
-                    return !_message_queue.empty() || _done;
-                });
-            }
-
-            if (_done) {
-                return nullptr;
-            }
-
+        while (!_done) {
             auto msg = get_next_msg();
             if (msg) {
                 return msg;
             }
+            wait_for_messages(clock_type::time_point::max());
         }
+        return nullptr;
+    }
+
+    /// Move all pending messages (but no more than `max_count`) to `out`,
+    /// waiting until at least one appears. Returns number of extracted messages.
+    size_t get_next_msgs_wait(std::vector<queued_message>& out, size_t max_count = default_capacity) {
+        return get_next_msgs_wait_until(out, clock_type::time_point::max(), max_count);
+    }
+
+    /// Same as get_next_msgs_wait(), but gives up at `deadline`; returns 0 then.
+    size_t get_next_msgs_wait_until(std::vector<queued_message>& out, clock_type::time_point deadline,
+                                    size_t max_count = default_capacity) {
+        size_t count = 0;
+        while (!_done) {
+            queued_message item;
+            while (count < max_count && try_pop(item)) {
+                out.push_back(std::move(item));
+                count++;
+            }
+            if (count || !wait_for_messages(deadline)) {
+                break;
+            }
+        }
+        return count;
     }
 
     /// Finish working with queue.
     void terminate() {
         _done = true;
+        mutex_guard lock(_wait_mutex);
         _new_msg_cond.notify_one();
+        _space_cond.notify_all();
     }
 
-    /// Get queue size.
+    /// Get queue size (approximate, lock-free).
     size_t size() const {
-        mutex_guard lock(_message_queue_mutex);
-        return _message_queue.size();
+        const auto dequeue_pos = _dequeue_pos.load(std::memory_order_acquire);
+        const auto enqueue_pos = _enqueue_pos.load(std::memory_order_acquire);
+        return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+    }
+
+    size_t capacity() const {
+        return _capacity;
     }
 
 private:
-    std::atomic<bool> _need_notify { true };
-    std::queue<message_ptr> _message_queue;
+    struct cell {
+        std::atomic<size_t> sequence;
+        queued_message item;
+    };
+
+    static size_t round_up_pow2(size_t value) {
+        size_t result = 2;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    bool try_push(queued_message& item) {
+        cell* c = nullptr;
+        auto pos = _enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            c = &_cells[pos & _mask];
+            const auto seq = c->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        c->item = std::move(item);
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Must be called only from the consumer thread.
+    bool try_pop(queued_message& item) {
+        const auto pos = _dequeue_pos.load(std::memory_order_relaxed);
+        auto& c = _cells[pos & _mask];
+        if (c.sequence.load(std::memory_order_acquire) != pos + 1) {
+            return false;
+        }
+        item = std::move(c.item);
+        c.item.msg.reset();
+        c.sequence.store(pos + _capacity, std::memory_order_release);
+        _dequeue_pos.store(pos + 1, std::memory_order_release);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_waiting_producers.load(std::memory_order_relaxed)) {
+            mutex_guard lock(_wait_mutex);
+            _space_cond.notify_all();
+        }
+        return true;
+    }
+
+    bool has_pending() const {
+        const auto pos = _dequeue_pos.load(std::memory_order_relaxed);
+        return _cells[pos & _mask].sequence.load(std::memory_order_acquire) == pos + 1;
+    }
+
+    /// Returns false if `deadline` passed without messages.
+    bool wait_for_messages(clock_type::time_point deadline) {
+        _need_notify.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        std::unique_lock<std::mutex> lk(_wait_mutex);
+        const auto ready = [this]() {
+            return has_pending() || _done;
+        };
+        bool woken = true;
+        if (deadline == clock_type::time_point::max()) {
+            _new_msg_cond.wait(lk, ready);
+        } else {
+            woken = _new_msg_cond.wait_until(lk, deadline, ready);
+        }
+        _need_notify.store(false, std::memory_order_relaxed);
+        return woken;
+    }
+
+private:
+    const size_t _capacity;
+    const size_t _mask;
+    std::unique_ptr<cell[]> _cells;
+
+    alignas(64) std::atomic<size_t> _enqueue_pos { 0 };
+    alignas(64) std::atomic<size_t> _dequeue_pos { 0 };
+    alignas(64) std::atomic<bool> _need_notify { false };
     std::atomic<bool> _done { false };
+    std::atomic<size_t> _waiting_producers { 0 };
+    std::atomic<uint64_t> _dropped { 0 };
 
-    mutable std::mutex _message_queue_mutex;
+    std::mutex _wait_mutex;
     std::condition_variable _new_msg_cond;
+    std::condition_variable _space_cond;    ///< producers waiting in push_message() on a full queue
 };
 
 
@@ -130,6 +299,10 @@ struct randpa_net_msg {
     uint32_t ses_id;
     randpa_net_msg_data data;
     fc::time_point_sec receive_time;
+    /// Of an outgoing broadcast: sent to each of these sessions instead of `ses_id`.
+    std::vector<uint32_t> bcast_ses_ids;
+    /// Of an outgoing broadcast: `data` packed once for all the sessions.
+    std::shared_ptr<const std::vector<char>> packed;
 };
 
 struct on_accepted_block_event {
@@ -148,7 +321,12 @@ struct on_new_peer_event {
     uint32_t ses_id;
 };
 
-using randpa_event_data = static_variant<on_accepted_block_event, on_irreversible_event, on_new_peer_event>;
+struct on_peer_closed_event {
+    uint32_t ses_id;
+};
+
+using randpa_event_data = static_variant<on_accepted_block_event, on_irreversible_event, on_new_peer_event,
+                                         on_peer_closed_event>;
 
 /// External events.
 struct randpa_event {
@@ -159,6 +337,149 @@ struct randpa_event {
 using randpa_message = static_variant<randpa_net_msg, randpa_event>;
 using randpa_message_ptr = std::shared_ptr<randpa_message>;
 
+
+/// Enqueue-to-dequeue latency of randpa messages, aggregated per message type.
+/// Written by randpa thread, read (and reset) by telemetry without locking.
+class queue_latency_stats {
+public:
+    static constexpr size_t net_types_count = randpa_net_msg_data::tag<proof_range_msg>::value + 1;
+    static constexpr size_t event_types_count = randpa_event_data::tag<on_new_peer_event>::value + 1;
+    static constexpr size_t types_count = net_types_count + event_types_count;
+
+    struct summary {
+        uint64_t count;
+        uint64_t avg_us;
+        uint64_t max_us;
+    };
+
+    void add(size_t type, std::chrono::microseconds latency) {
+        const uint64_t us = latency.count() > 0 ? latency.count() : 0;
+        auto& stat = _stats[type];
+        stat.count.fetch_add(1, std::memory_order_relaxed);
+        stat.total_us.fetch_add(us, std::memory_order_relaxed);
+        if (us > stat.max_us.load(std::memory_order_relaxed)) {
+            stat.max_us.store(us, std::memory_order_relaxed);
+        }
+    }
+
+    /// Get summary collected since the previous call.
+    summary take(size_t type) {
+        auto& stat = _stats[type];
+        const auto count = stat.count.exchange(0, std::memory_order_relaxed);
+        const auto total = stat.total_us.exchange(0, std::memory_order_relaxed);
+        const auto max = stat.max_us.exchange(0, std::memory_order_relaxed);
+        return { count, count ? total / count : 0, max };
+    }
+
+    static size_t get_type(const randpa_message& msg) {
+        if (msg.which() == randpa_message::tag<randpa_net_msg>::value) {
+            return msg.get<randpa_net_msg>().data.which();
+        }
+        return net_types_count + msg.get<randpa_event>().data.which();
+    }
+
+    static const char* type_name(size_t type) {
+        static const char* names[] = {
+            "handshake", "handshake_ans", "prevote", "precommit", "proof", "finality_notice", "finality_req_proof",
+            "handshake_ext", "compact_proof", "finality_req_proofs", "finality_req_proof_range", "proof_range",
+            "accepted_block", "irreversible", "new_peer",
+        };
+        static_assert(sizeof(names) / sizeof(names[0]) == types_count, "message type names are out of date");
+        return names[type];
+    }
+
+private:
+    struct stat_type {
+        std::atomic<uint64_t> count { 0 };
+        std::atomic<uint64_t> total_us { 0 };
+        std::atomic<uint64_t> max_us { 0 };
+    };
+
+    std::array<stat_type, types_count> _stats;
+};
+
+/// Times from the start of the recent rounds to their prevote threshold and to their proof.
+/// The adaptive prevote timeout is derived from the prevote distribution. Samples are written by randpa thread,
+/// the summary is published through atomics for telemetry.
+class round_timing_stats {
+public:
+    static constexpr size_t window = 64;
+    static constexpr size_t min_samples = 8; ///< the timeout stays at its minimum until then
+
+    struct summary {
+        uint64_t prevote_p50_us;
+        uint64_t prevote_p90_us;
+        uint64_t finality_p50_us;
+        uint64_t finality_p90_us;
+        uint64_t prevote_timeout_us;
+        uint64_t stretched_rounds; ///< rounds whose prevote went on past its block deadline
+    };
+
+    void add_prevote(fc::microseconds t) {
+        add(_prevote, t);
+        _prevote_p50_us.store(quantile(_prevote, 0.5).count(), std::memory_order_relaxed);
+        _prevote_p90_us.store(quantile(_prevote, 0.9).count(), std::memory_order_relaxed);
+    }
+
+    void add_finality(fc::microseconds t) {
+        add(_finality, t);
+        _finality_p50_us.store(quantile(_finality, 0.5).count(), std::memory_order_relaxed);
+        _finality_p90_us.store(quantile(_finality, 0.9).count(), std::memory_order_relaxed);
+    }
+
+    void add_stretched_round() {
+        _stretched_rounds.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// How long after its start prevote of a round may last: 1.5 times the 90th percentile of the recent prevotes,
+    /// within [`min`, `max`].
+    fc::microseconds prevote_timeout(fc::microseconds min, fc::microseconds max) {
+        auto timeout = min;
+        if (_prevote.size() >= min_samples) {
+            timeout = std::max(min, std::min(max, fc::microseconds(quantile(_prevote, 0.9).count() * 3 / 2)));
+        }
+        _prevote_timeout_us.store(timeout.count(), std::memory_order_relaxed);
+        return timeout;
+    }
+
+    summary get_summary() const {
+        return summary {
+            _prevote_p50_us.load(std::memory_order_relaxed),
+            _prevote_p90_us.load(std::memory_order_relaxed),
+            _finality_p50_us.load(std::memory_order_relaxed),
+            _finality_p90_us.load(std::memory_order_relaxed),
+            _prevote_timeout_us.load(std::memory_order_relaxed),
+            _stretched_rounds.load(std::memory_order_relaxed),
+        };
+    }
+
+private:
+    using samples_type = boost::circular_buffer<int64_t>;
+
+    static void add(samples_type& samples, fc::microseconds t) {
+        samples.push_back(std::max<int64_t>(t.count(), 0));
+    }
+
+    static fc::microseconds quantile(const samples_type& samples, double q) {
+        if (samples.empty()) {
+            return fc::microseconds(0);
+        }
+        std::vector<int64_t> sorted(samples.begin(), samples.end());
+        const auto nth = sorted.begin() + static_cast<size_t>(q * (sorted.size() - 1));
+        std::nth_element(sorted.begin(), nth, sorted.end());
+        return fc::microseconds(*nth);
+    }
+
+    samples_type _prevote { window };
+    samples_type _finality { window };
+    std::atomic<uint64_t> _prevote_p50_us { 0 };
+    std::atomic<uint64_t> _prevote_p90_us { 0 };
+    std::atomic<uint64_t> _finality_p50_us { 0 };
+    std::atomic<uint64_t> _finality_p90_us { 0 };
+    std::atomic<uint64_t> _prevote_timeout_us { 0 };
+    std::atomic<uint64_t> _stretched_rounds { 0 };
+};
+
 using net_channel = channel<const randpa_net_msg&>;
 using net_channel_ptr = std::shared_ptr<net_channel>;
 
@@ -167,6 +488,24 @@ using event_channel_ptr = std::shared_ptr<event_channel>;
 
 using finality_channel = channel<const block_id_type&>;
 using finality_channel_ptr = std::shared_ptr<finality_channel>;
+
+using proof_channel = channel<const proof_type&>;
+using proof_channel_ptr = std::shared_ptr<proof_channel>;
+
+using round_timeline_channel = channel<const round_timeline&>;
+using round_timeline_channel_ptr = std::shared_ptr<round_timeline_channel>;
+/// Randpa state saved on shutdown to resume finality right after restart.
+struct randpa_checkpoint {
+    block_id_type lib;
+    uint32_t round_num = 0;               ///< last round this node took part in
+    uint32_t last_prooved_block_num = 0;
+    std::vector<proof_type> last_proofs;  ///< most recent first
+};
+
+/// Source of proofs that are not in memory anymore (e.g. persistent proof log).
+using proof_provider_type = std::function<fc::optional<proof_type>(uint32_t round_num)>;
+/// Stored proofs of a light sync, see finality_req_proof_range_type.
+using proof_range_provider_type = std::function<std::vector<proof_type>(uint32_t from_block_num, uint32_t stride, uint32_t limit)>;
 using lru_cache_type = boost::compute::detail::lru_cache<digest_type, boost::blank>;
 
 
@@ -175,11 +514,16 @@ public:
     static constexpr uint32_t round_width = 2;
     static constexpr uint32_t prevote_width = 1;
     static constexpr uint32_t msg_expiration_ms = 1000;
+    static constexpr uint32_t default_prevote_timeout_max_ms = 250;
+    static constexpr uint32_t supported_features = randpa_features::compact_proofs | randpa_features::proof_ranges;
+    static constexpr uint32_t light_sync_stride = 16;          ///< blocks between the proofs requested by a light sync
+    static constexpr uint32_t light_sync_max_proofs = 64;      ///< per proof range
+    static constexpr uint32_t light_sync_ahead = 512;          ///< blocks proven ahead of the head by a light sync
+    static constexpr uint32_t light_sync_request_ms = 1000;    ///< between requests to peers
 
 public:
     randpa()
-            : _peer_messages{_messages_cache_size}
-            , _self_messages{_messages_cache_size}
+            : _self_messages{_messages_cache_size}
             , _last_proofs{_proofs_cache_size} {
         // 2 cases:
         //   full node:
@@ -221,6 +565,54 @@ public:
         return *this;
     }
 
+    /// Optional channel receiving every gained proof.
+    randpa& set_proof_channel(const proof_channel_ptr& ptr) {
+        _proof_channel = ptr;
+        return *this;
+    }
+
+    /// Optional channel receiving the timeline of every round this node took part in, once the round is dropped.
+    randpa& set_round_timeline_channel(const round_timeline_channel_ptr& ptr) {
+        _round_timeline_channel = ptr;
+        return *this;
+    }
+
+    randpa& set_proof_provider(const proof_provider_type& provider) {
+        _proof_provider = provider;
+        return *this;
+    }
+
+    randpa& set_proof_range_provider(const proof_range_provider_type& provider) {
+        _proof_range_provider = provider;
+        return *this;
+    }
+
+    /// While syncing, ask peers for the stored proofs of the blocks ahead of the head and send the blocks they
+    /// finalize to `proven_channel`. The proofs are checked against the BP schedule active at the head: the first
+    /// proof signed by another schedule (after a schedule change) ends a range, the next ranges are requested
+    /// once the blocks changing the schedule are applied.
+    randpa& set_light_sync(bool enabled, const finality_channel_ptr& proven_channel = nullptr) {
+        _light_sync = enabled;
+        _proven_channel = proven_channel;
+        return *this;
+    }
+
+    /// End prevote of a round as soon as it reaches the threshold instead of on its block deadline, and let a prevote
+    /// that did not reach it by then go on for the timeout adapted from recent rounds, at most `prevote_timeout_max`
+    /// after the start of the round.
+    randpa& set_adaptive_phases(bool enabled,
+                                fc::microseconds prevote_timeout_max = fc::milliseconds(default_prevote_timeout_max_ms)) {
+        _adaptive_phases = enabled;
+        _prevote_timeout_max = prevote_timeout_max;
+        return *this;
+    }
+
+    /// Clock of the phase timeouts; the simulator has its own.
+    randpa& set_time_source(std::function<fc::time_point()> now) {
+        _now = std::move(now);
+        return *this;
+    }
+
     /// Set signature providers.
     randpa& set_signature_providers(const std::vector<signature_provider_type>& signature_providers,
                                     const std::vector<public_key_type>& public_keys) {
@@ -297,16 +689,105 @@ public:
     const message_queue<randpa_message>& get_message_queue() const {
         return _message_queue;
     }
+
+    queue_latency_stats& get_queue_latency_stats() {
+        return _queue_latency_stats;
+    }
 #endif
 
     prefix_tree_ptr get_prefix_tree() const {
         return _prefix_tree;
     }
 
+    const round_timing_stats& get_round_timing_stats() const {
+        return _round_timing;
+    }
+
+    /// Check that `proof` finalizes a block of `tree` by a supermajority of its active BPs.
+    static bool validate_proof(const prefix_tree& tree, const proof_type& proof) {
+        const auto node = tree.find(proof.best_block);
+
+        if (!node) {
+            randpa_dlog("Received proof for unknown block: ${block_id}", ("block_id", proof.best_block));
+            return false;
+        }
+        return validate_proof(proof, node->get_active_bp_keys());
+    }
+
+    /// Check that `proof` finalizes its block by a supermajority of `bp_keys`.
+    static bool validate_proof(const proof_type& proof, const std::set<public_key_type>& bp_keys) {
+        const auto best_block = proof.best_block;
+        const auto active_bps = bp_index(bp_keys);
+        bp_index::voters_type prevoted_keys, precommited_keys;
+
+        for (const auto& prevote : proof.prevotes) {
+            for (const auto& prevoter_pub_key : prevote.public_keys()) {
+                if (!validate_prevote(prevote.data, prevoter_pub_key, best_block, bp_keys)) {
+                    randpa_dlog("Prevote validation failed, base_block: ${id}, blocks: ${blocks}",
+                        ("id", prevote.data.base_block)
+                        ("blocks", prevote.data.blocks));
+                    return false;
+                }
+                prevoted_keys.set(active_bps.find(prevoter_pub_key));
+            }
+        }
+
+        for (const auto& precommit : proof.precommits) {
+            for (const auto& precommiter_pub_key : precommit.public_keys()) {
+                const auto key_index = active_bps.find(precommiter_pub_key);
+                if (key_index == bp_index::npos || !prevoted_keys.test(key_index)) {
+                    randpa_dlog("Precommiter has not prevoted, pub_key: ${pub_key}", ("pub_key", precommiter_pub_key));
+                    return false;
+                }
+
+                if (!validate_precommit(precommit.data, precommiter_pub_key, best_block, bp_keys)) {
+                    randpa_dlog("Precommit validation failed for ${id}", ("id", precommit.data.block_id));
+                    return false;
+                }
+                precommited_keys.set(key_index);
+            }
+        }
+        bool is_enough_keys = active_bps.is_threshold_reached(precommited_keys);
+        if (!is_enough_keys) {
+            randpa_dlog("Precommit validation failed: not enough keys: have ${have}, need ${need}",
+                ("have", precommited_keys.count())("need", active_bps.size() * 2 / 3 + 1));
+        }
+        return is_enough_keys;
+    }
+
     bool is_syncing() const {
         return _is_syncing;
     }
 
+    /// Get state to checkpoint; should be called after stop().
+    randpa_checkpoint get_checkpoint() const {
+        randpa_checkpoint checkpoint { _lib, _last_round_num, _last_prooved_block_num };
+        checkpoint.last_proofs.assign(_last_proofs.begin(), _last_proofs.end());
+        return checkpoint;
+    }
+
+    /// Restore validated checkpoint; should be called before start().
+    randpa& restore(const randpa_checkpoint& checkpoint) {
+        _last_round_num = checkpoint.round_num;
+        _last_prooved_block_num = checkpoint.last_prooved_block_num;
+        _last_proofs.clear();
+        for (const auto& proof : checkpoint.last_proofs) {
+            _last_proofs.push_back(proof);
+        }
+        _need_latest_proof = _last_proofs.empty();
+        randpa_ilog("Randpa state restored, round: ${r}, last prooved block: ${b}, proofs: ${n}",
+            ("r", _last_round_num)("b", _last_prooved_block_num)("n", _last_proofs.size()));
+        return *this;
+    }
+
+    const std::shared_ptr<seen_messages_cache>& get_seen_messages() const {
+        return _seen_messages;
+    }
+
+    const std::shared_ptr<known_votes_cache>& get_known_votes() const {
+        return _known_votes;
+    }
+
     bool is_frozen() const {
         return _is_frozen;
     }
@@ -317,6 +798,7 @@ public:
 
 private:
     static constexpr size_t _proofs_cache_size = 2; ///< how much last proofs to keep; @see _last_proofs
+    static constexpr size_t _signed_proofs_cache_size = 4; ///< @see _signed_proofs
     static constexpr size_t _messages_cache_size = 100 * 100 * 100; // network msg cache size
     // See https://bit.ly/2Wp3Nsf
     // 2 / 3 * 102 * 12 (blocks per slot) * 2 rounds * 2 (additional)
@@ -334,25 +816,60 @@ private:
     bool _is_block_producer = false;        ///< node is a block producer if run with at least one --producer-name option
     prefix_tree_ptr _prefix_tree;
     randpa_round_ptr _round;
+    randpa_round_ptr _prev_round;           ///< previous round still collecting precommits
     block_id_type _lib;                     ///< last irreversible block
     uint32_t _last_prooved_block_num = 0;
     std::map<public_key_type, uint32_t> _peers;
-    lru_cache_type _peer_messages;
+    std::map<uint32_t, uint32_t> _peer_features; ///< features announced by peers (by session id)
+    bool _light_sync = false;               ///< see set_light_sync
+    uint32_t _light_sync_proven_to = 0;     ///< highest block sent to _proven_channel
+    uint32_t _light_sync_peer = 0;          ///< session of the last proof range request
+    fc::time_point _light_sync_requested;
     lru_cache_type _self_messages;
+    /// shared with network layer: duplicates are dropped there before signature recovery
+    std::shared_ptr<seen_messages_cache> _seen_messages = std::make_shared<seen_messages_cache>();
+    /// shared with network layer: votes of received proofs are not recovered again there
+    std::shared_ptr<known_votes_cache> _known_votes = std::make_shared<known_votes_cache>();
     /// Proof data is invalidated after each round is finished, but other nodes will want to request
     /// proofs for that round; this cache holds some proofs to reply such requests.
     boost::circular_buffer<proof_type> _last_proofs;
+    /// Messages of the recently sent proofs, signed once for every peer requesting them.
+    struct signed_proof {
+        uint32_t round_num;
+        block_id_type best_block;
+        fc::optional<proof_msg> full;
+        fc::optional<compact_proof_msg> compact;
+    };
+    boost::circular_buffer<signed_proof> _signed_proofs { _signed_proofs_cache_size };
+    uint32_t _last_round_num = 0;           ///< rounds with lower or the same number are not started again
+    bool _need_latest_proof = true;         ///< ask peers for recent proofs (after start without checkpoint)
     bool _is_syncing = false;               ///< syncing blocks from peers
     bool _is_frozen = false;                ///< freeze if dpos finality stops working
+    bool _adaptive_phases = false;          ///< see set_adaptive_phases
+    fc::microseconds _prevote_timeout_max = fc::milliseconds(default_prevote_timeout_max_ms);
+    std::function<fc::time_point()> _now = []() { return fc::time_point::now(); };
+    fc::time_point _round_start;            ///< of _round
+    fc::time_point _prev_round_start;       ///< of _prev_round
+    fc::time_point _prevote_deadline;       ///< stretched prevote of _round ends then, unset if not stretched
+    bool _round_prevote_reached = false;    ///< prevote threshold time of _round was sampled
+    round_timing_stats _round_timing;
+    fc::optional<round_timeline> _round_timeline;      ///< of _round, with a timeline channel
+    fc::optional<round_timeline> _prev_round_timeline; ///< of _prev_round
 
 #ifndef SYNC_RANDPA
     message_queue<randpa_message> _message_queue;
+    queue_latency_stats _queue_latency_stats;
 #endif
 
     net_channel_ptr _in_net_channel;
     net_channel_ptr _out_net_channel;
     event_channel_ptr _in_event_channel;
     finality_channel_ptr _finality_channel;
+    proof_channel_ptr _proof_channel;
+    round_timeline_channel_ptr _round_timeline_channel;
+    proof_provider_type _proof_provider;
+    proof_range_provider_type _proof_range_provider;
+    finality_channel_ptr _proven_channel;
 
     //
 
@@ -361,7 +878,11 @@ private:
 #ifdef SYNC_RANDPA
             process_msg(std::make_shared<randpa_message>(msg));
 #else
-            _message_queue.push_message(msg);
+            // a peer's message may be lost anyway, dropped instead of holding the network thread
+            if (!_message_queue.try_push_message(msg) && _message_queue.dropped() % 1000 == 1) {
+                randpa_wlog("Randpa message queue is full, ${n} network messages dropped so far",
+                    ("n", _message_queue.dropped()));
+            }
 #endif
         });
 
@@ -381,28 +902,53 @@ private:
         _out_net_channel->send(net_msg);
     }
 
+    /// Send `msg` to peers which are not known to have it yet.
+    /// The message is packed once: its digest is taken from the packed bytes, which are shared by all the peers.
     template <typename T>
     void bcast(const T & msg) {
-        auto msg_hash = digest_type::hash(msg);
-        if (_peer_messages.contains(msg_hash)) {
-            return;
-        }
+        auto packed = std::make_shared<const std::vector<char>>(fc::raw::pack(msg));
+        const auto msg_hash = digest_type::hash(packed->data(), packed->size());
+        std::vector<uint32_t> sessions;
+        sessions.reserve(_peers.size());
         for (const auto& peer : _peers) {
-            send(peer.second, msg);
+            sessions.push_back(peer.second);
         }
-        _peer_messages.insert(msg_hash, {});
+        auto targets = _seen_messages->take_relay_targets(msg_hash, msg.data.round_num, sessions);
+        if (targets.empty()) {
+            return;
+        }
+        _out_net_channel->send(randpa_net_msg { 0, msg, {}, std::move(targets), std::move(packed) });
     }
 
 #ifndef SYNC_RANDPA
     void loop() {
+        using queued_message = message_queue<randpa_message>::queued_message;
+        std::vector<queued_message> batch;
+        batch.reserve(256);
+
         while (true) {
-            auto msg = _message_queue.get_next_msg_wait();
+            batch.clear();
+            if (_prevote_deadline == fc::time_point()) {
+                _message_queue.get_next_msgs_wait(batch);
+            } else {
+                const auto wait = std::max<int64_t>((_prevote_deadline - _now()).count(), 0);
+                _message_queue.get_next_msgs_wait_until(batch,
+                    message_queue<randpa_message>::clock_type::now() + std::chrono::microseconds(wait));
+            }
 
             if (_done) {
                 break;
             }
+            check_deadlines();
 
-            process_msg(msg);
+            const auto now = message_queue<randpa_message>::clock_type::now();
+            for (const auto& item : batch) {
+                _queue_latency_stats.add(queue_latency_stats::get_type(*item.msg),
+                    std::chrono::duration_cast<std::chrono::microseconds>(now - item.enqueue_time));
+            }
+            for (const auto& item : batch) {
+                process_msg(item.msg);
+            }
         }
     }
 #endif
@@ -432,6 +978,7 @@ private:
 
     // need handle all messages
     void process_msg(randpa_message_ptr msg_ptr) {
+        check_deadlines();
         const auto msg = *msg_ptr;
         switch (msg.which()) {
         case randpa_message::tag<randpa_net_msg>::value:
@@ -488,16 +1035,19 @@ private:
         case randpa_event_data::tag<on_new_peer_event>::value:
             on(data.get<on_new_peer_event>());
             break;
+        case randpa_event_data::tag<on_peer_closed_event>::value:
+            on(data.get<on_peer_closed_event>());
+            break;
         default:
             randpa_wlog("Randpa event received, but handler not found, type: ${type}", ("type", data.which()));
             break;
         }
     }
 
-    bool validate_prevote(const prevote_type& prevote,
-                          const public_key_type& prevoter_key,
-                          const block_id_type& best_block,
-                          const std::set<public_key_type>& bp_keys) const {
+    static bool validate_prevote(const prevote_type& prevote,
+                                 const public_key_type& prevoter_key,
+                                 const block_id_type& best_block,
+                                 const std::set<public_key_type>& bp_keys) {
         if (prevote.base_block != best_block
             && std::find(prevote.blocks.begin(), prevote.blocks.end(), best_block) == prevote.blocks.end()) {
             randpa_dlog("Best block: ${id} was not found in prevote blocks", ("id", best_block));
@@ -510,10 +1060,10 @@ private:
         return false;
     }
 
-    bool validate_precommit(const precommit_type& precommit,
-                            const public_key_type& precommiter_key,
-                            const block_id_type& best_block,
-                            const std::set<public_key_type>& bp_keys) const {
+    static bool validate_precommit(const precommit_type& precommit,
+                                   const public_key_type& precommiter_key,
+                                   const block_id_type& best_block,
+                                   const std::set<public_key_type>& bp_keys) {
         if (precommit.block_id != best_block) {
             randpa_dlog("Precommit block ${pbid}, best block: ${bbid}",
                 ("pbid", precommit.block_id)
@@ -527,52 +1077,6 @@ private:
         return false;
     }
 
-    bool validate_proof(const proof_type& proof) const {
-        const auto best_block = proof.best_block;
-        const auto node = _prefix_tree->find(best_block);
-
-        if (!node) {
-            randpa_dlog("Received proof for unknown block: ${block_id}", ("block_id", best_block));
-            return false;
-        }
-
-        std::set<public_key_type> prevoted_keys, precommited_keys;
-        const auto& bp_keys = node->active_bp_keys;
-
-        for (const auto& prevote : proof.prevotes) {
-            for (const auto& prevoter_pub_key : prevote.public_keys()) {
-                if (!validate_prevote(prevote.data, prevoter_pub_key, best_block, bp_keys)) {
-                    randpa_dlog("Prevote validation failed, base_block: ${id}, blocks: ${blocks}",
-                        ("id", prevote.data.base_block)
-                        ("blocks", prevote.data.blocks));
-                    return false;
-                }
-                prevoted_keys.insert(prevoter_pub_key);
-            }
-        }
-
-        for (const auto& precommit : proof.precommits) {
-            for (const auto& precommiter_pub_key : precommit.public_keys()) {
-                if (!prevoted_keys.count(precommiter_pub_key)) {
-                    randpa_dlog("Precommiter has not prevoted, pub_key: ${pub_key}", ("pub_key", precommiter_pub_key));
-                    return false;
-                }
-
-                if (!validate_precommit(precommit.data, precommiter_pub_key, best_block, bp_keys)) {
-                    randpa_dlog("Precommit validation failed for ${id}", ("id", precommit.data.block_id));
-                    return false;
-                }
-                precommited_keys.insert(precommiter_pub_key);
-            }
-        }
-        bool is_enough_keys = precommited_keys.size() > node->active_bp_keys.size() * 2 / 3;
-        if (!is_enough_keys) {
-            randpa_dlog("Precommit validation failed: not enough keys: have ${have}, need ${need}",
-                ("have", precommited_keys.size())("need", node->active_bp_keys.size() * 2 / 3 + 1));
-        }
-        return is_enough_keys;
-    }
-
     void on(uint32_t ses_id, const prevote_msg& msg) {
         process_round_msg(ses_id, msg);
     }
@@ -597,9 +1101,161 @@ private:
         for (const auto& proof : _last_proofs) {
             if (proof.round_num == data.round_num) {
                 randpa_dlog("proof found; sending it");
-                send(ses_id, proof_msg{proof, _signature_providers}); // TODO: see above
+                send_proof(ses_id, proof);
+                return;
+            }
+        }
+
+        if (_proof_provider) {
+            if (const auto proof = _proof_provider(data.round_num)) {
+                randpa_dlog("proof found in storage; sending it");
+                send_proof(ses_id, *proof);
+            }
+        }
+    }
+
+    bool has_feature(uint32_t ses_id, randpa_features feature) const {
+        const auto it = _peer_features.find(ses_id);
+        return it != _peer_features.end() && (it->second & feature);
+    }
+
+    /// Send proof in compact form, if peer supports it; fall back to the full format otherwise.
+    void send_proof(uint32_t ses_id, const proof_type& proof) {
+        auto& cached = signed_proof_of(proof);
+        if (has_feature(ses_id, randpa_features::compact_proofs)) {
+            if (!cached.compact) {
+                const auto node = _prefix_tree->find(proof.best_block);
+                if (node) {
+                    if (auto compact = make_compact_proof(proof, bp_index(node->get_active_bp_keys()))) {
+                        cached.compact = compact_proof_msg{*compact, _signature_providers};
+                    }
+                }
+            }
+            if (cached.compact) {
+                send(ses_id, *cached.compact);
+                return;
+            }
+            randpa_dlog("cannot make compact proof for block ${b}; sending full one", ("b", proof.best_block));
+        }
+        if (!cached.full) {
+            cached.full = proof_msg{proof, _signature_providers};
+        }
+        send(ses_id, *cached.full);
+    }
+
+    /// Signing and hashing a proof costs as much as all its votes: it's done once, not for every peer.
+    signed_proof& signed_proof_of(const proof_type& proof) {
+        for (auto& cached : _signed_proofs) {
+            if (cached.round_num == proof.round_num && cached.best_block == proof.best_block) {
+                return cached;
+            }
+        }
+        _signed_proofs.push_front(signed_proof{proof.round_num, proof.best_block});
+        return _signed_proofs.front();
+    }
+
+    /// Keys of the votes of `proof` this node already received alone; they are not recovered again.
+    void restore_vote_keys(const proof_type& proof) {
+        for (const auto& prevote : proof.prevotes) {
+            _known_votes->restore_keys(prevote);
+        }
+        for (const auto& precommit : proof.precommits) {
+            _known_votes->restore_keys(precommit);
+        }
+    }
+
+    void on(uint32_t ses_id, const compact_proof_msg& msg) {
+        const auto& compact = msg.data;
+        randpa_dlog("Received compact proof for round ${num}", ("num", compact.round_num));
+
+        const auto node = _prefix_tree->find(compact.best_block);
+        if (!node) {
+            randpa_dlog("Received compact proof for unknown block: ${block_id}", ("block_id", compact.best_block));
+            return;
+        }
+
+        auto proof = expand_compact_proof(compact, bp_index(node->get_active_bp_keys()));
+        if (!proof) {
+            for (const auto& public_key : msg.public_keys()) {
+                randpa_ilog("Invalid compact proof among ${peer}", ("peer", public_key));
+            }
+            return;
+        }
+        on(ses_id, proof_msg(*proof, std::vector<signature_type>(msg.signatures), msg.public_keys()));
+    }
+
+    void on(uint32_t ses_id, const finality_req_proofs_msg& msg) {
+        const auto& data = msg.data;
+        randpa_dlog("Randpa finality_req_proofs_msg received from block ${b}", ("b", data.from_block_num));
+        // send oldest first, so the requester can apply them in order
+        for (auto it = _last_proofs.rbegin(); it != _last_proofs.rend(); ++it) {
+            if (get_block_num(it->best_block) > data.from_block_num) {
+                send_proof(ses_id, *it);
+            }
+        }
+    }
+
+    void on(uint32_t ses_id, const finality_req_proof_range_msg& msg) {
+        const auto& data = msg.data;
+        randpa_dlog("Randpa finality_req_proof_range_msg received from block ${b}, stride: ${s}, limit: ${l}",
+            ("b", data.from_block_num)("s", data.stride)("l", data.limit));
+        if (!_proof_range_provider || !data.stride || !data.limit) {
+            return;
+        }
+        auto proofs = _proof_range_provider(data.from_block_num, data.stride, std::min(data.limit, light_sync_max_proofs));
+        if (!proofs.empty()) {
+            send(ses_id, proof_range_msg(proof_range_type { std::move(proofs) }, _signature_providers));
+        }
+    }
+
+    void on(uint32_t ses_id, const proof_range_msg& msg) {
+        const auto& proofs = msg.data.proofs;
+        randpa_dlog("Randpa proof_range_msg received, ses_id: ${ses_id}, proofs: ${n}", ("ses_id", ses_id)("n", proofs.size()));
+        if (!_light_sync || !_proven_channel) {
+            return;
+        }
+
+        const auto head = _prefix_tree->get_head();
+        const auto& bp_keys = head->get_active_bp_keys();
+        for (const auto& proof : proofs) {
+            const auto block_num = get_block_num(proof.best_block);
+            if (block_num <= std::max(_light_sync_proven_to, get_block_num(head->block_id))) {
+                continue;
+            }
+            if (!validate_proof(proof, bp_keys)) {
+                randpa_dlog("Light sync stopped at proof for ${id}: not signed by the active BPs", ("id", proof.best_block));
                 break;
             }
+            _light_sync_proven_to = block_num;
+            _proven_channel->send(proof.best_block);
+        }
+        // the next range can be requested right away
+        _light_sync_requested = fc::time_point();
+    }
+
+    /// Ask the next peer supporting proof ranges for the proofs ahead of the head.
+    void request_proof_range(uint32_t head_num) {
+        if (_light_sync_proven_to >= head_num + light_sync_ahead) {
+            return;
+        }
+        const auto now = fc::time_point::now();
+        if (now - _light_sync_requested < fc::milliseconds(light_sync_request_ms)) {
+            return;
+        }
+
+        auto it = _peer_features.upper_bound(_light_sync_peer);
+        for (size_t i = 0; i < _peer_features.size(); i++, it++) {
+            if (it == _peer_features.end()) {
+                it = _peer_features.begin();
+            }
+            if (it->second & randpa_features::proof_ranges) {
+                _light_sync_peer = it->first;
+                _light_sync_requested = now;
+                const auto from = std::max(_light_sync_proven_to, head_num);
+                send(it->first, finality_req_proof_range_msg(
+                    finality_req_proof_range_type { from, light_sync_stride, light_sync_max_proofs }, _signature_providers));
+                return;
+            }
         }
     }
 
@@ -607,7 +1263,8 @@ private:
         const auto& proof = msg.data;
         randpa_dlog("Received proof for round ${num}", ("num", proof.round_num));
 
-        if (_is_syncing || _is_frozen) {
+        // requested proofs are accepted while syncing: blocks they prove can be already in the tree
+        if ((_is_syncing && !_need_latest_proof) || _is_frozen) {
             randpa_dlog("Skipping proof while syncing or frozen");
             return;
         }
@@ -633,7 +1290,8 @@ private:
             return;
         }
 
-        if (!validate_proof(proof)) {
+        restore_vote_keys(proof);
+        if (!validate_proof(*_prefix_tree, proof)) {
             for (const auto& public_key : msg.public_keys()) {
                 randpa_ilog("Invalid proof among ${peer}", ("peer", public_key));
             }
@@ -643,9 +1301,9 @@ private:
 
         randpa_ilog("Successfully validated proof for block ${id}", ("id", proof.best_block));
 
-        if (_round && _round->get_num() == proof.round_num) {
-            randpa_dlog("Gotta proof for round ${num}", ("num", _round->get_num()));
-            _round->set_state(randpa_round::state_type::done);
+        if (const auto& round = find_round(proof.round_num)) {
+            randpa_dlog("Gotta proof for round ${num}", ("num", round->get_num()));
+            round->set_state(randpa_round::state_type::done);
         }
         on_proof_gained(proof);
     }
@@ -656,6 +1314,7 @@ private:
             try {
                 _peers[public_key] = ses_id;
                 send(ses_id, handshake_ans_msg(handshake_ans_type { _lib }, _signature_providers));
+                send(ses_id, handshake_ext_msg(handshake_ext_type { _lib, supported_features }, _signature_providers));
             } catch (const fc::exception& e) {
                 randpa_elog("Randpa handshake_msg handler error, reason: ${e}", ("e", e.what()));
             }
@@ -667,12 +1326,21 @@ private:
             randpa_ilog("Randpa handshake_ans_msg received, ses_id: ${ses_id}, from: ${pk}", ("ses_id", ses_id)("pk", public_key));
             try {
                 _peers[public_key] = ses_id;
+                if (_need_latest_proof) {
+                    send(ses_id, finality_req_proofs_msg(finality_req_proofs_type { _last_prooved_block_num }, _signature_providers));
+                }
             } catch (const fc::exception& e) {
                 randpa_elog("Randpa handshake_ans_msg handler error, reason: ${e}", ("e", e.what()));
             }
         }
     }
 
+    void on(uint32_t ses_id, const handshake_ext_msg& msg) {
+        randpa_dlog("Randpa handshake_ext_msg received, ses_id: ${ses_id}, features: ${f}",
+            ("ses_id", ses_id)("f", msg.data.features));
+        _peer_features[ses_id] = msg.data.features;
+    }
+
     void on(const on_accepted_block_event& event) {
         randpa_dlog("Randpa on_accepted_block_event event handled, block_id: ${id}, num: ${num}, creator: ${c}, bp_keys: ${bpk}",
             ("id", event.block_id)
@@ -692,9 +1360,15 @@ private:
             return;
         }
 
+        _seen_messages->set_current_round(round_num(event.block_id));
+        _known_votes->set_current_round(round_num(event.block_id));
+
         // when node in syncing or frozen state it's useless to creating new rounds
         _is_syncing = event.sync;
         _is_frozen = get_block_num(event.block_id) - get_block_num(_lib) > _max_finality_lag_blocks;
+        if (_is_syncing && _light_sync) {
+            request_proof_range(get_block_num(event.block_id));
+        }
         if (_is_syncing) {
             randpa_ilog("Randpa omit block while syncing, block id: ${id}", ("id", event.block_id));
             return;
@@ -716,7 +1390,10 @@ private:
         }
 
         if (should_end_prevote(event.block_id)) {
-            _round->end_prevote();
+            if (is_prevoting(*_round) && !stretch_prevote()) {
+                _round->end_prevote();
+            }
+            retire_prev_round();
         }
     }
 
@@ -740,15 +1417,28 @@ private:
         randpa_dlog("Randpa on_new_peer_event event handled, ses_id: ${ses_id}", ("ses_id", event.ses_id));
         auto msg = handshake_msg(handshake_type{_lib}, _signature_providers);
         send(event.ses_id, msg);
+        send(event.ses_id, handshake_ext_msg(handshake_ext_type{_lib, supported_features}, _signature_providers));
+    }
+
+    void on(const on_peer_closed_event& event) {
+        randpa_dlog("Randpa on_peer_closed_event event handled, ses_id: ${ses_id}", ("ses_id", event.ses_id));
+        _peer_features.erase(event.ses_id);
     }
 
     void on_proof_gained(const proof_type& proof) {
+        _need_latest_proof = false;
         _last_proofs.push_front(proof);
         randpa_dlog("cached proof for block ${b}", ("b", proof.best_block));
 
         _last_prooved_block_num = get_block_num(proof.best_block);
         _finality_channel->send(proof.best_block);
+        if (_proof_channel) {
+            _proof_channel->send(proof);
+        }
         bcast(finality_notice_msg{{proof.round_num, proof.best_block}, _signature_providers});
+        if (auto timeline = find_timeline(proof.round_num)) {
+            timeline->proof_bcast_us = timeline->since_start(_now());
+        }
     }
 
     template <typename T>
@@ -759,6 +1449,8 @@ private:
         }
 
         const auto msg_hash = digest_type::hash(msg);
+        // sender has the message; don't relay it back
+        _seen_messages->mark(msg_hash, msg.data.round_num, ses_id);
         if (_self_messages.contains(msg_hash)) {
             return;
         }
@@ -766,16 +1458,81 @@ private:
         _self_messages.insert(msg_hash, {});
 
         const auto last_round_num = round_num(_prefix_tree->get_head()->block_id);
-        if (last_round_num == msg.data.round_num) {
+        if (last_round_num == msg.data.round_num
+            || (std::is_same_v<T, precommit_msg> && msg.data.round_num + 1 == last_round_num)) {
             bcast(msg);
         }
 
-        if (!_round) {
-            randpa_dlog("Randpa round does not exist");
+        const auto& round = find_round(msg.data.round_num);
+        if (!round) {
+            randpa_dlog("Randpa round ${r} does not exist", ("r", msg.data.round_num));
+            return;
+        }
+
+        round->on(msg);
+        _known_votes->add(msg);
+        on_round_updated(round);
+    }
+
+    static bool is_prevoting(const randpa_round& round) {
+        return round.get_state() == randpa_round::state_type::prevote
+            || round.get_state() == randpa_round::state_type::ready_to_precommit;
+    }
+
+    /// Samples the prevote threshold time of the current round, and ends its prevote there with adaptive phases.
+    void on_round_updated(const randpa_round_ptr& round) {
+        if (round != _round || _round_prevote_reached
+            || round->get_state() != randpa_round::state_type::ready_to_precommit) {
             return;
         }
+        _round_prevote_reached = true;
+        _round_timing.add_prevote(_now() - _round_start);
+        if (_round_timeline) {
+            _round_timeline->prevote_threshold_us = _round_timeline->since_start(_now());
+        }
+        if (_adaptive_phases) {
+            randpa_dlog("Prevote of round ${r} ends at the threshold", ("r", round->get_num()));
+            _prevote_deadline = fc::time_point();
+            round->end_prevote();
+        }
+    }
 
-        _round->on(msg);
+    /// Prevote of the current round reached its block deadline without the threshold: gives it until the adaptive
+    /// timeout instead of failing it now. Returns false if it has to end now.
+    bool stretch_prevote() {
+        if (!_adaptive_phases || _round->get_state() != randpa_round::state_type::prevote) {
+            return false;
+        }
+        const auto deadline = _round_start + _round_timing.prevote_timeout(fc::microseconds(0), _prevote_timeout_max);
+        if (deadline <= _now()) {
+            return false;
+        }
+        randpa_dlog("Prevote of round ${r} goes on for ${t} us", ("r", _round->get_num())("t", (deadline - _now()).count()));
+        _prevote_deadline = deadline;
+        _round_timing.add_stretched_round();
+        return true;
+    }
+
+    void check_deadlines() {
+        if (_prevote_deadline == fc::time_point() || _now() < _prevote_deadline) {
+            return;
+        }
+        _prevote_deadline = fc::time_point();
+        if (_round && is_prevoting(*_round)) {
+            randpa_dlog("Prevote of round ${r} timed out", ("r", _round->get_num()));
+            _round->end_prevote();
+        }
+    }
+
+    const randpa_round_ptr& find_round(uint32_t num) const {
+        static const randpa_round_ptr none;
+        if (_round && _round->get_num() == num) {
+            return _round;
+        }
+        if (_prev_round && _prev_round->get_num() == num) {
+            return _prev_round;
+        }
+        return none;
     }
 
     uint32_t round_num(const block_id_type& block_id) const {
@@ -791,6 +1548,11 @@ private:
             return false;
         }
 
+        // don't vote again in a round that was already taken part in before restart
+        if (round_num(block_id) <= _last_round_num && _last_round_num) {
+            return false;
+        }
+
         if (!_round) {
             return true;
         }
@@ -827,23 +1589,28 @@ private:
         }
 
         for (const auto& public_key : _public_keys) {
-            if (node_ptr->active_bp_keys.count(public_key)) {
+            if (node_ptr->get_active_bp_keys().count(public_key)) {
                 return true;
             }
         }
         return false;
     }
 
-    void finish_round() {
-        if (!_round) {
+    void finish_round(uint32_t num) {
+        const auto round = find_round(num);
+        if (!round) {
             return;
         }
 
-        if (!_round->finish()) {
+        if (!round->finish()) {
             return;
         }
+        _round_timing.add_finality(_now() - (round == _round ? _round_start : _prev_round_start));
+        if (auto timeline = find_timeline(num)) {
+            timeline->precommit_threshold_us = timeline->since_start(_now());
+        }
 
-        const auto& proof = _round->get_proof();
+        const auto& proof = round->get_proof();
         randpa_ilog("Randpa round reached supermajority, round num: ${n}, best block id: ${b}, best block num: ${bn}",
             ("n", proof.round_num)
             ("b", proof.best_block)
@@ -854,26 +1621,94 @@ private:
             on_proof_gained(proof);
             update_lib(proof.best_block);
         }
-        randpa_dlog("round ${r} finished", ("r", _round->get_num()));
+        randpa_dlog("round ${r} finished", ("r", num));
     }
 
     void new_round(uint32_t round_num, const public_key_type& primary, const std::set<public_key_type>& active_bp_keys) {
+        _last_round_num = round_num;
+        _round_start = _now();
+        _round_prevote_reached = false;
+        _prevote_deadline = fc::time_point();
+        close_timeline(_round_timeline);
+        if (_round_timeline_channel) {
+            _round_timeline.emplace(round_num, _round_start, active_bp_keys);
+        }
         _round.reset(new randpa_round(
             round_num,
             primary,
             _prefix_tree,
+            active_bp_keys,
             get_active_signature_providers(active_bp_keys),
             [this](const prevote_msg& msg) { bcast(msg); },
             [this](const precommit_msg& msg) { bcast(msg); },
-            [this]() { finish_round(); }
+            [this, round_num]() { finish_round(round_num); },
+            _adaptive_phases,
+            [this, round_num](const public_key_type& key, bool precommit) { on_vote(round_num, key, precommit); }
         ));
+        // own prevotes may be enough
+        on_round_updated(_round);
     }
 
+    /// Precommit phase doesn't depend on prevotes stored in the tree, so a round in that phase
+    /// keeps collecting precommits while the next round prevotes.
     void remove_round() {
-        _peer_messages.clear();
         _self_messages.clear();
         _prefix_tree->remove_confirmations();
+        if (_round && _round->get_state() == randpa_round::state_type::precommit) {
+            randpa_dlog("round ${r} continues precommit phase", ("r", _round->get_num()));
+            close_timeline(_prev_round_timeline);
+            _prev_round = std::move(_round);
+            _prev_round_start = _round_start;
+            _prev_round_timeline = std::move(_round_timeline);
+            _round_timeline.reset();
+        } else {
+            _prev_round.reset();
+            close_timeline(_prev_round_timeline);
+        }
         _round.reset();
+        close_timeline(_round_timeline);
+        _prevote_deadline = fc::time_point();
+    }
+
+    /// Next round finished prevote phase; stop waiting for precommits of the previous one.
+    void retire_prev_round() {
+        if (!_prev_round) {
+            return;
+        }
+        if (_prev_round->get_state() != randpa_round::state_type::done) {
+            randpa_dlog("round ${r} failed to gain precommits in time", ("r", _prev_round->get_num()));
+        }
+        _prev_round.reset();
+        close_timeline(_prev_round_timeline);
+    }
+
+    round_timeline* find_timeline(uint32_t num) {
+        if (_round_timeline && _round_timeline->round_num == num) {
+            return &*_round_timeline;
+        }
+        if (_prev_round_timeline && _prev_round_timeline->round_num == num) {
+            return &*_prev_round_timeline;
+        }
+        return nullptr;
+    }
+
+    void on_vote(uint32_t num, const public_key_type& key, bool precommit) {
+        if (auto timeline = find_timeline(num)) {
+            const auto own = std::find(_public_keys.begin(), _public_keys.end(), key) != _public_keys.end();
+            timeline->add_vote(key, precommit, _now(), own);
+        }
+    }
+
+    /// The round of `timeline` is dropped: its timeline is complete.
+    void close_timeline(fc::optional<round_timeline>& timeline) {
+        if (!timeline) {
+            return;
+        }
+        timeline->close();
+        if (_round_timeline_channel) {
+            _round_timeline_channel->send(*timeline);
+        }
+        timeline.reset();
     }
 
     void update_lib(const block_id_type& lib_id) {
@@ -891,3 +1726,10 @@ private:
 };
 
 } //namespace randpa_finality
+
+FC_REFLECT(randpa_finality::randpa_checkpoint, (lib)(round_num)(last_prooved_block_num)(last_proofs))
+FC_REFLECT(randpa_finality::on_accepted_block_event, (block_id)(prev_block_id)(creator_key)(active_bp_keys)(sync))
+FC_REFLECT(randpa_finality::on_irreversible_event, (block_id))
+FC_REFLECT(randpa_finality::on_new_peer_event, (ses_id))
+FC_REFLECT(randpa_finality::on_peer_closed_event, (ses_id))
+FC_REFLECT(randpa_finality::randpa_event, (data))
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <eosio/chain/async_log.hpp>
+
 #include <fc/log/logger.hpp>
 #include <fc/string.hpp>
 
@@ -8,17 +10,10 @@ namespace randpa_finality {
 extern const fc::string randpa_logger_name;
 extern fc::logger randpa_logger;
 
-#define randpa_dlog(FORMAT, ...) \
-    FC_MULTILINE_MACRO_BEGIN \
-        if (randpa_logger.is_enabled(fc::log_level::debug)) \
-            randpa_logger.log(FC_LOG_MESSAGE(debug, FORMAT, __VA_ARGS__)); \
-    FC_MULTILINE_MACRO_END
+// debug and info messages of rounds are written by the async_log thread, once it is started
+#define randpa_dlog(FORMAT, ...) async_dlog(randpa_logger, FORMAT, __VA_ARGS__)
 
-#define randpa_ilog(FORMAT, ...) \
-    FC_MULTILINE_MACRO_BEGIN \
-        if (randpa_logger.is_enabled(fc::log_level::info)) \
-            randpa_logger.log(FC_LOG_MESSAGE(info, FORMAT, __VA_ARGS__)); \
-    FC_MULTILINE_MACRO_END
+#define randpa_ilog(FORMAT, ...) async_ilog(randpa_logger, FORMAT, __VA_ARGS__)
 
 #define randpa_wlog(FORMAT, ...) \
     FC_MULTILINE_MACRO_BEGIN \
@@ -2,6 +2,10 @@
 
 #include <appbase/application.hpp>
 #include <eosio/net_plugin/net_plugin.hpp>
+#include <eosio/randpa_plugin/network_messages.hpp>
+#include <eosio/randpa_plugin/round_timeline.hpp>
+
+#include <limits>
 
 namespace eosio {
 
@@ -13,15 +17,49 @@ public:
     virtual ~randpa_plugin();
 
     APPBASE_PLUGIN_REQUIRES((net_plugin)(chain_plugin))
-    virtual void set_program_options(options_description& /*cli*/, options_description& /*cfg*/) override {}
+    virtual void set_program_options(options_description& cli, options_description& cfg) override;
 
     void plugin_initialize(const variables_map& options);
     void plugin_startup();
     void plugin_shutdown();
     void handle_sighup() override;
 
+    struct get_proof_params {
+        uint32_t block_num = 0;
+    };
+
+    struct get_proof_results {
+        randpa_finality::proof_type proof; ///< proof for the lowest finalized block not lower than requested
+    };
+
+    struct get_proofs_params {
+        uint32_t lower_bound = 0;
+        uint32_t upper_bound = std::numeric_limits<uint32_t>::max();
+        uint32_t limit = 10;
+    };
+
+    struct get_proofs_results {
+        std::vector<randpa_finality::proof_type> proofs;
+        uint32_t more = 0; ///< block number to continue from, if not all proofs fit into the limit
+    };
+
+    struct get_round_timelines_params {
+        uint32_t limit = 10;
+    };
+
+    struct get_round_timelines_results {
+        std::vector<randpa_finality::round_timeline> timelines; ///< of the latest rounds, newest first
+    };
+
 private:
     std::unique_ptr<class randpa_plugin_impl> my;
 };
 
 } // namespace eosio
+
+FC_REFLECT(eosio::randpa_plugin::get_proof_params, (block_num))
+FC_REFLECT(eosio::randpa_plugin::get_proof_results, (proof))
+FC_REFLECT(eosio::randpa_plugin::get_proofs_params, (lower_bound)(upper_bound)(limit))
+FC_REFLECT(eosio::randpa_plugin::get_proofs_results, (proofs)(more))
+FC_REFLECT(eosio::randpa_plugin::get_round_timelines_params, (limit))
+FC_REFLECT(eosio::randpa_plugin::get_round_timelines_results, (timelines))
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "types.hpp"
+#include "bp_index.hpp"
 #include "prefix_chain_tree.hpp"
 #include "network_messages.hpp"
 #include "randpa_logger.hpp"
@@ -31,6 +32,7 @@ private:
     using prevote_bcaster_type = std::function<void(const prevote_msg&)>;
     using precommit_bcaster_type = std::function<void(const precommit_msg&)>;
     using done_cb_type = std::function<void()>;
+    using vote_cb_type = std::function<void(const public_key_type& key, bool precommit)>;
 
     uint32_t num { 0 };
     public_key_type primary;
@@ -42,18 +44,26 @@ private:
     prevote_bcaster_type prevote_bcaster;
     precommit_bcaster_type precommit_bcaster;
     done_cb_type done_cb;
+    vote_cb_type vote_cb;                   ///< every vote the round accepts, own ones included
 
-    std::set<public_key_type> prevoted_keys;
-    std::set<public_key_type> precommited_keys;
+    bp_index active_bps;
+    bp_index::voters_type prevoted_keys;
+    bp_index::voters_type precommited_keys;
+    bp_index::voters_type best_prevoters;   ///< snapshot of `best_node` prevoters, tree confirmations are reset on next round
+    bool fast_path { false };               ///< prevote may end as soon as the threshold is reached, see randpa::set_adaptive_phases
+    std::vector<precommit_msg> early_precommits; ///< received during prevote, validated once it ends (fast path only)
 
 public:
     randpa_round(uint32_t num,
                  const public_key_type& primary,
                  const prefix_tree_ptr& tree,
+                 const bp_keys_type& active_bp_keys,
                  const std::vector<signature_provider_type>& signature_providers,
                  prevote_bcaster_type && prevote_bcaster,
                  precommit_bcaster_type && precommit_bcaster,
-                 done_cb_type && done_cb)
+                 done_cb_type && done_cb,
+                 bool fast_path = false,
+                 vote_cb_type && vote_cb = {})
         : num{num}
         , primary{primary}
         , tree{tree}
@@ -61,6 +71,9 @@ public:
         , prevote_bcaster{std::move(prevote_bcaster)}
         , precommit_bcaster{std::move(precommit_bcaster)}
         , done_cb{std::move(done_cb)}
+        , vote_cb{std::move(vote_cb)}
+        , active_bps{active_bp_keys}
+        , fast_path{fast_path}
     {
         randpa_dlog("Randpa round started, num: ${n}, primary: ${p}",
                    ("n", num)
@@ -82,13 +95,19 @@ public:
         state = s;
     }
 
-    proof_type get_proof() {
+    /// Proof is assembled as votes arrive: prevotes of the best block when prevote ends (and late ones
+    /// after it), precommits as they are added.
+    const proof_type& get_proof() const {
         FC_ASSERT(state == state_type::done, "state should be `done`");
 
         return proof;
     }
 
     void on(const prevote_msg& msg) {
+        if (fast_path && (state == state_type::precommit || state == state_type::done)) {
+            on_late_prevote(msg);
+            return;
+        }
         if (state != state_type::prevote && state != state_type::ready_to_precommit) {
             randpa_dlog("Skipping prevote for round ${r}: invalid state: ${s}", ("r", num)("s", static_cast<uint32_t>(state)));
             return;
@@ -105,11 +124,18 @@ public:
                 continue;
             }
             // use msg with a single key
-            add_prevote(prevote_msg(msg.data, { msg_signatures[i] }));
+            add_prevote(prevote_msg(msg.data, { msg_signatures[i] }, { msg_pub_keys[i] }));
         }
     }
 
     void on(const precommit_msg& msg) {
+        if (fast_path && state == state_type::prevote) {
+            // peers which reached the prevote threshold first already precommit
+            if (early_precommits.size() < max_early_precommits()) {
+                early_precommits.push_back(msg);
+            }
+            return;
+        }
         if (state != state_type::precommit && state != state_type::ready_to_precommit) {
             randpa_dlog("Skipping precommit for round ${r}: invalid state: ${s}", ("r", num)("s", static_cast<uint32_t>(state)));
             return;
@@ -124,7 +150,7 @@ public:
                 randpa_dlog("Invalid precommit for round ${num}", ("num", num));
                 continue;
             }
-            auto msg_with_single_key = precommit_msg(msg.data, { msg_signatures[i] });
+            auto msg_with_single_key = precommit_msg(msg.data, { msg_signatures[i] }, { msg_pub_keys[i] });
             add_precommit(msg_with_single_key);
         }
     }
@@ -144,8 +170,16 @@ public:
         proof.round_num = num;
         proof.best_block = best_node->block_id;
 
+        proof.prevotes.reserve(best_node->confirmation_data.size());
+        proof.precommits.reserve(active_bps.size());
         std::transform(best_node->confirmation_data.begin(), best_node->confirmation_data.end(),
             std::back_inserter(proof.prevotes), [](const auto& item) -> prevote_msg { return *item.second; });
+        for (const auto& item : best_node->confirmation_data) {
+            const auto key_index = active_bps.find(item.first);
+            if (key_index != bp_index::npos) {
+                best_prevoters.set(key_index);
+            }
+        }
 
         precommit();
     }
@@ -194,6 +228,47 @@ private:
             add_precommit(msg);
         }
         precommit_bcaster(precommit_msg(precommit, signature_providers));
+
+        auto early = std::move(early_precommits);
+        early_precommits.clear();
+        for (const auto& msg : early) {
+            on(msg);
+        }
+    }
+
+    size_t max_early_precommits() const {
+        return 2 * active_bps.size();
+    }
+
+    /// Prevote arriving after the prevote phase ended early: its producer may precommit the best block
+    /// if the prevote confirms it, as validate_proof() accepts it.
+    void on_late_prevote(const prevote_msg& msg) {
+        if (!best_node) {
+            return; // done by a proof received during prevote
+        }
+        const auto& msg_pub_keys = msg.public_keys();
+        const auto& blocks = msg.data.blocks;
+        const auto confirms_best = msg.data.base_block == best_node->block_id
+            || std::find(blocks.begin(), blocks.end(), best_node->block_id) != blocks.end();
+        if (!confirms_best) {
+            randpa_dlog("Late prevote for round ${r} does not confirm best block ${b}", ("r", num)("b", best_node->block_id));
+            return;
+        }
+
+        for (size_t i = 0; i < msg.signatures.size(); i++) {
+            const auto& key = msg_pub_keys[i];
+            if (!validate_prevote(msg, key) || !best_node->get_active_bp_keys().count(key)) {
+                continue;
+            }
+            const auto key_index = active_bps.find(key);
+            prevoted_keys.set(key_index);
+            best_prevoters.set(key_index);
+            proof.prevotes.push_back(prevote_msg(msg.data, { msg.signatures[i] }, { key }));
+            if (vote_cb) {
+                vote_cb(key, false);
+            }
+            randpa_dlog("Late prevote inserted, round: ${r}, from: ${f}", ("r", num)("f", key));
+        }
     }
 
     bool validate_prevote(const prevote_msg& msg, const public_key_type& key) {
@@ -205,7 +280,13 @@ private:
             return false;
         }
 
-        if (prevoted_keys.count(key)) {
+        const auto key_index = active_bps.find(key);
+        if (key_index == bp_index::npos) {
+            randpa_dlog("Randpa received prevote from not active producer ${p}", ("p", key));
+            return false;
+        }
+
+        if (prevoted_keys.test(key_index)) {
             randpa_dlog("Randpa received prevote second time for key ${k}", ("k", key));
             return false;
         }
@@ -217,7 +298,7 @@ private:
             return false;
         }
 
-        if (!node->active_bp_keys.count(key)) {
+        if (!node->get_active_bp_keys().count(key)) {
             randpa_dlog("Randpa received prevote for block ${b} from not active producer ${p}",
                 ("b", node->block_id)("p", key)
             );
@@ -236,7 +317,13 @@ private:
             return false;
         }
 
-        if (precommited_keys.count(key)) {
+        const auto key_index = active_bps.find(key);
+        if (key_index == bp_index::npos) {
+            randpa_dlog("Randpa received precommit from not active producer ${p}", ("p", key));
+            return false;
+        }
+
+        if (precommited_keys.test(key_index)) {
             randpa_dlog("Randpa received precommit second time for key ${k}", ("k", key));
             return false;
         }
@@ -249,7 +336,7 @@ private:
             return false;
         }
 
-        if (!best_node->has_confirmation(key)) {
+        if (!best_prevoters.test(key_index)) {
             randpa_dlog("Randpa received precommit for block ${b} from not prevoted peer: ${k}",
                 ("b", best_node->block_id)("k", key));
             return false;
@@ -268,7 +355,12 @@ private:
 
         FC_ASSERT(max_prevote_node, "confirmation should be insertable");
 
-        prevoted_keys.insert(key);
+        const auto key_index = active_bps.find(key);
+        FC_ASSERT(key_index != bp_index::npos, "prevote from not active producer");
+        prevoted_keys.set(key_index);
+        if (vote_cb) {
+            vote_cb(key, false);
+        }
         randpa_dlog("Prevote inserted, round: ${r}, from: ${f}, max_confs: ${c}",
                    ("r", num)
                    ("f", key)
@@ -289,8 +381,13 @@ private:
         FC_ASSERT(msg.public_keys().size() == 1, "invalid number of public keys in msg; should be 1");
 
         const auto key = msg.public_keys()[0];
-        precommited_keys.insert(key);
+        const auto key_index = active_bps.find(key);
+        FC_ASSERT(key_index != bp_index::npos, "precommit from not active producer");
+        precommited_keys.set(key_index);
         proof.precommits.push_back(msg);
+        if (vote_cb) {
+            vote_cb(key, true);
+        }
 
         randpa_dlog("Precommit inserted, round: ${r}, from: ${f}",
                    ("r", num)
@@ -321,11 +418,11 @@ private:
     }
 
     static bool is_prevote_threshold_reached(const tree_node_ptr& node) {
-        return node->confirmation_number() > 2 * node->active_bp_keys.size() / 3;
+        return node->confirmation_number() > 2 * node->get_active_bp_keys().size() / 3;
     }
 
     bool is_precommit_threshold_reached() const {
-        return proof.precommits.size() > 2 * best_node->active_bp_keys.size() / 3;
+        return active_bps.is_threshold_reached(precommited_keys);
     }
 };
 
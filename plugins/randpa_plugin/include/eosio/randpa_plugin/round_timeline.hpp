@@ -0,0 +1,100 @@
+#pragma once
+
+#include "types.hpp"
+
+#include <fc/optional.hpp>
+#include <fc/reflect/reflect.hpp>
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+namespace randpa_finality {
+
+/// Milestones of a round as seen by this node, in microseconds since the round started here.
+/// Built by randpa thread while the round is alive, complete once randpa drops the round.
+struct round_timeline {
+    struct voter {
+        public_key_type key;
+        fc::optional<int64_t> prevote_us;
+        fc::optional<int64_t> precommit_us;
+    };
+
+    uint32_t round_num = 0;
+    fc::time_point start;
+    fc::optional<int64_t> first_prevote_us;         ///< first prevote of another producer
+    fc::optional<int64_t> last_prevote_us;
+    fc::optional<int64_t> prevote_threshold_us;
+    fc::optional<int64_t> first_precommit_us;       ///< first precommit of another producer
+    fc::optional<int64_t> last_precommit_us;
+    fc::optional<int64_t> precommit_threshold_us;
+    fc::optional<int64_t> proof_bcast_us;            ///< finality notice of the round broadcast
+    std::vector<voter> voters;                      ///< active producers of the round, by key
+    std::vector<public_key_type> late_prevoters;    ///< prevoted after the threshold or not at all
+    std::vector<public_key_type> late_precommitters; ///< precommitted after the threshold or not at all
+
+    round_timeline() = default;
+    round_timeline(uint32_t round_num, fc::time_point start, const std::set<public_key_type>& active_bp_keys)
+        : round_num(round_num)
+        , start(start)
+    {
+        voters.reserve(active_bp_keys.size());
+        for (const auto& key : active_bp_keys) {
+            voters.push_back(voter { key });
+        }
+    }
+
+    int64_t since_start(fc::time_point t) const {
+        return (t - start).count();
+    }
+
+    /// A vote of `key` accepted by the round at `t`; votes of this node do not move first and last arrivals.
+    void add_vote(const public_key_type& key, bool precommit, fc::time_point t, bool own) {
+        const auto us = since_start(t);
+        auto it = std::lower_bound(voters.begin(), voters.end(), key,
+            [](const voter& v, const public_key_type& k) { return v.key < k; });
+        if (it != voters.end() && it->key == key) {
+            auto& vote_us = precommit ? it->precommit_us : it->prevote_us;
+            if (!vote_us) {
+                vote_us = us;
+            }
+        }
+        if (own) {
+            return;
+        }
+        auto& first = precommit ? first_precommit_us : first_prevote_us;
+        auto& last = precommit ? last_precommit_us : last_prevote_us;
+        if (!first) {
+            first = us;
+        }
+        last = us;
+    }
+
+    /// Fills the late voters once the round is over.
+    void close() {
+        late_prevoters.clear();
+        late_precommitters.clear();
+        for (const auto& v : voters) {
+            if (is_late(v.prevote_us, prevote_threshold_us)) {
+                late_prevoters.push_back(v.key);
+            }
+            if (is_late(v.precommit_us, precommit_threshold_us)) {
+                late_precommitters.push_back(v.key);
+            }
+        }
+    }
+
+private:
+    static bool is_late(const fc::optional<int64_t>& vote_us, const fc::optional<int64_t>& threshold_us) {
+        return !vote_us || (threshold_us && *vote_us > *threshold_us);
+    }
+};
+
+} // namespace randpa_finality
+
+FC_REFLECT(randpa_finality::round_timeline::voter, (key)(prevote_us)(precommit_us))
+FC_REFLECT(randpa_finality::round_timeline, (round_num)(start)
+    (first_prevote_us)(last_prevote_us)(prevote_threshold_us)
+    (first_precommit_us)(last_precommit_us)(precommit_threshold_us)
+    (proof_bcast_us)(voters)(late_prevoters)(late_precommitters))
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "types.hpp"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace randpa_finality {
+
+/// Digests of recently received or broadcasted randpa messages together with the sessions
+/// known to have them. Entries live for `ttl_rounds` rounds after the round of the message.
+/// Used from net threads (dropping duplicates before key recovery) and from randpa thread (relays).
+class seen_messages_cache {
+public:
+    static constexpr uint32_t default_ttl_rounds = 2;
+    static constexpr size_t default_max_size = 64 * 1024;
+
+    explicit seen_messages_cache(uint32_t ttl_rounds = default_ttl_rounds, size_t max_size = default_max_size)
+        : _ttl_rounds(ttl_rounds)
+        , _max_size(max_size)
+    {}
+
+    /// Remember that session `ses_id` has message `digest` of round `round_num`.
+    /// @return true if the message was not seen before
+    bool mark(const digest_type& digest, uint32_t round_num, uint32_t ses_id) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _entries.find(digest);
+        if (it != _entries.end()) {
+            it->second.sessions.insert(ses_id);
+            return false;
+        }
+        if (round_num + _ttl_rounds < _current_round) {
+            // message from expired round: treat as seen, it's useless anyway
+            return false;
+        }
+        insert(digest, round_num).sessions.insert(ses_id);
+        return true;
+    }
+
+    /// Sessions from `sessions` that are not known to have `digest` yet; they are marked as having it.
+    template <typename Sessions>
+    std::vector<uint32_t> take_relay_targets(const digest_type& digest, uint32_t round_num, const Sessions& sessions) {
+        std::vector<uint32_t> targets;
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _entries.find(digest);
+        auto& entry = it != _entries.end() ? it->second : insert(digest, round_num);
+        for (const auto ses_id : sessions) {
+            if (entry.sessions.insert(ses_id).second) {
+                targets.push_back(ses_id);
+            } else {
+                ++_relays_suppressed;
+            }
+        }
+        return targets;
+    }
+
+    /// Drop entries of rounds older than `round_num - ttl_rounds`.
+    void set_current_round(uint32_t round_num) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _current_round = std::max(_current_round, round_num);
+        while (!_by_round.empty() && _by_round.begin()->first + _ttl_rounds < _current_round) {
+            erase_oldest_round();
+        }
+    }
+
+    void count_duplicate() {
+        ++_duplicates_dropped;
+    }
+
+    uint64_t duplicates_dropped() const {
+        return _duplicates_dropped;
+    }
+
+    uint64_t relays_suppressed() const {
+        return _relays_suppressed;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _entries.size();
+    }
+
+private:
+    struct digest_hash {
+        size_t operator()(const digest_type& digest) const {
+            return digest._hash[3];
+        }
+    };
+
+    struct entry_type {
+        std::set<uint32_t> sessions;
+    };
+
+    entry_type& insert(const digest_type& digest, uint32_t round_num) {
+        while (_entries.size() >= _max_size && !_by_round.empty()) {
+            erase_oldest_round();
+        }
+        _by_round[round_num].push_back(digest);
+        return _entries[digest];
+    }
+
+    void erase_oldest_round() {
+        for (const auto& digest : _by_round.begin()->second) {
+            _entries.erase(digest);
+        }
+        _by_round.erase(_by_round.begin());
+    }
+
+    const uint32_t _ttl_rounds;
+    const size_t _max_size;
+    mutable std::mutex _mutex;
+    uint32_t _current_round = 0;
+    std::unordered_map<digest_type, entry_type, digest_hash> _entries;
+    std::map<uint32_t, std::vector<digest_type>> _by_round;
+    std::atomic<uint64_t> _duplicates_dropped { 0 };
+    std::atomic<uint64_t> _relays_suppressed { 0 };
+};
+
+} //namespace randpa_finality
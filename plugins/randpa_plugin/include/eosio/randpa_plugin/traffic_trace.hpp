@@ -0,0 +1,131 @@
+#pragma once
+
+#include "randpa.hpp"
+
+#include <fc/io/raw.hpp>
+
+#include <boost/filesystem/path.hpp>
+
+#include <fstream>
+#include <mutex>
+
+namespace randpa_finality {
+
+/*
+ *   randpa.trace:
+ *   +--------+---------+---------+-----+---------+
+ *   | Header | Entry 1 | Entry 2 | ... | Entry n |
+ *   +--------+---------+---------+-----+---------+
+ *
+ * header:
+ *    packed traffic_trace_header
+ *
+ * each entry:
+ *    uint32_t payload size
+ *    packed traffic_trace_record
+ *
+ * Trace holds everything randpa received: net messages after signature recovery (duplicates are
+ * already dropped) and chain events, in the order they were passed to randpa. Blocks known at the
+ * moment recording started are written first as synced accepted blocks, so trace can be replayed
+ * by a randpa instance started with an empty tree rooted at `lib`.
+ */
+
+struct traffic_trace_header {
+    static constexpr uint32_t trace_magic = 0x52505452; // "RTPR"
+    static constexpr uint32_t current_version = 1;
+
+    uint32_t magic = trace_magic;
+    uint32_t version = current_version;
+    block_id_type lib;
+};
+
+struct traced_net_msg {
+    uint32_t ses_id;
+    randpa_net_msg_data data;
+};
+
+using traffic_trace_event = static_variant<traced_net_msg, randpa_event>;
+
+struct traffic_trace_record {
+    uint64_t time_us; ///< since recording started
+    traffic_trace_event event;
+};
+
+class traffic_trace_writer {
+public:
+    traffic_trace_writer(const boost::filesystem::path& path, const block_id_type& lib)
+        : _file(path.string(), std::ios::out | std::ios::binary | std::ios::trunc)
+    {
+        FC_ASSERT(_file, "cannot open randpa trace file ${p}", ("p", path.string()));
+        const auto header = fc::raw::pack(traffic_trace_header{ traffic_trace_header::trace_magic,
+                                                                traffic_trace_header::current_version, lib });
+        _file.write(header.data(), header.size());
+    }
+
+    traffic_trace_writer(const traffic_trace_writer&) = delete;
+
+    /// Safe to call from any thread; records are written in the order of calls.
+    void append(uint64_t time_us, const traffic_trace_event& event) {
+        const auto payload = fc::raw::pack(traffic_trace_record{ time_us, event });
+        const uint32_t size = payload.size();
+        std::lock_guard<std::mutex> lock(_mutex);
+        _file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        _file.write(payload.data(), payload.size());
+        _records++;
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _file.flush();
+    }
+
+    size_t records() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _records;
+    }
+
+private:
+    std::ofstream _file;
+    size_t _records = 0;
+    mutable std::mutex _mutex;
+};
+
+class traffic_trace_reader {
+public:
+    explicit traffic_trace_reader(const boost::filesystem::path& path)
+        : _file(path.string(), std::ios::in | std::ios::binary)
+    {
+        FC_ASSERT(_file, "cannot open randpa trace file ${p}", ("p", path.string()));
+        fc::raw::unpack(_file, _header);
+        FC_ASSERT(_header.magic == traffic_trace_header::trace_magic, "${p} is not a randpa trace", ("p", path.string()));
+        FC_ASSERT(_header.version == traffic_trace_header::current_version,
+                  "unsupported randpa trace version ${v}", ("v", _header.version));
+    }
+
+    const traffic_trace_header& header() const {
+        return _header;
+    }
+
+    /// @return none at the end of trace; truncated last record (node was killed) is ignored
+    fc::optional<traffic_trace_record> next() {
+        uint32_t size = 0;
+        if (!_file.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+            return {};
+        }
+        std::vector<char> payload(size);
+        if (!_file.read(payload.data(), size)) {
+            return {};
+        }
+        return fc::raw::unpack<traffic_trace_record>(payload);
+    }
+
+private:
+    std::ifstream _file;
+    traffic_trace_header _header;
+};
+
+} //namespace randpa_finality
+
+FC_REFLECT(randpa_finality::traffic_trace_header, (magic)(version)(lib))
+FC_REFLECT(randpa_finality::traced_net_msg, (ses_id)(data))
+FC_REFLECT(randpa_finality::traffic_trace_record, (time_us)(event))
@@ -0,0 +1,208 @@
+///
+/// @file
+/// Append-only storage of RANDPA finality proofs.
+///
+
+#include <eosio/randpa_plugin/proof_log.hpp>
+#include <eosio/randpa_plugin/randpa_logger.hpp>
+
+#include <fc/exception/exception.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+
+namespace randpa_finality {
+
+namespace bfs = boost::filesystem;
+namespace bip = boost::interprocess;
+
+using mutex_guard = std::lock_guard<std::mutex>;
+
+proof_log::proof_log(const bfs::path& dir)
+    : _log_path{dir / "proofs.log"}
+    , _index_path{dir / "proofs.index"}
+{
+    if (!bfs::exists(dir)) {
+        bfs::create_directories(dir);
+    }
+    open();
+}
+
+void proof_log::open() {
+    for (const auto& path : { _log_path, _index_path }) {
+        if (!bfs::exists(path)) {
+            std::ofstream create(path.string(), std::ios::binary);
+        }
+    }
+    _log.open(_log_path.string(), std::ios::in | std::ios::out | std::ios::binary);
+    _index_file.open(_index_path.string(), std::ios::in | std::ios::out | std::ios::binary);
+    FC_ASSERT(_log && _index_file, "cannot open randpa proof log in ${dir}", ("dir", _log_path.parent_path().string()));
+
+    _log_size = bfs::file_size(_log_path);
+    const auto index_size = bfs::file_size(_index_path);
+
+    _index.resize(index_size / sizeof(index_entry));
+    _index_file.read(reinterpret_cast<char*>(_index.data()), _index.size() * sizeof(index_entry));
+
+    // index is written after the log entry, so it may lag behind, but never point past the log end
+    bool valid = index_size % sizeof(index_entry) == 0;
+    uint64_t expected_pos = 0;
+    for (const auto& entry : _index) {
+        if (!valid || entry.pos != expected_pos || entry.pos + sizeof(uint32_t) > _log_size) {
+            valid = false;
+            break;
+        }
+        uint32_t payload_size = 0;
+        _log.seekg(entry.pos);
+        _log.read(reinterpret_cast<char*>(&payload_size), sizeof(payload_size));
+        expected_pos = entry.pos + sizeof(payload_size) + payload_size;
+    }
+    if (!valid || expected_pos != _log_size) {
+        recover_index(_log_size);
+    }
+
+    if (_log_size) {
+        _mapping = bip::file_mapping(_log_path.string().c_str(), bip::read_only);
+        _region = bip::mapped_region(_mapping, bip::read_only);
+    }
+    randpa_ilog("Randpa proof log opened, proofs: ${n}, blocks: [${f}, ${l}]",
+        ("n", _index.size())("f", first_block_num())("l", last_block_num()));
+}
+
+void proof_log::recover_index(uint64_t log_size) {
+    randpa_wlog("Randpa proof log index is inconsistent; rebuilding it from ${f}", ("f", _log_path.string()));
+    _index.clear();
+
+    uint64_t pos = 0;
+    while (pos + sizeof(uint32_t) <= log_size) {
+        uint32_t payload_size = 0;
+        _log.seekg(pos);
+        _log.read(reinterpret_cast<char*>(&payload_size), sizeof(payload_size));
+        if (pos + sizeof(payload_size) + payload_size > log_size) {
+            break;
+        }
+        std::vector<char> payload(payload_size);
+        _log.read(payload.data(), payload.size());
+        try {
+            const auto proof = fc::raw::unpack<proof_type>(payload);
+            _index.push_back({ static_cast<uint32_t>(get_block_num(proof.best_block)), proof.round_num, pos });
+        } catch (const fc::exception& e) {
+            randpa_elog("Corrupted proof at position ${p}: ${e}", ("p", pos)("e", e.to_string()));
+            break;
+        }
+        pos += sizeof(payload_size) + payload_size;
+    }
+
+    // drop a partially written tail
+    _log.close();
+    bfs::resize_file(_log_path, pos);
+    _log.open(_log_path.string(), std::ios::in | std::ios::out | std::ios::binary);
+    _log_size = pos;
+
+    _index_file.close();
+    _index_file.open(_index_path.string(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    _index_file.write(reinterpret_cast<const char*>(_index.data()), _index.size() * sizeof(index_entry));
+    _index_file.flush();
+}
+
+bool proof_log::append(const proof_type& proof) {
+    const auto payload = fc::raw::pack(proof);
+    const auto entry = index_entry { static_cast<uint32_t>(get_block_num(proof.best_block)), proof.round_num, 0 };
+
+    {
+        mutex_guard lock(_mutex);
+        if (!_index.empty() && _index.back().block_num >= entry.block_num) {
+            return false;
+        }
+    }
+
+    // only one writer exists, so the file tail can be written without the lock
+    const uint32_t payload_size = payload.size();
+    _log.seekp(_log_size);
+    _log.write(reinterpret_cast<const char*>(&payload_size), sizeof(payload_size));
+    _log.write(payload.data(), payload.size());
+    _log.flush();
+    FC_ASSERT(_log, "failed to write randpa proof log");
+
+    auto stored = entry;
+    stored.pos = _log_size;
+    _index_file.seekp(0, std::ios::end);
+    _index_file.write(reinterpret_cast<const char*>(&stored), sizeof(stored));
+    _index_file.flush();
+
+    mutex_guard lock(_mutex);
+    _log_size += sizeof(payload_size) + payload_size;
+    _index.push_back(stored);
+    return true;
+}
+
+proof_type proof_log::read_entry(const index_entry& entry) const {
+    // must be called with the lock held
+    if (_region.get_size() < _log_size) {
+        _mapping = bip::file_mapping(_log_path.string().c_str(), bip::read_only);
+        _region = bip::mapped_region(_mapping, bip::read_only);
+    }
+    const char* data = static_cast<const char*>(_region.get_address()) + entry.pos;
+    uint32_t payload_size = 0;
+    memcpy(&payload_size, data, sizeof(payload_size));
+    fc::datastream<const char*> ds(data + sizeof(payload_size), payload_size);
+    proof_type proof;
+    fc::raw::unpack(ds, proof);
+    return proof;
+}
+
+fc::optional<proof_type> proof_log::get_by_block(uint32_t block_num) const {
+    mutex_guard lock(_mutex);
+    auto it = std::lower_bound(_index.begin(), _index.end(), block_num, [](const index_entry& e, uint32_t num) {
+        return e.block_num < num;
+    });
+    if (it == _index.end()) {
+        return {};
+    }
+    return read_entry(*it);
+}
+
+fc::optional<proof_type> proof_log::get_by_round(uint32_t round_num) const {
+    mutex_guard lock(_mutex);
+    auto it = std::lower_bound(_index.begin(), _index.end(), round_num, [](const index_entry& e, uint32_t num) {
+        return e.round_num < num;
+    });
+    if (it == _index.end() || it->round_num != round_num) {
+        return {};
+    }
+    return read_entry(*it);
+}
+
+std::vector<proof_type> proof_log::get_range(uint32_t lower_bound, uint32_t upper_bound, size_t limit) const {
+    mutex_guard lock(_mutex);
+    std::vector<proof_type> result;
+    auto it = std::lower_bound(_index.begin(), _index.end(), lower_bound, [](const index_entry& e, uint32_t num) {
+        return e.block_num < num;
+    });
+    for (; it != _index.end() && result.size() < limit; ++it) {
+        result.push_back(read_entry(*it));
+        // the proof for upper_bound itself is included
+        if (it->block_num >= upper_bound) {
+            break;
+        }
+    }
+    return result;
+}
+
+uint32_t proof_log::first_block_num() const {
+    mutex_guard lock(_mutex);
+    return _index.empty() ? 0 : _index.front().block_num;
+}
+
+uint32_t proof_log::last_block_num() const {
+    mutex_guard lock(_mutex);
+    return _index.empty() ? 0 : _index.back().block_num;
+}
+
+size_t proof_log::size() const {
+    mutex_guard lock(_mutex);
+    return _index.size();
+}
+
+} // namespace randpa_finality
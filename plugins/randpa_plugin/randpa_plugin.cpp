@@ -1,10 +1,15 @@
 #include <eosio/randpa_plugin/randpa_plugin.hpp>
 
 #include <eosio/chain/plugin_interface.hpp>
+#include <eosio/chain/executor_stats.hpp>
+#include <eosio/chain/thread_utils.hpp>
 #include <eosio/http_client_plugin/http_client_plugin.hpp>
+#include <eosio/http_plugin/http_plugin.hpp>
 #include <eosio/randpa_plugin/network_messages.hpp>
 #include <eosio/randpa_plugin/prefix_chain_tree.hpp>
+#include <eosio/randpa_plugin/proof_log.hpp>
 #include <eosio/randpa_plugin/randpa.hpp>
+#include <eosio/randpa_plugin/traffic_trace.hpp>
 #include <eosio/telemetry_plugin/telemetry_plugin.hpp>
 #include <fc/exception/exception.hpp>
 #include <fc/io/json.hpp>
@@ -12,9 +17,12 @@
 #include <fc/smart_ref_impl.hpp>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/circular_buffer.hpp>
 
 #include <atomic>
 #include <chrono>
+#include <fstream>
+#include <mutex>
 #include <queue>
 
 namespace eosio {
@@ -28,13 +36,60 @@ static appbase::abstract_plugin& _randpa_plugin = app().register_plugin<randpa_p
 
 static constexpr uint32_t net_message_types_base = 100;
 
+namespace bfs = boost::filesystem;
+
 class randpa_plugin_impl {
 public:
     randpa _randpa;
 
+    /// Stateless work on incoming messages (key recovery, compact proof expansion) runs on this pool,
+    /// so randpa thread only validates against its state and mutates it.
+    uint16_t _thread_pool_size = 2;
+    fc::optional<named_thread_pool> _thread_pool;
+    std::atomic<uint32_t> _pending_pool_tasks { 0 };
+
+    bfs::path _proofs_dir;
+    std::unique_ptr<proof_log> _proof_log;
+    /// Proofs are written to the log by this thread, not to block randpa one.
+    fc::optional<named_thread_pool> _proof_log_thread;
+
+    uint64_t _reported_relays_suppressed = 0;
+    bool _light_sync = false;
+
+    /// Per message type counters are indexed by randpa_net_msg_data tag.
+    std::array<telemetry::counter_handle, queue_latency_stats::net_types_count> _net_in_cnt;
+    std::array<telemetry::counter_handle, queue_latency_stats::net_types_count> _net_out_cnt;
+    telemetry::counter_handle _net_in_total_cnt;
+    telemetry::counter_handle _net_out_total_cnt;
+    telemetry::counter_handle _net_in_invalid_sig_cnt;
+    telemetry::counter_handle _net_in_duplicate_cnt;
+    telemetry::counter_handle _net_relay_suppressed_cnt;
+    telemetry::counter_handle _net_in_known_votes_cnt;
+
+    /// Milestones of the finished rounds, in microseconds since the start of the round.
+    enum round_milestone {
+        first_prevote, last_prevote, prevote_threshold,
+        first_precommit, last_precommit, precommit_threshold,
+        proof_bcast,
+        round_milestones_count
+    };
+    std::array<telemetry::histogram_handle, round_milestones_count> _round_milestone_hist;
+    telemetry::counter_handle _round_late_prevoters_cnt;
+    telemetry::counter_handle _round_late_precommitters_cnt;
+    /// Timelines of the latest rounds for get_round_timelines, none kept if the capacity is 0.
+    mutable std::mutex _round_timelines_mtx;
+    boost::circular_buffer<round_timeline> _round_timelines { 0 };
+
+    bfs::path _trace_path;
+    std::unique_ptr<traffic_trace_writer> _trace;
+
     channels::irreversible_block::channel_type::handle _on_irb_handle;
     channels::accepted_block::channel_type::handle     _on_accepted_block_handle;
+    channels::accepted_block::channel_type::handle     _on_accepted_block_event_handle;
+    /// signal-async-subscriber = randpa: events are built from the block states on a thread of their own
+    std::shared_ptr<chain::async_subscriber>           _signal_queue;
     net_plugin::new_peer::channel_type::handle         _on_new_peer_handle;
+    net_plugin::peer_closed::channel_type::handle      _on_peer_closed_handle;
 
     //
 
@@ -47,23 +102,116 @@ public:
 
     static std::set<public_key_type> get_bp_keys(block_state_ptr s) {
         std::set<public_key_type> producer_keys;
-        for (const auto& elem : s->active_schedule.producers) {
+        for (const auto& elem : s->active_schedule->producers) {
             producer_keys.insert(elem.block_signing_key);
         }
         return producer_keys;
     }
 
+    /// Counters updated on every message are registered once and updated through handles.
+    void register_net_counters() {
+        auto& telemetry = app().get_plugin<telemetry_plugin>();
+        for (size_t type = 0; type < queue_latency_stats::net_types_count; type++) {
+            _net_in_cnt[type] = telemetry.register_counter(std::string("randpa_net_in_") + queue_latency_stats::type_name(type) + "_cnt");
+            _net_out_cnt[type] = telemetry.register_counter(std::string("randpa_net_out_") + queue_latency_stats::type_name(type) + "_cnt");
+        }
+        _net_in_total_cnt = telemetry.register_counter("randpa_net_in_total_cnt");
+        _net_out_total_cnt = telemetry.register_counter("randpa_net_out_total_cnt");
+        _net_in_invalid_sig_cnt = telemetry.register_counter("randpa_net_in_invalid_sig_cnt");
+        _net_in_duplicate_cnt = telemetry.register_counter("randpa_net_in_duplicate_cnt");
+        _net_relay_suppressed_cnt = telemetry.register_counter("randpa_net_relay_suppressed_cnt");
+        _net_in_known_votes_cnt = telemetry.register_counter("randpa_net_in_known_votes_cnt");
+
+        const std::vector<double> round_keypoints { 10000, 50000, 100000, 250000, 500000, 1000000, 3000000 };
+        const char* milestone_names[] = {
+            "first_prevote", "last_prevote", "prevote_threshold",
+            "first_precommit", "last_precommit", "precommit_threshold",
+            "proof_bcast",
+        };
+        static_assert(sizeof(milestone_names) / sizeof(milestone_names[0]) == round_milestones_count, "name every round milestone");
+        for (size_t i = 0; i < round_milestones_count; i++) {
+            _round_milestone_hist[i] = telemetry.register_histogram(std::string("randpa_round_") + milestone_names[i] + "_us", round_keypoints);
+        }
+        _round_late_prevoters_cnt = telemetry.register_counter("randpa_round_late_prevoters_cnt");
+        _round_late_precommitters_cnt = telemetry.register_counter("randpa_round_late_precommitters_cnt");
+    }
+
+    /// Called by randpa thread for every round it drops.
+    void on_round_timeline(const round_timeline& timeline) {
+        const fc::optional<int64_t>* milestones[] = {
+            &timeline.first_prevote_us, &timeline.last_prevote_us, &timeline.prevote_threshold_us,
+            &timeline.first_precommit_us, &timeline.last_precommit_us, &timeline.precommit_threshold_us,
+            &timeline.proof_bcast_us,
+        };
+        static_assert(sizeof(milestones) / sizeof(milestones[0]) == round_milestones_count, "observe every round milestone");
+        for (size_t i = 0; i < round_milestones_count; i++) {
+            if (*milestones[i]) {
+                _round_milestone_hist[i].observe(**milestones[i]);
+            }
+        }
+        if (!timeline.late_prevoters.empty()) {
+            _round_late_prevoters_cnt.increment(timeline.late_prevoters.size());
+        }
+        if (!timeline.late_precommitters.empty()) {
+            _round_late_precommitters_cnt.increment(timeline.late_precommitters.size());
+        }
+
+        std::lock_guard<std::mutex> g(_round_timelines_mtx);
+        if (_round_timelines.capacity() > 0) {
+            _round_timelines.push_back(timeline);
+        }
+    }
+
     void start() {
+        register_net_counters();
+        _thread_pool.emplace("randpa", _thread_pool_size);
+
         auto in_net_ch = std::make_shared<net_channel>();
         auto out_net_ch = std::make_shared<net_channel>();
         auto ev_ch = std::make_shared<event_channel>();
         auto finality_ch = std::make_shared<finality_channel>();
+        auto proof_ch = std::make_shared<proof_channel>();
+        auto round_timeline_ch = std::make_shared<round_timeline_channel>();
 
         _randpa
             .set_in_net_channel(in_net_ch)
             .set_out_net_channel(out_net_ch)
             .set_event_channel(ev_ch)
-            .set_finality_channel(finality_ch);
+            .set_finality_channel(finality_ch)
+            .set_proof_channel(proof_ch)
+            .set_round_timeline_channel(round_timeline_ch)
+            .set_proof_provider([this](uint32_t round_num) {
+                return _proof_log->get_by_round(round_num);
+            })
+            .set_proof_range_provider([this](uint32_t from_block_num, uint32_t stride, uint32_t limit) {
+                std::vector<proof_type> proofs;
+                auto block_num = from_block_num;
+                while (proofs.size() < limit) {
+                    auto proof = _proof_log->get_by_block(block_num + stride);
+                    if (!proof) {
+                        break;
+                    }
+                    block_num = get_block_num(proof->best_block);
+                    proofs.push_back(std::move(*proof));
+                }
+                return proofs;
+            });
+
+        _proof_log = std::make_unique<proof_log>(_proofs_dir);
+        _proof_log_thread.emplace("rproof", 1);
+        proof_ch->subscribe([this](const proof_type& proof) {
+            boost::asio::post(_proof_log_thread->get_executor(), [this, proof]() {
+                try {
+                    _proof_log->append(proof);
+                } catch (const fc::exception& e) {
+                    randpa_elog("Cannot store proof for block ${b}: ${e}", ("b", proof.best_block)("e", e.to_detail_string()));
+                }
+            });
+        });
+
+        round_timeline_ch->subscribe([this](const round_timeline& timeline) {
+            on_round_timeline(timeline);
+        });
 
         subscribe<handshake_msg>(in_net_ch);
         subscribe<handshake_ans_msg>(in_net_ch);
@@ -72,11 +220,33 @@ public:
         subscribe<proof_msg>(in_net_ch);
         subscribe<finality_notice_msg>(in_net_ch);
         subscribe<finality_req_proof_msg>(in_net_ch);
+        subscribe<handshake_ext_msg>(in_net_ch);
+        subscribe<compact_proof_msg>(in_net_ch);
+        subscribe<finality_req_proofs_msg>(in_net_ch);
+        subscribe<finality_req_proof_range_msg>(in_net_ch);
+        subscribe<proof_range_msg>(in_net_ch);
+
+        _signal_queue = app().get_plugin<chain_plugin>().make_async_subscriber("randpa");
 
+        // metrics read the controller and update telemetry by name: main thread
         _on_accepted_block_handle = app().get_channel<channels::accepted_block>()
-            .subscribe( [ev_ch, this]( block_state_ptr s ) {
+            .subscribe(chain::timed_slot("randpa_metrics", [this](const block_state_ptr& s) {
                 app().get_plugin<telemetry_plugin>().update_gauge("randpa_queue_size", _randpa.get_message_queue().size());
+                app().get_plugin<telemetry_plugin>().update_gauge("randpa_queue_dropped_msgs", _randpa.get_message_queue().dropped());
+                app().get_plugin<telemetry_plugin>().update_gauge("randpa_pool_pending_tasks", _pending_pool_tasks.load());
+                update_queue_latency_gauges();
+                update_seen_messages_metrics();
+                update_round_timing_gauges();
                 app().get_plugin<telemetry_plugin>().update_gauge("head_block_num", app().get_plugin<chain_plugin>().chain().head_block_num());
+                if (_light_sync) {
+                    app().get_plugin<telemetry_plugin>().update_gauge("randpa_light_sync_checkpointed_blocks",
+                                                                      app().get_plugin<chain_plugin>().chain().get_checkpointed_blocks());
+                }
+                app().get_plugin<telemetry_plugin>().update_gauge("lib_block_num", app().get_plugin<chain_plugin>().chain().last_irreversible_block_num());
+            }));
+
+        _on_accepted_block_event_handle = app().get_channel<channels::accepted_block>()
+            .subscribe(chain::subscriber_slot("randpa_accepted_block", _signal_queue, [ev_ch](const block_state_ptr& s) {
                 ev_ch->send(randpa_event { on_accepted_block_event {
                     s->id,
                     s->header.previous,
@@ -84,55 +254,79 @@ public:
                     get_bp_keys(s),
                     is_sync(s)
                 }});
-            });
+            }));
 
         _on_irb_handle = app().get_channel<channels::irreversible_block>()
-            .subscribe( [ev_ch]( block_state_ptr s ) {
-                app().get_plugin<telemetry_plugin>().update_gauge("lib_block_num", s->block_num);
+            .subscribe(chain::subscriber_slot("randpa_irreversible_block", _signal_queue, [ev_ch](const block_state_ptr& s) {
                 ev_ch->send(randpa_event { on_irreversible_event { s->id } });
-            });
+            }));
 
         _on_new_peer_handle = app().get_channel<net_plugin::new_peer>()
             .subscribe( [ev_ch]( uint32_t ses_id ) {
                 ev_ch->send(randpa_event { on_new_peer_event { ses_id } });
             });
 
+        _on_peer_closed_handle = app().get_channel<net_plugin::peer_closed>()
+            .subscribe( [ev_ch]( uint32_t ses_id ) {
+                ev_ch->send(randpa_event { on_peer_closed_event { ses_id } });
+            });
+
         out_net_ch->subscribe([this](const randpa_net_msg& msg) {
-            const auto data = msg.data;
+            const auto& data = msg.data;
+            if (msg.packed) {
+                const auto sends = msg.bcast_ses_ids.size();
+                send(msg.bcast_ses_ids, net_message_types_base + data.which(), msg.packed);
+                if (data.which() < _net_out_cnt.size()) {
+                    _net_out_cnt[data.which()].increment(sends);
+                }
+                _net_out_total_cnt.increment(sends);
+                return;
+            }
             switch (data.which()) {
             case randpa_net_msg_data::tag<prevote_msg>::value:
                 send(msg.ses_id, data.get<prevote_msg>());
-                app().get_plugin<telemetry_plugin>().update_counter("randpa_net_out_prevote_cnt");
                 break;
             case randpa_net_msg_data::tag<precommit_msg>::value:
                 send(msg.ses_id, data.get<precommit_msg>());
-                app().get_plugin<telemetry_plugin>().update_counter("randpa_net_out_precommit_cnt");
                 break;
             case randpa_net_msg_data::tag<proof_msg>::value:
                 send(msg.ses_id, data.get<proof_msg>());
-                app().get_plugin<telemetry_plugin>().update_counter("randpa_net_out_proof_cnt");
                 break;
             case randpa_net_msg_data::tag<handshake_msg>::value:
                 send(msg.ses_id, data.get<handshake_msg>());
-                app().get_plugin<telemetry_plugin>().update_counter("randpa_net_out_handshake_cnt");
                 break;
             case randpa_net_msg_data::tag<handshake_ans_msg>::value:
                 send(msg.ses_id, data.get<handshake_ans_msg>());
-                app().get_plugin<telemetry_plugin>().update_counter("randpa_net_out_handshake_ans_cnt");
                 break;
             case randpa_net_msg_data::tag<finality_notice_msg>::value:
                 send(msg.ses_id, data.get<finality_notice_msg>());
-                app().get_plugin<telemetry_plugin>().update_counter("randpa_net_out_finality_notice_cnt");
                 break;
             case randpa_net_msg_data::tag<finality_req_proof_msg>::value:
                 send(msg.ses_id, data.get<finality_req_proof_msg>());
-                app().get_plugin<telemetry_plugin>().update_counter("randpa_net_out_finality_req_proof_cnt");
+                break;
+            case randpa_net_msg_data::tag<handshake_ext_msg>::value:
+                send(msg.ses_id, data.get<handshake_ext_msg>());
+                break;
+            case randpa_net_msg_data::tag<compact_proof_msg>::value:
+                send(msg.ses_id, data.get<compact_proof_msg>());
+                break;
+            case randpa_net_msg_data::tag<finality_req_proofs_msg>::value:
+                send(msg.ses_id, data.get<finality_req_proofs_msg>());
+                break;
+            case randpa_net_msg_data::tag<finality_req_proof_range_msg>::value:
+                send(msg.ses_id, data.get<finality_req_proof_range_msg>());
+                break;
+            case randpa_net_msg_data::tag<proof_range_msg>::value:
+                send(msg.ses_id, data.get<proof_range_msg>());
                 break;
             default:
                 randpa_wlog("randpa message sent, but handler not found, type: ${type}", ("type", data.which()));
                 break;
             }
-            app().get_plugin<telemetry_plugin>().update_counter("randpa_net_out_total_cnt");
+            if (data.which() < _net_out_cnt.size()) {
+                _net_out_cnt[data.which()].increment();
+            }
+            _net_out_total_cnt.increment();
         });
 
         finality_ch->subscribe([](const block_id_type& block_id) {
@@ -143,29 +337,177 @@ public:
             });
         });
 
+        if (_light_sync) {
+            auto proven_ch = std::make_shared<finality_channel>();
+            proven_ch->subscribe([](const block_id_type& block_id) {
+                app().get_io_service().post([block_id = block_id]() {
+                    app().get_plugin<chain_plugin>()
+                        .chain()
+                        .add_finality_checkpoint(block_id);
+                });
+            });
+            _randpa.set_light_sync(true, proven_ch);
+            app().get_plugin<telemetry_plugin>().add_gauge("randpa_light_sync_checkpointed_blocks");
+        }
+
         app().get_plugin<telemetry_plugin>().add_gauge("randpa_queue_size");
+        app().get_plugin<telemetry_plugin>().add_gauge("randpa_queue_dropped_msgs");
+        app().get_plugin<telemetry_plugin>().add_gauge("randpa_pool_pending_tasks");
+        for (size_t type = 0; type < queue_latency_stats::types_count; type++) {
+            app().get_plugin<telemetry_plugin>().add_gauge(queue_latency_gauge_name(type, "avg"));
+            app().get_plugin<telemetry_plugin>().add_gauge(queue_latency_gauge_name(type, "max"));
+        }
         app().get_plugin<telemetry_plugin>().add_gauge("head_block_num");
         app().get_plugin<telemetry_plugin>().add_gauge("lib_block_num");
+        app().get_plugin<telemetry_plugin>().add_gauge("randpa_seen_messages_size");
+        for (const auto name : round_timing_gauge_names) {
+            app().get_plugin<telemetry_plugin>().add_gauge(name);
+        }
+
+        // the checkpoint may advance the LIB, the tree starts from it
+        restore_checkpoint();
+        auto tree = copy_fork_db();
+        if (!_trace_path.empty()) {
+            start_trace(tree, in_net_ch, ev_ch);
+        }
+        _randpa.start(tree);
+    }
+
+    /// Record everything randpa receives to replay it in the simulator; blocks of `tree` are written
+    /// first, so the trace doesn't depend on the state of this node.
+    void start_trace(const prefix_tree_ptr& tree, const net_channel_ptr& in_net_ch, const event_channel_ptr& ev_ch) {
+        const auto root = tree->get_root();
+        _trace = std::make_unique<traffic_trace_writer>(_trace_path, root->block_id);
+        std::vector<tree_node_ptr> nodes { root };
+        while (!nodes.empty()) {
+            const auto node = nodes.back();
+            nodes.pop_back();
+            for (const auto& child : node->adjacent_nodes) {
+                _trace->append(0, randpa_event { on_accepted_block_event {
+                    child->block_id, node->block_id, child->creator_key, child->get_active_bp_keys(), true
+                }});
+                nodes.push_back(child);
+            }
+        }
+
+        const auto start_time = fc::time_point::now();
+        const auto trace_time = [start_time]() -> uint64_t {
+            return (fc::time_point::now() - start_time).count();
+        };
+        in_net_ch->subscribe([this, trace_time](const randpa_net_msg& msg) {
+            _trace->append(trace_time(), traced_net_msg { msg.ses_id, msg.data });
+        });
+        ev_ch->subscribe([this, trace_time](const randpa_event& event) {
+            _trace->append(trace_time(), event);
+        });
+        randpa_ilog("Recording randpa trace to ${p}", ("p", _trace_path.string()));
+    }
+
+    bfs::path checkpoint_path() const {
+        return _proofs_dir / "randpa.checkpoint";
+    }
+
+    /// Load checkpoint saved on the previous shutdown. A checkpoint whose LIB is not in our chain is
+    /// ignored, and so are the proofs for blocks that are not in it; if the best stored proof is above
+    /// current LIB and valid for the fork database the way received proofs are, the block is finalized
+    /// right away, an invalid one is dropped.
+    void restore_checkpoint() {
+        const auto path = checkpoint_path();
+        if (!bfs::exists(path)) {
+            randpa_ilog("No randpa checkpoint found; will request latest proofs from peers");
+            return;
+        }
+
+        randpa_checkpoint checkpoint;
+        try {
+            std::ifstream in(path.string(), std::ios::binary);
+            std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            checkpoint = fc::raw::unpack<randpa_checkpoint>(data);
+        } catch (const fc::exception& e) {
+            randpa_wlog("Cannot read randpa checkpoint ${p}: ${e}", ("p", path.string())("e", e.to_string()));
+            return;
+        }
+
+        auto& ctrl = app().get_plugin<chain_plugin>().chain();
+        const auto in_chain = [&](const block_id_type& id) {
+            return ctrl.fetch_block_state_by_id(id) || ctrl.fetch_block_by_id(id);
+        };
+        // e.g. the state was restored from a snapshot of another chain since
+        if (checkpoint.lib != block_id_type() && !in_chain(checkpoint.lib)) {
+            randpa_wlog("Ignoring randpa checkpoint ${p}, its LIB ${lib} is not in the chain",
+                ("p", path.string())("lib", checkpoint.lib));
+            return;
+        }
+
+        auto& proofs = checkpoint.last_proofs;
+        proofs.erase(std::remove_if(proofs.begin(), proofs.end(), [&](const proof_type& proof) {
+            return !in_chain(proof.best_block);
+        }), proofs.end());
+
+        if (!proofs.empty() && get_block_num(proofs.front().best_block) > ctrl.last_irreversible_block_num()
+            && !randpa::validate_proof(*copy_fork_db(), proofs.front())) {
+            randpa_wlog("Dropping invalid proof for ${b} from randpa checkpoint", ("b", proofs.front().best_block));
+            proofs.erase(proofs.begin());
+        }
+
+        if (!proofs.empty() && get_block_num(proofs.front().best_block) > ctrl.last_irreversible_block_num()) {
+            const auto& best_block = proofs.front().best_block;
+            randpa_ilog("Finalizing block ${b} from randpa checkpoint", ("b", best_block));
+            try {
+                ctrl.bft_finalize(best_block);
+            } catch (const fc::exception& e) {
+                randpa_wlog("Cannot finalize block from checkpoint: ${e}", ("e", e.to_string()));
+            }
+        }
+        _randpa.restore(checkpoint);
+    }
 
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_in_total_cnt");
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_in_prevote_cnt");
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_in_precommit_cnt");
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_in_proof_cnt");
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_in_handshake_cnt");
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_in_handshake_ans_cnt");
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_in_finality_notice_cnt");
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_in_finality_req_proof_cnt");
+    void save_checkpoint() {
+        try {
+            const auto data = fc::raw::pack(_randpa.get_checkpoint());
+            const auto tmp_path = checkpoint_path().string() + ".tmp";
+            {
+                std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+                out.write(data.data(), data.size());
+                FC_ASSERT(out, "write failed");
+            }
+            bfs::rename(tmp_path, checkpoint_path());
+        } catch (const std::exception& e) {
+            randpa_elog("Cannot save randpa checkpoint: ${e}", ("e", e.what()));
+        }
+    }
 
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_out_total_cnt");
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_out_prevote_cnt");
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_out_precommit_cnt");
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_out_proof_cnt");
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_out_handshake_cnt");
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_out_handshake_ans_cnt");
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_out_finality_notice_cnt");
-        app().get_plugin<telemetry_plugin>().add_counter("randpa_net_out_finality_req_proof_cnt");
+    static std::string queue_latency_gauge_name(size_t type, const char* kind) {
+        return std::string("randpa_queue_latency_") + queue_latency_stats::type_name(type) + "_" + kind + "_us";
+    }
 
-        _randpa.start(copy_fork_db());
+    /// Export enqueue-to-dequeue latency of messages handled since the previous block.
+    void update_queue_latency_gauges() {
+        auto& stats = _randpa.get_queue_latency_stats();
+        for (size_t type = 0; type < queue_latency_stats::types_count; type++) {
+            const auto summary = stats.take(type);
+            if (!summary.count) {
+                continue;
+            }
+            app().get_plugin<telemetry_plugin>().update_gauge(queue_latency_gauge_name(type, "avg"), summary.avg_us);
+            app().get_plugin<telemetry_plugin>().update_gauge(queue_latency_gauge_name(type, "max"), summary.max_us);
+        }
+    }
+
+    static constexpr std::array<const char*, 6> round_timing_gauge_names = {
+        "randpa_prevote_p50_us", "randpa_prevote_p90_us", "randpa_finality_p50_us", "randpa_finality_p90_us",
+        "randpa_prevote_timeout_us", "randpa_stretched_rounds",
+    };
+
+    void update_round_timing_gauges() {
+        const auto summary = _randpa.get_round_timing_stats().get_summary();
+        const std::array<uint64_t, round_timing_gauge_names.size()> values = {
+            summary.prevote_p50_us, summary.prevote_p90_us, summary.finality_p50_us, summary.finality_p90_us,
+            summary.prevote_timeout_us, summary.stretched_rounds,
+        };
+        for (size_t i = 0; i < values.size(); i++) {
+            app().get_plugin<telemetry_plugin>().update_gauge(round_timing_gauge_names[i], values[i]);
+        }
     }
 
     static bool is_sync(const block_state_ptr& block) {
@@ -203,46 +545,194 @@ public:
     }
 
     void stop() {
+        if (_signal_queue) {
+            _signal_queue->stop();
+        }
+        if (_thread_pool) {
+            _thread_pool->stop();
+        }
         _randpa.stop();
+        if (_proof_log_thread) {
+            _proof_log_thread->stop();
+        }
+        if (_proof_log) {
+            save_checkpoint();
+        }
+        if (_trace) {
+            _trace->flush();
+            randpa_ilog("Randpa trace ${p}: ${n} records", ("p", _trace_path.string())("n", _trace->records()));
+        }
+    }
+
+    randpa_plugin::get_proof_results get_proof(const randpa_plugin::get_proof_params& params) const {
+        auto proof = _proof_log->get_by_block(params.block_num);
+        EOS_ASSERT(proof, unknown_block_exception, "no proof found for block ${b}", ("b", params.block_num));
+        return { *proof };
+    }
+
+    randpa_plugin::get_proofs_results get_proofs(const randpa_plugin::get_proofs_params& params) const {
+        const auto limit = std::min<uint32_t>(params.limit, max_proofs_per_request);
+        auto proofs = _proof_log->get_range(params.lower_bound, params.upper_bound, limit + 1);
+        randpa_plugin::get_proofs_results result;
+        if (proofs.size() > limit) {
+            result.more = get_block_num(proofs.back().best_block);
+            proofs.pop_back();
+        }
+        result.proofs = std::move(proofs);
+        return result;
+    }
+
+    static constexpr uint32_t max_proofs_per_request = 1000;
+
+    randpa_plugin::get_round_timelines_results get_round_timelines(const randpa_plugin::get_round_timelines_params& params) const {
+        randpa_plugin::get_round_timelines_results result;
+        std::lock_guard<std::mutex> g(_round_timelines_mtx);
+        const auto count = std::min<size_t>(params.limit, _round_timelines.size());
+        result.timelines.assign(_round_timelines.rbegin(), _round_timelines.rbegin() + count);
+        return result;
     }
 
     template <typename T>
     static void send(uint32_t ses_id, const T& msg) {
-        app().post(priority::high, [ses_id, msg]() {
+        chain::instrumented_post(app(), priority::high, chain::executor_category::net, [ses_id, msg]() {
             app().get_plugin<net_plugin>().send(ses_id, get_net_msg_type(msg), msg);
         });
     }
 
+    /// Send a message packed once by randpa::bcast to all `ses_ids`, in one buffer shared by the peers.
+    static void send(std::vector<uint32_t> ses_ids, uint32_t msg_type, std::shared_ptr<const std::vector<char>> packed) {
+        chain::instrumented_post(app(), priority::high, chain::executor_category::net,
+                                 [ses_ids = std::move(ses_ids), msg_type, packed = std::move(packed)]() {
+            app().get_plugin<net_plugin>().send(ses_ids, msg_type, *packed);
+        });
+    }
+
+    /// Recover signer keys of `msg` and all messages nested into it on the verification pool,
+    /// then pass `msg` to the randpa queue. Every signed part is recovered by a separate task,
+    /// the last finished task forwards the message. Messages with malformed signatures are dropped.
+    /// Votes of a proof this node already received alone are not recovered again.
     template <typename T>
-    static void subscribe(const net_channel_ptr& ch) {
+    void recover_keys_and_send(const net_channel_ptr& ch, uint32_t ses_id, const T& msg) {
+        struct recovery_state {
+            T msg;
+            fc::time_point receive_time;
+            std::atomic<size_t> pending { 0 };
+            std::atomic<bool> failed { false };
+        };
+
+        auto state = std::make_shared<recovery_state>();
+        state->msg = msg;
+        state->receive_time = fc::time_point::now();
+
+        std::vector<std::function<void()>> tasks;
+        for_each_signed_msg(state->msg, [&](const auto& part) {
+            if (std::is_same_v<T, proof_msg> && is_known_vote(part)) {
+                _net_in_known_votes_cnt.increment();
+                return;
+            }
+            tasks.emplace_back([&part, ch, ses_id, state, invalid_sig_cnt = _net_in_invalid_sig_cnt]() {
+                try {
+                    part.public_keys();
+                } catch (const fc::exception&) {
+                    state->failed = true;
+                }
+
+                if (--state->pending > 0) {
+                    return;
+                }
+
+                if (state->failed) {
+                    randpa_dlog("Dropping randpa message with invalid signatures, ses_id: ${s}", ("s", ses_id));
+                    invalid_sig_cnt.increment();
+                    return;
+                }
+                ch->send(randpa_net_msg { ses_id, state->msg, state->receive_time });
+            });
+        });
+
+        state->pending = tasks.size();
+        for (auto& task : tasks) {
+            post_to_pool(std::move(task));
+        }
+    }
+
+    /// Votes of a proof already received alone take their keys from the known votes cache.
+    template <typename T>
+    bool is_known_vote(const network_msg<T>& msg) const {
+        if constexpr (std::is_same_v<T, prevote_type> || std::is_same_v<T, precommit_type>) {
+            return _randpa.get_known_votes()->restore_keys(msg);
+        }
+        return false;
+    }
+
+    /// Compact proof is expanded on the pool and passed to randpa as a regular proof with known keys;
+    /// checking the signers against the schedule is left to proof validation.
+    void recover_keys_and_send(const net_channel_ptr& ch, uint32_t ses_id, const compact_proof_msg& msg) {
+        const auto receive_time = fc::time_point::now();
+        post_to_pool([ch, ses_id, msg, receive_time, invalid_sig_cnt = _net_in_invalid_sig_cnt]() {
+            try {
+                auto proof = expand_compact_proof(msg.data);
+                if (!proof) {
+                    randpa_dlog("Dropping malformed compact proof, ses_id: ${s}", ("s", ses_id));
+                    return;
+                }
+                auto keys = msg.public_keys();
+                ch->send(randpa_net_msg { ses_id,
+                                          proof_msg(std::move(*proof), std::vector<signature_type>(msg.signatures), std::move(keys)),
+                                          receive_time });
+            } catch (const fc::exception&) {
+                randpa_dlog("Dropping randpa message with invalid signatures, ses_id: ${s}", ("s", ses_id));
+                invalid_sig_cnt.increment();
+            }
+        });
+    }
+
+    template <typename Task>
+    void post_to_pool(Task&& task) {
+        ++_pending_pool_tasks;
+        boost::asio::post(_thread_pool->get_executor(), [this, task = std::forward<Task>(task)]() mutable {
+            task();
+            --_pending_pool_tasks;
+        });
+    }
+
+    void update_seen_messages_metrics() {
+        const auto& seen = _randpa.get_seen_messages();
+        const auto suppressed = seen->relays_suppressed();
+        if (suppressed > _reported_relays_suppressed) {
+            _net_relay_suppressed_cnt.increment(suppressed - _reported_relays_suppressed);
+            _reported_relays_suppressed = suppressed;
+        }
+        app().get_plugin<telemetry_plugin>().update_gauge("randpa_seen_messages_size", seen->size());
+    }
+
+    /// Gossiped messages (votes, notices, proofs) already received from any peer are dropped
+    /// before signature recovery; the sender is remembered to not relay the message back.
+    template <typename T>
+    bool is_duplicate(uint32_t ses_id, const T& msg) {
+        if constexpr (std::is_same_v<T, prevote_msg> || std::is_same_v<T, precommit_msg>
+                      || std::is_same_v<T, finality_notice_msg> || std::is_same_v<T, proof_msg>) {
+            const auto& seen = _randpa.get_seen_messages();
+            if (!seen->mark(digest_type::hash(msg), msg.data.round_num, ses_id)) {
+                seen->count_duplicate();
+                _net_in_duplicate_cnt.increment();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename T>
+    void subscribe(const net_channel_ptr& ch) {
         app().get_plugin<net_plugin>().subscribe<T>(
             get_net_msg_type<T>(),
-            [ch](uint32_t ses_id, const T& msg) {
-                ch->send(randpa_net_msg { ses_id, msg, fc::time_point::now() });
-                switch (randpa_net_msg_data::tag<T>::value) {
-                case randpa_net_msg_data::tag<prevote_msg>::value:
-                    app().get_plugin<telemetry_plugin>().update_counter("randpa_net_in_prevote_cnt");
-                    break;
-                case randpa_net_msg_data::tag<precommit_msg>::value:
-                    app().get_plugin<telemetry_plugin>().update_counter("randpa_net_in_precommit_cnt");
-                    break;
-                case randpa_net_msg_data::tag<proof_msg>::value:
-                    app().get_plugin<telemetry_plugin>().update_counter("randpa_net_in_proof_cnt");
-                    break;
-                case randpa_net_msg_data::tag<handshake_msg>::value:
-                    app().get_plugin<telemetry_plugin>().update_counter("randpa_net_in_handshake_cnt");
-                    break;
-                case randpa_net_msg_data::tag<handshake_ans_msg>::value:
-                    app().get_plugin<telemetry_plugin>().update_counter("randpa_net_in_handshake_ans_cnt");
-                    break;
-                case randpa_net_msg_data::tag<finality_notice_msg>::value:
-                    app().get_plugin<telemetry_plugin>().update_counter("randpa_net_in_finality_notice_cnt");
-                    break;
-                case randpa_net_msg_data::tag<finality_req_proof_msg>::value:
-                    app().get_plugin<telemetry_plugin>().update_counter("randpa_net_in_finality_req_proof_cnt");
-                    break;
+            [ch, this](uint32_t ses_id, const T& msg) {
+                if (is_duplicate(ses_id, msg)) {
+                    return;
                 }
-                app().get_plugin<telemetry_plugin>().update_counter("randpa_net_in_total_cnt");
+                recover_keys_and_send(ch, ses_id, msg);
+                _net_in_cnt[randpa_net_msg_data::tag<T>::value].increment();
+                _net_in_total_cnt.increment();
             }
         );
     }
@@ -273,11 +763,52 @@ static signature_provider_type make_keosd_signature_provider(const string& url_s
         fc::variant params;
         fc::to_variant(std::make_pair(digest, pubkey), params);
         auto deadline = fc::time_point::maximum();
-        return app().get_plugin<http_client_plugin>().get_client().post_sync(keosd_url, params, deadline).as<chain::signature_type>();
+        return app().get_plugin<http_client_plugin>().post_sync(keosd_url, params, deadline).as<chain::signature_type>();
     };
 }
 
+void randpa_plugin::set_program_options(options_description& /*cli*/, options_description& cfg) {
+    cfg.add_options()
+        ("randpa-threads", bpo::value<uint16_t>()->default_value(my->_thread_pool_size),
+         "Number of worker threads doing stateless processing of incoming randpa messages (signature recovery, proof expansion)")
+        ("randpa-proofs-dir", bpo::value<bfs::path>()->default_value("randpa-proofs"),
+         "the location of the randpa finality proofs directory (absolute path or relative to application data dir)")
+        ("randpa-trace-file", bpo::value<bfs::path>(),
+         "Record incoming randpa messages and chain events to this file (absolute path or relative to application data dir) "
+         "to replay them in the simulator")
+        ("randpa-adaptive-phases", bpo::value<bool>()->default_value(true),
+         "End the prevote phase of a round as soon as a supermajority prevoted instead of on the next block, "
+         "and extend it past that block by a timeout adapted from the recent rounds when votes are slow")
+        ("randpa-prevote-timeout-max-ms", bpo::value<uint32_t>()->default_value(randpa::default_prevote_timeout_max_ms),
+         "Longest prevote phase with randpa-adaptive-phases, in milliseconds from the start of the round")
+        ("randpa-light-sync", bpo::value<bool>()->default_value(false),
+         "While syncing, fetch the stored finality proofs of the blocks ahead of the head from peers and pass the blocks "
+         "they finalize to the controller as finality checkpoints (the proofs are checked against the active BP schedule)")
+        ("randpa-round-timelines", bpo::value<uint32_t>()->default_value(0),
+         "Number of the latest rounds whose timelines (vote arrivals, thresholds, late voters) are kept for "
+         "/v1/randpa/get_round_timelines, 0 to keep none");
+}
+
 void randpa_plugin::plugin_initialize(const variables_map& options) {
+    auto proofs_dir = options.at("randpa-proofs-dir").as<bfs::path>();
+    my->_proofs_dir = proofs_dir.is_relative() ? app().data_dir() / proofs_dir : proofs_dir;
+
+    if (options.count("randpa-trace-file")) {
+        auto trace_path = options.at("randpa-trace-file").as<bfs::path>();
+        my->_trace_path = trace_path.is_relative() ? app().data_dir() / trace_path : trace_path;
+    }
+
+    if (options.count("randpa-threads")) {
+        my->_thread_pool_size = options.at("randpa-threads").as<uint16_t>();
+        EOS_ASSERT(my->_thread_pool_size > 0, plugin_config_exception,
+                   "randpa-threads ${num} must be greater than 0", ("num", my->_thread_pool_size));
+    }
+
+    my->_light_sync = options.at("randpa-light-sync").as<bool>();
+    my->_round_timelines.set_capacity(options.at("randpa-round-timelines").as<uint32_t>());
+    my->_randpa.set_adaptive_phases(options.at("randpa-adaptive-phases").as<bool>(),
+                                    fc::milliseconds(options.at("randpa-prevote-timeout-max-ms").as<uint32_t>()));
+
     if (options.count("producer-name") > 0) {
         my->_randpa.set_type_block_producer();
     } else {
@@ -321,11 +852,35 @@ void randpa_plugin::plugin_initialize(const variables_map& options) {
     my->_randpa.set_signature_providers(sig_provs, pub_keys);
 }
 
+#define CALL(api_name, api_handle, call_name, http_response_code) \
+{std::string("/v1/" #api_name "/" #call_name), \
+   [api_handle](string, string body, url_response_callback cb) mutable { \
+          try { \
+             if (body.empty()) body = "{}"; \
+             fc::variant result( api_handle->call_name(fc::json::from_string(body).as<randpa_plugin::call_name ## _params>()) ); \
+             cb(http_response_code, std::move(result)); \
+          } catch (...) { \
+             http_plugin::handle_exception(#api_name, #call_name, body, cb); \
+          } \
+       }}
+
 void randpa_plugin::plugin_startup() {
     handle_sighup();
     my->start();
+
+    auto http = app().find_plugin<http_plugin>();
+    if (http && http->get_state() != abstract_plugin::registered) {
+        auto api = my.get();
+        http->add_api({
+            CALL(randpa, api, get_proof, 200),
+            CALL(randpa, api, get_proofs, 200),
+            CALL(randpa, api, get_round_timelines, 200),
+        });
+    }
 }
 
+#undef CALL
+
 void randpa_plugin::plugin_shutdown() {
     my->stop();
 }
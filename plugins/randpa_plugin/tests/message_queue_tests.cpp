@@ -0,0 +1,137 @@
+#include <eosio/randpa_plugin/randpa.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fc/exception/exception.hpp>
+
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using namespace randpa_finality;
+
+using int_queue = message_queue<uint32_t>;
+
+BOOST_AUTO_TEST_SUITE(message_queue_tests)
+
+BOOST_AUTO_TEST_CASE(push_and_drain) try {
+    int_queue queue(4);
+    BOOST_TEST(queue.capacity() == 4);
+    BOOST_TEST(!queue.get_next_msg());
+
+    queue.push_message(1u);
+    queue.push_message(2u);
+    queue.push_message(3u);
+    BOOST_TEST(queue.size() == 3);
+
+    std::vector<int_queue::queued_message> batch;
+    BOOST_TEST(queue.get_next_msgs_wait(batch) == 3);
+    BOOST_TEST(*batch[0].msg == 1);
+    BOOST_TEST(*batch[2].msg == 3);
+    BOOST_TEST(queue.size() == 0);
+
+    // cells are reused after wrap around
+    for (uint32_t i = 0; i < 10; i++) {
+        queue.push_message(i);
+        BOOST_TEST(*queue.get_next_msg() == i);
+    }
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(multiple_producers) try {
+    constexpr uint32_t producers = 4;
+    constexpr uint32_t per_producer = 10000;
+    int_queue queue(64);
+
+    std::vector<std::thread> threads;
+    for (uint32_t p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, p]() {
+            for (uint32_t i = 0; i < per_producer; i++) {
+                queue.push_message(p * per_producer + i);
+            }
+        });
+    }
+
+    std::vector<uint32_t> received;
+    std::vector<int_queue::queued_message> batch;
+    while (received.size() < producers * per_producer) {
+        batch.clear();
+        queue.get_next_msgs_wait(batch);
+        for (const auto& item : batch) {
+            received.push_back(*item.msg);
+        }
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::sort(received.begin(), received.end());
+    std::vector<uint32_t> expected(producers * per_producer);
+    std::iota(expected.begin(), expected.end(), 0);
+    BOOST_TEST(received == expected);
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(full_queue) try {
+    int_queue queue(2);
+    queue.push_message(1u);
+    BOOST_TEST(queue.try_push_message(2u));
+    BOOST_TEST(!queue.try_push_message(3u));
+    BOOST_TEST(queue.dropped() == 1);
+
+    // a producer waits for the consumer to free a cell
+    std::thread producer([&queue]() {
+        queue.push_message(4u);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    BOOST_TEST(*queue.get_next_msg() == 1);
+    producer.join();
+    BOOST_TEST(*queue.get_next_msg() == 2);
+    BOOST_TEST(*queue.get_next_msg() == 4);
+    BOOST_TEST(queue.dropped() == 1);
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(terminate_wakes_consumer) try {
+    int_queue queue;
+    std::thread consumer([&queue]() {
+        BOOST_TEST(!queue.get_next_msg_wait());
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    queue.terminate();
+    consumer.join();
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(wait_until_deadline) try {
+    int_queue queue;
+    std::vector<int_queue::queued_message> batch;
+    const auto start = int_queue::clock_type::now();
+    BOOST_TEST(queue.get_next_msgs_wait_until(batch, start + std::chrono::milliseconds(20)) == 0);
+    BOOST_TEST(int_queue::clock_type::now() - start >= std::chrono::milliseconds(20));
+
+    queue.push_message(7u);
+    BOOST_TEST(queue.get_next_msgs_wait_until(batch, start) == 1);
+    BOOST_TEST(*batch[0].msg == 7);
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(round_timing_tests)
+
+BOOST_AUTO_TEST_CASE(prevote_timeout_follows_samples) try {
+    round_timing_stats stats;
+    const auto min = fc::milliseconds(10);
+    const auto max = fc::milliseconds(250);
+    BOOST_TEST(stats.prevote_timeout(min, max).count() == min.count());
+
+    for (size_t i = 1; i <= round_timing_stats::min_samples; i++) {
+        stats.add_prevote(fc::milliseconds(10 * i));
+    }
+    // 1.5 times the 90th percentile of 10..80 ms
+    BOOST_TEST(stats.prevote_timeout(min, max).count() == 105000);
+    BOOST_TEST(stats.get_summary().prevote_p50_us == 40000u);
+    BOOST_TEST(stats.get_summary().prevote_timeout_us == 105000u);
+
+    for (size_t i = 0; i < round_timing_stats::window; i++) {
+        stats.add_prevote(fc::seconds(1));
+    }
+    BOOST_TEST(stats.prevote_timeout(min, max).count() == max.count());
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,310 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+
+/// Micro-benchmarks of the RANDPA consensus components, outside of a node:
+///
+///   $ ./plugins/randpa_plugin/tests/randpa_bench --samples=20 --keys=21,51,101 --format=json --output=randpa_bench.json
+///
+/// Every benchmark runs for each number of producers and fork shape, and reports the median and minimal time
+/// per operation and the heap allocations per operation.
+
+#include <eosio/randpa_plugin/randpa.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/variant_object.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace randpa_finality;
+
+//---------- allocation counter ----------//
+
+static std::atomic<uint64_t> allocations { 0 };
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+//---------- runner ----------//
+
+struct bench_config {
+    size_t samples = 10;
+    std::vector<size_t> keys { 21, 51, 101 };
+    std::string format = "text"; ///< text | json
+    std::string output;          ///< stdout if empty
+};
+
+struct bench_result {
+    std::string name;
+    size_t keys = 0;
+    std::string shape;
+    size_t ops_per_sample = 0;
+    double ns_per_op_p50 = 0;
+    double ns_per_op_min = 0;
+    double allocs_per_op = 0;
+};
+
+/// Fork shape of the synthetic chain: `branches` forks growing from the root in turn.
+struct fork_shape {
+    std::string name;
+    size_t branches;
+};
+
+static const std::vector<fork_shape> fork_shapes {
+    { "linear", 1 },
+    { "forks_4", 4 },
+};
+
+/// Block with number `num` on `branch`; the number is stored in the first word as in real block ids.
+static block_id_type make_block_id(uint32_t num, size_t branch) {
+    auto id = fc::sha256::hash(std::to_string(branch) + "/" + std::to_string(num));
+    id._hash[0] = fc::endian_reverse_u32(num);
+    return id;
+}
+
+/// `sample` does its setup and returns the time of the `ops_per_sample` operations only, with their allocations in its argument.
+template <typename F>
+bench_result run(const bench_config& config, const std::string& name, size_t keys, const fork_shape& shape,
+                 size_t ops_per_sample, F&& sample) {
+    uint64_t allocs = 0;
+    sample(allocs); // warmup
+    allocs = 0;
+    std::vector<double> ns_per_op;
+    for (size_t i = 0; i < config.samples; i++) {
+        uint64_t sample_allocs = 0;
+        const auto elapsed = sample(sample_allocs);
+        ns_per_op.push_back(std::chrono::duration<double, std::nano>(elapsed).count() / ops_per_sample);
+        allocs += sample_allocs;
+    }
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+    return { name, keys, shape.name, ops_per_sample, ns_per_op[ns_per_op.size() / 2], ns_per_op.front(),
+             double(allocs) / (ops_per_sample * config.samples) };
+}
+
+/// Times `f`, counting the allocations it does into `allocs`.
+template <typename F>
+std::chrono::nanoseconds measure(uint64_t& allocs, F&& f) {
+    const auto allocs_before = allocations.load();
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    allocs = allocations.load() - allocs_before;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+}
+
+//---------- fixture ----------//
+
+/// Producers signing prevotes and precommits, and a tree of their blocks.
+struct producers {
+    std::vector<private_key_type> priv_keys;
+    std::vector<public_key_type> pub_keys;
+    bp_keys_type bp_keys;
+
+    explicit producers(size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            priv_keys.push_back(private_key_type::generate());
+            pub_keys.push_back(priv_keys.back().get_public_key());
+            bp_keys.insert(pub_keys.back());
+        }
+    }
+
+    signature_provider_type signature_provider(size_t i) const {
+        return [key = priv_keys[i]](const digest_type& digest) { return key.sign(digest); };
+    }
+
+    /// Inserts `blocks` blocks in turn on the branches of `shape`, producers taking turns as well.
+    void insert_blocks(prefix_tree& tree, const fork_shape& shape, size_t blocks) const {
+        const auto root_id = tree.get_root()->block_id;
+        std::vector<block_id_type> heads(shape.branches, root_id);
+        for (size_t i = 0; i < blocks; i++) {
+            const auto branch = i % shape.branches;
+            const auto num = static_cast<uint32_t>(get_block_num(root_id) + i / shape.branches + 1);
+            const auto id = make_block_id(num, branch);
+            tree.insert({ heads[branch], { id } }, pub_keys[i % pub_keys.size()], bp_keys);
+            heads[branch] = id;
+        }
+    }
+
+    prefix_tree_ptr make_tree() const {
+        return std::make_shared<prefix_tree>(std::make_unique<tree_node>(tree_node { make_block_id(1, 0) }));
+    }
+};
+
+/// Blocks in a round, 2 producers slots.
+static constexpr size_t round_blocks = 24;
+
+//---------- benchmarks ----------//
+
+/// Accepted blocks of 50 rounds, one by one.
+static bench_result bench_tree_insert(const bench_config& config, const producers& bps, const fork_shape& shape) {
+    const size_t blocks = 50 * round_blocks;
+    return run(config, "prefix_chain_tree::insert", bps.pub_keys.size(), shape, blocks, [&](uint64_t& allocs) {
+        auto tree = bps.make_tree();
+        return measure(allocs, [&] { bps.insert_blocks(*tree, shape, blocks); });
+    });
+}
+
+/// Prevotes of every producer for a round over a tree of `round_blocks` blocks, producer i voting for branch i.
+static bench_result bench_round_prevote(const bench_config& config, const producers& bps, const fork_shape& shape) {
+    auto tree = bps.make_tree();
+    bps.insert_blocks(*tree, shape, round_blocks);
+    const uint32_t round_num = 1;
+
+    std::vector<prevote_msg> prevotes;
+    for (size_t i = 0; i < bps.pub_keys.size(); i++) {
+        const auto head = make_block_id(get_block_num(tree->get_root()->block_id) + round_blocks / shape.branches,
+                                        i % shape.branches);
+        auto chain = tree->get_branch(head);
+        prevotes.emplace_back(prevote_type { round_num, chain.base_block, std::move(chain.blocks) },
+                              std::vector<signature_provider_type> { bps.signature_provider(i) });
+        prevotes.back().public_keys(); // recovered by the network thread in the node
+    }
+
+    return run(config, "randpa_round::on(prevote_msg)", bps.pub_keys.size(), shape, prevotes.size(), [&](uint64_t& allocs) {
+        tree->remove_confirmations();
+        randpa_round round(round_num, bps.pub_keys[0], tree, bps.bp_keys, {},
+                           [](const prevote_msg&) {}, [](const precommit_msg&) {}, [] {});
+        return measure(allocs, [&] {
+            for (const auto& msg : prevotes) {
+                round.on(msg);
+            }
+        });
+    });
+}
+
+/// A proof of the head of the first branch: prevotes of every producer, precommits of a supermajority.
+static bench_result bench_validate_proof(const bench_config& config, const producers& bps, const fork_shape& shape) {
+    auto tree = bps.make_tree();
+    bps.insert_blocks(*tree, shape, round_blocks);
+    const auto best_block = make_block_id(get_block_num(tree->get_root()->block_id) + round_blocks / shape.branches, 0);
+    auto chain = tree->get_branch(best_block);
+
+    const size_t proofs = 100;
+    proof_type proof { 1, best_block };
+    const auto prevote = prevote_type { 1, chain.base_block, chain.blocks };
+    const auto precommit = precommit_type { 1, best_block };
+    for (size_t i = 0; i < bps.pub_keys.size(); i++) {
+        proof.prevotes.emplace_back(prevote, std::vector<signature_provider_type> { bps.signature_provider(i) });
+        proof.prevotes.back().public_keys();
+        if (i <= 2 * bps.pub_keys.size() / 3) {
+            proof.precommits.emplace_back(precommit, std::vector<signature_provider_type> { bps.signature_provider(i) });
+            proof.precommits.back().public_keys();
+        }
+    }
+    FC_ASSERT(randpa::validate_proof(*tree, proof), "benchmark proof should be valid");
+
+    return run(config, "randpa::validate_proof", bps.pub_keys.size(), shape, proofs, [&](uint64_t& allocs) {
+        return measure(allocs, [&] {
+            for (size_t i = 0; i < proofs; i++) {
+                randpa::validate_proof(*tree, proof);
+            }
+        });
+    });
+}
+
+//---------- output ----------//
+
+static void write_text(std::ostream& out, const std::vector<bench_result>& results) {
+    out << std::left << std::setw(32) << "benchmark" << std::setw(6) << "keys" << std::setw(10) << "shape"
+        << std::right << std::setw(14) << "ns/op (p50)" << std::setw(14) << "ns/op (min)" << std::setw(12) << "allocs/op"
+        << std::endl;
+    for (const auto& r : results) {
+        out << std::left << std::setw(32) << r.name << std::setw(6) << r.keys << std::setw(10) << r.shape
+            << std::right << std::fixed << std::setprecision(1)
+            << std::setw(14) << r.ns_per_op_p50 << std::setw(14) << r.ns_per_op_min << std::setw(12) << r.allocs_per_op
+            << std::endl;
+    }
+}
+
+static void write_json(std::ostream& out, const bench_config& config, const std::vector<bench_result>& results) {
+    std::vector<fc::variant> benchmarks;
+    for (const auto& r : results) {
+        benchmarks.emplace_back(fc::mutable_variant_object()
+            ("name", r.name)("keys", r.keys)("shape", r.shape)("ops_per_sample", r.ops_per_sample)
+            ("ns_per_op_p50", r.ns_per_op_p50)("ns_per_op_min", r.ns_per_op_min)("allocs_per_op", r.allocs_per_op));
+    }
+    out << fc::json::to_pretty_string(fc::mutable_variant_object()
+        ("samples", config.samples)
+        ("benchmarks", benchmarks)) << std::endl;
+}
+
+/// Parse `--key=value` options.
+static bench_config parse_args(int argc, char** argv) {
+    bench_config config;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const auto eq = arg.find('=');
+        const auto key = arg.substr(0, eq);
+        const auto value = eq == std::string::npos ? std::string() : arg.substr(eq + 1);
+        if (key == "--samples") {
+            config.samples = std::max<size_t>(std::stoul(value), 1);
+        } else if (key == "--keys") {
+            config.keys.clear();
+            std::stringstream ss(value);
+            for (std::string item; std::getline(ss, item, ',');) {
+                config.keys.push_back(std::stoul(item));
+            }
+        } else if (key == "--format") {
+            config.format = value;
+        } else if (key == "--output") {
+            config.output = value;
+        } else {
+            std::cerr << "unknown option " << arg << std::endl;
+            std::exit(1);
+        }
+    }
+    return config;
+}
+
+int main(int argc, char** argv) {
+    const auto config = parse_args(argc, argv);
+    fc::logger::get(DEFAULT_LOGGER).set_log_level(fc::log_level::off);
+    randpa_logger.set_log_level(fc::log_level::off);
+
+    std::vector<bench_result> results;
+    for (const auto keys : config.keys) {
+        FC_ASSERT(keys > 0 && keys <= bp_index::max_producers, "keys should be in [1, ${max}]", ("max", bp_index::max_producers));
+        const producers bps(keys);
+        for (const auto& shape : fork_shapes) {
+            results.push_back(bench_tree_insert(config, bps, shape));
+            results.push_back(bench_round_prevote(config, bps, shape));
+            results.push_back(bench_validate_proof(config, bps, shape));
+        }
+    }
+
+    std::ofstream file;
+    if (!config.output.empty()) {
+        file.open(config.output, std::ios::out | std::ios::trunc);
+    }
+    std::ostream& out = config.output.empty() ? std::cout : file;
+    if (config.format == "json") {
+        write_json(out, config, results);
+    } else {
+        write_text(out, results);
+    }
+    return 0;
+}
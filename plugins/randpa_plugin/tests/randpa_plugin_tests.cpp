@@ -1,5 +1,12 @@
 #include <eosio/randpa_plugin/prefix_chain_tree.hpp>
 #include <eosio/randpa_plugin/network_messages.hpp>
+#include <eosio/randpa_plugin/bp_index.hpp>
+#include <eosio/randpa_plugin/compact_proof.hpp>
+#include <eosio/randpa_plugin/proof_log.hpp>
+#include <eosio/randpa_plugin/seen_messages.hpp>
+#include <eosio/randpa_plugin/known_votes.hpp>
+#include <eosio/randpa_plugin/round_timeline.hpp>
+#include <fc/filesystem.hpp>
 #include <fc/crypto/sha256.hpp>
 #include <boost/test/unit_test.hpp>
 #include <eosio/testing/tester.hpp>
@@ -118,6 +125,38 @@ BOOST_AUTO_TEST_CASE(prefix_chain_internal) try {
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_AUTO_TEST_CASE(prefix_chain_set_root_prunes) try {
+    auto lib_block_id = fc::sha256("beef");
+    prefix_tree tree(std::make_unique<tree_node>(tree_node{lib_block_id}));
+    auto pub_key = get_pub_key();
+    std::set<public_key_type> bp_keys { pub_key };
+
+    // long chain beef -> 0 -> 1 -> ... and a fork beef -> x
+    block_ids_type long_chain;
+    for (int i = 0; i < 10000; i++) {
+        long_chain.push_back(fc::sha256::hash(std::to_string(i)));
+    }
+    tree.insert({lib_block_id, long_chain}, pub_key, bp_keys);
+    tree.insert({lib_block_id, {fc::sha256("x")}}, pub_key, bp_keys);
+    BOOST_REQUIRE_EQUAL(10002, tree.size());
+
+    // equal BP sets are shared between nodes
+    BOOST_TEST(tree.find(long_chain[0])->active_bp_keys == tree.find(fc::sha256("x"))->active_bp_keys);
+    BOOST_TEST(tree.find(long_chain[0])->get_active_bp_keys() == bp_keys);
+    BOOST_TEST(tree.get_root()->get_active_bp_keys().empty());
+
+    tree.set_root(tree.find(long_chain[5000]));
+    BOOST_REQUIRE_EQUAL(5000, tree.size());
+    BOOST_TEST(!tree.find(lib_block_id));
+    BOOST_TEST(!tree.find(fc::sha256("x")));
+    BOOST_TEST(tree.find(long_chain.back()));
+
+    // root unknown to the tree
+    tree.set_root(std::make_shared<tree_node>(tree_node{fc::sha256("y")}));
+    BOOST_REQUIRE_EQUAL(1, tree.size());
+    BOOST_TEST(tree.find(fc::sha256("y")) == tree.get_root());
+} FC_LOG_AND_RETHROW()
+
 BOOST_AUTO_TEST_SUITE_END()
 
 
@@ -216,6 +255,229 @@ BOOST_AUTO_TEST_CASE(precommit_validate_fail) try {
 
 BOOST_AUTO_TEST_SUITE_END()
 
+BOOST_AUTO_TEST_SUITE(signature_recovery_tests)
+
+BOOST_AUTO_TEST_CASE(proof_signed_parts) try {
+    auto priv_key = private_key::generate();
+    std::vector<signature_provider_type> sig_provs {make_key_signature_provider(priv_key)};
+
+    auto prevote = prevote_msg(prevote_type { 0, fc::sha256("a"), { fc::sha256("b") } }, sig_provs);
+    auto precommit = precommit_msg(precommit_type { 0, fc::sha256("b") }, sig_provs);
+    auto proof = proof_msg(proof_type { 0, fc::sha256("b"), { prevote, prevote }, { precommit } }, sig_provs);
+
+    size_t parts = 0;
+    for_each_signed_msg(proof, [&](const auto& part) {
+        BOOST_TEST(!part.has_public_keys());
+        BOOST_TEST(part.public_keys() == std::vector<public_key>{ priv_key.get_public_key() });
+        BOOST_TEST(part.has_public_keys());
+        ++parts;
+    });
+    BOOST_TEST(parts == 4);
+
+    // recovered keys survive a copy
+    auto proof_copy = proof;
+    BOOST_TEST(proof_copy.data.prevotes[1].has_public_keys());
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(known_public_keys) try {
+    auto priv_key = private_key::generate();
+    std::vector<signature_provider_type> sig_provs {make_key_signature_provider(priv_key)};
+    auto msg = precommit_msg(precommit_type { 0, fc::sha256("a") }, sig_provs);
+
+    auto single = precommit_msg(msg.data, { msg.signatures[0] }, { priv_key.get_public_key() });
+    BOOST_TEST(single.has_public_keys());
+    BOOST_TEST(single.validate({ priv_key.get_public_key() }));
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(bp_index_tests)
+
+BOOST_AUTO_TEST_CASE(bp_index_threshold) try {
+    std::set<public_key_type> keys;
+    for (int i = 0; i < 21; i++) {
+        keys.insert(get_pub_key());
+    }
+    const auto index = bp_index(keys);
+    BOOST_REQUIRE_EQUAL(21, index.size());
+    BOOST_TEST(index.find(get_pub_key()) == bp_index::npos);
+
+    bp_index::voters_type voters;
+    int expected_index = 0;
+    for (const auto& key : keys) {
+        BOOST_TEST(index.find(key) == expected_index++);
+        voters.set(index.find(key));
+        BOOST_TEST(index.is_threshold_reached(voters) == (voters.count() >= 15));
+    }
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(compact_proof_tests)
+
+BOOST_AUTO_TEST_CASE(compact_proof_roundtrip) try {
+    std::vector<private_key> priv_keys;
+    std::set<public_key_type> bp_keys;
+    for (int i = 0; i < 4; i++) {
+        priv_keys.push_back(private_key::generate());
+        bp_keys.insert(priv_keys.back().get_public_key());
+    }
+    const auto active_bps = bp_index(bp_keys);
+
+    auto prevote = prevote_type { 1, fc::sha256("a"), { fc::sha256("b") } };
+    auto precommit = precommit_type { 1, fc::sha256("b") };
+    proof_type proof { 1, fc::sha256("b") };
+    for (size_t i = 0; i < priv_keys.size(); i++) {
+        proof.prevotes.emplace_back(prevote, std::vector<signature_provider_type>{ make_key_signature_provider(priv_keys[i]) });
+        if (i != 0) {
+            proof.precommits.emplace_back(precommit, std::vector<signature_provider_type>{ make_key_signature_provider(priv_keys[i]) });
+        }
+    }
+
+    auto compact = make_compact_proof(proof, active_bps);
+    BOOST_REQUIRE(compact);
+    BOOST_TEST(compact->prevote_signatures.size() == 4);
+    BOOST_TEST(compact->precommit_signatures.size() == 3);
+    BOOST_TEST(fc::raw::pack_size(*compact) < fc::raw::pack_size(proof));
+
+    auto restored = expand_compact_proof(*compact, active_bps);
+    BOOST_REQUIRE(restored);
+    BOOST_TEST(restored->prevotes.size() == 4);
+    BOOST_TEST(restored->precommits.size() == 3);
+    for (const auto& msg : restored->precommits) {
+        BOOST_TEST(active_bps.find(msg.public_keys()[0]) != bp_index::npos);
+    }
+
+    // signatures must match the bitmap
+    std::swap(compact->prevote_signatures[0], compact->prevote_signatures[1]);
+    BOOST_TEST(!expand_compact_proof(*compact, active_bps));
+
+    // prevotes with different payloads cannot be compacted
+    proof.prevotes[0].data.blocks.push_back(fc::sha256("c"));
+    BOOST_TEST(!make_compact_proof(proof, active_bps));
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(proof_log_tests)
+
+static block_id_type make_block_id(uint32_t num) {
+    auto id = fc::sha256::hash(std::to_string(num));
+    id._hash[0] = fc::endian_reverse_u32(num);
+    return id;
+}
+
+BOOST_AUTO_TEST_CASE(proof_log_append_and_read) try {
+    fc::temp_directory tempdir;
+    const auto dir = tempdir.path() / "proofs";
+    {
+        proof_log log(dir);
+        for (uint32_t num : { 10, 20, 30 }) {
+            BOOST_TEST(log.append(proof_type { num / 2, make_block_id(num) }));
+        }
+        BOOST_TEST(!log.append(proof_type { 1, make_block_id(5) }));
+        BOOST_TEST(log.size() == 3);
+
+        BOOST_TEST(log.get_by_block(1)->best_block == make_block_id(10));
+        BOOST_TEST(log.get_by_block(11)->best_block == make_block_id(20));
+        BOOST_TEST(log.get_by_block(30)->best_block == make_block_id(30));
+        BOOST_TEST(!log.get_by_block(31));
+        BOOST_TEST(log.get_by_round(10)->best_block == make_block_id(20));
+        BOOST_TEST(!log.get_by_round(11));
+        BOOST_TEST(log.get_range(11, 25, 10).size() == 2);
+        BOOST_TEST(log.get_range(0, 100, 2).size() == 2);
+    }
+
+    // partially written entry is dropped on reopen
+    {
+        std::ofstream tail((dir / "proofs.log").string(), std::ios::binary | std::ios::app);
+        const uint32_t size = 100;
+        tail.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    }
+    proof_log log(dir);
+    BOOST_TEST(log.size() == 3);
+    BOOST_TEST(log.last_block_num() == 30);
+    BOOST_TEST(log.append(proof_type { 20, make_block_id(40) }));
+    BOOST_TEST(log.get_by_block(31)->best_block == make_block_id(40));
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(seen_messages_tests)
+
+BOOST_AUTO_TEST_CASE(duplicates_and_relay_targets) try {
+    seen_messages_cache cache;
+    const auto digest = fc::sha256("a");
+    BOOST_TEST(cache.mark(digest, 10, 1));
+    BOOST_TEST(!cache.mark(digest, 10, 2));
+
+    const auto targets = cache.take_relay_targets(digest, 10, std::vector<uint32_t>{1, 2, 3, 4});
+    BOOST_TEST(targets == std::vector<uint32_t>({3, 4}));
+    BOOST_TEST(cache.relays_suppressed() == 2);
+    BOOST_TEST(cache.take_relay_targets(digest, 10, std::vector<uint32_t>{3, 4}).empty());
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(entries_expire_with_rounds) try {
+    seen_messages_cache cache(2);
+    BOOST_TEST(cache.mark(fc::sha256("a"), 10, 1));
+    BOOST_TEST(cache.mark(fc::sha256("b"), 11, 1));
+    cache.set_current_round(12);
+    BOOST_TEST(cache.size() == 2);
+    cache.set_current_round(13);
+    BOOST_TEST(cache.size() == 1);
+    // too old to be useful
+    BOOST_TEST(!cache.mark(fc::sha256("c"), 10, 1));
+    BOOST_TEST(cache.size() == 1);
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(known_votes_tests)
+
+BOOST_AUTO_TEST_CASE(keys_of_received_votes) try {
+    known_votes_cache cache;
+    const auto priv_key = private_key::generate();
+    const std::vector<signature_provider_type> providers { make_key_signature_provider(priv_key) };
+    const auto prevote = prevote_type { 10, fc::sha256("a"), { fc::sha256("b") } };
+
+    const auto received = prevote_msg(prevote, providers);
+    received.public_keys();
+    cache.add(received);
+
+    // the same vote, as a part of a proof
+    const auto in_proof = prevote_msg(prevote, std::vector<signature_type>(received.signatures));
+    BOOST_TEST(!in_proof.has_public_keys());
+    BOOST_TEST(cache.restore_keys(in_proof));
+    BOOST_TEST(in_proof.has_public_keys());
+    BOOST_TEST(in_proof.public_keys() == std::vector<public_key_type>({ priv_key.get_public_key() }));
+    BOOST_TEST(cache.hits() == 1);
+
+    // same signature over other data is recovered as usual
+    const auto forged = prevote_msg(prevote_type { 10, fc::sha256("a"), {} }, std::vector<signature_type>(received.signatures));
+    BOOST_TEST(!cache.restore_keys(forged));
+    BOOST_TEST(!forged.has_public_keys());
+
+    const auto precommit = precommit_msg(precommit_type { 10, fc::sha256("b") }, std::vector<signature_type>(received.signatures));
+    BOOST_TEST(!cache.restore_keys(precommit));
+    BOOST_TEST(cache.misses() == 2);
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(entries_expire_with_rounds) try {
+    known_votes_cache cache(2);
+    const std::vector<signature_provider_type> providers { make_key_signature_provider(private_key::generate()) };
+    const auto old_vote = precommit_msg(precommit_type { 10, fc::sha256("a") }, providers);
+    old_vote.public_keys();
+    cache.add(old_vote);
+    BOOST_TEST(cache.size() == 1);
+    cache.set_current_round(13);
+    BOOST_TEST(cache.size() == 0);
+    // too old to be useful
+    cache.add(old_vote);
+    BOOST_TEST(cache.size() == 0);
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
+
 BOOST_AUTO_TEST_SUITE(last_inserted_block_test)
 
 BOOST_AUTO_TEST_CASE(get_last_inserted_block) try {
@@ -258,3 +520,35 @@ BOOST_AUTO_TEST_CASE(remove_confirmations_test) try {
 } FC_LOG_AND_RETHROW()
 
 BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(round_timeline_tests)
+
+BOOST_AUTO_TEST_CASE(round_timeline_late_voters) try {
+    const auto own_key = get_pub_key();
+    const auto fast_key = get_pub_key();
+    const auto slow_key = get_pub_key();
+    const auto silent_key = get_pub_key();
+    const auto start = fc::time_point::now();
+    round_timeline timeline(7, start, { own_key, fast_key, slow_key, silent_key });
+
+    timeline.add_vote(own_key, false, start, true);
+    timeline.add_vote(fast_key, false, start + fc::milliseconds(10), false);
+    timeline.prevote_threshold_us = timeline.since_start(start + fc::milliseconds(10));
+    timeline.add_vote(slow_key, false, start + fc::milliseconds(30), false);
+    timeline.add_vote(own_key, true, start + fc::milliseconds(40), true);
+    timeline.add_vote(fast_key, true, start + fc::milliseconds(50), false);
+    timeline.precommit_threshold_us = timeline.since_start(start + fc::milliseconds(50));
+    timeline.close();
+
+    BOOST_TEST(*timeline.first_prevote_us == 10000);
+    BOOST_TEST(*timeline.last_prevote_us == 30000);
+    BOOST_TEST(*timeline.first_precommit_us == 50000);
+    BOOST_TEST(*timeline.last_precommit_us == 50000);
+    BOOST_TEST(timeline.late_prevoters.size() == 2);  // slow and silent
+    BOOST_TEST(timeline.late_precommitters.size() == 2);
+    BOOST_TEST(std::count(timeline.late_prevoters.begin(), timeline.late_prevoters.end(), slow_key) == 1);
+    BOOST_TEST(std::count(timeline.late_prevoters.begin(), timeline.late_prevoters.end(), own_key) == 0);
+    BOOST_TEST(std::count(timeline.late_precommitters.begin(), timeline.late_precommitters.end(), silent_key) == 1);
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
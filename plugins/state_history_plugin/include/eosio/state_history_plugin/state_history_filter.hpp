@@ -0,0 +1,202 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/state_history_plugin/state_history_plugin.hpp>
+
+namespace eosio {
+
+/*
+ * Filters of the traces and deltas sent by get_blocks_request_v1. They walk the serialized entries, skipping the
+ * fields they do not look at, and copy the matching transaction traces and rows as they are.
+ */
+namespace history_filter {
+
+using stream = fc::datastream<const char*>;
+using span   = std::pair<const char*, size_t>;
+
+inline uint32_t read_varuint(stream& ds) {
+   fc::unsigned_int v;
+   fc::raw::unpack(ds, v);
+   return v.value;
+}
+
+template <typename T>
+T read(stream& ds) {
+   T v;
+   fc::raw::unpack(ds, v);
+   return v;
+}
+
+inline void skip(stream& ds, uint64_t size) {
+   EOS_ASSERT(ds.remaining() >= size, chain::plugin_exception, "truncated state history entry");
+   ds.skip(size);
+}
+
+inline void skip_bytes(stream& ds) { skip(ds, read_varuint(ds)); }
+
+inline void skip_optional(stream& ds, uint64_t size) {
+   if (read<bool>(ds))
+      skip(ds, size);
+}
+
+inline void skip_optional_bytes(stream& ds) {
+   if (read<bool>(ds))
+      skip_bytes(ds);
+}
+
+inline void check_version(stream& ds, const char* type) {
+   auto v = read_varuint(ds);
+   EOS_ASSERT(v == 0, chain::plugin_exception, "unsupported ${t} version ${v}", ("t", type)("v", v));
+}
+
+inline bool matches(const std::vector<action_filter>& filters, uint64_t receiver, uint64_t action) {
+   for (auto& f : filters) {
+      if ((!f.receiver.value || f.receiver.value == receiver) && (!f.action.value || f.action.value == action))
+         return true;
+   }
+   return false;
+}
+
+inline bool matches(const std::vector<table_filter>& filters, uint64_t code, uint64_t table) {
+   for (auto& f : filters) {
+      if ((!f.code.value || f.code.value == code) && (!f.table.value || f.table.value == table))
+         return true;
+   }
+   return false;
+}
+
+/// skips an action_trace_v0, true if `filters` match it
+inline bool skip_action_trace(stream& ds, const std::vector<action_filter>& filters) {
+   check_version(ds, "action_trace");
+   read_varuint(ds); // action_ordinal
+   read_varuint(ds); // creator_action_ordinal
+   if (read<bool>(ds)) {
+      check_version(ds, "action_receipt");
+      skip(ds, 8 + 32 + 8 + 8);           // receiver, act_digest, global_sequence, recv_sequence
+      skip(ds, read_varuint(ds) * 16ull); // auth_sequence
+      read_varuint(ds);                   // code_sequence
+      read_varuint(ds);                   // abi_sequence
+   }
+   auto receiver = read<uint64_t>(ds);
+   skip(ds, 8); // act.account
+   auto action = read<uint64_t>(ds);
+   skip(ds, read_varuint(ds) * 16ull); // act.authorization
+   skip_bytes(ds);                     // act.data
+   skip(ds, 1 + 8);                    // context_free, elapsed
+   skip_bytes(ds);                     // console
+   skip(ds, read_varuint(ds) * 16ull); // account_ram_deltas
+   skip_optional_bytes(ds);            // except
+   skip_optional(ds, 8);               // error_code
+   return matches(filters, receiver, action);
+}
+
+inline void skip_partial_transaction(stream& ds) {
+   check_version(ds, "partial_transaction");
+   skip(ds, 4 + 2 + 4); // expiration, ref_block_num, ref_block_prefix
+   read_varuint(ds);    // max_net_usage_words
+   skip(ds, 1);         // max_cpu_usage_ms
+   read_varuint(ds);    // delay_sec
+   for (auto n = read_varuint(ds); n; --n) {
+      skip(ds, 2);
+      skip_bytes(ds);
+   }
+   for (auto n = read_varuint(ds); n; --n)
+      read<chain::signature_type>(ds);
+   for (auto n = read_varuint(ds); n; --n)
+      skip_bytes(ds);
+}
+
+/// skips a transaction_trace_v0, true if `filters` match one of its action traces or those of its failed_dtrx_trace
+inline bool skip_transaction_trace(stream& ds, const std::vector<action_filter>& filters) {
+   check_version(ds, "transaction_trace");
+   skip(ds, 32 + 1 + 4); // id, status, cpu_usage_us
+   read_varuint(ds);     // net_usage_words
+   skip(ds, 8 + 8 + 1);  // elapsed, net_usage, scheduled
+   bool match = false;
+   for (auto n = read_varuint(ds); n; --n)
+      match |= skip_action_trace(ds, filters);
+   skip_optional(ds, 16);   // account_ram_delta
+   skip_optional_bytes(ds); // except
+   skip_optional(ds, 8);    // error_code
+   if (read<bool>(ds))
+      match |= skip_transaction_trace(ds, filters);
+   if (read<bool>(ds))
+      skip_partial_transaction(ds);
+   return match;
+}
+
+inline std::vector<char> pack_spans(const std::vector<span>& spans, const std::vector<char>& prefix = {}) {
+   size_t size = prefix.size() + fc::raw::pack_size(fc::unsigned_int(spans.size()));
+   for (auto& s : spans)
+      size += s.second;
+   std::vector<char>     out(size);
+   fc::datastream<char*> ds(out.data(), out.size());
+   ds.write(prefix.data(), prefix.size());
+   fc::raw::pack(ds, fc::unsigned_int(spans.size()));
+   for (auto& s : spans)
+      ds.write(s.first, s.second);
+   return out;
+}
+
+} // namespace history_filter
+
+/// the transaction traces of serialized `traces` with an action trace matched by `filters`
+inline std::vector<char> filter_traces(const std::vector<char>& traces, const std::vector<action_filter>& filters) {
+   using namespace history_filter;
+   stream            ds(traces.data(), traces.size());
+   std::vector<span> kept;
+   for (auto n = read_varuint(ds); n; --n) {
+      auto begin = ds.pos();
+      if (skip_transaction_trace(ds, filters))
+         kept.emplace_back(begin, ds.pos() - begin);
+   }
+   return pack_spans(kept);
+}
+
+/// serialized `deltas` with only the contract_table, contract_row and contract_index* rows matched by `filters`
+inline std::vector<char> filter_deltas(const std::vector<char>& deltas, const std::vector<table_filter>& filters) {
+   using namespace history_filter;
+   stream                         ds(deltas.data(), deltas.size());
+   std::vector<std::vector<char>> tables;
+   std::vector<span>              table_spans;
+   for (auto n = read_varuint(ds); n; --n) {
+      auto begin = ds.pos();
+      check_version(ds, "table_delta");
+      auto name       = read<std::string>(ds);
+      auto rows_begin = ds.pos();
+      auto num_rows   = read_varuint(ds);
+      if (name != "contract_table" && name != "contract_row" && name.compare(0, 14, "contract_index")) {
+         for (auto i = num_rows; i; --i) {
+            skip(ds, 1); // present
+            skip_bytes(ds);
+         }
+         table_spans.emplace_back(begin, ds.pos() - begin);
+         continue;
+      }
+      // every contract table row starts with its version, code, scope and table
+      std::vector<span> rows;
+      for (auto i = num_rows; i; --i) {
+         auto row_begin = ds.pos();
+         skip(ds, 1); // present
+         auto size = read_varuint(ds);
+         auto data = ds.pos();
+         skip(ds, size);
+         EOS_ASSERT(size >= 1 + 3 * 8 && data[0] == 0, chain::plugin_exception, "unsupported ${n} row", ("n", name));
+         uint64_t code, table;
+         memcpy(&code, data + 1, sizeof(code));
+         memcpy(&table, data + 1 + 2 * 8, sizeof(table));
+         if (matches(filters, code, table))
+            rows.emplace_back(row_begin, ds.pos() - row_begin);
+      }
+      if (rows.empty())
+         continue;
+      tables.push_back(pack_spans(rows, std::vector<char>(begin, rows_begin)));
+      table_spans.emplace_back(tables.back().data(), tables.back().size());
+   }
+   return history_filter::pack_spans(table_spans);
+}
+
+} // namespace eosio
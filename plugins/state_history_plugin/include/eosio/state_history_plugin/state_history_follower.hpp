@@ -0,0 +1,53 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/state_history_plugin/state_history_plugin.hpp>
+
+#include <boost/asio/steady_timer.hpp>
+#include <boost/filesystem/path.hpp>
+
+namespace eosio {
+
+/// applies the contract_table, contract_row and contract_index* rows of `contracts` in serialized `deltas` to `db`,
+/// and the abi of their account rows; other rows are skipped. Applying the deltas of a block again changes nothing.
+void apply_contract_deltas(chainbase::database& db, const std::vector<char>& deltas,
+                           const boost::container::flat_set<chain::name>& contracts);
+
+/*
+ * Keeps the tables of a partial state current. Requests the irreversible deltas of its contracts from the state
+ * history endpoint of a node with the full state, starting after the last block applied, and applies them on the
+ * main thread. The last block applied is kept in `position_file`, the snapshot head is used when there is none.
+ * A lost connection is opened again after a few seconds.
+ */
+class state_history_follower : public std::enable_shared_from_this<state_history_follower> {
+ public:
+   state_history_follower(chain::controller& chain, std::string host, std::string port, boost::filesystem::path position_file);
+
+   void start();
+   void stop();
+
+   uint32_t last_applied_block() const { return applied_block; }
+
+ private:
+   struct connection;
+
+   void connect();
+   void reconnect_later();
+   void apply(const char* data, size_t size);
+   void apply_block(uint32_t block_num, const std::vector<char>& deltas);
+   void save_position() const;
+
+   chain::controller&                         chain;
+   const std::string                          host;
+   const std::string                          port;
+   const boost::filesystem::path              position_file;
+   uint32_t                                   applied_block = 0;
+   bool                                       stopping      = false;
+   std::shared_ptr<connection>                conn;
+   std::unique_ptr<boost::asio::steady_timer> retry_timer;
+};
+
+} // namespace eosio
@@ -5,7 +5,13 @@
 #pragma once
 
 #include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstring>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <stdint.h>
 
 #include <eosio/chain/block_header.hpp>
@@ -29,6 +35,9 @@ namespace eosio {
  * each entry:
  *    state_history_log_header
  *    payload
+ *
+ * A single thread appends and truncates through the streams. read_entry() and get_block_id() read a mapping of
+ * both files instead, under a shared lock, so other threads can read while blocks are appended.
  */
 
 inline uint64_t       ship_magic(uint32_t version) { return N(ship) | version; }
@@ -48,14 +57,53 @@ static const int state_history_log_header_serial_size = sizeof(state_history_log
 
 class state_history_log {
  private:
-   const char* const    name = "";
-   std::string          log_filename;
-   std::string          index_filename;
-   std::fstream         log;
-   std::fstream         index;
-   uint32_t             _begin_block = 0;
-   uint32_t             _end_block   = 0;
-   chain::block_id_type last_block_id;
+   /// read-only mapping of both files, covering blocks before `end_block`
+   struct mapped_log {
+      boost::interprocess::file_mapping  log_file;
+      boost::interprocess::file_mapping  index_file;
+      boost::interprocess::mapped_region log;
+      boost::interprocess::mapped_region index;
+      uint32_t                           begin_block = 0;
+      uint32_t                           end_block   = 0;
+
+      mapped_log(const std::string& log_filename, const std::string& index_filename, uint32_t begin_block,
+                 uint32_t end_block)
+          : log_file(log_filename.c_str(), boost::interprocess::read_only)
+          , index_file(index_filename.c_str(), boost::interprocess::read_only)
+          , log(log_file, boost::interprocess::read_only)
+          , index(index_file, boost::interprocess::read_only)
+          , begin_block(begin_block)
+          , end_block(end_block) {}
+
+      // returns position of payload
+      uint64_t get_entry(const char* name, uint32_t block_num, state_history_log_header& header) const {
+         uint64_t pos;
+         EOS_ASSERT((block_num - begin_block + 1) * sizeof(pos) <= index.get_size(), chain::plugin_exception,
+                    "corrupt ${name}.index", ("name", name));
+         memcpy(&pos, static_cast<const char*>(index.get_address()) + (block_num - begin_block) * sizeof(pos),
+                sizeof(pos));
+         EOS_ASSERT(pos + state_history_log_header_serial_size <= log.get_size(), chain::plugin_exception,
+                    "corrupt ${name}.log (9)", ("name", name));
+         fc::datastream<const char*> ds(static_cast<const char*>(log.get_address()) + pos,
+                                        state_history_log_header_serial_size);
+         fc::raw::unpack(ds, header);
+         EOS_ASSERT(is_ship(header.magic) && is_ship_supported_version(header.magic) &&
+                        pos + state_history_log_header_serial_size + header.payload_size <= log.get_size(),
+                    chain::plugin_exception, "corrupt ${name}.log (10)", ("name", name));
+         return pos + state_history_log_header_serial_size;
+      }
+   };
+
+   const char* const                         name = "";
+   std::string                               log_filename;
+   std::string                               index_filename;
+   std::fstream                              log;
+   std::fstream                              index;
+   uint32_t                                  _begin_block = 0;
+   uint32_t                                  _end_block   = 0;
+   chain::block_id_type                      last_block_id;
+   mutable std::shared_mutex                 mutex;  ///< shared by readers, exclusive while the files change
+   mutable std::shared_ptr<const mapped_log> mapped; ///< std::atomic_load/store, readers remap under the shared lock
 
  public:
    state_history_log(const char* const name, std::string log_filename, std::string index_filename)
@@ -69,6 +117,12 @@ class state_history_log {
    uint32_t begin_block() const { return _begin_block; }
    uint32_t end_block() const { return _end_block; }
 
+   /// thread safe begin_block() and end_block()
+   std::pair<uint32_t, uint32_t> block_range() const {
+      std::shared_lock<std::shared_mutex> lock(mutex);
+      return {_begin_block, _end_block};
+   }
+
    void read_header(state_history_log_header& header, bool assert_version = true) {
       char bytes[state_history_log_header_serial_size];
       log.read(bytes, sizeof(bytes));
@@ -106,6 +160,7 @@ class state_history_log {
          }
       }
 
+      std::unique_lock<std::shared_mutex> lock(mutex);
       if (block_num < _end_block)
          truncate(block_num);
       log.seekg(0, std::ios_base::end);
@@ -119,6 +174,9 @@ class state_history_log {
 
       index.seekg(0, std::ios_base::end);
       index.write((char*)&pos, sizeof(pos));
+      // visible to the mappings of the readers
+      log.flush();
+      index.flush();
       if (_begin_block == _end_block)
          _begin_block = block_num;
       _end_block    = block_num + 1;
@@ -134,13 +192,38 @@ class state_history_log {
       return log;
    }
 
-   chain::block_id_type get_block_id(uint32_t block_num) {
+   chain::block_id_type get_block_id(uint32_t block_num) const {
+      std::shared_lock<std::shared_mutex> lock(mutex);
       state_history_log_header header;
-      get_entry(block_num, header);
+      get_mapped(block_num)->get_entry(name, block_num, header);
       return header.block_id;
    }
 
+   /// copies the payload of the entry of `block_num`, false if the log does not have it; thread safe
+   bool read_entry(uint32_t block_num, state_history_log_header& header, std::vector<char>& payload) const {
+      std::shared_lock<std::shared_mutex> lock(mutex);
+      if (block_num < _begin_block || block_num >= _end_block)
+         return false;
+      const auto m   = get_mapped(block_num);
+      const auto pos = m->get_entry(name, block_num, header);
+      const char* p  = static_cast<const char*>(m->log.get_address()) + pos;
+      payload.assign(p, p + header.payload_size);
+      return true;
+   }
+
  private:
+   /// mapping covering `block_num`, remapped if the log was appended since; caller holds `mutex`
+   std::shared_ptr<const mapped_log> get_mapped(uint32_t block_num) const {
+      EOS_ASSERT(block_num >= _begin_block && block_num < _end_block, chain::plugin_exception,
+                 "read non-existing block in ${name}.log", ("name", name));
+      auto m = std::atomic_load(&mapped);
+      if (!m || m->begin_block != _begin_block || m->end_block <= block_num) {
+         m = std::make_shared<const mapped_log>(log_filename, index_filename, _begin_block, _end_block);
+         std::atomic_store(&mapped, m);
+      }
+      return m;
+   }
+
    bool get_last_block(uint64_t size) {
       state_history_log_header header;
       uint64_t                 suffix;
@@ -267,7 +350,10 @@ class state_history_log {
       return pos;
    }
 
+   // caller holds `mutex` exclusively
    void truncate(uint32_t block_num) {
+      // a mapping past the new end of the files must not be read
+      std::atomic_store(&mapped, std::shared_ptr<const mapped_log>());
       log.flush();
       index.flush();
       uint64_t num_removed = 0;
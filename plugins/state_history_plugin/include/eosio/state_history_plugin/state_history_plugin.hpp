@@ -102,10 +102,48 @@ struct get_blocks_request_v0 {
    bool                        fetch_deltas           = false;
 };
 
+/// matches action traces by receiver and action name, an empty name matches any
+struct action_filter {
+   chain::name receiver = {};
+   chain::name action   = {};
+};
+
+/// matches contract_table, contract_row and contract_index* rows by code and table, an empty name matches any
+struct table_filter {
+   chain::name code  = {};
+   chain::name table = {};
+};
+
+/// get_blocks_request_v0 with filters; empty filters send everything
+struct get_blocks_request_v1 : get_blocks_request_v0 {
+   std::vector<action_filter> trace_filters = {}; ///< only transaction traces with a matching action trace
+   std::vector<table_filter>  delta_filters = {}; ///< only matching contract rows, other tables are not filtered
+
+   get_blocks_request_v1() = default;
+   get_blocks_request_v1(const get_blocks_request_v0& req)
+       : get_blocks_request_v0(req) {}
+};
+
+/// get_blocks_request_v1 with batched results and a window of bytes
+struct get_blocks_request_v2 : get_blocks_request_v1 {
+   uint32_t max_blocks_per_message = 0; ///< blocks of a get_blocks_batch_result_v0, 0 or 1 sends get_blocks_result_v0
+   uint64_t max_bytes_in_flight    = 0; ///< of results not acknowledged by get_blocks_ack_request_v1, 0 for no limit
+
+   get_blocks_request_v2() = default;
+   get_blocks_request_v2(const get_blocks_request_v1& req)
+       : get_blocks_request_v1(req) {}
+};
+
 struct get_blocks_ack_request_v0 {
    uint32_t num_messages = 0;
 };
 
+/// acknowledges messages and their bytes, the size of the binary websocket messages received
+struct get_blocks_ack_request_v1 {
+   uint32_t num_messages = 0;
+   uint64_t num_bytes    = 0;
+};
+
 struct get_blocks_result_v0 {
    block_position               head;
    block_position               last_irreversible;
@@ -116,8 +154,16 @@ struct get_blocks_result_v0 {
    fc::optional<bytes>          deltas;
 };
 
-using state_request = fc::static_variant<get_status_request_v0, get_blocks_request_v0, get_blocks_ack_request_v0>;
-using state_result  = fc::static_variant<get_status_result_v0, get_blocks_result_v0>;
+/// consecutive results in one message, sent for a get_blocks_request_v2 with max_blocks_per_message above 1
+struct get_blocks_batch_result_v0 {
+   block_position                    head;
+   block_position                    last_irreversible;
+   std::vector<get_blocks_result_v0> blocks;
+};
+
+using state_request = fc::static_variant<get_status_request_v0, get_blocks_request_v0, get_blocks_ack_request_v0,
+                                         get_blocks_request_v1, get_blocks_request_v2, get_blocks_ack_request_v1>;
+using state_result  = fc::static_variant<get_status_result_v0, get_blocks_result_v0, get_blocks_batch_result_v0>;
 
 class state_history_plugin : public plugin<state_history_plugin> {
  public:
@@ -144,5 +190,10 @@ FC_REFLECT(eosio::block_position, (block_num)(block_id));
 FC_REFLECT_EMPTY(eosio::get_status_request_v0);
 FC_REFLECT(eosio::get_status_result_v0, (head)(last_irreversible)(trace_begin_block)(trace_end_block)(chain_state_begin_block)(chain_state_end_block));
 FC_REFLECT(eosio::get_blocks_request_v0, (start_block_num)(end_block_num)(max_messages_in_flight)(have_positions)(irreversible_only)(fetch_block)(fetch_traces)(fetch_deltas));
+FC_REFLECT(eosio::action_filter, (receiver)(action));
+FC_REFLECT(eosio::table_filter, (code)(table));
+FC_REFLECT_DERIVED(eosio::get_blocks_request_v1, (eosio::get_blocks_request_v0), (trace_filters)(delta_filters));
+FC_REFLECT_DERIVED(eosio::get_blocks_request_v2, (eosio::get_blocks_request_v1), (max_blocks_per_message)(max_bytes_in_flight));
 FC_REFLECT(eosio::get_blocks_ack_request_v0, (num_messages));
+FC_REFLECT(eosio::get_blocks_ack_request_v1, (num_messages)(num_bytes));
 // clang-format on
@@ -686,4 +686,14 @@ datastream<ST>& operator<<(datastream<ST>& ds, const eosio::get_blocks_result_v0
    return ds;
 }
 
+template <typename ST>
+datastream<ST>& operator<<(datastream<ST>& ds, const eosio::get_blocks_batch_result_v0& obj) {
+   fc::raw::pack(ds, obj.head);
+   fc::raw::pack(ds, obj.last_irreversible);
+   fc::raw::pack(ds, fc::unsigned_int(obj.blocks.size()));
+   for (auto& block : obj.blocks)
+      ds << block;
+   return ds;
+}
+
 } // namespace fc
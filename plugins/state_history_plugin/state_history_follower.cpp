@@ -0,0 +1,454 @@
+#include <eosio/chain/account_object.hpp>
+#include <eosio/chain/contract_table_objects.hpp>
+#include <eosio/state_history_plugin/state_history_filter.hpp>
+#include <eosio/state_history_plugin/state_history_follower.hpp>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+
+using tcp    = boost::asio::ip::tcp;
+namespace ws = boost::beast::websocket;
+
+namespace eosio {
+using namespace chain;
+using namespace history_filter;
+
+namespace {
+
+/// the sizes of big bytes are varuint64, see history_pack_varuint64
+uint64_t read_varuint64(stream& ds) {
+   uint64_t result = 0;
+   for (int shift = 0;; shift += 7) {
+      EOS_ASSERT(shift < 64, plugin_exception, "invalid varuint64 in state history result");
+      auto b = read<uint8_t>(ds);
+      result |= uint64_t(b & 0x7f) << shift;
+      if (!(b & 0x80))
+         return result;
+   }
+}
+
+fc::optional<span> read_optional_big_bytes(stream& ds) {
+   if (!read<bool>(ds))
+      return {};
+   auto size = read_varuint64(ds);
+   auto data = ds.pos();
+   skip(ds, size);
+   return span{data, size};
+}
+
+// the secondary keys as serialize_secondary_index_data writes them
+void read_secondary(stream& ds, uint64_t& key) { key = read<uint64_t>(ds); }
+
+template <typename T>
+void read_raw(stream& ds, T& key) {
+   EOS_ASSERT(ds.remaining() >= sizeof(key), plugin_exception, "truncated state history entry");
+   memcpy(&key, ds.pos(), sizeof(key));
+   ds.skip(sizeof(key));
+}
+
+void read_secondary(stream& ds, uint128_t& key) { read_raw(ds, key); }
+void read_secondary(stream& ds, float64_t& key) { read_raw(ds, key); }
+void read_secondary(stream& ds, float128_t& key) { read_raw(ds, key); }
+
+void read_secondary(stream& ds, key256_t& key) {
+   for (auto& k : key) {
+      read_raw(ds, k);
+      char* ch = reinterpret_cast<char*>(&k);
+      std::reverse(ch, ch + sizeof(k));
+   }
+}
+
+/// version, code, scope and table starting the rows of every contract table
+struct contract_row_header {
+   name code;
+   name scope;
+   name table;
+
+   explicit contract_row_header(stream& ds) {
+      check_version(ds, "contract row");
+      code  = name(read<uint64_t>(ds));
+      scope = name(read<uint64_t>(ds));
+      table = name(read<uint64_t>(ds));
+   }
+};
+
+class contract_delta_applier {
+ public:
+   contract_delta_applier(chainbase::database& db, const boost::container::flat_set<name>& contracts)
+       : db(db)
+       , contracts(contracts) {}
+
+   void apply(const std::vector<char>& deltas) {
+      stream ds(deltas.data(), deltas.size());
+      for (auto n = read_varuint(ds); n; --n) {
+         check_version(ds, "table_delta");
+         auto table_name = read<std::string>(ds);
+         for (auto i = read_varuint(ds); i; --i) {
+            auto present = read<bool>(ds);
+            auto size    = read_varuint(ds);
+            auto data    = ds.pos();
+            skip(ds, size);
+            stream row(data, size);
+            apply_row(table_name, present, row);
+         }
+      }
+      // the rows of a removed table come after it, it is removed once they are
+      for (auto& t : removed_tables) {
+         auto table = find_table(t);
+         if (table && !table->count)
+            db.remove(*table);
+      }
+      removed_tables.clear();
+   }
+
+ private:
+   void apply_row(const std::string& table_name, bool present, stream& ds) {
+      if (table_name == "account")
+         return apply_account(present, ds);
+      if (table_name.compare(0, 8, "contract"))
+         return;
+      contract_row_header header(ds);
+      if (!contracts.count(header.code))
+         return;
+      if (table_name == "contract_table")
+         return apply_table(present, header, ds);
+      if (table_name == "contract_row")
+         return apply_contract_row<key_value_object, by_scope_primary>(present, header, ds, [](stream& ds) {
+            auto size = read_varuint(ds);
+            auto data = ds.pos();
+            skip(ds, size);
+            return [data, size](auto& r) { r.value.assign(data, size); };
+         });
+      if (table_name == "contract_index64")
+         return apply_secondary<index64_object>(present, header, ds);
+      if (table_name == "contract_index128")
+         return apply_secondary<index128_object>(present, header, ds);
+      if (table_name == "contract_index256")
+         return apply_secondary<index256_object>(present, header, ds);
+      if (table_name == "contract_index_double")
+         return apply_secondary<index_double_object>(present, header, ds);
+      if (table_name == "contract_index_long_double")
+         return apply_secondary<index_long_double_object>(present, header, ds);
+   }
+
+   void apply_account(bool present, stream& ds) {
+      check_version(ds, "account");
+      auto account = chain::name(read<uint64_t>(ds));
+      if (!present || !contracts.count(account))
+         return;
+      skip(ds, sizeof(block_timestamp_type)); // creation_date
+      auto size = read_varuint(ds);
+      auto data = ds.pos();
+      skip(ds, size);
+      if (auto obj = db.find<account_object, by_name>(account))
+         db.modify(*obj, [&](auto& a) { a.abi.assign(data, size); });
+   }
+
+   const table_id_object* find_table(const contract_row_header& h) const {
+      return db.find<table_id_object, by_code_scope_table>(boost::make_tuple(h.code, h.scope, h.table));
+   }
+
+   const table_id_object& get_table(const contract_row_header& h, chain::name payer) {
+      if (auto table = find_table(h))
+         return *table;
+      return db.create<table_id_object>([&](auto& t) {
+         t.code  = h.code;
+         t.scope = h.scope;
+         t.table = h.table;
+         t.payer = payer;
+      });
+   }
+
+   void apply_table(bool present, const contract_row_header& h, stream& ds) {
+      if (!present) {
+         removed_tables.push_back(h);
+         return;
+      }
+      auto  payer = chain::name(read<uint64_t>(ds));
+      auto& table = get_table(h, payer);
+      if (table.payer != payer)
+         db.modify(table, [&](auto& t) { t.payer = payer; });
+   }
+
+   /// `read_value` reads the rest of the row and returns the function setting it to an object
+   template <typename Object, typename ByPrimary, typename ReadValue>
+   void apply_contract_row(bool present, const contract_row_header& h, stream& ds, ReadValue read_value) {
+      auto primary_key = read<uint64_t>(ds);
+      auto payer       = chain::name(read<uint64_t>(ds));
+      if (!present) {
+         auto table = find_table(h);
+         if (!table)
+            return;
+         auto row = db.find<Object, ByPrimary>(boost::make_tuple(table->id, primary_key));
+         if (!row)
+            return;
+         db.remove(*row);
+         db.modify(*table, [](auto& t) { --t.count; });
+         return;
+      }
+      auto  set_value = read_value(ds);
+      auto& table     = get_table(h, payer);
+      if (auto row = db.find<Object, ByPrimary>(boost::make_tuple(table.id, primary_key))) {
+         db.modify(*row, [&](auto& r) {
+            r.payer = payer;
+            set_value(r);
+         });
+         return;
+      }
+      db.create<Object>([&](auto& r) {
+         r.t_id        = table.id;
+         r.primary_key = primary_key;
+         r.payer       = payer;
+         set_value(r);
+      });
+      db.modify(table, [](auto& t) { ++t.count; });
+   }
+
+   template <typename Object>
+   void apply_secondary(bool present, const contract_row_header& h, stream& ds) {
+      apply_contract_row<Object, by_primary>(present, h, ds, [](stream& ds) {
+         typename Object::secondary_key_type key;
+         read_secondary(ds, key);
+         return [key](auto& r) { r.secondary_key = key; };
+      });
+   }
+
+   chainbase::database&                          db;
+   const boost::container::flat_set<chain::name>& contracts;
+   std::vector<contract_row_header>              removed_tables;
+};
+
+} // namespace
+
+void apply_contract_deltas(chainbase::database& db, const std::vector<char>& deltas,
+                           const boost::container::flat_set<chain::name>& contracts) {
+   contract_delta_applier(db, contracts).apply(deltas);
+}
+
+struct state_history_follower::connection : std::enable_shared_from_this<connection> {
+   std::shared_ptr<state_history_follower> follower;
+   tcp::resolver                           resolver;
+   ws::stream<tcp::socket>                 socket_stream;
+   boost::beast::flat_buffer               in_buffer;
+   std::vector<std::vector<char>>          send_queue;
+   bool                                    sending  = false;
+   bool                                    got_abi  = false;
+   bool                                    closed   = false;
+
+   explicit connection(std::shared_ptr<state_history_follower> follower)
+       : follower(std::move(follower))
+       , resolver(app().get_io_service())
+       , socket_stream(app().get_io_service()) {}
+
+   void start() {
+      resolver.async_resolve(follower->host, follower->port, [self = shared_from_this()](
+                                                                  boost::system::error_code ec, tcp::resolver::results_type results) {
+         if (self->failed(ec, "resolve"))
+            return;
+         boost::asio::async_connect(
+             self->socket_stream.next_layer(), results, [self](boost::system::error_code ec, const tcp::endpoint&) {
+                if (self->failed(ec, "connect"))
+                   return;
+                self->socket_stream.async_handshake(
+                    self->follower->host + ":" + self->follower->port, "/", [self](boost::system::error_code ec) {
+                       if (self->failed(ec, "handshake"))
+                          return;
+                       ilog("following state history of ${h}:${p} from block ${b}",
+                            ("h", self->follower->host)("p", self->follower->port)("b", self->follower->applied_block + 1));
+                       self->socket_stream.binary(true);
+                       self->send_request();
+                       self->read();
+                    });
+             });
+      });
+   }
+
+   void send_request() {
+      get_blocks_request_v2 req;
+      req.start_block_num        = follower->applied_block + 1;
+      req.end_block_num          = std::numeric_limits<uint32_t>::max();
+      req.max_messages_in_flight = max_messages_in_flight;
+      req.irreversible_only      = true;
+      req.fetch_deltas           = true;
+      for (auto& contract : follower->chain.get_partial_state_contracts())
+         req.delta_filters.push_back(table_filter{contract, {}});
+      req.max_blocks_per_message = max_blocks_per_message;
+      send(fc::raw::pack(state_request{std::move(req)}));
+   }
+
+   void read() {
+      socket_stream.async_read(in_buffer, [self = shared_from_this()](boost::system::error_code ec, size_t size) {
+         if (self->failed(ec, "read"))
+            return;
+         // the first message is the ABI of the protocol
+         if (self->got_abi) {
+            auto data = boost::asio::buffer_cast<const char*>(boost::beast::buffers_front(self->in_buffer.data()));
+            try {
+               self->follower->apply(data, boost::asio::buffer_size(self->in_buffer.data()));
+            } catch (const fc::exception& e) {
+               elog("cannot apply state history deltas: ${e}", ("e", e.to_detail_string()));
+               self->close();
+               self->follower->reconnect_later();
+               return;
+            }
+            send_ack(self, size);
+         }
+         self->got_abi = true;
+         self->in_buffer.consume(self->in_buffer.size());
+         self->read();
+      });
+   }
+
+   static void send_ack(const std::shared_ptr<connection>& self, size_t size) {
+      self->send(fc::raw::pack(state_request{get_blocks_ack_request_v1{1, size}}));
+   }
+
+   void send(std::vector<char> message) {
+      send_queue.push_back(std::move(message));
+      send();
+   }
+
+   void send() {
+      if (sending || send_queue.empty() || closed)
+         return;
+      sending = true;
+      socket_stream.async_write(boost::asio::buffer(send_queue[0]),
+                                [self = shared_from_this()](boost::system::error_code ec, size_t) {
+                                   if (self->failed(ec, "write"))
+                                      return;
+                                   self->send_queue.erase(self->send_queue.begin());
+                                   self->sending = false;
+                                   self->send();
+                                });
+   }
+
+   /// true if `ec` is an error, then the connection is closed and opened again later
+   bool failed(const boost::system::error_code& ec, const char* what) {
+      if (!ec)
+         return false;
+      if (closed)
+         return true;
+      if (!follower->stopping)
+         elog("state history follower ${w}: ${m}", ("w", what)("m", ec.message()));
+      close();
+      follower->reconnect_later();
+      return true;
+   }
+
+   void close() {
+      if (closed)
+         return;
+      closed = true;
+      boost::system::error_code ec;
+      socket_stream.next_layer().close(ec);
+   }
+
+   static constexpr uint32_t max_messages_in_flight = 4;
+   static constexpr uint32_t max_blocks_per_message = 100;
+};
+
+state_history_follower::state_history_follower(chain::controller& chain, std::string host, std::string port,
+                                               boost::filesystem::path position_file)
+    : chain(chain)
+    , host(std::move(host))
+    , port(std::move(port))
+    , position_file(std::move(position_file)) {
+   EOS_ASSERT(!chain.get_partial_state_contracts().empty(), plugin_exception,
+              "following a state history endpoint requires --partial-state-contract");
+   applied_block = chain.head_block_num();
+   if (boost::filesystem::exists(this->position_file)) {
+      std::ifstream in(this->position_file.string());
+      uint32_t      position = 0;
+      in >> position;
+      EOS_ASSERT(in && position >= applied_block, plugin_exception,
+                 "${f} is not a block after the head ${h} of the state", ("f", this->position_file.string())("h", applied_block));
+      applied_block = position;
+   }
+}
+
+void state_history_follower::start() {
+   retry_timer = std::make_unique<boost::asio::steady_timer>(app().get_io_service());
+   connect();
+}
+
+void state_history_follower::stop() {
+   stopping = true;
+   if (retry_timer)
+      retry_timer->cancel();
+   if (conn)
+      conn->close();
+   conn.reset();
+}
+
+void state_history_follower::connect() {
+   conn = std::make_shared<connection>(shared_from_this());
+   conn->start();
+}
+
+void state_history_follower::reconnect_later() {
+   if (stopping)
+      return;
+   retry_timer->expires_from_now(std::chrono::seconds(5));
+   retry_timer->async_wait([self = shared_from_this()](const boost::system::error_code& ec) {
+      if (!ec && !self->stopping)
+         self->connect();
+   });
+}
+
+void state_history_follower::apply(const char* data, size_t size) {
+   stream ds(data, size);
+   auto   result_type = read_varuint(ds);
+   if (result_type == 0)
+      return; // get_status_result_v0
+   uint32_t count = 1;
+   if (result_type == 2) {
+      skip(ds, 2 * (sizeof(uint32_t) + sizeof(block_id_type))); // head, last_irreversible
+      count = read_varuint(ds);
+   }
+   auto applied = applied_block;
+   for (; count; --count) {
+      skip(ds, 2 * (sizeof(uint32_t) + sizeof(block_id_type))); // head, last_irreversible
+      fc::optional<block_position> this_block;
+      if (read<bool>(ds))
+         this_block = read<block_position>(ds);
+      if (read<bool>(ds))
+         skip(ds, sizeof(uint32_t) + sizeof(block_id_type)); // prev_block
+      read_optional_big_bytes(ds);                            // block
+      read_optional_big_bytes(ds);                            // traces
+      auto deltas = read_optional_big_bytes(ds);
+      if (!this_block)
+         continue;
+      EOS_ASSERT(deltas, plugin_exception, "the state history endpoint has no chain state of block ${b}",
+                 ("b", this_block->block_num));
+      apply_block(this_block->block_num, std::vector<char>(deltas->first, deltas->first + deltas->second));
+   }
+   if (applied_block != applied)
+      save_position();
+}
+
+void state_history_follower::apply_block(uint32_t block_num, const std::vector<char>& deltas) {
+   // results of a closed connection may be read after those of the next one
+   if (block_num <= applied_block)
+      return;
+   EOS_ASSERT(block_num == applied_block + 1, plugin_exception, "the state history endpoint skipped from block ${a} to ${b}",
+              ("a", applied_block)("b", block_num));
+   apply_contract_deltas(chain.mutable_db(), deltas, chain.get_partial_state_contracts());
+   applied_block = block_num;
+}
+
+void state_history_follower::save_position() const {
+   auto tmp = position_file.string() + ".tmp";
+   {
+      std::ofstream out(tmp, std::ios::trunc);
+      out << applied_block;
+      EOS_ASSERT(out, plugin_exception, "cannot write ${f}", ("f", tmp));
+   }
+   boost::filesystem::rename(tmp, position_file);
+}
+
+} // namespace eosio
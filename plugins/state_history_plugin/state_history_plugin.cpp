@@ -1,4 +1,8 @@
 #include <eosio/chain/config.hpp>
+#include <eosio/chain/executor_stats.hpp>
+#include <eosio/chain/thread_utils.hpp>
+#include <eosio/state_history_plugin/state_history_filter.hpp>
+#include <eosio/state_history_plugin/state_history_follower.hpp>
 #include <eosio/state_history_plugin/state_history_log.hpp>
 #include <eosio/state_history_plugin/state_history_serialization.hpp>
 
@@ -48,12 +52,12 @@ static bytes zlib_compress_bytes(bytes in) {
    return out;
 }
 
-static bytes zlib_decompress(const bytes& in) {
+static bytes zlib_decompress(const char* in, size_t size) {
    bytes                  out;
    bio::filtering_ostream decomp;
    decomp.push(bio::zlib_decompressor());
    decomp.push(bio::back_inserter(out));
-   bio::write(decomp, in.data(), in.size());
+   bio::write(decomp, in, size);
    bio::close(decomp);
    return out;
 }
@@ -123,18 +127,28 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
    std::unique_ptr<tcp::acceptor>                             acceptor;
    std::map<transaction_id_type, augmented_transaction_trace> cached_traces;
    fc::optional<augmented_transaction_trace>                  onblock_trace;
-
-   void get_log_entry(state_history_log& log, uint32_t block_num, fc::optional<bytes>& result) {
-      if (block_num < log.begin_block() || block_num >= log.end_block())
-         return;
+   uint16_t                                                   read_threads = 2;
+   bool                                                       permessage_deflate = false;
+   fc::optional<task_executor>                                read_thread_pool; // history tasks on the chain scheduler
+   fc::optional<named_thread_pool>                            write_thread_pool;
+   uint32_t                                                   stored_block_num  = 0; ///< newest block in the logs
+   bool                                                       chain_state_fresh = false;
+   string                                                     follow_endpoint; ///< of a node with the full state
+   bfs::path                                                  follow_position_file;
+   std::shared_ptr<state_history_follower>                    follower;
+
+   // called on the read threads
+   void get_log_entry(const state_history_log& log, uint32_t block_num, fc::optional<bytes>& result) {
       state_history_log_header header;
-      auto&                    stream = log.get_entry(block_num, header);
-      uint32_t                 s;
-      stream.read((char*)&s, sizeof(s));
-      bytes compressed(s);
-      if (s)
-         stream.read(compressed.data(), s);
-      result = zlib_decompress(compressed);
+      bytes                    payload;
+      if (!log.read_entry(block_num, header, payload))
+         return;
+      uint32_t s;
+      EOS_ASSERT(payload.size() >= sizeof(s), plugin_exception, "corrupt log entry for block ${b}", ("b", block_num));
+      memcpy(&s, payload.data(), sizeof(s));
+      EOS_ASSERT(sizeof(s) + s <= payload.size(), plugin_exception, "corrupt log entry for block ${b}",
+                 ("b", block_num));
+      result = zlib_decompress(payload.data() + sizeof(s), s);
    }
 
    void get_block(uint32_t block_num, fc::optional<bytes>& result) {
@@ -149,9 +163,15 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
    }
 
    fc::optional<chain::block_id_type> get_block_id(uint32_t block_num) {
-      if (trace_log && block_num >= trace_log->begin_block() && block_num < trace_log->end_block())
+      auto in_log = [&](const fc::optional<state_history_log>& log) {
+         if (!log)
+            return false;
+         auto range = log->block_range();
+         return block_num >= range.first && block_num < range.second;
+      };
+      if (in_log(trace_log))
          return trace_log->get_block_id(block_num);
-      if (chain_state_log && block_num >= chain_state_log->begin_block() && block_num < chain_state_log->end_block())
+      if (in_log(chain_state_log))
          return chain_state_log->get_block_id(block_num);
       try {
          auto block = chain_plug->chain().fetch_block_by_number(block_num);
@@ -168,8 +188,13 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       bool                                       sending  = false;
       bool                                       sent_abi = false;
       std::vector<std::vector<char>>             send_queue;
-      fc::optional<get_blocks_request_v0>        current_request;
+      fc::optional<get_blocks_request_v2>        current_request;
+      uint32_t                                   current_request_num = 0; ///< tells results of a replaced request
       bool                                       need_to_send_update = false;
+      bool                                       reading = false; ///< a result is being read on the read threads
+      uint64_t                                   bytes_in_flight = 0; ///< of results not acknowledged
+      fc::optional<get_blocks_batch_result_v0>   batch; ///< results not sent yet of a batched request
+      uint64_t                                   batch_bytes = 0;
 
       session(std::shared_ptr<state_history_plugin_impl> plugin)
           : plugin(std::move(plugin)) {}
@@ -178,6 +203,12 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
          ilog("incoming connection");
          socket_stream = std::make_unique<ws::stream<tcp::socket>>(std::move(socket));
          socket_stream->binary(true);
+         if (plugin->permessage_deflate) {
+            // negotiated with clients offering it, the others get uncompressed messages
+            ws::permessage_deflate pmd;
+            pmd.server_enable = true;
+            socket_stream->set_option(pmd);
+         }
          socket_stream->next_layer().set_option(boost::asio::ip::tcp::no_delay(true));
          socket_stream->next_layer().set_option(boost::asio::socket_base::send_buffer_size(1024 * 1024));
          socket_stream->next_layer().set_option(boost::asio::socket_base::receive_buffer_size(1024 * 1024));
@@ -241,18 +272,25 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
          get_status_result_v0 result;
          result.head              = {chain.head_block_num(), chain.head_block_id()};
          result.last_irreversible = {chain.last_irreversible_block_num(), chain.last_irreversible_block_id()};
-         if (plugin->trace_log) {
-            result.trace_begin_block = plugin->trace_log->begin_block();
-            result.trace_end_block   = plugin->trace_log->end_block();
-         }
-         if (plugin->chain_state_log) {
-            result.chain_state_begin_block = plugin->chain_state_log->begin_block();
-            result.chain_state_end_block   = plugin->chain_state_log->end_block();
-         }
+         if (plugin->trace_log)
+            std::tie(result.trace_begin_block, result.trace_end_block) = plugin->trace_log->block_range();
+         if (plugin->chain_state_log)
+            std::tie(result.chain_state_begin_block, result.chain_state_end_block) =
+                  plugin->chain_state_log->block_range();
          send(std::move(result));
       }
 
       void operator()(get_blocks_request_v0& req) {
+         get_blocks_request_v1 v1{req};
+         (*this)(v1);
+      }
+
+      void operator()(get_blocks_request_v1& req) {
+         get_blocks_request_v2 v2{req};
+         (*this)(v2);
+      }
+
+      void operator()(get_blocks_request_v2& req) {
          for (auto& cp : req.have_positions) {
             if (req.start_block_num <= cp.block_num)
                continue;
@@ -261,7 +299,12 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
                req.start_block_num = std::min(req.start_block_num, cp.block_num);
          }
          req.have_positions.clear();
+         req.max_blocks_per_message = std::min(req.max_blocks_per_message, max_blocks_per_message);
          current_request = req;
+         ++current_request_num;
+         bytes_in_flight = 0;
+         batch.reset();
+         batch_bytes = 0;
          send_update(true);
       }
 
@@ -272,14 +315,33 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
          send_update();
       }
 
+      void operator()(get_blocks_ack_request_v1& req) {
+         if (!current_request)
+            return;
+         current_request->max_messages_in_flight += req.num_messages;
+         bytes_in_flight -= std::min(bytes_in_flight, req.num_bytes);
+         send_update();
+      }
+
+      static constexpr uint32_t max_blocks_per_message = 1000;
+
+      /// the client has room for another result: messages and bytes it did not acknowledge are within its windows
+      bool can_send_result() const {
+         return current_request && current_request->max_messages_in_flight &&
+                (!current_request->max_bytes_in_flight || bytes_in_flight + batch_bytes < current_request->max_bytes_in_flight);
+      }
+
       void send_update(get_blocks_result_v0 result) {
          need_to_send_update = true;
-         if (!send_queue.empty() || !current_request || !current_request->max_messages_in_flight)
+         if (reading || !send_queue.empty() || !can_send_result())
             return;
          auto& chain = plugin->chain_plug->chain();
          result.last_irreversible = {chain.last_irreversible_block_num(), chain.last_irreversible_block_id()};
          uint32_t current =
                current_request->irreversible_only ? result.last_irreversible.block_num : result.head.block_num;
+         // the entries of the newest blocks may still be on the write thread
+         if (plugin->write_thread_pool)
+            current = std::min(current, plugin->stored_block_num);
          if (current_request->start_block_num <= current &&
              current_request->start_block_num < current_request->end_block_num) {
             auto block_id = plugin->get_block_id(current_request->start_block_num);
@@ -290,22 +352,94 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
                   result.prev_block = block_position{current_request->start_block_num - 1, *prev_block_id};
                if (current_request->fetch_block)
                   plugin->get_block(current_request->start_block_num, result.block);
-               if (current_request->fetch_traces && plugin->trace_log)
-                  plugin->get_log_entry(*plugin->trace_log, current_request->start_block_num, result.traces);
-               if (current_request->fetch_deltas && plugin->chain_state_log)
-                  plugin->get_log_entry(*plugin->chain_state_log, current_request->start_block_num, result.deltas);
+               const bool fetch_traces = current_request->fetch_traces && plugin->trace_log;
+               const bool fetch_deltas = current_request->fetch_deltas && plugin->chain_state_log;
+               if (fetch_traces || fetch_deltas)
+                  return read_logs(std::move(result), fetch_traces, fetch_deltas, current);
             }
             ++current_request->start_block_num;
          }
-         send(std::move(result));
-         --current_request->max_messages_in_flight;
+         send_result(std::move(result), current);
+      }
+
+      void send_result(get_blocks_result_v0 result, uint32_t current) {
          need_to_send_update = current_request->start_block_num <= current &&
                                current_request->start_block_num < current_request->end_block_num;
+         if (current_request->max_blocks_per_message <= 1)
+            return queue_result(fc::raw::pack(state_result{std::move(result)}));
+
+         if (!batch)
+            batch.emplace();
+         batch->head              = result.head;
+         batch->last_irreversible = result.last_irreversible;
+         batch_bytes += fc::raw::pack_size(result);
+         batch->blocks.push_back(std::move(result));
+         // the batch is sent once full, or once the next block is not yet available or would not fit the byte window
+         if (need_to_send_update && batch->blocks.size() < current_request->max_blocks_per_message && can_send_result())
+            return send_update();
+         flush_batch();
+      }
+
+      void flush_batch() {
+         auto msg = fc::raw::pack(state_result{std::move(*batch)});
+         batch.reset();
+         batch_bytes = 0;
+         queue_result(std::move(msg));
+      }
+
+      void queue_result(std::vector<char> msg) {
+         --current_request->max_messages_in_flight;
+         bytes_in_flight += msg.size();
+         send_queue.push_back(std::move(msg));
+         send();
+      }
+
+      // traces and deltas are read and decompressed on the read threads, sessions read different blocks in parallel
+      void read_logs(get_blocks_result_v0 result, bool fetch_traces, bool fetch_deltas, uint32_t current) {
+         reading          = true;
+         auto block_num   = current_request->start_block_num++;
+         auto request_num = current_request_num;
+         plugin->read_thread_pool->post([self = shared_from_this(), result{std::move(result)}, block_num, request_num,
+                                         fetch_traces, fetch_deltas, current,
+                                         trace_filters = current_request->trace_filters,
+                                         delta_filters = current_request->delta_filters]() mutable {
+            auto read = [&] {
+               if (fetch_traces) {
+                  self->plugin->get_log_entry(*self->plugin->trace_log, block_num, result.traces);
+                  if (result.traces && !trace_filters.empty())
+                     result.traces = filter_traces(*result.traces, trace_filters);
+               }
+               if (fetch_deltas) {
+                  self->plugin->get_log_entry(*self->plugin->chain_state_log, block_num, result.deltas);
+                  if (result.deltas && !delta_filters.empty())
+                     result.deltas = filter_deltas(*result.deltas, delta_filters);
+               }
+            };
+            bool ok = false;
+            catch_and_log([&] {
+               read();
+               ok = true;
+            });
+            chain::instrumented_post(app(), priority::medium, chain::executor_category::other, [self, result{std::move(result)}, block_num, request_num, ok, current]() mutable {
+               auto& plugin = self->plugin;
+               if (plugin->stopping || !plugin->sessions.count(self.get()))
+                  return;
+               self->reading = false;
+               self->catch_and_close([&] {
+                  EOS_ASSERT(ok, plugin_exception, "unable to read state history of block ${b}", ("b", block_num));
+                  // a fork or a new request moved the position while reading, the result is stale
+                  if (!self->current_request || request_num != self->current_request_num ||
+                      self->current_request->start_block_num != block_num + 1)
+                     return self->send_update(true);
+                  self->send_result(std::move(result), current);
+               });
+            });
+         });
       }
 
       void send_update(const block_state_ptr& block_state) {
          need_to_send_update = true;
-         if (!send_queue.empty() || !current_request || !current_request->max_messages_in_flight)
+         if (!send_queue.empty() || !can_send_result())
             return;
          get_blocks_result_v0 result;
          result.head = {block_state->block_num, block_state->id};
@@ -315,8 +449,7 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       void send_update(bool changed = false) {
          if (changed)
             need_to_send_update = true;
-         if (!send_queue.empty() || !need_to_send_update || !current_request ||
-             !current_request->max_messages_in_flight)
+         if (!send_queue.empty() || !need_to_send_update || !can_send_result())
             return;
          auto& chain = plugin->chain_plug->chain();
          get_blocks_result_v0 result;
@@ -342,7 +475,7 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
 
       template <typename F>
       void callback(boost::system::error_code ec, const char* what, F f) {
-         app().post( priority::medium, [=]() {
+         chain::instrumented_post( app(), priority::medium, chain::executor_category::other, [=]() {
             if( plugin->stopping )
                return;
             if( ec )
@@ -433,9 +566,26 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       }
    }
 
+   // The changed rows are packed here, while the undo stack still holds them. Serializing, compressing and
+   // appending the entries happens on the write thread in block order, sessions hear of a block once it is stored.
    void on_accepted_block(const block_state_ptr& block_state) {
-      store_traces(block_state);
-      store_chain_state(block_state);
+      auto traces = get_traces(block_state);
+      auto deltas = get_deltas(block_state);
+      if (!write_thread_pool)
+         return on_stored_block(block_state);
+      boost::asio::post(write_thread_pool->get_executor(), [self = shared_from_this(), block_state,
+                                                            traces{std::move(traces)}, deltas{std::move(deltas)}] {
+         catch_and_log([&] { self->store_traces(block_state, traces); });
+         catch_and_log([&] { self->store_chain_state(block_state, deltas); });
+         chain::instrumented_post(app(), priority::medium, chain::executor_category::signals, [self, block_state] {
+            if (!self->stopping)
+               self->on_stored_block(block_state);
+         });
+      });
+   }
+
+   void on_stored_block(const block_state_ptr& block_state) {
+      stored_block_num = block_state->block_num;
       for (auto& s : sessions) {
          auto& p = s.second;
          if (p) {
@@ -446,11 +596,16 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       }
    }
 
+   // waits for the entries posted to the write thread
+   void flush_writes() {
+      if (write_thread_pool)
+         async_thread_pool(write_thread_pool->get_executor(), [] {}).wait();
+   }
 
-   void store_traces(const block_state_ptr& block_state) {
-      if (!trace_log)
-         return;
+   std::vector<augmented_transaction_trace> get_traces(const block_state_ptr& block_state) {
       std::vector<augmented_transaction_trace> traces;
+      if (!trace_log)
+         return traces;
       if (onblock_trace)
          traces.push_back(*onblock_trace);
       for (auto& r : block_state->block->transactions) {
@@ -466,7 +621,13 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       }
       cached_traces.clear();
       onblock_trace.reset();
+      return traces;
+   }
 
+   // called on the write thread
+   void store_traces(const block_state_ptr& block_state, const std::vector<augmented_transaction_trace>& traces) {
+      if (!trace_log)
+         return;
       auto& db         = chain_plug->chain().db();
       auto  traces_bin = zlib_compress_bytes(fc::raw::pack(make_history_context_wrapper(db, trace_debug_mode, traces)));
       EOS_ASSERT(traces_bin.size() == (uint32_t)traces_bin.size(), plugin_exception, "traces is too big");
@@ -482,14 +643,15 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       });
    }
 
-   void store_chain_state(const block_state_ptr& block_state) {
+   std::vector<table_delta> get_deltas(const block_state_ptr& block_state) {
+      std::vector<table_delta> deltas;
       if (!chain_state_log)
-         return;
-      bool fresh = chain_state_log->begin_block() == chain_state_log->end_block();
+         return deltas;
+      bool fresh        = chain_state_fresh;
+      chain_state_fresh = false;
       if (fresh)
          ilog("Placing initial state in block ${n}", ("n", block_state->block->block_num()));
 
-      std::vector<table_delta> deltas;
       auto&                    db = chain_plug->chain().db();
 
       const auto&                                table_id_index = db.get_index<table_id_multi_index>();
@@ -568,6 +730,13 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       process_table("resource_limits_state", db.get_index<resource_limits::resource_limits_state_index>(), pack_row);
       process_table("resource_limits_config", db.get_index<resource_limits::resource_limits_config_index>(), pack_row);
 
+      return deltas;
+   }
+
+   // called on the write thread
+   void store_chain_state(const block_state_ptr& block_state, const std::vector<table_delta>& deltas) {
+      if (!chain_state_log)
+         return;
       auto deltas_bin = zlib_compress_bytes(fc::raw::pack(deltas));
       EOS_ASSERT(deltas_bin.size() == (uint32_t)deltas_bin.size(), plugin_exception, "deltas is too big");
       state_history_log_header header{.magic        = ship_magic(ship_current_version),
@@ -599,6 +768,14 @@ void state_history_plugin::set_program_options(options_description& cli, options
            "your internal network.");
    options("trace-history-debug-mode", bpo::bool_switch()->default_value(false),
            "enable debug mode for trace history");
+   options("state-history-read-threads", bpo::value<uint16_t>()->default_value(my->read_threads),
+           "number of threads added to the chain workers, which read and decompress state history for the connected "
+           "clients after the tasks of higher classes");
+   options("state-history-permessage-deflate", bpo::bool_switch()->default_value(false),
+           "compress the websocket messages of the clients negotiating permessage-deflate");
+   options("state-history-follow-endpoint", bpo::value<string>(),
+           "host:port of the state history endpoint of a node with the full state; a node loaded with "
+           "--partial-state-contract applies the irreversible deltas of its contracts from there");
 }
 
 void state_history_plugin::plugin_initialize(const variables_map& options) {
@@ -610,11 +787,13 @@ void state_history_plugin::plugin_initialize(const variables_map& options) {
       EOS_ASSERT(my->chain_plug, chain::missing_chain_plugin_exception, "");
       auto& chain = my->chain_plug->chain();
       my->applied_transaction_connection.emplace(
-          chain.applied_transaction.connect([&](std::tuple<const transaction_trace_ptr&, const signed_transaction&> t) {
+          chain.applied_transaction.connect(chain::timed_slot("state_history_applied_transaction",
+              [&](std::tuple<const transaction_trace_ptr&, const signed_transaction&> t) {
              my->on_applied_transaction(std::get<0>(t), std::get<1>(t));
-          }));
+          })));
       my->accepted_block_connection.emplace(
-          chain.accepted_block.connect([&](const block_state_ptr& p) { my->on_accepted_block(p); }));
+          chain.accepted_block.connect(chain::timed_slot("state_history_accepted_block",
+              [&](const block_state_ptr& p) { my->on_accepted_block(p); })));
 
       auto                    dir_option = options.at("state-history-dir").as<bfs::path>();
       boost::filesystem::path state_history_dir;
@@ -640,24 +819,62 @@ void state_history_plugin::plugin_initialize(const variables_map& options) {
          my->trace_debug_mode = true;
       }
 
+      my->read_threads = options.at("state-history-read-threads").as<uint16_t>();
+      EOS_ASSERT(my->read_threads > 0, plugin_exception, "state-history-read-threads ${num} must be greater than 0",
+                 ("num", my->read_threads));
+
+      my->permessage_deflate = options.at("state-history-permessage-deflate").as<bool>();
+
+      if (options.count("state-history-follow-endpoint")) {
+         my->follow_endpoint = options.at("state-history-follow-endpoint").as<string>();
+         EOS_ASSERT(my->follow_endpoint.find(':') != string::npos, plugin_exception,
+                    "state-history-follow-endpoint ${e} is not host:port", ("e", my->follow_endpoint));
+         my->follow_position_file = state_history_dir / "follow_position";
+      }
+
       if (options.at("trace-history").as<bool>())
          my->trace_log.emplace("trace_history", (state_history_dir / "trace_history.log").string(),
                                (state_history_dir / "trace_history.index").string());
       if (options.at("chain-state-history").as<bool>())
          my->chain_state_log.emplace("chain_state_history", (state_history_dir / "chain_state_history.log").string(),
                                      (state_history_dir / "chain_state_history.index").string());
+      if (my->chain_state_log)
+         my->chain_state_fresh = my->chain_state_log->begin_block() == my->chain_state_log->end_block();
+      // blocks are applied while replaying, before plugin_startup
+      if (my->trace_log || my->chain_state_log)
+         my->write_thread_pool.emplace("shipw", 1);
    }
    FC_LOG_AND_RETHROW()
 } // state_history_plugin::plugin_initialize
 
-void state_history_plugin::plugin_startup() { my->listen(); }
+void state_history_plugin::plugin_startup() {
+   my->stored_block_num = my->chain_plug->chain().head_block_num();
+   auto& scheduler = my->chain_plug->chain().get_task_scheduler();
+   scheduler.add_workers("ship", my->read_threads);
+   my->read_thread_pool.emplace(scheduler, task_priority::history);
+   my->listen();
+   if (!my->follow_endpoint.empty()) {
+      auto colon   = my->follow_endpoint.rfind(':');
+      my->follower = std::make_shared<state_history_follower>(
+          my->chain_plug->chain(), my->follow_endpoint.substr(0, colon), my->follow_endpoint.substr(colon + 1),
+          my->follow_position_file);
+      my->follower->start();
+   }
+}
 
 void state_history_plugin::plugin_shutdown() {
+   if (my->follower)
+      my->follower->stop();
    my->applied_transaction_connection.reset();
    my->accepted_block_connection.reset();
    while (!my->sessions.empty())
       my->sessions.begin()->second->close();
    my->stopping = true;
+   my->flush_writes();
+   if (my->write_thread_pool)
+      my->write_thread_pool->stop();
+   if (my->read_thread_pool)
+      my->read_thread_pool->cancel();
 }
 
 } // namespace eosio
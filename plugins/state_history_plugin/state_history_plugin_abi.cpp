@@ -32,11 +32,59 @@ extern const char* const state_history_plugin_abi = R"({
                 { "name": "fetch_deltas", "type": "bool" }
             ]
         },
+        {
+            "name": "action_filter", "fields": [
+                { "name": "receiver", "type": "name" },
+                { "name": "action", "type": "name" }
+            ]
+        },
+        {
+            "name": "table_filter", "fields": [
+                { "name": "code", "type": "name" },
+                { "name": "table", "type": "name" }
+            ]
+        },
+        {
+            "name": "get_blocks_request_v1", "fields": [
+                { "name": "start_block_num", "type": "uint32" },
+                { "name": "end_block_num", "type": "uint32" },
+                { "name": "max_messages_in_flight", "type": "uint32" },
+                { "name": "have_positions", "type": "block_position[]" },
+                { "name": "irreversible_only", "type": "bool" },
+                { "name": "fetch_block", "type": "bool" },
+                { "name": "fetch_traces", "type": "bool" },
+                { "name": "fetch_deltas", "type": "bool" },
+                { "name": "trace_filters", "type": "action_filter[]" },
+                { "name": "delta_filters", "type": "table_filter[]" }
+            ]
+        },
+        {
+            "name": "get_blocks_request_v2", "fields": [
+                { "name": "start_block_num", "type": "uint32" },
+                { "name": "end_block_num", "type": "uint32" },
+                { "name": "max_messages_in_flight", "type": "uint32" },
+                { "name": "have_positions", "type": "block_position[]" },
+                { "name": "irreversible_only", "type": "bool" },
+                { "name": "fetch_block", "type": "bool" },
+                { "name": "fetch_traces", "type": "bool" },
+                { "name": "fetch_deltas", "type": "bool" },
+                { "name": "trace_filters", "type": "action_filter[]" },
+                { "name": "delta_filters", "type": "table_filter[]" },
+                { "name": "max_blocks_per_message", "type": "uint32" },
+                { "name": "max_bytes_in_flight", "type": "uint64" }
+            ]
+        },
         {
             "name": "get_blocks_ack_request_v0", "fields": [
                 { "name": "num_messages", "type": "uint32" }
             ]
         },
+        {
+            "name": "get_blocks_ack_request_v1", "fields": [
+                { "name": "num_messages", "type": "uint32" },
+                { "name": "num_bytes", "type": "uint64" }
+            ]
+        },
         {
             "name": "get_blocks_result_v0", "fields": [
                 { "name": "head", "type": "block_position" },
@@ -48,6 +96,13 @@ extern const char* const state_history_plugin_abi = R"({
                 { "name": "deltas", "type": "bytes?" }
             ]
         },
+        {
+            "name": "get_blocks_batch_result_v0", "fields": [
+                { "name": "head", "type": "block_position" },
+                { "name": "last_irreversible", "type": "block_position" },
+                { "name": "blocks", "type": "get_blocks_result_v0[]" }
+            ]
+        },
         {
             "name": "row", "fields": [
                 { "name": "present", "type": "bool" },
@@ -471,8 +526,8 @@ extern const char* const state_history_plugin_abi = R"({
         { "new_type_name": "transaction_id", "type": "checksum256" }
     ],
     "variants": [
-        { "name": "request", "types": ["get_status_request_v0", "get_blocks_request_v0", "get_blocks_ack_request_v0"] },
-        { "name": "result", "types": ["get_status_result_v0", "get_blocks_result_v0"] },
+        { "name": "request", "types": ["get_status_request_v0", "get_blocks_request_v0", "get_blocks_ack_request_v0", "get_blocks_request_v1", "get_blocks_request_v2", "get_blocks_ack_request_v1"] },
+        { "name": "result", "types": ["get_status_result_v0", "get_blocks_result_v0", "get_blocks_batch_result_v0"] },
 
         { "name": "action_receipt", "types": ["action_receipt_v0"] },
         { "name": "action_trace", "types": ["action_trace_v0"] },
@@ -0,0 +1,112 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace eosio { namespace telemetry {
+
+/**
+ *  HDR-style streaming quantile estimator for non-negative values.
+ *
+ *  Values below 2^sub_bucket_bits are counted exactly; larger ones go to log-linear buckets:
+ *  every power of two range is split into 2^sub_bucket_bits equal sub-buckets, so the relative
+ *  error of a quantile is below 2^-sub_bucket_bits (1.6%) whatever the value range is.
+ *  Buckets are allocated up to the largest observed value only, e.g. about 8KB for values up to 10^6.
+ */
+class quantile_sketch {
+public:
+   static constexpr uint32_t sub_bucket_bits = 6;
+   static constexpr uint64_t sub_bucket_count = 1ull << sub_bucket_bits;
+
+   void observe(double value) {
+      const uint64_t v = value <= 0 ? 0 : static_cast<uint64_t>(std::min<double>(std::llround(value),
+                                                                                   std::numeric_limits<int64_t>::max()));
+      const auto index = bucket_index(v);
+      if (index >= _buckets.size()) {
+         _buckets.resize(index + 1);
+      }
+      _buckets[index]++;
+      _count++;
+      _sum += value;
+      _min = std::min(_min, v);
+      _max = std::max(_max, v);
+   }
+
+   void merge(const quantile_sketch& other) {
+      if (other._buckets.size() > _buckets.size()) {
+         _buckets.resize(other._buckets.size());
+      }
+      for (size_t i = 0; i < other._buckets.size(); i++) {
+         _buckets[i] += other._buckets[i];
+      }
+      _count += other._count;
+      _sum += other._sum;
+      _min = std::min(_min, other._min);
+      _max = std::max(_max, other._max);
+   }
+
+   void reset() {
+      *this = quantile_sketch();
+   }
+
+   /// @param q  in [0, 1]
+   /// @return middle of the bucket holding the value of rank `q * count`, 0 if nothing was observed
+   double quantile(double q) const {
+      if (!_count) {
+         return 0;
+      }
+      const uint64_t rank = std::max<uint64_t>(1, std::ceil(std::min(std::max(q, 0.), 1.) * _count));
+      uint64_t seen = 0;
+      for (size_t i = 0; i < _buckets.size(); i++) {
+         seen += _buckets[i];
+         if (seen >= rank) {
+            const auto lower = bucket_lower_bound(i);
+            const auto width = bucket_width(i);
+            const double middle = lower + (width - 1) / 2.;
+            return std::min<double>(std::max<double>(middle, _min), _max);
+         }
+      }
+      return _max;
+   }
+
+   uint64_t count() const { return _count; }
+   double sum() const { return _sum; }
+
+private:
+   static size_t bucket_index(uint64_t v) {
+      if (v < sub_bucket_count) {
+         return v;
+      }
+      const uint32_t msb = 63 - __builtin_clzll(v);
+      const uint32_t shift = msb - sub_bucket_bits;
+      return sub_bucket_count + shift * sub_bucket_count + ((v >> shift) - sub_bucket_count);
+   }
+
+   static uint64_t bucket_lower_bound(size_t index) {
+      if (index < sub_bucket_count) {
+         return index;
+      }
+      const uint64_t shift = (index - sub_bucket_count) / sub_bucket_count;
+      const uint64_t mantissa = sub_bucket_count + (index - sub_bucket_count) % sub_bucket_count;
+      return mantissa << shift;
+   }
+
+   static uint64_t bucket_width(size_t index) {
+      return index < sub_bucket_count ? 1 : 1ull << ((index - sub_bucket_count) / sub_bucket_count);
+   }
+
+   std::vector<uint64_t> _buckets;
+   uint64_t _count = 0;
+   double _sum = 0;
+   uint64_t _min = std::numeric_limits<uint64_t>::max();
+   uint64_t _max = 0;
+};
+
+} } // namespace eosio::telemetry
@@ -4,11 +4,127 @@
  */
 #pragma once
 #include <appbase/application.hpp>
+#include <eosio/chain/types.hpp>
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace prometheus {
+   class Gauge;
+   class Histogram;
+   template <typename T> class Family;
+}
 
 namespace eosio {
 
 using namespace appbase;
 
+namespace telemetry {
+
+/**
+ *  Counter updated by many threads without contention: each thread adds to its own
+ *  cache line, shards are summed up and exported when metrics are scraped.
+ */
+class sharded_counter {
+public:
+   static constexpr size_t shards_count = 16;
+
+   void add(double value) {
+      auto& shard = _shards[shard_index()].value;
+      double current = shard.load(std::memory_order_relaxed);
+      while (!shard.compare_exchange_weak(current, current + value, std::memory_order_relaxed));
+   }
+
+   /// Sum of values added since the previous call.
+   double take() {
+      double sum = 0;
+      for (auto& shard : _shards) {
+         sum += shard.value.exchange(0, std::memory_order_relaxed);
+      }
+      return sum;
+   }
+
+private:
+   struct alignas(64) shard_type {
+      std::atomic<double> value{0};
+   };
+
+   static size_t shard_index() {
+      static std::atomic<size_t> next_index{0};
+      thread_local const size_t index = next_index++ % shards_count;
+      return index;
+   }
+
+   std::array<shard_type, shards_count> _shards;
+};
+
+/// Handles are cheap to copy; default constructed ones do nothing, so metrics may be updated
+/// before (or without) registration.
+class counter_handle {
+public:
+   counter_handle() = default;
+   explicit counter_handle(std::shared_ptr<sharded_counter> counter) : _counter(std::move(counter)) {}
+
+   void increment(double value = 1.) const {
+      if (_counter) {
+         _counter->add(value);
+      }
+   }
+
+private:
+   std::shared_ptr<sharded_counter> _counter;
+};
+
+class gauge_handle {
+public:
+   gauge_handle() = default;
+   explicit gauge_handle(prometheus::Gauge* gauge) : _gauge(gauge) {}
+
+   void set(double value) const;
+
+private:
+   prometheus::Gauge* _gauge = nullptr;
+};
+
+/// Gauges of one metric told apart by their labels, for things coming and going at run time (e.g. peers).
+/// The caller bounds the number of label sets and removes the ones it no longer updates.
+class gauge_family_handle {
+public:
+   using labels_type = std::map<std::string, std::string>;
+
+   gauge_family_handle() = default;
+   explicit gauge_family_handle(prometheus::Family<prometheus::Gauge>* family) : _family(family) {}
+
+   /// adds the gauge of `labels` on the first call
+   void set(const labels_type& labels, double value) const;
+   void remove(const labels_type& labels) const;
+
+private:
+   prometheus::Family<prometheus::Gauge>* _family = nullptr;
+};
+
+class quantile_summary;
+
+/// Observed values go to prometheus buckets and, if quantiles are enabled for the metric, to the summary.
+class histogram_handle {
+public:
+   histogram_handle() = default;
+   explicit histogram_handle(prometheus::Histogram* histogram, quantile_summary* summary = nullptr)
+      : _histogram(histogram), _summary(summary) {}
+
+   void observe(double value) const;
+
+private:
+   prometheus::Histogram* _histogram = nullptr;
+   quantile_summary* _summary = nullptr;
+};
+
+} // namespace telemetry
+
 /**
  *  This is a plugin, intended to create a prometheus server for getting telemetry (using prometheus PULL model)
  */
@@ -30,8 +146,41 @@ public:
    void update_gauge(const std::string& metric_name, const double value);
    void add_histogram(const std::string& metric_name, const std::vector<double>& keypoints);
    void update_histogram(const std::string& metric_name, const double value);
+
+   /// Register metric once and update it through the handle on hot paths (no lookup by name).
+   /// Registering an existing name returns handle of the existing metric.
+   /// Histogram keypoints are the defaults: telemetry-histogram-buckets overrides them per metric name.
+   telemetry::counter_handle register_counter(const std::string& metric_name);
+   telemetry::gauge_handle register_gauge(const std::string& metric_name);
+   telemetry::gauge_family_handle register_gauge_family(const std::string& metric_name, const std::string& help);
+   telemetry::histogram_handle register_histogram(const std::string& metric_name, const std::vector<double>& keypoints);
+
+   struct action_profile_stats {
+      chain::account_name receiver;
+      chain::action_name  action;
+      uint64_t executions = 0;
+      int64_t  wall_time_us = 0;
+      int64_t  billed_cpu_us = 0;
+      int64_t  ram_delta = 0;
+      uint64_t db_intrinsic_calls = 0;
+      uint64_t arena_allocations = 0;
+   };
+
+   struct get_action_profile_params {
+      uint32_t limit = 20;
+   };
+
+   struct get_action_profile_results {
+      std::vector<action_profile_stats> actions; ///< sorted by billed CPU, descending
+      action_profile_stats other;                ///< everything that didn't fit into telemetry-action-profile-size
+   };
 private:
    std::unique_ptr<class telemetry_plugin_impl> my;
 };
 
 }
+
+FC_REFLECT(eosio::telemetry_plugin::action_profile_stats,
+           (receiver)(action)(executions)(wall_time_us)(billed_cpu_us)(ram_delta)(db_intrinsic_calls)(arena_allocations))
+FC_REFLECT(eosio::telemetry_plugin::get_action_profile_params, (limit))
+FC_REFLECT(eosio::telemetry_plugin::get_action_profile_results, (actions)(other))
@@ -0,0 +1,249 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include "metrics_pusher.hpp"
+
+#include <eosio/chain/exceptions.hpp>
+#include <fc/log/logger.hpp>
+#include <prometheus/text_serializer.h>
+
+#include <boost/asio.hpp>
+
+#include <sstream>
+
+namespace eosio { namespace telemetry {
+
+using namespace prometheus;
+using boost::asio::ip::tcp;
+using boost::asio::ip::udp;
+
+namespace {
+
+std::pair<std::string, std::string> split_host_port(const std::string& address, const std::string& default_port) {
+   const auto colon = address.rfind(':');
+   if (colon == std::string::npos) {
+      return {address, default_port};
+   }
+   return {address.substr(0, colon), address.substr(colon + 1)};
+}
+
+/// Replaces the job's metrics on a pushgateway with a plain HTTP PUT.
+class pushgateway_pusher : public metrics_pusher {
+public:
+   pushgateway_pusher(const std::string& url, const std::string& job) {
+      const std::string scheme = "http://";
+      EOS_ASSERT(url.rfind(scheme, 0) == 0, chain::plugin_config_exception,
+                 "pushgateway url should start with ${s}: ${u}", ("s", scheme)("u", url));
+      auto host_port = url.substr(scheme.size());
+      const auto slash = host_port.find('/');
+      if (slash != std::string::npos) {
+         host_port.resize(slash);
+      }
+      std::tie(_host, _port) = split_host_port(host_port, "9091");
+      _path = "/metrics/job/" + job;
+   }
+
+   ~pushgateway_pusher() override {
+      stop();
+   }
+
+protected:
+   void push(const std::vector<MetricFamily>& families) override {
+      const auto body = TextSerializer().Serialize(families);
+
+      boost::asio::io_context ctx;
+      tcp::socket socket(ctx);
+      boost::asio::connect(socket, tcp::resolver(ctx).resolve(_host, _port));
+
+      std::ostringstream request;
+      request << "PUT " << _path << " HTTP/1.1\r\n"
+              << "Host: " << _host << ":" << _port << "\r\n"
+              << "Content-Type: text/plain; version=0.0.4\r\n"
+              << "Content-Length: " << body.size() << "\r\n"
+              << "Connection: close\r\n\r\n"
+              << body;
+      boost::asio::write(socket, boost::asio::buffer(request.str()));
+
+      boost::asio::streambuf response;
+      boost::asio::read_until(socket, response, "\r\n");
+      std::istream status_stream(&response);
+      std::string http_version;
+      unsigned status = 0;
+      status_stream >> http_version >> status;
+      if (status / 100 != 2) {
+         wlog("pushgateway ${h}:${p} responded with status ${s}", ("h", _host)("p", _port)("s", status));
+      }
+   }
+
+private:
+   std::string _host;
+   std::string _port;
+   std::string _path;
+};
+
+/**
+ *  Sends metrics as StatsD lines, several lines per datagram.
+ *  Counters are sent as increments since the previous push; gauges, histogram sums and counts
+ *  and summary quantiles as gauges.
+ */
+class statsd_pusher : public metrics_pusher {
+public:
+   static constexpr size_t max_datagram_size = 1432; // fits into ethernet MTU with IP and UDP headers
+
+   statsd_pusher(const std::string& address, const std::string& prefix)
+      : _socket(_ctx)
+      , _prefix(prefix.empty() ? prefix : prefix + ".")
+   {
+      std::string host, port;
+      std::tie(host, port) = split_host_port(address, "8125");
+      _endpoint = *udp::resolver(_ctx).resolve(udp::v4(), host, port).begin();
+      _socket.open(udp::v4());
+   }
+
+   ~statsd_pusher() override {
+      stop();
+   }
+
+protected:
+   void push(const std::vector<MetricFamily>& families) override {
+      std::string datagram;
+      const auto add_line = [&](const std::string& line) {
+         if (!datagram.empty() && datagram.size() + 1 + line.size() > max_datagram_size) {
+            send(datagram);
+            datagram.clear();
+         }
+         if (!datagram.empty()) {
+            datagram += '\n';
+         }
+         datagram += line;
+      };
+      const auto gauge = [&](const std::string& name, double value) {
+         add_line(name + ":" + std::to_string(value) + "|g");
+      };
+
+      for (const auto& family : families) {
+         for (const auto& metric : family.metric) {
+            const auto name = metric_name(family.name, metric);
+            switch (family.type) {
+               case MetricType::Counter: {
+                  auto& last = _last_counters[name];
+                  const double delta = metric.counter.value - last;
+                  last = metric.counter.value;
+                  if (delta > 0) {
+                     add_line(name + ":" + std::to_string(delta) + "|c");
+                  }
+                  break;
+               }
+               case MetricType::Gauge:
+                  gauge(name, metric.gauge.value);
+                  break;
+               case MetricType::Histogram:
+                  gauge(name + ".count", metric.histogram.sample_count);
+                  gauge(name + ".sum", metric.histogram.sample_sum);
+                  break;
+               case MetricType::Summary:
+                  gauge(name + ".count", metric.summary.sample_count);
+                  gauge(name + ".sum", metric.summary.sample_sum);
+                  for (const auto& q : metric.summary.quantile) {
+                     gauge(name + ".p" + quantile_suffix(q.quantile), q.value);
+                  }
+                  break;
+               default:
+                  gauge(name, metric.untyped.value);
+                  break;
+            }
+         }
+      }
+      if (!datagram.empty()) {
+         send(datagram);
+      }
+   }
+
+private:
+   std::string metric_name(const std::string& family, const ClientMetric& metric) const {
+      std::string name = _prefix + family;
+      for (const auto& label : metric.label) {
+         name += "." + label.value;
+      }
+      return name;
+   }
+
+   /// 0.5 -> "50", 0.99 -> "99", 0.999 -> "999"
+   static std::string quantile_suffix(double q) {
+      auto digits = std::to_string(q);
+      digits = digits.substr(digits.find('.') + 1);
+      digits.erase(digits.find_last_not_of('0') + 1);
+      if (digits.size() < 2) {
+         digits.resize(2, '0');
+      }
+      return digits;
+   }
+
+   void send(const std::string& datagram) {
+      boost::system::error_code ec;
+      _socket.send_to(boost::asio::buffer(datagram), _endpoint, 0, ec);
+      if (ec) {
+         wlog("cannot send metrics to statsd: ${e}", ("e", ec.message()));
+      }
+   }
+
+   boost::asio::io_context _ctx;
+   udp::socket _socket;
+   udp::endpoint _endpoint;
+   const std::string _prefix;
+   std::map<std::string, double> _last_counters;
+};
+
+} // namespace
+
+metrics_pusher::~metrics_pusher() = default;
+
+std::unique_ptr<metrics_pusher> metrics_pusher::make_pushgateway(const std::string& url, const std::string& job) {
+   return std::make_unique<pushgateway_pusher>(url, job);
+}
+
+std::unique_ptr<metrics_pusher> metrics_pusher::make_statsd(const std::string& address, const std::string& prefix) {
+   return std::make_unique<statsd_pusher>(address, prefix);
+}
+
+void metrics_pusher::start(collectables_type collectables, fc::microseconds interval) {
+   _collectables = std::move(collectables);
+   _interval = interval;
+   _thread = std::thread([this]() { run(); });
+}
+
+void metrics_pusher::stop() {
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopping = true;
+   }
+   _cv.notify_all();
+   if (_thread.joinable()) {
+      _thread.join();
+   }
+}
+
+void metrics_pusher::run() {
+   std::unique_lock<std::mutex> lock(_mutex);
+   while (!_cv.wait_for(lock, std::chrono::microseconds(_interval.count()), [this]() { return _stopping; })) {
+      lock.unlock();
+      try {
+         std::vector<MetricFamily> families;
+         for (const auto& weak : _collectables) {
+            if (auto collectable = weak.lock()) {
+               auto collected = collectable->Collect();
+               std::move(collected.begin(), collected.end(), std::back_inserter(families));
+            }
+         }
+         push(families);
+      } catch (const fc::exception& e) {
+         wlog("cannot push metrics: ${e}", ("e", e.to_detail_string()));
+      } catch (const std::exception& e) {
+         wlog("cannot push metrics: ${e}", ("e", e.what()));
+      }
+      lock.lock();
+   }
+}
+
+} } // namespace eosio::telemetry
@@ -0,0 +1,56 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <prometheus/collectable.h>
+#include <prometheus/metric_family.h>
+
+#include <fc/time.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace eosio { namespace telemetry {
+
+/**
+ *  Periodically sends metrics to a collector for nodes that cannot be scraped (e.g. behind NAT).
+ *  Metrics are collected and sent from a dedicated thread, so a slow collector delays only the next push.
+ */
+class metrics_pusher {
+public:
+   using collectables_type = std::vector<std::weak_ptr<prometheus::Collectable>>;
+
+   /// implementations call stop() in destructor, so the thread never runs push() of a destroyed object
+   virtual ~metrics_pusher();
+
+   /// pushgateway URL, e.g. http://127.0.0.1:9091; metrics are replaced under /metrics/job/<job>
+   static std::unique_ptr<metrics_pusher> make_pushgateway(const std::string& url, const std::string& job);
+   /// StatsD collector host:port; metric names are prefixed with `<prefix>.`
+   static std::unique_ptr<metrics_pusher> make_statsd(const std::string& address, const std::string& prefix);
+
+   void start(collectables_type collectables, fc::microseconds interval);
+   void stop();
+
+protected:
+   virtual void push(const std::vector<prometheus::MetricFamily>& families) = 0;
+
+private:
+   void run();
+
+   collectables_type _collectables;
+   fc::microseconds _interval;
+   std::thread _thread;
+   std::mutex _mutex;
+   std::condition_variable _cv;
+   bool _stopping = false;
+};
+
+} } // namespace eosio::telemetry
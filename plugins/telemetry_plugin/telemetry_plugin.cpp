@@ -3,13 +3,40 @@
  *  @copyright defined in LICENSE
  */
 #include <eosio/telemetry_plugin/telemetry_plugin.hpp>
+#include <eosio/telemetry_plugin/quantile_sketch.hpp>
 #include <fc/exception/exception.hpp>
+#include <eosio/chain/async_log.hpp>
+#include <eosio/chain/executor_stats.hpp>
 #include <eosio/chain/plugin_interface.hpp>
+#include <eosio/chain/signal_subscribers.hpp>
+#include <eosio/chain/signature_recovery_cache.hpp>
+#include <eosio/chain/thread_utils.hpp>
+#include <eosio/chain_plugin/chain_plugin.hpp>
+#include <eosio/http_client_plugin/http_client_plugin.hpp>
+#include <eosio/http_plugin/http_plugin.hpp>
+#include <fc/io/json.hpp>
 #include <prometheus/exposer.h>
 
+#include "metrics_pusher.hpp"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/signals2/connection.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
 #define LATENCY_HISTOGRAM_KEYPOINTS \
     {1000, 2000, 3000, 4000, 5000, 6000, 7000, 8000, 9000, 10000, 15000, 20000, 180000}
 
+// microseconds, stages take from a few us (trx signature recovery) to seconds (fork switch)
+#define STAGE_HISTOGRAM_KEYPOINTS \
+    {10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000}
+
 
 namespace eosio {
     using namespace chain::plugin_interface;
@@ -17,76 +44,834 @@ namespace eosio {
 
     static appbase::abstract_plugin &_telemetry_plugin = app().register_plugin<telemetry_plugin>();
 
+    namespace telemetry {
+        /**
+         *  Quantiles over a sliding window: values go to the current sketch, which replaces
+         *  the previous one every `window`; quantiles are computed over both of them.
+         */
+        class quantile_summary {
+        public:
+            explicit quantile_summary(fc::microseconds window) : window(window), rotated(fc::time_point::now()) {}
+
+            void observe(double value) {
+                std::lock_guard<std::mutex> lock(mutex);
+                rotate(fc::time_point::now());
+                current.observe(value);
+                total_count++;
+                total_sum += value;
+            }
+
+            ClientMetric::Summary collect(const std::vector<double>& quantiles) {
+                ClientMetric::Summary summary;
+                quantile_sketch window_sketch;
+                {
+                    // copy only, so `observe` is not blocked while quantiles are computed
+                    std::lock_guard<std::mutex> lock(mutex);
+                    rotate(fc::time_point::now());
+                    window_sketch = previous;
+                    window_sketch.merge(current);
+                    summary.sample_count = total_count;
+                    summary.sample_sum = total_sum;
+                }
+                for (const auto q : quantiles) {
+                    summary.quantile.push_back({q, window_sketch.quantile(q)});
+                }
+                return summary;
+            }
+
+        private:
+            void rotate(const fc::time_point& now) {
+                if (now - rotated < window) {
+                    return;
+                }
+                if (now - rotated < window + window) {
+                    previous = std::move(current);
+                } else {
+                    previous.reset(); // nothing was observed during the last window
+                }
+                current.reset();
+                rotated = now;
+            }
+
+            const fc::microseconds window;
+            std::mutex mutex;
+            fc::time_point rotated;
+            quantile_sketch current;
+            quantile_sketch previous;
+            uint64_t total_count = 0; ///< since start, like prometheus summaries
+            double total_sum = 0;
+        };
+
+        void gauge_handle::set(double value) const {
+            if (_gauge) {
+                _gauge->Set(value);
+            }
+        }
+
+        void gauge_family_handle::set(const labels_type& labels, double value) const {
+            if (_family) {
+                _family->Add(labels).Set(value);
+            }
+        }
+
+        void gauge_family_handle::remove(const labels_type& labels) const {
+            if (_family) {
+                // Add returns the existing gauge of `labels`
+                _family->Remove(&_family->Add(labels));
+            }
+        }
+
+        void histogram_handle::observe(double value) const {
+            if (_histogram) {
+                _histogram->Observe(value);
+            }
+            if (_summary) {
+                _summary->observe(value);
+            }
+        }
+    }
+
+    /**
+     *  Exports quantile summaries of histograms as `<histogram name>_summary`.
+     */
+    class summary_collectable : public Collectable {
+    public:
+        telemetry::quantile_summary* add(const std::string& name, fc::microseconds window) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto& summary = summaries[name];
+            if (!summary) {
+                summary = std::make_unique<telemetry::quantile_summary>(window);
+            }
+            return summary.get();
+        }
+
+        std::vector<MetricFamily> Collect() override {
+            static const std::vector<double> quantiles = {0.5, 0.9, 0.99, 0.999};
+            std::vector<MetricFamily> families;
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& item : summaries) {
+                MetricFamily family{item.first + "_summary", "Quantiles of " + item.first, MetricType::Summary, {}};
+                ClientMetric metric;
+                metric.summary = item.second->collect(quantiles);
+                family.metric.push_back(std::move(metric));
+                families.push_back(std::move(family));
+            }
+            return families;
+        }
+
+    private:
+        std::mutex mutex;
+        std::map<std::string, std::unique_ptr<telemetry::quantile_summary>> summaries;
+    };
+
+    /// Progress of block log index reconstruction, read from the chain library when scraped.
+    class block_log_index_collectable : public Collectable {
+    public:
+        std::vector<MetricFamily> Collect() override {
+            const auto& progress = chain::block_log::index_reconstruction_progress();
+            const auto gauge = [](const std::string& name, const std::string& help, double value) {
+                MetricFamily family{name, help, MetricType::Gauge, {}};
+                ClientMetric metric;
+                metric.gauge.value = value;
+                family.metric.push_back(std::move(metric));
+                return family;
+            };
+            return {
+                gauge("block_log_index_blocks_total", "Blocks to index in the latest block log index reconstruction",
+                      progress.blocks_total.load()),
+                gauge("block_log_index_blocks_indexed", "Blocks indexed so far in the latest block log index reconstruction",
+                      progress.blocks_indexed.load())
+            };
+        }
+    };
+
+    /// Hits and misses of the signature recovery cache of the process, read from the chain library when scraped.
+    class signature_recovery_collectable : public Collectable {
+    public:
+        std::vector<MetricFamily> Collect() override {
+            const auto& stats = chain::signature_recovery_cache::global().stats();
+            const auto counter = [](const std::string& name, const std::string& help, double value) {
+                MetricFamily family{name, help, MetricType::Counter, {}};
+                ClientMetric metric;
+                metric.counter.value = value;
+                family.metric.push_back(std::move(metric));
+                return family;
+            };
+            return {
+                counter("signature_recovery_cache_hit_cnt", "Keys of signatures found in the recovery cache",
+                        stats.hits.load()),
+                counter("signature_recovery_cache_miss_cnt", "Keys of signatures recovered and added to the recovery cache",
+                        stats.misses.load())
+            };
+        }
+    };
+
+    /// Messages of the async log of the process, read from the chain library when scraped.
+    class async_log_collectable : public Collectable {
+    public:
+        std::vector<MetricFamily> Collect() override {
+            const auto& log = chain::async_log::global();
+            const auto& stats = log.stats();
+            const auto metric = [](const std::string& name, const std::string& help, MetricType type, double value) {
+                MetricFamily family{name, help, type, {}};
+                ClientMetric m;
+                if (type == MetricType::Counter) {
+                    m.counter.value = value;
+                } else {
+                    m.gauge.value = value;
+                }
+                family.metric.push_back(std::move(m));
+                return family;
+            };
+            return {
+                metric("async_log_queued_cnt", "Log messages queued for the background logging thread",
+                       MetricType::Counter, stats.queued.load()),
+                metric("async_log_written_cnt", "Log messages written by the background logging thread",
+                       MetricType::Counter, stats.written.load()),
+                metric("async_log_dropped_cnt", "Log messages lost because the logging queue was full",
+                       MetricType::Counter, stats.dropped.load()),
+                metric("async_log_backlog", "Log messages waiting in the logging queue",
+                       MetricType::Gauge, log.backlog()),
+                metric("async_log_max_backlog", "Most log messages waiting in the logging queue",
+                       MetricType::Gauge, stats.max_backlog.load())
+            };
+        }
+    };
+
+    /// Requests and connections of the keep-alive pool of http_client_plugin, read from the plugin when scraped.
+    class http_client_pool_collectable : public Collectable {
+    public:
+        std::vector<MetricFamily> Collect() override {
+            const auto* client = app().find_plugin<http_client_plugin>();
+            if (!client) {
+                return {};
+            }
+            const auto& stats = client->pool_stats();
+            const auto metric = [](const std::string& name, const std::string& help, MetricType type, double value) {
+                MetricFamily family{name, help, type, {}};
+                ClientMetric m;
+                if (type == MetricType::Counter) {
+                    m.counter.value = value;
+                } else {
+                    m.gauge.value = value;
+                }
+                family.metric.push_back(std::move(m));
+                return family;
+            };
+            return {
+                metric("http_client_request_cnt", "Requests of remote signature providers sent through pooled connections",
+                       MetricType::Counter, stats.requests.load()),
+                metric("http_client_failure_cnt", "Pooled requests without a response",
+                       MetricType::Counter, stats.failures.load()),
+                metric("http_client_retry_cnt", "Pooled requests sent again after their reused connection failed",
+                       MetricType::Counter, stats.retries.load()),
+                metric("http_client_connection_opened_cnt", "Pooled connections opened",
+                       MetricType::Counter, stats.connections_opened.load()),
+                metric("http_client_connection_reused_cnt", "Requests sent through an idle pooled connection",
+                       MetricType::Counter, stats.connections_reused.load()),
+                metric("http_client_standby_opened_cnt", "Pooled connections opened ahead of a request",
+                       MetricType::Counter, stats.standby_opened.load()),
+                metric("http_client_connect_us", "Time spent opening pooled connections, TLS handshakes included",
+                       MetricType::Counter, stats.connect_us.load()),
+                metric("http_client_request_us", "Time from sending pooled requests to reading their responses",
+                       MetricType::Counter, stats.request_us.load()),
+                metric("http_client_idle_connections", "Pooled connections waiting for a request",
+                       MetricType::Gauge, stats.idle.load())
+            };
+        }
+    };
+
+    /// Tasks of the workers shared by the chain and the plugins, by class, read from the controller when scraped.
+    class task_scheduler_collectable : public Collectable {
+    public:
+        std::vector<MetricFamily> Collect() override {
+            auto* chain_plug = app().find_plugin<chain_plugin>();
+            if (!chain_plug || chain_plug->get_state() != abstract_plugin::started) {
+                return {};
+            }
+            const auto& scheduler = chain_plug->chain().get_task_scheduler();
+            const auto metric = [](const chain::task_class_stats& s) {
+                ClientMetric m;
+                m.label = { {"class", chain::to_string(s.priority)} };
+                return m;
+            };
+
+            MetricFamily submitted{"task_submitted_cnt", "Tasks submitted to the shared workers, by class", MetricType::Counter, {}};
+            MetricFamily executed{"task_executed_cnt", "Tasks run by the shared workers, by class", MetricType::Counter, {}};
+            MetricFamily stolen{"task_stolen_cnt", "Tasks run by another worker than the one they were queued on, by class",
+                                MetricType::Counter, {}};
+            MetricFamily queued{"task_queued", "Tasks waiting for a shared worker, by class", MetricType::Gauge, {}};
+            MetricFamily wait{"task_wait_us", "Time tasks waited for a shared worker, by class", MetricType::Counter, {}};
+            MetricFamily busy{"task_busy_us", "Time the shared workers ran tasks, by class", MetricType::Counter, {}};
+            for (const auto& s : scheduler.stats()) {
+                auto m = metric(s);
+                m.counter.value = s.submitted;
+                submitted.metric.push_back(m);
+                m = metric(s);
+                m.counter.value = s.executed;
+                executed.metric.push_back(m);
+                m = metric(s);
+                m.counter.value = s.stolen;
+                stolen.metric.push_back(m);
+                m = metric(s);
+                m.gauge.value = s.queued;
+                queued.metric.push_back(m);
+                m = metric(s);
+                m.counter.value = s.wait_us;
+                wait.metric.push_back(m);
+                m = metric(s);
+                m.counter.value = s.busy_us;
+                busy.metric.push_back(m);
+            }
+            MetricFamily workers{"task_workers", "Shared worker threads", MetricType::Gauge, {}};
+            ClientMetric w;
+            w.gauge.value = scheduler.workers();
+            workers.metric.push_back(w);
+            return { submitted, executed, stolen, queued, wait, busy, workers };
+        }
+    };
+
+    /// Work posted to the application thread and CPU time of the named threads, read from the chain library when scraped.
+    class executor_collectable : public Collectable {
+    public:
+        std::vector<MetricFamily> Collect() override {
+            using chain::executor_stats;
+            auto& stats = executor_stats::global();
+            const auto metric = [](const std::string& label, const std::string& value) {
+                ClientMetric m;
+                m.label = { {label, value} };
+                return m;
+            };
+
+            MetricFamily depth{"app_queue_depth", "Work waiting in the application queue, by priority", MetricType::Gauge, {}};
+            MetricFamily posted{"app_queue_posted_cnt", "Work posted to the application queue, by priority", MetricType::Counter, {}};
+            MetricFamily wait{"app_queue_wait_us", "Time work waited in the application queue, by priority", MetricType::Counter, {}};
+            MetricFamily max_wait{"app_queue_max_wait_us", "Longest wait in the application queue since the previous scrape, by priority",
+                                  MetricType::Gauge, {}};
+            for (size_t i = 0; i < executor_stats::levels_count; i++) {
+                const auto& level = stats.levels[i];
+                const std::string name = executor_stats::level_name(i);
+                auto m = metric("priority", name);
+                m.gauge.value = level.depth.load();
+                depth.metric.push_back(m);
+                m = metric("priority", name);
+                m.counter.value = level.posted.load();
+                posted.metric.push_back(m);
+                m = metric("priority", name);
+                m.counter.value = level.wait_us.load();
+                wait.metric.push_back(m);
+                m = metric("priority", name);
+                m.gauge.value = stats.take_max_wait(i);
+                max_wait.metric.push_back(m);
+            }
+
+            MetricFamily runs{"app_handler_runs_cnt", "Work run on the application thread, by poster", MetricType::Counter, {}};
+            MetricFamily run_time{"app_handler_run_us", "Time work ran on the application thread, by poster", MetricType::Counter, {}};
+            MetricFamily run_wait{"app_handler_wait_us", "Time work waited in the application queue, by poster", MetricType::Counter, {}};
+            for (size_t i = 0; i < stats.categories.size(); i++) {
+                const auto& category = stats.categories[i];
+                const std::string name = executor_stats::category_name(static_cast<chain::executor_category>(i));
+                auto m = metric("category", name);
+                m.counter.value = category.runs.load();
+                runs.metric.push_back(m);
+                m = metric("category", name);
+                m.counter.value = category.run_us.load();
+                run_time.metric.push_back(m);
+                m = metric("category", name);
+                m.counter.value = category.wait_us.load();
+                run_wait.metric.push_back(m);
+            }
+
+            MetricFamily thread_cpu{"thread_cpu_us", "CPU time of the named threads", MetricType::Counter, {}};
+            for (const auto& t : chain::thread_cpu_times()) {
+                auto m = metric("thread", t.name);
+                m.counter.value = t.cpu_us;
+                thread_cpu.metric.push_back(std::move(m));
+            }
+            return { depth, posted, wait, max_wait, runs, run_time, run_wait, thread_cpu };
+        }
+    };
+
+    /// Calls of the subscribers of the controller signals and queues of the asynchronous ones, read from the chain library when scraped.
+    class signal_subscribers_collectable : public Collectable {
+    public:
+        std::vector<MetricFamily> Collect() override {
+            MetricFamily calls{"signal_subscriber_calls_cnt", "Signals handled, by subscriber", MetricType::Counter, {}};
+            MetricFamily run_time{"signal_subscriber_run_us", "Time spent handling signals, by subscriber", MetricType::Counter, {}};
+            MetricFamily max_run{"signal_subscriber_max_run_us", "Longest signal handling since the previous scrape, by subscriber",
+                                 MetricType::Gauge, {}};
+            MetricFamily backlog{"signal_subscriber_backlog", "Signals queued for an asynchronous subscriber", MetricType::Gauge, {}};
+            MetricFamily full_waits{"signal_subscriber_full_wait_cnt",
+                                    "Signals the main thread waited to queue for an asynchronous subscriber", MetricType::Counter, {}};
+            chain::signal_subscribers::global().for_each([&](chain::subscriber_stats& stats) {
+                ClientMetric m;
+                m.label = { {"subscriber", stats.name} };
+                auto c = m;
+                c.counter.value = stats.calls.load();
+                calls.metric.push_back(c);
+                c = m;
+                c.counter.value = stats.run_us.load();
+                run_time.metric.push_back(c);
+                c = m;
+                c.gauge.value = stats.take_max_run();
+                max_run.metric.push_back(c);
+                c = m;
+                c.gauge.value = stats.backlog.load();
+                backlog.metric.push_back(c);
+                c = m;
+                c.counter.value = stats.full_waits.load();
+                full_waits.metric.push_back(c);
+            });
+            return { calls, run_time, max_run, backlog, full_waits };
+        }
+    };
+
+    /**
+     *  Registry wrapper that merges sharded counters into prometheus ones before every scrape.
+     */
+    class sharded_collectable : public Collectable {
+    public:
+        struct counter_entry {
+            std::shared_ptr<telemetry::sharded_counter> shards;
+            std::reference_wrapper<Counter> counter;
+        };
+
+        explicit sharded_collectable(std::shared_ptr<Registry> registry) : registry(std::move(registry)) {}
+
+        std::vector<MetricFamily> Collect() override {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto& entry : counters) {
+                    const auto value = entry.shards->take();
+                    if (value != 0) {
+                        entry.counter.get().Increment(value);
+                    }
+                }
+            }
+            return registry->Collect();
+        }
+
+        void add(const counter_entry& entry) {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.push_back(entry);
+        }
+
+    private:
+        std::shared_ptr<Registry> registry;
+        std::mutex mutex;
+        std::vector<counter_entry> counters;
+    };
+
+    /**
+     *  Resources used by contracts, aggregated by (receiver, action).
+     *  At most `capacity` keys are tracked: when a new key arrives and the table is full, the key
+     *  with the lowest billed CPU goes to the "other" bucket, so heavy contracts stay visible.
+     */
+    class action_profiler : public Collectable {
+    public:
+        using key_type = std::pair<chain::account_name, chain::action_name>;
+        using stats_type = telemetry_plugin::action_profile_stats;
+
+        explicit action_profiler(size_t capacity) : capacity(capacity) {}
+
+        void add(const chain::controller::action_profile& p) {
+            std::lock_guard<std::mutex> lock(mutex);
+            const key_type key(p.receiver, p.action);
+            auto it = stats.find(key);
+            if (it == stats.end()) {
+                if (stats.size() >= capacity) {
+                    evict_lightest();
+                }
+                it = stats.emplace(key, stats_type{p.receiver, p.action}).first;
+            }
+            accumulate(it->second, p);
+        }
+
+        telemetry_plugin::get_action_profile_results get(const telemetry_plugin::get_action_profile_params& params) {
+            telemetry_plugin::get_action_profile_results result;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                result.actions.reserve(stats.size());
+                for (const auto& item : stats) {
+                    result.actions.push_back(item.second);
+                }
+                result.other = other;
+            }
+            std::sort(result.actions.begin(), result.actions.end(), [](const stats_type& a, const stats_type& b) {
+                return a.billed_cpu_us > b.billed_cpu_us;
+            });
+            if (result.actions.size() > params.limit) {
+                result.actions.resize(params.limit);
+            }
+            return result;
+        }
+
+        std::vector<MetricFamily> Collect() override {
+            std::vector<MetricFamily> families = {
+                {"action_executions_total", "Executions of action by receiver", MetricType::Counter, {}},
+                {"action_wall_time_us_total", "Wall time spent in action by receiver", MetricType::Counter, {}},
+                {"action_billed_cpu_us_total", "Billed CPU attributed to action by receiver", MetricType::Counter, {}},
+                {"action_ram_delta_bytes", "Sum of RAM deltas caused by action by receiver", MetricType::Gauge, {}},
+                {"action_db_intrinsic_calls_total", "Database intrinsics called by action by receiver", MetricType::Counter, {}},
+                {"action_arena_allocations_total", "Transaction arena allocations made by action by receiver", MetricType::Counter, {}},
+            };
+            std::vector<stats_type> snapshot;
+            stats_type other_snapshot;
+            {
+                // copy only, so `add` is not blocked while metrics are built
+                std::lock_guard<std::mutex> lock(mutex);
+                snapshot.reserve(stats.size());
+                for (const auto& item : stats) {
+                    snapshot.push_back(item.second);
+                }
+                other_snapshot = other;
+            }
+            for (const auto& s : snapshot) {
+                add_metrics(families, s.receiver.to_string(), s.action.to_string(), s);
+            }
+            add_metrics(families, "other", "other", other_snapshot);
+            return families;
+        }
+
+    private:
+        static void accumulate(stats_type& s, const chain::controller::action_profile& p) {
+            s.executions++;
+            s.wall_time_us += p.elapsed.count();
+            s.billed_cpu_us += p.billed_cpu_us;
+            s.ram_delta += p.ram_delta;
+            s.db_intrinsic_calls += p.db_intrinsic_calls;
+            s.arena_allocations += p.arena_allocations;
+        }
+
+        static void merge(stats_type& to, const stats_type& from) {
+            to.executions += from.executions;
+            to.wall_time_us += from.wall_time_us;
+            to.billed_cpu_us += from.billed_cpu_us;
+            to.ram_delta += from.ram_delta;
+            to.db_intrinsic_calls += from.db_intrinsic_calls;
+            to.arena_allocations += from.arena_allocations;
+        }
+
+        static void add_metrics(std::vector<MetricFamily>& families, const std::string& receiver,
+                                const std::string& action, const stats_type& s) {
+            const double values[] = { double(s.executions), double(s.wall_time_us), double(s.billed_cpu_us),
+                                      double(s.ram_delta), double(s.db_intrinsic_calls),
+                                      double(s.arena_allocations) };
+            for (size_t i = 0; i < families.size(); i++) {
+                ClientMetric metric;
+                metric.label = { {"receiver", receiver}, {"action", action} };
+                if (families[i].type == MetricType::Gauge) {
+                    metric.gauge.value = values[i];
+                } else {
+                    metric.counter.value = values[i];
+                }
+                families[i].metric.push_back(std::move(metric));
+            }
+        }
+
+        void evict_lightest() {
+            auto lightest = std::min_element(stats.begin(), stats.end(), [](const auto& a, const auto& b) {
+                return a.second.billed_cpu_us < b.second.billed_cpu_us;
+            });
+            if (lightest != stats.end()) {
+                merge(other, lightest->second);
+                stats.erase(lightest);
+            }
+        }
+
+        struct key_hash {
+            size_t operator()(const key_type& key) const {
+                return std::hash<uint64_t>()(key.first.value) ^ (std::hash<uint64_t>()(key.second.value) << 1);
+            }
+        };
+
+        const size_t capacity;
+        std::mutex mutex;
+        std::unordered_map<key_type, stats_type, key_hash> stats;
+        stats_type other{N(other), N(other)};
+    };
+
     class telemetry_plugin_impl {
     private:
         channels::accepted_block::channel_type::handle _on_accepted_block_handle;
         channels::irreversible_block::channel_type::handle _on_irreversible_block_handle;
+        boost::signals2::scoped_connection _pipeline_stage_connection;
+        boost::signals2::scoped_connection _action_profile_connection;
+        boost::signals2::scoped_connection _wasm_cache_connection;
+        /// signal-async-subscriber = telemetry
+        std::shared_ptr<chain::async_subscriber> _signal_queue;
+        telemetry::counter_handle accepted_trx_total;
+        telemetry::gauge_handle last_irreversible_latency;
+        telemetry::histogram_handle irreversible_latency;
+
+        using stage = chain::controller::pipeline_stage;
+        std::array<telemetry::histogram_handle, static_cast<size_t>(stage::stages_count)> stage_histograms;
+        telemetry::counter_handle wasm_cache_hits;
+        telemetry::counter_handle wasm_cache_misses;
+        telemetry::counter_handle wasm_cache_evictions;
+        telemetry::gauge_handle wasm_cache_bytes;
+        telemetry::histogram_handle wasm_instantiation;
+
+        std::mutex http_latency_mtx;
+        std::map<string, telemetry::histogram_handle> http_latency; ///< by URL, registered on first request
+        std::set<string> http_latency_pending;
 
         std::unique_ptr<Exposer> exposer;
         std::shared_ptr<Registry> registry;
+        std::shared_ptr<sharded_collectable> collectable;
+        std::shared_ptr<summary_collectable> summaries;
+        std::shared_ptr<block_log_index_collectable> block_log_index = std::make_shared<block_log_index_collectable>();
+        std::shared_ptr<signature_recovery_collectable> signature_recovery = std::make_shared<signature_recovery_collectable>();
+        std::shared_ptr<executor_collectable> executor = std::make_shared<executor_collectable>();
+        std::shared_ptr<async_log_collectable> async_log_stats = std::make_shared<async_log_collectable>();
+        std::shared_ptr<http_client_pool_collectable> http_client_pool_stats = std::make_shared<http_client_pool_collectable>();
+        std::shared_ptr<signal_subscribers_collectable> signal_subscribers_stats = std::make_shared<signal_subscribers_collectable>();
+        std::shared_ptr<task_scheduler_collectable> task_scheduler_stats = std::make_shared<task_scheduler_collectable>();
+        fc::optional<chain::thread_cpu_registration> main_thread_cpu;
+        std::unique_ptr<telemetry::metrics_pusher> pusher;
 
         void start_server() {
-            exposer = std::make_unique<Exposer>(endpoint, uri, threads);
+            if (!endpoint.empty()) {
+                exposer = std::make_unique<Exposer>(endpoint, uri, threads);
+            }
+        }
+
+        void start_pusher(const telemetry::metrics_pusher::collectables_type& collectables) {
+            if (push_mode == "pushgateway") {
+                pusher = telemetry::metrics_pusher::make_pushgateway(push_address, push_job);
+            } else if (push_mode == "statsd") {
+                pusher = telemetry::metrics_pusher::make_statsd(push_address, push_job);
+            }
+            if (pusher) {
+                pusher->start(collectables, push_interval);
+                ilog("Pushing telemetry to ${m} ${a} every ${i} ms",
+                     ("m", push_mode)("a", push_address)("i", push_interval.count() / 1000));
+            }
         }
 
         void add_event_handlers() {
+            auto chain_plug = app().find_plugin<chain_plugin>();
+            if (chain_plug && chain_plug->get_state() != abstract_plugin::registered) {
+                _signal_queue = chain_plug->make_async_subscriber("telemetry");
+            }
+            // the handlers only use metric handles, which may be updated from any thread
+            accepted_trx_total = register_counter("accepted_trx_total");
             _on_accepted_block_handle = app().get_channel<channels::accepted_block>()
-                    .subscribe([this](block_state_ptr s) {
-                        update_counter("accepted_trx_total", s->trxs.size());
-                    });
+                    .subscribe(chain::subscriber_slot("telemetry_accepted_block", _signal_queue,
+                        [this](const block_state_ptr& s) {
+                            accepted_trx_total.increment(s->trxs.size());
+                        }));
 
+            last_irreversible_latency = register_gauge("last_irreversible_latency");
+            irreversible_latency = register_histogram("irreversible_latency", LATENCY_HISTOGRAM_KEYPOINTS);
             _on_irreversible_block_handle = app().get_channel<channels::irreversible_block>()
-                    .subscribe([this](block_state_ptr s) {
-                        fc::microseconds latency = fc::time_point::now() - s->header.timestamp.to_time_point();
-                        int64_t latency_millis = latency.count() / 1000;
-                        update_gauge("last_irreversible_latency", latency_millis);
-                        update_histogram("irreversible_latency", latency_millis);
+                    .subscribe(chain::subscriber_slot("telemetry_irreversible_block", _signal_queue,
+                        [this](const block_state_ptr& s) {
+                            fc::microseconds latency = fc::time_point::now() - s->header.timestamp.to_time_point();
+                            int64_t latency_millis = latency.count() / 1000;
+                            last_irreversible_latency.set(latency_millis);
+                            irreversible_latency.observe(latency_millis);
+                        }));
+
+            if (chain_plug && chain_plug->get_state() != abstract_plugin::registered) {
+                _pipeline_stage_connection = chain_plug->chain().pipeline_stage_timed.connect(
+                    [this](const chain::controller::pipeline_stage_timing& t) {
+                        stage_histograms[static_cast<size_t>(t.stage)].observe(t.duration.count());
                     });
+                _wasm_cache_connection = chain_plug->chain().wasm_cache_accessed.connect(
+                    [this](const chain::wasm_interface::cache_access& a) {
+                        if (a.hit) {
+                            wasm_cache_hits.increment();
+                            return;
+                        }
+                        wasm_cache_misses.increment();
+                        wasm_cache_evictions.increment(a.evicted);
+                        wasm_cache_bytes.set(a.cached_bytes);
+                        wasm_instantiation.observe(a.instantiation_time.count());
+                    });
+                // the timeline is complete once every plugin started, before the posted work runs
+                chain::instrumented_post(app(), priority::low, chain::executor_category::other, [this, chain_plug]() {
+                    for (const auto& p : chain_plug->startup_timeline()) {
+                        register_gauge("startup_" + p.name + "_us").set(p.duration.count());
+                    }
+                });
+                if (profiler) {
+                    _action_profile_connection = chain_plug->chain().action_profiled.connect(
+                        [this](const chain::controller::action_profile& p) {
+                            profiler->add(p);
+                        });
+                }
+            }
         }
 
         void add_metrics() {
             add_counter("accepted_trx_total");
             add_histogram("irreversible_latency", LATENCY_HISTOGRAM_KEYPOINTS);
             add_gauge("last_irreversible_latency");
+            for (size_t i = 0; i < stage_histograms.size(); i++) {
+                const auto name = chain::controller::pipeline_stage_name(static_cast<stage>(i));
+                stage_histograms[i] = register_histogram(std::string("pipeline_") + name + "_us", STAGE_HISTOGRAM_KEYPOINTS);
+            }
+            wasm_cache_hits = register_counter("wasm_cache_hit_cnt");
+            wasm_cache_misses = register_counter("wasm_cache_miss_cnt");
+            wasm_cache_evictions = register_counter("wasm_cache_evicted_cnt");
+            wasm_cache_bytes = register_gauge("wasm_cache_bytes");
+            wasm_instantiation = register_histogram("wasm_instantiation_us", STAGE_HISTOGRAM_KEYPOINTS);
 
-            exposer->RegisterCollectable(std::weak_ptr<Registry>(registry));
+            telemetry::metrics_pusher::collectables_type collectables = { collectable, summaries, block_log_index, signature_recovery, executor, async_log_stats, http_client_pool_stats, signal_subscribers_stats, task_scheduler_stats };
+            if (action_profile_size) {
+                profiler = std::make_shared<action_profiler>(action_profile_size);
+                collectables.push_back(profiler);
+            }
+            if (exposer) {
+                for (const auto& c : collectables) {
+                    exposer->RegisterCollectable(c);
+                }
+            }
+            start_pusher(collectables);
         }
 
     public:
+        /// called on http threads; histograms are registered on the main thread, samples before that are dropped
+        void observe_http_latency(const string& url, const fc::microseconds& latency) {
+            telemetry::histogram_handle histogram;
+            {
+                std::lock_guard<std::mutex> g(http_latency_mtx);
+                auto it = http_latency.find(url);
+                if (it != http_latency.end()) {
+                    histogram = it->second;
+                } else if (http_latency_pending.insert(url).second) {
+                    chain::instrumented_post(app(), priority::low, chain::executor_category::other, [this, url]() {
+                        std::string name = "http";
+                        for (char c : url) {
+                            name += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+                        }
+                        auto handle = register_histogram(boost::replace_all_copy(name, "__", "_") + "_us", STAGE_HISTOGRAM_KEYPOINTS);
+                        std::lock_guard<std::mutex> g(http_latency_mtx);
+                        http_latency[url] = handle;
+                    });
+                }
+            }
+            histogram.observe(latency.count());
+        }
+
         std::string endpoint;
         std::string uri;
         size_t threads{};
-        map<string, std::reference_wrapper<Counter>> counter_map;
+        size_t action_profile_size{};
+        std::string push_mode;
+        std::string push_address;
+        std::string push_job;
+        fc::microseconds push_interval;
+        std::shared_ptr<action_profiler> profiler;
+        map<string, telemetry::counter_handle> counter_map;
         map<string, std::reference_wrapper<Gauge>> gauge_map;
-        map<string, std::reference_wrapper<Histogram>> histogram_map;
+        map<string, std::reference_wrapper<Family<Gauge>>> gauge_family_map;
+        map<string, telemetry::histogram_handle> histogram_map;
+
+        map<string, std::vector<double>> histogram_buckets; ///< telemetry-histogram-buckets
+        std::set<string> quantile_metrics;                  ///< telemetry-quantiles, "*" enables all
+        fc::microseconds quantile_window;
 
         telemetry_plugin_impl() {
             registry = std::make_shared<Registry>();
+            collectable = std::make_shared<sharded_collectable>(registry);
+            summaries = std::make_shared<summary_collectable>();
+        }
+
+        void parse_histogram_buckets(const std::vector<std::string>& specs) {
+            for (const auto& spec : specs) {
+                // histogram_name=1,5,10,50
+                const auto eq = spec.find('=');
+                EOS_ASSERT(eq != std::string::npos && eq > 0, chain::plugin_config_exception,
+                           "invalid telemetry-histogram-buckets '${s}', expected <name>=<bound>[,<bound>...]", ("s", spec));
+                std::vector<std::string> bounds;
+                const auto list = spec.substr(eq + 1);
+                boost::split(bounds, list, boost::is_any_of(","));
+                std::vector<double> keypoints;
+                for (const auto& bound : bounds) {
+                    try {
+                        keypoints.push_back(std::stod(bound));
+                    } catch (const std::exception&) {
+                        EOS_THROW(chain::plugin_config_exception, "invalid bucket bound '${b}' in telemetry-histogram-buckets '${s}'",
+                                  ("b", bound)("s", spec));
+                    }
+                }
+                EOS_ASSERT(std::is_sorted(keypoints.begin(), keypoints.end()), chain::plugin_config_exception,
+                           "bucket bounds should be ascending in telemetry-histogram-buckets '${s}'", ("s", spec));
+                histogram_buckets[spec.substr(0, eq)] = std::move(keypoints);
+            }
         }
 
         void initialize() {
+            main_thread_cpu.emplace("main"); // on the main thread, plugins start there
             start_server();
             add_metrics();
             add_event_handlers();
         }
 
+        void shutdown() {
+            if (_signal_queue) {
+                _signal_queue->stop();
+            }
+            _pipeline_stage_connection.disconnect();
+            _action_profile_connection.disconnect();
+            _wasm_cache_connection.disconnect();
+            pusher.reset();
+            main_thread_cpu.reset();
+        }
+
+        telemetry_plugin::get_action_profile_results get_action_profile(const telemetry_plugin::get_action_profile_params& params) {
+            EOS_ASSERT(profiler, chain::plugin_config_exception, "action profiling is disabled, see telemetry-action-profile-size");
+            return profiler->get(params);
+        }
+
         void add_counter(const std::string& name) {
-            counter_map.insert({name, BuildCounter()
+            register_counter(name);
+        }
+
+        telemetry::counter_handle register_counter(const std::string& name) {
+            auto it = counter_map.find(name);
+            if (it != counter_map.end()) {
+                return it->second;
+            }
+            Counter& counter = BuildCounter()
                     .Name(name)
                     .Register(*registry)
-                    .Add({})});
-
+                    .Add({});
+            auto shards = std::make_shared<telemetry::sharded_counter>();
+            collectable->add({shards, counter});
+            return counter_map.emplace(name, telemetry::counter_handle(shards)).first->second;
         }
 
         void update_counter(const std::string& name, double value = 1.) {
-            ((Counter&)counter_map.at(name)).Increment(value);
+            counter_map.at(name).increment(value);
         }
 
         void add_gauge(const std::string& name) {
-            gauge_map.insert({name, BuildGauge()
-                .Name(name)
-                .Register(*registry)
-                .Add({})});
+            register_gauge(name);
+        }
+
+        telemetry::gauge_handle register_gauge(const std::string& name) {
+            auto it = gauge_map.find(name);
+            if (it == gauge_map.end()) {
+                it = gauge_map.insert({name, BuildGauge()
+                    .Name(name)
+                    .Register(*registry)
+                    .Add({})}).first;
+            }
+            return telemetry::gauge_handle(&it->second.get());
+        }
+
+        telemetry::gauge_family_handle register_gauge_family(const std::string& name, const std::string& help) {
+            auto it = gauge_family_map.find(name);
+            if (it == gauge_family_map.end()) {
+                it = gauge_family_map.insert({name, BuildGauge()
+                    .Name(name)
+                    .Help(help)
+                    .Register(*registry)}).first;
+            }
+            return telemetry::gauge_family_handle(&it->second.get());
         }
 
         void update_gauge(const std::string& name, const double value) {
@@ -94,14 +879,28 @@ namespace eosio {
         }
 
         void add_histogram(const std::string& name, const std::vector<double>& keypoints) {
-            histogram_map.insert({name, BuildHistogram()
+            register_histogram(name, keypoints);
+        }
+
+        telemetry::histogram_handle register_histogram(const std::string& name, const std::vector<double>& keypoints) {
+            auto it = histogram_map.find(name);
+            if (it == histogram_map.end()) {
+                const auto buckets = histogram_buckets.find(name);
+                Histogram& histogram = BuildHistogram()
                     .Name(name)
                     .Register(*registry)
-                    .Add({}, keypoints)});
+                    .Add({}, buckets != histogram_buckets.end() ? buckets->second : keypoints);
+                telemetry::quantile_summary* summary = nullptr;
+                if (quantile_metrics.count(name) || quantile_metrics.count("*")) {
+                    summary = summaries->add(name, quantile_window);
+                }
+                it = histogram_map.emplace(name, telemetry::histogram_handle(&histogram, summary)).first;
+            }
+            return it->second;
         }
 
         void update_histogram(const std::string& name, const double value) {
-            ((Histogram&)histogram_map.at(name)).Observe(value);
+            histogram_map.at(name).observe(value);
         }
 
         virtual ~telemetry_plugin_impl() = default;
@@ -114,11 +913,28 @@ namespace eosio {
     void telemetry_plugin::set_program_options(options_description &, options_description &cfg) {
         cfg.add_options()
                 ("telemetry-endpoint", bpo::value<string>()->default_value("8080"),
-                 "the endpoint upon which to listen for incoming connections to promethus server")
+                 "the endpoint upon which to listen for incoming connections to promethus server, empty to disable pull")
                 ("telemetry-uri", bpo::value<string>()->default_value("/metrics"),
                  "the base uri of the endpoint")
                 ("telemetry-threads", bpo::value<size_t>()->default_value(1),
-                 "the number of threads to use to process network messages to promethus server");
+                 "the number of threads to use to process network messages to promethus server")
+                ("telemetry-action-profile-size", bpo::value<size_t>()->default_value(100),
+                 "the number of (receiver, action) pairs to profile separately, others are summed up; 0 disables action profiling")
+                ("telemetry-histogram-buckets", bpo::value<vector<string>>()->composing(),
+                 "bucket bounds of a histogram, overriding the built-in ones, as <name>=<bound>[,<bound>...] (e.g. pipeline_block_apply_us=100,1000,10000). "
+                 "May be specified multiple times")
+                ("telemetry-quantiles", bpo::value<vector<string>>()->composing()->default_value({"pipeline_block_apply_us"}, "pipeline_block_apply_us"),
+                 "name of histogram to also export p50/p90/p99/p999 for, as <name>_summary; '*' for all histograms. May be specified multiple times")
+                ("telemetry-quantile-window-sec", bpo::value<uint32_t>()->default_value(60),
+                 "quantiles are computed over the last one to two windows of this length")
+                ("telemetry-push-mode", bpo::value<string>()->default_value("none"),
+                 "push metrics for nodes that cannot be scraped: none, pushgateway or statsd")
+                ("telemetry-push-address", bpo::value<string>(),
+                 "pushgateway url (http://host:9091) or statsd host:port (udp)")
+                ("telemetry-push-job", bpo::value<string>()->default_value("nodeos"),
+                 "pushgateway job name or statsd metric prefix")
+                ("telemetry-push-interval-ms", bpo::value<uint32_t>()->default_value(10000),
+                 "interval between pushes, all metrics are sent in one batch");
     }
 
     void telemetry_plugin::plugin_initialize(const variables_map &options) {
@@ -127,6 +943,38 @@ namespace eosio {
             my->endpoint = options.at("telemetry-endpoint").as<string>();
             my->uri = options.at("telemetry-uri").as<string>();
             my->threads = options.at("telemetry-threads").as<size_t>();
+            my->action_profile_size = options.at("telemetry-action-profile-size").as<size_t>();
+            if (options.count("telemetry-histogram-buckets")) {
+                my->parse_histogram_buckets(options.at("telemetry-histogram-buckets").as<vector<string>>());
+            }
+            if (options.count("telemetry-quantiles")) {
+                const auto& names = options.at("telemetry-quantiles").as<vector<string>>();
+                my->quantile_metrics.insert(names.begin(), names.end());
+            }
+            const auto window_sec = options.at("telemetry-quantile-window-sec").as<uint32_t>();
+            EOS_ASSERT(window_sec > 0, chain::plugin_config_exception, "telemetry-quantile-window-sec should be positive");
+            my->quantile_window = fc::seconds(window_sec);
+
+            my->push_mode = options.at("telemetry-push-mode").as<string>();
+            EOS_ASSERT(my->push_mode == "none" || my->push_mode == "pushgateway" || my->push_mode == "statsd",
+                       chain::plugin_config_exception, "unknown telemetry-push-mode ${m}", ("m", my->push_mode));
+            if (my->push_mode != "none") {
+                EOS_ASSERT(options.count("telemetry-push-address"), chain::plugin_config_exception,
+                           "telemetry-push-address is required for telemetry-push-mode ${m}", ("m", my->push_mode));
+                my->push_address = options.at("telemetry-push-address").as<string>();
+            }
+            my->push_job = options.at("telemetry-push-job").as<string>();
+            const auto push_interval_ms = options.at("telemetry-push-interval-ms").as<uint32_t>();
+            EOS_ASSERT(push_interval_ms > 0, chain::plugin_config_exception, "telemetry-push-interval-ms should be positive");
+            my->push_interval = fc::milliseconds(push_interval_ms);
+
+            // set before http_plugin starts: the observer is read by http threads without synchronization
+            if (auto http = app().find_plugin<http_plugin>()) {
+                auto impl = my.get();
+                http->set_latency_observer([impl](const string& url, const fc::microseconds& latency) {
+                    impl->observe_http_latency(url, latency);
+                });
+            }
         }
         FC_LOG_AND_RETHROW();
     }
@@ -135,14 +983,35 @@ namespace eosio {
         wlog("Telemetry plugin startup");
         try {
             my->initialize();
-            ilog("Telemetry plugin started, started listening endpoint (port) ${endpoint} with uri ${uri}",
-                 ("endpoint", my->endpoint)("uri", my->uri));
+            if (!my->endpoint.empty()) {
+                ilog("Telemetry plugin started, started listening endpoint (port) ${endpoint} with uri ${uri}",
+                     ("endpoint", my->endpoint)("uri", my->uri));
+            }
+
+            auto http = app().find_plugin<http_plugin>();
+            if (http && http->get_state() != abstract_plugin::registered) {
+                auto api = my.get();
+                http->add_api({
+                    {std::string("/v1/telemetry/get_action_profile"),
+                     [api](string, string body, url_response_callback cb) mutable {
+                         try {
+                             if (body.empty()) body = "{}";
+                             fc::variant result(api->get_action_profile(
+                                 fc::json::from_string(body).as<telemetry_plugin::get_action_profile_params>()));
+                             cb(200, std::move(result));
+                         } catch (...) {
+                             http_plugin::handle_exception("telemetry", "get_action_profile", body, cb);
+                         }
+                     }}
+                });
+            }
         }
         FC_LOG_AND_RETHROW();
     }
 
     void telemetry_plugin::plugin_shutdown() {
         wlog("Telemetry plugin shutdown");
+        my->shutdown();
     }
 
     void telemetry_plugin::add_counter(const std::string& metric_name) {
@@ -168,4 +1037,22 @@ namespace eosio {
     void telemetry_plugin::update_histogram(const std::string& metric_name, const double value) {
         my->update_histogram(metric_name, value);
     }
+
+    telemetry::counter_handle telemetry_plugin::register_counter(const std::string& metric_name) {
+        return my->register_counter(metric_name);
+    }
+
+    telemetry::gauge_handle telemetry_plugin::register_gauge(const std::string& metric_name) {
+        return my->register_gauge(metric_name);
+    }
+
+    telemetry::gauge_family_handle telemetry_plugin::register_gauge_family(const std::string& metric_name,
+                                                                           const std::string& help) {
+        return my->register_gauge_family(metric_name, help);
+    }
+
+    telemetry::histogram_handle telemetry_plugin::register_histogram(const std::string& metric_name,
+                                                                     const vector<double>& keypoints) {
+        return my->register_histogram(metric_name, keypoints);
+    }
 }
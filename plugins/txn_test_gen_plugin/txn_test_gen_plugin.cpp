@@ -4,6 +4,7 @@
  */
 #include <eosio/txn_test_gen_plugin/txn_test_gen_plugin.hpp>
 #include <eosio/chain_plugin/chain_plugin.hpp>
+#include <eosio/chain/executor_stats.hpp>
 #include <eosio/chain/wast_to_wasm.hpp>
 
 #include <fc/variant.hpp>
@@ -14,6 +15,8 @@
 
 #include <boost/asio/high_resolution_timer.hpp>
 #include <boost/algorithm/clamp.hpp>
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/signals2/connection.hpp>
 
 #include <Inline/BasicTypes.h>
 #include <IR/Module.h>
@@ -24,6 +27,9 @@
 
 #include <contracts.hpp>
 
+#include <mutex>
+#include <unordered_map>
+
 using namespace eosio::testing;
 
 namespace eosio { namespace detail {
@@ -31,10 +37,46 @@ namespace eosio { namespace detail {
   struct txn_test_gen_status {
      string status;
   };
+
+  /// action of a workload profile, picked for a transaction with a probability proportional to its weight
+  struct txn_test_gen_action {
+     chain::name                             account;
+     chain::name                             action;
+     std::vector<chain::permission_level>    authorization;
+     fc::variant                             data; ///< serialized with the ABI of account, "${nonce}" in its strings is replaced by a unique number
+     uint32_t                                weight = 1;
+  };
+
+  struct txn_test_gen_profile {
+     std::string                       mode = "open";  ///< "open": target_tps whether or not they are included, "closed": at most concurrency in flight
+     uint32_t                          target_tps = 1000;
+     uint32_t                          concurrency = 1000;
+     uint32_t                          period_ms = 10;  ///< between two batches
+     uint32_t                          actions_per_trx = 1;
+     std::vector<std::string>          keys;            ///< private keys signing every transaction
+     std::vector<txn_test_gen_action>  actions;
+  };
+
+  struct txn_test_gen_stats {
+     uint64_t  submitted = 0;
+     uint64_t  included = 0;
+     uint64_t  failed = 0;
+     uint64_t  lost = 0;       ///< neither included nor failed before they expired
+     uint64_t  in_flight = 0;
+     double    included_tps = 0;
+     double    latency_ms_p50 = 0; ///< from the submission to chain_plugin to the block including it
+     double    latency_ms_p90 = 0;
+     double    latency_ms_p99 = 0;
+     double    latency_ms_max = 0;
+  };
 }}
 
 FC_REFLECT(eosio::detail::txn_test_gen_empty, );
 FC_REFLECT(eosio::detail::txn_test_gen_status, (status));
+FC_REFLECT(eosio::detail::txn_test_gen_action, (account)(action)(authorization)(data)(weight));
+FC_REFLECT(eosio::detail::txn_test_gen_profile, (mode)(target_tps)(concurrency)(period_ms)(actions_per_trx)(keys)(actions));
+FC_REFLECT(eosio::detail::txn_test_gen_stats, (submitted)(included)(failed)(lost)(in_flight)(included_tps)
+                                              (latency_ms_p50)(latency_ms_p90)(latency_ms_p99)(latency_ms_max));
 
 namespace eosio {
 
@@ -69,6 +111,13 @@ using io_work_t = boost::asio::executor_work_guard<boost::asio::io_context::exec
      api_handle->call_name(); \
      eosio::detail::txn_test_gen_empty result;
 
+#define INVOKE_V_R(api_handle, call_name, in_param0) \
+     auto status = api_handle->call_name(fc::json::from_string(body).as<in_param0>()); \
+     eosio::detail::txn_test_gen_status result = { status };
+
+#define INVOKE_R_V(api_handle, call_name) \
+     auto result = api_handle->call_name();
+
 #define CALL_ASYNC(api_name, api_handle, call_name, INVOKE, http_response_code) \
 {std::string("/v1/" #api_name "/" #call_name), \
    [this](string, string body, url_response_callback cb) mutable { \
@@ -95,11 +144,154 @@ using io_work_t = boost::asio::executor_work_guard<boost::asio::io_context::exec
    const auto& vs = fc::json::json::from_string(body).as<fc::variants>(); \
    api_handle->call_name(vs.at(0).as<in_param0>(), vs.at(1).as<in_param1>(), result_handler);
 
+/**
+ * Times the generated transactions from their submission to chain_plugin to the block including them
+ */
+class inclusion_tracker {
+public:
+   static constexpr uint32_t prune_interval_blocks = 120;
+   static constexpr uint32_t lost_after_sec        = 60; ///< longer than any generated expiration
+
+   void reset() {
+      std::lock_guard<std::mutex> g( mtx );
+      pending.clear();
+      latencies_us.clear();
+      counts = detail::txn_test_gen_stats();
+      start = fc::time_point::now();
+   }
+
+   void submitted( const transaction_id_type& id ) {
+      std::lock_guard<std::mutex> g( mtx );
+      if( pending.emplace( id, fc::time_point::now() ).second )
+         ++counts.submitted;
+   }
+
+   void failed( const transaction_id_type& id ) {
+      std::lock_guard<std::mutex> g( mtx );
+      if( pending.erase( id ) )
+         ++counts.failed;
+   }
+
+   uint64_t in_flight() {
+      std::lock_guard<std::mutex> g( mtx );
+      return pending.size();
+   }
+
+   void on_block( const block_state_ptr& bsp ) {
+      const auto now = fc::time_point::now();
+      std::lock_guard<std::mutex> g( mtx );
+      if( pending.empty() ) return;
+      for( const auto& r : bsp->block->transactions ) {
+         if( !r.trx.contains<packed_transaction>() ) continue;
+         auto itr = pending.find( r.trx.get<packed_transaction>().id() );
+         if( itr == pending.end() ) continue;
+         latencies_us.push_back( (now - itr->second).count() );
+         ++counts.included;
+         pending.erase( itr );
+      }
+      if( bsp->block_num % prune_interval_blocks == 0 ) {
+         for( auto itr = pending.begin(); itr != pending.end(); ) {
+            if( now - itr->second > fc::seconds( lost_after_sec ) ) {
+               ++counts.lost;
+               itr = pending.erase( itr );
+            } else {
+               ++itr;
+            }
+         }
+      }
+   }
+
+   detail::txn_test_gen_stats stats() {
+      std::lock_guard<std::mutex> g( mtx );
+      auto s = counts;
+      s.in_flight = pending.size();
+      const auto elapsed = fc::time_point::now() - start;
+      if( elapsed.count() > 0 )
+         s.included_tps = s.included * 1e6 / elapsed.count();
+      if( !latencies_us.empty() ) {
+         auto sorted = latencies_us;
+         std::sort( sorted.begin(), sorted.end() );
+         auto percentile = [&]( size_t p ) { return sorted[(sorted.size() - 1) * p / 100] / 1000.0; };
+         s.latency_ms_p50 = percentile( 50 );
+         s.latency_ms_p90 = percentile( 90 );
+         s.latency_ms_p99 = percentile( 99 );
+         s.latency_ms_max = sorted.back() / 1000.0;
+      }
+      return s;
+   }
+
+private:
+   struct id_hash {
+      size_t operator()( const transaction_id_type& id )const { return id._hash[0]; }
+   };
+
+   std::mutex                                                          mtx;
+   std::unordered_map<transaction_id_type, fc::time_point, id_hash>   pending; ///< submission times
+   std::vector<int64_t>                                                latencies_us;
+   detail::txn_test_gen_stats                                          counts;
+   fc::time_point                                                      start = fc::time_point::now();
+};
+
+/// a profile action ready to be signed into transactions
+struct workload_action {
+   action                           act;        ///< data is serialized unless templated
+   fc::variant                      data;       ///< template of the data, set if templated
+   bool                             templated = false;
+   uint32_t                         weight = 1;
+   string                           type;
+   std::shared_ptr<abi_serializer>  serializer;
+};
+
+static bool has_nonce_template( const fc::variant& v ) {
+   if( v.is_string() ) return v.get_string().find( "${nonce}" ) != string::npos;
+   if( v.is_object() ) {
+      for( const auto& e : v.get_object() )
+         if( has_nonce_template( e.value() ) ) return true;
+   } else if( v.is_array() ) {
+      for( const auto& e : v.get_array() )
+         if( has_nonce_template( e ) ) return true;
+   }
+   return false;
+}
+
+static fc::variant substitute_nonce( const fc::variant& v, const string& nonce ) {
+   if( v.is_string() ) {
+      auto str = v.get_string();
+      boost::algorithm::replace_all( str, "${nonce}", nonce );
+      return fc::variant( str );
+   }
+   if( v.is_object() ) {
+      fc::mutable_variant_object obj;
+      for( const auto& e : v.get_object() )
+         obj( e.key(), substitute_nonce( e.value(), nonce ) );
+      return fc::variant( std::move( obj ) );
+   }
+   if( v.is_array() ) {
+      fc::variants arr;
+      arr.reserve( v.size() );
+      for( const auto& e : v.get_array() )
+         arr.emplace_back( substitute_nonce( e, nonce ) );
+      return fc::variant( std::move( arr ) );
+   }
+   return v;
+}
+
+/// splitmix64 finalizer, picks the actions of a transaction from its nonce
+static uint64_t mix64( uint64_t v ) {
+   v += 0x9e3779b97f4a7c15ull;
+   v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ull;
+   v = (v ^ (v >> 27)) * 0x94d049bb133111ebull;
+   return v ^ (v >> 31);
+}
+
 struct txn_test_gen_plugin_impl {
 
    uint64_t _total_us = 0;
    uint64_t _txcount = 0;
 
+   inclusion_tracker                                    tracker;
+   fc::optional<boost::signals2::scoped_connection>     accepted_block_connection;
+
    std::shared_ptr<boost::asio::io_context>             gen_ioc;
    optional<io_work_t>                                  gen_ioc_work;
    uint16_t                                             thread_pool_size;
@@ -113,10 +305,16 @@ struct txn_test_gen_plugin_impl {
       chain_plugin& cp = app().get_plugin<chain_plugin>();
 
       for (size_t i = 0; i < trxs->size(); ++i) {
+         const auto id = trxs->at(i).id();
+         tracker.submitted( id );
          cp.accept_transaction( packed_transaction(trxs->at(i)), [=](const fc::static_variant<fc::exception_ptr, transaction_trace_ptr>& result){
             if (result.contains<fc::exception_ptr>()) {
+               tracker.failed( id );
                next(result.get<fc::exception_ptr>());
             } else {
+               if (result.contains<transaction_trace_ptr>() && result.get<transaction_trace_ptr>()->except) {
+                  tracker.failed( id );
+               }
                if (result.contains<transaction_trace_ptr>() && result.get<transaction_trace_ptr>()->receipt) {
                   _total_us += result.get<transaction_trace_ptr>()->receipt->cpu_usage_us;
                   ++_txcount;
@@ -128,7 +326,7 @@ struct txn_test_gen_plugin_impl {
 
    void push_transactions( std::vector<signed_transaction>&& trxs, const std::function<void(fc::exception_ptr)>& next ) {
       auto trxs_copy = std::make_shared<std::decay_t<decltype(trxs)>>(std::move(trxs));
-      app().post(priority::low, [this, trxs_copy, next]() {
+      chain::instrumented_post(app(), priority::low, chain::executor_category::other, [this, trxs_copy, next]() {
          push_next_transaction(trxs_copy, next);
       });
    }
@@ -305,12 +503,7 @@ struct txn_test_gen_plugin_impl {
       batch = batch_size/2;
       nonce_prefix = 0;
 
-      gen_ioc = std::make_shared<boost::asio::io_context>();
-      gen_ioc_work.emplace( boost::asio::make_work_guard(*gen_ioc) );
-      thread_pool.emplace( thread_pool_size );
-      for( uint16_t i = 0; i < thread_pool_size; i++ )
-         boost::asio::post( *thread_pool, [ioc = gen_ioc]() { ioc->run(); } );
-      timer = std::make_shared<boost::asio::high_resolution_timer>(*gen_ioc);
+      start_threads();
 
       ilog("Started transaction test plugin; generating ${p} transactions every ${m} ms by ${t} load generation threads",
          ("p", batch_size) ("m", period) ("t", thread_pool_size));
@@ -339,6 +532,205 @@ struct txn_test_gen_plugin_impl {
       });
    }
 
+   void start_threads() {
+      tracker.reset();
+      gen_ioc = std::make_shared<boost::asio::io_context>();
+      gen_ioc_work.emplace( boost::asio::make_work_guard(*gen_ioc) );
+      thread_pool.emplace( thread_pool_size );
+      for( uint16_t i = 0; i < thread_pool_size; i++ )
+         boost::asio::post( *thread_pool, [ioc = gen_ioc]() { ioc->run(); } );
+      timer = std::make_shared<boost::asio::high_resolution_timer>(*gen_ioc);
+   }
+
+   block_id_type reference_block_id(const controller& cc)const {
+      uint32_t reference_block_num = cc.last_irreversible_block_num();
+      if (txn_reference_block_lag >= 0) {
+         reference_block_num = cc.head_block_num();
+         if (reference_block_num <= (uint32_t)txn_reference_block_lag) {
+            reference_block_num = 0;
+         } else {
+            reference_block_num -= (uint32_t)txn_reference_block_lag;
+         }
+      }
+      return cc.get_block_id_for_num(reference_block_num);
+   }
+
+   string start_profile(const detail::txn_test_gen_profile& p) {
+      ilog("Starting transaction test plugin with a workload profile");
+      if(running)
+         return "generation already running";
+      if(p.mode != "open" && p.mode != "closed")
+         return "mode must be open or closed";
+      if(p.mode == "open" && (p.target_tps < 1 || p.target_tps > 100000))
+         return "target_tps must be between 1 and 100000";
+      if(p.mode == "closed" && (p.concurrency < 1 || p.concurrency > 100000))
+         return "concurrency must be between 1 and 100000";
+      if(p.period_ms < 1 || p.period_ms > 2500)
+         return "period_ms must be between 1 and 2500";
+      if(p.actions_per_trx < 1 || p.actions_per_trx > 100)
+         return "actions_per_trx must be between 1 and 100";
+      if(p.keys.empty())
+         return "keys must not be empty";
+
+      controller& cc = app().get_plugin<chain_plugin>().chain();
+      auto abi_serializer_max_time = app().get_plugin<chain_plugin>().get_abi_serializer_max_time();
+
+      std::vector<workload_action> actions;
+      uint64_t total_weight = 0;
+      for( const auto& a : p.actions ) {
+         if( a.weight == 0 ) continue;
+         auto abis = cc.get_abi_serializer( a.account, abi_serializer_max_time );
+         if( !abis )
+            return "no ABI for " + a.account.to_string();
+         auto type = abis->get_action_type( a.action );
+         if( type.empty() )
+            return "unknown action " + a.account.to_string() + "::" + a.action.to_string();
+
+         workload_action w;
+         w.act.account = a.account;
+         w.act.name = a.action;
+         w.act.authorization = a.authorization;
+         w.weight = a.weight;
+         w.templated = has_nonce_template( a.data );
+         if( w.templated ) {
+            w.data = a.data;
+            w.type = type;
+            w.serializer = std::make_shared<abi_serializer>( std::move( *abis ) );
+         } else {
+            // serialized once, copied into every transaction
+            w.act.data = abis->variant_to_binary( type, a.data, abi_serializer_max_time );
+         }
+         total_weight += w.weight;
+         actions.emplace_back( std::move( w ) );
+      }
+      if( actions.empty() )
+         return "actions must contain an action of non zero weight";
+
+      profile = p;
+      workload = std::move( actions );
+      workload_weight = total_weight;
+      profile_keys.clear();
+      for( const auto& k : p.keys )
+         profile_keys.emplace_back( k );
+      profile_nonce = static_cast<uint64_t>(fc::time_point::now().sec_since_epoch()) << 32;
+      profile_sent = 0;
+      profile_queued = 0;
+      running = true;
+
+      start_threads();
+      profile_start = fc::time_point::now();
+
+      ilog("Started transaction test plugin; ${m} loop of ${n} ${u} with ${a} actions per transaction by ${t} load generation threads",
+           ("m", p.mode)("n", p.mode == "open" ? p.target_tps : p.concurrency)
+           ("u", p.mode == "open" ? "transactions / second" : "transactions in flight")
+           ("a", p.actions_per_trx)("t", thread_pool_size));
+
+      boost::asio::post( *gen_ioc, [this]() {
+         arm_profile_timer(boost::asio::high_resolution_timer::clock_type::now());
+      });
+      return "success";
+   }
+
+   void arm_profile_timer(boost::asio::high_resolution_timer::time_point s) {
+      timer->expires_at(s + std::chrono::milliseconds(profile.period_ms));
+      boost::asio::post( *gen_ioc, [this]() {
+         send_profile_transactions();
+      });
+      timer->async_wait([this](const boost::system::error_code& ec) {
+         if(!running || ec)
+            return;
+         arm_profile_timer(timer->expires_at());
+      });
+   }
+
+   /// open loop: keeps up with target_tps whether or not the transactions are included, closed loop: refills concurrency
+   void send_profile_transactions() {
+      uint64_t count = 0;
+      {
+         std::lock_guard<std::mutex> g( profile_mtx );
+         if( profile.mode == "open" ) {
+            const uint64_t due = (fc::time_point::now() - profile_start).count() * profile.target_tps / 1000000;
+            // a generator falling behind by more than a second drops the lag rather than bursting
+            if( due > profile_sent + profile.target_tps )
+               profile_sent = due - profile.target_tps;
+            count = due - std::min( due, profile_sent );
+         } else {
+            const uint64_t in_flight = tracker.in_flight() + profile_queued;
+            count = profile.concurrency - std::min<uint64_t>( profile.concurrency, in_flight );
+         }
+         profile_sent += count;
+         profile_queued += count;
+      }
+      if( count == 0 )
+         return;
+
+      // sign in parallel on the generation threads
+      const uint64_t chunk = (count + thread_pool_size - 1) / thread_pool_size;
+      for( uint64_t first = 0; first < count; first += chunk ) {
+         const uint64_t n = std::min( chunk, count - first );
+         boost::asio::post( *gen_ioc, [this, n]() {
+            send_profile_chunk( n );
+         });
+      }
+   }
+
+   action make_profile_action( uint64_t nonce, uint32_t index )const {
+      uint64_t r = mix64( nonce * profile.actions_per_trx + index ) % workload_weight;
+      auto itr = workload.begin();
+      while( r >= itr->weight ) {
+         r -= itr->weight;
+         ++itr;
+      }
+      if( !itr->templated )
+         return itr->act;
+
+      action act = itr->act;
+      auto abi_serializer_max_time = app().get_plugin<chain_plugin>().get_abi_serializer_max_time();
+      act.data = itr->serializer->variant_to_binary( itr->type, substitute_nonce( itr->data, std::to_string( nonce ) ), abi_serializer_max_time );
+      return act;
+   }
+
+   void send_profile_chunk( uint64_t count ) {
+      std::vector<signed_transaction> trxs;
+      trxs.reserve(count);
+
+      try {
+         controller& cc = app().get_plugin<chain_plugin>().chain();
+         auto chainid = app().get_plugin<chain_plugin>().get_chain_id();
+         const block_id_type ref_block_id = reference_block_id(cc);
+         const auto expiration = cc.head_block_time() + fc::seconds(30);
+
+         for( uint64_t i = 0; i < count; ++i ) {
+            const uint64_t nonce = profile_nonce++;
+            signed_transaction trx;
+            for( uint32_t a = 0; a < profile.actions_per_trx; ++a )
+               trx.actions.emplace_back( make_profile_action( nonce, a ) );
+            trx.context_free_actions.emplace_back(action({}, config::null_account_name, "nonce", fc::raw::pack( std::to_string(nonce) )));
+            trx.set_reference_block(ref_block_id);
+            trx.expiration = expiration;
+            for( const auto& k : profile_keys )
+               trx.sign(k, chainid);
+            trxs.emplace_back(std::move(trx));
+         }
+      } catch ( const fc::exception& e ) {
+         elog("building profile transactions failed: ${e}", ("e", e.to_detail_string()));
+      }
+      profile_queued -= count - trxs.size();
+
+      auto trxs_copy = std::make_shared<std::vector<signed_transaction>>(std::move(trxs));
+      chain::instrumented_post(app(), priority::low, chain::executor_category::other, [this, trxs_copy]() {
+         profile_queued -= trxs_copy->size();
+         // failures are counted by the tracker, they do not stop the generation
+         push_next_transaction(trxs_copy, [](const fc::exception_ptr& e) {
+            dlog("pushing profile transaction failed: ${e}", ("e", e->to_string()));
+         });
+      });
+   }
+
+   detail::txn_test_gen_stats get_stats() {
+      return tracker.stats();
+   }
+
    void send_transaction(std::function<void(const fc::exception_ptr&)> next, uint64_t nonce_prefix) {
       std::vector<signed_transaction> trxs;
       trxs.reserve(2*batch);
@@ -352,17 +744,7 @@ struct txn_test_gen_plugin_impl {
 
          static uint64_t nonce = static_cast<uint64_t>(fc::time_point::now().sec_since_epoch()) << 32;
 
-         uint32_t reference_block_num = cc.last_irreversible_block_num();
-         if (txn_reference_block_lag >= 0) {
-            reference_block_num = cc.head_block_num();
-            if (reference_block_num <= (uint32_t)txn_reference_block_lag) {
-               reference_block_num = 0;
-            } else {
-               reference_block_num -= (uint32_t)txn_reference_block_lag;
-            }
-         }
-
-         block_id_type reference_block_id = cc.get_block_id_for_num(reference_block_num);
+         block_id_type reference_block_id = this->reference_block_id(cc);
 
          for(unsigned int i = 0; i < batch; ++i) {
          {
@@ -414,6 +796,8 @@ struct txn_test_gen_plugin_impl {
          ilog("${d} transactions executed, ${t}us / transaction", ("d", _txcount)("t", _total_us / (double)_txcount));
          _txcount = _total_us = 0;
       }
+      ilog("Transaction generation stats: ${s}", ("s", tracker.stats()));
+      workload.clear();
    }
 
    bool running{false};
@@ -426,6 +810,16 @@ struct txn_test_gen_plugin_impl {
    action act_b_to_a;
 
    int32_t txn_reference_block_lag;
+
+   detail::txn_test_gen_profile              profile;
+   std::vector<workload_action>              workload;
+   uint64_t                                  workload_weight = 0;
+   std::vector<fc::crypto::private_key>      profile_keys;
+   fc::time_point                            profile_start;
+   std::mutex                                profile_mtx;
+   uint64_t                                  profile_sent = 0;   ///< guarded by profile_mtx
+   std::atomic<uint64_t>                     profile_queued{0};  ///< built or being built, not yet given to chain_plugin
+   std::atomic<uint64_t>                     profile_nonce{0};
 };
 
 txn_test_gen_plugin::txn_test_gen_plugin() {}
@@ -454,14 +848,22 @@ void txn_test_gen_plugin::plugin_initialize(const variables_map& options) {
 }
 
 void txn_test_gen_plugin::plugin_startup() {
+   controller& cc = app().get_plugin<chain_plugin>().chain();
+   my->accepted_block_connection.emplace( cc.accepted_block.connect( [this]( const block_state_ptr& bsp ) {
+      my->tracker.on_block( bsp );
+   } ) );
+
    app().get_plugin<http_plugin>().add_api({
       CALL_ASYNC(txn_test_gen, my, create_test_accounts, INVOKE_ASYNC_R_R(my, create_test_accounts, std::string, std::string), 200),
       CALL(txn_test_gen, my, stop_generation, INVOKE_V_V(my, stop_generation), 200),
-      CALL(txn_test_gen, my, start_generation, INVOKE_V_R_R_R(my, start_generation, std::string, uint64_t, uint64_t), 200)
+      CALL(txn_test_gen, my, start_generation, INVOKE_V_R_R_R(my, start_generation, std::string, uint64_t, uint64_t), 200),
+      CALL(txn_test_gen, my, start_profile, INVOKE_V_R(my, start_profile, detail::txn_test_gen_profile), 200),
+      CALL(txn_test_gen, my, get_stats, INVOKE_R_V(my, get_stats), 200)
    });
 }
 
 void txn_test_gen_plugin::plugin_shutdown() {
+   my->accepted_block_connection.reset();
    try {
       my->stop_generation();
    }
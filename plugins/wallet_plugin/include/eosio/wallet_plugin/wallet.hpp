@@ -183,6 +183,10 @@ class soft_wallet final : public wallet_api
       */
       fc::optional<signature_type> try_sign_digest( const digest_type digest, const public_key_type public_key ) override;
 
+      /* Signs the requests on every core
+      */
+      std::vector<fc::optional<signature_type>> try_sign_digests( const std::vector<sign_request>& requests ) override;
+
       std::shared_ptr<detail::soft_wallet_impl> my;
       void encrypt_keys();
 };
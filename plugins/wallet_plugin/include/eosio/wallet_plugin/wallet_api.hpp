@@ -102,6 +102,19 @@ class wallet_api
       /** Returns a signature given the digest and public_key, if this wallet can sign via that public key
        */
       virtual fc::optional<signature_type> try_sign_digest( const digest_type digest, const public_key_type public_key ) = 0;
+
+      using sign_request = std::pair<digest_type, public_key_type>;
+
+      /** Returns the signatures of the requests, in their order, empty for the keys this wallet does not have.
+       *  The default signs them one after the other.
+       */
+      virtual std::vector<fc::optional<signature_type>> try_sign_digests( const std::vector<sign_request>& requests ) {
+         std::vector<fc::optional<signature_type>> sigs;
+         sigs.reserve( requests.size() );
+         for( const auto& r : requests )
+            sigs.push_back( try_sign_digest( r.first, r.second ) );
+         return sigs;
+      }
 };
 
 }}
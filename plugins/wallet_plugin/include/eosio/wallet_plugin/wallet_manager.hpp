@@ -62,6 +62,23 @@ public:
    /// @throws fc::exception if corresponding private keys not found in unlocked wallets
    chain::signature_type sign_digest(const chain::digest_type& digest, const public_key_type& key);
 
+   using sign_transaction_request = std::pair<chain::signed_transaction, flat_set<public_key_type>>;
+
+   /// Sign many transactions, each with its keys as sign_transaction does.
+   /// The signatures of a wallet are computed together, in parallel by soft wallets.
+   /// @param txns the transactions to sign with the public keys of the corresponding private keys to sign each with
+   /// @param id the chain_id to sign transactions with.
+   /// @return txns signed, in order
+   /// @throws fc::exception if a private key is not found in unlocked wallets, then no transaction is returned
+   std::vector<chain::signed_transaction> sign_transactions(const std::vector<sign_transaction_request>& txns,
+                                                            const chain::chain_id_type& id);
+
+   /// Sign many digests, each with its key as sign_digest does.
+   /// @param requests the digests to sign with the public key of the corresponding private key to sign each with
+   /// @return signatures over the digests, in order
+   /// @throws fc::exception if a private key is not found in unlocked wallets
+   std::vector<chain::signature_type> sign_digests(const std::vector<wallet_api::sign_request>& requests);
+
    /// Create a new wallet.
    /// A new wallet is created in file dir/{name}.wallet see set_dir.
    /// The new wallet is unlocked after creation.
@@ -134,6 +151,9 @@ private:
    /// Calls lock_all() if timeout has passed.
    void check_timeout();
 
+   /// signatures of the requests by the unlocked wallets, throws if a key is in none of them
+   std::vector<chain::signature_type> sign_requests(const std::vector<wallet_api::sign_request>& requests);
+
 private:
    using timepoint_t = std::chrono::time_point<std::chrono::system_clock>;
    std::map<std::string, std::unique_ptr<wallet_api>> wallets;
@@ -5,13 +5,16 @@
 #include <eosio/wallet_plugin/wallet.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
 #include <sstream>
 #include <string>
 #include <list>
+#include <thread>
 
 #include <fc/container/deque.hpp>
 #include <fc/crypto/elliptic.hpp>
@@ -405,6 +408,27 @@ fc::optional<signature_type> soft_wallet::try_sign_digest( const digest_type dig
    return my->try_sign_digest(digest, public_key);
 }
 
+std::vector<fc::optional<signature_type>> soft_wallet::try_sign_digests( const std::vector<sign_request>& requests ) {
+   // below this many requests per thread, starting the threads takes longer than the signatures they save
+   constexpr size_t min_requests_per_thread = 8;
+   std::vector<fc::optional<signature_type>> sigs( requests.size() );
+   const size_t threads = std::min<size_t>( std::max( 1u, std::thread::hardware_concurrency() ),
+                                            ( requests.size() + min_requests_per_thread - 1 ) / min_requests_per_thread );
+   std::atomic<size_t> next{0};
+   // keys are only read while signing, wallet_manager is called by a single thread
+   auto sign = [&]() {
+      for( size_t i; ( i = next.fetch_add( 1 ) ) < requests.size(); )
+         sigs[i] = my->try_sign_digest( requests[i].first, requests[i].second );
+   };
+   std::vector<std::future<void>> workers;
+   for( size_t t = 1; t < threads; ++t )
+      workers.emplace_back( std::async( std::launch::async, sign ) );
+   sign();
+   for( auto& w : workers )
+      w.get();
+   return sigs;
+}
+
 pair<public_key_type,private_key_type> soft_wallet::get_private_key_from_password( string account, string role, string password )const {
    auto seed = account + role + password;
    EOS_ASSERT( seed.size(), wallet_exception, "seed should not be empty" );
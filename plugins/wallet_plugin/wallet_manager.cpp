@@ -8,6 +8,9 @@
 #include <eosio/wallet_plugin/se_wallet.hpp>
 #include <eosio/chain/exceptions.hpp>
 #include <boost/algorithm/string.hpp>
+
+#include <numeric>
+
 namespace eosio {
 namespace wallet {
 
@@ -270,6 +273,70 @@ wallet_manager::sign_digest(const chain::digest_type& digest, const public_key_t
    EOS_THROW(chain::wallet_missing_pub_key_exception, "Public key not found in unlocked wallets ${k}", ("k", key));
 }
 
+std::vector<chain::signed_transaction>
+wallet_manager::sign_transactions(const std::vector<sign_transaction_request>& txns, const chain::chain_id_type& id) {
+   check_timeout();
+   std::vector<wallet_api::sign_request> requests;
+   for (const auto& t : txns) {
+      const auto digest = t.first.sig_digest(id, t.first.context_free_data);
+      for (const auto& pk : t.second)
+         requests.emplace_back(digest, pk);
+   }
+   auto sigs = sign_requests(requests);
+
+   std::vector<chain::signed_transaction> stxns;
+   stxns.reserve(txns.size());
+   auto sig = sigs.begin();
+   for (const auto& t : txns) {
+      stxns.push_back(t.first);
+      for (size_t i = 0; i < t.second.size(); ++i)
+         stxns.back().signatures.push_back(std::move(*sig++));
+   }
+   return stxns;
+}
+
+std::vector<chain::signature_type>
+wallet_manager::sign_digests(const std::vector<wallet_api::sign_request>& requests) {
+   check_timeout();
+   return sign_requests(requests);
+}
+
+std::vector<chain::signature_type>
+wallet_manager::sign_requests(const std::vector<wallet_api::sign_request>& requests) {
+   std::vector<fc::optional<signature_type>> sigs(requests.size());
+   std::vector<size_t> missing(requests.size());
+   std::iota(missing.begin(), missing.end(), 0);
+   // each wallet signs what the previous ones could not, as the single requests try the wallets in order
+   for (const auto& i : wallets) {
+      if (missing.empty())
+         break;
+      if (i.second->is_locked())
+         continue;
+      std::vector<wallet_api::sign_request> pending;
+      pending.reserve(missing.size());
+      for (auto r : missing)
+         pending.push_back(requests[r]);
+      auto wallet_sigs = i.second->try_sign_digests(pending);
+      std::vector<size_t> still_missing;
+      for (size_t p = 0; p < missing.size(); ++p) {
+         if (wallet_sigs[p])
+            sigs[missing[p]] = std::move(wallet_sigs[p]);
+         else
+            still_missing.push_back(missing[p]);
+      }
+      missing = std::move(still_missing);
+   }
+   if (!missing.empty()) {
+      EOS_THROW(chain::wallet_missing_pub_key_exception, "Public key not found in unlocked wallets ${k}", ("k", requests[missing.front()].second));
+   }
+
+   std::vector<chain::signature_type> result;
+   result.reserve(sigs.size());
+   for (auto& s : sigs)
+      result.push_back(std::move(*s));
+   return result;
+}
+
 void wallet_manager::own_and_use_wallet(const string& name, std::unique_ptr<wallet_api>&& wallet) {
    if(wallets.find(name) != wallets.end())
       EOS_THROW(wallet_exception, "Tried to use wallet name that already exists.");
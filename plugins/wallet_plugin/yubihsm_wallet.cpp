@@ -17,6 +17,8 @@
 
 #include <dlfcn.h>
 
+#include <future>
+
 namespace eosio { namespace wallet {
 
 using namespace fc::crypto::r1;
@@ -143,25 +145,54 @@ struct yubihsm_wallet_impl {
       auto it = _keys.find(public_key);
       if(it == _keys.end())
          return fc::optional<signature_type>{};
+      return to_signature(sign_der(d, it->second), it->first, d);
+   }
+
+   /// The HSM signs the requests one after the other on the session. The conversion of a DER signature to a
+   /// compact one, which recovers the public key up to 4 times, runs on another thread while the HSM signs the next.
+   std::vector<fc::optional<signature_type>> try_sign_digests(const std::vector<wallet_api::sign_request>& requests) {
+      std::vector<fc::optional<signature_type>> sigs(requests.size());
+      std::future<void> converting;
+      for(size_t i = 0; i < requests.size(); ++i) {
+         auto it = _keys.find(requests[i].second);
+         if(it == _keys.end())
+            continue;
+         auto der_sig = sign_der(requests[i].first, it->second);
+         if(converting.valid())
+            converting.get();
+         converting = std::async(std::launch::async, [this, &sigs, &requests, i, pub_key = it->first, der_sig = std::move(der_sig)]() {
+            sigs[i] = to_signature(der_sig, pub_key, requests[i].first);
+         });
+      }
+      if(converting.valid())
+         converting.get();
+      return sigs;
+   }
 
+   std::vector<uint8_t> sign_der(const digest_type& d, uint16_t key_id) {
       size_t der_sig_sz = 128;
-      uint8_t der_sig[der_sig_sz];
+      std::vector<uint8_t> der_sig(der_sig_sz);
       yh_rc rc;
-      if((rc = yh_util_sign_ecdsa(session, it->second, (uint8_t*)d.data(), d.data_size(), der_sig, &der_sig_sz))) {
+      if((rc = yh_util_sign_ecdsa(session, key_id, (uint8_t*)d.data(), d.data_size(), der_sig.data(), &der_sig_sz))) {
          lock();
          FC_THROW_EXCEPTION(chain::wallet_exception, "yh_util_sign_ecdsa failed: ${m}", ("m", yh_strerror(rc)));
       }
+      der_sig.resize(der_sig_sz);
+      return der_sig;
+   }
 
+   /// uses `key`, called by one thread at a time
+   signature_type to_signature(const std::vector<uint8_t>& der_sig, const public_key_type& public_key, const digest_type& d) {
       ///XXX a lot of this below is similar to SE wallet; commonize it in non-junky way
       fc::ecdsa_sig sig = ECDSA_SIG_new();
       BIGNUM *r = BN_new(), *s = BN_new();
-      BN_bin2bn(der_sig+4, der_sig[3], r);
-      BN_bin2bn(der_sig+6+der_sig[3], der_sig[4+der_sig[3]+1], s);
+      BN_bin2bn(der_sig.data()+4, der_sig[3], r);
+      BN_bin2bn(der_sig.data()+6+der_sig[3], der_sig[4+der_sig[3]+1], s);
       ECDSA_SIG_set0(sig, r, s);
 
       char pub_key_shim_data[64];
       fc::datastream<char *> eds(pub_key_shim_data, sizeof(pub_key_shim_data));
-      fc::raw::pack(eds, it->first);
+      fc::raw::pack(eds, public_key);
       public_key_data* kd = (public_key_data*)(pub_key_shim_data+1);
 
       compact_signature compact_sig;
@@ -269,4 +300,8 @@ fc::optional<signature_type> yubihsm_wallet::try_sign_digest(const digest_type d
    return my->try_sign_digest(digest, public_key);
 }
 
+std::vector<fc::optional<signature_type>> yubihsm_wallet::try_sign_digests(const std::vector<sign_request>& requests) {
+   return my->try_sign_digests(requests);
+}
+
 }}
@@ -6,6 +6,7 @@
 #include <eosio/chain/block_log.hpp>
 #include <eosio/chain/config.hpp>
 #include <eosio/chain/reversible_block_object.hpp>
+#include <eosio/chain/thread_utils.hpp>
 
 #include <fc/io/json.hpp>
 #include <fc/filesystem.hpp>
@@ -15,10 +16,17 @@
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <deque>
+#include <iomanip>
+#include <thread>
 
 using namespace eosio::chain;
 namespace bfs = boost::filesystem;
 namespace bpo = boost::program_options;
+namespace bio = boost::iostreams;
 using bpo::options_description;
 using bpo::variables_map;
 
@@ -27,15 +35,70 @@ struct blocklog {
    {}
 
    void read_log();
+   void export_log();
+   void export_chunk(block_log::sequential_reader& reader, uint32_t first, uint32_t last)const;
+   void edit_log();
    void set_program_options(options_description& cli);
    void initialize(const variables_map& options);
 
    bfs::path                        blocks_dir;
    bfs::path                        output_file;
+   bfs::path                        export_dir;
+   bfs::path                        extract_dir;
    uint32_t                         first_block;
    uint32_t                         last_block;
+   uint32_t                         export_threads;
+   uint32_t                         blocks_per_file;
    bool                             no_pretty_print;
    bool                             as_json_array;
+   bool                             trim_log;
+   bool                             make_index;
+
+   bool edits_log()const { return trim_log || make_index || !extract_dir.empty(); }
+};
+
+fc::variant block_to_variant(const signed_block& block) {
+   const fc::microseconds deadline = fc::seconds(10);
+   fc::variant pretty_output;
+   abi_serializer::to_variant(block,
+                              pretty_output,
+                              []( account_name n ) { return optional<abi_serializer>(); },
+                              deadline);
+   const auto block_id = block.id();
+   const uint32_t ref_block_prefix = block_id._hash[1];
+   const auto enhanced_object = fc::mutable_variant_object
+              ("block_num",block.block_num())
+              ("id", block_id)
+              ("ref_block_prefix", ref_block_prefix)
+              (pretty_output.get_object());
+   return fc::variant(std::move(enhanced_object));
+}
+
+/// gzip compressed file of one JSON object per line
+struct export_file {
+   explicit export_file(const bfs::path& path)
+   :path(path)
+   ,file(path.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc)
+   {
+      EOS_ASSERT( file.good(), block_log_exception, "Unable to open file ${f}", ("f", path.generic_string()) );
+      out.push(bio::gzip_compressor());
+      out.push(file);
+   }
+
+   void write(const fc::variant& v) {
+      fc::json::to_stream(out, v, fc::time_point::maximum(), fc::json::stringify_large_ints_and_doubles);
+      out << '\n';
+   }
+
+   void close() {
+      out.reset(); // writes the gzip trailer
+      file.close();
+      EOS_ASSERT( !file.fail(), block_log_exception, "Unable to write file ${f}", ("f", path.generic_string()) );
+   }
+
+   bfs::path                path;
+   std::ofstream            file;
+   bio::filtering_ostream   out;
 };
 
 void blocklog::read_log() {
@@ -87,21 +150,8 @@ void blocklog::read_log() {
       *out << "[";
    uint32_t block_num = (first_block < 1) ? 1 : first_block;
    signed_block_ptr next;
-   fc::variant pretty_output;
-   const fc::microseconds deadline = fc::seconds(10);
    auto print_block = [&](signed_block_ptr& next) {
-      abi_serializer::to_variant(*next,
-                                 pretty_output,
-                                 []( account_name n ) { return optional<abi_serializer>(); },
-                                 deadline);
-      const auto block_id = next->id();
-      const uint32_t ref_block_prefix = block_id._hash[1];
-      const auto enhanced_object = fc::mutable_variant_object
-                 ("block_num",next->block_num())
-                 ("id", block_id)
-                 ("ref_block_prefix", ref_block_prefix)
-                 (pretty_output.get_object());
-      fc::variant v(std::move(enhanced_object));
+      const auto v = block_to_variant(*next);
        if (no_pretty_print)
           fc::json::to_stream(*out, v, fc::time_point::maximum(), fc::json::stringify_large_ints_and_doubles);
        else
@@ -130,6 +180,124 @@ void blocklog::read_log() {
       *out << "]";
 }
 
+void blocklog::export_log() {
+   block_log block_logger(blocks_dir);
+   const auto head = block_logger.head();
+   EOS_ASSERT( head, block_log_exception, "No blocks found in block log" );
+   const uint32_t first = std::max( { first_block, block_logger.first_block_num(), 1u } );
+   const uint32_t last = std::min( last_block, head->block_num() );
+   EOS_ASSERT( first <= last, block_log_exception, "No blocks from ${f} through ${l} in block log",
+               ("f", first_block)("l", last_block) );
+   bfs::create_directories(export_dir);
+   ilog( "exporting block num ${f} through block num ${l} to ${d} on ${t} threads",
+         ("f", first)("l", last)("d", export_dir.generic_string())("t", export_threads) );
+
+   // every chunk is read by its own reader, opened here and walked on a thread of the pool
+   named_thread_pool thread_pool( "export", export_threads );
+   std::deque<std::future<void>> exporting;
+   for( uint64_t chunk = first; chunk <= last; ) {
+      const uint32_t chunk_last = std::min<uint64_t>( (chunk - 1) / blocks_per_file * blocks_per_file + blocks_per_file, last );
+      auto reader = std::make_shared<block_log::sequential_reader>( block_logger, chunk );
+      exporting.push_back( async_thread_pool( thread_pool.get_executor(), [this, reader, chunk, chunk_last]() {
+         export_chunk( *reader, chunk, chunk_last );
+      } ) );
+      // bounds the open readers
+      if( exporting.size() >= 2 * export_threads ) {
+         exporting.front().get();
+         exporting.pop_front();
+      }
+      chunk = uint64_t(chunk_last) + 1;
+   }
+   for( auto& f : exporting )
+      f.get();
+   thread_pool.stop();
+}
+
+void blocklog::export_chunk(block_log::sequential_reader& reader, uint32_t first, uint32_t last)const {
+   std::ostringstream range;
+   range << std::setfill('0') << '-' << std::setw(10) << first << '-' << std::setw(10) << last << ".jsonl.gz";
+   export_file blocks( export_dir / ("blocks" + range.str()) );
+   export_file transactions( export_dir / ("transactions" + range.str()) );
+   export_file actions( export_dir / ("actions" + range.str()) );
+
+   const fc::microseconds deadline = fc::seconds(10);
+   auto no_abi = []( account_name n ) { return optional<abi_serializer>(); };
+   for( uint32_t block_num = first; block_num <= last; ++block_num ) {
+      const auto block = reader.next();
+      EOS_ASSERT( block && block->block_num() == block_num, block_log_exception,
+                  "Block ${n} is missing from block log", ("n", block_num) );
+      const auto block_id = block->id();
+      blocks.write( block_to_variant(*block) );
+
+      for( uint32_t index = 0; index < block->transactions.size(); ++index ) {
+         const auto& receipt = block->transactions[index];
+         fc::mutable_variant_object row;
+         row("block_num", block_num)
+            ("block_id", block_id)
+            ("index", index)
+            ("status", receipt.status)
+            ("cpu_usage_us", receipt.cpu_usage_us)
+            ("net_usage_words", receipt.net_usage_words);
+         if( receipt.trx.contains<transaction_id_type>() ) {
+            row("id", receipt.trx.get<transaction_id_type>());
+            transactions.write( fc::variant(std::move(row)) );
+            continue;
+         }
+         const auto& ptrx = receipt.trx.get<packed_transaction>();
+         const auto& trx = ptrx.get_signed_transaction();
+         const auto trx_id = ptrx.id();
+         fc::variant trx_variant;
+         abi_serializer::to_variant( trx, trx_variant, no_abi, deadline );
+         row("id", trx_id)("trx", std::move(trx_variant));
+         transactions.write( fc::variant(std::move(row)) );
+
+         uint32_t action_index = 0;
+         auto write_action = [&]( const action& act, bool context_free ) {
+            actions.write( fc::variant( fc::mutable_variant_object()
+               ("block_num", block_num)
+               ("trx_id", trx_id)
+               ("action_index", action_index++)
+               ("context_free", context_free)
+               ("account", act.account)
+               ("name", act.name)
+               ("authorization", act.authorization)
+               ("data", act.data) ) );
+         };
+         for( const auto& act : trx.context_free_actions )
+            write_action( act, true );
+         for( const auto& act : trx.actions )
+            write_action( act, false );
+      }
+   }
+   blocks.close();
+   transactions.close();
+   actions.close();
+}
+
+void blocklog::edit_log() {
+   if (make_index) {
+      ilog( "Reconstructing ${f}", ("f", (blocks_dir / "blocks.index").generic_string()) );
+      bfs::remove(blocks_dir / "blocks.index");
+      block_log log(blocks_dir); // rebuilds the missing index
+   }
+   if (!extract_dir.empty()) {
+      uint32_t first = 0, last = 0;
+      {
+         block_log log(blocks_dir);
+         EOS_ASSERT( log.head(), block_log_exception, "No blocks found in block log" );
+         first = std::max(first_block, log.first_block_num());
+         last = std::min(last_block, log.head()->block_num());
+      }
+      ilog( "Extracting block num ${f} through block num ${l} to ${d}", ("f", first)("l", last)("d", extract_dir.generic_string()) );
+      block_log::extract_blocks(blocks_dir, extract_dir, first, last);
+   }
+   if (trim_log) {
+      ilog( "Trimming block log to block num ${f} through block num ${l}", ("f", first_block)("l", last_block) );
+      block_log::trim_end(blocks_dir, last_block);
+      block_log::trim_front(blocks_dir, first_block);
+   }
+}
+
 void blocklog::set_program_options(options_description& cli)
 {
    cli.add_options()
@@ -145,6 +313,20 @@ void blocklog::set_program_options(options_description& cli)
           "Do not pretty print the output.  Useful if piping to jq to improve performance.")
          ("as-json-array", bpo::bool_switch(&as_json_array)->default_value(false),
           "Print out json blocks wrapped in json array (otherwise the output is free-standing json objects).")
+         ("export-dir", bpo::value<bfs::path>(),
+          "Instead of printing the blocks, export them to gzip compressed JSON lines files of blocks, transactions and actions "
+          "in this directory (absolute or relative path), one file of each per --blocks-per-file blocks.")
+         ("export-threads", bpo::value<uint32_t>(&export_threads)->default_value(std::max(1u, std::thread::hardware_concurrency())),
+          "the number of threads exporting files")
+         ("blocks-per-file", bpo::value<uint32_t>(&blocks_per_file)->default_value(100000),
+          "the number of blocks in each exported file")
+         ("trim-blocklog", bpo::bool_switch(&trim_log)->default_value(false),
+          "Remove the blocks before --first and after --last from the block log. Blocks after --last are cut in place, "
+          "removing blocks before --first rewrites the log. The node must be stopped.")
+         ("extract-blocks", bpo::value<bfs::path>(),
+          "Write the blocks from --first through --last to a new block log and index in this directory (absolute or relative path).")
+         ("make-index", bpo::bool_switch(&make_index)->default_value(false),
+          "Reconstruct blocks.index from blocks.log.")
          ("help", "Print this help message and exit.")
          ;
 
@@ -165,6 +347,24 @@ void blocklog::initialize(const variables_map& options) {
          else
             output_file = bld;
       }
+
+      if (options.count( "extract-blocks" )) {
+         bld = options.at( "extract-blocks" ).as<bfs::path>();
+         if( bld.is_relative())
+            extract_dir = bfs::current_path() / bld;
+         else
+            extract_dir = bld;
+      }
+
+      if (options.count( "export-dir" )) {
+         bld = options.at( "export-dir" ).as<bfs::path>();
+         if( bld.is_relative())
+            export_dir = bfs::current_path() / bld;
+         else
+            export_dir = bld;
+         EOS_ASSERT( export_threads > 0, fc::invalid_arg_exception, "--export-threads must be greater than 0" );
+         EOS_ASSERT( blocks_per_file > 0, fc::invalid_arg_exception, "--blocks-per-file must be greater than 0" );
+      }
    } FC_LOG_AND_RETHROW()
 
 }
@@ -185,7 +385,12 @@ int main(int argc, char** argv)
         return 0;
       }
       blog.initialize(vmap);
-      blog.read_log();
+      if (blog.edits_log())
+         blog.edit_log();
+      else if (!blog.export_dir.empty())
+         blog.export_log();
+      else
+         blog.read_log();
    } catch( const fc::exception& e ) {
       elog( "${e}", ("e", e.to_detail_string()));
       return -1;
@@ -54,8 +54,9 @@ namespace eosio { namespace client { namespace http {
       boost::asio::connect(sock, endpoints);
    }
 
+   /// `reusable` is set when the response is delimited by its content-length and the server keeps the connection open
    template<class T>
-   std::string do_txrx(T& socket, boost::asio::streambuf& request_buff, unsigned int& status_code) {
+   std::string do_txrx(T& socket, boost::asio::streambuf& request_buff, unsigned int& status_code, bool* reusable = nullptr) {
       // Send the request.
       boost::asio::write(socket, request_buff);
 
@@ -83,12 +84,18 @@ namespace eosio { namespace client { namespace http {
       // Process the response headers.
       std::string header;
       int response_content_length = -1;
+      bool connection_close = false;
       std::regex clregex(R"xx(^content-length:\s+(\d+))xx", std::regex_constants::icase);
+      std::regex closeregex(R"xx(^connection:\s+close)xx", std::regex_constants::icase);
       while (std::getline(response_stream, header) && header != "\r") {
          std::smatch match;
          if(std::regex_search(header, match, clregex))
             response_content_length = std::stoi(match[1]);
+         else if(std::regex_search(header, closeregex))
+            connection_close = true;
       }
+      if (reusable)
+         *reusable = response_content_length != -1 && !connection_close && http_version != "HTTP/1.0";
 
       // Attempt to read the response body using the length indicated by the
       // Content-length header. If the header was not present just read all available bytes.
@@ -183,41 +190,84 @@ namespace eosio { namespace client { namespace http {
       }
    }
 
+   void write_request( boost::asio::streambuf& request, const resolved_url& url, const string& path, const fc::variant& postdata,
+                       const std::vector<string>& headers, bool keep_alive, bool print_request ) {
+      std::string postjson;
+      if( !postdata.is_null() ) {
+         postjson = print_request ? fc::json::to_pretty_string( postdata ) : fc::json::to_string( postdata, fc::time_point::maximum() );
+      }
+
+      std::ostream request_stream(&request);
+      auto host_header_value = format_host_header(url);
+      request_stream << "POST " << path << (keep_alive ? " HTTP/1.1\r\n" : " HTTP/1.0\r\n");
+      request_stream << "Host: " << host_header_value << "\r\n";
+      request_stream << "content-length: " << postjson.size() << "\r\n";
+      request_stream << "Accept: */*\r\n";
+      request_stream << (keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+      // append more customized headers
+      for (const auto& h : headers) {
+         request_stream << h << "\r\n";
+      }
+      request_stream << "\r\n";
+      request_stream << postjson;
+
+      if ( print_request ) {
+         string s(request.size(), '\0');
+         buffer_copy(boost::asio::buffer(s), request.data());
+         std::cerr << "REQUEST:" << std::endl
+                   << "---------------------" << std::endl
+                   << s << std::endl
+                   << "---------------------" << std::endl;
+      }
+   }
+
+   fc::variant handle_response( const string& path, unsigned int status_code, const std::string& re, bool print_response ) {
+   const auto response_result = fc::json::from_string(re);
+   if( print_response ) {
+      std::cerr << "RESPONSE:" << std::endl
+                << "---------------------" << std::endl
+                << fc::json::to_pretty_string( response_result ) << std::endl
+                << "---------------------" << std::endl;
+   }
+   if( status_code == 200 || status_code == 201 || status_code == 202 ) {
+      return response_result;
+   } else if( status_code == 404 ) {
+      // Unknown endpoint
+      if (path.compare(0, chain_func_base.size(), chain_func_base) == 0) {
+         throw chain::missing_chain_api_plugin_exception(FC_LOG_MESSAGE(error, "Chain API plugin is not enabled"));
+      } else if (path.compare(0, wallet_func_base.size(), wallet_func_base) == 0) {
+         throw chain::missing_wallet_api_plugin_exception(FC_LOG_MESSAGE(error, "Wallet is not available"));
+      } else if (path.compare(0, history_func_base.size(), history_func_base) == 0) {
+         throw chain::missing_history_api_plugin_exception(FC_LOG_MESSAGE(error, "History API plugin is not enabled"));
+      } else if (path.compare(0, net_func_base.size(), net_func_base) == 0) {
+         throw chain::missing_net_api_plugin_exception(FC_LOG_MESSAGE(error, "Net API plugin is not enabled"));
+      }
+   } else {
+      auto &&error_info = response_result.as<eosio::error_results>().error;
+      // Construct fc exception from error
+      const auto &error_details = error_info.details;
+
+      fc::log_messages logs;
+      for (auto itr = error_details.begin(); itr != error_details.end(); itr++) {
+         const auto& context = fc::log_context(fc::log_level::error, itr->file.data(), itr->line_number, itr->method.data());
+         logs.emplace_back(fc::log_message(context, itr->message));
+      }
+
+      throw fc::exception(logs, error_info.code, error_info.name, error_info.what);
+   }
+
+   EOS_ASSERT( status_code == 200, http_request_fail, "Error code ${c}\n: ${msg}\n", ("c", status_code)("msg", re) );
+   return response_result;
+   }
+
    fc::variant do_http_call( const connection_param& cp,
                              const fc::variant& postdata,
                              bool print_request,
                              bool print_response ) {
-   std::string postjson;
-   if( !postdata.is_null() ) {
-      postjson = print_request ? fc::json::to_pretty_string( postdata ) : fc::json::to_string( postdata, fc::time_point::maximum() );
-   }
-
    const auto& url = cp.url;
 
    boost::asio::streambuf request;
-   std::ostream request_stream(&request);
-   auto host_header_value = format_host_header(url);
-   request_stream << "POST " << url.path << " HTTP/1.0\r\n";
-   request_stream << "Host: " << host_header_value << "\r\n";
-   request_stream << "content-length: " << postjson.size() << "\r\n";
-   request_stream << "Accept: */*\r\n";
-   request_stream << "Connection: close\r\n";
-   // append more customized headers
-   std::vector<string>::iterator itr;
-   for (itr = cp.headers.begin(); itr != cp.headers.end(); itr++) {
-      request_stream << *itr << "\r\n";
-   }
-   request_stream << "\r\n";
-   request_stream << postjson;
-
-   if ( print_request ) {
-      string s(request.size(), '\0');
-      buffer_copy(boost::asio::buffer(s), request.data());
-      std::cerr << "REQUEST:" << std::endl
-                << "---------------------" << std::endl
-                << s << std::endl
-                << "---------------------" << std::endl;
-   }
+   write_request(request, url, url.path, postdata, cp.headers, false, print_request);
 
    unsigned int status_code;
    std::string re;
@@ -255,41 +305,93 @@ namespace eosio { namespace client { namespace http {
       throw;
    }
 
-   const auto response_result = fc::json::from_string(re);
-   if( print_response ) {
-      std::cerr << "RESPONSE:" << std::endl
-                << "---------------------" << std::endl
-                << fc::json::to_pretty_string( response_result ) << std::endl
-                << "---------------------" << std::endl;
+   return handle_response(url.path, status_code, re, print_response);
    }
-   if( status_code == 200 || status_code == 201 || status_code == 202 ) {
-      return response_result;
-   } else if( status_code == 404 ) {
-      // Unknown endpoint
-      if (url.path.compare(0, chain_func_base.size(), chain_func_base) == 0) {
-         throw chain::missing_chain_api_plugin_exception(FC_LOG_MESSAGE(error, "Chain API plugin is not enabled"));
-      } else if (url.path.compare(0, wallet_func_base.size(), wallet_func_base) == 0) {
-         throw chain::missing_wallet_api_plugin_exception(FC_LOG_MESSAGE(error, "Wallet is not available"));
-      } else if (url.path.compare(0, history_func_base.size(), history_func_base) == 0) {
-         throw chain::missing_history_api_plugin_exception(FC_LOG_MESSAGE(error, "History API plugin is not enabled"));
-      } else if (url.path.compare(0, net_func_base.size(), net_func_base) == 0) {
-         throw chain::missing_net_api_plugin_exception(FC_LOG_MESSAGE(error, "Net API plugin is not enabled"));
+
+   struct keep_alive_connection::impl {
+      impl( const parsed_url& url, bool verify_cert, const std::vector<string>& headers )
+      : ssl_context(boost::asio::ssl::context::sslv23_client), verify_cert(verify_cert), headers(headers) {
+         auto ctx = create_http_context();
+         this->url.reset( new resolved_url( resolve_url(ctx, url) ) );
+         if( url.scheme == "https" )
+            fc::add_platform_root_cas_to_context(ssl_context);
       }
-   } else {
-      auto &&error_info = response_result.as<eosio::error_results>().error;
-      // Construct fc exception from error
-      const auto &error_details = error_info.details;
 
-      fc::log_messages logs;
-      for (auto itr = error_details.begin(); itr != error_details.end(); itr++) {
-         const auto& context = fc::log_context(fc::log_level::error, itr->file.data(), itr->line_number, itr->method.data());
-         logs.emplace_back(fc::log_message(context, itr->message));
+      void connect() {
+         const auto& u = *url;
+         if(u.scheme == "unix") {
+            unix_socket.reset( new boost::asio::local::stream_protocol::socket(ios) );
+            unix_socket->connect(boost::asio::local::stream_protocol::endpoint(u.server));
+         } else if(u.scheme == "http") {
+            socket.reset( new tcp::socket(ios) );
+            do_connect(*socket, u);
+         } else {
+            ssl_socket.reset( new boost::asio::ssl::stream<tcp::socket>(ios, ssl_context) );
+            SSL_set_tlsext_host_name(ssl_socket->native_handle(), u.server.c_str());
+            if(verify_cert) {
+               ssl_socket->set_verify_mode(boost::asio::ssl::verify_peer);
+               ssl_socket->set_verify_callback(boost::asio::ssl::rfc2818_verification(u.server));
+            }
+            do_connect(ssl_socket->next_layer(), u);
+            ssl_socket->handshake(boost::asio::ssl::stream_base::client);
+         }
+         connected = true;
       }
 
-      throw fc::exception(logs, error_info.code, error_info.name, error_info.what);
+      void close() {
+         unix_socket.reset();
+         socket.reset();
+         ssl_socket.reset();
+         connected = false;
+      }
+
+      std::string txrx( boost::asio::streambuf& request, unsigned int& status_code, bool& reusable ) {
+         if(unix_socket) return do_txrx(*unix_socket, request, status_code, &reusable);
+         if(socket) return do_txrx(*socket, request, status_code, &reusable);
+         return do_txrx(*ssl_socket, request, status_code, &reusable);
+      }
+
+      boost::asio::io_service                                        ios;
+      boost::asio::ssl::context                                      ssl_context;
+      std::unique_ptr<resolved_url>                                  url;
+      bool                                                           verify_cert;
+      std::vector<string>                                            headers;
+      bool                                                           connected = false;
+      std::unique_ptr<boost::asio::local::stream_protocol::socket>   unix_socket;
+      std::unique_ptr<tcp::socket>                                   socket;
+      std::unique_ptr<boost::asio::ssl::stream<tcp::socket>>         ssl_socket;
+   };
+
+   keep_alive_connection::keep_alive_connection( const parsed_url& url, bool verify_cert, const std::vector<string>& headers )
+   : my( new impl(url, verify_cert, headers) ) {
    }
 
-   EOS_ASSERT( status_code == 200, http_request_fail, "Error code ${c}\n: ${msg}\n", ("c", status_code)("msg", re) );
-   return response_result;
+   keep_alive_connection::~keep_alive_connection() = default;
+
+   fc::variant keep_alive_connection::call( const string& path, const fc::variant& postdata, bool print_request, bool print_response ) {
+      const string full_path = my->url->path + path;
+      unsigned int status_code = 0;
+      std::string re;
+      for( int attempt = 0; ; ++attempt ) {
+         const bool reused = my->connected;
+         boost::asio::streambuf request;
+         write_request(request, *my->url, full_path, postdata, my->headers, true, print_request && attempt == 0);
+         bool reusable = false;
+         try {
+            if( !my->connected ) my->connect();
+            re = my->txrx(request, status_code, reusable);
+         } catch( const boost::system::system_error& ) {
+            my->close();
+            // the server may have closed the connection while it was idle, the request did not reach it
+            if( reused && attempt == 0 ) continue;
+            throw;
+         } catch( ... ) {
+            my->close();
+            throw;
+         }
+         if( !reusable ) my->close();
+         break;
+      }
+      return handle_response(full_path, status_code, re, print_response);
    }
 }}}
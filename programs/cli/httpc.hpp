@@ -82,6 +82,26 @@ namespace eosio { namespace client { namespace http {
                              bool print_request = false,
                              bool print_response = false);
 
+   /**
+    * A connection kept open across requests, for a thread sending many requests to one server.
+    *
+    * Requests are sent with HTTP/1.1 keep-alive, one at a time. The connection is opened by the first request and
+    * opened again when the server closes it; a request failing on a reused connection is sent again once.
+    */
+   class keep_alive_connection {
+      public:
+         keep_alive_connection( const parsed_url& url, bool verify_cert, const std::vector<string>& headers );
+         ~keep_alive_connection();
+
+         /// POSTs `postdata` to `path`, relative to the url of the connection
+         fc::variant call( const string& path, const fc::variant& postdata,
+                           bool print_request = false, bool print_response = false );
+
+      private:
+         struct impl;
+         std::unique_ptr<impl> my;
+   };
+
    const string chain_func_base = "/v1/chain";
    const string get_info_func = chain_func_base + "/get_info";
    const string push_txn_func = chain_func_base + "/push_transaction";
@@ -130,6 +150,7 @@ namespace eosio { namespace client { namespace http {
    const string wallet_remove_key = wallet_func_base + "/remove_key";
    const string wallet_create_key = wallet_func_base + "/create_key";
    const string wallet_sign_trx = wallet_func_base + "/sign_transaction";
+   const string wallet_sign_trxs = wallet_func_base + "/sign_transactions";
    const string keosd_stop = "/v1/" + string(client::config::key_store_executable_name) + "/stop";
 
    FC_DECLARE_EXCEPTION( connection_exception, 1100000, "Connection Exception" );
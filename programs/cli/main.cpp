@@ -77,6 +77,11 @@ Options:
 #include <vector>
 #include <regex>
 #include <iostream>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #include <fc/crypto/hex.hpp>
 #include <fc/variant.hpp>
 #include <fc/io/datastream.hpp>
@@ -107,6 +112,7 @@ Options:
 #include <boost/range/adaptor/transformed.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/range/algorithm/copy.hpp>
 #include <boost/algorithm/string/classification.hpp>
 
@@ -276,7 +282,10 @@ string generate_nonce_string() {
 }
 
 chain::action generate_nonce_action() {
-   return chain::action( {}, config::null_account_name, "nonce", fc::raw::pack(fc::time_point::now().time_since_epoch().count()));
+   // strictly increasing, transactions built in the same microsecond by push bulk get different nonces
+   static int64_t last_nonce = 0;
+   last_nonce = std::max<int64_t>(fc::time_point::now().time_since_epoch().count(), last_nonce + 1);
+   return chain::action( {}, config::null_account_name, "nonce", fc::raw::pack(last_nonce));
 }
 
 void prompt_for_wallet_password(string& pw, const string& name) {
@@ -288,10 +297,7 @@ void prompt_for_wallet_password(string& pw, const string& name) {
    }
 }
 
-fc::variant determine_required_keys(const signed_transaction& trx) {
-   // TODO better error checking
-   //wdump((trx));
-   const auto& public_keys = call(wallet_url, wallet_public_keys);
+fc::variant determine_required_keys(const signed_transaction& trx, const fc::variant& public_keys) {
    auto get_arg = fc::mutable_variant_object
            ("transaction", (transaction)trx)
            ("available_keys", public_keys);
@@ -299,36 +305,50 @@ fc::variant determine_required_keys(const signed_transaction& trx) {
    return required_keys["required_keys"];
 }
 
+fc::variant determine_required_keys(const signed_transaction& trx) {
+   // TODO better error checking
+   //wdump((trx));
+   const auto& public_keys = call(wallet_url, wallet_public_keys);
+   return determine_required_keys(trx, public_keys);
+}
+
 void sign_transaction(signed_transaction& trx, fc::variant& required_keys, const chain_id_type& chain_id) {
    fc::variants sign_args = {fc::variant(trx), required_keys, fc::variant(chain_id)};
    const auto& signed_trx = call(wallet_url, wallet_sign_trx, sign_args);
    trx = signed_trx.as<signed_transaction>();
 }
 
-fc::variant push_transaction( signed_transaction& trx, packed_transaction::compression_type compression = packed_transaction::none ) {
-   auto info = get_info();
+// Tapos block, default to last irreversible block if it's not specified by the user
+block_id_type determine_ref_block_id(const eosio::chain_apis::read_only::get_info_results& info) {
+   block_id_type ref_block_id = info.last_irreversible_block_id;
+   try {
+      fc::variant ref_block;
+      if (!tx_ref_block_num_or_id.empty()) {
+         ref_block = call(get_block_func, fc::mutable_variant_object("block_num_or_id", tx_ref_block_num_or_id));
+         ref_block_id = ref_block["id"].as<block_id_type>();
+      }
+   } EOS_RETHROW_EXCEPTIONS(invalid_ref_block_exception, "Invalid reference block num or id: ${block_num_or_id}", ("block_num_or_id", tx_ref_block_num_or_id));
+   return ref_block_id;
+}
 
-   if (trx.signatures.size() == 0) { // #5445 can't change txn content if already signed
-      trx.expiration = info.head_block_time + tx_expiration;
+void set_transaction_header(signed_transaction& trx, const eosio::chain_apis::read_only::get_info_results& info, const block_id_type& ref_block_id) {
+   trx.expiration = info.head_block_time + tx_expiration;
+   trx.set_reference_block(ref_block_id);
 
-      // Set tapos, default to last irreversible block if it's not specified by the user
-      block_id_type ref_block_id = info.last_irreversible_block_id;
-      try {
-         fc::variant ref_block;
-         if (!tx_ref_block_num_or_id.empty()) {
-            ref_block = call(get_block_func, fc::mutable_variant_object("block_num_or_id", tx_ref_block_num_or_id));
-            ref_block_id = ref_block["id"].as<block_id_type>();
-         }
-      } EOS_RETHROW_EXCEPTIONS(invalid_ref_block_exception, "Invalid reference block num or id: ${block_num_or_id}", ("block_num_or_id", tx_ref_block_num_or_id));
-      trx.set_reference_block(ref_block_id);
+   if (tx_force_unique) {
+      trx.context_free_actions.emplace_back( generate_nonce_action() );
+   }
 
-      if (tx_force_unique) {
-         trx.context_free_actions.emplace_back( generate_nonce_action() );
-      }
+   trx.max_cpu_usage_ms = tx_max_cpu_usage;
+   trx.max_net_usage_words = (tx_max_net_usage + 7)/8;
+   trx.delay_sec = delaysec;
+}
 
-      trx.max_cpu_usage_ms = tx_max_cpu_usage;
-      trx.max_net_usage_words = (tx_max_net_usage + 7)/8;
-      trx.delay_sec = delaysec;
+fc::variant push_transaction( signed_transaction& trx, packed_transaction::compression_type compression = packed_transaction::none ) {
+   auto info = get_info();
+
+   if (trx.signatures.size() == 0) { // #5445 can't change txn content if already signed
+      set_transaction_header(trx, info, determine_ref_block_id(info));
    }
 
    if (!tx_skip_sign) {
@@ -520,6 +540,206 @@ void send_transaction( signed_transaction& trx, packed_transaction::compression_
    }
 }
 
+/// a line of push bulk is a transaction, or an action with `data` as JSON arguments or packed hex pushed in a transaction of its own
+signed_transaction bulk_line_to_transaction( const fc::variant& line ) {
+   const auto& obj = line.get_object();
+   signed_transaction trx;
+   if( obj.contains("actions") ) {
+      try {
+         trx = line.as<signed_transaction>();
+      } catch( fc::exception& ) {
+         // unable to convert so try via abi
+         abi_serializer::from_variant( line, trx, abi_serializer_resolver, abi_serializer_max_time );
+      }
+      return trx;
+   }
+
+   const auto account = name( obj["account"].as_string() );
+   const auto act = name( obj["name"].as_string() );
+   const auto authorization = obj.contains("authorization") ? obj["authorization"].as<vector<permission_level>>()
+                                                            : get_account_permissions(tx_permission);
+   bytes data;
+   if( obj.contains("data") && obj["data"].is_string() ) {
+      const auto& hex = obj["data"].get_string();
+      data.resize( hex.size() / 2 );
+      EOS_ASSERT( fc::from_hex( hex, data.data(), data.size() ) == data.size(), action_type_exception, "Invalid hex action data" );
+   } else {
+      data = variant_to_bin( account, act, obj.contains("data") ? obj["data"] : fc::variant() );
+   }
+   trx.actions.emplace_back( authorization, account, act, std::move(data) );
+   return trx;
+}
+
+/**
+ * Pushes the transactions of `input`, or of stdin, one JSON per line.
+ *
+ * The transactions are prepared and signed in batches, a request to the wallet signs a whole batch and the required
+ * keys are looked up once per set of authorizations. `window` threads each push one transaction at a time through a
+ * keep-alive connection of their own, while the next batch is signed. A transaction failing is reported with its line
+ * and the others are still pushed; a summary of the throughput and of the push latencies ends the output.
+ */
+void push_bulk( const string& input, uint32_t window, uint32_t batch_size ) {
+   FC_ASSERT( window > 0 && batch_size > 0, "--window and --batch must be positive" );
+   std::ifstream file;
+   if( input != "-" ) {
+      file.open( input );
+      FC_ASSERT( file, "Unable to open ${f}", ("f", input) );
+   }
+   std::istream& in = input == "-" ? std::cin : file;
+
+   struct bulk_item {
+      uint64_t           line;
+      packed_transaction trx;
+   };
+
+   std::mutex mtx;
+   std::condition_variable queue_changed;
+   std::deque<bulk_item> queue;
+   const size_t max_queued = std::max<size_t>( batch_size, window * 2 );
+   bool done = false;
+
+   std::mutex out_mtx;
+   std::vector<uint64_t> latencies_us;
+   uint64_t failed = 0;
+   const auto report_failure = [&]( uint64_t line, const string& error ) {
+      std::lock_guard<std::mutex> g( out_mtx );
+      ++failed;
+      std::cerr << localized("line ${l}: ${e}", ("l", line)("e", error)) << std::endl;
+   };
+
+   const auto start = fc::time_point::now();
+   std::vector<std::thread> workers;
+   if( !tx_dont_broadcast ) {
+      const auto node_url = parse_url( url );
+      for( uint32_t i = 0; i < window; ++i ) {
+         workers.emplace_back( [&]() {
+            keep_alive_connection conn( node_url, !no_verify, headers );
+            for( ;; ) {
+               bulk_item item;
+               {
+                  std::unique_lock<std::mutex> g( mtx );
+                  queue_changed.wait( g, [&]() { return done || !queue.empty(); } );
+                  if( queue.empty() ) return;
+                  item = std::move( queue.front() );
+                  queue.pop_front();
+               }
+               queue_changed.notify_all();
+
+               const auto sent = fc::time_point::now();
+               try {
+                  auto result = conn.call( push_txn_func, fc::variant( item.trx ), print_request, print_response );
+                  std::lock_guard<std::mutex> g( out_mtx );
+                  latencies_us.push_back( ( fc::time_point::now() - sent ).count() );
+                  if( tx_print_json )
+                     std::cout << fc::json::to_string( result ) << std::endl;
+               } catch( const fc::exception& e ) {
+                  report_failure( item.line, e.to_string() );
+               } catch( const std::exception& e ) {
+                  report_failure( item.line, e.what() );
+               }
+            }
+         } );
+      }
+   }
+   const auto stop_workers = [&]() {
+      {
+         std::lock_guard<std::mutex> g( mtx );
+         done = true;
+      }
+      queue_changed.notify_all();
+      for( auto& w : workers ) w.join();
+      workers.clear();
+   };
+
+   uint64_t line_num = 0;
+   uint64_t total = 0;
+   try {
+      fc::variant public_keys;
+      std::map<string, fc::variant> required_keys_by_auth;
+      string line;
+      bool eof = false;
+      while( !eof ) {
+         std::vector<std::pair<uint64_t, signed_transaction>> batch;
+         while( batch.size() < batch_size ) {
+            if( !std::getline( in, line ) ) {
+               eof = true;
+               break;
+            }
+            ++line_num;
+            boost::trim( line );
+            if( line.empty() || line[0] == '#' ) continue;
+            ++total;
+            try {
+               batch.emplace_back( line_num, bulk_line_to_transaction( fc::json::from_string( line, fc::json::relaxed_parser ) ) );
+            } catch( const fc::exception& e ) {
+               report_failure( line_num, e.to_string() );
+            }
+         }
+         if( batch.empty() ) continue;
+
+         const auto info = get_info();
+         const auto ref_block_id = determine_ref_block_id( info );
+         for( auto& b : batch ) {
+            if( b.second.signatures.empty() ) // #5445 can't change txn content if already signed
+               set_transaction_header( b.second, info, ref_block_id );
+         }
+
+         if( !tx_skip_sign ) {
+            if( public_keys.is_null() )
+               public_keys = call( wallet_url, wallet_public_keys );
+            fc::variants requests;
+            requests.reserve( batch.size() );
+            for( const auto& b : batch ) {
+               // transactions of an airdrop or a migration mostly share their authorizations
+               std::vector<permission_level> auths;
+               for( const auto& a : b.second.actions )
+                  auths.insert( auths.end(), a.authorization.begin(), a.authorization.end() );
+               auto& keys = required_keys_by_auth[fc::json::to_string( auths )];
+               if( keys.is_null() )
+                  keys = determine_required_keys( b.second, public_keys );
+               requests.emplace_back( fc::variants{ fc::variant( b.second ), keys } );
+            }
+            auto signed_trxs = call( wallet_url, wallet_sign_trxs, fc::variants{ fc::variant( requests ), fc::variant( info.chain_id ) } )
+                                       .as<std::vector<signed_transaction>>();
+            FC_ASSERT( signed_trxs.size() == batch.size(), "Wallet returned ${n} transactions for ${b}",
+                        ("n", signed_trxs.size())("b", batch.size()) );
+            for( size_t i = 0; i < batch.size(); ++i )
+               batch[i].second = std::move( signed_trxs[i] );
+         }
+
+         for( auto& b : batch ) {
+            if( tx_dont_broadcast ) {
+               std::cout << fc::json::to_string( tx_return_packed ? fc::variant( packed_transaction( b.second ) ) : fc::variant( b.second ) ) << std::endl;
+               continue;
+            }
+            std::unique_lock<std::mutex> g( mtx );
+            queue_changed.wait( g, [&]() { return queue.size() < max_queued; } );
+            queue.push_back( { b.first, packed_transaction( std::move( b.second ) ) } );
+            g.unlock();
+            queue_changed.notify_all();
+         }
+      }
+   } catch( ... ) {
+      stop_workers();
+      throw;
+   }
+   stop_workers();
+
+   if( tx_dont_broadcast ) return;
+   const double elapsed_s = std::max<int64_t>( ( fc::time_point::now() - start ).count(), 1 ) / 1e6;
+   std::sort( latencies_us.begin(), latencies_us.end() );
+   const auto percentile_ms = [&]( double p ) {
+      if( latencies_us.empty() ) return 0.0;
+      return latencies_us[std::min<size_t>( latencies_us.size() * p, latencies_us.size() - 1 )] / 1000.0;
+   };
+   std::cerr << localized("pushed ${t} transactions in ${s} s: ${ok} succeeded, ${f} failed, ${tps} trx/s",
+                          ("t", total)("s", boost::str( boost::format( "%.3f" ) % elapsed_s ))("ok", latencies_us.size())("f", failed)
+                          ("tps", boost::str( boost::format( "%.1f" ) % ( latencies_us.size() / elapsed_s ) ))) << std::endl;
+   std::cerr << localized("latency ms: min ${min} p50 ${p50} p90 ${p90} p99 ${p99} max ${max}",
+                          ("min", percentile_ms( 0 ))("p50", percentile_ms( 0.5 ))("p90", percentile_ms( 0.9 ))
+                          ("p99", percentile_ms( 0.99 ))("max", percentile_ms( 1 ))) << std::endl;
+}
+
 chain::permission_level to_permission_level(const std::string& s) {
    auto at_pos = s.find('@');
    return permission_level { s.substr(0, at_pos), s.substr(at_pos + 1) };
@@ -3068,6 +3288,20 @@ int main( int argc, char** argv ) {
    });
 
 
+   // push bulk
+   string bulk_input;
+   uint32_t bulk_window = 8;
+   uint32_t bulk_batch = 100;
+   auto bulkSubcommand = push->add_subcommand("bulk", localized("Push many transactions, or actions each in a transaction of its own, read as JSON lines"));
+   bulkSubcommand->add_option("input", bulk_input, localized("The file of transactions or actions, one JSON per line, '-' to read stdin"))->required();
+   bulkSubcommand->add_option("--window", bulk_window, localized("The number of transactions in flight, each on a keep-alive connection of its own"), true);
+   bulkSubcommand->add_option("--batch", bulk_batch, localized("The number of transactions signed by each request to the wallet"), true);
+   add_standard_transaction_options(bulkSubcommand);
+   bulkSubcommand->set_callback([&] {
+      push_bulk(bulk_input, bulk_window, bulk_batch);
+   });
+
+
    // multisig subcommand
    auto msig = app.add_subcommand("multisig", localized("Multisig contract commands"), false);
    msig->require_subcommand();
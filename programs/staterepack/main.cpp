@@ -0,0 +1,216 @@
+/**
+ *  @file
+ *  @copyright defined in eosio/LICENSE.txt
+ */
+#include <eosio/chain/config.hpp>
+#include <eosio/chain/controller.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/protocol_feature_manager.hpp>
+#include <eosio/chain/snapshot.hpp>
+
+#include <fc/filesystem.hpp>
+
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <fstream>
+#include <thread>
+
+using namespace eosio::chain;
+namespace bfs = boost::filesystem;
+namespace bpo = boost::program_options;
+using bpo::options_description;
+using bpo::variables_map;
+
+/**
+ * Rewrites the chain state of a stopped node into a new state file.
+ *
+ * The state is written to a snapshot and a new state is created from it: objects are allocated again in the order of
+ * the snapshot, the rows of a contract table one after the other, and the free space left by years of erased objects
+ * is gone. The new state is checked against the integrity hash of the original before it is kept.
+ *
+ * Both are at the last irreversible block: the reversible blocks are undone in the original like when a node starts
+ * in irreversible mode, and its fork database is copied next to the new state, so a node started on it applies them
+ * again.
+ */
+struct staterepack {
+   void repack();
+   void set_program_options(options_description& cli);
+   void initialize(const variables_map& options);
+
+   bfs::path                        blocks_dir;
+   bfs::path                        state_dir;
+   bfs::path                        output_dir;
+   uint64_t                         state_size = 0;
+   uint32_t                         snapshot_threads = 1;
+};
+
+protocol_feature_set make_protocol_feature_set() {
+   protocol_feature_set pfs;
+   std::map<builtin_protocol_feature_t, optional<digest_type>> visited_builtins;
+
+   std::function<digest_type(builtin_protocol_feature_t)> add_builtins =
+   [&pfs, &visited_builtins, &add_builtins]( builtin_protocol_feature_t codename ) -> digest_type {
+      auto res = visited_builtins.emplace( codename, optional<digest_type>() );
+      if( !res.second ) {
+         EOS_ASSERT( res.first->second, protocol_feature_exception,
+                     "invariant failure: cycle found in builtin protocol feature dependencies" );
+         return *res.first->second;
+      }
+
+      auto f = protocol_feature_set::make_default_builtin_protocol_feature( codename,
+      [&add_builtins]( builtin_protocol_feature_t d ) {
+         return add_builtins( d );
+      } );
+
+      const auto& pf = pfs.add_feature( f );
+      res.first->second = pf.feature_digest;
+      return pf.feature_digest;
+   };
+
+   for( const auto& p : builtin_protocol_feature_codenames ) {
+      add_builtins( p.first );
+   }
+   return pfs;
+}
+
+void staterepack::repack() {
+   const auto state_file = state_dir / "shared_memory.bin";
+   EOS_ASSERT( bfs::exists(state_file), database_exception, "No state found in ${d}", ("d", state_dir.generic_string()) );
+   EOS_ASSERT( !bfs::exists(output_dir / "shared_memory.bin"), database_exception,
+               "${d} already holds a state", ("d", output_dir.generic_string()) );
+   if( state_size == 0 )
+      state_size = bfs::file_size(state_file);
+   bfs::create_directories(output_dir);
+
+   const auto snapshot_path = output_dir / "repack.snapshot";
+   sha256 integrity_hash;
+   block_id_type head_id;
+   {
+      controller::config cfg;
+      cfg.blocks_dir = blocks_dir;
+      cfg.state_dir = state_dir;
+      cfg.state_size = state_size;
+      cfg.read_mode = db_read_mode::IRREVERSIBLE;
+      controller original( cfg, make_protocol_feature_set() );
+      original.add_indices();
+      original.startup( []() { return false; } );
+
+      const auto& segment = *original.db().get_segment_manager();
+      ilog( "state at block ${n} uses ${u} MiB of ${s} MiB",
+            ("n", original.head_block_num())("u", (segment.get_size() - segment.get_free_memory()) / (1024 * 1024))
+            ("s", segment.get_size() / (1024 * 1024)) );
+
+      integrity_hash = original.calculate_integrity_hash();
+      head_id = original.head_block_id();
+
+      std::ofstream snapshot( snapshot_path.generic_string(), std::ios::out | std::ios::binary | std::ios::trunc );
+      auto writer = std::make_shared<chunked_snapshot_writer>( snapshot, snapshot_threads );
+      original.write_snapshot( writer );
+      writer->finalize();
+      snapshot.close();
+      EOS_ASSERT( !snapshot.fail(), snapshot_exception, "Unable to write ${f}", ("f", snapshot_path.generic_string()) );
+   }
+
+   {
+      // the block log written for the new state is not needed, the node keeps its own
+      fc::temp_directory blocks;
+      controller::config cfg;
+      cfg.blocks_dir = blocks.path();
+      cfg.state_dir = output_dir;
+      cfg.state_size = state_size;
+      cfg.read_mode = db_read_mode::IRREVERSIBLE;
+      controller repacked( cfg, make_protocol_feature_set() );
+      repacked.add_indices();
+      repacked.startup( []() { return false; }, std::make_shared<mapped_snapshot_reader>( snapshot_path ) );
+
+      EOS_ASSERT( repacked.head_block_id() == head_id, snapshot_exception,
+                  "repacked state is at block ${r} instead of ${o}", ("r", repacked.head_block_id())("o", head_id) );
+      const auto repacked_hash = repacked.calculate_integrity_hash();
+      EOS_ASSERT( repacked_hash == integrity_hash, snapshot_exception,
+                  "integrity hash ${r} of the repacked state differs from ${o}", ("r", repacked_hash)("o", integrity_hash) );
+
+      const auto& segment = *repacked.db().get_segment_manager();
+      ilog( "repacked state uses ${u} MiB, integrity hash ${h}",
+            ("u", (segment.get_size() - segment.get_free_memory()) / (1024 * 1024))("h", integrity_hash) );
+   }
+   bfs::remove(snapshot_path);
+
+   // the reversible blocks after the state, applied again by the node
+   for( const auto& name : { config::forkdb_filename, config::forkdb_journal_filename } ) {
+      bfs::remove(output_dir / name);
+      if( bfs::exists(state_dir / name) )
+         bfs::copy_file(state_dir / name, output_dir / name);
+   }
+   ilog( "repacked state written to ${d}, replace the contents of ${s} with it to use it",
+         ("d", output_dir.generic_string())("s", state_dir.generic_string()) );
+}
+
+void staterepack::set_program_options(options_description& cli)
+{
+   cli.add_options()
+         ("blocks-dir", bpo::value<bfs::path>()->default_value("blocks"),
+          "the location of the blocks directory (absolute path or relative to the current directory)")
+         ("state-dir", bpo::value<bfs::path>()->default_value("state"),
+          "the location of the state directory to repack (absolute path or relative to the current directory). "
+          "The node must be stopped. Its reversible blocks are undone, the node applies them again when started.")
+         ("output-dir", bpo::value<bfs::path>(),
+          "the directory the repacked state is written to (absolute path or relative to the current directory)")
+         ("state-size-mb", bpo::value<uint64_t>()->default_value(0),
+          "Maximum size (in MiB) of the repacked state, 0 for the size of the original")
+         ("snapshot-threads", bpo::value<uint32_t>(&snapshot_threads)->default_value(std::max(1u, std::thread::hardware_concurrency())),
+          "the number of threads writing the intermediate snapshot")
+         ("help", "Print this help message and exit.")
+         ;
+}
+
+void staterepack::initialize(const variables_map& options) {
+   try {
+      const auto absolute = []( const bfs::path& p ) {
+         return p.is_relative() ? bfs::current_path() / p : p;
+      };
+      blocks_dir = absolute( options.at( "blocks-dir" ).as<bfs::path>() );
+      state_dir = absolute( options.at( "state-dir" ).as<bfs::path>() );
+      EOS_ASSERT( options.count( "output-dir" ), fc::invalid_arg_exception, "--output-dir is required" );
+      output_dir = absolute( options.at( "output-dir" ).as<bfs::path>() );
+      EOS_ASSERT( bfs::weakly_canonical(output_dir) != bfs::weakly_canonical(state_dir), fc::invalid_arg_exception,
+                  "--output-dir must not be the state directory" );
+      state_size = options.at( "state-size-mb" ).as<uint64_t>() * 1024 * 1024;
+      EOS_ASSERT( snapshot_threads > 0, fc::invalid_arg_exception, "--snapshot-threads must be greater than 0" );
+   } FC_LOG_AND_RETHROW()
+}
+
+
+int main(int argc, char** argv)
+{
+   options_description cli ("daobet-staterepack command line options");
+   try {
+      staterepack repack;
+      repack.set_program_options(cli);
+      variables_map vmap;
+      bpo::store(bpo::parse_command_line(argc, argv, cli), vmap);
+      bpo::notify(vmap);
+      if (vmap.count("help") > 0) {
+        cli.print(std::cerr);
+        return 0;
+      }
+      repack.initialize(vmap);
+      repack.repack();
+   } catch( const fc::exception& e ) {
+      elog( "${e}", ("e", e.to_detail_string()));
+      return -1;
+   } catch( const boost::exception& e ) {
+      elog("${e}", ("e",boost::diagnostic_information(e)));
+      return -1;
+   } catch( const std::exception& e ) {
+      elog("${e}", ("e",e.what()));
+      return -1;
+   } catch( ... ) {
+      elog("unknown exception");
+      return -1;
+   }
+
+   return 0;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "simulator.hpp"
+#include "topology.hpp"
+
+#include <fc/io/json.hpp>
+#include <fc/variant_object.hpp>
+
+#include <chrono>
+#include <ostream>
+#include <string>
+
+//---------- benchmark runner ----------//
+
+struct BenchmarkConfig {
+    std::string name = "default";
+    size_t nodes = 21;
+    std::string topology = "random_regular"; ///< random_regular | small_world | multi_region | full
+    size_t degree = 4;                       ///< peers per node (per region for multi_region)
+    size_t regions = 3;
+    delay_range delays { 10, 50 };
+    delay_range inter_region_delays { 100, 200 };
+    size_t slots = 20;                       ///< run duration in producer slots
+    uint64_t seed = 1;
+    size_t threads = 1;
+    LinkParams link;                         ///< applied to every link, ideal links by default
+};
+
+/// min / avg / percentiles of a sample, all zero for empty one
+struct DistributionSummary {
+    size_t count = 0;
+    double avg = 0;
+    uint32_t min = 0, p50 = 0, p90 = 0, p99 = 0, max = 0;
+
+    static DistributionSummary make(std::vector<uint32_t> values) {
+        DistributionSummary summary;
+        if (values.empty()) {
+            return summary;
+        }
+        std::sort(values.begin(), values.end());
+        const auto percentile = [&](double p) {
+            return values[std::min<size_t>(values.size() - 1, p * values.size())];
+        };
+        summary.count = values.size();
+        summary.avg = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+        summary.min = values.front();
+        summary.p50 = percentile(0.5);
+        summary.p90 = percentile(0.9);
+        summary.p99 = percentile(0.99);
+        summary.max = values.back();
+        return summary;
+    }
+
+    fc::variant to_variant() const {
+        return fc::mutable_variant_object()
+            ("count", count)("avg", avg)("min", min)("p50", p50)("p90", p90)("p99", p99)("max", max);
+    }
+};
+
+struct BenchmarkReport {
+    BenchmarkConfig config;
+    uint64_t wall_time_ms = 0;
+    DistributionSummary time_to_finality_ms;
+    DistributionSummary rounds_per_finalization;
+    DistributionSummary lib_height;          ///< last irreversible block of every node at the end
+    std::map<std::string, MessageStat> messages;
+
+    void write_json(std::ostream& out) const {
+        fc::mutable_variant_object msgs;
+        for (const auto& item : messages) {
+            msgs(item.first, fc::mutable_variant_object()
+                ("count", item.second.count)("bytes", item.second.bytes)("dropped", item.second.dropped));
+        }
+        const fc::variant report = fc::mutable_variant_object()
+            ("name", config.name)
+            ("nodes", config.nodes)
+            ("topology", config.topology)
+            ("degree", config.degree)
+            ("slots", config.slots)
+            ("seed", config.seed)
+            ("threads", config.threads)
+            ("bytes_per_ms", config.link.bytes_per_ms)
+            ("loss", config.link.loss)
+            ("wall_time_ms", wall_time_ms)
+            ("time_to_finality_ms", time_to_finality_ms.to_variant())
+            ("rounds_per_finalization", rounds_per_finalization.to_variant())
+            ("lib_height", lib_height.to_variant())
+            ("messages", msgs);
+        out << fc::json::to_pretty_string(report) << std::endl;
+    }
+
+    /// Long format: one `benchmark,metric,key,value` row per number.
+    void write_csv(std::ostream& out, bool header = true) const {
+        if (header) {
+            out << "benchmark,metric,key,value" << std::endl;
+        }
+        const auto row = [&](const std::string& metric, const std::string& key, const auto& value) {
+            out << config.name << "," << metric << "," << key << "," << value << std::endl;
+        };
+        row("config", "nodes", config.nodes);
+        row("config", "topology", config.topology);
+        row("config", "seed", config.seed);
+        row("config", "threads", config.threads);
+        row("config", "bytes_per_ms", config.link.bytes_per_ms);
+        row("config", "loss", config.link.loss);
+        row("run", "wall_time_ms", wall_time_ms);
+        const auto summary_rows = [&](const std::string& metric, const DistributionSummary& summary) {
+            row(metric, "count", summary.count);
+            row(metric, "avg", summary.avg);
+            row(metric, "min", summary.min);
+            row(metric, "p50", summary.p50);
+            row(metric, "p90", summary.p90);
+            row(metric, "p99", summary.p99);
+            row(metric, "max", summary.max);
+        };
+        summary_rows("time_to_finality_ms", time_to_finality_ms);
+        summary_rows("rounds_per_finalization", rounds_per_finalization);
+        summary_rows("lib_height", lib_height);
+        for (const auto& item : messages) {
+            row("messages_count", item.first, item.second.count);
+            row("messages_bytes", item.first, item.second.bytes);
+            row("messages_dropped", item.first, item.second.dropped);
+        }
+    }
+};
+
+inline graph_type make_benchmark_graph(const BenchmarkConfig& config) {
+    if (config.topology == "small_world") {
+        return small_world_graph(config.nodes, config.degree, 0.1, config.delays, config.seed);
+    }
+    if (config.topology == "multi_region") {
+        std::vector<size_t> sizes(config.regions, config.nodes / config.regions);
+        sizes.back() += config.nodes % config.regions;
+        return multi_region_graph(sizes, config.degree, 1, config.delays, config.inter_region_delays, config.seed);
+    }
+    if (config.topology == "full") {
+        return full_graph(config.nodes, config.delays, config.seed);
+    }
+    return random_regular_graph(config.nodes, config.degree, config.delays, config.seed);
+}
+
+/// Run `TNode` network described by `config` and collect its metrics.
+template <typename TNode>
+BenchmarkReport run_benchmark(const BenchmarkConfig& config) {
+    auto runner = TestRunner(config.nodes);
+    runner.set_seed(config.seed);
+    runner.set_threads(config.threads);
+    runner.load_graph(make_benchmark_graph(config));
+    runner.enable_stats();
+    if (config.link.bytes_per_ms > 0 || config.link.loss > 0) {
+        runner.set_link_params(config.link);
+    }
+    runner.add_stop_task(config.slots * runner.get_slot_ms());
+
+    const auto start = std::chrono::steady_clock::now();
+    runner.run<TNode>();
+    const auto finish = std::chrono::steady_clock::now();
+
+    BenchmarkReport report;
+    report.config = config;
+    report.wall_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count();
+    const auto& stats = runner.get_stats();
+    report.time_to_finality_ms = DistributionSummary::make(stats->get_finality_times());
+    report.rounds_per_finalization = DistributionSummary::make(stats->get_rounds_per_finalization());
+    report.messages = stats->get_messages();
+    std::vector<uint32_t> lib_heights;
+    for (size_t i = 0; i < runner.get_instances(); i++) {
+        lib_heights.push_back(get_block_height(runner.get_db(i).last_irreversible_block_id()));
+    }
+    report.lib_height = DistributionSummary::make(std::move(lib_heights));
+    return report;
+}
@@ -4,7 +4,9 @@
 #include <memory>
 #include <vector>
 #include <map>
+#include <queue>
 #include <exception>
+#include <unordered_map>
 #include <types.hpp>
 
 using std::vector;
@@ -21,6 +23,24 @@ struct fork_db_node {
     vector<fork_db_node_ptr> adjacent_nodes;
     weak_ptr<fork_db_node> parent;
     public_key_type creator_key;
+    size_t height = 0;                          ///< blocks since genesis
+    size_t child_index = 0;                     ///< position in `adjacent_nodes` of the parent
+    vector<weak_ptr<fork_db_node>> ancestors;   ///< ancestors[k] is 2^k blocks back, while they are alive
+
+    ~fork_db_node() {
+        // children freed iteratively, so that dropping a long chain does not overflow the stack
+        auto pending = std::move(adjacent_nodes);
+        while (!pending.empty()) {
+            auto node = std::move(pending.back());
+            pending.pop_back();
+            if (node.use_count() == 1) {
+                for (auto& child : node->adjacent_nodes) {
+                    pending.push_back(std::move(child));
+                }
+                node->adjacent_nodes.clear();
+            }
+        }
+    }
 
     fork_db_node_ptr get_matching_node(const block_id_type& block_id) {
         auto iterator = find_if(adjacent_nodes.begin(), adjacent_nodes.end(), [&](const auto& node) {
@@ -33,6 +53,8 @@ struct fork_db_node {
 static fork_db_node_ptr deep_copy(fork_db_node_ptr src) {
     fork_db_node_ptr dest(new fork_db_node);
     dest->block_id = src->block_id;
+    dest->height = src->height;
+    dest->child_index = src->child_index;
     dest->adjacent_nodes.resize(src->adjacent_nodes.size());
     for (auto src_iter = src->adjacent_nodes.begin(), dest_iter = dest->adjacent_nodes.begin();
                 src_iter != src->adjacent_nodes.end(); src_iter++, dest_iter++) {
@@ -56,12 +78,17 @@ using fork_db_chain_type_ptr = shared_ptr<fork_db_chain_type>;
 
 struct ForkDbInsertException : public std::exception {};
 
+/// Tree of blocks from the last irreversible one. Blocks are indexed by id and linked to their
+/// ancestors by jump pointers, so lookups, LIB moves and common ancestor queries take O(log n)
+/// and the master head, the first highest block in depth-first order, is updated on insert.
 class fork_db {
 public:
     fork_db() = default;
 
     explicit fork_db(fork_db_node_ptr root_, size_t conf_number_):
-        root(std::move(root_)), conf_number(conf_number_) {}
+        conf_number(conf_number_) {
+        set_root(std::move(root_));
+    }
     explicit fork_db(block_id_type genesys_block, size_t conf_number) {
         set_conf_number(conf_number);
         set_genesys_block(genesys_block);
@@ -71,7 +98,7 @@ public:
     fork_db(fork_db&&) = default;
 
     void set_genesys_block(const block_id_type& genesys_block) {
-        root = std::make_shared<fork_db_node>(fork_db_node{genesys_block});
+        set_root(std::make_shared<fork_db_node>(fork_db_node{genesys_block}));
     }
 
     void set_conf_number(size_t conf_number_) {
@@ -95,7 +122,12 @@ public:
     }
 
     fork_db_node_ptr find(const block_id_type& block_id) const {
-        return find_node(block_id, root);
+        auto it = index.find(block_id);
+        if (it == index.end()) {
+            return nullptr;
+        }
+        auto node = it->second.lock();
+        return node && is_in_tree(node) ? node : nullptr;
     }
 
     block_id_type fetch_prev_block_id(const block_id_type& block_id) const {
@@ -113,7 +145,7 @@ public:
     }
 
     fork_db_node_ptr get_master_head() const {
-        return find_master_head(root, 0).node;
+        return head;
     }
 
     void bft_finalize(const block_id_type& block_id) {
@@ -126,20 +158,74 @@ public:
         return root;
     }
 
+    /// Replace the tree by the one of `root_`, e.g. a copy of the tree of a peer.
     void set_root(fork_db_node_ptr root_) {
-        root = root_;
+        root = std::move(root_);
+        index.clear();
+        std::queue<fork_db_node_ptr> q;
+        q.push(root);
+        while (!q.empty()) {
+            auto node = q.front();
+            q.pop();
+            link(node);
+            for (const auto& adjacent_node : node->adjacent_nodes) {
+                q.push(adjacent_node);
+            }
+        }
+        pruned_index_size = index.size();
+        head = find_master_head(root, 0).node;
+    }
+
+    /// Ancestor of `node` at `height`, the node itself at its own height; null if it is above the root.
+    fork_db_node_ptr get_ancestor(fork_db_node_ptr node, size_t height) const {
+        if (!node || height > node->height) {
+            return nullptr;
+        }
+        while (node && node->height > height) {
+            if (node->ancestors.empty()) {
+                return nullptr;
+            }
+            const auto distance = node->height - height;
+            size_t k = 0;
+            while (k + 1 < node->ancestors.size() && (size_t(2) << k) <= distance) {
+                k++;
+            }
+            node = node->ancestors[k].lock();
+        }
+        return node;
+    }
+
+    /// The highest block both `a` and `b` build on, null if they are not in the same tree.
+    fork_db_node_ptr find_common_ancestor(fork_db_node_ptr a, fork_db_node_ptr b) const {
+        if (!a || !b) {
+            return nullptr;
+        }
+        if (a->height > b->height) {
+            a = get_ancestor(a, b->height);
+        } else {
+            b = get_ancestor(b, a->height);
+        }
+        if (!a || !b) {
+            return nullptr;
+        }
+        if (a == b) {
+            return a;
+        }
+        const auto children = branches(a, b);
+        return children.first ? children.first->parent.lock() : nullptr;
     }
 
 private:
     fork_db_node_ptr root;
+    fork_db_node_ptr head;
     size_t conf_number;
+    std::unordered_map<block_id_type, weak_ptr<fork_db_node>> index;
+    size_t pruned_index_size = 0;
 
     bool try_update_lib(const fork_db_node_ptr& new_chain_head) {
-        auto path_to_chain_head = construct_path(new_chain_head);
-        if (path_to_chain_head.size() > conf_number) {
+        if (new_chain_head->height - root->height > conf_number) {
             // we have new lib
-            auto new_lib = path_to_chain_head[path_to_chain_head.size() - conf_number - 1];
-            set_new_lib(new_lib);
+            set_new_lib(get_ancestor(new_chain_head, new_chain_head->height - conf_number));
             return true;
         }
         return false;
@@ -147,16 +233,70 @@ private:
 
     void set_new_lib(const fork_db_node_ptr& node) {
         root = node;
+        if (!is_in_tree(head)) {
+            head = find_master_head(root, 0).node;
+        }
+        // blocks of the dropped forks are freed with them, their expired entries are erased
+        // once the index doubles, so that pruning costs O(1) per block on average
+        if (index.size() >= 2 * pruned_index_size) {
+            for (auto it = index.begin(); it != index.end();) {
+                auto indexed = it->second.lock();
+                it = indexed && is_in_tree(indexed) ? std::next(it) : index.erase(it);
+            }
+            pruned_index_size = std::max<size_t>(index.size(), 64);
+        }
+    }
+
+    bool is_in_tree(const fork_db_node_ptr& node) const {
+        return node->height >= root->height && get_ancestor(node, root->height) == root;
     }
 
-    vector<fork_db_node_ptr> construct_path(fork_db_node_ptr node) const {
-        vector<fork_db_node_ptr> result;
-        while (node != root) {
-            result.push_back(node);
-            node = node->parent.lock();
+    /// Jump pointers of a new `node` from the ones of its parent; indexes it.
+    void link(const fork_db_node_ptr& node) {
+        node->ancestors.clear();
+        auto ancestor = node->parent.lock();
+        while (ancestor) {
+            node->ancestors.push_back(ancestor);
+            const auto k = node->ancestors.size() - 1;
+            ancestor = k < ancestor->ancestors.size() ? ancestor->ancestors[k].lock() : nullptr;
+        }
+        index[node->block_id] = node;
+    }
+
+    /// Children of the common ancestor of different `a` and `b` at the same height, on their paths.
+    pair<fork_db_node_ptr, fork_db_node_ptr> branches(fork_db_node_ptr a, fork_db_node_ptr b) const {
+        while (true) {
+            auto parent_a = a->parent.lock();
+            auto parent_b = b->parent.lock();
+            if (!parent_a || !parent_b) {
+                return {};
+            }
+            if (parent_a == parent_b) {
+                return {a, b};
+            }
+            // the highest jump that stays below the common ancestor
+            size_t k = std::min(a->ancestors.size(), b->ancestors.size());
+            while (k > 1 && a->ancestors[k - 1].lock() == b->ancestors[k - 1].lock()) {
+                k--;
+            }
+            a = a->ancestors[k - 1].lock();
+            b = b->ancestors[k - 1].lock();
+            if (!a || !b) {
+                return {};
+            }
+        }
+    }
+
+    /// `a` comes before `b` at the same height in depth-first order.
+    bool precedes(const fork_db_node_ptr& a, const fork_db_node_ptr& b) const {
+        const auto children = branches(a, b);
+        return children.first && children.first->child_index < children.second->child_index;
+    }
+
+    void update_head(const fork_db_node_ptr& node) {
+        if (node->height > head->height || (node->height == head->height && node != head && precedes(node, head))) {
+            head = node;
         }
-        std::reverse(result.begin(), result.end());
-        return result;
     }
 
     block_info find_master_head(const fork_db_node_ptr& node, size_t depth) const {
@@ -170,19 +310,6 @@ private:
         return result;
     }
 
-    fork_db_node_ptr find_node(const block_id_type& block_id, const fork_db_node_ptr& node) const {
-        if (block_id == node->block_id) {
-            return node;
-        }
-        for (const auto& adjacent_node : node->adjacent_nodes) {
-            auto result = find_node(block_id, adjacent_node);
-            if (result) {
-                return result;
-            }
-        }
-        return nullptr;
-    }
-
     fork_db_node_ptr insert_blocks(fork_db_node_ptr node, const vector<pair<block_id_type, public_key_type>>& blocks) {
         for (const auto& block : blocks) {
             auto next_node = node->get_matching_node(block.first);
@@ -190,8 +317,12 @@ private:
                 next_node = std::make_shared<fork_db_node>(fork_db_node{block.first,
                                                                         {},
                                                                         node,
-                                                                        block.second});
+                                                                        block.second,
+                                                                        node->height + 1,
+                                                                        node->adjacent_nodes.size()});
                 node->adjacent_nodes.push_back(next_node);
+                link(next_node);
+                update_head(next_node);
             }
             node = next_node;
         }
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+//---------- link model ----------//
+
+/// Capacity of a directed link. Default constructed params describe an ideal link.
+struct LinkParams {
+    double bytes_per_ms = 0;   ///< throughput, 0 means unlimited
+    double loss = 0;           ///< probability that a message is lost
+    uint32_t max_queue_ms = 0; ///< drop messages that would wait longer in the send queue, 0 means unlimited
+};
+
+/// Serializes messages on links with finite throughput (a message waits until previous ones
+/// are transmitted) and randomly drops them. State of a link is owned by its sending node, so
+/// `transmit` may be called from the parallel event loop; every link has its own random generator,
+/// so results depend only on the seed and the order of sends of each node.
+class LinkModel {
+public:
+    LinkModel(size_t nodes, uint64_t seed)
+        : seed(seed)
+        , overrides(nodes)
+        , states(nodes)
+    {}
+
+    void set_default(const LinkParams& params) {
+        default_params = params;
+    }
+
+    void set_params(uint32_t from, uint32_t to, const LinkParams& params) {
+        overrides[from][to] = params;
+        const auto it = states[from].find(to);
+        if (it != states[from].end()) {
+            it->second.params = params;
+        }
+    }
+
+    /// Message of `bytes` is sent at `now`.
+    /// @return time it spends in the queue and on the wire (without propagation delay), none if it's lost
+    boost::optional<uint32_t> transmit(uint32_t from, uint32_t to, uint32_t now, size_t bytes) {
+        auto& link = get_state(from, to);
+        const auto& params = link.params;
+        if (params.loss > 0 && std::uniform_real_distribution<double>(0, 1)(link.gen) < params.loss) {
+            return boost::none;
+        }
+        if (params.bytes_per_ms <= 0) {
+            return 0;
+        }
+        const double start = std::max<double>(now, link.busy_until);
+        if (params.max_queue_ms && start - now > params.max_queue_ms) {
+            return boost::none;
+        }
+        link.busy_until = start + bytes / params.bytes_per_ms;
+        return static_cast<uint32_t>(std::ceil(link.busy_until)) - now;
+    }
+
+private:
+    struct LinkState {
+        LinkParams params;
+        double busy_until = 0; ///< time the last queued message leaves the link
+        std::mt19937_64 gen;
+    };
+
+    LinkState& get_state(uint32_t from, uint32_t to) {
+        auto it = states[from].find(to);
+        if (it == states[from].end()) {
+            LinkState state;
+            const auto params = overrides[from].find(to);
+            state.params = params != overrides[from].end() ? params->second : default_params;
+            state.gen.seed(seed ^ (uint64_t(from) << 32 | to));
+            it = states[from].emplace(to, std::move(state)).first;
+        }
+        return it->second;
+    }
+
+    const uint64_t seed;
+    LinkParams default_params;
+    std::vector<std::unordered_map<uint32_t, LinkParams>> overrides;
+    std::vector<std::unordered_map<uint32_t, LinkState>> states;
+};
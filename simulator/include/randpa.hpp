@@ -6,6 +6,7 @@
 
 #define SYNC_RANDPA //SYNC mode
 #include <eosio/randpa_plugin/randpa.hpp>
+#include <eosio/randpa_plugin/traffic_trace.hpp>
 #include <fc/time.hpp>
 
 #include <mutex>
@@ -15,6 +16,18 @@ using namespace randpa_finality;
 
 using randpa_ptr = std::unique_ptr<randpa>;
 
+namespace randpa_finality {
+
+inline std::string message_type_name(const randpa_net_msg& msg) {
+    return queue_latency_stats::type_name(msg.data.which());
+}
+
+inline size_t message_size(const randpa_net_msg& msg) {
+    return fc::raw::pack_size(msg.data);
+}
+
+} //namespace randpa_finality
+
 //---------- types ----------//
 
 class RandpaNode: public Node {
@@ -87,12 +100,8 @@ public:
         init();
         randpa_impl->start(copy_fork_db());
         auto runner = get_runner();
-        auto from = id;
-        for (uint32_t to = 0; to < runner->get_instances(); to++) {
-            int delay = runner->get_delay_matrix()[from][to];
-            if (from != to && delay != -1) {
-                on_new_peer_event(to);
-            }
+        for (const auto& peer : runner->get_peers(id)) {
+            on_new_peer_event(peer.first);
         }
     }
 
@@ -100,12 +109,35 @@ public:
         return *randpa_impl;
     }
 
+    /// Record messages and events received by randpa the way randpa_plugin does it
+    /// (with simulated time); recording stops on restart.
+    void start_trace(const std::string& path) {
+        trace = std::make_shared<traffic_trace_writer>(path, db.last_irreversible_block_id());
+        const auto trace_time = [this]() -> uint64_t {
+            return uint64_t(get_clock().now()) * 1000;
+        };
+        in_net_ch->subscribe([trace = trace, trace_time](const randpa_net_msg& msg) {
+            trace->append(trace_time(), traced_net_msg { msg.ses_id, msg.data });
+        });
+        ev_ch->subscribe([trace = trace, trace_time](const randpa_event& event) {
+            trace->append(trace_time(), event);
+        });
+    }
+
+    void stop_trace() {
+        if (trace) {
+            trace->flush();
+            trace.reset();
+        }
+    }
+
 private:
     void init_channels() {
         in_net_ch = std::make_shared<net_channel>();
         out_net_ch = std::make_shared<net_channel>();
         ev_ch = std::make_shared<event_channel>();
         finality_ch = std::make_shared<finality_channel>();
+        proof_ch = std::make_shared<proof_channel>();
 
         out_net_ch->subscribe([this](const randpa_net_msg& msg) {
             send<randpa_net_msg>(msg.ses_id, msg);
@@ -114,6 +146,15 @@ private:
         finality_ch->subscribe([this](const block_id_type& id) {
             db.bft_finalize(id);
         });
+
+        proof_ch->subscribe([this](const proof_type& proof) {
+            if (const auto& stats = get_runner()->get_stats()) {
+                if (last_proof_round) {
+                    stats->on_finalization(id, proof.round_num - *last_proof_round);
+                }
+            }
+            last_proof_round = proof.round_num;
+        });
     }
 
     void init_randpa() {
@@ -122,7 +163,9 @@ private:
             .set_event_channel(ev_ch)
             .set_in_net_channel(in_net_ch)
             .set_out_net_channel(out_net_ch)
-            .set_finality_channel(finality_ch);
+            .set_finality_channel(finality_ch)
+            .set_proof_channel(proof_ch)
+            .set_time_source([this]() { return fc::time_point(fc::milliseconds(get_clock().now())); });
         if (type == node_type_t::BP) {
             logger << "[Node] #" << id << ": setting explicit signature provider for BP; "
                 << private_key.get_public_key() << std::endl;
@@ -143,6 +186,9 @@ private:
     net_channel_ptr out_net_ch;
     event_channel_ptr ev_ch;
     finality_channel_ptr finality_ch;
+    proof_channel_ptr proof_ch;
+    fc::optional<uint32_t> last_proof_round;
+    std::shared_ptr<traffic_trace_writer> trace;
 
     randpa_ptr randpa_impl;
 };
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "randpa.hpp"
+
+#include <eosio/randpa_plugin/traffic_trace.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/variant_object.hpp>
+
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <string>
+
+//---------- trace replay ----------//
+
+struct ReplayReport {
+    size_t records = 0;
+    uint64_t trace_time_us = 0;                   ///< time covered by the trace
+    uint64_t wall_time_us = 0;                    ///< time the replay took
+    std::map<std::string, uint64_t> received;     ///< records by randpa message type
+    std::map<std::string, uint64_t> sent;         ///< messages randpa tried to send, by type
+    std::vector<std::pair<uint64_t, uint32_t>> finalized; ///< (trace time, block num) of every finality event
+    size_t proofs = 0;
+
+    void write_json(std::ostream& out) const {
+        fc::mutable_variant_object received_obj, sent_obj;
+        for (const auto& item : received) {
+            received_obj(item.first, item.second);
+        }
+        for (const auto& item : sent) {
+            sent_obj(item.first, item.second);
+        }
+        fc::variants finalized_arr;
+        for (const auto& item : finalized) {
+            finalized_arr.push_back(fc::mutable_variant_object()("trace_time_us", item.first)("block_num", item.second));
+        }
+        const fc::variant report = fc::mutable_variant_object()
+            ("records", records)
+            ("trace_time_us", trace_time_us)
+            ("wall_time_us", wall_time_us)
+            ("received", received_obj)
+            ("sent", sent_obj)
+            ("proofs", proofs)
+            ("finalized", finalized_arr);
+        out << fc::json::to_pretty_string(report) << std::endl;
+    }
+};
+
+/// Feeds a trace recorded by randpa_plugin (or RandpaNode::start_trace) to a full node randpa
+/// connected the same way RandpaNode connects it, as fast as randpa handles the records.
+/// Outgoing messages are counted and dropped, so the result depends on the trace only.
+class TraceReplayer {
+public:
+    explicit TraceReplayer(const std::string& path)
+        : reader(path)
+    {}
+
+    ReplayReport run() {
+        ReplayReport report;
+        auto in_net_ch = std::make_shared<net_channel>();
+        auto out_net_ch = std::make_shared<net_channel>();
+        auto ev_ch = std::make_shared<event_channel>();
+        auto finality_ch = std::make_shared<finality_channel>();
+        auto proof_ch = std::make_shared<proof_channel>();
+
+        uint64_t trace_time = 0;
+        out_net_ch->subscribe([&](const randpa_net_msg& msg) {
+            report.sent[queue_latency_stats::type_name(msg.data.which())]++;
+        });
+        finality_ch->subscribe([&](const block_id_type& id) {
+            report.finalized.emplace_back(trace_time, get_block_num(id));
+        });
+        proof_ch->subscribe([&](const proof_type&) {
+            report.proofs++;
+        });
+
+        randpa impl;
+        impl.set_event_channel(ev_ch)
+            .set_in_net_channel(in_net_ch)
+            .set_out_net_channel(out_net_ch)
+            .set_finality_channel(finality_ch)
+            .set_proof_channel(proof_ch);
+        prefix_tree_ptr tree(new prefix_tree(std::make_unique<tree_node>(tree_node { reader.header().lib })));
+        impl.start(tree);
+
+        const auto start = std::chrono::steady_clock::now();
+        while (auto record = reader.next()) {
+            trace_time = record->time_us;
+            report.records++;
+            const auto& event = record->event;
+            if (event.which() == traffic_trace_event::tag<traced_net_msg>::value) {
+                const auto& msg = event.get<traced_net_msg>();
+                report.received[queue_latency_stats::type_name(msg.data.which())]++;
+                in_net_ch->send(randpa_net_msg { msg.ses_id, msg.data, fc::time_point::now() });
+            } else {
+                const auto& ev = event.get<randpa_event>();
+                report.received[queue_latency_stats::type_name(queue_latency_stats::net_types_count + ev.data.which())]++;
+                ev_ch->send(ev);
+            }
+        }
+        report.wall_time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        report.trace_time_us = trace_time;
+        impl.stop();
+        return report;
+    }
+
+private:
+    traffic_trace_reader reader;
+};
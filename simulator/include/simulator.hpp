@@ -1,7 +1,9 @@
 #pragma once
 
 #include "database.hpp"
+#include "link_model.hpp"
 #include "log.hpp"
+#include "stats.hpp"
 
 #include <fc/bitutil.hpp>
 #include <fc/crypto/sha256.hpp>
@@ -9,16 +11,22 @@
 #include <boost/optional.hpp>
 
 #include <algorithm>
+#include <atomic>
+#include <climits>
 #include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <queue>
 #include <random>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <tuple>
 #include <vector>
 
 //---------- helpers ----------//
@@ -97,9 +105,16 @@ struct Task {
         GENERAL,
     };
     task_type type = GENERAL;
+    uint64_t seq = 0; ///< insertion order; makes execution order of simultaneous tasks deterministic
 
     ///
 
+    using key_type = std::tuple<uint32_t, task_type, uint64_t>;
+
+    key_type key() const {
+        return { at, type, seq };
+    }
+
     std::string type_str() const {
         switch (type) {
         case STOP:         return "STOP";
@@ -114,15 +129,80 @@ struct Task {
     }
 
     bool operator<(const Task& task) const {
-        return at > task.at || (at == task.at && type > task.type);
+        return key() > task.key();
     }
 };
 
 using matrix_type = std::vector<std::vector<int>>;
 
-/// Weighted adjacency matrix.
+/// Weighted adjacency lists: graph[i] holds (j, delay) pairs; links are bidirectional,
+/// so every link may be listed only once.
 using graph_type = std::vector<std::vector<std::pair<int, int>>>;
 
+/// Fixed set of threads running the same job on every `run` call; `run` returns when all are done.
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threads) {
+        for (size_t i = 0; i < threads; i++) {
+            workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        start_cv.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    void run(const std::function<void()>& job) {
+        std::unique_lock<std::mutex> lock(mutex);
+        current_job = &job;
+        running = workers.size();
+        generation++;
+        start_cv.notify_all();
+        finish_cv.wait(lock, [this]() { return running == 0; });
+        current_job = nullptr;
+    }
+
+private:
+    void work() {
+        uint64_t seen_generation = 0;
+        while (true) {
+            const std::function<void()>* job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start_cv.wait(lock, [&]() { return done || generation != seen_generation; });
+                if (done) {
+                    return;
+                }
+                seen_generation = generation;
+                job = current_job;
+            }
+            (*job)();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--running == 0) {
+                    finish_cv.notify_one();
+                }
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start_cv;
+    std::condition_variable finish_cv;
+    const std::function<void()>* current_job = nullptr;
+    size_t running = 0;
+    uint64_t generation = 0;
+    bool done = false;
+};
+
 class Network {
 public:
     Network() = delete;
@@ -237,6 +317,9 @@ public:
 
 class TestRunner {
 public:
+    /// Position of executed task in sequential order: (epoch, task key)
+    using exec_pos_type = std::pair<uint64_t, Task::key_type>;
+
     TestRunner() = default;
     explicit TestRunner(int instances, size_t blocks_per_slot_ = 1)
         : blocks_per_slot{blocks_per_slot_}
@@ -245,21 +328,18 @@ public:
     }
 
     explicit TestRunner(const matrix_type& matrix) {
-        // TODO check that it's square matrix
-        delay_matrix = matrix;
-        count_dist_matrix();
+        init_runner_data(matrix.size());
+        load_matrix(matrix);
     }
 
     void load_graph(const graph_type& graph) {
         for (int i = 0; i < graph.size(); i++) {
             for (const auto& val : graph[i]) {
-                int j = val.first;
-                int delay = val.second;
-                delay_matrix[i][j] = delay_matrix[j][i] = delay;
+                set_link(i, val.first, val.second);
             }
         }
-        assert(delay_matrix.size() == nodetypes.size());
-        count_dist_matrix();
+        assert(links.size() == nodetypes.size());
+        reset_distances();
     }
 
     void load_nodetypes(const node_types_t& tnodes) {
@@ -280,10 +360,10 @@ public:
         while (in >> from >> to >> delay) {
             if (delay != -1) {
                 // assume graph is bidirectional
-                delay_matrix[from][to] = delay_matrix[to][from] = delay;
+                set_link(from, to, delay);
             }
         }
-        count_dist_matrix();
+        reset_distances();
     }
 
     void load_matrix_from_file(const char* filename) {
@@ -292,17 +372,27 @@ public:
         in >> instances;
         init_runner_data(instances);
 
+        matrix_type matrix(instances, vector<int>(instances));
         for (int i = 0; i < instances; i++) {
             for (int j = 0; j < instances; j++) {
-                in >> delay_matrix[i][j];
+                in >> matrix[i][j];
             }
         }
-        count_dist_matrix();
+        load_matrix(matrix);
     }
 
     void load_matrix(const matrix_type& matrix) {
-        delay_matrix = matrix;
-        count_dist_matrix();
+        assert(matrix.size() == links.size());
+        for (uint32_t i = 0; i < matrix.size(); i++) {
+            assert(matrix[i].size() == matrix.size());
+            links[i].clear();
+            for (uint32_t j = 0; j < matrix.size(); j++) {
+                if (i != j && matrix[i][j] != -1) {
+                    links[i].emplace_back(j, matrix[i][j]);
+                }
+            }
+        }
+        reset_distances();
     }
 
     fork_db_chain_type create_block(NodePtr node) {
@@ -310,13 +400,16 @@ public:
         std::stringstream ss;
         ss << "[Node] #" << node->id << " ";
         auto node_id = ss.str();
-        logger << node_id << "Generating block" << " at " << clock.now() << std::endl;
+        logger << node_id << "Generating block" << " at " << get_clock().now() << std::endl;
         logger << node_id << "LIB height: " << get_block_height(db.last_irreversible_block_id()) << std::endl;
         auto head = db.get_master_head();
         auto head_block_height = fc::endian_reverse_u32(head->block_id._hash[0]);
         logger << node_id << "Head block height: " << head_block_height << std::endl;
         logger << node_id << "Building on top of " << head->block_id << std::endl;
-        auto new_block_id = generate_block(head_block_height + 1);
+        auto new_block_id = generate_block(head_block_height + 1, node->id);
+        if (stats) {
+            stats->on_block_created(head_block_height + 1, get_clock().now());
+        }
         logger << node_id << "New block: " << new_block_id << std::endl;
         return {head->block_id, {{new_block_id, node->private_key.get_public_key()}}};
     }
@@ -324,8 +417,7 @@ public:
     vector<int> get_ordering() {
         vector<int> permutation(get_bp_list());
 
-        std::random_device rd;
-        std::mt19937 gen(rd());
+        std::mt19937 gen(seed + schedules_count++);
         std::shuffle(permutation.begin(), permutation.end(), gen);
 
         return permutation;
@@ -365,8 +457,8 @@ public:
     }
 
     void update_delay(uint32_t row, uint32_t col, int delay) {
-        delay_matrix[row][col] = delay_matrix[col][row] = delay;
-        count_dist_matrix();
+        set_link(row, col, delay);
+        reset_distances();
     }
 
     void schedule_producer(uint32_t start_ms, uint32_t producer_id) {
@@ -410,8 +502,9 @@ public:
     void relay_block(NodePtr node, const fork_db_chain_type& chain) {
         uint32_t from = node->id;
         for (uint32_t to = 0; to < get_instances(); to++) {
-            if (from != to && dist_matrix[from][to] != -1) {
-                Task task{from, to, clock.now() + dist_matrix[from][to]};
+            const auto dist = get_dist(from, to);
+            if (from != to && dist != -1) {
+                Task task{from, to, get_clock().now() + dist};
                 task.cb = [chain](NodePtr node) {
                     node->apply_chain(chain);
                 };
@@ -421,20 +514,25 @@ public:
         }
     }
 
-    void schedule_sync(NodePtr node) {
+    void schedule_sync(NodePtr node, uint32_t now, const exec_pos_type& pos = {}) {
+        add_task(make_sync_task(node, now, pos));
+    }
+
+    /// Sync task for `node` scheduled at `now`, right after execution position `pos` (parallel loop only).
+    Task make_sync_task(NodePtr node, uint32_t now, const exec_pos_type& pos) {
         Task task{RUNNER_ID, node->id};
         // syncing with the best peer aka largest master block height
         NodePtr best_peer = node;
-        uint32_t best_peer_master_height = get_block_height(best_peer->db.get_master_block_id());
+        uint32_t best_peer_master_height = get_master_height(node->id, pos);
         for (uint32_t peer = 0; peer < get_instances(); peer++) {
             auto current_peer = nodes[peer];
-            auto current_peer_master_height = get_block_height(current_peer->db.get_master_block_id());
+            auto current_peer_master_height = get_master_height(peer, pos);
             if (current_peer_master_height > best_peer_master_height) {
                 best_peer = current_peer;
                 best_peer_master_height = current_peer_master_height;
             }
         }
-        task.at = clock.now() + dist_matrix[node->id][best_peer->id];
+        task.at = now + get_dist(node->id, best_peer->id);
         task.cb = [=](NodePtr node) {
             logger << "[Node #" << node->id << "] Executing sync " << std::endl;
             const auto& peer_db = best_peer->db;
@@ -458,8 +556,8 @@ public:
             }
         };
         task.type = Task::SYNC;
-        add_task(std::move(task));
-    };
+        return task;
+    }
 
     template <typename TNode>
     void init_nodes(uint32_t count) {
@@ -491,43 +589,185 @@ public:
     void run_loop() {
         logger << "[TaskRunner] Run loop " << std::endl;
         should_stop = false;
+        if (threads > 1 && lookahead > 0 && !logger.enabled()) {
+            run_parallel_loop();
+            return;
+        }
         while (!should_stop) {
             auto task = timeline.top();
             logger << "[TaskRunner] current_time=" << task.at << " schedule_time=" << schedule_time << std::endl;
             timeline.pop();
-            clock.set(task.at);
-            if (task.to == RUNNER_ID) {
-                logger << "[TaskRunner] Executing task for TaskRunner" << std::endl;
-                task.cb(nullptr);
-            } else {
-                logger << "[TaskRunner] Gotta task " << task.type_str() << " for " << task.to << std::endl;
-                auto node = nodes[task.to];
-                if (node->should_sync() && task.type != Task::SYNC) {
-                    logger << "[TaskRunner] Skipping task cause node is not synchronized" << std::endl;
-                } else {
-                    logger << "[TaskRunner] Executing task ..." << std::endl;
-                    task.cb(node);
+            run_task(task);
+        }
+    }
+
+    /// Conservative parallel event loop. Tasks are executed in windows [T, T + lookahead), where
+    /// T is time of the earliest pending task and lookahead is the minimal link delay: nothing sent
+    /// inside the window can arrive before it ends, so tasks of different nodes are independent.
+    /// Runner tasks and syncs (they read state of other nodes) are executed alone, between windows.
+    /// Tasks created in a window get sequence numbers in the order the sequential loop would give them,
+    /// so for the same seed results are identical to `run_loop` with one thread.
+    /// Logger is not thread-safe, so the loop is used only when logging is disabled.
+    void run_parallel_loop() {
+        WorkerPool pool(threads);
+        master_heights.assign(get_instances(), {});
+        for (uint32_t i = 0; i < get_instances(); i++) {
+            master_heights[i].emplace_back(exec_pos_type{}, get_block_height(nodes[i]->db.get_master_block_id()));
+        }
+        track_master_heights = true;
+
+        std::vector<NodeWindow> windows(get_instances());
+        std::vector<uint32_t> active_nodes;
+        while (!should_stop) {
+            const auto& top = timeline.top();
+            if (is_barrier(top)) {
+                auto task = top;
+                timeline.pop();
+                run_task(task);
+                continue;
+            }
+
+            const auto window_start = top.key();
+            const auto window_end = top.at + lookahead;
+            prune_master_heights({ epoch, window_start });
+            while (!timeline.empty() && !is_barrier(timeline.top()) && timeline.top().at < window_end) {
+                auto& window = windows[timeline.top().to];
+                if (window.tasks.empty()) {
+                    active_nodes.push_back(timeline.top().to);
                 }
-                if (node->should_sync()) {
-                    logger << "[TaskRunner] Scheduling sync for node " << node->id << std::endl;
-                    schedule_sync(node);
+                window.tasks.push_back(timeline.top());
+                timeline.pop();
+            }
+
+            std::atomic<size_t> next_node { 0 };
+            const auto job = [&]() {
+                for (size_t i = next_node++; i < active_nodes.size(); i = next_node++) {
+                    run_node_window(windows[active_nodes[i]]);
                 }
+            };
+            if (active_nodes.size() == 1) {
+                job();
+            } else {
+                pool.run(job);
             }
+            merge_windows(windows, active_nodes);
+            active_nodes.clear();
+        }
+        track_master_heights = false;
+    }
+
+    void set_threads(size_t threads_) {
+        threads = std::max<size_t>(threads_, 1);
+    }
+
+    size_t get_threads() const {
+        return threads;
+    }
+
+    void set_seed(uint64_t seed_) {
+        seed = seed_;
+        random_gen.seed(seed_);
+    }
 
-//            this_thread::sleep_for(chrono::milliseconds(1000));
+    /// Generator for random topologies and delays of a scenario, derived from the seed of the runner
+    /// so that runners of concurrent runs do not share the global `rand()` state.
+    std::mt19937_64& get_random_engine() {
+        return random_gen;
+    }
+
+    /// Seeds of runners not given one by `set_seed` follow `seed` in the order they are created,
+    /// so a test run can be reproduced by its first seed; random ones by default.
+    static void set_default_seed(uint64_t seed) {
+        next_default_seed = seed;
+    }
+
+    static uint64_t take_default_seed() {
+        return next_default_seed++;
+    }
+
+    /// Start collecting traffic and finality metrics; should be called after topology is loaded.
+    void enable_stats() {
+        stats = std::make_shared<SimulationStats>(get_instances());
+    }
+
+    const std::shared_ptr<SimulationStats>& get_stats() const {
+        return stats;
+    }
+
+    /// Enable link model with `params` for every link; should be called after topology is loaded
+    /// and the seed is set, before the run. Without it messages are delivered after the link delay only.
+    void set_link_params(const LinkParams& params) {
+        get_link_model().set_default(params);
+    }
+
+    /// Params of directed link `from` -> `to`, overriding the default ones.
+    void set_link_params(uint32_t from, uint32_t to, const LinkParams& params) {
+        get_link_model().set_params(from, to, params);
+    }
+
+    /// Time message spends in the send queue and on the wire, none if it's dropped.
+    boost::optional<uint32_t> transmit(uint32_t from, uint32_t to, size_t bytes) {
+        if (!link_model) {
+            return 0;
         }
+        return link_model->transmit(from, to, get_clock().now(), bytes);
+    }
+
+    uint64_t get_seed() const {
+        return seed;
     }
 
     uint32_t get_instances() const {
-        return delay_matrix.size();
+        return links.size();
+    }
+
+    /// Delay of direct link, -1 if nodes are not connected.
+    int get_delay(uint32_t from, uint32_t to) const {
+        if (from == to) {
+            return 0;
+        }
+        const auto& peers = links[from];
+        auto it = std::lower_bound(peers.begin(), peers.end(), std::make_pair(to, INT_MIN));
+        return it != peers.end() && it->first == to ? it->second : -1;
+    }
+
+    /// Directly connected nodes with link delays, sorted by node id.
+    const std::vector<std::pair<uint32_t, int>>& get_peers(uint32_t node_id) const {
+        return links[node_id];
+    }
+
+    /// Shortest path delay, -1 if there is no path. Distances from a node are computed
+    /// on first request and cached until topology changes; safe to call from parallel loop.
+    int get_dist(uint32_t from, uint32_t to) const {
+        return get_dist_row(from)[to];
     }
 
-    const matrix_type& get_delay_matrix() const {
-        return delay_matrix;
+    /// Dense delay matrix; for small networks and debugging only.
+    matrix_type get_delay_matrix() const {
+        matrix_type matrix(get_instances(), vector<int>(get_instances(), -1));
+        for (uint32_t i = 0; i < get_instances(); i++) {
+            matrix[i][i] = 0;
+            for (const auto& peer : links[i]) {
+                matrix[i][peer.first] = peer.second;
+            }
+        }
+        return matrix;
     }
 
-    const matrix_type& get_dist_matrix() const {
-        return dist_matrix;
+    /// Compute distances from every node with `threads` threads, instead of lazily.
+    void precompute_distances(size_t threads_ = std::thread::hardware_concurrency()) {
+        std::atomic<uint32_t> next { 0 };
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < std::max<size_t>(threads_, 1); i++) {
+            workers.emplace_back([&]() {
+                for (uint32_t from = next++; from < get_instances(); from = next++) {
+                    get_dist_row(from);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
     }
 
     const vector<NodePtr> get_nodes() const {
@@ -543,11 +783,16 @@ public:
     }
 
     const Clock& get_clock() const {
-        return clock;
+        return current_window ? current_window->clock : clock;
     }
 
     void add_task(Task && task) {
-        timeline.push(task);
+        if (current_window) {
+            current_window->created_tasks.push_back(std::move(task));
+            return;
+        }
+        task.seq = next_task_seq++;
+        timeline.push(std::move(task));
     }
 
     size_t bft_threshold() const {
@@ -583,83 +828,313 @@ public:
 
     template<typename TNode>
     NodePtr get_initialized_node(int id, int conf_number) {
-        auto priv_key = get_priv_key();
+        digest_type::encoder enc;
+        fc::raw::pack(enc, seed);
+        fc::raw::pack(enc, id);
+        auto priv_key = private_key_type::regenerate(enc.result());
         auto node = std::make_shared<TNode>(id, nodetypes[id], Network(id, this), fork_db(genesys_block, conf_number), priv_key);
         return node;
     }
 
 private:
-    block_id_type generate_block(uint32_t block_height) {
-        auto block_id = digest_type::hash(fc::crypto::private_key::generate());
+    /// Tasks of a single node executed during one window of the parallel loop.
+    struct NodeWindow {
+        struct Executed {
+            Task::key_type key;
+            std::vector<Task> created_tasks;
+            bool needs_sync = false;
+        };
+
+        std::vector<Task> tasks;
+        std::vector<Executed> executed;
+        std::vector<Task> created_tasks; ///< by the currently executed task
+        Clock clock;
+    };
+
+    block_id_type generate_block(uint32_t block_height, uint32_t producer_id) {
+        digest_type::encoder enc;
+        fc::raw::pack(enc, seed);
+        fc::raw::pack(enc, producer_id);
+        fc::raw::pack(enc, block_height);
+        fc::raw::pack(enc, get_clock().now());
+        auto block_id = enc.result();
         block_id._hash[0] = fc::endian_reverse_u32(block_height);
         return block_id;
     }
 
+    /// Execute task the way sequential loop does; @return true if node needs sync after it
+    bool run_node_task(const NodePtr& node, const Task& task, const exec_pos_type& pos) {
+        logger << "[TaskRunner] Gotta task " << task.type_str() << " for " << task.to << std::endl;
+        if (node->should_sync() && task.type != Task::SYNC) {
+            logger << "[TaskRunner] Skipping task cause node is not synchronized" << std::endl;
+        } else {
+            logger << "[TaskRunner] Executing task ..." << std::endl;
+            task.cb(node);
+        }
+        if (stats) {
+            stats->on_lib(node->id, get_block_height(node->db.last_irreversible_block_id()), task.at);
+        }
+        if (track_master_heights) {
+            const auto height = get_block_height(node->db.get_master_block_id());
+            auto& heights = master_heights[node->id];
+            if (heights.back().second != height) {
+                heights.emplace_back(pos, height);
+            }
+        }
+        return node->should_sync();
+    }
+
+    void run_task(const Task& task) {
+        clock.set(task.at);
+        // Tasks created here may precede this one (e.g. block production starts right at schedule time),
+        // so a new epoch keeps execution positions ordered the same way as in sequential loop.
+        epoch++;
+        if (task.to == RUNNER_ID) {
+            logger << "[TaskRunner] Executing task for TaskRunner" << std::endl;
+            task.cb(nullptr);
+            return;
+        }
+        auto node = nodes[task.to];
+        const exec_pos_type pos { epoch, task.key() };
+        if (run_node_task(node, task, pos)) {
+            logger << "[TaskRunner] Scheduling sync for node " << node->id << std::endl;
+            schedule_sync(node, task.at, pos);
+        }
+    }
+
+    bool is_barrier(const Task& task) const {
+        return task.to == RUNNER_ID || task.type == Task::SYNC;
+    }
+
+    /// Worker side of the parallel loop. Node stops at the first task after which it needs sync:
+    /// the rest of its tasks depend on the sync and go back to the timeline.
+    void run_node_window(NodeWindow& window) {
+        const auto& node = nodes[window.tasks.front().to];
+        current_window = &window;
+        size_t i = 0;
+        for (; i < window.tasks.size(); i++) {
+            const auto& task = window.tasks[i];
+            window.clock.set(task.at);
+            const bool needs_sync = run_node_task(node, task, { epoch, task.key() });
+            window.executed.push_back({ task.key(), std::move(window.created_tasks), needs_sync });
+            window.created_tasks.clear();
+            if (needs_sync) {
+                i++;
+                break;
+            }
+        }
+        window.tasks.erase(window.tasks.begin(), window.tasks.begin() + i);
+        current_window = nullptr;
+    }
+
+    /// Push tasks created in the window into the timeline in the sequential execution order.
+    void merge_windows(std::vector<NodeWindow>& windows, const std::vector<uint32_t>& active_nodes) {
+        std::vector<std::pair<uint32_t, NodeWindow::Executed*>> executed;
+        for (const auto id : active_nodes) {
+            auto& window = windows[id];
+            for (auto& item : window.executed) {
+                executed.emplace_back(id, &item);
+            }
+            for (auto& task : window.tasks) {
+                timeline.push(std::move(task));
+            }
+            window.tasks.clear();
+        }
+        std::sort(executed.begin(), executed.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.second->key < rhs.second->key;
+        });
+        for (auto& item : executed) {
+            for (auto& task : item.second->created_tasks) {
+                add_task(std::move(task));
+            }
+            const auto& node = nodes[item.first];
+            const exec_pos_type pos { epoch, item.second->key };
+            const auto now = std::get<0>(item.second->key);
+            bool needs_sync = item.second->needs_sync;
+            while (needs_sync) {
+                auto sync = make_sync_task(node, now, pos);
+                if (sync.at != now) {
+                    add_task(std::move(sync));
+                    break;
+                }
+                // node syncs with itself: sequential loop executes it right after the current task
+                sync.seq = next_task_seq++;
+                clock.set(now);
+                needs_sync = run_node_task(node, sync, pos);
+            }
+        }
+        for (const auto id : active_nodes) {
+            windows[id].executed.clear();
+        }
+    }
+
+    /// Master block height of node right after execution position `pos`.
+    uint32_t get_master_height(uint32_t node_id, const exec_pos_type& pos) const {
+        if (!track_master_heights) {
+            return get_block_height(nodes[node_id]->db.get_master_block_id());
+        }
+        const auto& heights = master_heights[node_id];
+        auto it = std::upper_bound(heights.begin(), heights.end(), pos, [](const auto& pos, const auto& item) {
+            return pos < item.first;
+        });
+        assert(it != heights.begin());
+        return std::prev(it)->second;
+    }
+
+    /// Keep history needed to answer `get_master_height` for positions not less than `pos`.
+    void prune_master_heights(const exec_pos_type& pos) {
+        for (auto& heights : master_heights) {
+            auto it = std::upper_bound(heights.begin(), heights.end(), pos, [](const auto& pos, const auto& item) {
+                return pos < item.first;
+            });
+            if (it - heights.begin() > 1) {
+                heights.erase(heights.begin(), std::prev(it));
+            }
+        }
+    }
+
     void init_connections() {
         for (uint32_t from = 0; from < get_instances(); from++) {
-            for (uint32_t to = 0; to < get_instances(); to++) {
-                int delay = delay_matrix[from][to];
-                if (from != to && delay != -1) {
-                    add_task(Task{from, to, static_cast<uint32_t>(0),
-                                       [from](NodePtr n){ n->on_new_peer_event(from); }});
-                }
+            for (const auto& peer : links[from]) {
+                add_task(Task{from, peer.first, static_cast<uint32_t>(0),
+                                   [from](NodePtr n){ n->on_new_peer_event(from); }});
             }
         }
     }
 
+    LinkModel& get_link_model() {
+        if (!link_model) {
+            link_model = std::make_unique<LinkModel>(get_instances(), seed);
+        }
+        return *link_model;
+    }
+
     void init_runner_data(int instances) {
         nodetypes.resize(instances, node_type_t::BP);
-        delay_matrix.resize(instances);
+        links.assign(instances, {});
+        link_model.reset();
+        reset_distances();
+    }
 
-        for (int i = 0; i < instances; i++) {
-            delay_matrix[i] = vector<int>(instances, -1);
-            delay_matrix[i][i] = 0;
+    /// Add, change or remove (delay == -1) bidirectional link.
+    void set_link(uint32_t from, uint32_t to, int delay) {
+        if (from == to) {
+            return;
         }
+        const auto set_directed = [](std::vector<std::pair<uint32_t, int>>& peers, uint32_t to, int delay) {
+            auto it = std::lower_bound(peers.begin(), peers.end(), std::make_pair(to, INT_MIN));
+            const bool exists = it != peers.end() && it->first == to;
+            if (delay == -1) {
+                if (exists) {
+                    peers.erase(it);
+                }
+            } else if (exists) {
+                it->second = delay;
+            } else {
+                peers.emplace(it, to, delay);
+            }
+        };
+        set_directed(links[from], to, delay);
+        set_directed(links[to], from, delay);
+    }
+
+    /// Drop cached distances after topology change.
+    void reset_distances() {
+        dist_rows.assign(get_instances(), nullptr);
 
-        dist_matrix = delay_matrix;
+        lookahead = 0;
+        for (const auto& peers : links) {
+            for (const auto& peer : peers) {
+                if (!lookahead || static_cast<uint32_t>(peer.second) < lookahead) {
+                    lookahead = peer.second;
+                }
+            }
+        }
     }
 
-    void count_dist_matrix() {
-        int n = get_instances();
-        dist_matrix = delay_matrix;
+    const std::vector<int>& get_dist_row(uint32_t from) const {
+        auto row = std::atomic_load(&dist_rows[from]);
+        if (!row) {
+            // computation is not guarded: concurrent callers get the same result
+            auto computed = std::make_shared<const std::vector<int>>(dijkstra(from));
+            std::shared_ptr<const std::vector<int>> expected;
+            if (std::atomic_compare_exchange_strong(&dist_rows[from], &expected, computed)) {
+                row = std::move(computed);
+            } else {
+                row = std::move(expected);
+            }
+        }
+        // rows are replaced only by reset_distances, which is never run concurrently with readers
+        return *row;
+    }
 
-        for (int k = 0; k < n; ++k) {
-            for (int i = 0; i < n; ++i) {
-                for (int j = 0; j < n; ++j) {
-                    if (dist_matrix[i][k] != -1 && dist_matrix[k][j] != -1) {
-                        auto new_dist = dist_matrix[i][k] + dist_matrix[k][j];
-                        auto& cur_dist = dist_matrix[i][j];
-                        if (cur_dist == -1) {
-                            cur_dist = new_dist;
-                        } else {
-                            cur_dist = std::min(cur_dist, new_dist);
-                        }
-                    }
+    std::vector<int> dijkstra(uint32_t from) const {
+        std::vector<int> dist(get_instances(), -1);
+        using item_type = std::pair<int, uint32_t>;
+        std::priority_queue<item_type, std::vector<item_type>, std::greater<item_type>> queue;
+        dist[from] = 0;
+        queue.emplace(0, from);
+        while (!queue.empty()) {
+            const auto [d, node] = queue.top();
+            queue.pop();
+            if (d != dist[node]) {
+                continue;
+            }
+            for (const auto& peer : links[node]) {
+                const auto new_dist = d + peer.second;
+                auto& cur_dist = dist[peer.first];
+                if (cur_dist == -1 || new_dist < cur_dist) {
+                    cur_dist = new_dist;
+                    queue.emplace(new_dist, peer.first);
                 }
             }
         }
+        return dist;
     }
 
     node_types_t nodetypes;
     std::vector<NodePtr> nodes;
-    matrix_type delay_matrix;
-    matrix_type dist_matrix;
+    std::vector<std::vector<std::pair<uint32_t, int>>> links;
+    mutable std::vector<std::shared_ptr<const std::vector<int>>> dist_rows;
     std::priority_queue<Task> timeline;
+    uint64_t next_task_seq = 0;
     std::set<public_key_type> active_bp_keys;
     uint32_t schedule_time = DELAY_MS;
     Clock clock;
+
+    uint64_t seed = take_default_seed();
+    std::mt19937_64 random_gen { seed };
+    uint64_t schedules_count = 0;
+    static inline std::atomic<uint64_t> next_default_seed { std::random_device{}() };
+
+    size_t threads = 1;
+    uint32_t lookahead = 0;   ///< minimal link delay; 0 means no safe parallelism
+    bool track_master_heights = false;
+    uint64_t epoch = 0;       ///< number of tasks executed alone (between windows of parallel loop)
+    std::vector<std::vector<std::pair<exec_pos_type, uint32_t>>> master_heights;
+    static inline thread_local NodeWindow* current_window = nullptr;
+    std::shared_ptr<SimulationStats> stats;
+    std::unique_ptr<LinkModel> link_model;
 };
 
 
 template <typename T>
 void Network::send(uint32_t to, const T& msg) {
-    auto matrix = runner->get_delay_matrix();
-    assert(matrix[node_id][to] != -1);
+    const auto delay = runner->get_delay(node_id, to);
+    assert(delay != -1);
+    const auto bytes = message_size(msg);
+    const auto transmit_ms = runner->transmit(node_id, to, bytes);
+    if (const auto& stats = runner->get_stats()) {
+        stats->on_message(node_id, message_type_name(msg), bytes, !transmit_ms);
+    }
+    if (!transmit_ms) {
+        return;
+    }
 
     runner->add_task(Task {
         node_id,
         to,
-        get_runner()->get_clock().now() + matrix[node_id][to],
+        get_runner()->get_clock().now() + *transmit_ms + delay,
         [node_id = node_id, msg = msg](NodePtr n) {
             n->on_receive(node_id, (void*)&msg);
         },
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+//---------- simulation metrics ----------//
+
+/// Name and size of a message for traffic statistics; overload for concrete message types
+/// (found by ADL) to get meaningful reports.
+template <typename T>
+std::string message_type_name(const T&) {
+    return typeid(T).name();
+}
+
+template <typename T>
+size_t message_size(const T&) {
+    return sizeof(T);
+}
+
+struct MessageStat {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    uint64_t dropped = 0; ///< lost or dropped by full send queue, included in count
+};
+
+/// Metrics collected while TestRunner runs. Every node writes only its own slot, so recording
+/// is safe from the parallel event loop; aggregation should be done after the run.
+class SimulationStats {
+public:
+    explicit SimulationStats(size_t nodes)
+        : per_node(nodes)
+    {}
+
+    void on_message(uint32_t from, const std::string& type, size_t bytes, bool dropped = false) {
+        auto& stat = per_node[from].messages[type];
+        stat.count++;
+        stat.bytes += bytes;
+        stat.dropped += dropped;
+    }
+
+    void on_block_created(uint32_t height, uint32_t at) {
+        std::lock_guard<std::mutex> lock(blocks_mutex);
+        created_at.emplace(height, at); // forks: the first block at the height counts
+    }
+
+    /// LIB of node moved to `lib_height` at time `at`: every block up to it is finalized now.
+    void on_lib(uint32_t node, uint32_t lib_height, uint32_t at) {
+        auto& stats = per_node[node];
+        for (auto height = stats.lib_height + 1; height <= lib_height; height++) {
+            std::lock_guard<std::mutex> lock(blocks_mutex);
+            const auto it = created_at.find(height);
+            if (it != created_at.end()) {
+                stats.finality_times.push_back(at - it->second);
+            }
+        }
+        stats.lib_height = std::max(stats.lib_height, lib_height);
+    }
+
+    /// Node gained finality after `rounds` consensus rounds since the previous one.
+    void on_finalization(uint32_t node, uint32_t rounds) {
+        per_node[node].rounds_per_finalization.push_back(rounds);
+    }
+
+    std::map<std::string, MessageStat> get_messages() const {
+        std::map<std::string, MessageStat> result;
+        for (const auto& stats : per_node) {
+            for (const auto& item : stats.messages) {
+                result[item.first].count += item.second.count;
+                result[item.first].bytes += item.second.bytes;
+                result[item.first].dropped += item.second.dropped;
+            }
+        }
+        return result;
+    }
+
+    /// Block creation to finalization delays observed by all nodes, ms.
+    std::vector<uint32_t> get_finality_times() const {
+        std::vector<uint32_t> result;
+        for (const auto& stats : per_node) {
+            result.insert(result.end(), stats.finality_times.begin(), stats.finality_times.end());
+        }
+        return result;
+    }
+
+    std::vector<uint32_t> get_rounds_per_finalization() const {
+        std::vector<uint32_t> result;
+        for (const auto& stats : per_node) {
+            result.insert(result.end(), stats.rounds_per_finalization.begin(), stats.rounds_per_finalization.end());
+        }
+        return result;
+    }
+
+private:
+    struct NodeStats {
+        std::map<std::string, MessageStat> messages;
+        std::vector<uint32_t> finality_times;
+        std::vector<uint32_t> rounds_per_finalization;
+        uint32_t lib_height = 0;
+    };
+
+    std::vector<NodeStats> per_node;
+    std::mutex blocks_mutex;
+    std::unordered_map<uint32_t, uint32_t> created_at; ///< block height -> creation time
+};
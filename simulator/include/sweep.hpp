@@ -0,0 +1,174 @@
+#pragma once
+
+#include "benchmark.hpp"
+
+#include <fc/exception/exception.hpp>
+
+#include <atomic>
+#include <sstream>
+#include <thread>
+
+//---------- multi-seed sweep ----------//
+
+/// Runs of `base` with seeds `base.seed`, `base.seed + 1`, ... A run is failed when it throws,
+/// when some node ends below `min_lib_height` or when its p99 time to finality exceeds `max_finality_ms`.
+struct SweepConfig {
+    BenchmarkConfig base;
+    size_t runs = 16;
+    size_t jobs = std::max<size_t>(std::thread::hardware_concurrency(), 1); ///< runs executed concurrently
+    uint32_t min_lib_height = 1;
+    uint32_t max_finality_ms = 0;            ///< 0 means no bound
+};
+
+/// Command line running the benchmark of `config` alone, to reproduce a failed run.
+inline std::string benchmark_command(const BenchmarkConfig& config) {
+    std::stringstream ss;
+    ss << "simulator --benchmark"
+       << " --name=" << config.name
+       << " --nodes=" << config.nodes
+       << " --topology=" << config.topology
+       << " --degree=" << config.degree
+       << " --regions=" << config.regions
+       << " --min-delay=" << config.delays.min_delay
+       << " --max-delay=" << config.delays.max_delay
+       << " --slots=" << config.slots
+       << " --seed=" << config.seed
+       << " --threads=" << config.threads;
+    if (config.link.bytes_per_ms > 0 || config.link.loss > 0) {
+        ss << " --bandwidth=" << config.link.bytes_per_ms
+           << " --loss=" << config.link.loss
+           << " --max-queue-ms=" << config.link.max_queue_ms;
+    }
+    return ss.str();
+}
+
+struct SweepRun {
+    uint64_t seed = 0;
+    bool passed = false;
+    std::string failure;                     ///< why the run failed, empty if it passed
+    BenchmarkReport report;                  ///< empty if the run threw
+};
+
+struct SweepReport {
+    SweepConfig config;
+    uint64_t wall_time_ms = 0;
+    std::vector<SweepRun> runs;              ///< by seed
+    DistributionSummary finality_p50_ms;     ///< of the runs which did not throw
+    DistributionSummary finality_p99_ms;
+    DistributionSummary min_lib_height;
+
+    size_t failed() const {
+        return std::count_if(runs.begin(), runs.end(), [](const SweepRun& run) { return !run.passed; });
+    }
+
+    void write_json(std::ostream& out) const {
+        fc::variants failures;
+        fc::variants results;
+        for (const auto& run : runs) {
+            if (!run.passed) {
+                auto config = this->config.base;
+                config.seed = run.seed;
+                failures.emplace_back(fc::mutable_variant_object()
+                    ("seed", run.seed)("reason", run.failure)("reproduce", benchmark_command(config)));
+            }
+            results.emplace_back(fc::mutable_variant_object()
+                ("seed", run.seed)
+                ("passed", run.passed)
+                ("wall_time_ms", run.report.wall_time_ms)
+                ("time_to_finality_ms", run.report.time_to_finality_ms.to_variant())
+                ("lib_height", run.report.lib_height.to_variant()));
+        }
+        const fc::variant report = fc::mutable_variant_object()
+            ("name", config.base.name)
+            ("nodes", config.base.nodes)
+            ("topology", config.base.topology)
+            ("slots", config.base.slots)
+            ("first_seed", config.base.seed)
+            ("runs", config.runs)
+            ("jobs", config.jobs)
+            ("wall_time_ms", wall_time_ms)
+            ("failed", failed())
+            ("finality_p50_ms", finality_p50_ms.to_variant())
+            ("finality_p99_ms", finality_p99_ms.to_variant())
+            ("min_lib_height", min_lib_height.to_variant())
+            ("failures", failures)
+            ("results", results);
+        out << fc::json::to_pretty_string(report) << std::endl;
+    }
+
+    /// One row per run.
+    void write_csv(std::ostream& out, bool header = true) const {
+        if (header) {
+            out << "sweep,seed,passed,wall_time_ms,finality_p50_ms,finality_p99_ms,min_lib_height,failure" << std::endl;
+        }
+        for (const auto& run : runs) {
+            out << config.base.name << "," << run.seed << "," << run.passed << ","
+                << run.report.wall_time_ms << "," << run.report.time_to_finality_ms.p50 << ","
+                << run.report.time_to_finality_ms.p99 << "," << run.report.lib_height.min << ","
+                << "\"" << run.failure << "\"" << std::endl;
+        }
+    }
+};
+
+/// Run every seed of `config` with its own `TestRunner`, `config.jobs` of them at a time.
+/// Runs share nothing but the disabled logger, so each result is the same as the one of
+/// `run_benchmark` with the seed of the run, whatever the number of jobs.
+template <typename TNode>
+SweepReport run_sweep(const SweepConfig& config) {
+    SweepReport report;
+    report.config = config;
+    report.runs.resize(config.runs);
+
+    const auto run_one = [&](size_t i) {
+        auto& run = report.runs[i];
+        auto benchmark = config.base;
+        benchmark.seed = run.seed = config.base.seed + i;
+        try {
+            run.report = run_benchmark<TNode>(benchmark);
+        } catch (const fc::exception& e) {
+            run.failure = e.to_string();
+            return;
+        } catch (const std::exception& e) {
+            run.failure = e.what();
+            return;
+        }
+        std::stringstream failure;
+        if (run.report.lib_height.min < config.min_lib_height) {
+            failure << "lib height " << run.report.lib_height.min << " < " << config.min_lib_height;
+        } else if (config.max_finality_ms && run.report.time_to_finality_ms.p99 > config.max_finality_ms) {
+            failure << "p99 time to finality " << run.report.time_to_finality_ms.p99 << " ms > "
+                    << config.max_finality_ms << " ms";
+        }
+        run.failure = failure.str();
+        run.passed = run.failure.empty();
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next_run { 0 };
+    const auto job = [&]() {
+        for (size_t i = next_run++; i < config.runs; i = next_run++) {
+            run_one(i);
+        }
+    };
+    if (config.jobs <= 1 || config.runs <= 1) {
+        job();
+    } else {
+        WorkerPool pool(std::min(config.jobs, config.runs));
+        pool.run(job);
+    }
+    const auto finish = std::chrono::steady_clock::now();
+    report.wall_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count();
+
+    std::vector<uint32_t> p50, p99, lib;
+    for (const auto& run : report.runs) {
+        if (run.report.lib_height.count) {
+            p50.push_back(run.report.time_to_finality_ms.p50);
+            p99.push_back(run.report.time_to_finality_ms.p99);
+            lib.push_back(run.report.lib_height.min);
+        }
+    }
+    report.finality_p50_ms = DistributionSummary::make(std::move(p50));
+    report.finality_p99_ms = DistributionSummary::make(std::move(p99));
+    report.min_lib_height = DistributionSummary::make(std::move(lib));
+    return report;
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "simulator.hpp"
+
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+//---------- topology generators ----------//
+// All generators return graph_type with every link listed once (at the node with the lower id);
+// link delays are uniformly distributed in [min_delay, max_delay].
+
+struct delay_range {
+    int min_delay;
+    int max_delay;
+
+    int operator()(std::mt19937_64& gen) const {
+        return std::uniform_int_distribution<int>(min_delay, max_delay)(gen);
+    }
+};
+
+namespace topology_detail {
+
+inline graph_type to_graph(size_t nodes, const std::set<std::pair<int, int>>& edges,
+                           const delay_range& delays, std::mt19937_64& gen) {
+    graph_type graph(nodes);
+    for (const auto& edge : edges) {
+        graph[edge.first].emplace_back(edge.second, delays(gen));
+    }
+    return graph;
+}
+
+inline std::pair<int, int> make_edge(int a, int b) {
+    return a < b ? std::make_pair(a, b) : std::make_pair(b, a);
+}
+
+} // namespace topology_detail
+
+/// Every node is connected to every other one.
+inline graph_type full_graph(size_t nodes, const delay_range& delays, uint64_t seed) {
+    std::mt19937_64 gen(seed);
+    graph_type graph(nodes);
+    for (size_t i = 0; i < nodes; i++) {
+        for (size_t j = i + 1; j < nodes; j++) {
+            graph[i].emplace_back(j, delays(gen));
+        }
+    }
+    return graph;
+}
+
+/// Random graph where every node has `degree` peers: stubs are paired at random avoiding loops
+/// and parallel links, the whole pairing is restarted if it gets stuck.
+/// `nodes * degree` should be even and `degree < nodes`.
+inline graph_type random_regular_graph(size_t nodes, size_t degree, const delay_range& delays, uint64_t seed) {
+    assert(degree < nodes && nodes * degree % 2 == 0);
+    std::mt19937_64 gen(seed);
+    const size_t max_attempts = 100;
+    while (true) {
+        std::vector<int> stubs;
+        stubs.reserve(nodes * degree);
+        for (size_t i = 0; i < nodes; i++) {
+            stubs.insert(stubs.end(), degree, i);
+        }
+
+        std::set<std::pair<int, int>> edges;
+        while (!stubs.empty()) {
+            std::uniform_int_distribution<size_t> any_stub(0, stubs.size() - 1);
+            size_t attempt = 0;
+            for (; attempt < max_attempts; attempt++) {
+                const auto i = any_stub(gen), j = any_stub(gen);
+                if (stubs[i] == stubs[j] || edges.count(topology_detail::make_edge(stubs[i], stubs[j]))) {
+                    continue;
+                }
+                edges.insert(topology_detail::make_edge(stubs[i], stubs[j]));
+                // remove both stubs, the higher index first
+                for (const auto k : { std::max(i, j), std::min(i, j) }) {
+                    stubs[k] = stubs.back();
+                    stubs.pop_back();
+                }
+                break;
+            }
+            if (attempt == max_attempts) {
+                break;
+            }
+        }
+        if (stubs.empty()) {
+            return topology_detail::to_graph(nodes, edges, delays, gen);
+        }
+    }
+}
+
+/// Watts-Strogatz small-world graph: ring where each node is connected to `neighbours` nearest
+/// nodes (`neighbours / 2` on each side), every link is rewired with probability `rewire`.
+inline graph_type small_world_graph(size_t nodes, size_t neighbours, double rewire,
+                                    const delay_range& delays, uint64_t seed) {
+    assert(neighbours % 2 == 0 && neighbours < nodes);
+    std::mt19937_64 gen(seed);
+    std::uniform_real_distribution<double> coin(0, 1);
+    std::uniform_int_distribution<int> any_node(0, nodes - 1);
+
+    std::set<std::pair<int, int>> edges;
+    for (size_t i = 0; i < nodes; i++) {
+        for (size_t j = 1; j <= neighbours / 2; j++) {
+            edges.insert(topology_detail::make_edge(i, (i + j) % nodes));
+        }
+    }
+    for (size_t i = 0; i < nodes; i++) {
+        for (size_t j = 1; j <= neighbours / 2; j++) {
+            const auto edge = topology_detail::make_edge(i, (i + j) % nodes);
+            if (coin(gen) >= rewire || !edges.count(edge)) {
+                continue;
+            }
+            int target = any_node(gen);
+            if (target == static_cast<int>(i) || edges.count(topology_detail::make_edge(i, target))) {
+                continue;
+            }
+            edges.erase(edge);
+            edges.insert(topology_detail::make_edge(i, target));
+        }
+    }
+    return topology_detail::to_graph(nodes, edges, delays, gen);
+}
+
+/// Nodes split into regions. Inside a region nodes form a ring plus `intra_degree - 2` random
+/// links per node (so about `intra_degree` peers); each node also gets `inter_links` random
+/// peers in other regions, with (usually larger) `inter_delays`.
+inline graph_type multi_region_graph(const std::vector<size_t>& region_sizes, size_t intra_degree, size_t inter_links,
+                                     const delay_range& intra_delays, const delay_range& inter_delays, uint64_t seed) {
+    std::mt19937_64 gen(seed);
+    std::vector<int> region_of;
+    std::vector<std::pair<int, int>> regions; // [first, last)
+    for (size_t r = 0; r < region_sizes.size(); r++) {
+        regions.emplace_back(region_of.size(), region_of.size() + region_sizes[r]);
+        region_of.insert(region_of.end(), region_sizes[r], r);
+    }
+    const size_t nodes = region_of.size();
+
+    std::set<std::pair<int, int>> intra_edges, inter_edges;
+    for (const auto& region : regions) {
+        const int size = region.second - region.first;
+        if (size < 2) {
+            continue;
+        }
+        // ring keeps region connected
+        for (int i = 0; i < size; i++) {
+            intra_edges.insert(topology_detail::make_edge(region.first + i, region.first + (i + 1) % size));
+        }
+        std::uniform_int_distribution<int> in_region(region.first, region.second - 1);
+        for (int node = region.first; node < region.second; node++) {
+            for (size_t k = 2; k < intra_degree; k++) {
+                const int peer = in_region(gen);
+                if (peer != node) {
+                    intra_edges.insert(topology_detail::make_edge(node, peer));
+                }
+            }
+        }
+    }
+    if (regions.size() > 1) {
+        std::uniform_int_distribution<int> any_node(0, nodes - 1);
+        for (size_t node = 0; node < nodes; node++) {
+            for (size_t k = 0; k < inter_links; k++) {
+                int peer = any_node(gen);
+                while (region_of[peer] == region_of[node]) {
+                    peer = any_node(gen);
+                }
+                inter_edges.insert(topology_detail::make_edge(node, peer));
+            }
+        }
+    }
+
+    graph_type graph = topology_detail::to_graph(nodes, intra_edges, intra_delays, gen);
+    for (const auto& edge : inter_edges) {
+        graph[edge.first].emplace_back(edge.second, inter_delays(gen));
+    }
+    return graph;
+}
@@ -1,4 +1,8 @@
 #include "log.hpp"
+#include "benchmark.hpp"
+#include "randpa.hpp"
+#include "replay.hpp"
+#include "sweep.hpp"
 
 #include "eosio/randpa_plugin/randpa_logger.hpp"
 
@@ -7,6 +11,8 @@
 
 #include <gtest/gtest.h>
 
+#include <fstream>
+
 using namespace std;
 
 void init_randpa_logger() {
@@ -16,9 +22,77 @@ void init_randpa_logger() {
     fc::log_config::configure_logging(cfg);
 }
 
+/// Parse `--key=value` benchmark options; unknown ones are left for gtest.
+static bool parse_benchmark_args(int argc, char** argv, BenchmarkConfig& config, std::string& format, std::string& output) {
+    bool is_benchmark = false;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--benchmark") {
+            is_benchmark = true;
+            continue;
+        }
+        const auto eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            continue;
+        }
+        const auto key = arg.substr(2, eq - 2);
+        const auto value = arg.substr(eq + 1);
+        if (key == "name") config.name = value;
+        else if (key == "nodes") config.nodes = std::stoul(value);
+        else if (key == "topology") config.topology = value;
+        else if (key == "degree") config.degree = std::stoul(value);
+        else if (key == "regions") config.regions = std::stoul(value);
+        else if (key == "min-delay") config.delays.min_delay = std::stoi(value);
+        else if (key == "max-delay") config.delays.max_delay = std::stoi(value);
+        else if (key == "slots") config.slots = std::stoul(value);
+        else if (key == "seed") config.seed = std::stoull(value);
+        else if (key == "threads") config.threads = std::stoul(value);
+        else if (key == "bandwidth") config.link.bytes_per_ms = std::stod(value);
+        else if (key == "loss") config.link.loss = std::stod(value);
+        else if (key == "max-queue-ms") config.link.max_queue_ms = std::stoul(value);
+        else if (key == "format") format = value;
+        else if (key == "output") output = value;
+    }
+    return is_benchmark;
+}
+
+/// Parse `--sweep` and its options; the runs themselves are configured by the benchmark ones.
+static bool parse_sweep_args(int argc, char** argv, SweepConfig& config) {
+    bool is_sweep = false;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--sweep") {
+            is_sweep = true;
+            continue;
+        }
+        const auto eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            continue;
+        }
+        const auto key = arg.substr(2, eq - 2);
+        const auto value = arg.substr(eq + 1);
+        if (key == "runs") config.runs = std::stoul(value);
+        else if (key == "jobs") config.jobs = std::max<size_t>(std::stoul(value), 1);
+        else if (key == "min-lib") config.min_lib_height = std::stoul(value);
+        else if (key == "max-finality-ms") config.max_finality_ms = std::stoul(value);
+    }
+    return is_sweep;
+}
+
 int main(int argc, char **argv) {
-    auto seed = time(NULL);
-    std::srand(seed);
+    BenchmarkConfig config;
+    std::string format = "json";
+    std::string output;
+    const bool is_benchmark = parse_benchmark_args(argc, argv, config, format, output);
+
+    // $ simulator --seed=N reruns the gtest scenarios with the random delays of a previous run
+    uint64_t seed = time(NULL);
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]).rfind("--seed=", 0) == 0) {
+            seed = config.seed;
+        }
+    }
+    TestRunner::set_default_seed(seed);
     std::cout << "Random number generator seeded to " << seed << std::endl;
     init_randpa_logger();
 
@@ -39,6 +113,48 @@ int main(int argc, char **argv) {
         fc::logger::get(randpa_finality::randpa_logger_name).set_log_level(fc::log_level::off);
     }
 
+    std::ofstream file;
+    if (!output.empty()) {
+        file.open(output);
+    }
+    std::ostream& out = output.empty() ? std::cout : file;
+
+    // $ simulator --sweep --runs=64 --jobs=8 --nodes=21 --topology=small_world --slots=30 --seed=1 --min-lib=20
+    SweepConfig sweep;
+    if (parse_sweep_args(argc, argv, sweep)) {
+        sweep.base = config;
+        if (logger.enabled()) {
+            sweep.jobs = 1; // logger is not thread-safe
+        }
+        const auto report = run_sweep<RandpaNode>(sweep);
+        if (format == "csv") {
+            report.write_csv(out);
+        } else {
+            report.write_json(out);
+        }
+        return report.failed() ? 1 : 0;
+    }
+
+    // $ simulator --benchmark --nodes=100 --topology=small_world --slots=50 --threads=4 --format=csv --output=run.csv
+    if (is_benchmark) {
+        const auto report = run_benchmark<RandpaNode>(config);
+        if (format == "csv") {
+            report.write_csv(out);
+        } else {
+            report.write_json(out);
+        }
+        return 0;
+    }
+
+    // $ simulator --replay=/path/to/randpa.trace
+    const std::string replay_arg = "--replay=";
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]).rfind(replay_arg, 0) == 0) {
+            TraceReplayer(std::string(argv[i]).substr(replay_arg.size())).run().write_json(std::cout);
+            return 0;
+        }
+    }
+
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
 }
@@ -1,10 +1,16 @@
 // ./scripts/build.sh --build-type Debug && ./build/simulator/simulator --gtest_filter=randpa_finality.three_nodes
 
+#include "benchmark.hpp"
 #include "randpa.hpp"
+#include "replay.hpp"
 #include "simulator.hpp"
+#include "sweep.hpp"
+#include "topology.hpp"
 
 #include <gtest/gtest.h>
 
+#include <boost/filesystem.hpp>
+
 #include <cstdlib>
 #include <ctime>
 #include <iostream>
@@ -64,6 +70,82 @@ TEST(randpa_finality, many_nodes) {
     EXPECT_EQ(get_block_height(runner.get_db(19).last_irreversible_block_id()), 17);
 }
 
+TEST(randpa_finality, parallel_loop_matches_sequential) {
+    const auto run = [](size_t threads) {
+        size_t nodes_amount = 21;
+        auto runner = TestRunner(nodes_amount);
+        vector<pair<int, int>> v0{{1, 20}, {2, 10}, {3, 10}, {4, 30}, {5, 30}};
+        vector<pair<int, int>> v5{{6, 10}, {7, 30}, {8, 20}, {9, 10}, {10, 30}};
+        vector<pair<int, int>> v10{{11, 10}, {12, 10}, {13, 10}, {14, 10}, {15, 30}};
+        vector<pair<int, int>> v15{{16, 10}, {17, 10}, {18, 10}, {19, 10}, {20, 30}};
+        graph_type g(nodes_amount);
+        g[0] = v0;
+        g[5] = v5;
+        g[10] = v10;
+        g[15] = v15;
+        runner.set_seed(42);
+        runner.set_threads(threads);
+        runner.load_graph(g);
+        runner.add_stop_task(18 * runner.get_slot_ms());
+        runner.run<RandpaNode>();
+
+        vector<block_id_type> result;
+        for (size_t i = 0; i < nodes_amount; i++) {
+            result.push_back(runner.get_db(i).last_irreversible_block_id());
+            result.push_back(runner.get_db(i).get_master_block_id());
+        }
+        return result;
+    };
+
+    const auto sequential = run(1);
+    EXPECT_EQ(get_block_height(sequential[0]), 17);
+    EXPECT_EQ(sequential, run(4));
+}
+
+TEST(randpa_finality, sparse_topology_distances) {
+    const size_t nodes_cnt = 300;
+    auto runner = TestRunner(nodes_cnt);
+    runner.load_graph(small_world_graph(nodes_cnt, 6, 0.1, {10, 50}, 1));
+
+    auto expected = runner.get_delay_matrix();
+    for (size_t k = 0; k < nodes_cnt; k++) {
+        for (size_t i = 0; i < nodes_cnt; i++) {
+            for (size_t j = 0; j < nodes_cnt; j++) {
+                if (expected[i][k] != -1 && expected[k][j] != -1
+                    && (expected[i][j] == -1 || expected[i][k] + expected[k][j] < expected[i][j])) {
+                    expected[i][j] = expected[i][k] + expected[k][j];
+                }
+            }
+        }
+    }
+    runner.precompute_distances(4);
+    for (size_t i = 0; i < nodes_cnt; i++) {
+        for (size_t j = 0; j < nodes_cnt; j++) {
+            ASSERT_EQ(runner.get_dist(i, j), expected[i][j]);
+        }
+    }
+
+    runner.update_delay(0, 1, -1);
+    EXPECT_EQ(runner.get_delay(0, 1), -1);
+    EXPECT_GT(runner.get_dist(0, 1), 0);
+}
+
+TEST(randpa_finality, random_regular_topology) {
+    const size_t nodes_cnt = 40;
+    auto runner = TestRunner(nodes_cnt);
+    const auto graph = random_regular_graph(nodes_cnt, 4, {10, 30}, 7);
+    runner.load_graph(graph);
+    for (size_t i = 0; i < nodes_cnt; i++) {
+        EXPECT_EQ(runner.get_peers(i).size(), 4);
+    }
+
+    runner.add_stop_task(5 * runner.get_slot_ms());
+    runner.run<RandpaNode>();
+    for (size_t i = 0; i < nodes_cnt; i++) {
+        EXPECT_GE(get_block_height(runner.get_db(i).last_irreversible_block_id()), 2);
+    }
+}
+
 TEST(randpa_finality, finalize_long_chain) {
     auto runner = TestRunner(3);
     vector<pair<int, int>> v0{{1, 2}};
@@ -85,13 +167,14 @@ TEST(randpa_finality, finalize_long_chain) {
 }
 
 TEST(randpa_finality, random_delays) {
-    auto nodes_cnt = rand() % 9 + 1;
+    std::mt19937_64 gen(TestRunner::take_default_seed());
+    auto nodes_cnt = std::uniform_int_distribution<int>(1, 9)(gen);
     auto runner = TestRunner(nodes_cnt);
 
     auto max_delay = 500 / nodes_cnt;
     auto min_delay = 10;
 
-    auto random = [&](){ return (rand() % (max_delay - min_delay)) + min_delay; };
+    auto random = [&](){ return std::uniform_int_distribution<int>(min_delay, max_delay - 1)(runner.get_random_engine()); };
 
     graph_type g;
     for (auto i = 0; i < nodes_cnt; i++) {
@@ -329,7 +412,7 @@ TEST(randpa_finality, fullnodes_over_round_ring) {
 
     auto max_delay = 40;
     auto min_delay = 10;
-    auto random = [&](){ return (rand() % (max_delay - min_delay)) + min_delay; };
+    auto random = [&](){ return std::uniform_int_distribution<int>(min_delay, max_delay - 1)(runner.get_random_engine()); };
 
     graph_type g(nodes_amount);
     g[0] = {{ 1, 10 }};
@@ -365,7 +448,7 @@ TEST(randpa_finality, fullnodes_over_smash_ring) {
 
     auto max_delay = 40;
     auto min_delay = 10;
-    auto random = [&](){ return (rand() % (max_delay - min_delay)) + min_delay; };
+    auto random = [&](){ return std::uniform_int_distribution<int>(min_delay, max_delay - 1)(runner.get_random_engine()); };
 
     graph_type g;
     vector<pair<int, int>> empty_vector;
@@ -406,7 +489,7 @@ TEST(randpa_finality, bp_over_six_fn) {
 
     auto max_delay = 40;
     auto min_delay = 10;
-    auto random = [&](){ return (rand() % (max_delay - min_delay)) + min_delay; };
+    auto random = [&](){ return std::uniform_int_distribution<int>(min_delay, max_delay - 1)(runner.get_random_engine()); };
 
     graph_type g;
     vector<pair<int, int>> empty_vector;
@@ -439,7 +522,7 @@ TEST(randpa_finality, bp_over_spider_net_fn) {
 
     auto max_delay = 40;
     auto min_delay = 10;
-    auto random = [&](){ return (rand() % (max_delay - min_delay)) + min_delay; };
+    auto random = [&](){ return std::uniform_int_distribution<int>(min_delay, max_delay - 1)(runner.get_random_engine()); };
 
     graph_type g(nodes_amount);
     vector<pair<int, int>> empty_vector;
@@ -470,7 +553,7 @@ TEST(randpa_finality, bp_over_vertical_lines_fn) {
 
     auto max_delay = 40;
     auto min_delay = 10;
-    auto random = [&](){ return (rand() % (max_delay - min_delay)) + min_delay; };
+    auto random = [&](){ return std::uniform_int_distribution<int>(min_delay, max_delay - 1)(runner.get_random_engine()); };
 
     graph_type g;
     vector<pair<int, int>> empty_vector;
@@ -513,7 +596,7 @@ TEST(randpa_finality, bp_over_horizontal_lines_fn) {
 
     auto max_delay = 40;
     auto min_delay = 10;
-    auto random = [&](){ return (rand() % (max_delay - min_delay)) + min_delay; };
+    auto random = [&](){ return std::uniform_int_distribution<int>(min_delay, max_delay - 1)(runner.get_random_engine()); };
 
     graph_type g;
     vector<pair<int, int>> empty_vector;
@@ -674,3 +757,158 @@ TEST(randpa_finality, large_multisig_BP_only) {
         EXPECT_EQ(get_block_height(runner.get_db(i).last_irreversible_block_id()), 23);
     }
 }
+
+TEST(randpa_finality, benchmark_report) {
+    BenchmarkConfig config;
+    config.nodes = 8;
+    config.degree = 3;
+    config.slots = 15;
+
+    const auto report = run_benchmark<RandpaNode>(config);
+
+    EXPECT_GT(report.time_to_finality_ms.count, 0);
+    EXPECT_LE(report.time_to_finality_ms.min, report.time_to_finality_ms.p50);
+    EXPECT_LE(report.time_to_finality_ms.p99, report.time_to_finality_ms.max);
+    EXPECT_GT(report.rounds_per_finalization.count, 0);
+    EXPECT_GT(report.messages.count("prevote"), 0);
+    EXPECT_GT(report.messages.at("prevote").bytes, 0);
+}
+
+TEST(randpa_finality, sweep_matches_single_runs) {
+    SweepConfig config;
+    config.base.nodes = 7;
+    config.base.degree = 3;
+    config.base.slots = 10;
+    config.base.seed = 42;
+    config.runs = 3;
+    config.jobs = 3;
+    config.min_lib_height = 5;
+
+    const auto report = run_sweep<RandpaNode>(config);
+
+    ASSERT_EQ(report.runs.size(), 3);
+    EXPECT_EQ(report.failed(), 0);
+    for (size_t i = 0; i < report.runs.size(); i++) {
+        auto benchmark = config.base;
+        benchmark.seed = config.base.seed + i;
+        const auto single = run_benchmark<RandpaNode>(benchmark);
+        const auto& run = report.runs[i];
+        EXPECT_EQ(run.seed, benchmark.seed);
+        EXPECT_EQ(run.report.time_to_finality_ms.p50, single.time_to_finality_ms.p50);
+        EXPECT_EQ(run.report.time_to_finality_ms.max, single.time_to_finality_ms.max);
+        EXPECT_EQ(run.report.lib_height.min, single.lib_height.min);
+        EXPECT_EQ(run.report.messages.at("prevote").count, single.messages.at("prevote").count);
+    }
+    EXPECT_EQ(report.min_lib_height.count, 3);
+}
+
+TEST(fork_db, head_and_common_ancestor) {
+    const auto id = [](uint32_t n) { return digest_type::hash(n); };
+    fork_db db(id(0), 100);
+    // 0 - 1 - 2 - 3 - 4
+    //       \ 5 - 6 - 7
+    db.insert(fork_db_chain_type { id(0), {{ id(1), {} }, { id(2), {} }, { id(3), {} }, { id(4), {} }} });
+    db.insert(fork_db_chain_type { id(1), {{ id(5), {} }, { id(6), {} }, { id(7), {} }} });
+    // the first of the highest blocks in depth-first order
+    EXPECT_EQ(db.get_master_block_id(), id(4));
+    db.insert(fork_db_chain_type { id(7), {{ id(8), {} }} });
+    EXPECT_EQ(db.get_master_block_id(), id(8));
+
+    EXPECT_EQ(db.find_common_ancestor(db.find(id(4)), db.find(id(8)))->block_id, id(1));
+    EXPECT_EQ(db.find_common_ancestor(db.find(id(2)), db.find(id(3)))->block_id, id(2));
+    EXPECT_EQ(db.get_ancestor(db.find(id(8)), 2)->block_id, id(5));
+
+    // the other fork is dropped with the old LIB
+    db.bft_finalize(id(6));
+    EXPECT_EQ(db.last_irreversible_block_id(), id(6));
+    EXPECT_FALSE(db.find(id(4)));
+    EXPECT_FALSE(db.find(id(1)));
+    EXPECT_EQ(db.get_master_block_id(), id(8));
+}
+
+TEST(link_model, queueing_and_loss) {
+    LinkModel model(3, 1);
+    model.set_default({ 10, 0, 25 });
+    model.set_params(0, 2, { 0, 1, 0 });
+
+    EXPECT_EQ(*model.transmit(0, 1, 0, 100), 10);
+    EXPECT_EQ(*model.transmit(0, 1, 0, 100), 20);
+    EXPECT_EQ(*model.transmit(0, 1, 5, 50), 20);
+    // would wait 25+ ms in the queue
+    EXPECT_FALSE(model.transmit(0, 1, 0, 100));
+    // other direction has its own queue
+    EXPECT_EQ(*model.transmit(1, 0, 0, 100), 10);
+    EXPECT_FALSE(model.transmit(0, 2, 0, 1));
+}
+
+TEST(randpa_finality, slow_lossy_links) {
+    size_t nodes_amount = 8;
+    auto runner = TestRunner(nodes_amount);
+    runner.set_seed(1);
+    runner.load_graph(random_regular_graph(nodes_amount, 3, { 10, 30 }, 1));
+    runner.set_link_params({ 50, 0.05, 0 });
+    runner.add_stop_task(20 * runner.get_slot_ms());
+    runner.run<RandpaNode>();
+
+    for (size_t i = 0; i < nodes_amount; i++) {
+        EXPECT_GT(get_block_height(runner.get_db(i).last_irreversible_block_id()), 1);
+    }
+}
+
+TEST(randpa_finality, adaptive_phases) {
+    const auto run = [](bool adaptive) {
+        size_t nodes_amount = 4;
+        auto runner = TestRunner(nodes_amount);
+        runner.set_seed(1);
+        graph_type g(nodes_amount);
+        g[0] = {{1, 40}, {2, 80}, {3, 120}};
+        g[1] = {{2, 40}, {3, 80}};
+        g[2] = {{3, 40}};
+        runner.load_graph(g);
+        runner.add_stop_task(15 * runner.get_slot_ms());
+        runner.init_nodes<RandpaNode>(runner.get_instances());
+        for (size_t i = 0; i < nodes_amount; i++) {
+            std::dynamic_pointer_cast<RandpaNode>(runner.get_node(i))->get_randpa().set_adaptive_phases(adaptive);
+        }
+        runner.run_initialized_nodes();
+        vector<uint32_t> libs;
+        for (size_t i = 0; i < nodes_amount; i++) {
+            libs.push_back(get_block_height(runner.get_db(i).last_irreversible_block_id()));
+        }
+        return libs;
+    };
+
+    const auto fixed = run(false);
+    const auto adaptive = run(true);
+    for (size_t i = 0; i < fixed.size(); i++) {
+        EXPECT_GE(adaptive[i], fixed[i]);
+        EXPECT_GT(adaptive[i], 1);
+    }
+}
+
+TEST(randpa_finality, replay_recorded_trace) {
+    const auto path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    size_t nodes_amount = 4;
+    auto runner = TestRunner(nodes_amount);
+    runner.set_seed(1);
+    graph_type g(nodes_amount);
+    g[0] = {{1, 10}, {2, 20}, {3, 30}};
+    g[1] = {{2, 10}, {3, 20}};
+    g[2] = {{3, 10}};
+    runner.load_graph(g);
+    runner.add_stop_task(15 * runner.get_slot_ms());
+    runner.init_nodes<RandpaNode>(runner.get_instances());
+    const auto node = std::dynamic_pointer_cast<RandpaNode>(runner.get_node(0));
+    node->start_trace(path);
+    runner.run_initialized_nodes();
+    node->stop_trace();
+
+    const auto report = TraceReplayer(path).run();
+    boost::filesystem::remove(path);
+
+    EXPECT_GT(report.records, 0);
+    EXPECT_GT(report.received.at("prevote"), 0);
+    ASSERT_FALSE(report.finalized.empty());
+    // node's own votes are not in the trace, but 3 of 4 are enough to finalize the same blocks
+    EXPECT_EQ(report.finalized.back().second, get_block_height(runner.get_db(0).last_irreversible_block_id()));
+}
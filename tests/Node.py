@@ -1153,6 +1153,23 @@ class Node(object):
         payload="[ \"%s\", %d, %d ]" % (salt, period, batchSize)
         return self.processCurlCmd("txn_test_gen", "start_generation", payload, silentErrors=silentErrors, exitOnError=exitOnError, exitMsg=exitMsg, returnType=returnType)
 
+    def txnGenStartProfile(self, profile, silentErrors=True, exitOnError=False, exitMsg=None, returnType=ReturnType.json):
+        assert(isinstance(profile, dict))
+        assert(isinstance(returnType, ReturnType))
+
+        payload=json.dumps(profile)
+        return self.processCurlCmd("txn_test_gen", "start_profile", payload, silentErrors=silentErrors, exitOnError=exitOnError, exitMsg=exitMsg, returnType=returnType)
+
+    def txnGenStop(self, silentErrors=True, exitOnError=False, exitMsg=None, returnType=ReturnType.json):
+        assert(isinstance(returnType, ReturnType))
+
+        return self.processCurlCmd("txn_test_gen", "stop_generation", "{}", silentErrors=silentErrors, exitOnError=exitOnError, exitMsg=exitMsg, returnType=returnType)
+
+    def txnGenGetStats(self, silentErrors=True, exitOnError=False, exitMsg=None, returnType=ReturnType.json):
+        assert(isinstance(returnType, ReturnType))
+
+        return self.processCurlCmd("txn_test_gen", "get_stats", "{}", silentErrors=silentErrors, exitOnError=exitOnError, exitMsg=exitMsg, returnType=returnType)
+
     def waitForTransBlockIfNeeded(self, trans, waitForTransBlock, exitOnError=False):
         if not waitForTransBlock:
             return trans
@@ -122,4 +122,30 @@ BOOST_FIXTURE_TEST_CASE( get_block_with_invalid_abi, TESTER ) try {
 
 } FC_LOG_AND_RETHROW() /// get_block_with_invalid_abi
 
+BOOST_FIXTURE_TEST_CASE( get_raw_block_test, TESTER ) try {
+   produce_blocks(10);
+   chain_apis::read_only plugin(*(this->control), fc::microseconds::maximum());
+
+   // irreversible blocks come from the block log, the head block is packed
+   const uint32_t lib = control->last_irreversible_block_num();
+   BOOST_REQUIRE(lib > 2 && lib < control->head_block_num());
+   for (uint32_t num : {lib - 1, control->head_block_num()}) {
+      const auto block = control->fetch_block_by_number(num);
+      const auto expected = fc::raw::pack(*block);
+
+      for (const auto& num_or_id : {std::to_string(num), block->id().str()}) {
+         const auto raw = plugin.get_raw_block({num_or_id});
+         BOOST_REQUIRE(raw);
+         BOOST_REQUIRE(std::vector<char>(raw.data, raw.data + raw.size) == expected);
+      }
+   }
+
+   // ID of another block with the number of a block in the log
+   auto wrong_id = control->fetch_block_by_number(lib - 1)->id();
+   wrong_id._hash[3] ^= 1;
+   BOOST_CHECK_THROW(plugin.get_raw_block({wrong_id.str()}), unknown_block_exception);
+   BOOST_CHECK_THROW(plugin.get_raw_block({std::to_string(control->head_block_num() + 1)}), unknown_block_exception);
+
+} FC_LOG_AND_RETHROW() /// get_raw_block_test
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -22,6 +22,7 @@
 #include <fc/variant_object.hpp>
 #include <fc/io/json.hpp>
 
+#include <algorithm>
 #include <array>
 #include <utility>
 
@@ -315,6 +316,54 @@ BOOST_FIXTURE_TEST_CASE( get_table_test, TESTER ) try {
       BOOST_REQUIRE_EQUAL("7777.0000 CCC", result.rows[0]["balance"].as_string());
    }
 
+   // get table: pages of one row continued with the cursor
+   p.lower_bound = "";
+   p.upper_bound = "";
+   p.limit = 1;
+   for (bool reverse : {false, true}) {
+      p.reverse = reverse;
+      p.cursor = "";
+      std::vector<std::string> balances;
+      do {
+         result = plugin.read_only::get_table_rows(p);
+         BOOST_REQUIRE_EQUAL(1u, result.rows.size());
+         BOOST_REQUIRE_EQUAL(result.more, !result.next_cursor.empty());
+         balances.push_back(result.rows[0]["balance"].as_string());
+         p.cursor = result.next_cursor;
+      } while (result.more);
+      std::vector<std::string> expected = {"9999.0000 AAA", "8888.0000 BBB", "7777.0000 CCC", "10000.0000 " CORE_SYMBOL_NAME};
+      if (reverse) std::reverse(expected.begin(), expected.end());
+      BOOST_REQUIRE(balances == expected);
+   }
+
+   // raw rows are the rows of get_table_rows with json = false
+   p.reverse = false;
+   p.cursor = "";
+   p.limit = 10;
+   p.json = false;
+   p.show_payer = true;
+   auto raw_result = plugin.read_only::get_raw_table_rows(p);
+   result = plugin.read_only::get_table_rows(p);
+   BOOST_REQUIRE_EQUAL(4u, raw_result.rows.size());
+   BOOST_REQUIRE_EQUAL(4u, raw_result.payers.size());
+   BOOST_REQUIRE_EQUAL(false, raw_result.more);
+   for (size_t i = 0; i < raw_result.rows.size(); ++i) {
+      BOOST_REQUIRE(raw_result.rows[i] == result.rows[i]["data"].as<std::vector<char>>());
+      BOOST_REQUIRE_EQUAL(raw_result.payers[i], result.rows[i]["payer"].as<name>());
+   }
+   p.json = true;
+   p.show_payer = false;
+   p.limit = 1;
+
+   // cursor of another direction
+   p.reverse = false;
+   p.cursor = plugin.read_only::get_table_rows(p).next_cursor;
+   p.reverse = true;
+   BOOST_CHECK_THROW(plugin.read_only::get_table_rows(p), chain::contract_table_query_exception);
+   p.cursor = "zz";
+   BOOST_CHECK_THROW(plugin.read_only::get_table_rows(p), chain::contract_table_query_exception);
+   p.cursor = "";
+
 } FC_LOG_AND_RETHROW()
 
 BOOST_FIXTURE_TEST_CASE( get_table_by_seckey_test, TESTER ) try {
@@ -450,6 +499,19 @@ BOOST_FIXTURE_TEST_CASE( get_table_by_seckey_test, TESTER ) try {
       BOOST_REQUIRE_EQUAL("100000", result.rows[0]["high_bid"].as_string());
    }
 
+   // the cursor continues on the secondary index
+   p.reverse = false;
+   p.cursor = result.next_cursor;
+   BOOST_CHECK_THROW(plugin.read_only::get_table_rows(p), chain::contract_table_query_exception);
+   p.cursor = "";
+   result = plugin.read_only::get_table_rows(p);
+   p.cursor = result.next_cursor;
+   result = plugin.read_only::get_table_rows(p);
+   BOOST_REQUIRE_EQUAL(1u, result.rows.size());
+   if (result.rows.size() >= 1) {
+      BOOST_REQUIRE_EQUAL("io", result.rows[0]["newname"].as_string());
+   }
+
 } FC_LOG_AND_RETHROW()
 
 BOOST_AUTO_TEST_SUITE_END()
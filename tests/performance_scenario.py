@@ -0,0 +1,273 @@
+#!/usr/bin/env python3
+
+from testUtils import Utils
+from Cluster import Cluster
+from WalletMgr import WalletMgr
+from Node import BlockType
+from TestHelper import AppArgs
+from TestHelper import TestHelper
+
+import json
+import os
+import subprocess
+import time
+import urllib.request
+
+###############################################################
+# performance_scenario
+#  Reproducible performance run of a local cluster:
+#  1) launches <-p> producer nodes and <--api-nodes> API nodes with the launcher topology <--topology>,
+#     every node exporting telemetry_plugin metrics, API nodes running txn_test_gen_plugin
+#  2) optionally emulates a WAN on <--wan-dev> with tc netem (needs root), as impaired_network.py does
+#  3) drives <--tps> transactions per second from the API nodes, as transfers or as the workload
+#     profile of <--profile> (see plugins/txn_test_gen_plugin/README.md)
+#  4) after <--warmup> seconds, measures for <--duration> seconds: TPS in blocks, inclusion latency,
+#     finality latency, block pipeline times and CPU / RAM of every node
+#  5) writes the report to <--report>, and with <--baseline> fails if a metric regressed by more
+#     than <--tolerance> against the baseline report
+#
+#  $ tests/performance_scenario.py -p 3 --api-nodes 2 --tps 2000 --duration 120 --report rc.json --baseline release.json
+###############################################################
+
+Print=Utils.Print
+errorExit=Utils.errorExit
+
+appArgs=AppArgs()
+appArgs.add(flag="--api-nodes", type=int, help="API nodes generating the load", default=2)
+appArgs.add(flag="--topology", type=str, help="launcher topology of the cluster", default="mesh")
+appArgs.add(flag="--tps", type=int, help="transactions per second generated by all API nodes", default=1000)
+appArgs.add(flag="--profile", type=str, help="txn_test_gen_plugin workload profile (JSON file), transfers if not set", default=None)
+appArgs.add(flag="--warmup", type=int, help="seconds of load before measuring", default=30)
+appArgs.add(flag="--duration", type=int, help="seconds of measured load", default=60)
+appArgs.add(flag="--wan-dev", type=str, help="network device for WAN emulation, none if not set", default=None)
+appArgs.add(flag="--wan-delay-ms", type=int, help="emulated WAN delay", default=50)
+appArgs.add(flag="--wan-jitter-ms", type=int, help="emulated WAN delay jitter", default=10)
+appArgs.add(flag="--wan-loss", type=float, help="emulated WAN packet loss, in percents", default=0.0)
+appArgs.add(flag="--wan-rate", type=str, help="emulated WAN bandwidth, e.g. 100mbit, unlimited if not set", default=None)
+appArgs.add(flag="--telemetry-base-port", type=int, help="telemetry port of node 0, node n uses base + n", default=9100)
+appArgs.add(flag="--report", type=str, help="JSON report of the run", default="performance_report.json")
+appArgs.add(flag="--baseline", type=str, help="JSON report to compare the run with", default=None)
+appArgs.add(flag="--tolerance", type=float, help="allowed relative regression against the baseline", default=0.1)
+args = TestHelper.parse_args({"-p","--prod-count","--dump-error-details","--keep-logs","-v","--leave-running","--clean-run",
+                              "--wallet-port"}, applicationSpecificArgs=appArgs)
+Utils.Debug=args.v
+pnodes=args.p if args.p > 0 else 1
+apiNodes=args.api_nodes if args.api_nodes > 0 else 1
+totalNodes=pnodes+apiNodes
+prodCount=args.prod_count
+dumpErrorDetails=args.dump_error_details
+keepLogs=args.keep_logs
+dontKill=args.leave_running
+killAll=args.clean_run
+
+cluster=Cluster(walletd=True)
+walletMgr=WalletMgr(True, port=args.wallet_port)
+testSuccessful=False
+killEosInstances=not dontKill
+killWallet=not dontKill
+
+# metrics where a higher value is better, the other ones are better lower
+higherIsBetter={"tps"}
+
+def telemetryPort(nodeNum):
+    return args.telemetry_base_port + nodeNum
+
+def scrapeMetrics(nodeNum):
+    """Samples of the prometheus text exposition of a node, by metric name (labels dropped)."""
+    url="http://127.0.0.1:%d/metrics" % (telemetryPort(nodeNum))
+    metrics={}
+    try:
+        text=urllib.request.urlopen(url, timeout=5).read().decode("utf-8")
+    except Exception as ex:
+        Print("WARNING: could not scrape %s: %s" % (url, ex))
+        return metrics
+    for line in text.splitlines():
+        if not line or line.startswith("#"):
+            continue
+        name, _, value=line.rpartition(" ")
+        name=name.split("{")[0]
+        try:
+            metrics[name]=metrics.get(name, 0.0) + float(value)
+        except ValueError:
+            pass
+    return metrics
+
+def histogramMean(before, after, name):
+    count=after.get(name + "_count", 0) - before.get(name + "_count", 0)
+    total=after.get(name + "_sum", 0) - before.get(name + "_sum", 0)
+    return total / count if count > 0 else None
+
+def processUsage(pid):
+    """CPU seconds and resident memory (MiB) of a process, from procfs."""
+    if pid is None:
+        return None
+    try:
+        with open("/proc/%d/stat" % (pid)) as f:
+            fields=f.read().rpartition(")")[2].split()
+        cpu=(int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+        rss=0
+        with open("/proc/%d/status" % (pid)) as f:
+            for line in f:
+                if line.startswith("VmRSS:"):
+                    rss=int(line.split()[1]) / 1024
+        return {"cpu_sec": cpu, "rss_mib": rss}
+    except (OSError, IndexError, ValueError):
+        return None
+
+def setWanEmulation(dev):
+    cmd="tc qdisc add dev %s root netem delay %dms %dms" % (dev, args.wan_delay_ms, args.wan_jitter_ms)
+    if args.wan_loss > 0:
+        cmd+=" loss %.3f%%" % (args.wan_loss)
+    if args.wan_rate is not None:
+        cmd+=" rate %s" % (args.wan_rate)
+    Print("WAN emulation: %s" % (cmd))
+    subprocess.check_call(cmd.split())
+
+def resetWanEmulation(dev):
+    subprocess.call(("tc qdisc del dev %s root" % (dev)).split())
+
+def compareWithBaseline(report, baseline, tolerance):
+    """Names of the summary metrics that regressed by more than tolerance."""
+    regressions=[]
+    for name, value in report["summary"].items():
+        base=baseline.get("summary", {}).get(name)
+        if value is None or base is None or base == 0:
+            continue
+        change=(value - base) / base
+        regressed=change < -tolerance if name in higherIsBetter else change > tolerance
+        Print("%-32s %12.2f baseline %12.2f (%+.1f%%)%s" % (name, value, base, change * 100, " REGRESSED" if regressed else ""))
+        if regressed:
+            regressions.append(name)
+    return regressions
+
+try:
+    TestHelper.printSystemInfo("BEGIN")
+    cluster.setWalletMgr(walletMgr)
+
+    cluster.killall(allInstances=killAll)
+    cluster.cleanup()
+
+    specificExtraNodeArgs={}
+    for nodeNum in range(0, totalNodes):
+        specificExtraNodeArgs[nodeNum]="--plugin eosio::telemetry_plugin --telemetry-endpoint 127.0.0.1:%d" % (telemetryPort(nodeNum))
+    apiNodeNums=list(range(pnodes, totalNodes))
+    for nodeNum in apiNodeNums:
+        # account names only allow digits 1-5
+        specificExtraNodeArgs[nodeNum]+=" --plugin eosio::txn_test_gen_plugin --txn-test-gen-account-prefix perftest%s." % (chr(ord("a") + nodeNum))
+
+    Print("Stand up cluster")
+    if cluster.launch(prodCount=prodCount, onlyBios=False, pnodes=pnodes, totalNodes=totalNodes, totalProducers=pnodes*prodCount,
+                      topo=args.topology, useBiosBootFile=False, specificExtraNodeArgs=specificExtraNodeArgs, loadSystemContract=False) is False:
+        errorExit("Failed to stand up eos cluster.")
+
+    if args.wan_dev is not None:
+        setWanEmulation(args.wan_dev)
+
+    node0=cluster.getNode(0)
+    genNodes=[cluster.getNode(nodeNum) for nodeNum in apiNodeNums]
+
+    Print("Create accounts for generated txns")
+    for genNode in genNodes:
+        genNode.txnGenCreateTestAccounts(cluster.eosioAccount.name, cluster.eosioAccount.activePrivateKey, exitOnError=True)
+    node0.waitForIrreversibleBlock(node0.getBlockNum(BlockType.head), timeout=120)
+
+    Print("Startup txn generation, %d transactions / second" % (args.tps))
+    perNodeTps=max(args.tps // len(genNodes), 1)
+    for genNum, genNode in enumerate(genNodes):
+        if args.profile is not None:
+            with open(args.profile) as f:
+                profile=json.load(f)
+            profile["target_tps"]=perNodeTps
+            status=genNode.txnGenStartProfile(profile, exitOnError=True)
+        else:
+            period=20
+            batch=max(perNodeTps * period // 1000 // 2 * 2, 2)
+            status=genNode.txnGenStart("perf%d" % (genNum), period, batch, exitOnError=True)
+        if status is None or status.get("status") != "success":
+            errorExit("Failed to start generation on %s: %s" % (genNode, status))
+
+    Print("Warm up for %d seconds" % (args.warmup))
+    time.sleep(args.warmup)
+
+    nodes=cluster.getNodes()
+    startMetrics=[scrapeMetrics(nodeNum) for nodeNum in range(0, totalNodes)]
+    startUsage=[processUsage(node.pid) for node in nodes]
+    startBlockNum=node0.getBlockNum(BlockType.head)
+    startTime=time.time()
+
+    Print("Measure for %d seconds" % (args.duration))
+    time.sleep(args.duration)
+
+    elapsed=time.time() - startTime
+    endBlockNum=node0.getBlockNum(BlockType.head)
+    endMetrics=[scrapeMetrics(nodeNum) for nodeNum in range(0, totalNodes)]
+    endUsage=[processUsage(node.pid) for node in nodes]
+    genStats=[genNode.txnGenGetStats() for genNode in genNodes]
+    for genNode in genNodes:
+        genNode.txnGenStop()
+
+    Print("Collect blocks %d to %d" % (startBlockNum + 1, endBlockNum))
+    transactions=0
+    for blockNum in range(startBlockNum + 1, endBlockNum + 1):
+        block=node0.getBlock(blockNum, exitOnError=True)
+        transactions+=len(block["transactions"])
+
+    perNode=[]
+    for nodeNum, node in enumerate(nodes):
+        usage={}
+        if startUsage[nodeNum] is not None and endUsage[nodeNum] is not None:
+            usage={"cpu_percent": 100 * (endUsage[nodeNum]["cpu_sec"] - startUsage[nodeNum]["cpu_sec"]) / elapsed,
+                   "rss_mib": endUsage[nodeNum]["rss_mib"]}
+        perNode.append(dict(usage,
+            node=nodeNum,
+            role="producer" if nodeNum < pnodes else "api",
+            block_receive_us=histogramMean(startMetrics[nodeNum], endMetrics[nodeNum], "pipeline_block_receive_us"),
+            block_apply_us=histogramMean(startMetrics[nodeNum], endMetrics[nodeNum], "pipeline_block_apply_us"),
+            finality_latency_ms=histogramMean(startMetrics[nodeNum], endMetrics[nodeNum], "irreversible_latency")))
+
+    def average(values):
+        values=[v for v in values if v is not None]
+        return sum(values) / len(values) if values else None
+
+    def maxOf(values):
+        values=[v for v in values if v is not None]
+        return max(values) if values else None
+
+    genStats=[s for s in genStats if s is not None]
+    summary={
+        "tps": transactions / elapsed,
+        "inclusion_latency_ms_p50": maxOf([s["latency_ms_p50"] for s in genStats]),
+        "inclusion_latency_ms_p99": maxOf([s["latency_ms_p99"] for s in genStats]),
+        "finality_latency_ms": average([n["finality_latency_ms"] for n in perNode]),
+        "block_apply_us": average([n["block_apply_us"] for n in perNode if n["role"] == "api"]),
+        "producer_cpu_percent": maxOf([n.get("cpu_percent") for n in perNode if n["role"] == "producer"]),
+        "producer_rss_mib": maxOf([n.get("rss_mib") for n in perNode if n["role"] == "producer"]),
+    }
+    report={
+        "scenario": {"producer_nodes": pnodes, "api_nodes": apiNodes, "topology": args.topology, "tps": args.tps,
+                     "profile": args.profile, "duration_sec": args.duration, "wan_dev": args.wan_dev,
+                     "wan_delay_ms": args.wan_delay_ms, "wan_jitter_ms": args.wan_jitter_ms,
+                     "wan_loss": args.wan_loss, "wan_rate": args.wan_rate},
+        "summary": summary,
+        "generators": genStats,
+        "nodes": perNode,
+    }
+    with open(args.report, "w") as f:
+        json.dump(report, f, indent=2)
+    Print("Report written to %s:\n%s" % (args.report, json.dumps(summary, indent=2)))
+
+    if args.baseline is not None:
+        with open(args.baseline) as f:
+            baseline=json.load(f)
+        regressions=compareWithBaseline(report, baseline, args.tolerance)
+        if regressions:
+            errorExit("Regressed against %s: %s" % (args.baseline, ", ".join(regressions)))
+
+    testSuccessful=True
+finally:
+    if args.wan_dev is not None:
+        resetWanEmulation(args.wan_dev)
+    TestHelper.shutdown(cluster, walletMgr, testSuccessful=testSuccessful, killEosInstances=killEosInstances, killWallet=killWallet, keepLogs=keepLogs, cleanRun=killAll, dumpErrorDetails=dumpErrorDetails)
+
+exitCode = 0 if testSuccessful else 1
+exit(exitCode)
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+
+from testUtils import Utils
+from TestHelper import AppArgs
+from TestHelper import TestHelper
+
+import json
+import os
+import shutil
+import signal
+import subprocess
+import time
+
+###############################################################
+# startup_benchmark
+#  Startup time of a node against a fixed snapshot, by phase:
+#  1) starts a node <--runs> times from <--snapshot> in a fresh data directory, with the blocks
+#     of <--blocks-dir> (block log and reversible blocks to replay on top of the snapshot) if set
+#  2) waits for the startup timeline the chain plugin writes (see startup-timeline-file), then stops the node
+#  3) writes the duration of every phase (chain_plugin_initialize, controller_open, fork_db_open,
+#     snapshot_load, irreversible_replay, reversible_replay, ...) of every run to <--report>, with
+#     their mean, min and max
+#  4) with <--baseline>, fails if the mean of a phase regressed by more than <--tolerance>
+#
+#  $ tests/startup_benchmark.py --snapshot snapshot.bin --blocks-dir blocks --runs 5 --report startup.json
+###############################################################
+
+Print=Utils.Print
+errorExit=Utils.errorExit
+
+appArgs=AppArgs()
+appArgs.add(flag="--snapshot", type=str, help="snapshot the node starts from", default=None)
+appArgs.add(flag="--blocks-dir", type=str, help="blocks directory copied to the node before every run, none if not set", default=None)
+appArgs.add(flag="--runs", type=int, help="node restarts measured", default=3)
+appArgs.add(flag="--timeout", type=int, help="seconds a startup may take", default=3600)
+appArgs.add(flag="--nodeos-args", type=str, help="extra arguments of the node, e.g. --chain-state-db-size-mb", default="")
+appArgs.add(flag="--work-dir", type=str, help="directory of the node data and logs", default="startup_benchmark")
+appArgs.add(flag="--report", type=str, help="JSON report of the runs", default="startup_report.json")
+appArgs.add(flag="--baseline", type=str, help="JSON report to compare the runs with", default=None)
+appArgs.add(flag="--tolerance", type=float, help="allowed relative regression of a phase against the baseline", default=0.1)
+args = TestHelper.parse_args({"-v","--keep-logs"}, applicationSpecificArgs=appArgs)
+Utils.Debug=args.v
+
+if args.snapshot is None:
+    errorExit("--snapshot is required")
+if args.runs < 1:
+    errorExit("--runs must be at least 1")
+
+def startNode(runNum):
+    """Node of a run started in a fresh data directory, and the path of its timeline."""
+    dataDir=os.path.join(args.work_dir, "run%d" % (runNum))
+    shutil.rmtree(dataDir, ignore_errors=True)
+    os.makedirs(dataDir)
+    if args.blocks_dir is not None:
+        shutil.copytree(args.blocks_dir, os.path.join(dataDir, "blocks"))
+    timelineFile=os.path.join(dataDir, "startup_timeline.json")
+    cmd=[Utils.ServerPath, "--data-dir", dataDir, "--config-dir", dataDir, "--snapshot", os.path.abspath(args.snapshot),
+         "--startup-timeline-file", os.path.abspath(timelineFile), "--plugin", "eosio::chain_plugin"] + args.nodeos_args.split()
+    Print("Run %d: %s" % (runNum, " ".join(cmd)))
+    with open(os.path.join(dataDir, "stderr.txt"), "w") as err:
+        proc=subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=err)
+    return proc, timelineFile
+
+def waitForTimeline(proc, timelineFile):
+    """Phases written by the node, None if it exited or timed out before writing them."""
+    deadline=time.time() + args.timeout
+    while time.time() < deadline:
+        if os.path.exists(timelineFile):
+            # written in one go once the chain plugin started
+            time.sleep(1)
+            with open(timelineFile) as f:
+                return json.load(f)
+        if proc.poll() is not None:
+            return None
+        time.sleep(0.5)
+    return None
+
+def stopNode(proc):
+    if proc.poll() is None:
+        proc.send_signal(signal.SIGTERM)
+        try:
+            proc.wait(timeout=60)
+        except subprocess.TimeoutExpired:
+            proc.kill()
+            proc.wait()
+
+def compareWithBaseline(report, baseline, tolerance):
+    """Names of the phases whose mean regressed by more than tolerance."""
+    regressions=[]
+    for name, stats in report["summary"].items():
+        base=baseline.get("summary", {}).get(name, {}).get("mean_ms")
+        if base is None or base == 0:
+            continue
+        change=(stats["mean_ms"] - base) / base
+        regressed=change > tolerance
+        Print("%-32s %12.1f ms baseline %12.1f ms (%+.1f%%)%s" % (name, stats["mean_ms"], base, change * 100, " REGRESSED" if regressed else ""))
+        if regressed:
+            regressions.append(name)
+    return regressions
+
+testSuccessful=False
+try:
+    TestHelper.printSystemInfo("BEGIN")
+    os.makedirs(args.work_dir, exist_ok=True)
+
+    runs=[]
+    for runNum in range(0, args.runs):
+        proc, timelineFile=startNode(runNum)
+        try:
+            timeline=waitForTimeline(proc, timelineFile)
+        finally:
+            stopNode(proc)
+        if timeline is None:
+            errorExit("Run %d: node did not report its startup timeline, see %s" % (runNum, os.path.dirname(timelineFile)))
+        phases={p["name"]: p["duration"] / 1000 for p in timeline}
+        Print("Run %d: %s" % (runNum, ", ".join("%s %.1f ms" % (name, ms) for name, ms in phases.items())))
+        runs.append(phases)
+
+    # phases in the order of the first run, then those only later runs went through
+    names=[]
+    for phases in runs:
+        names+=[name for name in phases if name not in names]
+    summary={}
+    for name in names:
+        values=[phases[name] for phases in runs if name in phases]
+        summary[name]={"mean_ms": sum(values) / len(values), "min_ms": min(values), "max_ms": max(values), "runs": len(values)}
+
+    report={
+        "scenario": {"snapshot": args.snapshot, "blocks_dir": args.blocks_dir, "runs": args.runs, "nodeos_args": args.nodeos_args},
+        "summary": summary,
+        "runs": runs,
+    }
+    with open(args.report, "w") as f:
+        json.dump(report, f, indent=2)
+    Print("Report written to %s:\n%s" % (args.report, json.dumps(summary, indent=2)))
+
+    if args.baseline is not None:
+        with open(args.baseline) as f:
+            baseline=json.load(f)
+        regressions=compareWithBaseline(report, baseline, args.tolerance)
+        if regressions:
+            errorExit("Regressed against %s: %s" % (args.baseline, ", ".join(regressions)))
+
+    testSuccessful=True
+finally:
+    if testSuccessful and not args.keep_logs:
+        shutil.rmtree(args.work_dir, ignore_errors=True)
+
+exitCode = 0 if testSuccessful else 1
+exit(exitCode)
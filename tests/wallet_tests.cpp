@@ -179,6 +179,32 @@ BOOST_AUTO_TEST_CASE(wallet_manager_test)
    BOOST_CHECK(find(pks.cbegin(), pks.cend(), pkey1.get_public_key()) != pks.cend());
    BOOST_CHECK(find(pks.cbegin(), pks.cend(), pkey2.get_public_key()) != pks.cend());
 
+   // batches are signed by both wallets, results are in order and the same as single signatures
+   private_key_type pkey3{std::string(key3)};
+   std::vector<wallet_manager::sign_transaction_request> batch;
+   for (uint32_t i = 0; i < 40; ++i) {
+      chain::signed_transaction t;
+      t.ref_block_num = i;
+      flat_set<public_key_type> ks{pkey3.get_public_key()};
+      if (i % 2) ks.emplace(pkey1.get_public_key());
+      batch.emplace_back(t, ks);
+   }
+   const auto signed_batch = wm.sign_transactions(batch, chain_id);
+   BOOST_REQUIRE_EQUAL(batch.size(), signed_batch.size());
+   for (size_t i = 0; i < batch.size(); ++i) {
+      BOOST_CHECK_EQUAL(signed_batch[i].ref_block_num, uint16_t(i));
+      BOOST_CHECK(signed_batch[i].signatures == wm.sign_transaction(batch[i].first, batch[i].second, chain_id).signatures);
+   }
+   std::vector<wallet_api::sign_request> digests;
+   for (uint32_t i = 0; i < 20; ++i)
+      digests.emplace_back(fc::sha256::hash(std::to_string(i)), i % 2 ? pkey2.get_public_key() : pkey3.get_public_key());
+   const auto sigs = wm.sign_digests(digests);
+   BOOST_REQUIRE_EQUAL(digests.size(), sigs.size());
+   for (size_t i = 0; i < digests.size(); ++i)
+      BOOST_CHECK(sigs[i] == wm.sign_digest(digests[i].first, digests[i].second));
+   digests.emplace_back(fc::sha256::hash(std::string("missing")), private_key_type::generate().get_public_key());
+   BOOST_CHECK_THROW(wm.sign_digests(digests), chain::wallet_missing_pub_key_exception);
+
    BOOST_CHECK_EQUAL(3u, wm.get_public_keys().size());
    wm.set_timeout(chrono::seconds(0));
    BOOST_CHECK_THROW(wm.get_public_keys(), wallet_locked_exception);
@@ -331,6 +331,10 @@ def stepSetSystemContract():
     retry(args.cleos + 'push action eosio activate \'["1a99a59d87e06e09ec5b028a9cbb7749b4a5ad8819004365d02dc4379a8b7241"]\' -p eosio')
     # RAM_RESTRICTIONS
     retry(args.cleos + 'push action eosio activate \'["4e7bf348da00a945489b2a681749eb56f5de00b900014e137ddae39f48f69d67"]\' -p eosio')
+    # RSA_VERIFY_BATCH
+    retry(args.cleos + 'push action eosio activate \'["d3d5541cdfc924d4a6b00c955f0dfb0a95eccd02d23c4f722da559bf6deaa443"]\' -p eosio')
+    # SECONDARY_INDEX_BATCH
+    retry(args.cleos + 'push action eosio activate \'["9a27b53c4310ccab0a2538734196ab302943fef48855f53132f04820c797892e"]\' -p eosio')
     run(args.cleos + 'push action eosio setpriv' + jsonArg(['eosio.msig', 1]) + '-p eosio@active')
 
 def stepInitSystemContract():
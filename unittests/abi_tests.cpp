@@ -55,6 +55,7 @@ void verify_round_trip_conversion( const abi_serializer& abis, const type_name&
    BOOST_REQUIRE_EQUAL(fc::to_hex(bytes), hex);
    auto var2 = abis.binary_to_variant(type, bytes, max_serialization_time);
    BOOST_REQUIRE_EQUAL(fc::json::to_string(var2, fc::time_point::now() + max_serialization_time), expected_json);
+   BOOST_REQUIRE_EQUAL(abis.binary_to_json(type, bytes, max_serialization_time), expected_json);
    auto bytes2 = abis.variant_to_binary(type, var2, max_serialization_time);
    BOOST_REQUIRE_EQUAL(fc::to_hex(bytes2), hex);
 }
@@ -2534,6 +2535,30 @@ BOOST_AUTO_TEST_CASE(abi_serialize_json_empty_name)
    } FC_LOG_AND_RETHROW()
 }
 
+BOOST_AUTO_TEST_CASE(abi_name_array)
+{
+   auto abi = R"({
+      "version": "eosio::abi/1.0",
+      "structs": [
+         {"name": "s1", "base": "", "fields": [
+            {"name": "names", "type": "name[]"},
+         ]}
+      ],
+   })";
+
+   try {
+      abi_serializer abis( fc::json::from_string(abi).as<abi_def>(), max_serialization_time );
+
+      verify_round_trip_conversion(abis, "s1", R"({"names":[]})", "00");
+      verify_round_trip_conversion(abis, "s1", R"({"names":["alice","","eosio.token"]})",
+                                   "030000000000855c340000000000000000" "00a6823403ea3055");
+
+      // two names announced, one in the data
+      BOOST_CHECK_THROW( abis.binary_to_variant("s1", fc::variant("020000000000855c34").as<bytes>(), max_serialization_time), unpack_exception );
+
+   } FC_LOG_AND_RETHROW()
+}
+
 BOOST_AUTO_TEST_CASE(abi_serialize_detailed_error_messages)
 {
    using eosio::testing::fc_exception_message_is;
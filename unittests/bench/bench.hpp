@@ -0,0 +1,65 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <fc/time.hpp>
+#include <fc/variant_object.hpp>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace eosio { namespace bench {
+
+   /// set from the arguments after `--`: --warmup <n> --repetitions <n> --json <path> --corpus <dir>
+   struct options {
+      uint32_t    warmup      = 2;
+      uint32_t    repetitions = 10;
+      std::string json_path;  ///< results are printed to stdout if empty
+      std::string corpus_dir; ///< more contracts for the WASM benchmarks, `<name>.wasm` files
+   };
+
+   options& get_options();
+
+   /// samples of one benchmark, in microseconds per operation unless `unit` says otherwise
+   struct result {
+      std::string          name;
+      uint64_t             ops_per_sample = 1;
+      std::vector<double>  samples;
+      std::string          unit = "us/op";
+
+      /// min, max, mean, stddev, p50, p90, p99 and operations per second
+      fc::variant_object summary()const;
+   };
+
+   void record( result&& r );
+
+   /// writes the recorded results as JSON, called when the process exits
+   void write_results();
+
+   /**
+    * Calls `sample` warmup times, then repetitions times recording the time it returns.
+    * Each call performs `ops_per_sample` operations and returns only the time they took, its setup is not measured.
+    */
+   template<typename F>
+   void run( const std::string& name, uint64_t ops_per_sample, F&& sample ) {
+      const auto& opts = get_options();
+      for( uint32_t i = 0; i < opts.warmup; ++i )
+         sample();
+
+      result r{ name, ops_per_sample, {} };
+      r.samples.reserve( opts.repetitions );
+      for( uint32_t i = 0; i < opts.repetitions; ++i ) {
+         const fc::microseconds elapsed = sample();
+         r.samples.push_back( double( elapsed.count() ) / ops_per_sample );
+      }
+      record( std::move( r ) );
+   }
+
+   inline fc::microseconds since( fc::time_point start ) {
+      return fc::time_point::now() - start;
+   }
+
+} } // namespace eosio::bench
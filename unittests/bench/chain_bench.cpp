@@ -0,0 +1,484 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include "bench.hpp"
+#include "fork_test_utilities.hpp"
+
+#include <eosio/chain/snapshot.hpp>
+#include <eosio/chain/table_scan.hpp>
+#include <eosio/testing/tester.hpp>
+
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <contracts.hpp>
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+
+using namespace eosio;
+using namespace eosio::chain;
+using namespace eosio::testing;
+using mvo = fc::mutable_variant_object;
+
+namespace {
+
+   // sends the action it receives back to its receiver with the depth in its data decreased, until it is 0
+   const char* inline_chain_wast = R"=====(
+(module
+ (import "env" "read_action_data" (func $read_action_data (param i32 i32) (result i32)))
+ (import "env" "send_inline" (func $send_inline (param i32 i32)))
+ (table 0 anyfunc)
+ (memory $0 1)
+ (export "apply" (func $apply))
+ (func $apply (param $receiver i64) (param $account i64) (param $action i64)
+  (local $depth i32)
+  (drop (call $read_action_data (i32.const 64) (i32.const 4)))
+  (set_local $depth (i32.load (i32.const 64)))
+  (if (i32.eqz (get_local $depth)) (return))
+  (i64.store (i32.const 0) (get_local $receiver))
+  (i64.store (i32.const 8) (get_local $action))
+  (i32.store8 (i32.const 16) (i32.const 0))
+  (i32.store8 (i32.const 17) (i32.const 4))
+  (i32.store (i32.const 18) (i32.sub (get_local $depth) (i32.const 1)))
+  (call $send_inline (i32.const 0) (i32.const 22))
+ )
+)
+)=====";
+
+   /// billed to every transaction, so that a block holds a few thousand of them
+   constexpr uint32_t billed_cpu_time_us = 100;
+
+   /// transactions pushed per sample
+   constexpr uint32_t trxs_per_sample = 200;
+
+   /// a tester started from a snapshot, in its own directories
+   class snapshot_tester : public base_tester {
+   public:
+      snapshot_tester( controller::config config, const snapshot_reader_ptr& snapshot, uint32_t ordinal ) {
+         config.blocks_dir = config.blocks_dir.parent_path() / std::to_string(ordinal).append(config.blocks_dir.filename().generic_string());
+         config.state_dir  = config.state_dir.parent_path() / std::to_string(ordinal).append(config.state_dir.filename().generic_string());
+         init( config, snapshot );
+      }
+
+      signed_block_ptr produce_block( fc::microseconds skip_time = fc::milliseconds(config::block_interval_ms) )override {
+         return _produce_block( skip_time, false );
+      }
+
+      signed_block_ptr produce_empty_block( fc::microseconds skip_time = fc::milliseconds(config::block_interval_ms) )override {
+         control->abort_block();
+         return _produce_block( skip_time, true );
+      }
+
+      signed_block_ptr finish_block()override {
+         return _finish_block();
+      }
+   };
+
+   vector<account_name> make_accounts( const std::string& prefix, uint32_t count ) {
+      vector<account_name> names;
+      names.reserve( count );
+      // account names only have the letters 1-5 and a-z
+      static const char* chars = "abcdefghijklmnopqrstuvwxyz";
+      for( uint32_t i = 0; i < count; ++i ) {
+         names.emplace_back( prefix + chars[i / 26 % 26] + chars[i % 26] );
+      }
+      return names;
+   }
+
+   void setup_token( base_tester& chain, const vector<account_name>& holders ) {
+      chain.create_accounts( { N(eosio.token) } );
+      chain.create_accounts( holders );
+      chain.set_code( N(eosio.token), contracts::eosio_token_wasm() );
+      chain.set_abi( N(eosio.token), contracts::eosio_token_abi().data() );
+      chain.produce_block();
+
+      chain.push_action( N(eosio.token), N(create), N(eosio.token), mvo()
+         ( "issuer", "eosio.token" )
+         ( "maximum_supply", "1000000000.0000 TKN" )
+      );
+      chain.push_action( N(eosio.token), N(issue), N(eosio.token), mvo()
+         ( "to", "eosio.token" )
+         ( "quantity", "1000000000.0000 TKN" )
+         ( "memo", "" )
+      );
+      for( const auto& h : holders ) {
+         chain.push_action( N(eosio.token), N(transfer), N(eosio.token), mvo()
+            ( "from", "eosio.token" )
+            ( "to", h )
+            ( "quantity", "1000000.0000 TKN" )
+            ( "memo", "" )
+         );
+      }
+      chain.produce_block();
+   }
+
+   signed_transaction make_trx( base_tester& chain, action&& act, account_name signer ) {
+      signed_transaction trx;
+      trx.actions.emplace_back( std::move( act ) );
+      chain.set_transaction_headers( trx );
+      trx.sign( chain.get_private_key( signer, "active" ), chain.control->get_chain_id() );
+      return trx;
+   }
+
+   /// `count` transfers between `holders`, unique through their memo
+   vector<signed_transaction> make_transfers( base_tester& chain, const vector<account_name>& holders, uint32_t count ) {
+      static uint64_t nonce = 0;
+      vector<signed_transaction> trxs;
+      trxs.reserve( count );
+      for( uint32_t i = 0; i < count; ++i, ++nonce ) {
+         const auto from = holders[nonce % holders.size()];
+         const auto to   = holders[(nonce + 1) % holders.size()];
+         trxs.emplace_back( make_trx( chain, chain.get_action( N(eosio.token), N(transfer), { { from, config::active_name } }, mvo()
+            ( "from", from )
+            ( "to", to )
+            ( "quantity", "0.0001 TKN" )
+            ( "memo", std::to_string( nonce ) )
+         ), from ) );
+      }
+      return trxs;
+   }
+
+   fc::microseconds push_all( base_tester& chain, vector<signed_transaction>& trxs ) {
+      const auto start = fc::time_point::now();
+      for( auto& trx : trxs )
+         chain.push_transaction( trx, fc::time_point::maximum(), billed_cpu_time_us );
+      return bench::since( start );
+   }
+
+}
+
+namespace {
+   /// name::to_string() before it was table driven, the baseline of name_to_string
+   string legacy_name_to_string( uint64_t value ) {
+      static const char* charmap = ".12345abcdefghijklmnopqrstuvwxyz";
+      string str( 13, '.' );
+      uint64_t tmp = value;
+      for( uint32_t i = 0; i <= 12; ++i ) {
+         str[12 - i] = charmap[tmp & (i == 0 ? 0x0f : 0x1f)];
+         tmp >>= (i == 0 ? 4 : 5);
+      }
+      boost::algorithm::trim_right_if( str, []( char c ) { return c == '.'; } );
+      return str;
+   }
+}
+
+BOOST_AUTO_TEST_SUITE(chain_bench)
+
+BOOST_AUTO_TEST_CASE(token_transfer) try {
+   tester chain;
+   const auto holders = make_accounts( "holder", 100 );
+   setup_token( chain, holders );
+
+   bench::run( "token_transfer", trxs_per_sample, [&]() {
+      auto trxs = make_transfers( chain, holders, trxs_per_sample );
+      const auto elapsed = push_all( chain, trxs );
+      chain.produce_block();
+      return elapsed;
+   } );
+} FC_LOG_AND_RETHROW()
+
+// there is no game contract in the tree: a bet is a read-modify-write of a contract row, as snapshot_test::increment
+BOOST_AUTO_TEST_CASE(table_update) try {
+   tester chain;
+   chain.create_accounts( { N(snapshot) } );
+   chain.set_code( N(snapshot), contracts::snapshot_test_wasm() );
+   chain.set_abi( N(snapshot), contracts::snapshot_test_abi().data() );
+   chain.produce_block();
+
+   uint32_t value = 0;
+   bench::run( "table_update", trxs_per_sample, [&]() {
+      vector<signed_transaction> trxs;
+      for( uint32_t i = 0; i < trxs_per_sample; ++i ) {
+         trxs.emplace_back( make_trx( chain, chain.get_action( N(snapshot), N(increment), { { N(snapshot), config::active_name } }, mvo()
+            ( "value", ++value )
+         ), N(snapshot) ) );
+      }
+      const auto elapsed = push_all( chain, trxs );
+      chain.produce_block();
+      return elapsed;
+   } );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(undo_session) try {
+   constexpr uint32_t count = 10000;
+   tester chain;
+   auto& db = chain.control->mutable_db();
+
+   // what every transaction pays for its session, on top of the block one opened by the tester
+   bench::run( "undo_session_squash", count, [&]() {
+      const auto start = fc::time_point::now();
+      for( uint32_t i = 0; i < count; ++i )
+         db.start_undo_session( true ).squash();
+      return bench::since( start );
+   } );
+   bench::run( "undo_session_undo", count, [&]() {
+      const auto start = fc::time_point::now();
+      for( uint32_t i = 0; i < count; ++i )
+         db.start_undo_session( true ).undo();
+      return bench::since( start );
+   } );
+
+   // rejected before their first write, they open no session
+   bench::run( "expired_trx_rejection", trxs_per_sample, [&]() {
+      vector<signed_transaction> trxs;
+      for( uint32_t i = 0; i < trxs_per_sample; ++i ) {
+         signed_transaction trx;
+         trx.actions.emplace_back( vector<permission_level>{ { config::system_account_name, config::active_name } },
+                                   newaccount{ config::system_account_name, N(expired), authority(), authority() } );
+         chain.set_transaction_headers( trx );
+         trx.expiration = chain.control->head_block_time() - fc::seconds( i + 1 );
+         trx.sign( chain.get_private_key( config::system_account_name, "active" ), chain.control->get_chain_id() );
+         trxs.emplace_back( std::move( trx ) );
+      }
+      const auto start = fc::time_point::now();
+      for( auto& trx : trxs ) {
+         try {
+            chain.push_transaction( trx, fc::time_point::maximum(), billed_cpu_time_us );
+         } catch( const expired_tx_exception& ) {}
+      }
+      return bench::since( start );
+   } );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(inline_chain) try {
+   tester chain;
+   chain.create_accounts( { N(inlinechain) } );
+   chain.set_code( N(inlinechain), inline_chain_wast );
+   chain.produce_block();
+
+   // the whole chain is an action nested max_inline_action_depth times
+   const uint32_t depth = chain.control->get_global_properties().configuration.max_inline_action_depth;
+   uint32_t nonce = 0;
+   bench::run( "inline_chain_depth_" + std::to_string( depth ), trxs_per_sample, [&]() {
+      vector<signed_transaction> trxs;
+      for( uint32_t i = 0; i < trxs_per_sample; ++i ) {
+         // the contract only reads the depth, the nonce after it makes the transactions unique
+         action act( { { N(inlinechain), config::active_name } }, N(inlinechain), N(recurse), fc::raw::pack( std::make_pair( depth, ++nonce ) ) );
+         trxs.emplace_back( make_trx( chain, std::move( act ), N(inlinechain) ) );
+      }
+      const auto elapsed = push_all( chain, trxs );
+      chain.produce_block();
+      return elapsed;
+   } );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(deferred) try {
+   tester chain;
+   chain.create_accounts( { N(alice), N(deferred) } );
+   chain.set_code( N(deferred), contracts::deferred_test_wasm() );
+   chain.set_abi( N(deferred), contracts::deferred_test_abi().data() );
+   chain.produce_block();
+
+   // the tester bills every deferred transaction DEFAULT_BILLED_CPU_TIME_US, they have to fit in one block
+   constexpr uint32_t deferred_per_sample = 50;
+   uint64_t sender_id = 0;
+   auto schedule = [&]() {
+      vector<signed_transaction> trxs;
+      for( uint32_t i = 0; i < deferred_per_sample; ++i ) {
+         trxs.emplace_back( make_trx( chain, chain.get_action( N(deferred), N(defercall), { { N(alice), config::active_name } }, mvo()
+            ( "payer", "alice" )
+            ( "sender_id", ++sender_id )
+            ( "contract", "deferred" )
+            ( "payload", 0 )
+         ), N(alice) ) );
+      }
+      return push_all( chain, trxs );
+   };
+
+   bench::run( "deferred_schedule", deferred_per_sample, [&]() {
+      const auto elapsed = schedule();
+      chain.produce_block();
+      return elapsed;
+   } );
+
+   // without a delay they are due in the block scheduling them, and executed when the tester produces it
+   bench::run( "deferred_execute", deferred_per_sample, [&]() {
+      schedule();
+      const auto start = fc::time_point::now();
+      chain.produce_block();
+      return bench::since( start );
+   } );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(block_validation) try {
+   validating_tester chain;
+   const auto holders = make_accounts( "holder", 100 );
+   setup_token( chain, holders );
+
+   bench::run( "block_validation", trxs_per_sample, [&]() {
+      auto trxs = make_transfers( chain, holders, trxs_per_sample );
+      push_all( chain, trxs );
+      auto block = chain.produce_block_no_validation();
+      const auto start = fc::time_point::now();
+      chain.validate_push_block( block );
+      return bench::since( start );
+   } );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(snapshot) try {
+   tester chain;
+   const auto holders = make_accounts( "holder", 500 );
+   setup_token( chain, holders );
+   chain.control->abort_block();
+
+   std::string snapshot;
+   bench::run( "snapshot_write", 1, [&]() {
+      std::ostringstream out;
+      const auto start = fc::time_point::now();
+      auto writer = std::make_shared<ostream_snapshot_writer>( out );
+      chain.control->write_snapshot( writer );
+      writer->finalize();
+      const auto elapsed = bench::since( start );
+      snapshot = out.str();
+      return elapsed;
+   } );
+
+   uint32_t ordinal = 0;
+   bench::run( "snapshot_read", 1, [&]() {
+      std::istringstream in( snapshot );
+      auto reader = std::make_shared<istream_snapshot_reader>( in );
+      const auto start = fc::time_point::now();
+      fc::microseconds elapsed;
+      {
+         snapshot_tester restored( chain.get_config(), reader, ++ordinal );
+         elapsed = bench::since( start );
+         BOOST_REQUIRE_EQUAL( restored.control->head_block_id(), chain.control->head_block_id() );
+      }
+      const auto& cfg = chain.get_config();
+      fc::remove_all( cfg.blocks_dir.parent_path() / std::to_string(ordinal).append(cfg.blocks_dir.filename().generic_string()) );
+      fc::remove_all( cfg.state_dir.parent_path() / std::to_string(ordinal).append(cfg.state_dir.filename().generic_string()) );
+      return elapsed;
+   } );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(fork_switch) try {
+   tester a;
+   a.create_accounts( { N(dan), N(sam), N(pam) } );
+   a.produce_block();
+   a.set_producers( { N(dan), N(sam), N(pam) } );
+
+   tester b( setup_policy::none );
+   constexpr uint32_t depth = 3;
+
+   // dan's blocks on a, then sam's one longer fork on b pushed to a
+   bench::run( "fork_switch_depth_" + std::to_string( depth ), 1, [&]() {
+      BOOST_REQUIRE( produce_empty_blocks_until( a, N(pam), N(dan) ) );
+      push_blocks( a, b );
+      const auto fork_num = a.control->head_block_num() + 1;
+
+      for( uint32_t i = 0; i < depth; ++i )
+         a.produce_block();
+      b.produce_block( fc::milliseconds( config::block_interval_ms * (config::producer_repetitions + 1) ) );
+      for( uint32_t i = 0; i < depth; ++i )
+         b.produce_block();
+
+      const auto start = fc::time_point::now();
+      for( auto n = fork_num; n <= b.control->head_block_num(); ++n )
+         a.push_block( b.control->fetch_block_by_number( n ) );
+      const auto elapsed = bench::since( start );
+      BOOST_REQUIRE_EQUAL( a.control->head_block_id(), b.control->head_block_id() );
+      return elapsed;
+   } );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(name_conversion) try {
+   constexpr uint64_t count = 100000;
+   vector<name> names;
+   names.reserve( count );
+   for( const auto& n : make_accounts( "user", count ) )
+      names.push_back( n );
+   vector<string> strings;
+   strings.reserve( count );
+   for( const auto& n : names )
+      strings.push_back( n.to_string() );
+
+   size_t chars = 0;
+   bench::run( "name_to_string_legacy", count, [&]() {
+      const auto start = fc::time_point::now();
+      for( const auto& n : names )
+         chars += legacy_name_to_string( n.value ).size();
+      return bench::since( start );
+   } );
+   bench::run( "name_to_string", count, [&]() {
+      const auto start = fc::time_point::now();
+      for( const auto& n : names )
+         chars += n.to_string().size();
+      return bench::since( start );
+   } );
+   bench::run( "names_to_strings", count, [&]() {
+      const auto start = fc::time_point::now();
+      chars += names_to_strings( names.data(), names.size() ).size();
+      return bench::since( start );
+   } );
+   uint64_t sum = 0;
+   bench::run( "string_to_name", count, [&]() {
+      const auto start = fc::time_point::now();
+      for( const auto& s : strings )
+         sum += name( s ).value;
+      return bench::since( start );
+   } );
+   BOOST_REQUIRE( chars > 0 && sum > 0 );
+
+   abi_def abi;
+   abi.version = "eosio::abi/1.1";
+   abi.structs.push_back( struct_def{ "names", "", { { "names", "name[]" } } } );
+   abi_serializer abis( abi, fc::seconds( 10 ) );
+   const auto bin = fc::raw::pack( names );
+   bench::run( "abi_name_array_to_json", count, [&]() {
+      const auto start = fc::time_point::now();
+      const auto json = abis.binary_to_json( "names", bin, fc::seconds( 10 ) );
+      const auto elapsed = bench::since( start );
+      BOOST_REQUIRE( !json.empty() );
+      return elapsed;
+   } );
+} FC_LOG_AND_RETHROW()
+
+// rows inserted in random order, so that consecutive rows of the index are not next to each other in memory
+BOOST_AUTO_TEST_CASE(table_scan) try {
+   constexpr uint64_t count = 200000;
+   tester chain;
+   auto& db = chain.control->mutable_db();
+   const auto& t = db.create<table_id_object>( []( auto& t ) {
+      t.code  = N(scan);
+      t.scope = N(scan);
+      t.table = N(rows);
+      t.payer = N(scan);
+   } );
+   vector<uint64_t> keys( count );
+   for( uint64_t i = 0; i < count; ++i )
+      keys[i] = i;
+   std::shuffle( keys.begin(), keys.end(), std::mt19937_64( 1 ) );
+   const string value( 64, 'v' );
+   for( auto k : keys ) {
+      db.create<key_value_object>( [&]( auto& o ) {
+         o.t_id        = t.id;
+         o.primary_key = k;
+         o.payer       = N(scan);
+         o.value.assign( value.data(), value.size() );
+      } );
+   }
+
+   const auto& idx = db.get_index<key_value_index, by_scope_primary>();
+   const auto lower = idx.lower_bound( boost::make_tuple( t.id ) );
+   const auto upper = idx.upper_bound( boost::make_tuple( t.id ) );
+   uint64_t sum = 0;
+   bench::run( "table_scan", count, [&]() {
+      const auto start = fc::time_point::now();
+      for( auto itr = lower; itr != upper; ++itr )
+         sum += itr->primary_key + uint8_t( itr->value.data()[itr->value.size() - 1] );
+      return bench::since( start );
+   } );
+   bench::run( "table_scan_prefetch", count, [&]() {
+      const auto start = fc::time_point::now();
+      auto ahead = make_scan_prefetcher( lower, upper );
+      for( auto itr = lower; itr != upper; ++itr, ahead.advance() )
+         sum += itr->primary_key + uint8_t( itr->value.data()[itr->value.size() - 1] );
+      return bench::since( start );
+   } );
+   BOOST_REQUIRE( sum > 0 );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
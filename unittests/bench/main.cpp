@@ -0,0 +1,130 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+
+/// Runs the controller benchmarks and writes their results as JSON:
+///
+///   cd build/
+///   ./unittests/bench/chain_bench -- --repetitions 20 --json chain_bench.json
+///
+/// The WASM benchmarks also instantiate the `<name>.wasm` contracts of `--corpus <dir>`.
+/// A single benchmark is selected with the usual Boost.Test filter, e.g. `-t chain_bench/token_transfer`.
+
+#include "bench.hpp"
+
+#include <eosio/chain/exceptions.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/log/logger.hpp>
+
+#include <boost/test/included/unit_test.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+namespace eosio { namespace bench {
+
+   options& get_options() {
+      static options opts;
+      return opts;
+   }
+
+   static std::vector<result>& results() {
+      static std::vector<result> r;
+      return r;
+   }
+
+   fc::variant_object result::summary()const {
+      auto sorted = samples;
+      std::sort( sorted.begin(), sorted.end() );
+      auto percentile = [&]( double p ) {
+         if( sorted.empty() ) return 0.0;
+         // nearest rank
+         const size_t rank = std::max<size_t>( std::ceil( p / 100 * sorted.size() ), 1 );
+         return sorted[rank - 1];
+      };
+
+      double mean = 0;
+      for( auto s : sorted ) mean += s;
+      if( !sorted.empty() ) mean /= sorted.size();
+      double variance = 0;
+      for( auto s : sorted ) variance += (s - mean) * (s - mean);
+      if( sorted.size() > 1 ) variance /= sorted.size() - 1;
+
+      return fc::mutable_variant_object()
+         ( "name", name )
+         ( "ops_per_sample", ops_per_sample )
+         ( "samples", sorted.size() )
+         ( "unit", unit )
+         ( "min", sorted.empty() ? 0.0 : sorted.front() )
+         ( "max", sorted.empty() ? 0.0 : sorted.back() )
+         ( "mean", mean )
+         ( "stddev", std::sqrt( variance ) )
+         ( "p50", percentile( 50 ) )
+         ( "p90", percentile( 90 ) )
+         ( "p99", percentile( 99 ) )
+         ( "ops_per_sec", unit == "us/op" && mean > 0 ? 1e6 / mean : 0.0 );
+   }
+
+   void record( result&& r ) {
+      results().emplace_back( std::move( r ) );
+   }
+
+   void write_results() {
+      const auto& opts = get_options();
+      std::vector<fc::variant> benchmarks;
+      for( const auto& r : results() )
+         benchmarks.emplace_back( r.summary() );
+
+      const auto json = fc::json::to_pretty_string( fc::mutable_variant_object()
+         ( "warmup", opts.warmup )
+         ( "repetitions", opts.repetitions )
+         ( "benchmarks", benchmarks )
+      );
+      if( opts.json_path.empty() ) {
+         std::cout << json << std::endl;
+      } else {
+         std::ofstream out( opts.json_path, std::ios::out | std::ios::trunc );
+         out << json << std::endl;
+      }
+   }
+
+} } // namespace eosio::bench
+
+void translate_fc_exception(const fc::exception &e) {
+   std::cerr << "\033[33m" <<  e.to_detail_string() << "\033[0m" << std::endl;
+   BOOST_TEST_FAIL("Caught Unexpected Exception");
+}
+
+boost::unit_test::test_suite* init_unit_test_suite(int argc, char* argv[]) {
+   using namespace eosio::bench;
+
+   auto& opts = get_options();
+   bool is_verbose = false;
+   for( int i = 0; i < argc; ++i ) {
+      const std::string arg = argv[i];
+      if( arg == "--verbose" ) {
+         is_verbose = true;
+      } else if( i + 1 < argc && arg == "--warmup" ) {
+         opts.warmup = std::stoul( argv[++i] );
+      } else if( i + 1 < argc && arg == "--repetitions" ) {
+         opts.repetitions = std::max<uint32_t>( std::stoul( argv[++i] ), 1 );
+      } else if( i + 1 < argc && arg == "--json" ) {
+         opts.json_path = argv[++i];
+      } else if( i + 1 < argc && arg == "--corpus" ) {
+         opts.corpus_dir = argv[++i];
+      }
+   }
+   fc::logger::get(DEFAULT_LOGGER).set_log_level( is_verbose ? fc::log_level::debug : fc::log_level::off );
+
+   boost::unit_test::unit_test_monitor.register_exception_translator<fc::exception>(&translate_fc_exception);
+
+   // constructed before the exit handler is registered, so destroyed after it ran
+   results();
+   std::atexit( write_results );
+   return nullptr;
+}
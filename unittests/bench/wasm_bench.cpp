@@ -0,0 +1,213 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include "bench.hpp"
+
+#include <eosio/testing/tester.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <contracts.hpp>
+
+#include <fstream>
+
+using namespace eosio;
+using namespace eosio::chain;
+using namespace eosio::testing;
+using mvo = fc::mutable_variant_object;
+
+namespace {
+
+   /// applied between two instantiations of a contract, so that each one misses the cache
+   const char* evictor_wast = R"=====(
+(module
+ (export "apply" (func $apply))
+ (func $apply (param $receiver i64) (param $account i64) (param $action i64))
+)
+)=====";
+
+   /**
+    * A tester running its contracts with `vm`, whatever the command line selects.
+    * Its cache keeps a single instantiated module, so the instantiation of a contract applied after another one is
+    * timed and its size is the whole cache.
+    */
+   class runtime_tester : public tester {
+   public:
+      explicit runtime_tester( wasm_interface::vm_type vm ) {
+         close();
+         cfg.wasm_runtime    = vm;
+         cfg.wasm_cache_size = 1;
+         open( nullptr );
+         control->wasm_cache_accessed.connect( [this]( const wasm_interface::cache_access& a ) {
+            if( !a.hit ) last_miss = a;
+         } );
+      }
+
+      optional<wasm_interface::cache_access> last_miss;
+   };
+
+   /// a contract of the corpus, with the actions executed when it has an ABI
+   struct corpus_contract {
+      std::string     name;
+      vector<uint8_t> wasm;
+      vector<char>    abi;
+      std::function<vector<action>(base_tester&, account_name, uint32_t)> make_actions; ///< `count` actions
+   };
+
+   vector<corpus_contract> load_corpus() {
+      vector<corpus_contract> corpus = {
+         { "eosio.bios",   contracts::eosio_bios_wasm(),   {}, nullptr },
+         { "eosio.msig",   contracts::eosio_msig_wasm(),   {}, nullptr },
+         { "eosio.system", contracts::eosio_system_wasm(), {}, nullptr },
+         { "eosio.wrap",   contracts::eosio_wrap_wasm(),   {}, nullptr },
+         { "eosio.token",  contracts::eosio_token_wasm(),  contracts::eosio_token_abi(),
+           []( base_tester& chain, account_name contract, uint32_t count ) {
+              static uint32_t nonce = 0;
+              vector<action> acts;
+              for( uint32_t i = 0; i < count; ++i, ++nonce ) {
+                 acts.emplace_back( chain.get_action( contract, N(transfer), { { contract, config::active_name } }, mvo()
+                    ( "from", contract )
+                    ( "to", nonce % 2 ? "alice" : "bob" )
+                    ( "quantity", "0.0001 TKN" )
+                    ( "memo", std::to_string( nonce ) )
+                 ) );
+              }
+              return acts;
+           } },
+         { "noop",         contracts::noop_wasm(),         contracts::noop_abi(),
+           []( base_tester& chain, account_name contract, uint32_t count ) {
+              static uint32_t nonce = 0;
+              vector<action> acts;
+              for( uint32_t i = 0; i < count; ++i, ++nonce ) {
+                 acts.emplace_back( chain.get_action( contract, N(anyaction), { { contract, config::active_name } }, mvo()
+                    ( "from", contract )
+                    ( "type", "bench" )
+                    ( "data", std::to_string( nonce ) )
+                 ) );
+              }
+              return acts;
+           } },
+         { "snapshot_test", contracts::snapshot_test_wasm(), contracts::snapshot_test_abi(),
+           []( base_tester& chain, account_name contract, uint32_t count ) {
+              static uint32_t value = 0;
+              vector<action> acts;
+              for( uint32_t i = 0; i < count; ++i ) {
+                 acts.emplace_back( chain.get_action( contract, N(increment), { { contract, config::active_name } }, mvo()
+                    ( "value", ++value )
+                 ) );
+              }
+              return acts;
+           } },
+         { "asserter",             contracts::asserter_wasm(),             {}, nullptr },
+         { "deferred_test",        contracts::deferred_test_wasm(),        {}, nullptr },
+         { "proxy",                contracts::proxy_wasm(),                {}, nullptr },
+         { "rsa",                  contracts::rsa_wasm(),                  {}, nullptr },
+         { "test_api",             contracts::test_api_wasm(),             {}, nullptr },
+         { "test_api_db",          contracts::test_api_db_wasm(),          {}, nullptr },
+         { "test_api_multi_index", contracts::test_api_multi_index_wasm(), {}, nullptr },
+         { "test_ram_limit",       contracts::test_ram_limit_wasm(),       {}, nullptr },
+      };
+
+      const auto& dir = bench::get_options().corpus_dir;
+      if( !dir.empty() ) {
+         for( const auto& entry : boost::filesystem::directory_iterator( dir ) ) {
+            if( entry.path().extension() != ".wasm" ) continue;
+            std::ifstream in( entry.path().string(), std::ios::binary );
+            corpus.push_back( { entry.path().stem().string(),
+                                vector<uint8_t>( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() ),
+                                {}, nullptr } );
+         }
+      }
+      return corpus;
+   }
+
+   void push( runtime_tester& chain, vector<action>&& acts, account_name signer ) {
+      signed_transaction trx;
+      trx.actions = std::move( acts );
+      chain.set_transaction_headers( trx );
+      trx.sign( chain.get_private_key( signer, "active" ), chain.control->get_chain_id() );
+      chain.push_transaction( trx, fc::time_point::maximum(), 100 );
+   }
+
+   /// pushes an action the contract does not know: its module is instantiated before it rejects or ignores it
+   void touch( runtime_tester& chain, account_name contract ) {
+      static uint32_t nonce = 0;
+      try {
+         push( chain, { action( { { contract, config::active_name } }, contract, N(benchmark), fc::raw::pack( ++nonce ) ) }, contract );
+      } catch( const fc::exception& ) {
+      }
+   }
+
+   /// instantiation time and module size of every contract, then its actions if it has any
+   void run_corpus( wasm_interface::vm_type vm ) {
+      const std::string prefix = std::string( "wasm/" ) + fc::reflector<wasm_interface::vm_type>::to_string( vm ) + "/";
+      runtime_tester chain( vm );
+      chain.create_accounts( { N(evictor), N(alice), N(bob) } );
+      chain.set_code( N(evictor), evictor_wast );
+
+      uint32_t ordinal = 0;
+      for( const auto& c : load_corpus() ) {
+         const account_name contract( std::string( "corpus" ) + "abcdefghijklmnopqrstuvwxyz"[ordinal / 26 % 26] + "abcdefghijklmnopqrstuvwxyz"[ordinal % 26] );
+         ++ordinal;
+         chain.create_accounts( { contract } );
+         try {
+            chain.set_code( contract, c.wasm );
+         } catch( const fc::exception& e ) {
+            wlog( "skipping ${c}, it cannot be deployed: ${e}", ("c", c.name)("e", e.to_string()) );
+            continue;
+         }
+         if( !c.abi.empty() )
+            chain.set_abi( contract, c.abi.data() );
+         chain.produce_block();
+
+         bench::run( prefix + c.name + "/instantiate", 1, [&]() {
+            touch( chain, N(evictor) );
+            chain.last_miss.reset();
+            touch( chain, contract );
+            BOOST_REQUIRE( chain.last_miss );
+            return chain.last_miss->instantiation_time;
+         } );
+         // the cache holds this module alone after the miss
+         bench::record( { prefix + c.name + "/module_bytes", 1, { double( chain.last_miss->cached_bytes ) }, "bytes" } );
+         chain.produce_block();
+
+         if( !c.make_actions ) continue;
+         if( c.name == "eosio.token" ) {
+            chain.push_action( contract, N(create), contract, mvo()( "issuer", contract )( "maximum_supply", "1000000000.0000 TKN" ) );
+            chain.push_action( contract, N(issue), contract, mvo()( "to", contract )( "quantity", "1000000000.0000 TKN" )( "memo", "" ) );
+         }
+
+         // a transaction per action, its execution alone is timed from the trace
+         const uint32_t actions_per_sample = 100;
+         bench::run( prefix + c.name + "/" + c.make_actions( chain, contract, 1 ).front().name.to_string(), actions_per_sample, [&]() {
+            fc::microseconds elapsed;
+            auto c_conn = chain.control->applied_transaction.connect(
+               [&]( std::tuple<const transaction_trace_ptr&, const signed_transaction&> t ) {
+                  for( const auto& at : std::get<0>( t )->action_traces ) {
+                     if( at.receiver == contract ) elapsed += at.elapsed;
+                  }
+               } );
+            for( auto& act : c.make_actions( chain, contract, actions_per_sample ) )
+               push( chain, { std::move( act ) }, contract );
+            c_conn.disconnect();
+            chain.produce_block();
+            return elapsed;
+         } );
+      }
+   }
+
+}
+
+BOOST_AUTO_TEST_SUITE(wasm_bench)
+
+BOOST_AUTO_TEST_CASE(wabt) try {
+   run_corpus( wasm_interface::vm_type::wabt );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(wavm) try {
+   run_corpus( wasm_interface::vm_type::wavm );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,9 @@
  */
 #include <boost/test/unit_test.hpp>
 #include <eosio/testing/tester.hpp>
+#include <eosio/producer_plugin/prestarted_block.hpp>
+
+#include <fstream>
 
 using namespace eosio;
 using namespace testing;
@@ -198,4 +201,238 @@ BOOST_AUTO_TEST_CASE(broadcasted_block_test)
 
 }
 
+BOOST_AUTO_TEST_CASE(block_log_trim_and_extract_test)
+{
+   fc::temp_directory temp;
+   const auto log_dir = temp.path() / "blocks";
+   {
+      tester main;
+      main.create_account(N(newacc));
+      main.produce_blocks(30);
+      const auto blocks_dir = main.get_config().blocks_dir;
+      main.close();
+      fc::create_directories(log_dir);
+      fc::copy(blocks_dir / "blocks.log", log_dir / "blocks.log");
+      fc::copy(blocks_dir / "blocks.index", log_dir / "blocks.index");
+   }
+
+   vector<block_id_type> ids;
+   {
+      block_log log(log_dir);
+      for( uint32_t n = 1; n <= log.head()->block_num(); ++n )
+         ids.push_back(log.read_block_by_num(n)->id());
+   }
+   BOOST_REQUIRE(ids.size() > 20);
+
+   auto check_log = [&](const fc::path& dir, uint32_t first, uint32_t last) {
+      block_log log(dir);
+      BOOST_CHECK_EQUAL(log.first_block_num(), first);
+      BOOST_REQUIRE(log.head());
+      BOOST_CHECK_EQUAL(log.head()->block_num(), last);
+      BOOST_CHECK(!log.read_block_by_num(first - 1));
+      for( uint32_t n = first; n <= last; ++n ) {
+         auto b = log.read_block_by_num(n);
+         BOOST_REQUIRE(b);
+         BOOST_CHECK_EQUAL(b->id(), ids[n - 1]);
+      }
+   };
+
+   block_log::extract_blocks(log_dir, temp.path() / "extracted", 5, 15);
+   check_log(temp.path() / "extracted", 5, 15);
+
+   block_log::trim_front(log_dir, 10);
+   check_log(log_dir, 10, ids.size());
+   block_log::trim_end(log_dir, 20);
+   check_log(log_dir, 10, 20);
+   BOOST_CHECK_THROW(block_log::extract_blocks(log_dir, temp.path() / "out", 5, 15), block_log_exception);
+}
+
+BOOST_AUTO_TEST_CASE(block_log_buffered_writes_test)
+{
+   fc::temp_directory temp;
+   const auto log_dir = temp.path() / "blocks";
+   {
+      tester main;
+      main.produce_blocks(40);
+      const auto blocks_dir = main.get_config().blocks_dir;
+      main.close();
+      fc::create_directories(log_dir);
+      fc::copy(blocks_dir / "blocks.log", log_dir / "blocks.log");
+      fc::copy(blocks_dir / "blocks.index", log_dir / "blocks.index");
+   }
+
+   vector<signed_block_ptr> blocks;
+   {
+      block_log log(log_dir);
+      for( uint32_t n = 1; n <= log.head()->block_num(); ++n )
+         blocks.push_back(log.read_block_by_num(n));
+   }
+
+   // a buffer smaller than a page and fsyncs on a few blocks and on commit
+   const auto copy_dir = temp.path() / "copy";
+   block_log_write_config writes;
+   writes.buffer_size = 700;
+   writes.fsync_blocks = 7;
+   writes.fsync_on_commit = true;
+   {
+      block_log log(copy_dir, block_log_segment_config(), writes);
+      log.reset(block_log::extract_genesis_state(log_dir), blocks[0]);
+      for( size_t i = 1; i < blocks.size(); ++i ) {
+         log.append(blocks[i]);
+         if( i % 5 == 0 ) {
+            log.commit();
+            // reads see the buffered blocks
+            BOOST_CHECK_EQUAL(log.read_block_by_num(i + 1)->id(), blocks[i]->id());
+            BOOST_CHECK_EQUAL(log.read_head()->id(), blocks[i]->id());
+         }
+      }
+   }
+
+   block_log log(copy_dir);
+   BOOST_REQUIRE(log.head());
+   BOOST_CHECK_EQUAL(log.head()->id(), blocks.back()->id());
+   for( uint32_t n = 1; n <= blocks.size(); ++n )
+      BOOST_CHECK_EQUAL(log.read_block_by_num(n)->id(), blocks[n - 1]->id());
+   BOOST_CHECK(fc::file_size(copy_dir / "blocks.log") == fc::file_size(log_dir / "blocks.log"));
+   BOOST_CHECK(fc::file_size(copy_dir / "blocks.index") == fc::file_size(log_dir / "blocks.index"));
+}
+
+BOOST_AUTO_TEST_CASE(replay_timing_test)
+{
+   fc::temp_directory temp;
+   controller::config cfg;
+   {
+      tester main;
+      main.create_account(N(newacc));
+      main.produce_blocks(30);
+      cfg = main.get_config();
+      main.close();
+      const auto blocks_dir = temp.path() / "blocks";
+      fc::create_directories(blocks_dir);
+      fc::copy(cfg.blocks_dir / "blocks.log", blocks_dir / "blocks.log");
+      fc::copy(cfg.blocks_dir / "blocks.index", blocks_dir / "blocks.index");
+      cfg.blocks_dir = blocks_dir;
+      cfg.state_dir = temp.path() / "state";
+   }
+   cfg.replay_timing_file = temp.path() / "replay.csv";
+   cfg.replay_max_blocks = 10;
+
+   tester replayed(cfg);
+   BOOST_CHECK_EQUAL(replayed.control->head_block_num(), 11u);
+   replayed.close();
+
+   std::ifstream csv(cfg.replay_timing_file.generic_string());
+   std::string line;
+   std::getline(csv, line);
+   BOOST_CHECK_EQUAL(line, "block_num,transactions,apply_us,billed_cpu_us,net_bytes,ram_delta");
+   uint32_t expected_num = 2;
+   while (std::getline(csv, line)) {
+      BOOST_CHECK_EQUAL(line.substr(0, line.find(',')), std::to_string(expected_num));
+      BOOST_CHECK_EQUAL(std::count(line.begin(), line.end(), ','), 5);
+      ++expected_num;
+   }
+   BOOST_CHECK_EQUAL(expected_num, 12u);
+}
+
+BOOST_AUTO_TEST_CASE(startup_timeline_test)
+{
+   fc::temp_directory temp;
+   controller::config cfg;
+   {
+      tester main;
+      main.produce_blocks(10);
+      cfg = main.get_config();
+      main.close();
+      const auto blocks_dir = temp.path() / "blocks";
+      fc::create_directories(blocks_dir);
+      fc::copy(cfg.blocks_dir / "blocks.log", blocks_dir / "blocks.log");
+      fc::copy(cfg.blocks_dir / "blocks.index", blocks_dir / "blocks.index");
+      cfg.blocks_dir = blocks_dir;
+      cfg.state_dir = temp.path() / "state";
+   }
+
+   tester replayed(cfg);
+   vector<std::string> names;
+   for (const auto& p : replayed.control->startup_timeline()) {
+      BOOST_CHECK(p.duration.count() >= 0);
+      names.push_back(p.name);
+   }
+   const vector<std::string> expected = { "fork_db_open", "genesis_initialize", "irreversible_replay",
+                                          "reversible_replay", "integrity_hash", "controller_startup" };
+   BOOST_CHECK_EQUAL_COLLECTIONS(names.begin(), names.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(block_state_compact_test)
+{
+   tester main;
+   main.create_account(N(alice));
+   main.produce_block();
+   auto bsp = main.control->head_block_state();
+   const auto trxs = bsp->trxs;
+   BOOST_REQUIRE(!trxs.empty());
+
+   bsp->compact();
+   BOOST_CHECK(bsp->is_compact());
+   BOOST_CHECK(bsp->trxs.empty());
+
+   const auto& rebuilt = bsp->get_trxs();
+   BOOST_CHECK(!bsp->is_compact());
+   BOOST_REQUIRE_EQUAL(rebuilt.size(), trxs.size());
+   for (size_t i = 0; i < trxs.size(); ++i)
+      BOOST_CHECK_EQUAL(rebuilt[i]->id, trxs[i]->id);
+}
+
+
+// a finality checkpoint does not cover the producer signature, a checkpointed block with a forged one is rejected
+BOOST_AUTO_TEST_CASE(checkpointed_block_forged_signature_test)
+{
+   tester main;
+   main.create_account(N(alice));
+   auto b = main.produce_block();
+
+   auto copy_b = std::make_shared<signed_block>(b->clone());
+   copy_b->producer_signature = main.get_private_key(N(alice), "active").sign(digest_type::hash(std::string("forged")));
+   BOOST_REQUIRE(copy_b->id() == b->id());
+
+   tester validator;
+   validator.control->add_finality_checkpoint(copy_b->id());
+   validator.control->prefetch_blocks({copy_b});
+   auto bs = validator.control->create_block_state_future(copy_b);
+   validator.control->abort_block();
+   BOOST_REQUIRE_EXCEPTION(validator.control->push_block(bs), wrong_signing_key,
+   [] (const fc::exception &e)->bool {
+      return e.code() == wrong_signing_key::code_value;
+   });
+   BOOST_CHECK_EQUAL(validator.control->get_checkpointed_blocks(), 1u);
+   BOOST_CHECK(!validator.control->fetch_block_by_id(b->id()));
+}
+
+
+// a block pre-started by producer_plugin for the next slot is kept for its window, and discarded once the head changes
+BOOST_AUTO_TEST_CASE(prestarted_block_test)
+{
+   tester main;
+   main.produce_block();
+   main.control->abort_block();
+
+   const auto block_time = main.control->head_block_time() + fc::milliseconds(config::block_interval_ms);
+   main.control->start_block( block_time, 0 );
+   const prestarted_block prestarted{ main.control->head_block_id(), block_time, 0 };
+   BOOST_CHECK( prestarted.is_pending( *main.control, block_time, 0 ) );
+   BOOST_CHECK( !prestarted.is_pending( *main.control, block_time, 1 ) );
+   BOOST_CHECK( !prestarted.is_pending( *main.control, block_time + fc::milliseconds(config::block_interval_ms), 0 ) );
+
+   // kept: the transactions of the window go into the pre-started block
+   main.create_account( N(alice) );
+   BOOST_CHECK( prestarted.is_pending( *main.control, block_time, 0 ) );
+   auto b = main.produce_block();
+   BOOST_CHECK( b->timestamp.to_time_point() == block_time );
+   BOOST_CHECK_EQUAL( b->transactions.size(), 1u );
+
+   // discarded: the pending block of the new head is not the pre-started one
+   BOOST_REQUIRE( main.control->is_building_block() );
+   BOOST_CHECK( !prestarted.is_pending( *main.control, main.control->pending_block_time(), 0 ) );
+   BOOST_CHECK( !prestarted.is_pending( *main.control, block_time, 0 ) );
+}
+
 BOOST_AUTO_TEST_SUITE_END()
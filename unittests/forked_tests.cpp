@@ -640,6 +640,125 @@ BOOST_AUTO_TEST_CASE( bft_finalize_switch_fork ) try {
    BOOST_REQUIRE_EQUAL(87u, c.control->head_block_num());
 } FC_LOG_AND_RETHROW()
 
+BOOST_AUTO_TEST_CASE( bft_finalize_switch_fork_redo ) try {
+   tester c;
+   c.produce_blocks(10 - c.control->head_block_num() + 1);
+   c.create_accounts( {N(dan),N(sam),N(pam),N(scott)} );
+   c.set_producers( {N(dan),N(sam),N(pam),N(scott)} );
+   c.produce_blocks(50);
+
+   tester c2;
+   push_blocks(c, c2);
+   BOOST_REQUIRE_EQUAL(61u, c.control->head_block_num());
+   uint32_t fork_num = c.control->head_block_num();
+
+   auto nextproducer = [](tester &c, int skip_interval) ->account_name {
+      auto head_time = c.control->head_block_time();
+      auto next_time = head_time + fc::milliseconds(config::block_interval_ms * skip_interval);
+      return c.control->head_block_state()->get_scheduled_producer(next_time).producer_name;
+   };
+
+   // transactions in the blocks of the fork of c, which are redone when switching back to it
+   c.create_accounts( {N(alice),N(bob)} );
+   int skip1 = 1, skip2 = 1;
+   for (int i = 0; i < 50; ++i) {
+      account_name next1 = nextproducer(c, skip1);
+      if (next1 == N(dan) || next1 == N(sam)) {
+         c.produce_block(fc::milliseconds(config::block_interval_ms * skip1)); skip1 = 1;
+         if (i == 10) c.create_accounts( {N(carol)} );
+      }
+      else ++skip1;
+      account_name next2 = nextproducer(c2, skip2);
+      if (next2 == N(scott)) {
+         c2.produce_block(fc::milliseconds(config::block_interval_ms * skip2)); skip2 = 1;
+      }
+      else ++skip2;
+   }
+   BOOST_REQUIRE_EQUAL(87u, c.control->head_block_num());
+
+   // c validates the same blocks without forking
+   tester c3;
+   push_blocks(c, c3);
+
+   auto block_for_bft_finalize = c.control->fetch_block_by_number(79u);
+   for (uint32_t p = fork_num; p < c2.control->head_block_num(); ) {
+      c.push_block(c2.control->fetch_block_by_number(++p));
+   }
+   BOOST_REQUIRE_EQUAL(73u, c.control->head_block_num());
+
+   uint32_t redone = 0;
+   auto conn = c.control->pipeline_stage_timed.connect([&](const controller::pipeline_stage_timing& t) {
+      if (t.stage == controller::pipeline_stage::block_redo) ++redone;
+   });
+   c.control->bft_finalize(block_for_bft_finalize->id());
+   conn.disconnect();
+
+   BOOST_REQUIRE_EQUAL(87u, c.control->head_block_num());
+   BOOST_REQUIRE_EQUAL(87u - fork_num, redone);
+   BOOST_REQUIRE_EQUAL(c3.control->head_block_id(), c.control->head_block_id());
+   BOOST_REQUIRE_EQUAL(c3.control->calculate_integrity_hash().str(), c.control->calculate_integrity_hash().str());
+   c.control->get_account(N(carol));
+} FC_LOG_AND_RETHROW()
+
+
+BOOST_AUTO_TEST_CASE( bft_finalize_switch_fork_redo_next_id ) try {
+   tester c;
+   c.produce_blocks(10 - c.control->head_block_num() + 1);
+   c.create_accounts( {N(dan),N(sam),N(pam),N(scott)} );
+   c.set_producers( {N(dan),N(sam),N(pam),N(scott)} );
+   c.produce_blocks(50);
+
+   tester c2;
+   push_blocks(c, c2);
+   uint32_t fork_num = c.control->head_block_num();
+
+   auto nextproducer = [](tester &c, int skip_interval) ->account_name {
+      auto head_time = c.control->head_block_time();
+      auto next_time = head_time + fc::milliseconds(config::block_interval_ms * skip_interval);
+      return c.control->head_block_state()->get_scheduled_producer(next_time).producer_name;
+   };
+
+   c.create_accounts( {N(alice)} );
+   int skip1 = 1, skip2 = 1;
+   for (int i = 0; i < 50; ++i) {
+      account_name next1 = nextproducer(c, skip1);
+      if (next1 == N(dan) || next1 == N(sam)) {
+         if (i > 10 && i < 20) {
+            // a permission created then removed by the block: its id is used, the block leaves no row with it
+            c.set_authority( N(alice), N(temp), authority(get_public_key(N(alice), "temp")), N(active) );
+            c.delete_authority( N(alice), N(temp) );
+         }
+         c.produce_block(fc::milliseconds(config::block_interval_ms * skip1)); skip1 = 1;
+      }
+      else ++skip1;
+      account_name next2 = nextproducer(c2, skip2);
+      if (next2 == N(scott)) {
+         c2.produce_block(fc::milliseconds(config::block_interval_ms * skip2)); skip2 = 1;
+      }
+      else ++skip2;
+   }
+
+   tester c3;
+   push_blocks(c, c3);
+
+   auto block_for_bft_finalize = c.control->fetch_block_by_number(79u);
+   for (uint32_t p = fork_num; p < c2.control->head_block_num(); ) {
+      c.push_block(c2.control->fetch_block_by_number(++p));
+   }
+   c.control->bft_finalize(block_for_bft_finalize->id());
+   BOOST_REQUIRE_EQUAL(c3.control->head_block_id(), c.control->head_block_id());
+
+   // the ids created after the switch are the ones of a node that applied the blocks once
+   c.create_accounts( {N(dave)} );
+   c.produce_block();
+   c3.push_block(c.control->fetch_block_by_number(c.control->head_block_num()));
+   const auto& auth = c.control->get_authorization_manager();
+   const auto& auth3 = c3.control->get_authorization_manager();
+   BOOST_REQUIRE_EQUAL(auth3.get_permission({N(dave), config::owner_name}).id._id,
+                       auth.get_permission({N(dave), config::owner_name}).id._id);
+   BOOST_REQUIRE_EQUAL(c3.control->calculate_integrity_hash().str(), c.control->calculate_integrity_hash().str());
+} FC_LOG_AND_RETHROW()
+
 
 BOOST_AUTO_TEST_CASE( bft_finalize_dont_switch_fork ) try {
    tester c;
@@ -701,6 +820,55 @@ BOOST_AUTO_TEST_CASE( bft_finalize_dont_switch_fork ) try {
    BOOST_REQUIRE_EQUAL(73u, c.control->fork_db().head()->block_num);
    BOOST_REQUIRE_EQUAL(73u, c.control->head_block_num());
 } FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( bft_finalize_along_branch ) try {
+   tester c;
+   c.produce_blocks(10 - c.control->head_block_num() + 1);
+   auto r = c.create_accounts( {N(dan),N(sam),N(pam),N(scott)} );
+   auto res = c.set_producers( {N(dan),N(sam),N(pam),N(scott)} );
+   c.produce_blocks(50);
+
+   const uint32_t head_num = c.control->head_block_num();
+   BOOST_REQUIRE_LT(c.control->last_irreversible_block_num(), head_num - 10);
+
+   // finality moves forward along the branch, then an older block is finalized late
+   c.control->bft_finalize(c.control->fetch_block_by_number(head_num - 10)->id());
+   BOOST_REQUIRE_EQUAL(head_num - 10, c.control->fork_db().head()->bft_irreversible_blocknum);
+   c.control->bft_finalize(c.control->fetch_block_by_number(head_num - 5)->id());
+   BOOST_REQUIRE_EQUAL(head_num - 5, c.control->fork_db().head()->bft_irreversible_blocknum);
+   c.control->bft_finalize(c.control->fetch_block_by_number(head_num - 8)->id());
+   BOOST_REQUIRE_EQUAL(head_num - 5, c.control->fork_db().head()->bft_irreversible_blocknum);
+
+   // blocks built on top inherit the bft irreversible block
+   c.produce_block();
+   BOOST_REQUIRE_EQUAL(head_num - 5, c.control->fork_db().head()->bft_irreversible_blocknum);
+   BOOST_REQUIRE_EQUAL(head_num - 5, c.control->last_irreversible_block_num());
+} FC_LOG_AND_RETHROW()
 ///@}
 
+BOOST_AUTO_TEST_CASE( fork_db_reset_journal ) try {
+   tester c;
+   c.produce_blocks(3);
+   const auto root = c.control->head_block_state();
+
+   fc::temp_directory dir;
+   const auto no_validation = []( block_timestamp_type, const flat_set<digest_type>&, const vector<digest_type>& ) {};
+   {
+      // a new fork database, the journal is open without a root
+      fork_database fdb( dir.path() );
+      fdb.open( no_validation );
+      BOOST_REQUIRE( !fdb.root() );
+      fdb.reset( *root );
+      BOOST_REQUIRE_EQUAL( fdb.root()->id, root->id );
+      BOOST_REQUIRE_EQUAL( fdb.head()->id, root->id );
+   }
+
+   // the root reset to is the one in the journal
+   fork_database fdb( dir.path() );
+   fdb.open( no_validation );
+   BOOST_REQUIRE( fdb.root() );
+   BOOST_REQUIRE_EQUAL( fdb.root()->id, root->id );
+   BOOST_REQUIRE_EQUAL( fdb.head()->id, root->id );
+} FC_LOG_AND_RETHROW()
+
 BOOST_AUTO_TEST_SUITE_END()
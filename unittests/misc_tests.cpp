@@ -3,19 +3,35 @@
  *  @copyright defined in eos/LICENSE
  */
 #include <eosio/chain/asset.hpp>
+#include <eosio/chain/async_log.hpp>
 #include <eosio/chain/authority.hpp>
 #include <eosio/chain/authority_checker.hpp>
 #include <eosio/chain/chain_config.hpp>
+#include <eosio/chain/list_filter.hpp>
+#include <eosio/chain/merkle.hpp>
+#include <eosio/chain/numa_placement.hpp>
+#include <eosio/chain/reversible_block_object.hpp>
+#include <eosio/chain/signature_recovery_cache.hpp>
+#include <eosio/chain/state_window.hpp>
+#include <eosio/chain/subjective_account_tracker.hpp>
+#include <eosio/chain/table_scan.hpp>
 #include <eosio/chain/types.hpp>
 #include <eosio/chain/thread_utils.hpp>
+#include <eosio/chain/transaction_arena.hpp>
+#include <eosio/chain/webassembly/common.hpp>
 #include <eosio/testing/tester.hpp>
 
+#include <fc/filesystem.hpp>
 #include <fc/io/json.hpp>
 #include <fc/log/logger_config.hpp>
 #include <appbase/execution_priority_queue.hpp>
 
 #include <boost/test/unit_test.hpp>
 
+#include <fstream>
+#include <limits>
+#include <thread>
+
 #ifdef NON_VALIDATING_TEST
 #define TESTER tester
 #else
@@ -138,6 +154,36 @@ BOOST_AUTO_TEST_CASE(name_suffix_tests)
    BOOST_CHECK_EQUAL( name{name_suffix(N(abcdefhij.123))}, name{N(123)} );
 }
 
+BOOST_AUTO_TEST_CASE(name_string_tests) try {
+   BOOST_CHECK_EQUAL( name().to_string(), "" );
+   BOOST_CHECK_EQUAL( name(N(eosio.token)).to_string(), "eosio.token" );
+   BOOST_CHECK_EQUAL( name(N(abcdefghijklj)).to_string(), "abcdefghijklj" );
+   BOOST_CHECK_EQUAL( name(N(.a.b)).to_string(), ".a.b" );
+   BOOST_CHECK_EQUAL( name(std::numeric_limits<uint64_t>::max()).to_string(), "zzzzzzzzzzzzj" );
+
+   // every value is the name of its string
+   boost::random::mt19937_64 rng( 42 );
+   for( int i = 0; i < 10000; ++i ) {
+      const uint64_t v = rng() & ( ~0ull << ( rng() % 64 ) );
+      BOOST_CHECK_EQUAL( name( name(v).to_string() ).value, v );
+   }
+
+   BOOST_CHECK_THROW( name( "abc." ), name_type_exception );
+   BOOST_CHECK_THROW( name( "Abc" ), name_type_exception );
+   BOOST_CHECK_THROW( name( "a6" ), name_type_exception );
+   BOOST_CHECK_THROW( name( "abcdefghijklz" ), name_type_exception ); // 13th char is only 4 bits
+   BOOST_CHECK_THROW( name( "abcdefghijklmn" ), name_type_exception );
+
+   const vector<name> names{ N(alice), name(), N(eosio.token), N(abcdefghijklj) };
+   BOOST_CHECK( names_to_strings( names.data(), names.size() ) == vector<string>( { "alice", "", "eosio.token", "abcdefghijklj" } ) );
+
+   BOOST_CHECK( symbol( 4, "EOS" ).valid() );
+   BOOST_CHECK_EQUAL( symbol( 4, "EOS" ).name(), "EOS" );
+   BOOST_CHECK( !symbol::valid_code( uint64_t('E') | uint64_t('O') << 16 ) ); // embedded zero byte
+   BOOST_CHECK( !symbol::valid_code( uint64_t('e') ) );
+   BOOST_CHECK( symbol::valid_code( 0 ) );
+} FC_LOG_AND_RETHROW()
+
 /// Test processing of unbalanced strings
 BOOST_AUTO_TEST_CASE(json_from_string_test)
 {
@@ -582,6 +628,41 @@ BOOST_AUTO_TEST_CASE(authority_checker)
    }
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE(authority_checker_single_key)
+{ try {
+   testing::TESTER test;
+   auto a = test.get_public_key("a", "active");
+   auto b = test.get_public_key("b", "active");
+   auto c = test.get_public_key("c", "active");
+
+   auto GetNullAuthority = [](auto){abort(); return authority();};
+
+   {
+      auto checker = make_auth_checker(GetNullAuthority, 2, {a, b, c});
+      BOOST_TEST(checker.satisfied(authority(1, {key_weight{b, 1}})));
+      BOOST_TEST(checker.used_keys().size() == 1u);
+      BOOST_TEST(checker.used_keys().count(b) == 1u);
+      BOOST_TEST(!checker.satisfied(authority(2, {key_weight{c, 1}})));
+      BOOST_TEST(checker.used_keys().count(c) == 0u);
+      BOOST_TEST(checker.satisfied(authority(2, {key_weight{c, 2}})));
+      BOOST_TEST(checker.used_keys().count(c) == 1u);
+   }
+   {
+      auto checker = make_auth_checker(GetNullAuthority, 2, {a, c});
+      BOOST_TEST(!checker.satisfied(authority(1, {key_weight{b, 1}})));
+      BOOST_TEST(checker.used_keys().size() == 0u);
+   }
+   {
+      // a permission with a single key, satisfied through the account permission of an authority
+      auto GetAuthority = [&](const permission_level&) { return authority(1, {key_weight{a, 1}}); };
+      auto B = authority(1, {}, {permission_level_weight{{"alice", "active"}, 1}});
+      auto checker = make_auth_checker(GetAuthority, 2, {a, b});
+      BOOST_TEST(checker.satisfied(B));
+      BOOST_TEST(checker.used_keys().size() == 1u);
+      BOOST_TEST(checker.unused_keys().count(b) == 1u);
+   }
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE(alphabetic_sort)
 { try {
 
@@ -737,6 +818,12 @@ BOOST_AUTO_TEST_CASE(transaction_test) { try {
    BOOST_CHECK_EQUAL(true, std::equal(raw.begin(), raw.end(), raw4.begin()));
    BOOST_CHECK_EQUAL(pkt.get_signed_transaction().id(), pkt3.get_signed_transaction().id());
    BOOST_CHECK_EQUAL(pkt.get_signed_transaction().id(), pkt4.get_signed_transaction().id());
+
+   // the ids and raw bytes cached by an unpacked compressed transaction
+   packed_transaction pkt6 = fc::raw::unpack<packed_transaction>(fc::raw::pack(pkt2));
+   BOOST_CHECK_EQUAL(pkt2.id(), pkt6.id());
+   BOOST_CHECK_EQUAL(pkt4.id(), pkt6.id());
+   BOOST_CHECK(pkt2.get_raw_transaction() == pkt6.get_raw_transaction());
    BOOST_CHECK_EQUAL(pkt.get_signed_transaction().id(), pkt5.get_signed_transaction().id()); // failure indicates reflector_init not working
    BOOST_CHECK_EQUAL(pkt.id(), pkt4.get_signed_transaction().id());
    BOOST_CHECK_EQUAL(true, trx.expiration == pkt4.expiration());
@@ -826,20 +913,21 @@ BOOST_AUTO_TEST_CASE(transaction_metadata_test) { try {
       BOOST_CHECK_EQUAL(trx.id(), mtrx->id);
       BOOST_CHECK_EQUAL(trx.id(), mtrx2->id);
 
-      named_thread_pool thread_pool( "misc", 5 );
+      task_scheduler scheduler( "misc", 5 );
+      task_executor thread_pool( scheduler, task_priority::net );
 
       BOOST_CHECK( !mtrx->signing_keys_future.valid() );
       BOOST_CHECK( !mtrx2->signing_keys_future.valid() );
 
-      transaction_metadata::start_recover_keys( mtrx, thread_pool.get_executor(), test.control->get_chain_id(), fc::microseconds::maximum() );
-      transaction_metadata::start_recover_keys( mtrx2, thread_pool.get_executor(), test.control->get_chain_id(), fc::microseconds::maximum() );
+      transaction_metadata::start_recover_keys( mtrx, thread_pool, test.control->get_chain_id(), fc::microseconds::maximum() );
+      transaction_metadata::start_recover_keys( mtrx2, thread_pool, test.control->get_chain_id(), fc::microseconds::maximum() );
 
       BOOST_CHECK( mtrx->signing_keys_future.valid() );
       BOOST_CHECK( mtrx2->signing_keys_future.valid() );
 
       // no-op
-      transaction_metadata::start_recover_keys( mtrx, thread_pool.get_executor(), test.control->get_chain_id(), fc::microseconds::maximum() );
-      transaction_metadata::start_recover_keys( mtrx2, thread_pool.get_executor(), test.control->get_chain_id(), fc::microseconds::maximum() );
+      transaction_metadata::start_recover_keys( mtrx, thread_pool, test.control->get_chain_id(), fc::microseconds::maximum() );
+      transaction_metadata::start_recover_keys( mtrx2, thread_pool, test.control->get_chain_id(), fc::microseconds::maximum() );
 
       auto keys = mtrx->recover_keys( test.control->get_chain_id() );
       BOOST_CHECK_EQUAL(1u, keys.second.size());
@@ -1121,6 +1209,422 @@ BOOST_AUTO_TEST_CASE(stable_priority_queue_test) {
 }
 
 
+BOOST_AUTO_TEST_CASE(merkle_accumulator_test) { try {
+   merkle_accumulator acc;
+   vector<digest_type> digests;
+   BOOST_CHECK_EQUAL( merkle( digests ), acc.get_root() );
+   for( uint32_t i = 0; i < 300; ++i ) {
+      digests.emplace_back( digest_type::hash( i ) );
+      acc.append( digests.back() );
+      BOOST_CHECK_EQUAL( merkle( digests ), acc.get_root() );
+   }
+   BOOST_CHECK_EQUAL( acc.size(), digests.size() );
+
+   acc.reset();
+   BOOST_CHECK_EQUAL( digest_type(), acc.get_root() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(hash_canonical_pairs_test) { try {
+   vector<digest_type> nodes;
+   for( uint32_t i = 0; i < 2 * 40; ++i )
+      nodes.emplace_back( digest_type::hash( i ) );
+   // batches of several pairs and the pairs left over
+   for( size_t pairs = 0; pairs <= 40; ++pairs ) {
+      vector<digest_type> out( pairs );
+      hash_canonical_pairs( nodes.data(), pairs, out.data() );
+      auto in_place = nodes;
+      hash_canonical_pairs( in_place.data(), pairs, in_place.data() );
+      for( size_t i = 0; i < pairs; ++i ) {
+         const auto expected = digest_type::hash( make_canonical_pair( nodes[2 * i], nodes[2 * i + 1] ) );
+         BOOST_CHECK_EQUAL( out[i], expected );
+         BOOST_CHECK_EQUAL( in_place[i], expected );
+         BOOST_CHECK_EQUAL( hash_canonical_pair( nodes[2 * i], nodes[2 * i + 1] ), expected );
+      }
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(reversible_block_cache_test) { try {
+   const auto id_of = []( uint32_t num, uint64_t fork = 0 ) {
+      block_id_type id;
+      id._hash[0] = fc::endian_reverse_u32( num );
+      id._hash[1] = fork;
+      return id;
+   };
+   reversible_block_cache cache( 25 );
+   vector<signed_block_ptr> blocks;
+   for( uint32_t num = 1; num <= 3; ++num ) {
+      blocks.push_back( std::make_shared<signed_block>() );
+      cache.add( id_of( num ), blocks.back(), 10 );
+   }
+   // the lowest block went over the bound
+   BOOST_CHECK( !cache.find( 1 ) );
+   BOOST_REQUIRE( cache.find( 2 ) );
+   BOOST_CHECK( cache.find( 2 )->block == blocks[1] );
+   BOOST_CHECK_EQUAL( cache.find( 3 )->id, id_of( 3 ) );
+   BOOST_CHECK_EQUAL( cache.bytes(), 20u );
+
+   // a fork switch replaces the block of a number
+   auto other = std::make_shared<signed_block>();
+   cache.add( id_of( 3, 1 ), other, 5 );
+   BOOST_CHECK( cache.find( 3 )->block == other );
+   BOOST_CHECK_EQUAL( cache.bytes(), 15u );
+
+   cache.add( id_of( 4 ), std::make_shared<signed_block>(), 100 ); // larger than the cache
+   BOOST_CHECK( !cache.find( 4 ) );
+
+   cache.remove_through( 2 );
+   BOOST_CHECK( !cache.find( 2 ) );
+   BOOST_CHECK_EQUAL( cache.size(), 1u );
+   cache.remove( 3 );
+   BOOST_CHECK_EQUAL( cache.size(), 0u );
+   BOOST_CHECK_EQUAL( cache.bytes(), 0u );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(aligned_array_copy_test) { try {
+   // fits in the inline storage and needs the heap
+   for( size_t length : { size_t(0), size_t(3), size_t(1000) } ) {
+      std::vector<char> memory( length * sizeof(uint64_t) + 1 );
+      char* misaligned = memory.data() + 1;
+      for( size_t i = 0; i < length; ++i ) {
+         uint64_t v = i * 3;
+         memcpy( misaligned + i * sizeof(v), &v, sizeof(v) );
+      }
+
+      aligned_array_copy<uint64_t> copy( misaligned, length );
+      BOOST_CHECK_EQUAL( reinterpret_cast<uintptr_t>(copy.data()) % alignof(uint64_t), 0u );
+      for( size_t i = 0; i < length; ++i ) {
+         BOOST_CHECK_EQUAL( copy.data()[i], i * 3 );
+         copy.data()[i] += 1;
+      }
+      copy.copy_back( misaligned );
+      for( size_t i = 0; i < length; ++i ) {
+         uint64_t v = 0;
+         memcpy( &v, misaligned + i * sizeof(v), sizeof(v) );
+         BOOST_CHECK_EQUAL( v, i * 3 + 1 );
+      }
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(transaction_arena_test) { try {
+   transaction_arena arena( 64 );
+   std::map<int, int, std::less<int>, arena_allocator<std::pair<const int, int>>> m( arena_allocator<std::pair<const int, int>>(arena) );
+   std::vector<uint64_t, arena_allocator<uint64_t>> v( arena_allocator<uint64_t>(arena) );
+   // outgrows the first block, larger blocks follow
+   for( int i = 0; i < 1000; ++i ) {
+      m[i] = i * 2;
+      v.push_back( i );
+   }
+   for( int i = 0; i < 1000; ++i ) {
+      BOOST_CHECK_EQUAL( m[i], i * 2 );
+      BOOST_CHECK_EQUAL( v[i], uint64_t(i) );
+   }
+   BOOST_CHECK_EQUAL( reinterpret_cast<uintptr_t>(v.data()) % alignof(uint64_t), 0u );
+   BOOST_CHECK_GE( arena.allocations(), 1000u );
+
+   auto big = static_cast<char*>( arena.allocate( 4096, 16 ) );
+   BOOST_CHECK_EQUAL( reinterpret_cast<uintptr_t>(big) % 16, 0u );
+   memset( big, 1, 4096 );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(signature_recovery_cache_test) { try {
+   signature_recovery_cache cache( signature_recovery_cache::shards_count ); // one key per shard
+   auto key = private_key_type::regenerate<fc::ecc::private_key_shim>( fc::sha256::hash( std::string( "recovery" ) ) );
+   const auto digest = fc::sha256::hash( std::string( "digest" ) );
+   const auto other_digest = fc::sha256::hash( std::string( "other digest" ) );
+   const auto sig = key.sign( digest );
+
+   fc::microseconds cpu_usage;
+   BOOST_CHECK( cache.recover( sig, digest, &cpu_usage ) == key.get_public_key() );
+   BOOST_CHECK_EQUAL( cache.stats().misses.load(), 1u );
+   fc::microseconds cached_cpu_usage;
+   BOOST_CHECK( cache.recover( sig, digest, &cached_cpu_usage ) == key.get_public_key() );
+   BOOST_CHECK_EQUAL( cache.stats().hits.load(), 1u );
+   BOOST_CHECK_EQUAL( cached_cpu_usage.count(), cpu_usage.count() );
+
+   // the same signature over another digest is another key
+   BOOST_CHECK( cache.recover( sig, other_digest ) != key.get_public_key() );
+   BOOST_CHECK_EQUAL( cache.stats().misses.load(), 2u );
+
+   // evicted by the keys recovered after it in its shard
+   for( int i = 0; i < 256; ++i ) {
+      const auto d = fc::sha256::hash( std::to_string( i ) );
+      cache.recover( key.sign( d ), d );
+   }
+   const auto misses = cache.stats().misses.load();
+   cache.recover( sig, digest );
+   BOOST_CHECK_EQUAL( cache.stats().misses.load(), misses + 1 );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(numa_placement_test) { try {
+   BOOST_CHECK( numa_placement::from_string( "default" ).policy == numa_placement::policy_type::none );
+   BOOST_CHECK( numa_placement::from_string( "interleave" ).policy == numa_placement::policy_type::interleave );
+   const auto bind = numa_placement::from_string( "bind:1" );
+   BOOST_CHECK( bind.policy == numa_placement::policy_type::bind );
+   BOOST_CHECK_EQUAL( bind.node, 1u );
+   BOOST_CHECK_THROW( numa_placement::from_string( "bind:x" ), plugin_config_exception );
+   BOOST_CHECK_THROW( numa_placement::from_string( "local" ), plugin_config_exception );
+
+   fc::temp_directory dir;
+   const auto file = dir.path() / "data.bin";
+   {
+      std::ofstream out( file.generic_string(), std::ios::binary );
+      const std::vector<char> data( 3 * 1024 * 1024 + 17, 'x' );
+      out.write( data.data(), data.size() );
+   }
+   BOOST_CHECK_EQUAL( prefault_file( file, 4 ), 3u * 1024 * 1024 + 17 );
+   BOOST_CHECK_EQUAL( prefault_file( dir.path() / "missing.bin", 4 ), 0u );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(state_window_test) { try {
+   fc::temp_directory dir;
+   const auto file = dir.path() / "state_window.bin";
+   BOOST_CHECK_THROW( state_window( file, false ), database_exception );
+
+   state_window writer( file, true );
+   state_window reader( file, false );
+   BOOST_CHECK( !reader.read( []() {}, fc::milliseconds( 1 ) ) );
+
+   std::atomic<bool> done{ false };
+   std::thread replica( [&]() {
+      BOOST_CHECK( reader.read( [&]() { done = true; }, fc::seconds( 10 ) ) );
+   } );
+   while( writer.waiting_readers() == 0 )
+      std::this_thread::yield();
+   writer.open_window( fc::time_point::now() + fc::seconds( 10 ), 42 );
+   BOOST_CHECK_EQUAL( writer.close_window( fc::time_point::now() + fc::seconds( 10 ) ), 0u );
+   replica.join();
+   BOOST_CHECK( done );
+   BOOST_CHECK_EQUAL( reader.head_block_num(), 42u );
+   BOOST_CHECK_EQUAL( writer.waiting_readers(), 0u );
+
+   // a closed window is not entered
+   BOOST_CHECK( !reader.read( []() {}, fc::milliseconds( 1 ) ) );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(async_log_test) { try {
+   auto logger = fc::logger::get( "async_log_test" );
+   logger.set_log_level( fc::log_level::debug );
+   async_log log;
+
+   // logged in place before it starts
+   log.log( logger, FC_LOG_MESSAGE( debug, "before ${n}", ("n", 0) ) );
+   BOOST_CHECK_EQUAL( log.stats().queued.load(), 0u );
+
+   log.start( 4 );
+   BOOST_REQUIRE( log.running() );
+   constexpr uint32_t threads = 4, messages = 1000;
+   std::vector<std::thread> loggers;
+   for( uint32_t t = 0; t < threads; ++t ) {
+      loggers.emplace_back( [&, t]() {
+         for( uint32_t i = 0; i < messages; ++i )
+            log.log( logger, FC_LOG_MESSAGE( debug, "thread ${t} message ${i}", ("t", t)("i", i) ) );
+      } );
+   }
+   for( auto& t : loggers )
+      t.join();
+   log.flush();
+   const auto& stats = log.stats();
+   BOOST_CHECK_EQUAL( stats.queued.load() + stats.dropped.load(), threads * messages );
+   BOOST_CHECK_EQUAL( stats.written.load(), stats.queued.load() );
+   BOOST_CHECK_EQUAL( log.backlog(), 0u );
+   BOOST_CHECK_LE( stats.max_backlog.load(), 5u ); // the queue and the message being written
+
+   log.log( logger, FC_LOG_MESSAGE( debug, "last" ) );
+   log.stop();
+   BOOST_CHECK( !log.running() );
+   BOOST_CHECK_EQUAL( stats.written.load(), stats.queued.load() );
+   const auto queued = stats.queued.load();
+   log.log( logger, FC_LOG_MESSAGE( debug, "after" ) );
+   BOOST_CHECK_EQUAL( stats.queued.load(), queued );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(task_scheduler_test) { try {
+   task_scheduler scheduler( "sched", 1 );
+   task_executor history( scheduler, task_priority::history );
+   task_executor api( scheduler, task_priority::api );
+   task_executor block_apply( scheduler, task_priority::block_apply );
+
+   // the only worker is held while tasks of every class are queued
+   std::promise<void> release;
+   auto held = release.get_future().share();
+   auto holding = async_thread_pool( history, [held]() { held.wait(); } );
+   std::mutex mtx;
+   std::vector<task_priority> order;
+   std::vector<std::future<void>> done;
+   for( const auto* ex : { &history, &api, &block_apply, &api } ) {
+      done.emplace_back( async_thread_pool( *ex, [&mtx, &order, p = ex->priority()]() {
+         std::lock_guard<std::mutex> g( mtx );
+         order.push_back( p );
+      } ) );
+   }
+   release.set_value();
+   holding.get();
+   for( auto& f : done )
+      f.get();
+   const std::vector<task_priority> expected{ task_priority::block_apply, task_priority::api, task_priority::api, task_priority::history };
+   BOOST_CHECK( order == expected );
+
+   const auto stats = scheduler.stats();
+   BOOST_REQUIRE_EQUAL( stats.size(), task_priority_count );
+   // executed is counted once the future is ready
+   BOOST_CHECK_EQUAL( stats[size_t( task_priority::history )].submitted, 2u );
+   BOOST_CHECK_EQUAL( stats[size_t( task_priority::api )].submitted, 2u );
+   BOOST_CHECK_EQUAL( stats[size_t( task_priority::block_apply )].submitted, 1u );
+   BOOST_CHECK_EQUAL( stats[size_t( task_priority::net )].submitted, 0u );
+
+   // tasks queued on another worker are stolen
+   scheduler.add_workers( "sched2", 3 );
+   BOOST_CHECK_EQUAL( scheduler.workers(), 4u );
+   std::atomic<uint32_t> ran{0};
+   std::vector<std::future<void>> spread;
+   for( int i = 0; i < 64; ++i )
+      spread.emplace_back( async_thread_pool( api, [&ran]() { ++ran; } ) );
+   for( auto& f : spread )
+      f.get();
+   BOOST_CHECK_EQUAL( ran.load(), 64u );
+
+   // cancelled executors drop their queued tasks, other executors still run
+   std::promise<void> release2;
+   auto held2 = release2.get_future().share();
+   std::vector<std::future<void>> holders;
+   for( size_t i = 0; i < scheduler.workers(); ++i )
+      holders.emplace_back( async_thread_pool( block_apply, [held2]() { held2.wait(); } ) );
+   auto dropped = async_thread_pool( history, []() {} );
+   auto kept = async_thread_pool( api, []() {} );
+   history.cancel();
+   release2.set_value();
+   for( auto& f : holders )
+      f.get();
+   kept.get();
+   BOOST_CHECK_THROW( dropped.get(), std::future_error );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(subjective_account_tracker_test) { try {
+   subjective_account_tracker tracker;
+   tracker.set_decay_window( fc::seconds( 10 ) );
+   const auto start = fc::time_point::now();
+
+   // disabled, failures are accounted
+   tracker.on_failed( N(spammer), 5000, start );
+   BOOST_CHECK( tracker.may_execute( N(spammer), start ) );
+   BOOST_CHECK_EQUAL( tracker.failed_cpu_us( N(spammer), start ), 5000u );
+
+   tracker.set_max_failed_cpu_us( 10000 );
+   tracker.on_failed( N(spammer), 5000, start );
+   BOOST_CHECK( !tracker.may_execute( N(spammer), start ) );
+   BOOST_CHECK( tracker.may_execute( N(alice), start ) );
+
+   // decays linearly over the window
+   BOOST_CHECK_EQUAL( tracker.failed_cpu_us( N(spammer), start + fc::seconds( 5 ) ), 5000u );
+   BOOST_CHECK( tracker.may_execute( N(spammer), start + fc::seconds( 5 ) ) );
+   BOOST_CHECK_EQUAL( tracker.failed_cpu_us( N(spammer), start + fc::seconds( 10 ) ), 0u );
+
+   // greylisted accounts get greylist_limit / 1000 of the budget
+   tracker.set_greylist_limit( 100 );
+   tracker.set_greylisted( N(grey), true );
+   BOOST_CHECK( tracker.is_greylisted( N(grey) ) );
+   tracker.on_failed( N(grey), 1000, start );
+   BOOST_CHECK( !tracker.may_execute( N(grey), start ) );
+   tracker.set_greylisted( N(grey), false );
+   BOOST_CHECK( tracker.may_execute( N(grey), start ) );
+
+   tracker.set_greylisted( N(kept), true );
+   BOOST_CHECK_EQUAL( tracker.size(), 3u );
+   tracker.prune( start + fc::seconds( 10 ) );
+   BOOST_CHECK_EQUAL( tracker.size(), 1u );
+   BOOST_CHECK( tracker.is_greylisted( N(kept) ) );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(list_filter_test) { try {
+   list_filter filter;
+   BOOST_CHECK( !filter.may_contain( N(alice) ) );
+
+   flat_set<account_name> accounts;
+   for( uint64_t i = 0; i < 1000; ++i ) accounts.insert( account_name( i * 16 ) );
+   filter.reset( accounts );
+   for( const auto& a : accounts ) BOOST_CHECK( filter.may_contain( a ) );
+   uint32_t false_positives = 0;
+   for( uint64_t i = 0; i < 1000; ++i ) false_positives += filter.may_contain( account_name( i * 16 + 1 ) );
+   BOOST_CHECK_LT( false_positives, 50u );
+
+   flat_set< pair<account_name, action_name> > actions{ { N(eosio.token), N(transfer) } };
+   filter.reset( actions );
+   BOOST_CHECK( filter.may_contain( std::make_pair( N(eosio.token), N(transfer) ) ) );
+
+   const auto key = private_key_type::regenerate<fc::ecc::private_key_shim>( fc::sha256::hash( std::string( "blacklisted" ) ) ).get_public_key();
+   filter.reset( flat_set<public_key_type>{ key } );
+   BOOST_CHECK( filter.may_contain( key ) );
+
+   filter.reset( flat_set<account_name>() );
+   BOOST_CHECK( !filter.may_contain( N(alice) ) );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(scan_prefetcher_test) { try {
+   tester chain;
+   auto& db = chain.control->mutable_db();
+   const auto& t = db.create<table_id_object>( []( auto& t ) {
+      t.code  = N(scan);
+      t.scope = N(scan);
+      t.table = N(rows);
+   } );
+   for( uint64_t k : { 7, 3, 11, 1, 5, 9 } ) {
+      db.create<key_value_object>( [&]( auto& o ) {
+         o.t_id        = t.id;
+         o.primary_key = k;
+         if( k % 2 ) o.value.assign( "row", 3 ); // rows without value are prefetched too
+      } );
+   }
+   const auto& idx = db.get_index<key_value_index, by_scope_primary>();
+   const auto lower = idx.lower_bound( boost::make_tuple( t.id ) );
+   const auto upper = idx.upper_bound( boost::make_tuple( t.id ) );
+
+   auto scan = [&]( auto begin, auto end, uint32_t distance ) {
+      vector<uint64_t> keys;
+      auto ahead = make_scan_prefetcher( begin, end, distance );
+      for( auto itr = begin; itr != end; ++itr, ahead.advance() )
+         keys.push_back( itr->primary_key );
+      ahead.advance(); // past the end of the scan
+      return keys;
+   };
+   const vector<uint64_t> forward{ 1, 3, 5, 7, 9, 11 };
+   for( uint32_t distance : { 0, 1, 4, 100 } ) {
+      BOOST_REQUIRE( scan( lower, upper, distance ) == forward );
+      BOOST_REQUIRE( scan( boost::make_reverse_iterator( upper ), boost::make_reverse_iterator( lower ), distance )
+                     == vector<uint64_t>( forward.rbegin(), forward.rend() ) );
+   }
+   BOOST_REQUIRE( scan( upper, upper, 4 ).empty() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(read_only_transaction) { try {
+   TESTER chain;
+
+   signed_transaction trx;
+   trx.actions.emplace_back( vector<permission_level>{{config::system_account_name, config::active_name}},
+                             newaccount{
+                                .creator  = config::system_account_name,
+                                .name     = N(readonly),
+                                .owner    = authority( chain.get_public_key( N(readonly), "owner" ) ),
+                                .active   = authority( chain.get_public_key( N(readonly), "active" ) ),
+                             });
+   chain.set_transaction_headers( trx );
+   auto mtrx = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( trx, packed_transaction::none ) );
+
+   // not signed, executed without writing the state
+   auto trace = chain.control->push_read_only_transaction( mtrx, fc::time_point::now() + fc::milliseconds( 100 ) );
+   BOOST_REQUIRE( trace->except );
+   BOOST_CHECK_EQUAL( trace->except->code(), read_only_write_exception::code_value );
+   BOOST_CHECK( chain.control->db().find<account_object, by_name>( N(readonly) ) == nullptr );
+
+   chain.set_transaction_headers( trx, base_tester::DEFAULT_EXPIRATION_DELTA, 1 );
+   mtrx = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( trx, packed_transaction::none ) );
+   trace = chain.control->push_read_only_transaction( mtrx, fc::time_point::now() + fc::milliseconds( 100 ) );
+   BOOST_REQUIRE( trace->except );
+   BOOST_CHECK_EQUAL( trace->except->code(), transaction_exception::code_value );
+
+   chain.produce_block();
+   BOOST_CHECK( chain.control->db().find<account_object, by_name>( N(readonly) ) == nullptr );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } // namespace eosio
@@ -41,7 +41,7 @@ BOOST_AUTO_TEST_SUITE(producer_schedule_tests)
    // However, it won't be applied until the effective block num is deemed irreversible
    uint64_t calc_block_num_of_next_round_first_block(const controller& control){
       auto res = control.head_block_num() + 1;
-      const auto blocks_per_round = control.head_block_state()->active_schedule.producers.size() * config::producer_repetitions;
+      const auto blocks_per_round = control.head_block_state()->active_schedule->producers.size() * config::producer_repetitions;
       while((res % blocks_per_round) != 0) {
          res++;
       }
@@ -54,7 +54,7 @@ BOOST_AUTO_TEST_SUITE(producer_schedule_tests)
       const auto& confirm_schedule_correctness = [&](const vector<producer_key>& new_prod_schd, const uint64_t eff_new_prod_schd_block_num)  {
          const uint32_t check_duration = 1000; // number of blocks
          for (uint32_t i = 0; i < check_duration; ++i) {
-            const auto current_schedule = control->head_block_state()->active_schedule.producers;
+            const auto current_schedule = control->head_block_state()->active_schedule->producers;
             const auto& current_absolute_slot = control->get_global_properties().proposed_schedule_block_num;
             // Determine expected producer
             const auto& expected_producer = get_expected_producer(current_schedule, *current_absolute_slot + 1);
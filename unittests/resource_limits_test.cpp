@@ -285,6 +285,18 @@ BOOST_AUTO_TEST_SUITE(resource_limits_test)
 
    } FC_LOG_AND_RETHROW();
 
+   BOOST_FIXTURE_TEST_CASE(verify_pending_ram_usage_bounds, resource_limits_fixture) try {
+      const account_name account(1);
+      initialize_account(account);
+      add_pending_ram_usage(account, 100);
+
+      verify_pending_ram_usage(account, 50, -150);
+      BOOST_REQUIRE_THROW(verify_pending_ram_usage(account, 50, -151), transaction_exception);
+      verify_pending_ram_usage(account, UINT64_MAX - 200, 100);
+      BOOST_REQUIRE_THROW(verify_pending_ram_usage(account, UINT64_MAX - 200, 101), transaction_exception);
+      BOOST_REQUIRE_EQUAL(get_account_ram_usage(account), 100);
+   } FC_LOG_AND_RETHROW();
+
    BOOST_FIXTURE_TEST_CASE(enforce_account_ram_commitment, resource_limits_fixture) try {
       const int64_t limit = 1000;
       const int64_t commit = 600;
@@ -16,6 +16,8 @@
 #include <fc/io/json.hpp>
 #include <fc/crypto/sha256.hpp>
 
+#include <eosio/chain/rsa.hpp>
+
 #include <openssl/rsa.h>
 #include <openssl/pem.h>
 #include <openssl/bio.h>
@@ -184,4 +186,28 @@ BOOST_FIXTURE_TEST_CASE( long_message, rsa_tester ) {
     );
 }
 
+BOOST_FIXTURE_TEST_CASE( public_key_cache, rsa_tester ) {
+    auto keys = new_keys();
+    auto keys2 = new_keys();
+    auto digest = fc::sha256::hash(std::string("I'm message"));
+    auto signature = fc::base64_decode(sign(keys, digest));
+
+    fc::rsa_public_key_cache cache(2);
+    auto key = cache.get(pem_pubkey(keys));
+    BOOST_REQUIRE(*key);
+    BOOST_CHECK(key->verify(digest, signature));
+    BOOST_CHECK(cache.get(pem_pubkey(keys)) == key);
+
+    auto invalid = cache.get("invalid");
+    BOOST_CHECK(!*invalid);
+    BOOST_CHECK_EQUAL(cache.size(), 2u);
+
+    // the least recently used key is dropped
+    cache.get(pem_pubkey(keys));
+    BOOST_CHECK(!cache.get(pem_pubkey(keys2))->verify(digest, signature));
+    BOOST_CHECK_EQUAL(cache.size(), 2u);
+    BOOST_CHECK(cache.get(pem_pubkey(keys)) == key);
+    BOOST_CHECK(cache.get("invalid") != invalid);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
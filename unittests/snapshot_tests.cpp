@@ -2,10 +2,16 @@
  *  @file
  *  @copyright defined in eos/LICENSE
  */
+#include <fstream>
 #include <sstream>
+#include <thread>
 
+#include <eosio/chain/merkle.hpp>
 #include <eosio/chain/snapshot.hpp>
+#include <eosio/chain/snapshot_delta.hpp>
+#include <eosio/chain/snapshot_manifest.hpp>
 #include <eosio/testing/tester.hpp>
+#include <fc/io/fstream.hpp>
 
 #include <boost/mpl/list.hpp>
 #include <boost/test/unit_test.hpp>
@@ -147,9 +153,48 @@ struct buffered_snapshot_suite {
 
 };
 
+template<bool Compress>
+struct chunked_snapshot_suite_t {
+   using writer_t = chunked_snapshot_writer;
+   using reader_t = mapped_snapshot_reader;
+   using write_storage_t = std::ostringstream;
+   using snapshot_t = std::shared_ptr<fc::temp_file>;
+
+   struct writer : public writer_t {
+      writer( const std::shared_ptr<write_storage_t>& storage )
+      :writer_t(*storage, 4, Compress)
+      ,storage(storage)
+      {
+
+      }
+
+      std::shared_ptr<write_storage_t> storage;
+   };
+
+   static auto get_writer() {
+      return std::make_shared<writer>(std::make_shared<write_storage_t>());
+   }
+
+   static auto finalize(const std::shared_ptr<writer>& w) {
+      w->finalize();
+      auto file = std::make_shared<fc::temp_file>();
+      std::ofstream out(file->path().generic_string(), std::ios::out | std::ios::binary);
+      out << w->storage->str();
+      return file;
+   }
+
+   static auto get_reader( const snapshot_t& file) {
+      return std::make_shared<reader_t>(file->path());
+   }
+
+};
+
+using chunked_snapshot_suite = chunked_snapshot_suite_t<false>;
+using compressed_snapshot_suite = chunked_snapshot_suite_t<true>;
+
 BOOST_AUTO_TEST_SUITE(snapshot_tests)
 
-using snapshot_suites = boost::mpl::list<variant_snapshot_suite, buffered_snapshot_suite>;
+using snapshot_suites = boost::mpl::list<variant_snapshot_suite, buffered_snapshot_suite, chunked_snapshot_suite, compressed_snapshot_suite>;
 
 BOOST_AUTO_TEST_CASE_TEMPLATE(test_exhaustive_snapshot, SNAPSHOT_SUITE, snapshot_suites)
 {
@@ -195,6 +240,169 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_exhaustive_snapshot, SNAPSHOT_SUITE, snapshot
    }
 }
 
+BOOST_AUTO_TEST_CASE(test_tree_integrity_hash)
+{
+   tester chain;
+
+   chain.create_account(N(snapshot));
+   chain.produce_blocks(1);
+   chain.set_code(N(snapshot), contracts::snapshot_test_wasm());
+   chain.set_abi(N(snapshot), contracts::snapshot_test_abi().data());
+   chain.produce_blocks(1);
+   chain.control->abort_block();
+
+   const auto hash = chain.control->calculate_tree_integrity_hash(1);
+   BOOST_REQUIRE_EQUAL(hash.str(), chain.control->calculate_tree_integrity_hash(4).str());
+   BOOST_REQUIRE_NE(hash.str(), chain.control->calculate_integrity_hash().str());
+
+   auto writer = chunked_snapshot_suite::get_writer();
+   chain.control->write_snapshot(writer);
+   snapshotted_tester snap_chain(chain.get_config(), chunked_snapshot_suite::get_reader(chunked_snapshot_suite::finalize(writer)), 1);
+   BOOST_REQUIRE_EQUAL(hash.str(), snap_chain.control->calculate_tree_integrity_hash(2).str());
+
+   chain.push_action(N(snapshot), N(increment), N(snapshot), mutable_variant_object()
+      ( "value", 1 )
+   );
+   chain.produce_block();
+   chain.control->abort_block();
+   BOOST_REQUIRE_NE(hash.str(), chain.control->calculate_tree_integrity_hash(4).str());
+}
+
+BOOST_AUTO_TEST_CASE(test_partial_state_snapshot)
+{
+   tester chain;
+
+   chain.create_accounts({N(snapshot), N(other)});
+   chain.produce_blocks(1);
+   for( auto account : {N(snapshot), N(other)} ) {
+      chain.set_code(account, contracts::snapshot_test_wasm());
+      chain.set_abi(account, contracts::snapshot_test_abi().data());
+   }
+   chain.produce_blocks(1);
+   for( auto account : {N(snapshot), N(other)} ) {
+      chain.push_action(account, N(increment), account, mutable_variant_object()
+         ( "value", 1 )
+      );
+   }
+   chain.produce_block();
+   chain.control->abort_block();
+
+   auto writer = buffered_snapshot_suite::get_writer();
+   chain.control->write_snapshot(writer);
+   auto snapshot = buffered_snapshot_suite::finalize(writer);
+
+   auto config = chain.get_config();
+   config.partial_state_contracts = { N(snapshot) };
+   snapshotted_tester partial(config, buffered_snapshot_suite::get_reader(snapshot), 1);
+
+   auto count_tables = [](const base_tester& t, account_name code) {
+      const auto& tables = t.control->db().get_index<table_id_multi_index, by_code_scope_table>();
+      return std::distance(tables.lower_bound(boost::make_tuple(code)), tables.upper_bound(boost::make_tuple(code)));
+   };
+   BOOST_REQUIRE(count_tables(chain, N(other)) > 0);
+   BOOST_REQUIRE_EQUAL(count_tables(partial, N(other)), 0);
+   BOOST_REQUIRE_EQUAL(count_tables(partial, N(snapshot)), count_tables(chain, N(snapshot)));
+
+   // the partial state serves reads only
+   BOOST_REQUIRE_THROW(partial.produce_block(), unsupported_feature);
+}
+
+BOOST_AUTO_TEST_CASE(test_snapshot_manifest)
+{
+   tester chain;
+   chain.create_account(N(snapshot));
+   chain.produce_blocks(1);
+   chain.control->abort_block();
+
+   auto writer = chunked_snapshot_suite::get_writer();
+   chain.control->write_snapshot(writer);
+   auto file = chunked_snapshot_suite::finalize(writer);
+
+   const uint32_t chunk_size = 4096;
+   const auto manifest = snapshot_manifest::compute(file->path(), chain.control->head_block_id(), chunk_size);
+   BOOST_REQUIRE(manifest.valid());
+   BOOST_REQUIRE_EQUAL(manifest.block_num(), chain.control->head_block_num());
+   BOOST_REQUIRE_EQUAL(manifest.size, fc::file_size(file->path()));
+   BOOST_REQUIRE_GT(manifest.chunk_count(), 1u);
+   BOOST_REQUIRE_EQUAL(manifest.chunk_hashes.size(), manifest.chunk_count());
+
+   std::string content;
+   fc::read_file_contents(file->path(), content);
+   uint64_t total = 0;
+   for( uint32_t i = 0; i < manifest.chunk_count(); ++i ) {
+      const auto length = manifest.chunk_length(i);
+      BOOST_REQUIRE(manifest.verify_chunk(i, content.data() + manifest.chunk_offset(i), length));
+      total += length;
+   }
+   BOOST_REQUIRE_EQUAL(total, manifest.size);
+
+   // a tampered chunk, a truncated chunk and a chunk out of range are rejected
+   content[manifest.chunk_offset(1)] ^= 1;
+   BOOST_REQUIRE(!manifest.verify_chunk(1, content.data() + manifest.chunk_offset(1), manifest.chunk_length(1)));
+   BOOST_REQUIRE(!manifest.verify_chunk(0, content.data(), manifest.chunk_length(0) - 1));
+   BOOST_REQUIRE(!manifest.verify_chunk(manifest.chunk_count(), content.data(), 0));
+
+   // hashes that do not match the root, or a missing hash, invalidate the manifest
+   auto forged = manifest;
+   forged.chunk_hashes[0] = forged.chunk_hashes[1];
+   BOOST_REQUIRE(!forged.valid());
+   forged = manifest;
+   forged.chunk_hashes.pop_back();
+   forged.root = merkle(forged.chunk_hashes);
+   BOOST_REQUIRE(!forged.valid());
+}
+
+BOOST_AUTO_TEST_CASE(test_delta_snapshot)
+{
+   tester chain;
+
+   chain.create_account(N(snapshot));
+   chain.produce_blocks(1);
+   chain.set_code(N(snapshot), contracts::snapshot_test_wasm());
+   chain.set_abi(N(snapshot), contracts::snapshot_test_abi().data());
+   chain.produce_blocks(1);
+   chain.control->abort_block();
+
+   // the base snapshot and its digest
+   auto base_writer = chunked_snapshot_suite::get_writer();
+   chain.control->write_snapshot(base_writer);
+   auto base = chunked_snapshot_suite::finalize(base_writer);
+   auto digest_writer = std::make_shared<digest_snapshot_writer>();
+   chain.control->write_snapshot(digest_writer);
+   snapshot_digest digest = digest_writer->digest();
+
+   const std::vector<account_name> accounts = { N(deltaa), N(deltab), N(deltac) };
+   std::vector<fc::temp_file> deltas(accounts.size());
+   for (size_t i = 0; i < accounts.size(); i++) {
+      chain.create_account(accounts[i]);
+      chain.push_action(N(snapshot), N(increment), N(snapshot), mutable_variant_object()
+         ( "value", 1 )
+      );
+      chain.produce_block();
+      chain.control->abort_block();
+
+      std::ofstream out(deltas[i].path().generic_string(), std::ios::out | std::ios::binary);
+      auto writer = std::make_shared<delta_snapshot_writer>(out, digest);
+      chain.control->write_snapshot(writer);
+      writer->finalize();
+      out.close();
+      BOOST_REQUIRE(delta_snapshot_reader::is_delta_snapshot(deltas[i].path()));
+      BOOST_REQUIRE_LT(fc::file_size(deltas[i].path()), fc::file_size(base->path()));
+      digest = writer->digest();
+   }
+
+   snapshot_reader_ptr reader = chunked_snapshot_suite::get_reader(base);
+   for (const auto& delta : deltas) {
+      reader = std::make_shared<delta_snapshot_reader>(reader, delta.path());
+   }
+   snapshotted_tester snap_chain(chain.get_config(), reader, 1);
+   BOOST_REQUIRE_EQUAL(chain.control->calculate_integrity_hash().str(), snap_chain.control->calculate_integrity_hash().str());
+
+   // a delta applied to another base does not load
+   snapshot_reader_ptr wrong = std::make_shared<delta_snapshot_reader>(chunked_snapshot_suite::get_reader(base), deltas.back().path());
+   BOOST_REQUIRE_THROW(snapshotted_tester(chain.get_config(), wrong, 2), fc::exception);
+}
+
 BOOST_AUTO_TEST_CASE_TEMPLATE(test_replay_over_snapshot, SNAPSHOT_SUITE, snapshot_suites)
 {
    tester chain;
@@ -252,4 +460,39 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_replay_over_snapshot, SNAPSHOT_SUITE, snapsho
    BOOST_REQUIRE_EQUAL(expected_post_integrity_hash.str(), snap_chain.control->calculate_integrity_hash().str());
 }
 
+
+// as with background-snapshots of producer_plugin: serialized in memory at a block boundary, written to the file by
+// another thread while the chain moves on, the snapshot still loads back
+BOOST_AUTO_TEST_CASE(test_background_snapshot_file)
+{
+   for( const auto mode : { pinnable_mapped_file::map_mode::mapped, pinnable_mapped_file::map_mode::heap } ) {
+      auto cfg = validating_tester::default_config();
+      cfg.db_map_mode = mode;
+      tester chain(cfg);
+
+      chain.create_account(N(snapshot));
+      chain.produce_blocks(1);
+      chain.control->abort_block();
+      const auto expected_integrity_hash = chain.control->calculate_integrity_hash();
+
+      auto data = std::make_shared<std::stringstream>(std::ios::in | std::ios::out | std::ios::binary);
+      auto writer = std::make_shared<chunked_snapshot_writer>(*data, 4, false);
+      chain.control->write_snapshot(writer);
+      writer->finalize();
+
+      fc::temp_file file;
+      std::thread file_writer([data, path = file.path()]() {
+         std::ofstream out(path.generic_string(), std::ios::out | std::ios::binary);
+         out << data->rdbuf();
+      });
+      chain.create_account(N(other));
+      chain.produce_blocks(1);
+      file_writer.join();
+
+      snapshotted_tester snap_chain(chain.get_config(), std::make_shared<mapped_snapshot_reader>(file.path()),
+                                    static_cast<int>(mode) + 1);
+      BOOST_REQUIRE_EQUAL(expected_integrity_hash.str(), snap_chain.control->calculate_integrity_hash().str());
+   }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
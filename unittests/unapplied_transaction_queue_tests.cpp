@@ -0,0 +1,73 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/chain/unapplied_transaction_queue.hpp>
+#include <fc/filesystem.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace eosio::chain;
+
+namespace {
+   transaction_metadata_ptr make_trx( uint32_t expiration_sec, uint16_t ref_block_num = 0 ) {
+      signed_transaction trx;
+      trx.expiration = fc::time_point_sec( expiration_sec );
+      trx.ref_block_num = ref_block_num;
+      return std::make_shared<transaction_metadata>( trx );
+   }
+}
+
+BOOST_AUTO_TEST_SUITE(unapplied_transaction_queue_tests)
+
+BOOST_AUTO_TEST_CASE(add_replace_erase) {
+   unapplied_transaction_queue q;
+   auto a = make_trx( 100 );
+   auto b = make_trx( 200 );
+   q.add( a );
+   q.add( b );
+   q.add( make_trx( 100 ) ); // same signed id as a
+   BOOST_CHECK_EQUAL( q.size(), 2u );
+
+   q.erase( a->signed_id );
+   BOOST_REQUIRE_EQUAL( q.size(), 1u );
+   BOOST_CHECK( q.begin()->trx_meta == b );
+
+   auto itr = q.erase( q.begin() );
+   BOOST_CHECK( itr == q.end() );
+   BOOST_CHECK( q.empty() );
+}
+
+BOOST_AUTO_TEST_CASE(clear_expired) {
+   unapplied_transaction_queue q;
+   for( uint16_t i = 0; i < 10; ++i )
+      q.add( make_trx( 100 + i * 10, i ) );
+
+   BOOST_CHECK_EQUAL( q.clear_expired( fc::time_point_sec( 100 ) ), 0u );
+   BOOST_CHECK_EQUAL( q.clear_expired( fc::time_point_sec( 135 ) ), 4u );
+   BOOST_CHECK_EQUAL( q.size(), 6u );
+   for( const auto& ut : q ) {
+      BOOST_CHECK( ut.expiry >= fc::time_point_sec( 135 ) );
+   }
+}
+
+BOOST_AUTO_TEST_CASE(write_read) {
+   fc::temp_directory dir;
+   const auto path = dir.path() / "unapplied-trxs.bin";
+
+   unapplied_transaction_queue q;
+   for( uint16_t i = 0; i < 5; ++i )
+      q.add( make_trx( 100, i ) );
+   q.write_to( path );
+
+   auto trxs = unapplied_transaction_queue::read_from( path );
+   BOOST_REQUIRE_EQUAL( trxs.size(), 5u );
+   auto itr = q.begin();
+   for( const auto& trx : trxs ) {
+      BOOST_CHECK_EQUAL( trx->signed_id, itr->signed_id );
+      BOOST_CHECK( !trx->signing_keys_future.valid() );
+      ++itr;
+   }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
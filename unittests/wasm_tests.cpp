@@ -3,6 +3,7 @@
  *  @copyright defined in eos/LICENSE.txt
  */
 #include <array>
+#include <random>
 #include <utility>
 
 #include <eosio/chain/abi_serializer.hpp>
@@ -11,9 +12,11 @@
 #include <eosio/chain/resource_limits.hpp>
 #include <eosio/chain/wasm_eosio_constraints.hpp>
 #include <eosio/chain/wast_to_wasm.hpp>
+#include <eosio/chain/webassembly/native_float.hpp>
 #include <eosio/testing/tester.hpp>
 
 #include <Runtime/Runtime.h>
+#include <softfloat.hpp>
 
 #include <boost/test/unit_test.hpp>
 #include <boost/algorithm/string/predicate.hpp>
@@ -211,6 +214,85 @@ BOOST_FIXTURE_TEST_CASE( abi_from_variant, TESTER ) try {
 
 } FC_LOG_AND_RETHROW() /// prove_mem_reset
 
+// the hardware path of the float intrinsics gives the bits of softfloat whenever it is taken
+BOOST_AUTO_TEST_CASE( native_float_tests ) try {
+   namespace nf = eosio::chain::webassembly::native_float;
+   std::mt19937_64 rng( 7 );
+
+   std::vector<uint32_t> f32_bits = { 0, 0x80000000, 1, 0x80000001, 0x007fffff, 0x00800000, 0x3f800000, 0xbf800000,
+                                      0x3f7fffff, 0x7f7fffff, 0xff7fffff, 0x7f800000, 0xff800000, 0x7fc00000,
+                                      0xffc00000, 0x7f800001, 0x7fa00000 };
+   std::vector<uint64_t> f64_bits = { 0, 0x8000000000000000ull, 1, 0x8000000000000001ull, 0x000fffffffffffffull,
+                                      0x0010000000000000ull, 0x3ff0000000000000ull, 0xbff0000000000000ull,
+                                      0x7fefffffffffffffull, 0x7ff0000000000000ull, 0xfff0000000000000ull,
+                                      0x7ff8000000000000ull, 0x7ff0000000000001ull, 0x36a0000000000000ull,
+                                      0x47efffffe0000000ull, 0x3690000000000000ull };
+   for( int i = 0; i < 2000; ++i ) {
+      f32_bits.push_back( uint32_t(rng()) );
+      f64_bits.push_back( rng() );
+   }
+
+   auto f32 = []( uint32_t v ) { float f; memcpy( &f, &v, sizeof(f) ); return f; };
+   auto f64 = []( uint64_t v ) { double d; memcpy( &d, &v, sizeof(d) ); return d; };
+   auto bits32 = []( float f ) { uint32_t v; memcpy( &v, &f, sizeof(v) ); return v; };
+   auto bits64 = []( double d ) { uint64_t v; memcpy( &v, &d, sizeof(v) ); return v; };
+   uint64_t native = 0, fallback = 0;
+   auto check32 = [&]( bool taken, float r, float32_t expected ) {
+      if( taken ) {
+         ++native;
+         BOOST_REQUIRE_EQUAL( bits32(r), expected.v );
+      } else {
+         ++fallback;
+#ifdef EOSIO_NATIVE_FLOAT
+         BOOST_REQUIRE( is_nan(expected) );
+#endif
+      }
+   };
+   auto check64 = [&]( bool taken, double r, float64_t expected ) {
+      if( taken ) {
+         ++native;
+         BOOST_REQUIRE_EQUAL( bits64(r), expected.v );
+      } else {
+         ++fallback;
+#ifdef EOSIO_NATIVE_FLOAT
+         BOOST_REQUIRE( is_nan(expected) );
+#endif
+      }
+   };
+
+   for( auto a : f32_bits ) {
+      float r;
+      double d;
+      check32( nf::sqrt( f32(a), r ), r, f32_sqrt( float32_t{a} ) );
+      check64( nf::promote( f32(a), d ), d, f32_to_f64( float32_t{a} ) );
+      for( size_t j = 0; j < f32_bits.size(); j += 7 ) {
+         const auto b = f32_bits[j];
+         check32( nf::add( f32(a), f32(b), r ), r, f32_add( float32_t{a}, float32_t{b} ) );
+         check32( nf::sub( f32(a), f32(b), r ), r, f32_sub( float32_t{a}, float32_t{b} ) );
+         check32( nf::mul( f32(a), f32(b), r ), r, f32_mul( float32_t{a}, float32_t{b} ) );
+         check32( nf::div( f32(a), f32(b), r ), r, f32_div( float32_t{a}, float32_t{b} ) );
+      }
+   }
+   for( auto a : f64_bits ) {
+      double r;
+      float f;
+      check64( nf::sqrt( f64(a), r ), r, f64_sqrt( float64_t{a} ) );
+      check32( nf::demote( f64(a), f ), f, f64_to_f32( float64_t{a} ) );
+      for( size_t j = 0; j < f64_bits.size(); j += 7 ) {
+         const auto b = f64_bits[j];
+         check64( nf::add( f64(a), f64(b), r ), r, f64_add( float64_t{a}, float64_t{b} ) );
+         check64( nf::sub( f64(a), f64(b), r ), r, f64_sub( float64_t{a}, float64_t{b} ) );
+         check64( nf::mul( f64(a), f64(b), r ), r, f64_mul( float64_t{a}, float64_t{b} ) );
+         check64( nf::div( f64(a), f64(b), r ), r, f64_div( float64_t{a}, float64_t{b} ) );
+      }
+   }
+#ifdef EOSIO_NATIVE_FLOAT
+   BOOST_REQUIRE( native > fallback );
+#else
+   BOOST_REQUIRE_EQUAL( native, 0u );
+#endif
+} FC_LOG_AND_RETHROW()
+
 // test softfloat 32 bit operations
 BOOST_FIXTURE_TEST_CASE( f32_tests, TESTER ) try {
    produce_blocks(2);